@@ -52,13 +52,34 @@ AC_DEFUN([INTRINSIC_FLAG_CHECK],
   AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_AVX512F_FLAGS, $INTRINSICFLAGS)])
   AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AVX512F ")
   
-  dnl fixme: We should handle also -mavx512pf  -mavx512er  -mavx512cd  -mavx512vl -mavx512bw  -mavx512dq  -mavx512ifma  -mavx512vbmi - potentially, though its unclear if any of our code would benefit from these
+  dnl AVX-512BW is only used in combination with VAES (512 bit registers holding four independent AES lanes need byte shuffles)
+  INTRINSICFLAGS="-mavx512bw -DCOMPILER_HAS_AVX512BW"
+  CXXFLAGS="-Werror $INTRINSICFLAGS"
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([])], [PASSED=yes], [PASSED=no] )
+  AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_AVX512BW_FLAGS, $INTRINSICFLAGS)])
+  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AVX512BW ")
+
+  dnl fixme: We should handle also -mavx512pf  -mavx512er  -mavx512cd  -mavx512vl  -mavx512dq  -mavx512ifma  -mavx512vbmi - potentially, though its unclear if any of our code would benefit from these
   
   INTRINSICFLAGS="-maes -DCOMPILER_HAS_AES"
   CXXFLAGS="-Werror $INTRINSICFLAGS"
   AC_COMPILE_IFELSE([AC_LANG_PROGRAM([])], [PASSED=yes], [PASSED=no] )
   AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_AES_FLAGS, $INTRINSICFLAGS)])
-  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AES")
+  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_AES ")
+  
+  dnl The SHA extensions come with SSE4.1 (the SHA-256 kernel needs its blend and align instructions)
+  INTRINSICFLAGS="-msse4.1 -msha -DCOMPILER_HAS_SHANI"
+  CXXFLAGS="-Werror $INTRINSICFLAGS"
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([])], [PASSED=yes], [PASSED=no] )
+  AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_SHANI_FLAGS, $INTRINSICFLAGS)])
+  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_SHANI ")
+
+  dnl VAES is only used in combination with AVX2 or AVX-512BW (256/512 bit registers holding two/four independent AES lanes)
+  INTRINSICFLAGS="-mvaes -DCOMPILER_HAS_VAES"
+  CXXFLAGS="-Werror $INTRINSICFLAGS"
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([])], [PASSED=yes], [PASSED=no] )
+  AS_IF([test "$PASSED" = yes], [AC_SUBST(PLATFORM_INTRINSICS_VAES_FLAGS, $INTRINSICFLAGS)])
+  AS_IF([test "$PASSED" = yes], COMPILERINSTRINSICS+="-DCOMPILER_HAS_VAES ")
   
   dnl -------------------------- End of x86 tests ------------------------------------------
   dnl -------------------------- Start of arm tests ------------------------------------------
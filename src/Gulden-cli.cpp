@@ -36,6 +36,8 @@ static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
 static const bool DEFAULT_NAMED=false;
 static const int CONTINUE_EXECUTION=-1;
+//! Default for -batchsize, commands sent at a time as one JSON-RPC batch in -batch mode
+static const int DEFAULT_BATCH_SIZE=1;
 
 static std::string HelpMessageCli()
 {
@@ -55,6 +57,9 @@ static std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
     strUsage += HelpMessageOpt("-stdin", _("Read extra arguments from standard input, one per line until EOF/Ctrl-D (recommended for sensitive information such as passphrases)"));
+    strUsage += HelpMessageOpt("-batch", _("Read commands with their arguments from standard input, one per line until EOF/Ctrl-D, and send them all over one connection. Arguments are separated by spaces and can be quoted"));
+    strUsage += HelpMessageOpt("-batchsize=<n>", strprintf(_("With -batch, send <n> commands at a time as one JSON-RPC batch (default: %d)"), DEFAULT_BATCH_SIZE));
+    strUsage += HelpMessageOpt("-repl", _("Prompt for commands, one per line, until EOF/Ctrl-D or \"quit\", and send them all over one connection"));
 
     return strUsage;
 }
@@ -95,7 +100,9 @@ static int AppInitRPC(int argc, char* argv[])
                   "  Gulden-cli [options] <command> [params]  " + strprintf(_("Send command to %s"), _(PACKAGE_NAME)) + "\n" +
                   "  Gulden-cli [options] -named <command> [name=value] ... " + strprintf(_("Send command to %s (with named arguments)"), _(PACKAGE_NAME)) + "\n" +
                   "  Gulden-cli [options] help                " + _("List commands") + "\n" +
-                  "  Gulden-cli [options] help <command>      " + _("Get help for a command") + "\n";
+                  "  Gulden-cli [options] help <command>      " + _("Get help for a command") + "\n" +
+                  "  Gulden-cli [options] -batch < commands   " + _("Send a command for every line of standard input") + "\n" +
+                  "  Gulden-cli [options] -repl               " + _("Prompt for commands") + "\n";
 
             strUsage += "\n" + HelpMessageCli();
         }
@@ -136,11 +143,13 @@ static int AppInitRPC(int argc, char* argv[])
 /** Reply structure for request_done to fill in */
 struct HTTPReply
 {
-    HTTPReply(): status(0), error(-1) {}
+    HTTPReply(): status(0), error(-1), base(NULL) {}
 
     int status;
     int error;
     std::string body;
+    //! Loop to stop once the request is done; a connection that is kept alive keeps the loop busy otherwise.
+    struct event_base* base;
 };
 
 const char *http_errorstring(int code)
@@ -168,6 +177,8 @@ const char *http_errorstring(int code)
 static void http_request_done(struct evhttp_request *req, void *ctx)
 {
     HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+    if (reply->base)
+        event_base_loopbreak(reply->base);
 
     if (req == NULL) {
         /* If req is NULL, it means an error occurred while connecting: the
@@ -198,73 +209,101 @@ static void http_error_cb(enum evhttp_request_error err, void *ctx)
 }
 #endif
 
-UniValue CallRPC(const std::string& strMethod, const UniValue& params)
+/**
+ * A connection to the RPC server. With fKeepAlive it stays open from one request to the next, so that a run of commands pays for
+ * looking up the host, connecting and reading the credentials once; libevent reconnects by itself if the server closed it meanwhile.
+ */
+class CRPCConnection
 {
-    std::string host = GetArg("-rpcconnect", DEFAULT_RPCCONNECT);
-    int port = GetArg("-rpcport", BaseParams().RPCPort());
+public:
+    explicit CRPCConnection(bool fKeepAliveIn)
+    : fKeepAlive(fKeepAliveIn)
+    , host(GetArg("-rpcconnect", DEFAULT_RPCCONNECT))
+    , port(GetArg("-rpcport", BaseParams().RPCPort()))
+    , base(obtain_event_base())
+    // Synchronously look up hostname
+    , evcon(obtain_evhttp_connection_base(base.get(), host, port))
+    {
+        evhttp_connection_set_timeout(evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
 
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
+        // Get credentials
+        std::string strRPCUserColonPass;
+        if (GetArg("-rpcpassword", "") == "") {
+            // Try fall back to cookie-based authentication if no password is provided
+            if (!GetAuthCookie(&strRPCUserColonPass)) {
+                throw std::runtime_error(strprintf(
+                    _("Could not locate RPC credentials. No authentication cookie could be found, and no rpcpassword is set in the configuration file (%s)"),
+                        GetConfigFile(GetArg("-conf", GULDEN_CONF_FILENAME)).string().c_str()));
 
-    // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-    evhttp_connection_set_timeout(evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+            }
+        } else {
+            strRPCUserColonPass = GetArg("-rpcuser", "") + ":" + GetArg("-rpcpassword", "");
+        }
+        strAuthorization = std::string("Basic ") + EncodeBase64(strRPCUserColonPass);
+    }
 
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == NULL)
-        throw std::runtime_error("create http request failed");
+    //! Post a JSON-RPC request, an object or an array of them for a batch, and return the parsed reply.
+    UniValue Post(const UniValue& request)
+    {
+        HTTPReply response;
+        if (fKeepAlive)
+            response.base = base.get();
+        raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
+        if (req == NULL)
+            throw std::runtime_error("create http request failed");
 #if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
+        evhttp_request_set_error_cb(req.get(), http_error_cb);
 #endif
 
-    // Get credentials
-    std::string strRPCUserColonPass;
-    if (GetArg("-rpcpassword", "") == "") {
-        // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
-            throw std::runtime_error(strprintf(
-                _("Could not locate RPC credentials. No authentication cookie could be found, and no rpcpassword is set in the configuration file (%s)"),
-                    GetConfigFile(GetArg("-conf", GULDEN_CONF_FILENAME)).string().c_str()));
-
+        struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+        assert(output_headers);
+        evhttp_add_header(output_headers, "Host", host.c_str());
+        evhttp_add_header(output_headers, "Connection", fKeepAlive ? "keep-alive" : "close");
+        evhttp_add_header(output_headers, "Authorization", strAuthorization.c_str());
+
+        // Attach request data
+        std::string strRequest = request.write() + "\n";
+        struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+        assert(output_buffer);
+        evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+        int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, "/");
+        req.release(); // ownership moved to evcon in above call
+        if (r != 0) {
+            throw CConnectionFailed("send http request failed");
         }
-    } else {
-        strRPCUserColonPass = GetArg("-rpcuser", "") + ":" + GetArg("-rpcpassword", "");
-    }
 
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = JSONRPCRequestObj(strMethod, params, 1).write() + "\n";
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, "/");
-    req.release(); // ownership moved to evcon in above call
-    if (r != 0) {
-        throw CConnectionFailed("send http request failed");
+        event_base_dispatch(base.get());
+
+        if (response.status == 0)
+            throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
+        else if (response.status == HTTP_UNAUTHORIZED)
+            throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
+        else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
+            throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
+        else if (response.body.empty())
+            throw std::runtime_error("no response from server");
+
+        // Parse reply
+        UniValue valReply(UniValue::VSTR);
+        if (!valReply.read(response.body))
+            throw std::runtime_error("couldn't parse reply from server");
+        return valReply;
     }
 
-    event_base_dispatch(base.get());
-
-    if (response.status == 0)
-        throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
-    else if (response.status == HTTP_UNAUTHORIZED)
-        throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
-    else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
-        throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
-    else if (response.body.empty())
-        throw std::runtime_error("no response from server");
-
-    // Parse reply
-    UniValue valReply(UniValue::VSTR);
-    if (!valReply.read(response.body))
-        throw std::runtime_error("couldn't parse reply from server");
+private:
+    const bool fKeepAlive;
+    const std::string host;
+    const int port;
+    raii_event_base base;
+    raii_evhttp_connection evcon;
+    std::string strAuthorization;
+};
+
+UniValue CallRPC(const std::string& strMethod, const UniValue& params)
+{
+    CRPCConnection connection(false);
+    const UniValue valReply = connection.Post(JSONRPCRequestObj(strMethod, params, 1));
     const UniValue& reply = valReply.get_obj();
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
@@ -272,11 +311,241 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params)
     return reply;
 }
 
+//! Turn the reply to a command into what to print, returns the exit code for it.
+static int FormatReply(const UniValue& reply, bool fWait, std::string& strPrint)
+{
+    int nRet = 0;
+    const UniValue& result = find_value(reply, "result");
+    const UniValue& error  = find_value(reply, "error");
+
+    if (!error.isNull()) {
+        // Error
+        int code = error["code"].get_int();
+        if (fWait && code == RPC_IN_WARMUP)
+            throw CConnectionFailed("server in warmup");
+        strPrint = "error: " + error.write();
+        nRet = abs(code);
+        if (error.isObject())
+        {
+            UniValue errCode = find_value(error, "code");
+            UniValue errMsg  = find_value(error, "message");
+            strPrint = errCode.isNull() ? "" : "error code: "+errCode.getValStr()+"\n";
+
+            if (errMsg.isStr())
+                strPrint += "error message:\n"+errMsg.get_str();
+        }
+    } else {
+        // Result
+        if (result.isNull())
+            strPrint = "";
+        else if (result.isStr())
+            strPrint = result.get_str();
+        else
+            strPrint = result.write(2);
+    }
+    return nRet;
+}
+
+//! The parameters of a command, by name or by position as asked for with -named.
+static UniValue ConvertParams(const std::string& strMethod, const std::vector<std::string>& args)
+{
+    if(GetBoolArg("-named", DEFAULT_NAMED)) {
+        return RPCConvertNamedValues(strMethod, args);
+    } else {
+        return RPCConvertValues(strMethod, args);
+    }
+}
+
+/**
+ * Split a line of the batch or interactive mode into the command and its arguments: words are separated by white space, and can be
+ * quoted with single or double quotes to hold white space themselves (JSON arguments, mostly); a backslash takes the next character as is.
+ * Returns false if a quote isn't closed.
+ */
+static bool SplitCommandLine(const std::string& strLine, std::vector<std::string>& args)
+{
+    args.clear();
+    std::string strWord;
+    bool fInWord = false;
+    char cQuote = 0;
+    for (size_t i = 0; i < strLine.size(); ++i)
+    {
+        char c = strLine[i];
+        if (c == '\\' && i + 1 < strLine.size() && cQuote != '\'')
+        {
+            strWord += strLine[++i];
+            fInWord = true;
+        }
+        else if (cQuote)
+        {
+            if (c == cQuote)
+                cQuote = 0;
+            else
+                strWord += c;
+        }
+        else if (c == '"' || c == '\'')
+        {
+            cQuote = c;
+            fInWord = true;
+        }
+        else if (isspace((unsigned char)c))
+        {
+            if (fInWord)
+                args.push_back(strWord);
+            strWord.clear();
+            fInWord = false;
+        }
+        else
+        {
+            strWord += c;
+            fInWord = true;
+        }
+    }
+    if (fInWord)
+        args.push_back(strWord);
+    return cQuote == 0;
+}
+
+//! Post request on connection, retrying while the server can't be reached (or is warming up) with -rpcwait.
+template <typename Function>
+static void PostWithWait(CRPCConnection& connection, const UniValue& request, Function handleReply)
+{
+    const bool fWait = GetBoolArg("-rpcwait", false);
+    do {
+        try {
+            handleReply(connection.Post(request), fWait);
+            // Connection succeeded, no need to retry.
+            break;
+        }
+        catch (const CConnectionFailed&) {
+            if (fWait)
+                MilliSleep(1000);
+            else
+                throw;
+        }
+    } while (fWait);
+}
+
+static void PrintReply(int nRet, const std::string& strPrint)
+{
+    if (strPrint != "") {
+        fprintf((nRet == 0 ? stdout : stderr), "%s\n", strPrint.c_str());
+        fflush(nRet == 0 ? stdout : stderr);
+    }
+}
+
+/**
+ * The batch (-batch) and interactive (-repl) modes: commands are read from standard input, one per line, and sent over a single connection
+ * that is kept open. In batch mode -batchsize commands at a time go out as one JSON-RPC batch. Results are printed in the order of the
+ * commands; the exit code is that of the last command that failed.
+ */
+static int CommandLoopRPC(bool fInteractive)
+{
+    const size_t nBatchSize = fInteractive ? 1 : std::max<int64_t>(1, GetArg("-batchsize", DEFAULT_BATCH_SIZE));
+    CRPCConnection connection(true);
+    int nRet = 0;
+    bool fEOF = false;
+    while (!fEOF)
+    {
+        // Collect the next batch, commands that can't be made sense of fail right away.
+        std::vector<std::string> vMethods;
+        UniValue requests(UniValue::VARR);
+        while (requests.size() < nBatchSize)
+        {
+            if (fInteractive)
+            {
+                fprintf(stdout, "Gulden> ");
+                fflush(stdout);
+            }
+            std::string line;
+            if (!std::getline(std::cin, line))
+            {
+                fEOF = true;
+                break;
+            }
+            std::vector<std::string> args;
+            try {
+                if (!SplitCommandLine(line, args))
+                    throw std::runtime_error("unterminated quote");
+                if (args.empty() || args[0][0] == '#')
+                    continue;
+                std::string strMethod = args[0];
+                if (fInteractive && (strMethod == "quit" || strMethod == "exit"))
+                {
+                    fEOF = true;
+                    break;
+                }
+                args.erase(args.begin());
+                requests.push_back(JSONRPCRequestObj(strMethod, ConvertParams(strMethod, args), UniValue((uint64_t)vMethods.size())));
+                vMethods.push_back(strMethod);
+            }
+            catch (const std::exception& e) {
+                nRet = EXIT_FAILURE;
+                PrintReply(nRet, std::string("error: ") + e.what());
+            }
+        }
+        if (requests.empty())
+            continue;
+
+        try {
+            PostWithWait(connection, nBatchSize == 1 ? requests[0] : requests, [&](const UniValue& valReply, bool fWait)
+            {
+                // Replies to a batch are matched up by id, the server needn't keep the order.
+                std::vector<UniValue> replies(vMethods.size());
+                if (valReply.isArray())
+                {
+                    for (size_t i = 0; i < valReply.size(); ++i)
+                    {
+                        const UniValue& id = find_value(valReply[i], "id");
+                        if (id.isNum() && id.get_int64() >= 0 && (size_t)id.get_int64() < replies.size())
+                            replies[id.get_int64()] = valReply[i];
+                    }
+                }
+                else if (valReply.isObject())
+                {
+                    replies[0] = valReply;
+                }
+                std::vector<std::string> vPrint(replies.size());
+                std::vector<int> vRet(replies.size());
+                for (size_t i = 0; i < replies.size(); ++i)
+                {
+                    if (!replies[i].isObject() || replies[i].empty())
+                    {
+                        vPrint[i] = "error: no reply from server for " + vMethods[i];
+                        vRet[i] = EXIT_FAILURE;
+                        continue;
+                    }
+                    vRet[i] = FormatReply(replies[i], fWait, vPrint[i]);
+                }
+                for (size_t i = 0; i < replies.size(); ++i)
+                {
+                    if (vRet[i] != 0)
+                        nRet = vRet[i];
+                    PrintReply(vRet[i], vPrint[i]);
+                }
+            });
+        }
+        catch (const boost::thread_interrupted&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            // Without the server there is no point going on; otherwise the commands after may still work.
+            nRet = EXIT_FAILURE;
+            PrintReply(nRet, std::string("error: ") + e.what());
+            if (dynamic_cast<const CConnectionFailed*>(&e))
+                return nRet;
+        }
+    }
+    return nRet;
+}
+
 int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
     int nRet = 0;
     try {
+        if (GetBoolArg("-batch", false) || GetBoolArg("-repl", false))
+            return CommandLoopRPC(GetBoolArg("-repl", false));
+
         // Skip switches
         while (argc > 1 && IsSwitchChar(argv[1][0])) {
             argc--;
@@ -294,48 +563,14 @@ int CommandLineRPC(int argc, char *argv[])
         std::string strMethod = args[0];
         args.erase(args.begin()); // Remove trailing method name from arguments vector
 
-        UniValue params;
-        if(GetBoolArg("-named", DEFAULT_NAMED)) {
-            params = RPCConvertNamedValues(strMethod, args);
-        } else {
-            params = RPCConvertValues(strMethod, args);
-        }
+        UniValue params = ConvertParams(strMethod, args);
 
         // Execute and handle connection failures with -rpcwait
         const bool fWait = GetBoolArg("-rpcwait", false);
         do {
             try {
                 const UniValue reply = CallRPC(strMethod, params);
-
-                // Parse reply
-                const UniValue& result = find_value(reply, "result");
-                const UniValue& error  = find_value(reply, "error");
-
-                if (!error.isNull()) {
-                    // Error
-                    int code = error["code"].get_int();
-                    if (fWait && code == RPC_IN_WARMUP)
-                        throw CConnectionFailed("server in warmup");
-                    strPrint = "error: " + error.write();
-                    nRet = abs(code);
-                    if (error.isObject())
-                    {
-                        UniValue errCode = find_value(error, "code");
-                        UniValue errMsg  = find_value(error, "message");
-                        strPrint = errCode.isNull() ? "" : "error code: "+errCode.getValStr()+"\n";
-
-                        if (errMsg.isStr())
-                            strPrint += "error message:\n"+errMsg.get_str();
-                    }
-                } else {
-                    // Result
-                    if (result.isNull())
-                        strPrint = "";
-                    else if (result.isStr())
-                        strPrint = result.get_str();
-                    else
-                        strPrint = result.write(2);
-                }
+                nRet = FormatReply(reply, fWait, strPrint);
                 // Connection succeeded, no need to retry.
                 break;
             }
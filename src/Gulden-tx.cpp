@@ -33,7 +33,9 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <stdio.h>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 
@@ -72,12 +74,16 @@ static int AppInitRawTx(int argc, char* argv[])
             _("Usage:") + "\n" +
               "  Gulden-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded gulden transaction") + "\n" +
               "  Gulden-tx [options] -create [commands]   " + _("Create hex-encoded gulden transaction") + "\n" +
+              "  Gulden-tx [options] -batch <file> [commands]  " + _("Update many hex-encoded gulden transactions") + "\n" +
               "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
 
         strUsage = HelpMessageGroup(_("Options:"));
         strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt("-batch", _("Read hex-encoded transactions from the file (or standard input for \"-\"), one per line, and apply the commands to each; "
+            "the register commands and the keys and previous outputs for signing are done once for all of them, and the transactions are processed in parallel. "
+            "The results are written in the same order, one per line; if any transaction fails none are."));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
@@ -147,18 +153,8 @@ static void RegisterSet(const std::string& strInput)
     RegisterSetJson(key, valStr);
 }
 
-static void RegisterLoad(const std::string& strInput)
+static std::string ReadFile(const std::string& filename)
 {
-    // separate NAME:FILENAME in string
-    size_t pos = strInput.find(':');
-    if ((pos == std::string::npos) ||
-        (pos == 0) ||
-        (pos == (strInput.size() - 1)))
-        throw std::runtime_error("Register load requires NAME:FILENAME");
-
-    std::string key = strInput.substr(0, pos);
-    std::string filename = strInput.substr(pos + 1, std::string::npos);
-
     FILE *f = fopen(filename.c_str(), "r");
     if (!f) {
         std::string strErr = "Cannot open file " + filename;
@@ -184,8 +180,23 @@ static void RegisterLoad(const std::string& strInput)
         throw std::runtime_error(strErr);
     }
 
+    return valStr;
+}
+
+static void RegisterLoad(const std::string& strInput)
+{
+    // separate NAME:FILENAME in string
+    size_t pos = strInput.find(':');
+    if ((pos == std::string::npos) ||
+        (pos == 0) ||
+        (pos == (strInput.size() - 1)))
+        throw std::runtime_error("Register load requires NAME:FILENAME");
+
+    std::string key = strInput.substr(0, pos);
+    std::string filename = strInput.substr(pos + 1, std::string::npos);
+
     // evaluate as JSON buffer register
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(key, ReadFile(filename));
 }
 
 static CAmount ExtractAndValidateValue(const std::string& strValue)
@@ -531,27 +542,22 @@ static CAmount AmountFromValue(const UniValue& value)
     return amount;
 }
 
-static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+/** What signing needs besides the transaction: the keys and the outputs spent, parsed from the registers once for any number of transactions. */
+struct CSignContext
 {
     int nHashType = SIGHASH_ALL;
+    CBasicKeyStore keystore;
+    std::map<COutPoint, Coin> prevouts;
+};
 
+static void PrepareSign(CSignContext& context, const std::string& flagStr)
+{
     if (flagStr.size() > 0)
-        if (!findSighashFlags(nHashType, flagStr))
+        if (!findSighashFlags(context.nHashType, flagStr))
             throw std::runtime_error("unknown sighash flag/sign option");
 
-    std::vector<CTransaction> txVariants;
-    txVariants.push_back(tx);
-
-    // mergedTx will end up with all the signatures; it
-    // starts as a clone of the raw tx:
-    CMutableTransaction mergedTx(txVariants[0]);
-    bool fComplete = true;
-    CCoinsView viewDummy;
-    CCoinsViewCache view(&viewDummy);
-
     if (!registers.count("privatekeys"))
         throw std::runtime_error("privatekeys register variable must be set.");
-    CBasicKeyStore tempKeystore;
     UniValue keysObj = registers["privatekeys"];
 
     for (unsigned int kidx = 0; kidx < keysObj.size(); kidx++) {
@@ -563,7 +569,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
             throw std::runtime_error("privatekey not valid");
 
         CKey key = vchSecret.GetKey();
-        tempKeystore.AddKey(key);
+        context.keystore.AddKey(key);
     }
 
     // Add previous txouts given in the RPC call:
@@ -596,7 +602,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
             CScript scriptPubKey(pkData.begin(), pkData.end());
 
             {
-                const Coin& coin = view.AccessCoin(out);
+                Coin& coin = context.prevouts[out];
                 //fixme: (2.1) (SEGSIG)
                 if (!coin.IsSpent() && coin.out.output.scriptPubKey != scriptPubKey) {
                     std::string err("Previous output scriptPubKey mismatch:\n");
@@ -611,33 +617,49 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
                     newcoin.out.nValue = AmountFromValue(prevOut["amount"]);
                 }
                 newcoin.nHeight = 1;
-                view.AddCoin(out, std::move(newcoin), true);
+                coin = std::move(newcoin);
             }
 
             // if redeemScript given and private keys given,
-            // add redeemScript to the tempKeystore so it can be signed:
+            // add redeemScript to the keystore so it can be signed:
             if ((scriptPubKey.IsPayToScriptHash()) && prevOut.exists("redeemScript"))
             {
                 UniValue v = prevOut["redeemScript"];
                 std::vector<unsigned char> rsData(ParseHexUV(v, "redeemScript"));
                 CScript redeemScript(rsData.begin(), rsData.end());
-                tempKeystore.AddCScript(redeemScript);
+                context.keystore.AddCScript(redeemScript);
             }
         }
     }
+}
+
+/** Sign what we can of tx; context is only read, so several transactions can be signed with it at once. */
+static void SignTx(CMutableTransaction& tx, const CSignContext& context)
+{
+    // txConst is the transaction as it came in, to merge its signatures with the new ones; the hashes over all inputs and outputs that
+    // go into every signature don't depend on the signatures, so they are done once for it instead of for every input.
+    const CTransaction txConst(tx);
+    const PrecomputedTransactionData txdata(txConst);
+
+    // mergedTx will end up with all the signatures; it
+    // starts as a clone of the raw tx:
+    CMutableTransaction mergedTx(tx);
+    bool fComplete = true;
 
-    const CKeyStore& keystore = tempKeystore;
+    const CKeyStore& keystore = context.keystore;
+    const int nHashType = context.nHashType;
 
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
 
     // Sign what we can:
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
         CTxIn& txin = mergedTx.vin[i];
-        const Coin& coin = view.AccessCoin(txin.prevout);
-        if (coin.IsSpent()) {
+        const auto coinIter = context.prevouts.find(txin.prevout);
+        if (coinIter == context.prevouts.end() || coinIter->second.IsSpent()) {
             fComplete = false;
             continue;
         }
+        const Coin& coin = coinIter->second;
         const CScript& prevPubKey = coin.out.output.scriptPubKey;
         const CAmount& amount = coin.out.nValue;
 
@@ -648,14 +670,13 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
-            ProduceSignature(MutableTransactionSignatureCreator(signingKeyID, &keystore, &mergedTx, i, amount, nHashType), coin.out, sigdata, Spend, mergedTx.nVersion);
+            ProduceSignature(TransactionSignatureCreator(signingKeyID, &keystore, &txConst, i, amount, nHashType, &txdata), coin.out, sigdata, Spend, mergedTx.nVersion);
 
         // ... and merge in other signatures:
-        for(const CTransaction& txv : txVariants)
-            sigdata = CombineSignatures(prevPubKey, MutableTransactionSignatureChecker(signingKeyID, CKeyID(), &mergedTx, i, amount), sigdata, DataFromTransaction(txv, i));
+        sigdata = CombineSignatures(prevPubKey, TransactionSignatureChecker(signingKeyID, CKeyID(), &txConst, i, amount, txdata), sigdata, DataFromTransaction(txConst, i));
         UpdateTransaction(mergedTx, i, sigdata);
 
-        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.segregatedSignatureData, STANDARD_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(signingKeyID, CKeyID(), &mergedTx, i, amount)))
+        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.segregatedSignatureData, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(signingKeyID, CKeyID(), &txConst, i, amount, txdata)))
             fComplete = false;
     }
 
@@ -667,6 +688,13 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     tx = mergedTx;
 }
 
+static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+{
+    CSignContext context;
+    PrepareSign(context, flagStr);
+    SignTx(tx, context);
+}
+
 class Secp256k1Init
 {
     ECCVerifyHandle globalVerifyHandle;
@@ -680,8 +708,9 @@ public:
     }
 };
 
+//! fHaveECC: the caller started secp256k1 already (batches, which mutate transactions on several threads at once).
 static void MutateTx(CMutableTransaction& tx, const std::string& command,
-                     const std::string& commandVal)
+                     const std::string& commandVal, bool fHaveECC = false)
 {
     std::unique_ptr<Secp256k1Init> ecc;
 
@@ -703,10 +732,10 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
     else if (command == "outaddr")
         MutateTxAddOutAddr(tx, commandVal);
     else if (command == "outpubkey") {
-        if (!ecc) { ecc.reset(new Secp256k1Init()); }
+        if (!ecc && !fHaveECC) { ecc.reset(new Secp256k1Init()); }
         MutateTxAddOutPubKey(tx, commandVal);
     } else if (command == "outmultisig") {
-        if (!ecc) { ecc.reset(new Secp256k1Init()); }
+        if (!ecc && !fHaveECC) { ecc.reset(new Secp256k1Init()); }
         MutateTxAddOutMultiSig(tx, commandVal);
     } else if (command == "outscript")
         MutateTxAddOutScript(tx, commandVal);
@@ -714,7 +743,7 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
         MutateTxAddOutData(tx, commandVal);
 
     else if (command == "sign") {
-        if (!ecc) { ecc.reset(new Secp256k1Init()); }
+        if (!ecc && !fHaveECC) { ecc.reset(new Secp256k1Init()); }
         MutateTxSign(tx, commandVal);
     }
 
@@ -781,6 +810,67 @@ static std::string readStdin()
     return ret;
 }
 
+/**
+ * Apply commands to every transaction in strInput, one hex-encoded transaction per line, for -batch.
+ * Register commands only go once, in their place among the commands; a sign command parses its keys and previous outputs right there,
+ * once, after which all that is left per transaction can go in parallel.
+ */
+static void BatchRawTx(const std::string& strInput, const std::vector<std::pair<std::string, std::string>>& commands)
+{
+    std::vector<std::string> vHexTx;
+    boost::split(vHexTx, strInput, boost::is_any_of("\n"));
+    for (std::string& strHexTx : vHexTx)
+        boost::algorithm::trim(strHexTx);
+    vHexTx.erase(std::remove(vHexTx.begin(), vHexTx.end(), std::string()), vHexTx.end());
+
+    Secp256k1Init ecc;
+    std::vector<std::unique_ptr<CSignContext>> vSignContexts(commands.size());
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (commands[i].first == "load" || commands[i].first == "set") {
+            CMutableTransaction txDummy(1);
+            MutateTx(txDummy, commands[i].first, commands[i].second, true);
+        } else if (commands[i].first == "sign") {
+            vSignContexts[i].reset(new CSignContext());
+            PrepareSign(*vSignContexts[i], commands[i].second);
+        }
+    }
+
+    std::vector<CMutableTransaction> vTx(vHexTx.size(), CMutableTransaction(1));
+    std::vector<std::string> vError(vHexTx.size());
+    std::atomic<size_t> nNext(0);
+    auto processTxs = [&]()
+    {
+        for (size_t nTx = nNext++; nTx < vTx.size(); nTx = nNext++) {
+            try {
+                if (!DecodeHexTx(vTx[nTx], vHexTx[nTx], true))
+                    throw std::runtime_error("invalid transaction encoding");
+                for (size_t i = 0; i < commands.size(); i++) {
+                    if (vSignContexts[i])
+                        SignTx(vTx[nTx], *vSignContexts[i]);
+                    else if (commands[i].first != "load" && commands[i].first != "set")
+                        MutateTx(vTx[nTx], commands[i].first, commands[i].second, true);
+                }
+            } catch (const std::exception& e) {
+                vError[nTx] = e.what();
+            }
+        }
+    };
+    int nThreads = std::max(1, std::min(GetNumCores(), (int)vTx.size()));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(processTxs);
+    processTxs();
+    for (auto& thread : vThreads)
+        thread.join();
+
+    for (size_t nTx = 0; nTx < vTx.size(); nTx++) {
+        if (!vError[nTx].empty())
+            throw std::runtime_error(strprintf("transaction %d: %s", nTx + 1, vError[nTx]));
+    }
+    for (const CMutableTransaction& tx : vTx)
+        OutputTx(tx);
+}
+
 static int CommandLineRawTx(int argc, char* argv[])
 {
     std::string strPrint;
@@ -798,6 +888,27 @@ static int CommandLineRawTx(int argc, char* argv[])
         CMutableTransaction tx(1);
         int startArg;
 
+        if (GetBoolArg("-batch", false)) {
+            if (fCreateBlank)
+                throw std::runtime_error("-batch and -create can't be combined");
+            if (argc < 2)
+                throw std::runtime_error("too few parameters");
+
+            std::string strFile(argv[1]);
+            std::string strInput = (strFile == "-") ? readStdin() : ReadFile(strFile);
+            std::vector<std::pair<std::string, std::string>> commands;
+            for (int i = 2; i < argc; i++) {
+                std::string arg = argv[i];
+                size_t eqpos = arg.find('=');
+                if (eqpos == std::string::npos)
+                    commands.emplace_back(arg, "");
+                else
+                    commands.emplace_back(arg.substr(0, eqpos), arg.substr(eqpos + 1));
+            }
+            BatchRawTx(strInput, commands);
+            return nRet;
+        }
+
         if (!fCreateBlank) {
             // require at least one param
             if (argc < 2)
@@ -63,6 +63,8 @@
     #define INDEX_HEIGHT(block) block->nHeight
     #define INDEX_TIME(block) block->GetBlockTime()
     #define INDEX_PREV(block) block->pprev
+    // Jumps back nBack blocks through the skip list instead of walking pprev (other platforms walk INDEX_PREV).
+    #define INDEX_ANCESTOR(block, nBack) block->GetAncestor(block->nHeight - (nBack))
     #define INDEX_TARGET(block) block->nBits
     #define DIFF_SWITCHOVER(TEST, MAIN) (IsArgSet("-testnet") ? TEST :  MAIN)
     #define DIFF_ABS std::abs
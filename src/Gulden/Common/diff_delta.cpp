@@ -202,9 +202,13 @@ unsigned int GetNextWorkRequired_DELTA (const INDEX_TYPE pindexLast, const BLOCK
     }
     else
     {
+        #ifdef INDEX_ANCESTOR
+        pindexFirst = INDEX_ANCESTOR(pindexLast, nLongFrame);
+        #else
         pindexFirst = pindexLast;
         for (unsigned int i = 1; pindexFirst != NULL && i <= nLongFrame; i++)
             pindexFirst = INDEX_PREV(pindexFirst);
+        #endif
 
         nLongTimespan = INDEX_TIME(pindexLast) - INDEX_TIME(pindexFirst);
     }
@@ -0,0 +1,123 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+//
+// Multi lane scrypt(1024,1,1) for verifying batches of pre-SIGMA headers.
+// Instead of vectorising a single salsa20/8 (see scrypt-sse2.cpp) each 32 bit lane of a vector holds the same state word of a different hash.
+// This keeps all four lanes busy for the whole of ROMix without any of the shuffles the single hash layout needs,
+// the price is that the data dependent lookups in the second ROMix loop have to be gathered one lane at a time.
+// On arm the same code compiles to neon via our sse compat layer.
+
+#include "scrypt.h"
+#include <compat/sse.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef SCRYPT_MULTI_LANE
+
+#define ROTL_4WAY(v, c) _mm_or_si128(_mm_slli_epi32((v), (c)), _mm_srli_epi32((v), 32 - (c)))
+#define QUARTERROUND_4WAY(a, b, c, d) \
+    b = _mm_xor_si128(b, ROTL_4WAY(_mm_add_epi32(a, d),  7)); \
+    c = _mm_xor_si128(c, ROTL_4WAY(_mm_add_epi32(b, a),  9)); \
+    d = _mm_xor_si128(d, ROTL_4WAY(_mm_add_epi32(c, b), 13)); \
+    a = _mm_xor_si128(a, ROTL_4WAY(_mm_add_epi32(d, c), 18));
+
+static inline void xor_salsa8_4way(__m128i B[16], const __m128i Bx[16])
+{
+    __m128i x[16];
+    for (int i = 0; i < 16; ++i)
+        x[i] = B[i] = _mm_xor_si128(B[i], Bx[i]);
+
+    for (int i = 0; i < 8; i += 2)
+    {
+        // Operate on columns.
+        QUARTERROUND_4WAY(x[ 0], x[ 4], x[ 8], x[12]);
+        QUARTERROUND_4WAY(x[ 5], x[ 9], x[13], x[ 1]);
+        QUARTERROUND_4WAY(x[10], x[14], x[ 2], x[ 6]);
+        QUARTERROUND_4WAY(x[15], x[ 3], x[ 7], x[11]);
+
+        // Operate on rows.
+        QUARTERROUND_4WAY(x[ 0], x[ 1], x[ 2], x[ 3]);
+        QUARTERROUND_4WAY(x[ 5], x[ 6], x[ 7], x[ 4]);
+        QUARTERROUND_4WAY(x[10], x[11], x[ 8], x[ 9]);
+        QUARTERROUND_4WAY(x[15], x[12], x[13], x[14]);
+    }
+
+    for (int i = 0; i < 16; ++i)
+        B[i] = _mm_add_epi32(B[i], x[i]);
+}
+
+void scrypt_1024_1_1_256_sp_4way(const char* const input[SCRYPT_BATCH_LANES], char* const output[SCRYPT_BATCH_LANES], char* scratchpad)
+{
+    uint8_t B[SCRYPT_BATCH_LANES][128];
+    __m128i X[32];
+    // V[i*32+k] holds word k of the i'th ROMix block for all lanes, 512k in total.
+    __m128i* V = (__m128i*)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+    const uint32_t* V32 = (const uint32_t*)V;
+
+    for (int lane = 0; lane < SCRYPT_BATCH_LANES; ++lane)
+        PBKDF2_SHA256((const uint8_t*)input[lane], 80, (const uint8_t*)input[lane], 80, 1, B[lane], 128);
+
+    for (int k = 0; k < 32; ++k)
+        X[k] = _mm_set_epi32(le32dec(&B[3][4 * k]), le32dec(&B[2][4 * k]), le32dec(&B[1][4 * k]), le32dec(&B[0][4 * k]));
+
+    for (int i = 0; i < 1024; ++i)
+    {
+        memcpy(&V[i * 32], X, sizeof(X));
+        xor_salsa8_4way(&X[0], &X[16]);
+        xor_salsa8_4way(&X[16], &X[0]);
+    }
+    for (int i = 0; i < 1024; ++i)
+    {
+        uint32_t j[SCRYPT_BATCH_LANES];
+        memcpy(j, &X[16], sizeof(j));
+        for (int lane = 0; lane < SCRYPT_BATCH_LANES; ++lane)
+            j[lane] = 32 * 4 * (j[lane] & 1023) + lane;
+        for (int k = 0; k < 32; ++k)
+            X[k] = _mm_xor_si128(X[k], _mm_set_epi32(V32[j[3] + 4 * k], V32[j[2] + 4 * k], V32[j[1] + 4 * k], V32[j[0] + 4 * k]));
+        xor_salsa8_4way(&X[0], &X[16]);
+        xor_salsa8_4way(&X[16], &X[0]);
+    }
+
+    for (int k = 0; k < 32; ++k)
+    {
+        uint32_t words[SCRYPT_BATCH_LANES];
+        memcpy(words, &X[k], sizeof(words));
+        for (int lane = 0; lane < SCRYPT_BATCH_LANES; ++lane)
+            le32enc(&B[lane][4 * k], words[lane]);
+    }
+
+    for (int lane = 0; lane < SCRYPT_BATCH_LANES; ++lane)
+        PBKDF2_SHA256((const uint8_t*)input[lane], 80, B[lane], 128, 1, (uint8_t*)output[lane], 32);
+}
+#endif
+
+void scrypt_1024_1_1_256_sp_batch(const char* const* input, char* const* output, size_t count, char* scratchpad)
+{
+    size_t i = 0;
+    #ifdef SCRYPT_MULTI_LANE
+    for (; i + SCRYPT_BATCH_LANES <= count; i += SCRYPT_BATCH_LANES)
+    {
+        scrypt_1024_1_1_256_sp_4way(&input[i], &output[i], scratchpad);
+    }
+    // A partially filled final group is still cheaper to run through the lanes (padded with repeats of its first entry) than one by one, unless only a single hash remains.
+    if (count - i > 1)
+    {
+        const char* paddedInput[SCRYPT_BATCH_LANES];
+        char* paddedOutput[SCRYPT_BATCH_LANES];
+        char discard[SCRYPT_BATCH_LANES][32];
+        for (size_t lane = 0; lane < SCRYPT_BATCH_LANES; ++lane)
+        {
+            bool fUsed = i + lane < count;
+            paddedInput[lane] = fUsed ? input[i + lane] : input[i];
+            paddedOutput[lane] = fUsed ? output[i + lane] : discard[lane];
+        }
+        scrypt_1024_1_1_256_sp_4way(paddedInput, paddedOutput, scratchpad);
+        return;
+    }
+    #endif
+    for (; i < count; ++i)
+    {
+        scrypt_1024_1_1_256_sp(input[i], output[i], scratchpad);
+    }
+}
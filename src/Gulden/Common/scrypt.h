@@ -2,9 +2,21 @@
 #define SCRYPT_H
 #include <stdlib.h>
 #include <stdint.h>
+#include <compat/arch.h>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
+// Number of hashes scrypt_1024_1_1_256_sp_batch computes side by side, the scratchpad passed to it must be SCRYPT_BATCH_SCRATCHPAD_SIZE bytes.
+#define SCRYPT_BATCH_LANES 4
+static const int SCRYPT_BATCH_SCRATCHPAD_SIZE = SCRYPT_BATCH_LANES * 131072 + 63;
+
+#if (defined(ARCH_CPU_X86_FAMILY) && defined(__SSE2__)) || (defined(ARCH_CPU_ARM_FAMILY) && defined(__ARM_NEON))
+#define SCRYPT_MULTI_LANE 1
+void scrypt_1024_1_1_256_sp_4way(const char* const input[SCRYPT_BATCH_LANES], char* const output[SCRYPT_BATCH_LANES], char* scratchpad);
+#endif
+// Hash count 80 byte inputs, SCRYPT_BATCH_LANES at a time where the platform allows it and one at a time otherwise.
+void scrypt_1024_1_1_256_sp_batch(const char* const* input, char* const* output, size_t count, char* scratchpad);
+
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
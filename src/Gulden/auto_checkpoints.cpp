@@ -19,6 +19,8 @@
 #include "pubkey.h"
 #include "timedata.h"
 #include "netmessagemaker.h"
+#include "limitedmap.h"
+#include "utiltime.h"
 
 #include <stdint.h>
 
@@ -32,6 +34,9 @@
 // How many blocks back the checkpoint should run
 #define AUTO_CHECKPOINT_DEPTH 4
 
+// How many sync-checkpoint messages to remember as having a valid signature
+#define MAX_VERIFIED_CHECKPOINT_MESSAGES 32
+
 // ppcoin: synchronized checkpoint (centrally broadcasted)
 namespace Checkpoints
 {
@@ -581,23 +586,39 @@ const std::string CSyncCheckpoint::strMasterPubKeyOld             = "043872e0472
 
 std::string CSyncCheckpoint::strMasterPrivKey = "";
 
+// Messages (by GetHash, which covers both message and signature) that have already passed CheckSignature.
+// The same checkpoint is relayed to us by every peer, so there is no need to verify it more than once.
+static CCriticalSection cs_verifiedCheckpointMessages;
+static limitedmap<uint256, int64_t> verifiedCheckpointMessages(MAX_VERIFIED_CHECKPOINT_MESSAGES);
+
 // ppcoin: verify signature of sync-checkpoint message
 bool CSyncCheckpoint::CheckSignature(CNode* pfrom)
 {
-    CPubKey key(ParseHex(IsArgSet("-testnet") ? CSyncCheckpoint::strMasterPubKeyTestnet : CSyncCheckpoint::strMasterPubKey));
-    if (!key.IsValid())
+    uint256 hashMessage = GetHash();
+    bool fAlreadyVerified;
     {
-        return error("CSyncCheckpoint::CheckSignature() : SetPubKey failed");
+        LOCK(cs_verifiedCheckpointMessages);
+        fAlreadyVerified = verifiedCheckpointMessages.count(hashMessage) > 0;
     }
-    if (!key.Verify(Hash(vchMsg.begin(), vchMsg.end()), vchSig))
+    if (!fAlreadyVerified)
     {
-        CPubKey keyOld(ParseHex(strMasterPubKeyOld));
-        if (!keyOld.Verify(Hash(vchMsg.begin(), vchMsg.end()), vchSig))
+        CPubKey key(ParseHex(IsArgSet("-testnet") ? CSyncCheckpoint::strMasterPubKeyTestnet : CSyncCheckpoint::strMasterPubKey));
+        if (!key.IsValid())
         {
-            Misbehaving(pfrom->GetId(), 10);
-            return error("CSyncCheckpoint::CheckSignature() : verify signature failed");
+            return error("CSyncCheckpoint::CheckSignature() : SetPubKey failed");
         }
-        return false;
+        if (!key.Verify(Hash(vchMsg.begin(), vchMsg.end()), vchSig))
+        {
+            CPubKey keyOld(ParseHex(strMasterPubKeyOld));
+            if (!keyOld.Verify(Hash(vchMsg.begin(), vchMsg.end()), vchSig))
+            {
+                Misbehaving(pfrom->GetId(), 10);
+                return error("CSyncCheckpoint::CheckSignature() : verify signature failed");
+            }
+            return false;
+        }
+        LOCK(cs_verifiedCheckpointMessages);
+        verifiedCheckpointMessages.insert(std::pair(hashMessage, GetTimeMicros()));
     }
 
     // Now unserialize the data
@@ -609,6 +630,26 @@ bool CSyncCheckpoint::CheckSignature(CNode* pfrom)
 // ppcoin: process synchronized checkpoint
 bool CSyncCheckpoint::ProcessSyncCheckpoint(CNode* pfrom, const CChainParams& chainparams)
 {
+    // Copies of the current (or pending) checkpoint that other peers relay to us need no further processing, and mustn't be relayed again.
+    {
+        LOCK(Checkpoints::cs_hashSyncCheckpoint);
+        uint256 hashMessage = GetHash();
+        const CSyncCheckpoint* knownMessage = nullptr;
+        if (hashMessage == Checkpoints::checkpointMessage.GetHash())
+            knownMessage = &Checkpoints::checkpointMessage;
+        else if (hashMessage == Checkpoints::checkpointMessagePending.GetHash())
+            knownMessage = &Checkpoints::checkpointMessagePending;
+        if (knownMessage && !knownMessage->IsNull())
+        {
+            if (pfrom)
+            {
+                LOCK(pfrom->cs_floodRelay);
+                pfrom->hashCheckpointKnown = knownMessage->hashCheckpoint;
+            }
+            return false;
+        }
+    }
+
     if (!CheckSignature(pfrom))
     {
         return false;
@@ -701,6 +742,7 @@ uint256 CSyncCheckpoint::GetHash() const
 
 bool CSyncCheckpoint::RelayTo(CNode* pnode) const
 {
+    LOCK(pnode->cs_floodRelay);
     // returns true if wasn't already sent
     if (pnode->hashCheckpointKnown != hashCheckpoint)
     {
@@ -807,6 +849,7 @@ uint256 CSyncCheckpointInvalidate::GetHash() const
 
 bool CSyncCheckpointInvalidate::RelayTo(CNode* pnode) const
 {
+    LOCK(pnode->cs_floodRelay);
     // returns true if wasn't already sent
     if (pnode->hashInvalidateKnown != hashInvalidate)
     {
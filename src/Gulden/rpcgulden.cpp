@@ -45,6 +45,8 @@
 #include <consensus/validation.h>
 #include <consensus/consensus.h>
 #include "net.h"
+#include "clockcache.h"
+#include "executor.h"
 
 
 #ifdef ENABLE_WALLET
@@ -54,7 +56,29 @@ static UniValue gethashps(const JSONRPCRequest& request)
     if (request.fHelp)
         throw std::runtime_error(
             "gethashps\n"
-            "\nReturns the estimated hashes per second that this computer is mining at.\n");
+            "\nReturns the estimated hashes per second that this computer is mining at.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"last_reported\": \"xxx\",     (string) The most recently measured hash rate\n"
+            "  \"rolling_average\": \"xxx\",   (string) Rolling average of the hash rate\n"
+            "  \"best_reported\": \"xxx\",     (string) The best hash rate measured so far\n"
+            "  \"arena_backing\": \"xxx\",     (string) Memory backing obtained for the mining arenas (none, heap, normal_pages, transparent_huge_pages, huge_pages_2mb, huge_pages_1gb, large_pages)\n"
+            "  \"arena_locked\": true|false,  (boolean) Whether the mining arenas are locked into physical memory\n"
+            "  \"numa_nodes\": {             (object, only when mining with -gennuma) Hash rate of the current round per NUMA node\n"
+            "      \"n\": \"xxx\",              (string) The hash rate of node n\n"
+            "  },\n"
+            "  \"throttle\": {               (object) The limits set with sethashlimit and how the mining threads of the current round kept to them\n"
+            "      \"hash_limit\": n,         (numeric) Hashes per second over all threads, 0 if unlimited\n"
+            "      \"duty_cycle\": n,         (numeric) Percentage of the time each thread may spend hashing\n"
+            "      \"threads\": [             (array) Per mining thread\n"
+            "          {\n"
+            "            \"hashes\": n,        (numeric) Hashes done this round\n"
+            "            \"busy_ms\": n,       (numeric) Time spent hashing this round\n"
+            "            \"throttled_ms\": n,  (numeric) Time spent sleeping to keep to the limits this round\n"
+            "          }\n"
+            "      ]\n"
+            "  }\n"
+            "}\n");
 
     double dHashPerSecLog = dHashesPerSec;
     std::string sHashPerSecLogLabel = " h";
@@ -70,6 +94,38 @@ static UniValue gethashps(const JSONRPCRequest& request)
     rec.push_back(Pair("last_reported", strprintf("%lf %s", dHashPerSecLog, sHashPerSecLogLabel)));
     rec.push_back(Pair("rolling_average", strprintf("%lf %s", dRollingHashPerSecLog, sRollingHashPerSecLogLabel)));
     rec.push_back(Pair("best_reported", strprintf("%lf %s", dBestHashPerSecLog, sBestHashPerSecLogLabel)));
+    rec.push_back(Pair("arena_backing", GetArenaBackingName()));
+    rec.push_back(Pair("arena_locked", (bool)fArenaLocked));
+    {
+        LOCK(cs_numaHashesPerSec);
+        if (!mapNumaNodeHashesPerSec.empty())
+        {
+            UniValue nodes(UniValue::VOBJ);
+            for (const auto& nodeIter : mapNumaNodeHashesPerSec)
+            {
+                double dNodeHashPerSecLog = nodeIter.second;
+                std::string sNodeHashPerSecLogLabel = " h";
+                selectLargesHashUnit(dNodeHashPerSecLog, sNodeHashPerSecLogLabel);
+                nodes.push_back(Pair(itostr(nodeIter.first), strprintf("%lf %s", dNodeHashPerSecLog, sNodeHashPerSecLogLabel)));
+            }
+            rec.push_back(Pair("numa_nodes", nodes));
+        }
+    }
+
+    UniValue throttle(UniValue::VOBJ);
+    throttle.push_back(Pair("hash_limit", miningThrottle.hashLimit()));
+    throttle.push_back(Pair("duty_cycle", miningThrottle.dutyCycle()));
+    UniValue threads(UniValue::VARR);
+    for (const sigma_throttle_thread_stats& stats : miningThrottle.threadStats())
+    {
+        UniValue thread(UniValue::VOBJ);
+        thread.push_back(Pair("hashes", stats.halfHashes));
+        thread.push_back(Pair("busy_ms", stats.busyNanos / 1000000));
+        thread.push_back(Pair("throttled_ms", stats.throttledNanos / 1000000));
+        threads.push_back(thread);
+    }
+    throttle.push_back(Pair("threads", threads));
+    rec.push_back(Pair("throttle", throttle));
 
     return rec;
     return strprintf("%lf %s/s (best %lf %s/s)", dHashPerSecLog, sHashPerSecLogLabel, dBestHashPerSecLog, sBestHashPerSecLogLabel);
@@ -77,31 +133,58 @@ static UniValue gethashps(const JSONRPCRequest& request)
 
 static UniValue sethashlimit(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
         throw std::runtime_error(
-            "sethashlimit  ( limit )\n"
-            "\nSet the maximum number of hashes to calculate per second when mining.\n"
-            "\nThis mainly exists for testing purposes but can also be used to limit CPU usage a little.\n"
+            "sethashlimit limit ( dutycycle )\n"
+            "\nSet the maximum number of hashes to calculate per second when mining, and optionally the share of the time the mining threads may spend on it.\n"
+            "\nThe mining threads are paced evenly rather than stopped and started, so that mining can run in the spare cycles of a node without holding up its other work.\n"
             "\nArguments:\n"
-            "1. limit     (numeric) The number of hashes to allow per second, or -1 to remove limit.\n"
+            "1. limit       (numeric) The number of hashes to allow per second over all mining threads, or -1 to remove limit.\n"
+            "2. dutycycle   (numeric, optional, default=100) Percentage (1-100) of the time every mining thread may spend hashing, sleeping the rest.\n"
             "\nExamples:\n"
             + HelpExampleCli("sethashlimit 500000", "")
+            + HelpExampleCli("sethashlimit -1 25", "")
             + HelpExampleRpc("sethashlimit 500000", ""));
 
-    RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VNUM));
+    RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM));
 
-    nHashThrottle = request.params[0].get_int();
+    int64_t nLimit = request.params[0].get_int64();
+    int64_t nDutyCycle = request.params.size() > 1 ? request.params[1].get_int64() : 100;
+    if (nLimit < -1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid limit, must be -1 or more");
+    if (nDutyCycle < 1 || nDutyCycle > 100)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid dutycycle, must be between 1 and 100");
+    miningThrottle.setHashLimit(nLimit < 0 ? 0 : nLimit);
+    miningThrottle.setDutyCycle(nDutyCycle);
 
-    LogPrintf("<DELTA> hash throttle %ld\n", nHashThrottle);
+    LogPrintf("<DELTA> hash throttle %d duty cycle %d\n", nLimit, nDutyCycle);
 
-    return strprintf("Throttling hash: %d", nHashThrottle);
+    return strprintf("Throttling hash: %d, duty cycle: %d%%", nLimit, nDutyCycle);
+}
+
+#ifdef ENABLE_WALLET
+static std::string WitnessAccountEventTypeToString(CWitnessAccountEvent::Type type)
+{
+    switch (type)
+    {
+        case CWitnessAccountEvent::Fund: return "fund";
+        case CWitnessAccountEvent::Reward: return "reward";
+        case CWitnessAccountEvent::Renew: return "renew";
+        case CWitnessAccountEvent::Increase: return "increase";
+        case CWitnessAccountEvent::Split: return "split";
+        case CWitnessAccountEvent::Merge: return "merge";
+        case CWitnessAccountEvent::ChangeKey: return "changekey";
+        case CWitnessAccountEvent::Empty: return "empty";
+    }
+    return "";
 }
+#endif
 
 static UniValue getwitnessinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() > 3)
+    if (request.fHelp || request.params.size() > 5)
         throw std::runtime_error(
-            "getwitnessinfo \"block_specifier\" verbose mine_only\n"
+            "getwitnessinfo \"block_specifier\" verbose mine_only start count\n"
             "\nReturns witness related network info for a given block."
             "\nWhen verbose is enabled returns additional statistics.\n"
             "\nArguments:\n"
@@ -109,6 +192,9 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             "\nSpecifier can be the hash of the block; an absolute height in the blockchain or a tip~# specifier to iterate backwards from tip; for which to return witness details\n"
             "2. verbose                  (boolean, optional, default=false) Display additional verbose information.\n"
             "3. mine_only                (boolean, optional, default=false) In verbose display only show account info for accounts belonging to this wallet.\n"
+            "4. start                    (numeric, optional, default=0) In verbose display skip this many entries of the witness address list, to page through it.\n"
+            "5. count                    (numeric, optional, default=0) In verbose display list at most this many witness addresses, 0 to list all of them.\n"
+            "\nThe witness address list is in a fixed order for a given block, so it can be fetched in pages with start and count; the statistics always cover all witness addresses.\n"
             "\nResult:\n"
             "[{\n"
             "     \"pow2_phase\": n                                  (number) The number of the currently active pow2_phase.\n"
@@ -145,6 +231,7 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             "             \"median\": n                              (number) The median age of all witness addresses.\n"
             "         }\n"
             "     }\n"
+            "     \"number_of_listed_addresses\": n                  (number) The number of entries the complete witness address list has, before paging.\n"
             "     \"witness_address_list\": [                        List of all witness addresses on the network, with address specific information\n"
             "         {\n"
             "             \"type\": address_type                     (string) The type of address output used to create the address. Either SCRIPT or POW2WITNESS depending on whether SegSig was activated at the time of creation or not.\n"
@@ -166,6 +253,13 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             //"             \"fail_count\": n                          (number) Internal accounting for how many times this address has been renewed; Note it increases in a non-linear fashion but decreases by 1 for every valid witnessing operation.\n"
             //"             \"action_nonce\": n                        (number) Internal count of how many actions this address has been involved in since creation; Used to ensure address transaction uniqueness across operations.\n"
             "             \"ismine_accountname\": n                  (string) If the address belongs to an account in this wallet, the name of the account.\n"
+            "             \"ismine_account_earnings\": {             If the address belongs to a witness account in this wallet, what that account earned and did in the current chain.\n"
+            "                 \"rewards_to_date\": n                 (number) The total of the witness rewards of the account.\n"
+            "                 \"reward_count\": n                    (number) The number of witness rewards of the account.\n"
+            "                 \"last_reward_block\": n               (number) The block of the last witness reward, 0 if none.\n"
+            "                 \"average_reward_period\": n           (number) The average number of blocks between rewards since the account was funded, 0 if none.\n"
+            "                 \"actions\": [ {\"action\": type, \"txid\": txid, \"block\": n, \"amount\": n}, ... ]  The fund, renew, increase, split, merge, changekey and empty operations of the account, oldest first.\n"
+            "             }\n"
             "         }\n"
             "         ...\n"
             "     ]\n"
@@ -177,16 +271,15 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             + HelpExampleCli("getwitnessinfo tip~2 true", "")
             + "\nExtended witness info for block 400000\n"
             + HelpExampleCli("getwitnessinfo 400000 true", "")
+            + "\nExtended witness info for the current chain tip, listing only the second hundred witness addresses\n"
+            + HelpExampleCli("getwitnessinfo tip true false 100 100", "")
             + "\nExtended witness info for block with hash 8383d8e9999ade8ad0c9f84e7816afec3b9e4855341f678bb0fdc3af46ee6f31\n"
             + HelpExampleCli("getwitnessinfo \"8383d8e9999ade8ad0c9f84e7816afec3b9e4855341f678bb0fdc3af46ee6f31\" true", ""));
 
     #ifdef ENABLE_WALLET
     CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
-    LOCK2(cs_main, pwallet ? &pwallet->cs_wallet : NULL);
     if (!EnsureWalletIsAvailable(pwallet, request.fHelp))
         return NullUniValue;
-    #else
-    LOCK(cs_main);
     #endif
 
     int64_t nTotalWeightAll = 0;
@@ -199,157 +292,218 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
     boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::median(boost::accumulators::with_p_square_quantile), boost::accumulators::tag::mean, boost::accumulators::tag::min, boost::accumulators::tag::max> > lockPeriodWeightStats;
     boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::median(boost::accumulators::with_p_square_quantile), boost::accumulators::tag::mean, boost::accumulators::tag::min, boost::accumulators::tag::max> > ageStats;
 
-    CBlockIndex* pTipIndex = nullptr;
     bool fVerbose = false;
     bool showMineOnly = false;
-    if (request.params.size() > 0)
+    uint64_t nListStart = 0;
+    uint64_t nListCount = 0;
+    uint64_t nNumListedAddresses = 0;
+    uint64_t nTipIndexHeight = 0;
+    CGetWitnessInfo witInfo;
+    #ifdef ENABLE_WALLET
+    std::map<const CAccount*, CWitnessAccountHistory> witnessAccountHistories;
+    #endif
+
+    // The locks are only held while the witness information is captured into witInfo; the (potentially very large) verbose output below is produced from witInfo alone.
     {
-        std::string sTipHash = request.params[0].get_str();
-        int32_t nTipHeight;
-        if (ParseInt32(sTipHash, &nTipHeight))
-        {
-            pTipIndex = chainActive[nTipHeight];
-            if (!pTipIndex)
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found.");
-        }
-        else
+        #ifdef ENABLE_WALLET
+        LOCK2(cs_main, pwallet ? &pwallet->cs_wallet : NULL);
+        #else
+        LOCK(cs_main);
+        #endif
+
+        CBlockIndex* pTipIndex = nullptr;
+        if (request.params.size() > 0)
         {
-            if (sTipHash == "tip" || sTipHash.empty())
+            std::string sTipHash = request.params[0].get_str();
+            int32_t nTipHeight;
+            if (ParseInt32(sTipHash, &nTipHeight))
             {
-                pTipIndex = chainActive.Tip();
+                pTipIndex = chainActive[nTipHeight];
                 if (!pTipIndex)
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Chain has no tip.");
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found.");
             }
-            else if(boost::starts_with(sTipHash, "tip~"))
+            else
             {
-                int nReverseHeight;
-                if (!ParseInt32(sTipHash.substr(4,std::string::npos), &nReverseHeight))
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid block specifier.");
-                pTipIndex = chainActive.Tip();
-                if (!pTipIndex)
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Chain has no tip.");
-                while(pTipIndex && nReverseHeight>0)
+                if (sTipHash == "tip" || sTipHash.empty())
                 {
-                    pTipIndex = pTipIndex->pprev;
-                    --nReverseHeight;
+                    pTipIndex = chainActive.Tip();
+                    if (!pTipIndex)
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Chain has no tip.");
+                }
+                else if(boost::starts_with(sTipHash, "tip~"))
+                {
+                    int nReverseHeight;
+                    if (!ParseInt32(sTipHash.substr(4,std::string::npos), &nReverseHeight))
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid block specifier.");
+                    pTipIndex = chainActive.Tip();
+                    if (!pTipIndex)
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Chain has no tip.");
+                    while(pTipIndex && nReverseHeight>0)
+                    {
+                        pTipIndex = pTipIndex->pprev;
+                        --nReverseHeight;
+                    }
+                    if (!pTipIndex)
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid block specifier, chain does not go back that far.");
+                }
+                else
+                {
+                    uint256 hash(uint256S(sTipHash));
+                    if (mapBlockIndex.count(hash) == 0)
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found.");
+                    pTipIndex = mapBlockIndex[hash];
                 }
-                if (!pTipIndex)
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid block specifier, chain does not go back that far.");
-            }
-            else
-            {
-                uint256 hash(uint256S(sTipHash));
-                if (mapBlockIndex.count(hash) == 0)
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found.");
-                pTipIndex = mapBlockIndex[hash];
             }
         }
-    }
-    else
-    {
-        pTipIndex = chainActive.Tip();
-    }
+        else
+        {
+            pTipIndex = chainActive.Tip();
+        }
 
-    if (!pTipIndex || pTipIndex->nHeight < GetPhase2ActivationHeight())
-        return NullUniValue;
+        if (!pTipIndex || pTipIndex->nHeight < GetPhase2ActivationHeight())
+            return NullUniValue;
 
-    if (request.params.size() >= 2)
-        fVerbose = request.params[1].get_bool();
+        if (request.params.size() >= 2)
+            fVerbose = request.params[1].get_bool();
 
-    if (request.params.size() > 2)
-        showMineOnly = request.params[2].get_bool();
+        if (request.params.size() > 2)
+            showMineOnly = request.params[2].get_bool();
 
-    CBlockIndex* pTipIndex_ = nullptr;
-    //fixme: (2.0.x) - Fix this to only do a shallow clone of whats needed (need to fix recursive cloning mess first)
-    CCloneChain tempChain(chainActive, GetPow2ValidationCloneHeight(chainActive, pTipIndex, 10), pTipIndex, pTipIndex_);
+        #ifdef ENABLE_WALLET
+        // The earnings of our own witness accounts come from the history the wallet keeps for them, which needs cs_main as well.
+        if (fVerbose && pwallet)
+        {
+            for (const auto& [accountUUID, account] : pwallet->mapAccounts)
+            {
+                (unused)accountUUID;
+                if (account->IsPoW2Witness())
+                    pwallet->GetWitnessAccountHistory(account, witnessAccountHistories[account]);
+            }
+        }
+        #endif
 
-    if (!pTipIndex_)
-        throw std::runtime_error("Could not locate a valid PoW² chain that contains this block as tip.");
-    CCoinsViewCache viewNew(pcoinsTip);
-    CValidationState state;
-    if (!ForceActivateChain(pTipIndex_, nullptr, state, Params(), tempChain, viewNew))
-        throw std::runtime_error("Could not locate a valid PoW² chain that contains this block as tip.");
-    if (!state.IsValid())
-        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
-
-    if (IsPow2Phase5Active(pTipIndex_, Params(), tempChain, &viewNew))
-        nPow2Phase = 5;
-    else if (IsPow2Phase4Active(pTipIndex_, Params(), tempChain, &viewNew))
-        nPow2Phase = 4;
-    else if (IsPow2Phase3Active(pTipIndex_->nHeight))
-        nPow2Phase = 3;
-    else if (IsPow2Phase2Active(pTipIndex_, Params(), tempChain, &viewNew))
-        nPow2Phase = 2;
+        if (request.params.size() > 3)
+        {
+            if (request.params[3].get_int64() < 0)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start, must not be negative.");
+            nListStart = request.params[3].get_int64();
+        }
 
-    CGetWitnessInfo witInfo;
+        if (request.params.size() > 4)
+        {
+            if (request.params[4].get_int64() < 0)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must not be negative.");
+            nListCount = request.params[4].get_int64();
+        }
 
-    if (nPow2Phase >= 2)
-    {
-        CBlock block;
+        CBlockIndex* pTipIndex_ = nullptr;
+        std::unique_ptr<CChain> tempChain;
+        CCoinsViewCache viewNew(pcoinsTip);
+        CValidationState state;
+
+        // Restore the state after pTipIndex from undo data if we can, this is much cheaper than cloning the chain and force activating pTipIndex on the clone.
+        {
+            CCoinsViewCache viewRestore(&viewNew);
+            if (RestoreViewToBlock(chainActive, pTipIndex, viewRestore, Params()))
+            {
+                viewRestore.Flush();
+                pTipIndex_ = pTipIndex;
+                tempChain.reset(new CBranchChain(chainActive, pTipIndex_));
+            }
+        }
+
+        if (!tempChain)
         {
-            LOCK(cs_main);// cs_main lock required for ReadBlockFromDisk
-            if (!ReadBlockFromDisk(block, pTipIndex_, Params()))
-                throw std::runtime_error("Could not load block to obtain PoW² information.");
+            //fixme: (2.0.x) - Fix this to only do a shallow clone of whats needed (need to fix recursive cloning mess first)
+            tempChain.reset(new CCloneChain(chainActive, GetPow2ValidationCloneHeight(chainActive, pTipIndex, 10), pTipIndex, pTipIndex_));
+
+            if (!pTipIndex_)
+                throw std::runtime_error("Could not locate a valid PoW² chain that contains this block as tip.");
+            if (!ForceActivateChain(pTipIndex_, nullptr, state, Params(), *tempChain, viewNew))
+                throw std::runtime_error("Could not locate a valid PoW² chain that contains this block as tip.");
+            if (!state.IsValid())
+                throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
         }
 
-        if (!GetWitnessInfo(tempChain, Params(), &viewNew, pTipIndex_->pprev, block, witInfo, pTipIndex_->nHeight))
-            throw std::runtime_error("Could not enumerate all PoW² witness information for block.");
+        if (IsPow2Phase5Active(pTipIndex_, Params(), *tempChain, &viewNew))
+            nPow2Phase = 5;
+        else if (IsPow2Phase4Active(pTipIndex_, Params(), *tempChain, &viewNew))
+            nPow2Phase = 4;
+        else if (IsPow2Phase3Active(pTipIndex_->nHeight))
+            nPow2Phase = 3;
+        else if (IsPow2Phase2Active(pTipIndex_, Params(), *tempChain, &viewNew))
+            nPow2Phase = 2;
 
-        if (!GetPow2NetworkWeight(pTipIndex_, Params(), nNumWitnessAddressesAll, nTotalWeightAll, tempChain, &viewNew))
-            throw std::runtime_error("Block does not form part of a valid PoW² chain.");
+        nTipIndexHeight = pTipIndex_->nHeight;
 
-        if (nPow2Phase >= 3)
+        if (nPow2Phase >= 2)
         {
-            if (!GetWitnessHelper(block.GetHashLegacy(), witInfo, pTipIndex_->nHeight))
-                throw std::runtime_error("Could not select a valid PoW² witness for block.");
+            CBlock block;
+            {
+                LOCK(cs_main);// cs_main lock required for ReadBlockFromDisk
+                if (!ReadBlockFromDisk(block, pTipIndex_, Params()))
+                    throw std::runtime_error("Could not load block to obtain PoW² information.");
+            }
 
-            CTxDestination selectedWitnessAddress;
-            if (!ExtractDestination(witInfo.selectedWitnessTransaction, selectedWitnessAddress))
-                throw std::runtime_error("Could not extract PoW² witness for block.");
+            // From phase 3 the witness is selected as well; GetWitness also fills in everything GetWitnessInfo would and can answer from the witness selection cache.
+            if (nPow2Phase >= 3)
+            {
+                if (!GetWitness(*tempChain, Params(), &viewNew, pTipIndex_->pprev, block, witInfo))
+                    throw std::runtime_error("Could not select a valid PoW² witness for block.");
+            }
+            else if (!GetWitnessInfo(*tempChain, Params(), &viewNew, pTipIndex_->pprev, block, witInfo, pTipIndex_->nHeight))
+            {
+                throw std::runtime_error("Could not enumerate all PoW² witness information for block.");
+            }
 
-            sWitnessAddress = CGuldenAddress(selectedWitnessAddress).ToString();
+            if (!GetPow2NetworkWeight(pTipIndex_, Params(), nNumWitnessAddressesAll, nTotalWeightAll, *tempChain, &viewNew))
+                throw std::runtime_error("Block does not form part of a valid PoW² chain.");
+
+            if (nPow2Phase >= 3)
+            {
+                CTxDestination selectedWitnessAddress;
+                if (!ExtractDestination(witInfo.selectedWitnessTransaction, selectedWitnessAddress))
+                    throw std::runtime_error("Could not extract PoW² witness for block.");
+
+                sWitnessAddress = CGuldenAddress(selectedWitnessAddress).ToString();
+            }
         }
     }
 
     if (fVerbose)
     {
+        #ifdef ENABLE_WALLET
+        LOCK(pwallet->cs_wallet); // Required for accountNameForAddress
+        #endif
+
+        std::map<COutPoint, const RouletteItem*> filteredPool;
+        for (const auto& item : witInfo.witnessSelectionPoolFiltered)
+            filteredPool.emplace(item.outpoint, &item);
+        std::map<COutPoint, const RouletteItem*> unfilteredPool;
+        for (const auto& item : witInfo.witnessSelectionPoolUnfiltered)
+            unfilteredPool.emplace(item.outpoint, &item);
+
         for (auto& iter : witInfo.allWitnessCoins)
         {
             bool fEligible = false;
             uint64_t nAdjustedWeight = 0;
             {
-                auto poolIter = witInfo.witnessSelectionPoolFiltered.begin();
-                while (poolIter != witInfo.witnessSelectionPoolFiltered.end())
+                auto poolIter = filteredPool.find(iter.first);
+                if (poolIter != filteredPool.end() && poolIter->second->coin.out == iter.second.out)
                 {
-                    if (poolIter->outpoint == iter.first)
-                    {
-                        if (poolIter->coin.out == iter.second.out)
-                        {
-                            nAdjustedWeight = poolIter->nWeight;
-                            fEligible = true;
-                            break;
-                        }
-                    }
-                    ++poolIter;
+                    nAdjustedWeight = poolIter->second->nWeight;
+                    fEligible = true;
                 }
             }
             bool fExpired = false;
             {
-                auto poolIter = witInfo.witnessSelectionPoolUnfiltered.begin();
-                while (poolIter != witInfo.witnessSelectionPoolUnfiltered.end())
+                auto poolIter = unfilteredPool.find(iter.first);
+                if (poolIter != unfilteredPool.end() && poolIter->second->coin.out == iter.second.out)
                 {
-                    if (poolIter->outpoint == iter.first)
+                    if (witnessHasExpired(poolIter->second->nAge, poolIter->second->nWeight, witInfo.nTotalWeightRaw))
                     {
-                        if (poolIter->coin.out == iter.second.out)
-                        {
-                            if (witnessHasExpired(poolIter->nAge, poolIter->nWeight, witInfo.nTotalWeightRaw))
-                            {
-                                fExpired = true;
-                            }
-                            break;
-                        }
+                        fExpired = true;
                     }
-                    ++poolIter;
                 }
             }
 
@@ -362,15 +516,31 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             uint64_t nLockUntilBlock = 0;
             uint64_t nLockPeriodInBlocks = GetPoW2LockLengthInBlocksFromOutput(iter.second.out, iter.second.nHeight, nLockFromBlock, nLockUntilBlock);
             uint64_t nRawWeight = GetPoW2RawWeightForAmount(iter.second.out.nValue, nLockPeriodInBlocks);
-            uint64_t nAge = pTipIndex_->nHeight - nLastActiveBlock;
+            uint64_t nAge = nTipIndexHeight - nLastActiveBlock;
             CAmount nValue = iter.second.out.nValue;
 
-            bool fLockPeriodExpired = (GetPoW2RemainingLockLengthInBlocks(nLockUntilBlock, pTipIndex_->nHeight) == 0);
+            bool fLockPeriodExpired = (GetPoW2RemainingLockLengthInBlocks(nLockUntilBlock, nTipIndexHeight) == 0);
 
             #ifdef ENABLE_WALLET
-            std::string accountName = accountNameForAddress(*pwallet, address);
+            CAccount* account = accountForAddress(*pwallet, address);
+            std::string accountName = account ? account->getLabel() : "";
             #endif
 
+            witnessWeightStats(nRawWeight);
+            lockPeriodWeightStats(nLockPeriodInBlocks);
+            witnessAmountStats(nValue);
+            ageStats(nAge);
+
+            #ifdef ENABLE_WALLET
+            if (showMineOnly && accountName.empty())
+                continue;
+            #endif
+
+            // The statistics cover all addresses, but only the requested page of the address list is output.
+            uint64_t nListIndex = nNumListedAddresses++;
+            if (nListIndex < nListStart || (nListCount > 0 && nListIndex >= nListStart + nListCount))
+                continue;
+
             UniValue rec(UniValue::VOBJ);
             rec.push_back(Pair("type", iter.second.out.GetTypeAsString()));
             rec.push_back(Pair("address", CGuldenAddress(address).ToString()));
@@ -393,20 +563,34 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             //rec.push_back(Pair("action_nonce", fExpired));
             #ifdef ENABLE_WALLET
             rec.push_back(Pair("ismine_accountname", accountName));
+            const auto historyIter = witnessAccountHistories.find(account);
+            if (historyIter != witnessAccountHistories.end())
+            {
+                const CWitnessAccountHistory& history = historyIter->second;
+                UniValue earnings(UniValue::VOBJ);
+                earnings.push_back(Pair("rewards_to_date", ValueFromAmount(history.nRewardsToDate)));
+                earnings.push_back(Pair("reward_count", history.nRewardCount));
+                earnings.push_back(Pair("last_reward_block", history.nLastRewardHeight));
+                earnings.push_back(Pair("average_reward_period", history.GetAverageRewardPeriod()));
+                UniValue actions(UniValue::VARR);
+                for (const CWitnessAccountEvent& event : history.vEvents)
+                {
+                    if (event.type == CWitnessAccountEvent::Reward)
+                        continue;
+                    UniValue action(UniValue::VOBJ);
+                    action.push_back(Pair("action", WitnessAccountEventTypeToString(event.type)));
+                    action.push_back(Pair("txid", event.hashTx.GetHex()));
+                    action.push_back(Pair("block", event.nHeight));
+                    action.push_back(Pair("amount", ValueFromAmount(event.nAmount)));
+                    actions.push_back(action);
+                }
+                earnings.push_back(Pair("actions", actions));
+                rec.push_back(Pair("ismine_account_earnings", earnings));
+            }
             #else
             rec.push_back(Pair("ismine_accountname", ""));
             #endif
 
-            witnessWeightStats(nRawWeight);
-            lockPeriodWeightStats(nLockPeriodInBlocks);
-            witnessAmountStats(nValue);
-            ageStats(nAge);
-
-            #ifdef ENABLE_WALLET
-            if (showMineOnly && accountName.empty())
-                continue;
-            #endif
-
             jsonAllWitnessAddresses.push_back(rec);
         }
     }
@@ -469,6 +653,7 @@ static UniValue getwitnessinfo(const JSONRPCRequest& request)
             }
         }
         rec.push_back(Pair("witness_statistics", averages));
+        rec.push_back(Pair("number_of_listed_addresses", nNumListedAddresses));
         rec.push_back(Pair("witness_address_list", jsonAllWitnessAddresses));
     }
     witnessInfoForBlock.push_back(rec);
@@ -486,6 +671,7 @@ static UniValue disablewitnessing(const JSONRPCRequest& request)
     }
 
     witnessingEnabled = false;
+    ClearWitnessKeyCache();
     return true;
 }
 
@@ -499,9 +685,64 @@ static UniValue enablewitnessing(const JSONRPCRequest& request)
     }
 
     witnessingEnabled = true;
+    WakeWitnessThread();
     return true;
 }
 
+/** The blocks the chain statistics dumps go over: from start_height blocks below the tip, count - 1 blocks going backwards (stopping short of genesis). */
+static std::vector<const CBlockIndex*> GetChainSliceBackwards(int nStart, int nCount)
+{
+    LOCK(cs_main);
+    const CBlockIndex* pBlock = chainActive.Tip();
+    while (pBlock && pBlock->pprev && --nStart > 0)
+        pBlock = pBlock->pprev;
+    std::vector<const CBlockIndex*> vBlocks;
+    while (pBlock && pBlock->pprev && --nCount > 0)
+    {
+        vBlocks.push_back(pBlock);
+        pBlock = pBlock->pprev;
+    }
+    return vBlocks;
+}
+
+/** Transaction counts by number of inputs and outputs (7 and up counted together) of a block, or the sum of several. */
+struct CBlockTxShape
+{
+    static const int MAX_BUCKET = 7;
+    int64_t nTx = 0;
+    int64_t nInputs[MAX_BUCKET + 1] = {};
+    int64_t nOutputs[MAX_BUCKET + 1] = {};
+
+    void Add(const CTransaction& tx)
+    {
+        ++nTx;
+        ++nInputs[std::min<size_t>(tx.vin.size(), MAX_BUCKET)];
+        ++nOutputs[std::min<size_t>(tx.vout.size(), MAX_BUCKET)];
+    }
+
+    void Merge(const CBlockTxShape& other)
+    {
+        nTx += other.nTx;
+        for (int i = 0; i <= MAX_BUCKET; ++i)
+        {
+            nInputs[i] += other.nInputs[i];
+            nOutputs[i] += other.nOutputs[i];
+        }
+    }
+};
+
+//! Blocks whose shape dumptransactionstats remembers; a block doesn't change, so entries never go stale.
+static const size_t BLOCK_TX_SHAPE_CACHE_SIZE = 20000;
+//! Blocks read by one task of dumptransactionstats.
+static const size_t TX_STATS_RANGE_SIZE = 64;
+
+//! Allocated on first use, most nodes never run the dumps.
+static CClockCache<uint256, CBlockTxShape, BlockHasher>& GetBlockTxShapeCache()
+{
+    static CClockCache<uint256, CBlockTxShape, BlockHasher> cache(BLOCK_TX_SHAPE_CACHE_SIZE);
+    return cache;
+}
+
 static UniValue dumpdiffarray(const JSONRPCRequest& request)
 {
     CWallet* const pwallet = GetWalletForJSONRPCRequest(request);
@@ -525,7 +766,12 @@ static UniValue dumpdiffarray(const JSONRPCRequest& request)
     unsigned int nNumToOutput = request.params[0].get_int();
     reverseOutBuffer.reserve(16*nNumToOutput);
 
-    CBlockIndex* pBlock = chainActive.Tip();
+    // Block index entries are never freed, so once found the walk can go on without cs_main.
+    const CBlockIndex* pBlock;
+    {
+        LOCK(cs_main);
+        pBlock = chainActive.Tip();
+    }
     while(pBlock->pprev && (unsigned int)pBlock->nHeight > nNumToOutput)
         pBlock = pBlock->pprev;
 
@@ -568,24 +814,15 @@ static UniValue dumpblockgaps(const JSONRPCRequest& request)
 
     RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VNUM));
 
-    int nStart = request.params[0].get_int();
-    int nNumToOutput = request.params[1].get_int();
-
-    CBlockIndex* pBlock = chainActive.Tip();
+    std::vector<const CBlockIndex*> vBlocks = GetChainSliceBackwards(request.params[0].get_int(), request.params[1].get_int());
 
     UniValue jsonGaps(UniValue::VARR);
 
     boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::median(boost::accumulators::with_p_square_quantile), boost::accumulators::tag::mean, boost::accumulators::tag::min, boost::accumulators::tag::max> > gapStats;
 
-    while(pBlock && pBlock->pprev && --nStart>0)
-    {
-        pBlock = pBlock->pprev;
-    }
-
-    while(pBlock && pBlock->pprev && --nNumToOutput>0)
+    for (const CBlockIndex* pBlock : vBlocks)
     {
         int64_t gap = std::abs((int64_t)pBlock->nTime - (int64_t)pBlock->pprev->nTime);
-        pBlock = pBlock->pprev;
         if (gap > 6000)
         {
             continue;
@@ -625,58 +862,44 @@ static UniValue dumptransactionstats(const JSONRPCRequest& request)
 
     RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VNUM));
 
-    int nStart = request.params[0].get_int();
-    int nNumToOutput = request.params[1].get_int();
-
-    CBlockIndex* pBlock = chainActive.Tip();
-
-    UniValue jsonGaps(UniValue::VARR);
+    std::vector<const CBlockIndex*> vBlocks = GetChainSliceBackwards(request.params[0].get_int(), request.params[1].get_int());
 
-    while(pBlock && pBlock->pprev && --nStart>0)
+    // The blocks are read in ranges in parallel, without cs_main; blocks counted before come from the cache.
+    auto& blockTxShapeCache = GetBlockTxShapeCache();
+    std::vector<CBlockTxShape> rangeShapes((vBlocks.size() + TX_STATS_RANGE_SIZE - 1) / TX_STATS_RANGE_SIZE);
     {
-        pBlock = pBlock->pprev;
-    }
-
-    int count = 0;
-    std::map<int64_t, int64_t> inputCount;
-    std::map<int64_t, int64_t> outputCount;
-    inputCount[1]=outputCount[1]=0;
-    inputCount[2]=outputCount[2]=0;
-    inputCount[3]=outputCount[3]=0;
-    inputCount[4]=outputCount[4]=0;
-    inputCount[5]=outputCount[5]=0;
-    inputCount[6]=outputCount[6]=0;
-    inputCount[7]=outputCount[7]=0;
-
-    while(pBlock && pBlock->pprev && --nNumToOutput>0)
-    {
-        CBlock block;
-        LOCK(cs_main);// cs_main lock required for ReadBlockFromDisk
-        if (ReadBlockFromDisk(block, pBlock, Params()))
+        CTaskGroup group(GetExecutor(), EXECUTOR_RPC);
+        for (size_t nRange = 0; nRange < rangeShapes.size(); ++nRange)
         {
-            for (auto transaction : block.vtx)
+            group.Run([&, nRange]()
             {
-                ++count;
-                if (transaction->vin.size() >=7)
-                {
-                    ++inputCount[7];
-                }
-                else
-                {
-                    ++inputCount[transaction->vin.size()];
-                }
-                if (transaction->vout.size() >=7)
+                for (size_t i = nRange * TX_STATS_RANGE_SIZE; i < std::min((nRange + 1) * TX_STATS_RANGE_SIZE, vBlocks.size()); ++i)
                 {
-                    ++outputCount[7];
-                }
-                else
-                {
-                    ++outputCount[transaction->vout.size()];
+                    const uint256 hash = vBlocks[i]->GetBlockHashPoW2();
+                    CBlockTxShape shape;
+                    if (!blockTxShapeCache.tryGet(hash, shape))
+                    {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, vBlocks[i], Params()))
+                            continue;
+                        for (const auto& transaction : block.vtx)
+                            shape.Add(*transaction);
+                        blockTxShapeCache.insert(hash, shape);
+                    }
+                    rangeShapes[nRange].Merge(shape);
                 }
-            }
+            });
         }
-        pBlock = pBlock->pprev;
+        group.Wait();
     }
+    CBlockTxShape total;
+    for (const CBlockTxShape& shape : rangeShapes)
+        total.Merge(shape);
+
+    UniValue jsonGaps(UniValue::VARR);
+    int64_t count = total.nTx;
+    const int64_t* inputCount = total.nInputs;
+    const int64_t* outputCount = total.nOutputs;
 
     jsonGaps.push_back("count:");
     jsonGaps.push_back(count);
@@ -2618,12 +2841,10 @@ static UniValue resetconfig_pi_lowmem(const JSONRPCRequest& request)
     {
         streamConfig << keepLine << "\n";
     }
-    streamConfig << "maxconnections=10\n";
-    streamConfig << "maxmempool=50\n";
-    streamConfig << "dbcache=50\n";
+    // The memory budget sizes the caches, mempool and connections from it and moves memory between them as the node syncs.
+    streamConfig << "memorybudget=160\n";
     streamConfig << "rpcthreads=1\n";
     streamConfig << "par=1\n";
-    streamConfig << "reverseheaders=false\n";
 
     return NullUniValue;
 }
@@ -2664,10 +2885,8 @@ static UniValue resetconfig_pi_medmem(const JSONRPCRequest& request)
     {
         streamConfig << keepLine << "\n";
     }
-    streamConfig << "maxmempool=100\n";
-    streamConfig << "dbcache=200\n";
+    streamConfig << "memorybudget=512\n";
     streamConfig << "rpcthreads=1\n";
-    streamConfig << "reverseheaders=false\n";
 
     return NullUniValue;
 }
@@ -2697,6 +2916,7 @@ static UniValue getlastblocks(const JSONRPCRequest& request)
 
     LogPrintf("getlastblocks requested.\n");
     UniValue result(UniValue::VOBJ);    
+    LOCK(cs_main);
     if (chainActive.Tip()->nHeight > 30)
     {
         CBlockIndex* pIndex = chainActive.Tip();
@@ -3549,7 +3769,7 @@ static const CRPCCommand commands[] =
 { //  category                   name                               actor (function)                 okSafeMode
   //  ---------------------      ------------------------           -----------------------          ----------
     { "mining",                  "gethashps",                       &gethashps,                      true,    {} },
-    { "mining",                  "sethashlimit",                    &sethashlimit,                   true,    {"limit"} },
+    { "mining",                  "sethashlimit",                    &sethashlimit,                   true,    {"limit","dutycycle"} },
     { "mining",                  "createminingaccount",             &createminingaccount,            true,    {"name"} },
     { "mining",                  "setminingrewardaddress",          &setminingrewardaddress,         true,    {"reward_address"} },
     { "mining",                  "getminingrewardaddress",          &getminingrewardaddress,         true,    {""} },
@@ -3563,7 +3783,7 @@ static const CRPCCommand commands[] =
     { "witness",                 "getwitnessaccountkeys",           &getwitnessaccountkeys,          true,    {"witness_account"} },
     { "witness",                 "getwitnessaddresskeys",           &getwitnessaddresskeys,          true,    {"witness_address"} },
     { "witness",                 "getwitnesscompound",              &getwitnesscompound,             true,    {"witness_account"} },
-    { "witness",                 "getwitnessinfo",                  &getwitnessinfo,                 true,    {"block_specifier", "verbose", "mine_only"} },
+    { "witness",                 "getwitnessinfo",                  &getwitnessinfo,                 true,    {"block_specifier", "verbose", "mine_only", "start", "count"}, false, RPC_CACHE_TIP },
     { "witness",                 "getwitnessrewardscript",          &getwitnessrewardscript,         true,    {"witness_account"} },
     { "witness",                 "importwitnesskeys",               &importwitnesskeys,              true,    {"account_name", "encoded_key_url", "create_account"} },
     { "witness",                 "mergewitnessaccount",             &mergewitnessaccount,            true,    {"funding_account", "witness_account"} },
@@ -8,6 +8,7 @@
 #include "wallet/wallet.h"
 #endif
 #include "util.h"
+#include "metrics.h"
 #include "consensus/validation.h"
 #include "validation/validation.h"
 #include "validation/versionbitsvalidation.h"
@@ -17,7 +18,6 @@
 #include "txdb.h"
 
 #include "primitives/transaction.h"
-#include <LRUCache/LRUCache11.hpp>
 
 
 #ifdef ENABLE_WALLET
@@ -173,11 +173,30 @@ bool IsPow2Phase4Active(const CBlockIndex* pIndex, const CChainParams& chainpara
 {
     DO_BENCHMARK("WIT: IsPow2Phase4Active", BCLog::BENCH|BCLog::WITNESS);
 
+    // The memo in the index is shared by all threads so may only be touched under cs_main.
+    #ifdef ENABLE_WALLET
+    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
+    #else
+    LOCK(cs_main);
+    #endif
+
     // First make sure that none of the obvious conditions that would preclude us from being active are true, if they are we can just abort testing immediately.
     static int checkDepth = IsArgSet("-testnet") ? 10 : 778301+17280;
     if (!pIndex || !pIndex->pprev || pIndex->nHeight < checkDepth )
         return false;
 
+    // Once known for a block the answer never changes; and once active for a block it is active for all its descendants.
+    // Only answers computed against the tip view are remembered, a temporary view (e.g. for a chain being tested) mustn't decide them for the real chain.
+    bool fMemoise = (viewOverride == nullptr || viewOverride == pcoinsTip);
+    if (pIndex->nPoW2Phase4Active >= 0)
+        return pIndex->nPoW2Phase4Active;
+    if (pIndex->pprev->nPoW2Phase4Active == 1)
+    {
+        if (fMemoise)
+            pIndex->nPoW2Phase4Active = 1;
+        return true;
+    }
+
     // Optimisation - If we have never activated phase 3 then phase 4 can't possibly be active either.
     if (phase3ActivationHash == uint256())
         return false;
@@ -191,7 +210,11 @@ bool IsPow2Phase4Active(const CBlockIndex* pIndex, const CChainParams& chainpara
         while (pIndexPrev)
         {
             if (pIndexPrev->GetBlockHashPoW2() == phase4ActivationHash)
+            {
+                if (fMemoise)
+                    pIndex->nPoW2Phase4Active = 1;
                 return true;
+            }
             // No point searching any further as we won't find any true matches below this depth.
             if (pIndexPrev->nHeight < checkDepth)
                 break;
@@ -200,13 +223,10 @@ bool IsPow2Phase4Active(const CBlockIndex* pIndex, const CChainParams& chainpara
     }
 
     {
-        #ifdef ENABLE_WALLET
-        LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
-        #else
-        LOCK(cs_main);
-        #endif
         // Version bits - mined by PoW but controlled by witnesses.
         bool ret = (VersionBitsState(pIndex, chainparams.GetConsensus(), Consensus::DEPLOYMENT_POW2_PHASE4, versionbitscache) == THRESHOLD_ACTIVE);
+        if (fMemoise)
+            pIndex->nPoW2Phase4Active = ret ? 1 : 0;
         // If we are the first ever block to test as active, or if the previous active block is not our parent (can happen in the case of a fork from before activation)
         // Then set ourselves as the activation hash.
         if (ret)
@@ -238,6 +258,18 @@ bool IsPow2Phase5Active(const CBlockIndex* pIndex, const CChainParams& params, C
     if (!pIndex || !pIndex->pprev || pIndex->nHeight < checkDepth )
         return false;
 
+    // Once known for a block the answer never changes; and once active for a block it is active for all its descendants.
+    // As for phase 4 only answers computed against the tip view are remembered.
+    bool fMemoise = (viewOverride == nullptr || viewOverride == pcoinsTip);
+    if (pIndex->nPoW2Phase5Active >= 0)
+        return pIndex->nPoW2Phase5Active;
+    if (pIndex->pprev->nPoW2Phase5Active == 1)
+    {
+        if (fMemoise)
+            pIndex->nPoW2Phase5Active = 1;
+        return true;
+    }
+
     // Optimisation - If we have never activated phase 4 then phase 5 can't possibly be active either.
     if (phase4ActivationHash == uint256())
         return false;
@@ -251,7 +283,11 @@ bool IsPow2Phase5Active(const CBlockIndex* pIndex, const CChainParams& params, C
         while (pIndexPrev)
         {
             if (pIndexPrev->GetBlockHashPoW2() == phase5ActivationHash)
+            {
+                if (fMemoise)
+                    pIndex->nPoW2Phase5Active = 1;
                 return true;
+            }
             // No point searching any further as we won't find any true matches below this depth.
             if (pIndexPrev->nHeight < checkDepth)
                 break;
@@ -262,6 +298,8 @@ bool IsPow2Phase5Active(const CBlockIndex* pIndex, const CChainParams& params, C
     // Phase 5 can't be active if phase 4 is not.
     if (!IsPow2Phase4Active(pIndex, params, chain, viewOverride))
     {
+        if (fMemoise && pIndex->nPoW2Phase4Active == 0)
+            pIndex->nPoW2Phase5Active = 0;
         return false;
     }
 
@@ -273,13 +311,21 @@ bool IsPow2Phase5Active(const CBlockIndex* pIndex, const CChainParams& params, C
     for (auto iter : allWitnessCoins)
     {
         if (iter.second.out.GetType() != CTxOutType::PoW2WitnessOutput)
+        {
+            if (fMemoise)
+                pIndex->nPoW2Phase5Active = 0;
             return false;
+        }
     }
 
     // If we are the first ever block to test as active, or if the previous active block is not our parent (can happen in the case of a fork from before activation)
     // Then set ourselves as the activation hash.
-    phase5ActivationHash = pIndex->GetBlockHashPoW2();
-    ppow2witdbview->SetPhase5ActivationHash(phase5ActivationHash);
+    if (fMemoise)
+    {
+        phase5ActivationHash = pIndex->GetBlockHashPoW2();
+        ppow2witdbview->SetPhase5ActivationHash(phase5ActivationHash);
+        pIndex->nPoW2Phase5Active = 1;
+    }
     return true;
 }
 
@@ -328,6 +374,12 @@ int64_t GetPoW2RawWeightForAmount(int64_t nAmount, int64_t nLockLengthInBlocks)
 }
 
 
+int64_t GetPoW2RawWeightForOutput(const CTxOut& out, uint64_t txBlockNumber)
+{
+    uint64_t nUnused1, nUnused2;
+    return GetPoW2RawWeightForAmount(out.nValue, GetPoW2LockLengthInBlocksFromOutput(out, txBlockNumber, nUnused1, nUnused2));
+}
+
 int64_t GetPoW2LockLengthInBlocksFromOutput(const CTxOut& out, uint64_t txBlockNumber, uint64_t& nFromBlockOut, uint64_t& nUntilBlockOut)
 {
     if ( (out.GetType() <= CTxOutType::ScriptLegacyOutput && out.output.scriptPubKey.IsPoW2Witness()) )
@@ -378,22 +430,37 @@ int64_t GetPoW2Phase3ActivationTime(CChain& chain, CCoinsViewCache* viewOverride
     return 0;
 }
 
-typedef std::pair<int64_t, int64_t> NumAndWeight;
-typedef lru11::Cache<uint256, NumAndWeight, lru11::NullLock, std::unordered_map<uint256, typename std::list<lru11::KeyValuePair<uint256, NumAndWeight>>::iterator, BlockHasher>> BlockWeightCache;
-BlockWeightCache networkWeightCache(800,100);
 bool GetPow2NetworkWeight(const CBlockIndex* pIndex, const CChainParams& chainparams, int64_t& nNumWitnessAddresses, int64_t& nTotalWeight, CChain& chain, CCoinsViewCache* viewOverride)
 {
     DO_BENCHMARK("WIT: GetPow2NetworkWeight", BCLog::BENCH|BCLog::WITNESS);
 
-    const auto& blockHash = pIndex->GetBlockHashPoW2();
-    if (networkWeightCache.contains(blockHash))
+    // The totals are normally kept up to date on the block index by ConnectBlock.
+    // For a witnessed phase 3 block the witness set is that of the PoW block it is based on, so the totals of that block are what we want.
+    CBlockIndex* pTotalsIndex = nullptr;
     {
-        const auto& cachePair = networkWeightCache.get(blockHash);
-        nNumWitnessAddresses = cachePair.first;
-        nTotalWeight = cachePair.second;
-        return true;
+        LOCK(cs_main);
+
+        if (pIndex->nVersionPoW2Witness==0 || IsPow2Phase4Active(pIndex->pprev, chainparams, chain, viewOverride?viewOverride:pcoinsTip))
+        {
+            pTotalsIndex = const_cast<CBlockIndex*>(pIndex);
+        }
+        else
+        {
+            BlockMap::iterator iter = mapBlockIndex.find(pIndex->GetBlockHashLegacy());
+            if (iter != mapBlockIndex.end())
+                pTotalsIndex = iter->second;
+        }
+
+        if (pTotalsIndex && pTotalsIndex->nWitnessTotalWeight >= 0)
+        {
+            nNumWitnessAddresses = pTotalsIndex->nWitnessCount;
+            nTotalWeight = pTotalsIndex->nWitnessTotalWeight;
+            return true;
+        }
     }
 
+    // Locks are only needed to capture the witness set, not to sum it up.
+    std::map<COutPoint, Coin> allWitnessCoins;
     {
         #ifdef ENABLE_WALLET
         LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
@@ -401,26 +468,29 @@ bool GetPow2NetworkWeight(const CBlockIndex* pIndex, const CChainParams& chainpa
         LOCK(cs_main);
         #endif
 
-        std::map<COutPoint, Coin> allWitnessCoins;
         if (!getAllUnspentWitnessCoins(chain, chainparams, pIndex, allWitnessCoins, nullptr, viewOverride))
             return error("GetPow2NetworkWeight: Failed to enumerate all unspent witness coins");
+    }
 
-        nNumWitnessAddresses = 0;
-        nTotalWeight = 0;
+    nNumWitnessAddresses = 0;
+    nTotalWeight = 0;
 
-        for (auto iter : allWitnessCoins)
+    for (const auto& iter : allWitnessCoins)
+    {
+        if (pIndex == nullptr || iter.second.nHeight <= pIndex->nHeight)
         {
-            if (pIndex == nullptr || iter.second.nHeight <= pIndex->nHeight)
-            {
-                CTxOut output = iter.second.out;
-
-                uint64_t nUnused1, nUnused2;
-                nTotalWeight += GetPoW2RawWeightForAmount(output.nValue, GetPoW2LockLengthInBlocksFromOutput(output, iter.second.nHeight, nUnused1, nUnused2));
-                ++nNumWitnessAddresses;
-            }
+            nTotalWeight += GetPoW2RawWeightForOutput(iter.second.out, iter.second.nHeight);
+            ++nNumWitnessAddresses;
         }
     }
-    networkWeightCache.insert(blockHash, std::pair(nNumWitnessAddresses, nTotalWeight));
+
+    // Remember the totals so that this is computed at most once per block; blocks connected on top of this one can then also keep them up to date.
+    if (pTotalsIndex && !viewOverride)
+    {
+        LOCK(cs_main);
+        pTotalsIndex->nWitnessCount = nNumWitnessAddresses;
+        pTotalsIndex->nWitnessTotalWeight = nTotalWeight;
+    }
     return true;
 }
 
@@ -432,34 +502,25 @@ CBlockIndex* GetPoWBlockForPoSBlock(const CBlockIndex* pIndex)
 
     AssertLockHeld(cs_main); // Required for ReadBlockFromDisk.
 
+    // The PoW block is normally already known; either because we received it before the witness block or because we reconstructed it earlier.
+    // Reconstructed blocks are stored like any other block, so their index entry is written to and loaded with the block index and we only ever need to go to disk for this once.
     uint256 powHash = pIndex->GetBlockHashLegacy();
-    if (!mapBlockIndex.count(powHash))
-    {
-        std::shared_ptr<CBlock> pBlockPoW(new CBlock);
-        if (!ReadBlockFromDisk(*pBlockPoW, pIndex, Params()))
-            return nullptr;
-
-        // Strip any witness information from the block we have been given to get back to the raw PoW block on which it was based.
-        for (unsigned int i = 1; i < pBlockPoW->vtx.size(); i++)
-        {
-            if (pBlockPoW->vtx[i]->IsCoinBase() && pBlockPoW->vtx[i]->IsPoW2WitnessCoinBase())
-            {
-                while (pBlockPoW->vtx.size() > i)
-                {
-                    pBlockPoW->vtx.pop_back();
-                }
-                break;
-            }
-        }
-        pBlockPoW->nVersionPoW2Witness = 0;
-        pBlockPoW->nTimePoW2Witness = 0;
-        pBlockPoW->hashMerkleRootPoW2Witness = uint256();
-        pBlockPoW->witnessHeaderPoW2Sig.clear();
-
-        if (!ProcessNewBlock(Params(), pBlockPoW, true, nullptr))
-            return nullptr;
-    }
-    return mapBlockIndex[powHash];
+    BlockMap::iterator iter = mapBlockIndex.find(powHash);
+    if (iter != mapBlockIndex.end())
+        return iter->second;
+
+    CBlock witnessBlock;
+    if (!ReadBlockFromDisk(witnessBlock, pIndex, Params()))
+        return nullptr;
+
+    // Strip any witness information from the block we have been given to get back to the raw PoW block on which it was based.
+    CBlock strippedBlock;
+    std::shared_ptr<CBlock> pBlockPoW(new CBlock(GetBlockWithoutWitness(witnessBlock, strippedBlock)));
+    if (!ProcessNewBlock(Params(), pBlockPoW, true, nullptr))
+        return nullptr;
+
+    iter = mapBlockIndex.find(powHash);
+    return (iter != mapBlockIndex.end()) ? iter->second : nullptr;
 }
 
 int GetPow2ValidationCloneHeight(CChain& chain, const CBlockIndex* pIndex, int nMargin)
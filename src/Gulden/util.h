@@ -38,6 +38,9 @@ int64_t GetPoW2Phase3ActivationTime(CChain& chain, CCoinsViewCache* viewOverride
 
 int64_t GetPoW2RawWeightForAmount(int64_t nAmount, int64_t nLockLengthInBlocks);
 
+//! Raw weight of a witness output that was created in block `txBlockNumber`
+int64_t GetPoW2RawWeightForOutput(const CTxOut& out, uint64_t txBlockNumber);
+
 
 //! Calculate how many blocks a witness transaction is locked for from an output
 //! Always use this helper instead of attempting to calculate directly - to avoid off by 1 errors.
@@ -9,6 +9,7 @@
 #include "base58.h"
 #include "wallet/walletdb.h"
 #include "wallet/crypter.h"
+#include "memusage.h"
 
 #include <map>
 
@@ -473,13 +474,54 @@ bool CAccountHD::GetKey([[maybe_unused]] const CKeyID &address, [[maybe_unused]]
 
 void CAccountHD::GetPubKey(CExtPubKey& childKey, int nChain) const
 {
-    if (nChain == KEYCHAIN_EXTERNAL)
+    auto& mapDerived = (nChain == KEYCHAIN_EXTERNAL ? mapDerivedChildKeys : mapDerivedChangeKeys);
+    uint32_t nChild = (nChain == KEYCHAIN_EXTERNAL ? m_nNextChildIndex++ : m_nNextChangeIndex++);
+
+    // Keys derived ahead for indexes that have been passed in the meantime are of no further use.
+    mapDerived.erase(mapDerived.begin(), mapDerived.lower_bound(nChild));
+    auto it = mapDerived.find(nChild);
+    if (it != mapDerived.end())
     {
-        primaryChainKeyPub.Derive(childKey, m_nNextChildIndex++);
+        childKey = it->second;
+        mapDerived.erase(it);
+        return;
     }
-    else
+    GetChainKeyPub(nChain).Derive(childKey, nChild);
+}
+
+std::vector<uint32_t> CAccountHD::GetChildIndexesToDerive(int nChain, unsigned int nCount) const
+{
+    const auto& mapDerived = (nChain == KEYCHAIN_EXTERNAL ? mapDerivedChildKeys : mapDerivedChangeKeys);
+    uint32_t nNext = (nChain == KEYCHAIN_EXTERNAL ? m_nNextChildIndex : m_nNextChangeIndex);
+
+    std::vector<uint32_t> vIndexes;
+    for (uint32_t nChild = nNext; nChild < nNext + nCount && nChild < BIP32_HARDENED_KEY_LIMIT; ++nChild)
+    {
+        if (!mapDerived.count(nChild))
+            vIndexes.push_back(nChild);
+    }
+    return vIndexes;
+}
+
+void CAccountHD::AddDerivedChildKey(int nChain, const CExtPubKey& childKey)
+{
+    uint32_t nNext = (nChain == KEYCHAIN_EXTERNAL ? m_nNextChildIndex : m_nNextChangeIndex);
+    if (childKey.nChild >= nNext)
+        (nChain == KEYCHAIN_EXTERNAL ? mapDerivedChildKeys : mapDerivedChangeKeys)[childKey.nChild] = childKey;
+}
+
+void CAccountHD::DeriveChildKeysAhead(int nChain, unsigned int nCount)
+{
+    const std::vector<uint32_t> vIndexes = GetChildIndexesToDerive(nChain, nCount);
+    const CExtPubKey& chainKey = GetChainKeyPub(nChain);
+    std::vector<CExtPubKey> vChildKeys;
+    for (size_t nRunStart = 0, nRunEnd; nRunStart < vIndexes.size(); nRunStart = nRunEnd)
     {
-        changeChainKeyPub.Derive(childKey, m_nNextChangeIndex++);
+        for (nRunEnd = nRunStart + 1; nRunEnd < vIndexes.size() && vIndexes[nRunEnd] == vIndexes[nRunEnd - 1] + 1; ++nRunEnd) {}
+        if (!chainKey.DeriveRange(vChildKeys, vIndexes[nRunStart], nRunEnd - nRunStart))
+            continue;
+        for (const CExtPubKey& childKey : vChildKeys)
+            AddDerivedChildKey(nChain, childKey);
     }
 }
 
@@ -806,6 +848,13 @@ bool CAccount::IsCrypted() const
     return externalKeyStore.IsCrypted() || internalKeyStore.IsCrypted();
 }
 
+size_t CAccount::DynamicMemoryUsage() const
+{
+    size_t nUsage = CCryptoKeyStore::DynamicMemoryUsage() + externalKeyStore.DynamicMemoryUsage() + internalKeyStore.DynamicMemoryUsage();
+    LOCK(cs_keypool);
+    return nUsage + memusage::DynamicUsage(setKeyPoolInternal) + memusage::DynamicUsage(setKeyPoolExternal);
+}
+
 bool CAccount::Lock()
 {
     // NB! We don't encrypt the keystores for witness-only accounts - as they only contain keys for witnessing.
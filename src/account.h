@@ -335,15 +335,20 @@ public:
     virtual bool HaveWatchOnly(const CScript &dest) const override;
     virtual bool HaveWatchOnly() const override;
     virtual bool HaveCScript(const CScriptID &hash) const override;
+    bool HaveCScripts() const { return externalKeyStore.HaveCScripts() || internalKeyStore.HaveCScripts(); }
     virtual bool GetCScript(const CScriptID &hash, CScript& redeemScriptOut) const override;
     virtual bool IsLocked() const override;
     virtual bool IsCrypted() const override;
+    //! Including the key stores of the external and internal chains and the key pools.
+    size_t DynamicMemoryUsage() const override;
     virtual bool Lock() override;
     virtual bool Unlock(const CKeyingMaterial& vMasterKeyIn, bool& needsWriteToDisk) override;
     virtual bool GetKey(const CKeyID& keyID, CKey& key) const override;
     virtual bool GetKey(const CKeyID &address, std::vector<unsigned char>& encryptedKeyOut) const override;
     virtual void GetKeys(std::set<CKeyID> &setAddress) const override;
     void GetKeys(std::set<CKeyID> &setAddressExternal, std::set<CKeyID> &setAddressInternal) const;
+    //! Changes whenever the keys of either key store of the account do; keys are only ever added to them, never taken away.
+    uint64_t GetKeysChangeCounter() const { return externalKeyStore.GetStoreChangeCounter() + internalKeyStore.GetStoreChangeCounter(); }
     virtual bool EncryptKeys(const CKeyingMaterial& vMasterKeyIn) override;
     virtual bool Encrypt(const CKeyingMaterial& vMasterKeyIn);
     virtual bool GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const override;
@@ -443,6 +448,13 @@ public:
     virtual bool AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey, int keyChain) override;
 
     void GetPubKey(CExtPubKey& childKey, int nChain) const;
+    //! The next (up to) nCount child indexes of nChain that GetPubKey will hand out and that aren't derived ahead of time already.
+    std::vector<uint32_t> GetChildIndexesToDerive(int nChain, unsigned int nCount) const;
+    const CExtPubKey& GetChainKeyPub(int nChain) const { return nChain == KEYCHAIN_EXTERNAL ? primaryChainKeyPub : changeChainKeyPub; }
+    //! Take a child key of nChain derived ahead of time (without the wallet lock), for GetPubKey to hand out instead of deriving it.
+    void AddDerivedChildKey(int nChain, const CExtPubKey& childKey);
+    //! Derive the next nCount child keys of nChain that GetPubKey will hand out in one go (see CExtPubKey::DeriveRange), instead of one by one as they are asked for.
+    void DeriveChildKeysAhead(int nChain, unsigned int nCount);
     bool IsHD() const override {return true;};
     uint32_t getIndex();
     boost::uuids::uuid getSeedUUID() const;
@@ -500,6 +512,9 @@ private:
     uint32_t m_nIndex = 0;
     mutable uint32_t m_nNextChildIndex = 0;
     mutable uint32_t m_nNextChangeIndex = 0;
+    //! Child keys derived ahead of time by index (see AddDerivedChildKey); in memory only.
+    mutable std::map<uint32_t, CExtPubKey> mapDerivedChildKeys;
+    mutable std::map<uint32_t, CExtPubKey> mapDerivedChangeKeys;
 
     //These members are always valid.
     CExtPubKey primaryChainKeyPub;
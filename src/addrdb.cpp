@@ -116,6 +116,7 @@ bool CBanDB::Read(banmap_t& banSet)
 CAddrDB::CAddrDB()
 {
     pathAddr = GetDataDir() / "peers.dat";
+    pathJournal = GetDataDir() / "peers.journal";
 }
 
 bool CAddrDB::Write(const CAddrMan& addr)
@@ -153,9 +154,164 @@ bool CAddrDB::Write(const CAddrMan& addr)
     if (!RenameOver(pathTmp, pathAddr))
         return error("%s: Rename-into-place failed", __func__);
 
+    // Everything is in peers.dat now; if this fails the old journal no longer matches it and is ignored.
+    return StartJournal(hash);
+}
+
+bool CAddrDB::StartJournal(const uint256& hashAddr)
+{
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char*)&randv, sizeof(randv));
+    fs::path pathTmp = GetDataDir() / strprintf("peers.journal.%04x", randv);
+
+    FILE *file = fsbridge::fopen(pathTmp, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    try {
+        fileout << FLATDATA(Params().MessageStart());
+        fileout << hashAddr;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathJournal))
+        return error("%s: Rename-into-place failed", __func__);
+    return true;
+}
+
+bool CAddrDB::ReadAddrChecksum(uint256& hash) const
+{
+    // The checksum is what peers.dat ends with.
+    FILE *file = fsbridge::fopen(pathAddr, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull() || fseek(filein.Get(), -(long)sizeof(uint256), SEEK_END) != 0)
+        return false;
+    try {
+        filein >> hash;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool CAddrDB::ReadJournalChecksum(uint256& hash) const
+{
+    FILE *file = fsbridge::fopen(pathJournal, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+    unsigned char pchMsgTmp[4];
+    try {
+        filein >> FLATDATA(pchMsgTmp);
+        filein >> hash;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)) == 0;
+}
+
+bool CAddrDB::IsJournalFull() const
+{
+    try {
+        if (!fs::exists(pathJournal) || !fs::exists(pathAddr))
+            return true;
+        return fs::file_size(pathJournal) * 100 >= fs::file_size(pathAddr) * ADDRDB_JOURNAL_MAX_PCT;
+    }
+    catch (const fs::filesystem_error&) {
+        return true;
+    }
+}
+
+bool CAddrDB::Append(const std::vector<CAddrJournalEntry>& vChanges)
+{
+    uint256 hashAddr, hashJournal;
+    if (!ReadAddrChecksum(hashAddr) || !ReadJournalChecksum(hashJournal) || hashAddr != hashJournal)
+        return false;
+
+    // size of the changes, the changes, checksum of the changes
+    CDataStream ssChanges(SER_DISK, CLIENT_VERSION);
+    ssChanges << COMPACTSIZEVECTOR(vChanges);
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << (uint32_t)ssChanges.size();
+    ssBlock << ssChanges;
+    ssBlock << Hash(ssChanges.begin(), ssChanges.end());
+
+    FILE *file = fsbridge::fopen(pathJournal, "ab");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathJournal.string());
+    try {
+        fileout << ssBlock;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
     return true;
 }
 
+void CAddrDB::ReadJournal(CAddrMan& addr, const uint256& hashAddr)
+{
+    uint256 hashJournal;
+    if (!ReadJournalChecksum(hashJournal))
+        return;
+    if (hashJournal != hashAddr) {
+        LogPrintf("%s: peers.journal is not for this peers.dat, ignoring it\n", __func__);
+        return;
+    }
+
+    FILE *file = fsbridge::fopen(pathJournal, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return;
+    uint64_t nFileSize = fs::file_size(pathJournal);
+    uint64_t nGood = 4 + sizeof(uint256);
+    size_t nChanges = 0;
+    try {
+        filein.ignore(nGood);
+        while (nGood < nFileSize) {
+            uint32_t nSize;
+            filein >> nSize;
+            if (nSize > nFileSize - nGood)
+                break;
+            std::vector<unsigned char> vchData(nSize);
+            uint256 hashIn;
+            filein.read((char *)vchData.data(), nSize);
+            filein >> hashIn;
+            if (Hash(vchData.begin(), vchData.end()) != hashIn)
+                break;
+
+            CDataStream ssChanges(vchData, SER_DISK, CLIENT_VERSION);
+            std::vector<CAddrJournalEntry> vChanges;
+            ssChanges >> COMPACTSIZEVECTOR(vChanges);
+            addr.ApplyChanges(vChanges);
+            nChanges += vChanges.size();
+            nGood += sizeof(nSize) + nSize + sizeof(uint256);
+        }
+    }
+    catch (const std::exception&) {
+    }
+    filein.fclose();
+
+    // Cut off what wasn't written completely, so that new changes aren't appended behind it.
+    if (nGood < nFileSize) {
+        LogPrintf("%s: dropping %u bytes of peers.journal that were not written completely\n", __func__, nFileSize - nGood);
+        boost::system::error_code ec;
+        fs::resize_file(pathJournal, nGood, ec);
+        // Without a journal the next flush writes everything out again.
+        if (ec)
+            fs::remove(pathJournal, ec);
+    }
+    LogPrint(BCLog::NET, "Applied %u changes from peers.journal\n", nChanges);
+}
+
 bool CAddrDB::Read(CAddrMan& addr)
 {
     // open input file, and associate with CAutoFile
@@ -191,7 +347,10 @@ bool CAddrDB::Read(CAddrMan& addr)
     if (hashIn != hashTmp)
         return error("%s: Checksum mismatch, data corrupted", __func__);
 
-    return Read(addr, ssPeers);
+    if (!Read(addr, ssPeers))
+        return false;
+    ReadJournal(addr, hashIn);
+    return true;
 }
 
 bool CAddrDB::Read(CAddrMan& addr, CDataStream& ssPeers)
@@ -11,10 +11,16 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 class CSubNet;
 class CAddrMan;
+class CAddrJournalEntry;
 class CDataStream;
+class uint256;
+
+//! Write peers.dat out in full again once its journal has grown to this percentage of its size.
+static const unsigned int ADDRDB_JOURNAL_MAX_PCT = 50;
 
 typedef enum BanReason
 {
@@ -76,14 +82,32 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
-/** Access to the (IP) address database (peers.dat) */
+/**
+ * Access to the (IP) address database (peers.dat), and the journal of changes since it was written (peers.journal).
+ *
+ * The journal starts with the checksum of the peers.dat it belongs to, followed by blocks of changes that each carry a
+ * checksum of their own; reading stops at the first block that doesn't check out, which is how a write cut short by a
+ * crash is dropped again.
+ */
 class CAddrDB
 {
 private:
     fs::path pathAddr;
+    fs::path pathJournal;
+
+    bool ReadAddrChecksum(uint256& hash) const;
+    bool ReadJournalChecksum(uint256& hash) const;
+    bool StartJournal(const uint256& hashAddr);
+    void ReadJournal(CAddrMan& addr, const uint256& hashAddr);
 public:
     CAddrDB();
+    //! Write all of the tables, and start an empty journal on top of them.
     bool Write(const CAddrMan& addr);
+    //! Append changes to the journal; false if there is no journal for the current peers.dat or it can't be written.
+    bool Append(const std::vector<CAddrJournalEntry>& vChanges);
+    //! Whether it is time to write everything out again instead of appending; also when there is no journal at all.
+    bool IsJournalFull() const;
+    //! Read peers.dat and apply the journal on top of it.
     bool Read(CAddrMan& addr);
     bool Read(CAddrMan& addr, CDataStream& ssPeers);
 };
@@ -92,6 +92,7 @@ CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, in
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    setChanged.insert(addr);
     if (pnId)
         *pnId = nId;
     return &mapInfo[nId];
@@ -126,6 +127,7 @@ void CAddrMan::Delete(int nId)
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
+    setChanged.insert(info);
     mapAddr.erase(info);
     mapInfo.erase(nId);
     nNew--;
@@ -139,20 +141,71 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNewSlot(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
     }
 }
 
+void CAddrMan::DeleteTried(int nId)
+{
+    assert(mapInfo.count(nId) == 1);
+    CAddrInfo& info = mapInfo[nId];
+    assert(info.fInTried);
+    int nKBucket = info.GetTriedBucket(nKey);
+    int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
+    assert(vvTried[nKBucket][nKBucketPos] == nId);
+    SetTriedSlot(nKBucket, nKBucketPos, -1);
+    info.fInTried = false;
+    nTried--;
+    // Delete counts it as a "new" entry without references.
+    nNew++;
+    Delete(nId);
+}
+
+void CAddrMan::SetNewSlot(int nUBucket, int nUBucketPos, int nId)
+{
+    int& nSlotId = vvNew[nUBucket][nUBucketPos];
+    if (nSlotId != -1)
+        MarkChanged(nSlotId);
+    nSlotId = nId;
+    if (nId != -1) {
+        MarkChanged(nId);
+        slotsNew.Insert(nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos);
+    } else {
+        slotsNew.Erase(nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos);
+    }
+}
+
+void CAddrMan::SetTriedSlot(int nKBucket, int nKBucketPos, int nId)
+{
+    int& nSlotId = vvTried[nKBucket][nKBucketPos];
+    if (nSlotId != -1)
+        MarkChanged(nSlotId);
+    nSlotId = nId;
+    if (nId != -1) {
+        MarkChanged(nId);
+        slotsTried.Insert(nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos);
+    } else {
+        slotsTried.Erase(nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos);
+    }
+}
+
+void CAddrMan::MarkChanged(int nId)
+{
+    std::map<int, CAddrInfo>::const_iterator it = mapInfo.find(nId);
+    if (it != mapInfo.end())
+        setChanged.insert(it->second);
+}
+
 void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 {
     // remove the entry from all new buckets
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNewSlot(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -173,7 +226,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTriedSlot(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -184,12 +237,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNewSlot(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTriedSlot(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -216,6 +269,7 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime)
     info.nLastSuccess = nTime;
     info.nLastTry = nTime;
     info.nAttempts = 0;
+    MarkChanged(nId);
     // nTime is not updated here, to avoid leaking information about
     // currently-connected peers.
 
@@ -264,11 +318,16 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         // periodically update nTime
         bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
         int64_t nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
-        if (addr.nTime && (!pinfo->nTime || pinfo->nTime < addr.nTime - nUpdateInterval - nTimePenalty))
+        if (addr.nTime && (!pinfo->nTime || pinfo->nTime < addr.nTime - nUpdateInterval - nTimePenalty)) {
             pinfo->nTime = std::max((int64_t)0, addr.nTime - nTimePenalty);
+            MarkChanged(nId);
+        }
 
         // add services
-        pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+        if ((pinfo->nServices | addr.nServices) != pinfo->nServices) {
+            pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+            MarkChanged(nId);
+        }
 
         // do not update if no new information is present
         if (!addr.nTime || (pinfo->nTime && addr.nTime <= pinfo->nTime))
@@ -309,7 +368,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNewSlot(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -321,7 +380,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
 
 void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -338,6 +398,7 @@ void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
     if (fCountFailure && info.nLastCountAttempt < nLastGood) {
         info.nLastCountAttempt = nTime;
         info.nAttempts++;
+        MarkChanged(nId);
     }
 }
 
@@ -355,13 +416,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
+            int nSlot = slotsTried[RandomInt(slotsTried.size())];
+            int nId = vvTried[nSlot / ADDRMAN_BUCKET_SIZE][nSlot % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -372,13 +428,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
+            int nSlot = slotsNew[RandomInt(slotsNew.size())];
+            int nId = vvNew[nSlot / ADDRMAN_BUCKET_SIZE][nSlot % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -430,6 +481,8 @@ int CAddrMan::Check_()
 
     for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+             if ((vvTried[n][i] != -1) != slotsTried.Contains(n * ADDRMAN_BUCKET_SIZE + i))
+                 return -20;
              if (vvTried[n][i] != -1) {
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
@@ -444,6 +497,8 @@ int CAddrMan::Check_()
 
     for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+            if ((vvNew[n][i] != -1) != slotsNew.Contains(n * ADDRMAN_BUCKET_SIZE + i))
+                return -21;
             if (vvNew[n][i] != -1) {
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
@@ -489,7 +544,8 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
 void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -503,13 +559,16 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 
     // update info
     int64_t nUpdateInterval = 20 * 60;
-    if (nTime - info.nTime > nUpdateInterval)
+    if (nTime - info.nTime > nUpdateInterval) {
         info.nTime = nTime;
+        MarkChanged(nId);
+    }
 }
 
 void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -522,7 +581,102 @@ void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
         return;
 
     // update info
-    info.nServices = nServices;
+    if (info.nServices != nServices) {
+        info.nServices = nServices;
+        MarkChanged(nId);
+    }
+}
+
+void CAddrMan::GetChanges_(std::vector<CAddrJournalEntry>& vChanges)
+{
+    vChanges.clear();
+    vChanges.reserve(setChanged.size());
+    std::map<int, size_t> mapChangedIds;
+    for (const CNetAddr& addr : setChanged) {
+        CAddrJournalEntry entry;
+        int nId;
+        CAddrInfo* pinfo = Find(addr, &nId);
+        if (pinfo) {
+            entry.info = *pinfo;
+            entry.fInTried = pinfo->fInTried;
+            mapChangedIds[nId] = vChanges.size();
+        } else {
+            entry.info = CAddrInfo(CAddress(CService(addr, 0), NODE_NONE), CNetAddr());
+            entry.fDeleted = true;
+        }
+        vChanges.push_back(entry);
+    }
+
+    // One pass over the occupied positions finds the "new" buckets of all of them.
+    if (!mapChangedIds.empty()) {
+        for (size_t n = 0; n < slotsNew.size(); n++) {
+            int nUBucket = slotsNew[n] / ADDRMAN_BUCKET_SIZE;
+            std::map<int, size_t>::const_iterator it = mapChangedIds.find(vvNew[nUBucket][slotsNew[n] % ADDRMAN_BUCKET_SIZE]);
+            if (it != mapChangedIds.end())
+                vChanges[it->second].vNewBuckets.push_back(nUBucket);
+        }
+    }
+    setChanged.clear();
+}
+
+void CAddrMan::ApplyChanges_(const std::vector<CAddrJournalEntry>& vChanges)
+{
+    // Take every address that has a record out of the tables first, so that the order of the records doesn't matter.
+    std::set<int> setRecorded;
+    for (const CAddrJournalEntry& entry : vChanges) {
+        int nId;
+        if (Find(entry.info, &nId))
+            setRecorded.insert(nId);
+    }
+    if (!setRecorded.empty()) {
+        std::vector<int> vSlots;
+        for (size_t n = 0; n < slotsNew.size(); n++) {
+            if (setRecorded.count(vvNew[slotsNew[n] / ADDRMAN_BUCKET_SIZE][slotsNew[n] % ADDRMAN_BUCKET_SIZE]))
+                vSlots.push_back(slotsNew[n]);
+        }
+        // Clearing the last reference of a "new" entry deletes it.
+        for (int nSlot : vSlots)
+            ClearNew(nSlot / ADDRMAN_BUCKET_SIZE, nSlot % ADDRMAN_BUCKET_SIZE);
+        for (int nId : setRecorded) {
+            if (mapInfo.count(nId) && mapInfo[nId].fInTried)
+                DeleteTried(nId);
+        }
+    }
+
+    // Then put them back where they were when the records were taken.
+    for (const CAddrJournalEntry& entry : vChanges) {
+        if (entry.fDeleted || !entry.info.IsRoutable() || Find(entry.info))
+            continue;
+        int nId;
+        CAddrInfo* pinfo = Create(entry.info, entry.info.source, &nId);
+        pinfo->nLastSuccess = entry.info.nLastSuccess;
+        pinfo->nAttempts = entry.info.nAttempts;
+        if (entry.fInTried) {
+            int nKBucket = pinfo->GetTriedBucket(nKey);
+            int nKBucketPos = pinfo->GetBucketPosition(nKey, false, nKBucket);
+            if (vvTried[nKBucket][nKBucketPos] != -1)
+                DeleteTried(vvTried[nKBucket][nKBucketPos]);
+            SetTriedSlot(nKBucket, nKBucketPos, nId);
+            pinfo->fInTried = true;
+            nTried++;
+        } else {
+            nNew++;
+            for (int nUBucket : entry.vNewBuckets) {
+                if (nUBucket < 0 || nUBucket >= ADDRMAN_NEW_BUCKET_COUNT || pinfo->nRefCount >= ADDRMAN_NEW_BUCKETS_PER_ADDRESS)
+                    continue;
+                int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+                if (vvNew[nUBucket][nUBucketPos] == nId)
+                    continue;
+                ClearNew(nUBucket, nUBucketPos);
+                SetNewSlot(nUBucket, nUBucketPos, nId);
+                pinfo->nRefCount++;
+            }
+            if (pinfo->nRefCount == 0)
+                Delete(nId);
+        }
+    }
+    // The tables now match what is on disk.
+    setChanged.clear();
 }
 
 int CAddrMan::RandomInt(int nMax){
@@ -6,6 +6,7 @@
 #ifndef GULDEN_ADDRMAN_H
 #define GULDEN_ADDRMAN_H
 
+#include "memusage.h"
 #include "netaddress.h"
 #include "protocol.h"
 #include "random.h"
@@ -109,6 +110,82 @@ public:
 
 };
 
+/**
+ * The state of one address as kept in the journal of changes to peers.dat (see CAddrDB): enough to put it back in exactly
+ * the same place in the tables, or to take it out.
+ */
+class CAddrJournalEntry
+{
+public:
+    CAddrInfo info;
+    //! the address is no longer in the tables at all
+    bool fDeleted;
+    bool fInTried;
+    //! the "new" buckets it is in; the position within each of them follows from the bucket
+    std::vector<int> vNewBuckets;
+
+    CAddrJournalEntry() : fDeleted(false), fInTried(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(info);
+        READWRITE(fDeleted);
+        READWRITE(fInTried);
+        READWRITECOMPACTSIZEVECTOR(vNewBuckets);
+    }
+};
+
+/**
+ * The occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position) of a table, in a dense list so that a random one can
+ * be picked in constant time however empty the table is.
+ */
+class CAddrSlotList
+{
+private:
+    //! occupied positions, in no particular order
+    std::vector<int> vSlots;
+
+    //! index in vSlots of every position, -1 for empty ones
+    std::vector<int> vIndex;
+
+public:
+    explicit CAddrSlotList(int nPositions) : vIndex(nPositions, -1) {}
+
+    void Insert(int nSlot)
+    {
+        if (vIndex[nSlot] != -1)
+            return;
+        vIndex[nSlot] = vSlots.size();
+        vSlots.push_back(nSlot);
+    }
+
+    void Erase(int nSlot)
+    {
+        int nIndex = vIndex[nSlot];
+        if (nIndex == -1)
+            return;
+        vSlots[nIndex] = vSlots.back();
+        vIndex[vSlots[nIndex]] = nIndex;
+        vSlots.pop_back();
+        vIndex[nSlot] = -1;
+    }
+
+    void Clear()
+    {
+        for (int nSlot : vSlots)
+            vIndex[nSlot] = -1;
+        vSlots.clear();
+    }
+
+    bool Contains(int nSlot) const { return vIndex[nSlot] != -1; }
+    size_t size() const { return vSlots.size(); }
+    int operator[](size_t nIndex) const { return vSlots[nIndex]; }
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vSlots) + memusage::DynamicUsage(vIndex); }
+};
+
 /** Stochastic address manager
  *
  * Design goals:
@@ -133,6 +210,10 @@ public:
  *      be observable by adversaries.
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *    * The occupied positions of both tables are kept in a list, so that selection picks one directly instead of probing
+ *      the (mostly empty, on a young node) buckets at random until it hits one.
+ *    * Addresses whose state changed since the tables were last written are remembered, so that only those need to be
+ *      written out (see CAddrDB::Append).
  */
 
 //! total number of buckets for tried addresses
@@ -209,6 +290,13 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions of vvTried and vvNew
+    CAddrSlotList slotsTried;
+    CAddrSlotList slotsNew;
+
+    //! addresses that were added, changed or deleted since the last GetChanges
+    std::set<CNetAddr> setChanged;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
@@ -238,6 +326,16 @@ protected:
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos);
 
+    //! Take an entry out of the "tried" table and delete it.
+    void DeleteTried(int nId);
+
+    //! Put nId (or -1 for none) at a position in the "new" or "tried" table; all writes to vvNew and vvTried go through these.
+    void SetNewSlot(int nUBucket, int nUBucketPos, int nId);
+    void SetTriedSlot(int nKBucket, int nKBucketPos, int nId);
+
+    //! Remember that an entry has to be written out.
+    void MarkChanged(int nId);
+
     //! Mark an entry "good", possibly moving it from "new" to "tried".
     void Good_(const CService &addr, int64_t nTime);
 
@@ -267,6 +365,12 @@ protected:
     //! Update an entry's service bits.
     void SetServices_(const CService &addr, ServiceFlags nServices);
 
+    //! Take the state of the entries that changed.
+    void GetChanges_(std::vector<CAddrJournalEntry>& vChanges);
+
+    //! Replay changes on the tables they were taken from.
+    void ApplyChanges_(const std::vector<CAddrJournalEntry>& vChanges);
+
 public:
     /**
      * serialized format:
@@ -389,7 +493,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNewSlot(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -409,7 +513,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTriedSlot(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -429,7 +533,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNewSlot(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -449,6 +553,8 @@ public:
         if (nLost + nLostUnk > 0) {
             LogPrint(BCLog::ADDRMAN, "addrman lost %i new and %i tried addresses due to collisions\n", nLostUnk, nLost);
         }
+        // What was just read is what is on disk.
+        setChanged.clear();
 
         Check();
     }
@@ -467,6 +573,9 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        slotsNew.Clear();
+        slotsTried.Clear();
+        setChanged.clear();
 
         nIdCount = 0;
         nTried = 0;
@@ -475,6 +584,8 @@ public:
     }
 
     CAddrMan()
+    : slotsTried(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE)
+    , slotsNew(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE)
     {
         Clear();
     }
@@ -491,6 +602,14 @@ public:
         return vRandom.size();
     }
 
+    //! Memory used by the address tables, including the buckets (which are part of the object).
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return memusage::DynamicUsage(mapInfo) + memusage::DynamicUsage(mapAddr) + memusage::DynamicUsage(vRandom) + sizeof(vvTried) + sizeof(vvNew)
+               + slotsTried.DynamicMemoryUsage() + slotsNew.DynamicMemoryUsage() + memusage::DynamicUsage(setChanged);
+    }
+
     //! Consistency check
     void Check()
     {
@@ -596,6 +715,22 @@ public:
         Check();
     }
 
+    //! Take the state of every address that was added, changed or deleted since the last call (or since the tables were read).
+    void GetChanges(std::vector<CAddrJournalEntry>& vChanges)
+    {
+        LOCK(cs);
+        GetChanges_(vChanges);
+    }
+
+    //! Replay changes taken with GetChanges on top of the tables as they were when the changes started, e.g. just read from disk.
+    void ApplyChanges(const std::vector<CAddrJournalEntry>& vChanges)
+    {
+        LOCK(cs);
+        Check();
+        ApplyChanges_(vChanges);
+        Check();
+    }
+
 };
 
 #endif // GULDEN_ADDRMAN_H
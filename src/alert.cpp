@@ -137,6 +137,7 @@ bool CAlert::RelayTo(CNode* pnode) const
     // don't relay to nodes which haven't sent their version message
     if (pnode->nVersion == 0)
         return false;
+    LOCK(pnode->cs_floodRelay);
     // returns true if wasn't already contained in the set
     if (pnode->setKnown.insert(GetHash()).second)
     {
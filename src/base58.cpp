@@ -14,11 +14,15 @@
 #include "hash.h"
 #include "uint256.h"
 
+#include "clockcache.h"
+
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
 #include <vector>
 #include <string>
+#include <map>
+#include <mutex>
 #include <boost/variant/apply_visitor.hpp>
 #include <boost/variant/static_visitor.hpp>
 
@@ -79,31 +83,47 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
 {
     // Skip & count leading zeroes.
     int zeroes = 0;
-    int length = 0;
     while (pbegin != pend && *pbegin == 0) {
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    int size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
+    // Work in limbs of 5 base58 digits (58^5 < 2^32) and take the input up to 4 bytes at a time, so that each step does a
+    // single 64 bit division per limb instead of one division per base58 digit for every byte.
+    static const uint64_t nLimbBase = 58ULL * 58 * 58 * 58 * 58;
+    int size = ((pend - pbegin) * 138 / 100 + 1) / 5 + 1; // log(256) / log(58), rounded up.
+    std::vector<uint32_t> limbs(size);
+    int length = 0;
     while (pbegin != pend) {
-        int carry = *pbegin;
+        // Take the odd bytes first, so the remaining input is whole words.
+        int nBytes = (pend - pbegin) % 4;
+        if (nBytes == 0)
+            nBytes = 4;
+        uint64_t carry = 0;
+        for (int n = 0; n < nBytes; ++n)
+            carry = (carry << 8) | *pbegin++;
+        const int nShift = nBytes * 8;
         int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+        // Apply "limbs = limbs * 256^nBytes + carry".
+        for (std::vector<uint32_t>::reverse_iterator it = limbs.rbegin(); (carry != 0 || i < length) && (it != limbs.rend()); it++, i++) {
+            carry += (uint64_t)(*it) << nShift;
+            *it = carry % nLimbBase;
+            carry /= nLimbBase;
         }
 
         assert(carry == 0);
         length = i;
-        pbegin++;
+    }
+    // Spell the limbs out as base58 digits, most significant first.
+    std::vector<unsigned char> b58(length * 5);
+    for (int i = 0; i < length; ++i) {
+        uint32_t limb = limbs[size - length + i];
+        for (int j = 4; j >= 0; --j) {
+            b58[i * 5 + j] = limb % 58;
+            limb /= 58;
+        }
     }
     // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
+    std::vector<unsigned char>::iterator it = b58.begin();
     while (it != b58.end() && *it == 0)
         it++;
     // Translate the result into a string.
@@ -350,6 +370,29 @@ bool CGuldenAddress::IsScript() const
     return IsValid() && (vchVersion == Params().Base58Prefix(CChainParams::SCRIPT_ADDRESS));
 }
 
+//! Number of encoded addresses to remember; enough for the addresses of a large wallet.
+static const size_t ADDRESS_STRING_CACHE_SIZE = 20000;
+
+//! Encoded addresses by version and data bytes. Only public addresses go in here, never secrets.
+typedef std::vector<unsigned char> AddressStringCacheKey;
+struct AddressStringCacheHasher
+{
+    uint64_t operator()(const AddressStringCacheKey& key) const { return CSipHasher(0, 0).Write(key.data(), key.size()).Finalize(); }
+};
+static CClockCache<AddressStringCacheKey, std::string, AddressStringCacheHasher> addressStringCache(ADDRESS_STRING_CACHE_SIZE);
+
+std::string CGuldenAddress::ToString() const
+{
+    AddressStringCacheKey key = vchVersion;
+    key.insert(key.end(), vchData.begin(), vchData.end());
+    std::string str;
+    if (addressStringCache.tryGet(key, str))
+        return str;
+    str = EncodeBase58Check(key);
+    addressStringCache.insert(key, str);
+    return str;
+}
+
 void CGuldenSecret::SetKey(const CKey& vchSecret)
 {
     assert(vchSecret.IsValid());
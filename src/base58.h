@@ -140,6 +140,9 @@ public:
 
     bool IsScript() const;
 
+    //! The encoded address; recently encoded addresses are remembered, as listings encode the same few addresses over and over.
+    std::string ToString() const;
+
     bool operator==(const CGuldenAddress& otherAddress) const { return CBase58Data::CompareTo((CBase58Data)otherAddress) == 0; }
 };
 
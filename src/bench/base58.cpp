@@ -50,7 +50,18 @@ static void Base58Decode(benchmark::State& state)
     }
 }
 
+static void Base58AddressToString(benchmark::State& state)
+{
+    // A listing encodes the same few addresses again and again.
+    CKeyID keyID(uint160(std::vector<unsigned char>(20, 7)));
+    CGuldenAddress address(keyID);
+    while (state.KeepRunning()) {
+        address.ToString();
+    }
+}
+
 
 BENCHMARK(Base58Encode);
 BENCHMARK(Base58CheckEncode);
 BENCHMARK(Base58Decode);
+BENCHMARK(Base58AddressToString);
@@ -3,7 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "replay.h"
 
+#include "chainparams.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "validation/validation.h"
 #include "util.h"
@@ -11,11 +14,33 @@
 int
 main(int argc, char** argv)
 {
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
+    ParseParameters(argc, argv);
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    fPrintToConsole = GetBoolArg("-printtoconsole", false);
 
-    benchmark::BenchRunner::RunAll();
+    // -replay=<dir> runs the block replay instead of the micro benchmarks.
+    int nResult = EXIT_SUCCESS;
+    if (IsArgSet("-replay"))
+    {
+        try
+        {
+            SelectParams(ChainNameFromCommandLine());
+        }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr, "Error: %s\n", e.what());
+            return EXIT_FAILURE;
+        }
+        nResult = benchmark::RunReplay(GetArg("-replay", ""));
+    }
+    else
+    {
+        benchmark::BenchRunner::RunAll();
+    }
 
     ECC_Stop();
+    return nResult;
 }
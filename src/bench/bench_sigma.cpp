@@ -6,9 +6,16 @@
 #include <crypto/hash/sigma/sigma.h>
 #include <iostream>
 #include <boost/program_options.hpp>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <sstream>
 #include <thread>
 
 #include <crypto/hash/sigma/sigma.h>
+#include <tinyformat.h>
+#include <univalue.h>
 
 #include <cryptopp/config.h>
 #include <cryptopp/aes.h>
@@ -33,6 +40,8 @@ uint64_t memAllowGb;
 uint64_t numUserVerifyThreads;
 uint64_t numFullHashesTarget = 50000;
 bool mineOnly=false;
+// Human readable progress, moved to stderr when machine readable results are written to stdout.
+FILE* humanOut = stdout;
     
 using namespace boost::program_options;
 std::vector<std::string> hashTestVector = {
@@ -104,16 +113,16 @@ void testShaviteReference(uint64_t& nTestFailCount)
         std::string compare(shaviteTestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 void testShaviteOptimised(uint64_t& nTestFailCount)
@@ -132,16 +141,16 @@ void testShaviteOptimised(uint64_t& nTestFailCount)
         std::string compare(shaviteTestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 void testEchoReference(uint64_t& nTestFailCount)
@@ -158,16 +167,16 @@ void testEchoReference(uint64_t& nTestFailCount)
         std::string compare(echo256TestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 void testEchoOptimised(uint64_t& nTestFailCount)
@@ -186,16 +195,16 @@ void testEchoOptimised(uint64_t& nTestFailCount)
         std::string compare(echo256TestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 void testArgonReference(uint64_t& nTestFailCount)
@@ -220,16 +229,16 @@ void testArgonReference(uint64_t& nTestFailCount)
         std::string compare(argonTestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 void testArgonOptimised(uint64_t& nTestFailCount)
@@ -254,16 +263,16 @@ void testArgonOptimised(uint64_t& nTestFailCount)
         std::string compare(argonTestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 void testPRNG(uint64_t& nTestFailCount)
@@ -292,16 +301,16 @@ void testPRNG(uint64_t& nTestFailCount)
         std::string compare(prngTestVectorOut[i]);
         if (outHashHex == compare)
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
             ++nTestFailCount;
-            printf("✘");
-            printf("%s\n", outHashHex.c_str());
+            fprintf(humanOut, "✘");
+            fprintf(humanOut, "%s\n", outHashHex.c_str());
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 
@@ -323,16 +332,16 @@ void testValidateValidHeaders(sigma_settings settings, uint64_t& nTestFailCount)
         sigma_verify_context verify(settings, numUserVerifyThreads);
         if (verify.verifyHeader(header))
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
-            printf("✘");
+            fprintf(humanOut, "✘");
             ++nTestFailCount;
         }
         
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 std::vector<std::string>
@@ -353,15 +362,15 @@ void testValidateInvalidHeaders(sigma_settings settings, uint64_t& nTestFailCoun
         sigma_verify_context verify(settings, numUserVerifyThreads);
         if (!verify.verifyHeader(header))
         {
-            printf("✔");
+            fprintf(humanOut, "✔");
         }
         else
         {
-            printf("✘");
+            fprintf(humanOut, "✘");
             ++nTestFailCount;
         }
     }
-    printf("\n");
+    fprintf(humanOut, "\n");
 }
 
 double calculateSustainedHashrateForTimePeriod(uint64_t maxHashesPre, uint64_t maxHashesPost, double nHalfHashAverage, uint64_t nArenaSetuptime, uint64_t nTimePeriodSeconds)
@@ -380,7 +389,331 @@ double calculateSustainedHashrateForTimePeriod(uint64_t maxHashesPre, uint64_t m
     double nSustainedHashesPerMicrosecond = (1/nSustainedMicrosecondsPerHash);
     return nSustainedHashesPerMicrosecond * 1000000;
 }
-    
+
+// Benchmark suite===================================================
+// Every benchmark is a named case, run for a number of untimed warm-up repetitions followed by a number of timed repetitions.
+// Cases that depend on the machine configuration (mining threads/arena size) run once for every point of the configured matrix.
+// Results are printed as they come in and at the end can be emitted as JSON or CSV, so that runs across machines and releases can be compared.
+
+std::vector<std::string> benchCaseNames = {
+    "scrypt", "scrypt_batch", "scrypt_threads",
+    "fast_hashes_opt", "fast_hashes_ref", "slow_hashes", "arena_prime",
+    "verify", "verify_latency_0", "verify_latency_1", "verify_latency_2",
+    "mining"
+};
+
+uint64_t numWarmup = 1;
+uint64_t numRepetitions = 3;
+uint64_t numVerifySamples = 100;
+std::vector<std::string> benchFilter;
+std::vector<uint64_t> threadMatrix;
+std::vector<uint64_t> arenaMatrixGb;
+
+struct bench_result
+{
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> params;
+    uint64_t opsPerRepetition = 0;
+    // Microseconds per operation, one entry per timed repetition.
+    std::vector<double> samples;
+    // Figures that don't fit the per operation model (e.g. arena setup time, extrapolated hashrates).
+    std::vector<std::pair<std::string, double>> metrics;
+    // Per operation latencies for cases that time each operation individually (verify_latency_*), empty otherwise.
+    std::vector<uint64_t> latencies;
+};
+std::vector<bench_result> benchResults;
+
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<uint64_t> splitNumberList(const std::string& list)
+{
+    std::vector<uint64_t> numbers;
+    for (const auto& item : splitList(list))
+    {
+        numbers.push_back(std::stoull(item));
+    }
+    return numbers;
+}
+
+bool benchEnabled(const std::string& name)
+{
+    if (benchFilter.empty())
+        return true;
+    for (const auto& filter : benchFilter)
+    {
+        if (name.compare(0, filter.size(), filter) == 0)
+            return true;
+    }
+    return false;
+}
+
+// True if any case whose name starts with prefix is enabled.
+bool anyBenchEnabled(const std::string& prefix)
+{
+    return std::any_of(benchCaseNames.begin(), benchCaseNames.end(), [&](const std::string& name){ return name.compare(0, prefix.size(), prefix) == 0 && benchEnabled(name); });
+}
+
+double sampleMedian(std::vector<double> samples)
+{
+    if (samples.empty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t mid = samples.size() / 2;
+    return (samples.size() % 2) ? samples[mid] : (samples[mid-1] + samples[mid]) / 2;
+}
+
+double sampleMean(const std::vector<double>& samples)
+{
+    if (samples.empty())
+        return 0;
+    return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+}
+
+double sampleStddev(const std::vector<double>& samples)
+{
+    if (samples.size() < 2)
+        return 0;
+    double mean = sampleMean(samples);
+    double sum = 0;
+    for (double sample : samples)
+        sum += (sample - mean) * (sample - mean);
+    return std::sqrt(sum / (samples.size() - 1));
+}
+
+// Nearest rank percentile of the individually timed operations.
+uint64_t latencyPercentile(std::vector<uint64_t> latencies, double percentile)
+{
+    if (latencies.empty())
+        return 0;
+    std::sort(latencies.begin(), latencies.end());
+    size_t rank = (size_t)std::ceil(percentile / 100.0 * latencies.size());
+    return latencies[std::max((size_t)1, rank) - 1];
+}
+
+// Power of two buckets (upper bound in microseconds, count), from the first to the last non empty bucket.
+std::vector<std::pair<uint64_t, uint64_t>> latencyHistogram(const std::vector<uint64_t>& latencies)
+{
+    std::vector<uint64_t> counts(64, 0);
+    for (uint64_t latency : latencies)
+    {
+        uint64_t bucket = 0;
+        while (bucket < 63 && (1ULL << bucket) < latency)
+            ++bucket;
+        ++counts[bucket];
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> histogram;
+    auto first = std::find_if(counts.begin(), counts.end(), [](uint64_t count){ return count > 0; });
+    auto last = std::find_if(counts.rbegin(), counts.rend(), [](uint64_t count){ return count > 0; });
+    if (first == counts.end())
+        return histogram;
+    for (auto it = first; it != last.base(); ++it)
+    {
+        histogram.emplace_back(1ULL << (it - counts.begin()), *it);
+    }
+    return histogram;
+}
+
+std::string formatParams(const bench_result& result, const char* separator)
+{
+    std::string formatted;
+    for (const auto& [key, value] : result.params)
+    {
+        if (!formatted.empty())
+            formatted += separator;
+        formatted += key + "=" + value;
+    }
+    return formatted;
+}
+
+void printResult(const bench_result& result)
+{
+    std::string params = formatParams(result, " ");
+    fprintf(humanOut, "%-18s %s%smedian [%.4f micros] min [%.4f micros] max [%.4f micros] per op over [%lu] repetitions of [%lu] ops\n", result.name.c_str(), params.c_str(), params.empty() ? "" : " ", sampleMedian(result.samples), result.samples.empty() ? 0 : *std::min_element(result.samples.begin(), result.samples.end()), result.samples.empty() ? 0 : *std::max_element(result.samples.begin(), result.samples.end()), result.samples.size(), result.opsPerRepetition);
+    if (!result.latencies.empty())
+    {
+        fprintf(humanOut, "    p50 [%lu micros] p90 [%lu micros] p99 [%lu micros] max [%lu micros]\n", latencyPercentile(result.latencies, 50), latencyPercentile(result.latencies, 90), latencyPercentile(result.latencies, 99), latencyPercentile(result.latencies, 100));
+        for (const auto& [upperBound, count] : latencyHistogram(result.latencies))
+        {
+            fprintf(humanOut, "    <= %10lu micros %6lu %s\n", upperBound, count, std::string((count * 50) / result.latencies.size(), '#').c_str());
+        }
+    }
+    for (const auto& [key, value] : result.metrics)
+    {
+        fprintf(humanOut, "    %s [%.2f]\n", key.c_str(), value);
+    }
+}
+
+// Run a case that performs a batch of operations on each call to body, body returns the number of operations it performed.
+bench_result& runBench(const std::string& name, const std::vector<std::pair<std::string, std::string>>& params, const std::function<uint64_t()>& body)
+{
+    for (uint64_t i = 0; i < numWarmup; ++i)
+    {
+        body();
+    }
+    bench_result result;
+    result.name = name;
+    result.params = params;
+    for (uint64_t i = 0; i < numRepetitions; ++i)
+    {
+        uint64_t nStart = GetTimeMicros();
+        uint64_t nOps = body();
+        uint64_t nTime = GetTimeMicros() - nStart;
+        result.opsPerRepetition = nOps;
+        result.samples.push_back(nOps ? nTime / (double)nOps : 0);
+    }
+    benchResults.push_back(result);
+    return benchResults.back();
+}
+
+// Run a case that times every call to op individually so that the latency distribution can be reported.
+bench_result& runLatencyBench(const std::string& name, const std::vector<std::pair<std::string, std::string>>& params, uint64_t nOpsPerRepetition, const std::function<void()>& op)
+{
+    for (uint64_t i = 0; i < numWarmup * nOpsPerRepetition; ++i)
+    {
+        op();
+    }
+    bench_result result;
+    result.name = name;
+    result.params = params;
+    result.opsPerRepetition = nOpsPerRepetition;
+    for (uint64_t i = 0; i < numRepetitions; ++i)
+    {
+        uint64_t nTotal = 0;
+        for (uint64_t j = 0; j < nOpsPerRepetition; ++j)
+        {
+            uint64_t nStart = GetTimeMicros();
+            op();
+            uint64_t nTime = GetTimeMicros() - nStart;
+            result.latencies.push_back(nTime);
+            nTotal += nTime;
+        }
+        result.samples.push_back(nOpsPerRepetition ? nTotal / (double)nOpsPerRepetition : 0);
+    }
+    benchResults.push_back(result);
+    return benchResults.back();
+}
+
+UniValue resultsToJSON()
+{
+    UniValue implementations(UniValue::VOBJ);
+    implementations.push_back(Pair("shavite", selectedSigmaImplementations.shavite));
+    implementations.push_back(Pair("echo", selectedSigmaImplementations.echo));
+    implementations.push_back(Pair("argon", selectedSigmaImplementations.argon));
+    implementations.push_back(Pair("prng", selectedSigmaImplementations.prng));
+    implementations.push_back(Pair("shavite_x2", selectedSigmaImplementations.shaviteX2));
+    implementations.push_back(Pair("echo_x2", selectedSigmaImplementations.echoX2));
+    implementations.push_back(Pair("shavite_x4", selectedSigmaImplementations.shaviteX4));
+    implementations.push_back(Pair("echo_x4", selectedSigmaImplementations.echoX4));
+
+    UniValue settings(UniValue::VOBJ);
+    settings.push_back(Pair("arena_size_kb", defaultSigmaSettings.arenaSizeKb));
+    settings.push_back(Pair("argon_arena_round_cost", defaultSigmaSettings.argonArenaRoundCost));
+    settings.push_back(Pair("argon_slowhash_round_cost", defaultSigmaSettings.argonSlowHashRoundCost));
+    settings.push_back(Pair("argon_memory_cost_kb", defaultSigmaSettings.argonMemoryCostKb));
+    settings.push_back(Pair("fast_hash_size_bytes", defaultSigmaSettings.fastHashSizeBytes));
+    settings.push_back(Pair("num_hashes_pre", defaultSigmaSettings.numHashesPre));
+    settings.push_back(Pair("num_hashes_post", defaultSigmaSettings.numHashesPost));
+    settings.push_back(Pair("num_verify_threads", defaultSigmaSettings.numVerifyThreads));
+    settings.push_back(Pair("default", defaultSigma));
+
+    UniValue meta(UniValue::VOBJ);
+    meta.push_back(Pair("hardware_threads", (uint64_t)std::thread::hardware_concurrency()));
+    meta.push_back(Pair("warmup", numWarmup));
+    meta.push_back(Pair("repetitions", numRepetitions));
+    meta.push_back(Pair("implementations", implementations));
+    meta.push_back(Pair("sigma_settings", settings));
+
+    UniValue results(UniValue::VARR);
+    for (const auto& result : benchResults)
+    {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", result.name));
+        UniValue params(UniValue::VOBJ);
+        for (const auto& [key, value] : result.params)
+            params.push_back(Pair(key, value));
+        entry.push_back(Pair("params", params));
+        entry.push_back(Pair("ops_per_repetition", result.opsPerRepetition));
+        UniValue samples(UniValue::VARR);
+        for (double sample : result.samples)
+            samples.push_back(sample);
+        entry.push_back(Pair("micros_per_op", samples));
+        entry.push_back(Pair("min", result.samples.empty() ? 0 : *std::min_element(result.samples.begin(), result.samples.end())));
+        entry.push_back(Pair("median", sampleMedian(result.samples)));
+        entry.push_back(Pair("mean", sampleMean(result.samples)));
+        entry.push_back(Pair("max", result.samples.empty() ? 0 : *std::max_element(result.samples.begin(), result.samples.end())));
+        entry.push_back(Pair("stddev", sampleStddev(result.samples)));
+        if (!result.latencies.empty())
+        {
+            UniValue latency(UniValue::VOBJ);
+            latency.push_back(Pair("p50", latencyPercentile(result.latencies, 50)));
+            latency.push_back(Pair("p90", latencyPercentile(result.latencies, 90)));
+            latency.push_back(Pair("p99", latencyPercentile(result.latencies, 99)));
+            latency.push_back(Pair("max", latencyPercentile(result.latencies, 100)));
+            UniValue histogram(UniValue::VARR);
+            for (const auto& [upperBound, count] : latencyHistogram(result.latencies))
+            {
+                UniValue bucket(UniValue::VOBJ);
+                bucket.push_back(Pair("le_micros", upperBound));
+                bucket.push_back(Pair("count", count));
+                histogram.push_back(bucket);
+            }
+            latency.push_back(Pair("histogram", histogram));
+            entry.push_back(Pair("latency_micros", latency));
+        }
+        UniValue metrics(UniValue::VOBJ);
+        for (const auto& [key, value] : result.metrics)
+            metrics.push_back(Pair(key, value));
+        entry.push_back(Pair("metrics", metrics));
+        results.push_back(entry);
+    }
+
+    UniValue json(UniValue::VOBJ);
+    json.push_back(Pair("meta", meta));
+    json.push_back(Pair("results", results));
+    return json;
+}
+
+// One row per result; the implementation selection is repeated on every row so that rows from different machines can simply be concatenated.
+std::string resultsToCSV()
+{
+    std::string csv = "name,params,ops_per_repetition,repetitions,min_micros,median_micros,mean_micros,max_micros,stddev_micros,p50_micros,p90_micros,p99_micros,metrics,shavite,echo,argon,prng,shavite_x2,echo_x2,shavite_x4,echo_x4\n";
+    for (const auto& result : benchResults)
+    {
+        std::string metrics;
+        for (const auto& [key, value] : result.metrics)
+        {
+            if (!metrics.empty())
+                metrics += ";";
+            metrics += strprintf("%s=%.2f", key, value);
+        }
+        csv += strprintf("%s,%s,%lu,%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
+                         result.name, formatParams(result, ";"), result.opsPerRepetition, result.samples.size(),
+                         result.samples.empty() ? 0 : *std::min_element(result.samples.begin(), result.samples.end()),
+                         sampleMedian(result.samples), sampleMean(result.samples),
+                         result.samples.empty() ? 0 : *std::max_element(result.samples.begin(), result.samples.end()),
+                         sampleStddev(result.samples),
+                         result.latencies.empty() ? "" : strprintf("%lu", latencyPercentile(result.latencies, 50)),
+                         result.latencies.empty() ? "" : strprintf("%lu", latencyPercentile(result.latencies, 90)),
+                         result.latencies.empty() ? "" : strprintf("%lu", latencyPercentile(result.latencies, 99)),
+                         metrics,
+                         selectedSigmaImplementations.shavite, selectedSigmaImplementations.echo, selectedSigmaImplementations.argon,
+                         selectedSigmaImplementations.prng, selectedSigmaImplementations.shaviteX2, selectedSigmaImplementations.echoX2,
+                         selectedSigmaImplementations.shaviteX4, selectedSigmaImplementations.echoX4);
+    }
+    return csv;
+}
+
 int main(int argc, char** argv)
 {
     memAllowGb = defaultSigmaSettings.arenaSizeKb/1024/1024;
@@ -394,6 +727,15 @@ int main(int argc, char** argv)
     options_description desc("Allowed options");
     desc.add_options()
     ("help", "produce help message")
+    ("list", "List the available benchmark cases and exit")
+    ("bench", value<std::string>(), "Comma separated list of benchmark cases (or case name prefixes) to run, e.g. 'scrypt,verify_latency' (default all)")
+    ("warmup", value<int64_t>(), "Number of untimed repetitions to run for each case before timing it (default 1)")
+    ("repetitions", value<int64_t>(), "Number of timed repetitions to run for each case (default 3)")
+    ("format", value<std::string>(), "Format in which to emit the results once all cases have run: text, json or csv (default text)")
+    ("output", value<std::string>(), "File to write json/csv results to instead of stdout")
+    ("thread-matrix", value<std::string>(), "Comma separated list of thread counts to run the mining and threaded scrypt cases with (default mine-threads)")
+    ("arena-matrix", value<std::string>(), "Comma separated list of memory sizes in gb to run the mining case with (default mine-memory)")
+    ("verify-samples", value<int64_t>(), "How many individually timed verifications make up each repetition of the verify_latency cases (default 100)")
     ("mine-threads", value<int64_t>(), "Set number of threads to use for mining")
     ("mine-memory", value<int64_t>(), "Set how much memory in gb to mine with")
     ("mine-num-hashes", value<int64_t>(), "How many full hash attempts to run mining for (default 50000)")
@@ -422,21 +764,67 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (vm.count("help"))
+    {
+        std::cout << desc << "\n";
+        return 1;
+    }
+
+    if (vm.count("list"))
+    {
+        for (const auto& name : benchCaseNames)
+        {
+            printf("%s\n", name.c_str());
+        }
+        return 0;
+    }
+
+    std::string outputFormat = "text";
+    if (vm.count("format"))
+    {
+        outputFormat = vm["format"].as<std::string>();
+        if (outputFormat != "text" && outputFormat != "json" && outputFormat != "csv")
+        {
+            printf("Unknown output format [%s], expected text, json or csv.\n", outputFormat.c_str());
+            return 1;
+        }
+    }
+    std::string outputFile;
+    if (vm.count("output"))
+    {
+        outputFile = vm["output"].as<std::string>();
+    }
+    // Keep stdout clean for the machine readable results if that is where they are going.
+    if (outputFormat != "text" && outputFile.empty())
+    {
+        humanOut = stderr;
+    }
+
     if (vm.size() == 0)
     {
-        printf("Using default options use '--help' to see a list of possible options.\n\n");
+        fprintf(humanOut, "Using default options use '--help' to see a list of possible options.\n\n");
     }
     else
     {
-        printf("Using non default options use '--help' to see a list of possible options.\n\n");
+        fprintf(humanOut, "Using non default options use '--help' to see a list of possible options.\n\n");
     }
-    
-    if (vm.count("help"))
+
+    if (vm.count("bench"))
     {
-        std::cout << desc << "\n";
-        return 1;
+        benchFilter = splitList(vm["bench"].as<std::string>());
+    }
+    if (vm.count("warmup"))
+    {
+        numWarmup = vm["warmup"].as<int64_t>();
+    }
+    if (vm.count("repetitions"))
+    {
+        numRepetitions = std::max((int64_t)1, vm["repetitions"].as<int64_t>());
+    }
+    if (vm.count("verify-samples"))
+    {
+        numVerifySamples = std::max((int64_t)1, vm["verify-samples"].as<int64_t>());
     }
-
     if (vm.count("mine-threads"))
     {
         numThreads = vm["mine-threads"].as<int64_t>();
@@ -459,6 +847,10 @@ int main(int argc, char** argv)
     {
         mineOnly = vm["mine-only"].as<bool>();;
         defaultSigma = false;
+        if (mineOnly)
+        {
+            benchFilter = {"mining"};
+        }
     }
     if (vm.count("verify-threads"))
     {
@@ -499,6 +891,13 @@ int main(int argc, char** argv)
         defaultSigmaSettings.numVerifyThreads = vm["sigma-verify-threads"].as<int64_t>();
         defaultSigma = false;
     }
+    threadMatrix = vm.count("thread-matrix") ? splitNumberList(vm["thread-matrix"].as<std::string>()) : std::vector<uint64_t>{numThreads};
+    arenaMatrixGb = vm.count("arena-matrix") ? splitNumberList(vm["arena-matrix"].as<std::string>()) : std::vector<uint64_t>{memAllowGb};
+    if (threadMatrix.empty() || std::find(threadMatrix.begin(), threadMatrix.end(), 0) != threadMatrix.end() || arenaMatrixGb.empty())
+    {
+        printf("Thread and arena matrices must be non empty and thread counts may not be zero.\n");
+        return 1;
+    }
     
     
     if (numUserVerifyThreads > defaultSigmaSettings.numVerifyThreads)
@@ -507,9 +906,11 @@ int main(int argc, char** argv)
         return 1;
     }
     
-    printf("Configuration=====================================================\n\n");
-    printf("NETWORK:\nGlobal memory cost [%lugb]\nArgon_echo cpu cost for arenas [%lu rounds]\nArgon_echo cpu cost for slow hash [%lu rounds]\nArgon_echo mem cost [%luMb]\nEcho/Shavite digest size [%lu bytes]\nNumber of fast hashes per slow hash [%lu]\nNumber of slow hashes per global arena [%lu]\nNumber of verify threads [%lu]\n\n", defaultSigmaSettings.arenaSizeKb/1024/1024, defaultSigmaSettings.argonArenaRoundCost ,defaultSigmaSettings.argonSlowHashRoundCost, defaultSigmaSettings.argonMemoryCostKb/1024, defaultSigmaSettings.fastHashSizeBytes, defaultSigmaSettings.numHashesPost, defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numVerifyThreads);
-    printf("USER:\nMining with [%lu] threads\nMining with [%lu gb] memory.\nVerifying with [%lu] threads.\n\n", numThreads, memAllowGb, numUserVerifyThreads);
+    fprintf(humanOut, "Configuration=====================================================\n\n");
+    fprintf(humanOut, "NETWORK:\nGlobal memory cost [%lugb]\nArgon_echo cpu cost for arenas [%lu rounds]\nArgon_echo cpu cost for slow hash [%lu rounds]\nArgon_echo mem cost [%luMb]\nEcho/Shavite digest size [%lu bytes]\nNumber of fast hashes per slow hash [%lu]\nNumber of slow hashes per global arena [%lu]\nNumber of verify threads [%lu]\n\n", defaultSigmaSettings.arenaSizeKb/1024/1024, defaultSigmaSettings.argonArenaRoundCost ,defaultSigmaSettings.argonSlowHashRoundCost, defaultSigmaSettings.argonMemoryCostKb/1024, defaultSigmaSettings.fastHashSizeBytes, defaultSigmaSettings.numHashesPost, defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numVerifyThreads);
+    fprintf(humanOut, "USER:\nMining with [%lu] threads\nMining with [%lu gb] memory.\nVerifying with [%lu] threads.\n\n", numThreads, memAllowGb, numUserVerifyThreads);
+    fprintf(humanOut, "IMPLEMENTATIONS:\nshavite [%s]\necho [%s]\nargon [%s]\nprng [%s]\nshavite two way [%s]\necho two way [%s]\nshavite four way [%s]\necho four way [%s]\n\n", selectedSigmaImplementations.shavite.c_str(), selectedSigmaImplementations.echo.c_str(), selectedSigmaImplementations.argon.c_str(), selectedSigmaImplementations.prng.c_str(), selectedSigmaImplementations.shaviteX2.c_str(), selectedSigmaImplementations.echoX2.c_str(), selectedSigmaImplementations.shaviteX4.c_str(), selectedSigmaImplementations.echoX4.c_str());
+    fprintf(humanOut, "SUITE:\nWarm-up repetitions [%lu]\nTimed repetitions [%lu]\n\n", numWarmup, numRepetitions);
     
     uint64_t memAllowKb = memAllowGb*1024*1024;
     if (memAllowKb == 0)
@@ -524,51 +925,51 @@ int main(int argc, char** argv)
     }
     else
     {
-        printf("Tests=============================================================\n\n");
+        fprintf(humanOut, "Tests=============================================================\n\n");
         uint64_t nTestFailCount=0;
         
-        printf("Verify shavite reference operation\n");
+        fprintf(humanOut, "Verify shavite reference operation\n");
         testShaviteReference(nTestFailCount);
         
         if (selected_shavite3_256_opt_Final)
         {
-            printf("Verify shavite optimised operation\n");
+            fprintf(humanOut, "Verify shavite optimised operation\n");
             testShaviteOptimised(nTestFailCount);
         }
         
-        printf("Verify echo reference operation\n");
+        fprintf(humanOut, "Verify echo reference operation\n");
         testEchoReference(nTestFailCount);
         
         if (selected_echo256_opt_Final)
         {
-            printf("Verify echo optimised operation\n");
+            fprintf(humanOut, "Verify echo optimised operation\n");
             testEchoOptimised(nTestFailCount);
         }
         
-        printf("Verify argon reference operation\n");
+        fprintf(humanOut, "Verify argon reference operation\n");
         testArgonReference(nTestFailCount);
         
         if (selected_argon2_echo_hash)
         {
-            printf("Verify argon optimised operation\n");
+            fprintf(humanOut, "Verify argon optimised operation\n");
             testArgonOptimised(nTestFailCount);
         }
         
-        printf("Verify PRNG\n");
+        fprintf(humanOut, "Verify PRNG\n");
         testPRNG(nTestFailCount);
         
-        printf("Verify validation of valid headers\n");
+        fprintf(humanOut, "Verify validation of valid headers\n");
         testValidateValidHeaders(defaultSigmaSettings, nTestFailCount);
         
-        printf("Verify validation of invalid headers\n");
+        fprintf(humanOut, "Verify validation of invalid headers\n");
         testValidateInvalidHeaders(defaultSigmaSettings, nTestFailCount);
         
         if (nTestFailCount > 0)
         {
-            printf("Aborting due to [%lu] failed tests.\n", nTestFailCount);
+            fprintf(humanOut, "Aborting due to [%lu] failed tests.\n", nTestFailCount);
             exit(EXIT_FAILURE);
         }
-        printf("\n");
+        fprintf(humanOut, "\n");
     }
     
     //Random header to benchmark with, we will randomly change it more throughout the tests.
@@ -580,13 +981,16 @@ int main(int argc, char** argv)
     header.nBits = rand();
     header.nNonce = rand();
     
-    if (!mineOnly)
+    uint64_t nBenchStart = GetTimeMicros();
+    if (anyBenchEnabled("scrypt"))
     {
-        printf("Scrypt============================================================\n\n");
-        uint256 hash;    
+        fprintf(humanOut, "Scrypt============================================================\n\n");
+    }
+    if (benchEnabled("scrypt"))
+    {
+        printResult(runBench("scrypt", {{"threads", "1"}}, [&]()
         {
-            printf("Bench cost [single thread]:\n");
-            uint64_t nStart = GetTimeMicros(); 
+            uint256 hash;
             uint64_t numHashes = 20;
             char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
             for (uint64_t i=0; i< numHashes; ++i)
@@ -594,240 +998,298 @@ int main(int argc, char** argv)
                 header.nNonce = i;
                 scrypt_1024_1_1_256_sp(BEGIN(header.nVersion), BEGIN(hash), scratchpad);
             }
-            printf("total [%lu micros] per hash: [%.2f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numHashes);
-        }
-        
+            return numHashes;
+        }));
+    }
+    if (benchEnabled("scrypt_batch"))
+    {
+        printResult(runBench("scrypt_batch", {{"threads", "1"}, {"lanes", strprintf("%d", SCRYPT_BATCH_LANES)}}, [&]()
+        {
+            uint64_t numHashes = 20;
+            std::vector<CBlockHeader> headers(numHashes, header);
+            std::vector<uint256> hashes(numHashes);
+            std::vector<const char*> input;
+            std::vector<char*> output;
+            for (uint64_t i=0; i< numHashes; ++i)
+            {
+                headers[i].nNonce = i;
+                input.push_back(BEGIN(headers[i].nVersion));
+                output.push_back(BEGIN(hashes[i]));
+            }
+            std::vector<char> scratchpad(SCRYPT_BATCH_SCRATCHPAD_SIZE);
+            scrypt_1024_1_1_256_sp_batch(input.data(), output.data(), numHashes, scratchpad.data());
+            return numHashes;
+        }));
+    }
+    for (uint64_t nBenchThreads : threadMatrix)
+    {
+        if (!benchEnabled("scrypt_threads"))
+            break;
+        printResult(runBench("scrypt_threads", {{"threads", strprintf("%lu", nBenchThreads)}}, [&]()
         {
-            printf("Bench cost [%lu threads]:\n", numThreads);
-            uint64_t nStart = GetTimeMicros();
             uint64_t numHashes = 100;
-            auto workerThreads = new boost::asio::thread_pool(numThreads);
-            for (uint64_t i = 0; i <= numHashes;++i)
+            boost::asio::thread_pool workerThreads(nBenchThreads);
+            for (uint64_t i = 0; i < numHashes;++i)
             {
-                boost::asio::post(*workerThreads, [=]() mutable
+                boost::asio::post(workerThreads, [=]() mutable
                 {
+                    uint256 hash;
                     char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
                     header.nNonce = i;
                     scrypt_1024_1_1_256_sp(BEGIN(header.nVersion), BEGIN(hash), scratchpad);    
                 });
             }
-            workerThreads->join();
-            printf("total [%lu micros] per hash [%.2f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numHashes);
+            workerThreads.join();
+            return numHashes;
+        }));
+    }
+        
+    if (anyBenchEnabled("fast_hashes") || anyBenchEnabled("slow_hashes") || anyBenchEnabled("arena_prime") || anyBenchEnabled("verify"))
+    {
+        fprintf(humanOut, "\nSIGMA=============================================================\n\n");
+    }
+    if (anyBenchEnabled("fast_hashes") || anyBenchEnabled("slow_hashes") || anyBenchEnabled("arena_prime"))
+    {
+        sigma_context sigmaContext(defaultSigmaSettings, std::min(memAllowKb, defaultSigmaSettings.arenaSizeKb), numThreads);
+        if (!sigmaContext.arenaIsValid())
+        {
+            fprintf(humanOut, "Failed to allocate arena memory, try again with lower memory settings.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        uint8_t hashData1[80];
+        for (int i=0;i<80;++i)
+        {
+            hashData1[i] = rand();
+        }
+        uint8_t hashData2[32];
+        for (int i=0;i<32;++i)
+        {
+            hashData2[i] = rand();
+        }
+        std::vector<unsigned char> hashData3(defaultSigmaSettings.fastHashSizeBytes);
+        for (uint64_t i=0;i<defaultSigmaSettings.fastHashSizeBytes;++i)
+        {
+            hashData3[i] = rand();
         }
         
-        printf("SIGMA=============================================================\n\n");
+        #if defined(ARCH_CPU_X86_FAMILY) || defined(ARCH_CPU_ARM_FAMILY)
+        if (benchEnabled("fast_hashes_opt"))
         {
-            sigma_context sigmaContext(defaultSigmaSettings, std::min(memAllowKb, defaultSigmaSettings.arenaSizeKb), numThreads);
-            if (!sigmaContext.arenaIsValid())
-            {
-                printf("Failed to allocate arena memory, try again with lower memory settings.\n");
-                exit(EXIT_FAILURE);
-            }
-            
-            #if defined(ARCH_CPU_X86_FAMILY) || defined(ARCH_CPU_ARM_FAMILY)
+            printResult(runBench("fast_hashes_opt", {{"threads", "1"}}, [&]()
             {
-                printf("Bench fast hashes optimised [single thread]:\n");
-                uint8_t hashData1[80];
-                for (int i=0;i<80;++i)
-                {
-                    hashData1[i] = rand();
-                }
-                uint8_t hashData2[32];
-                for (int i=0;i<32;++i)
-                {
-                    hashData2[i] = rand();
-                }
-                std::vector<unsigned char> hashData3(defaultSigmaSettings.fastHashSizeBytes);
-                for (uint64_t i=0;i<defaultSigmaSettings.fastHashSizeBytes;++i)
-                {
-                    hashData3[i] = rand();
-                }
-                uint64_t nStart = GetTimeMicros();
                 uint64_t numFastHashes = 20000;
                 sigmaContext.benchmarkFastHashes(hashData1, hashData2, &hashData3[0], numFastHashes);
-                printf("total [%lu micros] per hash [%.4f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numFastHashes);
-            }
-            #endif
+                return numFastHashes;
+            }));
+        }
+        #endif
+        if (benchEnabled("fast_hashes_ref"))
+        {
+            printResult(runBench("fast_hashes_ref", {{"threads", "1"}}, [&]()
             {
-                printf("Bench fast hashes reference [single thread]:\n");
-                uint8_t hashData1[80];
-                for (int i=0;i<80;++i)
-                {
-                    hashData1[i] = rand();
-                }
-                uint8_t hashData2[32];
-                for (int i=0;i<32;++i)
-                {
-                    hashData2[i] = rand();
-                }
-                std::vector<unsigned char> hashData3(defaultSigmaSettings.fastHashSizeBytes);
-                for (uint64_t i=0;i<defaultSigmaSettings.fastHashSizeBytes;++i)
-                {
-                    hashData3[i] = rand();
-                }
-                uint64_t nStart = GetTimeMicros();
                 uint64_t numFastHashes = 20000;
                 sigmaContext.benchmarkFastHashesRef(hashData1, hashData2, &hashData3[0], numFastHashes);
-                printf("total [%lu micros] per hash [%.4f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numFastHashes);
-            }
-            
+                return numFastHashes;
+            }));
+        }
+        if (benchEnabled("slow_hashes"))
+        {
+            printResult(runBench("slow_hashes", {{"threads", "1"}}, [&]()
             {
-                printf("Bench slow hashes [single thread]:\n");
-                uint8_t hashData[80];
-                for (int i=0;i<80;++i)
-                {
-                    hashData[i] = rand();
-                }
-                    
-                uint64_t nStart = GetTimeMicros();
                 uint64_t numSlowHashes = 100;
-                sigmaContext.benchmarkSlowHashes(hashData, numSlowHashes);
-                printf("total [%lu micros] per hash [%.2f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numSlowHashes);
-            }
-            
+                sigmaContext.benchmarkSlowHashes(hashData1, numSlowHashes);
+                return numSlowHashes;
+            }));
+        }
+        if (benchEnabled("arena_prime"))
+        {
+            printResult(runBench("arena_prime", {{"cpu_cost", strprintf("%lu", defaultSigmaSettings.argonArenaRoundCost)}, {"mem_cost_mb", strprintf("%lu", defaultSigmaSettings.argonMemoryCostKb/1024)}}, [&]()
             {
-                printf("Bench global arena priming [cpu_cost %lurounds] [mem_cost %lumb]:\n", defaultSigmaSettings.argonArenaRoundCost, defaultSigmaSettings.argonMemoryCostKb/1024 );
-                uint64_t nStart = GetTimeMicros(); 
                 uint64_t numArenas=4;
                 for (uint64_t i=0; i<numArenas; ++i)
                 {
                     sigmaContext.prepareArenas(header);
                 }
-                printf("total [%lu micros] per round: [%.2f micros]\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)numArenas);
-            }  
+                return numArenas;
+            }));
         }
+    }
+    if (anyBenchEnabled("verify"))
+    {
+        sigma_verify_context verify(defaultSigmaSettings, numUserVerifyThreads);
+        std::vector<std::pair<std::string, std::string>> verifyParams = {{"verify_threads", strprintf("%lu", numUserVerifyThreads)}};
+        // Count and log number of successes to avoid possibility of compiler optimising the call out.
+        uint64_t nCountValid=0;
+        if (benchEnabled("verify"))
         {
+            bench_result& result = runBench("verify", verifyParams, [&]()
             {
-                sigma_verify_context verify(defaultSigmaSettings, numUserVerifyThreads);
-                printf("Bench verify [single thread]\n");
                 uint64_t nVerifyNumber=100;
-                uint64_t nCountValid=0;
-                uint64_t nStart = GetTimeMicros();
                 for (uint64_t i =0; i< nVerifyNumber; ++i)
                 {
                     header.nNonce = rand();
-                    // Count and log number of successes to avoid possibility of compiler optimising the call out.
                     if (verify.verifyHeader(header))
                     {
                         ++nCountValid;
                     }
                 }
-                printf("total [%lu micros] per verification [%.2f micros] found [%lu] valid random hashes\n\n", (GetTimeMicros() - nStart), ((GetTimeMicros() - nStart)) / (double)nVerifyNumber, nCountValid);
-            }
+                return nVerifyNumber;
+            });
+            result.metrics.emplace_back("valid_random_hashes", nCountValid);
+            printResult(result);
+        }
+        // verifyHeader<1> and verifyHeader<2> only check one of the two halves of the hash, these are used interchangeably with full verification in CheckProofOfWork.
+        if (benchEnabled("verify_latency_0"))
+        {
+            printResult(runLatencyBench("verify_latency_0", verifyParams, numVerifySamples, [&]()
+            {
+                header.nNonce = rand();
+                nCountValid += verify.verifyHeader<0>(header);
+            }));
+        }
+        if (benchEnabled("verify_latency_1"))
+        {
+            printResult(runLatencyBench("verify_latency_1", verifyParams, numVerifySamples, [&]()
+            {
+                header.nNonce = rand();
+                nCountValid += verify.verifyHeader<1>(header);
+            }));
+        }
+        if (benchEnabled("verify_latency_2"))
+        {
+            printResult(runLatencyBench("verify_latency_2", verifyParams, numVerifySamples, [&]()
+            {
+                header.nNonce = rand();
+                nCountValid += verify.verifyHeader<2>(header);
+            }));
         }
     }
     
     uint64_t nArenaSetuptime=0;
     uint64_t nMineStart = GetTimeMicros();
+    uint64_t nMineHashTarget = numFullHashesTarget;
+    if (benchEnabled("mining"))
     {
-        if (mineOnly)
-        {
-            printf("SIGMA=============================================================\n\n");
-        }
+        fprintf(humanOut, "\nMining============================================================\n\n");
         header.nTime = GetTime();
         header.nVersion = rand();
         header.nBits = arith_uint256((~arith_uint256(0) >> 10)).GetCompact();
         
-        std::vector<sigma_context*> sigmaContexts;
-        std::vector<uint64_t> sigmaMemorySizes;
-        uint64_t nMemoryAllocatedKb=0;
-        
-        while (nMemoryAllocatedKb < memAllowKb)
+        for (uint64_t nBenchMemGb : arenaMatrixGb)
         {
-            uint64_t nMemoryChunkKb = std::min((memAllowKb-nMemoryAllocatedKb), defaultSigmaSettings.arenaSizeKb);
-            nMemoryAllocatedKb += nMemoryChunkKb;
-            sigmaMemorySizes.emplace_back(nMemoryChunkKb);
-        }
-        for (auto instanceMemorySizeKb : sigmaMemorySizes)
-        {
-            sigmaContexts.push_back(new sigma_context(defaultSigmaSettings, instanceMemorySizeKb, numThreads/sigmaMemorySizes.size()));
-        }
-        
-        printf("Bench mining for low difficulty target\n");
-        uint64_t nStart = GetTimeMicros();
-        std::atomic<uint64_t> slowHashCounter = 0;
-        std::atomic<uint64_t> halfHashCounter = 0;
-        std::atomic<uint64_t> skippedHashCounter = 0;
-        std::atomic<uint64_t> hashCounter = 0;
-        std::atomic<uint64_t> blockCounter = 0;
-        {
-            auto workerThreads = new boost::asio::thread_pool(numThreads);
-            for (auto sigmaContext : sigmaContexts)
+            for (uint64_t nBenchThreads : threadMatrix)
             {
-                boost::asio::post(*workerThreads, [&, header, sigmaContext]() mutable
+                uint64_t nBenchMemKb = nBenchMemGb ? nBenchMemGb*1024*1024 : 512*1024;
+                std::vector<sigma_context*> sigmaContexts;
+                std::vector<uint64_t> sigmaMemorySizes;
+                uint64_t nMemoryAllocatedKb=0;
+                
+                while (nMemoryAllocatedKb < nBenchMemKb)
                 {
-                    sigmaContext->prepareArenas(header);
-                });
-            }
-            workerThreads->join();
-        }
-        double nHalfHashAverage=0;
-        nArenaSetuptime = (GetTimeMicros() - nStart);
-        printf("Arena setup time [%lu micros]\n", nArenaSetuptime);
-        nStart = GetTimeMicros();
-        {
-            auto workerThreads = new boost::asio::thread_pool(numThreads);
-            for (auto sigmaContext : sigmaContexts)
-            {
-                boost::asio::post(*workerThreads, [&, header, sigmaContext]() mutable
+                    uint64_t nMemoryChunkKb = std::min((nBenchMemKb-nMemoryAllocatedKb), defaultSigmaSettings.arenaSizeKb);
+                    nMemoryAllocatedKb += nMemoryChunkKb;
+                    sigmaMemorySizes.emplace_back(nMemoryChunkKb);
+                }
+                for (auto instanceMemorySizeKb : sigmaMemorySizes)
                 {
-                    sigmaContext->benchmarkMining(header, slowHashCounter, halfHashCounter, skippedHashCounter, hashCounter, blockCounter, numFullHashesTarget);
+                    sigmaContexts.push_back(new sigma_context(defaultSigmaSettings, instanceMemorySizeKb, std::max((uint64_t)1, nBenchThreads/sigmaMemorySizes.size())));
+                }
+                
+                nMineStart = GetTimeMicros();
+                {
+                    boost::asio::thread_pool workerThreads(nBenchThreads);
+                    for (auto sigmaContext : sigmaContexts)
+                    {
+                        boost::asio::post(workerThreads, [&, header, sigmaContext]() mutable
+                        {
+                            sigmaContext->prepareArenas(header);
+                        });
+                    }
+                    workerThreads.join();
+                }
+                nArenaSetuptime = (GetTimeMicros() - nMineStart);
+                
+                std::atomic<uint64_t> slowHashCounter = 0;
+                std::atomic<uint64_t> halfHashCounter = 0;
+                std::atomic<uint64_t> skippedHashCounter = 0;
+                std::atomic<uint64_t> hashCounter = 0;
+                std::atomic<uint64_t> blockCounter = 0;
+                // One operation is a half hash, the unit all of the extrapolations below are based on.
+                bench_result& result = runBench("mining", {{"threads", strprintf("%lu", nBenchThreads)}, {"arena_gb", strprintf("%lu", nBenchMemGb)}, {"full_hashes", strprintf("%lu", numFullHashesTarget)}}, [&]()
+                {
+                    slowHashCounter = halfHashCounter = skippedHashCounter = hashCounter = blockCounter = 0;
+                    boost::asio::thread_pool workerThreads(nBenchThreads);
+                    for (auto sigmaContext : sigmaContexts)
+                    {
+                        boost::asio::post(workerThreads, [&, header, sigmaContext]() mutable
+                        {
+                            sigmaContext->benchmarkMining(header, slowHashCounter, halfHashCounter, skippedHashCounter, hashCounter, blockCounter, numFullHashesTarget);
+                        });
+                    }
+                    workerThreads.join();
+                    return halfHashCounter.load();
                 });
+                
+                //Extrapolate sustained hashing speed for various time intervals
+                double nHalfHashAverage = sampleMedian(result.samples);
+                result.metrics.emplace_back("arena_setup_micros", nArenaSetuptime);
+                result.metrics.emplace_back("slow_hashes", slowHashCounter.load());
+                result.metrics.emplace_back("skipped_hashes", skippedHashCounter.load());
+                result.metrics.emplace_back("full_hashes", hashCounter.load());
+                result.metrics.emplace_back("blocks", blockCounter.load());
+                for (uint64_t nSeconds : {30, 60, 120, 240, 480})
+                {
+                    result.metrics.emplace_back(strprintf("sustained_hashes_per_second_%lus", nSeconds), calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, nSeconds));
+                }
+                double nSustainedHashesPerSecond = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 150);
+                result.metrics.emplace_back("sustained_hashes_per_second", nSustainedHashesPerSecond);
+                printResult(result);
+                
+                // Log a highly noticeable number for users who just want a number to compare without all the gritty details.
+                std::string labelSustained = " h";
+                selectLargesHashUnit(nSustainedHashesPerSecond, labelSustained);
+                fprintf(humanOut, "\n===========================================================");
+                fprintf(humanOut, "\n* Estimated continuous sustained hashrate %10.2f %s/s *", nSustainedHashesPerSecond, labelSustained.c_str());
+                fprintf(humanOut, "\n===========================================================\n\n");
+                
+                for (auto sigmaContext : sigmaContexts)
+                {
+                    delete sigmaContext;
+                }
             }
-            workerThreads->join();
         }
-        nHalfHashAverage = ((GetTimeMicros() - nStart)) / (double)halfHashCounter;
-        printf("slow-hashes [%lu] half-hashes[%lu] skipped-hashes [%lu] full-hashes [%lu] blocks [%lu] total [%lu micros] per half-hash[%.2f micros] per hash [%.2f micros]\n\n", slowHashCounter.load(), halfHashCounter.load(), skippedHashCounter.load(), hashCounter.load(), blockCounter.load(), (GetTimeMicros() - nStart), nHalfHashAverage, ((GetTimeMicros() - nStart)) / (double)hashCounter);
-        
-        //Extrapolate sustained hashing speed for various time intervals
-        double nSustainedHashesPerSecond30s  = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 30);
-        double nSustainedHashesPerSecond60s  = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 60);
-        double nSustainedHashesPerSecond120s = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 120);
-        double nSustainedHashesPerSecond     = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 150);
-        double nSustainedHashesPerSecond240s = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 240);
-        double nSustainedHashesPerSecond480s = calculateSustainedHashrateForTimePeriod(defaultSigmaSettings.numHashesPre, defaultSigmaSettings.numHashesPost, nHalfHashAverage, nArenaSetuptime, 480);
-        
-        // Convert to the largest unit we can so that output is easier to read
-        std::string labelSustained = " h";        
-        selectLargesHashUnit(nSustainedHashesPerSecond, labelSustained);
-        std::string labelSustained30s = " h";        
-        selectLargesHashUnit(nSustainedHashesPerSecond30s, labelSustained30s);
-        std::string labelSustained60s = " h";        
-        selectLargesHashUnit(nSustainedHashesPerSecond60s, labelSustained60s);
-        std::string labelSustained120s = " h";        
-        selectLargesHashUnit(nSustainedHashesPerSecond120s, labelSustained120s);
-        std::string labelSustained240s = " h";        
-        selectLargesHashUnit(nSustainedHashesPerSecond240s, labelSustained240s);
-        std::string labelSustained480s = " h";        
-        selectLargesHashUnit(nSustainedHashesPerSecond480s, labelSustained480s);
-        
-        // Log extrapolated speeds
-        printf("Extrapolate sustained hashrates for block timings\n");
-        printf("Estimated 30s hashrate %.2f %s/s\n", nSustainedHashesPerSecond30s, labelSustained30s.c_str());
-        printf("Estimated 1m hashrate  %.2f %s/s\n", nSustainedHashesPerSecond60s, labelSustained60s.c_str());
-        printf("Estimated 2m hashrate  %.2f %s/s\n", nSustainedHashesPerSecond120s, labelSustained120s.c_str());
-        printf("Estimated 4m hashrate  %.2f %s/s\n", nSustainedHashesPerSecond240s, labelSustained240s.c_str());
-        printf("Estimated 8m hashrate  %.2f %s/s\n", nSustainedHashesPerSecond480s, labelSustained480s.c_str());
-        
-        // Log a highly noticeable number for users who just want a number to compare without all the gritty details.
-        printf("\n===========================================================");
-        printf("\n* Estimated continuous sustained hashrate %10.2f %s/s *", nSustainedHashesPerSecond, labelSustained.c_str());
-        printf("\n===========================================================\n");
     }
     
     uint64_t nMineEnd = GetTimeMicros();
-    printf("\nBenchmarks finished in [%.2f seconds]\n", (nMineEnd-nMineStart)*0.000001);
+    fprintf(humanOut, "\nBenchmarks finished in [%.2f seconds]\n", (nMineEnd-nBenchStart)*0.000001);
     
-    if ((nMineEnd-nMineStart)*0.000001<30)
+    if (benchEnabled("mining") && (nMineEnd-nMineStart)*0.000001<30)
     {
         // Calculate hash target to spend 40 seconds running and suggest user set that.
         // NB! We delibritely test for 30 but calculate on 40 to prevent making people run the program multiple times unnecessarily.
-        uint64_t nTimeSpentMining = (nMineEnd - (nArenaSetuptime+nMineStart));
-        double nMultiplier = ((40*1000000) / nTimeSpentMining);
+        uint64_t nTimeSpentMining = std::max((uint64_t)1, (nMineEnd - (nArenaSetuptime+nMineStart)) / (numWarmup + numRepetitions));
+        double nMultiplier = ((40*1000000) / (double)nTimeSpentMining);
         
-        printf("Mining benchmark too fast to be accurate recommend running with `--mine-num-hashes=%lu` or larger for at least 30 seconds of benchmarking.\n", (uint64_t)(numFullHashesTarget*nMultiplier));
+        fprintf(humanOut, "Mining benchmark too fast to be accurate recommend running with `--mine-num-hashes=%lu` or larger for at least 30 seconds of benchmarking.\n", (uint64_t)(nMineHashTarget*nMultiplier));
+    }
+    
+    if (outputFormat != "text")
+    {
+        std::string output = (outputFormat == "json") ? resultsToJSON().write(4) + "\n" : resultsToCSV();
+        FILE* outputHandle = outputFile.empty() ? stdout : fopen(outputFile.c_str(), "w");
+        if (!outputHandle)
+        {
+            fprintf(stderr, "Unable to open [%s] for writing.\n", outputFile.c_str());
+            return 1;
+        }
+        fwrite(output.data(), 1, output.size(), outputHandle);
+        if (outputHandle != stdout)
+        {
+            fclose(outputHandle);
+        }
     }
-    //NB! We leak sigmaContexts here, we don't really care because this is a trivial benchmark program its faster for the user to just exit than to actually free them.
+    return 0;
 }
 
 //fixme: (HIGH)
@@ -12,7 +12,7 @@ static void addCoin(const CAmount& nValue, const CWallet& wallet, std::vector<CO
     int nInput = 0;
 
     static int nextLockTime = 0;
-    CMutableTransaction tx;
+    CMutableTransaction tx(CTransaction::CURRENT_VERSION);
     tx.nLockTime = nextLockTime++; // so all transactions get different hashes
     tx.vout.resize(nInput + 1);
     tx.vout[nInput].nValue = nValue;
@@ -56,4 +56,29 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// A wallet with many small outputs, such as that of a witness collecting its
+// rewards; the target can be met exactly from them.
+static void CoinSelectionLargeWallet(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < 20000; i++)
+        addCoin((20 + i % 7) * COIN, wallet, vCoins);
+    addCoin(10000 * COIN, wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(1000 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet == 1000 * COIN);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionLargeWallet);
@@ -43,5 +43,32 @@ static void BenchLockedPool(benchmark::State& state)
     addr.clear();
 }
 
+// Churn of small chunks (keys, seeds) through the pool itself, as secure_allocator does it.
+static void BenchLockedPoolSmall(benchmark::State& state)
+{
+    LockedPoolManager &pool = LockedPoolManager::Instance();
+    std::vector<std::pair<void*, size_t>> addr(ASIZE, std::make_pair(nullptr, 0));
+    uint32_t s = 0x12345678;
+    while (state.KeepRunning()) {
+        for (int x=0; x<BITER; ++x) {
+            int idx = s & (addr.size()-1);
+            if (s & 0x80000000) {
+                pool.free(addr[idx].first, addr[idx].second);
+                addr[idx].first = nullptr;
+            } else if(!addr[idx].first) {
+                addr[idx].second = 1 + ((s >> 16) & (LockedPool::SMALL_CHUNK_MAX-1));
+                addr[idx].first = pool.alloc(addr[idx].second);
+            }
+            bool lsb = s & 1;
+            s >>= 1;
+            if (lsb)
+                s ^= 0xf00f00f0; // LFSR period 0xf7ffffe0
+        }
+    }
+    for (const auto& chunk: addr)
+        pool.free(chunk.first, chunk.second);
+}
+
 BENCHMARK(BenchLockedPool);
+BENCHMARK(BenchLockedPoolSmall);
 
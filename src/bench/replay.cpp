@@ -0,0 +1,297 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "replay.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "fs.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation/validation.h"
+#include "validation/witnessvalidation.h"
+#include <unity/appmanager.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+#include <boost/thread.hpp>
+
+// End-to-end counterpart of the micro benchmarks: the headers are accepted first, in chain order, like a node that syncs from peers does; then the
+// blocks are processed in the order they are in the files, which stores and connects them. All through ProcessNewBlockHeaders/ProcessNewBlock, so
+// everything a node does during initial block download is covered, SIGMA verification, witness blocks and phase transitions included.
+
+namespace {
+
+struct ReplayCounts
+{
+    unsigned int nTx = 0;
+    //! Inputs that spend an output; with -assumevalid unset (the default here) the script or witness signature of each of them is checked.
+    unsigned int nInputs = 0;
+};
+
+struct ReplayPhase
+{
+    std::string name;
+    int64_t nMicros = 0;
+    uint64_t nBlocks = 0;
+    uint64_t nTx = 0;
+    uint64_t nInputs = 0;
+};
+
+// Resident set size high water mark of the process, 0 where unknown.
+uint64_t GetPeakMemoryUsage()
+{
+#ifndef WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef __APPLE__
+        return usage.ru_maxrss;
+#else
+        return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+std::vector<fs::path> ListBlockFiles(const fs::path& dir)
+{
+    std::vector<fs::path> files;
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it)
+    {
+        std::string strName = it->path().filename().string();
+        if (!fs::is_regular_file(it->status()) || strName.size() < 4 || strName.substr(strName.size() - 4) != ".dat")
+            continue;
+        if (strName.compare(0, 3, "blk") == 0 || strName == "bootstrap.dat")
+            files.push_back(it->path());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool ForEachBlock(const CChainParams& chainparams, const std::vector<fs::path>& files, const std::function<bool(const std::shared_ptr<CBlock>&)>& f)
+{
+    for (const fs::path& path : files)
+    {
+        FILE* file = fsbridge::fopen(path, "rb");
+        if (!file)
+        {
+            std::cerr << "replay: can't open " << path.string() << "\n";
+            return false;
+        }
+        bool fContinue = true;
+        ReadBlocksFromFile(chainparams, file, [&](const std::shared_ptr<CBlock>& pblock, uint64_t) { return fContinue = f(pblock); });
+        if (!fContinue)
+            return false;
+    }
+    return true;
+}
+
+void PrintPhase(const ReplayPhase& phase)
+{
+    double nSeconds = std::max<int64_t>(phase.nMicros, 1) * 0.000001;
+    std::cout << std::fixed << std::setprecision(3) << phase.name << "," << nSeconds << "," << phase.nBlocks << "," << phase.nTx << "," << phase.nInputs << ","
+              << phase.nBlocks / nSeconds << "," << phase.nTx / nSeconds << "," << phase.nInputs / nSeconds << "\n";
+}
+
+} // namespace
+
+int benchmark::RunReplay(const std::string& strDir)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<fs::path> files;
+    try
+    {
+        files = ListBlockFiles(strDir);
+    }
+    catch (const fs::filesystem_error& e)
+    {
+        std::cerr << "replay: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    if (files.empty())
+    {
+        std::cerr << "replay: no block files in " << strDir << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // A fresh data directory, with the databases on disk unless -replaymemory is given; cache sizes are split up like init does.
+    fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_gulden_replay_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    fs::create_directories(pathTemp);
+    ForceSetArg("-datadir", pathTemp.string());
+    ClearDatadirCache();
+    bool fMemory = GetBoolArg("-replaymemory", false);
+    int64_t nTotalCache = std::max(nMinDbCache, std::min(nMaxDbCache, GetArg("-dbcache", nDefaultDbCache))) << 20;
+    int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
+    nTotalCache -= nBlockTreeDBCache;
+    int64_t nCoinDBCache = std::min(std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)), nMaxCoinsDBCache << 20);
+    nTotalCache -= nCoinDBCache;
+    nCoinCacheUsage = nTotalCache;
+
+    InitSignatureCache();
+    pblocktree = new CBlockTreeDB(nBlockTreeDBCache, fMemory);
+    pcoinsdbview = new CCoinsViewDB(nCoinDBCache, fMemory);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    ppow2witdbview = new CWitViewDB(nCoinDBCache, fMemory);
+    ppow2witTip = std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(ppow2witdbview));
+    pcoinsTip->SetSiblingView(ppow2witTip);
+
+    nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += GetNumCores();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nScriptCheckThreads - 1; ++i)
+    {
+        threadGroup.create_thread(&ThreadScriptCheck);
+        threadGroup.create_thread(&ThreadBlockCheck);
+        if (fPrefetchCoins)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+    }
+
+    int nResult = EXIT_SUCCESS;
+    std::vector<ReplayPhase> phases;
+    try
+    {
+        if (!InitBlockIndex(chainparams))
+            throw std::runtime_error("InitBlockIndex failed");
+
+        // Decode everything once, keeping only the headers.
+        ReplayPhase read{"read"};
+        std::map<uint256, CBlockHeader> mapHeaders;
+        std::multimap<uint256, uint256> mapChildren;
+        int64_t nStart = GetTimeMicros();
+        ForEachBlock(chainparams, files, [&](const std::shared_ptr<CBlock>& pblock) {
+            uint256 hash = pblock->GetHashPoW2();
+            ++read.nBlocks;
+            read.nTx += pblock->vtx.size();
+            if (mapHeaders.emplace(hash, pblock->GetBlockHeader()).second)
+                mapChildren.emplace(pblock->hashPrevBlock, hash);
+            return true;
+        });
+        read.nMicros = GetTimeMicros() - nStart;
+        phases.push_back(read);
+
+        // Put the headers in chain order, starting from the genesis block; anything that doesn't build on it is left out.
+        std::vector<CBlockHeader> vHeaders;
+        std::vector<uint256> vTodo(1, chainparams.GetConsensus().hashGenesisBlock);
+        while (!vTodo.empty())
+        {
+            uint256 hash = vTodo.back();
+            vTodo.pop_back();
+            auto range = mapChildren.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                vHeaders.push_back(mapHeaders[it->second]);
+                vTodo.push_back(it->second);
+            }
+        }
+        size_t nSkipped = mapHeaders.size() - vHeaders.size() - mapHeaders.count(chainparams.GetConsensus().hashGenesisBlock);
+        if (nSkipped > 0)
+            std::cerr << "replay: " << nSkipped << " blocks don't build on the genesis block, skipped\n";
+
+        ReplayPhase headers{"headers"};
+        nStart = GetTimeMicros();
+        for (size_t i = 0; i < vHeaders.size(); i += MAX_HEADERS_RESULTS)
+        {
+            std::vector<CBlockHeader> vBatch(vHeaders.begin() + i, vHeaders.begin() + std::min(vHeaders.size(), i + MAX_HEADERS_RESULTS));
+            CValidationState state;
+            if (!ProcessNewBlockHeaders(vBatch, state, chainparams))
+                throw std::runtime_error(strprintf("header rejected: %s", FormatStateMessage(state)));
+            headers.nBlocks += vBatch.size();
+        }
+        headers.nMicros = GetTimeMicros() - nStart;
+        phases.push_back(headers);
+
+        std::set<uint256> setAccepted;
+        for (const CBlockHeader& header : vHeaders)
+            setAccepted.insert(header.GetHashPoW2());
+        std::map<uint256, ReplayCounts> mapCounts;
+        std::map<uint256, CBlockHeader>().swap(mapHeaders);
+        std::multimap<uint256, uint256>().swap(mapChildren);
+        std::vector<CBlockHeader>().swap(vHeaders);
+
+        // Process the blocks in file order; blocks that arrive ahead of their parent are stored and connected once it is in.
+        ReplayPhase blocks{"blocks"};
+        nStart = GetTimeMicros();
+        ForEachBlock(chainparams, files, [&](const std::shared_ptr<CBlock>& pblock) {
+            uint256 hash = pblock->GetHashPoW2();
+            if (!setAccepted.count(hash))
+                return true;
+            ReplayCounts& counts = mapCounts[hash];
+            counts.nTx = pblock->vtx.size();
+            for (const auto& tx : pblock->vtx)
+                for (const auto& txin : tx->vin)
+                    if (!txin.prevout.IsNull())
+                        ++counts.nInputs;
+            ProcessNewBlock(chainparams, pblock, true, nullptr);
+            return !ShutdownRequested();
+        });
+        FlushStateToDisk();
+        blocks.nMicros = GetTimeMicros() - nStart;
+
+        int nHeight;
+        int nBestHeaderHeight;
+        {
+            LOCK(cs_main);
+            nHeight = chainActive.Height();
+            nBestHeaderHeight = pindexBestHeader ? pindexBestHeader->nHeight : 0;
+            for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+            {
+                const ReplayCounts& counts = mapCounts[pindex->GetBlockHashPoW2()];
+                ++blocks.nBlocks;
+                blocks.nTx += counts.nTx;
+                blocks.nInputs += counts.nInputs;
+            }
+        }
+        phases.push_back(blocks);
+
+        std::cout << "#Replay,seconds,blocks,tx,script_checks,blocks/s,tx/s,script_checks/s\n";
+        for (const ReplayPhase& phase : phases)
+            PrintPhase(phase);
+        std::cout << "tip height " << nHeight << ", " << nScriptCheckThreads << " script check threads, peak memory " << GetPeakMemoryUsage() / (1024 * 1024) << " MiB\n";
+        if (nHeight < nBestHeaderHeight)
+        {
+            std::cerr << "replay: stopped at height " << nHeight << " of " << nBestHeaderHeight << ", run with -printtoconsole for why\n";
+            nResult = EXIT_FAILURE;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "replay: " << e.what() << "\n";
+        nResult = EXIT_FAILURE;
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    UnloadBlockIndex();
+    ppow2witTip = nullptr;
+    delete ppow2witdbview;
+    ppow2witdbview = nullptr;
+    delete pcoinsTip;
+    pcoinsTip = nullptr;
+    delete pcoinsdbview;
+    pcoinsdbview = nullptr;
+    delete pblocktree;
+    pblocktree = nullptr;
+    fs::remove_all(pathTemp);
+    return nResult;
+}
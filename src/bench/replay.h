@@ -0,0 +1,21 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_BENCH_REPLAY_H
+#define GULDEN_BENCH_REPLAY_H
+
+#include <string>
+
+namespace benchmark {
+
+/**
+ * Replay the block files (blk?????.dat, as written by a node, or bootstrap.dat) in strDir through the real validation code against a fresh data
+ * directory, and print the time taken and the throughput of each phase. The blocks have to build on the genesis block of the selected chain.
+ * Returns the exit code for bench_gulden.
+ */
+int RunReplay(const std::string& strDir);
+
+}
+
+#endif // GULDEN_BENCH_REPLAY_H
@@ -0,0 +1,130 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "bench.h"
+
+#include "coins.h"
+#include "consensus/validation.h"
+#include "random.h"
+#include "validation/witnessvalidation.h"
+#include <Gulden/util.h>
+
+#include <memory>
+
+// Synthetic witness sets of various sizes, to see how the witness selection scales with the number of witnesses on the network.
+// Only the parts of the witness code that work on the witness set itself are covered; replaying blocks (ForceActivateChain/ConnectBlock) needs a full node with a chain on disk.
+
+static const uint64_t nBenchTipHeight = 1000000;
+
+struct WitnessBenchSet
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view;
+    CGetWitnessInfo witnessInfo;
+
+    WitnessBenchSet() : view(&viewDummy) {}
+};
+
+// Witness outputs with amounts between the minimum and 100 times that, lock periods of one month up to three years and ages of 200 up to 50000 blocks.
+static const WitnessBenchSet& GetWitnessBenchSet(size_t nCount)
+{
+    static std::map<size_t, std::unique_ptr<WitnessBenchSet>> sets;
+    std::unique_ptr<WitnessBenchSet>& set = sets[nCount];
+    if (set)
+        return *set;
+
+    set.reset(new WitnessBenchSet());
+    FastRandomContext rng(true);
+    for (size_t i = 0; i < nCount; ++i)
+    {
+        uint64_t nHeight = nBenchTipHeight - 200 - rng.randrange(50000);
+        Coin coin;
+        coin.nHeight = nHeight;
+        coin.out.nValue = (gMinimumWitnessAmount + rng.randrange(gMinimumWitnessAmount * 100)) * COIN;
+        coin.out.SetType(CTxOutType::PoW2WitnessOutput);
+        coin.out.output.witnessDetails.spendingKeyID = CKeyID(uint160(std::vector<unsigned char>(20, (unsigned char)i)));
+        coin.out.output.witnessDetails.witnessKeyID = CKeyID(uint160(std::vector<unsigned char>(20, (unsigned char)(i >> 8))));
+        coin.out.output.witnessDetails.lockFromBlock = nHeight;
+        coin.out.output.witnessDetails.lockUntilBlock = nHeight + 30 * 576 + rng.randrange(3 * 365 * 576);
+        set->view.AddCoin(COutPoint(rng.rand256(), 0), std::move(coin), false);
+    }
+    set->view.GetAllCoins(set->witnessInfo.allWitnessCoins);
+    PopulateWitnessSelectionPool(set->witnessInfo, nBenchTipHeight + 1);
+
+    fprintf(stderr, "witness set: %u witnesses, %u in selection pool, view uses %u bytes\n", (unsigned int)nCount, (unsigned int)set->witnessInfo.witnessSelectionPoolUnfiltered.size(), (unsigned int)set->view.DynamicMemoryUsage());
+    return *set;
+}
+
+// Enumerating the witness view, the bulk of getAllUnspentWitnessCoins.
+static void WitnessEnumerate(benchmark::State& state, size_t nCount)
+{
+    const WitnessBenchSet& set = GetWitnessBenchSet(nCount);
+    while (state.KeepRunning())
+    {
+        std::map<COutPoint, Coin> allWitnessCoins;
+        set.view.GetAllCoins(allWitnessCoins);
+    }
+}
+
+// Weighing all witnesses, GetPow2NetworkWeight when its totals aren't known yet.
+static void WitnessNetworkWeight(benchmark::State& state, size_t nCount)
+{
+    const WitnessBenchSet& set = GetWitnessBenchSet(nCount);
+    while (state.KeepRunning())
+    {
+        int64_t nTotalWeight = 0;
+        for (const auto& iter : set.witnessInfo.allWitnessCoins)
+            nTotalWeight += GetPoW2RawWeightForOutput(iter.second.out, iter.second.nHeight);
+        assert(nTotalWeight > 0);
+    }
+}
+
+// Building the unfiltered selection pool, GetWitnessInfo after the witness set has been captured.
+static void WitnessPopulatePool(benchmark::State& state, size_t nCount)
+{
+    CGetWitnessInfo witnessInfo = GetWitnessBenchSet(nCount).witnessInfo;
+    while (state.KeepRunning())
+    {
+        PopulateWitnessSelectionPool(witnessInfo, nBenchTipHeight + 1);
+    }
+}
+
+// Filtering, weight capping and selection from the unfiltered pool, GetWitnessHelper.
+static void WitnessSelect(benchmark::State& state, size_t nCount)
+{
+    CGetWitnessInfo witnessInfo = GetWitnessBenchSet(nCount).witnessInfo;
+    FastRandomContext rng(true);
+    while (state.KeepRunning())
+    {
+        GetWitnessHelper(rng.rand256(), witnessInfo, nBenchTipHeight + 1);
+    }
+}
+
+// Only the roulette spin, GetWitness when the pool has been prepared ahead of time (see CWitnessPoolPrecompute).
+static void WitnessSelectPrepared(benchmark::State& state, size_t nCount)
+{
+    CGetWitnessInfo witnessInfo = GetWitnessBenchSet(nCount).witnessInfo;
+    PrepareWitnessSelectionPool(witnessInfo, nBenchTipHeight + 1);
+    FastRandomContext rng(true);
+    while (state.KeepRunning())
+    {
+        SelectWitnessFromPool(rng.rand256(), witnessInfo);
+    }
+}
+
+#define WITNESS_BENCHMARKS(suffix, count) \
+    static void WitnessEnumerate##suffix(benchmark::State& state) { WitnessEnumerate(state, count); } \
+    static void WitnessNetworkWeight##suffix(benchmark::State& state) { WitnessNetworkWeight(state, count); } \
+    static void WitnessPopulatePool##suffix(benchmark::State& state) { WitnessPopulatePool(state, count); } \
+    static void WitnessSelect##suffix(benchmark::State& state) { WitnessSelect(state, count); } \
+    static void WitnessSelectPrepared##suffix(benchmark::State& state) { WitnessSelectPrepared(state, count); } \
+    BENCHMARK(WitnessEnumerate##suffix); \
+    BENCHMARK(WitnessNetworkWeight##suffix); \
+    BENCHMARK(WitnessPopulatePool##suffix); \
+    BENCHMARK(WitnessSelect##suffix); \
+    BENCHMARK(WitnessSelectPrepared##suffix);
+
+WITNESS_BENCHMARKS(10k, 10000)
+WITNESS_BENCHMARKS(100k, 100000)
+WITNESS_BENCHMARKS(1M, 1000000)
@@ -11,6 +11,7 @@
 
 #include "blockencodings.h"
 #include "consensus/consensus.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "chainparams.h"
 #include "hash.h"
@@ -230,3 +231,36 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
 
     return READ_STATUS_OK;
 }
+
+CBlockWitnessDelta::CBlockWitnessDelta(const CBlock& block) : header(block) {
+    if (block.nVersionPoW2Witness == 0)
+        return;
+    for (size_t i = block.vtx.size(); i-- > 1;) {
+        if (block.vtx[i]->IsPoW2WitnessCoinBase()) {
+            vtxWitness.assign(block.vtx.begin() + i, block.vtx.end());
+            break;
+        }
+    }
+}
+
+ReadStatus CBlockWitnessDelta::FillBlock(const CBlock& blockPoW, CBlock& block) const {
+    if (header.nVersionPoW2Witness == 0 || vtxWitness.empty() || !vtxWitness[0]->IsPoW2WitnessCoinBase())
+        return READ_STATUS_INVALID;
+    // The legacy hash commits to the PoW transactions, so a PoW block with the same one has exactly those.
+    if (blockPoW.nVersionPoW2Witness != 0 || blockPoW.vtx.empty() || blockPoW.GetHashLegacy() != header.GetHashLegacy())
+        return READ_STATUS_FAILED;
+
+    // The witness transactions are committed to by the witness header only; as the PoW part can't be wrong, a mismatch
+    // here is down to the peer that sent the delta.
+    bool mutated;
+    if (BlockMerkleRoot(vtxWitness.begin(), vtxWitness.end(), &mutated) != header.hashMerkleRootPoW2Witness || mutated)
+        return READ_STATUS_INVALID;
+
+    block = header;
+    block.vtx.reserve(blockPoW.vtx.size() + vtxWitness.size());
+    block.vtx.insert(block.vtx.end(), blockPoW.vtx.begin(), blockPoW.vtx.end());
+    block.vtx.insert(block.vtx.end(), vtxWitness.begin(), vtxWitness.end());
+
+    LogPrint(BCLog::CMPCTBLOCK, "Rebuilt witnessed block %s from PoW block %s and %lu witness txn\n", header.GetHashPoW2().ToString(), header.GetHashLegacy().ToString(), vtxWitness.size());
+    return READ_STATUS_OK;
+}
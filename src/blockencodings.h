@@ -213,4 +213,34 @@ public:
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
 };
 
+/**
+ * What a witnessed block adds to the PoW block it witnesses: the full header (with the witness fields and signature) and
+ * the transactions from the witness coinbase on. A peer that has the PoW block already rebuilds the witnessed block from
+ * this, instead of being sent the whole block again.
+ */
+class CBlockWitnessDelta {
+public:
+    CBlockHeader header;
+    std::vector<CTransactionRef> vtxWitness;
+
+    // Dummy for deserialization
+    CBlockWitnessDelta() {}
+
+    //! Left empty if the block isn't witnessed.
+    explicit CBlockWitnessDelta(const CBlock& block);
+
+    bool IsNull() const { return vtxWitness.empty(); }
+
+    //! Rebuild the witnessed block from the PoW block with the same legacy hash.
+    ReadStatus FillBlock(const CBlock& blockPoW, CBlock& block) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(header);
+        READWRITECOMPACTSIZEVECTOR(vtxWitness);
+    }
+};
+
 #endif
@@ -0,0 +1,323 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "blockfilter.h"
+
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+/** Writes bits most significant first, to the end of a byte vector. */
+class CBitWriter
+{
+public:
+    explicit CBitWriter(std::vector<unsigned char>& vDataIn) : vData(vDataIn) {}
+
+    void Write(uint64_t nValue, int nBits)
+    {
+        while (nBits > 0)
+        {
+            if (nOffset == 0)
+                vData.push_back(0);
+            int nChunk = std::min(8 - nOffset, nBits);
+            unsigned char nChunkBits = (nValue >> (nBits - nChunk)) & ((1 << nChunk) - 1);
+            vData.back() |= nChunkBits << (8 - nOffset - nChunk);
+            nOffset = (nOffset + nChunk) % 8;
+            nBits -= nChunk;
+        }
+    }
+
+private:
+    std::vector<unsigned char>& vData;
+    //! Bits of the last byte in use.
+    int nOffset = 0;
+};
+
+/** Reads bits most significant first; throws std::ios_base::failure past the end. */
+class CBitReader
+{
+public:
+    CBitReader(const std::vector<unsigned char>& vDataIn, size_t nPosIn) : vData(vDataIn), nPos(nPosIn) {}
+
+    uint64_t Read(int nBits)
+    {
+        uint64_t nValue = 0;
+        while (nBits > 0)
+        {
+            if (nPos >= vData.size())
+                throw std::ios_base::failure("CBitReader::Read(): end of data");
+            int nChunk = std::min(8 - nOffset, nBits);
+            nValue = (nValue << nChunk) | ((vData[nPos] >> (8 - nOffset - nChunk)) & ((1 << nChunk) - 1));
+            nOffset += nChunk;
+            if (nOffset == 8)
+            {
+                nOffset = 0;
+                ++nPos;
+            }
+            nBits -= nChunk;
+        }
+        return nValue;
+    }
+
+    //! Bytes touched so far, including a partly read one.
+    size_t GetBytesUsed() const { return nPos + (nOffset ? 1 : 0); }
+
+private:
+    const std::vector<unsigned char>& vData;
+    size_t nPos;
+    int nOffset = 0;
+};
+
+void GolombRiceEncode(CBitWriter& writer, uint8_t nP, uint64_t nValue)
+{
+    // The quotient in unary: a one for every multiple of 2^P, then a zero.
+    uint64_t nQuotient = nValue >> nP;
+    while (nQuotient > 0)
+    {
+        int nBits = std::min<uint64_t>(nQuotient, 64);
+        writer.Write(~0ULL, nBits);
+        nQuotient -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(nValue, nP);
+}
+
+uint64_t GolombRiceDecode(CBitReader& reader, uint8_t nP)
+{
+    uint64_t nQuotient = 0;
+    while (reader.Read(1) == 1)
+        ++nQuotient;
+    return (nQuotient << nP) + reader.Read(nP);
+}
+
+//! Map x uniformly into [0, n), without the bias or the cost of a modulo.
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi, ad = x_hi * n_lo, bc = x_lo * n_hi, bd = x_lo * n_lo;
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+
+}
+
+CGCSFilter::CGCSFilter(const Params& paramsIn)
+: params(paramsIn)
+, nN(0)
+, nF(0)
+{
+    CVectorWriter stream(SER_NETWORK, 0, vEncoded, 0);
+    WriteCompactSize(stream, 0);
+}
+
+CGCSFilter::CGCSFilter(const Params& paramsIn, std::vector<unsigned char> vEncodedIn)
+: params(paramsIn)
+, vEncoded(std::move(vEncodedIn))
+{
+    CMemoryReader stream(SER_NETWORK, 0, vEncoded.data(), vEncoded.size());
+    uint64_t nCount = ReadCompactSize(stream);
+    if (nCount > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("N must be < 2^32");
+    nN = nCount;
+    nF = (uint64_t)nN * params.nM;
+
+    // Decode everything once, so that a filter that is cut short or padded with more than the last byte is refused right here.
+    CBitReader reader(vEncoded, vEncoded.size() - stream.size());
+    for (uint32_t i = 0; i < nN; ++i)
+        GolombRiceDecode(reader, params.nP);
+    if (nN > 0 && reader.GetBytesUsed() != vEncoded.size())
+        throw std::ios_base::failure("encoded filter contains more than its elements");
+    if (nN == 0 && !stream.empty())
+        throw std::ios_base::failure("encoded filter contains more than its elements");
+}
+
+CGCSFilter::CGCSFilter(const Params& paramsIn, const ElementSet& elements)
+: params(paramsIn)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("N must be < 2^32");
+    nN = elements.size();
+    nF = (uint64_t)nN * params.nM;
+
+    CVectorWriter stream(SER_NETWORK, 0, vEncoded, 0);
+    WriteCompactSize(stream, nN);
+    CBitWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    for (uint64_t nValue : BuildHashedSet(elements))
+    {
+        GolombRiceEncode(writer, params.nP, nValue - nLast);
+        nLast = nValue;
+    }
+}
+
+uint64_t CGCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(params.nSipHashK0, params.nSipHashK1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+std::vector<uint64_t> CGCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (const Element& element : elements)
+        vHashed.push_back(HashToRange(element));
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+bool CGCSFilter::MatchInternal(const uint64_t* pQuery, size_t nQuery) const
+{
+    // Walk the sorted query along the decoded set; both are in order, so this is one pass over the filter.
+    CMemoryReader stream(SER_NETWORK, 0, vEncoded.data(), vEncoded.size());
+    ReadCompactSize(stream);
+    CBitReader reader(vEncoded, vEncoded.size() - stream.size());
+    uint64_t nValue = 0;
+    size_t nQueryPos = 0;
+    for (uint32_t i = 0; i < nN; ++i)
+    {
+        nValue += GolombRiceDecode(reader, params.nP);
+        while (nQueryPos < nQuery && pQuery[nQueryPos] < nValue)
+            ++nQueryPos;
+        if (nQueryPos == nQuery)
+            return false;
+        if (pQuery[nQueryPos] == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const Element& element) const
+{
+    uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool CGCSFilter::MatchAny(const ElementSet& elements) const
+{
+    const std::vector<uint64_t> vQuery = BuildHashedSet(elements);
+    return MatchInternal(vQuery.data(), vQuery.size());
+}
+
+const std::string& BlockFilterTypeName(BlockFilterType filterType)
+{
+    static const std::string strBasic = "basic";
+    static const std::string strUnknown = "";
+    return filterType == BlockFilterType::BASIC ? strBasic : strUnknown;
+}
+
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType)
+{
+    if (strName != BlockFilterTypeName(BlockFilterType::BASIC))
+        return false;
+    filterType = BlockFilterType::BASIC;
+    return true;
+}
+
+static CGCSFilter::Element ScriptElement(const CScript& script)
+{
+    return CGCSFilter::Element(script.begin(), script.end());
+}
+
+std::vector<CGCSFilter::Element> GetBasicFilterElements(const CTxOut& out)
+{
+    std::vector<CGCSFilter::Element> elements;
+    switch (out.GetType())
+    {
+        case CTxOutType::PoW2WitnessOutput:
+            elements.push_back(ScriptElement(GetScriptForDestination(out.output.witnessDetails.spendingKeyID)));
+            if (out.output.witnessDetails.witnessKeyID != out.output.witnessDetails.spendingKeyID)
+                elements.push_back(ScriptElement(GetScriptForDestination(out.output.witnessDetails.witnessKeyID)));
+            break;
+        case CTxOutType::StandardKeyHashOutput:
+            elements.push_back(ScriptElement(GetScriptForDestination(out.output.standardKeyHash.keyID)));
+            break;
+        case CTxOutType::ScriptLegacyOutput:
+            if (!out.output.scriptPubKey.empty() && out.output.scriptPubKey[0] != OP_RETURN)
+                elements.push_back(ScriptElement(out.output.scriptPubKey));
+            break;
+    }
+    return elements;
+}
+
+static CGCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockundo)
+{
+    CGCSFilter::ElementSet elements;
+    for (const CTransactionRef& tx : block.vtx)
+    {
+        for (const CTxOut& out : tx->vout)
+        {
+            for (CGCSFilter::Element& element : GetBasicFilterElements(out))
+                elements.insert(std::move(element));
+        }
+    }
+    // The spent outputs of every transaction but the coinbase.
+    for (const CTxUndo& txundo : blockundo.vtxundo)
+    {
+        for (const Coin& prevout : txundo.vprevout)
+        {
+            for (CGCSFilter::Element& element : GetBasicFilterElements(prevout.out))
+                elements.insert(std::move(element));
+        }
+    }
+    return elements;
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, std::vector<unsigned char> vFilter)
+: filterType(filterTypeIn)
+, hashBlock(hashBlockIn)
+{
+    CGCSFilter::Params params;
+    if (!BuildParams(params))
+        throw std::invalid_argument("unknown filter type");
+    filter = CGCSFilter(params, std::move(vFilter));
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockundo)
+: filterType(filterTypeIn)
+, hashBlock(block.GetHashPoW2())
+{
+    CGCSFilter::Params params;
+    if (!BuildParams(params))
+        throw std::invalid_argument("unknown filter type");
+    filter = CGCSFilter(params, BasicFilterElements(block, blockundo));
+}
+
+bool CBlockFilter::BuildParams(CGCSFilter::Params& params) const
+{
+    if (filterType != BlockFilterType::BASIC)
+        return false;
+    // Keyed by the block, so that nobody can make elements collide in the filters of many blocks at once.
+    params.nSipHashK0 = hashBlock.GetUint64(0);
+    params.nSipHashK1 = hashBlock.GetUint64(1);
+    params.nP = BASIC_FILTER_P;
+    params.nM = BASIC_FILTER_M;
+    return true;
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vData = GetEncodedFilter();
+    return Hash(vData.begin(), vData.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& hashPrevHeader) const
+{
+    const uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(), hashPrevHeader.end());
+}
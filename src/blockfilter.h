@@ -0,0 +1,137 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_BLOCKFILTER_H
+#define GULDEN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+class CTxOut;
+
+/**
+ * A Golomb-coded set (as in BIP158): the elements are hashed into the range [0, N * M), sorted, and the differences between them
+ * written out with Golomb-Rice coding of parameter P. Matching gives false positives at a rate of about 1/M and never false negatives.
+ */
+class CGCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        uint8_t nP;
+        uint32_t nM;
+
+        Params(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, uint8_t nPIn = 0, uint32_t nMIn = 1)
+        : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn)
+        {}
+    };
+
+    //! An empty filter.
+    explicit CGCSFilter(const Params& params = Params());
+    //! Take over an encoded filter; throws std::ios_base::failure if it doesn't decode.
+    CGCSFilter(const Params& params, std::vector<unsigned char> vEncodedIn);
+    CGCSFilter(const Params& params, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const Params& GetParams() const { return params; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    //! Whether the element is (probably) in the set.
+    bool Match(const Element& element) const;
+    //! Whether any of the elements is (probably) in the set; cheaper than matching them one by one.
+    bool MatchAny(const ElementSet& elements) const;
+
+private:
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    bool MatchInternal(const uint64_t* pQuery, size_t nQuery) const;
+
+    Params params;
+    uint32_t nN;
+    uint64_t nF;
+    //! Number of elements as compact size, followed by the Golomb-Rice coded differences.
+    std::vector<unsigned char> vEncoded;
+};
+
+/** Kinds of block filters; only the basic filter of BIP158 (all output scripts and the ones spent) for now. */
+enum class BlockFilterType : uint8_t
+{
+    BASIC = 0,
+    INVALID = 255,
+};
+
+//! Parameters of the basic filter, chosen in BIP158 for the smallest filters at a false positive rate of 1/784931.
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+const std::string& BlockFilterTypeName(BlockFilterType filterType);
+//! False for names of filter types we don't know.
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType);
+
+/**
+ * The scripts an output is found by in the basic filter: the script of legacy outputs (but not unspendable ones), the
+ * equivalent key hash script for key hash outputs and for witness outputs the key hash scripts of both the spending and
+ * the witness key, so that a light wallet can look for witness accounts by either key without knowing the other one.
+ */
+std::vector<CGCSFilter::Element> GetBasicFilterElements(const CTxOut& out);
+
+/** The filter of one block (BIP157), identified by the hash of the block it is made from. */
+class CBlockFilter
+{
+public:
+    CBlockFilter() = default;
+    //! Take over an encoded filter; throws std::ios_base::failure if it doesn't decode.
+    CBlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, std::vector<unsigned char> vFilter);
+    //! Build the filter of block; blockundo holds the outputs it spends.
+    CBlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockundo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const CGCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    uint256 GetHash() const;
+    //! The filter header: the hash of this filter on top of the header of the filter of the previous block, which commits to all filters before it.
+    uint256 ComputeHeader(const uint256& hashPrevHeader) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << (uint8_t)filterType << hashBlock << COMPACTSIZEVECTOR(filter.GetEncoded());
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        uint8_t nType;
+        std::vector<unsigned char> vFilter;
+        s >> nType >> hashBlock >> COMPACTSIZEVECTOR(vFilter);
+        filterType = (BlockFilterType)nType;
+        CGCSFilter::Params params;
+        if (!BuildParams(params))
+            throw std::ios_base::failure("unknown filter type");
+        filter = CGCSFilter(params, std::move(vFilter));
+    }
+
+private:
+    bool BuildParams(CGCSFilter::Params& params) const;
+
+    BlockFilterType filterType = BlockFilterType::INVALID;
+    uint256 hashBlock;
+    CGCSFilter filter;
+};
+
+#endif // GULDEN_BLOCKFILTER_H
@@ -14,10 +14,27 @@
 #include "streams.h"
 #include "clientversion.h"
 #include "validation/validation.h" //For cs_main
-#include "util.h" // For DO_BENCHMARK
+#include "metrics.h" // For DO_BENCHMARK
+#include "support/lz4.h"
+#include "crypto/common.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 CBlockStore blockStore;
 
+void CBlockStore::BlockFilePair::UnmapBlockFile()
+{
+#ifndef WIN32
+    if (blockmap)
+        munmap(const_cast<unsigned char*>(blockmap), blockmapsize);
+#endif
+    blockmap = nullptr;
+    blockmapsize = 0;
+}
+
 fs::path CBlockStore::GetBlockPosFilename(const CDiskBlockPos &pos, BlockFileType fileType)
 {
     std::string basename = mainPrefix + (fileType == BlockFileType::block ? "blk" : "rev");
@@ -34,6 +51,8 @@ FILE* CBlockStore::GetDiskFile(const CDiskBlockPos &pos, BlockFileType fileType,
     if (pos.IsNull())
         return NULL;
 
+    LOCK(cs_blockstore);
+
     if (int(vBlockfiles.size()) <= pos.nFile) {
         vBlockfiles.resize(pos.nFile + 1);
     }
@@ -73,17 +92,175 @@ FILE* CBlockStore::GetUndoFile(const CDiskBlockPos &pos, bool fNoCreate) {
     return GetDiskFile(pos, BlockFileType::undo, fNoCreate);
 }
 
+bool CBlockStore::GetMappedBlockData(const CDiskBlockPos& pos, size_t nBytes, const unsigned char*& data)
+{
+#ifdef WIN32
+    return false;
+#else
+    AssertLockHeld(cs_blockstore);
+    FILE* file = GetBlockFile(pos, true);
+    if (!file)
+        return false;
+    BlockFilePair& p = vBlockfiles[pos.nFile];
+
+    // The mapping shares the page cache with the file, but writes can still be sitting in the stdio buffer.
+    if (fflush(file) != 0)
+        return false;
+
+    size_t nEnd = (size_t)pos.nPos + nBytes;
+    if (nEnd > p.blockmapsize)
+    {
+        // The file has grown since it was mapped (or hasn't been mapped yet), map all of it.
+        struct stat st;
+        if (fstat(fileno(file), &st) != 0 || (size_t)st.st_size < nEnd)
+            return false;
+        p.UnmapBlockFile();
+        mappedBlockFiles.remove(pos.nFile);
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (map == MAP_FAILED)
+        {
+            LogPrintf("Unable to map block file %05u: %s\n", pos.nFile, strerror(errno));
+            return false;
+        }
+        p.blockmap = static_cast<const unsigned char*>(map);
+        p.blockmapsize = st.st_size;
+        mappedBlockFiles.push_back(pos.nFile);
+        while (mappedBlockFiles.size() > MAX_MAPPED_BLOCK_FILES)
+        {
+            vBlockfiles[mappedBlockFiles.front()].UnmapBlockFile();
+            mappedBlockFiles.pop_front();
+        }
+    }
+    else if (mappedBlockFiles.back() != pos.nFile)
+    {
+        mappedBlockFiles.remove(pos.nFile);
+        mappedBlockFiles.push_back(pos.nFile);
+    }
+
+    data = p.blockmap + pos.nPos;
+    return true;
+#endif
+}
+
+bool CBlockStore::DecompressBlockFrame(const unsigned char* data, size_t nSize, std::vector<unsigned char>& block)
+{
+    if (nSize < sizeof(uint32_t))
+        return false;
+    uint32_t nBlockSize = ReadLE32(data);
+    if (nBlockSize > MAX_SIZE)
+        return false;
+    block.resize(nBlockSize);
+    return LZ4DecompressBlock(data + sizeof(uint32_t), nSize - sizeof(uint32_t), block.data(), block.size());
+}
+
+template <typename Reader>
+bool CBlockStore::ReadBlockData(const CDiskBlockPos& pos, int nVersion, Reader&& read, const CMessageHeader::MessageStartChars* pMessageStart)
+{
+    // The index header, the message start followed by the size field, comes right before the block; only read as much of it as needed.
+    const unsigned int nHeaderSize = (pMessageStart ? CMessageHeader::MESSAGE_START_SIZE : 0) + sizeof(uint32_t);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - nHeaderSize);
+
+    // Held throughout, the mapping and the position in the file are shared with other readers.
+    LOCK(cs_blockstore);
+    try {
+        std::vector<unsigned char> block;
+        const unsigned char* headerData;
+        const unsigned char* data;
+        if (GetMappedBlockData(posHeader, nHeaderSize, headerData))
+        {
+            if (pMessageStart && memcmp(headerData, *pMessageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+                return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+            uint32_t nFrameSize = ReadLE32(headerData + nHeaderSize - sizeof(uint32_t));
+            unsigned int nSize = nFrameSize & ~BLOCK_FRAME_COMPRESSED;
+            if (nSize > MAX_SIZE || !GetMappedBlockData(pos, nSize, data))
+                return error("%s: Invalid block size %u at %s", __func__, nSize, pos.ToString());
+            if (nFrameSize & BLOCK_FRAME_COMPRESSED)
+            {
+                if (!DecompressBlockFrame(data, nSize, block))
+                    return error("%s: Corrupt compressed block at %s", __func__, pos.ToString());
+                data = block.data();
+                nSize = block.size();
+            }
+            CMemoryReader reader(SER_DISK, nVersion, data, nSize);
+            read(reader, nSize);
+            return true;
+        }
+
+        CFile filein(GetBlockFile(posHeader, true), SER_DISK, nVersion);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        if (pMessageStart)
+        {
+            CMessageHeader::MessageStartChars blockMessageStart;
+            filein >> FLATDATA(blockMessageStart);
+            if (memcmp(blockMessageStart, *pMessageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+                return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+        }
+        uint32_t nFrameSize;
+        filein >> nFrameSize;
+        unsigned int nSize = nFrameSize & ~BLOCK_FRAME_COMPRESSED;
+        if (nSize > MAX_SIZE)
+            return error("%s: Invalid block size %u at %s", __func__, nSize, pos.ToString());
+        if (!(nFrameSize & BLOCK_FRAME_COMPRESSED))
+        {
+            read(filein, nSize);
+            return true;
+        }
+        std::vector<unsigned char> compressed(nSize);
+        filein.read((char*)compressed.data(), compressed.size());
+        if (!DecompressBlockFrame(compressed.data(), compressed.size(), block))
+            return error("%s: Corrupt compressed block at %s", __func__, pos.ToString());
+        CMemoryReader reader(SER_DISK, nVersion, block.data(), block.size());
+        read(reader, block.size());
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 void CBlockStore::CloseBlockFiles()
 {
+    LOCK(cs_blockstore);
     vBlockfiles.clear();
+    mappedBlockFiles.clear();
+    recentBlocks.clear();
+    undoCache.clear();
     LogPrintStr("Block and undo files closed\n");
 }
 
-bool CBlockStore::WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+unsigned int CBlockStore::PrepareBlockForDisk(const CBlock& block, std::vector<unsigned char>& blockData)
+{
+    // Size field followed by the serialised block.
+    blockData.clear();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, blockData, sizeof(uint32_t), block);
+    uint32_t nFrameSize = blockData.size() - sizeof(uint32_t);
+
+    if (fCompressBlocks)
+    {
+        std::vector<unsigned char> compressed(2 * sizeof(uint32_t));
+        compressed.reserve(blockData.size());
+        WriteLE32(compressed.data() + sizeof(uint32_t), nFrameSize);
+        LZ4CompressBlock(blockData.data() + sizeof(uint32_t), nFrameSize, compressed);
+        if (compressed.size() < blockData.size())
+        {
+            blockData.swap(compressed);
+            nFrameSize = (blockData.size() - sizeof(uint32_t)) | BLOCK_FRAME_COMPRESSED;
+        }
+    }
+
+    WriteLE32(blockData.data(), nFrameSize);
+    return CMessageHeader::MESSAGE_START_SIZE + blockData.size();
+}
+
+bool CBlockStore::WriteBlockToDisk(const std::vector<unsigned char>& blockData, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     DO_BENCHMARK("CBlockStore: WriteBlockToDisk", BCLog::BENCH|BCLog::IO);
 
     AssertLockHeld(cs_main);
+    LOCK(cs_blockstore);
 
     // Open history file to append
     CFile fileout(GetBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -91,59 +268,105 @@ bool CBlockStore::WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, cons
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = ::GetSerializeSize(fileout, block);
-
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart);
+    fileout.write((const char*)blockData.data(), sizeof(uint32_t));
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write((const char*)blockData.data() + sizeof(uint32_t), blockData.size() - sizeof(uint32_t));
 
     return true;
 }
 
+unsigned int CBlockStore::GetBlockDiskSize(const CDiskBlockPos& pos)
+{
+    if (pos.IsNull() || pos.nPos < sizeof(uint32_t))
+        return 0;
+    LOCK(cs_blockstore);
+    CFile filein(GetBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return 0;
+    uint32_t nFrameSize;
+    try {
+        filein >> nFrameSize;
+    }
+    catch (const std::exception&) {
+        return 0;
+    }
+    return CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t) + (nFrameSize & ~BLOCK_FRAME_COMPRESSED);
+}
+
 bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const CChainParams& params, const CBlockIndex* index)
 {
     DO_BENCHMARK("CBlockStore: ReadBlockFromDisk", BCLog::BENCH|BCLog::IO);
 
-    AssertLockHeld(cs_main);
-
     block.SetNull();
 
-    // Open history file to read
-    CFile filein(GetBlockFile(pos, true), SER_DISK, CLIENT_VERSION | (isLegacy ? SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS : 0));
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
-    try {
-        filein >> block;
+    bool fCached = false;
+    {
+        LOCK(cs_blockstore);
+        for (auto it = recentBlocks.begin(); it != recentBlocks.end(); ++it) {
+            if (it->first == pos) {
+                recentBlocks.splice(recentBlocks.begin(), recentBlocks, it);
+                block = *it->second;
+                block.fChecked = false;
+                block.fPOWChecked = false;
+                fCached = true;
+                break;
+            }
+        }
     }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+
+    if (!fCached)
+    {
+        if (!ReadBlockData(pos, CLIENT_VERSION | (isLegacy ? SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS : 0), [&](auto& s, unsigned int)
+            {
+                if (fBlockArena)
+                    block.UnserializeWithArena(s);
+                else
+                    s >> block;
+            }))
+            return false;
+        CacheBlock(pos, std::make_shared<const CBlock>(block));
     }
 
     if (index && block.GetHashPoW2() != index->GetBlockHashPoW2())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                      index->ToString(), pos.ToString());
 
+    // The status of the index and the PoW cache belong to validation; only look at them now the block is read from disk.
+    // GetHashPoW2 doesn't cover the PoW of witness headers, so also compare the (legacy) hash the PoW is on before trusting what the index says about it.
+    LOCK(cs_main);
     bool fPOW_ok = false;
+    uint256 hashLegacy = block.GetHashLegacy();
+    bool fHeaderMatchesIndex = index && hashLegacy == index->GetBlockHashLegacy();
+    if (index && !fHeaderMatchesIndex)
+    {
+        // Leave fPOWChecked unset so that CheckBlock verifies the PoW of what is actually on disk.
+        LogPrintf("ReadBlockFromDisk: PoW header of %s at %s doesn't match index\n", index->ToString(), pos.ToString());
+        return true;
+    }
     int lastCheckPointHeight = params.Checkpoints().mapCheckpoints.rbegin()->first;
-    if (index && (index->nStatus & BLOCK_VALID_HEADER) != 0 && index->nHeight < lastCheckPointHeight)
+    if (fHeaderMatchesIndex && (index->nStatus & BLOCK_VALID_HEADER) != 0 && index->nHeight < lastCheckPointHeight)
     {
         // block header data equals that in our index which is valid and below checkpoint height
         // the expensive PoW check does not need be done
         fPOW_ok = true;
     }
+    else if (fHeaderMatchesIndex && (index->nStatus & BLOCK_POW_VERIFIED) != 0)
+    {
+        // block header data equals that in our index for which we have previously verified the PoW
+        fPOW_ok = true;
+    }
     else
     {
-        uint256 hashLegacy = block.GetHashLegacy();
-        if (checkedPoWCache.contains(hashLegacy))
+        uint8_t nPoWResult;
+        if (checkedPoWCache.tryGet(hashLegacy, nPoWResult))
         {
-            fPOW_ok = checkedPoWCache.get(hashLegacy);
+            fPOW_ok = (nPoWResult != POW_CHECK_FAILED);
         }
         else
         {
@@ -160,10 +383,60 @@ bool CBlockStore::ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, con
     return true;
 }
 
+bool CBlockStore::ReadBlockPrefixFromDisk(CBlock& block, const CDiskBlockPos& pos, unsigned int nMaxTransactions, const CBlockIndex* index)
+{
+    DO_BENCHMARK("CBlockStore: ReadBlockPrefixFromDisk", BCLog::BENCH|BCLog::IO);
+
+    block.SetNull();
+
+    bool fRead = ReadBlockData(pos, CLIENT_VERSION | (isLegacy ? SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS : 0), [&](auto& s, unsigned int)
+    {
+        s >> *(CBlockHeader*)&block;
+        uint64_t nTransactions = ReadCompactSize(s);
+        nTransactions = std::min(nTransactions, (uint64_t)nMaxTransactions);
+        block.vtx.resize(nTransactions);
+        for (auto& tx : block.vtx)
+            s >> tx;
+    });
+    if (!fRead)
+        return false;
+
+    if (index && block.GetHashPoW2() != index->GetBlockHashPoW2())
+        return error("ReadBlockPrefixFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s", index->ToString(), pos.ToString());
+
+    return true;
+}
+
+bool CBlockStore::ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    DO_BENCHMARK("CBlockStore: ReadRawBlockFromDisk", BCLog::BENCH|BCLog::IO);
+
+    block.clear();
+    if (isLegacy)
+        return false;
+
+    return ReadBlockData(pos, CLIENT_VERSION, [&](auto& s, unsigned int nSize)
+    {
+        block.resize(nSize);
+        s.read((char*)block.data(), nSize);
+    }, &messageStart);
+}
+
+bool CBlockStore::ReadTransactionFromDisk(CBlockHeader& header, CTransactionRef& tx, const CDiskBlockPos& pos, unsigned int nTxOffset)
+{
+    return ReadBlockData(pos, CLIENT_VERSION | (isLegacy ? SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS : 0), [&](auto& s, unsigned int)
+    {
+        s >> header;
+        s.ignore(nTxOffset);
+        s >> tx;
+    });
+}
+
 bool CBlockStore::UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     DO_BENCHMARK("CBlockStore: UndoWriteToDisk", BCLog::BENCH|BCLog::IO);
 
+    LOCK(cs_blockstore);
     // Open history file to append
     CFile fileout(GetUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
@@ -186,6 +459,7 @@ bool CBlockStore::UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& po
     hasher << blockundo;
     fileout << hasher.GetHash();
 
+    CacheUndo(pos, hashBlock, blockundo);
     return true;
 }
 
@@ -193,6 +467,15 @@ bool CBlockStore::UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& p
 {
     DO_BENCHMARK("CBlockStore: UndoReadFromDisk", BCLog::BENCH|BCLog::IO);
 
+    LOCK(cs_blockstore);
+    for (auto it = undoCache.begin(); it != undoCache.end(); ++it) {
+        if (it->pos == pos && it->hashBlock == hashBlock) {
+            undoCache.splice(undoCache.begin(), undoCache, it);
+            blockundo = it->blockundo;
+            return true;
+        }
+    }
+
     // Open history file to read
     CFile filein(GetUndoFile(pos, true), SER_DISK, CLIENT_VERSION | (isLegacy ? SERIALIZE_TXUNDO_LEGACY_COMPRESSION : 0) );
     if (filein.IsNull())
@@ -214,16 +497,44 @@ bool CBlockStore::UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& p
     if (hashChecksum != verifier.GetHash())
         return error("%s: Checksum mismatch", __func__);
 
+    CacheUndo(pos, hashBlock, blockundo);
     return true;
 }
 
+void CBlockStore::CacheBlock(const CDiskBlockPos& pos, const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs_blockstore);
+    if (RECENT_BLOCK_CACHE_SIZE == 0)
+        return;
+    recentBlocks.remove_if([&](const std::pair<CDiskBlockPos, std::shared_ptr<const CBlock>>& cached) { return cached.first == pos; });
+    if (recentBlocks.size() >= RECENT_BLOCK_CACHE_SIZE)
+        recentBlocks.pop_back();
+    recentBlocks.emplace_front(pos, pblock);
+}
+
+void CBlockStore::CacheUndo(const CDiskBlockPos& pos, const uint256& hashBlock, const CBlockUndo& blockundo)
+{
+    AssertLockHeld(cs_blockstore);
+    if (UNDO_CACHE_BLOCKS == 0)
+        return;
+    if (undoCache.size() >= UNDO_CACHE_BLOCKS)
+        undoCache.pop_back();
+    undoCache.push_front({pos, hashBlock, blockundo});
+}
+
 void CBlockStore::UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
+    LOCK(cs_blockstore);
+    // Positions in the pruned files get used again for other blocks.
+    recentBlocks.remove_if([&](const std::pair<CDiskBlockPos, std::shared_ptr<const CBlock>>& cached) { return setFilesToPrune.count(cached.first.nFile) > 0; });
+    undoCache.remove_if([&](const CachedUndo& cached) { return setFilesToPrune.count(cached.pos.nFile) > 0; });
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         int nFile = *it;
         if (nFile < 0 || nFile >= int(vBlockfiles.size()))
             break;
         BlockFilePair& p = vBlockfiles[nFile];
+        p.UnmapBlockFile();
+        mappedBlockFiles.remove(nFile);
         if (p.blockfile) {
             fclose(p.blockfile);
             p.blockfile = nullptr;
@@ -241,6 +552,7 @@ void CBlockStore::UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 
 bool CBlockStore::Rename(const std::string& newPrefix)
 {
+    LOCK(cs_blockstore);
     CloseBlockFiles();
 
     // Move all the block files into backup files
@@ -16,16 +16,41 @@
 //fixme: (2.1) methods to support conversion of 1.6 block storage to 2.0 can be reverted once not needed anymore
 // revert the changes in this commit for blockstore.h + .cpp back to 517362d123ce7c7e83de86a962ad099abbf199b0
 
+#include <list>
 #include <stdio.h>
 #include "chain.h"
 #include "chainparams.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
+#include "sync.h"
 #include "undo.h"
 
+/** Maximum number of block files kept memory mapped for reading at once */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = sizeof(void*) > 4 ? 32 : 2;
+/** Flag in the size field of a block's index header for a compressed block; the data that follows is then the uncompressed size (4 bytes) and the LZ4 compressed block */
+static const uint32_t BLOCK_FRAME_COMPRESSED = 0x80000000;
+/** Number of recently received or read blocks kept in memory, for the witness, mining and reorg code that reads the blocks near the tip over and over */
+static const unsigned int RECENT_BLOCK_CACHE_SIZE = 8;
+/** Number of blocks whose undo data is kept in memory after writing or reading it, for reorgs and the indexes that follow the tip */
+static const unsigned int UNDO_CACHE_BLOCKS = 16;
+/** -compressblocks default */
+static const bool DEFAULT_COMPRESS_BLOCKS = false;
+
+/**
+ * The block and undo files.
+ *
+ * Reads don't need cs_main, so blocks can be served to peers and RPC while a block is being connected; the files themselves are protected by
+ * cs_blockstore, which is taken last (after cs_main and cs_LastBlockFile, never the other way round).
+ */
 class CBlockStore
 {
 public:
-    CBlockStore(bool legacy=false) : isLegacy(legacy) {}
+    //! Protects the open files and their mappings; has to be held while using a file returned by GetBlockFile or GetUndoFile.
+    mutable CCriticalSection cs_blockstore;
+
+    CBlockStore(bool legacy=false) : isLegacy(legacy), fCompressBlocks(false) {}
+
+    /** Store new blocks compressed (when that makes them smaller); blocks are read back transparently in either format. */
+    void SetCompressBlocks(bool fCompressBlocksIn) { fCompressBlocks = fCompressBlocksIn; }
 
     bool BlockFileExists(const CDiskBlockPos &pos);
 
@@ -43,7 +68,13 @@ public:
     void CloseBlockFiles();
 
 
-    bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+    /** Serialise block for WriteBlockToDisk, compressed if enabled. Returns the number of bytes it will take up in the block file, to reserve with FindBlockPos. */
+    unsigned int PrepareBlockForDisk(const CBlock& block, std::vector<unsigned char>& blockData);
+    bool WriteBlockToDisk(const std::vector<unsigned char>& blockData, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+    /** Number of bytes the block stored at pos takes up in the block file (as PrepareBlockForDisk), 0 if it can't be read. */
+    unsigned int GetBlockDiskSize(const CDiskBlockPos& pos);
+    /** Decompress the data of a compressed block frame (see BLOCK_FRAME_COMPRESSED) into the serialised block. */
+    static bool DecompressBlockFrame(const unsigned char* data, size_t nSize, std::vector<unsigned char>& block);
 
     /** Read block from disk and do basic verifiaction to guard against (disk) corruption.
         If an index is given which is: BLOCK_VALID_HEADER validated, has height below last checkpoint then the
@@ -53,7 +84,25 @@ public:
     */
     bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const CChainParams& params, const CBlockIndex* index = nullptr);
 
+    /** Remember the block stored at pos, so that ReadBlockFromDisk doesn't have to go to the block file for it. */
+    void CacheBlock(const CDiskBlockPos& pos, const std::shared_ptr<const CBlock>& pblock);
+
+    /** Read only the header and the first nMaxTransactions transactions (e.g. just the coinbase) of the block at pos, the remaining transactions are not deserialised.
+        The result is not a complete block and must not be validated as such; if an index is given the header is checked against it.
+    */
+    bool ReadBlockPrefixFromDisk(CBlock& block, const CDiskBlockPos& pos, unsigned int nMaxTransactions, const CBlockIndex* index = nullptr);
+
+    /** Read the serialised block at pos without deserialising it (decompressing it if stored compressed); the bytes are the same as the network
+        serialisation of the block with PoW² witness header and segregated signatures. Only the message start is checked, not the block itself.
+        Fails for a legacy block store, whose format differs from the network serialisation.
+    */
+    bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+
+    /** Read the header of the block at pos and the transaction nTxOffset bytes after it (see CDiskTxPos). */
+    bool ReadTransactionFromDisk(CBlockHeader& header, CTransactionRef& tx, const CDiskBlockPos& pos, unsigned int nTxOffset);
+
     bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart);
+    /** Read the undo data at pos, from the undo cache if it was written or read recently. */
     bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
     /**
@@ -75,33 +124,71 @@ private:
     fs::path GetBlockPosFilename(const CDiskBlockPos &pos, BlockFileType fileType);
     FILE* GetDiskFile(const CDiskBlockPos &pos, BlockFileType fileType, bool fNoCreate);
 
+    /** Point data at the nBytes at pos in the memory mapped block file, (re)mapping the file as needed.
+        Returns false if that isn't possible (e.g. no mmap on this platform), in which case callers read the file instead.
+    */
+    bool GetMappedBlockData(const CDiskBlockPos& pos, size_t nBytes, const unsigned char*& data);
+    /** Call read(stream, nSize) with a stream over the nSize bytes of the serialised block at pos; which is the mapped block file,
+        the decompressed block or the block file itself. Deserialisation errors are caught and reported as a failed read.
+        If pMessageStart is given the message start of the index header must match it.
+    */
+    template <typename Reader>
+    bool ReadBlockData(const CDiskBlockPos& pos, int nVersion, Reader&& read, const CMessageHeader::MessageStartChars* pMessageStart = nullptr);
+
+    /** Remember the undo data at pos, dropping the least recently used if the cache is full. */
+    void CacheUndo(const CDiskBlockPos& pos, const uint256& hashBlock, const CBlockUndo& blockundo);
+
+    //! The last RECENT_BLOCK_CACHE_SIZE blocks cached or read, most recently used first.
+    std::list<std::pair<CDiskBlockPos, std::shared_ptr<const CBlock>>> recentBlocks;
+
+    struct CachedUndo {
+        CDiskBlockPos pos;
+        uint256 hashBlock;
+        CBlockUndo blockundo;
+    };
+    //! The undo data of the last UNDO_CACHE_BLOCKS blocks written or read, most recently used first.
+    std::list<CachedUndo> undoCache;
+
     struct BlockFilePair {
         FILE* blockfile = nullptr;
         FILE* undofile = nullptr;
-        BlockFilePair() : blockfile(nullptr), undofile(nullptr) {}
+        //! Read only mapping of the first blockmapsize bytes of the block file, if mapped.
+        const unsigned char* blockmap = nullptr;
+        size_t blockmapsize = 0;
+        BlockFilePair() : blockfile(nullptr), undofile(nullptr), blockmap(nullptr), blockmapsize(0) {}
 
         BlockFilePair(BlockFilePair&& other) :
             blockfile(other.blockfile),
-            undofile(other.undofile)
+            undofile(other.undofile),
+            blockmap(other.blockmap),
+            blockmapsize(other.blockmapsize)
         {
             other.blockfile = nullptr;
             other.undofile = nullptr;
+            other.blockmap = nullptr;
+            other.blockmapsize = 0;
         }
 
         ~BlockFilePair() {
+            UnmapBlockFile();
             if (blockfile)
                 fclose(blockfile);
             if (undofile)
                 fclose(undofile);
         }
+
+        void UnmapBlockFile();
     };
 
     std::vector<BlockFilePair> vBlockfiles;
+    //! Numbers of the block files that are mapped, least recently used first.
+    std::list<int> mappedBlockFiles;
 
     // more block store format conversion support:
     fs::path GetBlockPosNewFilename(const CDiskBlockPos &pos, BlockFileType fileType, const std::string& newPrefix);
     bool isLegacy;
     std::string mainPrefix;
+    bool fCompressBlocks;
 };
 
 extern CBlockStore blockStore;
@@ -55,19 +55,24 @@ CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, c
 {
 }
 
-inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const unsigned char* pDataToHash, size_t nDataLen) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pDataToHash, nDataLen) % (vData.size() * 8);
 }
 
 void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    insert(vKey.data(), vKey.size());
+}
+
+void CBloomFilter::insert(const unsigned char* pKey, size_t nKeyLen)
 {
     if (isFull)
         return;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nKeyLen);
         // Sets bit nIndex of vData
         vData[nIndex >> 3] |= (1 << (7 & nIndex));
     }
@@ -79,17 +84,20 @@ void CBloomFilter::insert(const COutPoint& outpoint)
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     //fixme: (2.1) SEGSIG - HIGH
     outpoint.WriteToStream(stream, (CTxInType)0, 0, 3);
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
+    insert((const unsigned char*)stream.data(), stream.size());
 }
 
 void CBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    insert(hash.begin(), hash.size());
 }
 
 bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+{
+    return contains(vKey.data(), vKey.size());
+}
+
+bool CBloomFilter::contains(const unsigned char* pKey, size_t nKeyLen) const
 {
     if (isFull)
         return true;
@@ -97,7 +105,7 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
         return false;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nKeyLen);
         // Checks bit nIndex of vData
         if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
             return false;
@@ -110,14 +118,12 @@ bool CBloomFilter::contains(const COutPoint& outpoint) const
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     //fixme: (2.1) SEGSIG HIGH
     outpoint.WriteToStream(stream, (CTxInType)0, 0, 3);
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
+    return contains((const unsigned char*)stream.data(), stream.size());
 }
 
 bool CBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    return contains(hash.begin(), hash.size());
 }
 
 void CBloomFilter::clear()
@@ -189,7 +195,7 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
             }
             case CTxOutType::PoW2WitnessOutput:
             {
-                if (contains(std::vector<unsigned char>(txout.output.standardKeyHash.keyID.begin(), txout.output.standardKeyHash.keyID.end())))
+                if (contains(txout.output.standardKeyHash.keyID.begin(), txout.output.standardKeyHash.keyID.size()))
                 {
                     fFound = true;
                     insert(COutPoint(hash, i));
@@ -198,12 +204,12 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
             }
             case CTxOutType::StandardKeyHashOutput:
             {
-                if (contains(std::vector<unsigned char>(txout.output.witnessDetails.witnessKeyID.begin(), txout.output.witnessDetails.witnessKeyID.end())))
+                if (contains(txout.output.witnessDetails.witnessKeyID.begin(), txout.output.witnessDetails.witnessKeyID.size()))
                 {
                     fFound = true;
                     insert(COutPoint(hash, i));
                 }
-                else if(contains(std::vector<unsigned char>(txout.output.witnessDetails.spendingKeyID.begin(), txout.output.witnessDetails.spendingKeyID.end())))
+                else if(contains(txout.output.witnessDetails.spendingKeyID.begin(), txout.output.witnessDetails.spendingKeyID.size()))
                 {
                     fFound = true;
                     insert(COutPoint(hash, i));
@@ -279,11 +285,21 @@ CRollingBloomFilter::CRollingBloomFilter(const unsigned int nElements, const dou
 }
 
 /* Similar to CBloomFilter::Hash */
-static inline uint32_t RollingBloomHash(unsigned int nHashNum, uint32_t nTweak, const std::vector<unsigned char>& vDataToHash) {
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash);
+static inline uint32_t RollingBloomHash(unsigned int nHashNum, uint32_t nTweak, const unsigned char* pDataToHash, size_t nDataLen) {
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pDataToHash, nDataLen);
+}
+
+/* Map x uniformly into [0, n), without a division. */
+static inline uint32_t FastRange32(uint32_t x, uint32_t n) {
+    return ((uint64_t)x * (uint64_t)n) >> 32;
 }
 
 void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    insert(vKey.data(), vKey.size());
+}
+
+void CRollingBloomFilter::insert(const unsigned char* pKey, size_t nKeyLen)
 {
     if (nEntriesThisGeneration == nEntriesPerGeneration) {
         nEntriesThisGeneration = 0;
@@ -303,10 +319,14 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
     }
     nEntriesThisGeneration++;
 
+    /* Hash function n is h1 + n * h2 (Kirsch and Mitzenmacher), which does as well as independent hash functions
+     * for a bloom filter at the cost of two. */
+    const uint32_t h1 = RollingBloomHash(0, nTweak, pKey, nKeyLen);
+    const uint32_t h2 = RollingBloomHash(1, nTweak, pKey, nKeyLen);
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
+        uint32_t h = h1 + n * h2;
         int bit = h & 0x3F;
-        uint32_t pos = (h >> 6) % data.size();
+        uint32_t pos = FastRange32(h, data.size());
         /* The lowest bit of pos is ignored, and set to zero for the first bit, and to one for the second. */
         data[pos & ~1] = (data[pos & ~1] & ~(((uint64_t)1) << bit)) | ((uint64_t)(nGeneration & 1)) << bit;
         data[pos | 1] = (data[pos | 1] & ~(((uint64_t)1) << bit)) | ((uint64_t)(nGeneration >> 1)) << bit;
@@ -315,16 +335,22 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
 
 void CRollingBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> vData(hash.begin(), hash.end());
-    insert(vData);
+    insert(hash.begin(), hash.size());
 }
 
 bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 {
+    return contains(vKey.data(), vKey.size());
+}
+
+bool CRollingBloomFilter::contains(const unsigned char* pKey, size_t nKeyLen) const
+{
+    const uint32_t h1 = RollingBloomHash(0, nTweak, pKey, nKeyLen);
+    const uint32_t h2 = RollingBloomHash(1, nTweak, pKey, nKeyLen);
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
+        uint32_t h = h1 + n * h2;
         int bit = h & 0x3F;
-        uint32_t pos = (h >> 6) % data.size();
+        uint32_t pos = FastRange32(h, data.size());
         /* If the relevant bit is not set in either data[pos & ~1] or data[pos | 1], the filter does not contain vKey */
         if (!(((data[pos & ~1] | data[pos | 1]) >> bit) & 1)) {
             return false;
@@ -335,8 +361,7 @@ bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 
 bool CRollingBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> vData(hash.begin(), hash.end());
-    return contains(vData);
+    return contains(hash.begin(), hash.size());
 }
 
 void CRollingBloomFilter::reset()
@@ -12,6 +12,7 @@
 #ifndef GULDEN_BLOOM_H
 #define GULDEN_BLOOM_H
 
+#include "memusage.h"
 #include "serialize.h"
 
 #include <vector>
@@ -58,7 +59,11 @@ private:
     unsigned int nTweak;
     unsigned char nFlags;
 
-    unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    unsigned int Hash(unsigned int nHashNum, const unsigned char* pDataToHash, size_t nDataLen) const;
+
+    //! The element as bytes, without copying it into a vector first.
+    void insert(const unsigned char* pKey, size_t nKeyLen);
+    bool contains(const unsigned char* pKey, size_t nKeyLen) const;
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweak);
@@ -122,6 +127,9 @@ public:
  *
  * It needs around 1.8 bytes per element per factor 0.1 of false positive rate.
  * (More accurately: 3/(log(256)*log(2)) * log(1/fpRate) * nElements bytes)
+ *
+ * Unlike CBloomFilter, whose hash functions are fixed by the protocol, the positions of an element are derived from
+ * just two hashes of it (double hashing), however many hash functions the false positive rate calls for.
  */
 class CRollingBloomFilter
 {
@@ -138,7 +146,12 @@ public:
 
     void reset();
 
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(data); }
+
 private:
+    void insert(const unsigned char* pKey, size_t nKeyLen);
+    bool contains(const unsigned char* pKey, size_t nKeyLen) const;
+
     int nEntriesPerGeneration;
     int nEntriesThisGeneration;
     int nGeneration;
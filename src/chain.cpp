@@ -94,100 +94,34 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     return pindex;
 }
 
-void CCloneChain::FreeMemory()
-{
-    //fixme: (2.1) - We should use shared_ptr for the chain instead of raw pointers
-    //This will remove the need for this messy vFree situation; and also allow us to re-enable the miner test that relied on nHeight++ that we have had to disable due to a crash in this FreeMemory call.
-    for (auto index : vFree)
-    {
-        if (vChain[index->nHeight - cloneFrom] == index)
-            vChain[index->nHeight - cloneFrom] = nullptr;
-        delete index;
-    }
-    for (auto index : vChain)
-    {
-        if (index)
-        {
-            delete index;
-        }
-    }
-    vFree.clear();
-    vChain.clear();
-}
-
 CCloneChain::CCloneChain(const CChain& _origin, unsigned int _cloneFrom, const CBlockIndex *retainIndexIn, CBlockIndex *&retainIndexOut)
 : CChain()
 , origin(_origin)
 , cloneFrom(_cloneFrom)
+, forkHeight(_origin.Height())
 {
-    //fixme: (2.0.x) - Temporarily allow nested cloning 'getwitnessinfo' needs this; however we should fix this in the near future.
-    // NB! Nested cloning is okay IFF we stick to a fixed clone height, the second we start trying to optimise by using a non-fixed clone height there will be problems.
-    // forbid nested cloning
-    //assert(dynamic_cast<const CCloneChain*>(&origin) == nullptr);
-
+    // Nested cloning is fine, as long as the inner clone is done with before the outer one changes.
     assert(cloneFrom <= origin.Height());
     assert(cloneFrom >=0);
 
-    vChain.reserve(origin.Height() + 1 - cloneFrom);
-    vFree.reserve(origin.Height() + 1 - cloneFrom);
-
-    CBlockIndex* pprev = nullptr;
-    for (int i=cloneFrom; i<=origin.Height(); i++)
-    {
-        CBlockIndex* index = origin[i];
-        vChain.emplace_back(new CBlockIndex(*index));
-        vFree.push_back(vChain.back());
-        if (pprev)
-            vChain.back()->pprev = pprev;
-        vChain.back()->pskip = nullptr;
-        vChain.back()->BuildSkip();
-        pprev = vChain.back();
-        if (index == retainIndexIn)
-            retainIndexOut = pprev;
-    }
-
-    // case where retainIndexIn is in the chain before the part we've cloned
-    // you better know what you're doing!
-    if (!retainIndexOut && origin.Contains(retainIndexIn))
-        retainIndexOut = const_cast<CBlockIndex*>(retainIndexIn);
-
-    if (retainIndexIn && !retainIndexOut)
-    {
-        // Link the pprev(s) of our new potential tip with a new pointer thats inside the cloned chain instead of the old pointer to the old chain.
-        retainIndexOut = new CBlockIndex(*retainIndexIn);
-        {
-            //Don't worry about leaks, these become part of tempChain and are cleaned up along with tempChain.
-            CBlockIndex* pNotInChain = retainIndexOut;
-            // We might be sitting multiple blocks ahead of the chain, in which case we need to clone those blocks as well.
-            while (pNotInChain->pprev->nHeight > Tip()->nHeight || pNotInChain->pprev->GetBlockHashPoW2() != vChain[pNotInChain->pprev->nHeight - cloneFrom]->GetBlockHashPoW2())
-            {
-                pNotInChain->pskip = nullptr;
-                pNotInChain->pprev = new CBlockIndex(*pNotInChain->pprev);
-                pNotInChain = pNotInChain->pprev;
-            }
-            while (pNotInChain->pprev != vChain[pNotInChain->pprev->nHeight - cloneFrom])
-            {
-                pNotInChain->pskip = nullptr;
-                pNotInChain->pprev = vChain[pNotInChain->pprev->nHeight - cloneFrom];
-                pNotInChain = pNotInChain->pprev;
-            }
-        }
-    }
+    // The block index entries are shared, so the block to retain (which may also sit on a fork of origin) is usable as it is.
+    retainIndexOut = const_cast<CBlockIndex*>(retainIndexIn);
 }
 
 CBlockIndex *CCloneChain::operator[](int nHeight) const
 {
-    if (nHeight >= cloneFrom && nHeight <= Height())
-    {
-        return vChain[nHeight - cloneFrom];
-    }
-    else
+    if (nHeight < 0)
+        return nullptr;
+    if (nHeight <= forkHeight)
         return origin[nHeight];
+    if (nHeight <= Height())
+        return vChain[nHeight - forkHeight - 1];
+    return nullptr;
 }
 
 int CCloneChain::Height() const
 {
-    return cloneFrom + vChain.size() - 1;
+    return forkHeight + vChain.size();
 }
 
 void CCloneChain::SetTip(CBlockIndex *pindex)
@@ -195,10 +129,62 @@ void CCloneChain::SetTip(CBlockIndex *pindex)
     // not allowed to modify origin chain
     assert(pindex != nullptr && pindex->nHeight >= cloneFrom);
 
-    vChain.resize(pindex->nHeight - cloneFrom + 1);
+    // Walk back to the last block the new tip has in common with the current chain, only what comes after it changes.
+    std::vector<CBlockIndex*> vNew;
+    while (pindex && (*this)[pindex->nHeight] != pindex)
+    {
+        vNew.push_back(pindex);
+        pindex = pindex->pprev;
+    }
+    int nCommonHeight = pindex ? pindex->nHeight : -1;
+    assert(nCommonHeight >= cloneFrom - 1);
 
-    while (pindex && vChain[pindex->nHeight - cloneFrom] != pindex) {
-        vChain[pindex->nHeight - cloneFrom] = pindex;
+    if (nCommonHeight < forkHeight)
+    {
+        forkHeight = nCommonHeight;
+        vChain.clear();
+    }
+    else
+    {
+        vChain.resize(nCommonHeight - forkHeight);
+    }
+    vChain.insert(vChain.end(), vNew.rbegin(), vNew.rend());
+}
+
+CBranchChain::CBranchChain(const CChain& _origin, CBlockIndex* pindex)
+: CChain()
+, origin(_origin)
+, forkHeight(-1)
+{
+    SetTip(pindex);
+}
+
+CBlockIndex *CBranchChain::operator[](int nHeight) const
+{
+    if (nHeight < 0)
+        return nullptr;
+    if (nHeight <= forkHeight)
+        return origin[nHeight];
+    if (nHeight <= Height())
+        return vChain[nHeight - forkHeight - 1];
+    return nullptr;
+}
+
+int CBranchChain::Height() const
+{
+    return forkHeight + vChain.size();
+}
+
+void CBranchChain::SetTip(CBlockIndex *pindex)
+{
+    assert(pindex != nullptr);
+
+    vChain.clear();
+    const CBlockIndex* pfork = origin.FindFork(pindex);
+    forkHeight = pfork ? pfork->nHeight : -1;
+    vChain.resize(pindex->nHeight - forkHeight);
+    while (pindex && pindex->nHeight > forkHeight) {
+        vChain[pindex->nHeight - forkHeight - 1] = pindex;
         pindex = pindex->pprev;
     }
 }
@@ -19,6 +19,7 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <memory>
 #include <vector>
 #include <valarray>
 /**
@@ -167,6 +168,9 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_POW_VERIFIED      =   256, //!< header PoW has been fully verified by this node (and need never be verified again)
+    BLOCK_POW_PENDING_CHECKPOINT = 512, //!< header was accepted without PoW verification as part of a run up to a checkpoint that has not been accepted yet, PoW must still be checked for its block (and is verified in the background) until it is
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -174,6 +178,13 @@ enum BlockStatus: uint32_t {
  * candidates to be the next block. A blockindex may have multiple pprev pointing
  * to it, but at most one of them can be part of the currently active branch.
  */
+/** The parts of the PoW² witness header that are only needed to rebuild the header (hashing, storing the index, RPC), see CBlockIndex. */
+struct CBlockIndexWitnessHeader
+{
+    uint256 hashMerkleRootPoW2Witness;
+    std::vector<unsigned char> witnessHeaderPoW2Sig; // 65 bytes
+};
+
 class CBlockIndex
 {
 public:
@@ -216,9 +227,9 @@ public:
     //! PoW2 witness block header
     int32_t nVersionPoW2Witness;
     uint32_t nTimePoW2Witness;
-    uint256 hashMerkleRootPoW2Witness;
-    std::vector<unsigned char> witnessHeaderPoW2Sig; // 65 bytes
-
+    //! Rest of the witness header, kept out of line as nothing that walks the chain needs it; nullptr for blocks without one.
+    //! Never changed once set, so copies of an index entry share it.
+    std::shared_ptr<const CBlockIndexWitnessHeader> witnessHeader;
 
     //! block header
     int32_t nVersion;
@@ -242,6 +253,16 @@ public:
     //! (memory only) Maximum nTime in the chain upto and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) Number and total raw weight of the unspent witness outputs after this block; -1 when not (yet) known.
+    //! Maintained incrementally by ConnectBlock, see GetPow2NetworkWeight.
+    int64_t nWitnessCount;
+    int64_t nWitnessTotalWeight;
+
+    //! (memory only) Memoised results of IsPow2Phase4Active/IsPow2Phase5Active for this block; -1 when not (yet) known.
+    //! Both only depend on the block and its ancestors so once known they never change.
+    mutable int8_t nPoW2Phase4Active;
+    mutable int8_t nPoW2Phase5Active;
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -257,11 +278,14 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nWitnessCount = -1;
+        nWitnessTotalWeight = -1;
+        nPoW2Phase4Active = -1;
+        nPoW2Phase5Active = -1;
 
         nVersionPoW2Witness = 0;
         nTimePoW2Witness = 0;
-        hashMerkleRootPoW2Witness = uint256();
-        witnessHeaderPoW2Sig.clear();
+        witnessHeader.reset();
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -281,8 +305,7 @@ public:
 
         nVersionPoW2Witness = block.nVersionPoW2Witness;
         nTimePoW2Witness = block.nTimePoW2Witness;
-        hashMerkleRootPoW2Witness = block.hashMerkleRootPoW2Witness;
-        witnessHeaderPoW2Sig = block.witnessHeaderPoW2Sig;
+        SetWitnessHeader(block.hashMerkleRootPoW2Witness, block.witnessHeaderPoW2Sig);
         nVersion       = block.nVersion;
         hashMerkleRoot = block.hashMerkleRoot;
         nTime          = block.nTime;
@@ -290,6 +313,25 @@ public:
         nNonce         = block.nNonce;
     }
 
+    uint256 GetHashMerkleRootPoW2Witness() const
+    {
+        return witnessHeader ? witnessHeader->hashMerkleRootPoW2Witness : uint256();
+    }
+
+    const std::vector<unsigned char>& GetWitnessHeaderPoW2Sig() const
+    {
+        static const std::vector<unsigned char> emptySig;
+        return witnessHeader ? witnessHeader->witnessHeaderPoW2Sig : emptySig;
+    }
+
+    void SetWitnessHeader(const uint256& hashMerkleRootPoW2Witness, const std::vector<unsigned char>& witnessHeaderPoW2Sig)
+    {
+        if (hashMerkleRootPoW2Witness.IsNull() && witnessHeaderPoW2Sig.empty())
+            witnessHeader.reset();
+        else
+            witnessHeader = std::make_shared<const CBlockIndexWitnessHeader>(CBlockIndexWitnessHeader{hashMerkleRootPoW2Witness, witnessHeaderPoW2Sig});
+    }
+
     CDiskBlockPos GetBlockPos() const {
         CDiskBlockPos ret;
         if (nStatus & BLOCK_HAVE_DATA) {
@@ -313,8 +355,8 @@ public:
         CBlockHeader block;
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
-        block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+        block.hashMerkleRootPoW2Witness = GetHashMerkleRootPoW2Witness();
+        block.witnessHeaderPoW2Sig = GetWitnessHeaderPoW2Sig();
         block.nVersion       = nVersion;
         if (pprev)
             block.hashPrevBlock = pprev->GetBlockHashPoW2();
@@ -524,10 +566,14 @@ public:
             if (nVersionPoW2Witness != 0)
             {
                 READWRITE(nTimePoW2Witness);
+                uint256 hashMerkleRootPoW2Witness = GetHashMerkleRootPoW2Witness();
+                std::vector<unsigned char> witnessHeaderPoW2Sig = GetWitnessHeaderPoW2Sig();
                 READWRITE(hashMerkleRootPoW2Witness);
                 if (ser_action.ForRead())
                     witnessHeaderPoW2Sig.resize(65);
                 READWRITENOSIZEVECTOR(witnessHeaderPoW2Sig);
+                if (ser_action.ForRead())
+                    SetWitnessHeader(hashMerkleRootPoW2Witness, witnessHeaderPoW2Sig);
             }
         }
         catch (...)
@@ -540,8 +586,8 @@ public:
         CBlockHeader block;
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
-        block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+        block.hashMerkleRootPoW2Witness = GetHashMerkleRootPoW2Witness();
+        block.witnessHeaderPoW2Sig = GetWitnessHeaderPoW2Sig();
         block.nVersion        = nVersion;
         block.hashPrevBlock   = hashPrev;
         block.hashMerkleRoot  = hashMerkleRoot;
@@ -556,8 +602,8 @@ public:
         CBlockHeader block;
         block.nVersionPoW2Witness = nVersionPoW2Witness;
         block.nTimePoW2Witness = nTimePoW2Witness;
-        block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+        block.hashMerkleRootPoW2Witness = GetHashMerkleRootPoW2Witness();
+        block.witnessHeaderPoW2Sig = GetWitnessHeaderPoW2Sig();
         block.nVersion        = nVersion;
         block.hashPrevBlock   = hashPrev;
         block.hashMerkleRoot  = hashMerkleRoot;
@@ -658,18 +704,16 @@ public:
     virtual ~CChain(){};
 };
 
-// Simple helper class to control memory of cloned chains.
+// Chain that starts out as a copy of another one and can then be moved to another tip (e.g. by ForceActivateChain) without affecting the original.
+// Nothing is copied: heights up to the point where the two chains part are looked up in the original, only pointers to the blocks past that point are held.
+// So the block index entries are shared with the original chain, and the original must not change while the clone is in use.
+// The tip can only be moved to blocks that share the original chain up to cloneFrom.
 class CCloneChain : public CChain
 {
 public:
     CCloneChain() = delete;
     CCloneChain(const CChain& _origin, unsigned int _cloneFrom, const CBlockIndex* retainIndexIn, CBlockIndex*& retainIndexOut);
 
-    virtual ~CCloneChain()
-    {
-        FreeMemory();
-    }
-
     virtual CBlockIndex *operator[](int nHeight) const override;
 
     virtual int Height() const override;
@@ -677,11 +721,29 @@ public:
     virtual void SetTip(CBlockIndex *pindex) override;
 
 private:
-    void FreeMemory();
-
     const CChain& origin;
     int cloneFrom;
-    std::vector<CBlockIndex*> vFree;
+    //! Last height of origin that is still part of this chain, vChain holds the blocks after it.
+    int forkHeight;
+};
+
+// Read only view of another chain as it would be with pindex as its tip (pindex can also sit on a fork of that chain).
+// Unlike CCloneChain no block index entries are copied; only pointers to the blocks past the fork point are held.
+class CBranchChain : public CChain
+{
+public:
+    CBranchChain() = delete;
+    CBranchChain(const CChain& _origin, CBlockIndex* pindex);
+
+    virtual CBlockIndex *operator[](int nHeight) const override;
+
+    virtual int Height() const override;
+
+    virtual void SetTip(CBlockIndex *pindex) override;
+
+private:
+    const CChain& origin;
+    int forkHeight;
 };
 
 #endif // GULDEN_CHAIN_H
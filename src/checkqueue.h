@@ -8,6 +8,10 @@
 #include "sync.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +20,11 @@
 template <typename T>
 class CCheckQueueControl;
 
+//! Number of work queues; workers beyond this share a queue with another worker.
+static const unsigned int CHECKQUEUE_MAX_SLOTS = 32;
+//! What a batch of checks should take, in nanoseconds; long enough to make the queue overhead negligible, short enough for all workers to finish at about the same time.
+static const int64_t CHECKQUEUE_TARGET_BATCH_NANOS = 50000;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +34,27 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a queue of its own (slot 0 is the master's) that the
+  * master spreads added checks over. Workers take batches from the back of
+  * their own queue and, once it is empty, steal from the front of the others,
+  * so that the shared mutex is only taken to go to sleep and to wake up.
+  * The batch size adapts to what checks have been costing: cheap checks are
+  * taken many at a time, expensive ones few at a time, never more than
+  * nBatchSize.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A worker's queue of checks.
+    struct Slot
+    {
+        boost::mutex mutex;
+        std::deque<T> queue;
+    };
+
+    //! Mutex for going to sleep and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,25 +63,33 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The work queues; as the order of booleans doesn't matter the order in which they are emptied doesn't either.
+    std::array<Slot, CHECKQUEUE_MAX_SLOTS> slots;
+
+    //! Number of checks in the work queues, so that idle workers don't have to look through all of them to know there is nothing.
+    std::atomic<unsigned int> nQueued;
+
+    //! Number of worker threads started, excluding the master.
+    std::atomic<unsigned int> nWorkers;
+
+    //! Slot the next added checks go to first.
+    unsigned int nNextSlot;
 
     //! The number of workers (including the master) that are idle.
-    int nIdle;
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -65,66 +97,110 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Running average of what a check takes, in nanoseconds; 0 until the first batch is timed.
+    std::atomic<int64_t> nCheckNanos;
+
+    //! How many checks to take at once: enough for about CHECKQUEUE_TARGET_BATCH_NANOS, while leaving something for the idle workers.
+    unsigned int GetBatchSize() const
+    {
+        int64_t nCost = nCheckNanos.load(std::memory_order_relaxed);
+        unsigned int nAdaptive = nCost > 0 ? (unsigned int)std::min<int64_t>(nBatchSize, std::max<int64_t>(1, CHECKQUEUE_TARGET_BATCH_NANOS / nCost)) : nBatchSize;
+        return std::max(1U, std::min(nAdaptive, nQueued.load(std::memory_order_relaxed) / (nTotal + nIdle + 1)));
+    }
+
+    //! The slots checks are added to: the master's and one per worker.
+    unsigned int GetActiveSlots() const
+    {
+        return std::min<unsigned int>(nWorkers, CHECKQUEUE_MAX_SLOTS - 1) + 1;
+    }
+
+    //! Move up to nMax checks from the back (own queue) or front (stealing) of slot into vChecks.
+    bool Take(Slot& slot, bool fOwn, unsigned int nMax, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(slot.mutex);
+        if (slot.queue.empty())
+            return false;
+        unsigned int nNow = std::min<size_t>(nMax, slot.queue.size());
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap rather than copy, to keep the lock as short as possible.
+            if (fOwn) {
+                vChecks[i].swap(slot.queue.back());
+                slot.queue.pop_back();
+            } else {
+                vChecks[i].swap(slot.queue.front());
+                slot.queue.pop_front();
+            }
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    bool TakeOrSteal(unsigned int nSlot, std::vector<T>& vChecks)
+    {
+        if (nQueued == 0)
+            return false;
+        unsigned int nMax = GetBatchSize();
+        if (Take(slots[nSlot], true, nMax, vChecks))
+            return true;
+        unsigned int nSlots = GetActiveSlots();
+        for (unsigned int i = 1; i < nSlots; i++) {
+            if (Take(slots[(nSlot + i) % nSlots], false, nMax, vChecks))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSlot, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        nTotal++;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (TakeOrSteal(nSlot, vChecks)) {
+                unsigned int nNow = vChecks.size();
+                // Check whether we need to do work at all
+                bool fOk = fAllOk;
+                auto nStart = std::chrono::steady_clock::now();
+                for (T& check : vChecks)
+                {
+                    if (fOk)
+                        fOk = check();
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                if (fOk) {
+                    int64_t nNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - nStart).count() / nNow;
+                    int64_t nCost = nCheckNanos.load(std::memory_order_relaxed);
+                    nCheckNanos.store(nCost ? (nCost * 7 + nNanos) / 8 : std::max<int64_t>(1, nNanos), std::memory_order_relaxed);
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                // The checks go before they are counted as done, the master may not return while any of them is still around.
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk = false;
+                if ((nTodo -= nNow) == 0 && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-            {
-                if (fOk)
-                    fOk = check();
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // Added checks are counted before the mutex is taken to wake workers, so none can come in unnoticed between looking and waiting.
+            if (nQueued != 0)
+                continue;
+            if ((fMaster || fQuit) && nTodo == 0) {
+                nTotal--;
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                if (fMaster)
+                    fAllOk = true;
+                // return the current status
+                return fRet;
             }
-            vChecks.clear();
+            nIdle++;
+            cond.wait(lock); // wait
+            nIdle--;
         } while (true);
     }
 
@@ -133,32 +209,46 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nQueued(0), nWorkers(0), nNextSlot(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn), nCheckNanos(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(1 + nWorkers++ % (CHECKQUEUE_MAX_SLOTS - 1));
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        // Spread the checks over the queues of the workers in batches, continuing with the next queue on the next call.
+        unsigned int nSlots = GetActiveSlots();
+        unsigned int nChunk = std::max(1U, std::min<unsigned int>(GetBatchSize(), (vChecks.size() + nSlots - 1) / nSlots));
+        // Counted as to do before they are queued, so that the count never drops below what is still to be done; counted as
+        // queued once they are, so that workers don't spin on checks they can't find yet.
         nTodo += vChecks.size();
+        for (size_t i = 0; i < vChecks.size(); i += nChunk) {
+            Slot& slot = slots[nNextSlot++ % nSlots];
+            boost::unique_lock<boost::mutex> lock(slot.mutex);
+            for (size_t j = i; j < std::min(i + nChunk, vChecks.size()); j++) {
+                slot.queue.push_back(T());
+                vChecks[j].swap(slot.queue.back());
+            }
+            nQueued += std::min(i + nChunk, vChecks.size()) - i;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nIdle == 0)
+            return;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -0,0 +1,205 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_CLOCKCACHE_H
+#define GULDEN_CLOCKCACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Fixed size cache for lookups from many threads at once, in place of an lru11::Cache behind one lock.
+ *
+ * The entries are split over shards with a lock each, so that threads looking up different keys rarely wait on each other.
+ * Within a shard a key can only live in one set of CLOCKCACHE_WAYS slots; a lookup compares the keys of one set and an
+ * insert into a full set evicts the first slot (going round from where the last eviction stopped) that wasn't used since
+ * the last time round, which approximates LRU without reordering anything on a hit.
+ *
+ * All slots are allocated up front: inserts assign to an existing slot and never allocate for the cache itself.
+ * Hasher is expected to spread keys over all 64 bits; the low bits pick the shard and the next ones the set.
+ */
+template <typename Key, typename Value, typename Hasher>
+class CClockCache
+{
+public:
+    //! Slots per set.
+    static const size_t CLOCKCACHE_WAYS = 8;
+
+    //! Room for at least nCapacity entries, in nShards shards (at least one).
+    explicit CClockCache(size_t nCapacity, size_t nShards = 16, const Hasher& hasherIn = Hasher())
+    : hasher(hasherIn)
+    , nSetsPerShard(SetsPerShard(nCapacity, std::max<size_t>(1, nShards)))
+    , vShards(std::max<size_t>(1, nShards))
+    {
+        for (Shard& shard : vShards)
+        {
+            shard.vSlots.resize(nSetsPerShard * CLOCKCACHE_WAYS);
+            shard.vHands.resize(nSetsPerShard, 0);
+        }
+    }
+
+    CClockCache(const CClockCache&) = delete;
+    CClockCache& operator=(const CClockCache&) = delete;
+
+    void insert(const Key& key, const Value& value)
+    {
+        uint64_t nHash = hasher(key);
+        Shard& shard = GetShard(nHash);
+        size_t nSet = GetSet(nHash);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        Slot* pSlots = &shard.vSlots[nSet * CLOCKCACHE_WAYS];
+        Slot* pFree = nullptr;
+        for (size_t i = 0; i < CLOCKCACHE_WAYS; ++i)
+        {
+            if (!pSlots[i].fUsed)
+            {
+                if (!pFree)
+                    pFree = &pSlots[i];
+            }
+            else if (pSlots[i].key == key)
+            {
+                pSlots[i].value = value;
+                pSlots[i].fReferenced = true;
+                return;
+            }
+        }
+        if (!pFree)
+        {
+            // Every slot gets its reference bit cleared on the way round, so this ends within two rounds.
+            uint8_t& nHand = shard.vHands[nSet];
+            while (pSlots[nHand].fReferenced)
+            {
+                pSlots[nHand].fReferenced = false;
+                nHand = (nHand + 1) % CLOCKCACHE_WAYS;
+            }
+            pFree = &pSlots[nHand];
+            nHand = (nHand + 1) % CLOCKCACHE_WAYS;
+            nEvictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            nSize.fetch_add(1, std::memory_order_relaxed);
+        }
+        pFree->key = key;
+        pFree->value = value;
+        pFree->fUsed = true;
+        pFree->fReferenced = false;
+    }
+
+    //! Copy the value of key to valueOut and mark it as used; false if it isn't in the cache.
+    bool tryGet(const Key& key, Value& valueOut)
+    {
+        uint64_t nHash = hasher(key);
+        Shard& shard = GetShard(nHash);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        Slot* pSlot = Find(shard, GetSet(nHash), key);
+        if (!pSlot)
+        {
+            nMisses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        pSlot->fReferenced = true;
+        valueOut = pSlot->value;
+        nHits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //! Whether key is in the cache; doesn't count as a use of the entry or in the statistics.
+    bool contains(const Key& key)
+    {
+        uint64_t nHash = hasher(key);
+        Shard& shard = GetShard(nHash);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        return Find(shard, GetSet(nHash), key) != nullptr;
+    }
+
+    bool remove(const Key& key)
+    {
+        uint64_t nHash = hasher(key);
+        Shard& shard = GetShard(nHash);
+        std::lock_guard<std::mutex> lock(shard.cs);
+        Slot* pSlot = Find(shard, GetSet(nHash), key);
+        if (!pSlot)
+            return false;
+        pSlot->fUsed = false;
+        pSlot->fReferenced = false;
+        nSize.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //! Drop all entries; the statistics are kept.
+    void clear()
+    {
+        for (Shard& shard : vShards)
+        {
+            std::lock_guard<std::mutex> lock(shard.cs);
+            for (Slot& slot : shard.vSlots)
+            {
+                if (slot.fUsed)
+                    nSize.fetch_sub(1, std::memory_order_relaxed);
+                slot.fUsed = false;
+                slot.fReferenced = false;
+            }
+        }
+    }
+
+    size_t size() const { return nSize.load(std::memory_order_relaxed); }
+    size_t capacity() const { return vShards.size() * nSetsPerShard * CLOCKCACHE_WAYS; }
+    uint64_t hits() const { return nHits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return nMisses.load(std::memory_order_relaxed); }
+    uint64_t evictions() const { return nEvictions.load(std::memory_order_relaxed); }
+
+    //! The slot arrays, which are allocated whether they hold anything or not; memory the keys and values own outside their slot isn't counted.
+    size_t SlotBytes() const { return capacity() * sizeof(Slot) + vShards.size() * (sizeof(Shard) + nSetsPerShard); }
+
+private:
+    struct Slot
+    {
+        Key key;
+        Value value;
+        bool fUsed = false;
+        bool fReferenced = false;
+    };
+
+    struct Shard
+    {
+        std::mutex cs;
+        std::vector<Slot> vSlots;
+        //! Per set, the slot the next eviction looks at first.
+        std::vector<uint8_t> vHands;
+    };
+
+    static size_t SetsPerShard(size_t nCapacity, size_t nShards)
+    {
+        size_t nSlotsPerSetIndex = nShards * CLOCKCACHE_WAYS;
+        return std::max<size_t>(1, (nCapacity + nSlotsPerSetIndex - 1) / nSlotsPerSetIndex);
+    }
+
+    Shard& GetShard(uint64_t nHash) { return vShards[nHash % vShards.size()]; }
+    size_t GetSet(uint64_t nHash) const { return (nHash / vShards.size()) % nSetsPerShard; }
+
+    Slot* Find(Shard& shard, size_t nSet, const Key& key)
+    {
+        Slot* pSlots = &shard.vSlots[nSet * CLOCKCACHE_WAYS];
+        for (size_t i = 0; i < CLOCKCACHE_WAYS; ++i)
+        {
+            if (pSlots[i].fUsed && pSlots[i].key == key)
+                return &pSlots[i];
+        }
+        return nullptr;
+    }
+
+    const Hasher hasher;
+    const size_t nSetsPerShard;
+    std::vector<Shard> vShards;
+    std::atomic<size_t> nSize{0};
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    std::atomic<uint64_t> nEvictions{0};
+};
+
+#endif // GULDEN_CLOCKCACHE_H
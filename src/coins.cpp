@@ -11,7 +11,9 @@
 
 #include "coins.h"
 
+#include "amount.h"
 #include "consensus/consensus.h"
+#include "crypto/common.h"
 #include "memusage.h"
 #include "random.h"
 
@@ -20,6 +22,180 @@
 // Gulden specific includes
 #include "Gulden/util.h"
 
+namespace {
+//! Just enough of a stream over a byte buffer for WriteVarInt/ReadVarInt.
+class CCompactCoinWriter
+{
+public:
+    explicit CCompactCoinWriter(unsigned char* pIn) : p(pIn) {}
+    void write(const char* pch, size_t nSize) { memcpy(p, pch, nSize); p += nSize; }
+    unsigned char* p;
+};
+
+class CCompactCoinReader
+{
+public:
+    CCompactCoinReader(const unsigned char* pIn, const unsigned char* pEndIn) : p(pIn), pEnd(pEndIn) {}
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size_t(pEnd - p))
+            throw std::ios_base::failure("CCompactCoinReader::read(): end of data");
+        memcpy(pch, p, nSize);
+        p += nSize;
+    }
+    const unsigned char* p;
+    const unsigned char* pEnd;
+};
+
+enum CompactLegacyScript : unsigned char
+{
+    COMPACT_SCRIPT_KEYHASH = 0,
+    COMPACT_SCRIPT_SCRIPTHASH = 1,
+    COMPACT_SCRIPT_RAW = 2,
+};
+
+bool IsPayToKeyHash(const CScript& script)
+{
+    return script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 && script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG;
+}
+}
+
+CCompactCoin& CCompactCoin::operator=(const Coin& coin)
+{
+    nCode = ((uint32_t)coin.fSegSig << 31) + (coin.nHeight << 1) + coin.fCoinBase;
+    data.clear();
+    if (coin.IsSpent())
+        return *this;
+
+    // Everything but the script of a raw legacy output fits in here; the largest is a witness output at 1 + 10 + 40 + 4 * 10 bytes.
+    unsigned char buffer[96];
+    CCompactCoinWriter writer(buffer);
+    const CTxOut& out = coin.out;
+    *writer.p++ = (out.output.nType << 3) | out.output.nValueBase;
+    if (MoneyRange(out.nValue))
+    {
+        WriteVarInt(writer, CTxOutCompressorLegacy::CompressAmount(out.nValue) + 1);
+    }
+    else
+    {
+        *writer.p++ = 0;
+        WriteLE64(writer.p, out.nValue);
+        writer.p += 8;
+    }
+    const CScript* pScriptRaw = nullptr;
+    switch (out.GetType())
+    {
+        case CTxOutType::StandardKeyHashOutput:
+            writer.write((const char*)out.output.standardKeyHash.keyID.begin(), 20);
+            break;
+        case CTxOutType::PoW2WitnessOutput:
+            writer.write((const char*)out.output.witnessDetails.spendingKeyID.begin(), 20);
+            writer.write((const char*)out.output.witnessDetails.witnessKeyID.begin(), 20);
+            WriteVarInt(writer, out.output.witnessDetails.lockFromBlock);
+            WriteVarInt(writer, out.output.witnessDetails.lockUntilBlock);
+            WriteVarInt(writer, out.output.witnessDetails.failCount);
+            WriteVarInt(writer, out.output.witnessDetails.actionNonce);
+            break;
+        case CTxOutType::ScriptLegacyOutput:
+        {
+            const CScript& script = out.output.scriptPubKey;
+            if (IsPayToKeyHash(script))
+            {
+                *writer.p++ = COMPACT_SCRIPT_KEYHASH;
+                writer.write((const char*)&script[3], 20);
+            }
+            else if (script.IsPayToScriptHash())
+            {
+                *writer.p++ = COMPACT_SCRIPT_SCRIPTHASH;
+                writer.write((const char*)&script[2], 20);
+            }
+            else
+            {
+                *writer.p++ = COMPACT_SCRIPT_RAW;
+                pScriptRaw = &script;
+            }
+            break;
+        }
+    }
+    size_t nSize = writer.p - buffer;
+    size_t nScriptSize = pScriptRaw ? pScriptRaw->size() : 0;
+    data.reserve(nSize + nScriptSize);
+    data.insert(data.end(), buffer, writer.p);
+    if (pScriptRaw)
+        data.insert(data.end(), pScriptRaw->begin(), pScriptRaw->end());
+    return *this;
+}
+
+Coin CCompactCoin::Decompress() const
+{
+    Coin coin;
+    coin.nHeight = (nCode & 0b01111111111111111111111111111110) >> 1;
+    coin.fSegSig = (nCode & 0b10000000000000000000000000000000) > 0;
+    coin.fCoinBase = (nCode & 0b00000000000000000000000000000001) > 0;
+    if (data.empty())
+        return coin;
+
+    CTxOut& out = coin.out;
+    CCompactCoinReader reader(data.data(), data.data() + data.size());
+    unsigned char nTypeAndValueBase = *reader.p++;
+    out.SetType(CTxOutType(nTypeAndValueBase >> 3));
+    out.output.nValueBase = nTypeAndValueBase & 0b00000111;
+    uint64_t nValueCompressed = ReadVarInt<CCompactCoinReader, uint64_t>(reader);
+    if (nValueCompressed > 0)
+    {
+        out.nValue = CTxOutCompressorLegacy::DecompressAmount(nValueCompressed - 1);
+    }
+    else
+    {
+        unsigned char value[8];
+        reader.read((char*)value, 8);
+        out.nValue = ReadLE64(value);
+    }
+    switch (out.GetType())
+    {
+        case CTxOutType::StandardKeyHashOutput:
+            reader.read((char*)out.output.standardKeyHash.keyID.begin(), 20);
+            break;
+        case CTxOutType::PoW2WitnessOutput:
+            reader.read((char*)out.output.witnessDetails.spendingKeyID.begin(), 20);
+            reader.read((char*)out.output.witnessDetails.witnessKeyID.begin(), 20);
+            out.output.witnessDetails.lockFromBlock = ReadVarInt<CCompactCoinReader, uint64_t>(reader);
+            out.output.witnessDetails.lockUntilBlock = ReadVarInt<CCompactCoinReader, uint64_t>(reader);
+            out.output.witnessDetails.failCount = ReadVarInt<CCompactCoinReader, uint64_t>(reader);
+            out.output.witnessDetails.actionNonce = ReadVarInt<CCompactCoinReader, uint64_t>(reader);
+            break;
+        case CTxOutType::ScriptLegacyOutput:
+        {
+            CScript& script = out.output.scriptPubKey;
+            unsigned char nTag = *reader.p++;
+            if (nTag == COMPACT_SCRIPT_KEYHASH)
+            {
+                script.resize(25);
+                script[0] = OP_DUP;
+                script[1] = OP_HASH160;
+                script[2] = 20;
+                reader.read((char*)&script[3], 20);
+                script[23] = OP_EQUALVERIFY;
+                script[24] = OP_CHECKSIG;
+            }
+            else if (nTag == COMPACT_SCRIPT_SCRIPTHASH)
+            {
+                script.resize(23);
+                script[0] = OP_HASH160;
+                script[1] = 20;
+                reader.read((char*)&script[2], 20);
+                script[22] = OP_EQUAL;
+            }
+            else
+            {
+                script.assign(reader.p, reader.pEnd);
+            }
+            break;
+        }
+    }
+    return coin;
+}
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
@@ -38,8 +214,8 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), pChainedWitView(nullptr) {}
-CCoinsViewCache::CCoinsViewCache(CCoinsViewCache *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), pChainedWitView(baseIn->pChainedWitView?std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(baseIn->pChainedWitView.get())):nullptr) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource), cachedCoinsUsage(0), pChainedWitView(nullptr) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsViewCache *baseIn) : CCoinsViewBacked(baseIn), cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource), cachedCoinsUsage(0), pChainedWitView(baseIn->pChainedWitView?std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(baseIn->pChainedWitView.get())):nullptr) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -65,7 +241,7 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
-        coin = it->second.coin;
+        coin = it->second.coin.Decompress();
         return true;
     }
     return false;
@@ -98,7 +274,7 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
         }
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
-    it->second.coin = std::move(coin);
+    it->second.coin = coin;
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
@@ -125,7 +301,7 @@ void CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout, bool n
     if (it == cacheCoins.end()) return;
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     if (moveout) {
-        *moveout = std::move(it->second.coin);
+        *moveout = it->second.coin.Decompress();
     }
     if (!nodeletefresh && it->second.flags & CCoinsCacheEntry::FRESH) {
         cacheCoins.erase(it);
@@ -137,12 +313,12 @@ void CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout, bool n
 
 static const Coin coinEmpty;
 
-const Coin& CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
+Coin CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) {
         return coinEmpty;
     } else {
-        return it->second.coin;
+        return it->second.coin.Decompress();
     }
 }
 
@@ -151,6 +327,14 @@ bool CCoinsViewCache::HaveCoin(const COutPoint &outpoint) const {
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
+void CCoinsViewCache::AddPrefetchedCoin(const COutPoint& outpoint, Coin&& coin) {
+    if (coin.IsSpent())
+        return;
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (ret.second)
+        cachedCoinsUsage += ret.first->second.coin.DynamicMemoryUsage();
+}
+
 bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
     return it != cacheCoins.end();
@@ -229,9 +413,27 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    ReallocateCache();
     return fOk;
 }
 
+void CCoinsViewCache::Discard()
+{
+    cacheCoins.clear();
+    cachedCoinsUsage = 0;
+    hashBlock.SetNull();
+    ReallocateCache();
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    assert(cacheCoins.empty());
+    cacheCoins.~CCoinsMap();
+    cacheCoinsMemoryResource.~CCoinsMapMemoryResource();
+    ::new (&cacheCoinsMemoryResource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource);
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     if (pChainedWitView)
@@ -283,11 +485,11 @@ bool CCoinsViewCache::HaveInputs(const CTransaction& tx) const
 //22 is the lower bound for a new SegSig output
 static const size_t MAX_OUTPUTS_PER_BLOCK = MAX_BLOCK_BASE_SIZE / 22; // TODO: merge with similar definition in undo.h.
 
-const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
+Coin AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
 {
     COutPoint iter(txid, 0);
     while (iter.n < MAX_OUTPUTS_PER_BLOCK) {
-        const Coin& alternate = view.AccessCoin(iter);
+        Coin alternate = view.AccessCoin(iter);
         if (!alternate.IsSpent()) return alternate;
         ++iter.n;
     }
@@ -18,12 +18,15 @@
 #include "core_memusage.h"
 #include "hash.h"
 #include "memusage.h"
+#include "prevector.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
 #include <stdint.h>
 
+#include <functional>
 #include <unordered_map>
 
 /**
@@ -93,6 +96,61 @@ public:
     }
 };
 
+/**
+ * A Coin as it is kept in a coins cache: the height/coinbase/segsig code and the output packed into a few bytes, instead of a
+ * full CTxOut with the room for the largest of its output types. Key hash outputs and pay to key hash/script hash scripts
+ * fit in the inline part and take no allocation at all; Decompress() copies their hashes straight back out.
+ *
+ * Packed format (empty for a spent coin):
+ * - the type of the output (5 bits) and its nValueBase (3 bits)
+ * - VARINT(CompressAmount(nValue) + 1), or 0 followed by the 8 bytes of nValue for values outside MoneyRange
+ * - key hash outputs: the key hash
+ * - witness outputs: the spending and witness key hashes, then VARINTs of lockFromBlock, lockUntilBlock, failCount and actionNonce
+ * - legacy outputs: a tag, then the hash for pay to key hash (0) and pay to script hash (1) scripts or the whole script (2)
+ *
+ * Serializes the same as Coin does.
+ */
+class CCompactCoin
+{
+public:
+    CCompactCoin() : nCode(0) {}
+    explicit CCompactCoin(const Coin& coin) { *this = coin; }
+
+    CCompactCoin& operator=(const Coin& coin);
+
+    Coin Decompress() const;
+
+    bool IsSpent() const {
+        return data.empty();
+    }
+
+    void Clear() {
+        nCode = 0;
+        data.clear();
+    }
+
+    size_t DynamicMemoryUsage() const {
+        return memusage::DynamicUsage(data);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        Decompress().Serialize(s);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        Coin coin;
+        coin.Unserialize(s);
+        *this = coin;
+    }
+
+private:
+    //! As written by Coin::Serialize.
+    uint32_t nCode;
+    prevector<28, unsigned char> data;
+};
+
 class SaltedOutpointHasher
 {
 private:
@@ -108,13 +166,17 @@ public:
      * uint64_t, resulting in failures when syncing the chain (#4634).
      */
     size_t operator()(const COutPoint& id) const {
-        return SipHashUint256Extra(k0, k1, id.getHash(), id.n);
+        if (id.isHash)
+            return SipHashUint256Extra(k0, k1, id.getHash(), id.n);
+        // Block positions are hashed as they are, not by way of the double SHA256 of getHash.
+        const CBlockPosition& position = id.getBlockPosition();
+        return CSipHasher(k0, k1).Write(position.blockNumber).Write(position.transactionIndex).Write((uint64_t)id.n).Finalize();
     }
 };
 
 struct CCoinsCacheEntry
 {
-    Coin coin; // The actual cached data.
+    CCompactCoin coin; // The actual cached data.
     unsigned char flags;
 
     enum Flags {
@@ -128,10 +190,17 @@ struct CCoinsCacheEntry
     };
 
     CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    explicit CCoinsCacheEntry(const Coin& coin_) : coin(coin_), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of a coins cache all come out of a single CPoolResource, owned by the cache; see CPoolResource for why.
+ * The block size leaves room for the node overhead (next pointer, cached hash) of the standard library implementations we build with.
+ */
+static const size_t COINS_MAP_POOL_BLOCK_SIZE = sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + 4 * sizeof(void*);
+typedef CPoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>, COINS_MAP_POOL_BLOCK_SIZE, alignof(void*)> CCoinsMapAllocator;
+typedef CCoinsMapAllocator::ResourceType CCoinsMapMemoryResource;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -223,6 +292,8 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    // NB! Must be declared before cacheCoins, which allocates from it.
+    mutable CCoinsMapMemoryResource cacheCoinsMemoryResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -250,11 +321,11 @@ public:
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
     /**
-     * Return a reference to Coin in the cache, or a pruned one if not found. This is
-     * more efficient than GetCoin. Modifications to other cache entries are
-     * allowed while accessing the returned pointer.
+     * Return a copy of the Coin in the cache, or a pruned one if not found. This is
+     * more efficient than GetCoin. As the cache holds its coins packed (see CCompactCoin)
+     * there is no Coin to return a reference to.
      */
-    const Coin& AccessCoin(const COutPoint &output) const;
+    Coin AccessCoin(const COutPoint &output) const;
 
     /**
      * Add a coin. Set potential_overwrite to true if a non-pruned version may
@@ -262,6 +333,12 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Add a coin that was read from the backing view ahead of time (see PrefetchBlockInputs),
+     * as an unmodified entry. Has no effect if the cache already has an entry for outpoint or coin is spent.
+     */
+    void AddPrefetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -301,6 +378,71 @@ public:
     //! Check whether all prevouts of the transaction are present in the UTXO set represented by this view
     bool HaveInputs(const CTransaction& tx) const;
 
+    /**
+     * Write the modified entries of this cache and its best block to s, to be taken back into a cache on top of the same base
+     * with ReadJournal instead of writing them to the base. Returns the number of entries written.
+     */
+    template<typename Stream>
+    uint64_t WriteJournal(Stream& s) const
+    {
+        uint64_t nCount = 0;
+        for (const auto& entry : cacheCoins)
+        {
+            if (entry.second.flags & CCoinsCacheEntry::DIRTY)
+                ++nCount;
+        }
+        s << hashBlock << nCount;
+        for (const auto& [outpoint, entry] : cacheCoins)
+        {
+            if (!(entry.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            // As in the coin database, by hash: the outpoints of cached coins always are.
+            bool fSpent = entry.coin.IsSpent();
+            uint32_t n = outpoint.n;
+            s << outpoint.getHash() << VARINT(n) << entry.flags << fSpent;
+            if (!fSpent)
+                s << entry.coin;
+        }
+        return nCount;
+    }
+
+    //! Take the entries written by WriteJournal into this cache, which has to be empty. Throws if s doesn't hold a journal, the cache is left empty then.
+    template<typename Stream>
+    uint64_t ReadJournal(Stream& s)
+    {
+        assert(cacheCoins.empty());
+        uint256 hashBlockIn;
+        uint64_t nCount;
+        try
+        {
+            s >> hashBlockIn >> nCount;
+            for (uint64_t i = 0; i < nCount; ++i)
+            {
+                uint256 hash;
+                uint32_t n = 0;
+                unsigned char flags;
+                bool fSpent;
+                s >> hash >> VARINT(n) >> flags >> fSpent;
+                COutPoint outpoint(hash, n);
+                CCoinsCacheEntry& entry = cacheCoins[outpoint];
+                if (!fSpent)
+                    s >> entry.coin;
+                entry.flags = CCoinsCacheEntry::DIRTY | (flags & CCoinsCacheEntry::FRESH);
+                cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
+            }
+        }
+        catch (...)
+        {
+            Discard();
+            throw;
+        }
+        hashBlock = hashBlockIn;
+        return nCount;
+    }
+
+    //! Drop all entries, modified ones included, and forget the best block; for a cache whose contents turn out to be of no use (see ReadJournal).
+    void Discard();
+
     // Side view
     void SetSiblingView(std::shared_ptr<CCoinsViewCache> pChainedWitView_) { pChainedWitView = pChainedWitView_; };
     std::shared_ptr<CCoinsViewCache> pChainedWitView;
@@ -313,10 +455,36 @@ public:
     void GetAllCoins(std::map<COutPoint, Coin>& allCoins) const override
     {
         base->GetAllCoins(allCoins);
+        ApplyCachedCoins(allCoins);
+    }
 
-        for (auto iter : cacheCoins)
+    /**
+     * As GetAllCoins, but instead of enumerating pBaseView (which must be below this view) use baseCoins, which the caller already knows to be its contents.
+     * Falls back to enumerating everything if pBaseView is not found.
+     */
+    void GetAllCoinsAbove(const CCoinsView* pBaseView, const std::map<COutPoint, Coin>& baseCoins, std::map<COutPoint, Coin>& allCoins) const
+    {
+        if (base == pBaseView)
+        {
+            allCoins = baseCoins;
+        }
+        else if (const CCoinsViewCache* pBaseCache = dynamic_cast<const CCoinsViewCache*>(base))
         {
-            if (iter.second.coin.out.IsNull())
+            pBaseCache->GetAllCoinsAbove(pBaseView, baseCoins, allCoins);
+        }
+        else
+        {
+            base->GetAllCoins(allCoins);
+        }
+        ApplyCachedCoins(allCoins);
+    }
+
+    //! Apply the insertions/deletions held in this cache (but not those of any view below it) to allCoins.
+    void ApplyCachedCoins(std::map<COutPoint, Coin>& allCoins) const
+    {
+        for (const auto& iter : cacheCoins)
+        {
+            if (iter.second.coin.IsSpent())
             {
                 if (allCoins.find(iter.first) != allCoins.end())
                 {
@@ -325,7 +493,7 @@ public:
             }
             else
             {
-                allCoins[iter.first] = iter.second.coin;
+                allCoins[iter.first] = iter.second.coin.Decompress();
             }
         }
     }
@@ -333,6 +501,9 @@ public:
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 
+    //! Replace cacheCoins (which must be empty) and its memory resource by new ones, which gives the memory of the old ones back to the system.
+    void ReallocateCache();
+
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
      */
@@ -346,6 +517,6 @@ private:
 void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight);
 
 //! Utility function to find any unspent output with a given txid.
-const Coin& AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
+Coin AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
 
 #endif // GULDEN_COINS_H
@@ -23,6 +23,13 @@ inline uint64_t systemPhysicalMemoryInBytes()
     GlobalMemoryStatus(&status);
     return status.dwTotalPhys;
 }
+inline uint64_t systemAvailableMemoryInBytes()
+{
+    MEMORYSTATUS status;
+    status.dwLength = sizeof(status);
+    GlobalMemoryStatus(&status);
+    return status.dwAvailPhys;
+}
 #elif defined(MAC_OSX)
 #include <sys/types.h>
 #include <sys/sysctl.h>
@@ -37,7 +44,13 @@ inline uint64_t systemPhysicalMemoryInBytes()
         return totalRam;
     return 0;
 }
+//! Not known here; 0.
+inline uint64_t systemAvailableMemoryInBytes()
+{
+    return 0;
+}
 #else
+#include <stdio.h>
 #include <sys/sysinfo.h>
 inline uint64_t systemPhysicalMemoryInBytes()
 {
@@ -45,6 +58,26 @@ inline uint64_t systemPhysicalMemoryInBytes()
     sysinfo(&info);
     return info.totalram/info.mem_unit;
 }
+//! Memory that can be had without swapping (MemAvailable, which counts the page cache that can be dropped); 0 if not known.
+inline uint64_t systemAvailableMemoryInBytes()
+{
+    FILE* file = fopen("/proc/meminfo", "r");
+    if (!file)
+        return 0;
+    uint64_t nAvailableKb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned long long nKb;
+        if (sscanf(line, "MemAvailable: %llu kB", &nKb) == 1)
+        {
+            nAvailableKb = nKb;
+            break;
+        }
+    }
+    fclose(file);
+    return nAvailableKb * 1024;
+}
 #endif
 
 #endif
@@ -11,6 +11,7 @@
 
 #include "merkle.h"
 #include "hash.h"
+#include "crypto/sha256.h"
 #include "utilstrencodings.h"
 
 /*     WARNING! If you're reading this because you're learning about crypto
@@ -137,10 +138,24 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
+    // A level at a time, in place: every pair of a level is a 64-byte message, which SHA256D64 hashes several at once.
+    bool mutation = false;
+    while (hashes.size() > 1) {
+        if (mutated) {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+                if (hashes[pos] == hashes[pos + 1]) mutation = true;
+            }
+        }
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    if (mutated) *mutated = mutation;
+    if (hashes.size() == 0) return uint256();
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
@@ -167,12 +182,28 @@ uint256 BlockMerkleRoot(const std::vector<CTransactionRef>::const_iterator txSta
     std::vector<uint256> leaves;
     leaves.reserve(std::distance(txStartIter, txEndIter));
     std::transform(txStartIter, txEndIter, std::back_inserter(leaves), [](const CTransactionRef& ref) { return ref->GetHash(); });
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
-    return BlockMerkleRoot(block.vtx.begin(), block.vtx.end(), mutated);
+    return BlockMerkleRoot(block, 0, block.vtx.size(), mutated);
+}
+
+uint256 BlockMerkleRoot(const CBlock& block, size_t nBegin, size_t nEnd, bool* mutated)
+{
+    CBlockHashCache* cache = block.GetHashCache();
+    uint256 hash;
+    bool fMutated;
+    if (!cache || !cache->GetMerkleRoot(block.vtx, nBegin, nEnd, hash, fMutated))
+    {
+        hash = BlockMerkleRoot(block.vtx.begin() + nBegin, block.vtx.begin() + nEnd, &fMutated);
+        if (cache)
+            cache->SetMerkleRoot(block.vtx, nBegin, nEnd, hash, fMutated);
+    }
+    if (mutated)
+        *mutated = fMutated;
+    return hash;
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock& block, uint32_t position)
@@ -19,7 +19,7 @@
 #include "primitives/block.h"
 #include "uint256.h"
 
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NULL);
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = NULL);
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
@@ -29,6 +29,8 @@ uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint2
  */
 uint256 BlockMerkleRoot(const std::vector<CTransactionRef>::const_iterator txStartIter, const std::vector<CTransactionRef>::const_iterator txEndIter, bool* mutated = NULL);
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated = NULL);
+//! The merkle root of block.vtx[nBegin, nEnd), remembered with the block for as long as vtx is unchanged.
+uint256 BlockMerkleRoot(const CBlock& block, size_t nBegin, size_t nEnd, bool* mutated = NULL);
 
 /*
  * Compute the Merkle branch for the tree of transactions in a block, for a
@@ -13,6 +13,7 @@
 
 #include "consensus.h"
 #include "consensus/validation.h"
+#include "prevector.h"
 #include "script/interpreter.h"
 #include "validation/validation.h"
 #include "validation/witnessvalidation.h"
@@ -221,14 +222,15 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-txouttotal-toolarge");
     }
 
-    // Check for duplicate inputs - note that this check is slow so we skip it in CheckBlock
-    if (fCheckDuplicateInputs) {
-        std::set<COutPoint> vInOutPoints;
+    // Check for duplicate inputs, by sorting pointers to them; on the stack for all but the largest transactions.
+    if (fCheckDuplicateInputs && tx.vin.size() > 1)
+    {
+        prevector<32, const COutPoint*> vInOutPoints;
+        vInOutPoints.reserve(tx.vin.size());
         for (const auto& txin : tx.vin)
-        {
-            if (!vInOutPoints.insert(txin.prevout).second)
-                return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
-        }
+            vInOutPoints.push_back(&txin.prevout);
+        if (SortAndFindDuplicateOutPoints(vInOutPoints.begin(), vInOutPoints.end()))
+            return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
     }
 
     if (tx.IsCoinBase())
@@ -256,6 +258,27 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
 }
 
 
+bool CheckBlockDuplicateInputs(const std::vector<CTransactionRef>& vtx, CValidationState& state)
+{
+    size_t nInputs = 0;
+    for (const auto& tx : vtx)
+        nInputs += tx->vin.size();
+    std::vector<const COutPoint*> vInOutPoints;
+    vInOutPoints.reserve(nInputs);
+    for (const auto& tx : vtx)
+    {
+        for (const auto& txin : tx->vin)
+        {
+            // The coinbase inputs, which spend nothing.
+            if (!txin.prevout.IsNull())
+                vInOutPoints.push_back(&txin.prevout);
+        }
+    }
+    if (SortAndFindDuplicateOutPoints(vInOutPoints.begin(), vInOutPoints.end()))
+        return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
+    return true;
+}
+
 bool CheckTransactionContextual(const CTransaction& tx, CValidationState &state, int checkHeight, std::vector<CWitnessTxBundle>* pWitnessBundles)
 {
     for (const CTxOut& txout : tx.vout)
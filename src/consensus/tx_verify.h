@@ -14,6 +14,7 @@
 
 #include "primitives/transaction.h"
 
+#include <algorithm>
 #include <stdint.h>
 #include <vector>
 
@@ -73,11 +74,22 @@ bool CheckTxInputAgainstWitnessBundles(CValidationState& state, std::vector<CWit
 CAmount CalculateWitnessPenaltyFee(const CTxOut& output);
 void IncrementWitnessFailCount(uint64_t& failCount);
 
+/** Whether any two of the outpoints pointed to in [begin, end) are equal; reorders the range. */
+template <typename Iterator>
+bool SortAndFindDuplicateOutPoints(Iterator begin, Iterator end)
+{
+    std::sort(begin, end, CompareOutPointPtrFast());
+    return std::adjacent_find(begin, end, [](const COutPoint* a, const COutPoint* b) { return *a == *b; }) != end;
+}
+
 /** Transaction validation functions */
 
-/** Context-independent validity checks */
+/** Context-independent validity checks; CheckBlock does the duplicate input check for a whole block at once, see CheckBlockDuplicateInputs */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCheckDuplicateInputs=true);
 
+/** No outpoint is spent twice by the transactions of the block, within one of them or across them. */
+bool CheckBlockDuplicateInputs(const std::vector<CTransactionRef>& vtx, CValidationState& state);
+
 /** Context-dependent validity checks */
 bool CheckTransactionContextual(const CTransaction& tx, CValidationState& state, int checkHeight, std::vector<CWitnessTxBundle>* pWitnessBundles);
 
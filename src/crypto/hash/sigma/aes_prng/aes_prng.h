@@ -0,0 +1,24 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// Hardware AES kernels for the SIGMA PRNG.
+// The PRNG is AES-256 in ECB mode keyed with its 32 byte seed, where each step replaces the 32 byte state with the encryption of itself (two independent AES blocks).
+// These kernels produce identical output to the CryptoPP ECB_Mode<AES> implementation but without its per call overhead, and advance several steps per call so that verification can walk the PRNG in a single call.
+
+#ifndef GULDEN_SIGMA_AES_PRNG_H
+#define GULDEN_SIGMA_AES_PRNG_H
+
+#include <stdint.h>
+
+#define AES256_PRNG_ROUND_KEY_BYTES 240
+
+// Expand a 256 bit key into the 15 AES-256 round keys, in standard (FIPS-197) byte order which both AES-NI and ARMv8 AES consume directly.
+void aes256_prng_expand_key(const uint8_t* key, uint8_t* roundKeys);
+
+// Advance the 32 byte PRNG state numSteps times.
+void aes256_prng_advance_sse3_aes(const uint8_t* roundKeys, uint8_t* state, uint64_t numSteps);
+void aes256_prng_advance_arm_cortex_a53_aes(const uint8_t* roundKeys, uint8_t* state, uint64_t numSteps);
+
+#endif
@@ -0,0 +1,36 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// The build system compiles this file with the ARMv8 crypto extensions enabled, it is only ever called after a runtime check for hardware AES.
+
+#include "aes_prng.h"
+
+#if defined(COMPILER_HAS_CORTEX53_AES)
+#include <arm_neon.h>
+
+void aes256_prng_advance_arm_cortex_a53_aes(const uint8_t* roundKeys, uint8_t* state, uint64_t numSteps)
+{
+    uint8x16_t rk[15];
+    for (int i = 0; i < 15; ++i)
+        rk[i] = vld1q_u8(&roundKeys[i*16]);
+
+    // The two halves of the state are independent blocks, interleave them to hide the aese/aesmc latency.
+    // NB! ARM AESE performs AddRoundKey before SubBytes/ShiftRows, so the round keys are shifted by one compared to AES-NI.
+    uint8x16_t s0 = vld1q_u8(&state[0]);
+    uint8x16_t s1 = vld1q_u8(&state[16]);
+    for (uint64_t n = 0; n < numSteps; ++n)
+    {
+        for (int i = 0; i < 13; ++i)
+        {
+            s0 = vaesmcq_u8(vaeseq_u8(s0, rk[i]));
+            s1 = vaesmcq_u8(vaeseq_u8(s1, rk[i]));
+        }
+        s0 = veorq_u8(vaeseq_u8(s0, rk[13]), rk[14]);
+        s1 = veorq_u8(vaeseq_u8(s1, rk[13]), rk[14]);
+    }
+    vst1q_u8(&state[0], s0);
+    vst1q_u8(&state[16], s1);
+}
+#endif
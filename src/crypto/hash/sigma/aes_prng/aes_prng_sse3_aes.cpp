@@ -0,0 +1,37 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// The build system compiles this file with AES-NI enabled, it is only ever called after a runtime check for AES-NI support.
+
+#include "aes_prng.h"
+
+#if defined(COMPILER_HAS_SSE3) && defined(COMPILER_HAS_AES)
+#include <wmmintrin.h>
+
+void aes256_prng_advance_sse3_aes(const uint8_t* roundKeys, uint8_t* state, uint64_t numSteps)
+{
+    __m128i rk[15];
+    for (int i = 0; i < 15; ++i)
+        rk[i] = _mm_loadu_si128((const __m128i*)&roundKeys[i*16]);
+
+    // The two halves of the state are independent blocks, interleave them to hide the aesenc latency.
+    __m128i s0 = _mm_loadu_si128((const __m128i*)&state[0]);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)&state[16]);
+    for (uint64_t n = 0; n < numSteps; ++n)
+    {
+        s0 = _mm_xor_si128(s0, rk[0]);
+        s1 = _mm_xor_si128(s1, rk[0]);
+        for (int i = 1; i < 14; ++i)
+        {
+            s0 = _mm_aesenc_si128(s0, rk[i]);
+            s1 = _mm_aesenc_si128(s1, rk[i]);
+        }
+        s0 = _mm_aesenclast_si128(s0, rk[14]);
+        s1 = _mm_aesenclast_si128(s1, rk[14]);
+    }
+    _mm_storeu_si128((__m128i*)&state[0], s0);
+    _mm_storeu_si128((__m128i*)&state[16], s1);
+}
+#endif
@@ -0,0 +1,30 @@
+// File contains modifications by: The Gulden developers
+// All modifications:
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef ECHO256_OPT_X2_H
+#define ECHO256_OPT_X2_H
+#include "echo256_opt.h"
+
+// State for hashing two messages of identical length side by side.
+// As both messages always have the same length the counters and buffer offsets are shared; only the data differs per lane.
+typedef struct
+{
+    __m128i        state[4][2];      // First column of the state (the only part carried between blocks) for each lane
+    unsigned char  buffer[2][192];
+    __m128i        k;
+    unsigned int   uBufferBytes;
+    uint64_t       processed_bits;
+} echo256_opt_x2_hashState __attribute__ ((aligned (64)));
+#endif
+
+#ifndef ECHO256_OPT_X2_IMPL
+#include "opt/echo256_opt_x2_avx2_vaes.h"
+#else
+HashReturn echo256_opt_x2_Init(echo256_opt_x2_hashState* state);
+HashReturn echo256_opt_x2_Update(echo256_opt_x2_hashState* state, const unsigned char* data_a, const unsigned char* data_b, uint64_t dataByteLength);
+HashReturn echo256_opt_x2_Final(echo256_opt_x2_hashState* state, unsigned char* hashval_a, unsigned char* hashval_b);
+#endif
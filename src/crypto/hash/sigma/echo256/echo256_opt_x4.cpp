@@ -0,0 +1,350 @@
+/*
+ * file        : echo_vperm.c
+ * version     : 1.0.208
+ * date        : 14.12.2010
+ *
+ * Cagdas Calik
+ * ccalik@metu.edu.tr
+ * Institute of Applied Mathematics, Middle East Technical University, Turkey.
+ *
+ */
+// File contains modifications by: The Gulden developers
+// All modifications:
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// Four way variant of 'echo256_opt' that hashes four equal length messages at once.
+// This is the AVX-512 counterpart of 'echo256_opt_x4'; each 128 bit state word is widened to a 512 bit register holding the same word for all four messages, see echo256_opt_x4.cpp for why the result is bit for bit identical.
+
+#include <stdint.h>
+#include "echo256_opt_x4.h"
+
+#ifdef ECHO256_OPT_X4_IMPL
+
+#include <memory.h>
+
+#define LOAD_X2(a, b) _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(a))), _mm_loadu_si128((const __m128i*)(b)), 1)
+#define LOAD_X4(a, b, c, d) _mm512_inserti64x4(_mm512_castsi256_si512(LOAD_X2(a, b)), LOAD_X2(c, d), 1)
+#define LOAD_BROADCAST(a) _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(a)))
+
+__attribute__((aligned(16))) static const unsigned int const1[]        = {0x00000001, 0x00000000, 0x00000000, 0x00000000};
+__attribute__((aligned(16))) static const unsigned int mul2mask[]      = {0x00001b00, 0x00000000, 0x00000000, 0x00000000};
+__attribute__((aligned(16))) static const unsigned int lsbmask[]       = {0x01010101, 0x01010101, 0x01010101, 0x01010101};
+__attribute__((aligned(16))) static const unsigned int constinit1[]    = {0x00000100, 0x00000000, 0x00000000, 0x00000000};
+__attribute__((aligned(16))) static const unsigned int constinit2[]    = {0x00000600, 0x00000000, 0x00000000, 0x00000000};
+
+#define ECHO256_X4_BLOCK_LENGTH 192
+#define ECHO256_X4_ROUNDS 8
+#define ECHO256_X4_HASH_SIZE 256
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#define ECHO_SUBBYTES_X4(state, i, j) \
+    state[i][j] = _mm512_aesenc_epi128(state[i][j], k1);\
+    state[i][j] = _mm512_aesenc_epi128(state[i][j], _mm512_setzero_si512());\
+    k1 = _mm512_add_epi32(k1, const1_x4)
+
+#define ECHO_MIXBYTES_X4(state1, state2, j, t1, t2, s2) \
+    s2 = _mm512_add_epi8(state1[0][j], state1[0][j]);\
+    t1 = _mm512_srli_epi16(state1[0][j], 7);\
+    t1 = _mm512_and_si512(t1, lsbmask_x4);\
+    t2 = _mm512_shuffle_epi8(mul2mask_x4, t1);\
+    s2 = _mm512_xor_si512(s2, t2);\
+    state2[0][j] = s2;\
+    state2[1][j] = state1[0][j];\
+    state2[2][j] = state1[0][j];\
+    state2[3][j] = _mm512_xor_si512(s2, state1[0][j]);\
+    s2 = _mm512_add_epi8(state1[1][(j + 1) & 3], state1[1][(j + 1) & 3]);\
+    t1 = _mm512_srli_epi16(state1[1][(j + 1) & 3], 7);\
+    t1 = _mm512_and_si512(t1, lsbmask_x4);\
+    t2 = _mm512_shuffle_epi8(mul2mask_x4, t1);\
+    s2 = _mm512_xor_si512(s2, t2);\
+    state2[0][j] = _mm512_xor_si512(state2[0][j], _mm512_xor_si512(s2, state1[1][(j + 1) & 3]));\
+    state2[1][j] = _mm512_xor_si512(state2[1][j], s2);\
+    state2[2][j] = _mm512_xor_si512(state2[2][j], state1[1][(j + 1) & 3]);\
+    state2[3][j] = _mm512_xor_si512(state2[3][j], state1[1][(j + 1) & 3]);\
+    s2 = _mm512_add_epi8(state1[2][(j + 2) & 3], state1[2][(j + 2) & 3]);\
+    t1 = _mm512_srli_epi16(state1[2][(j + 2) & 3], 7);\
+    t1 = _mm512_and_si512(t1, lsbmask_x4);\
+    t2 = _mm512_shuffle_epi8(mul2mask_x4, t1);\
+    s2 = _mm512_xor_si512(s2, t2);\
+    state2[0][j] = _mm512_xor_si512(state2[0][j], state1[2][(j + 2) & 3]);\
+    state2[1][j] = _mm512_xor_si512(state2[1][j], _mm512_xor_si512(s2, state1[2][(j + 2) & 3]));\
+    state2[2][j] = _mm512_xor_si512(state2[2][j], s2);\
+    state2[3][j] = _mm512_xor_si512(state2[3][j], state1[2][(j + 2) & 3]);\
+    s2 = _mm512_add_epi8(state1[3][(j + 3) & 3], state1[3][(j + 3) & 3]);\
+    t1 = _mm512_srli_epi16(state1[3][(j + 3) & 3], 7);\
+    t1 = _mm512_and_si512(t1, lsbmask_x4);\
+    t2 = _mm512_shuffle_epi8(mul2mask_x4, t1);\
+    s2 = _mm512_xor_si512(s2, t2);\
+    state2[0][j] = _mm512_xor_si512(state2[0][j], state1[3][(j + 3) & 3]);\
+    state2[1][j] = _mm512_xor_si512(state2[1][j], state1[3][(j + 3) & 3]);\
+    state2[2][j] = _mm512_xor_si512(state2[2][j], _mm512_xor_si512(s2, state1[3][(j + 3) & 3]));\
+    state2[3][j] = _mm512_xor_si512(state2[3][j], s2)
+
+
+#define ECHO_ROUND_UNROLL2_X4 \
+    ECHO_SUBBYTES_X4(_state, 0, 0);\
+    ECHO_SUBBYTES_X4(_state, 1, 0);\
+    ECHO_SUBBYTES_X4(_state, 2, 0);\
+    ECHO_SUBBYTES_X4(_state, 3, 0);\
+    ECHO_SUBBYTES_X4(_state, 0, 1);\
+    ECHO_SUBBYTES_X4(_state, 1, 1);\
+    ECHO_SUBBYTES_X4(_state, 2, 1);\
+    ECHO_SUBBYTES_X4(_state, 3, 1);\
+    ECHO_SUBBYTES_X4(_state, 0, 2);\
+    ECHO_SUBBYTES_X4(_state, 1, 2);\
+    ECHO_SUBBYTES_X4(_state, 2, 2);\
+    ECHO_SUBBYTES_X4(_state, 3, 2);\
+    ECHO_SUBBYTES_X4(_state, 0, 3);\
+    ECHO_SUBBYTES_X4(_state, 1, 3);\
+    ECHO_SUBBYTES_X4(_state, 2, 3);\
+    ECHO_SUBBYTES_X4(_state, 3, 3);\
+    ECHO_MIXBYTES_X4(_state, _state2, 0, t1, t2, s2);\
+    ECHO_MIXBYTES_X4(_state, _state2, 1, t1, t2, s2);\
+    ECHO_MIXBYTES_X4(_state, _state2, 2, t1, t2, s2);\
+    ECHO_MIXBYTES_X4(_state, _state2, 3, t1, t2, s2);\
+    ECHO_SUBBYTES_X4(_state2, 0, 0);\
+    ECHO_SUBBYTES_X4(_state2, 1, 0);\
+    ECHO_SUBBYTES_X4(_state2, 2, 0);\
+    ECHO_SUBBYTES_X4(_state2, 3, 0);\
+    ECHO_SUBBYTES_X4(_state2, 0, 1);\
+    ECHO_SUBBYTES_X4(_state2, 1, 1);\
+    ECHO_SUBBYTES_X4(_state2, 2, 1);\
+    ECHO_SUBBYTES_X4(_state2, 3, 1);\
+    ECHO_SUBBYTES_X4(_state2, 0, 2);\
+    ECHO_SUBBYTES_X4(_state2, 1, 2);\
+    ECHO_SUBBYTES_X4(_state2, 2, 2);\
+    ECHO_SUBBYTES_X4(_state2, 3, 2);\
+    ECHO_SUBBYTES_X4(_state2, 0, 3);\
+    ECHO_SUBBYTES_X4(_state2, 1, 3);\
+    ECHO_SUBBYTES_X4(_state2, 2, 3);\
+    ECHO_SUBBYTES_X4(_state2, 3, 3);\
+    ECHO_MIXBYTES_X4(_state2, _state, 0, t1, t2, s2);\
+    ECHO_MIXBYTES_X4(_state2, _state, 1, t1, t2, s2);\
+    ECHO_MIXBYTES_X4(_state2, _state, 2, t1, t2, s2);\
+    ECHO_MIXBYTES_X4(_state2, _state, 3, t1, t2, s2)
+
+
+
+#define SAVESTATE_X4(dst, src)\
+    dst[0][0] = src[0][0];\
+    dst[0][1] = src[0][1];\
+    dst[0][2] = src[0][2];\
+    dst[0][3] = src[0][3];\
+    dst[1][0] = src[1][0];\
+    dst[1][1] = src[1][1];\
+    dst[1][2] = src[1][2];\
+    dst[1][3] = src[1][3];\
+    dst[2][0] = src[2][0];\
+    dst[2][1] = src[2][1];\
+    dst[2][2] = src[2][2];\
+    dst[2][3] = src[2][3];\
+    dst[3][0] = src[3][0];\
+    dst[3][1] = src[3][1];\
+    dst[3][2] = src[3][2];\
+    dst[3][3] = src[3][3]
+
+
+
+void Compress_x4(echo256_opt_x4_hashState* ctx, const unsigned char* const pmsg_in[4], unsigned int uBlockCount)
+{
+    unsigned int r, b, i, j;
+    __m512i t1, t2, s2, k1;
+    __m512i _state[4][4], _state2[4][4], _statebackup[4][4];
+    const __m512i const1_x4 = LOAD_BROADCAST(const1);
+    const __m512i mul2mask_x4 = LOAD_BROADCAST(mul2mask);
+    const __m512i lsbmask_x4 = LOAD_BROADCAST(lsbmask);
+    const __m128i const1536 = _mm_loadu_si128((const __m128i*)constinit2);
+    const __m128i* pmsg[4] = { (const __m128i*)pmsg_in[0], (const __m128i*)pmsg_in[1], (const __m128i*)pmsg_in[2], (const __m128i*)pmsg_in[3] };
+
+    for(i = 0; i < 4; i++)
+    {
+        _state[i][0] = LOAD_X4(&ctx->state[i][0], &ctx->state[i][1], &ctx->state[i][2], &ctx->state[i][3]);
+    }
+
+    for(b = 0; b < uBlockCount; b++)
+    {
+        ctx->k = _mm_add_epi64(ctx->k, const1536);
+
+        // load message
+        for(j = 1; j < 4; j++)
+        {
+            for(i = 0; i < 4; i++)
+            {
+                _state[i][j] = LOAD_X4(pmsg[0] + 4 * (j - 1) + i, pmsg[1] + 4 * (j - 1) + i, pmsg[2] + 4 * (j - 1) + i, pmsg[3] + 4 * (j - 1) + i);
+            }
+        }
+
+        // save state
+        SAVESTATE_X4(_statebackup, _state);
+
+        k1 = _mm512_broadcast_i32x4(ctx->k);
+
+        for(r = 0; r < ECHO256_X4_ROUNDS / 2; r++)
+        {
+            ECHO_ROUND_UNROLL2_X4;
+        }
+
+        for(i = 0; i < 4; i++)
+        {
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _state[i][1]);
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _state[i][2]);
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _state[i][3]);
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _statebackup[i][0]);
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _statebackup[i][1]);
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _statebackup[i][2]);
+            _state[i][0] = _mm512_xor_si512(_state[i][0], _statebackup[i][3]);
+        }
+        for (int lane = 0; lane < 4; ++lane)
+            pmsg[lane] += ECHO256_X4_BLOCK_LENGTH / 16;
+    }
+
+    // Only the first column of the state is carried over between blocks
+    for(i = 0; i < 4; i++)
+    {
+        _mm_storeu_si128(&ctx->state[i][0], _mm512_extracti32x4_epi32(_state[i][0], 0));
+        _mm_storeu_si128(&ctx->state[i][1], _mm512_extracti32x4_epi32(_state[i][0], 1));
+        _mm_storeu_si128(&ctx->state[i][2], _mm512_extracti32x4_epi32(_state[i][0], 2));
+        _mm_storeu_si128(&ctx->state[i][3], _mm512_extracti32x4_epi32(_state[i][0], 3));
+    }
+}
+#pragma GCC diagnostic pop
+
+HashReturn echo256_opt_x4_Init(echo256_opt_x4_hashState* ctx)
+{
+    ctx->k = _mm_setzero_si128();
+    ctx->processed_bits = 0;
+    ctx->uBufferBytes = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+            ctx->state[i][lane] = _mm_loadu_si128((const __m128i*)constinit1);
+    }
+    return SUCCESS;
+}
+
+HashReturn echo256_opt_x4_Update(echo256_opt_x4_hashState* state, const unsigned char* const data_in[4], uint64_t dataByteLength)
+{
+    const unsigned char* data[4] = { data_in[0], data_in[1], data_in[2], data_in[3] };
+    if((state->uBufferBytes + dataByteLength) >= ECHO256_X4_BLOCK_LENGTH)
+    {
+        if(state->uBufferBytes != 0)
+        {
+            // Fill the buffer
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                memcpy(state->buffer[lane] + state->uBufferBytes, data[lane], ECHO256_X4_BLOCK_LENGTH - state->uBufferBytes);
+                data[lane] += ECHO256_X4_BLOCK_LENGTH - state->uBufferBytes;
+            }
+
+            // Process buffer
+            const unsigned char* const buffers[4] = { state->buffer[0], state->buffer[1], state->buffer[2], state->buffer[3] };
+            Compress_x4(state, buffers, 1);
+            state->processed_bits += ECHO256_X4_BLOCK_LENGTH * 8;
+
+            dataByteLength -= ECHO256_X4_BLOCK_LENGTH - state->uBufferBytes;
+        }
+
+        // buffer now does not contain any unprocessed bytes
+        unsigned int uBlockCount = dataByteLength / ECHO256_X4_BLOCK_LENGTH;
+        unsigned int uRemainingBytes = dataByteLength % ECHO256_X4_BLOCK_LENGTH;
+
+        if(uBlockCount > 0)
+        {
+            Compress_x4(state, data, uBlockCount);
+            state->processed_bits += uBlockCount * ECHO256_X4_BLOCK_LENGTH * 8;
+            for (int lane = 0; lane < 4; ++lane)
+                data[lane] += uBlockCount * ECHO256_X4_BLOCK_LENGTH;
+        }
+
+        if(uRemainingBytes > 0)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+                memcpy(state->buffer[lane], data[lane], uRemainingBytes);
+        }
+        state->uBufferBytes = uRemainingBytes;
+    }
+    else
+    {
+        for (int lane = 0; lane < 4; ++lane)
+            memcpy(state->buffer[lane] + state->uBufferBytes, data[lane], dataByteLength);
+        state->uBufferBytes += dataByteLength;
+    }
+    return SUCCESS;
+}
+
+// Write the hash size and the processed bit count into the tail of all lane buffers
+static inline void echo256_opt_x4_pad_length(echo256_opt_x4_hashState* state)
+{
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        *((unsigned short*)(state->buffer[lane] + ECHO256_X4_BLOCK_LENGTH - 18)) = ECHO256_X4_HASH_SIZE;
+        *((uint64_t*)(state->buffer[lane] + ECHO256_X4_BLOCK_LENGTH - 16)) = state->processed_bits;
+        *((uint64_t*)(state->buffer[lane] + ECHO256_X4_BLOCK_LENGTH - 8)) = 0;
+    }
+}
+
+HashReturn echo256_opt_x4_Final(echo256_opt_x4_hashState* state, unsigned char* const hashval[4])
+{
+    const __m128i const1536 = _mm_loadu_si128((const __m128i*)constinit2);
+    const unsigned char* const buffers[4] = { state->buffer[0], state->buffer[1], state->buffer[2], state->buffer[3] };
+
+    // Add remaining bytes in the buffer
+    state->processed_bits += state->uBufferBytes * 8;
+
+    __attribute__((aligned(16))) const unsigned int load_buffer_bytes[] = {state->uBufferBytes * 8, 0x00000000, 0x00000000, 0x00000000};
+    __m128i remainingbits = _mm_loadu_si128((__m128i*)load_buffer_bytes);
+
+    // Pad with 0x80
+    for (int lane = 0; lane < 4; ++lane)
+        state->buffer[lane][state->uBufferBytes] = 0x80;
+    state->uBufferBytes++;
+
+    // Enough buffer space for padding in this block?
+    if((ECHO256_X4_BLOCK_LENGTH - state->uBufferBytes) >= 18)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+            memset(state->buffer[lane] + state->uBufferBytes, 0, ECHO256_X4_BLOCK_LENGTH - (state->uBufferBytes + 18));
+        echo256_opt_x4_pad_length(state);
+
+        // Last block contains message bits?
+        if(state->uBufferBytes == 1)
+        {
+            state->k = _mm_sub_epi64(_mm_setzero_si128(), const1536);
+        }
+        else
+        {
+            state->k = _mm_add_epi64(state->k, remainingbits);
+            state->k = _mm_sub_epi64(state->k, const1536);
+        }
+        Compress_x4(state, buffers, 1);
+    }
+    else
+    {
+        // Fill with zero and compress
+        for (int lane = 0; lane < 4; ++lane)
+            memset(state->buffer[lane] + state->uBufferBytes, 0, ECHO256_X4_BLOCK_LENGTH - state->uBufferBytes);
+        state->k = _mm_add_epi64(state->k, remainingbits);
+        state->k = _mm_sub_epi64(state->k, const1536);
+        Compress_x4(state, buffers, 1);
+
+        // Last block
+        for (int lane = 0; lane < 4; ++lane)
+            memset(state->buffer[lane], 0, ECHO256_X4_BLOCK_LENGTH - 18);
+        echo256_opt_x4_pad_length(state);
+        state->k = _mm_sub_epi64(_mm_setzero_si128(), const1536);
+        Compress_x4(state, buffers, 1);
+    }
+
+    // Store the hash value
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        _mm_storeu_si128((__m128i*)hashval[lane] + 0, state->state[0][lane]);
+        _mm_storeu_si128((__m128i*)hashval[lane] + 1, state->state[1][lane]);
+    }
+    return SUCCESS;
+}
+#endif
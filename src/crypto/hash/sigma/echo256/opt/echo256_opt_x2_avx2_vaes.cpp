@@ -0,0 +1,18 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// This file is a thin wrapper around the actual 'echo256_opt_x2' implementation.
+// The build system compiles it with VAES enabled; at runtime it must only be selected on processors that support VAES.
+
+#if defined(COMPILER_HAS_AVX2) && defined(COMPILER_HAS_VAES)
+    #define echo256_opt_x2_Init        echo256_opt_x2_avx2_vaes_Init
+    #define echo256_opt_x2_Update      echo256_opt_x2_avx2_vaes_Update
+    #define echo256_opt_x2_Final       echo256_opt_x2_avx2_vaes_Final
+    #define Compress_x2                echo256_opt_x2_avx2_vaes_compress
+
+    #define USE_HARDWARE_AES
+    #define ECHO256_OPT_X2_IMPL
+    #include "../echo256_opt_x2.cpp"
+#endif
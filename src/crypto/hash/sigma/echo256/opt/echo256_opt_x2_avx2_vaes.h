@@ -0,0 +1,21 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying file COPYING
+
+// This file is a thin wrapper around the actual 'echo256_opt_x2' implementation.
+// The build system compiles it with VAES enabled; at runtime it must only be selected on processors that support VAES.
+
+#ifndef HASH_ECHO256_X2_AVX2_VAES_H
+#define HASH_ECHO256_X2_AVX2_VAES_H
+    #define echo256_opt_x2_Init        echo256_opt_x2_avx2_vaes_Init
+    #define echo256_opt_x2_Update      echo256_opt_x2_avx2_vaes_Update
+    #define echo256_opt_x2_Final       echo256_opt_x2_avx2_vaes_Final
+
+    #define ECHO256_OPT_X2_IMPL
+    #include "../echo256_opt_x2.h"
+    #undef ECHO256_OPT_X2_IMPL
+
+    #undef echo256_opt_x2_Init
+    #undef echo256_opt_x2_Update
+    #undef echo256_opt_x2_Final
+#endif
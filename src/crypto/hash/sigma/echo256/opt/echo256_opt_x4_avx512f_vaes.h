@@ -0,0 +1,21 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying file COPYING
+
+// This file is a thin wrapper around the actual 'echo256_opt_x4' implementation.
+// The build system compiles it with AVX-512 (F and BW) and VAES enabled; at runtime it must only be selected on processors that support AVX-512BW and VAES.
+
+#ifndef HASH_ECHO256_X4_AVX512F_VAES_H
+#define HASH_ECHO256_X4_AVX512F_VAES_H
+    #define echo256_opt_x4_Init        echo256_opt_x4_avx512f_vaes_Init
+    #define echo256_opt_x4_Update      echo256_opt_x4_avx512f_vaes_Update
+    #define echo256_opt_x4_Final       echo256_opt_x4_avx512f_vaes_Final
+
+    #define ECHO256_OPT_X4_IMPL
+    #include "../echo256_opt_x4.h"
+    #undef ECHO256_OPT_X4_IMPL
+
+    #undef echo256_opt_x4_Init
+    #undef echo256_opt_x4_Update
+    #undef echo256_opt_x4_Final
+#endif
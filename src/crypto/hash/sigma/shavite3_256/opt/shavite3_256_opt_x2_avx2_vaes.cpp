@@ -0,0 +1,18 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// This file is a thin wrapper around the actual 'shavite3_256_opt_x2' implementation.
+// The build system compiles it with VAES enabled; at runtime it must only be selected on processors that support VAES.
+
+#if defined(COMPILER_HAS_AVX2) && defined(COMPILER_HAS_VAES)
+    #define shavite3_256_opt_x2_Init        shavite3_256_opt_x2_avx2_vaes_Init
+    #define shavite3_256_opt_x2_Update      shavite3_256_opt_x2_avx2_vaes_Update
+    #define shavite3_256_opt_x2_Final       shavite3_256_opt_x2_avx2_vaes_Final
+    #define shavite3_256_opt_x2_Compress256 shavite3_256_opt_x2_avx2_vaes_Compress256
+
+    #define USE_HARDWARE_AES
+    #define SHAVITE3_256_OPT_X2_IMPL
+    #include "../shavite3_256_opt_x2.cpp"
+#endif
@@ -0,0 +1,21 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying file COPYING
+
+// This file is a thin wrapper around the actual 'shavite3_256_opt_x2' implementation.
+// The build system compiles it with VAES enabled; at runtime it must only be selected on processors that support VAES.
+
+#ifndef HASH_SHAVITE3_256_X2_AVX2_VAES_H
+#define HASH_SHAVITE3_256_X2_AVX2_VAES_H
+    #define shavite3_256_opt_x2_Init        shavite3_256_opt_x2_avx2_vaes_Init
+    #define shavite3_256_opt_x2_Update      shavite3_256_opt_x2_avx2_vaes_Update
+    #define shavite3_256_opt_x2_Final       shavite3_256_opt_x2_avx2_vaes_Final
+
+    #define SHAVITE3_256_OPT_X2_IMPL
+    #include "../shavite3_256_opt_x2.h"
+    #undef SHAVITE3_256_OPT_X2_IMPL
+
+    #undef shavite3_256_opt_x2_Init
+    #undef shavite3_256_opt_x2_Update
+    #undef shavite3_256_opt_x2_Final
+#endif
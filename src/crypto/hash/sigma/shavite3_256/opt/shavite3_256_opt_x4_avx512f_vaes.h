@@ -0,0 +1,21 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying file COPYING
+
+// This file is a thin wrapper around the actual 'shavite3_256_opt_x4' implementation.
+// The build system compiles it with AVX-512 (F and BW) and VAES enabled; at runtime it must only be selected on processors that support AVX-512BW and VAES.
+
+#ifndef HASH_SHAVITE3_256_X4_AVX512F_VAES_H
+#define HASH_SHAVITE3_256_X4_AVX512F_VAES_H
+    #define shavite3_256_opt_x4_Init        shavite3_256_opt_x4_avx512f_vaes_Init
+    #define shavite3_256_opt_x4_Update      shavite3_256_opt_x4_avx512f_vaes_Update
+    #define shavite3_256_opt_x4_Final       shavite3_256_opt_x4_avx512f_vaes_Final
+
+    #define SHAVITE3_256_OPT_X4_IMPL
+    #include "../shavite3_256_opt_x4.h"
+    #undef SHAVITE3_256_OPT_X4_IMPL
+
+    #undef shavite3_256_opt_x4_Init
+    #undef shavite3_256_opt_x4_Update
+    #undef shavite3_256_opt_x4_Final
+#endif
@@ -0,0 +1,38 @@
+// File originates from the supercop project
+// Authors: Eli Biham and Orr Dunkelman
+//
+// File contains modifications by: The Gulden developers
+// All modifications:
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef SHAVITE3_256_OPT_X2_H
+#define SHAVITE3_256_OPT_X2_H
+#include <stdint.h>
+
+// State for hashing two messages of identical length side by side.
+// As both messages always have the same length the counters and buffer offsets are shared; only the data differs per lane.
+struct shavite3_256_opt_x2_hashState
+{
+   uint64_t bitcount;                // The number of bits compressed so far (per lane)
+   uint8_t chaining_value[2][32];    // The chaining value of each lane
+   uint8_t buffer[2][64];            // Buffers storing bytes until they are compressed
+   int DigestSize;                   // The requested digest size
+   int BlockSize;                    // The message block size
+};
+#endif
+
+
+#ifndef SHAVITE3_256_OPT_X2_IMPL
+#include "opt/shavite3_256_opt_x2_avx2_vaes.h"
+#else
+#include "compat.h"
+#include <compat/arch.h>
+#include <compat/sse.h>
+
+bool shavite3_256_opt_x2_Init(shavite3_256_opt_x2_hashState* state);
+bool shavite3_256_opt_x2_Update(shavite3_256_opt_x2_hashState* state, const unsigned char* data_a, const unsigned char* data_b, uint64_t dataLenBytes);
+bool shavite3_256_opt_x2_Final(shavite3_256_opt_x2_hashState* state, unsigned char* hashval_a, unsigned char* hashval_b);
+#endif
@@ -0,0 +1,466 @@
+// File originates from the supercop project
+// Authors: Eli Biham and Orr Dunkelman
+//
+// File contains modifications by: The Gulden developers
+// All modifications:
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// Four way variant of 'shavite3_256_opt' that hashes four equal length messages at once.
+// This is the AVX-512 counterpart of 'shavite3_256_opt_x2'; each 128 bit register is widened to a 512 bit register holding the same value for all four messages, see shavite3_256_opt_x2.cpp for why the result is bit for bit identical.
+
+#include "shavite3_256_opt_x4.h"
+
+#ifdef SHAVITE3_256_OPT_X4_IMPL
+
+#include "compat.h"
+#include <memory.h>
+
+#define T8(x) ((x) & 0xff)
+
+#define LOAD_X2(a, b) _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(a))), _mm_loadu_si128((const __m128i*)(b)), 1)
+#define LOAD_X4(p, offset) _mm512_inserti64x4(_mm512_castsi256_si512(LOAD_X2((p)[0]+(offset), (p)[1]+(offset))), LOAD_X2((p)[2]+(offset), (p)[3]+(offset)), 1)
+#define LOAD_BROADCAST(a) _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(a)))
+#define STORE_X4(p, offset, x) \
+    _mm_storeu_si128((__m128i*)((p)[0]+(offset)), _mm512_extracti32x4_epi32(x, 0)); \
+    _mm_storeu_si128((__m128i*)((p)[1]+(offset)), _mm512_extracti32x4_epi32(x, 1)); \
+    _mm_storeu_si128((__m128i*)((p)[2]+(offset)), _mm512_extracti32x4_epi32(x, 2)); \
+    _mm_storeu_si128((__m128i*)((p)[3]+(offset)), _mm512_extracti32x4_epi32(x, 3))
+
+#define SHAVITE_MIXING_256_X4         \
+    x11 = x15;                        \
+    x10 = x14;                        \
+    x9 =  x13;                        \
+    x8 = x12;                         \
+                                      \
+    x6 = x11;                         \
+    x6 = _mm512_bsrli_epi128(x6, 4);  \
+    x8 = _mm512_xor_si512(x8,  x6);   \
+    x6 = x8;                          \
+    x6 = _mm512_bslli_epi128(x6,  12);\
+    x8 = _mm512_xor_si512(x8, x6);    \
+                                      \
+    x7 = x8;                          \
+    x7 =  _mm512_bsrli_epi128(x7,  4);\
+    x9 = _mm512_xor_si512(x9,  x7);   \
+    x7 = x9;                          \
+    x7 = _mm512_bslli_epi128(x7, 12); \
+    x9 = _mm512_xor_si512(x9, x7);    \
+                                      \
+    x6 = x9;                          \
+    x6 =  _mm512_bsrli_epi128(x6, 4); \
+    x10 = _mm512_xor_si512(x10, x6);  \
+    x6 = x10;                         \
+    x6 = _mm512_bslli_epi128(x6,  12);\
+    x10 = _mm512_xor_si512(x10, x6);  \
+                                      \
+    x7 = x10;                         \
+    x7 = _mm512_bsrli_epi128(x7,  4); \
+    x11 = _mm512_xor_si512(x11, x7);  \
+    x7 = x11;                         \
+    x7 = _mm512_bslli_epi128(x7,  12);\
+    x11 = _mm512_xor_si512(x11, x7);
+
+// encryption + Davies-Meyer transform, for four message blocks (lane n in 128 bit lane n) at once
+void shavite3_256_opt_x4_Compress256(const unsigned char* const message_block[4], uint8_t chaining_value[4][32], uint64_t counter)
+{
+    __attribute__ ((aligned (16))) static const unsigned int SHAVITE_REVERSE[4] = {0x07060504, 0x0b0a0908, 0x0f0e0d0c, 0x03020100 };
+    __attribute__ ((aligned (16))) static const unsigned int SHAVITE256_XOR2[4] = {0x0, 0xFFFFFFFF, 0x0, 0x0};
+    __attribute__ ((aligned (16))) static const unsigned int SHAVITE256_XOR3[4] = {0x0, 0x0, 0xFFFFFFFF, 0x0};
+    __attribute__ ((aligned (16))) static const unsigned int SHAVITE256_XOR4[4] = {0x0, 0x0, 0x0, 0xFFFFFFFF};
+    __attribute__ ((aligned (16))) const unsigned int SHAVITE_CNTS[4] = {(unsigned int)(counter & 0xFFFFFFFFULL),(unsigned int)(counter>>32),0,0}; 
+
+    __m512i x0;
+    __m512i x1;
+    __m512i x2;
+    __m512i x3;
+    __m512i x4;
+    __m512i x6;
+    __m512i x7;
+    __m512i x8;
+    __m512i x9;
+    __m512i x10;
+    __m512i x11;
+    __m512i x12;
+    __m512i x13;
+    __m512i x14;
+    __m512i x15;
+
+    // (L,R) = (xmm0,xmm1)
+    const __m512i ptxt1 = LOAD_X4(chaining_value, 0);
+    const __m512i ptxt2 = LOAD_X4(chaining_value, 16);
+
+    x0 = ptxt1;
+    x1 = ptxt2;
+
+    x3 = LOAD_BROADCAST(SHAVITE_CNTS);
+    x4 = LOAD_BROADCAST(SHAVITE256_XOR2);
+    x2 = _mm512_setzero_si512();
+
+    // init key schedule
+    x8 = LOAD_X4(message_block, 0);
+    x9 = LOAD_X4(message_block, 16);
+    x10 = LOAD_X4(message_block, 32);
+    x11 = LOAD_X4(message_block, 48);
+
+    // xmm8..xmm11 = rk[0..15]
+    // start key schedule
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+
+    const __m512i xtemp = LOAD_BROADCAST(SHAVITE_REVERSE);
+    x12 = _mm512_shuffle_epi8(x12, xtemp);
+    x13 = _mm512_shuffle_epi8(x13, xtemp);
+    x14 = _mm512_shuffle_epi8(x14, xtemp);
+    x15 = _mm512_shuffle_epi8(x15, xtemp);
+
+    x12 = _mm512_aesenc_epi128(x12, x2);
+    x13 = _mm512_aesenc_epi128(x13, x2);
+    x14 = _mm512_aesenc_epi128(x14, x2);
+    x15 = _mm512_aesenc_epi128(x15, x2);
+
+    x12 = _mm512_xor_si512(x12, x3);
+    x12 = _mm512_xor_si512(x12, x4);
+    x4 =  LOAD_BROADCAST(SHAVITE256_XOR3);
+    x12 = _mm512_xor_si512(x12, x11);
+    x13 = _mm512_xor_si512(x13, x12);
+    x14 = _mm512_xor_si512(x14, x13);
+    x15 = _mm512_xor_si512(x15, x14);
+   
+    // xmm12..xmm15 = rk[16..31]
+    // F3 - first round 
+    x6 = x8;
+    x8 = _mm512_xor_si512(x8, x1);
+    x8 = _mm512_aesenc_epi128(x8, x9);
+    x8 = _mm512_aesenc_epi128(x8, x10);
+    x8 = _mm512_aesenc_epi128(x8, x2);
+    x0 = _mm512_xor_si512(x0, x8);
+    x8 = x6;
+
+    // F3 - second round
+    x6 = x11;
+    x11 = _mm512_xor_si512(x11, x0);
+    x11 = _mm512_aesenc_epi128(x11, x12);
+    x11 = _mm512_aesenc_epi128(x11, x13);
+    x11 = _mm512_aesenc_epi128(x11, x2);
+    x1 = _mm512_xor_si512(x1, x11);
+    x11 = x6;
+
+    // key schedule
+    SHAVITE_MIXING_256_X4
+
+    // xmm8..xmm11 - rk[32..47]
+    // F3 - third round
+    x6 = x14;
+    x14 = _mm512_xor_si512(x14, x1);
+    x14 = _mm512_aesenc_epi128(x14, x15);
+    x14 = _mm512_aesenc_epi128(x14, x8);
+    x14 = _mm512_aesenc_epi128(x14, x2);
+    x0 = _mm512_xor_si512(x0, x14);
+    x14 = x6;
+
+    // key schedule
+    x3 = _mm512_shuffle_epi32(x3, (_MM_PERM_ENUM)135);
+
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+    x12 = _mm512_shuffle_epi8(x12, xtemp);
+    x13 = _mm512_shuffle_epi8(x13, xtemp);
+    x14 = _mm512_shuffle_epi8(x14, xtemp);
+    x15 = _mm512_shuffle_epi8(x15, xtemp);
+    x12 = _mm512_aesenc_epi128(x12, x2);
+    x13 = _mm512_aesenc_epi128(x13, x2);
+    x14 = _mm512_aesenc_epi128(x14, x2);
+    x15 = _mm512_aesenc_epi128(x15, x2);
+
+    x12 = _mm512_xor_si512(x12, x11);
+    x14 = _mm512_xor_si512(x14, x3);
+    x14 = _mm512_xor_si512(x14, x4);
+    x4 = LOAD_BROADCAST(SHAVITE256_XOR4);
+    x13 = _mm512_xor_si512(x13, x12);
+    x14 = _mm512_xor_si512(x14, x13);
+    x15 = _mm512_xor_si512(x15, x14);
+
+    // xmm12..xmm15 - rk[48..63]
+
+    // F3 - fourth round
+    x6 = x9;
+    x9 = _mm512_xor_si512(x9, x0);
+    x9 = _mm512_aesenc_epi128(x9, x10);
+    x9 = _mm512_aesenc_epi128(x9, x11);
+    x9 = _mm512_aesenc_epi128(x9, x2);
+    x1 = _mm512_xor_si512(x1, x9);
+    x9 = x6;
+
+    // key schedule
+    SHAVITE_MIXING_256_X4
+    // xmm8..xmm11 = rk[64..79]
+    // F3  - fifth round
+    x6 = x12;
+    x12 = _mm512_xor_si512(x12, x1);
+    x12 = _mm512_aesenc_epi128(x12, x13);
+    x12 = _mm512_aesenc_epi128(x12, x14);
+    x12 = _mm512_aesenc_epi128(x12, x2);
+    x0 = _mm512_xor_si512(x0, x12);
+    x12 = x6;
+
+    // F3 - sixth round
+    x6 = x15;
+    x15 = _mm512_xor_si512(x15, x0);
+    x15 = _mm512_aesenc_epi128(x15, x8);
+    x15 = _mm512_aesenc_epi128(x15, x9);
+    x15 = _mm512_aesenc_epi128(x15, x2);
+    x1 = _mm512_xor_si512(x1, x15);
+    x15 = x6;
+
+    // key schedule
+    x3 = _mm512_shuffle_epi32(x3, (_MM_PERM_ENUM)147);
+
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+    x12 = _mm512_shuffle_epi8(x12, xtemp);
+    x13 = _mm512_shuffle_epi8(x13, xtemp);
+    x14 = _mm512_shuffle_epi8(x14, xtemp);
+    x15 = _mm512_shuffle_epi8(x15, xtemp);
+    x12 = _mm512_aesenc_epi128(x12, x2);
+    x13 = _mm512_aesenc_epi128(x13, x2);
+    x14 = _mm512_aesenc_epi128(x14, x2);
+    x15 = _mm512_aesenc_epi128(x15, x2);
+    x12 = _mm512_xor_si512(x12, x11);
+    x13 = _mm512_xor_si512(x13, x3);
+    x13 = _mm512_xor_si512(x13, x4);
+    x13 = _mm512_xor_si512(x13, x12);
+    x14 = _mm512_xor_si512(x14, x13);
+    x15 = _mm512_xor_si512(x15, x14);
+
+    // xmm12..xmm15 = rk[80..95]
+    // F3 - seventh round
+    x6 = x10;
+    x10 = _mm512_xor_si512(x10, x1);
+    x10 = _mm512_aesenc_epi128(x10, x11);
+    x10 = _mm512_aesenc_epi128(x10, x12);
+    x10 = _mm512_aesenc_epi128(x10, x2);
+    x0 = _mm512_xor_si512(x0, x10);
+    x10 = x6;
+
+    // key schedule
+    SHAVITE_MIXING_256_X4
+
+    // xmm8..xmm11 = rk[96..111]
+    // F3 - eigth round
+    x6 = x13;
+    x13 = _mm512_xor_si512(x13, x0);
+    x13 = _mm512_aesenc_epi128(x13, x14);
+    x13 = _mm512_aesenc_epi128(x13, x15);
+    x13 = _mm512_aesenc_epi128(x13, x2);
+    x1 = _mm512_xor_si512(x1, x13);
+    x13 = x6;
+
+
+    // key schedule
+    x3 = _mm512_shuffle_epi32(x3, (_MM_PERM_ENUM)135);
+
+    x12 = x8;
+    x13 = x9;
+    x14 = x10;
+    x15 = x11;
+    x12 = _mm512_shuffle_epi8(x12, xtemp);
+    x13 = _mm512_shuffle_epi8(x13, xtemp);
+    x14 = _mm512_shuffle_epi8(x14, xtemp);
+    x15 = _mm512_shuffle_epi8(x15, xtemp);
+    x12 = _mm512_aesenc_epi128(x12, x2);
+    x13 = _mm512_aesenc_epi128(x13, x2);
+    x14 = _mm512_aesenc_epi128(x14, x2);
+    x15 = _mm512_aesenc_epi128(x15, x2);
+    x12 = _mm512_xor_si512(x12, x11);
+    x15 = _mm512_xor_si512(x15, x3);
+    x15 = _mm512_xor_si512(x15, x4);
+    x13 = _mm512_xor_si512(x13, x12);
+    x14 = _mm512_xor_si512(x14, x13);
+    x15 = _mm512_xor_si512(x15, x14);
+
+    // xmm12..xmm15 = rk[112..127]
+    // F3 - ninth round
+    x6 = x8;
+    x8 = _mm512_xor_si512(x8, x1);
+    x8 = _mm512_aesenc_epi128(x8, x9);
+    x8 = _mm512_aesenc_epi128(x8, x10);
+    x8 = _mm512_aesenc_epi128(x8, x2);
+    x0 = _mm512_xor_si512(x0, x8);
+    x8 = x6;
+    // F3 - tenth round
+    x6 = x11;
+    x11 = _mm512_xor_si512(x11, x0);
+    x11 = _mm512_aesenc_epi128(x11, x12);
+    x11 = _mm512_aesenc_epi128(x11, x13);
+    x11 = _mm512_aesenc_epi128(x11, x2);
+    x1 = _mm512_xor_si512(x1, x11);
+    x11 = x6;
+
+    // key schedule
+    SHAVITE_MIXING_256_X4
+
+    // xmm8..xmm11 = rk[128..143]
+    // F3 - eleventh round
+    x6 = x14;
+    x14 = _mm512_xor_si512(x14, x1);
+    x14 = _mm512_aesenc_epi128(x14, x15);
+    x14 = _mm512_aesenc_epi128(x14, x8);
+    x14 = _mm512_aesenc_epi128(x14, x2);
+    x0 = _mm512_xor_si512(x0, x14);
+    x14 = x6;
+
+    // F3 - twelfth round
+    x6 = x9;
+    x9 = _mm512_xor_si512(x9, x0);
+    x9 = _mm512_aesenc_epi128(x9, x10);
+    x9 = _mm512_aesenc_epi128(x9, x11);
+    x9 = _mm512_aesenc_epi128(x9, x2);
+    x1 = _mm512_xor_si512(x1, x9);
+    x9 = x6;
+
+
+    // feedforward
+    x0 = _mm512_xor_si512(x0, ptxt1);
+    x1 = _mm512_xor_si512(x1, ptxt2);
+    STORE_X4(chaining_value, 0, x0);
+    STORE_X4(chaining_value, 16, x1);
+
+    return;
+}
+
+#define U16TO8_LITTLE(c, v) do { \
+    uint16_t tmp_portable_h_x = (v); \
+    uint8_t *tmp_portable_h_d = (c); \
+    tmp_portable_h_d[0] = T8(tmp_portable_h_x); \
+    tmp_portable_h_d[1] = T8(tmp_portable_h_x >> 8); \
+} while (0)
+
+#define U64TO8_LITTLE(c, v)    do { \
+    uint64_t tmp_portable_h_x = (v); \
+    uint8_t *tmp_portable_h_d = (c); \
+    tmp_portable_h_d[0] = T8(tmp_portable_h_x); \
+    tmp_portable_h_d[1] = T8(tmp_portable_h_x >> 8);  \
+    tmp_portable_h_d[2] = T8(tmp_portable_h_x >> 16); \
+    tmp_portable_h_d[3] = T8(tmp_portable_h_x >> 24); \
+    tmp_portable_h_d[4] = T8(tmp_portable_h_x >> 32); \
+    tmp_portable_h_d[5] = T8(tmp_portable_h_x >> 40); \
+    tmp_portable_h_d[6] = T8(tmp_portable_h_x >> 48); \
+    tmp_portable_h_d[7] = T8(tmp_portable_h_x >> 56); \
+} while (0)
+
+bool shavite3_256_opt_x4_Init(shavite3_256_opt_x4_hashState* state)
+{
+    state->bitcount = 0;
+    state->DigestSize = 256;
+    state->BlockSize = 512;
+
+    // Compute MIV_{256} followed by IV_m, identically for all lanes
+    const unsigned char* const buffers[4] = { state->buffer[0], state->buffer[1], state->buffer[2], state->buffer[3] };
+    memset(state->buffer, 0, sizeof(state->buffer));
+    memset(state->chaining_value, 0, sizeof(state->chaining_value));
+    shavite3_256_opt_x4_Compress256(buffers, state->chaining_value, 0x0ULL);
+    for (int lane = 0; lane < 4; ++lane)
+        U16TO8_LITTLE(state->buffer[lane], 256);
+    shavite3_256_opt_x4_Compress256(buffers, state->chaining_value, 0x0ULL);
+    memset(state->buffer, 0, sizeof(state->buffer));
+    return true;
+}
+
+bool shavite3_256_opt_x4_Update(shavite3_256_opt_x4_hashState* state, const unsigned char* const data_in[4], uint64_t dataLenBytes)
+{
+    const int BlockSizeB = (state->BlockSize/8);
+    int len = dataLenBytes;
+    int bufcnt = (state->bitcount>>3)%BlockSizeB;
+    uint64_t SHAVITE_CNT = state->bitcount;
+    const unsigned char* data[4] = { data_in[0], data_in[1], data_in[2], data_in[3] };
+    state->bitcount += dataLenBytes*8;
+
+    if (bufcnt + len < BlockSizeB)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+            memcpy(&state->buffer[lane][bufcnt], data[lane], len);
+        return true;
+    }
+
+    if (bufcnt > 0)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            memcpy(&state->buffer[lane][bufcnt], data[lane], BlockSizeB-bufcnt);
+            data[lane] += BlockSizeB-bufcnt;
+        }
+        len -= BlockSizeB-bufcnt;
+        SHAVITE_CNT += 8*(BlockSizeB-bufcnt);
+        const unsigned char* const buffers[4] = { state->buffer[0], state->buffer[1], state->buffer[2], state->buffer[3] };
+        shavite3_256_opt_x4_Compress256(buffers, state->chaining_value, SHAVITE_CNT);
+    }
+
+    for( ; len>=BlockSizeB; len-=BlockSizeB)
+    {
+        SHAVITE_CNT += 8*BlockSizeB;
+        shavite3_256_opt_x4_Compress256(data, state->chaining_value, SHAVITE_CNT);
+        for (int lane = 0; lane < 4; ++lane)
+            data[lane] += BlockSizeB;
+    }
+
+    if (len > 0)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+            memcpy(state->buffer[lane], data[lane], len);
+    }
+    return true;
+}
+
+bool shavite3_256_opt_x4_Final(shavite3_256_opt_x4_hashState* state, unsigned char* const hashval[4])
+{
+    const int BlockSizeB = (state->BlockSize/8);
+    const int bufcnt = ((uint32_t)state->bitcount>>3)%BlockSizeB;
+    uint8_t block[4][64];
+    const unsigned char* const blocks[4] = { block[0], block[1], block[2], block[3] };
+
+    // Only byte aligned input is supported so the padding byte is always a lone 1 bit
+    for (int lane=0; lane<4; ++lane)
+    {
+        memset(block[lane], 0, BlockSizeB);
+        memcpy(block[lane], state->buffer[lane], bufcnt);
+        block[lane][bufcnt] = 0x80;
+    }
+
+    // An additional message block is required if there are less than 10 more bytes for message length and digest length encoding
+    if (bufcnt>=BlockSizeB-10)
+    {
+        shavite3_256_opt_x4_Compress256(blocks, state->chaining_value, state->bitcount);
+        for (int lane=0; lane<4; ++lane)
+        {
+            memset(block[lane], 0, BlockSizeB);
+            U64TO8_LITTLE(block[lane]+BlockSizeB-10, state->bitcount);
+            U16TO8_LITTLE(block[lane]+BlockSizeB-2, state->DigestSize);
+        }
+        shavite3_256_opt_x4_Compress256(blocks, state->chaining_value, 0x0ULL);
+    }
+    else
+    {
+        for (int lane=0; lane<4; ++lane)
+        {
+            U64TO8_LITTLE(block[lane]+BlockSizeB-10, state->bitcount);
+            U16TO8_LITTLE(block[lane]+BlockSizeB-2, state->DigestSize);
+        }
+        uint64_t counter = ((state->bitcount&(state->BlockSize-1))==0) ? 0ULL : state->bitcount;
+        shavite3_256_opt_x4_Compress256(blocks, state->chaining_value, counter);
+    }
+
+    for (int lane=0; lane<4; ++lane)
+        memcpy(hashval[lane], state->chaining_value[lane], 32);
+    return true;
+}
+
+#endif
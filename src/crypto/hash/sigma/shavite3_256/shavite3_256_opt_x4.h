@@ -0,0 +1,38 @@
+// File originates from the supercop project
+// Authors: Eli Biham and Orr Dunkelman
+//
+// File contains modifications by: The Gulden developers
+// All modifications:
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef SHAVITE3_256_OPT_X4_H
+#define SHAVITE3_256_OPT_X4_H
+#include <stdint.h>
+
+// State for hashing four messages of identical length side by side.
+// As all messages always have the same length the counters and buffer offsets are shared; only the data differs per lane.
+struct shavite3_256_opt_x4_hashState
+{
+   uint64_t bitcount;                // The number of bits compressed so far (per lane)
+   uint8_t chaining_value[4][32];    // The chaining value of each lane
+   uint8_t buffer[4][64];            // Buffers storing bytes until they are compressed
+   int DigestSize;                   // The requested digest size
+   int BlockSize;                    // The message block size
+};
+#endif
+
+
+#ifndef SHAVITE3_256_OPT_X4_IMPL
+#include "opt/shavite3_256_opt_x4_avx512f_vaes.h"
+#else
+#include "compat.h"
+#include <compat/arch.h>
+#include <compat/sse.h>
+
+bool shavite3_256_opt_x4_Init(shavite3_256_opt_x4_hashState* state);
+bool shavite3_256_opt_x4_Update(shavite3_256_opt_x4_hashState* state, const unsigned char* const data[4], uint64_t dataLenBytes);
+bool shavite3_256_opt_x4_Final(shavite3_256_opt_x4_hashState* state, unsigned char* const hashval[4]);
+#endif
@@ -8,6 +8,7 @@
 #include <compat/arch.h>
 #include "util.h"
 #include "primitives/block.h"
+#include "crypto/sha256.h"
 
 #include <cryptopp/config.h>
 #include <cryptopp/aes.h>
@@ -18,12 +19,66 @@
 #include <stddef.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <sstream>
 
 #include <boost/scope_exit.hpp>
 #include <thread>
+#include <array>
+#include <chrono>
+
+#ifdef WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+// Some systems (at least OS X) do not define MAP_ANONYMOUS yet and define MAP_ANON which is deprecated
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
 sigma_settings defaultSigmaSettings;
 
+// The SIGMA PRNG; AES-256 in ECB mode keyed with the seed and repeatedly fed back into itself (see mineBlock for the rationale).
+// Uses the selected hardware AES kernel if there is one and falls back to CryptoPP otherwise, the output is identical either way.
+class sigma_prng
+{
+public:
+    sigma_prng(const uint8_t* seed)
+    {
+        if (selected_aes256_prng_advance)
+            aes256_prng_expand_key(seed, roundKeys);
+        else
+            prng.SetKey(seed, 32);
+    }
+    // Advance the 32 byte state numSteps times.
+    inline void advance(uint8_t* state, uint64_t numSteps=1)
+    {
+        if (LIKELY(selected_aes256_prng_advance != nullptr))
+        {
+            selected_aes256_prng_advance(roundKeys, state, numSteps);
+            return;
+        }
+        unsigned char ciphered[32];
+        for (uint64_t i=0; i<numSteps; ++i)
+        {
+            prng.ProcessData(&ciphered[0], state, 32);
+            memcpy(state, &ciphered[0], (size_t)32);
+        }
+    }
+private:
+    alignas(16) uint8_t roundKeys[AES256_PRNG_ROUND_KEY_BYTES];
+    CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption prng;
+};
+
 inline void sigmaRandomFastHash(uint64_t nPseudoRandomAlg, uint8_t* data1, uint64_t data1Size, uint8_t* data2, uint64_t data2Size, uint8_t* data3, uint64_t data3Size, uint256& outHash)
 {
     switch (nPseudoRandomAlg)
@@ -79,6 +134,192 @@ inline void sigmaRandomFastHash(uint64_t nPseudoRandomAlg, uint8_t* data1, uint6
     }
 }
 
+// Calculate the same fast hash algorithm over two equal length inputs in a single pass.
+// Must only be called if the two way kernels for the algorithm are available.
+inline void sigmaRandomFastHashX2(uint64_t nPseudoRandomAlg, uint8_t* data1a, uint8_t* data1b, uint64_t data1Size, uint8_t* data2a, uint8_t* data2b, uint64_t data2Size, uint8_t* data3a, uint8_t* data3b, uint64_t data3Size, uint256& outHashA, uint256& outHashB)
+{
+    switch (nPseudoRandomAlg)
+    {
+        case 0:
+        {
+            echo256_opt_x2_hashState ctx_echo;
+            selected_echo256_opt_x2_Init(&ctx_echo);
+            selected_echo256_opt_x2_Update(&ctx_echo, data1a, data1b, data1Size);
+            selected_echo256_opt_x2_Update(&ctx_echo, data2a, data2b, data2Size);
+            selected_echo256_opt_x2_Update(&ctx_echo, data3a, data3b, data3Size);
+            selected_echo256_opt_x2_Final(&ctx_echo, outHashA.begin(), outHashB.begin());
+            break;
+        }
+        case 1:
+        {
+            shavite3_256_opt_x2_hashState ctx_shavite;
+            selected_shavite3_256_opt_x2_Init(&ctx_shavite);
+            selected_shavite3_256_opt_x2_Update(&ctx_shavite, data1a, data1b, data1Size);
+            selected_shavite3_256_opt_x2_Update(&ctx_shavite, data2a, data2b, data2Size);
+            selected_shavite3_256_opt_x2_Update(&ctx_shavite, data3a, data3b, data3Size);
+            selected_shavite3_256_opt_x2_Final(&ctx_shavite, outHashA.begin(), outHashB.begin());
+            break;
+        }
+        default:
+            assert(0);
+    }
+}
+
+// Calculate the same fast hash algorithm over four equal length inputs in a single pass.
+// Must only be called if the four way kernels for the algorithm are available.
+inline void sigmaRandomFastHashX4(uint64_t nPseudoRandomAlg, uint8_t* const data1[4], uint64_t data1Size, uint8_t* const data2[4], uint64_t data2Size, uint8_t* const data3[4], uint64_t data3Size, uint256 outHash[4])
+{
+    unsigned char* const hashval[4] = { outHash[0].begin(), outHash[1].begin(), outHash[2].begin(), outHash[3].begin() };
+    switch (nPseudoRandomAlg)
+    {
+        case 0:
+        {
+            echo256_opt_x4_hashState ctx_echo;
+            selected_echo256_opt_x4_Init(&ctx_echo);
+            selected_echo256_opt_x4_Update(&ctx_echo, data1, data1Size);
+            selected_echo256_opt_x4_Update(&ctx_echo, data2, data2Size);
+            selected_echo256_opt_x4_Update(&ctx_echo, data3, data3Size);
+            selected_echo256_opt_x4_Final(&ctx_echo, hashval);
+            break;
+        }
+        case 1:
+        {
+            shavite3_256_opt_x4_hashState ctx_shavite;
+            selected_shavite3_256_opt_x4_Init(&ctx_shavite);
+            selected_shavite3_256_opt_x4_Update(&ctx_shavite, data1, data1Size);
+            selected_shavite3_256_opt_x4_Update(&ctx_shavite, data2, data2Size);
+            selected_shavite3_256_opt_x4_Update(&ctx_shavite, data3, data3Size);
+            selected_shavite3_256_opt_x4_Final(&ctx_shavite, hashval);
+            break;
+        }
+        default:
+            assert(0);
+    }
+}
+
+// Everything needed to calculate (and if it meets the target, follow up on) the first fast hash of a single post nonce.
+struct sigma_fast_hash_job
+{
+    std::array<uint8_t, 80> header;
+    std::array<uint64_t, 4> prngState;
+    uint8_t* arenaChunk1;
+    uint8_t* arenaChunk2;
+    uint64_t nPseudoRandomAlg2;
+    uint32_t nNonce;
+};
+
+// The mining loop calculates one first fast hash per post nonce, with a pseudo randomly selected algorithm.
+// When multi way kernels are available jobs are held back per algorithm, and then hashed together once enough jobs that select the same algorithm have accumulated to fill every lane.
+// Every job is still evaluated exactly once with an identical result; only the order in which post nonces are evaluated changes.
+class sigma_fast_hash_queue
+{
+public:
+    sigma_fast_hash_queue(uint64_t fastHashSizeBytes_) : fastHashSizeBytes(fastHashSizeBytes_) {}
+
+    // Calls evaluate(job, firstHash) for every job whose first hash has been calculated, which may be none, this job alone or the held back jobs followed by this one.
+    // Returns true as soon as evaluate does, which signals that all remaining work should be abandoned.
+    template <typename Evaluate> inline bool push(uint64_t nPseudoRandomAlg1, const sigma_fast_hash_job& job, Evaluate&& evaluate)
+    {
+        const uint64_t nLanes = lanes(nPseudoRandomAlg1);
+        if (nLanes == 1)
+        {
+            uint256 fastHash;
+            sigmaRandomFastHash(nPseudoRandomAlg1, (uint8_t*)&job.header[0], 80, (uint8_t*)&job.prngState[0], 32, job.arenaChunk1, fastHashSizeBytes, fastHash);
+            return evaluate(job, fastHash);
+        }
+        if (pendingCount[nPseudoRandomAlg1] + 1 < nLanes)
+        {
+            pending[nPseudoRandomAlg1][pendingCount[nPseudoRandomAlg1]++] = job;
+            return false;
+        }
+        pendingCount[nPseudoRandomAlg1] = 0;
+
+        if (nLanes == 2)
+        {
+            const sigma_fast_hash_job& held = pending[nPseudoRandomAlg1][0];
+            uint256 fastHashHeld;
+            uint256 fastHash;
+            sigmaRandomFastHashX2(nPseudoRandomAlg1, (uint8_t*)&held.header[0], (uint8_t*)&job.header[0], 80, (uint8_t*)&held.prngState[0], (uint8_t*)&job.prngState[0], 32, held.arenaChunk1, job.arenaChunk1, fastHashSizeBytes, fastHashHeld, fastHash);
+            if (evaluate(held, fastHashHeld))
+                return true;
+            return evaluate(job, fastHash);
+        }
+
+        const sigma_fast_hash_job* jobs[4] = { &pending[nPseudoRandomAlg1][0], &pending[nPseudoRandomAlg1][1], &pending[nPseudoRandomAlg1][2], &job };
+        uint8_t* headers[4];
+        uint8_t* prngStates[4];
+        uint8_t* arenaChunks[4];
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            headers[lane] = (uint8_t*)&jobs[lane]->header[0];
+            prngStates[lane] = (uint8_t*)&jobs[lane]->prngState[0];
+            arenaChunks[lane] = jobs[lane]->arenaChunk1;
+        }
+        uint256 fastHashes[4];
+        sigmaRandomFastHashX4(nPseudoRandomAlg1, headers, 80, prngStates, 32, arenaChunks, fastHashSizeBytes, fastHashes);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (evaluate(*jobs[lane], fastHashes[lane]))
+                return true;
+        }
+        return false;
+    }
+
+    // Hash any jobs that are still held back, two at a time where possible and otherwise one at a time.
+    template <typename Evaluate> inline bool flush(Evaluate&& evaluate)
+    {
+        for (uint64_t nAlg = 0; nAlg < 2; ++nAlg)
+        {
+            const uint64_t nCount = pendingCount[nAlg];
+            pendingCount[nAlg] = 0;
+            uint64_t i = 0;
+            if (haveTwoWay(nAlg))
+            {
+                for (; i + 1 < nCount; i += 2)
+                {
+                    const sigma_fast_hash_job& jobA = pending[nAlg][i];
+                    const sigma_fast_hash_job& jobB = pending[nAlg][i+1];
+                    uint256 fastHashA;
+                    uint256 fastHashB;
+                    sigmaRandomFastHashX2(nAlg, (uint8_t*)&jobA.header[0], (uint8_t*)&jobB.header[0], 80, (uint8_t*)&jobA.prngState[0], (uint8_t*)&jobB.prngState[0], 32, jobA.arenaChunk1, jobB.arenaChunk1, fastHashSizeBytes, fastHashA, fastHashB);
+                    if (evaluate(jobA, fastHashA) || evaluate(jobB, fastHashB))
+                        return true;
+                }
+            }
+            for (; i < nCount; ++i)
+            {
+                uint256 fastHash;
+                sigmaRandomFastHash(nAlg, (uint8_t*)&pending[nAlg][i].header[0], 80, (uint8_t*)&pending[nAlg][i].prngState[0], 32, pending[nAlg][i].arenaChunk1, fastHashSizeBytes, fastHash);
+                if (evaluate(pending[nAlg][i], fastHash))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    inline void clear()
+    {
+        pendingCount[0] = pendingCount[1] = 0;
+    }
+private:
+    static inline bool haveTwoWay(uint64_t nPseudoRandomAlg)
+    {
+        return nPseudoRandomAlg == 0 ? selected_echo256_opt_x2_Init != nullptr : selected_shavite3_256_opt_x2_Init != nullptr;
+    }
+    static inline bool haveFourWay(uint64_t nPseudoRandomAlg)
+    {
+        return nPseudoRandomAlg == 0 ? selected_echo256_opt_x4_Init != nullptr : selected_shavite3_256_opt_x4_Init != nullptr;
+    }
+    static inline uint64_t lanes(uint64_t nPseudoRandomAlg)
+    {
+        return haveFourWay(nPseudoRandomAlg) ? 4 : (haveTwoWay(nPseudoRandomAlg) ? 2 : 1);
+    }
+
+    uint64_t fastHashSizeBytes;
+    sigma_fast_hash_job pending[2][3];
+    uint64_t pendingCount[2] = {0, 0};
+};
+
 inline void sigmaRandomFastHashRef(uint64_t nPseudoRandomAlg, uint8_t* data1, uint64_t data1Size, uint8_t* data2, uint64_t data2Size, uint8_t* data3, uint64_t data3Size, uint256& outHash)
 {
     {
@@ -198,78 +439,291 @@ uint64_t nNumArgonTrials=10;
 }
 
 #ifdef ARCH_CPU_X86_FAMILY
-void LogSelection(uint64_t nSel, std::string sAlgoName)
+static std::string GetSelectionName(uint64_t nSel)
 {
     switch (nSel)
     {
-        case 0:
-            LogPrintf("[%d] Selected reference implementation \n", sAlgoName); break;
-        case 1:
-            LogPrintf("[%d] Selected avx512f-aes\n", sAlgoName); break;
-        case 2:
-            LogPrintf("[%d] Selected avx2-aes\n", sAlgoName); break;
-        case 3:
-            LogPrintf("[%d] Selected avx-aes\n", sAlgoName); break;
-        case 4:
-            LogPrintf("[%d] Selected sse4-aes\n", sAlgoName); break;
-        case 5:
-            LogPrintf("[%d] Selected sse3-aes\n", sAlgoName); break;
-        case 6:
-            LogPrintf("[%d] Selected sse2-aes\n", sAlgoName); break;
-        case 7:
-            LogPrintf("[%d] Selected avx512f\n", sAlgoName); break;
-        case 8:
-            LogPrintf("[%d] Selected avx2\n", sAlgoName); break;
-        case 9:
-            LogPrintf("[%d] Selected avx\n", sAlgoName); break;
-        case 10:
-            LogPrintf("[%d] Selected sse4\n", sAlgoName); break;
-        case 11:
-            LogPrintf("[%d] Selected sse3\n", sAlgoName); break;
-        case 12:
-            LogPrintf("[%d] Selected sse2\n", sAlgoName); break;
-        case 9999:
-            LogPrintf("[%d] Selected hybrid implementation\n", sAlgoName); break;
+        case 0: return "reference implementation";
+        case 1: return "avx512f-aes";
+        case 2: return "avx2-aes";
+        case 3: return "avx-aes";
+        case 4: return "sse4-aes";
+        case 5: return "sse3-aes";
+        case 6: return "sse2-aes";
+        case 7: return "avx512f";
+        case 8: return "avx2";
+        case 9: return "avx";
+        case 10: return "sse4";
+        case 11: return "sse3";
+        case 12: return "sse2";
+        case 9999: return "hybrid implementation";
     }
+    return "unknown";
 }
 #elif defined(ARCH_CPU_ARM_FAMILY)
-void LogSelection(uint64_t nSel, std::string sAlgoName)
+static std::string GetSelectionName(uint64_t nSel)
 {
     switch (nSel)
     {
-        case 0:
-            LogPrintf("[%d] Selected reference implementation (no NEON support)\n", sAlgoName); break;
-        case 1:
-            LogPrintf("[%d] Selected Cortex-A53 optimised NEON support (no hardware AES)\n", sAlgoName); break;
-        case 2:
-            LogPrintf("[%d] Selected Cortex-A57 optimised NEON support (no hardware AES)\n", sAlgoName); break;
-        case 3:
-            LogPrintf("[%d] Selected Cortex-A72 optimised NEON support (no hardware AES)\n", sAlgoName); break;
-        case 4:
-            LogPrintf("[%d] Selected Cortex-A53 optimised NEON+AES support\n", sAlgoName); break;
-        case 5:
-            LogPrintf("[%d] Selected Cortex-A57 optimised NEON+AES support\n", sAlgoName); break;
-        case 6:
-            LogPrintf("[%d] Selected Cortex-A72 optimised NEON+AES support\n", sAlgoName); break;
-        case 7:
-            LogPrintf("[%d] Selected Thunderx optimised NEON+AES support\n", sAlgoName); break;
-        case 9999:
-            LogPrintf("[%d] Selected hybrid implementation\n", sAlgoName); break;
+        case 0: return "reference implementation (no NEON support)";
+        case 1: return "Cortex-A53 optimised NEON support (no hardware AES)";
+        case 2: return "Cortex-A57 optimised NEON support (no hardware AES)";
+        case 3: return "Cortex-A72 optimised NEON support (no hardware AES)";
+        case 4: return "Cortex-A53 optimised NEON+AES support";
+        case 5: return "Cortex-A57 optimised NEON+AES support";
+        case 6: return "Cortex-A72 optimised NEON+AES support";
+        case 7: return "Thunderx optimised NEON+AES support";
+        case 9999: return "hybrid implementation";
     }
+    return "unknown";
 }
 #include <sys/auxv.h>
 #else
-void LogSelection(uint64_t nSel, std::string sAlgoName)
+static std::string GetSelectionName(uint64_t nSel)
 {
     //fixme: (SIGMA) Implement for riscv
+    return "reference implementation";
+}
+#endif
+
+// What the fast hashes hash when mining: a header, the PRNG state and a chunk of the arena.
+static std::vector<uint8_t> benchmarkData()
+{
+    std::vector<uint8_t> data(80 + 32 + defaultSigmaSettings.fastHashSizeBytes);
+    for (size_t i=0; i<data.size(); ++i)
+        data[i] = (uint8_t)(i*31 + 7);
+    return data;
+}
+
+static const uint64_t nBenchmarkMessages=256;
+
+// Nanoseconds f takes, the best of a few runs so that a run that got interrupted doesn't count.
+template <typename F> static uint64_t timeBestOf(F f)
+{
+    uint64_t nBest = std::numeric_limits<uint64_t>::max();
+    for (int nRun=0; nRun<3; ++nRun)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        nBest = std::min<uint64_t>(nBest, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    return nBest;
+}
+
+static uint64_t timeShavite(decltype(selected_shavite3_256_opt_Init) init, decltype(selected_shavite3_256_opt_Update) update, decltype(selected_shavite3_256_opt_Final) final, const std::vector<uint8_t>& data)
+{
+    return timeBestOf([&]()
+    {
+        shavite3_256_opt_hashState ctx;
+        uint8_t outHash[32];
+        for (uint64_t i=0; i<nBenchmarkMessages; ++i)
+        {
+            init(&ctx);
+            update(&ctx, data.data(), data.size());
+            final(&ctx, outHash);
+        }
+    });
+}
+
+static uint64_t timeEcho(decltype(selected_echo256_opt_Init) init, decltype(selected_echo256_opt_Update) update, decltype(selected_echo256_opt_Final) final, const std::vector<uint8_t>& data)
+{
+    return timeBestOf([&]()
+    {
+        echo256_opt_hashState ctx;
+        uint8_t outHash[32];
+        for (uint64_t i=0; i<nBenchmarkMessages; ++i)
+        {
+            init(&ctx);
+            update(&ctx, data.data(), data.size());
+            final(&ctx, outHash);
+        }
+    });
+}
+
+// A slow hash with the real settings, so that what is timed is the memory hard hashing and not argon rejecting its inputs.
+// Returns the maximum if the implementation fails, so that it can never be picked.
+static uint64_t timeArgon(decltype(selected_argon2_echo_hash) argon, const std::vector<uint8_t>& data, std::vector<uint8_t>& argonScratch)
+{
+    bool fOK = true;
+    uint64_t nTime = timeBestOf([&]()
+    {
+        argon2_echo_context context;
+        context.t_cost = defaultSigmaSettings.argonSlowHashRoundCost;
+        context.m_cost = defaultSigmaSettings.argonMemoryCostKb;
+        context.allocated_memory = argonScratch.data();
+        context.pwd = (uint8_t*)data.data();
+        context.pwdlen = 80;
+        context.lanes = defaultSigmaSettings.numVerifyThreads;
+        context.threads = 1;
+        if (argon(&context, true) != ARGON2_OK)
+            fOK = false;
+    });
+    return fOK ? nTime : std::numeric_limits<uint64_t>::max();
+}
+
+// The multi way kernels in use, for the same number of messages as the single way timings above.
+static uint64_t timeShaviteX2(const std::vector<uint8_t>& data)
+{
+    return timeBestOf([&]()
+    {
+        shavite3_256_opt_x2_hashState ctx;
+        uint8_t outHashA[32], outHashB[32];
+        for (uint64_t i=0; i<nBenchmarkMessages/2; ++i)
+        {
+            selected_shavite3_256_opt_x2_Init(&ctx);
+            selected_shavite3_256_opt_x2_Update(&ctx, data.data(), data.data(), data.size());
+            selected_shavite3_256_opt_x2_Final(&ctx, outHashA, outHashB);
+        }
+    });
+}
+
+static uint64_t timeEchoX2(const std::vector<uint8_t>& data)
+{
+    return timeBestOf([&]()
+    {
+        echo256_opt_x2_hashState ctx;
+        uint8_t outHashA[32], outHashB[32];
+        for (uint64_t i=0; i<nBenchmarkMessages/2; ++i)
+        {
+            selected_echo256_opt_x2_Init(&ctx);
+            selected_echo256_opt_x2_Update(&ctx, data.data(), data.data(), data.size());
+            selected_echo256_opt_x2_Final(&ctx, outHashA, outHashB);
+        }
+    });
+}
+
+static uint64_t timeShaviteX4(const std::vector<uint8_t>& data)
+{
+    return timeBestOf([&]()
+    {
+        shavite3_256_opt_x4_hashState ctx;
+        uint8_t outHashes[4][32];
+        const unsigned char* const inputs[4] = { data.data(), data.data(), data.data(), data.data() };
+        unsigned char* const outputs[4] = { outHashes[0], outHashes[1], outHashes[2], outHashes[3] };
+        for (uint64_t i=0; i<nBenchmarkMessages/4; ++i)
+        {
+            selected_shavite3_256_opt_x4_Init(&ctx);
+            selected_shavite3_256_opt_x4_Update(&ctx, inputs, data.size());
+            selected_shavite3_256_opt_x4_Final(&ctx, outputs);
+        }
+    });
+}
+
+static uint64_t timeEchoX4(const std::vector<uint8_t>& data)
+{
+    return timeBestOf([&]()
+    {
+        echo256_opt_x4_hashState ctx;
+        uint8_t outHashes[4][32];
+        const unsigned char* const inputs[4] = { data.data(), data.data(), data.data(), data.data() };
+        unsigned char* const outputs[4] = { outHashes[0], outHashes[1], outHashes[2], outHashes[3] };
+        for (uint64_t i=0; i<nBenchmarkMessages/4; ++i)
+        {
+            selected_echo256_opt_x4_Init(&ctx);
+            selected_echo256_opt_x4_Update(&ctx, inputs, data.size());
+            selected_echo256_opt_x4_Final(&ctx, outputs);
+        }
+    });
+}
+
+#ifdef ARCH_CPU_X86_FAMILY
+// One build of the shavite, echo and argon implementations for a level of x86 extensions.
+struct sigma_kernel_candidate
+{
+    uint64_t index;
+    // As given to -sigmaalgo.
+    std::string name;
+    bool needsAES;
+    // Whether the CPU has the extensions it needs.
+    bool supported;
+    decltype(selected_shavite3_256_opt_Init) shaviteInit;
+    decltype(selected_shavite3_256_opt_Update) shaviteUpdate;
+    decltype(selected_shavite3_256_opt_Final) shaviteFinal;
+    decltype(selected_echo256_opt_Init) echoInit;
+    decltype(selected_echo256_opt_Update) echoUpdate;
+    decltype(selected_echo256_opt_Final) echoFinal;
+    decltype(selected_echo256_opt_UpdateFinal) echoUpdateFinal;
+    decltype(selected_argon2_echo_hash) argon;
+};
+
+#define SIGMA_KERNEL_CANDIDATE(CPU, IDX, NAME, NEEDS_AES, SUPPORTED) \
+    candidates.push_back({IDX, NAME, NEEDS_AES, (bool)(SUPPORTED), \
+                          shavite3_256_opt_##CPU##_Init, shavite3_256_opt_##CPU##_Update, shavite3_256_opt_##CPU##_Final, \
+                          echo256_opt_##CPU##_Init, echo256_opt_##CPU##_Update, echo256_opt_##CPU##_Final, echo256_opt_##CPU##_UpdateFinal, \
+                          argon2_echo_ctx_##CPU})
+
+// The builds there are, in order of preference: the widest extensions first, all those that use AES ahead of those that don't.
+static std::vector<sigma_kernel_candidate> sigmaKernelCandidates(bool haveAES)
+{
+    std::vector<sigma_kernel_candidate> candidates;
+    (unused)haveAES;
+    #if defined(COMPILER_HAS_AES)
+    #if defined(COMPILER_HAS_AVX512F)
+    SIGMA_KERNEL_CANDIDATE(avx512f_aes, 1, "avx512faes", true, haveAES && __builtin_cpu_supports("avx512f"));
+    #endif
+    #if defined(COMPILER_HAS_AVX2)
+    SIGMA_KERNEL_CANDIDATE(avx2_aes, 2, "avx2aes", true, haveAES && __builtin_cpu_supports("avx2"));
+    #endif
+    #if defined(COMPILER_HAS_AVX)
+    SIGMA_KERNEL_CANDIDATE(avx_aes, 3, "avxaes", true, haveAES && __builtin_cpu_supports("avx"));
+    #endif
+    #if defined(COMPILER_HAS_SSE4)
+    SIGMA_KERNEL_CANDIDATE(sse4_aes, 4, "sse4.2aes", true, haveAES && __builtin_cpu_supports("sse4.2"));
+    #endif
+    #if defined(COMPILER_HAS_SSE3)
+    SIGMA_KERNEL_CANDIDATE(sse3_aes, 5, "ssse3aes", true, haveAES && __builtin_cpu_supports("ssse3"));
+    #endif
+    //fixme: (SIGMA) sse2_aes (6)
+    #endif
+    #if defined(COMPILER_HAS_AVX512F)
+    SIGMA_KERNEL_CANDIDATE(avx512f, 7, "avx512f", false, __builtin_cpu_supports("avx512f"));
+    #endif
+    #if defined(COMPILER_HAS_AVX2)
+    SIGMA_KERNEL_CANDIDATE(avx2, 8, "avx2", false, __builtin_cpu_supports("avx2"));
+    #endif
+    #if defined(COMPILER_HAS_AVX)
+    SIGMA_KERNEL_CANDIDATE(avx, 9, "avx", false, __builtin_cpu_supports("avx"));
+    #endif
+    #if defined(COMPILER_HAS_SSE4)
+    SIGMA_KERNEL_CANDIDATE(sse4, 10, "sse4.2", false, __builtin_cpu_supports("sse4.2"));
+    #endif
+    #if defined(COMPILER_HAS_SSE3)
+    SIGMA_KERNEL_CANDIDATE(sse3, 11, "ssse3", false, __builtin_cpu_supports("ssse3"));
+    #endif
+    //fixme: (SIGMA) sse2 (12)
+    return candidates;
 }
 #endif
 
 void selectOptimisedImplementations()
+{
+    sigma_kernel_choice choice;
+    selectOptimisedImplementations(SIGMA_SELECT_BY_FEATURES, choice);
+}
+
+void selectOptimisedImplementations(sigma_kernel_selection selection, sigma_kernel_choice& choice)
 {
     uint64_t nSelShavite=0;
     uint64_t nSelEcho=0;
     uint64_t nSelArgon=0;
+    // Which multi way kernels may be used, and whether to time them against the single way ones first.
+    sigma_kernel_choice allowed;
+    bool benchmarkMultiWay = false;
+    std::string selectionName = "benchmark";
+    (unused)selection;
+    // Only set below where they fit the single way kernels.
+    selected_shavite3_256_opt_x2_Init = nullptr;
+    selected_shavite3_256_opt_x2_Update = nullptr;
+    selected_shavite3_256_opt_x2_Final = nullptr;
+    selected_echo256_opt_x2_Init = nullptr;
+    selected_echo256_opt_x2_Update = nullptr;
+    selected_echo256_opt_x2_Final = nullptr;
+    selected_shavite3_256_opt_x4_Init = nullptr;
+    selected_shavite3_256_opt_x4_Update = nullptr;
+    selected_shavite3_256_opt_x4_Final = nullptr;
+    selected_echo256_opt_x4_Init = nullptr;
+    selected_echo256_opt_x4_Update = nullptr;
+    selected_echo256_opt_x4_Final = nullptr;
 
     #ifndef ARCH_CPU_X86_FAMILY
     std::string data = "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz";
@@ -326,132 +780,133 @@ void selectOptimisedImplementations()
     #ifdef ARCH_CPU_X86_FAMILY
     {
         std::string forceSigmaAlgo = GetArg("-sigmaalgo", "");
-        #define SELECT_ALGO(x) ((__builtin_cpu_supports(x) && forceSigmaAlgo.empty()) || (forceSigmaAlgo==x))
-        #if defined(COMPILER_HAS_AES)
-        if (__builtin_cpu_supports("aes") && (forceSigmaAlgo.empty() || boost::algorithm::ends_with(forceSigmaAlgo, "aes")))
+        bool haveAES = __builtin_cpu_supports("aes");
+        #if defined(COMPILER_HAS_SSE3) && defined(COMPILER_HAS_AES)
+        if (haveAES && (forceSigmaAlgo.empty() || boost::algorithm::ends_with(forceSigmaAlgo, "aes")))
         {
-            if (!forceSigmaAlgo.empty())
-            {
-                forceSigmaAlgo.erase(forceSigmaAlgo.length()-3);
-            }
-            #if defined(COMPILER_HAS_AVX512F)
-            if (SELECT_ALGO("avx512f"))
-            {
-                FORCE_SELECT_OPTIMISED_SHAVITE(avx512f_aes, 1);
-                FORCE_SELECT_OPTIMISED_ECHO   (avx512f_aes, 1);
-                FORCE_SELECT_OPTIMISED_ARGON  (avx512f_aes, 1);
-                goto logselection;
-            }
-            #endif
-            #if defined(COMPILER_HAS_AVX2)
-            if (SELECT_ALGO("avx2"))
-            {
-                FORCE_SELECT_OPTIMISED_SHAVITE(avx2_aes, 2);
-                FORCE_SELECT_OPTIMISED_ECHO   (avx2_aes, 2);
-                FORCE_SELECT_OPTIMISED_ARGON  (avx2_aes, 2);
-                goto logselection;
-            }
-            #endif
-            #if defined(COMPILER_HAS_AVX)
-            if (SELECT_ALGO("avx"))
-            {
-                FORCE_SELECT_OPTIMISED_SHAVITE(avx_aes, 3);
-                FORCE_SELECT_OPTIMISED_ECHO   (avx_aes, 3);
-                FORCE_SELECT_OPTIMISED_ARGON  (avx_aes, 3);
-                goto logselection;
-            }
-            #endif
-            #if defined(COMPILER_HAS_SSE4)
-            if (SELECT_ALGO("sse4.2"))
-            {
-                FORCE_SELECT_OPTIMISED_SHAVITE(sse4_aes, 4);
-                FORCE_SELECT_OPTIMISED_ECHO   (sse4_aes, 4);
-                FORCE_SELECT_OPTIMISED_ARGON  (sse4_aes, 4);
-                goto logselection;
-            }
-            #endif
-            #if defined(COMPILER_HAS_SSE3)
-            if (SELECT_ALGO("ssse3"))
-            {
-                FORCE_SELECT_OPTIMISED_SHAVITE(sse3_aes, 5);
-                FORCE_SELECT_OPTIMISED_ECHO   (sse3_aes, 5);
-                FORCE_SELECT_OPTIMISED_ARGON  (sse3_aes, 5);
-                goto logselection;
-            }
-            #endif
-            #if defined(COMPILER_HAS_SSE2)
-            #if 0
-            //fixme: (SIGMA)
-            if (SELECT_ALGO("sse2"))
-            {
-                FORCE_SELECT_OPTIMISED_SHAVITE(sse2_aes, 6);
-                FORCE_SELECT_OPTIMISED_ECHO   (sse2_aes, 6);
-                FORCE_SELECT_OPTIMISED_ARGON  (sse2_aes, 6);
-                goto logselection;
-            }
-            #endif
-            #endif
+            selected_aes256_prng_advance = aes256_prng_advance_sse3_aes;
         }
-        else
         #endif
+
+        std::vector<sigma_kernel_candidate> candidates = sigmaKernelCandidates(haveAES);
+        const sigma_kernel_candidate* shavite = nullptr;
+        const sigma_kernel_candidate* echo = nullptr;
+        const sigma_kernel_candidate* argon = nullptr;
+        if (!forceSigmaAlgo.empty())
         {
-            #if defined(COMPILER_HAS_AVX512F)
-            if (SELECT_ALGO("avx512f"))
+            // A forced implementation is used whether or not the feature flags claim support for it, except for AES.
+            for (const auto& candidate : candidates)
             {
-                FORCE_SELECT_OPTIMISED_SHAVITE(avx512f, 7);
-                FORCE_SELECT_OPTIMISED_ECHO   (avx512f, 7);
-                FORCE_SELECT_OPTIMISED_ARGON  (avx512f, 7);
-                goto logselection;
+                if (candidate.name == forceSigmaAlgo && (haveAES || !candidate.needsAES))
+                    shavite = echo = argon = &candidate;
             }
-            #endif
-            #if defined(COMPILER_HAS_AVX2)
-            if (SELECT_ALGO("avx2"))
+            selectionName = "forced";
+        }
+        else if (selection == SIGMA_SELECT_BENCHMARK)
+        {
+            std::vector<uint8_t> data = benchmarkData();
+            std::vector<uint8_t> argonScratch(defaultSigmaSettings.argonMemoryCostKb*1024);
+            uint64_t nBestShavite = std::numeric_limits<uint64_t>::max();
+            uint64_t nBestEcho = std::numeric_limits<uint64_t>::max();
+            uint64_t nBestArgon = std::numeric_limits<uint64_t>::max();
+            bool fArgonFailed = false;
+            for (const auto& candidate : candidates)
             {
-                FORCE_SELECT_OPTIMISED_SHAVITE(avx2, 8);
-                FORCE_SELECT_OPTIMISED_ECHO   (avx2, 8);
-                FORCE_SELECT_OPTIMISED_ARGON  (avx2, 8);
-                goto logselection;
+                if (!candidate.supported)
+                    continue;
+                uint64_t nTimeShavite = timeShavite(candidate.shaviteInit, candidate.shaviteUpdate, candidate.shaviteFinal, data);
+                uint64_t nTimeEcho = timeEcho(candidate.echoInit, candidate.echoUpdate, candidate.echoFinal, data);
+                uint64_t nTimeArgon = timeArgon(candidate.argon, data, argonScratch);
+                if (nTimeArgon == std::numeric_limits<uint64_t>::max())
+                {
+                    LogPrintf("[sigma] %s: argon benchmark failed\n", candidate.name);
+                    fArgonFailed = true;
+                }
+                LogPrint(BCLog::BENCH, "[sigma] %s: shavite %dns echo %dns argon %dns\n", candidate.name, nTimeShavite, nTimeEcho, nTimeArgon);
+                if (nTimeShavite < nBestShavite)
+                {
+                    nBestShavite = nTimeShavite;
+                    shavite = &candidate;
+                }
+                if (nTimeEcho < nBestEcho)
+                {
+                    nBestEcho = nTimeEcho;
+                    echo = &candidate;
+                }
+                if (nTimeArgon < nBestArgon)
+                {
+                    nBestArgon = nTimeArgon;
+                    argon = &candidate;
+                }
             }
-            #endif
-            #if defined(COMPILER_HAS_AVX)
-            if (SELECT_ALGO("avx"))
+            // A failing argon benchmark means the timings can't be trusted, keep to what the feature flags allow instead (the first supported candidate).
+            if (fArgonFailed)
             {
-                FORCE_SELECT_OPTIMISED_SHAVITE(avx, 9);
-                FORCE_SELECT_OPTIMISED_ECHO   (avx, 9);
-                FORCE_SELECT_OPTIMISED_ARGON  (avx, 9);
-                goto logselection;
+                argon = nullptr;
+                for (const auto& candidate : candidates)
+                {
+                    if (candidate.supported)
+                    {
+                        argon = &candidate;
+                        break;
+                    }
+                }
             }
-            #endif
-            #if defined(COMPILER_HAS_SSE4)
-            if (SELECT_ALGO("sse4.2"))
+            benchmarkMultiWay = true;
+            selectionName = "benchmark";
+        }
+        else
+        {
+            auto supportedCandidate = [&](uint64_t index) -> const sigma_kernel_candidate*
             {
-                FORCE_SELECT_OPTIMISED_SHAVITE(sse4, 10);
-                FORCE_SELECT_OPTIMISED_ECHO   (sse4, 10);
-                FORCE_SELECT_OPTIMISED_ARGON  (sse4, 10);
-                goto logselection;
-            }
-            #endif
-            #if defined(COMPILER_HAS_SSE3)
-            if (SELECT_ALGO("ssse3"))
+                for (const auto& candidate : candidates)
+                {
+                    if (candidate.supported && candidate.index == index)
+                        return &candidate;
+                }
+                return nullptr;
+            };
+            if (selection == SIGMA_SELECT_CACHED)
             {
-                FORCE_SELECT_OPTIMISED_SHAVITE(sse3, 11);
-                FORCE_SELECT_OPTIMISED_ECHO   (sse3, 11);
-                FORCE_SELECT_OPTIMISED_ARGON  (sse3, 11);
-                goto logselection;
+                shavite = supportedCandidate(choice.shavite);
+                echo = supportedCandidate(choice.echo);
+                argon = supportedCandidate(choice.argon);
+                allowed = choice;
             }
-            #endif
-            #if defined(COMPILER_HAS_SSE2)
-            #if 0
-            //fixme: (SIGMA)
-            else if (SELECT_ALGO("sse2"))
+            selectionName = (shavite && echo && argon) ? "cached" : "features";
+            // The candidates are in order of preference, so the first supported one is the widest the feature flags allow.
+            for (const auto& candidate : candidates)
             {
-                FORCE_SELECT_OPTIMISED_SHAVITE(sse2, 12);
-                FORCE_SELECT_OPTIMISED_ECHO   (sse2, 12);
-                FORCE_SELECT_OPTIMISED_ARGON  (sse2, 12);
-                goto logselection;
+                if (!candidate.supported)
+                    continue;
+                if (!shavite)
+                    shavite = &candidate;
+                if (!echo)
+                    echo = &candidate;
+                if (!argon)
+                    argon = &candidate;
+                break;
             }
-            #endif
-            #endif
+        }
+        if (shavite)
+        {
+            selected_shavite3_256_opt_Init   = shavite->shaviteInit;
+            selected_shavite3_256_opt_Update = shavite->shaviteUpdate;
+            selected_shavite3_256_opt_Final  = shavite->shaviteFinal;
+            nSelShavite = shavite->index;
+        }
+        if (echo)
+        {
+            selected_echo256_opt_Init        = echo->echoInit;
+            selected_echo256_opt_Update      = echo->echoUpdate;
+            selected_echo256_opt_Final       = echo->echoFinal;
+            selected_echo256_opt_UpdateFinal = echo->echoUpdateFinal;
+            nSelEcho = echo->index;
+        }
+        if (argon)
+        {
+            selected_argon2_echo_hash = argon->argon;
+            nSelArgon = argon->index;
         }
     }
     #elif defined (ARCH_CPU_ARM_FAMILY)
@@ -470,6 +925,12 @@ void selectOptimisedImplementations()
             haveAES=true;
         }
         #endif
+        #ifdef COMPILER_HAS_CORTEX53_AES
+        if (haveAES)
+        {
+            selected_aes256_prng_advance = aes256_prng_advance_arm_cortex_a53_aes;
+        }
+        #endif
         #ifdef COMPILER_HAS_CORTEX53
         SELECT_OPTIMISED_SHAVITE(arm_cortex_a53, 1);
         SELECT_OPTIMISED_ECHO(arm_cortex_a53, 1);
@@ -485,72 +946,570 @@ void selectOptimisedImplementations()
         SELECT_OPTIMISED_ECHO(arm_cortex_a72, 3);
         SELECT_OPTIMISED_ARGON(arm_cortex_a72, 3);
         #endif
-        if (haveAES)
+        if (haveAES)
+        {
+            #ifdef COMPILER_HAS_CORTEX53_AES
+            SELECT_OPTIMISED_SHAVITE(arm_cortex_a53_aes, 4);
+            SELECT_OPTIMISED_ECHO(arm_cortex_a53_aes, 4);
+            SELECT_OPTIMISED_ARGON(arm_cortex_a53_aes, 4);
+            #endif
+            #ifdef COMPILER_HAS_CORTEX57_AES
+            SELECT_OPTIMISED_SHAVITE(arm_cortex_a57_aes, 5);
+            SELECT_OPTIMISED_ECHO(arm_cortex_a57_aes, 5);
+            SELECT_OPTIMISED_ARGON(arm_cortex_a57_aes, 5);
+            #endif
+            #ifdef COMPILER_HAS_CORTEX72_AES
+            SELECT_OPTIMISED_SHAVITE(arm_cortex_a72_aes, 6);
+            SELECT_OPTIMISED_ECHO(arm_cortex_a72_aes, 6);
+            SELECT_OPTIMISED_ARGON(arm_cortex_a72_aes, 6);
+            #endif
+            #ifdef COMPILER_HAS_THUNDERX_AES
+            SELECT_OPTIMISED_SHAVITE(arm_thunderx_aes, 7);
+            SELECT_OPTIMISED_ECHO(arm_thunderx_aes, 7);
+            SELECT_OPTIMISED_ARGON(arm_thunderx_aes, 7);
+            #endif
+        }
+    }
+    
+    // Finally (only after we have fastest echo implementation) give the hybrid echo a go
+    // Just in case it happens to be faster.
+    SELECT_OPTIMISED_ARGON(hybrid, 9999);
+    #endif
+    
+    // The two way kernels are only built with VAES; pair them with the AVX2/AVX-512 AES single way kernels (so that a forced lesser implementation disables them as well).
+    #if defined(ARCH_CPU_X86_FAMILY) && defined(COMPILER_HAS_AVX2) && defined(COMPILER_HAS_VAES)
+    if (__builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2"))
+    {
+        if (nSelShavite == 1 || nSelShavite == 2)
+        {
+            selected_shavite3_256_opt_x2_Init   = shavite3_256_opt_x2_avx2_vaes_Init;
+            selected_shavite3_256_opt_x2_Update = shavite3_256_opt_x2_avx2_vaes_Update;
+            selected_shavite3_256_opt_x2_Final  = shavite3_256_opt_x2_avx2_vaes_Final;
+        }
+        if (nSelEcho == 1 || nSelEcho == 2)
+        {
+            selected_echo256_opt_x2_Init   = echo256_opt_x2_avx2_vaes_Init;
+            selected_echo256_opt_x2_Update = echo256_opt_x2_avx2_vaes_Update;
+            selected_echo256_opt_x2_Final  = echo256_opt_x2_avx2_vaes_Final;
+        }
+    }
+    #endif
+    // A two way kernel is only worth it if it beats hashing the two inputs one after the other.
+    if (benchmarkMultiWay)
+    {
+        std::vector<uint8_t> data = benchmarkData();
+        if (selected_shavite3_256_opt_x2_Init)
+            allowed.shaviteX2 = timeShaviteX2(data) < timeShavite(selected_shavite3_256_opt_Init, selected_shavite3_256_opt_Update, selected_shavite3_256_opt_Final, data);
+        if (selected_echo256_opt_x2_Init)
+            allowed.echoX2 = timeEchoX2(data) < timeEcho(selected_echo256_opt_Init, selected_echo256_opt_Update, selected_echo256_opt_Final, data);
+    }
+    if (!allowed.shaviteX2)
+    {
+        selected_shavite3_256_opt_x2_Init = nullptr;
+        selected_shavite3_256_opt_x2_Update = nullptr;
+        selected_shavite3_256_opt_x2_Final = nullptr;
+    }
+    if (!allowed.echoX2)
+    {
+        selected_echo256_opt_x2_Init = nullptr;
+        selected_echo256_opt_x2_Update = nullptr;
+        selected_echo256_opt_x2_Final = nullptr;
+    }
+    // The four way kernels need AVX-512BW on top of VAES; pair them with the AVX-512 AES single way kernels only.
+    #if defined(ARCH_CPU_X86_FAMILY) && defined(COMPILER_HAS_AVX512F) && defined(COMPILER_HAS_AVX512BW) && defined(COMPILER_HAS_VAES)
+    if (__builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    {
+        if (nSelShavite == 1)
+        {
+            selected_shavite3_256_opt_x4_Init   = shavite3_256_opt_x4_avx512f_vaes_Init;
+            selected_shavite3_256_opt_x4_Update = shavite3_256_opt_x4_avx512f_vaes_Update;
+            selected_shavite3_256_opt_x4_Final  = shavite3_256_opt_x4_avx512f_vaes_Final;
+        }
+        if (nSelEcho == 1)
+        {
+            selected_echo256_opt_x4_Init   = echo256_opt_x4_avx512f_vaes_Init;
+            selected_echo256_opt_x4_Update = echo256_opt_x4_avx512f_vaes_Update;
+            selected_echo256_opt_x4_Final  = echo256_opt_x4_avx512f_vaes_Final;
+        }
+    }
+    #endif
+    // Likewise a four way kernel has to beat the two way kernel (or else the single way one); AVX-512 in particular can lower the clock of the whole core.
+    if (benchmarkMultiWay)
+    {
+        std::vector<uint8_t> data = benchmarkData();
+        if (selected_shavite3_256_opt_x4_Init)
+            allowed.shaviteX4 = timeShaviteX4(data) < (selected_shavite3_256_opt_x2_Init ? timeShaviteX2(data) : timeShavite(selected_shavite3_256_opt_Init, selected_shavite3_256_opt_Update, selected_shavite3_256_opt_Final, data));
+        if (selected_echo256_opt_x4_Init)
+            allowed.echoX4 = timeEchoX4(data) < (selected_echo256_opt_x2_Init ? timeEchoX2(data) : timeEcho(selected_echo256_opt_Init, selected_echo256_opt_Update, selected_echo256_opt_Final, data));
+    }
+    if (!allowed.shaviteX4)
+    {
+        selected_shavite3_256_opt_x4_Init = nullptr;
+        selected_shavite3_256_opt_x4_Update = nullptr;
+        selected_shavite3_256_opt_x4_Final = nullptr;
+    }
+    if (!allowed.echoX4)
+    {
+        selected_echo256_opt_x4_Init = nullptr;
+        selected_echo256_opt_x4_Update = nullptr;
+        selected_echo256_opt_x4_Final = nullptr;
+    }
+
+    choice.shavite = nSelShavite;
+    choice.echo = nSelEcho;
+    choice.argon = nSelArgon;
+    choice.shaviteX2 = allowed.shaviteX2;
+    choice.echoX2 = allowed.echoX2;
+    choice.shaviteX4 = allowed.shaviteX4;
+    choice.echoX4 = allowed.echoX4;
+    selectedSigmaImplementations.selection = selectionName;
+    selectedSigmaImplementations.shavite = GetSelectionName(nSelShavite);
+    selectedSigmaImplementations.echo = GetSelectionName(nSelEcho);
+    selectedSigmaImplementations.argon = GetSelectionName(nSelArgon);
+    selectedSigmaImplementations.prng = selected_aes256_prng_advance ? "hardware aes" : "reference implementation";
+    selectedSigmaImplementations.shaviteX2 = selected_shavite3_256_opt_x2_Init ? "avx2-vaes" : "unavailable";
+    selectedSigmaImplementations.echoX2 = selected_echo256_opt_x2_Init ? "avx2-vaes" : "unavailable";
+    selectedSigmaImplementations.shaviteX4 = selected_shavite3_256_opt_x4_Init ? "avx512f-vaes" : "unavailable";
+    selectedSigmaImplementations.echoX4 = selected_echo256_opt_x4_Init ? "avx512f-vaes" : "unavailable";
+
+    LogPrintf("[shavite] Selected %s\n", selectedSigmaImplementations.shavite);
+    LogPrintf("[echo] Selected %s\n", selectedSigmaImplementations.echo);
+    LogPrintf("[argon] Selected %s\n", selectedSigmaImplementations.argon);
+    LogPrintf("[prng] Selected %s\n", selectedSigmaImplementations.prng);
+    LogPrintf("[shavite] Two way kernel %s\n", selectedSigmaImplementations.shaviteX2);
+    LogPrintf("[echo] Two way kernel %s\n", selectedSigmaImplementations.echoX2);
+    LogPrintf("[shavite] Four way kernel %s\n", selectedSigmaImplementations.shaviteX4);
+    LogPrintf("[echo] Four way kernel %s\n", selectedSigmaImplementations.echoX4);
+    LogPrintf("[sigma] Implementations selected by %s\n", selectedSigmaImplementations.selection);
+}
+
+void normaliseBufferSize(uint64_t& nBufferSizeBytes)
+{
+    nBufferSizeBytes = (nBufferSizeBytes / (defaultSigmaSettings.argonMemoryCostKb*1024)) * (defaultSigmaSettings.argonMemoryCostKb*1024);
+}
+
+sigma_settings::sigma_settings()
+{
+    verify();
+}
+
+void sigma_settings::verify()
+{
+    assert(arenaSizeKb%argonMemoryCostKb==0);
+    assert(numHashesPre <= std::numeric_limits<uint16_t>::max()+1);
+    assert(numHashesPost <= std::numeric_limits<uint16_t>::max()+1);
+    arenaChunkSizeBytes = (arenaSizeKb*1024)/numHashesPost;
+    assert(fastHashSizeBytes<=arenaChunkSizeBytes);
+}
+
+
+std::string sigmaArenaBackingName(sigma_arena_backing backing)
+{
+    switch (backing)
+    {
+        case SIGMA_ARENA_HEAP: return "heap";
+        case SIGMA_ARENA_NORMAL_PAGES: return "normal_pages";
+        case SIGMA_ARENA_TRANSPARENT_HUGE_PAGES: return "transparent_huge_pages";
+        case SIGMA_ARENA_HUGE_PAGES_2MB: return "huge_pages_2mb";
+        case SIGMA_ARENA_HUGE_PAGES_1GB: return "huge_pages_1gb";
+        case SIGMA_ARENA_LARGE_PAGES: return "large_pages";
+    }
+    return "unknown";
+}
+
+sigma_context::sigma_context(sigma_settings settings_, uint64_t allocateArenaSizeKb_, uint64_t numThreads_, bool allowLargePages_, bool lockArena_)
+: numThreads(numThreads_)
+, allocatedArenaSizeKb(allocateArenaSizeKb_)
+, settings(settings_)
+{           
+    assert(allocatedArenaSizeKb <= settings.arenaSizeKb);
+    assert(allocatedArenaSizeKb%settings.argonMemoryCostKb==0);
+    
+    allocateArena(allowLargePages_, lockArena_);
+    numHashesPossibleWithAvailableMemory = (allocatedArenaSizeKb*1024)/settings.arenaChunkSizeBytes;
+
+    // Value initialisation touches every page, so workers never page fault on their scratch memory while mining.
+    slowHashScratchPool.resize(std::max(numThreads, (uint64_t)1)*settings.argonMemoryCostKb*1024);
+}
+
+uint8_t* sigma_context::slowHashScratch(uint64_t nThreadIndex)
+{
+    assert(nThreadIndex < std::max(numThreads, (uint64_t)1));
+    return &slowHashScratchPool[nThreadIndex*settings.argonMemoryCostKb*1024];
+}
+
+#ifdef WIN32
+// Large pages require SeLockMemoryPrivilege, which has to be granted to the user by policy and then enabled on the process token.
+static bool enableLockMemoryPrivilege()
+{
+    HANDLE hToken;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+        return false;
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool ret = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) && AdjustTokenPrivileges(hToken, FALSE, &tp, 0, nullptr, 0) && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(hToken);
+    return ret;
+}
+#endif
+
+void sigma_context::allocateArena(bool allowLargePages, bool lockArena)
+{
+    size_t arenaSizeBytes = allocatedArenaSizeKb*1024;
+    arena = nullptr;
+    arenaLocked = false;
+
+    #ifdef WIN32
+    if (allowLargePages)
+    {
+        static bool havePrivilege = enableLockMemoryPrivilege();
+        size_t largePageSize = GetLargePageMinimum();
+        if (havePrivilege && largePageSize > 0 && arenaSizeBytes % largePageSize == 0)
+        {
+            arena = (uint8_t*)VirtualAlloc(nullptr, arenaSizeBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (arena)
+            {
+                // Large pages are never paged out.
+                arenaBacking = SIGMA_ARENA_LARGE_PAGES;
+                arenaLocked = true;
+                return;
+            }
+        }
+    }
+    arena = (uint8_t*)VirtualAlloc(nullptr, arenaSizeBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (arena)
+    {
+        arenaBacking = SIGMA_ARENA_NORMAL_PAGES;
+        if (lockArena)
+        {
+            // VirtualLock is limited by the working set size, so grow that first.
+            SIZE_T minWorkingSet, maxWorkingSet;
+            if (GetProcessWorkingSetSize(GetCurrentProcess(), &minWorkingSet, &maxWorkingSet))
+                SetProcessWorkingSetSize(GetCurrentProcess(), minWorkingSet+arenaSizeBytes, maxWorkingSet+arenaSizeBytes);
+            arenaLocked = VirtualLock(arena, arenaSizeBytes) != 0;
+        }
+        return;
+    }
+    #else
+    #ifdef MAP_HUGETLB
+    if (allowLargePages)
+    {
+        #ifdef MAP_HUGE_1GB
+        if (arenaSizeBytes % (1024*1024*1024) == 0)
+        {
+            void* addr = mmap(nullptr, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_HUGE_1GB, -1, 0);
+            if (addr != MAP_FAILED)
+            {
+                arena = (uint8_t*)addr;
+                arenaBacking = SIGMA_ARENA_HUGE_PAGES_1GB;
+            }
+        }
+        #endif
+        if (!arena && arenaSizeBytes % (2*1024*1024) == 0)
         {
-            #ifdef COMPILER_HAS_CORTEX53_AES
-            SELECT_OPTIMISED_SHAVITE(arm_cortex_a53_aes, 4);
-            SELECT_OPTIMISED_ECHO(arm_cortex_a53_aes, 4);
-            SELECT_OPTIMISED_ARGON(arm_cortex_a53_aes, 4);
-            #endif
-            #ifdef COMPILER_HAS_CORTEX57_AES
-            SELECT_OPTIMISED_SHAVITE(arm_cortex_a57_aes, 5);
-            SELECT_OPTIMISED_ECHO(arm_cortex_a57_aes, 5);
-            SELECT_OPTIMISED_ARGON(arm_cortex_a57_aes, 5);
-            #endif
-            #ifdef COMPILER_HAS_CORTEX72_AES
-            SELECT_OPTIMISED_SHAVITE(arm_cortex_a72_aes, 6);
-            SELECT_OPTIMISED_ECHO(arm_cortex_a72_aes, 6);
-            SELECT_OPTIMISED_ARGON(arm_cortex_a72_aes, 6);
-            #endif
-            #ifdef COMPILER_HAS_THUNDERX_AES
-            SELECT_OPTIMISED_SHAVITE(arm_thunderx_aes, 7);
-            SELECT_OPTIMISED_ECHO(arm_thunderx_aes, 7);
-            SELECT_OPTIMISED_ARGON(arm_thunderx_aes, 7);
+            void* addr = mmap(nullptr, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+            if (addr != MAP_FAILED)
+            {
+                arena = (uint8_t*)addr;
+                arenaBacking = SIGMA_ARENA_HUGE_PAGES_2MB;
+            }
+        }
+    }
+    #endif
+    if (!arena)
+    {
+        void* addr = mmap(nullptr, arenaSizeBytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (addr != MAP_FAILED)
+        {
+            arena = (uint8_t*)addr;
+            arenaBacking = SIGMA_ARENA_NORMAL_PAGES;
+            #ifdef MADV_HUGEPAGE
+            if (allowLargePages && madvise(addr, arenaSizeBytes, MADV_HUGEPAGE) == 0)
+                arenaBacking = SIGMA_ARENA_TRANSPARENT_HUGE_PAGES;
             #endif
         }
     }
-    
-    // Finally (only after we have fastest echo implementation) give the hybrid echo a go
-    // Just in case it happens to be faster.
-    SELECT_OPTIMISED_ARGON(hybrid, 9999);
+    if (arena)
+    {
+        // Locking can fail (e.g. RLIMIT_MEMLOCK), in which case we carry on with an unlocked arena.
+        if (lockArena)
+            arenaLocked = mlock(arena, arenaSizeBytes) == 0;
+        return;
+    }
     #endif
-    
-logselection:
-    LogSelection(nSelShavite, "shavite");
-    LogSelection(nSelEcho, "echo");
-    LogSelection(nSelArgon, "argon");
+
+    arena = (uint8_t*)malloc(arenaSizeBytes);
+    arenaBacking = SIGMA_ARENA_HEAP;
 }
 
-void normaliseBufferSize(uint64_t& nBufferSizeBytes)
+#ifdef __linux__
+// Parse a sysfs cpu/node list of the form "0-3,8,10-11".
+static std::vector<int> parseSysfsList(const std::string& list)
 {
-    nBufferSizeBytes = (nBufferSizeBytes / (defaultSigmaSettings.argonMemoryCostKb*1024)) * (defaultSigmaSettings.argonMemoryCostKb*1024);
+    std::vector<int> ret;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        if (range.empty() || !isdigit(range[0]))
+            continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.substr(0, dash).c_str());
+        int last = (dash == std::string::npos) ? first : atoi(range.substr(dash+1).c_str());
+        for (int i=first; i<=last; ++i)
+            ret.push_back(i);
+    }
+    return ret;
 }
 
-sigma_settings::sigma_settings()
+static std::string readSysfsLine(const std::string& path)
 {
-    verify();
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
 }
 
-void sigma_settings::verify()
+// Value of a "<key>: <value> [kB]" line from /proc/meminfo or a per node meminfo (where lines are prefixed with "Node <n> "), 0 if absent.
+static uint64_t readMeminfoValue(const std::string& path, const std::string& key)
 {
-    assert(arenaSizeKb%argonMemoryCostKb==0);
-    assert(numHashesPre <= std::numeric_limits<uint16_t>::max()+1);
-    assert(numHashesPost <= std::numeric_limits<uint16_t>::max()+1);
-    arenaChunkSizeBytes = (arenaSizeKb*1024)/numHashesPost;
-    assert(fastHashSizeBytes<=arenaChunkSizeBytes);
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t pos = line.find(key + ":");
+        if (pos != std::string::npos && (pos == 0 || line[pos-1] == ' '))
+            return strtoull(line.c_str() + pos + key.size() + 1, nullptr, 10);
+    }
+    return 0;
 }
+#endif
 
+std::vector<sigma_numa_node> sigmaNumaNodes()
+{
+    std::vector<sigma_numa_node> nodes;
+    #ifdef __linux__
+    for (int nodeIndex : parseSysfsList(readSysfsLine("/sys/devices/system/node/online")))
+    {
+        sigma_numa_node node;
+        node.node = nodeIndex;
+        node.cpus = parseSysfsList(readSysfsLine(strprintf("/sys/devices/system/node/node%d/cpulist", nodeIndex)));
+        // Nodes have no MemAvailable, inactive page cache is the part of their file cache that the kernel will give up first.
+        std::string meminfoPath = strprintf("/sys/devices/system/node/node%d/meminfo", nodeIndex);
+        node.freeKb = readMeminfoValue(meminfoPath, "MemFree") + readMeminfoValue(meminfoPath, "Inactive(file)");
+        // Memory only nodes have no cpus to run our threads on.
+        if (!node.cpus.empty())
+            nodes.push_back(node);
+    }
+    #endif
+    return nodes;
+}
 
-sigma_context::sigma_context(sigma_settings settings_, uint64_t allocateArenaSizeKb_, uint64_t numThreads_)
-: numThreads(numThreads_)
-, allocatedArenaSizeKb(allocateArenaSizeKb_)
-, settings(settings_)
-{           
-    assert(allocatedArenaSizeKb <= settings.arenaSizeKb);
-    assert(allocatedArenaSizeKb%settings.argonMemoryCostKb==0);
-    
-    arena = (uint8_t*)malloc(allocatedArenaSizeKb*1024);
-    numHashesPossibleWithAvailableMemory = (allocatedArenaSizeKb*1024)/settings.arenaChunkSizeBytes;
+sigma_memory_info sigmaMemoryInfo()
+{
+    sigma_memory_info memory;
+    #if defined(WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+    {
+        memory.totalKb = status.ullTotalPhys/1024;
+        memory.availableKb = status.ullAvailPhys/1024;
+    }
+    #elif defined(__linux__)
+    memory.totalKb = readMeminfoValue("/proc/meminfo", "MemTotal");
+    memory.availableKb = readMeminfoValue("/proc/meminfo", "MemAvailable");
+    memory.hugePageSizeKb = readMeminfoValue("/proc/meminfo", "Hugepagesize");
+    memory.freeHugePagesKb = readMeminfoValue("/proc/meminfo", "HugePages_Free") * memory.hugePageSizeKb;
+    #elif defined(_SC_PHYS_PAGES)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && pageSize > 0)
+        memory.totalKb = ((uint64_t)pages * (uint64_t)pageSize)/1024;
+    #endif
+    return memory;
+}
+
+std::string sigma_arena_plan::ToString() const
+{
+    std::string contextsString;
+    for (const auto& context : contexts)
+    {
+        if (!contextsString.empty())
+            contextsString += ", ";
+        contextsString += strprintf("%d MB/%d threads", context.arenaSizeKb/1024, context.numThreads);
+        if (context.numaNode >= 0)
+            contextsString += strprintf("/node %d", context.numaNode);
+    }
+    return strprintf("requested %d MB, budget %d MB (limited by %s%s), planned %d MB in %d context(s) [%s], %d hashes per round",
+                     requestedKb/1024, budgetKb/1024, limitedBy, hugePages ? ", including huge pages" : "", plannedKb/1024, contexts.size(), contextsString, numHashes);
+}
+
+sigma_arena_plan sigmaPlanArenas(const sigma_settings& settings, uint64_t requestedKb, uint64_t numThreads, uint64_t numArenaSets, bool allowLargePages, const sigma_memory_info& memory, const std::vector<sigma_numa_node>& numaNodes)
+{
+    numThreads = std::max(numThreads, (uint64_t)1);
+    numArenaSets = std::max(numArenaSets, (uint64_t)1);
+
+    sigma_arena_plan plan;
+    plan.requestedKb = requestedKb;
+    plan.budgetKb = requestedKb;
+    plan.limitedBy = "request";
+    if (memory.totalKb > 0)
+    {
+        // Leave room for the OS and the node itself, and for the slow hash scratch memory that every worker allocates next to the arenas.
+        uint64_t reserveKb = std::max(memory.totalKb/16, (uint64_t)512*1024);
+        uint64_t scratchKb = numThreads*settings.argonMemoryCostKb*numArenaSets;
+        uint64_t ramKb = memory.availableKb > 0 ? memory.availableKb : memory.totalKb;
+        ramKb = (ramKb > reserveKb+scratchKb) ? ramKb-reserveKb-scratchKb : 0;
+        uint64_t hugePagesKb = allowLargePages ? memory.freeHugePagesKb : 0;
+        uint64_t machineBudgetKb = (ramKb+hugePagesKb)/numArenaSets;
+        plan.hugePages = hugePagesKb > 0;
+        if (machineBudgetKb < plan.budgetKb)
+        {
+            plan.budgetKb = machineBudgetKb;
+            plan.limitedBy = memory.availableKb > 0 ? "available_memory" : "total_memory";
+        }
+    }
+
+    // Without a NUMA layout to respect the whole machine is a single (unbound) node.
+    std::vector<sigma_numa_node> nodes = numaNodes;
+    if (nodes.empty())
+        nodes.emplace_back();
+    // Every context needs at least one thread so there can't be more nodes in use than threads.
+    if (nodes.size() > numThreads)
+        nodes.resize(numThreads);
+
+    // Memory and threads in proportion to the cpus of each node; memory a node can't hold moves to nodes that still have room.
+    uint64_t totalCpus = 0;
+    for (const auto& node : nodes)
+        totalCpus += std::max(node.cpus.size(), (size_t)1);
+    std::vector<uint64_t> nodeKb(nodes.size());
+    std::vector<uint64_t> nodeCapKb(nodes.size());
+    std::vector<uint64_t> nodeThreads(nodes.size());
+    uint64_t assignedKb = 0;
+    uint64_t assignedThreads = 0;
+    for (size_t i=0; i<nodes.size(); ++i)
+    {
+        uint64_t cpus = std::max(nodes[i].cpus.size(), (size_t)1);
+        nodeCapKb[i] = (nodes[i].freeKb > 0) ? nodes[i].freeKb/numArenaSets : std::numeric_limits<uint64_t>::max();
+        nodeKb[i] = std::min(plan.budgetKb*cpus/totalCpus, nodeCapKb[i]);
+        nodeThreads[i] = std::max(numThreads*cpus/totalCpus, (uint64_t)1);
+        assignedKb += nodeKb[i];
+        assignedThreads += nodeThreads[i];
+    }
+    for (size_t i=0; i<nodes.size() && assignedKb<plan.budgetKb; ++i)
+    {
+        uint64_t extraKb = std::min(plan.budgetKb-assignedKb, nodeCapKb[i]-nodeKb[i]);
+        nodeKb[i] += extraKb;
+        assignedKb += extraKb;
+    }
+    for (size_t i=0; assignedThreads<numThreads; i=(i+1)%nodes.size())
+    {
+        ++nodeThreads[i];
+        ++assignedThreads;
+    }
+    for (size_t i=nodes.size(); assignedThreads>numThreads && i-->0; )
+    {
+        while (nodeThreads[i] > 1 && assignedThreads>numThreads)
+        {
+            --nodeThreads[i];
+            --assignedThreads;
+        }
+    }
+
+    // Split each node's memory evenly over as few contexts as the maximum arena size allows.
+    for (size_t i=0; i<nodes.size(); ++i)
+    {
+        uint64_t numContexts = std::min((nodeKb[i]+settings.arenaSizeKb-1)/settings.arenaSizeKb, nodeThreads[i]);
+        if (numContexts == 0)
+            continue;
+        uint64_t contextKb = std::min(nodeKb[i]/numContexts, settings.arenaSizeKb);
+        contextKb = (contextKb/settings.argonMemoryCostKb)*settings.argonMemoryCostKb;
+        if (contextKb == 0)
+            continue;
+        for (uint64_t j=0; j<numContexts; ++j)
+        {
+            sigma_arena_plan_context context;
+            context.arenaSizeKb = contextKb;
+            context.numThreads = nodeThreads[i]/numContexts + ((j < nodeThreads[i]%numContexts) ? 1 : 0);
+            context.numaNode = nodes[i].node;
+            plan.contexts.push_back(context);
+            plan.plannedKb += contextKb;
+            plan.numHashes += (contextKb*1024)/settings.arenaChunkSizeBytes;
+        }
+    }
+    return plan;
+}
+
+bool sigma_context::bindToNumaNode(const sigma_numa_node& node)
+{
+    numaNode = node.node;
+    affinityCpus = node.cpus;
+    #ifdef __linux__
+    // Raw syscall so that we don't need libnuma; values from linux/mempolicy.h
+    const int SIGMA_MPOL_BIND = 2;
+    const unsigned int SIGMA_MPOL_MF_MOVE = (1<<1);
+    if (arena && arenaBacking != SIGMA_ARENA_HEAP && node.node >= 0)
+    {
+        const size_t bitsPerWord = sizeof(unsigned long)*8;
+        std::vector<unsigned long> nodeMask((node.node/bitsPerWord)+1, 0);
+        nodeMask[node.node/bitsPerWord] |= (1UL << (node.node%bitsPerWord));
+
+        // The scratch pool is a plain heap allocation, so only bind the whole pages inside it; best effort.
+        const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+        uintptr_t scratchBegin = ((uintptr_t)slowHashScratchPool.data() + pageSize - 1) & ~(pageSize - 1);
+        uintptr_t scratchEnd = ((uintptr_t)slowHashScratchPool.data() + slowHashScratchPool.size()) & ~(pageSize - 1);
+        if (scratchEnd > scratchBegin)
+        {
+            syscall(SYS_mbind, (void*)scratchBegin, scratchEnd - scratchBegin, SIGMA_MPOL_BIND, nodeMask.data(), nodeMask.size()*bitsPerWord+1, SIGMA_MPOL_MF_MOVE);
+        }
+        return syscall(SYS_mbind, arena, allocatedArenaSizeKb*1024, SIGMA_MPOL_BIND, nodeMask.data(), nodeMask.size()*bitsPerWord+1, SIGMA_MPOL_MF_MOVE) == 0;
+    }
+    #endif
+    return false;
+}
+
+void sigma_context::pinWorkerThread(uint64_t nThreadIndex)
+{
+    #ifdef __linux__
+    if (!affinityCpus.empty())
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(affinityCpus[nThreadIndex % affinityCpus.size()], &cpuset);
+        sched_setaffinity(0, sizeof(cpuset), &cpuset);
+        return;
+    }
+    #endif
+    #ifdef SIGMA_SET_THREAD_AFFINITY
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(nThreadIndex, &cpuset);
+    sched_setaffinity(0, sizeof(cpuset), &cpuset);
+    #endif
+}
+
+void sigma_context::freeArena()
+{
+    if (!arena)
+        return;
+    size_t arenaSizeBytes = allocatedArenaSizeKb*1024;
+    if (arenaBacking == SIGMA_ARENA_HEAP)
+    {
+        free(arena);
+    }
+    else
+    {
+        #ifdef WIN32
+        if (arenaLocked && arenaBacking != SIGMA_ARENA_LARGE_PAGES)
+            VirtualUnlock(arena, arenaSizeBytes);
+        VirtualFree(arena, 0, MEM_RELEASE);
+        #else
+        munmap(arena, arenaSizeBytes);
+        #endif
+    }
+    arena = nullptr;
 }
 
 bool sigma_context::arenaIsValid()
@@ -558,9 +1517,11 @@ bool sigma_context::arenaIsValid()
     return (arena != nullptr);
 }
 
-void sigma_context::prepareArenas(CBlockHeader& headerData)
+bool sigma_context::prepareArenas(CBlockHeader& headerData, uint64_t numPrepareThreads, std::atomic<bool>* interrupt)
 {
     uint32_t numHashes = allocatedArenaSizeKb/settings.argonMemoryCostKb;
+    if (numPrepareThreads == 0 || numPrepareThreads > numThreads)
+        numPrepareThreads = numThreads;
     
     // Set the nonce to something quasi random, thats difficult for an attacker to control.
     // It doesn't matter exactly what the value is they key thing is that it makes it harder for an attacker to manipulate the arena values, or re-use them across blocks, or to compute the argon hash faster.
@@ -569,20 +1530,17 @@ void sigma_context::prepareArenas(CBlockHeader& headerData)
     // This is a bit of a paranoid measure as realistically the argon hashes are of the block header which should always be different anyway.
     uint32_t nBaseNonce = headerData.nBits ^ (uint32_t)(headerData.hashPrevBlock.GetCheapHash());
     std::vector<std::thread> workerPool;
-    workerPool.reserve(numThreads);
-    for (uint32_t nThreadIndex=0; nThreadIndex<numThreads; ++nThreadIndex)
+    workerPool.reserve(numPrepareThreads);
+    for (uint32_t nThreadIndex=0; nThreadIndex<numPrepareThreads; ++nThreadIndex)
     {
         workerPool.emplace_back( [&,headerData, nThreadIndex]() mutable
         {
-            #ifdef SIGMA_SET_THREAD_AFFINITY
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
-            CPU_SET(nThreadIndex, &cpuset);
-            sched_setaffinity(0, sizeof(cpuset), &cpuset);
-            #endif
+            pinWorkerThread(nThreadIndex);
                 
-            for (;nThreadIndex<numHashes;nThreadIndex+=numThreads)
+            for (;nThreadIndex<numHashes;nThreadIndex+=numPrepareThreads)
             {
+                if (UNLIKELY(interrupt && *interrupt))
+                    return;
                 headerData.nNonce = nBaseNonce+nThreadIndex;
                 argon2_echo_context context;
                 context.t_cost = settings.argonArenaRoundCost;
@@ -600,14 +1558,13 @@ void sigma_context::prepareArenas(CBlockHeader& headerData)
         });
     }
     for (auto& thread : workerPool) { thread.join(); }
+    return !(interrupt && *interrupt);
 }
 
 void sigma_context::benchmarkSlowHashes(uint8_t* hashData, uint64_t numSlowHashes)
 {
-    uint8_t* hashMem = new uint8_t[settings.argonMemoryCostKb*1024];
+    uint8_t* hashMem = slowHashScratch(0);
     {
-        BOOST_SCOPE_EXIT(&hashMem) { delete[] hashMem; } BOOST_SCOPE_EXIT_END
-
         argon2_echo_context argonContext;
         argonContext.t_cost = settings.argonSlowHashRoundCost;
         argonContext.m_cost = settings.argonMemoryCostKb;
@@ -633,15 +1590,12 @@ void sigma_context::benchmarkSlowHashes(uint8_t* hashData, uint64_t numSlowHashe
 
 void sigma_context::benchmarkFastHashes(uint8_t* hashData1, uint8_t* hashData2, uint8_t* hashData3, uint64_t numFastHashes)
 {   
-    CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption prng;
-    prng.SetKey((const unsigned char*)&hashData2[0], 32);
-    unsigned char ciphered[32];
+    sigma_prng prng(&hashData2[0]);
 
     uint256 outHash;
     for (uint64_t i=0;i<numFastHashes;++i)
     {
-        prng.ProcessData((unsigned char*)&ciphered[0], (const unsigned char*)&hashData2[0], 32);
-        memcpy(&hashData2[0], &ciphered[0], (size_t)32);
+        prng.advance(&hashData2[0]);
                 
         hashData1[rand()%80] = rand();
         hashData1[rand()%80] = i;
@@ -673,9 +1627,102 @@ void sigma_context::benchmarkFastHashesRef(uint8_t* hashData1, uint8_t* hashData
 
 
 //fixme: (SIGMA) - dedup with benchmarkMining
-void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCounter, uint256& foundBlockHash, bool& interrupt)
+void sigma_throttle::setHashLimit(uint64_t halfHashesPerSec)
+{
+    hashLimitPerSec = halfHashesPerSec;
+    ++generation;
+}
+
+void sigma_throttle::setDutyCycle(uint64_t percent)
+{
+    dutyCyclePercent = std::min<uint64_t>(std::max<uint64_t>(percent, 1), 100);
+    ++generation;
+}
+
+void sigma_throttle::startRound(uint64_t numThreads)
+{
+    std::lock_guard<std::mutex> lock(roundMutex);
+    threads.reset(new thread_state[numThreads]);
+    numThreadStates = numThreads;
+}
+
+std::vector<sigma_throttle_thread_stats> sigma_throttle::threadStats() const
+{
+    std::lock_guard<std::mutex> lock(roundMutex);
+    std::vector<sigma_throttle_thread_stats> stats(numThreadStates);
+    for (uint64_t i=0; i<numThreadStates; ++i)
+    {
+        stats[i].halfHashes = threads[i].halfHashes;
+        stats[i].busyNanos = threads[i].busyNanos;
+        stats[i].throttledNanos = threads[i].throttledNanos;
+    }
+    return stats;
+}
+
+static int64_t throttleClockNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// How far a thread that fell behind its hash limit schedule (e.g. while busy with a slow hash) may then run ahead of it; more would come out as a burst.
+static const int64_t throttleMaxCatchUpNanos = 50 * 1000 * 1000;
+// Sleep at most this long at a time, so that an interrupt is noticed quickly.
+static const int64_t throttleSleepStepNanos = 10 * 1000 * 1000;
+
+void sigma_throttle::pace(uint64_t threadSlot, uint64_t halfHashes, const bool& interrupt)
+{
+    if (threadSlot >= numThreadStates)
+        return;
+    thread_state& state = threads[threadSlot];
+    int64_t nowNanos = throttleClockNanos();
+    state.halfHashes.fetch_add(halfHashes, std::memory_order_relaxed);
+    uint64_t currentGeneration = generation;
+    if (state.generationSeen != currentGeneration)
+    {
+        state.generationSeen = currentGeneration;
+        state.nextHashNanos = nowNanos;
+    }
+    // The first call of a round only starts the clock.
+    if (state.lastNanos == 0)
+    {
+        state.lastNanos = nowNanos;
+        return;
+    }
+    int64_t busyNanos = nowNanos - state.lastNanos;
+    state.busyNanos.fetch_add(busyNanos, std::memory_order_relaxed);
+
+    int64_t sleepUntilNanos = nowNanos;
+    if (uint64_t limit = hashLimitPerSec; limit > 0)
+    {
+        // Each thread gets an even share of the limit; every half hash moves its schedule on by the time one may take at that rate.
+        double nanosPerHalfHash = 1e9 * numThreadStates / limit;
+        state.nextHashNanos = std::max(state.nextHashNanos, nowNanos - throttleMaxCatchUpNanos) + (int64_t)(halfHashes * nanosPerHalfHash);
+        sleepUntilNanos = std::max(sleepUntilNanos, state.nextHashNanos);
+    }
+    if (uint64_t duty = dutyCyclePercent; duty < 100)
+    {
+        sleepUntilNanos = std::max(sleepUntilNanos, nowNanos + (int64_t)((busyNanos * (100 - duty)) / duty));
+    }
+
+    int64_t startNanos = nowNanos;
+    while (nowNanos < sleepUntilNanos && !interrupt)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(sleepUntilNanos - nowNanos, throttleSleepStepNanos)));
+        nowNanos = throttleClockNanos();
+    }
+    state.throttledNanos.fetch_add(nowNanos - startNanos, std::memory_order_relaxed);
+    state.lastNanos = nowNanos;
+}
+
+// Half hashes a throttled worker thread does between calls to sigma_throttle::pace.
+static const uint64_t throttlePaceInterval = 256;
+
+void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCounter, uint256& foundBlockHash, bool& interrupt, uint64_t nPreNonceStart, uint64_t nPreNonceCount, std::atomic<uint64_t>* preNoncesDone, sigma_throttle* throttle, uint64_t throttleSlotStart)
 {
     CBlockHeader headerData = pBlock->GetBlockHeader();
+    if (nPreNonceCount == 0 || nPreNonceStart + nPreNonceCount > settings.numHashesPre)
+        nPreNonceCount = settings.numHashesPre - std::min(nPreNonceStart, settings.numHashesPre);
+    uint64_t nPreNonceEnd = nPreNonceStart + nPreNonceCount;
     
     arith_uint256 hashTarget = arith_uint256().SetCompact(headerData.nBits);
     
@@ -688,18 +1735,9 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
         {
             workerPool.emplace_back( [&,headerData, nThreadIndex]() mutable
             {
-                #ifdef SIGMA_SET_THREAD_AFFINITY
-                cpu_set_t cpuset; 
-                CPU_ZERO(&cpuset);
-                CPU_SET(nThreadIndex, &cpuset);
-                sched_setaffinity(0, sizeof(cpuset), &cpuset);
-                #endif
+                pinWorkerThread(nThreadIndex);
                 
-                //fixme: (CBSU) - Theoretically we can reduce thread contention here if we allocate on the stack (VLA) instead of the heap...
-                uint8_t* hashMem = new uint8_t[settings.argonMemoryCostKb*1024];
-                //fixme: (SIGMA) - Return false and handle this in the external mining loop.
-                if (!hashMem)
-                    return;
+                uint8_t* hashMem = slowHashScratch(nThreadIndex);
                 
                 argon2_echo_context argonContext;
                 argonContext.t_cost = settings.argonSlowHashRoundCost;
@@ -708,16 +1746,53 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                 argonContext.pwdlen = 80;
                 argonContext.lanes = settings.numVerifyThreads;
                 argonContext.threads = 1;
+
+                uint64_t nUnpacedHalfHashes = 0;
+                auto paceThread = [&]()
+                {
+                    if (throttle)
+                    {
+                        throttle->pace(throttleSlotStart + nThreadIndex, nUnpacedHalfHashes, interrupt);
+                        nUnpacedHalfHashes = 0;
+                    }
+                };
+                paceThread();
+
+                sigma_fast_hash_queue fastHashQueue(settings.fastHashSizeBytes);
+                auto evaluateJob = [&](const sigma_fast_hash_job& job, uint256& fastHash) -> bool
+                {
+                    ++halfHashCounter;
+                    if (UNLIKELY(++nUnpacedHalfHashes == throttlePaceInterval))
+                        paceThread();
+
+                    // 4.3 Evaluate first hash (short circuit evaluation)
+                    if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                    {
+                        // 4.4 Calculate second hash
+                        sigmaRandomFastHash(job.nPseudoRandomAlg2, (uint8_t*)&job.header[0], 80, (uint8_t*)&job.prngState[0], 32, job.arenaChunk2, settings.fastHashSizeBytes, fastHash);
+
+                        // 4.5 See if we have a valid block
+                        if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                        {
+                            // Found a block, set it and exit.
+                            pBlock->nNonce = job.nNonce;
+                            foundBlockHash = fastHash;
+                            interrupt=true;
+                            return true;
+                        }
+                    }
+                    return false;
+                };
   
-                for (; nThreadIndex <= settings.numHashesPre;nThreadIndex+=numThreads)
+                // NB! The pre nonce is 16 bit, the loop counter must not be or the loop never terminates.
+                for (uint64_t nPreNonceIndex = nPreNonceStart + nThreadIndex; nPreNonceIndex < nPreNonceEnd; nPreNonceIndex += numThreads)
                 {
                     if (UNLIKELY(interrupt))
                     {
-                        delete[] hashMem;
                         return;
                     }
 
-                    uint16_t nPreNonce = nThreadIndex;
+                    uint16_t nPreNonce = nPreNonceIndex;
                     uint32_t nBaseNonce = headerData.nBits ^ (uint32_t)(headerData.hashPrevBlock.GetCheapHash());
 
                     // 1. Reset nonce to base nonce and select the pre nonce.
@@ -731,10 +1806,11 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                         argonContext.pwd = (uint8_t*)&headerData.nVersion;
                         if (selected_argon2_echo_hash(&argonContext, true) != ARGON2_OK)
                         {
-                            delete[] hashMem;
                             //fixme: (SIGMA) - Return false and handle this in the external mining loop.
                             return;
                         }
+                        // The slow hash counts towards the duty cycle as well.
+                        paceThread();
                         
                         // 3. Set the initial state of the seed for the 'pseudo random' nonces.
                         // PRNG notes:
@@ -748,9 +1824,7 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                         //
                         // We construct a simple PRNG by passing our seed data through AES in ECB mode and then repeatedly feeding it back in.
                         // This is possibly not the most high quality RNG ever; however should be perfect for our specific needs.
-                        CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption prng;
-                        prng.SetKey((const unsigned char*)&argonContext.outHash[0], 32);
-                        unsigned char ciphered[32];
+                        sigma_prng prng((const uint8_t*)&argonContext.outHash[0]);
                                         
                         // 4. Iterate through all 'post' nonce combinations, calculating 2 hashes from the global memory.
                         // The input of one is determined by the 'post' nonce, while the second is determined by the 'pseudo random' nonce, forcing random memory access.
@@ -759,13 +1833,11 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                         {
                             if (UNLIKELY(interrupt))
                             {
-                                delete[] hashMem;
                                 return;
                             }
 
                             // 4.1. For each iteration advance the state of the pseudo random nonce
-                            prng.ProcessData((unsigned char*)&ciphered[0], (const unsigned char*)&argonContext.outHash[0], 32);
-                            memcpy(&argonContext.outHash[0], &ciphered[0], (size_t)32);
+                            prng.advance((uint8_t*)&argonContext.outHash[0]);
 
                             uint64_t nPseudoRandomNonce1 = (argonContext.outHash[0] ^ argonContext.outHash[1]) % settings.numHashesPost;
                             uint64_t nPseudoRandomNonce2 = (argonContext.outHash[2] ^ argonContext.outHash[3]) % settings.numHashesPost;
@@ -778,27 +1850,18 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                                 uint64_t nFastHashOffset1 = (argonContext.outHash[0] ^ argonContext.outHash[2])%(settings.arenaChunkSizeBytes-settings.fastHashSizeBytes);
                                 uint64_t nFastHashOffset2 = (argonContext.outHash[1] ^ argonContext.outHash[3])%(settings.arenaChunkSizeBytes-settings.fastHashSizeBytes);
 
-                                // 4.2 Calculate first hash
-                                uint256 fastHash;
-                                sigmaRandomFastHash(nPseudoRandomAlg1, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)&argonContext.outHash, 32,  &arena[(nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+nFastHashOffset1], settings.fastHashSizeBytes, fastHash);
-                                ++halfHashCounter;
-                                
-                                // 4.3 Evaluate first hash (short circuit evaluation)
-                                if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                                // 4.2 Calculate first hash, possibly deferred so that it can be paired with another post nonce using the same algorithm (see sigma_fast_hash_queue)
+                                // Evaluation (4.3 onwards) takes place in evaluateJob
+                                sigma_fast_hash_job job;
+                                memcpy(&job.header[0], &headerData.nVersion, 80);
+                                job.prngState = argonContext.outHash;
+                                job.arenaChunk1 = &arena[(nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+nFastHashOffset1];
+                                job.arenaChunk2 = &arena[(nPseudoRandomNonce2*settings.arenaChunkSizeBytes)+nFastHashOffset2];
+                                job.nPseudoRandomAlg2 = nPseudoRandomAlg2;
+                                job.nNonce = headerData.nNonce;
+                                if (UNLIKELY(fastHashQueue.push(nPseudoRandomAlg1, job, evaluateJob)))
                                 {
-                                    // 4.4 Calculate second hash
-                                    sigmaRandomFastHash(nPseudoRandomAlg2, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)&argonContext.outHash, 32,  &arena[(nPseudoRandomNonce2*settings.arenaChunkSizeBytes)+nFastHashOffset2], settings.fastHashSizeBytes, fastHash);
-
-                                    // 4.5 See if we have a valid block
-                                    if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
-                                    {
-                                        // Found a block, set it and exit.
-                                        delete[] hashMem;
-                                        pBlock->nNonce = headerData.nNonce;
-                                        foundBlockHash = fastHash;
-                                        interrupt=true;
-                                        return;
-                                    }
+                                    return;
                                 }
                             }
                             if (UNLIKELY(headerData.nPostNonce == settings.numHashesPost-1))
@@ -807,9 +1870,14 @@ void sigma_context::mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCou
                             }
                             ++headerData.nPostNonce;
                         }
+                        if (UNLIKELY(fastHashQueue.flush(evaluateJob)))
+                        {
+                            return;
+                        }
+                        if (preNoncesDone)
+                            ++(*preNoncesDone);
                     }
                 }
-                delete[] hashMem;
             });
         }
     }
@@ -828,18 +1896,9 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
         {
             workerPool.emplace_back( [&,headerData, nThreadIndex]() mutable
             {
-                #ifdef SIGMA_SET_THREAD_AFFINITY
-                cpu_set_t cpuset; 
-                CPU_ZERO(&cpuset);
-                CPU_SET(nThreadIndex, &cpuset);
-                sched_setaffinity(0, sizeof(cpuset), &cpuset);
-                #endif
+                pinWorkerThread(nThreadIndex);
                 
-                //fixme: (CBSU) - Theoretically we can reduce thread contention here if we allocate on the stack (VLA) instead of the heap...
-                uint8_t* hashMem = new uint8_t[settings.argonMemoryCostKb*1024];
-                //fixme: (SIGMA) - Return false and handle this in the external mining loop.
-                if (!hashMem)
-                    return;
+                uint8_t* hashMem = slowHashScratch(nThreadIndex);
                 
                 argon2_echo_context argonContext;
                 argonContext.t_cost = settings.argonSlowHashRoundCost;
@@ -848,6 +1907,35 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                 argonContext.pwdlen = 80;
                 argonContext.lanes = settings.numVerifyThreads;
                 argonContext.threads = 1;
+
+                sigma_fast_hash_queue fastHashQueue(settings.fastHashSizeBytes);
+                auto evaluateJob = [&](const sigma_fast_hash_job& job, uint256& fastHash) -> bool
+                {
+                    ++halfHashCounter;
+
+                    // 4.3 Evaluate first hash (short circuit evaluation)
+                    if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                    {
+                        // 4.4 Calculate second hash
+                        sigmaRandomFastHash(job.nPseudoRandomAlg2, (uint8_t*)&job.header[0], 80, (uint8_t*)&job.prngState[0], 32, job.arenaChunk2, settings.fastHashSizeBytes, fastHash);
+                        ++hashCounter;
+
+                        // 4.5 See if we have a valid block
+                        if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                        {
+                            //#define LOG_VALID_BLOCK
+                            #ifdef LOG_VALID_BLOCK
+                            LogPrintf("Found block [%s]\n", HexStr(job.header.begin(), job.header.end()).c_str());
+                            #endif
+                            ++blockCounter;
+                        }
+                        if (UNLIKELY(hashCounter >= nRoundsTarget))
+                        {
+                            return true;
+                        }
+                    }
+                    return false;
+                };
   
                 for (; nThreadIndex <= settings.numHashesPre;nThreadIndex+=numThreads)
                 {
@@ -870,7 +1958,6 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                         
                         if (selected_argon2_echo_hash(&argonContext, true) != ARGON2_OK)
                         {
-                            delete[] hashMem;
                             assert(0);
                         }
                         
@@ -886,9 +1973,7 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                         //
                         // We construct a simple PRNG by passing our seed data through AES in ECB mode and then repeatedly feeding it back in.
                         // This is possibly not the most high quality RNG ever; however should be perfect for our specific needs.
-                        CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption prng;
-                        prng.SetKey((const unsigned char*)&argonContext.outHash[0], 32);
-                        unsigned char ciphered[32];
+                        sigma_prng prng((const uint8_t*)&argonContext.outHash[0]);
                                         
                         // 4. Iterate through all 'post' nonce combinations, calculating 2 hashes from the global memory.
                         // The input of one is determined by the 'post' nonce, while the second is determined by the 'pseudo random' nonce, forcing random memory access.
@@ -899,8 +1984,7 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                                 break;
                             
                             // 4.1. For each iteration advance the state of the pseudo random nonce
-                            prng.ProcessData((unsigned char*)&ciphered[0], (const unsigned char*)&argonContext.outHash[0], 32);
-                            memcpy(&argonContext.outHash[0], &ciphered[0], (size_t)32);
+                            prng.advance((uint8_t*)&argonContext.outHash[0]);
 
                             uint64_t nPseudoRandomNonce1 = (argonContext.outHash[0] ^ argonContext.outHash[1]) % settings.numHashesPost;
                             uint64_t nPseudoRandomNonce2 = (argonContext.outHash[2] ^ argonContext.outHash[3]) % settings.numHashesPost;
@@ -916,34 +2000,18 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                                 uint64_t nFastHashOffset1 = (argonContext.outHash[0] ^ argonContext.outHash[2])%(settings.arenaChunkSizeBytes-settings.fastHashSizeBytes);
                                 uint64_t nFastHashOffset2 = (argonContext.outHash[1] ^ argonContext.outHash[3])%(settings.arenaChunkSizeBytes-settings.fastHashSizeBytes);
 
-                                // 4.2 Calculate first hash
-                                uint256 fastHash;
-                                sigmaRandomFastHash(nPseudoRandomAlg1, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)&argonContext.outHash, 32,  &arena[(nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+nFastHashOffset1], settings.fastHashSizeBytes, fastHash);
-                                ++halfHashCounter;
-                                
-                                // 4.3 Evaluate first hash (short circuit evaluation)
-                                if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
+                                // 4.2 Calculate first hash (see mineBlock)
+                                sigma_fast_hash_job job;
+                                memcpy(&job.header[0], &headerData.nVersion, 80);
+                                job.prngState = argonContext.outHash;
+                                job.arenaChunk1 = &arena[(nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+nFastHashOffset1];
+                                job.arenaChunk2 = &arena[(nPseudoRandomNonce2*settings.arenaChunkSizeBytes)+nFastHashOffset2];
+                                job.nPseudoRandomAlg2 = nPseudoRandomAlg2;
+                                job.nNonce = headerData.nNonce;
+                                if (UNLIKELY(fastHashQueue.push(nPseudoRandomAlg1, job, evaluateJob)))
                                 {
-                                    // 4.4 Calculate second hash
-                                    sigmaRandomFastHash(nPseudoRandomAlg2, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)&argonContext.outHash, 32,  &arena[(nPseudoRandomNonce2*settings.arenaChunkSizeBytes)+nFastHashOffset2], settings.fastHashSizeBytes, fastHash);
-                                    ++hashCounter;
-
-                                    // 4.5 See if we have a valid block
-                                    if (UNLIKELY(UintToArith256(fastHash) <= hashTarget))
-                                    {
-                                        //#define LOG_VALID_BLOCK
-                                        #ifdef LOG_VALID_BLOCK
-                                        LogPrintf("Found block [%s]\n", HexStr((uint8_t*)&headerData.nVersion, (uint8_t*)&headerData.nVersion+80).c_str());
-                                        LogPrintf("pseudorandomnonce1[%d] pseudorandomalg1[%d] fasthashoffset1[%d] arenaoffset1[%d]\n", nPseudoRandomNonce1, nPseudoRandomAlg1, nFastHashOffset1, (nPseudoRandomNonce1*settings.arenaChunkSizeBytes)+nFastHashOffset1);
-                                        LogPrintf("pseudorandomnonce2[%d] pseudorandomalg2[%d] fasthashoffset2[%d] arenaoffset2[%d]\n", nPseudoRandomNonce2, nPseudoRandomAlg2, nFastHashOffset2, (nPseudoRandomNonce2*settings.arenaChunkSizeBytes)+nFastHashOffset2);
-                                        LogPrintf("base [%d] pre [%d] post [%d] nversion [%d] nbits [%d] ntime [%d]\n", nBaseNonce, headerData.nPreNonce, headerData.nPostNonce, headerData.nVersion, headerData.nBits, headerData.nTime);
-                                        #endif
-                                        ++blockCounter;
-                                    }
-                                    if (UNLIKELY(hashCounter >= nRoundsTarget))
-                                    {
-                                        break;
-                                    }
+                                    fastHashQueue.clear();
+                                    break;
                                 }
                             }
                             if (UNLIKELY(headerData.nPostNonce == settings.numHashesPost-1))
@@ -952,9 +2020,9 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
                             }
                             ++headerData.nPostNonce;
                         }
+                        fastHashQueue.flush(evaluateJob);
                     }
                 }
-                delete[] hashMem;
             });
         }
     }
@@ -962,13 +2030,120 @@ void sigma_context::benchmarkMining(CBlockHeader& headerData, std::atomic<uint64
 
 sigma_context::~sigma_context()
 {
-    free(arena);
+    freeArena();
+}
+
+
+sigma_verify_cache::sigma_verify_cache(uint64_t maxChunkBytes_, uint64_t maxSlowHashes_)
+: maxChunkBytes(maxChunkBytes_)
+, maxSlowHashes(maxSlowHashes_)
+{
+}
+
+uint256 sigma_verify_cache::key(const uint8_t* input, uint64_t inputLen, uint64_t t_cost, uint64_t m_cost, uint64_t lanes)
+{
+    uint64_t costs[3] = {t_cost, m_cost, lanes};
+    uint256 result;
+    CSHA256().Write(input, inputLen).Write((const uint8_t*)&costs[0], sizeof(costs)).Finalize(result.begin());
+    return result;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> sigma_verify_cache::getChunk(const uint256& chunkKey)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = chunkIndex.find(chunkKey);
+    if (iter == chunkIndex.end())
+    {
+        ++chunkMisses;
+        return nullptr;
+    }
+    ++chunkHits;
+    chunks.splice(chunks.begin(), chunks, iter->second);
+    return iter->second->second;
+}
+
+void sigma_verify_cache::putChunk(const uint256& chunkKey, const uint8_t* chunk, uint64_t chunkLen)
+{
+    if (chunkLen > maxChunkBytes)
+        return;
+    // Copy outside the lock, this is the expensive part.
+    auto entry = std::make_shared<const std::vector<uint8_t>>(chunk, chunk+chunkLen);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Another context may have generated the same chunk in the meantime.
+    if (chunkIndex.find(chunkKey) != chunkIndex.end())
+        return;
+    while (!chunks.empty() && chunkBytes + chunkLen > maxChunkBytes)
+    {
+        chunkBytes -= chunks.back().second->size();
+        chunkIndex.erase(chunks.back().first);
+        chunks.pop_back();
+    }
+    chunks.emplace_front(chunkKey, std::move(entry));
+    chunkIndex[chunkKey] = chunks.begin();
+    chunkBytes += chunkLen;
+}
+
+bool sigma_verify_cache::getSlowHash(const uint256& slowHashKey, std::array<uint64_t, 4>& slowHash)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = slowHashIndex.find(slowHashKey);
+    if (iter == slowHashIndex.end())
+    {
+        ++slowHashMisses;
+        return false;
+    }
+    ++slowHashHits;
+    slowHashes.splice(slowHashes.begin(), slowHashes, iter->second);
+    slowHash = iter->second->second;
+    return true;
+}
+
+void sigma_verify_cache::putSlowHash(const uint256& slowHashKey, const std::array<uint64_t, 4>& slowHash)
+{
+    if (maxSlowHashes == 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slowHashIndex.find(slowHashKey) != slowHashIndex.end())
+        return;
+    while (slowHashes.size() >= maxSlowHashes)
+    {
+        slowHashIndex.erase(slowHashes.back().first);
+        slowHashes.pop_back();
+    }
+    slowHashes.emplace_front(slowHashKey, slowHash);
+    slowHashIndex[slowHashKey] = slowHashes.begin();
+}
+
+void sigma_verify_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    chunks.clear();
+    chunkIndex.clear();
+    chunkBytes = 0;
+    slowHashes.clear();
+    slowHashIndex.clear();
+}
+
+sigma_verify_cache_stats sigma_verify_cache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sigma_verify_cache_stats stats;
+    stats.chunkEntries = chunks.size();
+    stats.chunkBytes = chunkBytes;
+    stats.chunkHits = chunkHits;
+    stats.chunkMisses = chunkMisses;
+    stats.slowHashEntries = slowHashes.size();
+    stats.slowHashHits = slowHashHits;
+    stats.slowHashMisses = slowHashMisses;
+    return stats;
 }
 
 
-sigma_verify_context::sigma_verify_context(sigma_settings settings_, uint64_t numUserVerifyThreads_)
+sigma_verify_context::sigma_verify_context(sigma_settings settings_, uint64_t numUserVerifyThreads_, sigma_verify_cache* cache_)
 : settings(settings_)
 , numUserVerifyThreads(numUserVerifyThreads_)
+, cache(cache_)
 {           
     assert(numUserVerifyThreads <= settings.numVerifyThreads);
     hashMem = new uint8_t[settings.argonMemoryCostKb*1024];
@@ -979,8 +2154,11 @@ sigma_verify_context::sigma_verify_context(sigma_settings settings_, uint64_t nu
 
 template<int verifyLevel> bool sigma_verify_context::verifyHeader(CBlockHeader headerData)
 {
-    arith_uint256 hashTarget = arith_uint256().SetCompact(headerData.nBits);
-    
+    return verifyHeaderAgainstTarget<verifyLevel>(headerData, arith_uint256().SetCompact(headerData.nBits));
+}
+
+template<int verifyLevel> bool sigma_verify_context::verifyHeaderAgainstTarget(CBlockHeader headerData, const arith_uint256& hashTarget, uint256* pFastHash)
+{
     uint32_t nBaseNonce = headerData.nBits ^ (uint32_t)(headerData.hashPrevBlock.GetCheapHash());
     uint64_t nPostNonce = headerData.nPostNonce;
     uint64_t nPreNonce = headerData.nPreNonce;
@@ -1002,22 +2180,27 @@ template<int verifyLevel> bool sigma_verify_context::verifyHeader(CBlockHeader h
     argonContext.lanes = settings.numVerifyThreads;
     argonContext.threads = numUserVerifyThreads;
 
-    if (selected_argon2_echo_hash(&argonContext, true) != ARGON2_OK)
-        assert(0);
+    uint256 slowHashKey;
+    bool haveSlowHash = false;
+    if (cache)
+    {
+        slowHashKey = sigma_verify_cache::key(argonContext.pwd, argonContext.pwdlen, argonContext.t_cost, argonContext.m_cost, argonContext.lanes);
+        haveSlowHash = cache->getSlowHash(slowHashKey, argonContext.outHash);
+    }
+    if (!haveSlowHash)
+    {
+        if (selected_argon2_echo_hash(&argonContext, true) != ARGON2_OK)
+            assert(0);
+        if (cache)
+            cache->putSlowHash(slowHashKey, argonContext.outHash);
+    }
 
     // 3. Set the initial state of the seed for the 'pseudo random' nonces.
-    CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption prng;
-    prng.SetKey((const unsigned char*)&argonContext.outHash[0], 32);
-    unsigned char ciphered[32];
+    sigma_prng prng((const uint8_t*)&argonContext.outHash[0]);
                             
     // 4. Advance PRNG to 'post' nonce
-    headerData.nPostNonce=0;
-    for (uint64_t i=0; i<=nPostNonce; ++i)
-    {               
-        prng.ProcessData((unsigned char*)&ciphered[0], (const unsigned char*)&argonContext.outHash[0], 32);
-        memcpy(&argonContext.outHash[0], &ciphered[0], (size_t)32);
-        ++headerData.nPostNonce;
-    }
+    prng.advance((uint8_t*)&argonContext.outHash[0], (uint64_t)nPostNonce+1);
+    headerData.nPostNonce = nPostNonce+1;
     
     [[maybe_unused]] uint64_t nPseudoRandomNonce1 = (argonContext.outHash[0] ^ argonContext.outHash[1]) % settings.numHashesPost;
     [[maybe_unused]] uint64_t nPseudoRandomNonce2 = (argonContext.outHash[2] ^ argonContext.outHash[3]) % settings.numHashesPost;
@@ -1036,6 +2219,26 @@ template<int verifyLevel> bool sigma_verify_context::verifyHeader(CBlockHeader h
     {
         uint256 fastHash;
         argonContext.t_cost = settings.argonArenaRoundCost;    
+
+        // Generate (or fetch from the cache) the arena chunk for nNonce, the header must already have nNonce set.
+        // The returned memory is valid until the next call; it is only ever read (the fast hash interfaces just aren't const correct).
+        std::shared_ptr<const std::vector<uint8_t>> cachedChunk;
+        auto arenaChunk = [&]() -> uint8_t*
+        {
+            uint256 chunkKey;
+            if (cache)
+            {
+                chunkKey = sigma_verify_cache::key(argonContext.pwd, argonContext.pwdlen, argonContext.t_cost, argonContext.m_cost, argonContext.lanes);
+                cachedChunk = cache->getChunk(chunkKey);
+                if (cachedChunk)
+                    return const_cast<uint8_t*>(cachedChunk->data());
+            }
+            if (selected_argon2_echo_hash(&argonContext, false) != ARGON2_OK)
+                assert(0);
+            if (cache)
+                cache->putChunk(chunkKey, argonContext.allocated_memory, settings.argonMemoryCostKb*1024);
+            return argonContext.allocated_memory;
+        };
         
         // For each fast hash, set the pre and post nonce to the final values the miner claims he was using
         // Then calculate the fast hash and compare against the hash target to see if it meets it or not
@@ -1047,11 +2250,12 @@ template<int verifyLevel> bool sigma_verify_context::verifyHeader(CBlockHeader h
         if constexpr (verifyLevel == 0 || verifyLevel == 1)
         {
             headerData.nNonce = nBaseNonce+nArenaMemoryIndex1;
-            if (selected_argon2_echo_hash(&argonContext, false) != ARGON2_OK)
-                assert(0);        
+            uint8_t* chunk = arenaChunk();
             headerData.nPreNonce = nPreNonce;
             headerData.nPostNonce = nPostNonce;
-            sigmaRandomFastHash(nPseudoRandomAlg1, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)slowHash.begin(), 32,  &argonContext.allocated_memory[nArenaMemoryOffset1+nFastHashOffset1], settings.fastHashSizeBytes, fastHash);
+            sigmaRandomFastHash(nPseudoRandomAlg1, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)slowHash.begin(), 32,  &chunk[nArenaMemoryOffset1+nFastHashOffset1], settings.fastHashSizeBytes, fastHash);
+            if (pFastHash)
+                *pFastHash = fastHash;
             if (UintToArith256(fastHash) > hashTarget)
             {
                 return false;
@@ -1062,11 +2266,12 @@ template<int verifyLevel> bool sigma_verify_context::verifyHeader(CBlockHeader h
         if constexpr (verifyLevel == 0 || verifyLevel == 2)
         {
             headerData.nNonce = nBaseNonce+nArenaMemoryIndex2;
-            if (selected_argon2_echo_hash(&argonContext, false) != ARGON2_OK)
-                assert(0);
+            uint8_t* chunk = arenaChunk();
             headerData.nPreNonce = nPreNonce;
             headerData.nPostNonce = nPostNonce;
-            sigmaRandomFastHash(nPseudoRandomAlg2, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)slowHash.begin(), 32,  &argonContext.allocated_memory[nArenaMemoryOffset2+nFastHashOffset2], settings.fastHashSizeBytes, fastHash);
+            sigmaRandomFastHash(nPseudoRandomAlg2, (uint8_t*)&headerData.nVersion, 80, (uint8_t*)slowHash.begin(), 32,  &chunk[nArenaMemoryOffset2+nFastHashOffset2], settings.fastHashSizeBytes, fastHash);
+            if (pFastHash)
+                *pFastHash = fastHash;
             if (UintToArith256(fastHash) > hashTarget)
             {
                 return false;
@@ -1081,6 +2286,9 @@ template<int verifyLevel> bool sigma_verify_context::verifyHeader(CBlockHeader h
 template bool sigma_verify_context::verifyHeader<0>(CBlockHeader);
 template bool sigma_verify_context::verifyHeader<1>(CBlockHeader);
 template bool sigma_verify_context::verifyHeader<2>(CBlockHeader);
+template bool sigma_verify_context::verifyHeaderAgainstTarget<0>(CBlockHeader, const arith_uint256&, uint256*);
+template bool sigma_verify_context::verifyHeaderAgainstTarget<1>(CBlockHeader, const arith_uint256&, uint256*);
+template bool sigma_verify_context::verifyHeaderAgainstTarget<2>(CBlockHeader, const arith_uint256&, uint256*);
 
 sigma_verify_context::~sigma_verify_context()
 {
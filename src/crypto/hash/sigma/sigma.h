@@ -7,13 +7,26 @@
 #define GULDEN_SIGMA_HASH_H
 
 #include <stdint.h>
+#include <atomic>
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
 #include <primitives/block.h>
 
 #include <crypto/hash/sigma/argon_echo/argon_echo.h>
 #include <crypto/hash/sigma/echo256/sphlib/sph_echo.h>
 #include <crypto/hash/sigma/echo256/echo256_opt.h>
+#include <crypto/hash/sigma/echo256/echo256_opt_x2.h>
+#include <crypto/hash/sigma/echo256/echo256_opt_x4.h>
 #include <crypto/hash/sigma/shavite3_256/shavite3_256_opt.h>
+#include <crypto/hash/sigma/shavite3_256/shavite3_256_opt_x2.h>
+#include <crypto/hash/sigma/shavite3_256/shavite3_256_opt_x4.h>
 #include <crypto/hash/sigma/shavite3_256/ref/shavite3_ref.h>
+#include <crypto/hash/sigma/aes_prng/aes_prng.h>
 
 //  SIGMA hash
 // *S*emi
@@ -97,8 +110,48 @@ public:
 extern sigma_settings defaultSigmaSettings;
 
 
+// How selectOptimisedImplementations picks the implementations on x86; elsewhere it always times them.
+enum sigma_kernel_selection
+{
+    SIGMA_SELECT_BY_FEATURES,   // The widest implementation the CPU feature flags allow
+    SIGMA_SELECT_CACHED,        // The ones in the choice passed in, as picked by an earlier benchmark on this CPU (by features where the choice doesn't fit)
+    SIGMA_SELECT_BENCHMARK      // Time every implementation the CPU supports and take the fastest of each
+};
+
+// What selectOptimisedImplementations picked, in a form that can be stored and handed back to it on a later start.
+struct sigma_kernel_choice
+{
+    uint64_t shavite=0;
+    uint64_t echo=0;
+    uint64_t argon=0;
+    // Whether the multi way kernels may be used where there are any for the single way kernels picked.
+    bool shaviteX2=true;
+    bool echoX2=true;
+    bool shaviteX4=true;
+    bool echoX4=true;
+};
+
 // We select the optimal implementation of these hash functions to match our CPU once at program start and then just use the function pointers throghout the SIGMA code.
 void selectOptimisedImplementations();
+// As above, choice is the input for SIGMA_SELECT_CACHED and always receives what was picked.
+// Selecting by benchmark takes a fraction of a second; some CPUs run slower on their widest instructions (e.g. AVX-512 frequency drops) so what their feature flags allow isn't always fastest.
+void selectOptimisedImplementations(sigma_kernel_selection selection, sigma_kernel_choice& choice);
+
+// Human readable names of the implementations picked by selectOptimisedImplementations (for logs, benchmarks and diagnostics).
+struct sigma_selected_implementations
+{
+    std::string shavite = "none";
+    std::string echo = "none";
+    std::string argon = "none";
+    std::string prng = "none";
+    std::string shaviteX2 = "none";
+    std::string echoX2 = "none";
+    std::string shaviteX4 = "none";
+    std::string echoX4 = "none";
+    // How they were picked: "features", "cached", "benchmark" or "forced" (-sigmaalgo).
+    std::string selection = "none";
+};
+inline sigma_selected_implementations selectedSigmaImplementations;
 inline HashReturn (*selected_echo256_opt_Init)(echo256_opt_hashState* state) = nullptr;
 inline HashReturn (*selected_echo256_opt_Update)(echo256_opt_hashState* state, const unsigned char* data, uint64_t databitlen) = nullptr;
 inline HashReturn (*selected_echo256_opt_Final)(echo256_opt_hashState* state, unsigned char* hashval) = nullptr;
@@ -107,22 +160,162 @@ inline bool (*selected_shavite3_256_opt_Init)(shavite3_256_opt_hashState* state)
 inline bool (*selected_shavite3_256_opt_Update)(shavite3_256_opt_hashState* state, const unsigned char* data, uint64_t dataLenBytes) = nullptr;
 inline bool (*selected_shavite3_256_opt_Final)(shavite3_256_opt_hashState* state, unsigned char* hashval) = nullptr;
 inline int (*selected_argon2_echo_hash)(argon2_echo_context* context, bool doHash) = nullptr;
+// Two way kernels that hash a pair of equal length inputs in a single pass, nullptr if the CPU has no VAES (in which case mining hashes one input at a time).
+inline HashReturn (*selected_echo256_opt_x2_Init)(echo256_opt_x2_hashState* state) = nullptr;
+inline HashReturn (*selected_echo256_opt_x2_Update)(echo256_opt_x2_hashState* state, const unsigned char* data_a, const unsigned char* data_b, uint64_t dataByteLength) = nullptr;
+inline HashReturn (*selected_echo256_opt_x2_Final)(echo256_opt_x2_hashState* state, unsigned char* hashval_a, unsigned char* hashval_b) = nullptr;
+inline bool (*selected_shavite3_256_opt_x2_Init)(shavite3_256_opt_x2_hashState* state) = nullptr;
+inline bool (*selected_shavite3_256_opt_x2_Update)(shavite3_256_opt_x2_hashState* state, const unsigned char* data_a, const unsigned char* data_b, uint64_t dataLenBytes) = nullptr;
+inline bool (*selected_shavite3_256_opt_x2_Final)(shavite3_256_opt_x2_hashState* state, unsigned char* hashval_a, unsigned char* hashval_b) = nullptr;
+// Four way kernels, nullptr if the CPU lacks AVX-512BW or VAES (in which case mining falls back to the two way kernels).
+inline HashReturn (*selected_echo256_opt_x4_Init)(echo256_opt_x4_hashState* state) = nullptr;
+inline HashReturn (*selected_echo256_opt_x4_Update)(echo256_opt_x4_hashState* state, const unsigned char* const data[4], uint64_t dataByteLength) = nullptr;
+inline HashReturn (*selected_echo256_opt_x4_Final)(echo256_opt_x4_hashState* state, unsigned char* const hashval[4]) = nullptr;
+inline bool (*selected_shavite3_256_opt_x4_Init)(shavite3_256_opt_x4_hashState* state) = nullptr;
+inline bool (*selected_shavite3_256_opt_x4_Update)(shavite3_256_opt_x4_hashState* state, const unsigned char* const data[4], uint64_t dataLenBytes) = nullptr;
+inline bool (*selected_shavite3_256_opt_x4_Final)(shavite3_256_opt_x4_hashState* state, unsigned char* const hashval[4]) = nullptr;
+// Hardware AES kernel for the PRNG, nullptr if the CPU has no hardware AES (in which case CryptoPP is used).
+inline void (*selected_aes256_prng_advance)(const uint8_t* roundKeys, uint8_t* state, uint64_t numSteps) = nullptr;
 
 void normaliseBufferSize(uint64_t& nBufferSizeBytes);
 
+// What ended up backing a sigma_context arena, in order of preference from worst to best.
+// Mining reads each fast hash from a random arena offset, so on multi-gigabyte arenas the TLB miss rate is a large part of the cost and large pages help noticeably.
+enum sigma_arena_backing : uint8_t
+{
+    SIGMA_ARENA_HEAP,                   // Plain heap allocation (fallback)
+    SIGMA_ARENA_NORMAL_PAGES,           // Anonymous mapping, kernel declined transparent huge pages
+    SIGMA_ARENA_TRANSPARENT_HUGE_PAGES, // Anonymous mapping with madvise(MADV_HUGEPAGE)
+    SIGMA_ARENA_HUGE_PAGES_2MB,         // Explicit 2 MB pages (MAP_HUGETLB)
+    SIGMA_ARENA_HUGE_PAGES_1GB,         // Explicit 1 GB pages (MAP_HUGETLB|MAP_HUGE_1GB)
+    SIGMA_ARENA_LARGE_PAGES             // Windows large pages (MEM_LARGE_PAGES)
+};
+std::string sigmaArenaBackingName(sigma_arena_backing backing);
+
+// A NUMA node and the logical cpus that belong to it.
+struct sigma_numa_node
+{
+    int node=-1;
+    std::vector<int> cpus;
+    // Free (or cheaply reclaimable) memory on the node, 0 if unknown.
+    uint64_t freeKb=0;
+};
+// The NUMA nodes of this machine (Linux only, empty where the topology cannot be determined).
+std::vector<sigma_numa_node> sigmaNumaNodes();
+
+// Memory of this machine as far as it matters for sizing mining arenas, fields are 0 where they cannot be determined.
+struct sigma_memory_info
+{
+    uint64_t totalKb=0;
+    // What can be allocated without pushing this or other processes into swap.
+    uint64_t availableKb=0;
+    // The explicit huge page pool is reserved up front, so it is not part of availableKb.
+    uint64_t hugePageSizeKb=0;
+    uint64_t freeHugePagesKb=0;
+};
+sigma_memory_info sigmaMemoryInfo();
+
+struct sigma_arena_plan_context
+{
+    uint64_t arenaSizeKb=0;
+    uint64_t numThreads=0;
+    int numaNode=-1;
+};
+
+// How the miner should lay out its arenas (see sigmaPlanArenas).
+struct sigma_arena_plan
+{
+    uint64_t requestedKb=0;
+    // Memory the plan is allowed to use per arena set after accounting for the machine (and the per thread slow hash scratch memory).
+    uint64_t budgetKb=0;
+    uint64_t plannedKb=0;
+    // Sum of numHashesPossibleWithAvailableMemory over all planned contexts.
+    uint64_t numHashes=0;
+    // Whether the budget includes the free explicit huge page pool.
+    bool hugePages=false;
+    // What bounded the plan: "request", "available_memory" or "total_memory".
+    std::string limitedBy;
+    std::vector<sigma_arena_plan_context> contexts;
+    std::string ToString() const;
+};
+
+// Plan the contexts for mining with requestedKb of arena memory and numThreads threads.
+// numArenaSets is 2 when a standby set of arenas is kept (-genarenadoublebuffer), both sets get the same plan.
+// Memory is capped to what the machine can hold without swapping, as thrashing arenas are far slower than smaller ones.
+// Memory is split evenly over as few contexts as possible so that arena preparation finishes at the same time for all of them.
+// If numaNodes is non empty every node gets its own contexts, sized to the node's free memory, with threads in proportion to its cpus.
+sigma_arena_plan sigmaPlanArenas(const sigma_settings& settings, uint64_t requestedKb, uint64_t numThreads, uint64_t numArenaSets, bool allowLargePages, const sigma_memory_info& memory, const std::vector<sigma_numa_node>& numaNodes);
+
+struct sigma_throttle_thread_stats
+{
+    uint64_t halfHashes=0;
+    uint64_t busyNanos=0;
+    uint64_t throttledNanos=0;
+};
+
+// Paces the worker threads of mineBlock so that mining can be confined to the spare cycles of a machine that is busy with other work.
+// Two limits, either or both of which can be set (and changed while mining): the combined half hashes per second of all threads of the round, split evenly between them,
+// and the duty cycle, the percentage of wall clock time each thread spends hashing rather than sleeping.
+// Every thread keeps its own schedule and only sleeps a little at a time, so pacing is smooth instead of bursts of hashing followed by long pauses.
+class sigma_throttle
+{
+public:
+    // 0 removes the limit.
+    void setHashLimit(uint64_t halfHashesPerSec);
+    // 100 (or more) removes the limit, 0 is treated as 1.
+    void setDutyCycle(uint64_t percent);
+    uint64_t hashLimit() const { return hashLimitPerSec; }
+    uint64_t dutyCycle() const { return dutyCyclePercent; }
+    // Start a mining round with numThreads workers, resetting the per thread statistics; must not be called while threads of the previous round are still in pace.
+    void startRound(uint64_t numThreads);
+    // Called by worker threadSlot (in [0, numThreads) of the round) with the half hashes it did since its previous call; sleeps for as long as the limits require or until interrupt is set.
+    void pace(uint64_t threadSlot, uint64_t halfHashes, const bool& interrupt);
+    std::vector<sigma_throttle_thread_stats> threadStats() const;
+private:
+    struct alignas(64) thread_state
+    {
+        std::atomic<uint64_t> halfHashes{0};
+        std::atomic<uint64_t> busyNanos{0};
+        std::atomic<uint64_t> throttledNanos{0};
+        // Only touched by the thread itself.
+        uint64_t generationSeen=0;
+        int64_t lastNanos=0;
+        int64_t nextHashNanos=0;
+    };
+    std::atomic<uint64_t> hashLimitPerSec{0};
+    std::atomic<uint64_t> dutyCyclePercent{100};
+    // Bumped whenever a limit changes, so that threads start their schedule afresh instead of making up for the past.
+    std::atomic<uint64_t> generation{1};
+    // Guards threads and numThreadStates against startRound while the statistics are read.
+    mutable std::mutex roundMutex;
+    std::unique_ptr<thread_state[]> threads;
+    uint64_t numThreadStates=0;
+};
+
 // Heavy weight sigma context for mining - allocated the entire arena (currently 4gb)
 // NB!!! Take care creating/using these they allocate lots of memory..
 class sigma_context
 {
 public:
-    sigma_context(sigma_settings settings_, uint64_t allocateArenaSizeKb_, uint64_t numThreads_);
+    // If allowLargePages_ is set the arena is backed by huge/large pages where the OS permits, falling back to normal pages otherwise.
+    // If lockArena_ is set the arena is additionally locked into physical memory (mlock/VirtualLock), this is best effort and arenaLocked reports the outcome.
+    sigma_context(sigma_settings settings_, uint64_t allocateArenaSizeKb_, uint64_t numThreads_, bool allowLargePages_=true, bool lockArena_=false);
     bool arenaIsValid();
-    void prepareArenas(CBlockHeader& headerData);
+    // Fill the arena for headerData, optionally with fewer threads than the context mines with (0 = numThreads) so that arenas can be prepared in the background while another context is mining.
+    // Returns false if interrupted before the arena was fully populated.
+    bool prepareArenas(CBlockHeader& headerData, uint64_t numPrepareThreads=0, std::atomic<bool>* interrupt=nullptr);
     void benchmarkSlowHashes(uint8_t* hashData, uint64_t numSlowHashes);
     void benchmarkFastHashes(uint8_t* hashData1, uint8_t* hashData2, uint8_t* hashData3, uint64_t numFastHashes);
     void benchmarkFastHashesRef(uint8_t* hashData1, uint8_t* hashData2, uint8_t* hashData3, uint64_t numFastHashes);
     void benchmarkMining(CBlockHeader& headerData, std::atomic<uint64_t>& slowHashCounter, std::atomic<uint64_t>& halfHashCounter, std::atomic<uint64_t>& skippedHashCounter, std::atomic<uint64_t>&hashCounter, std::atomic<uint64_t>&blockCounter, uint64_t nRoundsTarget);
-    void mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCounter, uint256& foundBlockHash, bool& interrupt);
+    // Search pre nonces [nPreNonceStart, nPreNonceStart+nPreNonceCount) (0 = all numHashesPre of them) against every post nonce, returning once they are exhausted, a block is found or interrupt is set.
+    // Contexts that were prepared for the same header should be given disjoint ranges, otherwise they duplicate each others work.
+    // If preNoncesDone is set it is incremented for every pre nonce whose post nonces have all been searched.
+    // If throttle is set the worker threads are paced by it, as slots [throttleSlotStart, throttleSlotStart+numThreads) of its round.
+    void mineBlock(CBlock* pBlock, std::atomic<uint64_t>& halfHashCounter, uint256& foundBlockHash, bool& interrupt, uint64_t nPreNonceStart=0, uint64_t nPreNonceCount=0, std::atomic<uint64_t>* preNoncesDone=nullptr, sigma_throttle* throttle=nullptr, uint64_t throttleSlotStart=0);
+    // Bind the arena to a NUMA node (migrating any pages that are already resident) and pin the worker threads of this context to the cpus of that node.
+    // Returns false if the memory could not be bound, the threads are pinned regardless.
+    bool bindToNumaNode(const sigma_numa_node& node);
     virtual ~sigma_context();
     sigma_context(const sigma_context&) = delete;
     sigma_context& operator=(const sigma_context&) = delete;
@@ -130,16 +323,76 @@ public:
     uint64_t numThreads=0;
     uint64_t allocatedArenaSizeKb=0;
     uint8_t* arena=nullptr;
+    sigma_arena_backing arenaBacking=SIGMA_ARENA_HEAP;
+    bool arenaLocked=false;
+    int numaNode=-1;
 private:
+    void allocateArena(bool allowLargePages, bool lockArena);
+    void freeArena();
+    void pinWorkerThread(uint64_t nThreadIndex);
+    // Slow hash (argon) scratch memory of worker nThreadIndex, valid for the lifetime of the context.
+    uint8_t* slowHashScratch(uint64_t nThreadIndex);
+    std::vector<int> affinityCpus;
+    // One argonMemoryCostKb block per worker thread; allocated (and pre-faulted) once with the context instead of on every mineBlock call.
+    // As a consequence mineBlock/benchmarkMining/benchmarkSlowHashes must not run concurrently on the same context.
+    std::vector<uint8_t> slowHashScratchPool;
     sigma_settings settings;
     uint64_t numHashesPossibleWithAvailableMemory=0;
 };
 
+struct sigma_verify_cache_stats
+{
+    uint64_t chunkEntries=0;
+    uint64_t chunkBytes=0;
+    uint64_t chunkHits=0;
+    uint64_t chunkMisses=0;
+    uint64_t slowHashEntries=0;
+    uint64_t slowHashHits=0;
+    uint64_t slowHashMisses=0;
+};
+
+// Bounded, thread safe, least recently used cache of the expensive parts of a header verification, shared by any number of verify contexts.
+// Arena chunks only depend on the header without its nonce and on the chunk index, slow hashes only on the header with its pre nonce; so repeat verifications of the same header (or of other headers from the same template) reuse them.
+// Entries are keyed on a hash of the full argon input (header bytes and cost parameters) so a cache can never hand out data generated under different settings.
+class sigma_verify_cache
+{
+public:
+    sigma_verify_cache(uint64_t maxChunkBytes_, uint64_t maxSlowHashes_);
+    static uint256 key(const uint8_t* input, uint64_t inputLen, uint64_t t_cost, uint64_t m_cost, uint64_t lanes);
+    // Returns nullptr on a miss; the returned chunk stays valid after it is evicted for as long as the caller holds on to it.
+    std::shared_ptr<const std::vector<uint8_t>> getChunk(const uint256& chunkKey);
+    void putChunk(const uint256& chunkKey, const uint8_t* chunk, uint64_t chunkLen);
+    bool getSlowHash(const uint256& slowHashKey, std::array<uint64_t, 4>& slowHash);
+    void putSlowHash(const uint256& slowHashKey, const std::array<uint64_t, 4>& slowHash);
+    void clear();
+    sigma_verify_cache_stats getStats();
+    sigma_verify_cache(const sigma_verify_cache&) = delete;
+    sigma_verify_cache& operator=(const sigma_verify_cache&) = delete;
+private:
+    struct key_hasher { size_t operator()(const uint256& k) const { return k.GetCheapHash(); } };
+    template<typename T> using lru_list = std::list<std::pair<uint256, T>>;
+    template<typename T> using lru_index = std::unordered_map<uint256, typename lru_list<T>::iterator, key_hasher>;
+
+    std::mutex mutex;
+    uint64_t maxChunkBytes;
+    uint64_t maxSlowHashes;
+    uint64_t chunkBytes=0;
+    lru_list<std::shared_ptr<const std::vector<uint8_t>>> chunks;
+    lru_index<std::shared_ptr<const std::vector<uint8_t>>> chunkIndex;
+    lru_list<std::array<uint64_t, 4>> slowHashes;
+    lru_index<std::array<uint64_t, 4>> slowHashIndex;
+    uint64_t chunkHits=0;
+    uint64_t chunkMisses=0;
+    uint64_t slowHashHits=0;
+    uint64_t slowHashMisses=0;
+};
+
 // Light weight sigma context for header verification - allocates just the size of one argon round (16mb)
 class sigma_verify_context
 {
 public:
-    sigma_verify_context(sigma_settings settings_, uint64_t numUserVerifyThreads_);
+    // If cache_ is set arena chunks and slow hashes are looked up in (and added to) it instead of always being regenerated; it must outlive the context.
+    sigma_verify_context(sigma_settings settings_, uint64_t numUserVerifyThreads_, sigma_verify_cache* cache_=nullptr);
     // Use verifyLevel to determine which of the fast hashes to check
     // 0 = Check both
     // 1 = Check first hash
@@ -147,12 +400,16 @@ public:
     // NB! Do not use 1 or 2 unless you fully understand the repercussions; If in doubt stick to the default 0
     // Careless use of 1/2 can allow for carefully crafted attacks to split the chain.
     template<int verifyLevel=0> bool verifyHeader(CBlockHeader headerData);
+    // As verifyHeader but against an explicit target instead of the one encoded in nBits (e.g. a pool share target).
+    // If pFastHash is set it receives the last fast hash that was calculated, so that a caller can tell whether a header that meets an easier target also meets a harder one.
+    template<int verifyLevel=0> bool verifyHeaderAgainstTarget(CBlockHeader headerData, const arith_uint256& hashTarget, uint256* pFastHash=nullptr);
     virtual ~sigma_verify_context();
     sigma_verify_context(const sigma_verify_context&) = delete;
     sigma_verify_context& operator=(const sigma_verify_context&) = delete;
 private:
     sigma_settings settings;
     uint64_t numUserVerifyThreads;
+    sigma_verify_cache* cache;
     uint8_t* hashMem;
 };
 
@@ -5,9 +5,40 @@
 #include "crypto/sha256.h"
 
 #include "crypto/common.h"
+#include "compat/arch.h"
 
+#include <assert.h>
 #include <string.h>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#if defined(COMPILER_HAS_SSE4)
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#if defined(COMPILER_HAS_AVX2)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#if defined(COMPILER_HAS_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in);
+}
+#endif
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -44,7 +75,7 @@ void inline Initialize(uint32_t* s)
 }
 
 /** Perform one SHA-256 transformation, processing a 64-byte chunk. */
-void Transform(uint32_t* s, const unsigned char* chunk)
+void inline TransformBlock(uint32_t* s, const unsigned char* chunk)
 {
     uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
     uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
@@ -127,9 +158,263 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Perform a number of SHA-256 transformations, processing 64-byte chunks. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--)
+    {
+        TransformBlock(s, chunk);
+        chunk += 64;
+    }
+}
+
+/** The double SHA-256 of a 64-byte message, by way of transform: the message, its padding, then the padded 32-byte digest. */
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+template<TransformType transform>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    Initialize(s);
+    transform(s, in, 1);
+    transform(s, padding1, 1);
+    for (int i = 0; i < 8; ++i)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    Initialize(s);
+    transform(s, buffer2, 1);
+    for (int i = 0; i < 8; ++i)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
 } // namespace sha256
+
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+//! The implementations in use, see SHA256AutoDetect; the multi way ones are null where there is none for the processor.
+sha256::TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = sha256::TransformD64Wrapper<sha256::Transform>;
+TransformD64Type TransformD64_2way = nullptr;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+std::string strImplementation = "standard";
+
+/** Check the implementations in use against the reference implementation above, which the test vectors in crypto_tests cover. */
+bool SelfTest()
+{
+    // Eight 64-byte messages, at an odd offset as callers don't necessarily pass aligned data.
+    unsigned char data[1 + 8 * 64];
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 7 + 1);
+    const unsigned char* input = data + 1;
+
+    unsigned char expected[8 * 32];
+    for (int i = 0; i < 8; ++i)
+        sha256::TransformD64Wrapper<sha256::Transform>(expected + 32 * i, input + 64 * i);
+
+    unsigned char out[8 * 32];
+    for (int i = 0; i < 8; ++i)
+    {
+        TransformD64(out + 32 * i, input + 64 * i);
+        if (memcmp(out + 32 * i, expected + 32 * i, 32))
+            return false;
+    }
+    if (TransformD64_2way)
+    {
+        TransformD64_2way(out, input);
+        if (memcmp(out, expected, 64))
+            return false;
+    }
+    if (TransformD64_4way)
+    {
+        TransformD64_4way(out, input);
+        if (memcmp(out, expected, 128))
+            return false;
+    }
+    if (TransformD64_8way)
+    {
+        TransformD64_8way(out, input);
+        if (memcmp(out, expected, 256))
+            return false;
+    }
+
+    // And the block transform, over several blocks at once.
+    uint32_t s[8], sExpected[8];
+    sha256::Initialize(s);
+    sha256::Initialize(sExpected);
+    Transform(s, input, 8);
+    sha256::Transform(sExpected, input, 8);
+    return memcmp(s, sExpected, sizeof(s)) == 0;
+}
+
+#if defined(ARCH_CPU_X86_FAMILY)
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+}
+
+/** Whether the OS saves the AVX registers on context switches. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+#if defined(ARCH_CPU_X86_FAMILY) && (defined(COMPILER_HAS_SSE4) || defined(COMPILER_HAS_AVX2) || defined(COMPILER_HAS_SHANI))
+/** Nanoseconds per message of a double SHA-256 kernel that hashes nWays 64-byte messages per call; the best of a few runs. */
+int64_t TimeD64(TransformD64Type transform, int nWays)
+{
+    static const int nMessages = 2048;
+    unsigned char data[8 * 64] = {};
+    unsigned char out[8 * 32];
+    int64_t nBest = std::numeric_limits<int64_t>::max();
+    for (int nRun = 0; nRun < 3; ++nRun)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nMessages / nWays; ++i)
+        {
+            transform(out, data);
+            // Feed the output back in so that the calls can't be folded together.
+            data[i % sizeof(data)] ^= out[0];
+        }
+        nBest = std::min<int64_t>(nBest, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    return nBest / nMessages;
+}
+
+/**
+ * The kernels that are no faster than what would be used without them. Merkle hashing goes through the widest kernel there
+ * is and then the narrower ones for what is left, so a kernel is only worth it if it beats every narrower one; SHA-NI, which
+ * replaces the others altogether, has to beat the best of them.
+ */
+uint32_t SlowerKernels(bool fHaveSSE41, bool fHaveAVX2, bool fHaveSHANI)
+{
+    uint32_t nSlower = 0;
+    int64_t nBest = TimeD64(sha256::TransformD64Wrapper<sha256::Transform>, 1);
+#if defined(COMPILER_HAS_SSE4)
+    if (fHaveSSE41)
+    {
+        int64_t nTime = TimeD64(sha256d64_sse41::Transform_4way, 4);
+        if (nTime < nBest)
+            nBest = nTime;
+        else
+            nSlower |= SHA256_KERNEL_SSE41_4WAY;
+    }
+#endif
+#if defined(COMPILER_HAS_AVX2)
+    if (fHaveAVX2)
+    {
+        int64_t nTime = TimeD64(sha256d64_avx2::Transform_8way, 8);
+        if (nTime < nBest)
+            nBest = nTime;
+        else
+            nSlower |= SHA256_KERNEL_AVX2_8WAY;
+    }
+#endif
+#if defined(COMPILER_HAS_SHANI)
+    if (fHaveSHANI)
+    {
+        int64_t nTime = std::min(TimeD64(sha256::TransformD64Wrapper<sha256_shani::Transform>, 1), TimeD64(sha256d64_shani::Transform_2way, 2));
+        if (nTime >= nBest)
+            nSlower |= SHA256_KERNEL_SHANI;
+    }
+#endif
+    (void)fHaveSSE41;
+    (void)fHaveAVX2;
+    (void)fHaveSHANI;
+    return nSlower;
+}
+#endif
 } // namespace
 
+std::string SHA256AutoDetect()
+{
+    uint32_t nDisable = 0;
+    return SHA256AutoDetect(nDisable, false);
+}
+
+std::string SHA256AutoDetect(uint32_t& nDisable, bool fBenchmark)
+{
+    Transform = sha256::Transform;
+    TransformD64 = sha256::TransformD64Wrapper<sha256::Transform>;
+    TransformD64_2way = nullptr;
+    TransformD64_4way = nullptr;
+    TransformD64_8way = nullptr;
+    std::string ret = "standard";
+#if defined(ARCH_CPU_X86_FAMILY) && (defined(COMPILER_HAS_SSE4) || defined(COMPILER_HAS_AVX2) || defined(COMPILER_HAS_SHANI))
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    const uint32_t nMaxLeaf = eax;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    bool fHaveSSE41 = (ecx >> 19) & 1;
+    bool fHaveAVX = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    bool fHaveAVX2 = false;
+    bool fHaveSHANI = false;
+    if (nMaxLeaf >= 7)
+    {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        fHaveAVX2 = fHaveAVX && ((ebx >> 5) & 1);
+        fHaveSHANI = fHaveSSE41 && ((ebx >> 29) & 1);
+    }
+    if (fBenchmark)
+        nDisable |= SlowerKernels(fHaveSSE41, fHaveAVX2, fHaveSHANI);
+    fHaveSHANI = fHaveSHANI && !(nDisable & SHA256_KERNEL_SHANI);
+    fHaveAVX2 = fHaveAVX2 && !(nDisable & SHA256_KERNEL_AVX2_8WAY);
+    fHaveSSE41 = fHaveSSE41 && !(nDisable & SHA256_KERNEL_SSE41_4WAY);
+    (void)fHaveSSE41;
+    (void)fHaveAVX2;
+    (void)fHaveSHANI;
+
+#if defined(COMPILER_HAS_SHANI)
+    if (fHaveSHANI)
+    {
+        // With the dedicated instructions two interleaved messages beat the multi way kernels.
+        Transform = sha256_shani::Transform;
+        TransformD64 = sha256::TransformD64Wrapper<sha256_shani::Transform>;
+        TransformD64_2way = sha256d64_shani::Transform_2way;
+        ret = "shani(1way,2way)";
+        fHaveSSE41 = false;
+        fHaveAVX2 = false;
+    }
+#endif
+#if defined(COMPILER_HAS_SSE4)
+    if (fHaveSSE41)
+    {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+    }
+#endif
+#if defined(COMPILER_HAS_AVX2)
+    if (fHaveAVX2)
+    {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    strImplementation = ret;
+    return ret;
+}
+
+std::string SHA256Implementation()
+{
+    return strImplementation;
+}
+
 
 ////// SHA-256
 
@@ -147,14 +432,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -187,3 +473,44 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way)
+    {
+        while (blocks >= 8)
+        {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way)
+    {
+        while (blocks >= 4)
+        {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way)
+    {
+        while (blocks >= 2)
+        {
+            TransformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks)
+    {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,28 @@ public:
     CSHA256& Reset();
 };
 
+/** Pick the fastest SHA-256 implementations the processor supports, and return their names. Call once at startup, before hashing on other threads. */
+std::string SHA256AutoDetect();
+
+/** Kernels that SHA256AutoDetect can be told to leave out. */
+static const uint32_t SHA256_KERNEL_SHANI = 1;
+static const uint32_t SHA256_KERNEL_SSE41_4WAY = 2;
+static const uint32_t SHA256_KERNEL_AVX2_8WAY = 4;
+
+/**
+ * As above, but never picking the kernels in nDisable. With fBenchmark every kernel the processor supports is timed first and
+ * the ones that turn out no faster than what would be used without them are added to nDisable; some processors slow down
+ * for the wider instructions, so what their feature flags allow isn't always what is fastest.
+ */
+std::string SHA256AutoDetect(uint32_t& nDisable, bool fBenchmark);
+
+/** The names SHA256AutoDetect returned last, "standard" if it hasn't run. */
+std::string SHA256Implementation();
+
+/**
+ * The double SHA-256 of each of blocks 64-byte messages at input, written as blocks 32-byte hashes to output (which may be input).
+ * Merkle trees hash nothing else, so this is where the multi way implementations come in.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // GULDEN_CRYPTO_SHA256_H
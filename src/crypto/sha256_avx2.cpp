@@ -0,0 +1,56 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// Eight way double SHA-256 of 64-byte messages, one message per 32 bit lane of AVX2 registers.
+// The build system compiles this file with the AVX2 flags, see sha256.cpp for the runtime selection.
+
+#if defined(COMPILER_HAS_AVX2)
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_avx2
+{
+namespace
+{
+typedef __m256i vec;
+
+inline vec K(uint32_t x) { return _mm256_set1_epi32(x); }
+inline vec Add(vec x, vec y) { return _mm256_add_epi32(x, y); }
+inline vec Xor(vec x, vec y) { return _mm256_xor_si256(x, y); }
+inline vec Or(vec x, vec y) { return _mm256_or_si256(x, y); }
+inline vec And(vec x, vec y) { return _mm256_and_si256(x, y); }
+inline vec ShR(vec x, int n) { return _mm256_srli_epi32(x, n); }
+inline vec ShL(vec x, int n) { return _mm256_slli_epi32(x, n); }
+
+inline vec Read(const unsigned char* in, int offset)
+{
+    return _mm256_set_epi32(ReadBE32(in + 448 + offset), ReadBE32(in + 384 + offset), ReadBE32(in + 320 + offset), ReadBE32(in + 256 + offset),
+                            ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+}
+
+inline void Write(unsigned char* out, int offset, vec v)
+{
+    WriteBE32(out + offset, _mm256_extract_epi32(v, 0));
+    WriteBE32(out + 32 + offset, _mm256_extract_epi32(v, 1));
+    WriteBE32(out + 64 + offset, _mm256_extract_epi32(v, 2));
+    WriteBE32(out + 96 + offset, _mm256_extract_epi32(v, 3));
+    WriteBE32(out + 128 + offset, _mm256_extract_epi32(v, 4));
+    WriteBE32(out + 160 + offset, _mm256_extract_epi32(v, 5));
+    WriteBE32(out + 192 + offset, _mm256_extract_epi32(v, 6));
+    WriteBE32(out + 224 + offset, _mm256_extract_epi32(v, 7));
+}
+}
+
+#define SHA256_MULTIWAY_IMPL
+#include "crypto/sha256_multiway.h"
+#undef SHA256_MULTIWAY_IMPL
+
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Multiway(out, in);
+}
+}
+#endif
@@ -0,0 +1,129 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// The body of the multi way double SHA-256 kernels (sha256_sse41.cpp and sha256_avx2.cpp), which hash one 64-byte message per lane.
+// The including file defines, inside its own namespace, the lane vector type 'vec' with WAYS lanes and the operations on it:
+// K (broadcast), Add, Xor, Or, And, ShR, ShL, Read (word offset of each of the WAYS consecutive 64-byte messages, big endian) and
+// Write (word offset of each of the WAYS consecutive 32-byte hashes, big endian).
+
+#ifndef SHA256_MULTIWAY_IMPL
+#error "sha256_multiway.h is only included by the multi way SHA-256 kernels"
+#endif
+
+namespace
+{
+inline vec Add(vec x, vec y, vec z) { return Add(Add(x, y), z); }
+inline vec Add(vec x, vec y, vec z, vec w) { return Add(Add(x, y), Add(z, w)); }
+inline vec Xor(vec x, vec y, vec z) { return Xor(Xor(x, y), z); }
+
+inline vec Ch(vec x, vec y, vec z) { return Xor(z, And(x, Xor(y, z))); }
+inline vec Maj(vec x, vec y, vec z) { return Or(And(x, y), And(z, Or(x, y))); }
+inline vec Sigma0(vec x) { return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10))); }
+inline vec Sigma1(vec x) { return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7))); }
+inline vec sigma0(vec x) { return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3)); }
+inline vec sigma1(vec x) { return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10)); }
+
+constexpr uint32_t RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+constexpr uint32_t InitialState[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+constexpr uint32_t RotR(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+/** The second block of a 64-byte message (only padding) is the same for every message; its round constants plus message words, worked out at compile time. */
+struct PaddingBlockSchedule
+{
+    uint32_t kw[64];
+    constexpr PaddingBlockSchedule() : kw()
+    {
+        uint32_t w[64] = {};
+        w[0] = 0x80000000;
+        w[15] = 512;
+        for (int i = 16; i < 64; ++i)
+            w[i] = (RotR(w[i - 2], 17) ^ RotR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] + (RotR(w[i - 15], 7) ^ RotR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+        for (int i = 0; i < 64; ++i)
+            kw[i] = RoundConstants[i] + w[i];
+    }
+};
+constexpr PaddingBlockSchedule paddingBlockSchedule;
+
+inline void __attribute__((always_inline)) Round(vec* s, vec kw)
+{
+    vec t1 = Add(s[7], Sigma1(s[4]), Ch(s[4], s[5], s[6]), kw);
+    vec t2 = Add(Sigma0(s[0]), Maj(s[0], s[1], s[2]));
+    s[7] = s[6];
+    s[6] = s[5];
+    s[5] = s[4];
+    s[4] = Add(s[3], t1);
+    s[3] = s[2];
+    s[2] = s[1];
+    s[1] = s[0];
+    s[0] = Add(t1, t2);
+}
+
+/** One transformation of each lane's state by the block (of 16 words per lane) in w, which is expanded in place. */
+inline void __attribute__((always_inline)) Transform(vec* s, vec* w)
+{
+    vec a[8];
+    for (int i = 0; i < 8; ++i)
+        a[i] = s[i];
+    for (int i = 0; i < 16; ++i)
+        Round(a, Add(K(RoundConstants[i]), w[i]));
+    for (int i = 16; i < 64; ++i)
+    {
+        w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+        Round(a, Add(K(RoundConstants[i]), w[i & 15]));
+    }
+    for (int i = 0; i < 8; ++i)
+        s[i] = Add(s[i], a[i]);
+}
+
+/** The same for the padding block, from the schedule worked out ahead. */
+inline void __attribute__((always_inline)) TransformPadding(vec* s)
+{
+    vec a[8];
+    for (int i = 0; i < 8; ++i)
+        a[i] = s[i];
+    for (int i = 0; i < 64; ++i)
+        Round(a, K(paddingBlockSchedule.kw[i]));
+    for (int i = 0; i < 8; ++i)
+        s[i] = Add(s[i], a[i]);
+}
+
+void TransformD64Multiway(unsigned char* out, const unsigned char* in)
+{
+    vec s[8], w[16];
+
+    // First hash: the message, then its padding.
+    for (int i = 0; i < 8; ++i)
+        s[i] = K(InitialState[i]);
+    for (int i = 0; i < 16; ++i)
+        w[i] = Read(in, 4 * i);
+    Transform(s, w);
+    TransformPadding(s);
+
+    // Second hash: the 32-byte digest with its padding.
+    for (int i = 0; i < 8; ++i)
+    {
+        w[i] = s[i];
+        s[i] = K(InitialState[i]);
+    }
+    w[8] = K(0x80000000);
+    for (int i = 9; i < 15; ++i)
+        w[i] = K(0);
+    w[15] = K(256);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; ++i)
+        Write(out, 4 * i, s[i]);
+}
+}
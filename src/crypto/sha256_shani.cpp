@@ -0,0 +1,171 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// SHA-256 with the x86 SHA extensions (SHA-NI), after the Intel reference; the block transform and a two way double SHA-256 of
+// 64-byte messages, with the rounds of the two messages interleaved so that the latency of the round instructions overlaps.
+// The build system compiles this file with the SHA-NI flags, see sha256.cpp for the runtime selection.
+
+#if defined(COMPILER_HAS_SHANI)
+#include <stdint.h>
+#include <stddef.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace
+{
+alignas(16) const uint32_t RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t InitialState[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+//! Message words are big endian.
+inline __m128i __attribute__((always_inline)) Load(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL));
+}
+
+//! The round instructions keep the state as ABEF and CDGH.
+inline void __attribute__((always_inline)) Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+inline void __attribute__((always_inline)) Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+//! Four rounds, with message words m.
+inline void __attribute__((always_inline)) QuadRound(__m128i& s0, __m128i& s1, __m128i m, int i)
+{
+    __m128i msg = _mm_add_epi32(m, _mm_load_si128((const __m128i*)(RoundConstants + 4 * i)));
+    s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+//! Message words 4i to 4i+3 into m[i & 3], from the 16 before them in m.
+inline void __attribute__((always_inline)) Schedule(__m128i* m, int i)
+{
+    __m128i x = _mm_add_epi32(_mm_sha256msg1_epu32(m[i & 3], m[(i - 3) & 3]), _mm_alignr_epi8(m[(i - 1) & 3], m[(i - 2) & 3], 4));
+    m[i & 3] = _mm_sha256msg2_epu32(x, m[(i - 1) & 3]);
+}
+
+/** One block for each of two states, interleaved. */
+inline void __attribute__((always_inline)) TransformTwo(uint32_t* sa, uint32_t* sb, const unsigned char* ina, const unsigned char* inb)
+{
+    __m128i sa0 = _mm_loadu_si128((const __m128i*)sa), sa1 = _mm_loadu_si128((const __m128i*)(sa + 4));
+    __m128i sb0 = _mm_loadu_si128((const __m128i*)sb), sb1 = _mm_loadu_si128((const __m128i*)(sb + 4));
+    Shuffle(sa0, sa1);
+    Shuffle(sb0, sb1);
+    const __m128i sao0 = sa0, sao1 = sa1, sbo0 = sb0, sbo1 = sb1;
+
+    __m128i ma[4], mb[4];
+    for (int i = 0; i < 16; ++i)
+    {
+        if (i < 4)
+        {
+            ma[i] = Load(ina + 16 * i);
+            mb[i] = Load(inb + 16 * i);
+        }
+        else
+        {
+            Schedule(ma, i);
+            Schedule(mb, i);
+        }
+        QuadRound(sa0, sa1, ma[i & 3], i);
+        QuadRound(sb0, sb1, mb[i & 3], i);
+    }
+
+    sa0 = _mm_add_epi32(sa0, sao0);
+    sa1 = _mm_add_epi32(sa1, sao1);
+    sb0 = _mm_add_epi32(sb0, sbo0);
+    sb1 = _mm_add_epi32(sb1, sbo1);
+    Unshuffle(sa0, sa1);
+    Unshuffle(sb0, sb1);
+    _mm_storeu_si128((__m128i*)sa, sa0);
+    _mm_storeu_si128((__m128i*)(sa + 4), sa1);
+    _mm_storeu_si128((__m128i*)sb, sb0);
+    _mm_storeu_si128((__m128i*)(sb + 4), sb1);
+}
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i*)s), s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--)
+    {
+        const __m128i so0 = s0, so1 = s1;
+        __m128i m[4];
+        for (int i = 0; i < 16; ++i)
+        {
+            if (i < 4)
+                m[i] = Load(chunk + 16 * i);
+            else
+                Schedule(m, i);
+            QuadRound(s0, s1, m[i & 3], i);
+        }
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+}
+
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffera[64] = {0}, bufferb[64] = {0};
+    buffera[32] = bufferb[32] = 0x80;
+    buffera[62] = bufferb[62] = 1;
+
+    uint32_t sa[8], sb[8];
+    for (int i = 0; i < 8; ++i)
+        sa[i] = sb[i] = InitialState[i];
+    TransformTwo(sa, sb, in, in + 64);
+    TransformTwo(sa, sb, padding1, padding1);
+    for (int i = 0; i < 8; ++i)
+    {
+        WriteBE32(buffera + 4 * i, sa[i]);
+        WriteBE32(bufferb + 4 * i, sb[i]);
+        sa[i] = sb[i] = InitialState[i];
+    }
+    TransformTwo(sa, sb, buffera, bufferb);
+    for (int i = 0; i < 8; ++i)
+    {
+        WriteBE32(out + 4 * i, sa[i]);
+        WriteBE32(out + 32 + 4 * i, sb[i]);
+    }
+}
+}
+#endif
@@ -0,0 +1,51 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// Four way double SHA-256 of 64-byte messages, one message per 32 bit lane of SSE4.1 registers.
+// The build system compiles this file with the SSE4 flags, see sha256.cpp for the runtime selection.
+
+#if defined(COMPILER_HAS_SSE4)
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_sse41
+{
+namespace
+{
+typedef __m128i vec;
+
+inline vec K(uint32_t x) { return _mm_set1_epi32(x); }
+inline vec Add(vec x, vec y) { return _mm_add_epi32(x, y); }
+inline vec Xor(vec x, vec y) { return _mm_xor_si128(x, y); }
+inline vec Or(vec x, vec y) { return _mm_or_si128(x, y); }
+inline vec And(vec x, vec y) { return _mm_and_si128(x, y); }
+inline vec ShR(vec x, int n) { return _mm_srli_epi32(x, n); }
+inline vec ShL(vec x, int n) { return _mm_slli_epi32(x, n); }
+
+inline vec Read(const unsigned char* in, int offset)
+{
+    return _mm_set_epi32(ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+}
+
+inline void Write(unsigned char* out, int offset, vec v)
+{
+    WriteBE32(out + offset, _mm_extract_epi32(v, 0));
+    WriteBE32(out + 32 + offset, _mm_extract_epi32(v, 1));
+    WriteBE32(out + 64 + offset, _mm_extract_epi32(v, 2));
+    WriteBE32(out + 96 + offset, _mm_extract_epi32(v, 3));
+}
+}
+
+#define SHA256_MULTIWAY_IMPL
+#include "crypto/sha256_multiway.h"
+#undef SHA256_MULTIWAY_IMPL
+
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Multiway(out, in);
+}
+}
+#endif
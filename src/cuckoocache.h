@@ -444,6 +444,23 @@ public:
             }
         return false;
     }
+
+    /** for_each calls f for every element in the table that isn't marked for
+     * garbage collection, in table order.
+     *
+     * Used to save the contents of the cache (see DumpSignatureCache); it
+     * doesn't change any flags, so the caller has to prevent concurrent
+     * inserts.
+     *
+     * @param f the function to call with every live element
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
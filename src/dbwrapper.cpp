@@ -11,6 +11,7 @@
 
 #include "dbwrapper.h"
 
+#include "executor.h"
 #include "fs.h"
 #include "util.h"
 #include "random.h"
@@ -21,6 +22,12 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <sstream>
 
 class CGuldenLevelDBLogger : public leveldb::Logger {
 public:
@@ -80,14 +87,67 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace {
+
+/** Block cache that counts its hits and misses, for the statistics of a database. */
+class CCountingCache : public leveldb::Cache
 {
+public:
+    explicit CCountingCache(size_t nCapacity) : cache(leveldb::NewLRUCache(nCapacity)), nCapacity(nCapacity) {}
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value)) override
+    {
+        return cache->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key) override
+    {
+        Handle* handle = cache->Lookup(key);
+        ++(handle ? nHits : nMisses);
+        return handle;
+    }
+
+    void Release(Handle* handle) override { cache->Release(handle); }
+    void* Value(Handle* handle) override { return cache->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { cache->Erase(key); }
+    uint64_t NewId() override { return cache->NewId(); }
+    void Prune() override { cache->Prune(); }
+    size_t TotalCharge() const override { return cache->TotalCharge(); }
+
+    std::unique_ptr<leveldb::Cache> cache;
+    const size_t nCapacity;
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+};
+
+//! Open databases that have a name, for GetOpenDatabaseStats.
+std::mutex csOpenDatabases;
+std::set<CDBWrapper*> setOpenDatabases;
+
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const std::string& name, int& nBloomBits)
+{
+    size_t nBlockCacheSize = nCacheSize / 2;
+    size_t nWriteBufferSize = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    nBloomBits = DEFAULT_DB_BLOOM_BITS;
+    int nMaxOpenFiles = DEFAULT_DB_MAX_OPEN_FILES;
+    if (!name.empty()) {
+        // The sizes are in MiB; leveldb itself clamps values that are out of range.
+        if (IsArgSet("-" + name + "-blockcache"))
+            nBlockCacheSize = std::max<int64_t>(GetArg("-" + name + "-blockcache", 0), 0) << 20;
+        if (IsArgSet("-" + name + "-writebuffer"))
+            nWriteBufferSize = std::max<int64_t>(GetArg("-" + name + "-writebuffer", 0), 0) << 20;
+        nBloomBits = std::max<int64_t>(GetArg("-" + name + "-bloombits", DEFAULT_DB_BLOOM_BITS), 0);
+        nMaxOpenFiles = GetArg("-" + name + "-maxopenfiles", DEFAULT_DB_MAX_OPEN_FILES);
+    }
+
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = new CCountingCache(nBlockCacheSize);
+    options.write_buffer_size = nWriteBufferSize;
+    options.filter_policy = nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(nBloomBits) : NULL;
     options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.max_open_files = nMaxOpenFiles;
     options.info_log = new CGuldenLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -97,14 +157,16 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const std::string& nameIn)
+: name(nameIn)
+, fCompactPass(false)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, name, nBloomBits);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -121,6 +183,10 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    if (!name.empty()) {
+        LogPrint(BCLog::LEVELDB, "LevelDB %s: block cache %.1fMiB, write buffer %.1fMiB, %d bloom filter bits, %d open files\n", name,
+            static_cast<CCountingCache*>(options.block_cache)->nCapacity * (1.0 / 1024 / 1024), options.write_buffer_size * (1.0 / 1024 / 1024), nBloomBits, options.max_open_files);
+    }
 
     // The base-case obfuscation key, which is a noop.
     obfuscate_key = std::vector<unsigned char>(OBFUSCATE_KEY_NUM_BYTES, '\000');
@@ -140,10 +206,19 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    if (!name.empty()) {
+        std::lock_guard<std::mutex> lock(csOpenDatabases);
+        setOpenDatabases.insert(this);
+    }
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        std::lock_guard<std::mutex> lock(csOpenDatabases);
+        setOpenDatabases.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -163,6 +238,155 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
     return true;
 }
 
+void CDBWrapper::ReadManyRaw(const std::vector<std::string>& keys, std::vector<std::string>& values, std::vector<char>& found) const
+{
+    values.assign(keys.size(), std::string());
+    found.assign(keys.size(), false);
+
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+    leveldb::ReadOptions options = readoptions;
+    options.snapshot = pdb->GetSnapshot();
+    // Each thread takes a consecutive range of the sorted keys; the results go to distinct elements so need no locking.
+    auto readRange = [&](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            size_t n = order[i];
+            leveldb::Status status = pdb->Get(options, keys[n], &values[n]);
+            if (status.ok()) {
+                found[n] = true;
+            } else if (!status.IsNotFound()) {
+                LogPrintf("LevelDB read failure: %s\n", status.ToString());
+                dbwrapper_private::HandleError(status);
+            }
+        }
+    };
+
+    size_t nThreads = std::min(DBWRAPPER_READMANY_MAX_THREADS, keys.size() / DBWRAPPER_READMANY_MIN_PER_THREAD);
+    try {
+        if (nThreads <= 1) {
+            readRange(0, keys.size());
+        } else {
+            size_t nPerThread = (keys.size() + nThreads - 1) / nThreads;
+            CTaskGroup ranges(GetExecutor(), EXECUTOR_VALIDATION);
+            for (size_t nBegin = nPerThread; nBegin < keys.size(); nBegin += nPerThread)
+                ranges.Run([&readRange, nBegin, nPerThread, &keys]() { readRange(nBegin, std::min(nBegin + nPerThread, keys.size())); });
+            readRange(0, nPerThread);
+            ranges.Wait();
+        }
+    } catch (...) {
+        pdb->ReleaseSnapshot(options.snapshot);
+        throw;
+    }
+    pdb->ReleaseSnapshot(options.snapshot);
+}
+
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats;
+    const CCountingCache* cache = static_cast<const CCountingCache*>(options.block_cache);
+    stats.name = name;
+    stats.nBlockCacheSize = cache->nCapacity;
+    stats.nWriteBufferSize = options.write_buffer_size;
+    stats.nBloomBits = nBloomBits;
+    stats.nMaxOpenFiles = options.max_open_files;
+    stats.nBlockCacheUsage = cache->TotalCharge();
+    stats.nCacheHits = cache->nHits;
+    stats.nCacheMisses = cache->nMisses;
+
+    std::string strValue;
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+
+    // One line per level that has files or has seen compactions: level, files, size (MB), compaction time (s), read (MB), written (MB).
+    if (pdb->GetProperty("leveldb.stats", &strValue)) {
+        std::istringstream lines(strValue);
+        std::string line;
+        while (std::getline(lines, line)) {
+            CDBStats::Level level;
+            if (sscanf(line.c_str(), "%d %d %lf %lf %lf %lf", &level.nLevel, &level.nFiles, &level.nSizeMB, &level.nCompactionSeconds, &level.nCompactionReadMB, &level.nCompactionWriteMB) != 6)
+                continue;
+            // The compaction triggers that LevelDB uses: 4 files for level 0, 10MiB for level 1 and ten times the previous level after that.
+            if (level.nLevel == 0) {
+                level.nCompactionScore = level.nFiles / 4.0;
+            } else {
+                double nTargetMB = 10 * std::pow(10.0, level.nLevel - 1);
+                level.nCompactionScore = level.nSizeMB / nTargetMB;
+                stats.nCompactionBacklogMB += std::max(0.0, level.nSizeMB - nTargetMB);
+            }
+            stats.levels.push_back(level);
+        }
+    }
+    return stats;
+}
+
+std::vector<CDBStats> CDBWrapper::GetOpenDatabaseStats()
+{
+    std::vector<CDBStats> vStats;
+    std::lock_guard<std::mutex> lock(csOpenDatabases);
+    for (const CDBWrapper* db : setOpenDatabases)
+        vStats.push_back(db->GetStats());
+    std::sort(vStats.begin(), vStats.end(), [](const CDBStats& a, const CDBStats& b) { return a.name < b.name; });
+    return vStats;
+}
+
+int CDBWrapper::GetLevelFileCount(int nLevel) const
+{
+    std::string strValue;
+    if (!pdb->GetProperty("leveldb.num-files-at-level" + std::to_string(nLevel), &strValue))
+        return 0;
+    return atoi(strValue);
+}
+
+bool CDBWrapper::CompactStep()
+{
+    if (!fCompactPass) {
+        if (GetLevelFileCount(0) < DBWRAPPER_COMPACT_LEVEL0_FILES)
+            return false;
+        LogPrint(BCLog::LEVELDB, "Compacting LevelDB %s\n", name);
+        fCompactPass = true;
+        compactCursor.clear();
+    }
+
+    // The next part is that of the first key from the cursor on, so empty parts of the key space are skipped.
+    std::string begin;
+    {
+        std::unique_ptr<leveldb::Iterator> it(pdb->NewIterator(iteroptions));
+        it->Seek(compactCursor);
+        if (!it->Valid()) {
+            LogPrint(BCLog::LEVELDB, "Compacted LevelDB %s\n", name);
+            fCompactPass = false;
+            return false;
+        }
+        begin = it->key().ToString().substr(0, 2);
+    }
+    // The first key past the prefix; empty if there is none.
+    std::string end = begin;
+    while (!end.empty() && (unsigned char)end.back() == 0xff)
+        end.pop_back();
+    if (!end.empty())
+        end.back()++;
+
+    leveldb::Slice slBegin(begin);
+    leveldb::Slice slEnd(end);
+    pdb->CompactRange(&slBegin, end.empty() ? NULL : &slEnd);
+
+    compactCursor = end;
+    if (end.empty())
+        fCompactPass = false;
+    return true;
+}
+
+bool CDBWrapper::CompactOpenDatabasesStep()
+{
+    bool fCompacted = false;
+    std::lock_guard<std::mutex> lock(csOpenDatabases);
+    for (CDBWrapper* db : setOpenDatabases)
+        fCompacted |= db->CompactStep();
+    return fCompacted;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
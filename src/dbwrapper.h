@@ -25,6 +25,18 @@
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! Max number of threads a single ReadMany spreads its lookups over
+static const size_t DBWRAPPER_READMANY_MAX_THREADS = 4;
+//! Min number of lookups per thread for ReadMany, smaller batches are looked up on the calling thread
+static const size_t DBWRAPPER_READMANY_MIN_PER_THREAD = 256;
+//! Default bits per key of the bloom filters of a database (-<db>-bloombits, 0 for none)
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+//! Default max number of files a database keeps open (-<db>-maxopenfiles)
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+//! Number of level 0 files at which LevelDB starts slowing down writes
+static const int DBWRAPPER_LEVEL0_SLOWDOWN_FILES = 8;
+//! Number of level 0 files from which CompactStep starts a pass over the database
+static const int DBWRAPPER_COMPACT_LEVEL0_FILES = 2;
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -50,6 +62,38 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
 };
 
+/** LevelDB settings and statistics of one database, see CDBWrapper::GetStats. */
+struct CDBStats
+{
+    struct Level
+    {
+        int nLevel = 0;
+        int nFiles = 0;
+        double nSizeMB = 0;
+        //! Time spent compacting into this level and the amount of data read and written doing so, since the database was opened.
+        double nCompactionSeconds = 0;
+        double nCompactionReadMB = 0;
+        double nCompactionWriteMB = 0;
+        //! As LevelDB scores the level for compaction (file count for level 0, size for the others); 1 or more means a compaction is due.
+        double nCompactionScore = 0;
+    };
+
+    std::string name;
+    size_t nBlockCacheSize = 0;
+    size_t nWriteBufferSize = 0;
+    int nBloomBits = 0;
+    int nMaxOpenFiles = 0;
+
+    size_t nBlockCacheUsage = 0;
+    //! Block cache plus memtables.
+    size_t nMemoryUsage = 0;
+    uint64_t nCacheHits = 0;
+    uint64_t nCacheMisses = 0;
+    std::vector<Level> levels;
+    //! Data above the target size of the levels past level 0, which has to be compacted into the next level.
+    double nCompactionBacklogMB = 0;
+};
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -229,6 +273,19 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! name of the database for its settings (-<name>-blockcache etc.) and statistics, empty if neither applies
+    std::string name;
+
+    //! bits per key of the bloom filters, 0 for none
+    int nBloomBits;
+
+    //! whether CompactStep is in the middle of a pass, and the key it continues from
+    bool fCompactPass;
+    std::string compactCursor;
+
+    //! Raw lookups for ReadMany: sets values[i] and found[i] for keys[i].
+    void ReadManyRaw(const std::vector<std::string>& keys, std::vector<std::string>& values, std::vector<char>& found) const;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -237,8 +294,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] name        If not empty, -<name>-blockcache, -<name>-writebuffer, -<name>-bloombits and -<name>-maxopenfiles
+     *                        override the LevelDB settings, and GetOpenDatabaseStats lists the database under this name.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const std::string& name = "");
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -267,6 +326,45 @@ public:
         return true;
     }
 
+    /**
+     * Read the values of many keys at once: values[i] is set to the value of keys[i] and found[i] to whether it has one (an entry that can't be
+     * decoded counts as not found, as for Read). Returns the number of keys found.
+     * The lookups are done in key order, so that neighbouring keys are served from the same table blocks, all against one snapshot of the
+     * database; large batches are spread over a few threads (see DBWRAPPER_READMANY_MAX_THREADS).
+     */
+    template <typename K, typename V>
+    size_t ReadMany(const std::vector<K>& keys, std::vector<V>& values, std::vector<char>& found) const
+    {
+        std::vector<std::string> vKeys;
+        vKeys.reserve(keys.size());
+        for (const K& key : keys) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+            ssKey << key;
+            vKeys.emplace_back(ssKey.data(), ssKey.size());
+        }
+
+        std::vector<std::string> vValues;
+        ReadManyRaw(vKeys, vValues, found);
+
+        values.clear();
+        values.resize(keys.size());
+        size_t nFound = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (!found[i])
+                continue;
+            try {
+                CDataStream ssValue(vValues[i].data(), vValues[i].data() + vValues[i].size(), SER_DISK, CLIENT_VERSION);
+                ssValue.Xor(obfuscate_key);
+                ssValue >> values[i];
+                ++nFound;
+            } catch (const std::exception&) {
+                found[i] = false;
+            }
+        }
+        return nFound;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -326,6 +424,24 @@ public:
      */
     bool IsEmpty();
 
+    //! Settings, cache use and compaction state of the database.
+    CDBStats GetStats() const;
+    //! Statistics of every open database that has a name.
+    static std::vector<CDBStats> GetOpenDatabaseStats();
+
+    //! Number of table files at level nLevel.
+    int GetLevelFileCount(int nLevel) const;
+
+    /**
+     * Compact the next part of the database: the keys that share the next two byte prefix. For compacting the database bit by bit while the
+     * node is idle, so that LevelDB doesn't have to in the middle of block processing. A pass over the database is started once level 0 holds
+     * DBWRAPPER_COMPACT_LEVEL0_FILES or more files. Returns false if there was nothing (left) to compact.
+     * Not to be called from more than one thread at a time.
+     */
+    bool CompactStep();
+    //! CompactStep on every open database that has a name; false if none of them had anything to compact.
+    static bool CompactOpenDatabasesStep();
+
     template<typename K>
     size_t EstimateSize(const K& key_begin, const K& key_end) const
     {
@@ -341,6 +457,20 @@ public:
         pdb->GetApproximateSizes(&range, 1, &size);
         return size;
     }
+
+    //! Compact the keys from key_begin up to (not including) key_end right away, dropping what they overwrote or erased.
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
 };
 
 #endif // GULDEN_DBWRAPPER_H
@@ -0,0 +1,249 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "executor.h"
+
+#include "util.h"
+
+#include <algorithm>
+
+// The executor, and the queue, of the thread that is running; nullptr/-1 for threads not of an executor.
+static thread_local CExecutor* pThreadExecutor = nullptr;
+static thread_local int nThreadQueue = -1;
+
+CExecutor::CExecutor(int nThreads)
+{
+    for (int i = 0; i < nThreads; ++i)
+        queues.emplace_back(new Queue());
+    for (int i = 0; i < nThreads; ++i)
+        threads.emplace_back(&CExecutor::ThreadWorker, this, i);
+}
+
+CExecutor::~CExecutor()
+{
+    Stop();
+}
+
+void CExecutor::Submit(ExecutorPriority priority, Task task)
+{
+    bool fQueued = false;
+    {
+        std::lock_guard<std::mutex> lockWake(mutexWake);
+        if (!fStop)
+        {
+            Queue& queue = pThreadExecutor == this ? *queues[nThreadQueue] : sharedQueue;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks[priority].push_back(std::move(task));
+            }
+            ++nPending;
+            fQueued = true;
+        }
+    }
+    if (!fQueued)
+    {
+        Run(task);
+        return;
+    }
+    condWake.notify_one();
+}
+
+bool CExecutor::Pop(int nSelf, Task& task)
+{
+    if (nPending == 0)
+        return false;
+    for (int nPriority = 0; nPriority < EXECUTOR_PRIORITIES; ++nPriority)
+    {
+        if (nSelf >= 0)
+        {
+            std::lock_guard<std::mutex> lock(queues[nSelf]->mutex);
+            std::deque<Task>& tasks = queues[nSelf]->tasks[nPriority];
+            if (!tasks.empty())
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                --nPending;
+                return true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(sharedQueue.mutex);
+            std::deque<Task>& tasks = sharedQueue.tasks[nPriority];
+            if (!tasks.empty())
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                --nPending;
+                return true;
+            }
+        }
+        // Steal, starting with the next thread so that not everyone goes for the same one.
+        for (size_t i = 1; i <= queues.size(); ++i)
+        {
+            size_t nVictim = (nSelf + i) % queues.size();
+            if ((int)nVictim == nSelf)
+                continue;
+            std::lock_guard<std::mutex> lock(queues[nVictim]->mutex);
+            std::deque<Task>& tasks = queues[nVictim]->tasks[nPriority];
+            if (!tasks.empty())
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                --nPending;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CExecutor::Run(Task& task)
+{
+    try
+    {
+        task();
+    }
+    catch (const std::exception& e)
+    {
+        PrintExceptionContinue(&e, "executor");
+    }
+    catch (...)
+    {
+        PrintExceptionContinue(NULL, "executor");
+    }
+    task = nullptr;
+}
+
+bool CExecutor::RunOne()
+{
+    Task task;
+    if (!Pop(pThreadExecutor == this ? nThreadQueue : -1, task))
+        return false;
+    Run(task);
+    return true;
+}
+
+void CExecutor::ThreadWorker(int nIndex)
+{
+    RenameThread("gulden-executor");
+    pThreadExecutor = this;
+    nThreadQueue = nIndex;
+    while (true)
+    {
+        Task task;
+        if (Pop(nIndex, task))
+        {
+            Run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lockWake(mutexWake);
+        condWake.wait(lockWake, [this]{ return nPending > 0 || fStop; });
+        if (fStop && nPending == 0)
+            return;
+    }
+}
+
+void CExecutor::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lockWake(mutexWake);
+        fStop = true;
+    }
+    condWake.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+CTaskGroup::CTaskGroup(CExecutor& executor_, ExecutorPriority priority_)
+: executor(executor_)
+, priority(priority_)
+{
+}
+
+CTaskGroup::~CTaskGroup()
+{
+    WaitAll();
+}
+
+void CTaskGroup::Run(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++nOutstanding;
+    }
+    executor.Submit(priority, [this, task]()
+    {
+        std::exception_ptr taskError;
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            taskError = std::current_exception();
+        }
+        // Notify with the lock held, the group may be gone as soon as it is released.
+        std::lock_guard<std::mutex> lock(mutex);
+        if (taskError && !error)
+            error = taskError;
+        if (--nOutstanding == 0)
+            cond.notify_all();
+    });
+}
+
+void CTaskGroup::WaitAll()
+{
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (nOutstanding == 0)
+                return;
+        }
+        if (executor.RunOne())
+            continue;
+        // The rest is running elsewhere; look again now and then in case one of them queues more.
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait_for(lock, std::chrono::milliseconds(10), [this]{ return nOutstanding == 0; });
+    }
+}
+
+void CTaskGroup::Wait()
+{
+    WaitAll();
+    std::exception_ptr taskError;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(taskError, error);
+    }
+    if (taskError)
+        std::rethrow_exception(taskError);
+}
+
+// Never freed, tasks submitted after StopExecutor (at exit) still find it.
+static std::mutex csExecutor;
+static CExecutor* pExecutor = nullptr;
+
+CExecutor& GetExecutor()
+{
+    std::lock_guard<std::mutex> lock(csExecutor);
+    if (!pExecutor)
+    {
+        int nThreads = GetArg("-threadbudget", DEFAULT_THREAD_BUDGET);
+        if (nThreads <= 0)
+            nThreads += GetNumCores();
+        nThreads = std::max(1, std::min(nThreads, MAX_THREAD_BUDGET));
+        LogPrintf("Using %d executor threads\n", nThreads);
+        pExecutor = new CExecutor(nThreads);
+    }
+    return *pExecutor;
+}
+
+void StopExecutor()
+{
+    std::lock_guard<std::mutex> lock(csExecutor);
+    if (pExecutor)
+        pExecutor->Stop();
+}
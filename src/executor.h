@@ -0,0 +1,110 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_EXECUTOR_H
+#define GULDEN_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+//! Default for -threadbudget, the number of threads of the shared executor (0 = one per core)
+static const int DEFAULT_THREAD_BUDGET = 0;
+static const int MAX_THREAD_BUDGET = 256;
+
+/** What a task is for; a free thread always takes the most urgent task there is. */
+enum ExecutorPriority
+{
+    EXECUTOR_VALIDATION = 0,
+    EXECUTOR_WITNESS,
+    EXECUTOR_RPC,
+    EXECUTOR_MINING,
+    EXECUTOR_PRIORITIES
+};
+
+/**
+ * A fixed set of threads that runs short tasks for the whole node, so that the parallel parts of validation, witnessing and mining share the
+ * cores instead of each starting threads of their own.
+ *
+ * Every thread has a queue per priority. Tasks submitted from one of the threads go to its own queue, and are taken from the back, while they are
+ * still in cache; tasks from elsewhere go to a shared queue. A thread out of work steals from the front of the queues of the others.
+ * Tasks shouldn't block for long (on I/O or on other tasks, see CTaskGroup::Wait): a thread stuck in a task is a thread less for everyone.
+ */
+class CExecutor
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit CExecutor(int nThreads);
+    ~CExecutor();
+
+    //! Queue task; after Stop it is run on the calling thread instead.
+    void Submit(ExecutorPriority priority, Task task);
+    //! Run the most urgent waiting task on the calling thread; false if there was none.
+    bool RunOne();
+    //! Run what is still queued and join the threads.
+    void Stop();
+
+    int GetThreadCount() const { return (int)threads.size(); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks[EXECUTOR_PRIORITIES];
+    };
+
+    bool Pop(int nSelf, Task& task);
+    static void Run(Task& task);
+    void ThreadWorker(int nIndex);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    Queue sharedQueue;
+    std::vector<std::thread> threads;
+
+    std::mutex mutexWake;
+    std::condition_variable condWake;
+    //! Tasks queued but not taken yet; only raised with mutexWake held, so that threads going to sleep can't miss a task.
+    std::atomic<uint64_t> nPending{0};
+    bool fStop = false;
+};
+
+/**
+ * A set of tasks to wait for. Exceptions thrown by the tasks are passed on by Wait (the first one).
+ * The waiting thread runs queued tasks meanwhile, so tasks can themselves start groups and wait for them without tying up the executor.
+ */
+class CTaskGroup
+{
+public:
+    CTaskGroup(CExecutor& executor, ExecutorPriority priority);
+    //! Waits for the tasks still running, any exception is dropped.
+    ~CTaskGroup();
+
+    void Run(std::function<void()> task);
+    void Wait();
+
+private:
+    void WaitAll();
+
+    CExecutor& executor;
+    const ExecutorPriority priority;
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nOutstanding = 0;
+    std::exception_ptr error;
+};
+
+/** The executor of the node, started on first use with -threadbudget threads. */
+CExecutor& GetExecutor();
+/** Finish the tasks of the executor and stop its threads, later tasks run on the thread that submits them. */
+void StopExecutor();
+
+#endif // GULDEN_EXECUTOR_H
@@ -24,6 +24,7 @@
 #include "consensus/tx_verify.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "executor.h"
 #include "Gulden/auto_checkpoints.h"
 #include "hash.h"
 #include "validation/validation.h"
@@ -43,6 +44,9 @@
 
 #include <algorithm>
 #include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <utility>
 
 #include <Gulden/Common/diff.h>
@@ -227,8 +231,8 @@ static bool InsertPoW2WitnessIntoCoinbase(CBlock& block, const CBlockIndex* pind
             CVectorWriter serialisedWitnessHeaderInfoStream(SER_NETWORK, INIT_PROTO_VERSION, serialisedWitnessHeaderInfo, 0);
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->nVersionPoW2Witness); //4 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->nTimePoW2Witness); //4 bytes
-            ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->hashMerkleRootPoW2Witness); // 32 bytes
-            ::Serialize(serialisedWitnessHeaderInfoStream, NOSIZEVECTOR(pWitnessBlockToEmbed->witnessHeaderPoW2Sig)); //65 bytes
+            ::Serialize(serialisedWitnessHeaderInfoStream, pWitnessBlockToEmbed->GetHashMerkleRootPoW2Witness()); // 32 bytes
+            ::Serialize(serialisedWitnessHeaderInfoStream, NOSIZEVECTOR(pWitnessBlockToEmbed->GetWitnessHeaderPoW2Sig())); //65 bytes
             ::Serialize(serialisedWitnessHeaderInfoStream, pindexPrev->GetBlockHashLegacy()); //32 bytes
         }
 
@@ -281,6 +285,55 @@ static bool InsertPoW2WitnessIntoCoinbase(CBlock& block, const CBlockIndex* pind
 
 
 
+// The transactions CreateNewBlock picked for a parent, with what the choice depended on.
+// Templates for the same parent (extra nonce restarts, other coinbase keys, another witness to embed) reuse them as long as none of that changed;
+// which spares the cloned chain, the cannibalised block reads, the run over the mempool and the validity check.
+struct CBlockTemplateSelection
+{
+    uint256 hashTip;
+    int nParentHeight;
+    int64_t nLockTimeCutoff;
+    unsigned int nTransactionsUpdated;
+    unsigned int nBlockMaxWeight;
+    unsigned int nBlockMaxSize;
+    CFeeRate blockMinFeeRate;
+    //! Whether TestBlockValidity passed on a block with these transactions.
+    bool fValidated;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOpsCost;
+    uint64_t nBlockWeight;
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    uint64_t nBlockSigOpsCost;
+    CAmount nFees;
+    bool fIncludeSegSig;
+};
+// By parent hash, guarded by cs_main. Templates are only built on a handful of parents at a time (tip, and below it while a witness is absent).
+static std::map<uint256, CBlockTemplateSelection> mapTemplateSelections;
+static const size_t MAX_TEMPLATE_SELECTIONS = 8;
+
+// The transactions of the blocks above the parent that CreateNewBlock cannibalises while a witness is absent, by block hash and guarded by cs_main;
+// those are the same one or two blocks for every template until the witness shows up, no need to read them from disk each time.
+static std::map<uint256, std::vector<CTransactionRef>> mapCannibalTransactions;
+static const size_t MAX_CANNIBAL_BLOCKS = 16;
+
+static const std::vector<CTransactionRef>* GetCannibalTransactions(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    auto iter = mapCannibalTransactions.find(pindex->GetBlockHashPoW2());
+    if (iter != mapCannibalTransactions.end())
+        return &iter->second;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params()))
+        return nullptr;
+    if (mapCannibalTransactions.size() >= MAX_CANNIBAL_BLOCKS)
+        mapCannibalTransactions.clear();
+    return &(mapCannibalTransactions[pindex->GetBlockHashPoW2()] = std::move(block.vtx));
+}
+
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(CBlockIndex* pParent, std::shared_ptr<CReserveKeyOrScript> coinbaseReservedKey, bool fMineSegSig, CBlockIndex* pWitnessBlockToEmbed, bool noValidityCheck)
 {
     fMineSegSig = true;
@@ -354,23 +407,51 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(CBlockIndex* pPar
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
 
+    CBlockTemplateSelection selection;
+    selection.hashTip = chainActive.Tip()->GetBlockHashPoW2();
+    selection.nParentHeight = pParent->nHeight;
+    selection.nLockTimeCutoff = nLockTimeCutoff;
+    selection.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    selection.nBlockMaxWeight = nBlockMaxWeight;
+    selection.nBlockMaxSize = nBlockMaxSize;
+    selection.blockMinFeeRate = blockMinFeeRate;
+    selection.fValidated = !noValidityCheck;
+
+    const CBlockTemplateSelection* pCachedSelection = nullptr;
+    auto cachedSelectionIter = mapTemplateSelections.find(pParent->GetBlockHashPoW2());
+    if (cachedSelectionIter != mapTemplateSelections.end())
+    {
+        const CBlockTemplateSelection& cached = cachedSelectionIter->second;
+        if (cached.hashTip == selection.hashTip && cached.nParentHeight == selection.nParentHeight && cached.nLockTimeCutoff == selection.nLockTimeCutoff
+            && cached.nTransactionsUpdated == selection.nTransactionsUpdated && cached.nBlockMaxWeight == selection.nBlockMaxWeight && cached.nBlockMaxSize == selection.nBlockMaxSize
+            && cached.blockMinFeeRate == selection.blockMinFeeRate && (cached.fValidated || noValidityCheck))
+        {
+            pCachedSelection = &cached;
+        }
+    }
+
     // For phase 3 we need to do some gymnastics to ensure the right chain tip before calling TestBlockValidity.
     CValidationState state;
     CCoinsViewCache viewNew(pcoinsTip);
     CBlockIndex* pindexPrev_ = nullptr;
-    CCloneChain tempChain(chainActive, GetPow2ValidationCloneHeight(chainActive, pParent, 1), pParent, pindexPrev_);
-    assert(pindexPrev_);
-    ForceActivateChain(pindexPrev_, nullptr, state, chainparams, tempChain, viewNew);
+    std::unique_ptr<CCloneChain> tempChain;
+    if (pCachedSelection)
     {
-        LOCK(mempool.cs);
-
-        // Decide whether to include segsig signature information
-        // This is only needed in case the segsig signature activation is reverted
-        // (which would require a very deep reorganization) or when
-        // -promiscuousmempoolflags is used.
-        // TODO: replace this with a call to main to assess validity of a mempool
-        // transaction (which in most cases can be a no-op).
-        fIncludeSegSig = IsSegSigEnabled(pParent) && fMineSegSig;
+        pblock->vtx.insert(pblock->vtx.end(), pCachedSelection->vtx.begin(), pCachedSelection->vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), pCachedSelection->vTxFees.begin(), pCachedSelection->vTxFees.end());
+        pblocktemplate->vTxSigOpsCost.insert(pblocktemplate->vTxSigOpsCost.end(), pCachedSelection->vTxSigOpsCost.begin(), pCachedSelection->vTxSigOpsCost.end());
+        nBlockWeight = pCachedSelection->nBlockWeight;
+        nBlockSize = pCachedSelection->nBlockSize;
+        nBlockTx = pCachedSelection->nBlockTx;
+        nBlockSigOpsCost = pCachedSelection->nBlockSigOpsCost;
+        nFees = pCachedSelection->nFees;
+        fIncludeSegSig = pCachedSelection->fIncludeSegSig;
+    }
+    else
+    {
+        tempChain.reset(new CCloneChain(chainActive, GetPow2ValidationCloneHeight(chainActive, pParent, 1), pParent, pindexPrev_));
+        assert(pindexPrev_);
+        ForceActivateChain(pindexPrev_, nullptr, state, chainparams, *tempChain, viewNew);
 
         // If we are mining below the tip (orphaned tip due to absent witness) - it is desirable to include first all transactions that are in the tip.
         // If we do not do this we can end up creating invalid blocks, due to the fact that we don't rewind the mempool here
@@ -386,21 +467,41 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(CBlockIndex* pPar
         std::vector<CTransactionRef> canabalizeTransactions;
         for (const auto& pIndexCannibalBlock : canabalizeBlocks)
         {
-            std::shared_ptr<CBlock> pBlockCannibal(new CBlock);
-            if (!ReadBlockFromDisk(*pBlockCannibal.get(), pIndexCannibalBlock, Params()))
+            const std::vector<CTransactionRef>* pCannibalTransactions = GetCannibalTransactions(pIndexCannibalBlock);
+            if (!pCannibalTransactions)
             {
                 LogPrintf("Error in CreateNewBlock: could not read block from disk.\n");
                 return nullptr;
             }
             //fixme: (PHASE4)
             // We don't want to canabalize coinbase transaction or 'witness refresh' transaction as these are 'generated' by miner and not actual transactions.
-            for (uint32_t i = (bSegSigIsEnabled?1:2); i < pBlockCannibal.get()->vtx.size(); ++i)
+            for (uint32_t i = (bSegSigIsEnabled?1:2); i < pCannibalTransactions->size(); ++i)
             {
-                canabalizeTransactions.push_back(pBlockCannibal.get()->vtx[i]);
+                canabalizeTransactions.push_back((*pCannibalTransactions)[i]);
             }
         }
 
+        LOCK(mempool.cs);
+
+        // Decide whether to include segsig signature information
+        // This is only needed in case the segsig signature activation is reverted
+        // (which would require a very deep reorganization) or when
+        // -promiscuousmempoolflags is used.
+        // TODO: replace this with a call to main to assess validity of a mempool
+        // transaction (which in most cases can be a no-op).
+        fIncludeSegSig = IsSegSigEnabled(pParent) && fMineSegSig;
+
         addPackageTxs(nPackagesSelected, nDescendantsUpdated, &canabalizeTransactions, &viewNew);
+
+        selection.vtx.assign(pblock->vtx.begin() + 1, pblock->vtx.end());
+        selection.vTxFees.assign(pblocktemplate->vTxFees.begin() + 1, pblocktemplate->vTxFees.end());
+        selection.vTxSigOpsCost.assign(pblocktemplate->vTxSigOpsCost.begin() + 1, pblocktemplate->vTxSigOpsCost.end());
+        selection.nBlockWeight = nBlockWeight;
+        selection.nBlockSize = nBlockSize;
+        selection.nBlockTx = nBlockTx;
+        selection.nBlockSigOpsCost = nBlockSigOpsCost;
+        selection.nFees = nFees;
+        selection.fIncludeSegSig = fIncludeSegSig;
     }
 
     int64_t nTime1 = GetTimeMicros();
@@ -505,31 +606,25 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(CBlockIndex* pPar
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = GetLegacySigOpCount(*pblock->vtx[0]);
 
-    if (!noValidityCheck && !TestBlockValidity(tempChain, state, chainparams, *pblock, pindexPrev_, false, false, &viewNew))
+    // With a selection from before only the coinbase (and embedded witness) is new, which is all our own making.
+    if (!pCachedSelection)
     {
-        LogPrintf("Error in CreateNewBlock: TestBlockValidity failed.\n");
-        return nullptr;
+        if (!noValidityCheck && !TestBlockValidity(*tempChain, state, chainparams, *pblock, pindexPrev_, false, false, &viewNew))
+        {
+            LogPrintf("Error in CreateNewBlock: TestBlockValidity failed.\n");
+            return nullptr;
+        }
+        if (mapTemplateSelections.size() >= MAX_TEMPLATE_SELECTIONS)
+            mapTemplateSelections.clear();
+        mapTemplateSelections[pParent->GetBlockHashPoW2()] = std::move(selection);
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants%s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, pCachedSelection ? ", reused" : "", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
-{
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-        // Only test txs not already in the block
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        }
-        else {
-            iit++;
-        }
-    }
-}
-
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost)
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
@@ -812,12 +907,10 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
+        // Everything in the block came in with all its ancestors, so the ancestors that are still needed are found without
+        // walking back through the (often long) chains that are already in.
         CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-
-        onlyUnconfirmed(ancestors);
+        mempool.CalculateMemPoolAncestorsExcept(iter, ancestors, inBlock);
         ancestors.insert(iter);
 
         // Test if all tx's are Final
@@ -980,8 +1073,9 @@ CBlockIndex* FindMiningTip(CBlockIndex* pIndexParent, const CChainParams& chainp
                         if (!pWitnessBlockToEmbed)
                         {
                             std::shared_ptr<CBlock> pBlockPoWParent(new CBlock);
-                            LOCK(cs_main); // For ReadBlockFromDisk
-                            if (ReadBlockFromDisk(*pBlockPoWParent.get(), pIndexParent, Params()))
+                            LOCK(cs_main); // For ReadBlockPrefixFromDisk
+                            // Only the coinbase and the witness coinbase are needed to extract the embedded witness.
+                            if (ReadBlockPrefixFromDisk(*pBlockPoWParent.get(), pIndexParent, 2))
                             {
                                 int nWitnessCoinbaseIndex = GetPoW2WitnessCoinbaseIndex(*pBlockPoWParent.get());
                                 if (nWitnessCoinbaseIndex != -1)
@@ -1049,9 +1143,26 @@ double dBestHashesPerSec = 0.0;
 double dRollingHashesPerSec = 0.0;
 double dHashesPerSec = 0.0;
 int64_t nArenaSetupTime = 0;
+std::atomic<int> nArenaBacking(-1);
+std::atomic<bool> fArenaLocked(false);
+CCriticalSection cs_arenaPlan;
+sigma_arena_plan arenaPlan;
+
+CCriticalSection cs_numaHashesPerSec;
+std::map<int, double> mapNumaNodeHashesPerSec;
+CCriticalSection cs_arenaUtilisation;
+std::vector<CMiningArenaUtilisation> vArenaUtilisation;
+std::string strLastMiningRestartReason;
+
+std::string GetArenaBackingName()
+{
+    int backing = nArenaBacking;
+    if (backing < 0)
+        return "none";
+    return sigmaArenaBackingName((sigma_arena_backing)backing);
+}
 int64_t nHPSTimerStart = 0;
-int64_t nHashCounter=0;
-std::atomic<int64_t> nHashThrottle(-1);
+sigma_throttle miningThrottle;
 static CCriticalSection timerCS;
 
 inline void updateHashesPerSec(uint64_t& nStart, uint64_t nStop, uint64_t nCount)
@@ -1073,11 +1184,272 @@ inline void updateHashesPerSec(uint64_t& nStart, uint64_t nStop, uint64_t nCount
 
 static const unsigned int hashPSTimerInterval = 200;
 
+// How often the mining supervisor wakes up by itself (to update hash rate and check for timeout/difficulty drop), in the absence of any signal.
+static const int64_t nMiningSupervisorIntervalMs = 500;
+
+// Wakes the mining supervisor as soon as something happens that may require it to abandon its current work.
+class CMiningWakeup : public CValidationInterface
+{
+public:
+    void notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fSignalled = true;
+        }
+        cond.notify_all();
+    }
+    // Wait until notified or until nTimeoutMs has passed, returns true if notified.
+    bool wait(int64_t nTimeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool fRet = cond.wait_for(lock, std::chrono::milliseconds(nTimeoutMs), [this]{ return fSignalled; });
+        fSignalled = false;
+        return fRet;
+    }
+protected:
+    void UpdatedBlockTip([[maybe_unused]] const CBlockIndex *pindexNew, [[maybe_unused]] const CBlockIndex *pindexFork, [[maybe_unused]] bool fInitialDownload) override
+    {
+        notify();
+    }
+    // Also fires for blocks that don't change the tip, which is what a new top level witness orphan looks like.
+    // This is signalled with cs_main held and the block is only added to setBlockIndexCandidates after, but GetTopLevelWitnessOrphans takes cs_main so will see it.
+    void NewPoWValidBlock([[maybe_unused]] const CBlockIndex *pindex, [[maybe_unused]] const std::shared_ptr<const CBlock>& block) override
+    {
+        notify();
+    }
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool fSignalled = false;
+};
+static CMiningWakeup miningWakeup;
+
+static uint64_t sumHalfHashes(const std::vector<std::atomic<uint64_t>>& contextHalfHashCounters)
+{
+    uint64_t nTotal = 0;
+    for (const auto& counter : contextHalfHashCounters)
+        nTotal += counter;
+    return nTotal;
+}
+
+static void updateNumaHashesPerSec(const std::vector<std::unique_ptr<sigma_context>>& sigmaContexts, const std::vector<std::atomic<uint64_t>>& contextHalfHashCounters, uint64_t nStart, uint64_t nStop)
+{
+    if (nStop <= nStart)
+        return;
+    std::map<int, double> mapHashesPerSec;
+    for (uint64_t i=0; i<sigmaContexts.size(); ++i)
+    {
+        if (sigmaContexts[i]->numaNode >= 0)
+            mapHashesPerSec[sigmaContexts[i]->numaNode] += (contextHalfHashCounters[i]*1000.0) / (nStop-nStart);
+    }
+    LOCK(cs_numaHashesPerSec);
+    mapNumaNodeHashesPerSec = mapHashesPerSec;
+}
+
+// All contexts are prepared for the same header, so give each a disjoint share of the pre nonces in proportion to its threads so that they all exhaust their share at about the same time.
+static void SplitPreNonces(const std::vector<std::unique_ptr<sigma_context>>& sigmaContexts, std::vector<CMiningArenaUtilisation>& utilisation)
+{
+    utilisation.assign(sigmaContexts.size(), CMiningArenaUtilisation());
+    uint64_t nTotalThreads = 0;
+    for (const auto& sigmaContext : sigmaContexts)
+        nTotalThreads += sigmaContext->numThreads;
+    uint64_t nStart = 0;
+    uint64_t nAssignedThreads = 0;
+    for (uint64_t i=0; i<sigmaContexts.size(); ++i)
+    {
+        nAssignedThreads += sigmaContexts[i]->numThreads;
+        uint64_t nEnd = (i+1 == sigmaContexts.size()) ? defaultSigmaSettings.numHashesPre : (defaultSigmaSettings.numHashesPre*nAssignedThreads)/std::max(nTotalThreads, (uint64_t)1);
+        utilisation[i].nArenaSizeKb = sigmaContexts[i]->allocatedArenaSizeKb;
+        utilisation[i].nThreads = sigmaContexts[i]->numThreads;
+        utilisation[i].nNumaNode = sigmaContexts[i]->numaNode;
+        utilisation[i].nPreNonceStart = nStart;
+        utilisation[i].nPreNonceCount = nEnd - nStart;
+        nStart = nEnd;
+    }
+}
+
+static void updateArenaUtilisation(const std::vector<CMiningArenaUtilisation>& utilisation, const std::vector<std::atomic<uint64_t>>& contextPreNoncesDone, const std::vector<std::atomic<uint64_t>>& contextHalfHashCounters)
+{
+    LOCK(cs_arenaUtilisation);
+    vArenaUtilisation = utilisation;
+    for (uint64_t i=0; i<vArenaUtilisation.size(); ++i)
+    {
+        vArenaUtilisation[i].nPreNoncesDone = contextPreNoncesDone[i];
+        vArenaUtilisation[i].nHalfHashes = contextHalfHashCounters[i];
+    }
+}
+
+// Standby arenas older than this are discarded and regenerated, so that a switch never resurrects a stale template.
+static const int64_t nStandbyArenaMaxAgeMs = 60000;
+
+// Size the arenas from what the machine can actually hold (see sigmaPlanArenas) and allocate them.
+// Should an allocation still fail (e.g. memory was taken by something else in the meantime) that context is retried in smaller steps.
+static void AllocateSigmaContexts(std::vector<std::unique_ptr<sigma_context>>& sigmaContexts, uint64_t nThreads, uint64_t nMemoryKb)
+{
+    bool fLargePages = GetBoolArg("-genlargepages", DEFAULT_GENERATE_LARGE_PAGES);
+    bool fLockMemory = GetBoolArg("-genlockmemory", DEFAULT_GENERATE_LOCK_MEMORY);
+    uint64_t nArenaSets = GetBoolArg("-genarenadoublebuffer", DEFAULT_GENERATE_ARENA_DOUBLE_BUFFER) ? 2 : 1;
+
+    std::vector<sigma_numa_node> numaNodes;
+    if (GetBoolArg("-gennuma", DEFAULT_GENERATE_NUMA))
+    {
+        numaNodes = sigmaNumaNodes();
+        if (numaNodes.size() < 2)
+        {
+            LogPrintf("GuldenGenerate: -gennuma specified but no NUMA topology detected, ignoring\n");
+            numaNodes.clear();
+        }
+    }
+
+    sigma_arena_plan plan = sigmaPlanArenas(defaultSigmaSettings, nMemoryKb, nThreads, nArenaSets, fLargePages, sigmaMemoryInfo(), numaNodes);
+    LogPrintf("GuldenGenerate: arena plan: %s\n", plan.ToString());
+    if (plan.budgetKb < plan.requestedKb)
+        LogPrintf("GuldenGenerate: -genmemlimit exceeds what this machine can hold without swapping, mining with %d MB instead\n", plan.plannedKb/1024);
+    if (nArenaSets > 1)
+        LogPrintf("GuldenGenerate: -genarenadoublebuffer keeps a second set of arenas, using %d MB of arena memory in total (twice the plan)\n", nArenaSets*plan.plannedKb/1024);
+    {
+        LOCK(cs_arenaPlan);
+        arenaPlan = plan;
+    }
+
+    for (const auto& plannedContext : plan.contexts)
+    {
+        uint64_t trySizeBytes = plannedContext.arenaSizeKb*1024;
+        while (trySizeBytes > 0)
+        {
+            normaliseBufferSize(trySizeBytes);
+            try
+            {
+                std::unique_ptr<sigma_context> sigmaContext(new sigma_context(defaultSigmaSettings, trySizeBytes/1024, plannedContext.numThreads, fLargePages, fLockMemory));
+                if (!sigmaContext->arenaIsValid())
+                    throw std::bad_alloc();
+                if (trySizeBytes/1024 < plannedContext.arenaSizeKb)
+                    LogPrintf("GuldenGenerate: could only allocate %d of %d MB planned for arena %d\n", trySizeBytes/1024/1024, plannedContext.arenaSizeKb/1024, sigmaContexts.size());
+                // Bind before the arena is first touched so that its pages are faulted in on the right node.
+                for (const auto& node : numaNodes)
+                {
+                    if (node.node == plannedContext.numaNode)
+                    {
+                        bool fBound = sigmaContext->bindToNumaNode(node);
+                        LogPrintf("GuldenGenerate: arena %d assigned to NUMA node %d (%d cpus)%s\n", sigmaContexts.size(), node.node, node.cpus.size(), fBound ? "" : ", memory binding failed");
+                    }
+                }
+                sigmaContexts.push_back(std::move(sigmaContext));
+                break;
+            }
+            catch (...)
+            {
+                // reduce by 256mb and try again.
+                if (trySizeBytes < 256*1024*1024)
+                    break;
+                trySizeBytes -= 256*1024*1024;
+            }
+        }
+    }
+
+    if (!sigmaContexts.empty())
+    {
+        sigma_arena_backing backing = sigmaContexts[0]->arenaBacking;
+        bool locked = true;
+        for (const auto& sigmaContext : sigmaContexts)
+        {
+            backing = std::min(backing, sigmaContext->arenaBacking);
+            locked = locked && sigmaContext->arenaLocked;
+        }
+        nArenaBacking = backing;
+        fArenaLocked = locked;
+        LogPrintf("GuldenGenerate: allocated %d arena(s), backing: %s%s\n", sigmaContexts.size(), sigmaArenaBackingName(backing), locked ? ", locked" : "");
+    }
+}
+
+// A second set of arenas (-genarenadoublebuffer) that is filled in the background, for a fresh template on the same parent, while the active set is being mined.
+// Every restart that keeps the parent (timeout, difficulty drop, another unwitnessed block at our height) can then swap it in and resume hashing immediately.
+struct CSigmaStandbyArenas
+{
+    std::vector<std::unique_ptr<sigma_context>> sigmaContexts;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    CBlockIndex* pindexParent = nullptr;
+    CBlockIndex* pWitnessBlockToEmbed = nullptr;
+    std::atomic<int64_t> nPreparedTime{0};
+    std::atomic<bool> ready{false};
+    std::atomic<bool> finished{false};
+    std::atomic<bool> interrupt{false};
+    std::thread preparer;
+
+    bool matches(const CBlockIndex* pindexParent_, const CBlockIndex* pWitnessBlockToEmbed_) const
+    {
+        return pindexParent == pindexParent_ && pWitnessBlockToEmbed == pWitnessBlockToEmbed_;
+    }
+    bool expired() const
+    {
+        return GetTimeMillis() - nPreparedTime > nStandbyArenaMaxAgeMs;
+    }
+    // Abort (if running) and wait for the preparer; the contexts are kept for reuse.
+    void cancel()
+    {
+        interrupt = true;
+        if (preparer.joinable())
+            preparer.join();
+        pblocktemplate.reset();
+        pindexParent = pWitnessBlockToEmbed = nullptr;
+        ready = finished = interrupt = false;
+    }
+    ~CSigmaStandbyArenas()
+    {
+        cancel();
+    }
+};
+
+static void LaunchStandbyArenas(CSigmaStandbyArenas& standby, CBlockIndex* pindexParent, CBlockIndex* pWitnessBlockToEmbed, std::shared_ptr<CReserveKeyOrScript> coinbaseScript, uint256 activeHeaderHash, uint64_t nThreads, uint64_t nMemoryKb)
+{
+    standby.pindexParent = pindexParent;
+    standby.pWitnessBlockToEmbed = pWitnessBlockToEmbed;
+    standby.preparer = std::thread([&standby, pindexParent, pWitnessBlockToEmbed, coinbaseScript, activeHeaderHash, nThreads, nMemoryKb]()
+    {
+        RenameThread("gulden-arena-standby");
+        BOOST_SCOPE_EXIT(&standby) { standby.finished = true; } BOOST_SCOPE_EXIT_END
+
+        if (standby.sigmaContexts.empty())
+            AllocateSigmaContexts(standby.sigmaContexts, nThreads, nMemoryKb);
+        if (standby.sigmaContexts.empty())
+            return;
+
+        std::unique_ptr<CBlockTemplate> pblocktemplate;
+        {
+            LOCK(processBlockCS);
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(pindexParent, coinbaseScript, true, pWitnessBlockToEmbed);
+        }
+        if (!pblocktemplate.get())
+            return;
+        CBlock* pblock = &pblocktemplate->block;
+        pblock->hashMerkleRoot = BlockMerkleRoot(pblock->vtx.begin(), pblock->vtx.end());
+        // An identical header would only repeat the search space of the active arenas.
+        if (pblock->GetHashLegacy() == activeHeaderHash)
+            return;
+        standby.nPreparedTime = GetTimeMillis();
+
+        // Leave most of the cores to the active arenas, which are mining in the meantime.
+        CBlockHeader header = pblock->GetBlockHeader();
+        uint64_t nPrepareThreads = std::max((uint64_t)1, nThreads/4);
+        for (const auto& sigmaContext : standby.sigmaContexts)
+        {
+            if (!sigmaContext->prepareArenas(header, nPrepareThreads, &standby.interrupt))
+                return;
+        }
+        standby.pblocktemplate = std::move(pblocktemplate);
+        standby.ready = true;
+    });
+}
+
 void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount, uint64_t nThreads, uint64_t nMemoryKb)
 {
     LogPrintf("GuldenGenerate started\n");
     RenameThread("gulden-generate");
 
+    RegisterValidationInterface(&miningWakeup);
+    BOOST_SCOPE_EXIT(void) { UnregisterValidationInterface(&miningWakeup); } BOOST_SCOPE_EXIT_END
+
     int64_t nUpdateTimeStart = GetTimeMillis();
 
     static bool testnet = IsArgSet("-testnet");
@@ -1109,6 +1481,10 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
         if (!coinbaseScript || coinbaseScript->reserveScript.empty())
             throw std::runtime_error("No coinbase script available (mining requires a wallet)");
 
+        // Arenas are multiple gigabytes, so allocate them once and reuse them for every block we mine.
+        std::vector<std::unique_ptr<sigma_context>> sigmaContexts;
+        bool fDoubleBufferArenas = GetBoolArg("-genarenadoublebuffer", DEFAULT_GENERATE_ARENA_DOUBLE_BUFFER);
+        CSigmaStandbyArenas standby;
 
         while (true)
         {
@@ -1160,6 +1536,27 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
             }
 
             std::unique_ptr<CBlockTemplate> pblocktemplate;
+            bool fStandbyArenas = false;
+            if (fDoubleBufferArenas && standby.matches(pindexParent, pWitnessBlockToEmbed))
+            {
+                if (standby.ready && !standby.expired())
+                {
+                    standby.preparer.join();
+                    pblocktemplate = std::move(standby.pblocktemplate);
+                    std::swap(sigmaContexts, standby.sigmaContexts);
+                    standby.cancel();
+                    fStandbyArenas = true;
+                }
+                else if (standby.finished)
+                {
+                    standby.cancel();
+                }
+            }
+            else if (standby.preparer.joinable())
+            {
+                standby.cancel();
+            }
+            if (!fStandbyArenas)
             {
                 TRY_LOCK(processBlockCS, lockProcessBlock);
                 if(!lockProcessBlock)
@@ -1177,64 +1574,33 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
                 }
             }
             CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexParent, nExtraNonce);
+            if (!fStandbyArenas)
+                IncrementExtraNonce(pblock, pindexParent, nExtraNonce);
 
             //
             // Search
             //
             uint64_t nStart = GetTimeMillis();
-            //fixme: (2.1) Do away with this timeout once witness timestamps are available
-            std::uint64_t nTimeout =  120000 + GetRand(60000);
             std::uint64_t nMissedSteps = CalculateMissedTimeSteps(GetAdjustedFutureTime(), pindexParent->GetBlockTime());
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
             if (pblock->nTime > defaultSigmaSettings.activationDate)
             {
-                std::vector<std::unique_ptr<sigma_context>> sigmaContexts;
-                std::vector<uint64_t> sigmaMemorySizes;
-                uint64_t nMemoryAllocatedKb=0;
-                
-                
-                while (nMemoryAllocatedKb < nMemoryKb)
-                {
-                    uint64_t nMemoryChunkKb = std::min((nMemoryKb-nMemoryAllocatedKb), defaultSigmaSettings.arenaSizeKb);
-                    nMemoryAllocatedKb += nMemoryChunkKb;
-                    sigmaMemorySizes.emplace_back(nMemoryChunkKb);
-                }
-                //fixme: (SIGMA) - better memory size handling - right now we just blindly allocate until we succeed...
-                //And we don't even attempt to account for swap, so if the user sets a memory size too large for system memory we will just happily swap and perform worse than if the user picked a more reasonable size.
-                for (auto instanceMemorySizeKb : sigmaMemorySizes)
-                {
-                    uint64_t trySizeBytes = instanceMemorySizeKb*1024;
-                    while (trySizeBytes > 0)
-                    {
-                        normaliseBufferSize(trySizeBytes);
-                        try
-                        {
-                            sigmaContexts.push_back(std::unique_ptr<sigma_context>(new sigma_context(defaultSigmaSettings, trySizeBytes/1024, nThreads/sigmaMemorySizes.size())));
-                            break;
-                        }
-                        catch (...)
-                        {
-                            // reduce by 256mb and try again.
-                            if (trySizeBytes < 256*1024*1024)
-                                break;
-                            trySizeBytes -= 256*1024*1024;
-                        }
-                    }
-                }
-                
-                // Prepare arenas
+                if (sigmaContexts.empty())
+                    AllocateSigmaContexts(sigmaContexts, nThreads, nMemoryKb);
+
+                // Prepare arenas (unless the standby set was swapped in, in which case they are ready already)
                 CBlockHeader header = pblock->GetBlockHeader();
+                if (!fStandbyArenas)
                 {
-                    auto workerThreads = new boost::asio::thread_pool(nThreads);
+                    CTaskGroup prepare(GetExecutor(), EXECUTOR_MINING);
                     for (const auto& sigmaContext : sigmaContexts)
                     {
-                        boost::asio::post(*workerThreads, [&, header]() mutable
+                        prepare.Run([&, header]() mutable
                         {
                             sigmaContext->prepareArenas(header);
                         });
                     }
-                    workerThreads->join();
+                    prepare.Wait();
                 }
                 nArenaSetupTime = GetTimeMillis() - nStart;
                 
@@ -1243,69 +1609,112 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
                     //fixme: (SIGMA) use hash instead of bool so we can log it
                     //fixme: (SIGMA) set limitdeltadiffdrop for mining from wallet (SoftSetArg)
                     uint256 foundBlockHash;
-                    std::atomic<uint64_t> halfHashCounter=0;
+                    // One counter per context, so that contexts on different NUMA nodes don't contend for the same cache line and so that we can report per node.
+                    std::vector<std::atomic<uint64_t>> contextHalfHashCounters(sigmaContexts.size());
+                    std::vector<std::atomic<uint64_t>> contextPreNoncesDone(sigmaContexts.size());
+                    std::vector<CMiningArenaUtilisation> utilisation;
+                    SplitPreNonces(sigmaContexts, utilisation);
                     std::atomic<uint64_t> nThreadCounter=0;
                     bool interrupt = false;
+                    std::string strRestartReason;
+
+                    // Every worker thread of every context gets its own slot in the throttle.
+                    std::vector<uint64_t> contextThrottleSlots;
+                    uint64_t nThrottleSlots = 0;
+                    for (const auto& sigmaContext : sigmaContexts)
+                    {
+                        contextThrottleSlots.push_back(nThrottleSlots);
+                        nThrottleSlots += sigmaContext->numThreads;
+                    }
+                    miningThrottle.startRound(nThrottleSlots);
                     
                     auto workerThreads = new boost::asio::thread_pool(nThreads);
-                    for (const auto& sigmaContext : sigmaContexts)
+                    for (uint64_t nContextIndex=0; nContextIndex<sigmaContexts.size(); ++nContextIndex)
                     {
                         ++nThreadCounter;
-                        boost::asio::post(*workerThreads, [&, header]() mutable
+                        boost::asio::post(*workerThreads, [&, header, nContextIndex]() mutable
                         {
-                            sigmaContext->mineBlock(pblock, halfHashCounter, foundBlockHash, interrupt);
+                            sigmaContexts[nContextIndex]->mineBlock(pblock, contextHalfHashCounters[nContextIndex], foundBlockHash, interrupt, utilisation[nContextIndex].nPreNonceStart, utilisation[nContextIndex].nPreNonceCount, &contextPreNoncesDone[nContextIndex], &miningThrottle, contextThrottleSlots[nContextIndex]);
                             --nThreadCounter;
+                            miningWakeup.notify();
                         });
                     }
                     {
                         // If this thread gets interrupted then terminate mining
                         BOOST_SCOPE_EXIT(&workerThreads, &interrupt) { interrupt=true; workerThreads->stop(); workerThreads->join(); delete workerThreads;} BOOST_SCOPE_EXIT_END
-                        int nCount = 0;
+                        uint64_t nLastPeriodicCheck = GetTimeMillis();
                         while (true)
-                        {    
-                            //fixme: (SIGMA) - Instead of busy polling it would be better if we could wait here on various signals, we would need to wait on several signals
-                            // 1) A signal for block found by one of our mining threads
-                            // 2) A signal for chain tip change
-                            // 3) A signal for 'top level witness orphan' changes
-                            MilliSleep(100);
+                        {
+                            // Sleep until a mining thread finishes (block found or work exhausted), the chain tip changes or a new block arrives that could be a witness orphan; or until the periodic checks are due.
+                            bool fSignalled = miningWakeup.wait(nMiningSupervisorIntervalMs);
 
-                            // If we have found a block then exit loop and process it immediately
-                            if (foundBlockHash != uint256())
-                                break;
-                            
-                            //fixme: (SIGMA) - This can be improved in cases where we have 'uneven' contexts, one may still have lots of work when another is finished, we might want to only restart one of them and not both...
-                            // If at least one of the threads is done working then abandon the rest of them, and then see if we have found a block or need to start again with a different block etc.
-                            if (nThreadCounter < sigmaContexts.size())
+                            // Keep a standby set of arenas ready for the next restart on this parent.
+                            if (fDoubleBufferArenas)
                             {
-                                break;
+                                if (standby.finished && (!standby.ready || standby.expired()))
+                                    standby.cancel();
+                                // Only worth it once a restart on this same parent is in sight, i.e. the nonce space is about to run out or difficulty is about to drop; otherwise the standby set would just expire and be regenerated over and over at the expense of the hash rate.
+                                bool fRestartInSight = CalculateMissedTimeSteps(GetAdjustedFutureTime() + nStandbyArenaMaxAgeMs/2000, pindexParent->GetBlockTime()) != nMissedSteps;
+                                uint64_t nPreNoncesDone = 0;
+                                for (const auto& done : contextPreNoncesDone)
+                                    nPreNoncesDone += done;
+                                if (nPreNoncesDone > 0)
+                                {
+                                    uint64_t nElapsed = GetTimeMillis() - nStart;
+                                    uint64_t nRemaining = (nElapsed * (defaultSigmaSettings.numHashesPre - std::min(nPreNoncesDone, defaultSigmaSettings.numHashesPre))) / nPreNoncesDone;
+                                    fRestartInSight = fRestartInSight || nRemaining < (uint64_t)nStandbyArenaMaxAgeMs/2;
+                                }
+                                if (fRestartInSight && !standby.preparer.joinable() && GetAdjustedFutureTime() > pblock->nTime)
+                                    LaunchStandbyArenas(standby, pindexParent, pWitnessBlockToEmbed, coinbaseScript, pblock->GetHashLegacy(), nThreads, nMemoryKb);
                             }
 
-                            // Abort for timestamp update if its been longer than ~3 minutes; but only if difficulty reduction has not yet kicked in and we are on a machine that generated arenas 'quickly'
-                            // Randomly stagger the checks so that all miners perform slightly differently.
-                            if (nMissedSteps == 0 && nArenaSetupTime < 5000.0 && (GetTimeMillis() - nStart > nTimeout))
+                            // If we have found a block then exit loop and process it immediately
+                            if (foundBlockHash != uint256())
                             {
+                                strRestartReason = "block_found";
                                 break;
                             }
                             
-                            // Abort mining and start mining a new block instead if chain tip changed
+                            // Regenerating the arenas costs far more than the hashes they still have to offer, so we only move on to a new header (and with it a new timestamp) once every context has exhausted its share of the nonce space.
+                            //fixme: (SIGMA) - With 'uneven' contexts the ones that finish first sit idle until the rest are done, we could hand them part of the remaining range instead.
+                            if (nThreadCounter == 0)
                             {
-                                LOCK(cs_main);
-                                if (pTipAtStartOfMining != chainActive.Tip())
-                                    break;
+                                strRestartReason = "exhausted";
+                                break;
                             }
                             
-                            // Abort mining and start mining a new block instead if alternative chain tip changed
-                            if (nOrphansAtStartOfMining != GetTopLevelWitnessOrphans(pTipAtStartOfMining->nHeight).size())
+                            // Chain state can only have changed if we were signalled, so only then do we need cs_main.
+                            if (fSignalled)
                             {
-                                nOrphansAtStartOfMining = GetTopLevelWitnessOrphans(pTipAtStartOfMining->nHeight).size();
-                                if (pindexParent != FindMiningTip(pindexParent, chainparams, strError, pWitnessBlockToEmbed))
-                                    break;
+                                // Abort mining and start mining a new block instead if chain tip changed
+                                {
+                                    LOCK(cs_main);
+                                    if (pTipAtStartOfMining != chainActive.Tip())
+                                    {
+                                        strRestartReason = "tip_changed";
+                                        break;
+                                    }
+                                }
+
+                                // Abort mining and start mining a new block instead if alternative chain tip changed
+                                uint64_t nOrphans = GetTopLevelWitnessOrphans(pTipAtStartOfMining->nHeight).size();
+                                if (nOrphansAtStartOfMining != nOrphans)
+                                {
+                                    nOrphansAtStartOfMining = nOrphans;
+                                    if (pindexParent != FindMiningTip(pindexParent, chainparams, strError, pWitnessBlockToEmbed))
+                                    {
+                                        strRestartReason = "witness_orphan";
+                                        break;
+                                    }
+                                }
                             }
-                            
-                            if (++nCount>5)
+
+                            if (GetTimeMillis() - nLastPeriodicCheck >= nMiningSupervisorIntervalMs)
                             {
-                                updateHashesPerSec(nStart, GetTimeMillis(), halfHashCounter);
-                                nCount=0;
+                                updateHashesPerSec(nStart, GetTimeMillis(), sumHalfHashes(contextHalfHashCounters));
+                                updateNumaHashesPerSec(sigmaContexts, contextHalfHashCounters, nStart, GetTimeMillis());
+                                updateArenaUtilisation(utilisation, contextPreNoncesDone, contextHalfHashCounters);
+                                nLastPeriodicCheck = GetTimeMillis();
                                 
                                 // Abort for timestamp update if difficulty has dropped
                                 std::uint64_t nUpdateMissedSteps = CalculateMissedTimeSteps(GetAdjustedFutureTime(), pindexParent->GetBlockTime());
@@ -1315,6 +1724,7 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
                                     //For machines with really slow arena setup time we only apply this for every second missed step, but starting from the first one.
                                     if (nUpdateMissedSteps % 2 == 1 || nArenaSetupTime < 30000.0)
                                     {
+                                        strRestartReason = "difficulty_drop";
                                         break;
                                     }
                                 }
@@ -1324,7 +1734,13 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
                             boost::this_thread::interruption_point();
                         }
                     
-                        updateHashesPerSec(nStart, GetTimeMillis(), halfHashCounter);
+                        updateHashesPerSec(nStart, GetTimeMillis(), sumHalfHashes(contextHalfHashCounters));
+                        updateArenaUtilisation(utilisation, contextPreNoncesDone, contextHalfHashCounters);
+                        {
+                            LOCK(cs_arenaUtilisation);
+                            strLastMiningRestartReason = strRestartReason;
+                        }
+                        LogPrint(BCLog::BENCH, "GuldenGenerate: mining round ended after %dms (%s)\n", GetTimeMillis() - nStart, strRestartReason);
 
                         if (foundBlockHash != uint256())
                         {
@@ -1352,6 +1768,9 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
             {
                 // Check if something found
                 arith_uint256 hashMined;
+                const bool fNoInterrupt = false;
+                miningThrottle.startRound(1);
+                miningThrottle.pace(0, 0, fNoInterrupt);
                 while (true)
                 {
                     // Check for stop or if block needs to be rebuilt
@@ -1363,12 +1782,6 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
                         if (UpdateTime(pblock, chainparams.GetConsensus(), pindexParent) < 0)
                             break; // Recreate the block if the clock has run backwards,so that we can use the correct time.
                     }
-                    if (nHashThrottle != -1 && nHashCounter > nHashThrottle)
-                    {
-                        MilliSleep(50);
-                        continue;
-                    }
-
                     hashMined = UintToArith256(pblock->GetPoWHash());
 
                     if (hashMined <= hashTarget)
@@ -1392,7 +1805,7 @@ void static GuldenGenerate(const CChainParams& chainparams, CAccount* forAccount
                         }
                     }
                     pblock->nNonce += 1;
-                    ++nHashCounter;
+                    miningThrottle.pace(0, 1, fNoInterrupt);
 
                     if (pblock->nNonce >= 0xffff0000)
                         break;
@@ -1428,8 +1841,9 @@ void PoWStopGeneration()
     fixedGenerateAddress="";
     if (minerThread != nullptr)
     {
-        //fixme: (SIGMA) - The interrupt here doesn't work fast enough.
         minerThread->interrupt();
+        // Don't wait for the supervisor to wake up by itself.
+        miningWakeup.notify();
         minerThread->join();
         delete minerThread;
         minerThread = nullptr;
@@ -17,9 +17,11 @@
 #include "txmempool.h"
 
 #include "generation/generation.h"
+#include "crypto/hash/sigma/sigma.h"
 
 #include <stdint.h>
 #include <memory>
+#include <map>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
@@ -36,8 +38,34 @@ extern double dBestHashesPerSec;
 extern double dRollingHashesPerSec;
 extern double dHashesPerSec;
 extern int64_t nArenaSetupTime;
+// Memory backing of the most recently allocated mining arenas (a sigma_arena_backing, weakest across all contexts; -1 if none allocated yet) and whether they were all locked into memory.
+extern std::atomic<int> nArenaBacking;
+extern std::atomic<bool> fArenaLocked;
+std::string GetArenaBackingName();
+// The arena layout picked for the most recent allocation of mining arenas (empty if none allocated yet).
+extern CCriticalSection cs_arenaPlan;
+extern sigma_arena_plan arenaPlan;
+// How far each mining arena has got through the nonce space of the header it was prepared for, for the current (or most recent) mining round.
+struct CMiningArenaUtilisation
+{
+    uint64_t nArenaSizeKb = 0;
+    uint64_t nThreads = 0;
+    int nNumaNode = -1;
+    uint64_t nPreNonceStart = 0;
+    uint64_t nPreNonceCount = 0;
+    uint64_t nPreNoncesDone = 0;
+    uint64_t nHalfHashes = 0;
+};
+extern CCriticalSection cs_arenaUtilisation;
+extern std::vector<CMiningArenaUtilisation> vArenaUtilisation;
+// Why the previous mining round ended and the arenas were regenerated (empty if none has ended yet), guarded by cs_arenaUtilisation.
+extern std::string strLastMiningRestartReason;
+// Hash rate per NUMA node of the current mining round, only populated when mining with -gennuma on a NUMA machine.
+extern CCriticalSection cs_numaHashesPerSec;
+extern std::map<int, double> mapNumaNodeHashesPerSec;
 extern int64_t nHPSTimerStart;
-extern std::atomic<int64_t> nHashThrottle;
+// Limits for how fast mining may go, see sethashlimit.
+extern sigma_throttle miningThrottle;
 
 bool ProcessBlockFound(const std::shared_ptr<const CBlock> pblock, const CChainParams& chainparams);
 
@@ -45,6 +73,12 @@ namespace Consensus { struct Params; };
 
 static const bool DEFAULT_GENERATE = false;
 static const int DEFAULT_GENERATE_THREADS = 1;
+static const bool DEFAULT_GENERATE_ARENA_DOUBLE_BUFFER = false;
+static const bool DEFAULT_GENERATE_LARGE_PAGES = true;
+static const bool DEFAULT_GENERATE_LOCK_MEMORY = false;
+static const bool DEFAULT_GENERATE_NUMA = false;
+static const int64_t DEFAULT_GENERATE_HASH_LIMIT = 0;
+static const int64_t DEFAULT_GENERATE_DUTY_CYCLE = 100;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
@@ -223,8 +257,6 @@ private:
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, std::vector<CTransactionRef>* pCannabalizeTransactions = nullptr, CCoinsViewCache* pViewIn=nullptr);
 
     // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
     /** Perform checks on each transaction in a package:
@@ -0,0 +1,759 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "generation/poolserver.h"
+#include "generation/generation.h"
+#include "generation/miner.h"
+
+#include "base58.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "crypto/common.h"
+#include "netbase.h"
+#include "pow.h"
+#include "random.h"
+#include "streams.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation/validation.h"
+#include "validation/validationinterface.h"
+#include "validation/witnessvalidation.h"
+
+#include <univalue.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+// Longest request line we accept before dropping the connection (a submit is well under 200 bytes).
+static const size_t MAX_POOL_LINE_LENGTH = 4096;
+// How often the server checks whether the work it hands out is still current.
+static const int64_t nPoolWorkCheckIntervalMs = 500;
+// Push a refreshed job (new transactions, same parent) at most this often.
+static const int64_t nPoolWorkRefreshIntervalSeconds = 60;
+// Jobs for the same parent stay valid for shares after a refresh, up to this many.
+static const size_t MAX_POOL_JOBS_PER_PARENT = 4;
+
+// Stratum error codes.
+static const int POOL_ERROR_OTHER = 20;
+static const int POOL_ERROR_JOB_NOT_FOUND = 21;
+static const int POOL_ERROR_DUPLICATE_SHARE = 22;
+static const int POOL_ERROR_LOW_DIFFICULTY = 23;
+static const int POOL_ERROR_UNAUTHORIZED = 24;
+static const int POOL_ERROR_NOT_SUBSCRIBED = 25;
+
+CPoolPreNonceAllocator::CPoolPreNonceAllocator(uint32_t nRangeSize_, uint32_t nMaxGroups_)
+: nRangeSize(std::max<uint32_t>(1, std::min(nRangeSize_, POOL_PRENONCE_SPACE)))
+, nSlotsPerGroup(POOL_PRENONCE_SPACE / nRangeSize)
+, nMaxGroups(std::max<uint32_t>(1, nMaxGroups_))
+{
+}
+
+bool CPoolPreNonceAllocator::Allocate(uint32_t nRequested, uint32_t& nGroup, uint32_t& nStart, uint32_t& nCount)
+{
+    uint32_t nSlots = std::max<uint32_t>(1, (nRequested + nRangeSize - 1) / nRangeSize);
+    nSlots = std::min(nSlots, nSlotsPerGroup);
+
+    // First fit, so that sessions are packed into as few header variants (and therefore arenas) as possible.
+    for (uint32_t nGroupIndex = 0; nGroupIndex < nMaxGroups; ++nGroupIndex)
+    {
+        if (nGroupIndex == groups.size())
+            groups.emplace_back(nSlotsPerGroup, false);
+        std::vector<bool>& slots = groups[nGroupIndex];
+        uint32_t nRun = 0;
+        for (uint32_t nSlot = 0; nSlot < nSlotsPerGroup; ++nSlot)
+        {
+            nRun = slots[nSlot] ? 0 : nRun + 1;
+            if (nRun == nSlots)
+            {
+                uint32_t nFirst = nSlot + 1 - nSlots;
+                for (uint32_t i = nFirst; i <= nSlot; ++i)
+                    slots[i] = true;
+                nGroup = nGroupIndex;
+                nStart = nFirst * nRangeSize;
+                nCount = nSlots * nRangeSize;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CPoolPreNonceAllocator::Release(uint32_t nGroup, uint32_t nStart, uint32_t nCount)
+{
+    if (nGroup >= groups.size())
+        return;
+    for (uint32_t nSlot = nStart / nRangeSize; nSlot < (nStart + nCount) / nRangeSize && nSlot < nSlotsPerGroup; ++nSlot)
+        groups[nGroup][nSlot] = false;
+}
+
+uint32_t CPoolPreNonceAllocator::ActiveGroups() const
+{
+    uint32_t nActive = 0;
+    for (const auto& slots : groups)
+    {
+        if (std::find(slots.begin(), slots.end(), true) != slots.end())
+            ++nActive;
+    }
+    return nActive;
+}
+
+// Give every header variant its own coinbase, and therefore merkle root and arena.
+static void SetCoinbaseExtraNonce(CBlock& block, uint32_t nExtraNonce)
+{
+    CMutableTransaction coinbaseTx(*block.vtx[0]);
+    std::vector<unsigned char> extraNonce(4);
+    WriteLE32(&extraNonce[0], nExtraNonce);
+    if (coinbaseTx.vin[0].segregatedSignatureData.stack.size() >= 2)
+    {
+        // Stack is height followed by the (optional) coinbase signature, see CreateNewBlock.
+        std::vector<unsigned char>& signature = coinbaseTx.vin[0].segregatedSignatureData.stack[1];
+        signature.insert(signature.end(), extraNonce.begin(), extraNonce.end());
+    }
+    else
+    {
+        coinbaseTx.vin[0].scriptSig << extraNonce;
+    }
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+}
+
+struct CPoolJob
+{
+    std::string strId;
+    const CBlockIndex* pindexParent = nullptr;
+    std::shared_ptr<const CBlockTemplate> pTemplate;
+    // Header variant per pre nonce group, created on first use.
+    std::map<uint32_t, std::shared_ptr<CBlock>> groupBlocks;
+    // (group, nonce) of every share already accepted for this job.
+    std::set<std::pair<uint32_t, uint32_t>> submitted;
+
+    std::shared_ptr<CBlock> GetGroupBlock(uint32_t nGroup)
+    {
+        auto iter = groupBlocks.find(nGroup);
+        if (iter != groupBlocks.end())
+            return iter->second;
+        std::shared_ptr<CBlock> pBlock = std::make_shared<CBlock>(pTemplate->block);
+        SetCoinbaseExtraNonce(*pBlock, nGroup);
+        groupBlocks[nGroup] = pBlock;
+        return pBlock;
+    }
+};
+
+struct CPoolSession
+{
+    uint64_t nId = 0;
+    struct bufferevent* bev = nullptr;
+    std::string strPeer;
+    bool fSubscribed = false;
+    std::string strWorker;
+    uint32_t nGroup = 0;
+    uint32_t nPreNonceStart = 0;
+    uint32_t nPreNonceCount = 0;
+};
+
+// Remembers that the chain changed so the event loop can refresh work on its next check, without doing any work on the validation thread.
+class CPoolServerWakeup : public CValidationInterface
+{
+public:
+    std::atomic<bool> fSignalled{true};
+protected:
+    void UpdatedBlockTip([[maybe_unused]] const CBlockIndex *pindexNew, [[maybe_unused]] const CBlockIndex *pindexFork, [[maybe_unused]] bool fInitialDownload) override
+    {
+        fSignalled = true;
+    }
+    // A new top level witness orphan does not change the tip, see CMiningWakeup.
+    void NewPoWValidBlock([[maybe_unused]] const CBlockIndex *pindex, [[maybe_unused]] const std::shared_ptr<const CBlock>& block) override
+    {
+        fSignalled = true;
+    }
+};
+
+class CPoolServer
+{
+public:
+    CPoolServer(struct event_base* base_, std::shared_ptr<CReserveKeyOrScript> coinbaseScript_, uint32_t nRangeSize, uint32_t nMaxSessions_, unsigned int nShareShift_)
+    : base(base_), coinbaseScript(coinbaseScript_), allocator(nRangeSize, nMaxSessions_), nMaxSessions(nMaxSessions_), nShareShift(nShareShift_) {}
+    ~CPoolServer();
+
+    bool Listen(const CService& bindAddress, std::string& strError);
+
+    // Only ever called from the event loop thread.
+    void CheckWork();
+
+    CPoolServerWakeup wakeup;
+    CCriticalSection cs_stats;
+    PoolServerStats stats;
+private:
+    static void acceptcb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* address, int socklen, void* ctx);
+    static void readcb(struct bufferevent* bev, void* ctx);
+    static void eventcb(struct bufferevent* bev, short what, void* ctx);
+
+    void Disconnect(uint64_t nSessionId);
+    void HandleLine(CPoolSession& session, const std::string& strLine);
+    UniValue HandleSubscribe(CPoolSession& session, const UniValue& params);
+    UniValue HandleSubmit(CPoolSession& session, const UniValue& params);
+    void SendJob(CPoolSession& session, CPoolJob& job, bool fCleanJobs);
+    void Send(CPoolSession& session, const UniValue& message);
+    void CreateJob(const CBlockIndex* pindexParent, CBlockIndex* pWitnessBlockToEmbed);
+    arith_uint256 ShareTarget(const CBlock& block) const;
+    void UpdateStats();
+
+    struct event_base* base;
+    struct evconnlistener* listener = nullptr;
+    std::shared_ptr<CReserveKeyOrScript> coinbaseScript;
+    CPoolPreNonceAllocator allocator;
+    uint32_t nMaxSessions;
+    unsigned int nShareShift;
+
+    uint64_t nNextSessionId = 1;
+    std::map<uint64_t, CPoolSession> sessions;
+
+    // Oldest first; all jobs share the same parent, the last is the one being handed out.
+    std::vector<std::shared_ptr<CPoolJob>> jobs;
+    uint64_t nNextJobId = 1;
+    const CBlockIndex* pTipAtLastJob = nullptr;
+    uint64_t nOrphansAtLastJob = 0;
+    int64_t nLastJobTime = 0;
+    unsigned int nTransactionsUpdatedLast = 0;
+
+    uint64_t nSharesAccepted = 0;
+    uint64_t nSharesRejected = 0;
+    uint64_t nSharesStale = 0;
+    uint64_t nBlocksFound = 0;
+};
+
+CPoolServer::~CPoolServer()
+{
+    for (auto& [nId, session] : sessions)
+    {
+        (unused) nId;
+        bufferevent_free(session.bev);
+    }
+    sessions.clear();
+    if (listener)
+        evconnlistener_free(listener);
+}
+
+bool CPoolServer::Listen(const CService& bindAddress, std::string& strError)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!bindAddress.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+    {
+        strError = strprintf("Invalid -poolserverbind address '%s'", bindAddress.ToString());
+        return false;
+    }
+    listener = evconnlistener_new_bind(base, CPoolServer::acceptcb, this, LEV_OPT_CLOSE_ON_FREE|LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+    if (!listener)
+    {
+        strError = strprintf("Unable to bind pool server to %s", bindAddress.ToString());
+        return false;
+    }
+    return true;
+}
+
+void CPoolServer::acceptcb([[maybe_unused]] struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* address, [[maybe_unused]] int socklen, void* ctx)
+{
+    CPoolServer* self = (CPoolServer*)ctx;
+    CService peer;
+    if (address->sa_family == AF_INET)
+        peer = CService(*(const struct sockaddr_in*)address);
+    else if (address->sa_family == AF_INET6)
+        peer = CService(*(const struct sockaddr_in6*)address);
+    if (self->sessions.size() >= self->nMaxSessions)
+    {
+        LogPrint(BCLog::POOL, "pool: refusing connection from %s, -poolmaxsessions reached\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+
+    struct bufferevent* bev = bufferevent_socket_new(self->base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev)
+    {
+        evutil_closesocket(fd);
+        return;
+    }
+    CPoolSession& session = self->sessions[self->nNextSessionId];
+    session.nId = self->nNextSessionId++;
+    session.bev = bev;
+    session.strPeer = peer.ToString();
+    // There is only ever one server so the callbacks reach it through the global and only need to be told the session.
+    bufferevent_setcb(bev, CPoolServer::readcb, nullptr, CPoolServer::eventcb, (void*)session.nId);
+    bufferevent_enable(bev, EV_READ|EV_WRITE);
+    LogPrint(BCLog::POOL, "pool: session %d connected from %s\n", session.nId, session.strPeer);
+    self->UpdateStats();
+}
+
+static CPoolServer* poolServer = nullptr;
+
+void CPoolServer::readcb(struct bufferevent* bev, void* ctx)
+{
+    uint64_t nSessionId = (uint64_t)ctx;
+    auto iter = poolServer->sessions.find(nSessionId);
+    if (iter == poolServer->sessions.end())
+        return;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t nReadOut = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &nReadOut, EVBUFFER_EOL_CRLF)) != nullptr)
+    {
+        std::string strLine(line, nReadOut);
+        free(line);
+        poolServer->HandleLine(iter->second, strLine);
+        // HandleLine may have dropped the session.
+        iter = poolServer->sessions.find(nSessionId);
+        if (iter == poolServer->sessions.end())
+            return;
+    }
+    if (evbuffer_get_length(input) > MAX_POOL_LINE_LENGTH)
+    {
+        LogPrint(BCLog::POOL, "pool: session %d sent an over long line, disconnecting\n", nSessionId);
+        poolServer->Disconnect(nSessionId);
+    }
+}
+
+void CPoolServer::eventcb([[maybe_unused]] struct bufferevent* bev, short what, void* ctx)
+{
+    if (what & (BEV_EVENT_EOF|BEV_EVENT_ERROR))
+        poolServer->Disconnect((uint64_t)ctx);
+}
+
+void CPoolServer::Disconnect(uint64_t nSessionId)
+{
+    auto iter = sessions.find(nSessionId);
+    if (iter == sessions.end())
+        return;
+    LogPrint(BCLog::POOL, "pool: session %d (%s) disconnected\n", nSessionId, iter->second.strPeer);
+    if (iter->second.fSubscribed)
+        allocator.Release(iter->second.nGroup, iter->second.nPreNonceStart, iter->second.nPreNonceCount);
+    bufferevent_free(iter->second.bev);
+    sessions.erase(iter);
+    UpdateStats();
+}
+
+void CPoolServer::Send(CPoolSession& session, const UniValue& message)
+{
+    std::string strMessage = message.write() + "\n";
+    evbuffer_add(bufferevent_get_output(session.bev), strMessage.data(), strMessage.size());
+}
+
+static UniValue PoolError(int nCode, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(nCode);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+    return error;
+}
+
+void CPoolServer::HandleLine(CPoolSession& session, const std::string& strLine)
+{
+    if (strLine.empty())
+        return;
+
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject())
+    {
+        LogPrint(BCLog::POOL, "pool: session %d sent malformed request, disconnecting\n", session.nId);
+        Disconnect(session.nId);
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+
+    UniValue result = NullUniValue;
+    UniValue error = NullUniValue;
+    bool fSendJob = false;
+    if (!method.isStr())
+    {
+        error = PoolError(POOL_ERROR_OTHER, "Missing method");
+    }
+    else if (method.get_str() == "mining.subscribe")
+    {
+        if (session.fSubscribed)
+        {
+            error = PoolError(POOL_ERROR_OTHER, "Already subscribed");
+        }
+        else
+        {
+            result = HandleSubscribe(session, params);
+            if (result.isNull())
+                error = PoolError(POOL_ERROR_OTHER, "No pre nonce range available");
+            else
+                fSendJob = true;
+        }
+    }
+    else if (method.get_str() == "mining.authorize")
+    {
+        // Workers are only named for accounting by the pool operator; authentication is left to whatever fronts the server.
+        if (params.isArray() && params.size() > 0 && params[0].isStr())
+        {
+            session.strWorker = params[0].get_str();
+            result = true;
+        }
+        else
+        {
+            error = PoolError(POOL_ERROR_UNAUTHORIZED, "Missing worker name");
+        }
+    }
+    else if (method.get_str() == "mining.submit")
+    {
+        result = HandleSubmit(session, params);
+        if (result.isArray())
+        {
+            error = result;
+            result = NullUniValue;
+        }
+    }
+    else
+    {
+        error = PoolError(POOL_ERROR_OTHER, "Unknown method");
+    }
+
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("id", id));
+    reply.push_back(Pair("result", result));
+    reply.push_back(Pair("error", error));
+    Send(session, reply);
+
+    if (fSendJob && !jobs.empty())
+        SendJob(session, *jobs.back(), true);
+}
+
+UniValue CPoolServer::HandleSubscribe(CPoolSession& session, const UniValue& params)
+{
+    uint32_t nRequested = 0;
+    if (params.isArray() && params.size() > 1 && params[1].isNum() && params[1].get_int64() > 0)
+        nRequested = (uint32_t)std::min<int64_t>(params[1].get_int64(), POOL_PRENONCE_SPACE);
+    if (!allocator.Allocate(nRequested, session.nGroup, session.nPreNonceStart, session.nPreNonceCount))
+        return NullUniValue;
+    session.fSubscribed = true;
+    LogPrint(BCLog::POOL, "pool: session %d subscribed, group %d pre nonces [%d, %d)\n", session.nId, session.nGroup, session.nPreNonceStart, session.nPreNonceStart + session.nPreNonceCount);
+    UpdateStats();
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("session", strprintf("%016x", session.nId)));
+    result.push_back(Pair("prenonce_start", (uint64_t)session.nPreNonceStart));
+    result.push_back(Pair("prenonce_count", (uint64_t)session.nPreNonceCount));
+    return result;
+}
+
+arith_uint256 CPoolServer::ShareTarget(const CBlock& block) const
+{
+    arith_uint256 blockTarget = arith_uint256().SetCompact(block.nBits);
+    arith_uint256 shareTarget = blockTarget << nShareShift;
+    // Saturate instead of wrapping around if the shift overflows.
+    if ((shareTarget >> nShareShift) != blockTarget)
+        shareTarget = ~arith_uint256();
+    return shareTarget;
+}
+
+// Returns true if the share was accepted or a stratum error array if not.
+UniValue CPoolServer::HandleSubmit(CPoolSession& session, const UniValue& params)
+{
+    if (!session.fSubscribed)
+        return PoolError(POOL_ERROR_NOT_SUBSCRIBED, "Not subscribed");
+    if (!params.isArray() || params.size() < 4 || !params[1].isStr() || !params[2].isNum() || !params[3].isNum())
+        return PoolError(POOL_ERROR_OTHER, "Expected [worker, job id, pre nonce, post nonce]");
+
+    const std::string& strJobId = params[1].get_str();
+    int64_t nPreNonce = params[2].get_int64();
+    int64_t nPostNonce = params[3].get_int64();
+
+    std::shared_ptr<CPoolJob> job;
+    for (const auto& candidate : jobs)
+    {
+        if (candidate->strId == strJobId)
+            job = candidate;
+    }
+    if (!job)
+    {
+        ++nSharesStale;
+        UpdateStats();
+        return PoolError(POOL_ERROR_JOB_NOT_FOUND, "Job not found (stale)");
+    }
+    if (nPreNonce < session.nPreNonceStart || nPreNonce >= session.nPreNonceStart + session.nPreNonceCount || nPostNonce < 0 || nPostNonce >= 65536)
+    {
+        ++nSharesRejected;
+        UpdateStats();
+        return PoolError(POOL_ERROR_OTHER, "Nonce outside of the assigned range");
+    }
+
+    std::shared_ptr<CBlock> pBlock = job->GetGroupBlock(session.nGroup);
+    CBlockHeader header = pBlock->GetBlockHeader();
+    header.nPreNonce = (uint16_t)nPreNonce;
+    header.nPostNonce = (uint16_t)nPostNonce;
+    if (!job->submitted.insert(std::pair(session.nGroup, header.nNonce)).second)
+    {
+        ++nSharesRejected;
+        UpdateStats();
+        return PoolError(POOL_ERROR_DUPLICATE_SHARE, "Duplicate share");
+    }
+
+    bool fMeetsBlockTarget = false;
+    if (!CheckProofOfWorkShare(header, ShareTarget(*pBlock), fMeetsBlockTarget))
+    {
+        ++nSharesRejected;
+        UpdateStats();
+        return PoolError(POOL_ERROR_LOW_DIFFICULTY, "Low difficulty share");
+    }
+    ++nSharesAccepted;
+    LogPrint(BCLog::POOL, "pool: share accepted from session %d (%s) job %s nonce %08x\n", session.nId, session.strWorker, strJobId, header.nNonce);
+
+    if (fMeetsBlockTarget)
+    {
+        std::shared_ptr<CBlock> pFound = std::make_shared<CBlock>(*pBlock);
+        pFound->nNonce = header.nNonce;
+        LogPrintf("pool: block candidate from session %d (%s)\n", session.nId, session.strWorker);
+        if (ProcessBlockFound(pFound, Params()))
+            ++nBlocksFound;
+    }
+    UpdateStats();
+    return true;
+}
+
+void CPoolServer::SendJob(CPoolSession& session, CPoolJob& job, bool fCleanJobs)
+{
+    if (!session.fSubscribed)
+        return;
+    std::shared_ptr<CBlock> pBlock = job.GetGroupBlock(session.nGroup);
+    CBlockHeader header = pBlock->GetBlockHeader();
+    header.nNonce = 0;
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << header;
+
+    UniValue params(UniValue::VARR);
+    params.push_back(job.strId);
+    params.push_back(HexStr(ssHeader.begin(), ssHeader.end()));
+    params.push_back(ShareTarget(*pBlock).GetHex());
+    params.push_back(fCleanJobs);
+
+    UniValue notify(UniValue::VOBJ);
+    notify.push_back(Pair("id", NullUniValue));
+    notify.push_back(Pair("method", "mining.notify"));
+    notify.push_back(Pair("params", params));
+    Send(session, notify);
+}
+
+void CPoolServer::CreateJob(const CBlockIndex* pindexParent, CBlockIndex* pWitnessBlockToEmbed)
+{
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    {
+        LOCK(processBlockCS);
+        pblocktemplate = BlockAssembler(Params()).CreateNewBlock((CBlockIndex*)pindexParent, coinbaseScript, true, pWitnessBlockToEmbed);
+    }
+    if (!pblocktemplate)
+    {
+        LogPrintf("pool: failed to create block template\n");
+        return;
+    }
+
+    bool fCleanJobs = jobs.empty() || jobs.back()->pindexParent != pindexParent;
+    if (fCleanJobs)
+        jobs.clear();
+    else if (jobs.size() >= MAX_POOL_JOBS_PER_PARENT)
+        jobs.erase(jobs.begin());
+
+    std::shared_ptr<CPoolJob> job = std::make_shared<CPoolJob>();
+    job->strId = strprintf("%x", nNextJobId++);
+    job->pindexParent = pindexParent;
+    job->pTemplate = std::move(pblocktemplate);
+    jobs.push_back(job);
+    nLastJobTime = GetTime();
+    nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+
+    LogPrint(BCLog::POOL, "pool: new job %s on parent %s (height %d), clean %d\n", job->strId, pindexParent->GetBlockHashPoW2().ToString(), pindexParent->nHeight + 1, fCleanJobs);
+    for (auto& [nId, session] : sessions)
+    {
+        (unused) nId;
+        SendJob(session, *job, fCleanJobs);
+    }
+    UpdateStats();
+}
+
+void CPoolServer::CheckWork()
+{
+    const CBlockIndex* pTip = nullptr;
+    {
+        LOCK(cs_main);
+        pTip = chainActive.Tip();
+    }
+    if (!pTip)
+        return;
+
+    bool fSignalled = wakeup.fSignalled.exchange(false);
+    bool fRefresh = !jobs.empty() && GetTime() - nLastJobTime >= nPoolWorkRefreshIntervalSeconds && mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast;
+    if (!fSignalled && !fRefresh && !jobs.empty())
+        return;
+
+    // Same rules as the internal miner for when the chain tip or the set of top level witness orphans has moved under us.
+    uint64_t nOrphans = GetTopLevelWitnessOrphans(pTip->nHeight).size();
+    if (!fRefresh && !jobs.empty() && pTip == pTipAtLastJob && nOrphans == nOrphansAtLastJob)
+        return;
+
+    std::string strError;
+    CBlockIndex* pWitnessBlockToEmbed = nullptr;
+    CBlockIndex* pindexParent = FindMiningTip((CBlockIndex*)pTip, Params(), strError, pWitnessBlockToEmbed);
+    if (!pindexParent)
+    {
+        LogPrint(BCLog::POOL, "pool: %s\n", strError);
+        return;
+    }
+    pTipAtLastJob = pTip;
+    nOrphansAtLastJob = nOrphans;
+    if (!fRefresh && !jobs.empty() && jobs.back()->pindexParent == pindexParent)
+        return;
+    CreateJob(pindexParent, pWitnessBlockToEmbed);
+}
+
+void CPoolServer::UpdateStats()
+{
+    LOCK(cs_stats);
+    stats.nSessions = sessions.size();
+    stats.nGroups = allocator.ActiveGroups();
+    stats.strJobId = jobs.empty() ? "" : jobs.back()->strId;
+    stats.nJobHeight = jobs.empty() ? 0 : jobs.back()->pindexParent->nHeight + 1;
+    stats.nSharesAccepted = nSharesAccepted;
+    stats.nSharesRejected = nSharesRejected;
+    stats.nSharesStale = nSharesStale;
+    stats.nBlocksFound = nBlocksFound;
+}
+
+/****** Thread ********/
+static struct event_base* poolBase = nullptr;
+static struct event* poolWorkTimer = nullptr;
+static boost::thread poolServerThread;
+
+static void PoolWorkTimerCallback([[maybe_unused]] evutil_socket_t fd, [[maybe_unused]] short what, [[maybe_unused]] void* arg)
+{
+    try
+    {
+        poolServer->CheckWork();
+    }
+    catch (const boost::thread_interrupted&)
+    {
+        throw;
+    }
+    catch (const std::exception& e)
+    {
+        LogPrintf("pool: error while updating work: %s\n", e.what());
+    }
+}
+
+static void PoolServerThread()
+{
+    event_base_dispatch(poolBase);
+}
+
+PoolServerStats GetPoolServerStats()
+{
+    if (!poolServer)
+        return PoolServerStats();
+    LOCK(poolServer->cs_stats);
+    return poolServer->stats;
+}
+
+bool StartPoolServer([[maybe_unused]] boost::thread_group& threadGroup, [[maybe_unused]] CScheduler& scheduler, std::string& strError)
+{
+    assert(!poolBase);
+
+    CGuldenAddress address(GetArg("-poolserveraddress", ""));
+    if (!address.IsValid())
+    {
+        strError = "-poolserver requires a valid -poolserveraddress to pay block rewards to";
+        return false;
+    }
+    CScript outputScript = GetScriptForDestination(address.Get());
+    std::shared_ptr<CReserveKeyOrScript> coinbaseScript = std::make_shared<CReserveKeyOrScript>(outputScript);
+
+    std::string strBind = GetArg("-poolserverbind", DEFAULT_POOL_SERVER_BIND);
+    CService bindAddress;
+    if (!Lookup(strBind.c_str(), bindAddress, GetArg("-poolserverport", DEFAULT_POOL_SERVER_PORT), false))
+    {
+        strError = strprintf("Invalid -poolserverbind address '%s'", strBind);
+        return false;
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    poolBase = event_base_new();
+    if (!poolBase)
+    {
+        strError = "Unable to create event_base for pool server";
+        return false;
+    }
+
+    uint32_t nRangeSize = std::max<int64_t>(1, std::min<int64_t>(GetArg("-poolprenoncerange", DEFAULT_POOL_PRENONCE_RANGE), POOL_PRENONCE_SPACE));
+    uint32_t nMaxSessions = std::max<int64_t>(1, GetArg("-poolmaxsessions", DEFAULT_POOL_MAX_SESSIONS));
+    unsigned int nShareShift = std::max<int64_t>(0, std::min<int64_t>(GetArg("-poolshareshift", DEFAULT_POOL_SHARE_SHIFT), 255));
+    poolServer = new CPoolServer(poolBase, coinbaseScript, nRangeSize, nMaxSessions, nShareShift);
+    if (!poolServer->Listen(bindAddress, strError))
+    {
+        delete poolServer;
+        poolServer = nullptr;
+        event_base_free(poolBase);
+        poolBase = nullptr;
+        return false;
+    }
+    {
+        LOCK(poolServer->cs_stats);
+        poolServer->stats.fRunning = true;
+        poolServer->stats.strBind = bindAddress.ToString();
+    }
+    RegisterValidationInterface(&poolServer->wakeup);
+
+    poolWorkTimer = event_new(poolBase, -1, EV_PERSIST, PoolWorkTimerCallback, nullptr);
+    struct timeval tv = { nPoolWorkCheckIntervalMs / 1000, (nPoolWorkCheckIntervalMs % 1000) * 1000 };
+    event_add(poolWorkTimer, &tv);
+
+    LogPrintf("pool: listening on %s (pre nonce range %d, share shift %d, max sessions %d)\n", bindAddress.ToString(), nRangeSize, nShareShift, nMaxSessions);
+    poolServerThread = boost::thread(boost::bind(&TraceThread<void (*)()>, "poolserver", &PoolServerThread));
+    return true;
+}
+
+void InterruptPoolServer()
+{
+    if (poolBase)
+    {
+        LogPrintf("pool: thread interrupt\n");
+        event_base_loopbreak(poolBase);
+    }
+}
+
+void StopPoolServer()
+{
+    if (poolBase)
+    {
+        poolServerThread.join();
+        UnregisterValidationInterface(&poolServer->wakeup);
+        event_free(poolWorkTimer);
+        poolWorkTimer = nullptr;
+        delete poolServer;
+        poolServer = nullptr;
+        event_base_free(poolBase);
+        poolBase = nullptr;
+    }
+}
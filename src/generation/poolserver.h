@@ -0,0 +1,76 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+// Native (stratum style) work server for mining pools.
+// Miners keep a single TCP connection open over which new jobs are pushed as soon as the tip (or witness orphan set) changes and over which shares are submitted.
+// Messages are newline delimited JSON-RPC objects:
+//   -> {"id":1,"method":"mining.subscribe","params":["agent", <requested pre nonces>]}
+//   <- {"id":1,"result":{"session":"...","prenonce_start":n,"prenonce_count":n},"error":null}
+//   -> {"id":2,"method":"mining.authorize","params":["worker","password"]}
+//   <- {"id":null,"method":"mining.notify","params":["job id","header hex","share target hex",true]}
+//   -> {"id":3,"method":"mining.submit","params":["worker","job id",<pre nonce>,<post nonce>]}
+// Every session mines a disjoint range of pre nonces; once all 65536 pre nonces of a header have been handed out further sessions get a header with a different coinbase extra nonce.
+
+#ifndef GULDEN_POOLSERVER_H
+#define GULDEN_POOLSERVER_H
+
+#include "scheduler.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static const bool DEFAULT_POOL_SERVER = false;
+static const std::string DEFAULT_POOL_SERVER_BIND = "127.0.0.1";
+static const unsigned short DEFAULT_POOL_SERVER_PORT = 9233;
+//! Granularity (and default size) of the pre nonce range handed to each session
+static const unsigned int DEFAULT_POOL_PRENONCE_RANGE = 4096;
+//! Shares are 2^n times easier than the block target
+static const unsigned int DEFAULT_POOL_SHARE_SHIFT = 8;
+static const unsigned int DEFAULT_POOL_MAX_SESSIONS = 256;
+//! Number of pre nonces in a SIGMA header (nPreNonce is 16 bit)
+static const uint32_t POOL_PRENONCE_SPACE = 65536;
+
+// Hands out disjoint pre nonce ranges to sessions.
+// Ranges are allocated in units of nRangeSize; a group is one header variant (coinbase extra nonce) whose pre nonce space is shared by up to POOL_PRENONCE_SPACE/nRangeSize sessions.
+class CPoolPreNonceAllocator
+{
+public:
+    CPoolPreNonceAllocator(uint32_t nRangeSize, uint32_t nMaxGroups);
+    // Allocate at least nRequested (0 = one unit) pre nonces, capped to a whole group; returns false if every group is full.
+    bool Allocate(uint32_t nRequested, uint32_t& nGroup, uint32_t& nStart, uint32_t& nCount);
+    void Release(uint32_t nGroup, uint32_t nStart, uint32_t nCount);
+    // Number of groups that currently have at least one range allocated.
+    uint32_t ActiveGroups() const;
+    uint32_t RangeSize() const { return nRangeSize; }
+private:
+    uint32_t nRangeSize;
+    uint32_t nSlotsPerGroup;
+    uint32_t nMaxGroups;
+    // One entry per group, one flag per slot of nRangeSize pre nonces.
+    std::vector<std::vector<bool>> groups;
+};
+
+struct PoolServerStats
+{
+    bool fRunning = false;
+    std::string strBind;
+    uint64_t nSessions = 0;
+    uint64_t nGroups = 0;
+    std::string strJobId;
+    int nJobHeight = 0;
+    uint64_t nSharesAccepted = 0;
+    uint64_t nSharesRejected = 0;
+    uint64_t nSharesStale = 0;
+    uint64_t nBlocksFound = 0;
+};
+PoolServerStats GetPoolServerStats();
+
+// Returns false (with strError set) if the server could not be started.
+bool StartPoolServer(boost::thread_group& threadGroup, CScheduler& scheduler, std::string& strError);
+void InterruptPoolServer();
+void StopPoolServer();
+
+#endif
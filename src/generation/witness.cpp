@@ -18,9 +18,11 @@
 #include "consensus/tx_verify.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "executor.h"
 #include "Gulden/auto_checkpoints.h"
 #include "hash.h"
 #include "key.h"
+#include "metrics.h"
 #include "validation/validation.h"
 #include "validation/witnessvalidation.h"
 #include "net.h"
@@ -37,7 +39,11 @@
 #include "validation/validationinterface.h"
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
 #include <queue>
+#include <tuple>
 #include <utility>
 
 #include <Gulden/Common/hash/hash.h>
@@ -53,6 +59,17 @@
 
 CCriticalSection processBlockCS;
 
+// Witness keys we have signed with before, so that signing doesn't have to go through all the account keystores (and decrypt the key) for every block.
+// CKey keeps its secret in secure_allocator (locked pool) memory, so cached keys stay out of swap like the keystore copies.
+static CCriticalSection cs_witnessKeyCache;
+static std::map<CKeyID, CKey> witnessKeyCache;
+
+void ClearWitnessKeyCache()
+{
+    LOCK(cs_witnessKeyCache);
+    witnessKeyCache.clear();
+}
+
 #ifdef ENABLE_WALLET
 CReserveKeyOrScript::CReserveKeyOrScript(CWallet* pwalletIn, CAccount* forAccount, int64_t forKeyChain)
 {
@@ -119,21 +136,35 @@ static bool SignBlockAsWitness(std::shared_ptr<CBlock> pBlock, CTxOut fittestWit
     }
 
     CKey key;
-    if (!pactiveWallet->GetKey(witnessKeyID, key))
     {
-        std::string strErrorMessage = strprintf("Failed to obtain key to sign as witness: chain-tip-height[%d]", chainActive.Tip()? chainActive.Tip()->nHeight : 0);
-        CAlert::Notify(strErrorMessage, true, true);
-        LogPrintf("%s", strErrorMessage.c_str());
-        return false;
-    }
+        LOCK(cs_witnessKeyCache);
+        auto findIter = witnessKeyCache.find(witnessKeyID);
+        // HaveKey is only a lookup, it makes sure we stop signing with keys of accounts that have since been removed.
+        if (findIter != witnessKeyCache.end() && pactiveWallet->HaveKey(witnessKeyID))
+        {
+            key = findIter->second;
+        }
+        else
+        {
+            witnessKeyCache.erase(witnessKeyID);
+            if (!pactiveWallet->GetKey(witnessKeyID, key))
+            {
+                std::string strErrorMessage = strprintf("Failed to obtain key to sign as witness: chain-tip-height[%d]", chainActive.Tip()? chainActive.Tip()->nHeight : 0);
+                CAlert::Notify(strErrorMessage, true, true);
+                LogPrintf("%s", strErrorMessage.c_str());
+                return false;
+            }
 
-    // Do not allow uncompressed keys.
-    if (!key.IsCompressed())
-    {
-        std::string strErrorMessage = strprintf("Invalid witness key - uncompressed keys not allowed: chain-tip-height[%d]", chainActive.Tip()? chainActive.Tip()->nHeight : 0);
-        CAlert::Notify(strErrorMessage, true, true);
-        LogPrintf("%s", strErrorMessage.c_str());
-        return false;
+            // Do not allow uncompressed keys.
+            if (!key.IsCompressed())
+            {
+                std::string strErrorMessage = strprintf("Invalid witness key - uncompressed keys not allowed: chain-tip-height[%d]", chainActive.Tip()? chainActive.Tip()->nHeight : 0);
+                CAlert::Notify(strErrorMessage, true, true);
+                LogPrintf("%s", strErrorMessage.c_str());
+                return false;
+            }
+            witnessKeyCache[witnessKeyID] = key;
+        }
     }
 
     //Sign the hash of the block as proof that it has been witnessed.
@@ -358,6 +389,115 @@ std::set<CBlockIndex*, CBlockIndexCacheComparator> cacheAlreadySeenWitnessCandid
 bool witnessScriptsAreDirty = false;
 bool witnessingEnabled = true;
 
+// Wakes the witness thread as soon as there is something new to look at (a new tip or a new PoW valid block, which could be a top level orphan to sign) instead of having it poll.
+class CWitnessWakeup : public CValidationInterface
+{
+public:
+    void Notify()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fNotified = true;
+        }
+        cond.notify_all();
+    }
+
+    // Returns as soon as Notify has been called since the previous Wait, or after nMilliseconds otherwise; this is an interruption point.
+    void Wait(int64_t nMilliseconds)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        cond.wait_for(lock, boost::chrono::milliseconds(nMilliseconds), [this]{ return fNotified; });
+        fNotified = false;
+    }
+
+protected:
+    void UpdatedBlockTip([[maybe_unused]] const CBlockIndex *pindexNew, [[maybe_unused]] const CBlockIndex *pindexFork, [[maybe_unused]] bool fInitialDownload) override { Notify(); }
+    void NewPoWValidBlock([[maybe_unused]] const CBlockIndex *pindex, [[maybe_unused]] const std::shared_ptr<const CBlock>& block) override { Notify(); }
+
+private:
+    boost::mutex mutex;
+    CConditionVariable cond;
+    bool fNotified = false;
+};
+static CWitnessWakeup witnessWakeup;
+
+void WakeWitnessThread()
+{
+    witnessWakeup.Notify();
+}
+
+// Runs GetWitness for a set of witness candidates on a few executor threads at once; results are handed out in the order in which they complete so that each candidate can be signed as soon as it is ready.
+// NB! The caller must not hold cs_main while waiting for results, GetWitness takes it (for as long as it needs to capture the witness set).
+class CWitnessCandidateEvaluator
+{
+public:
+    CWitnessCandidateEvaluator(const CChainParams& chainparams_, const std::vector<CBlockIndex*>& candidates_, const std::vector<std::shared_ptr<CBlock>>& blocks_)
+    : chainparams(chainparams_)
+    , candidates(candidates_)
+    , blocks(blocks_)
+    , workers(GetExecutor(), EXECUTOR_WITNESS)
+    {
+        assert(candidates.size() == blocks.size());
+        size_t nThreads = std::min(candidates.size(), std::min((size_t)GetExecutor().GetThreadCount(), MAX_WITNESS_CANDIDATE_THREADS));
+        for (size_t i = 0; i < nThreads; ++i)
+            workers.Run([this]() { Worker(); });
+    }
+
+    ~CWitnessCandidateEvaluator()
+    {
+        // Stop handing out candidates; workers (the last member, so destroyed first) waits for those in progress, GetWitness itself can't be interrupted.
+        nNextCandidate = candidates.size();
+    }
+
+    // Wait for the next candidate to be evaluated, returns false once all of them have been handed out; this is an interruption point.
+    bool Next(size_t& nCandidate, CGetWitnessInfo& witnessInfo, bool& fValid)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nHandedOut == candidates.size())
+            return false;
+        while (results.empty())
+            cond.wait(lock);
+        std::tie(nCandidate, fValid, witnessInfo) = std::move(results.front());
+        results.pop_front();
+        ++nHandedOut;
+        return true;
+    }
+
+private:
+    void Worker()
+    {
+        size_t nCandidate;
+        while ((nCandidate = nNextCandidate++) < candidates.size())
+        {
+            CGetWitnessInfo witnessInfo;
+            bool fValid = false;
+            try
+            {
+                fValid = blocks[nCandidate] && GetWitness(chainActive, chainparams, nullptr, candidates[nCandidate]->pprev, *blocks[nCandidate], witnessInfo);
+            }
+            catch (const std::exception& e)
+            {
+                LogPrintf("GuldenWitness: Failed to evaluate candidate [%s]: %s\n", candidates[nCandidate]->GetBlockHashPoW2().ToString(), e.what());
+            }
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                results.emplace_back(nCandidate, fValid, std::move(witnessInfo));
+            }
+            cond.notify_all();
+        }
+    }
+
+    const CChainParams& chainparams;
+    const std::vector<CBlockIndex*>& candidates;
+    const std::vector<std::shared_ptr<CBlock>>& blocks;
+    std::atomic<size_t> nNextCandidate{0};
+    boost::mutex mutex;
+    CConditionVariable cond;
+    std::deque<std::tuple<size_t, bool, CGetWitnessInfo>> results;
+    size_t nHandedOut = 0;
+    CTaskGroup workers;
+};
+
 void static GuldenWitness()
 {
     LogPrintf("GuldenWitness started\n");
@@ -388,13 +528,24 @@ void static GuldenWitness()
                     {
                         break;
                     }
-                    MilliSleep(5000);
+                    witnessWakeup.Wait(5000);
                 } while (true);
             }
+            static bool fReportedReady = false;
+            if (!fReportedReady)
+            {
+                fReportedReady = true;
+                LogPrintf("GuldenWitness: able to witness %ds after startup\n", GetTime() - GetStartupTime());
+            }
             while (!witnessingEnabled)
             {
-                MilliSleep(200);
+                witnessWakeup.Wait(200);
             }
+
+            // Sleep until a new tip or PoW block comes in.
+            // The timeout keeps the absent witness logging below (which works at a granularity of seconds) going while we wait for a witness to show up.
+            witnessWakeup.Wait(WITNESS_IDLE_WAKEUP_MS);
+
             DO_BENCHMARK("WIT: GuldenWitness", BCLog::BENCH|BCLog::WITNESS);
 
             CBlockIndex* pindexTip = nullptr;
@@ -407,15 +558,11 @@ void static GuldenWitness()
             //We can only start witnessing from phase 3 onward.
             if ( !pindexTip || !pindexTip->pprev || !IsPow2WitnessingActive(pindexTip, chainparams, chainActive)  )
             {
-                MilliSleep(5000);
+                witnessWakeup.Wait(5000);
                 continue;
             }
             int nPoW2PhasePrev = GetPoW2Phase(pindexTip->pprev, chainparams, chainActive);
 
-            //fixme: (2.1)
-            //Ideally instead of just sleeping/busy polling rather wait on a signal that gets triggered only when new blocks come in??
-            MilliSleep(100);
-
             // Check for stop or if block needs to be rebuilt
             boost::this_thread::interruption_point();
 
@@ -483,28 +630,48 @@ void static GuldenWitness()
 
             if (candidateOrphans.size() > 0)
             {
-                LOCK2(processBlockCS,cs_main); //cs_main lock for ReadBlockFromDisk and chainActive.Tip()
-                
-                if (chainActive.Tip() != pindexTip)
+                std::vector<std::shared_ptr<CBlock>> candidateBlocks;
                 {
-                    continue;
+                    LOCK(cs_main); //cs_main lock for ReadBlockFromDisk and chainActive.Tip()
+
+                    if (chainActive.Tip() != pindexTip)
+                    {
+                        continue;
+                    }
+
+                    for (const auto candidateIter : candidateOrphans)
+                    {
+                        cacheAlreadySeenWitnessCandidates.insert(candidateIter);
+
+                        //Create new block
+                        std::shared_ptr<CBlock> pWitnessBlock(new CBlock);
+                        if (!ReadBlockFromDisk(*pWitnessBlock, candidateIter, chainparams))
+                            pWitnessBlock = nullptr;
+                        candidateBlocks.push_back(pWitnessBlock);
+                    }
                 }
 
-                
-                for (const auto candidateIter : candidateOrphans)
+                // During PoW races there can be several candidates; evaluate them concurrently and sign whichever is ready first instead of going through them one by one.
+                CWitnessCandidateEvaluator evaluator(chainparams, candidateOrphans, candidateBlocks);
+                size_t nCandidate;
+                CGetWitnessInfo witnessInfo;
+                bool fValidWitness;
+                while (evaluator.Next(nCandidate, witnessInfo, fValidWitness))
                 {
                     boost::this_thread::interruption_point();
 
-                    cacheAlreadySeenWitnessCandidates.insert(candidateIter);
+                    LOCK2(processBlockCS,cs_main);
 
-                    //Create new block
-                    std::shared_ptr<CBlock> pWitnessBlock(new CBlock);
-                    if (ReadBlockFromDisk(*pWitnessBlock, candidateIter, chainparams))
+                    if (chainActive.Tip() != pindexTip)
                     {
-                        boost::this_thread::interruption_point();
-                        CGetWitnessInfo witnessInfo;
+                        break;
+                    }
 
-                        if (!GetWitness(chainActive, chainparams, nullptr, candidateIter->pprev, *pWitnessBlock, witnessInfo))
+                    CBlockIndex* candidateIter = candidateOrphans[nCandidate];
+                    std::shared_ptr<CBlock> pWitnessBlock = candidateBlocks[nCandidate];
+                    if (pWitnessBlock)
+                    {
+                        if (!fValidWitness)
                         {
                             LogPrintf("GuldenWitness: Invalid candidate witness [%s]\n", candidateIter->GetBlockHashPoW2().ToString());
                             static int64_t nLastErrorHeight = -1;
@@ -520,6 +687,7 @@ void static GuldenWitness()
                             LogPrintf("%s", strErrorMessage.c_str());
                             continue;
                         }
+                        GetMainSignals().WitnessSelected(candidateIter, witnessInfo.selectedWitnessOutpoint);
 
                         boost::this_thread::interruption_point();
                         CAmount witnessBlockSubsidy = GetBlockSubsidyWitness(candidateIter->nHeight);
@@ -672,6 +840,7 @@ void static GuldenWitness()
 void StartPoW2WitnessThread(boost::thread_group& threadGroup)
 {
     #ifdef ENABLE_WALLET
+    RegisterValidationInterface(&witnessWakeup);
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "pow2_witness", &GuldenWitness));
     #endif
 }
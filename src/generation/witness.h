@@ -14,6 +14,18 @@ extern bool witnessScriptsAreDirty;
 
 extern bool witnessingEnabled;
 
+//! Maximum number of threads used to evaluate competing witness candidates at once
+static const size_t MAX_WITNESS_CANDIDATE_THREADS = 4;
+
+//! How long the witness thread sleeps when no new tip or PoW block comes in
+static const int64_t WITNESS_IDLE_WAKEUP_MS = 500;
+
+//! Wake the witness thread (it is woken automatically by new tips and new PoW valid blocks)
+void WakeWitnessThread();
+
+//! Forget the witness keys cached for signing (they are cached on first use and kept until witnessing is disabled)
+void ClearWitnessKeyCache();
+
 //! Run the main witnessing thread; On wallets with no witnessing accounts this will just sleep permanently.
 void StartPoW2WitnessThread(boost::thread_group& threadGroup);
 
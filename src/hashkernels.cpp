@@ -0,0 +1,139 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "hashkernels.h"
+
+#include "clientversion.h"
+#include "compat/arch.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#include <cpuid.h>
+#include <string.h>
+#endif
+
+std::string GetCPUModelName()
+{
+    std::string strName;
+#if defined(ARCH_CPU_X86_FAMILY)
+    unsigned int nMaxLeaf = __get_cpuid_max(0x80000000, nullptr);
+    if (nMaxLeaf >= 0x80000004)
+    {
+        char brand[49] = {};
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            unsigned int regs[4];
+            __get_cpuid(0x80000002 + i, &regs[0], &regs[1], &regs[2], &regs[3]);
+            memcpy(brand + 16 * i, regs, sizeof(regs));
+        }
+        strName = brand;
+    }
+#else
+    // The name of the first processor, on kernels that give one.
+    fs::ifstream file("/proc/cpuinfo");
+    std::string strLine;
+    while (strName.empty() && std::getline(file, strLine))
+    {
+        if (boost::algorithm::starts_with(strLine, "model name") || boost::algorithm::starts_with(strLine, "Hardware") || boost::algorithm::starts_with(strLine, "CPU part"))
+        {
+            size_t nPos = strLine.find(':');
+            if (nPos != std::string::npos)
+                strName = strLine.substr(nPos + 1);
+        }
+    }
+#endif
+    boost::algorithm::trim(strName);
+    return strName.empty() ? "unknown" : strName;
+}
+
+CHashKernelChoice NewHashKernelChoice()
+{
+    CHashKernelChoice choice;
+    choice.strCPU = GetCPUModelName();
+    choice.nClientVersion = CLIENT_VERSION;
+    return choice;
+}
+
+bool IsHashKernelChoiceCurrent(const CHashKernelChoice& choice)
+{
+    return choice.nClientVersion == CLIENT_VERSION && choice.strCPU == GetCPUModelName();
+}
+
+// A line "name=value" per field; text so that it can be looked at and edited by hand.
+bool ReadHashKernelChoice(const fs::path& path, CHashKernelChoice& choice)
+{
+    fs::ifstream file(path);
+    if (!file.is_open())
+        return false;
+    CHashKernelChoice read;
+    bool fHaveCPU = false;
+    std::string strLine;
+    while (std::getline(file, strLine))
+    {
+        size_t nPos = strLine.find('=');
+        if (nPos == std::string::npos)
+            continue;
+        const std::string strKey = strLine.substr(0, nPos);
+        const std::string strValue = strLine.substr(nPos + 1);
+        int64_t nValue = 0;
+        if (strKey == "cpu")
+        {
+            read.strCPU = strValue;
+            fHaveCPU = true;
+            continue;
+        }
+        if (!ParseInt64(strValue, &nValue) || nValue < 0)
+            return false;
+        if (strKey == "version")
+            read.nClientVersion = nValue;
+        else if (strKey == "sha256_disable")
+            read.nSHA256Disable = nValue;
+        else if (strKey == "shavite")
+            read.sigma.shavite = nValue;
+        else if (strKey == "echo")
+            read.sigma.echo = nValue;
+        else if (strKey == "argon")
+            read.sigma.argon = nValue;
+        else if (strKey == "shavite_x2")
+            read.sigma.shaviteX2 = nValue != 0;
+        else if (strKey == "echo_x2")
+            read.sigma.echoX2 = nValue != 0;
+        else if (strKey == "shavite_x4")
+            read.sigma.shaviteX4 = nValue != 0;
+        else if (strKey == "echo_x4")
+            read.sigma.echoX4 = nValue != 0;
+    }
+    if (!fHaveCPU || read.nClientVersion == 0)
+        return false;
+    choice = read;
+    return true;
+}
+
+bool WriteHashKernelChoice(const fs::path& path, const CHashKernelChoice& choice)
+{
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    {
+        fs::ofstream file(pathTmp, std::ios_base::out | std::ios_base::trunc);
+        if (!file.is_open())
+            return false;
+        file << "cpu=" << choice.strCPU << "\n";
+        file << "version=" << choice.nClientVersion << "\n";
+        file << "sha256_disable=" << choice.nSHA256Disable << "\n";
+        file << "shavite=" << choice.sigma.shavite << "\n";
+        file << "echo=" << choice.sigma.echo << "\n";
+        file << "argon=" << choice.sigma.argon << "\n";
+        file << "shavite_x2=" << choice.sigma.shaviteX2 << "\n";
+        file << "echo_x2=" << choice.sigma.echoX2 << "\n";
+        file << "shavite_x4=" << choice.sigma.shaviteX4 << "\n";
+        file << "echo_x4=" << choice.sigma.echoX4 << "\n";
+        if (!file.good())
+            return false;
+    }
+    return RenameOver(pathTmp, path);
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_HASHKERNELS_H
+#define GULDEN_HASHKERNELS_H
+
+#include "crypto/hash/sigma/sigma.h"
+#include "fs.h"
+
+#include <stdint.h>
+#include <string>
+
+/** Default for -benchmarkkernels */
+static const bool DEFAULT_BENCHMARK_KERNELS = false;
+
+/**
+ * The hash implementations a startup benchmark (-benchmarkkernels) picked, kept in the data directory so that later starts
+ * on the same machine don't have to time them again. Only valid for the processor model and version of the software that
+ * made it; another processor or new implementations can change the outcome.
+ */
+struct CHashKernelChoice
+{
+    std::string strCPU;
+    int nClientVersion = 0;
+    //! SHA256_KERNEL_* flags of the kernels SHA256AutoDetect is to leave out.
+    uint32_t nSHA256Disable = 0;
+    sigma_kernel_choice sigma;
+};
+
+//! The brand name of the processor model, "unknown" if there is no way to tell.
+std::string GetCPUModelName();
+
+//! A choice made on this processor by this version of the software.
+CHashKernelChoice NewHashKernelChoice();
+bool IsHashKernelChoiceCurrent(const CHashKernelChoice& choice);
+
+//! False if the file doesn't exist or isn't a kernel choice.
+bool ReadHashKernelChoice(const fs::path& path, CHashKernelChoice& choice);
+bool WriteHashKernelChoice(const fs::path& path, const CHashKernelChoice& choice);
+
+#endif // GULDEN_HASHKERNELS_H
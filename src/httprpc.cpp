@@ -15,6 +15,8 @@
 #include "utilstrencodings.h"
 #include "ui_interface.h"
 #include "crypto/hmac_sha256.h"
+#include "executor.h"
+#include <map>
 #include <stdio.h>
 
 #include <boost/algorithm/string.hpp> // boost::trim
@@ -145,6 +147,125 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+/** A deferred reply of a single call, see RPCDeferFunction. */
+class HTTPRPCDeferredReply : public CRPCDeferredReply
+{
+public:
+    HTTPRPCDeferredReply(const UniValue& idIn, std::function<UniValue()> onTimeoutIn) : id(idIn), onTimeout(std::move(onTimeoutIn)) {}
+
+    bool Reply(const UniValue& result) override { return Finish(result, NullUniValue); }
+    bool HasReplied() const override
+    {
+        LOCK(cs);
+        return fReplied;
+    }
+    bool ReplyTimeout()
+    {
+        UniValue result;
+        try {
+            result = onTimeout();
+        } catch (const UniValue& objError) {
+            return Finish(NullUniValue, objError);
+        } catch (const std::exception& e) {
+            return Finish(NullUniValue, JSONRPCError(RPC_MISC_ERROR, e.what()));
+        }
+        return Finish(result, NullUniValue);
+    }
+    bool ReplyError(const UniValue& objError) { return Finish(NullUniValue, objError); }
+
+    //! Hand over the request once the handler has returned; a reply that came before is sent now.
+    void Activate(std::unique_ptr<HTTPRequest> reqIn)
+    {
+        {
+            LOCK(cs);
+            if (!fReplied)
+            {
+                req = std::move(reqIn);
+                return;
+            }
+        }
+        Send(reqIn.get());
+    }
+
+private:
+    bool Finish(const UniValue& result, const UniValue& objError);
+    void Send(HTTPRequest* reqReply)
+    {
+        if (!error.isNull())
+        {
+            JSONErrorReply(reqReply, error, id);
+            return;
+        }
+        reqReply->WriteHeader("Content-Type", "application/json");
+        reqReply->WriteReply(HTTP_OK, JSONRPCReply(reply, NullUniValue, id));
+    }
+
+    mutable CCriticalSection cs;
+    std::unique_ptr<HTTPRequest> req;
+    const UniValue id;
+    const std::function<UniValue()> onTimeout;
+    bool fReplied = false;
+    UniValue reply;
+    UniValue error;
+};
+
+/** The deferred replies still waiting, so that they can all be answered on shutdown. */
+static CCriticalSection cs_deferredReplies;
+static std::map<const HTTPRPCDeferredReply*, std::shared_ptr<HTTPRPCDeferredReply>> mapDeferredReplies;
+static bool fDeferredRepliesInterrupted = false;
+
+bool HTTPRPCDeferredReply::Finish(const UniValue& result, const UniValue& objError)
+{
+    std::unique_ptr<HTTPRequest> reqReply;
+    {
+        LOCK(cs);
+        if (fReplied)
+            return false;
+        fReplied = true;
+        reply = result;
+        error = objError;
+        reqReply = std::move(req);
+    }
+    // Without the request the handler hasn't returned yet, Activate sends the reply then.
+    if (reqReply)
+        Send(reqReply.get());
+    LOCK(cs_deferredReplies);
+    mapDeferredReplies.erase(this);
+    return true;
+}
+
+static std::shared_ptr<HTTPRPCDeferredReply> DeferReply(HTTPRequest* req, const UniValue& id, int64_t nTimeoutMillis, std::function<UniValue()> onTimeout)
+{
+    std::shared_ptr<HTTPRPCDeferredReply> deferred = std::make_shared<HTTPRPCDeferredReply>(id, std::move(onTimeout));
+    bool fInterrupted;
+    {
+        LOCK(cs_deferredReplies);
+        fInterrupted = fDeferredRepliesInterrupted;
+        if (!fInterrupted)
+            mapDeferredReplies[deferred.get()] = deferred;
+    }
+    if (fInterrupted)
+    {
+        deferred->ReplyTimeout();
+        return deferred;
+    }
+    if (nTimeoutMillis <= 0)
+        return deferred;
+
+    // The timeout fires in the event loop of the connection; work out the reply on an RPC thread though, as it may have to take locks.
+    std::weak_ptr<HTTPRPCDeferredReply> weakDeferred = deferred;
+    HTTPEvent* ev = new HTTPEvent(req->GetEventBase(), true, [weakDeferred]()
+    {
+        if (std::shared_ptr<HTTPRPCDeferredReply> deferred = weakDeferred.lock())
+            GetExecutor().Submit(EXECUTOR_RPC, [deferred]() { deferred->ReplyTimeout(); });
+    });
+    struct timeval tv;
+    tv.tv_sec = nTimeoutMillis / 1000;
+    tv.tv_usec = (nTimeoutMillis % 1000) * 1000;
+    ev->trigger(&tv);
+    return deferred;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -188,7 +309,27 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
+            std::shared_ptr<HTTPRPCDeferredReply> deferred;
+            jreq.deferReply = [&](int64_t nTimeoutMillis, std::function<UniValue()> onTimeout) -> std::shared_ptr<CRPCDeferredReply>
+            {
+                deferred = DeferReply(req, jreq.id, nTimeoutMillis, std::move(onTimeout));
+                return deferred;
+            };
+
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+            } catch (const UniValue& objError) {
+                if (!deferred)
+                    throw;
+                deferred->ReplyError(objError);
+            }
+            if (deferred)
+            {
+                // The reply goes out from wherever the result comes from (or on timeout), keep the request until then.
+                req->Detach([deferred](std::unique_ptr<HTTPRequest> reqDetached) { deferred->Activate(std::move(reqDetached)); });
+                return true;
+            }
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
@@ -246,6 +387,18 @@ bool StartHTTPRPC()
 void InterruptHTTPRPC()
 {
     LogPrint(BCLog::RPC, "Interrupting HTTP RPC server\n");
+    // Nothing is going to answer the calls still waiting anymore, give them their timeout reply now.
+    std::map<const HTTPRPCDeferredReply*, std::shared_ptr<HTTPRPCDeferredReply>> mapInterrupted;
+    {
+        LOCK(cs_deferredReplies);
+        fDeferredRepliesInterrupted = true;
+        mapInterrupted.swap(mapDeferredReplies);
+    }
+    for (const auto& [pDeferred, deferred] : mapInterrupted)
+    {
+        (unused)pDeferred;
+        deferred->ReplyTimeout();
+    }
 }
 
 void StopHTTPRPC()
@@ -6,6 +6,7 @@
 
 #include "chainparamsbase.h"
 #include "compat.h"
+#include "metrics.h"
 #include "util.h"
 #include "netbase.h"
 #include "rpc/protocol.h" // For HTTP status codes
@@ -43,12 +44,20 @@ class HTTPWorkItem : public HTTPClosure
 {
 public:
     HTTPWorkItem(std::unique_ptr<HTTPRequest> _req, const std::string &_path, const HTTPRequestHandler& _func):
-        req(std::move(_req)), path(_path), func(_func)
+        req(std::move(_req)), path(_path), func(_func), queued(std::chrono::steady_clock::now())
     {
     }
     void operator()()
     {
+        static CMetric metricQueueWait("HTTP: time in work queue", BCLog::HTTP);
+        metricQueueWait.Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queued).count());
         func(req.get(), path);
+        if (req->onDetached)
+        {
+            std::function<void(std::unique_ptr<HTTPRequest>)> onDetached = std::move(req->onDetached);
+            req->onDetached = nullptr;
+            onDetached(std::move(req));
+        }
     }
 
     std::unique_ptr<HTTPRequest> req;
@@ -56,6 +65,7 @@ public:
 private:
     std::string path;
     HTTPRequestHandler func;
+    std::chrono::steady_clock::time_point queued;
 };
 
 /** Simple work queue for distributing work over multiple threads.
@@ -72,6 +82,8 @@ private:
     bool running;
     size_t maxDepth;
     int numThreads;
+    uint64_t numProcessed;
+    uint64_t numRejected;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -94,7 +106,9 @@ private:
 public:
     WorkQueue(size_t _maxDepth) : running(true),
                                  maxDepth(_maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 numProcessed(0),
+                                 numRejected(0)
     {
     }
     /** Precondition: worker threads have all stopped
@@ -108,6 +122,7 @@ public:
     {
         std::unique_lock<std::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
+            ++numRejected;
             return false;
         }
         queue.emplace_back(std::unique_ptr<WorkItem>(item));
@@ -128,6 +143,7 @@ public:
                     break;
                 i = std::move(queue.front());
                 queue.pop_front();
+                ++numProcessed;
             }
             (*i)();
         }
@@ -139,6 +155,16 @@ public:
         running = false;
         cond.notify_all();
     }
+    /** Current depth, limit and throughput, for HTTPServerStats */
+    void GetStats(HTTPServerStats& stats)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        stats.nWorkerThreads = numThreads;
+        stats.nWorkQueueDepth = queue.size();
+        stats.nWorkQueueMaxDepth = maxDepth;
+        stats.nRequestsProcessed = numProcessed;
+        stats.nRequestsRejected = numRejected;
+    }
     /** Wait for worker threads to exit */
     void WaitExit()
     {
@@ -162,18 +188,19 @@ struct HTTPPathHandler
 
 /** HTTP module state */
 
-//! libevent event loop
-static struct event_base* eventBase = 0;
-//! HTTP server
-struct evhttp* eventHTTP = 0;
+//! libevent event loops (-rpceventthreads); each accepts connections of its own, and parses and replies to the requests on them. The first also runs
+//! the events of other modules, see EventBase().
+static std::vector<struct event_base*> eventBases;
+//! HTTP servers, one per event loop
+static std::vector<struct evhttp*> eventHTTPs;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-std::vector<evhttp_bound_socket *> boundSockets;
+//! Bound listening sockets, with the server they belong to
+std::vector<std::pair<struct evhttp*, evhttp_bound_socket*>> boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -310,8 +337,41 @@ static bool ThreadHTTP(struct event_base* base, struct evhttp* http)
     return event_base_got_break(base) == 0;
 }
 
-/** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp* http)
+#ifdef SO_REUSEPORT
+/**
+ * A listening socket on addr that the other event loops can each have one of as well, the kernel spreading the incoming connections over them.
+ * Returns -1 on failure.
+ */
+static evutil_socket_t CreateReusePortListenSocket(const CService& addr)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addr.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return -1;
+    evutil_socket_t fd = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+        return -1;
+    int one = 1;
+    bool fOk = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one)) == 0
+            && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one)) == 0;
+    // IPv6 sockets only take IPv6 connections, so that the IPv4 wildcard can be bound next to the IPv6 one.
+    if (fOk && addr.IsIPv6())
+        fOk = setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&one, sizeof(one)) == 0;
+    fOk = fOk && evutil_make_socket_nonblocking(fd) == 0
+              && evutil_make_socket_closeonexec(fd) == 0
+              && bind(fd, (struct sockaddr*)&sockaddr, len) == 0
+              && listen(fd, 128) == 0;
+    if (!fOk)
+    {
+        evutil_closesocket(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+/** Bind HTTP servers to specified addresses; with several event loops each gets a socket of its own for every address. */
+static bool HTTPBindAddresses()
 {
     int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
     std::vector<std::pair<std::string, uint16_t> > endpoints;
@@ -338,12 +398,33 @@ static bool HTTPBindAddresses(struct evhttp* http)
     // Bind addresses
     for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint(BCLog::HTTP, "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
-        if (bind_handle) {
-            boundSockets.push_back(bind_handle);
-        } else {
-            LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+        if (eventHTTPs.size() == 1) {
+            evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(eventHTTPs[0], i->first.empty() ? NULL : i->first.c_str(), i->second);
+            if (bind_handle) {
+                boundSockets.push_back(std::pair(eventHTTPs[0], bind_handle));
+            } else {
+                LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+            }
+            continue;
+        }
+#ifdef SO_REUSEPORT
+        CService addr;
+        if (!Lookup(i->first.empty() ? "0.0.0.0" : i->first.c_str(), addr, i->second, true)) {
+            LogPrintf("Binding RPC on address %s port %i failed, could not resolve address.\n", i->first, i->second);
+            continue;
         }
+        for (struct evhttp* http : eventHTTPs) {
+            evutil_socket_t fd = CreateReusePortListenSocket(addr);
+            evhttp_bound_socket *bind_handle = (fd >= 0) ? evhttp_accept_socket_with_handle(http, fd) : NULL;
+            if (!bind_handle) {
+                if (fd >= 0)
+                    evutil_closesocket(fd);
+                LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+                break;
+            }
+            boundSockets.push_back(std::pair(http, bind_handle));
+        }
+#endif
     }
     return !boundSockets.empty();
 }
@@ -368,11 +449,20 @@ static void libevent_log_cb(int severity, const char *msg)
         LogPrint(BCLog::LIBEVENT, "libevent: %s\n", msg);
 }
 
-bool InitHTTPServer()
+/** Free the HTTP servers and event loops set up so far */
+static void FreeHTTPEventBases()
 {
-    struct evhttp* http = 0;
-    struct event_base* base = 0;
+    for (struct evhttp* http : eventHTTPs)
+        evhttp_free(http);
+    eventHTTPs.clear();
+    for (struct event_base* base : eventBases)
+        event_base_free(base);
+    eventBases.clear();
+    boundSockets.clear();
+}
 
+bool InitHTTPServer()
+{
     if (!InitHTTPAllowList())
         return false;
 
@@ -398,29 +488,41 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    base = event_base_new(); // XXX RAII
-    if (!base) {
-        LogPrintf("Couldn't create an event_base: exiting\n");
-        return false;
+    int eventThreads = std::max((long)GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS), 1L);
+#ifndef SO_REUSEPORT
+    if (eventThreads > 1) {
+        LogPrintf("HTTP: -rpceventthreads needs SO_REUSEPORT, which this platform doesn't have; using one event thread\n");
+        eventThreads = 1;
     }
+#endif
 
-    /* Create a new evhttp object to handle requests. */
-    http = evhttp_new(base); // XXX RAII
-    if (!http) {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        event_base_free(base);
-        return false;
-    }
+    for (int i = 0; i < eventThreads; i++) {
+        struct event_base* base = event_base_new(); // XXX RAII
+        if (!base) {
+            LogPrintf("Couldn't create an event_base: exiting\n");
+            FreeHTTPEventBases();
+            return false;
+        }
+        eventBases.push_back(base);
 
-    evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(http, MAX_SIZE);
-    evhttp_set_gencb(http, http_request_cb, NULL);
+        /* Create a new evhttp object to handle requests. */
+        struct evhttp* http = evhttp_new(base); // XXX RAII
+        if (!http) {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            FreeHTTPEventBases();
+            return false;
+        }
+        eventHTTPs.push_back(http);
 
-    if (!HTTPBindAddresses(http)) {
+        evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+        evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(http, MAX_SIZE);
+        evhttp_set_gencb(http, http_request_cb, NULL);
+    }
+
+    if (!HTTPBindAddresses()) {
         LogPrintf("Unable to bind any endpoint for RPC server\n");
-        evhttp_free(http);
-        event_base_free(base);
+        FreeHTTPEventBases();
         return false;
     }
 
@@ -429,8 +531,6 @@ bool InitHTTPServer()
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    eventBase = base;
-    eventHTTP = http;
     return true;
 }
 
@@ -448,17 +548,19 @@ bool UpdateHTTPServerLogging(bool enable) {
 #endif
 }
 
-std::thread threadHTTP;
-std::future<bool> threadResult;
+std::vector<std::thread> threadsHTTP;
+std::vector<std::future<bool>> threadResults;
 
 bool StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
     int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
-    threadResult = task.get_future();
-    threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
+    LogPrintf("HTTP: starting %d event threads and %d worker threads\n", eventBases.size(), rpcThreads);
+    for (size_t i = 0; i < eventBases.size(); i++) {
+        std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
+        threadResults.push_back(task.get_future());
+        threadsHTTP.emplace_back(std::move(task), eventBases[i], eventHTTPs[i]);
+    }
 
     for (int i = 0; i < rpcThreads; i++) {
         std::thread rpc_worker(HTTPWorkQueueRun, workQueue);
@@ -470,13 +572,14 @@ bool StartHTTPServer()
 void InterruptHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Interrupting HTTP server\n");
-    if (eventHTTP) {
-        // Unlisten sockets
-        for (evhttp_bound_socket *socket : boundSockets) {
-            evhttp_del_accept_socket(eventHTTP, socket);
-        }
-        // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+    // Unlisten sockets
+    for (const auto& [http, socket] : boundSockets) {
+        evhttp_del_accept_socket(http, socket);
+    }
+    boundSockets.clear();
+    // Reject requests on current connections
+    for (struct evhttp* http : eventHTTPs) {
+        evhttp_set_gencb(http, http_reject_request_cb, NULL);
     }
     if (workQueue)
         workQueue->Interrupt();
@@ -491,34 +594,42 @@ void StopHTTPServer()
         delete workQueue;
         workQueue = nullptr;
     }
-    if (eventBase) {
-        LogPrint(BCLog::HTTP, "Waiting for HTTP event thread to exit\n");
+    if (!threadsHTTP.empty()) {
+        LogPrint(BCLog::HTTP, "Waiting for HTTP event threads to exit\n");
         // Give event loop a few seconds to exit (to send back last RPC responses), then break it
         // Before this was solved with event_base_loopexit, but that didn't work as expected in
         // at least libevent 2.0.21 and always introduced a delay. In libevent
         // master that appears to be solved, so in the future that solution
         // could be used again (if desirable).
         // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
-        if (threadResult.valid() && threadResult.wait_for(std::chrono::milliseconds(2000)) == std::future_status::timeout) {
-            LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
-            event_base_loopbreak(eventBase);
+        // The loops wind down side by side, so they share the one allotment.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2000);
+        for (size_t i = 0; i < threadsHTTP.size(); i++) {
+            if (threadResults[i].valid() && threadResults[i].wait_until(deadline) == std::future_status::timeout) {
+                LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
+                event_base_loopbreak(eventBases[i]);
+            }
+            threadsHTTP[i].join();
         }
-        threadHTTP.join();
-    }
-    if (eventHTTP) {
-        evhttp_free(eventHTTP);
-        eventHTTP = 0;
-    }
-    if (eventBase) {
-        event_base_free(eventBase);
-        eventBase = 0;
+        threadsHTTP.clear();
+        threadResults.clear();
     }
+    FreeHTTPEventBases();
     LogPrint(BCLog::HTTP, "Stopped HTTP server\n");
 }
 
 struct event_base* EventBase()
 {
-    return eventBase;
+    return eventBases.empty() ? nullptr : eventBases[0];
+}
+
+bool GetHTTPServerStats(HTTPServerStats& stats)
+{
+    if (!workQueue)
+        return false;
+    stats.nEventThreads = eventBases.size();
+    workQueue->GetStats(stats);
+    return true;
 }
 
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
@@ -550,6 +661,9 @@ void HTTPEvent::trigger(struct timeval* tv)
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
                                                        replySent(false)
 {
+    // The reply has to be sent from the event loop that the connection belongs to.
+    evhttp_connection* con = evhttp_request_get_connection(req);
+    base = con ? evhttp_connection_get_base(con) : EventBase();
 }
 HTTPRequest::~HTTPRequest()
 {
@@ -604,14 +718,23 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+void HTTPRequest::WriteReplyPart(const char* pData, size_t nSize)
+{
+    assert(!replySent && req);
+    // The event loop doesn't touch the output buffer of the request before the reply is sent, so this can go straight in.
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_add(evb, pData, nSize);
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
     assert(!replySent && req);
-    // Send event to main http thread to send reply message
+    // Send event to the http thread of the connection to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
-    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+    HTTPEvent* ev = new HTTPEvent(base, true,
         std::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
     replySent = true;
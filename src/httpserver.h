@@ -8,10 +8,12 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+static const int DEFAULT_HTTP_EVENT_THREADS=1;
 
 struct evhttp_request;
 struct event_base;
@@ -32,6 +34,19 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** What the HTTP server is doing, see GetHTTPServerStats */
+struct HTTPServerStats
+{
+    int nEventThreads = 0;
+    int nWorkerThreads = 0;
+    size_t nWorkQueueDepth = 0;
+    size_t nWorkQueueMaxDepth = 0;
+    uint64_t nRequestsProcessed = 0;
+    uint64_t nRequestsRejected = 0;
+};
+/** Fill stats with the event loops and the state of the work queue; false if the server isn't set up. */
+bool GetHTTPServerStats(HTTPServerStats& stats);
+
 /** Change logging level for libevent. Removes BCLog::LIBEVENT from logCategories if
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
@@ -58,7 +73,13 @@ class HTTPRequest
 {
 private:
     struct evhttp_request* req;
+    //! The event loop of the connection, which the reply is handed to
+    struct event_base* base;
     bool replySent;
+    //! Takes over the request once the handler that detached it has returned, see Detach.
+    std::function<void(std::unique_ptr<HTTPRequest>)> onDetached;
+
+    friend class HTTPWorkItem;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -105,6 +126,14 @@ public:
      */
     void WriteHeader(const std::string& hdr, const std::string& value);
 
+    /**
+     * Append to the body of the reply, for replies that are made up piece by piece.
+     * The body is sent, after what was appended, by WriteReply.
+     *
+     * @note call this before calling WriteReply.
+     */
+    void WriteReplyPart(const char* pData, size_t nSize);
+
     /**
      * Write HTTP reply.
      * nStatus is the HTTP status code to send.
@@ -114,6 +143,17 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Keep the request after the handler returns, for a reply from elsewhere later (a long poll) instead of tying up the worker thread
+     * meanwhile. Once the handler has returned onDetachedIn is handed the request, to reply to and then delete.
+     *
+     * @note call this from the handler; don't reply to the request from the handler after.
+     */
+    void Detach(std::function<void(std::unique_ptr<HTTPRequest>)> onDetachedIn) { onDetached = std::move(onDetachedIn); }
+
+    //! The event loop of the connection, for timers that belong with the request.
+    struct event_base* GetEventBase() const { return base; }
 };
 
 /** Event handler closure.
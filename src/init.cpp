@@ -26,7 +26,14 @@
 #include <Gulden/auto_checkpoints.h>
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "executor.h"
+#include "hashkernels.h"
 #include "validation/validation.h"
+#include "validation/txindex.h"
+#include "validation/addressindex.h"
+#include "validation/blockfilterindex.h"
+#include "validation/chainstatus.h"
 #include "validation/witnessvalidation.h"
 #include "validation/validationinterface.h"
 #include "validation/versionbitsvalidation.h"
@@ -36,12 +43,14 @@
 #include "key.h"
 #include "generation/miner.h"
 #include "generation/witness.h"
+#include "generation/poolserver.h"
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
 #include "policy/feerate.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "rpc/blockchain.h"
@@ -62,6 +71,7 @@
 #include "warnings.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <future>
 #include <memory>
 
 #ifndef WIN32
@@ -79,6 +89,8 @@
 
 #if ENABLE_ZMQ
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqpublishnotifier.h"
+#include "zmq/zmqrpc.h"
 #endif
 
 #include "util.h"
@@ -93,9 +105,6 @@ static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
-#endif
 
 #ifdef WIN32
 // Win32 LevelDB doesn't use filedescriptors, and the ones used for
@@ -138,6 +147,7 @@ static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
 
 
 std::atomic<bool> fDumpMempoolLater(false);
+std::atomic<bool> fDumpSignatureCacheLater(false);
 bool partiallyEraseDatadirOnShutdown=false;
 bool fullyEraseDatadirOnShutdown=false;
 
@@ -182,10 +192,41 @@ void CoreInterrupt(boost::thread_group& threadGroup)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptPoolServer();
     threadGroup.interrupt_all();
     LogPrintf("Core interrupt: done.\n");
 }
 
+/**
+ * A startup or shutdown phase that doesn't depend on the ones around it (e.g. at startup on the block index), run on a thread of its own
+ * alongside them. Whatever depends on it calls Wait() first; that rethrows what the phase threw and is a no-op once it has finished.
+ */
+class CParallelPhase
+{
+public:
+    CParallelPhase(const std::string& strNameIn, std::function<void()> func)
+    : strName(strNameIn)
+    , nStart(GetTimeMillis())
+    , future(std::async(std::launch::async, [this, func]() { RenameThread(("Gulden-" + strName).c_str()); func(); nDone = GetTimeMillis(); }))
+    {
+    }
+
+    void Wait()
+    {
+        if (!future.valid())
+            return;
+        int64_t nWaitStart = GetTimeMillis();
+        future.get();
+        LogPrintf("Phase %s took %dms, waited %dms for it\n", strName, nDone - nStart, GetTimeMillis() - nWaitStart);
+    }
+
+private:
+    const std::string strName;
+    const int64_t nStart;
+    std::atomic<int64_t> nDone{0};
+    std::future<void> future;
+};
+
 void CoreShutdown(boost::thread_group& threadGroup)
 {
     LogPrintf("Core shutdown: commence core shutdown\n");
@@ -215,7 +256,9 @@ void CoreShutdown(boost::thread_group& threadGroup)
     StopREST();
     MilliSleep(20); //Allow other threads (UI etc. a chance to cleanup as well)
     StopTorControl();
+    StopPoolServer();
     threadGroup.join_all();
+    StopExecutor();
     MilliSleep(20); //Allow other threads (UI etc. a chance to cleanup as well)
 
     #ifdef ENABLE_WALLET
@@ -230,31 +273,61 @@ void CoreShutdown(boost::thread_group& threadGroup)
     MapPort(false);
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
+    UnregisterValidationInterface(&witnessPoolPrecompute);
+    witnessPoolPrecompute.SetScheduler(nullptr);
     g_connman.reset();
     MilliSleep(20); //Allow other threads (UI etc. a chance to cleanup as well)
 
     UnregisterNodeSignals(GetNodeSignals());
-    if (fDumpMempoolLater && GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool();
-    }
+    // The dumps don't depend on each other nor on the chainstate, so they are written alongside the final flush below.
+    CParallelPhase mempoolDump("shutdown-mempool", []() {
+        if (fDumpMempoolLater && GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+            DumpMempool();
+        }
+    });
+    CParallelPhase sigcacheDump("shutdown-sigcache", []() {
+        if (fDumpSignatureCacheLater && GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+            DumpSignatureCache();
+        }
+    });
+    CParallelPhase feeEstimatesDump("shutdown-fees", []() {
+        if (fFeeEstimatesInitialized)
+        {
+            ::feeEstimator.FlushUnconfirmed(::mempool);
+            fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+            CAutoFile est_fileout(fsbridge::fopen(est_path, "wb"), SER_DISK, CLIENT_VERSION);
+            if (!est_fileout.IsNull())
+                ::feeEstimator.Write(est_fileout);
+            else
+                LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+            fFeeEstimatesInitialized = false;
+        }
+    });
 
-    if (fFeeEstimatesInitialized)
+    if (g_txindex)
     {
-        ::feeEstimator.FlushUnconfirmed(::mempool);
-        fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-        CAutoFile est_fileout(fsbridge::fopen(est_path, "wb"), SER_DISK, CLIENT_VERSION);
-        if (!est_fileout.IsNull())
-            ::feeEstimator.Write(est_fileout);
-        else
-            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
-        fFeeEstimatesInitialized = false;
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+    if (g_addressindex)
+    {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_blockfilterindex)
+    {
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
     }
 
     LogPrintf("Core shutdown: close coin databases.\n");
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
-            FlushStateToDisk();
+            if (GetBoolArg("-fastshutdown", DEFAULT_FAST_SHUTDOWN))
+                FlushStateToJournal();
+            else
+                FlushStateToDisk();
         }
         blockStore.CloseBlockFiles();
         delete pcoinsTip;
@@ -271,9 +344,15 @@ void CoreShutdown(boost::thread_group& threadGroup)
         delete ppow2witdbview;
         ppow2witdbview = NULL;
 
+        // Lets the next startup's VerifyDB trust what this one verified.
+        if (pblocktree)
+            pblocktree->WriteFlag("cleanshutdown", true);
         delete pblocktree;
         pblocktree = NULL;
     }
+    mempoolDump.Wait();
+    sigcacheDump.Wait();
+    feeEstimatesDump.Wait();
     MilliSleep(20); //Allow other threads (UI etc. a chance to cleanup as well)
 
 
@@ -321,6 +400,7 @@ void CoreShutdown(boost::thread_group& threadGroup)
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("Core shutdown: done.\n");
+    StopLogWriter();
     MilliSleep(20); //Allow other threads (UI etc. a chance to cleanup as well)
     
     if (fullyEraseDatadirOnShutdown||partiallyEraseDatadirOnShutdown)
@@ -427,12 +507,19 @@ std::string HelpMessage(HelpMessageMode mode)
     std::string strUsage = HelpMessageGroup(helptr("Options:"));
     strUsage += HelpMessageOpt("-?", helptr("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", helptr("Print version and exit"));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(helptr("Maintain an index of the outputs and spends of every address (including witness addresses), used by the getaddressbalance and getaddresshistory rpc calls; built in the background (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-alerts", strprintf(helptr("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", helptr("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockarena", strprintf(helptr("Read the transactions of a block from disk or from a peer into one arena for the block rather than allocating each on its own (default: %u)"), DEFAULT_BLOCK_ARENA));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(helptr("Maintain an index of compact block filters (BIP158) of every block, used by the getblockfilter rpc call and -peerblockfilters; built in the background (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", helptr("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(helptr("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(helptr("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)"), defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-assumecheckpointpow", strprintf(helptr("Skip proof of work verification for headers that link up to a checkpoint, checking only their linkage (requires -checkpoints, default: %u)"), DEFAULT_ASSUME_CHECKPOINT_POW));
+    strUsage += HelpMessageOpt("-samplepow=<n>", strprintf(helptr("Light client mode: accept SIGMA headers older than -samplepowtipage on their linkage and difficulty, and verify the proof of work of one in <n> of them in the background (0 = verify every header, default: %d)"), DEFAULT_SAMPLE_POW));
+    strUsage += HelpMessageOpt("-samplepowtipage=<n>", strprintf(helptr("With -samplepow, always verify headers younger than <n> hours immediately (default: %d)"), DEFAULT_SAMPLE_POW_TIP_AGE));
+    strUsage += HelpMessageOpt("-schedulerthreads=<n>", strprintf(helptr("Set the number of threads that run background tasks such as database flushes and address dumps (1 to %d, default: %d)"), MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(helptr("Specify configuration file (default: %s)"), GULDEN_CONF_FILENAME));
     if (mode == HMM_GULDEND)
     {
@@ -440,31 +527,51 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-daemon", helptr("Run in the background as a daemon and accept commands"));
 #endif
     }
+    strUsage += HelpMessageOpt("-fastshutdown", strprintf(helptr("At shutdown write the coin and witness caches to a journal that is read back at the next start, instead of to their databases; quicker with a large -dbcache (default: %u)"), DEFAULT_FAST_SHUTDOWN));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(helptr("Write the coin and witness caches to disk from a background thread, so that validation doesn't wait for the write (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
+    strUsage += HelpMessageOpt("-compressblocks", strprintf(helptr("Store new blocks LZ4 compressed in the block files; existing blocks are left as they are and both formats can be read (default: %u)"), DEFAULT_COMPRESS_BLOCKS));
     strUsage += HelpMessageOpt("-datadir=<dir>", helptr("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(helptr("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbidlecompact=<n>", strprintf(helptr("Compact the databases bit by bit once no new block was connected for <n> seconds, so that less compaction is left for block processing; 0 to leave it to the database (default: %d)"), DEFAULT_DB_IDLE_COMPACT));
+    if (showDebug)
+    {
+        strUsage += HelpMessageOpt("-<db>-blockcache=<n>", "Set the LevelDB block cache of database <db> (blockindex, chainstate, witstate, addressindex or blockfilterindex) to <n> megabytes (default: half of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-<db>-writebuffer=<n>", "Set the LevelDB write buffer of database <db> to <n> megabytes (default: a quarter of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-<db>-bloombits=<n>", strprintf("Use <n> bits per key for the LevelDB bloom filters of database <db>, 0 for none; only affects tables written from then on (default: %d)", DEFAULT_DB_BLOOM_BITS));
+        strUsage += HelpMessageOpt("-<db>-maxopenfiles=<n>", strprintf("Let LevelDB keep up to <n> files of database <db> open (default: %d)", DEFAULT_DB_MAX_OPEN_FILES));
+    }
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", helptr("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(helptr("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphantxsize=<n>", strprintf(helptr("Keep unconnectable transactions in memory below <n> megabytes, a single peer's below a quarter of that (default: %u)"), DEFAULT_MAX_ORPHAN_TX_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(helptr("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(helptr("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-memorybudget=<n>", strprintf(helptr("Keep to about <n> megabytes of memory: -dbcache, -maxmempool, -maxsigcachesize, -maxconnections and -sigmaverifypool default to a share of it, and the UTXO cache grows into what the rest leaves unused during initial sync and shrinks back near the tip (0 = off, default: %d)"), DEFAULT_MEMORY_BUDGET));
     strUsage += HelpMessageOpt("-persistmempool", strprintf(helptr("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistsigcache", strprintf(helptr("Whether to save the signature cache on shutdown and load on restart, so that transactions and blocks don't have to be verified again (default: %u)"), DEFAULT_PERSIST_SIGCACHE));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(helptr("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(helptr("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(helptr("Specify pid file (default: %s)"), GULDEN_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prefetchcoins", strprintf(helptr("Read the inputs of a block into the coins cache in parallel before connecting it, with as many threads as script verification (default: %u)"), DEFAULT_PREFETCH_COINS));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(helptr("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", helptr("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", helptr("Rebuild chain state and block index from the blk*.dat files on disk"));
     strUsage += HelpMessageOpt("-resyncforblockindexupgrade", helptr("In the event that the system requires an expensive block index upgrade, the system will bypass the upgrade in favour of simply doing a complete resync. This might be favourable for unattended devices like pis."));
+    strUsage += HelpMessageOpt("-sigmaverifypool=<n>", strprintf(helptr("Set the number of SIGMA headers that can be verified concurrently, each uses %dmb of memory (0 = auto, max: %d, default: %d)"), defaultSigmaSettings.argonMemoryCostKb/1024, MAX_SIGMA_VERIFY_POOL_SIZE, DEFAULT_SIGMA_VERIFY_POOL_SIZE));
+    strUsage += HelpMessageOpt("-sigmaverifycache=<n>", strprintf(helptr("Keep up to <n> megabytes of generated SIGMA arena chunks so that headers which are verified again (e.g. when their block arrives) are cheaper to verify (0 = disable, default: %d)"), DEFAULT_SIGMA_VERIFY_CACHE_MB));
+    strUsage += HelpMessageOpt("-benchmarkkernels", strprintf(helptr("Time the hash implementations this processor supports at startup and use the fastest, instead of the widest its feature flags allow; the outcome is kept in hashkernels.dat in the data directory and reused until the processor or the software changes (default: %u)"), DEFAULT_BENCHMARK_KERNELS));
+    strUsage += HelpMessageOpt("-sigmapartialverify=<n>", strprintf(helptr("Percentage of SIGMA headers to only half verify while all verify contexts are busy, headers are always fully verified when there are idle contexts (0-100, default: %d)"), DEFAULT_SIGMA_PARTIAL_VERIFY_PERCENT));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", helptr("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(helptr("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-threadbudget=<n>", strprintf(helptr("Set the number of threads shared by parallel SIGMA verification, witness candidate evaluation, database lookups and arena preparation for mining (0 = one per core, <0 = leave that many cores free, max: %d, default: %d)"), MAX_THREAD_BUDGET, DEFAULT_THREAD_BUDGET));
+    strUsage += HelpMessageOpt("-txindex", strprintf(helptr("Maintain a full transaction index, used by the getrawtransaction rpc call; when turned on for an existing node the index is built in the background (default: %u)"), DEFAULT_TXINDEX));
 
     strUsage += HelpMessageGroup(helptr("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", helptr("Add a node to connect to and attempt to keep the connection open"));
@@ -483,10 +590,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(helptr("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(helptr("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(helptr("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(helptr("Set the number of threads that process messages from peers, the messages of one peer are always processed in order (1 to %d, default: %d)"), MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
+    strUsage += HelpMessageOpt("-netthreads=<n>", strprintf(helptr("Set the number of threads that send to and receive from peers (1 to %d, default: %d)"), MAX_NET_THREADS, DEFAULT_NET_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(helptr("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", helptr("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(helptr("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(helptr("Serve compact block filters (BIP157) to peers, needs -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
+    strUsage += HelpMessageOpt("-peercompression", strprintf(helptr("Compress blocks and headers sent to peers that can decompress them (default: %u)"), DEFAULT_PEER_COMPRESSION));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(helptr("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt("-peerpowbudget=<n>", strprintf(helptr("Proof of work verification time (in ms) an inbound peer may use in one burst before further headers from it wait for other peers (default: %d)"), DEFAULT_PEER_POW_BUDGET_MS));
+    strUsage += HelpMessageOpt("-peerpowbudgetrate=<n>", strprintf(helptr("Proof of work verification time (in ms per second) each inbound peer is allowed on average (default: %d)"), DEFAULT_PEER_POW_BUDGET_RATE));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(helptr("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", helptr("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(helptr("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
@@ -517,7 +630,13 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", helptr("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", helptr("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", helptr("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawheader=<address>", helptr("Enable publish raw block header in <address>"));
     strUsage += HelpMessageOpt("-zmqpubstalledwitness=<address>", helptr("Enable publish of slow witnesses in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubwitnessselected=<address>", helptr("Enable publish of the witness selected for a block in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubwitnesssigned=<address>", helptr("Enable publish of witnessed blocks in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubphasechange=<address>", helptr("Enable publish of PoW2 phase changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpub<type>hwm=<n>", strprintf(helptr("Set the outbound message high water mark of the socket of publisher <type> (hashblock, hashtx, rawblock, rawtx, rawheader, stalledwitness, witnessselected, witnesssigned or phasechange), messages kept per subscriber (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqqueuesize=<n>", strprintf(helptr("Messages kept per socket while they wait to be sent, beyond that notifications are dropped (default: %d)"), DEFAULT_ZMQ_QUEUE_SIZE));
 #endif
 
     strUsage += HelpMessageGroup(helptr("Debugging/Testing options:"));
@@ -547,13 +666,21 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-debugexclude=<category>", strprintf(helptr("Exclude debugging information for a category. Can be used in conjunction with -debug=1 to output debug logs for all categories except one or more specified categories.")));
     strUsage += HelpMessageOpt("-gen", strprintf(helptr("Generate coins (default: %u)"), DEFAULT_GENERATE));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(helptr("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_THREADS));
-    strUsage += HelpMessageOpt("-genmemlimit=<n>", strprintf(helptr("Set the memory limit for coin generation (in Kilobytes) if enabled (default: 4194304 (4Gb))")));
+    strUsage += HelpMessageOpt("-genmemlimit=<n>", strprintf(helptr("Set the memory limit for coin generation (in Kilobytes) if enabled, capped to what fits in physical memory without swapping (default: 4194304 (4Gb))")));
+    strUsage += HelpMessageOpt("-genlargepages", strprintf(helptr("Back mining arenas with huge/large pages where the operating system allows it, falling back to normal pages otherwise (default: %u)"), DEFAULT_GENERATE_LARGE_PAGES));
+    strUsage += HelpMessageOpt("-genlockmemory", strprintf(helptr("Lock mining arenas into physical memory so they are never swapped out, if permitted (default: %u)"), DEFAULT_GENERATE_LOCK_MEMORY));
+    strUsage += HelpMessageOpt("-gennuma", strprintf(helptr("On NUMA machines bind each mining arena to a NUMA node and pin the threads that mine it to the cores of that node (default: %u)"), DEFAULT_GENERATE_NUMA));
+    strUsage += HelpMessageOpt("-genhashlimit=<n>", strprintf(helptr("Mine at no more than <n> hashes per second over all mining threads together (0 = no limit, default: %d)"), DEFAULT_GENERATE_HASH_LIMIT));
+    strUsage += HelpMessageOpt("-gendutycycle=<n>", strprintf(helptr("Let every mining thread hash for only <n> percent of the time and sleep for the rest, to leave the cores to other work (1-100, default: %d)"), DEFAULT_GENERATE_DUTY_CYCLE));
+    strUsage += HelpMessageOpt("-genarenadoublebuffer", strprintf(helptr("Prepare a second set of arenas in the background while mining so that restarts on the same block do not have to wait for arena setup; uses twice the -genmemlimit memory (default: %u)"), DEFAULT_GENERATE_ARENA_DOUBLE_BUFFER));
     strUsage += HelpMessageOpt("-help-debug", helptr("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-logasync", strprintf(helptr("Write debug output from a separate thread, so logging doesn't hold up the node; output is written out every %dms (default: %u)"), LOG_FLUSH_INTERVAL_MS, DEFAULT_LOGASYNC));
     strUsage += HelpMessageOpt("-logips", strprintf(helptr("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(helptr("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
+        strUsage += HelpMessageOpt("-lockstats", strprintf("Record how long locks are waited for and held, per place in the code, for getlockstats (default: %u)", DEFAULT_LOCKSTATS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
@@ -583,6 +710,7 @@ std::string HelpMessage(HelpMessageMode mode)
         CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
     strUsage += HelpMessageOpt("-whitelistrelay", strprintf(helptr("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)"), DEFAULT_WHITELISTRELAY));
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(helptr("Force relay of transactions from whitelisted peers even if they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf(helptr("Announce transactions to peers that support it by reconciling sets of short ids instead of sending an inv for each (default: %u)"), DEFAULT_TX_RECONCILIATION));
 
     strUsage += HelpMessageGroup(helptr("Block generation options:"));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(helptr("Set maximum BIP141 block weight (default: %d)"), DEFAULT_BLOCK_MAX_WEIGHT));
@@ -591,9 +719,18 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
+    strUsage += HelpMessageGroup(helptr("Pool server options:"));
+    strUsage += HelpMessageOpt("-poolserver", strprintf(helptr("Serve mining work to pool miners over a persistent stratum style connection (default: %u)"), DEFAULT_POOL_SERVER));
+    strUsage += HelpMessageOpt("-poolserveraddress=<addr>", helptr("Address to pay block rewards found through the pool server to (required with -poolserver)"));
+    strUsage += HelpMessageOpt("-poolserverbind=<addr>", strprintf(helptr("Bind the pool server to the given address (default: %s)"), DEFAULT_POOL_SERVER_BIND));
+    strUsage += HelpMessageOpt("-poolserverport=<port>", strprintf(helptr("Listen for pool miner connections on <port> (default: %u)"), DEFAULT_POOL_SERVER_PORT));
+    strUsage += HelpMessageOpt("-poolprenoncerange=<n>", strprintf(helptr("Number of pre nonces handed to each pool session by default (default: %u)"), DEFAULT_POOL_PRENONCE_RANGE));
+    strUsage += HelpMessageOpt("-poolshareshift=<n>", strprintf(helptr("Accept shares 2^n times easier than the block target (default: %u)"), DEFAULT_POOL_SHARE_SHIFT));
+    strUsage += HelpMessageOpt("-poolmaxsessions=<n>", strprintf(helptr("Maximum number of simultaneous pool sessions (default: %u)"), DEFAULT_POOL_MAX_SESSIONS));
+
     strUsage += HelpMessageGroup(helptr("RPC server options:"));
     strUsage += HelpMessageOpt("-server", helptr("Accept command line and JSON-RPC commands"));
-    strUsage += HelpMessageOpt("-rest", strprintf(helptr("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
+    strUsage += HelpMessageOpt("-rest", strprintf(helptr("Accept public REST requests, including the operation timings in the Prometheus text format at /rest/metrics (default: %u)"), DEFAULT_REST_ENABLE));
     strUsage += HelpMessageOpt("-rpcbind=<addr>[:port]", helptr("Bind to given address to listen for JSON-RPC connections. This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost, or if -rpcallowip has been specified, 0.0.0.0 and :: i.e., all addresses)"));
     strUsage += HelpMessageOpt("-rpccookiefile=<loc>", helptr("Location of the auth cookie (default: data dir)"));
     strUsage += HelpMessageOpt("-rpcuser=<user>", helptr("Username for JSON-RPC connections"));
@@ -612,7 +749,9 @@ std::string HelpMessage(HelpMessageMode mode)
 
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpceventthreads=<n>", strprintf("Set the number of threads to accept, parse and reply to RPC and REST requests on; more than one needs SO_REUSEPORT (default: %d)", DEFAULT_HTTP_EVENT_THREADS));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-rpctipcache", strprintf("Answer repeated calls of getblockchaininfo, getmininginfo, getwitnessinfo, getdifficulty and getnetworkhashps from memory until the next block (default: %u)", DEFAULT_RPC_TIP_CACHE));
     }
 
     return strUsage;
@@ -730,27 +869,10 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            FILE* file;
-            CDiskBlockPos pos(nFile, 0);
-            {
-                LOCK(cs_main);
-                if (!blockStore.BlockFileExists(pos))
-                    break; // No block files left to reindex
-                FILE *tmpfile = blockStore.GetBlockFile(pos, true);
-                if (!tmpfile)
-                    break; // This error is logged in OpenBlockFile
-                // dupping here because otherwise the cs_main might be locked for a long time
-                file = fdopen(dup(fileno(tmpfile)), "rb+");
-            }
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            fclose(file);
-            nFile++;
-        }
+        ReindexBlockFiles(chainparams);
         pblocktree->WriteReindexing(false);
         fReindex = false;
+        ClearPoWVerifiedBeforeReindex();
         LogPrintf("Reindexing finished\n");
         // To avoid ending up in a situation without genesis block, re-try initializing (no-op if reindexing worked):
         InitBlockIndex(chainparams);
@@ -1000,6 +1122,37 @@ bool AppInitBasicSetup()
     return true;
 }
 
+/** Default the memory options that aren't set explicitly to a share of a budget of nBudget MiB (-memorybudget). */
+static void ApplyMemoryBudget(int64_t nBudget)
+{
+    // The mempool gets an eighth, peers about a MiB each and the signature cache a sixty-fourth; a further eighth is held back
+    // (MEMORY_BUDGET_RESERVE_FRACTION) for the block index and everything else, and the database cache gets what is left.
+    int64_t nMempool = std::clamp<int64_t>(nBudget / 8, 5, DEFAULT_MAX_MEMPOOL_SIZE);
+    int64_t nConnections = std::clamp<int64_t>(nBudget / 16, 8, DEFAULT_MAX_PEER_CONNECTIONS);
+    int64_t nSigCache = std::clamp<int64_t>(nBudget / 64, 1, DEFAULT_MAX_SIG_CACHE_SIZE);
+    SoftSetArg("-maxmempool", i64tostr(nMempool));
+    SoftSetArg("-maxconnections", i64tostr(nConnections));
+    SoftSetArg("-maxsigcachesize", i64tostr(nSigCache));
+    nMempool = GetArg("-maxmempool", nMempool);
+    nConnections = GetArg("-maxconnections", nConnections);
+    nSigCache = GetArg("-maxsigcachesize", nSigCache);
+
+    int64_t nSigmaContexts = 0;
+    if (nBudget < 2048)
+    {
+        // Each verify context holds a SIGMA arena per thread; on small budgets don't have one per core.
+        nSigmaContexts = std::clamp<int64_t>(nBudget / 256, 1, MAX_SIGMA_VERIFY_POOL_SIZE);
+        SoftSetArg("-sigmaverifypool", i64tostr(nSigmaContexts));
+        // Reverse header sync keeps all headers in memory until they link up.
+        SoftSetBoolArg("-reverseheaders", false);
+    }
+
+    int64_t nDbCache = nBudget - nMempool - nConnections - nSigCache - nBudget / MEMORY_BUDGET_RESERVE_FRACTION;
+    SoftSetArg("-dbcache", i64tostr(std::clamp<int64_t>(nDbCache, nMinDbCache, nMaxDbCache)));
+    LogPrintf("Memory budget of %dMiB: dbcache %s, maxmempool %d, maxconnections %d, maxsigcachesize %d, sigmaverifypool %d\n",
+              nBudget, GetArg("-dbcache", ""), nMempool, nConnections, nSigCache, GetArg("-sigmaverifypool", nSigmaContexts));
+}
+
 bool AppInitParameterInteraction()
 {
     const CChainParams& chainparams = Params();
@@ -1011,8 +1164,19 @@ bool AppInitParameterInteraction()
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(errortr("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(errortr("Prune mode is incompatible with -addressindex."));
+        if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(errortr("Prune mode is incompatible with -blockfilterindex."));
     }
 
+    // A memory budget sizes the options below from it; explicitly set options go before it and the low memory defaults after.
+    int64_t nMemoryBudgetMiB = GetArg("-memorybudget", DEFAULT_MEMORY_BUDGET);
+    if (nMemoryBudgetMiB < 0)
+        return InitError(errortr("-memorybudget can't be negative."));
+    if (nMemoryBudgetMiB > 0)
+        ApplyMemoryBudget(nMemoryBudgetMiB);
+
     // Make sure enough file descriptors are available
     int nBind = std::max(
                 (gArgs.IsArgSet("-bind") ? gArgs.GetArgs("-bind").size() : 0) +
@@ -1126,6 +1290,14 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fPrefetchCoins = GetBoolArg("-prefetchcoins", DEFAULT_PREFETCH_COINS);
+    fBlockArena = GetBoolArg("-blockarena", DEFAULT_BLOCK_ARENA);
+    nDBIdleCompact = GetArg("-dbidlecompact", DEFAULT_DB_IDLE_COMPACT);
+    g_fLockStats = GetBoolArg("-lockstats", DEFAULT_LOCKSTATS);
+    blockStore.SetCompressBlocks(GetBoolArg("-compressblocks", DEFAULT_COMPRESS_BLOCKS));
+    fAssumeCheckpointPoW = GetBoolArg("-assumecheckpointpow", DEFAULT_ASSUME_CHECKPOINT_POW);
+    nSamplePoW = std::max(GetArg("-samplepow", DEFAULT_SAMPLE_POW), (int64_t)0);
+    nSamplePoWTipAge = std::max(GetArg("-samplepowtipage", DEFAULT_SAMPLE_POW_TIP_AGE), (int64_t)0) * 60 * 60;
 
     hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1179,6 +1351,9 @@ bool AppInitParameterInteraction()
 #ifdef ENABLE_WALLET
     RegisterWalletRPCCommands(tableRPC);
 #endif
+#if ENABLE_ZMQ
+    RegisterZMQRPCCommands(tableRPC);
+#endif
 
     nConnectTimeout = GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0)
@@ -1260,6 +1435,13 @@ bool AppInitParameterInteraction()
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS))
+    {
+        if (!GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(errortr("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     fEnableReplacement = GetBoolArg("-mempoolreplacement", DEFAULT_ENABLE_REPLACEMENT);
@@ -1332,10 +1514,29 @@ static bool LockDataDirectory(bool probeOnly)
     return true;
 }
 
+// The hash implementations -benchmarkkernels picked, and whether they were read back from an earlier run rather than timed on this one.
+static CHashKernelChoice hashKernelChoice;
+static bool fHashKernelChoiceCached = false;
+
+static fs::path GetHashKernelChoicePath()
+{
+    return GetDataDir() / "hashkernels.dat";
+}
+
 bool AppInitSanityChecks()
 {
     // ********************************************************* Step 4: sanity checks
 
+    bool fBenchmarkKernels = GetBoolArg("-benchmarkkernels", DEFAULT_BENCHMARK_KERNELS);
+    if (fBenchmarkKernels)
+    {
+        fHashKernelChoiceCached = ReadHashKernelChoice(GetHashKernelChoicePath(), hashKernelChoice) && IsHashKernelChoiceCurrent(hashKernelChoice);
+        if (!fHashKernelChoiceCached)
+            hashKernelChoice = NewHashKernelChoice();
+    }
+    std::string sha256_algo = SHA256AutoDetect(hashKernelChoice.nSHA256Disable, fBenchmarkKernels && !fHashKernelChoiceCached);
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1361,9 +1562,19 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 
     //fixme: (SIGMA) Improve.
-    // Select optimised algorithms for SIGMA
-    selected_argon2_echo_hash = argon2_echo_ctx_ref;
-    selectOptimisedImplementations();
+    // Select optimised algorithms for SIGMA; where the choice is benchmarked that takes a while, so it runs alongside the
+    // steps below. Needed by: anything that computes a PoW hash, the earliest of which is verifying the chain in step 7.
+    CParallelPhase sigmaSelection("init-sigma", []() {
+        selected_argon2_echo_hash = argon2_echo_ctx_ref;
+        if (!GetBoolArg("-benchmarkkernels", DEFAULT_BENCHMARK_KERNELS))
+        {
+            selectOptimisedImplementations();
+            return;
+        }
+        selectOptimisedImplementations(fHashKernelChoiceCached ? SIGMA_SELECT_CACHED : SIGMA_SELECT_BENCHMARK, hashKernelChoice.sigma);
+        if (!fHashKernelChoiceCached && !WriteHashKernelChoice(GetHashKernelChoicePath(), hashKernelChoice))
+            LogPrintf("Failed to write %s, the hash implementations will be timed again on the next start\n", GetHashKernelChoicePath().string());
+    });
 
 #ifndef WIN32
     CreatePidFile(GetPidFile(), getpid());
@@ -1376,6 +1587,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (fPrintToDebugLog)
         OpenDebugLog();
+    if (GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+        StartLogWriter();
 
     if (!fLogTimestamps)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()));
@@ -1385,11 +1598,24 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    // Needed by: script verification, the earliest of which is verifying the chain in step 7 (loading replaces the cache nonce).
+    CParallelPhase sigcacheLoad("init-sigcache", []() {
+        if (GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+            LoadSignatureCache();
+            fDumpSignatureCacheLater = true;
+        }
+    });
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadBlockCheck);
+        if (fPrefetchCoins) {
+            for (int i=0; i<nScriptCheckThreads-1; i++)
+                threadGroup.create_thread(&ThreadCoinsPrefetch);
+        }
     }
 
     //Gulden - private key for checkpoint system.
@@ -1406,9 +1632,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     // InitRPCMining is needed here so getblocktemplate in the GUI debug console works properly.
     InitRPCMining();
 #endif
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
+    int nSchedulerThreads = std::max(1, std::min((int)GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; ++i)
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1447,6 +1675,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     assert(!g_connman);
     g_connman = std::unique_ptr<CConnman>(new CConnman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())));
     CConnman& connman = *g_connman;
+    // Needed by: starting the node in step 11.
+    CParallelPhase addressesLoad("init-addresses", [&connman]() { connman.LoadAddresses(); });
 
     if (gArgs.IsArgSet("-disablenet"))
         g_connman->SetNetworkActive(false);
@@ -1603,7 +1833,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     pzmqNotificationInterface = CZMQNotificationInterface::Create();
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        // Publishing only, it has no reason to hold up validation.
+        RegisterValidationInterface(pzmqNotificationInterface, true);
     }
 #endif
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
@@ -1628,13 +1859,30 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nAddressIndexCache = 0;
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+    {
+        nAddressIndexCache = std::min(nTotalCache / 8, nMaxAddressIndexCache << 20);
+        nTotalCache -= nAddressIndexCache;
+    }
+    int64_t nBlockFilterIndexCache = 0;
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+    {
+        nBlockFilterIndexCache = std::min(nTotalCache / 16, nMaxBlockFilterIndexCache << 20);
+        nTotalCache -= nBlockFilterIndexCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    nMemoryBudget = GetArg("-memorybudget", DEFAULT_MEMORY_BUDGET) << 20;
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nAddressIndexCache > 0)
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexCache * (1.0 / 1024 / 1024));
+    if (nBlockFilterIndexCache > 0)
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
@@ -1661,16 +1909,37 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinscatcher;
                 delete pblocktree;
 
+                if (fReindex && !HavePoWVerifiedBeforeReindex())
+                {
+                    // Remember which headers we have already verified the PoW of before the block index is wiped, so that the reindex doesn't have to verify them again.
+                    CBlockTreeDB oldBlockTree(nBlockTreeDBCache, false, false);
+                    std::unordered_set<uint256, BlockHasher> setVerified;
+                    oldBlockTree.ReadPoWVerifiedHashes([&setVerified](const uint256& hash) { setVerified.insert(hash); });
+                    LogPrintf("Found %u PoW verified headers in existing block index\n", setVerified.size());
+                    SetPoWVerifiedBeforeReindex(std::move(setVerified));
+                }
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                pcoinsdbview->SetBackgroundFlush(GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH));
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
                 delete ppow2witdbview;
                 delete ppow2witcatcher;
                 ppow2witTip = nullptr;
+                {
+                    LOCK(cs_main);
+                    witnessSetIndex.Clear();
+                    witnessSelectionCache.Clear();
+                    witnessPoolPrecompute.Clear();
+                }
 
                 ppow2witdbview = new CWitViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                if (!ppow2witdbview->UpgradeRecordFormat()) {
+                    strLoadError = errortr("Error upgrading witness database");
+                    break;
+                }
+                ppow2witdbview->SetBackgroundFlush(GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH));
                 ppow2witcatcher = new CCoinsViewErrorCatcher(ppow2witdbview);
                 ppow2witTip = std::shared_ptr<CCoinsViewCache>(new CCoinsViewCache(ppow2witcatcher));
 
@@ -1690,6 +1959,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     }
                 }
 
+                // Take back what a fast shutdown (-fastshutdown) left in the chainstate journal, before the chain tip is loaded from the coin cache;
+                // a rebuilt chainstate starts from scratch instead.
+                bool fChainstateJournal = false;
+                if (fReindex || fReindexChainState) {
+                    RemoveChainstateJournal();
+                } else {
+                    fChainstateJournal = LoadChainstateJournal();
+                }
+
                 //GULDEN - version 2.0 upgrade
                 if (upgradeOnceOnly && pcoinsdbview->nPreviousVersion < 1)
                 {
@@ -1709,6 +1987,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     strLoadError = errortr("Error loading block database");
                     break;
                 }
+                sigmaSelection.Wait();
 
                 //GULDEN - version 2.0 upgrade
                 if (upgradeOnceOnly && pcoinsdbview->nPreviousVersion < 1)
@@ -1753,12 +2032,6 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = errortr("You need to rebuild the database using -reindex-chainstate to change -txindex");
-                    break;
-                }
-
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1784,6 +2057,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     LOCK(cs_main);
                     CBlockIndex* tip = chainActive.Tip();
                     RPCNotifyBlockChange(true, tip);
+                    // The witness database is loaded by now, which the phase of the tip may need.
+                    PublishChainStatus(chainparams, GetPoW2Phase(tip, chainparams, chainActive));
                     if (tip && tip->nTime > GetAdjustedTime() + 2 * 60 * 60) {
                         strLoadError = errortr("The block database contains a block which appears to be from the future. "
                                 "This may be due to your computer's date and time being set incorrectly. "
@@ -1792,8 +2067,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     }
                 }
 
-                if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
-                              GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                sigcacheLoad.Wait();
+                // With a journal the coin database is behind the tip, the cache on top of it isn't.
+                if (!CVerifyDB().VerifyDB(chainparams, fChainstateJournal ? (CCoinsView*)pcoinsTip : pcoinsdbview, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+                              GetArg("-checkblocks", DEFAULT_CHECKBLOCKS), true)) {
                     strLoadError = errortr("Corrupted block database detected");
                     break;
                 }
@@ -1842,6 +2119,26 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         ::feeEstimator.Read(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // The indexes catch up with the chain (if needed) in the background.
+    if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
+    {
+        g_txindex.reset(new CTxIndex());
+        if (!g_txindex->Start())
+            return InitError(errortr("Failed to start the transaction index"));
+    }
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+    {
+        g_addressindex.reset(new CAddressIndex(nAddressIndexCache));
+        if (!g_addressindex->Start())
+            return InitError(errortr("Failed to start the address index"));
+    }
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+    {
+        g_blockfilterindex.reset(new CBlockFilterIndex(BlockFilterType::BASIC, nBlockFilterIndexCache));
+        if (!g_blockfilterindex->Start())
+            return InitError(errortr("Failed to start the block filter index"));
+    }
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     if (!CWallet::InitLoadWallet())
@@ -1882,6 +2179,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!CheckDiskSpace())
         return false;
 
+    // Normally done with already in step 7, but not if the chain wasn't verified.
+    sigmaSelection.Wait();
+    sigcacheLoad.Wait();
+
     // Either install a handler to notify us when genesis activates, or set fHaveGenesis directly.
     // No locking, as this happens before any background thread is started.
     if (chainActive.Tip() == NULL) {
@@ -1940,14 +2241,39 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
+    connOptions.nNetThreads = GetArg("-netthreads", DEFAULT_NET_THREADS);
+    connOptions.nMsgHandThreads = GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
 
     if (gArgs.IsArgSet("-seednode")) {
         connOptions.vSeedNodes = gArgs.GetArgs("-seednode");
     }
 
+    addressesLoad.Wait();
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
 
+    if (nSamplePoW > 0)
+        LogPrintf("Sampling proof of work of 1 in %d headers older than %d hours\n", nSamplePoW, nSamplePoWTipAge / (60 * 60));
+    // Also verifies headers that -assumecheckpointpow accepted but that were left without their checkpoint.
+    if (nSamplePoW > 0 || fAssumeCheckpointPoW)
+        scheduler.scheduleEvery(VerifySampledPoWBatch, 500);
+
+    if (nDBIdleCompact > 0)
+        scheduler.scheduleEvery(CompactDatabasesIfIdle, DB_IDLE_COMPACT_INTERVAL);
+
+    // Prepare the witness selection pool for the next block whenever the tip changes.
+    witnessPoolPrecompute.SetScheduler(&scheduler);
+    RegisterValidationInterface(&witnessPoolPrecompute);
+
+    if (GetBoolArg("-poolserver", DEFAULT_POOL_SERVER))
+    {
+        std::string strPoolError;
+        if (!StartPoolServer(threadGroup, scheduler, strPoolError))
+            return InitError(strPoolError);
+    }
+
+    miningThrottle.setHashLimit(std::max<int64_t>(GetArg("-genhashlimit", DEFAULT_GENERATE_HASH_LIMIT), 0));
+    miningThrottle.setDutyCycle(std::max<int64_t>(GetArg("-gendutycycle", DEFAULT_GENERATE_DUTY_CYCLE), 1));
 
     // Generate coins in the background
     if (GetBoolArg("-gen", DEFAULT_GENERATE))
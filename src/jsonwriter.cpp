@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "jsonwriter.h"
+
+#include <univalue.h>
+
+#include <assert.h>
+
+CJSONWriter::CJSONWriter(Sink sinkIn, size_t nFlushSizeIn)
+: sink(std::move(sinkIn))
+, nFlushSize(nFlushSizeIn)
+{
+    strBuffer.reserve(nFlushSize);
+}
+
+CJSONWriter::~CJSONWriter()
+{
+    Flush();
+}
+
+void CJSONWriter::Separate()
+{
+    if (fAfterKey)
+    {
+        fAfterKey = false;
+        return;
+    }
+    if (!vNonEmpty.empty())
+    {
+        if (vNonEmpty.back())
+            strBuffer += ',';
+        vNonEmpty.back() = true;
+    }
+}
+
+void CJSONWriter::Append(const std::string& str)
+{
+    strBuffer += str;
+    if (strBuffer.size() >= nFlushSize)
+        Flush();
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vNonEmpty.push_back(false);
+}
+
+void CJSONWriter::EndObject()
+{
+    assert(!vNonEmpty.empty() && !fAfterKey);
+    vNonEmpty.pop_back();
+    Append("}");
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vNonEmpty.push_back(false);
+}
+
+void CJSONWriter::EndArray()
+{
+    assert(!vNonEmpty.empty() && !fAfterKey);
+    vNonEmpty.pop_back();
+    Append("]");
+}
+
+void CJSONWriter::Key(const std::string& strKey)
+{
+    assert(!vNonEmpty.empty() && !fAfterKey);
+    Separate();
+    strBuffer += UniValue(strKey).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONWriter::Value(const UniValue& value)
+{
+    Separate();
+    Append(value.write());
+}
+
+void CJSONWriter::ObjectMembers(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); ++i)
+        KeyValue(keys[i], values[i]);
+}
+
+void CJSONWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    sink(strBuffer.data(), strBuffer.size());
+    strBuffer.clear();
+}
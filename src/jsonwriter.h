@@ -0,0 +1,56 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_JSONWRITER_H
+#define GULDEN_JSONWRITER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+//! Size to which the writer lets its buffer grow before handing it on.
+static const size_t JSON_WRITER_FLUSH_SIZE = 64 * 1024;
+
+/**
+ * Writes compact JSON piece by piece, in the same form as UniValue::write, and hands it on in chunks as it goes; so that a large
+ * document (a block with all its transactions) never has to exist as a UniValue tree, or as one string, all at once.
+ * Values can still be given as UniValue, for the small parts that are built that way anyway.
+ */
+class CJSONWriter
+{
+public:
+    typedef std::function<void(const char* pData, size_t nSize)> Sink;
+
+    explicit CJSONWriter(Sink sinkIn, size_t nFlushSizeIn = JSON_WRITER_FLUSH_SIZE);
+    //! Flushes what is left.
+    ~CJSONWriter();
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! The key of the next value, inside an object.
+    void Key(const std::string& strKey);
+    void Value(const UniValue& value);
+    void KeyValue(const std::string& strKey, const UniValue& value) { Key(strKey); Value(value); }
+    //! All the keys and values of obj, as if they were members of the object being written.
+    void ObjectMembers(const UniValue& obj);
+
+    void Flush();
+
+private:
+    void Separate();
+    void Append(const std::string& str);
+
+    Sink sink;
+    const size_t nFlushSize;
+    std::string strBuffer;
+    //! Per open object or array, whether something has been written into it already.
+    std::vector<bool> vNonEmpty;
+    bool fAfterKey = false;
+};
+
+#endif // GULDEN_JSONWRITER_H
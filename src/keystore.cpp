@@ -12,10 +12,14 @@
 
 #include "keystore.h"
 
+#include "core_memusage.h"
+
 #include "key.h"
 #include "pubkey.h"
 #include "util.h"
 
+std::atomic<uint64_t> CBasicKeyStore::nChangeCounter{0};
+
 bool CKeyStore::AddKey(const CKey &key) {
     return AddKeyPubKey(key, key.GetPubKey());
 }
@@ -40,6 +44,7 @@ bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    NoteChange();
     return true;
 }
 
@@ -47,6 +52,7 @@ bool CBasicKeyStore::AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapHDKeys[pubkey.GetID()] = HDKeyIndex;
+    NoteChange();
     return true;
 }
 
@@ -57,6 +63,7 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    NoteChange();
     return true;
 }
 
@@ -101,6 +108,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey))
         mapWatchKeys[pubKey.GetID()] = pubKey;
+    NoteChange();
     return true;
 }
 
@@ -111,6 +119,7 @@ bool CBasicKeyStore::RemoveWatchOnly(const CScript &dest)
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey))
         mapWatchKeys.erase(pubKey.GetID());
+    NoteChange();
     return true;
 }
 
@@ -125,3 +134,14 @@ bool CBasicKeyStore::HaveWatchOnly() const
     LOCK(cs_KeyStore);
     return (!setWatchOnly.empty());
 }
+
+size_t CBasicKeyStore::DynamicMemoryUsage() const
+{
+    LOCK(cs_KeyStore);
+    size_t nUsage = memusage::DynamicUsage(mapKeys) + memusage::DynamicUsage(mapHDKeys) + memusage::DynamicUsage(mapWatchKeys) + memusage::DynamicUsage(mapScripts) + memusage::DynamicUsage(setWatchOnly);
+    for (const auto& entry : mapScripts)
+        nUsage += RecursiveDynamicUsage(entry.second);
+    for (const CScript& script : setWatchOnly)
+        nUsage += RecursiveDynamicUsage(script);
+    return nUsage;
+}
@@ -21,6 +21,8 @@
 
 #include "util.h"
 
+#include <atomic>
+
 #include <boost/signals2/signal.hpp>
 
 //temp
@@ -75,10 +77,30 @@ protected:
     ScriptMap mapScripts;
     WatchOnlySet setWatchOnly;
 
+    //! Changes to this key store, see GetStoreChangeCounter.
+    uint64_t nStoreChangeCounter = 0;
+    //! Note a change to the keys or scripts of this key store. Requires cs_KeyStore.
+    void NoteChange() { ++nChangeCounter; ++nStoreChangeCounter; }
+
 public:
+    //! Bumped by every change to the keys or scripts of any key store, so that indexes built from key stores can tell they are stale.
+    static std::atomic<uint64_t> nChangeCounter;
+    //! As nChangeCounter but for this key store alone, so that an index over many key stores only has to read again the ones that changed.
+    uint64_t GetStoreChangeCounter() const
+    {
+        LOCK(cs_KeyStore);
+        return nStoreChangeCounter;
+    }
+
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
     bool AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey);
     bool GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const;
+    //! Whether any redeem script was added (AddCScript).
+    bool HaveCScripts() const
+    {
+        LOCK(cs_KeyStore);
+        return !mapScripts.empty();
+    }
     bool HaveKey(const CKeyID &address) const
     {
         bool result=false;
@@ -147,6 +169,9 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest);
     virtual bool HaveWatchOnly(const CScript &dest) const;
     virtual bool HaveWatchOnly() const;
+
+    //! Memory used by the key and script maps (private keys live in locked memory, which is accounted for separately).
+    virtual size_t DynamicMemoryUsage() const;
 };
 
 typedef std::vector<unsigned char, secure_allocator<unsigned char> > CKeyingMaterial;
@@ -0,0 +1,183 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace {
+
+// Never freed, so metrics that are destroyed at exit can still find it.
+std::mutex& MetricsMutex()
+{
+    static std::mutex* cs = new std::mutex();
+    return *cs;
+}
+
+std::vector<CMetric*>& Metrics()
+{
+    static std::vector<CMetric*>* metrics = new std::vector<CMetric*>();
+    return *metrics;
+}
+
+unsigned int GetThreadShard()
+{
+    static std::atomic<unsigned int> nNextShard{0};
+    static thread_local unsigned int nShard = nNextShard++ % METRIC_SHARDS;
+    return nShard;
+}
+
+int GetBucket(uint64_t nMicros)
+{
+    int nBucket = 0;
+    while (nBucket < METRIC_BUCKETS - 1 && nMicros >= (uint64_t(1) << nBucket))
+        ++nBucket;
+    return nBucket;
+}
+
+uint64_t GetPercentile(const CMetricSnapshot& snapshot, double fraction)
+{
+    uint64_t nTarget = std::max<uint64_t>(1, snapshot.nCount * fraction);
+    uint64_t nSeen = 0;
+    for (int i = 0; i < METRIC_BUCKETS - 1; ++i)
+    {
+        nSeen += snapshot.buckets[i];
+        if (nSeen >= nTarget)
+            return std::min(uint64_t(1) << i, snapshot.nMax);
+    }
+    return snapshot.nMax;
+}
+
+} // namespace
+
+CMetric::CMetric(const char* name_, uint32_t logCategory_, uint32_t nLogThreshold_, MetricUnit unit_)
+: name(name_)
+, unit(unit_)
+, logCategory(logCategory_)
+, nLogThreshold(nLogThreshold_)
+{
+    std::lock_guard<std::mutex> lock(MetricsMutex());
+    Metrics().push_back(this);
+}
+
+CMetric::~CMetric()
+{
+    std::lock_guard<std::mutex> lock(MetricsMutex());
+    Metrics().erase(std::remove(Metrics().begin(), Metrics().end(), this), Metrics().end());
+}
+
+void CMetric::Record(uint64_t nMicros)
+{
+    Shard& shard = shards[GetThreadShard()];
+    uint64_t nCount = shard.nCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    shard.nTotal.fetch_add(nMicros, std::memory_order_relaxed);
+    shard.buckets[GetBucket(nMicros)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t nMax = shard.nMax.load(std::memory_order_relaxed);
+    while (nMicros > nMax && !shard.nMax.compare_exchange_weak(nMax, nMicros, std::memory_order_relaxed))
+    {
+    }
+
+    if (nCount % 100 == 0 && unit == MetricUnit::MICROSECONDS && LogAcceptCategory(logCategory))
+    {
+        CMetricSnapshot snapshot = GetSnapshot();
+        if (snapshot.nTotal * 0.000001 > nLogThreshold)
+        {
+            LogPrint(logCategory, "%s: %.2fms [%.2fs] (calls: %d, p50: %.2fms, p99: %.2fms, max: %.2fms)\n", name, 0.001 * nMicros, snapshot.nTotal * 0.000001,
+                     snapshot.nCount, 0.001 * snapshot.nP50, 0.001 * snapshot.nP99, 0.001 * snapshot.nMax);
+        }
+    }
+}
+
+CMetricSnapshot CMetric::GetSnapshot() const
+{
+    CMetricSnapshot snapshot;
+    snapshot.name = name;
+    snapshot.unit = unit;
+    for (const Shard& shard : shards)
+    {
+        snapshot.nTotal += shard.nTotal.load(std::memory_order_relaxed);
+        snapshot.nMax = std::max(snapshot.nMax, shard.nMax.load(std::memory_order_relaxed));
+        for (int i = 0; i < METRIC_BUCKETS; ++i)
+            snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+    }
+    // The shards are read one after the other, without stopping the writers; go by the buckets so the percentiles add up.
+    snapshot.nCount = 0;
+    for (int i = 0; i < METRIC_BUCKETS; ++i)
+        snapshot.nCount += snapshot.buckets[i];
+    if (snapshot.nCount > 0)
+    {
+        snapshot.nP50 = GetPercentile(snapshot, 0.5);
+        snapshot.nP99 = GetPercentile(snapshot, 0.99);
+    }
+    return snapshot;
+}
+
+void CMetric::Reset()
+{
+    for (Shard& shard : shards)
+    {
+        shard.nCount = 0;
+        shard.nTotal = 0;
+        shard.nMax = 0;
+        for (int i = 0; i < METRIC_BUCKETS; ++i)
+            shard.buckets[i] = 0;
+    }
+}
+
+std::vector<CMetricSnapshot> GetMetricSnapshots()
+{
+    std::vector<CMetricSnapshot> snapshots;
+    {
+        std::lock_guard<std::mutex> lock(MetricsMutex());
+        for (const CMetric* metric : Metrics())
+            snapshots.push_back(metric->GetSnapshot());
+    }
+    std::sort(snapshots.begin(), snapshots.end(), [](const CMetricSnapshot& a, const CMetricSnapshot& b) { return a.name < b.name; });
+    return snapshots;
+}
+
+void ResetMetrics()
+{
+    std::lock_guard<std::mutex> lock(MetricsMutex());
+    for (CMetric* metric : Metrics())
+        metric->Reset();
+}
+
+static void AppendPrometheusFamily(std::string& strText, const std::vector<CMetricSnapshot>& snapshots, MetricUnit unit, const std::string& strFamily, const std::string& strHelp)
+{
+    // Durations are reported in seconds, sizes as they are.
+    double scale = unit == MetricUnit::MICROSECONDS ? 0.000001 : 1;
+    strText += strprintf("# HELP %s %s\n# TYPE %s histogram\n", strFamily, strHelp, strFamily);
+    for (const CMetricSnapshot& snapshot : snapshots)
+    {
+        if (snapshot.unit != unit)
+            continue;
+        std::string strName;
+        for (char c : snapshot.name)
+        {
+            if (c == '\\' || c == '"')
+                strName += '\\';
+            strName += c;
+        }
+        uint64_t nCumulative = 0;
+        for (int i = 0; i < METRIC_BUCKETS - 1; ++i)
+        {
+            nCumulative += snapshot.buckets[i];
+            strText += strprintf("%s_bucket{name=\"%s\",le=\"%g\"} %d\n", strFamily, strName, (uint64_t(1) << i) * scale, nCumulative);
+        }
+        strText += strprintf("%s_bucket{name=\"%s\",le=\"+Inf\"} %d\n", strFamily, strName, snapshot.nCount);
+        strText += strprintf("%s_sum{name=\"%s\"} %.6f\n", strFamily, strName, snapshot.nTotal * scale);
+        strText += strprintf("%s_count{name=\"%s\"} %d\n", strFamily, strName, snapshot.nCount);
+    }
+}
+
+std::string GetMetricsPrometheusText()
+{
+    std::vector<CMetricSnapshot> snapshots = GetMetricSnapshots();
+    std::string strText;
+    AppendPrometheusFamily(strText, snapshots, MetricUnit::MICROSECONDS, "gulden_duration_seconds", "Time spent in timed operations.");
+    AppendPrometheusFamily(strText, snapshots, MetricUnit::BYTES, "gulden_size_bytes", "Sizes seen by measured operations.");
+    return strText;
+}
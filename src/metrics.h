@@ -0,0 +1,108 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_METRICS_H
+#define GULDEN_METRICS_H
+
+#include "util.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Number of histogram buckets of a metric; bucket i counts the durations below 2^i microseconds, the last one everything longer.
+static const int METRIC_BUCKETS = 32;
+//! Number of sets of counters of a metric, threads are spread over them so they don't contend for the same cache lines.
+static const int METRIC_SHARDS = 16;
+
+/** What the values recorded to a metric are. */
+enum class MetricUnit
+{
+    MICROSECONDS,
+    BYTES,
+};
+
+/** Totals of a metric at some point, see CMetric::GetSnapshot. All times in microseconds. */
+struct CMetricSnapshot
+{
+    std::string name;
+    MetricUnit unit = MetricUnit::MICROSECONDS;
+    uint64_t nCount = 0;
+    uint64_t nTotal = 0;
+    uint64_t nMax = 0;
+    //! Upper bounds of the buckets the median and 99th percentile fall in (capped at the max).
+    uint64_t nP50 = 0;
+    uint64_t nP99 = 0;
+    uint64_t buckets[METRIC_BUCKETS] = {};
+};
+
+/**
+ * Durations of an operation: count, total, max and a log2 histogram. Metrics of sizes (MetricUnit::BYTES) work the same, they are just never logged.
+ *
+ * Recording is lock free, every thread adds to one of METRIC_SHARDS sets of relaxed atomic counters which are only summed up when read.
+ * Metrics register themselves on construction so GetMetricSnapshots can find them; they are normally function local statics, see DO_BENCHMARK.
+ */
+class CMetric
+{
+public:
+    //! Durations are logged under logCategory every 100 calls (per thread) once the total passes nLogThreshold seconds.
+    CMetric(const char* name, uint32_t logCategory = BCLog::BENCH, uint32_t nLogThreshold = 1, MetricUnit unit = MetricUnit::MICROSECONDS);
+    ~CMetric();
+
+    void Record(uint64_t nMicros);
+    CMetricSnapshot GetSnapshot() const;
+    void Reset();
+    const char* GetName() const { return name; }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> nCount{0};
+        std::atomic<uint64_t> nTotal{0};
+        std::atomic<uint64_t> nMax{0};
+        std::atomic<uint64_t> buckets[METRIC_BUCKETS] = {};
+    };
+
+    const char* name;
+    const MetricUnit unit;
+    const uint32_t logCategory;
+    const uint32_t nLogThreshold;
+    Shard shards[METRIC_SHARDS];
+};
+
+/** Times the scope it lives in and records the duration to a metric. */
+class CMetricTimer
+{
+public:
+    explicit CMetricTimer(CMetric& metric_)
+    : metric(metric_)
+    , nStart(std::chrono::steady_clock::now())
+    {
+    }
+    ~CMetricTimer()
+    {
+        metric.Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - nStart).count());
+    }
+private:
+    CMetric& metric;
+    std::chrono::steady_clock::time_point nStart;
+};
+
+/** Snapshots of all metrics, ordered by name. */
+std::vector<CMetricSnapshot> GetMetricSnapshots();
+/** Clear the counters of all metrics. */
+void ResetMetrics();
+/** All metrics in the Prometheus text format, as histograms in seconds (or bytes). */
+std::string GetMetricsPrometheusText();
+
+#define METRIC_CONCAT_(a, b) a##b
+#define METRIC_CONCAT(a, b) METRIC_CONCAT_(a, b)
+
+/** Time the rest of the enclosing scope as metric DESC; logged under LOGCATEGORY every 100 calls once over THRESHOLD seconds in total (default 1) */
+#define DO_BENCHMARKT(DESC, LOGCATEGORY, THRESHOLD) static CMetric METRIC_CONCAT(metric_, __LINE__)(DESC, LOGCATEGORY, THRESHOLD); CMetricTimer METRIC_CONCAT(metricTimer_, __LINE__)(METRIC_CONCAT(metric_, __LINE__));
+#define DO_BENCHMARK(DESC, LOGCATEGORY) DO_BENCHMARKT(DESC, LOGCATEGORY, 1)
+
+#endif // GULDEN_METRICS_H
@@ -23,8 +23,10 @@
 #include "crypto/common.h"
 #include "crypto/sha256.h"
 #include "hash.h"
+#include "metrics.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "support/lz4.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 
@@ -72,6 +74,58 @@
 
 const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
+namespace {
+/** The wait and process time metrics of one command. */
+struct CMsgCmdMetrics
+{
+    // The names have to be there before the metrics that point to them.
+    const std::string strWait;
+    const std::string strProcess;
+    CMetric wait;
+    CMetric process;
+
+    explicit CMsgCmdMetrics(const std::string& strCommand)
+    : strWait("NET: wait " + strCommand)
+    , strProcess("NET: process " + strCommand)
+    , wait(strWait.c_str(), BCLog::BENCH|BCLog::NET)
+    , process(strProcess.c_str(), BCLog::BENCH|BCLog::NET)
+    {
+    }
+};
+
+// One for every valid command and one for the rest; never freed, like the metrics registry.
+CMsgCmdMetrics& GetMsgCmdMetrics(const std::string& strCommand)
+{
+    static std::map<std::string, std::unique_ptr<CMsgCmdMetrics>>* metrics = []() {
+        auto* metrics = new std::map<std::string, std::unique_ptr<CMsgCmdMetrics>>();
+        for (const std::string& msg : getAllNetMessageTypes())
+            metrics->emplace(msg, std::make_unique<CMsgCmdMetrics>(msg));
+        metrics->emplace(NET_MESSAGE_COMMAND_OTHER, std::make_unique<CMsgCmdMetrics>(NET_MESSAGE_COMMAND_OTHER));
+        return metrics;
+    }();
+    auto it = metrics->find(strCommand);
+    if (it == metrics->end())
+        it = metrics->find(NET_MESSAGE_COMMAND_OTHER);
+    return *it->second;
+}
+} // namespace
+
+CMetric& GetMsgWaitMetric(const std::string& strCommand)
+{
+    return GetMsgCmdMetrics(strCommand).wait;
+}
+
+CMetric& GetMsgProcessMetric(const std::string& strCommand)
+{
+    return GetMsgCmdMetrics(strCommand).process;
+}
+
+CMetric& GetSendQueueMetric()
+{
+    static CMetric* metric = new CMetric("NET: send queue", BCLog::NET, 1, MetricUnit::BYTES);
+    return *metric;
+}
+
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
 //
@@ -651,6 +705,28 @@ void CNode::SetAddrLocal(const CService& addrLocalIn) {
 
 #undef X
 #define X(name) stats.name = name
+size_t CNode::DynamicMemoryUsage()
+{
+    size_t nUsage = 0;
+    {
+        LOCK(cs_floodRelay);
+        nUsage += addrKnown.DynamicMemoryUsage() + memusage::DynamicUsage(vAddrToSend);
+    }
+    {
+        LOCK(cs_vSend);
+        nUsage += nSendSize;
+    }
+    {
+        LOCK(cs_vProcessMsg);
+        nUsage += nProcessQueueSize;
+    }
+    {
+        LOCK(cs_inventory);
+        nUsage += filterInventoryKnown.DynamicMemoryUsage() + memusage::DynamicUsage(setInventoryTxToSend) + memusage::DynamicUsage(vInventoryBlockToSend);
+    }
+    return nUsage;
+}
+
 void CNode::copyStats(CNodeStats &stats)
 {
     stats.nodeid = this->GetId();
@@ -678,6 +754,19 @@ void CNode::copyStats(CNodeStats &stats)
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
         X(nSendBytes);
+        stats.nSendQueueBytes = nSendSize;
+        stats.nSendQueuePeakBytes = nSendSizePeak;
+    }
+    X(fCompressSend);
+    X(fCompressRecv);
+    X(nCompressSendRawBytes);
+    X(nCompressSendBytes);
+    X(nCompressRecvRawBytes);
+    X(nCompressRecvBytes);
+    {
+        LOCK(cs_msgTime);
+        X(mapWaitTimePerMsgCmd);
+        X(mapProcessTimePerMsgCmd);
     }
     {
         LOCK(cs_vRecv);
@@ -765,6 +854,27 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::RecordMessageTimes(const std::string& strCommand, int64_t nWaitMicros, int64_t nProcessMicros)
+{
+    nWaitMicros = std::max<int64_t>(nWaitMicros, 0);
+    nProcessMicros = std::max<int64_t>(nProcessMicros, 0);
+    GetMsgWaitMetric(strCommand).Record(nWaitMicros);
+    GetMsgProcessMetric(strCommand).Record(nProcessMicros);
+
+    auto add = [](mapMsgCmdTime& mapTime, const std::string& strCommand, uint64_t nMicros) {
+        mapMsgCmdTime::iterator i = mapTime.find(strCommand);
+        if (i == mapTime.end())
+            i = mapTime.find(NET_MESSAGE_COMMAND_OTHER);
+        assert(i != mapTime.end());
+        i->second.nCount++;
+        i->second.nTotal += nMicros;
+        i->second.nMax = std::max(i->second.nMax, nMicros);
+    };
+    LOCK(cs_msgTime);
+    add(mapWaitTimePerMsgCmd, strCommand, nWaitMicros);
+    add(mapProcessTimePerMsgCmd, strCommand, nProcessMicros);
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -792,6 +902,73 @@ int CNode::GetSendVersion() const
 }
 
 
+CNetRecvBufferPool::CNetRecvBufferPool()
+{
+    for (int i = 0; i < NUM_CLASSES; ++i)
+        nBytes[i] = 0;
+}
+
+void CNetRecvBufferPool::Get(CSerializeData& vch, size_t nSize, size_t nCapacity)
+{
+    // The smallest class that is large enough, for nCapacity and then nSize.
+    auto classFor = [](size_t n) {
+        int nClass = 0;
+        while (nClass < NUM_CLASSES && (MIN_CLASS_SIZE << nClass) < n)
+            ++nClass;
+        return nClass;
+    };
+    CSerializeData vchNew;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int nClass : {classFor(nCapacity), classFor(nSize)}) {
+            if (nClass < NUM_CLASSES && !vFree[nClass].empty()) {
+                vchNew.swap(vFree[nClass].back());
+                vFree[nClass].pop_back();
+                nBytes[nClass] -= vchNew.capacity();
+                break;
+            }
+        }
+    }
+    if (vchNew.capacity() < nSize) {
+        // Allocate the whole class, so that the buffer goes back to it.
+        int nClass = classFor(nSize);
+        vchNew.reserve(nClass < NUM_CLASSES ? (MIN_CLASS_SIZE << nClass) : nSize);
+    }
+    vchNew.resize(nSize);
+    vch.swap(vchNew);
+}
+
+void CNetRecvBufferPool::Put(CSerializeData&& vch)
+{
+    size_t nCapacity = vch.capacity();
+    if (nCapacity < MIN_CLASS_SIZE)
+        return;
+    // The largest class it can serve.
+    int nClass = 0;
+    while (nClass + 1 < NUM_CLASSES && (MIN_CLASS_SIZE << (nClass + 1)) <= nCapacity)
+        ++nClass;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nBytes[nClass] + nCapacity > MAX_CLASS_BYTES)
+        return;
+    vch.clear();
+    nBytes[nClass] += nCapacity;
+    vFree[nClass].push_back(std::move(vch));
+}
+
+CNetRecvBufferPool& GetRecvBufferPool()
+{
+    // Never destroyed, messages may still be destroyed during shutdown.
+    static CNetRecvBufferPool* pool = new CNetRecvBufferPool();
+    return *pool;
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData vch;
+    vRecv.swap_data(vch);
+    GetRecvBufferPool().Put(std::move(vch));
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -820,21 +997,40 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    if (hdr.nMessageSize > 0) {
+        CSerializeData vch;
+        GetRecvBufferPool().Get(vch, std::min(hdr.nMessageSize, RECV_PRESIZE_LIMIT), hdr.nMessageSize);
+        vRecv.swap_data(vch);
+    }
+
     return nCopy;
 }
 
+boost::asio::mutable_buffer CNode::GetReceiveBuffer()
+{
+    LOCK(cs_vRecv);
+    if (!vRecvMsg.empty()) {
+        CNetMessage& msg = vRecvMsg.back();
+        // Only when there is more to come than pchBuf holds; otherwise the next header is better read with the same call.
+        if (msg.in_data && msg.vRecv.size() == msg.hdr.nMessageSize && msg.hdr.nMessageSize - msg.nDataPos >= sizeof(pchBuf))
+            return boost::asio::mutable_buffer(&msg.vRecv[msg.nDataPos], msg.hdr.nMessageSize - msg.nDataPos);
+    }
+    return boost::asio::mutable_buffer(pchBuf, sizeof(pchBuf));
+}
+
 int CNetMessage::readData(const char *pch, unsigned int nBytes)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // The first RECV_PRESIZE_LIMIT bytes of a large message are in, now make room for all of it.
+        vRecv.resize(hdr.nMessageSize);
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    if (pch != &vRecv[nDataPos])
+        memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -848,6 +1044,54 @@ const uint256& CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
+bool CompressNetMessage(CSerializedNetMsg& msg)
+{
+    // Blocks and headers; most other messages are small, or hashes that don't compress.
+    if (msg.data.size() < MIN_COMPRESS_MESSAGE_SIZE)
+        return false;
+    if (msg.command != NetMsgType::BLOCK && msg.command != NetMsgType::HEADERS && msg.command != NetMsgType::RHEADERS
+        && msg.command != NetMsgType::CMPCTBLOCK && msg.command != NetMsgType::BLOCKTXN)
+        return false;
+
+    std::vector<unsigned char> vCompressed;
+    vCompressed.reserve(msg.data.size());
+    CVectorWriter writer(SER_NETWORK, INIT_PROTO_VERSION, vCompressed, 0);
+    writer << msg.command;
+    WriteCompactSize(writer, msg.data.size());
+    LZ4CompressBlock(msg.data.data(), msg.data.size(), vCompressed);
+    // Not worth the work on the other side for less than an eighth.
+    if (vCompressed.size() > msg.data.size() - msg.data.size() / 8)
+        return false;
+
+    msg.command = NetMsgType::COMPRESSED;
+    msg.data.swap(vCompressed);
+    return true;
+}
+
+bool DecompressNetMessage(CDataStream& vRecv, std::string& strCommand)
+{
+    std::string strInnerCommand;
+    uint64_t nSize;
+    try {
+        vRecv >> LIMITED_STRING(strInnerCommand, CMessageHeader::COMMAND_SIZE);
+        nSize = ReadCompactSize(vRecv);
+    } catch (const std::ios_base::failure&) {
+        return false;
+    }
+    if (strInnerCommand == NetMsgType::COMPRESSED || nSize > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return false;
+    // Otherwise a tiny message could have us allocate up to MAX_PROTOCOL_MESSAGE_LENGTH for nothing; +16 for the fixed overhead of very short blocks.
+    if (nSize > vRecv.size() * MAX_LZ4_EXPANSION_RATIO + 16)
+        return false;
+
+    CSerializeData vData(nSize);
+    if (!LZ4DecompressBlock((const unsigned char*)vRecv.data(), vRecv.size(), (unsigned char*)vData.data(), nSize))
+        return false;
+    vRecv.swap_data(vData);
+    strCommand = strInnerCommand;
+    return true;
+}
+
 struct NodeEvictionCandidate
 {
     NodeId id;
@@ -1022,8 +1266,12 @@ void CConnman::NodeDisconnectAndDeleter()
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                    // close socket and cleanup, on the strand so that no handler of the node is using the socket
+                    pnode->AddRef();
+                    boost::asio::post(pnode->strand, [pnode]() {
+                        pnode->CloseSocketDisconnect();
+                        pnode->Release();
+                    });
 
                     // hold in disconnected pool until all refs are released
                     pnode->Release();
@@ -1092,7 +1340,7 @@ void CConnman::NodeInactivityChecker(CNode* pnode)
     const int INTERVAL_SEC = 1;
 
     pnode->inactivityTimer.expires_from_now(boost::posix_time::seconds(INTERVAL_SEC));
-    pnode->inactivityTimer.async_wait([this, pnode](const boost::system::error_code& ec) {
+    pnode->inactivityTimer.async_wait(boost::asio::bind_executor(pnode->strand, [this, pnode](const boost::system::error_code& ec) {
 
         if (!ec) {
             int64_t nTime = GetSystemTimeInSeconds();
@@ -1136,7 +1384,7 @@ void CConnman::NodeInactivityChecker(CNode* pnode)
             LogPrint(BCLog::NET, "inactivity timer for %d failed [%s]\n", pnode->GetId(), ec.message().c_str());
         }
         pnode->Release();
-    });
+    }));
 }
 
 void CConnman::ResumeReceive(CNode* pnode)
@@ -1157,72 +1405,68 @@ void CConnman::ResumeReceive(CNode* pnode)
 
     pnode->AddRef();
 
-    pnode->hSocket.async_receive(boost::asio::mutable_buffer(pnode->pchBuf, sizeof(pnode->pchBuf)),
-                                 [this,pnode] (const boost::system::error_code& ec, std::size_t bytes_transferred) {
-        if (!ec) {
-            bool msgcomplete = false;
-            if (!pnode->ReceiveMsgBytes(pnode->pchBuf, bytes_transferred, msgcomplete)) {
-                pnode->fDisconnect = true;
+    // The message handler resumes a paused node from its own thread; the socket is only used on the strand.
+    boost::asio::dispatch(pnode->strand, [this, pnode]() {
+        boost::asio::mutable_buffer buffer = pnode->GetReceiveBuffer();
+        pnode->hSocket.async_receive(buffer, boost::asio::bind_executor(pnode->strand, [this, pnode, buffer] (const boost::system::error_code& ec, std::size_t bytes_transferred) {
+            if (!ec) {
+                bool msgcomplete = false;
+                if (!pnode->ReceiveMsgBytes(static_cast<const char*>(buffer.data()), bytes_transferred, msgcomplete)) {
+                    pnode->fDisconnect = true;
+                }
+                else {
+                    RecordBytesRecv(bytes_transferred);
+                    if (msgcomplete) {
+                        size_t nSizeAdded = 0;
+                        auto it(pnode->vRecvMsg.begin());
+                        for (; it != pnode->vRecvMsg.end(); ++it) {
+                            if (!it->complete())
+                                break;
+                            nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                        }
+                        {
+                            LOCK(pnode->cs_vProcessMsg);
+                            pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                            pnode->nProcessQueueSize += nSizeAdded;
+                            pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+                        }
+                        WakeMessageHandler();
+                    }
+                    this->ResumeReceive(pnode);
+                }
             }
             else {
-                RecordBytesRecv(bytes_transferred);
-                if (msgcomplete) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        if (!it->complete())
-                            break;
-                        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                if (boost::asio::error::eof == ec) {
+                    // socket closed gracefully
+                    if (!pnode->fDisconnect) {
+                        LogPrint(BCLog::NET, "socket closed\n");
                     }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
                 }
-                this->ResumeReceive(pnode);
-            }
-        }
-        else {
-            if (boost::asio::error::eof == ec) {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed\n");
+                else {
+                    if (!pnode->fDisconnect)
+                        LogPrintf("socket recv error %s\n", ec.message());
                 }
+                pnode->fDisconnect = true;
             }
-            else {
-                if (!pnode->fDisconnect)
-                    LogPrintf("socket recv error %s\n", ec.message());
-            }
-            pnode->fDisconnect = true;
-        }
 
-        pnode->Release();
+            pnode->Release();
+        }));
     });
 }
 
 void CConnman::ThreadSocketHandler()
 {
-    NodeDisconnectAndDeleter();
-    NumConnectionsNotifier();
-
-    while (!interruptNet) {
-        get_io_context().run();
-        if (!interruptNet.sleep_for(std::chrono::milliseconds(50)))
-            return;
-        get_io_context().restart();
-    }
+    // Returns when Interrupt stops the io_context.
+    get_io_context().run();
 }
 
 void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        ++nMsgProcWake;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1445,7 +1689,19 @@ void CConnman::DumpAddresses()
 {
     int64_t nStart = GetTimeMillis();
 
+    // Append what changed to the journal, and only write out all of peers.dat again once the journal has grown too big.
     CAddrDB adb;
+    std::vector<CAddrJournalEntry> vChanges;
+    addrman.GetChanges(vChanges);
+    if (!adb.IsJournalFull()) {
+        if (vChanges.empty())
+            return;
+        if (adb.Append(vChanges)) {
+            LogPrint(BCLog::NET, "Flushed %d changed addresses to peers.journal  %dms\n",
+                   vChanges.size(), GetTimeMillis() - nStart);
+            return;
+        }
+    }
     adb.Write(addrman);
 
     LogPrint(BCLog::NET, "Flushed %d addresses to peers.dat  %dms\n",
@@ -1778,8 +2034,9 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nWorker)
 {
+    uint64_t nWakeSeen = 0;
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
@@ -1793,24 +2050,28 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
-        for(CNode* pnode : vNodesCopy)
+        // Every worker starts at a different peer and skips the peers another worker is busy with, so a peer that is slow
+        // to process holds up only the worker that has it.
+        size_t nStart = vNodesCopy.empty() ? 0 : (size_t)nWorker * vNodesCopy.size() / nMsgHandThreads;
+        for (size_t i = 0; i < vNodesCopy.size(); ++i)
         {
-            if (pnode->fDisconnect)
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
+            if (pnode->fDisconnect || pnode->fMsgProcClaimed.exchange(true))
                 continue;
 
             // Receive messages
             bool fMoreNodeWork = GetNodeSignals().ProcessMessages(pnode, *this, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
 
             // Send messages
+            if (!flagInterruptMsgProc)
             {
                 LOCK(pnode->cs_sendProcessing);
                 GetNodeSignals().SendMessages(pnode, *this, flagInterruptMsgProc);
             }
+            pnode->fMsgProcClaimed = false;
             if (flagInterruptMsgProc)
-                return;
+                break;
         }
 
         {
@@ -1821,9 +2082,9 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nWakeSeen] { return nMsgProcWake != nWakeSeen; });
         }
-        fMsgProcWake = false;
+        nWakeSeen = nMsgProcWake;
     }
 }
 
@@ -2027,6 +2288,7 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     fNetworkActive = true;
     setBannedIsDirty = false;
     fAddressesInitialized = false;
+    fAddressesLoaded = false;
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
@@ -2045,6 +2307,39 @@ NodeId CConnman::GetNewNodeId()
     return nLastNodeId.fetch_add(1, std::memory_order_relaxed);
 }
 
+void CConnman::LoadAddresses()
+{
+    // Load addresses from peers.dat
+    int64_t nStart = GetTimeMillis();
+    {
+        CAddrDB adb;
+        if (adb.Read(addrman))
+            LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
+        else {
+            addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
+            LogPrintf("Invalid or missing peers.dat; recreating\n");
+            adb.Write(addrman);
+        }
+    }
+    // Load addresses from banlist.dat
+    nStart = GetTimeMillis();
+    CBanDB bandb;
+    banmap_t banmap;
+    if (bandb.Read(banmap)) {
+        SetBanned(banmap); // thread save setter
+        SetBannedSetDirty(false); // no need to write down, just read data
+        SweepBanned(); // sweep out unused entries
+
+        LogPrint(BCLog::NET, "Loaded %d banned node ips/subnets from banlist.dat  %dms\n",
+            banmap.size(), GetTimeMillis() - nStart);
+    } else {
+        LogPrintf("Invalid or missing banlist.dat; recreating\n");
+        SetBannedSetDirty(true); // force write
+        DumpBanlist();
+    }
+    fAddressesLoaded = true;
+}
+
 bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options connOptions)
 {
     nTotalBytesRecv = 0;
@@ -2058,6 +2353,8 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nMaxOutbound = std::min((connOptions.nMaxOutbound), nMaxConnections);
     nMaxAddnode = connOptions.nMaxAddnode;
     nMaxFeeler = connOptions.nMaxFeeler;
+    nNetThreads = std::max(1, std::min(connOptions.nNetThreads, MAX_NET_THREADS));
+    nMsgHandThreads = std::max(1, std::min(connOptions.nMsgHandThreads, MAX_MSGHAND_THREADS));
 
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
@@ -2072,38 +2369,11 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     }
 
     clientInterface = connOptions.uiInterface;
-    if (clientInterface) {
-        clientInterface->InitMessage(_("Loading P2P addresses..."));
-    }
-    // Load addresses from peers.dat
-    int64_t nStart = GetTimeMillis();
-    {
-        CAddrDB adb;
-        if (adb.Read(addrman))
-            LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
-        else {
-            addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
-            LogPrintf("Invalid or missing peers.dat; recreating\n");
-            DumpAddresses();
+    if (!fAddressesLoaded) {
+        if (clientInterface) {
+            clientInterface->InitMessage(_("Loading P2P addresses..."));
         }
-    }
-    if (clientInterface)
-        clientInterface->InitMessage(_("Loading banlist..."));
-    // Load addresses from banlist.dat
-    nStart = GetTimeMillis();
-    CBanDB bandb;
-    banmap_t banmap;
-    if (bandb.Read(banmap)) {
-        SetBanned(banmap); // thread save setter
-        SetBannedSetDirty(false); // no need to write down, just read data
-        SweepBanned(); // sweep out unused entries
-
-        LogPrint(BCLog::NET, "Loaded %d banned node ips/subnets from banlist.dat  %dms\n",
-            banmap.size(), GetTimeMillis() - nStart);
-    } else {
-        LogPrintf("Invalid or missing banlist.dat; recreating\n");
-        SetBannedSetDirty(true); // force write
-        DumpBanlist();
+        LoadAddresses();
     }
 
     uiInterface.InitMessage(_("Starting network threads..."));
@@ -2128,11 +2398,16 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        nMsgProcWake = 0;
     }
 
     // Send and receive from sockets, accept connections
-    threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
+    get_io_context().restart();
+    socketHandlerWork.reset(new boost::asio::executor_work_guard<boost::asio::io_context::executor_type>(get_io_context().get_executor()));
+    NodeDisconnectAndDeleter();
+    NumConnectionsNotifier();
+    for (int i = 0; i < nNetThreads; ++i)
+        threadSocketHandlers.push_back(std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this))));
 
     if (!GetBoolArg("-dnsseed", true))
         LogPrintf("DNS seeding disabled\n");
@@ -2147,7 +2422,8 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMsgHandThreads; ++i)
+        threadMessageHandlers.push_back(std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2181,6 +2457,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    socketHandlerWork.reset();
     get_io_context().stop();
     InterruptSocks5(true);
 
@@ -2201,16 +2478,23 @@ void CConnman::Stop()
 {
     LogPrint(BCLog::NET, "CConnman::Stop\n");
 
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
         threadOpenAddedConnections.join();
     if (threadDNSAddressSeed.joinable())
         threadDNSAddressSeed.join();
-    if (threadSocketHandler.joinable())
-        threadSocketHandler.join();
+    for (std::thread& thread : threadSocketHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadSocketHandlers.clear();
 
     if (fAddressesInitialized)
     {
@@ -2328,6 +2612,15 @@ size_t CConnman::GetNodeCount(NumConnections flags)
     return nNum;
 }
 
+size_t CConnman::GetPeerMemoryUsage()
+{
+    LOCK(cs_vNodes);
+    size_t nUsage = memusage::DynamicUsage(vNodes);
+    for (CNode* pnode : vNodes)
+        nUsage += memusage::MallocUsage(sizeof(CNode)) + pnode->DynamicMemoryUsage();
+    return nUsage;
+}
+
 void CConnman::GetNodeStats(std::vector<CNodeStats>& vstats)
 {
     vstats.clear();
@@ -2501,7 +2794,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nLocalServices(nLocalServicesIn),
     nMyStartingHeight(nMyStartingHeightIn),
     nSendVersion(0),
-    inactivityTimer(get_io_context())
+    inactivityTimer(get_io_context()),
+    strand(get_io_context())
 {
     nServices = NODE_NONE;
     nServicesExpected = NODE_NONE;
@@ -2524,6 +2818,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fDisconnect = false;
     nRefCount = 0;
     nSendSize = 0;
+    nSendSizePeak = 0;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2549,11 +2844,25 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fMsgProcClaimed = false;
+    fCompressRecv = false;
+    fCompressSend = false;
+    nCompressSendRawBytes = 0;
+    nCompressSendBytes = 0;
+    nCompressRecvRawBytes = 0;
+    nCompressRecvBytes = 0;
     nProcessQueueSize = 0;
 
     for(const std::string &msg : getAllNetMessageTypes())
         mapRecvBytesPerMsgCmd[msg] = 0;
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    for(const std::string &msg : getAllNetMessageTypes())
+    {
+        mapWaitTimePerMsgCmd[msg];
+        mapProcessTimePerMsgCmd[msg];
+    }
+    mapWaitTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER];
+    mapProcessTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER];
 
     if (fLogIPs) {
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
@@ -2609,6 +2918,14 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
+    if (pnode->fCompressSend) {
+        size_t nRawSize = msg.data.size();
+        if (CompressNetMessage(msg)) {
+            pnode->nCompressSendRawBytes += nRawSize;
+            pnode->nCompressSendBytes += msg.data.size();
+        }
+    }
+
     size_t nMessageSize = msg.data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
@@ -2627,6 +2944,8 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         //log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
         pnode->nSendSize += nTotalSize;
+        pnode->nSendSizePeak = std::max(pnode->nSendSizePeak, pnode->nSendSize);
+        GetSendQueueMetric().Record(pnode->nSendSize);
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
@@ -2637,7 +2956,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         if (!pnode->fResumeSendActive) {
             pnode->fResumeSendActive = true;
             pnode->AddRef();
-            boost::asio::post(get_io_context(), [this, pnode]() {
+            boost::asio::post(pnode->strand, [this, pnode]() {
                 this->ResumeSend(pnode);
                 pnode->Release();
             });
@@ -2654,15 +2973,21 @@ void CConnman::ResumeSend(CNode *pnode)
         return;
     }
 
-    // buffer to hold and own the message data, Asio buffers don't take ownership
-    using BufferHolder = std::shared_ptr<std::vector<unsigned char> >;
-    auto bufferHolder = BufferHolder(new std::vector<unsigned char>(std::move(pnode->vSendMsg.front())));
-    pnode->vSendMsg.pop_front();
-    boost::asio::const_buffer buffer = boost::asio::buffer(reinterpret_cast<const char*>(bufferHolder->data()), bufferHolder->size());
+    // Write everything that is queued with one gathering write. The node keeps the data until the write completes, Asio
+    // buffers don't take ownership; there is only one write in progress per node.
+    pnode->vSendInFlight.clear();
+    pnode->vSendBuffers.clear();
+    pnode->vSendInFlight.reserve(pnode->vSendMsg.size());
+    pnode->vSendBuffers.reserve(pnode->vSendMsg.size());
+    for (auto& data : pnode->vSendMsg) {
+        pnode->vSendInFlight.push_back(std::move(data));
+        pnode->vSendBuffers.push_back(boost::asio::buffer(pnode->vSendInFlight.back()));
+    }
+    pnode->vSendMsg.clear();
 
     pnode->AddRef();
-    boost::asio::async_write(pnode->hSocket, buffer,
-                             [this, pnode, bufferHolder](const boost::system::error_code& ec, std::size_t bytes_transferred) {
+    boost::asio::async_write(pnode->hSocket, pnode->vSendBuffers,
+                             boost::asio::bind_executor(pnode->strand, [this, pnode](const boost::system::error_code& ec, std::size_t bytes_transferred) {
         if (ec) {
             LogPrint(BCLog::NET, "socket send error %s\n", ec.message());
             pnode->fDisconnect = true;
@@ -2682,7 +3007,7 @@ void CConnman::ResumeSend(CNode *pnode)
 
         this->ResumeSend(pnode);
         pnode->Release();
-    });
+    }));
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
@@ -20,6 +20,7 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
+#include "metrics.h"
 #include "netaddress.h"
 #include "policy/feerate.h"
 #include "protocol.h"
@@ -38,6 +39,7 @@
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <mutex>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -66,6 +68,14 @@ static const unsigned int MAX_SEND_INIT_MEMPOOL = 20;
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
+/** Default for -peercompression, compress large messages to peers that can decompress them */
+static const bool DEFAULT_PEER_COMPRESSION = true;
+/** Version of "sendcompress": LZ4 blocks. */
+static const uint32_t NET_COMPRESSION_VERSION = 1;
+/** Messages smaller than this aren't worth compressing. */
+static const size_t MIN_COMPRESS_MESSAGE_SIZE = 1024;
+/** LZ4 can't expand data by much more than this factor, a compressed message claiming more is rejected before anything is allocated for it. */
+static const uint64_t MAX_LZ4_EXPANSION_RATIO = 255;
 /** Maximum length of strSubVer in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** Maximum number of automatic outgoing nodes */
@@ -97,6 +107,12 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 static const size_t DEFAULT_MAXRECEIVEBUFFER_LOWMEM = 1 * 1000;
+/** Default for -netthreads, the number of threads handling socket I/O */
+static const int DEFAULT_NET_THREADS = 2;
+static const int MAX_NET_THREADS = 16;
+/** Default for -msghandthreads, the number of threads processing messages; each peer is handled by one of them at a time */
+static const int DEFAULT_MSGHAND_THREADS = 2;
+static const int MAX_MSGHAND_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -130,6 +146,11 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** Replace msg by a "compressed" message carrying it, if it is one of the large kinds and compresses well; false if it is left as it is. */
+bool CompressNetMessage(CSerializedNetMsg& msg);
+/** Replace the payload of a "compressed" message and its command by those of the message it carries; false if it is malformed. */
+bool DecompressNetMessage(CDataStream& vRecv, std::string& strCommand);
+
 
 class CConnman
 {
@@ -157,10 +178,14 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         std::vector<std::string> vSeedNodes;
+        int nNetThreads = 1;
+        int nMsgHandThreads = 1;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
     bool Start(CScheduler& scheduler, std::string& strNodeError, Options options);
+    /** Load the addresses (peers.dat) and bans (banlist.dat); Start does this itself unless it was done before. Can be called from another thread while the node starts up, but not during Start. */
+    void LoadAddresses();
     void Stop();
     void Interrupt();
     bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
@@ -252,6 +277,9 @@ public:
 
     size_t GetNodeCount(NumConnections num);
     void GetNodeStats(std::vector<CNodeStats>& vstats);
+    //! Memory used by all peers together, see CNode::DynamicMemoryUsage.
+    size_t GetPeerMemoryUsage();
+    size_t GetAddrManMemoryUsage() const { return addrman.DynamicMemoryUsage(); }
     bool DisconnectNode(const std::string& node);
     bool DisconnectNode(NodeId id);
 
@@ -318,7 +346,7 @@ private:
     void NodeDisconnectAndDeleter();
     void NumConnectionsNotifier();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nWorker);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -382,6 +410,8 @@ private:
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
+    //! Whether LoadAddresses was called.
+    bool fAddressesLoaded;
     CAddrMan addrman;
     std::deque<std::string> vOneShots;
     CCriticalSection cs_vOneShots;
@@ -404,14 +434,16 @@ private:
     int nMaxOutbound;
     int nMaxAddnode;
     int nMaxFeeler;
+    int nNetThreads;
+    int nMsgHandThreads;
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
 
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Counts the wakeups of the message processor; every thread processes again once it has moved on from the count it last saw. */
+    uint64_t nMsgProcWake;
 
     /** flag to check that Stop has been called on us */
     bool hasBeenStopped = false;
@@ -423,10 +455,12 @@ private:
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
-    std::thread threadSocketHandler;
+    //! All run the io_context; the work guard keeps them in it while there is nothing to do, until Interrupt.
+    std::vector<std::thread> threadSocketHandlers;
+    std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> socketHandlerWork;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     boost::asio::deadline_timer disconnectAndDeleterTimer;
     boost::asio::deadline_timer connectionsNotifierTimer;
@@ -495,6 +529,15 @@ extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** Time spent on the messages of one command, in microseconds. */
+struct CMsgCmdTime
+{
+    uint64_t nCount = 0;
+    uint64_t nTotal = 0;
+    uint64_t nMax = 0;
+};
+typedef std::map<std::string, CMsgCmdTime> mapMsgCmdTime; //command, time spent
+
 class CNodeStats
 {
 public:
@@ -515,6 +558,16 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdTime mapWaitTimePerMsgCmd;
+    mapMsgCmdTime mapProcessTimePerMsgCmd;
+    uint64_t nSendQueueBytes;
+    uint64_t nSendQueuePeakBytes;
+    bool fCompressSend;
+    bool fCompressRecv;
+    uint64_t nCompressSendRawBytes;
+    uint64_t nCompressSendBytes;
+    uint64_t nCompressRecvRawBytes;
+    uint64_t nCompressRecvBytes;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -530,6 +583,36 @@ public:
 
 
 
+/**
+ * Receive buffers for message payloads, kept after the messages are processed so that the next messages of about the same
+ * size don't have to allocate (and grow) their buffer again. Buffers are kept by size class, powers of two from 4 KiB up to
+ * the largest message, with a limit on the memory kept per class.
+ */
+class CNetRecvBufferPool
+{
+public:
+    static const size_t MIN_CLASS_SIZE = 4 * 1024;
+    static const int NUM_CLASSES = 11;
+    static const size_t MAX_CLASS_BYTES = 8 * 1024 * 1024;
+
+    CNetRecvBufferPool();
+
+    //! Replace vch by a buffer of nSize bytes; one that can hold nCapacity bytes if the pool has such a buffer free.
+    void Get(CSerializeData& vch, size_t nSize, size_t nCapacity);
+    void Put(CSerializeData&& vch);
+
+private:
+    std::mutex mutex;
+    std::vector<CSerializeData> vFree[NUM_CLASSES];
+    size_t nBytes[NUM_CLASSES];
+};
+
+CNetRecvBufferPool& GetRecvBufferPool();
+
+/** Messages up to this size get a buffer for all of their payload as soon as the header is in; larger ones once this much
+ * has arrived, so that a peer can't make us allocate much more than it actually sends. */
+static const unsigned int RECV_PRESIZE_LIMIT = 256 * 1024;
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -553,6 +636,12 @@ public:
         nDataPos = 0;
         nTime = 0;
     }
+    CNetMessage(const CNetMessage&) = default;
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(const CNetMessage&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    //! Gives the payload buffer back to the pool.
+    ~CNetMessage();
 
     bool complete() const
     {
@@ -570,10 +659,17 @@ public:
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
+    //! pch may point into vRecv itself at nDataPos when the data was received there directly (see CNode::GetReceiveBuffer).
     int readData(const char *pch, unsigned int nBytes);
 };
 
 
+/** Histograms over all peers of the time messages of strCommand waited to be processed and took to process, see metrics.h. */
+CMetric& GetMsgWaitMetric(const std::string& strCommand);
+CMetric& GetMsgProcessMetric(const std::string& strCommand);
+/** Histogram of the size of the send queue of a peer each time a message is added to it. */
+CMetric& GetSendQueueMetric();
+
 /** Information about a peer */
 class CNode
 {
@@ -584,8 +680,12 @@ public:
     ServiceFlags nServicesExpected;
     socket_t hSocket;
     size_t nSendSize; // total size of all vSendMsg entries
+    size_t nSendSizePeak; // largest nSendSize so far
     uint64_t nSendBytes;
     std::deque<std::vector<unsigned char>> vSendMsg;
+    //! The messages of the write in progress (at most one per node), taken from vSendMsg all at once.
+    std::vector<std::vector<unsigned char>> vSendInFlight;
+    std::vector<boost::asio::const_buffer> vSendBuffers;
     CCriticalSection cs_vSend;
     bool fResumeSendActive;
     CCriticalSection cs_vRecv;
@@ -637,16 +737,32 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    //! Set while a message handler thread processes this peer, so that its messages are handled in order by one thread at a time.
+    std::atomic_bool fMsgProcClaimed;
+    //! We sent "sendcompress", so the peer may send us compressed messages; it sent it too, so we compress large messages to it.
+    std::atomic_bool fCompressRecv;
+    std::atomic_bool fCompressSend;
+    //! Payload bytes of the messages that went compressed, before compression and on the wire.
+    std::atomic<uint64_t> nCompressSendRawBytes;
+    std::atomic<uint64_t> nCompressSendBytes;
+    std::atomic<uint64_t> nCompressRecvRawBytes;
+    std::atomic<uint64_t> nCompressRecvBytes;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    //! Time messages waited in vProcessMsg and took to process, by command; only valid commands are kept, like mapRecvBytesPerMsgCmd.
+    CCriticalSection cs_msgTime;
+    mapMsgCmdTime mapWaitTimePerMsgCmd;
+    mapMsgCmdTime mapProcessTimePerMsgCmd;
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // Other peers relay to this one from their own message handler thread, so these are protected by cs_floodRelay.
+    CCriticalSection cs_floodRelay;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -730,6 +846,8 @@ private:
     boost::asio::deadline_timer inactivityTimer;
 
 public:
+    //! Runs the socket and timer handlers of this node one at a time, whichever net thread picks them up.
+    boost::asio::io_context::strand strand;
 
     NodeId GetId() const {
         return id;
@@ -750,6 +868,10 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    //! Account the time a message waited to be processed and took to process, to this peer and to the totals over all peers.
+    void RecordMessageTimes(const std::string& strCommand, int64_t nWaitMicros, int64_t nProcessMicros);
+    //! Where to receive the next bytes: straight into the payload of a large message that is being received, or pchBuf.
+    boost::asio::mutable_buffer GetReceiveBuffer();
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -781,11 +903,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_floodRelay);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_floodRelay);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -831,6 +955,9 @@ public:
 
     void copyStats(CNodeStats &stats);
 
+    //! Memory used by the send and process queues, the known address and inventory filters and the inventory waiting to be announced.
+    size_t DynamicMemoryUsage();
+
     ServiceFlags GetLocalServices() const
     {
         return nLocalServices;
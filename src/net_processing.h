@@ -14,14 +14,12 @@
 #define GULDEN_NET_PROCESSING_H
 
 #include "net.h"
+#include "txorphanpool.h"
+#include "txreconciliation.h"
 #include "validation/validationinterface.h"
 
-/** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
-static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
-/** Expiration time for orphan transactions in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Most transaction announcements kept for a peer that doesn't keep up with them */
+static const unsigned int MAX_TX_ANNOUNCEMENT_BACKLOG = 50000;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Headers download timeout expressed in microseconds
@@ -40,6 +38,19 @@ static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 1000; // 1ms/head
 */
 static constexpr int64_t RHEADERS_DOWNLOAD_TIMEOUT_BASE = 1 * 60 * 1000000; // 1 minute
 static constexpr int64_t RHEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 305; // 305usec/header
+/** Most peers fetching reverse headers at the same time, each fetches a segment of its own */
+static const int MAX_RHEADERS_SYNC_PEERS = 4;
+/** Most headers in a reverse headers segment (five getrheaders); longer stretches between two checkpoints are split up */
+static const int RHEADERS_SEGMENT_SIZE = 20000;
+
+/** Default for -peerpowbudget, the proof of work verification time (in ms) an inbound peer can use up in one burst */
+static const int64_t DEFAULT_PEER_POW_BUDGET_MS = 2000;
+/** Default for -peerpowbudgetrate, the proof of work verification time (in ms per second) an inbound peer is allowed on average */
+static const int64_t DEFAULT_PEER_POW_BUDGET_RATE = 100;
+/** Headers per chunk of the cache of serialised headers that headers messages are put together from */
+static const int HEADERS_CACHE_CHUNK_SIZE = 500;
+/** Chunks in the serialised headers cache, of both formats together */
+static const size_t HEADERS_CACHE_CHUNKS = 128;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
@@ -64,6 +75,12 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int64_t nPoWBudgetMicros;
+    uint64_t nPoWDeferred;
+    int64_t nBlockServiceMicros;
+    int64_t nBlockLatencyMicros;
+    int64_t nBlockBytesPerSecond;
+    int nBlockWindow;
 };
 
 /** Get statistics from node state */
@@ -71,6 +88,13 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
+/**
+ * A headers message with the nCount headers from pindexFirst on, consecutive blocks of the active chain; fCompat for the format without the
+ * PoW2 witness headers. Put together from cached chunks of serialised headers, which are checked against the active chain on use so a reorg
+ * can't give out stale ones. A block that isn't in the active chain can only be sent on its own. Requires cs_main.
+ */
+CSerializedNetMsg MakeHeadersMessage(const CBlockIndex* pindexFirst, int nCount, bool fCompat);
+
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& interrupt);
 /**
@@ -26,6 +26,7 @@ public:
     {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        msg.data.reserve(::GetSerializeSizeMany(SER_NETWORK, nFlags | nVersion | nExtraFlags, args...));
         CVectorWriter{ SER_NETWORK, nFlags | nVersion | nExtraFlags, msg.data, 0, std::forward<Args>(args)... };
         return msg;
     }
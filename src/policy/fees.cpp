@@ -38,6 +38,11 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // The per period tables below are kept in one block each, a row of nBuckets per period, so that decaying them
+    // every block walks memory in order; they are only split into a vector per period in the estimates file.
+    unsigned int nBuckets;
+    unsigned int nPeriods;
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
@@ -45,11 +50,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * nBuckets + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * nBuckets + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -66,11 +71,14 @@ private:
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    std::vector<int> unconfTxs;  //unconfTxs[Y * nBuckets + X]
+    unsigned int nUnconfBins;
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
     void resizeInMemoryCounters(size_t newbuckets);
+    static void WritePeriods(CAutoFile& fileout, const std::vector<double>& table, unsigned int nBucketsIn);
+    static unsigned int ReadPeriods(CAutoFile& filein, std::vector<double>& table, size_t numBuckets, const char* what);
 
 public:
     /**
@@ -121,7 +129,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * nPeriods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -141,14 +149,10 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
 {
     decay = _decay;
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    nBuckets = buckets.size();
+    nPeriods = maxPeriods;
+    confAvg.resize(nPeriods * nBuckets);
+    failAvg.resize(nPeriods * nBuckets);
 
     txCtAvg.resize(buckets.size());
     avg.resize(buckets.size());
@@ -158,19 +162,18 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
-    oldUnconfTxs.resize(newbuckets);
+    nUnconfBins = GetMaxConfirms();
+    unconfTxs.assign(nUnconfBins * newbuckets, 0);
+    oldUnconfTxs.assign(newbuckets, 0);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+    int* current = &unconfTxs[(nBlockHeight % nUnconfBins) * nBuckets];
+    for (unsigned int j = 0; j < nBuckets; j++) {
+        oldUnconfTxs[j] += current[j];
+        current[j] = 0;
     }
 }
 
@@ -182,8 +185,8 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    for (size_t i = periodsToConfirm; i <= nPeriods; i++) {
+        confAvg[(i - 1) * nBuckets + bucketindex]++;
     }
     txCtAvg[bucketindex]++;
     avg[bucketindex] += val;
@@ -191,11 +194,11 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
+    for (double& value : confAvg)
+        value *= decay;
+    for (double& value : failAvg)
+        value *= decay;
+    for (unsigned int j = 0; j < nBuckets; j++) {
         avg[j] = avg[j] * decay;
         txCtAvg[j] = txCtAvg[j] * decay;
     }
@@ -233,7 +236,6 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -246,11 +248,11 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
+        nConf += confAvg[(periodTarget - 1) * nBuckets + bucket];
         totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        failNum += failAvg[(periodTarget - 1) * nBuckets + bucket];
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+            extraNum += unconfTxs[((nBlockHeight - confct) % nUnconfBins) * nBuckets + bucket];
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -354,14 +356,38 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
+void TxConfirmStats::WritePeriods(CAutoFile& fileout, const std::vector<double>& table, unsigned int nBucketsIn)
+{
+    std::vector<std::vector<double>> periods;
+    for (auto row = table.begin(); row != table.end(); row += nBucketsIn)
+        periods.emplace_back(row, row + nBucketsIn);
+    const std::vector<std::vector<double>>& constPeriods = periods;
+    fileout << COMPACTSIZEVECTOR(constPeriods);
+}
+
+unsigned int TxConfirmStats::ReadPeriods(CAutoFile& filein, std::vector<double>& table, size_t numBuckets, const char* what)
+{
+    std::vector<std::vector<double>> periods;
+    filein >> COMPACTSIZEVECTOR(periods);
+    table.clear();
+    table.reserve(periods.size() * numBuckets);
+    for (const auto& period : periods) {
+        if (period.size() != numBuckets) {
+            throw std::runtime_error(strprintf("Corrupt estimates file. Mismatch in %s bucket count", what));
+        }
+        table.insert(table.end(), period.begin(), period.end());
+    }
+    return periods.size();
+}
+
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
     fileout << decay;
     fileout << scale;
     fileout << COMPACTSIZEVECTOR(avg);
     fileout << COMPACTSIZEVECTOR(txCtAvg);
-    fileout << COMPACTSIZEVECTOR(confAvg);
-    fileout << COMPACTSIZEVECTOR(failAvg);
+    WritePeriods(fileout, confAvg, nBuckets);
+    WritePeriods(fileout, failAvg, nBuckets);
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -388,36 +414,24 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> COMPACTSIZEVECTOR(confAvg);
-    maxPeriods = confAvg.size();
+    maxPeriods = ReadPeriods(filein, confAvg, numBuckets, "feerate conf average");
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
-            throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
-        }
-    }
 
     if (nFileVersion >= 149900) {
-        filein >> COMPACTSIZEVECTOR(failAvg);
-        if (maxPeriods != failAvg.size()) {
+        if (ReadPeriods(filein, failAvg, numBuckets, "failure average") != maxPeriods) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
         }
-        for (unsigned int i = 0; i < maxPeriods; i++) {
-            if (failAvg[i].size() != numBuckets) {
-                throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
-            }
-        }
     } else {
-        failAvg.resize(confAvg.size());
-        for (unsigned int i = 0; i < failAvg.size(); i++) {
-            failAvg[i].resize(numBuckets);
-        }
+        failAvg.assign(maxPeriods * numBuckets, 0);
     }
 
+    nBuckets = numBuckets;
+    nPeriods = maxPeriods;
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -429,8 +443,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int blockIndex = nBlockHeight % nUnconfBins;
+    unconfTxs[blockIndex * nBuckets + bucketindex]++;
     return bucketindex;
 }
 
@@ -445,7 +459,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    if (blocksAgo >= (int)nUnconfBins) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
@@ -454,9 +468,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int blockIndex = entryHeight % nUnconfBins;
+        if (unconfTxs[blockIndex * nBuckets + bucketindex] > 0) {
+            unconfTxs[blockIndex * nBuckets + bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -464,8 +478,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     }
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < nPeriods; i++) {
+            failAvg[i * nBuckets + bucketindex]++;
         }
     }
 }
@@ -628,6 +642,9 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     trackedTxs = 0;
     untrackedTxs = 0;
+
+    smartFeeCache[0].clear();
+    smartFeeCache[1].clear();
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -774,52 +791,20 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
         if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms())
             return CFeeRate(0);
 
-        // It's not possible to get reasonable estimates for confTarget of 1
-        if (confTarget == 1)
-            confTarget = 2;
-
-        unsigned int maxUsableEstimate = MaxUsableEstimate();
-        if (maxUsableEstimate <= 1)
+        std::vector<SmartFeeEstimate>& cache = smartFeeCache[conservative ? 1 : 0];
+        if (cache.empty())
+            cache.resize(longStats->GetMaxConfirms() + 1);
+        SmartFeeEstimate& estimate = cache[confTarget];
+        if (estimate.foundAtTarget == 0)
+            estimate = calculateSmartFee(confTarget, conservative);
+        if (!estimate.usable)
             return CFeeRate(0);
 
-        if ((unsigned int)confTarget > maxUsableEstimate) {
-            confTarget = maxUsableEstimate;
-        }
-
-        assert(confTarget > 0); //estimateCombinedFee and estimateConservativeFee take unsigned ints
-
-        /** true is passed to estimateCombined fee for target/2 and target so
-         * that we check the max confirms for shorter time horizons as well.
-         * This is necessary to preserve monotonically increasing estimates.
-         * For non-conservative estimates we do the same thing for 2*target, but
-         * for conservative estimates we want to skip these shorter horizons
-         * checks for 2*target because we are taking the max over all time
-         * horizons so we already have monotonically increasing estimates and
-         * the purpose of conservative estimates is not to let short term
-         * fluctuations lower our estimates by too much.
-         */
-        double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true);
-        double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true);
-        double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative);
-        median = halfEst;
-        if (actualEst > median) {
-            median = actualEst;
-        }
-        if (doubleEst > median) {
-            median = doubleEst;
-        }
-
-        if (conservative || median == -1) {
-            double consEst =  estimateConservativeFee(2 * confTarget);
-            if (consEst > median) {
-                median = consEst;
-            }
-        }
+        if (answerFoundAtTarget)
+            *answerFoundAtTarget = estimate.foundAtTarget;
+        median = estimate.median;
     } // Must unlock cs_feeEstimator before taking mempool locks
 
-    if (answerFoundAtTarget)
-        *answerFoundAtTarget = confTarget;
-
     // If mempool is limiting txs , return at least the min feerate from the mempool
     CAmount minPoolFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
     if (minPoolFee > 0 && minPoolFee > median)
@@ -831,6 +816,59 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
     return CFeeRate(median);
 }
 
+CBlockPolicyEstimator::SmartFeeEstimate CBlockPolicyEstimator::calculateSmartFee(int confTarget, bool conservative) const
+{
+    SmartFeeEstimate estimate;
+    estimate.foundAtTarget = confTarget;
+
+    // It's not possible to get reasonable estimates for confTarget of 1
+    if (confTarget == 1)
+        confTarget = 2;
+
+    unsigned int maxUsableEstimate = MaxUsableEstimate();
+    if (maxUsableEstimate <= 1)
+        return estimate;
+
+    if ((unsigned int)confTarget > maxUsableEstimate) {
+        confTarget = maxUsableEstimate;
+    }
+
+    assert(confTarget > 0); //estimateCombinedFee and estimateConservativeFee take unsigned ints
+
+    /** true is passed to estimateCombined fee for target/2 and target so
+     * that we check the max confirms for shorter time horizons as well.
+     * This is necessary to preserve monotonically increasing estimates.
+     * For non-conservative estimates we do the same thing for 2*target, but
+     * for conservative estimates we want to skip these shorter horizons
+     * checks for 2*target because we are taking the max over all time
+     * horizons so we already have monotonically increasing estimates and
+     * the purpose of conservative estimates is not to let short term
+     * fluctuations lower our estimates by too much.
+     */
+    double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true);
+    double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true);
+    double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative);
+    double median = halfEst;
+    if (actualEst > median) {
+        median = actualEst;
+    }
+    if (doubleEst > median) {
+        median = doubleEst;
+    }
+
+    if (conservative || median == -1) {
+        double consEst =  estimateConservativeFee(2 * confTarget);
+        if (consEst > median) {
+            median = consEst;
+        }
+    }
+
+    estimate.median = median;
+    estimate.foundAtTarget = confTarget;
+    estimate.usable = true;
+    return estimate;
+}
+
 
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
@@ -934,6 +972,8 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            smartFeeCache[0].clear();
+            smartFeeCache[1].clear();
         }
     }
     catch (const std::exception& e) {
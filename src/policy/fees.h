@@ -219,9 +219,22 @@ private:
 
     mutable CCriticalSection cs_feeEstimator;
 
+    struct SmartFeeEstimate
+    {
+        double median;        //!< Before the mempool minimum is applied, -1 if there is none
+        int foundAtTarget;    //!< 0 if not calculated yet
+        bool usable;          //!< false if there is too little data for any estimate
+        SmartFeeEstimate() : median(-1), foundAtTarget(0), usable(false) {}
+    };
+    /** estimateSmartFee answers by [conservative][confTarget]. The data only changes much from block to block, so they
+     *  are calculated on first use and kept until the next block. */
+    mutable std::vector<SmartFeeEstimate> smartFeeCache[2];
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
+    /** Helper for estimateSmartFee, the calculation without cache or mempool minimum */
+    SmartFeeEstimate calculateSmartFee(int confTarget, bool conservative) const;
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon) const;
     /** Helper for estimateSmartFee */
@@ -43,8 +43,6 @@ RBFTransactionState IsRBFOptIn(const CTransaction &tx, CTxMemPool &pool)
 {
     AssertLockHeld(pool.cs);
 
-    CTxMemPool::setEntries setAncestors;
-
     // First check the transaction itself.
     if (SignalsOptInRBF(tx))
     {
@@ -53,24 +51,17 @@ RBFTransactionState IsRBFOptIn(const CTransaction &tx, CTxMemPool &pool)
 
     // If this transaction is not in our mempool, then we can't be sure
     // we will know about all its inputs.
-    if (!pool.exists(tx.GetHash()))
+    CTxMemPool::txiter it = pool.mapTx.find(tx.GetHash());
+    if (it == pool.mapTx.end())
     {
         return RBF_TRANSACTIONSTATE_UNKNOWN;
     }
 
     // If all the inputs have nSequence >= maxint-1, it still might be
     // signaled for RBF if any unconfirmed parents have signaled.
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    CTxMemPoolEntry entry = *pool.mapTx.find(tx.GetHash());
-    pool.CalculateMemPoolAncestors(entry, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
-
-    for(CTxMemPool::txiter it : setAncestors)
+    if (pool.AnyMemPoolAncestor(it, [](const CTxMemPoolEntry& ancestor) { return SignalsOptInRBF(ancestor.GetTx()); }))
     {
-        if (SignalsOptInRBF(it->GetTx()))
-        {
-            return RBF_TRANSACTIONSTATE_REPLACEABLE_BIP125;
-        }
+        return RBF_TRANSACTIONSTATE_REPLACEABLE_BIP125;
     }
     return RBF_TRANSACTIONSTATE_FINAL;
 }
@@ -17,8 +17,18 @@
 #include "primitives/block.h"
 #include "uint256.h"
 #include "crypto/hash/sigma/sigma.h"
+#include "executor.h"
 #include "random.h"
+#include "sync.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 /*GULDEN - We  use our own calculation from elsewhere in the source
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
@@ -83,15 +93,160 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
 }
 */
 
-bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params)
-{    
+// Pool of light weight SIGMA verify contexts.
+// Each context owns its own argon scratch memory so that independent headers can be verified concurrently instead of all funneling through a single locked context.
+class CSigmaVerifyPool
+{
+public:
+    CSigmaVerifyPool(uint64_t nContexts, uint64_t nThreadsPerContext, sigma_verify_cache* cache)
+    : nThreadsPerContext_(nThreadsPerContext)
+    {
+        contexts.reserve(nContexts);
+        freeContexts.reserve(nContexts);
+        for (uint64_t i=0; i<nContexts; ++i)
+        {
+            contexts.emplace_back(std::make_unique<sigma_verify_context>(defaultSigmaSettings, nThreadsPerContext_, cache));
+            freeContexts.push_back(contexts.back().get());
+        }
+    }
+
+    // Block until a context is available and take ownership of it.
+    sigma_verify_context* acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeContexts.empty())
+        {
+            ++nWaits;
+            int64_t nWaitStart = GetTimeMicros();
+            condition.wait(lock, [this]{ return !freeContexts.empty(); });
+            nWaitTimeMicros += GetTimeMicros() - nWaitStart;
+        }
+        sigma_verify_context* context = freeContexts.back();
+        freeContexts.pop_back();
+        nPeakBusy = std::max(nPeakBusy, (uint64_t)(contexts.size() - freeContexts.size()));
+        return context;
+    }
+
+    // Whether a context is free right now, i.e. whether a verification would have cores to itself.
+    bool hasIdleContext()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !freeContexts.empty();
+    }
+
+    void release(sigma_verify_context* context)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeContexts.push_back(context);
+            ++nVerified;
+        }
+        condition.notify_one();
+    }
+
+    SigmaVerifyPoolStats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SigmaVerifyPoolStats stats;
+        stats.nContexts = contexts.size();
+        stats.nThreadsPerContext = nThreadsPerContext_;
+        stats.nBusy = contexts.size() - freeContexts.size();
+        stats.nPeakBusy = nPeakBusy;
+        stats.nVerified = nVerified;
+        stats.nWaits = nWaits;
+        stats.nWaitTimeMicros = nWaitTimeMicros;
+        stats.nMemoryUsage = contexts.size() * defaultSigmaSettings.argonMemoryCostKb * 1024;
+        return stats;
+    }
+
+    CSigmaVerifyPool(const CSigmaVerifyPool&) = delete;
+    CSigmaVerifyPool& operator=(const CSigmaVerifyPool&) = delete;
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::unique_ptr<sigma_verify_context>> contexts;
+    std::vector<sigma_verify_context*> freeContexts;
+    uint64_t nThreadsPerContext_ = 0;
+    uint64_t nPeakBusy = 0;
+    uint64_t nVerified = 0;
+    uint64_t nWaits = 0;
+    uint64_t nWaitTimeMicros = 0;
+};
+
+// RAII helper to return a context to the pool on all exit paths.
+class CSigmaVerifyPoolGrant
+{
+public:
+    CSigmaVerifyPoolGrant(CSigmaVerifyPool& pool_) : pool(pool_), context(pool_.acquire()) {}
+    ~CSigmaVerifyPoolGrant() { pool.release(context); }
+    sigma_verify_context& operator*() { return *context; }
+    sigma_verify_context* operator->() { return context; }
+    CSigmaVerifyPoolGrant(const CSigmaVerifyPoolGrant&) = delete;
+    CSigmaVerifyPoolGrant& operator=(const CSigmaVerifyPoolGrant&) = delete;
+private:
+    CSigmaVerifyPool& pool;
+    sigma_verify_context* context;
+};
+
+// Shared by every context in the pool so that e.g. a block that arrives after its header was already verified doesn't regenerate the same arena chunks.
+static sigma_verify_cache* GetSigmaVerifyCache()
+{
+    static std::unique_ptr<sigma_verify_cache> cache = []()
+    {
+        int64_t nCacheMB = GetArg("-sigmaverifycache", DEFAULT_SIGMA_VERIFY_CACHE_MB);
+        if (nCacheMB <= 0)
+            return std::unique_ptr<sigma_verify_cache>();
+        return std::make_unique<sigma_verify_cache>((uint64_t)nCacheMB*1024*1024, SIGMA_VERIFY_CACHE_SLOW_HASHES);
+    }();
+    return cache.get();
+}
+
+// Constructed on first use so that the (memory consuming) contexts are never allocated by programs that never verify SIGMA headers.
+static CSigmaVerifyPool& GetSigmaVerifyPool()
+{
+    static CSigmaVerifyPool pool = []()
+    {
+        uint64_t nCores = std::max((uint64_t)1, (uint64_t)std::thread::hardware_concurrency());
+        int64_t nContextsArg = GetArg("-sigmaverifypool", DEFAULT_SIGMA_VERIFY_POOL_SIZE);
+        uint64_t nContexts = nContextsArg > 0 ? (uint64_t)nContextsArg : std::max((uint64_t)1, nCores / defaultSigmaSettings.numVerifyThreads);
+        nContexts = std::min(nContexts, (uint64_t)MAX_SIGMA_VERIFY_POOL_SIZE);
+        uint64_t nThreadsPerContext = std::max((uint64_t)1, std::min(defaultSigmaSettings.numVerifyThreads, nCores / nContexts));
+        LogPrintf("Using %d SIGMA verify contexts with %d threads each\n", nContexts, nThreadsPerContext);
+        return CSigmaVerifyPool(nContexts, nThreadsPerContext, GetSigmaVerifyCache());
+    }();
+    return pool;
+}
+
+static std::atomic<uint64_t> nFullVerifies(0);
+static std::atomic<uint64_t> nPartialVerifies(0);
+// Seeded with a typical figure for a 4 thread verify so that budgets are sensible before anything has been measured.
+static std::atomic<int64_t> nSigmaVerifyCostMicros(30000);
+
+int64_t GetSigmaVerifyCostMicros()
+{
+    return nSigmaVerifyCostMicros;
+}
+
+SigmaVerifyPoolStats GetSigmaVerifyPoolStats()
+{
+    SigmaVerifyPoolStats stats = GetSigmaVerifyPool().getStats();
+    stats.nFullVerifies = nFullVerifies;
+    stats.nPartialVerifies = nPartialVerifies;
+    if (sigma_verify_cache* cache = GetSigmaVerifyCache())
+        stats.cache = cache->getStats();
+    stats.nMemoryUsage += stats.cache.chunkBytes;
+    return stats;
+}
+
+// Check that the claimed target is within the allowed range, setting bnTarget on success.
+static bool CheckProofOfWorkTarget(const CBlockHeader& block, const Consensus::Params& params, arith_uint256& bnTarget)
+{
     bool fNegative;
     bool fOverflow;
-    arith_uint256 bnTarget;
 
-    bnTarget.SetCompact(block->nBits, &fNegative, &fOverflow);
+    bnTarget.SetCompact(block.nBits, &fNegative, &fOverflow);
 
-    if (block->nTime > 1571320800)
+    if (block.nTime > 1571320800)
     {
         uint256 newProofOfWorkLimit = uint256S("0x003fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
         // Check range
@@ -104,35 +259,162 @@ bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params)
         if (fNegative || bnTarget == 0 || fOverflow || bnTarget > UintToArith256(params.powLimit))
             return false;
     }
+    return true;
+}
+
+static bool CheckSigmaProofOfWork(sigma_verify_context& verify, const CBlockHeader& block, bool& fFullyVerified)
+{
+    // A half verify has a 50% chance of detecting a 'half valid' hash, so with the default of 40% half verifies an attacker has a 20% chance of a node accepting his header without banning him.
+    // That trade off is only worth making when verification is the bottleneck; while there is an idle verify context there are spare cores and every header is verified fully.
+    static const int64_t nPartialVerifyPercent = std::max((int64_t)0, std::min(GetArg("-sigmapartialverify", DEFAULT_SIGMA_PARTIAL_VERIFY_PERCENT), (int64_t)100));
+    int verifyLevel = (nPartialVerifyPercent > 0 && !GetSigmaVerifyPool().hasIdleContext()) ? GetRand(100) : 100;
+    fFullyVerified = false;
+    if (verifyLevel < nPartialVerifyPercent/2)
+    {
+        ++nPartialVerifies;
+        return verify.verifyHeader<1>(block);
+    }
+    else if (verifyLevel < nPartialVerifyPercent)
+    {
+        ++nPartialVerifies;
+        return verify.verifyHeader<2>(block);
+    }
+    ++nFullVerifies;
+    fFullyVerified = true;
+    int64_t nStart = GetTimeMicros();
+    bool fValid = verify.verifyHeader<0>(block);
+    int64_t nCost = GetTimeMicros() - nStart;
+    // Exponential moving average, races between concurrent verifies only lose a sample.
+    nSigmaVerifyCostMicros = (nSigmaVerifyCostMicros*7 + nCost)/8;
+    return fValid;
+}
+
+bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params, bool* pfFullyVerified)
+{
+    bool fFullyVerified = true;
+    if (!pfFullyVerified)
+        pfFullyVerified = &fFullyVerified;
+    *pfFullyVerified = true;
+
+    arith_uint256 bnTarget;
+    if (!CheckProofOfWorkTarget(*block, params, bnTarget))
+        return false;
 
     //fixme: (SIGMA) - Post activation we can simplify this.
     // Check proof of work matches claimed amount
     if (block->nTime > defaultSigmaSettings.activationDate)
     {
-        static sigma_verify_context verify(defaultSigmaSettings,std::min(defaultSigmaSettings.numVerifyThreads, (uint64_t)std::thread::hardware_concurrency()));
-        static CCriticalSection csPOW;
-        LOCK(csPOW);
-        
-        //fixme: (SIGMA) - Detect faster machines and disable this optimisation for them, this will further increase network security.
-        // We speed up verification by doing a half verify 40% of the time instead of a full verify
-        // As a half verify has a 50% chance of detecting a 'half valid' hash an attacker has only a 20% chance of a node accepting his header without banning him
-        // This should provide a ~20% speed up for slow machines
-        int verifyLevel = GetRand(100);
-        if (verifyLevel < 20)
+        CSigmaVerifyPoolGrant verify(GetSigmaVerifyPool());
+        return CheckSigmaProofOfWork(*verify, *block, *pfFullyVerified);
+    }
+    else
+    {
+        if (UintToArith256(block->GetPoWHash()) > bnTarget)
+            return false;
+    }
+
+    return true;
+}
+
+bool CheckProofOfWorkShare(const CBlockHeader& header, const arith_uint256& shareTarget, bool& fMeetsBlockTarget)
+{
+    fMeetsBlockTarget = false;
+    arith_uint256 bnTarget = arith_uint256().SetCompact(header.nBits);
+
+    uint256 hash;
+    if (header.nTime > defaultSigmaSettings.activationDate)
+    {
+        // Only the first fast hash is checked; this is what makes a share cheap to verify, the full verify happens in ProcessNewBlock for the rare share that is also a block candidate.
+        CSigmaVerifyPoolGrant verify(GetSigmaVerifyPool());
+        if (!verify->verifyHeaderAgainstTarget<1>(header, shareTarget, &hash))
+            return false;
+    }
+    else
+    {
+        hash = CBlock(header).GetPoWHash();
+        if (UintToArith256(hash) > shareTarget)
+            return false;
+    }
+    fMeetsBlockTarget = UintToArith256(hash) <= bnTarget;
+    return true;
+}
+
+void CheckProofOfWorkBatch(const std::vector<CBlockHeader>& headers, const Consensus::Params& params, std::vector<bool>& results, std::vector<bool>* pFullyVerified)
+{
+    // std::vector<bool> packs bits so can't be safely written from multiple threads, collect into bytes instead.
+    std::vector<uint8_t> valid(headers.size(), 0);
+    std::vector<uint8_t> full(headers.size(), 1);
+
+    // Split the headers that pass the (cheap) target check by algorithm.
+    // Pre-SIGMA headers are hashed SCRYPT_BATCH_LANES at a time so that the multi lane scrypt can be used, SIGMA headers are verified individually.
+    std::vector<arith_uint256> targets(headers.size());
+    std::vector<uint64_t> legacyIndices;
+    std::vector<uint64_t> sigmaIndices;
+    for (uint64_t nIndex = 0; nIndex < headers.size(); ++nIndex)
+    {
+        if (!CheckProofOfWorkTarget(headers[nIndex], params, targets[nIndex]))
+            continue;
+        if (headers[nIndex].nTime > defaultSigmaSettings.activationDate)
+            sigmaIndices.push_back(nIndex);
+        else
+            legacyIndices.push_back(nIndex);
+    }
+    uint64_t nLegacyGroups = (legacyIndices.size() + SCRYPT_BATCH_LANES - 1) / SCRYPT_BATCH_LANES;
+    uint64_t nWorkUnits = nLegacyGroups + sigmaIndices.size();
+    std::atomic<uint64_t> nNextUnit(0);
+
+    // Each worker claims work units (a group of pre-SIGMA headers or a single SIGMA header) one at a time until the batch is exhausted.
+    // A verify context is only taken from the pool once a worker actually encounters a SIGMA header, and is then held for the remainder of the batch.
+    auto worker = [&]()
+    {
+        std::unique_ptr<CSigmaVerifyPoolGrant> verify;
+        for (uint64_t nUnit = nNextUnit++; nUnit < nWorkUnits; nUnit = nNextUnit++)
         {
-            return verify.verifyHeader<1>(*block);
+            if (nUnit < nLegacyGroups)
+            {
+                uint64_t nBegin = nUnit * SCRYPT_BATCH_LANES;
+                uint64_t nCount = std::min((uint64_t)SCRYPT_BATCH_LANES, legacyIndices.size() - nBegin);
+                const CBlockHeader* group[SCRYPT_BATCH_LANES];
+                uint256 hashes[SCRYPT_BATCH_LANES];
+                for (uint64_t i = 0; i < nCount; ++i)
+                    group[i] = &headers[legacyIndices[nBegin + i]];
+                GetPoWHashBatch(group, hashes, nCount);
+                for (uint64_t i = 0; i < nCount; ++i)
+                {
+                    uint64_t nIndex = legacyIndices[nBegin + i];
+                    valid[nIndex] = !(UintToArith256(hashes[i]) > targets[nIndex]);
+                }
+            }
+            else
+            {
+                uint64_t nIndex = sigmaIndices[nUnit - nLegacyGroups];
+                if (!verify)
+                    verify = std::make_unique<CSigmaVerifyPoolGrant>(GetSigmaVerifyPool());
+                bool fFullyVerified;
+                valid[nIndex] = CheckSigmaProofOfWork(**verify, headers[nIndex], fFullyVerified);
+                full[nIndex] = fFullyVerified;
+            }
         }
-        else if (verifyLevel < 40)
+    };
+
+    uint64_t nWorkers = std::min(std::min(nWorkUnits, GetSigmaVerifyPool().getStats().nContexts), (uint64_t)GetExecutor().GetThreadCount() + 1);
+    if (nWorkers > 1)
+    {
+        CTaskGroup workers(GetExecutor(), EXECUTOR_VALIDATION);
+        for (uint64_t i=1; i<nWorkers; ++i)
         {
-            return verify.verifyHeader<2>(*block);
+            workers.Run(worker);
         }
-        return verify.verifyHeader<0>(*block);
+        // The calling thread participates as well instead of idling.
+        worker();
+        workers.Wait();
     }
     else
     {
-        if (UintToArith256(block->GetPoWHash()) > bnTarget)
-            return false;
+        worker();
     }
 
-    return true;
+    results.assign(valid.begin(), valid.end());
+    if (pFullyVerified)
+        pFullyVerified->assign(full.begin(), full.end());
 }
@@ -17,8 +17,10 @@
 #include "crypto/hash/sigma/sigma.h"
 
 #include <stdint.h>
+#include <vector>
 
 class CBlock;
+class CBlockHeader;
 class CBlockIndex;
 class uint256;
 /*GULDEN - our own version of this software from elsewhere in the source is used
@@ -26,7 +28,48 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
 */
 
-/** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
-bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params);
+/** Default for -sigmaverifypool; 0 = one verify context per numVerifyThreads available cores */
+static const int64_t DEFAULT_SIGMA_VERIFY_POOL_SIZE = 0;
+/** Hard upper bound on the number of verify contexts (each one holds its own argon scratch buffer) */
+static const int64_t MAX_SIGMA_VERIFY_POOL_SIZE = 64;
+
+/** Default for -sigmapartialverify; percentage of SIGMA headers that are only half verified while every verify context is busy (0 = always verify fully) */
+static const int64_t DEFAULT_SIGMA_PARTIAL_VERIFY_PERCENT = 40;
+
+/** Default for -sigmaverifycache; megabytes of generated arena chunks kept around for repeat verifications of the same (or a sibling) header (0 = disable the cache) */
+static const int64_t DEFAULT_SIGMA_VERIFY_CACHE_MB = 64;
+/** Number of slow hashes kept around alongside the arena chunks, each entry is ~100 bytes */
+static const uint64_t SIGMA_VERIFY_CACHE_SLOW_HASHES = 16384;
+
+/** Utilisation statistics for the pool of SIGMA verify contexts used by CheckProofOfWork */
+struct SigmaVerifyPoolStats
+{
+    uint64_t nContexts = 0;
+    uint64_t nThreadsPerContext = 0;
+    uint64_t nBusy = 0;
+    uint64_t nPeakBusy = 0;
+    uint64_t nVerified = 0;
+    uint64_t nWaits = 0;
+    uint64_t nWaitTimeMicros = 0;
+    uint64_t nFullVerifies = 0;
+    uint64_t nPartialVerifies = 0;
+    //! Argon memory of the contexts plus the arena chunks in the cache, in bytes.
+    uint64_t nMemoryUsage = 0;
+    sigma_verify_cache_stats cache;
+};
+SigmaVerifyPoolStats GetSigmaVerifyPoolStats();
+
+/** Running average of the time a full SIGMA header verification takes on this machine, in microseconds (an estimate until the first header is verified) */
+int64_t GetSigmaVerifyCostMicros();
+
+/** Check whether a block hash satisfies the proof-of-work requirement specified by nBits; pfFullyVerified is cleared if only a partial SIGMA verify (see -sigmapartialverify) was done */
+bool CheckProofOfWork(const CBlock* block, const Consensus::Params& params, bool* pfFullyVerified = nullptr);
+
+/** Check a pool share: that header meets shareTarget (an easier target than nBits) with a half verify of the SIGMA proof of work.
+ *  fMeetsBlockTarget is set if the checked hash also meets nBits, in which case the block should be submitted (which performs the full verify). */
+bool CheckProofOfWorkShare(const CBlockHeader& header, const arith_uint256& shareTarget, bool& fMeetsBlockTarget);
+
+/** Check the proof-of-work of a batch of independent headers concurrently across the SIGMA verify pool; results[i] is set to the outcome for headers[i], and (*pFullyVerified)[i] to whether it was a full verify */
+void CheckProofOfWorkBatch(const std::vector<CBlockHeader>& headers, const Consensus::Params& params, std::vector<bool>& results, std::vector<bool>* pFullyVerified = nullptr);
 
 #endif // GULDEN_POW_H
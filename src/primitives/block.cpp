@@ -17,14 +17,91 @@
 #include "utilstrencodings.h"
 #include "crypto/common.h"
 
-uint256 CBlockHeader::GetHashLegacy() const
+CBlockHashCache::HeaderFields::HeaderFields(const CBlockHeader& header)
+: nVersionPoW2Witness(header.nVersionPoW2Witness)
+, nTimePoW2Witness(header.nTimePoW2Witness)
+, hashMerkleRootPoW2Witness(header.hashMerkleRootPoW2Witness)
+, nVersion(header.nVersion)
+, hashPrevBlock(header.hashPrevBlock)
+, hashMerkleRoot(header.hashMerkleRoot)
+, nTime(header.nTime)
+, nBits(header.nBits)
+, nNonce(header.nNonce)
+{
+}
+
+bool CBlockHashCache::HeaderFields::operator==(const HeaderFields& other) const
 {
-    //if (!cachedHash.IsNull())
-        //return cachedHash;
+    return nNonce == other.nNonce && nTime == other.nTime && hashMerkleRoot == other.hashMerkleRoot && hashPrevBlock == other.hashPrevBlock
+        && nVersion == other.nVersion && nBits == other.nBits && nVersionPoW2Witness == other.nVersionPoW2Witness
+        && nTimePoW2Witness == other.nTimePoW2Witness && hashMerkleRootPoW2Witness == other.hashMerkleRootPoW2Witness;
+}
 
-    //cachedHash = SerializeHash(*this);
-    //return cachedHash;
-    return SerializeHash(*this, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS);
+bool CBlockHashCache::GetHeaderHash(const CBlockHeader& header, HeaderHash kind, uint256& hash)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!fHaveHeaderHash[kind] || !(headerFields == HeaderFields(header)))
+        return false;
+    hash = headerHashes[kind];
+    return true;
+}
+
+void CBlockHashCache::SetHeaderHash(const CBlockHeader& header, HeaderHash kind, const uint256& hash)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    HeaderFields fields(header);
+    if (!(headerFields == fields))
+    {
+        headerFields = fields;
+        for (bool& fHave : fHaveHeaderHash)
+            fHave = false;
+    }
+    headerHashes[kind] = hash;
+    fHaveHeaderHash[kind] = true;
+}
+
+bool CBlockHashCache::GetMerkleRoot(const std::vector<CTransactionRef>& vtx, size_t nBegin, size_t nEnd, uint256& hash, bool& fMutated)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (vtx != vtxMerkle)
+        return false;
+    for (const MerkleRoot& root : merkleRoots)
+    {
+        if (root.nBegin == nBegin && root.nEnd == nEnd)
+        {
+            hash = root.hash;
+            fMutated = root.fMutated;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CBlockHashCache::SetMerkleRoot(const std::vector<CTransactionRef>& vtx, size_t nBegin, size_t nEnd, const uint256& hash, bool fMutated)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (vtx != vtxMerkle)
+    {
+        vtxMerkle = vtx;
+        merkleRoots.clear();
+    }
+    for (const MerkleRoot& root : merkleRoots)
+    {
+        if (root.nBegin == nBegin && root.nEnd == nEnd)
+            return;
+    }
+    merkleRoots.push_back(MerkleRoot{nBegin, nEnd, hash, fMutated});
+}
+
+uint256 CBlockHeader::GetHashLegacy() const
+{
+    uint256 hash;
+    if (hashCache && hashCache->GetHeaderHash(*this, CBlockHashCache::HASH_LEGACY, hash))
+        return hash;
+    hash = SerializeHash(*this, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS);
+    if (hashCache)
+        hashCache->SetHeaderHash(*this, CBlockHashCache::HASH_LEGACY, hash);
+    return hash;
 }
 
 uint256 CBlockHeader::GetHashPoW2(bool force) const
@@ -33,21 +110,31 @@ uint256 CBlockHeader::GetHashPoW2(bool force) const
         assert(nVersionPoW2Witness != 0 || nTimePoW2Witness != 0);
 
     if (nVersionPoW2Witness == 0 || nTimePoW2Witness == 0)
-        return SerializeHash(*this, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS);
+        return GetHashLegacy();
 
-    return SerializeHash(*this, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS_SIG);
+    uint256 hash;
+    if (hashCache && hashCache->GetHeaderHash(*this, CBlockHashCache::HASH_POW2, hash))
+        return hash;
+    hash = SerializeHash(*this, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS_SIG);
+    if (hashCache)
+        hashCache->SetHeaderHash(*this, CBlockHashCache::HASH_POW2, hash);
+    return hash;
 }
 
-uint256 CBlock::GetPoWHash() const
+static bool IsHashCityTestnet()
 {
-    //if (!cachedPOWHash.IsNull())
-        //return cachedPOWHash;
+    static bool hashCity = IsArgSet("-testnet") ? ( GetArg("-testnet", "")[0] == 'C' ? true : false ) : false;
+    return hashCity;
+}
 
+uint256 CBlock::GetPoWHash() const
+{
     uint256 hashRet;
+    if (GetHashCache() && GetHashCache()->GetHeaderHash(*this, CBlockHashCache::HASH_POW, hashRet))
+        return hashRet;
 
     //CBSU - maybe use a static functor or something here instead of having the branch 
-    static bool hashCity = IsArgSet("-testnet") ? ( GetArg("-testnet", "")[0] == 'C' ? true : false ) : false;
-    if (hashCity)
+    if (IsHashCityTestnet())
     {
         arith_uint256 thash;
         hash_city(BEGIN(nVersion), thash);
@@ -58,11 +145,32 @@ uint256 CBlock::GetPoWHash() const
         char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
         scrypt_1024_1_1_256_sp(BEGIN(nVersion), BEGIN(hashRet), scratchpad);
     }
-    //cachedPOWHash = ArithToUint256(thash);
-    //return cachedPOWHash;
+    if (GetHashCache())
+        GetHashCache()->SetHeaderHash(*this, CBlockHashCache::HASH_POW, hashRet);
     return hashRet;
 }
 
+void GetPoWHashBatch(const CBlockHeader* const* headers, uint256* hashes, size_t count)
+{
+    if (IsHashCityTestnet())
+    {
+        for (size_t i = 0; i < count; ++i)
+            hashes[i] = CBlock(*headers[i]).GetPoWHash();
+        return;
+    }
+
+    // Too large for the stack of every thread we may be called from, so keep one per thread around instead of reallocating it for each batch.
+    static thread_local std::vector<char> scratchpad(SCRYPT_BATCH_SCRATCHPAD_SIZE);
+    std::vector<const char*> input(count);
+    std::vector<char*> output(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        input[i] = BEGIN(headers[i]->nVersion);
+        output[i] = BEGIN(hashes[i]);
+    }
+    scrypt_1024_1_1_256_sp_batch(input.data(), output.data(), count, scratchpad.data());
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -21,6 +21,9 @@
 #include "util.h"
 #include <Gulden/Common/hash/hash.h>
 
+#include <memory>
+#include <mutex>
+
 #define SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS     0x20000000
 #define SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS_SIG 0x40000000
 
@@ -46,6 +49,62 @@ inline double GetHumanDifficultyFromBits(uint64_t nBits)
     return dDiff * 1000000000;
 }
 
+class CBlockHeader;
+
+/**
+ * Hashes worked out from a block: the header hashes and the merkle roots of its transactions. Each is remembered together
+ * with what it was worked out from, and only handed out again while that is unchanged; the header fields and vtx are public
+ * and changed in place (e.g. by the miner), so there is nothing to invalidate on, instead a lookup compares.
+ * Shared by copies of a block, which is fine as each lookup compares against the copy asking.
+ */
+class CBlockHashCache
+{
+public:
+    enum HeaderHash { HASH_LEGACY, HASH_POW2, HASH_POW, NUM_HEADER_HASHES };
+
+    bool GetHeaderHash(const CBlockHeader& header, HeaderHash kind, uint256& hash);
+    void SetHeaderHash(const CBlockHeader& header, HeaderHash kind, const uint256& hash);
+
+    //! The merkle root of vtx[nBegin, nEnd), and whether it was mutated (see ComputeMerkleRoot).
+    bool GetMerkleRoot(const std::vector<CTransactionRef>& vtx, size_t nBegin, size_t nEnd, uint256& hash, bool& fMutated);
+    void SetMerkleRoot(const std::vector<CTransactionRef>& vtx, size_t nBegin, size_t nEnd, const uint256& hash, bool fMutated);
+
+private:
+    //! The header fields the hashes cover; the witness signature is in none of them.
+    struct HeaderFields
+    {
+        int32_t nVersionPoW2Witness = 0;
+        uint32_t nTimePoW2Witness = 0;
+        uint256 hashMerkleRootPoW2Witness;
+        int32_t nVersion = 0;
+        uint256 hashPrevBlock;
+        uint256 hashMerkleRoot;
+        uint32_t nTime = 0;
+        uint32_t nBits = 0;
+        uint32_t nNonce = 0;
+
+        HeaderFields() {}
+        explicit HeaderFields(const CBlockHeader& header);
+        bool operator==(const HeaderFields& other) const;
+    };
+
+    struct MerkleRoot
+    {
+        size_t nBegin;
+        size_t nEnd;
+        uint256 hash;
+        bool fMutated;
+    };
+
+    std::mutex cs;
+    HeaderFields headerFields;
+    uint256 headerHashes[NUM_HEADER_HASHES];
+    bool fHaveHeaderHash[NUM_HEADER_HASHES] = {};
+    //! The transactions the merkle roots are of; a block has at most two (the PoW part and the witness part).
+    std::vector<CTransactionRef> vtxMerkle;
+    std::vector<MerkleRoot> merkleRoots;
+};
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -141,12 +200,15 @@ public:
         return (nBits == 0);
     }
 
-    //fixme: (Post-2.1) SBSU - this gives speed boost
-    //but causes issues for mining
-    //Disabled out of concern it may cause issues for others as well
-    //re-enable once carefully looking into the below assertion.
-    //GuldenD: main.cpp:2341: bool ConnectBlock(const CBlock&, CValidationState&, CBlockIndex*, CCoinsViewCache&, const CChainParams&, bool): Assertion `hashPrevBlock == view.GetBestBlock()' failed.
-    //mutable uint256 cachedHash;
+    //! Remember hashes of this header (and of the block) from here on; blocks do so always, bare headers only when asked as
+    //! there can be a great many of them in memory at once (reverse header sync).
+    void EnableHashCache()
+    {
+        if (!hashCache)
+            hashCache = std::make_shared<CBlockHashCache>();
+    }
+    CBlockHashCache* GetHashCache() const { return hashCache.get(); }
+
     uint256 GetHashLegacy() const;
 
     uint256 GetHashPoW2(bool force=false) const;
@@ -155,6 +217,9 @@ public:
     {
         return (int64_t)nTime;
     }
+
+private:
+    std::shared_ptr<CBlockHashCache> hashCache;
 };
 
 
@@ -171,12 +236,14 @@ public:
     CBlock()
     {
         SetNull();
+        EnableHashCache();
     }
 
     CBlock(const CBlockHeader &header)
     {
         SetNull();
         *((CBlockHeader*)this) = header;
+        EnableHashCache();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -187,33 +254,28 @@ public:
         READWRITECOMPACTSIZEVECTOR(vtx);
     }
 
+    //! As s >> block, but with the transactions in a CTransactionArena.
+    template <typename Stream>
+    void UnserializeWithArena(Stream& s)
+    {
+        s >> *(CBlockHeader*)this;
+        CTransactionArena::Unserialize(s, ReadCompactSize(s), vtx);
+    }
+
     void SetNull()
     {
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
         fPOWChecked = false;
-        //cachedHash = uint256();
-        //cachedPOWHash = uint256();
     }
 
-    //mutable uint256 cachedPOWHash;
     uint256 GetPoWHash() const;
 
+    //! The header, sharing the hashes remembered for this block.
     CBlockHeader GetBlockHeader() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        block.nVersionPoW2Witness = nVersionPoW2Witness;
-        block.nTimePoW2Witness = nTimePoW2Witness;
-        block.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
-        block.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
-        return block;
+        return *this;
     }
 
     std::string ToString() const;
@@ -252,6 +314,9 @@ struct CBlockLocator
     }
 };
 
+/** Compute the pre-SIGMA proof of work hash (as CBlock::GetPoWHash) for several headers at once, interleaving the scrypt work across SIMD lanes where the platform allows it. */
+void GetPoWHashBatch(const CBlockHeader* const* headers, uint256* hashes, size_t count);
+
 /** Compute the consensus-critical block weight (see BIP 141). */
 int64_t GetBlockWeight(const CBlock& tx);
 
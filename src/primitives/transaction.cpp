@@ -173,3 +173,23 @@ int64_t GetTransactionWeight(const CTransaction& tx)
     // segsig: transaction weight = transaction size, including the size of the segregated signatures - no complicated segwit weighting shenanigans necessary.
     return ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 }
+
+CTransactionArena::~CTransactionArena()
+{
+    for (size_t i = 0; i < nConstructed; ++i)
+        reinterpret_cast<CTransaction*>(&vChunks[i / nChunkSize][i % nChunkSize])->~CTransaction();
+}
+
+void* CTransactionArena::Allocate()
+{
+    if (nConstructed / nChunkSize == vChunks.size())
+        vChunks.emplace_back(new Storage[nChunkSize]);
+    return &vChunks[nConstructed / nChunkSize][nConstructed % nChunkSize];
+}
+
+CTransactionRef DetachFromArena(const CTransactionRef& tx)
+{
+    if (!tx || !CTransactionArena::Contains(tx))
+        return tx;
+    return MakeTransactionRef(*tx);
+}
@@ -14,6 +14,8 @@
 #define GULDEN_PRIMITIVES_TRANSACTION_H
 
 #include "amount.h"
+#include "crypto/common.h"
+#include "hash.h"
 #include "script/script.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -23,7 +25,11 @@
 #include "streams.h"
 #include "utilstrencodings.h"
 #include <new> // Required for placement 'new'.
+#include <algorithm>
 #include <bitset>
+#include <memory>
+#include <type_traits>
+#include <vector>
 
 
 static const int SERIALIZE_TRANSACTION_NO_SEGREGATED_SIGNATURES = 0x40000000;
@@ -39,29 +45,30 @@ struct CBlockPosition
     uint64_t transactionIndex; // Position of transaction within the block.
     CBlockPosition(uint64_t blockNumber_, uint64_t transactionIndex_) : blockNumber(blockNumber_), transactionIndex(transactionIndex_) {}
 
+    //! Fixed size encoding: block number then transaction index, both little endian.
+    static const size_t SERIALIZED_SIZE = 16;
+    void GetSerialized(unsigned char* data) const
+    {
+        WriteLE64(data, blockNumber);
+        WriteLE64(data + 8, transactionIndex);
+    }
+
     //fixme: (2.1) (MOBILE) (SPV) (SEGSIG) Look closer at how to handle this in relation to mobile SPV wallets
+    //! Stands in for the hash of the transaction where a hash is needed; the double SHA256 of the fixed size encoding, without allocating.
     uint256 getHash() const
     {
-        std::vector<unsigned char> serData;
-        {
-            CVectorWriter serializedBlockPosition(SER_NETWORK, INIT_PROTO_VERSION, serData, 0);
-            serializedBlockPosition << blockNumber;
-            serializedBlockPosition << transactionIndex;
-        }
-        std::string sHex = HexStr(serData);
-        return Hash(sHex.begin(), sHex.end());
+        unsigned char data[SERIALIZED_SIZE];
+        GetSerialized(data);
+        uint256 result;
+        CHash256().Write(data, SERIALIZED_SIZE).Finalize(result.begin());
+        return result;
     }
 
     friend bool operator<(const CBlockPosition& a, const CBlockPosition& b)
     {
-        if (a.blockNumber == b.blockNumber)
-        {
+        if (a.blockNumber != b.blockNumber)
             return a.blockNumber < b.blockNumber;
-        }
-        else
-        {
-            return a.transactionIndex < b.transactionIndex;
-        }
+        return a.transactionIndex < b.transactionIndex;
     }
 
     friend bool operator==(const CBlockPosition& a, const CBlockPosition& b)
@@ -153,6 +160,11 @@ public:
             return prevBlock.getHash();
         }
     }
+    //! Only meaningful when !isHash.
+    const CBlockPosition& getBlockPosition() const
+    {
+        return prevBlock;
+    }
     void setHash(uint256 hash_)
     {
         hash = hash_;
@@ -242,7 +254,14 @@ public:
             }
             else
             {
-                return a.prevBlock < b.prevBlock;
+                if (a.prevBlock == b.prevBlock)
+                {
+                    return a.n < b.n;
+                }
+                else
+                {
+                    return a.prevBlock < b.prevBlock;
+                }
             }
         }
         else
@@ -262,6 +281,24 @@ public:
     }
 
     std::string ToString() const;
+
+    friend struct CompareOutPointPtrFast;
+};
+
+/**
+ * An order on outpoints that is cheap to evaluate (the index first, the hash only on a tie) and brings equal outpoints
+ * together; unlike operator< it means nothing beyond that.
+ */
+struct CompareOutPointPtrFast
+{
+    bool operator()(const COutPoint* a, const COutPoint* b) const
+    {
+        if (a->n != b->n)
+            return a->n < b->n;
+        if (a->isHash != b->isHash)
+            return a->isHash < b->isHash;
+        return a->isHash ? a->hash < b->hash : a->prevBlock < b->prevBlock;
+    }
 };
 
 /** An input of a transaction.  It contains the location of the previous
@@ -1294,6 +1331,63 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef(int32_t nVersion_) { return std::make_shared<const CTransaction>(nVersion_); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/**
+ * Storage for the transactions of one block, in a few large chunks instead of an allocation (with its shared_ptr control
+ * block) per transaction. The references handed out all share ownership of the arena, so it lives as long as any of its
+ * transactions is referenced; anything keeping transactions around for longer than the block (mempool, wallet) should
+ * take them through DetachFromArena so as not to hold on to the whole block.
+ * Only the transaction objects themselves are in the arena; their inputs, outputs and scripts are allocated as usual.
+ */
+class CTransactionArena
+{
+public:
+    //! The arena doesn't trust the transaction count it is given beyond this, so a bogus count can't make it allocate much.
+    static constexpr size_t MAX_CHUNK_SIZE = 4096;
+
+    CTransactionArena() {}
+    ~CTransactionArena();
+    CTransactionArena(const CTransactionArena&) = delete;
+    CTransactionArena& operator=(const CTransactionArena&) = delete;
+
+    //! Read nCount transactions from s into a new arena, and set vtx to references to them.
+    template <typename Stream>
+    static void Unserialize(Stream& s, uint64_t nCount, std::vector<CTransactionRef>& vtx)
+    {
+        std::shared_ptr<CTransactionArena> arena(new CTransactionArena(), Deleter());
+        arena->nChunkSize = std::max<size_t>(1, std::min<uint64_t>(nCount, MAX_CHUNK_SIZE));
+        vtx.clear();
+        vtx.reserve(arena->nChunkSize);
+        for (uint64_t i = 0; i < nCount; ++i)
+        {
+            void* pStorage = arena->Allocate();
+            const CTransaction* tx = new (pStorage) CTransaction(deserialize, s);
+            ++arena->nConstructed;
+            vtx.emplace_back(arena, tx);
+        }
+    }
+
+    //! Whether tx is in an arena.
+    static bool Contains(const CTransactionRef& tx) { return std::get_deleter<Deleter>(tx) != nullptr; }
+
+private:
+    //! The deleter of arenas, by which references into one are told apart.
+    struct Deleter
+    {
+        void operator()(CTransactionArena* arena) const { delete arena; }
+    };
+    typedef std::aligned_storage<sizeof(CTransaction), alignof(CTransaction)>::type Storage;
+
+    void* Allocate();
+
+    std::vector<std::unique_ptr<Storage[]>> vChunks;
+    size_t nChunkSize = 1;
+    //! Transactions constructed so far; they fill the chunks in order.
+    size_t nConstructed = 0;
+};
+
+//! tx itself if it isn't in an arena, otherwise a copy of it that doesn't keep the arena alive.
+CTransactionRef DetachFromArena(const CTransactionRef& tx);
+
 /** Compute the weight of a transaction, as defined by BIP 141 */
 int64_t GetTransactionWeight(const CTransaction &tx);
 
@@ -273,6 +273,80 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a CBlockWitnessDelta.
+ * Announces a witnessed block to a peer that has the PoW block it witnesses, instead of "cmpctblock".
+ * @since protocol version 70017
+ */
+extern const char *WITNESSDELTA;
+/**
+ * Contains a 4-byte version and an 8-byte salt.
+ * Indicates that a node is willing to reconcile transaction announcements, sent after "verack".
+ * Both sides of the connection have to send it; the short ids are salted with both salts.
+ */
+extern const char *SENDRECON;
+/**
+ * Contains the 4-byte size of the sender's reconciliation set.
+ * Starts a reconciliation round; sent by the side that made the connection.
+ * Peer should respond with "sketch" message.
+ */
+extern const char *REQRECON;
+/**
+ * Contains a sketch of the sender's reconciliation set.
+ * Sent in response to a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte bool and a vector of 4-byte short ids.
+ * Ends a reconciliation round: whether the difference could be decoded and, if so, the short ids of the transactions
+ * that the sender wants announced.
+ */
+extern const char *RECONCILDIFF;
+/**
+ * Contains a 1-byte filter type, a 4-byte start height and a stop hash.
+ * Asks for the compact filters of the blocks from the start height up to the stop block.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP157.
+ * Peer should respond with a "cfilter" message for each block.
+ */
+extern const char *GETCFILTERS;
+/**
+ * Contains a 1-byte filter type, a block hash and the filter of that block.
+ * Sent in response to a "getcfilters" message.
+ */
+extern const char *CFILTER;
+/**
+ * Contains a 1-byte filter type, a 4-byte start height and a stop hash.
+ * Asks for the filter hashes of the blocks from the start height up to the stop block.
+ * Peer should respond with "cfheaders" message.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * Contains a 1-byte filter type, the stop hash, the filter header of the block before the start height and a vector of filter hashes.
+ * Sent in response to a "getcfheaders" message.
+ */
+extern const char *CFHEADERS;
+/**
+ * Contains a 1-byte filter type and a stop hash.
+ * Asks for the filter headers at every 1000th block up to the stop block.
+ * Peer should respond with "cfcheckpt" message.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * Contains a 1-byte filter type, the stop hash and a vector of filter headers.
+ * Sent in response to a "getcfcheckpt" message.
+ */
+extern const char *CFCHECKPT;
+/**
+ * Contains the 4-byte version of the compression the sender can decompress.
+ * Indicates that a node is willing to receive "compressed" messages, sent after "verack".
+ * Both sides of the connection have to send it.
+ */
+extern const char *SENDCOMPRESS;
+/**
+ * Contains the command of the message it carries, the size of that message and the message as an LZ4 block.
+ * Takes the place of a large message to a peer that sent "sendcompress", when it compresses well enough.
+ */
+extern const char *COMPRESSED;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -299,6 +373,8 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_COMPACT_FILTERS means the node serves the compact block filters of BIP157 and BIP158.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -4,6 +4,12 @@
 
 #include "pubkey.h"
 
+#include "crypto/common.h"
+#include "crypto/hmac_sha512.h"
+
+#include <memory>
+#include <string.h>
+
 #include <secp256k1.h>
 #include <secp256k1_recovery.h>
 
@@ -11,6 +17,48 @@ namespace
 {
 /* Global secp256k1_context object used for verification. */
 secp256k1_context* secp256k1_context_verify = NULL;
+
+/**
+ * The public keys a verifying thread parsed last, by their serialized bytes. Parsing a compressed key takes a square
+ * root, which is a good part of the cost of a verification, and the same keys are verified against over and over (the
+ * witness keys most of all). One per thread, so the script check threads don't contend for it.
+ * Slots are picked by bytes of the X coordinate; anyone able to make keys collide merely gets them parsed every time.
+ */
+class CPubKeyParseCache
+{
+public:
+    static const size_t NUM_SLOTS = 1024;
+
+    bool Parse(const unsigned char* pch, size_t nSize, secp256k1_pubkey& pubkey)
+    {
+        if (nSize < 5 || nSize > sizeof(Slot::vch))
+            return secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, pch, nSize);
+        Slot& slot = slots[ReadLE32(pch + 1) % NUM_SLOTS];
+        if (slot.nSize == nSize && memcmp(slot.vch, pch, nSize) == 0)
+        {
+            pubkey = slot.pubkey;
+            return true;
+        }
+        if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, pch, nSize))
+            return false;
+        slot.nSize = nSize;
+        memcpy(slot.vch, pch, nSize);
+        slot.pubkey = pubkey;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        size_t nSize = 0;
+        unsigned char vch[65];
+        secp256k1_pubkey pubkey;
+    };
+    Slot slots[NUM_SLOTS];
+};
+
+//! Allocated on first use, so that threads that never verify don't carry it around.
+thread_local std::unique_ptr<CPubKeyParseCache> pubkeyParseCache;
 }
 
 /** This function is taken from the libsecp256k1 distribution and implements
@@ -169,7 +217,9 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
         return false;
     secp256k1_pubkey pubkey;
     secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
+    if (!pubkeyParseCache)
+        pubkeyParseCache.reset(new CPubKeyParseCache());
+    if (!pubkeyParseCache->Parse(&(*this)[0], size(), pubkey)) {
         return false;
     }
     if (vchSig.size() == 0) {
@@ -272,6 +322,48 @@ bool CExtPubKey::Derive(CExtPubKey &out, unsigned int _nChild) const {
     return pubkey.Derive(out.pubkey, out.chaincode, _nChild, chaincode);
 }
 
+bool CExtPubKey::DeriveRange(std::vector<CExtPubKey>& vOut, unsigned int nFirstChild, unsigned int nCount) const {
+    assert(pubkey.IsValid());
+    assert(pubkey.size() == 33);
+    assert(((nFirstChild + (uint64_t)nCount - 1) >> 31) == 0 || nCount == 0);
+    vOut.clear();
+    if (nCount == 0)
+        return true;
+
+    // The fingerprint, the parsed parent key and the HMAC keyed with the chain code and fed the parent key are the same for every child.
+    CKeyID id = pubkey.GetID();
+    secp256k1_pubkey parent;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parent, pubkey.begin(), pubkey.size())) {
+        return false;
+    }
+    CHMAC_SHA512 hmacParent(chaincode.begin(), chaincode.size());
+    hmacParent.Write(pubkey.begin(), 33);
+
+    vOut.resize(nCount);
+    for (unsigned int i = 0; i < nCount; ++i) {
+        CExtPubKey& out = vOut[i];
+        out.nDepth = nDepth + 1;
+        memcpy(&out.vchFingerprint[0], &id, 4);
+        out.nChild = nFirstChild + i;
+
+        unsigned char num[4] = { (unsigned char)((out.nChild >> 24) & 0xFF), (unsigned char)((out.nChild >> 16) & 0xFF), (unsigned char)((out.nChild >> 8) & 0xFF), (unsigned char)((out.nChild >> 0) & 0xFF) };
+        unsigned char hash[64];
+        CHMAC_SHA512(hmacParent).Write(num, 4).Finalize(hash);
+        memcpy(out.chaincode.begin(), hash+32, 32);
+
+        secp256k1_pubkey child = parent;
+        if (!secp256k1_ec_pubkey_tweak_add(secp256k1_context_verify, &child, hash)) {
+            vOut.clear();
+            return false;
+        }
+        unsigned char pub[33];
+        size_t publen = 33;
+        secp256k1_ec_pubkey_serialize(secp256k1_context_verify, pub, &publen, &child, SECP256K1_EC_COMPRESSED);
+        out.pubkey.Set(pub, pub + publen);
+    }
+    return true;
+}
+
 /* static */ bool CPubKey::CheckLowS(const std::vector<unsigned char>& vchSig) {
     secp256k1_ecdsa_signature sig;
     if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, &vchSig[0], vchSig.size())) {
@@ -218,6 +218,8 @@ struct CExtPubKey {
     void Encode(unsigned char code[BIP32_EXTKEY_SIZE]) const;
     void Decode(const unsigned char code[BIP32_EXTKEY_SIZE]);
     bool Derive(CExtPubKey& out, unsigned int nChild) const;
+    //! Derive the children nFirstChild up to nFirstChild+nCount into vOut, in order; the work that only depends on the parent is done once for all of them.
+    bool DeriveRange(std::vector<CExtPubKey>& vOut, unsigned int nFirstChild, unsigned int nCount) const;
 
     void Serialize(CSizeComputer& s) const
     {
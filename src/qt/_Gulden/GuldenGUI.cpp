@@ -13,6 +13,7 @@
 #include "clickablelabel.h"
 #include "receivecoinsdialog.h"
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 #include "validation/witnessvalidation.h"
 #include "guiutil.h"
 #include "init.h"
@@ -310,7 +311,8 @@ void GUI::requestRenewWitness(CAccount* funderAccount)
 
     CAccount* targetWitnessAccount = pactiveWallet->getActiveAccount();
 
-    if (!chainActive.Tip() || (IsArgSet("-testnet") && chainActive.Tip()->nHeight < 100) || (!IsArgSet("-testnet") && chainActive.Tip()->nHeight < 797000))
+    int nTipHeight = GetChainStatus()->nHeight;
+    if (nTipHeight < 0 || (IsArgSet("-testnet") && nTipHeight < 100) || (!IsArgSet("-testnet") && nTipHeight < 797000))
     {
         QString message = tr("This feature is not yet available, please try again after block 797000.");
         QDialog* d = createDialog(this, message, tr("Okay"), QString(""), 400, 180);
@@ -12,6 +12,7 @@
 #include <Gulden/mnemonic.h>
 #include <vector>
 #include "random.h"
+#include "metrics.h"
 #include "walletmodel.h"
 #include "clientmodel.h"
 #include "wallet/wallet.h"
@@ -36,6 +37,7 @@
 #include "transactiontablemodel.h"
 #include "transactionrecord.h"
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 #include "validation/witnessvalidation.h"
 
 #include "Gulden/util.h"
@@ -448,79 +450,46 @@ void WitnessDialog::GetWitnessInfoForAccount(CAccount* forAccount, WitnessInfoFo
     std::map<double, CAmount> pointMapForecast; pointMapForecast[0] = 0;
     std::map<double, CAmount> pointMapGenerated;
 
-    CTxOutPoW2Witness witnessDetails;
+    uint64_t nLockUntilBlock = 0;
 
     // fixme: (2.1) Make this work for multiple 'origin' blocks.
-    // Iterate the transaction history and extract all 'origin' block details.
-    // Also extract details for every witness reward we have received.
-    filter->setAccountFilter(forAccount);
-    int rows = filter->rowCount();
-    for (int row = 0; row < rows; ++row)
+    // The 'origin' block details and every witness reward we have received come from the witness history the wallet keeps for the account.
+    CWitnessAccountHistory history;
     {
-        QModelIndex index = filter->index(row, 0);
+        LOCK2(cs_main, pactiveWallet->cs_wallet);
+        pactiveWallet->GetWitnessAccountHistory(forAccount, history);
+    }
+    if (const CWitnessAccountEvent* origin = history.GetOrigin())
+    {
+        infoForAccount.originDate = QDateTime::fromTime_t(origin->nTime);
+        infoForAccount.nOriginBlock = origin->nHeight;
 
-        int nDepth = filter->data(index, TransactionTableModel::DepthRole).toInt();
-        if ( nDepth > 0 )
+        // We take the network weight 100 blocks ahead to give a chance for our own weight to filter into things (and also if e.g. the first time witnessing activated - testnet - then weight will only climb once other people also join)
+        CBlockIndex* sampleWeightIndex = chainActive[infoForAccount.nOriginBlock+100 > (uint64_t)chainActive.Tip()->nHeight ? infoForAccount.nOriginBlock : infoForAccount.nOriginBlock+100];
+        int64_t nUnused1;
+        if (!GetPow2NetworkWeight(sampleWeightIndex, Params(), nUnused1, infoForAccount.nOriginNetworkWeight, chainActive))
         {
-            int nType = filter->data(index, TransactionTableModel::TypeRole).toInt();
-            if ( (nType >= TransactionRecord::WitnessFundRecv) )
-            {
-                //fixme (2.1) - (multiple witnesses in single account etc.)
-                if (infoForAccount.nOriginBlock == 0)
-                {
-                    infoForAccount.originDate = filter->data(index, TransactionTableModel::DateRole).toDateTime();
-                    infoForAccount.nOriginBlock = filter->data(index, TransactionTableModel::TxBlockHeightRole).toInt();
-
-                    // We take the network weight 100 blocks ahead to give a chance for our own weight to filter into things (and also if e.g. the first time witnessing activated - testnet - then weight will only climb once other people also join)
-                    CBlockIndex* sampleWeightIndex = chainActive[infoForAccount.nOriginBlock+100 > (uint64_t)chainActive.Tip()->nHeight ? infoForAccount.nOriginBlock : infoForAccount.nOriginBlock+100];
-                    int64_t nUnused1;
-                    if (!GetPow2NetworkWeight(sampleWeightIndex, Params(), nUnused1, infoForAccount.nOriginNetworkWeight, chainActive))
-                    {
-                        std::string strErrorMessage = "Error in witness dialog, failed to get weight for account";
-                        CAlert::Notify(strErrorMessage, true, true);
-                        LogPrintf("%s", strErrorMessage.c_str());
-                        return;
-                    }
-                    pointMapGenerated[0] = 0;
+            std::string strErrorMessage = "Error in witness dialog, failed to get weight for account";
+            CAlert::Notify(strErrorMessage, true, true);
+            LogPrintf("%s", strErrorMessage.c_str());
+            return;
+        }
+        pointMapGenerated[0] = 0;
 
-                    uint256 originHash;
-                    originHash.SetHex( filter->data(index, TransactionTableModel::TxHashRole).toString().toStdString());
+        infoForAccount.nOriginLength = origin->nLockLength;
+        infoForAccount.nOriginWeight = GetPoW2RawWeightForAmount(origin->nAmount, infoForAccount.nOriginLength);
+        nLockUntilBlock = origin->nLockUntilBlock;
 
-                    LOCK2(cs_main, pactiveWallet->cs_wallet);
-                    auto walletTxIter = pactiveWallet->mapWallet.find(originHash);
-                    if(walletTxIter == pactiveWallet->mapWallet.end())
-                    {
-                        return;
-                    }
-
-                    for (unsigned int i=0; i<walletTxIter->second.tx->vout.size(); ++i)
-                    {
-                        //fixme: (2.1) Handle multiple in one tx. Handle regular transactions that may have somehow been sent to the account.
-                        if (IsMine(*forAccount, walletTxIter->second.tx->vout[i]))
-                        {
-                            if (GetPow2WitnessOutput(walletTxIter->second.tx->vout[i], witnessDetails))
-                            {
-                                uint64_t nUnused1, nUnused2;
-                                infoForAccount.nOriginLength = GetPoW2LockLengthInBlocksFromOutput(walletTxIter->second.tx->vout[i], infoForAccount.nOriginBlock, nUnused1, nUnused2);
-                                infoForAccount.nOriginWeight = GetPoW2RawWeightForAmount(filter->data(index, TransactionTableModel::AmountRole).toLongLong(), infoForAccount.nOriginLength);
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
-            else if (nType == TransactionRecord::GeneratedWitness)
-            {
-                int nX = filter->data(index, TransactionTableModel::TxBlockHeightRole).toInt();
-                if (nX > 0)
-                {
-                    infoForAccount.lastEarningsDate = filter->data(index, TransactionTableModel::DateRole).toDateTime();
-                    uint64_t nY = filter->data(index, TransactionTableModel::AmountRole).toLongLong()/COIN;
-                    infoForAccount.nEarningsToDate += nY;
-                    uint64_t nDays = infoForAccount.originDate.daysTo(infoForAccount.lastEarningsDate);
-                    AddPointToMapWithAdjustedTimePeriod(pointMapGenerated, infoForAccount.nOriginBlock, nX, nY, nDays, infoForAccount.scale, true);
-                }
-            }
+        for (const CWitnessAccountEvent& event : history.vEvents)
+        {
+            if (event.type != CWitnessAccountEvent::Reward || event.nHeight <= 0)
+                continue;
+            int nX = event.nHeight;
+            infoForAccount.lastEarningsDate = QDateTime::fromTime_t(event.nTime);
+            uint64_t nY = event.nAmount/COIN;
+            infoForAccount.nEarningsToDate += nY;
+            uint64_t nDays = infoForAccount.originDate.daysTo(infoForAccount.lastEarningsDate);
+            AddPointToMapWithAdjustedTimePeriod(pointMapGenerated, infoForAccount.nOriginBlock, nX, nY, nDays, infoForAccount.scale, true);
         }
     }
 
@@ -588,7 +557,7 @@ void WitnessDialog::GetWitnessInfoForAccount(CAccount* forAccount, WitnessInfoFo
 
     infoForAccount.nExpectedWitnessBlockPeriod = expectedWitnessBlockPeriod(infoForAccount.nOurWeight, infoForAccount.nTotalNetworkWeightTip);
     infoForAccount.nEstimatedWitnessBlockPeriod = estimatedWitnessBlockPeriod(infoForAccount.nOurWeight, infoForAccount.nTotalNetworkWeightTip);
-    infoForAccount.nLockBlocksRemaining = GetPoW2RemainingLockLengthInBlocks(witnessDetails.lockUntilBlock, chainActive.Tip()->nHeight);
+    infoForAccount.nLockBlocksRemaining = GetPoW2RemainingLockLengthInBlocks(nLockUntilBlock, chainActive.Tip()->nHeight);
 
     return;
 }
@@ -715,7 +684,7 @@ void WitnessDialog::update()
 void WitnessDialog::doUpdate(bool forceUpdate)
 {
     // rate limit this expensive UI update when chain tip is still far from known height
-    int heightRemaining = clientModel->cachedProbableHeight - chainActive.Height();
+    int heightRemaining = clientModel->cachedProbableHeight - clientModel->getNumBlocks();
     if (!forceUpdate && heightRemaining > 10 && heightRemaining % 100 != 0)
         return;
 
@@ -724,7 +693,7 @@ void WitnessDialog::doUpdate(bool forceUpdate)
     DO_BENCHMARK("WIT: WitnessDialog::update", BCLog::BENCH|BCLog::WITNESS);
 
     // If SegSig is enabled then allow possibility of witness compounding.
-    ui->compoundEarningsCheckBox->setVisible(IsSegSigEnabled(chainActive.TipPrev()));
+    ui->compoundEarningsCheckBox->setVisible(GetChainStatus()->fSegSigEnabled);
 
     static WitnessDialogStates cachedIndex = WitnessDialogStates::EMPTY;
     static CAccount* cachedIndexForAccount = nullptr;
@@ -999,7 +968,7 @@ void WitnessDialog::updateAccountIndicators()
         return;
     
     // Don't do this during initial block sync i - it can be very slow on a wallet with lots of transactions.
-    if (IsInitialBlockDownload())
+    if (GetChainStatus()->fInitialBlockDownload)
         return;
 
     //Don't update for every single block change if we are on testnet and have them streaming in at a super fast speed.
@@ -22,6 +22,7 @@
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 #include "net.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -85,20 +86,16 @@ int ClientModel::getNumConnections(unsigned int flags) const
 
 int ClientModel::getNumBlocks() const
 {
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainStatus()->nHeight;
 }
 
 int ClientModel::getHeaderTipHeight() const
 {
     if (cachedBestHeaderHeight == -1) {
-        // make sure we initially populate the cache via a cs_main lock
-        // otherwise we need to wait for a tip update
-        LOCK(cs_main);
-        if (pindexBestHeader) {
-            cachedBestHeaderHeight = pindexBestHeader->nHeight;
-            cachedBestHeaderTime = pindexBestHeader->GetBlockTime();
-        }
+        // populate the cache from the published chain status, otherwise we need to wait for a tip update
+        std::shared_ptr<const CChainStatus> status = GetChainStatus();
+        cachedBestHeaderHeight = status->nHeaderHeight;
+        cachedBestHeaderTime = status->nHeaderTime;
     }
     return cachedBestHeaderHeight;
 }
@@ -106,11 +103,9 @@ int ClientModel::getHeaderTipHeight() const
 int64_t ClientModel::getHeaderTipTime() const
 {
     if (cachedBestHeaderTime == -1) {
-        LOCK(cs_main);
-        if (pindexBestHeader) {
-            cachedBestHeaderHeight = pindexBestHeader->nHeight;
-            cachedBestHeaderTime = pindexBestHeader->GetBlockTime();
-        }
+        std::shared_ptr<const CChainStatus> status = GetChainStatus();
+        cachedBestHeaderHeight = status->nHeaderHeight;
+        cachedBestHeaderTime = status->nHeaderTime;
     }
     return cachedBestHeaderTime;
 }
@@ -136,10 +131,9 @@ quint64 ClientModel::getTotalBytesSent() const
 
 QDateTime ClientModel::getLastBlockDate() const
 {
-    LOCK(cs_main);
-
-    if (chainActive.Tip())
-        return QDateTime::fromTime_t(chainActive.Tip()->GetBlockTime());
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    if (status->nHeight >= 0)
+        return QDateTime::fromTime_t(status->nTipTime);
 
     return QDateTime::fromTime_t(Params().GenesisBlock().GetBlockTime()); // Genesis block's time of current network
 }
@@ -156,13 +150,9 @@ size_t ClientModel::getMempoolDynamicUsage() const
 
 double ClientModel::getVerificationProgress(const CBlockIndex *tipIn) const
 {
-    CBlockIndex *tip = const_cast<CBlockIndex *>(tipIn);
-    if (!tip)
-    {
-        LOCK(cs_main);
-        tip = chainActive.Tip();
-    }
-    return GuessVerificationProgress(Params().TxData(), tip);
+    if (!tipIn)
+        return GetChainStatus()->dVerificationProgress;
+    return GuessVerificationProgress(Params().TxData(), const_cast<CBlockIndex *>(tipIn));
 }
 
 void ClientModel::updateTimer()
@@ -206,7 +196,7 @@ void ClientModel::updateUIAlert(const QString& alertMessage)
 
 bool ClientModel::inInitialBlockDownload() const
 {
-    return IsInitialBlockDownload();
+    return GetChainStatus()->fInitialBlockDownload;
 }
 
 enum BlockSource ClientModel::getBlockSource() const
@@ -363,7 +353,7 @@ static void BlockTipChanged(ClientModel *clientmodel, bool initialSync, const CB
 void ClientModel::updatePoW2Display()
 {
     //fixme: (2.1) We can remove this for 2.1
-    cachedPoW2Phase = GetPoW2Phase(chainActive.Tip(), Params(), chainActive);
+    cachedPoW2Phase = GetChainStatus()->nPoW2Phase;
 }
 
 static void HeaderProgressChanged(ClientModel *clientmodel, int currentCount, int probableHeight, int headerTipHeight, int64_t headerTipTime)
@@ -51,6 +51,7 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "chain.h"
+#include "validation/chainstatus.h"
 
 #include <iostream>
 
@@ -1163,7 +1164,7 @@ void GUI::updateWindowTitle()
 
 
     if (IsArgSet("-testnet"))
-        windowTitle += QString(" (Current chain tip - %1)").arg(chainActive.Tip() ? chainActive.Tip()->nHeight : 0);
+        windowTitle += QString(" (Current chain tip - %1)").arg(std::max(GetChainStatus()->nHeight, 0));
 
     setWindowTitle(windowTitle);
 }
@@ -15,6 +15,9 @@
 /* Milliseconds between model updates */
 static const int MODEL_UPDATE_DELAY = 250;
 
+/* Transaction list -- wallet transactions to load into the model at a time */
+static const int TRANSACTION_TABLE_LOAD_CHUNK_SIZE = 500;
+
 /* AskPassphraseDialog -- Maximum passphrase length */
 static const int MAX_PASSPHRASE_SIZE = 1024;
 
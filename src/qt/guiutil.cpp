@@ -20,6 +20,7 @@
 #include "primitives/transaction.h"
 #include "init.h"
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 #include "policy/policy.h"
 #include "protocol.h"
 #include "script/script.h"
@@ -284,7 +285,7 @@ QString formatGuldenURI(const SendCoinsRecipient &info)
 bool isDust(const QString& addressString, const CAmount& amount)
 {
     CGuldenAddress address(addressString.toStdString());
-    if (IsSegSigEnabled(chainActive.TipPrev()))
+    if (GetChainStatus()->fSegSigEnabled)
     {
         CKeyID idPrimary;
         CKeyID idSecondary;
@@ -21,6 +21,7 @@
 
 #include "_Gulden/GuldenGUI.h"
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 
 SyncOverlay::SyncOverlay(QWidget *parent)
 : QWidget(parent)
@@ -96,7 +97,7 @@ void SyncOverlay::setKnownBestHeight(int count, const QDateTime& blockDate)
     if (doOnceOnly)
     {
         int messageChangeThreshold = IsArgSet("-testnet") ? 1000 : 5000;
-        if (chainActive.Tip() && chainActive.Tip()->nHeight > messageChangeThreshold)
+        if (GetChainStatus()->nHeight > messageChangeThreshold)
         {
             ui->infoText->setText(tr("<br/><br/><b>Notice</b><br/><br/>Your wallet is now synchronizing with the Gulden network.<br/>Once your wallet has finished synchronizing, your balance and recent transactions will be visible."));
         }
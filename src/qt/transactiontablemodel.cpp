@@ -32,6 +32,7 @@
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QTimer>
 
 #include <Gulden/util.h>
 
@@ -69,7 +70,9 @@ class TransactionTablePriv
 public:
     TransactionTablePriv(CWallet *_wallet, TransactionTableModel *_parent) :
         wallet(_wallet),
-        parent(_parent)
+        parent(_parent),
+        fAnyLoaded(false),
+        fFullyLoaded(false)
     {
     }
 
@@ -82,22 +85,66 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* The cache is filled a chunk at a time, in the order of the wallet; everything up to and including
+     * hashLoadedUpTo has been looked at.
+     */
+    uint256 hashLoadedUpTo;
+    bool fAnyLoaded;
+    bool fFullyLoaded;
+
+    /* Start filling the cache anew from core.
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
-        cachedWallet.clear();
+        if (!cachedWallet.isEmpty())
+        {
+            parent->beginResetModel();
+            cachedWallet.clear();
+            parent->endResetModel();
+        }
+        fAnyLoaded = false;
+        fFullyLoaded = false;
+        loadNextChunk();
+    }
+
+    /* Decompose the next TRANSACTION_TABLE_LOAD_CHUNK_SIZE wallet transactions into the cache; the locks are only
+     * held for one chunk, so neither the core nor the GUI has to wait for all of a large wallet at once.
+     */
+    void loadNextChunk()
+    {
+        if (fFullyLoaded)
+            return;
+
+        QList<TransactionRecord> toAppend;
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+            std::map<uint256, CWalletTx>::iterator it = fAnyLoaded ? wallet->mapWallet.upper_bound(hashLoadedUpTo) : wallet->mapWallet.begin();
+            for (int nCount = 0; it != wallet->mapWallet.end() && nCount < TRANSACTION_TABLE_LOAD_CHUNK_SIZE; ++it, ++nCount)
             {
                 if(TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                    toAppend.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                hashLoadedUpTo = it->first;
+                fAnyLoaded = true;
             }
+            fFullyLoaded = (it == wallet->mapWallet.end());
+        }
+        // Everything in this chunk sorts after what is loaded already.
+        if (!toAppend.isEmpty())
+        {
+            parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size() + toAppend.size() - 1);
+            cachedWallet.append(toAppend);
+            parent->endInsertRows();
         }
     }
 
+    /* Whether the cache has got as far as hash; updates beyond it are picked up when their chunk is loaded.
+     */
+    bool isLoaded(const uint256 &hash) const
+    {
+        return fFullyLoaded || (fAnyLoaded && !(hashLoadedUpTo < hash));
+    }
+
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
        with that of the core.
 
@@ -107,6 +154,9 @@ public:
     {
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
+        if (!isLoaded(hash))
+            return;
+
         // Find bounds of this transaction in model
         QList<TransactionRecord>::iterator lower = qLowerBound(
             cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
@@ -272,6 +322,9 @@ TransactionTableModel::TransactionTableModel(const QStyle *_platformStyle, CWall
 {
     columns << QString() << QString() << tr("Date") << tr("Type") << tr("Description") << tr("Received") << tr("Sent");
     priv->refreshWallet();
+    // Fill in the rest of a large wallet from the event loop, a chunk at a time, instead of freezing here.
+    if (!priv->fFullyLoaded)
+        QTimer::singleShot(0, this, SLOT(loadMoreTransactions()));
 
     if (walletModel->getOptionsModel())
         connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
@@ -300,6 +353,54 @@ void TransactionTableModel::updateTransaction(const QString &hash, int status, b
     priv->updateWallet(updated, status, showTransaction);
 }
 
+void TransactionTableModel::enqueueTransactionUpdate(const uint256 &hash, int status, bool showTransaction)
+{
+    bool fSchedule;
+    {
+        std::lock_guard<std::mutex> lock(csPendingUpdates);
+        fSchedule = vPendingUpdates.empty();
+        vPendingUpdates.push_back(PendingUpdate{hash, status, showTransaction});
+    }
+    // Only the first update of a batch posts an event, the rest ride along with it.
+    if (fSchedule)
+        QMetaObject::invokeMethod(this, "processPendingUpdates", Qt::QueuedConnection);
+}
+
+void TransactionTableModel::processPendingUpdates()
+{
+    std::vector<PendingUpdate> vUpdates;
+    {
+        std::lock_guard<std::mutex> lock(csPendingUpdates);
+        vUpdates.swap(vPendingUpdates);
+    }
+    if (vUpdates.empty())
+        return;
+    qDebug() << "TransactionTableModel::processPendingUpdates: " + QString::number(vUpdates.size());
+
+    LOCK2(cs_main, wallet->cs_wallet);
+    for (const PendingUpdate &update : vUpdates)
+        priv->updateWallet(update.hash, update.status, update.showTransaction);
+}
+
+void TransactionTableModel::loadMoreTransactions()
+{
+    priv->loadNextChunk();
+    if (!priv->fFullyLoaded)
+        QTimer::singleShot(0, this, SLOT(loadMoreTransactions()));
+}
+
+bool TransactionTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    (unused)parent;
+    return !priv->fFullyLoaded;
+}
+
+void TransactionTableModel::fetchMore(const QModelIndex &parent)
+{
+    (unused)parent;
+    priv->loadNextChunk();
+}
+
 void TransactionTableModel::updateConfirmations()
 {
     // Blocks came in since last poll.
@@ -1004,6 +1105,12 @@ public:
     TransactionNotification(uint256 _hash, ChangeType _status, bool _showTransaction):
         hash(_hash), status(_status), showTransaction(_showTransaction) {}
 
+    // Hand over to the next batch of updates, for notifications that nobody needs to see one at a time.
+    void enqueue(TransactionTableModel *ttm)
+    {
+        ttm->enqueueTransactionUpdate(hash, status, showTransaction);
+    }
+
     void invoke(QObject *ttm)
     {
         QString strHash = QString::fromStdString(hash.GetHex());
@@ -1022,22 +1129,25 @@ private:
 static bool fQueueNotifications = false;
 static std::vector< TransactionNotification > vQueueNotifications;
 
-static void NotifyTransactionChanged(TransactionTableModel *ttm, CWallet *wallet, const uint256 &hash, ChangeType status)
+static void NotifyTransactionsChanged(TransactionTableModel *ttm, CWallet *wallet, const std::vector<std::pair<uint256, ChangeType>>& vChanges)
 {
-    // Find transaction in wallet
-    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
-    // Determine whether to show transaction or not (determine this here so that no relocking is needed in GUI thread)
-    bool inWallet = mi != wallet->mapWallet.end();
-    bool showTransaction = (inWallet && TransactionRecord::showTransaction(mi->second));
+    for (const auto& [hash, status] : vChanges)
+    {
+        // Find transaction in wallet
+        std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+        // Determine whether to show transaction or not (determine this here so that no relocking is needed in GUI thread)
+        bool inWallet = mi != wallet->mapWallet.end();
+        bool showTransaction = (inWallet && TransactionRecord::showTransaction(mi->second));
 
-    TransactionNotification notification(hash, status, showTransaction);
+        TransactionNotification notification(hash, status, showTransaction);
 
-    if (fQueueNotifications)
-    {
-        vQueueNotifications.push_back(notification);
-        return;
+        if (fQueueNotifications)
+        {
+            vQueueNotifications.push_back(notification);
+            continue;
+        }
+        notification.enqueue(ttm);
     }
-    notification.invoke(ttm);
 }
 
 static void ShowProgress(TransactionTableModel *ttm, [[maybe_unused]] const std::string &title, int nProgress)
@@ -1053,9 +1163,15 @@ static void ShowProgress(TransactionTableModel *ttm, [[maybe_unused]] const std:
         for (unsigned int i = 0; i < vQueueNotifications.size(); ++i)
         {
             if (vQueueNotifications.size() - i <= 10)
+            {
                 QMetaObject::invokeMethod(ttm, "setProcessingQueuedTransactions", Qt::QueuedConnection, Q_ARG(bool, false));
-
-            vQueueNotifications[i].invoke(ttm);
+                vQueueNotifications[i].invoke(ttm);
+            }
+            else
+            {
+                // All but the last few go in a single batch, the model doesn't need to be told of them one by one.
+                vQueueNotifications[i].enqueue(ttm);
+            }
         }
         std::vector<TransactionNotification >().swap(vQueueNotifications); // clear
     }
@@ -1064,13 +1180,13 @@ static void ShowProgress(TransactionTableModel *ttm, [[maybe_unused]] const std:
 void TransactionTableModel::subscribeToCoreSignals()
 {
     // Connect signals to wallet
-    wallet->NotifyTransactionChanged.connect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
+    wallet->NotifyTransactionsChanged.connect(boost::bind(NotifyTransactionsChanged, this, _1, _2));
     wallet->ShowProgress.connect(boost::bind(ShowProgress, this, _1, _2));
 }
 
 void TransactionTableModel::unsubscribeFromCoreSignals()
 {
     // Disconnect signals from wallet
-    wallet->NotifyTransactionChanged.disconnect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
+    wallet->NotifyTransactionsChanged.disconnect(boost::bind(NotifyTransactionsChanged, this, _1, _2));
     wallet->ShowProgress.disconnect(boost::bind(ShowProgress, this, _1, _2));
 }
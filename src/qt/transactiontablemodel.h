@@ -13,10 +13,14 @@
 #define GULDEN_QT_TRANSACTIONTABLEMODEL_H
 
 #include "units.h"
+#include "uint256.h"
 
 #include <QAbstractTableModel>
 #include <QStringList>
 
+#include <mutex>
+#include <vector>
+
 class QStyle;
 class TransactionRecord;
 class TransactionTablePriv;
@@ -100,8 +104,12 @@ public:
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     QModelIndex index(int row, int column, const QModelIndex & parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
     bool processingQueuedTransactions() { return fProcessingQueuedTransactions; }
     void unsubscribeFromCoreSignals();
+    /** Thread safe; updates are applied together, from the event loop. */
+    void enqueueTransactionUpdate(const uint256 &hash, int status, bool showTransaction);
 
 private:
     CWallet* wallet;
@@ -111,6 +119,15 @@ private:
     bool fProcessingQueuedTransactions;
     const QStyle *platformStyle;
 
+    struct PendingUpdate
+    {
+        uint256 hash;
+        int status;
+        bool showTransaction;
+    };
+    std::mutex csPendingUpdates;
+    std::vector<PendingUpdate> vPendingUpdates;
+
     void subscribeToCoreSignals();
 
     QString lookupAddress(const std::string &address, bool tooltip) const;
@@ -136,6 +153,10 @@ public Q_SLOTS:
     void updateAmountColumnTitle();
     /* Needed to update fProcessingQueuedTransactions through a QueuedConnection */
     void setProcessingQueuedTransactions(bool value) { fProcessingQueuedTransactions = value; }
+    /* Apply the updates enqueued since the last call */
+    void processPendingUpdates();
+    /* Load the next chunk of a large wallet, and schedule the one after */
+    void loadMoreTransactions();
 
     friend class TransactionTablePriv;
 };
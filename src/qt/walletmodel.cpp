@@ -617,11 +617,10 @@ static void NotifyAddressBookChanged(WalletModel *walletmodel, [[maybe_unused]]
                               Q_ARG(int, status));
 }
 
-static void NotifyTransactionChanged(WalletModel *walletmodel, CWallet *wallet, const uint256 &hash, ChangeType status)
+static void NotifyTransactionsChanged(WalletModel *walletmodel, CWallet *wallet, const std::vector<std::pair<uint256, ChangeType>>& vChanges)
 {
     (unused)wallet;
-    (unused)hash;
-    (unused)status;
+    (unused)vChanges;
     QMetaObject::invokeMethod(walletmodel, "updateTransaction", Qt::QueuedConnection);
 }
 
@@ -710,7 +709,7 @@ void WalletModel::subscribeToCoreSignals()
         wallet->activeAccount->internalKeyStore.NotifyStatusChanged.connect(boost::bind(&NotifyKeyStoreStatusChanged, this, _1));
     }
     wallet->NotifyAddressBookChanged.connect(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5, _6));
-    wallet->NotifyTransactionChanged.connect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
+    wallet->NotifyTransactionsChanged.connect(boost::bind(NotifyTransactionsChanged, this, _1, _2));
     wallet->NotifyAccountNameChanged.connect(boost::bind(NotifyAccountNameChanged, this, _1, _2));
     wallet->NotifyAccountWarningChanged.connect(boost::bind(NotifyAccountWarningChanged, this, _1, _2));
     wallet->NotifyActiveAccountChanged.connect(boost::bind(NotifyActiveAccountChanged, this, _1, _2));
@@ -741,7 +740,7 @@ void WalletModel::unsubscribeFromCoreSignals()
 
         LogPrintf("WalletModel::~unsubscribeFromCoreSignals - disconnect wallet signals\n");
         wallet->NotifyAddressBookChanged.disconnect(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5, _6));
-        wallet->NotifyTransactionChanged.disconnect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
+        wallet->NotifyTransactionsChanged.disconnect(boost::bind(NotifyTransactionsChanged, this, _1, _2));
         wallet->NotifyAccountNameChanged.disconnect(boost::bind(NotifyAccountNameChanged, this, _1, _2));
         wallet->NotifyAccountWarningChanged.disconnect(boost::bind(NotifyAccountWarningChanged, this, _1, _2));
         wallet->NotifyActiveAccountChanged.disconnect(boost::bind(NotifyActiveAccountChanged, this, _1, _2));
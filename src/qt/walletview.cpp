@@ -31,6 +31,7 @@
 
 
 #include "ui_interface.h"
+#include "validation/chainstatus.h"
 
 #include <QAction>
 #include <QActionGroup>
@@ -206,7 +207,7 @@ void WalletView::setWalletModel(WalletModel *_walletModel)
         // Ask for passphrase if needed
         connect(_walletModel, SIGNAL(requireUnlock()), this, SLOT(unlockWallet()));
 
-        if (chainActive.Tip() && chainActive.TipPrev())
+        if (GetChainStatus()->nHeight > 0)
         {
             if (witnessDialogPage)
                 witnessDialogPage->updateAccountIndicators();
@@ -16,8 +16,14 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "validation/validation.h"
+#include "validation/addressindex.h"
+#include "validation/witnessvalidation.h"
+#include "Gulden/util.h"
+#include "base58.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "jsonwriter.h"
+#include "metrics.h"
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "streams.h"
@@ -231,23 +237,28 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    std::vector<unsigned char> vRawBlock;
     CBlockIndex* pblockindex = NULL;
     {
+        LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-        {
-            LOCK(cs_main); // Required for ReadBlockFromDisk.
-            if (!ReadBlockFromDisk(block, pblockindex, Params()))
-                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-        }
     }
+    // Read without cs_main, so that block processing doesn't wait for the disk.
+    // Without extra serialisation flags the binary and hex formats are the block as it is stored, which saves a deserialise/serialise round trip.
+    bool fRawBlock = (rf == RF_BINARY || rf == RF_HEX) && RPCSerializationFlags() == 0 && ReadRawBlockFromDisk(vRawBlock, pblockindex, Params());
+    if (!fRawBlock && !ReadBlockFromDisk(block, pblockindex, Params()))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (!vRawBlock.empty())
+        ssBlock.write((const char*)vRawBlock.data(), vRawBlock.size());
+    else
+        ssBlock << block;
 
     switch (rf)
     {
@@ -266,10 +277,14 @@ static bool rest_block(HTTPRequest* req,
         }
 
         case RF_JSON: {
-            UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-            std::string strJSON = objBlock.write() + "\n";
+            // Straight into the reply, a big block never exists as one UniValue or string.
             req->WriteHeader("Content-Type", "application/json");
-            req->WriteReply(HTTP_OK, strJSON);
+            {
+                CJSONWriter writer([req](const char* pData, size_t nSize) { req->WriteReplyPart(pData, nSize); });
+                LOCK(cs_main);
+                blockToJSON(block, pblockindex, showTxDetails, writer);
+            }
+            req->WriteReply(HTTP_OK, "\n");
             return true;
         }
 
@@ -431,6 +446,297 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_address(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 1 && path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/address/<address>.<ext> or /rest/address/<address>/<skip>/<count>.<ext>.");
+    if (!g_addressindex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled");
+
+    CGuldenAddress address(path[0]);
+    uint160 hashScript;
+    if (!address.IsValid() || !GetAddressIndexScriptHash(address.Get(), hashScript))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + path[0]);
+
+    long nSkip = 0;
+    long nCount = DEFAULT_ADDRESS_HISTORY_COUNT;
+    if (path.size() == 3)
+    {
+        nSkip = strtol(path[1].c_str(), NULL, 10);
+        nCount = strtol(path[2].c_str(), NULL, 10);
+        if (nSkip < 0 || nCount < 0 || nCount > MAX_ADDRESS_HISTORY_COUNT)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Skip or count out of range");
+    }
+
+    switch (rf)
+    {
+        case RF_JSON: {
+            g_addressindex->BlockUntilSynced();
+            CAddressIndexSummary summary;
+            std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>> entries;
+            if (!g_addressindex->GetSummary(hashScript, summary) || !g_addressindex->GetHistory(hashScript, nSkip, nCount, entries))
+                return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read from the address index");
+            UniValue objAddress = addressSummaryToJSON(summary);
+            objAddress.push_back(Pair("synced", g_addressindex->IsSynced()));
+            objAddress.push_back(Pair("history", addressHistoryToJSON(entries)));
+            std::string strJSON = objAddress.write() + "\n";
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strJSON);
+            return true;
+        }
+        case RF_UNDEF: case RF_BINARY: case RF_HEX:
+        default: {
+            return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+        }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+/** What the witness set says about one witness output; the entries of witness_address_list of getwitnessinfo. */
+struct CWitnessAddressState
+{
+    COutPoint outpoint;
+    std::string strAddress;
+    CAmount nValue = 0;
+    uint64_t nAge = 0;
+    uint64_t nRawWeight = 0;
+    uint64_t nAdjustedWeight = 0;
+    uint64_t nAdjustedWeightFinal = 0;
+    uint64_t nExpectedWitnessPeriod = 0;
+    uint64_t nEstimatedWitnessPeriod = 0;
+    uint64_t nLastActiveBlock = 0;
+    uint64_t nLockFromBlock = 0;
+    uint64_t nLockUntilBlock = 0;
+    uint64_t nLockPeriod = 0;
+    bool fLockPeriodExpired = false;
+    bool fEligible = false;
+    bool fExpired = false;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        // COutPoint only has the transaction encodings, which depend on the input.
+        uint256 hashTx = outpoint.getHash();
+        uint32_t nOut = outpoint.n;
+        READWRITE(hashTx);
+        READWRITE(nOut);
+        if (ser_action.ForRead())
+            outpoint = COutPoint(hashTx, nOut);
+        READWRITE(strAddress);
+        READWRITE(nValue);
+        READWRITE(nAge);
+        READWRITE(nRawWeight);
+        READWRITE(nAdjustedWeight);
+        READWRITE(nAdjustedWeightFinal);
+        READWRITE(nExpectedWitnessPeriod);
+        READWRITE(nEstimatedWitnessPeriod);
+        READWRITE(nLastActiveBlock);
+        READWRITE(nLockFromBlock);
+        READWRITE(nLockUntilBlock);
+        READWRITE(nLockPeriod);
+        READWRITE(fLockPeriodExpired);
+        READWRITE(fEligible);
+        READWRITE(fExpired);
+    }
+};
+
+// The witness set of the latest prepared selection pool (see CWitnessPoolPrecompute), restricted to the outputs of forAddress if given.
+static void GetWitnessAddressStates(const CGetWitnessInfo& witnessInfo, uint64_t nTipHeight, const CTxDestination* forAddress, std::vector<CWitnessAddressState>& states)
+{
+    std::map<COutPoint, const RouletteItem*> filteredPool;
+    for (const auto& item : witnessInfo.witnessSelectionPoolFiltered)
+        filteredPool.emplace(item.outpoint, &item);
+    std::map<COutPoint, const RouletteItem*> unfilteredPool;
+    for (const auto& item : witnessInfo.witnessSelectionPoolUnfiltered)
+        unfilteredPool.emplace(item.outpoint, &item);
+
+    for (const auto& [outpoint, coin] : witnessInfo.allWitnessCoins)
+    {
+        CTxDestination address;
+        if (!ExtractDestination(coin.out, address) || (forAddress && !(address == *forAddress)))
+            continue;
+
+        CWitnessAddressState state;
+        state.outpoint = outpoint;
+        state.strAddress = CGuldenAddress(address).ToString();
+        state.nValue = coin.out.nValue;
+        state.nLastActiveBlock = coin.nHeight;
+        state.nAge = nTipHeight - coin.nHeight;
+        state.nLockPeriod = GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, state.nLockFromBlock, state.nLockUntilBlock);
+        state.nRawWeight = GetPoW2RawWeightForAmount(coin.out.nValue, state.nLockPeriod);
+        state.nAdjustedWeight = std::min(state.nRawWeight, witnessInfo.nMaxIndividualWeight);
+        state.nExpectedWitnessPeriod = expectedWitnessBlockPeriod(state.nRawWeight, witnessInfo.nTotalWeightRaw);
+        state.nEstimatedWitnessPeriod = estimatedWitnessBlockPeriod(state.nRawWeight, witnessInfo.nTotalWeightRaw);
+        state.fLockPeriodExpired = (GetPoW2RemainingLockLengthInBlocks(state.nLockUntilBlock, nTipHeight) == 0);
+        auto poolIter = filteredPool.find(outpoint);
+        if (poolIter != filteredPool.end() && poolIter->second->coin.out == coin.out)
+        {
+            state.nAdjustedWeightFinal = poolIter->second->nWeight;
+            state.fEligible = true;
+        }
+        poolIter = unfilteredPool.find(outpoint);
+        if (poolIter != unfilteredPool.end() && poolIter->second->coin.out == coin.out)
+            state.fExpired = witnessHasExpired(poolIter->second->nAge, poolIter->second->nWeight, witnessInfo.nTotalWeightRaw);
+        states.push_back(state);
+    }
+}
+
+static UniValue WitnessNetworkWeightToJSON(const CWitnessNetworkWeight& weight)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blockhash", weight.hashBlock.GetHex()));
+    obj.push_back(Pair("height", weight.nHeight));
+    obj.push_back(Pair("number_of_witnesses_raw", weight.nWitnesses));
+    obj.push_back(Pair("number_of_witnesses_eligible", weight.nEligibleWitnesses));
+    obj.push_back(Pair("total_witness_weight_raw", weight.nTotalWeightRaw));
+    obj.push_back(Pair("total_witness_weight_eligible_raw", weight.nTotalWeightEligibleRaw));
+    obj.push_back(Pair("total_witness_weight_eligible_adjusted", weight.nTotalWeightEligibleAdjusted));
+    return obj;
+}
+
+static UniValue WitnessAddressStatesToJSON(const CWitnessNetworkWeight& tipWeight, const std::vector<CWitnessAddressState>& states)
+{
+    UniValue obj = WitnessNetworkWeightToJSON(tipWeight);
+    UniValue list(UniValue::VARR);
+    for (const CWitnessAddressState& state : states)
+    {
+        UniValue rec(UniValue::VOBJ);
+        rec.push_back(Pair("txid", state.outpoint.getHash().GetHex()));
+        rec.push_back(Pair("vout", (uint64_t)state.outpoint.n));
+        rec.push_back(Pair("address", state.strAddress));
+        rec.push_back(Pair("age", state.nAge));
+        rec.push_back(Pair("amount", ValueFromAmount(state.nValue)));
+        rec.push_back(Pair("raw_weight", state.nRawWeight));
+        rec.push_back(Pair("adjusted_weight", state.nAdjustedWeight));
+        rec.push_back(Pair("adjusted_weight_final", state.nAdjustedWeightFinal));
+        rec.push_back(Pair("expected_witness_period", state.nExpectedWitnessPeriod));
+        rec.push_back(Pair("estimated_witness_period", state.nEstimatedWitnessPeriod));
+        rec.push_back(Pair("last_active_block", state.nLastActiveBlock));
+        rec.push_back(Pair("lock_from_block", state.nLockFromBlock));
+        rec.push_back(Pair("lock_until_block", state.nLockUntilBlock));
+        rec.push_back(Pair("lock_period", state.nLockPeriod));
+        rec.push_back(Pair("lock_period_expired", state.fLockPeriodExpired));
+        rec.push_back(Pair("eligible_to_witness", state.fEligible));
+        rec.push_back(Pair("expired_from_inactivity", state.fExpired));
+        list.push_back(rec);
+    }
+    obj.push_back(Pair("witness_address_list", list));
+    return obj;
+}
+
+// The witness endpoints answer in any of the formats, ssBinary is the reply in binary and toJSON makes the one in JSON.
+static bool RESTWriteWitnessReply(HTTPRequest* req, RetFormat rf, const CDataStream& ssBinary, const std::function<UniValue()>& toJSON)
+{
+    switch (rf)
+    {
+        case RF_BINARY: {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssBinary.str());
+            return true;
+        }
+        case RF_HEX: {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(ssBinary.begin(), ssBinary.end()) + "\n");
+            return true;
+        }
+        case RF_JSON: {
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, toJSON().write() + "\n");
+            return true;
+        }
+        case RF_UNDEF:
+        default: {
+            return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+        }
+    }
+}
+
+// The witness endpoints are served from the selection pool prepared for the tip, without taking cs_main.
+static bool rest_witness_set(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/witness/set.<ext>.");
+
+    CWitnessNetworkWeight tipWeight;
+    CWitnessPoolPrecompute::Pool pool = witnessPoolPrecompute.GetLatest(tipWeight);
+    if (!pool)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Witness information not available yet");
+    std::vector<CWitnessAddressState> states;
+    GetWitnessAddressStates(*pool, tipWeight.nHeight, nullptr, states);
+
+    CDataStream ssWitness(SER_NETWORK, PROTOCOL_VERSION);
+    ssWitness << tipWeight << COMPACTSIZEVECTOR(states);
+    return RESTWriteWitnessReply(req, rf, ssWitness, [&]() { return WitnessAddressStatesToJSON(tipWeight, states); });
+}
+
+static bool rest_witness_weights(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/witness/weights.<ext>.");
+
+    std::vector<CWitnessNetworkWeight> history = witnessPoolPrecompute.GetWeightHistory();
+    CDataStream ssWeights(SER_NETWORK, PROTOCOL_VERSION);
+    ssWeights << COMPACTSIZEVECTOR(history);
+    return RESTWriteWitnessReply(req, rf, ssWeights, [&]()
+    {
+        UniValue list(UniValue::VARR);
+        for (const CWitnessNetworkWeight& weight : history)
+            list.push_back(WitnessNetworkWeightToJSON(weight));
+        return list;
+    });
+}
+
+static bool rest_witness_address(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    CGuldenAddress address(param);
+    if (!address.IsValid())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + param);
+    CTxDestination destination = address.Get();
+
+    CWitnessNetworkWeight tipWeight;
+    CWitnessPoolPrecompute::Pool pool = witnessPoolPrecompute.GetLatest(tipWeight);
+    if (!pool)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Witness information not available yet");
+    std::vector<CWitnessAddressState> states;
+    GetWitnessAddressStates(*pool, tipWeight.nHeight, &destination, states);
+
+    CDataStream ssWitness(SER_NETWORK, PROTOCOL_VERSION);
+    ssWitness << tipWeight << COMPACTSIZEVECTOR(states);
+    return RESTWriteWitnessReply(req, rf, ssWitness, [&]() { return WitnessAddressStatesToJSON(tipWeight, states); });
+}
+
+static bool rest_metrics(HTTPRequest* req, [[maybe_unused]] const std::string& strURIPart)
+{
+    // For Prometheus and the like, which expect their text format regardless of any extension.
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, GetMetricsPrometheusText());
+    return true;
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -648,6 +954,11 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/address/", rest_address},
+      {"/rest/witness/set", rest_witness_set},
+      {"/rest/witness/weights", rest_witness_weights},
+      {"/rest/witness/address/", rest_witness_address},
+      {"/rest/metrics", rest_metrics},
 };
 
 bool StartREST()
@@ -16,13 +16,22 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "clientversion.h"
 #include "coins.h"
 #include "consensus/validation.h"
 #include "validation/validation.h"
+#include "validation/addressindex.h"
+#include "validation/blockfilterindex.h"
 #include "validation/versionbitsvalidation.h"
+#include "validation/witnessvalidation.h"
 #include "core_io.h"
+#include "executor.h"
+#include "fs.h"
+#include "Gulden/util.h"
+#include "jsonwriter.h"
 #include "policy/feerate.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
 #include "streams.h"
@@ -33,6 +42,7 @@
 #include "utilstrencodings.h"
 #include "hash.h"
 #include "versionbits.h"
+#include "base58.h"
 
 #include <stdint.h>
 
@@ -40,8 +50,9 @@
 
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
-#include <mutex>
 #include <condition_variable>
+#include <list>
+#include <mutex>
 
 struct CUpdatedBlock
 {
@@ -53,6 +64,15 @@ static std::mutex cs_blockchange;
 static std::condition_variable cond_blockchange;
 static CUpdatedBlock latestblock;
 
+/** A call waiting for the tip without holding a thread, see WaitForBlockChange. */
+struct CBlockChangeWaiter
+{
+    std::function<bool(const CUpdatedBlock&)> ready;
+    std::function<UniValue(const CUpdatedBlock&)> result;
+    std::shared_ptr<CRPCDeferredReply> deferred;
+};
+static std::list<CBlockChangeWaiter> listBlockChangeWaiters; // guarded by cs_blockchange
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 
 double GetDifficulty(const CBlockIndex* blockindex)
@@ -86,7 +106,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("witness_version", blockindex->nVersionPoW2Witness));
     result.push_back(Pair("witness_versionHex", strprintf("%08x", blockindex->nVersionPoW2Witness)));
     result.push_back(Pair("witness_time", (int64_t)blockindex->nTimePoW2Witness));
-    result.push_back(Pair("witness_merkleroot", blockindex->hashMerkleRootPoW2Witness.GetHex()));
+    result.push_back(Pair("witness_merkleroot", blockindex->GetHashMerkleRootPoW2Witness().GetHex()));
     result.push_back(Pair("nonce", (uint64_t)blockindex->nNonce));
     result.push_back(Pair("pre_nonce", (uint64_t)blockindex->nPreNonce));
     result.push_back(Pair("post_nonce", (uint64_t)blockindex->nPostNonce));
@@ -102,9 +122,9 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+// The fields of a block before and after its transactions, shared by both forms of blockToJSON.
+static void blockFieldsBeforeTxToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result)
 {
-    UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHashPoW2().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
@@ -121,20 +141,11 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("witness_version", blockindex->nVersionPoW2Witness));
     result.push_back(Pair("witness_versionHex", strprintf("%08x", blockindex->nVersionPoW2Witness)));
     result.push_back(Pair("witness_time", (int64_t)blockindex->nTimePoW2Witness));
-    result.push_back(Pair("witness_merkleroot", blockindex->hashMerkleRootPoW2Witness.GetHex()));
-    UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToUniv(*tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
+    result.push_back(Pair("witness_merkleroot", blockindex->GetHashMerkleRootPoW2Witness().GetHex()));
+}
+
+static void blockFieldsAfterTxToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result)
+{
     result.push_back(Pair("time", block.GetBlockTime()));
     result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
@@ -149,9 +160,46 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHashPoW2().GetHex()));
+}
+
+static UniValue txToBlockJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToUniv(tx, uint256(), objTx);
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    UniValue result(UniValue::VOBJ);
+    blockFieldsBeforeTxToJSON(block, blockindex, result);
+    UniValue txs(UniValue::VARR);
+    for(const auto& tx : block.vtx)
+        txs.push_back(txToBlockJSON(*tx, txDetails));
+    result.push_back(Pair("tx", txs));
+    blockFieldsAfterTxToJSON(block, blockindex, result);
     return result;
 }
 
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONWriter& writer)
+{
+    writer.BeginObject();
+    UniValue fields(UniValue::VOBJ);
+    blockFieldsBeforeTxToJSON(block, blockindex, fields);
+    writer.ObjectMembers(fields);
+    writer.Key("tx");
+    writer.BeginArray();
+    for(const auto& tx : block.vtx)
+        writer.Value(txToBlockJSON(*tx, txDetails));
+    writer.EndArray();
+    fields.setObject();
+    blockFieldsAfterTxToJSON(block, blockindex, fields);
+    writer.ObjectMembers(fields);
+    writer.EndObject();
+}
+
 static UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -188,12 +236,88 @@ static UniValue getbestblockhash(const JSONRPCRequest& request)
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
 {
-    if(pindex) {
+    std::list<CBlockChangeWaiter> listReady;
+    CUpdatedBlock block;
+    bool fRunning = IsRPCRunning();
+    {
         std::lock_guard<std::mutex> lock(cs_blockchange);
-        latestblock.hash = pindex->GetBlockHashPoW2();
-        latestblock.height = pindex->nHeight;
+        if (pindex) {
+            latestblock.hash = pindex->GetBlockHashPoW2();
+            latestblock.height = pindex->nHeight;
+        }
+        block = latestblock;
+        for (auto it = listBlockChangeWaiters.begin(); it != listBlockChangeWaiters.end();)
+        {
+            if (it->deferred->HasReplied())
+                it = listBlockChangeWaiters.erase(it);
+            else if (!fRunning || it->ready(block))
+                listReady.splice(listReady.end(), listBlockChangeWaiters, it++);
+            else
+                ++it;
+        }
     }
+    RPCTipCacheNewTip(pindex ? pindex->GetBlockHashPoW2() : uint256());
     cond_blockchange.notify_all();
+
+    // Work out the replies on RPC threads, not on the thread that connected the block.
+    for (CBlockChangeWaiter& waiter : listReady)
+    {
+        if (fRunning)
+            GetExecutor().Submit(EXECUTOR_RPC, [waiter, block]() { waiter.deferred->Reply(waiter.result(block)); });
+        else
+            waiter.deferred->Reply(waiter.result(block));
+    }
+}
+
+static CUpdatedBlock GetLatestBlock()
+{
+    std::lock_guard<std::mutex> lock(cs_blockchange);
+    return latestblock;
+}
+
+/**
+ * Wait for ready to hold for the tip (or the timeout in milliseconds to pass, 0 for none, or RPC to stop), then return result of the tip.
+ * Where the transport can defer the reply the wait doesn't hold the calling thread, the reply is sent from RPCNotifyBlockChange.
+ */
+static UniValue WaitForBlockChange(const JSONRPCRequest& request, int timeout, std::function<bool(const CUpdatedBlock&)> ready, std::function<UniValue(const CUpdatedBlock&)> result)
+{
+    CUpdatedBlock block;
+    {
+        std::unique_lock<std::mutex> lock(cs_blockchange);
+        if (!request.deferReply)
+        {
+            auto fDone = [&ready]{ return ready(latestblock) || !IsRPCRunning(); };
+            if (timeout)
+                cond_blockchange.wait_for(lock, std::chrono::milliseconds(timeout), fDone);
+            else
+                cond_blockchange.wait(lock, fDone);
+        }
+        block = latestblock;
+    }
+    if (!request.deferReply || ready(block) || !IsRPCRunning())
+        return result(block);
+
+    std::shared_ptr<CRPCDeferredReply> deferred = request.deferReply(timeout, [result]() { return result(GetLatestBlock()); });
+    {
+        std::lock_guard<std::mutex> lock(cs_blockchange);
+        block = latestblock;
+        if (!ready(block) && IsRPCRunning() && !deferred->HasReplied())
+        {
+            listBlockChangeWaiters.push_back(CBlockChangeWaiter{ready, result, deferred});
+            return NullUniValue;
+        }
+    }
+    // The tip got there meanwhile.
+    deferred->Reply(result(block));
+    return NullUniValue;
+}
+
+static UniValue UpdatedBlockToJSON(const CUpdatedBlock& block)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("hash", block.hash.GetHex()));
+    ret.push_back(Pair("height", block.height));
+    return ret;
 }
 
 static UniValue waitfornewblock(const JSONRPCRequest& request)
@@ -218,20 +342,8 @@ static UniValue waitfornewblock(const JSONRPCRequest& request)
     if (request.params.size() > 0)
         timeout = request.params[0].get_int();
 
-    CUpdatedBlock block;
-    {
-        std::unique_lock<std::mutex> lock(cs_blockchange);
-        block = latestblock;
-        if(timeout)
-            cond_blockchange.wait_for(lock, std::chrono::milliseconds(timeout), [&block]{return latestblock.height != block.height || latestblock.hash != block.hash || !IsRPCRunning(); });
-        else
-            cond_blockchange.wait(lock, [&block]{return latestblock.height != block.height || latestblock.hash != block.hash || !IsRPCRunning(); });
-        block = latestblock;
-    }
-    UniValue ret(UniValue::VOBJ);
-    ret.push_back(Pair("hash", block.hash.GetHex()));
-    ret.push_back(Pair("height", block.height));
-    return ret;
+    CUpdatedBlock startblock = GetLatestBlock();
+    return WaitForBlockChange(request, timeout, [startblock](const CUpdatedBlock& block){ return block.height != startblock.height || block.hash != startblock.hash; }, UpdatedBlockToJSON);
 }
 
 static UniValue waitforblock(const JSONRPCRequest& request)
@@ -260,20 +372,7 @@ static UniValue waitforblock(const JSONRPCRequest& request)
     if (request.params.size() > 1)
         timeout = request.params[1].get_int();
 
-    CUpdatedBlock block;
-    {
-        std::unique_lock<std::mutex> lock(cs_blockchange);
-        if(timeout)
-            cond_blockchange.wait_for(lock, std::chrono::milliseconds(timeout), [&hash]{return latestblock.hash == hash || !IsRPCRunning();});
-        else
-            cond_blockchange.wait(lock, [&hash]{return latestblock.hash == hash || !IsRPCRunning(); });
-        block = latestblock;
-    }
-
-    UniValue ret(UniValue::VOBJ);
-    ret.push_back(Pair("hash", block.hash.GetHex()));
-    ret.push_back(Pair("height", block.height));
-    return ret;
+    return WaitForBlockChange(request, timeout, [hash](const CUpdatedBlock& block){ return block.hash == hash; }, UpdatedBlockToJSON);
 }
 
 static UniValue waitforblockheight(const JSONRPCRequest& request)
@@ -303,19 +402,54 @@ static UniValue waitforblockheight(const JSONRPCRequest& request)
     if (request.params.size() > 1)
         timeout = request.params[1].get_int();
 
-    CUpdatedBlock block;
+    return WaitForBlockChange(request, timeout, [height](const CUpdatedBlock& block){ return block.height >= height; }, UpdatedBlockToJSON);
+}
+
+//! Identifies the block template of a tip and mempool state: the tip hash followed by the mempool update count.
+static std::string TemplateIdFor(const CUpdatedBlock& block)
+{
+    return block.hash.GetHex() + i64tostr(mempool.GetTransactionsUpdated());
+}
+
+static UniValue waitfortemplatechange(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "waitfortemplatechange ( \"templateid\" timeout )\n"
+            "\nLong poll for block template consumers: waits until a template built now would be built on a different tip than\n"
+            "the one of templateid and returns the id of the current template.\n"
+            "\nReturns straight away when templateid is left out or is already out of date (the tip or the mempool changed since).\n"
+            "On timeout it returns the current id too, which differs from templateid when only the mempool changed.\n"
+            "\nArguments:\n"
+            "1. \"templateid\" (string, optional) The id returned by the previous call.\n"
+            "2. timeout      (int, optional, default=60000) Time in milliseconds to wait for a change. 0 indicates no timeout.\n"
+            "\nResult:\n"
+            "{                           (json object)\n"
+            "  \"templateid\" : \"xxx\",   (string) The id of the current template, to pass to the next call\n"
+            "  \"hash\" : \"xxx\",         (string) The hash of the tip the template builds on\n"
+            "  \"height\" : n,           (int) The height of that tip\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("waitfortemplatechange", "")
+            + HelpExampleRpc("waitfortemplatechange", "\"templateid\", 60000")
+        );
+
+    int timeout = 60000;
+    if (request.params.size() > 1)
+        timeout = request.params[1].get_int();
+
+    auto result = [](const CUpdatedBlock& block)
     {
-        std::unique_lock<std::mutex> lock(cs_blockchange);
-        if(timeout)
-            cond_blockchange.wait_for(lock, std::chrono::milliseconds(timeout), [&height]{return latestblock.height >= height || !IsRPCRunning();});
-        else
-            cond_blockchange.wait(lock, [&height]{return latestblock.height >= height || !IsRPCRunning(); });
-        block = latestblock;
-    }
-    UniValue ret(UniValue::VOBJ);
-    ret.push_back(Pair("hash", block.hash.GetHex()));
-    ret.push_back(Pair("height", block.height));
-    return ret;
+        UniValue ret = UpdatedBlockToJSON(block);
+        ret.push_back(Pair("templateid", TemplateIdFor(block)));
+        return ret;
+    };
+    if (request.params.size() == 0 || request.params[0].get_str() != TemplateIdFor(GetLatestBlock()))
+        return result(GetLatestBlock());
+
+    // Only a new tip ends the wait early; mempool changes alone are picked up on timeout, so that busy mempools don't wake every poller.
+    uint256 hashTip = uint256S(request.params[0].get_str().substr(0, 64));
+    return WaitForBlockChange(request, timeout, [hashTip](const CUpdatedBlock& block){ return block.hash != hashTip; }, result);
 }
 
 static UniValue getdifficulty(const JSONRPCRequest& request)
@@ -740,8 +874,6 @@ static UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main); // Required for ReadBlockFromDisk.
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -753,15 +885,20 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mapBlockIndex[hash];
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
 
+    // Read without cs_main, so that block processing doesn't wait for the disk.
     if (!ReadBlockFromDisk(block, pblockindex, Params()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -778,9 +915,23 @@ static UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
+//! Shards of the UTXO set that GetUTXOStats goes through in parallel, by ranges of the first byte of the transaction hash (under 256).
+static const int UTXO_STATS_SHARDS = 16;
+
+/** What GetUTXOStats hashes the set into. */
+enum class CoinStatsHashType
+{
+    //! One hash over the whole set in order (hash_serialized_2); the only kind that can't be worked out in parallel.
+    HASH_SERIALIZED_2,
+    //! A hash over the hashes of the shards in order (hash_serialized_sharded).
+    SHARDED,
+    NONE,
+};
+
 struct CCoinsStats
 {
     int nHeight;
@@ -791,22 +942,45 @@ struct CCoinsStats
     uint256 hashSerialized;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
+    uint64_t nWitnessOutputs;
+    CAmount nWitnessAmount;
+    uint64_t nWitnessWeight;
     std::map<int, int> nTypeCount;
 
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0), nWitnessOutputs(0), nWitnessAmount(0), nWitnessWeight(0) {}
+
+    //! Add the counts of a shard.
+    void Merge(const CCoinsStats& other)
+    {
+        nTransactions += other.nTransactions;
+        nTransactionOutputs += other.nTransactionOutputs;
+        nBogoSize += other.nBogoSize;
+        nTotalAmount += other.nTotalAmount;
+        nWitnessOutputs += other.nWitnessOutputs;
+        nWitnessAmount += other.nWitnessAmount;
+        nWitnessWeight += other.nWitnessWeight;
+        for (const auto& item : other.nTypeCount)
+            nTypeCount[item.first] += item.second;
+    }
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+static void ApplyStats(CCoinsStats &stats, CHashWriter* ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    if (ss)
+    {
+        *ss << hash;
+        *ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    }
     stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        //fixme: (2.1) (SEGSIG)
-        ss << *(const CScriptBase*)(&output.second.out.output.scriptPubKey);
-        ss << VARINT(output.second.out.nValue);
+    for (const auto& output : outputs) {
+        if (ss)
+        {
+            *ss << VARINT(output.first + 1);
+            //fixme: (2.1) (SEGSIG)
+            *ss << *(const CScriptBase*)(&output.second.out.output.scriptPubKey);
+            *ss << VARINT(output.second.out.nValue);
+        }
         {
             std::vector<CTxDestination> addresses;
             txnouttype whichType;
@@ -819,22 +993,20 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
         stats.nTotalAmount += output.second.out.nValue;
         stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
                            2 /* scriptPubKey len */ + output.second.out.output.scriptPubKey.size() /* scriptPubKey */;
+        if (IsPow2WitnessOutput(output.second.out))
+        {
+            stats.nWitnessOutputs++;
+            stats.nWitnessAmount += output.second.out.nValue;
+            stats.nWitnessWeight += GetPoW2RawWeightForOutput(output.second.out, output.second.nHeight);
+        }
     }
-    ss << VARINT(0);
+    if (ss)
+        *ss << VARINT(0);
 }
 
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+//! Go through the coins of pcursor up to (not including) the first transaction with a hash that starts with a byte above nLastByte.
+static bool ApplyStatsCursor(CCoinsStats &stats, CHashWriter* ss, CCoinsViewCursor* pcursor, int nLastByte)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
     uint256 prevkey;
     std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
@@ -842,6 +1014,8 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         COutPoint key;
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (*key.getHash().begin() > nLastByte)
+                break;
             if (!outputs.empty() && key.getHash() != prevkey) {
                 ApplyStats(stats, ss, prevkey, outputs);
                 outputs.clear();
@@ -856,8 +1030,98 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
     if (!outputs.empty()) {
         ApplyStats(stats, ss, prevkey, outputs);
     }
-    stats.hashSerialized = ss.GetHash();
+    return true;
+}
+
+// The statistics of the set last worked out, per view and kind of hash; valid for as long as the view stays at the same block.
+static CCriticalSection cs_utxoStatsCache;
+static std::map<std::pair<const CCoinsViewDB*, CoinStatsHashType>, CCoinsStats> mapUTXOStatsCache;
+
+/**
+ * Calculate statistics about the unspent transaction output set (or the witness set). Unless hashing the whole set in order, the set is
+ * gone through in shards on the executor; the cursors of the shards are all made under cs_main, right after a flush, so they see the set
+ * at the same block. Results are kept until the view moves on to another block.
+ */
+static bool GetUTXOStats(CCoinsViewDB *view, CCoinsStats &stats, CoinStatsHashType hashType)
+{
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        const uint256 hashBest = view->GetBestBlock();
+        {
+            LOCK(cs_utxoStatsCache);
+            auto it = mapUTXOStatsCache.find(std::pair(view, hashType));
+            if (it != mapUTXOStatsCache.end() && it->second.hashBlock == hashBest)
+            {
+                stats = it->second;
+                stats.nDiskSize = view->EstimateSize();
+                return true;
+            }
+        }
+        if (hashType == CoinStatsHashType::HASH_SERIALIZED_2)
+        {
+            cursors.emplace_back(view->Cursor());
+        }
+        else
+        {
+            for (int nShard = 0; nShard < UTXO_STATS_SHARDS; ++nShard)
+            {
+                uint256 hashStart;
+                *hashStart.begin() = (unsigned char)(nShard * 256 / UTXO_STATS_SHARDS);
+                cursors.emplace_back(view->CursorFrom(hashStart));
+            }
+        }
+        stats = CCoinsStats();
+        stats.hashBlock = cursors[0]->GetBestBlock();
+        BlockMap::iterator mi = mapBlockIndex.find(stats.hashBlock);
+        if (mi == mapBlockIndex.end())
+            return error("%s: unable to find the block of the set", __func__);
+        stats.nHeight = mi->second->nHeight;
+    }
+
+    if (hashType == CoinStatsHashType::HASH_SERIALIZED_2)
+    {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << stats.hashBlock;
+        if (!ApplyStatsCursor(stats, &ss, cursors[0].get(), 255))
+            return false;
+        stats.hashSerialized = ss.GetHash();
+    }
+    else
+    {
+        std::vector<CCoinsStats> shardStats(cursors.size());
+        std::vector<uint256> shardHashes(cursors.size());
+        std::atomic<bool> fFailed(false);
+        CTaskGroup group(GetExecutor(), EXECUTOR_RPC);
+        for (size_t nShard = 0; nShard < cursors.size(); ++nShard)
+        {
+            group.Run([&, nShard]()
+            {
+                CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+                int nLastByte = (nShard + 1) * 256 / UTXO_STATS_SHARDS - 1;
+                if (!ApplyStatsCursor(shardStats[nShard], hashType == CoinStatsHashType::SHARDED ? &ss : nullptr, cursors[nShard].get(), nLastByte))
+                    fFailed = true;
+                shardHashes[nShard] = ss.GetHash();
+            });
+        }
+        group.Wait();
+        if (fFailed)
+            return false;
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << stats.hashBlock;
+        for (size_t nShard = 0; nShard < cursors.size(); ++nShard)
+        {
+            stats.Merge(shardStats[nShard]);
+            ss << shardHashes[nShard];
+        }
+        if (hashType == CoinStatsHashType::SHARDED)
+            stats.hashSerialized = ss.GetHash();
+    }
     stats.nDiskSize = view->EstimateSize();
+
+    LOCK(cs_utxoStatsCache);
+    mapUTXOStatsCache[std::pair(view, hashType)] = stats;
     return true;
 }
 
@@ -912,11 +1176,16 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
 
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" witness )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless the set hasn't changed since the last time; the results are kept until the next block.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"        (string, optional, default=hash_serialized_2) Which hash to work out: \"hash_serialized_2\", a hash over\n"
+            "                       the whole set in order; \"hash_serialized_sharded\", a hash over the hashes of shards of the set, which are\n"
+            "                       gone through in parallel; or \"none\", which is also done in parallel\n"
+            "2. witness            (boolean, optional, default=false) Returns the statistics of the witness set instead\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -924,28 +1193,52 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (or hash_serialized_sharded, as asked for)\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"witness_txouts\": n,    (numeric) The number of witness outputs\n"
+            "  \"witness_amount\": x.xxx (numeric) The amount locked in witness outputs\n"
+            "  \"witness_weight\": n,    (numeric) The raw weight of the witness outputs\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
-            + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"none\"")
+            + HelpExampleRpc("gettxoutsetinfo", "\"hash_serialized_sharded\", true")
         );
 
+    CoinStatsHashType hashType = CoinStatsHashType::HASH_SERIALIZED_2;
+    if (!request.params[0].isNull())
+    {
+        const std::string strHashType = request.params[0].get_str();
+        if (strHashType == "hash_serialized_sharded")
+            hashType = CoinStatsHashType::SHARDED;
+        else if (strHashType == "none")
+            hashType = CoinStatsHashType::NONE;
+        else if (strHashType != "hash_serialized_2")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+    }
+    CCoinsViewDB* view = pcoinsdbview;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        view = ppow2witdbview;
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview, stats)) {
+    if (GetUTXOStats(view, stats, hashType)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        if (hashType == CoinStatsHashType::HASH_SERIALIZED_2)
+            ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        else if (hashType == CoinStatsHashType::SHARDED)
+            ret.push_back(Pair("hash_serialized_sharded", stats.hashSerialized.GetHex()));
         ret.push_back(Pair("disk_size", stats.nDiskSize));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        ret.push_back(Pair("witness_txouts", (int64_t)stats.nWitnessOutputs));
+        ret.push_back(Pair("witness_amount", ValueFromAmount(stats.nWitnessAmount)));
+        ret.push_back(Pair("witness_weight", (int64_t)stats.nWitnessWeight));
         for (auto& item : stats.nTypeCount)
         {
             ret.push_back(Pair(GetTxnOutputType((txnouttype)item.first), item.second));
@@ -956,6 +1249,107 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+//! Magic bytes and version at the start of a dumptxoutset file
+static const unsigned char UTXO_SNAPSHOT_MAGIC[4] = {'g', 'u', 't', 'x'};
+static const uint32_t UTXO_SNAPSHOT_VERSION = 1;
+
+// Write all coins the cursor visits as (outpoint hash, index, coin) records, each preceded by a 1 and the section terminated by a 0; the records also go into the snapshot hash.
+static uint64_t WriteUTXOSnapshotSection(CCoinsViewCursor* pcursor, CAutoFile& file, CHashWriter& ss)
+{
+    uint64_t nCoins = 0;
+    while (pcursor->Valid())
+    {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read UTXO set");
+        //fixme: (2.1) (SEGSIG) - Implement handling of non-hash outpoints.
+        uint256 hash = key.getHash();
+        uint32_t n = key.n;
+        file << (uint8_t)1 << hash << VARINT(n) << coin;
+        ss << hash << VARINT(n) << coin;
+        ++nCoins;
+        pcursor->Next();
+    }
+    file << (uint8_t)0;
+    ss << nCoins;
+    return nCoins;
+}
+
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set and the witness set, as of the current chain tip, to a file.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) Path to the output file, relative paths are relative to the data directory. The file must not exist yet.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",         (string) The hash of the block the snapshot is of\n"
+            "  \"base_height\": n,            (numeric) The height of that block\n"
+            "  \"coins_written\": n,          (numeric) The number of coins in the snapshot\n"
+            "  \"witness_coins_written\": n,  (numeric) The number of witness coins in the snapshot\n"
+            "  \"snapshot_hash\": \"hex\",     (string) Hash over the contents of the snapshot\n"
+            "  \"path\": \"xxx\"              (string) The absolute path of the snapshot file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists.");
+    fs::path pathTemp = path.string() + ".incomplete";
+
+    // Both databases are flushed to the same block under cs_main, and a cursor iterates a consistent snapshot of its database; so the dump itself can go without the lock.
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::unique_ptr<CCoinsViewCursor> pcursorWitness;
+    uint256 hashBase;
+    int nBaseHeight;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        pcursorWitness.reset(ppow2witdbview->Cursor());
+        hashBase = pcursor->GetBestBlock();
+        if (pcursorWitness->GetBestBlock() != hashBase)
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Witness set is not at the same block as the UTXO set.");
+        BlockMap::iterator mi = mapBlockIndex.find(hashBase);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to find the block of the UTXO set.");
+        nBaseHeight = mi->second->nHeight;
+    }
+
+    CAutoFile file(fsbridge::fopen(pathTemp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Couldn't open " + pathTemp.string() + " for writing.");
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBase << nBaseHeight;
+    file << FLATDATA(UTXO_SNAPSHOT_MAGIC) << UTXO_SNAPSHOT_VERSION << hashBase << nBaseHeight;
+    uint64_t nCoins = WriteUTXOSnapshotSection(pcursor.get(), file, ss);
+    uint64_t nWitnessCoins = WriteUTXOSnapshotSection(pcursorWitness.get(), file, ss);
+    uint256 hashSnapshot = ss.GetHash();
+    file << hashSnapshot;
+    file.fclose();
+
+    if (!RenameOver(pathTemp, path))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to rename " + pathTemp.string() + " to " + path.string());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", hashBase.GetHex()));
+    ret.push_back(Pair("base_height", nBaseHeight));
+    ret.push_back(Pair("coins_written", nCoins));
+    ret.push_back(Pair("witness_coins_written", nWitnessCoins));
+    ret.push_back(Pair("snapshot_hash", hashSnapshot.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
 static UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1058,8 +1452,7 @@ static UniValue verifychain(const JSONRPCRequest& request)
             + HelpExampleRpc("verifychain", "")
         );
 
-    LOCK(cs_main);
-
+    // VerifyDB takes cs_main itself, between the batches of blocks it reads and checks in parallel.
     if (request.params.size() > 0)
         nCheckLevel = request.params[0].get_int();
     if (request.params.size() > 1)
@@ -1568,26 +1961,327 @@ static UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue getblockconnectstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getblockconnectstats ( count )\n"
+            "\nReturns the time spent in each phase of connecting the most recent blocks to the active chain, oldest first.\n"
+            "All times are in microseconds; the ConnectBlock phases add up to connect_block.\n"
+            "\nArguments:\n"
+            "1. count    (numeric, optional, default=" + std::to_string(BLOCK_CONNECT_STATS_HISTORY) + ") Number of blocks to return, at most " + std::to_string(BLOCK_CONNECT_STATS_HISTORY) + "\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\": n,             (numeric) Height of the block\n"
+            "    \"hash\": \"hash\",          (string) Hash of the block\n"
+            "    \"txs\": n,                (numeric) Number of transactions\n"
+            "    \"inputs\": n,             (numeric) Number of transaction inputs\n"
+            "    \"read\": n,               (numeric) Reading the block from disk (0 if it was still in memory)\n"
+            "    \"prefetch\": n,           (numeric) Prefetching the coins the block spends\n"
+            "    \"connect_block\": n,      (numeric) ConnectBlock in total\n"
+            "    \"check\": n,              (numeric) Sanity and contextual transaction checks\n"
+            "    \"forks\": n,              (numeric) BIP30 and soft fork checks\n"
+            "    \"witness_signature\": n,  (numeric) Witness header signature, including looking up the expected witness\n"
+            "    \"phase\": n,              (numeric) Determining the PoW2 phase of the parents\n"
+            "    \"witness_coinbase\": n,   (numeric) Validating the witness coinbase embedded in a phase 3 coinbase\n"
+            "    \"connect_txs\": n,        (numeric) Checking inputs and updating the coins of the transactions\n"
+            "    \"verify\": n,             (numeric) Reward checks, writing the undo data and waiting for the script checks\n"
+            "    \"index\": n,              (numeric) Updating the block index\n"
+            "    \"witness_flush\": n,      (numeric) Updating the witness set index\n"
+            "    \"flush\": n,              (numeric) Flushing the coins to the chain state cache\n"
+            "    \"chainstate\": n,         (numeric) Writing the chain state to disk, if needed\n"
+            "    \"postconnect\": n,        (numeric) Updating the mempool and the tip\n"
+            "    \"total\": n               (numeric) Everything above\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockconnectstats", "10")
+            + HelpExampleRpc("getblockconnectstats", "10")
+        );
+
+    int nCount = BLOCK_CONNECT_STATS_HISTORY;
+    if (!request.params[0].isNull())
+        nCount = request.params[0].get_int();
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count");
+
+    UniValue ret(UniValue::VARR);
+    for (const CBlockConnectStats& stats : GetBlockConnectStats(nCount))
+    {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("height", stats.nHeight));
+        entry.push_back(Pair("hash", stats.hash.GetHex()));
+        entry.push_back(Pair("txs", (uint64_t)stats.nTx));
+        entry.push_back(Pair("inputs", (uint64_t)stats.nInputs));
+        entry.push_back(Pair("read", stats.nReadMicros));
+        entry.push_back(Pair("prefetch", stats.nPrefetchMicros));
+        entry.push_back(Pair("connect_block", stats.nConnectBlockMicros));
+        entry.push_back(Pair("check", stats.nCheckMicros));
+        entry.push_back(Pair("forks", stats.nForksMicros));
+        entry.push_back(Pair("witness_signature", stats.nWitnessSigMicros));
+        entry.push_back(Pair("phase", stats.nPhaseMicros));
+        entry.push_back(Pair("witness_coinbase", stats.nWitnessCoinbaseMicros));
+        entry.push_back(Pair("connect_txs", stats.nTxMicros));
+        entry.push_back(Pair("verify", stats.nVerifyMicros));
+        entry.push_back(Pair("index", stats.nIndexMicros));
+        entry.push_back(Pair("witness_flush", stats.nWitnessFlushMicros));
+        entry.push_back(Pair("flush", stats.nFlushMicros));
+        entry.push_back(Pair("chainstate", stats.nChainStateMicros));
+        entry.push_back(Pair("postconnect", stats.nPostConnectMicros));
+        entry.push_back(Pair("total", stats.nTotalMicros));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+static UniValue getpowverifyinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getpowverifyinfo\n"
+            "\nReturns utilisation statistics for the pool of SIGMA contexts used to verify proof of work.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"contexts\": xxxxx,            (numeric) Number of verify contexts in the pool (-sigmaverifypool)\n"
+            "  \"threads_per_context\": xxxxx, (numeric) Number of argon threads used by each context\n"
+            "  \"busy\": xxxxx,                (numeric) Number of contexts currently verifying a header\n"
+            "  \"peak_busy\": xxxxx,           (numeric) Highest number of contexts that have been in use at the same time\n"
+            "  \"verified\": xxxxx,            (numeric) Number of headers verified through the pool\n"
+            "  \"waits\": xxxxx,               (numeric) Number of verifications that had to wait for a free context\n"
+            "  \"wait_time_us\": xxxxx,        (numeric) Total time in microseconds spent waiting for a free context\n"
+            "  \"full_verifies\": xxxxx,       (numeric) Number of headers that were verified fully\n"
+            "  \"partial_verifies\": xxxxx,    (numeric) Number of headers that were half verified because every context was busy (-sigmapartialverify)\n"
+            "  \"verify_cost_us\": xxxxx,      (numeric) Running average of the time a full verification takes in microseconds\n"
+            "  \"cache\": {                    (json object) Arena chunks and slow hashes kept for repeat verifications (-sigmaverifycache)\n"
+            "    \"chunks\": xxxxx,             (numeric) Number of arena chunks in the cache\n"
+            "    \"chunk_bytes\": xxxxx,        (numeric) Memory used by the cached arena chunks\n"
+            "    \"chunk_hits\": xxxxx,         (numeric) Number of arena chunks that did not have to be regenerated\n"
+            "    \"chunk_misses\": xxxxx,       (numeric) Number of arena chunks that had to be generated\n"
+            "    \"slow_hashes\": xxxxx,        (numeric) Number of slow hashes in the cache\n"
+            "    \"slow_hash_hits\": xxxxx,     (numeric) Number of slow hashes that did not have to be recalculated\n"
+            "    \"slow_hash_misses\": xxxxx    (numeric) Number of slow hashes that had to be calculated\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getpowverifyinfo", "")
+            + HelpExampleRpc("getpowverifyinfo", "")
+        );
+
+    SigmaVerifyPoolStats stats = GetSigmaVerifyPoolStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("contexts", stats.nContexts));
+    ret.push_back(Pair("threads_per_context", stats.nThreadsPerContext));
+    ret.push_back(Pair("busy", stats.nBusy));
+    ret.push_back(Pair("peak_busy", stats.nPeakBusy));
+    ret.push_back(Pair("verified", stats.nVerified));
+    ret.push_back(Pair("waits", stats.nWaits));
+    ret.push_back(Pair("wait_time_us", stats.nWaitTimeMicros));
+    ret.push_back(Pair("full_verifies", stats.nFullVerifies));
+    ret.push_back(Pair("partial_verifies", stats.nPartialVerifies));
+    ret.push_back(Pair("verify_cost_us", GetSigmaVerifyCostMicros()));
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("chunks", stats.cache.chunkEntries));
+    cache.push_back(Pair("chunk_bytes", stats.cache.chunkBytes));
+    cache.push_back(Pair("chunk_hits", stats.cache.chunkHits));
+    cache.push_back(Pair("chunk_misses", stats.cache.chunkMisses));
+    cache.push_back(Pair("slow_hashes", stats.cache.slowHashEntries));
+    cache.push_back(Pair("slow_hash_hits", stats.cache.slowHashHits));
+    cache.push_back(Pair("slow_hash_misses", stats.cache.slowHashMisses));
+    ret.push_back(Pair("cache", cache));
+    return ret;
+}
+
+UniValue addressSummaryToJSON(const CAddressIndexSummary& summary)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("balance", ValueFromAmount(summary.nBalance)));
+    ret.push_back(Pair("received", ValueFromAmount(summary.nReceived)));
+    ret.push_back(Pair("entries", summary.nEntries));
+    return ret;
+}
+
+UniValue addressHistoryToJSON(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>>& entries)
+{
+    UniValue ret(UniValue::VARR);
+    for (const auto& entry : entries)
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.first.txid.GetHex()));
+        obj.push_back(Pair("height", (int64_t)entry.first.nHeight));
+        obj.push_back(Pair(entry.first.fSpend ? "vin" : "vout", (int64_t)entry.first.nIndex));
+        obj.push_back(Pair("spend", entry.first.fSpend));
+        obj.push_back(Pair("amount", ValueFromAmount(entry.second.nValue)));
+        obj.push_back(Pair("witnesskey", entry.second.nRole == ADDRESS_INDEX_WITNESS_KEY));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static uint160 AddressIndexScriptHashFromParam(const UniValue& param)
+{
+    if (!g_addressindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, use -addressindex");
+    CGuldenAddress address(param.get_str());
+    uint160 hashScript;
+    if (!address.IsValid() || !GetAddressIndexScriptHash(address.Get(), hashScript))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    g_addressindex->BlockUntilSynced();
+    return hashScript;
+}
+
+static UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the balance of an address, from the address index (requires -addressindex).\n"
+            "For a witness address the balance of its spending key is returned, which includes the locked witness amount.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,   (numeric) Received minus spent, in " + CURRENCY_UNIT + "\n"
+            "  \"received\" : x.xxx,  (numeric) Total received, in " + CURRENCY_UNIT + "\n"
+            "  \"entries\" : n,       (numeric) Number of entries in the history of the address\n"
+            "  \"synced\" : true|false (boolean) Whether the index has caught up with the chain; if not the numbers only cover part of it\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"address\"")
+            + HelpExampleRpc("getaddressbalance", "\"address\"")
+        );
+
+    uint160 hashScript = AddressIndexScriptHashFromParam(request.params[0]);
+    CAddressIndexSummary summary;
+    if (!g_addressindex->GetSummary(hashScript, summary))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read from the address index");
+
+    UniValue ret = addressSummaryToJSON(summary);
+    ret.push_back(Pair("synced", g_addressindex->IsSynced()));
+    return ret;
+}
+
+static UniValue getaddresshistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddresshistory \"address\" ( skip count )\n"
+            "\nReturns the outputs received by and spent from an address, in the order of the chain, from the address index (requires -addressindex).\n"
+            "For a witness address the history of its spending key is returned; witness outputs also show up in the history of their witness key.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The address\n"
+            "2. skip         (numeric, optional, default=0) The number of entries to skip\n"
+            "3. count        (numeric, optional, default=" + std::to_string(DEFAULT_ADDRESS_HISTORY_COUNT) + ") The number of entries to return (at most " + std::to_string(MAX_ADDRESS_HISTORY_COUNT) + ")\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",      (string) The transaction\n"
+            "    \"height\" : n,         (numeric) The height of the block\n"
+            "    \"vout\"|\"vin\" : n,     (numeric) The output received, or the input that spends\n"
+            "    \"spend\" : true|false, (boolean) Whether this is a spend\n"
+            "    \"amount\" : x.xxx,     (numeric) The amount of the output in " + CURRENCY_UNIT + "\n"
+            "    \"witnesskey\" : true|false (boolean) Whether the address is only the witness key of the output, which doesn't count towards its balance\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresshistory", "\"address\" 100 100")
+            + HelpExampleRpc("getaddresshistory", "\"address\", 100, 100")
+        );
+
+    uint160 hashScript = AddressIndexScriptHashFromParam(request.params[0]);
+    int64_t nSkip = 0;
+    int64_t nCount = DEFAULT_ADDRESS_HISTORY_COUNT;
+    if (request.params.size() > 1)
+        nSkip = request.params[1].get_int64();
+    if (request.params.size() > 2)
+        nCount = request.params[2].get_int64();
+    if (nSkip < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative skip");
+    if (nCount < 0 || nCount > MAX_ADDRESS_HISTORY_COUNT)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Count out of range");
+
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>> entries;
+    if (!g_addressindex->GetHistory(hashScript, nSkip, nCount, entries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read from the address index");
+    return addressHistoryToJSON(entries);
+}
+
+static UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nReturns the compact filter (BIP158) of a block, from the block filter index (requires -blockfilterindex).\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"  (string, required) The hash of the block\n"
+            "2. \"filtertype\" (string, optional, default=\"basic\") The type of filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) The encoded filter\n"
+            "  \"header\" : \"hex\"   (string) The filter header, which also commits to the filters of all blocks before\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hashBlock = ParseHashV(request.params[0], "blockhash");
+    BlockFilterType filterType = BlockFilterType::BASIC;
+    if (request.params.size() > 1 && !BlockFilterTypeByName(request.params[1].get_str(), filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filter type");
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filterType)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filter index not enabled, use -blockfilterindex");
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pindex = it->second;
+    }
+
+    g_blockfilterindex->BlockUntilSynced();
+    CBlockFilter filter;
+    uint256 hashHeader;
+    if (!g_blockfilterindex->LookupFilter(pindex, filter) || !g_blockfilterindex->LookupFilterHeader(pindex, hashHeader))
+        throw JSONRPCError(RPC_MISC_ERROR, g_blockfilterindex->IsSynced() ? "Filter not found" : "Filter not found, the block filter index is still catching up");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", hashHeader.GetHex()));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {}, false, RPC_CACHE_TIP },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        true,  {"num_blocks", "block_hash"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {} },
     { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
-    { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbosity|verbose"} },
-    { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
-    { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbosity|verbose"}, true },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"}, true },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"}, true },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {}, false, RPC_CACHE_TIP },
     { "blockchain",         "emptymempool",           &emptymempool,           true,  {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"}, true },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
-    { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "getpowverifyinfo",       &getpowverifyinfo,       true,  {} },
+    { "blockchain",         "getblockconnectstats",   &getblockconnectstats,   true,  {"count"} },
+    { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"}, true },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      true,  {"address"} },
+    { "blockchain",         "getaddresshistory",      &getaddresshistory,      true,  {"address","skip","count"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,  {"blockhash","filtertype"}, true },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type","witness"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"check_level","num_blocks"} },
 
@@ -1599,6 +2293,7 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitfornewblock",        &waitfornewblock,        true,  {"timeout"} },
     { "hidden",             "waitforblock",           &waitforblock,           true,  {"blockhash","timeout"} },
     { "hidden",             "waitforblockheight",     &waitforblockheight,     true,  {"height","timeout"} },
+    { "hidden",             "waitfortemplatechange",  &waitfortemplatechange,  true,  {"templateid","timeout"} },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &t)
@@ -5,8 +5,16 @@
 #ifndef GULDEN_RPC_BLOCKCHAIN_H
 #define GULDEN_RPC_BLOCKCHAIN_H
 
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
 class CBlock;
 class CBlockIndex;
+class CJSONWriter;
+struct CAddressIndexKey;
+struct CAddressIndexSummary;
+struct CAddressIndexValue;
 class CScript;
 class CTransaction;
 class uint256;
@@ -26,6 +34,8 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+/** The same, written out as it is made; holds only one transaction at a time as UniValue. */
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONWriter& writer);
 
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
@@ -36,5 +46,16 @@ UniValue mempoolToJSON(bool fVerbose = false);
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
+//! Number of address history entries returned when no count is given (getaddresshistory, /rest/address/).
+static const int64_t DEFAULT_ADDRESS_HISTORY_COUNT = 100;
+//! Maximum number of address history entries returned at once.
+static const int64_t MAX_ADDRESS_HISTORY_COUNT = 1000;
+
+/** Totals of an address in the address index to JSON */
+UniValue addressSummaryToJSON(const CAddressIndexSummary& summary);
+
+/** Address index entries to JSON */
+UniValue addressHistoryToJSON(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>>& entries);
+
 #endif
 
@@ -62,6 +62,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "waitforblockheight", 1, "timeout" },
     { "waitforblock", 1, "timeout" },
     { "waitfornewblock", 0, "timeout" },
+    { "waitfortemplatechange", 1, "timeout" },
     { "move", 2, "amount" },
     { "move", 3, "min_conf" },
     { "sendfrom", 2, "amount" },
@@ -69,6 +70,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listtransactions", 1, "count" },
     { "listtransactions", 2, "skip" },
     { "listtransactions", 3, "include_watchonly" },
+    { "listtransactions", 4, "cursor" },
     { "walletpassphrase", 1, "timeout" },
     { "getblocktemplate", 0, "template_request" },
     { "listsinceblock", 1, "target_confirmations" },
@@ -91,6 +93,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblock", 1, "verbosity" },
     { "getblockheader", 1, "verbose" },
     { "getchaintxstats", 0, "num_blocks" },
+    { "getblockconnectstats", 0, "count" },
     { "gettransaction", 1, "include_watchonly" },
     { "getrawtransaction", 1, "verbose" },
     { "createrawtransaction", 0, "inputs" },
@@ -102,7 +105,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "sendrawtransaction", 1, "allow_high_fees" },
     { "fundrawtransaction", 1, "options" },
     { "gettxout", 1, "n" },
+    { "getaddresshistory", 1, "skip" },
+    { "getaddresshistory", 2, "count" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 1, "witness" },
     { "gettxoutproof", 0, "txids" },
     { "lockunspent", 0, "unlock" },
     { "lockunspent", 1, "transactions" },
@@ -134,6 +140,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
     { "disconnectnode", 1, "node_id" },
+    { "getmetrics", 0, "reset" },
+    { "getlockstats", 0, "enable" },
+    { "getlockstats", 1, "reset" },
     // Echo with conversion (For testing only)
     { "echojson", 0, "arg0" },
     { "echojson", 1, "arg1" },
@@ -153,9 +162,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "setwitnesscompound", 1, "amount" },
     { "getwitnessinfo", 1, "verbose" },
     { "getwitnessinfo", 2, "mine_only" },
+    { "getwitnessinfo", 3, "start" },
+    { "getwitnessinfo", 4, "count" },
     { "fundwitnessaccount", 4, "force_multiple" },
     { "setwitnessrewardscript", 2, "force_pubkey" },
     { "sethashlimit", 0, "limit" },
+    { "sethashlimit", 1, "dutycycle" },
     { "dumpdiffarray", 0, "height" },
     { "dumpblockgaps", 0, "start_height" },
     { "dumpblockgaps", 1, "count" },
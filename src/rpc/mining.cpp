@@ -21,9 +21,11 @@
 #include "validation/validationinterface.h"
 #include "validation/versionbitsvalidation.h"
 #include "core_io.h"
+#include "crypto/sha256.h"
 #include "init.h"
 #include "versionbits.h"
 #include "generation/miner.h"
+#include "generation/poolserver.h"
 #include "net.h"
 #include "policy/fees.h"
 #include "pow.h"
@@ -489,6 +491,32 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
             "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see getgenerate or setgenerate calls)\n"
             "  \"genmemlimit\": n           (numeric) The memory limit for generation; In Kilobytes. (see getgenerate or setgenerate calls)\n"
+            "  \"arena_backing\": \"xxx\",    (string) Memory backing obtained for the mining arenas (see gethashps)\n"
+            "  \"arena_locked\": true|false (boolean) Whether the mining arenas are locked into physical memory\n"
+            "  \"arena_plan\": {            (object) How the memory for the most recent mining arenas was laid out, empty if none allocated yet\n"
+            "    \"requested_kb\": n,       (numeric) Memory requested through -genmemlimit\n"
+            "    \"budget_kb\": n,          (numeric) Memory the machine could hold without swapping (per arena set)\n"
+            "    \"planned_kb\": n,         (numeric) Memory planned for the arenas\n"
+            "    \"limited_by\": \"xxx\",     (string) What bounded the plan: request, available_memory or total_memory\n"
+            "    \"huge_pages\": true|false (boolean) Whether the budget includes the free explicit huge page pool\n"
+            "    \"hashes_per_round\": n,   (numeric) Hashes each round of arenas allows for\n"
+            "    \"contexts\": [            (array) One entry per arena\n"
+            "      { \"arena_kb\": n, \"threads\": n, \"numa_node\": n }\n"
+            "    ]\n"
+            "  }\n"
+            "  \"arena_utilisation\": [     (array) Progress of each arena through the nonce space of the header it is mining, for the current or most recent round\n"
+            "    {\n"
+            "      \"arena_kb\": n,           (numeric) Size of the arena\n"
+            "      \"threads\": n,            (numeric) Threads mining on the arena\n"
+            "      \"numa_node\": n,          (numeric) NUMA node the arena is bound to, -1 if none\n"
+            "      \"prenonce_start\": n,     (numeric) First pre nonce assigned to the arena\n"
+            "      \"prenonce_count\": n,     (numeric) Number of pre nonces assigned to the arena\n"
+            "      \"prenonces_done\": n,     (numeric) Number of assigned pre nonces that have been fully searched\n"
+            "      \"half_hashes\": n,        (numeric) Number of half hashes performed\n"
+            "      \"utilisation\": x.xxx     (numeric) Fraction of the assigned nonce space that has been searched\n"
+            "    }\n"
+            "  ]\n"
+            "  \"last_restart_reason\": \"xxx\" (string) Why the previous round ended: block_found, exhausted, tip_changed, witness_orphan or difficulty_drop\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "}\n"
@@ -509,6 +537,51 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
     obj.push_back(Pair("genproclimit",     (int)GetArg("-genproclimit", DEFAULT_GENERATE_THREADS)));
     obj.push_back(Pair("genmemlimit",      (uint64_t)GetArg("-genmemlimit", DEFAULT_GENERATE_THREADS)));
+    obj.push_back(Pair("arena_backing",    GetArenaBackingName()));
+    obj.push_back(Pair("arena_locked",     (bool)fArenaLocked));
+    {
+        LOCK(cs_arenaPlan);
+        UniValue plan(UniValue::VOBJ);
+        if (!arenaPlan.contexts.empty())
+        {
+            plan.push_back(Pair("requested_kb",     arenaPlan.requestedKb));
+            plan.push_back(Pair("budget_kb",        arenaPlan.budgetKb));
+            plan.push_back(Pair("planned_kb",       arenaPlan.plannedKb));
+            plan.push_back(Pair("limited_by",       arenaPlan.limitedBy));
+            plan.push_back(Pair("huge_pages",       arenaPlan.hugePages));
+            plan.push_back(Pair("hashes_per_round", arenaPlan.numHashes));
+            UniValue contexts(UniValue::VARR);
+            for (const auto& context : arenaPlan.contexts)
+            {
+                UniValue contextObj(UniValue::VOBJ);
+                contextObj.push_back(Pair("arena_kb",  context.arenaSizeKb));
+                contextObj.push_back(Pair("threads",   context.numThreads));
+                contextObj.push_back(Pair("numa_node", context.numaNode));
+                contexts.push_back(contextObj);
+            }
+            plan.push_back(Pair("contexts", contexts));
+        }
+        obj.push_back(Pair("arena_plan", plan));
+    }
+    {
+        LOCK(cs_arenaUtilisation);
+        UniValue arenas(UniValue::VARR);
+        for (const auto& arena : vArenaUtilisation)
+        {
+            UniValue arenaObj(UniValue::VOBJ);
+            arenaObj.push_back(Pair("arena_kb",       arena.nArenaSizeKb));
+            arenaObj.push_back(Pair("threads",        arena.nThreads));
+            arenaObj.push_back(Pair("numa_node",      arena.nNumaNode));
+            arenaObj.push_back(Pair("prenonce_start", arena.nPreNonceStart));
+            arenaObj.push_back(Pair("prenonce_count", arena.nPreNonceCount));
+            arenaObj.push_back(Pair("prenonces_done", arena.nPreNoncesDone));
+            arenaObj.push_back(Pair("half_hashes",    arena.nHalfHashes));
+            arenaObj.push_back(Pair("utilisation",    arena.nPreNonceCount == 0 ? 0.0 : (double)arena.nPreNoncesDone / arena.nPreNonceCount));
+            arenas.push_back(arenaObj);
+        }
+        obj.push_back(Pair("arena_utilisation", arenas));
+        obj.push_back(Pair("last_restart_reason", strLastMiningRestartReason));
+    }
     obj.push_back(Pair("networkhashps",    getnetworkhashps(request)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
@@ -517,6 +590,83 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
 }
 
 
+static UniValue getsigmainfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getsigmainfo\n"
+            "\nReturns which optimised SIGMA (and SHA256) hash implementations were selected for this CPU at startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"shavite\": \"xxx\",        (string) Single way shavite3 implementation\n"
+            "  \"echo\": \"xxx\",           (string) Single way echo256 implementation\n"
+            "  \"argon\": \"xxx\",          (string) argon2_echo implementation\n"
+            "  \"prng\": \"xxx\",           (string) AES PRNG implementation\n"
+            "  \"shavite_x2\": \"xxx\",     (string) Two way shavite3 kernel used by the miner, or \"unavailable\"\n"
+            "  \"echo_x2\": \"xxx\",        (string) Two way echo256 kernel used by the miner, or \"unavailable\"\n"
+            "  \"shavite_x4\": \"xxx\",     (string) Four way shavite3 kernel used by the miner, or \"unavailable\"\n"
+            "  \"echo_x4\": \"xxx\",        (string) Four way echo256 kernel used by the miner, or \"unavailable\"\n"
+            "  \"selection\": \"xxx\",      (string) How the SIGMA implementations were picked: \"features\" (CPU feature flags), \"benchmark\" (timed at startup, see -benchmarkkernels), \"cached\" (timed on an earlier start on this CPU) or \"forced\" (-sigmaalgo)\n"
+            "  \"sha256\": \"xxx\"          (string) SHA256 implementations\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigmainfo", "")
+            + HelpExampleRpc("getsigmainfo", "")
+        );
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("shavite",    selectedSigmaImplementations.shavite));
+    obj.push_back(Pair("echo",       selectedSigmaImplementations.echo));
+    obj.push_back(Pair("argon",      selectedSigmaImplementations.argon));
+    obj.push_back(Pair("prng",       selectedSigmaImplementations.prng));
+    obj.push_back(Pair("shavite_x2", selectedSigmaImplementations.shaviteX2));
+    obj.push_back(Pair("echo_x2",    selectedSigmaImplementations.echoX2));
+    obj.push_back(Pair("shavite_x4", selectedSigmaImplementations.shaviteX4));
+    obj.push_back(Pair("echo_x4",    selectedSigmaImplementations.echoX4));
+    obj.push_back(Pair("selection",  selectedSigmaImplementations.selection));
+    obj.push_back(Pair("sha256",     SHA256Implementation()));
+    return obj;
+}
+
+static UniValue getpoolserverinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getpoolserverinfo\n"
+            "\nReturns the state of the native pool work server (see -poolserver).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"running\": true|false,     (boolean) Whether the pool server is running\n"
+            "  \"bind\": \"xxx\",           (string) Address the server is listening on\n"
+            "  \"sessions\": n,             (numeric) Connected sessions\n"
+            "  \"prenonce_groups\": n,      (numeric) Header variants currently handed out to sessions\n"
+            "  \"job\": \"xxx\",            (string) Id of the current job\n"
+            "  \"job_height\": n,           (numeric) Height of the block the current job is for\n"
+            "  \"shares_accepted\": n,      (numeric) Shares accepted since startup\n"
+            "  \"shares_rejected\": n,      (numeric) Invalid, duplicate or low difficulty shares since startup\n"
+            "  \"shares_stale\": n,         (numeric) Shares for jobs that were no longer current\n"
+            "  \"blocks_found\": n          (numeric) Shares that were accepted as blocks\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getpoolserverinfo", "")
+            + HelpExampleRpc("getpoolserverinfo", "")
+        );
+
+    PoolServerStats stats = GetPoolServerStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("running",         stats.fRunning));
+    obj.push_back(Pair("bind",            stats.strBind));
+    obj.push_back(Pair("sessions",        stats.nSessions));
+    obj.push_back(Pair("prenonce_groups", stats.nGroups));
+    obj.push_back(Pair("job",             stats.strJobId));
+    obj.push_back(Pair("job_height",      stats.nJobHeight));
+    obj.push_back(Pair("shares_accepted", stats.nSharesAccepted));
+    obj.push_back(Pair("shares_rejected", stats.nSharesRejected));
+    obj.push_back(Pair("shares_stale",    stats.nSharesStale));
+    obj.push_back(Pair("blocks_found",    stats.nBlocksFound));
+    return obj;
+}
+
 // NOTE: Unlike wallet RPC (which use NLG values), mining RPCs follow GBT (BIP 22) in using satoshi amounts
 static UniValue prioritisetransaction(const JSONRPCRequest& request)
 {
@@ -824,8 +974,10 @@ static UniValue estimaterawfee(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
-    { "block_generation",   "getnetworkhashps",       &getnetworkhashps,       true,  {"num_blocks","height"} },
-    { "block_generation",   "getmininginfo",          &getmininginfo,          true,  {} },
+    { "block_generation",   "getnetworkhashps",       &getnetworkhashps,       true,  {"num_blocks","height"}, false, RPC_CACHE_TIP },
+    { "block_generation",   "getmininginfo",          &getmininginfo,          true,  {}, false, RPC_CACHE_TIP_MEMPOOL },
+    { "block_generation",   "getsigmainfo",           &getsigmainfo,           true,  {} },
+    { "block_generation",   "getpoolserverinfo",      &getpoolserverinfo,      true,  {} },
     { "block_generation",   "prioritisetransaction",  &prioritisetransaction,  true,  {"txid","dummy_value","fee_delta"} },
     { "block_generation",   "submitblock",            &submitblock,            true,  {"hexdata","parameters"} },
 
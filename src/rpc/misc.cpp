@@ -13,8 +13,13 @@
 #include "base58.h"
 #include "chain.h"
 #include "clientversion.h"
+#include "dbwrapper.h"
 #include "init.h"
+#include "metrics.h"
+#include "pow.h"
+#include "txmempool.h"
 #include "validation/validation.h"
+#include "validation/witnessvalidation.h"
 #include "httpserver.h"
 #include "net.h"
 #include "netbase.h"
@@ -565,6 +570,65 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCCheckedPoWCacheInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", uint64_t(checkedPoWCache.size())));
+    obj.push_back(Pair("capacity", uint64_t(checkedPoWCache.capacity())));
+    obj.push_back(Pair("hits", checkedPoWCache.hits()));
+    obj.push_back(Pair("misses", checkedPoWCache.misses()));
+    obj.push_back(Pair("evictions", checkedPoWCache.evictions()));
+    return obj;
+}
+
+static UniValue RPCMemoryDetail()
+{
+    UniValue obj(UniValue::VOBJ);
+    uint64_t nTotal = 0;
+    auto add = [&](UniValue& o, const std::string& name, uint64_t nUsage) { o.push_back(Pair(name, nUsage)); nTotal += nUsage; };
+
+    {
+        LOCK(cs_main);
+        add(obj, "coins_tip", pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0);
+        add(obj, "block_index", BlockIndexDynamicMemoryUsage());
+        add(obj, "checked_pow_cache", CheckedPoWCacheDynamicMemoryUsage());
+        add(obj, "witness_tip", ppow2witTip ? ppow2witTip->DynamicMemoryUsage() : 0);
+        add(obj, "witness_set_index", witnessSetIndex.DynamicMemoryUsage());
+    }
+    add(obj, "mempool", mempool.DynamicMemoryUsage());
+    add(obj, "witness_selection_cache", witnessSelectionCache.DynamicMemoryUsage());
+    add(obj, "witness_expiry_queue", witnessExpiryQueue.DynamicMemoryUsage());
+    add(obj, "witness_pool_precompute", witnessPoolPrecompute.DynamicMemoryUsage());
+    add(obj, "sigma_verify", GetSigmaVerifyPoolStats().nMemoryUsage);
+    if (g_connman)
+    {
+        add(obj, "addrman", g_connman->GetAddrManMemoryUsage());
+        add(obj, "peers", g_connman->GetPeerMemoryUsage());
+    }
+
+    UniValue databases(UniValue::VOBJ);
+    for (const CDBStats& stats : CDBWrapper::GetOpenDatabaseStats())
+        add(databases, stats.name, stats.nMemoryUsage);
+    obj.push_back(Pair("databases", databases));
+
+#ifdef ENABLE_WALLET
+    UniValue wallets(UniValue::VOBJ);
+    for (CWalletRef pwallet : vpwallets)
+    {
+        UniValue wallet(UniValue::VOBJ);
+        add(wallet, "transactions", pwallet->TransactionsDynamicMemoryUsage());
+        add(wallet, "accounts", pwallet->AccountsDynamicMemoryUsage());
+        wallets.push_back(Pair(pwallet->GetName(), wallet));
+    }
+    obj.push_back(Pair("wallets", wallets));
+#endif
+
+    LockedPool::Stats lockedStats = LockedPoolManager::Instance().stats();
+    add(obj, "locked", lockedStats.total);
+    obj.push_back(Pair("total", nTotal));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -596,6 +660,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "Arguments:\n"
             "1. \"mode\" determines what kind of information is returned. This argument is optional, the default mode is \"stats\".\n"
             "  - \"stats\" returns general statistics about memory usage in the daemon.\n"
+            "  - \"detail\" returns an estimate of the memory used by each subsystem, in bytes.\n"
             "  - \"mallocinfo\" returns an XML string describing low-level heap state (only available if compiled with glibc 2.10+).\n"
             "\nResult (mode \"stats\"):\n"
             "{\n"
@@ -606,12 +671,47 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"checked_pow_cache\": {    (json object) Cache of headers whose proof of work was checked\n"
+            "    \"entries\": xxxxx,        (numeric) Number of headers in the cache\n"
+            "    \"capacity\": xxxxx,       (numeric) Most headers the cache holds\n"
+            "    \"hits\": xxxxx,           (numeric) Lookups that found the header since startup\n"
+            "    \"misses\": xxxxx,         (numeric) Lookups that didn't\n"
+            "    \"evictions\": xxxxx,      (numeric) Headers dropped to make room for others\n"
             "  }\n"
             "}\n"
+            "\nResult (mode \"detail\"):\n"
+            "{\n"
+            "  \"coins_tip\": xxxxx,                (numeric) Coins cache (see -dbcache)\n"
+            "  \"block_index\": xxxxx,              (numeric) Block index entries and the map of them\n"
+            "  \"checked_pow_cache\": xxxxx,        (numeric) Cache of headers whose proof of work was checked\n"
+            "  \"witness_tip\": xxxxx,              (numeric) Witness coins cache\n"
+            "  \"witness_set_index\": xxxxx,        (numeric) Snapshots of the witness set of recent blocks\n"
+            "  \"mempool\": xxxxx,                  (numeric) Memory pool\n"
+            "  \"witness_selection_cache\": xxxxx,  (numeric) Cached witness selections\n"
+            "  \"witness_expiry_queue\": xxxxx,     (numeric) Projected expiry heights of the witnesses\n"
+            "  \"witness_pool_precompute\": xxxxx,  (numeric) Witness selection pools prepared for the next block\n"
+            "  \"sigma_verify\": xxxxx,             (numeric) SIGMA verify contexts and their cache\n"
+            "  \"addrman\": xxxxx,                  (numeric) Known peer addresses\n"
+            "  \"peers\": xxxxx,                    (numeric) Send and receive queues and per peer filters and inventory\n"
+            "  \"databases\": {                     (json object) Block cache and write buffers per database\n"
+            "    \"name\": xxxxx,\n"
+            "    ...\n"
+            "  },\n"
+            "  \"wallets\": {                       (json object) Per wallet\n"
+            "    \"name\": {\n"
+            "      \"transactions\": xxxxx,         (numeric) Wallet transactions\n"
+            "      \"accounts\": xxxxx              (numeric) Accounts, keys and the address book\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"locked\": xxxxx,                   (numeric) Locked memory (for keys)\n"
+            "  \"total\": xxxxx                     (numeric) Sum of the above\n"
+            "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
             "\"<malloc version=\"1\">...\"\n"
             "\nExamples:\n"
             + HelpExampleCli("getmemoryinfo", "")
+            + HelpExampleCli("getmemoryinfo", "\"detail\"")
             + HelpExampleRpc("getmemoryinfo", "")
         );
 
@@ -619,7 +719,10 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("checked_pow_cache", RPCCheckedPoWCacheInfo()));
         return obj;
+    } else if (mode == "detail") {
+        return RPCMemoryDetail();
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
         return RPCMallocInfo();
@@ -711,11 +814,222 @@ UniValue echo(const JSONRPCRequest& request)
     return request.params;
 }
 
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getdbstats\n"
+            "Returns the LevelDB settings, cache use and compaction state of each database.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                  (json object) The database (blockindex, chainstate, witstate, addressindex)\n"
+            "    \"block_cache\": xxxxx,      (numeric) Size of the block cache in bytes\n"
+            "    \"write_buffer\": xxxxx,     (numeric) Size of a write buffer in bytes\n"
+            "    \"bloom_bits\": n,           (numeric) Bits per key of the bloom filters, 0 for none\n"
+            "    \"max_open_files\": n,       (numeric) Max number of open files\n"
+            "    \"block_cache_usage\": xxx,  (numeric) Bytes in the block cache\n"
+            "    \"memory_usage\": xxxxx,     (numeric) Bytes used by the block cache and the write buffers\n"
+            "    \"cache_hits\": n,           (numeric) Block cache lookups that found the block since the database was opened\n"
+            "    \"cache_misses\": n,         (numeric) Block cache lookups that had to read from disk\n"
+            "    \"cache_hit_rate\": x.xxx,   (numeric) Fraction of the lookups that were hits\n"
+            "    \"compaction_backlog_mb\": x, (numeric) Megabytes above the target size of their level, still to be compacted\n"
+            "    \"levels\": [                (json array) The levels that have files or have seen compactions\n"
+            "      {\n"
+            "        \"level\": n,               (numeric) The level\n"
+            "        \"files\": n,               (numeric) Number of table files\n"
+            "        \"size_mb\": x,             (numeric) Size of the level in megabytes\n"
+            "        \"compaction_seconds\": x,  (numeric) Time spent on compactions into this level\n"
+            "        \"compaction_read_mb\": x,  (numeric) Data read by those compactions\n"
+            "        \"compaction_write_mb\": x, (numeric) Data written by those compactions\n"
+            "        \"compaction_score\": x.xx  (numeric) 1 or more when a compaction of the level is due\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue result(UniValue::VOBJ);
+    for (const CDBStats& stats : CDBWrapper::GetOpenDatabaseStats())
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("block_cache", (uint64_t)stats.nBlockCacheSize));
+        obj.push_back(Pair("write_buffer", (uint64_t)stats.nWriteBufferSize));
+        obj.push_back(Pair("bloom_bits", stats.nBloomBits));
+        obj.push_back(Pair("max_open_files", stats.nMaxOpenFiles));
+        obj.push_back(Pair("block_cache_usage", (uint64_t)stats.nBlockCacheUsage));
+        obj.push_back(Pair("memory_usage", (uint64_t)stats.nMemoryUsage));
+        obj.push_back(Pair("cache_hits", stats.nCacheHits));
+        obj.push_back(Pair("cache_misses", stats.nCacheMisses));
+        uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+        obj.push_back(Pair("cache_hit_rate", nLookups ? (double)stats.nCacheHits / nLookups : 0.0));
+        obj.push_back(Pair("compaction_backlog_mb", stats.nCompactionBacklogMB));
+        UniValue levels(UniValue::VARR);
+        for (const CDBStats::Level& level : stats.levels)
+        {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("level", level.nLevel));
+            entry.push_back(Pair("files", level.nFiles));
+            entry.push_back(Pair("size_mb", level.nSizeMB));
+            entry.push_back(Pair("compaction_seconds", level.nCompactionSeconds));
+            entry.push_back(Pair("compaction_read_mb", level.nCompactionReadMB));
+            entry.push_back(Pair("compaction_write_mb", level.nCompactionWriteMB));
+            entry.push_back(Pair("compaction_score", level.nCompactionScore));
+            levels.push_back(entry);
+        }
+        obj.push_back(Pair("levels", levels));
+        result.push_back(Pair(stats.name, obj));
+    }
+    return result;
+}
+
+UniValue getmetrics(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getmetrics ( reset )\n"
+            "Returns the durations recorded for the timed operations (block reads and writes, witness selection...) since startup.\n"
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Clear the counters after reading them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {          (json object) The operation\n"
+            "    \"count\": n,        (numeric) Number of times it ran\n"
+            "    \"total_ms\": x.xx,  (numeric) Time spent in it in total\n"
+            "    \"mean_ms\": x.xx,   (numeric) Average duration\n"
+            "    \"p50_ms\": x.xx,    (numeric) Upper bound of the median duration (durations are kept in power of 2 microsecond buckets)\n"
+            "    \"p99_ms\": x.xx,    (numeric) Upper bound of the 99th percentile\n"
+            "    \"max_ms\": x.xx     (numeric) Longest duration\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmetrics", "")
+            + HelpExampleRpc("getmetrics", "true")
+        );
+
+    UniValue result(UniValue::VOBJ);
+    for (const CMetricSnapshot& snapshot : GetMetricSnapshots())
+    {
+        // Sizes are in getmsgstats.
+        if (snapshot.unit != MetricUnit::MICROSECONDS)
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", snapshot.nCount));
+        obj.push_back(Pair("total_ms", 0.001 * snapshot.nTotal));
+        obj.push_back(Pair("mean_ms", snapshot.nCount ? 0.001 * snapshot.nTotal / snapshot.nCount : 0.0));
+        obj.push_back(Pair("p50_ms", 0.001 * snapshot.nP50));
+        obj.push_back(Pair("p99_ms", 0.001 * snapshot.nP99));
+        obj.push_back(Pair("max_ms", 0.001 * snapshot.nMax));
+        result.push_back(Pair(snapshot.name, obj));
+    }
+    if (request.params.size() > 0 && request.params[0].get_bool())
+        ResetMetrics();
+    return result;
+}
+
+UniValue getrpcinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getrpcinfo\n"
+            "Returns the state of the HTTP server that serves RPC and REST requests.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"event_threads\": n,         (numeric) Threads accepting connections and parsing and replying to requests (-rpceventthreads)\n"
+            "  \"worker_threads\": n,        (numeric) Threads handling requests (-rpcthreads)\n"
+            "  \"work_queue_depth\": n,      (numeric) Requests waiting for a worker thread\n"
+            "  \"work_queue_max_depth\": n,  (numeric) Requests that can wait before new ones are refused (-rpcworkqueue)\n"
+            "  \"requests_processed\": n,    (numeric) Requests handed to a worker thread since startup\n"
+            "  \"requests_rejected\": n      (numeric) Requests refused because the work queue was full\n"
+            "}\n"
+            "\nThe time requests spend in the work queue is in getmetrics.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    HTTPServerStats stats;
+    if (!GetHTTPServerStats(stats))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "HTTP server not running");
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("event_threads", stats.nEventThreads));
+    result.push_back(Pair("worker_threads", stats.nWorkerThreads));
+    result.push_back(Pair("work_queue_depth", (uint64_t)stats.nWorkQueueDepth));
+    result.push_back(Pair("work_queue_max_depth", (uint64_t)stats.nWorkQueueMaxDepth));
+    result.push_back(Pair("requests_processed", stats.nRequestsProcessed));
+    result.push_back(Pair("requests_rejected", stats.nRequestsRejected));
+    return result;
+}
+
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "getlockstats ( enable reset )\n"
+            "Returns how often locks were taken at each place in the code, and how long they were waited for and held there.\n"
+            "Only recorded while the lock profiler is on (-lockstats, or enable here).\n"
+            "\nArguments:\n"
+            "1. enable   (boolean, optional) Turn the lock profiler on or off\n"
+            "2. reset    (boolean, optional, default=false) Clear what was recorded after reading it\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,      (boolean) Whether the lock profiler is on\n"
+            "  \"sites\": [                  (json array) The places locks were taken, most waited for first\n"
+            "    {\n"
+            "      \"lock\": \"name\",          (string) The lock (cs_main, pwallet->cs_wallet...)\n"
+            "      \"site\": \"file:line\",     (string) Where it was taken\n"
+            "      \"count\": n,              (numeric) Number of times it was taken there\n"
+            "      \"contended\": n,          (numeric) Number of times another thread held it\n"
+            "      \"wait_ms\": x.xx,         (numeric) Time spent waiting for it in total\n"
+            "      \"max_wait_ms\": x.xx,     (numeric) Longest wait\n"
+            "      \"hold_ms\": x.xx,         (numeric) Time it was held in total\n"
+            "      \"max_hold_ms\": x.xx      (numeric) Longest hold\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "true")
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "false, true")
+        );
+
+    if (request.params.size() > 0 && !request.params[0].isNull())
+        g_fLockStats = request.params[0].get_bool();
+
+    UniValue sites(UniValue::VARR);
+    for (const CLockSiteStats& stats : GetLockStats())
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", stats.name));
+        obj.push_back(Pair("site", strprintf("%s:%d", stats.file, stats.nLine)));
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("contended", stats.nContended));
+        obj.push_back(Pair("wait_ms", 0.001 * stats.nWait));
+        obj.push_back(Pair("max_wait_ms", 0.001 * stats.nMaxWait));
+        obj.push_back(Pair("hold_ms", 0.001 * stats.nHold));
+        obj.push_back(Pair("max_hold_ms", 0.001 * stats.nMaxHold));
+        sites.push_back(obj);
+    }
+    if (request.params.size() > 1 && request.params[1].get_bool())
+        ResetLockStats();
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("enabled", g_fLockStats.load()));
+    result.push_back(Pair("sites", sites));
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getinfo",                &getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {"mode"} },
+    { "control",            "getdbstats",             &getdbstats,             true,  {} },
+    { "control",            "getmetrics",             &getmetrics,             true,  {"reset"} },
+    { "control",            "getlockstats",           &getlockstats,           true,  {"enable","reset"} },
+    { "control",            "getrpcinfo",             &getrpcinfo,             true,  {} },
 
     { "util",               "getaddress",             &getaddress,             true,  {"pubkey_or_script"} },
     { "util",               "validateaddress",        &validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
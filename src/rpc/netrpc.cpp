@@ -110,6 +110,12 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"pow_budget_ms\": n,        (numeric) Proof of work verification time this peer may still use before its headers are deferred, only limited for inbound peers (-peerpowbudget)\n"
+            "    \"pow_deferred\": n,         (numeric) Number of times headers from this peer were deferred for lack of budget\n"
+            "    \"block_service_ms\": n,     (numeric) Average time this peer takes to send a block once it gets to it, 0 until it sent one we asked for\n"
+            "    \"block_latency_ms\": n,     (numeric) Average time from asking this peer for a block until it arrives\n"
+            "    \"block_bytes_per_sec\": n,  (numeric) Average rate this peer sends blocks at\n"
+            "    \"block_window\": n,         (numeric) Number of blocks we ask this peer for at a time, sized by how fast it delivers\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -118,6 +124,24 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"waittime_per_msg\": {\n"
+            "       \"addr\": x.xx,           (numeric) The total time in ms received messages waited to be processed, by message type\n"
+            "       ...\n"
+            "    },\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": x.xx,           (numeric) The total time in ms spent processing received messages, by message type\n"
+            "       ...\n"
+            "    },\n"
+            "    \"sendqueue_bytes\": n,      (numeric) The bytes waiting to be sent to the peer\n"
+            "    \"sendqueue_peak_bytes\": n, (numeric) The most bytes that were waiting to be sent to the peer at once\n"
+            "    \"compression\": {\n"
+            "       \"send\": true|false,     (boolean) Whether large messages to the peer are compressed\n"
+            "       \"recv\": true|false,     (boolean) Whether the peer may send compressed messages\n"
+            "       \"bytessent_raw\": n,     (numeric) The payload bytes of the messages sent compressed, before compression\n"
+            "       \"bytessent\": n,         (numeric) The payload bytes of the messages sent compressed, as sent\n"
+            "       \"bytesrecv_raw\": n,     (numeric) The payload bytes of the messages received compressed, after decompression\n"
+            "       \"bytesrecv\": n          (numeric) The payload bytes of the messages received compressed, as received\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -176,6 +200,12 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("pow_budget_ms", statestats.nPoWBudgetMicros/1000));
+            obj.push_back(Pair("pow_deferred", statestats.nPoWDeferred));
+            obj.push_back(Pair("block_service_ms", statestats.nBlockServiceMicros / 1000.0));
+            obj.push_back(Pair("block_latency_ms", statestats.nBlockLatencyMicros / 1000.0));
+            obj.push_back(Pair("block_bytes_per_sec", statestats.nBlockBytesPerSecond));
+            obj.push_back(Pair("block_window", statestats.nBlockWindow));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -193,12 +223,150 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue waitPerMsgCmd(UniValue::VOBJ);
+        for(const mapMsgCmdTime::value_type &i : stats.mapWaitTimePerMsgCmd) {
+            if (i.second.nCount > 0)
+                waitPerMsgCmd.push_back(Pair(i.first, 0.001 * i.second.nTotal));
+        }
+        obj.push_back(Pair("waittime_per_msg", waitPerMsgCmd));
+
+        UniValue processPerMsgCmd(UniValue::VOBJ);
+        for(const mapMsgCmdTime::value_type &i : stats.mapProcessTimePerMsgCmd) {
+            if (i.second.nCount > 0)
+                processPerMsgCmd.push_back(Pair(i.first, 0.001 * i.second.nTotal));
+        }
+        obj.push_back(Pair("processtime_per_msg", processPerMsgCmd));
+        obj.push_back(Pair("sendqueue_bytes", stats.nSendQueueBytes));
+        obj.push_back(Pair("sendqueue_peak_bytes", stats.nSendQueuePeakBytes));
+
+        UniValue compression(UniValue::VOBJ);
+        compression.push_back(Pair("send", stats.fCompressSend));
+        compression.push_back(Pair("recv", stats.fCompressRecv));
+        compression.push_back(Pair("bytessent_raw", stats.nCompressSendRawBytes));
+        compression.push_back(Pair("bytessent", stats.nCompressSendBytes));
+        compression.push_back(Pair("bytesrecv_raw", stats.nCompressRecvRawBytes));
+        compression.push_back(Pair("bytesrecv", stats.nCompressRecvBytes));
+        obj.push_back(Pair("compression", compression));
+
         ret.push_back(obj);
     }
 
     return ret;
 }
 
+static UniValue MetricToJSON(const CMetricSnapshot& snapshot)
+{
+    // Sizes as they are, durations in ms.
+    bool fDuration = snapshot.unit == MetricUnit::MICROSECONDS;
+    double scale = fDuration ? 0.001 : 1;
+    std::string strSuffix = fDuration ? "_ms" : "_bytes";
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", snapshot.nCount));
+    obj.push_back(Pair("mean" + strSuffix, snapshot.nCount ? scale * snapshot.nTotal / snapshot.nCount : 0.0));
+    obj.push_back(Pair("p50" + strSuffix, scale * snapshot.nP50));
+    obj.push_back(Pair("p99" + strSuffix, scale * snapshot.nP99));
+    obj.push_back(Pair("max" + strSuffix, scale * snapshot.nMax));
+    return obj;
+}
+
+static UniValue getmsgstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getmsgstats\n"
+            "\nReturns how long received messages wait to be processed and take to process, by message type, and how full send queues get.\n"
+            "Durations are kept in power of 2 microsecond buckets, the percentiles are upper bounds of the bucket they fall in.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"messages\": {\n"
+            "    \"type\": {                (json object) The message type, over all peers\n"
+            "      \"wait\": {              (json object) Time from arrival until processing starts\n"
+            "        \"count\": n,          (numeric) Number of messages\n"
+            "        \"mean_ms\": x.xx,     (numeric) Average\n"
+            "        \"p50_ms\": x.xx,      (numeric) Median\n"
+            "        \"p99_ms\": x.xx,      (numeric) 99th percentile\n"
+            "        \"max_ms\": x.xx       (numeric) Longest\n"
+            "      },\n"
+            "      \"process\": {...}       (json object) Time spent processing, the same fields\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"sendqueue\": {           (json object) Bytes in the send queue of a peer each time a message is added to it\n"
+            "    \"count\": n,              (numeric) Number of messages sent\n"
+            "    \"mean_bytes\": n,         (numeric) Average\n"
+            "    \"p50_bytes\": n,          (numeric) Median\n"
+            "    \"p99_bytes\": n,          (numeric) 99th percentile\n"
+            "    \"max_bytes\": n           (numeric) Largest\n"
+            "  },\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,               (numeric) Peer index\n"
+            "      \"sendqueue_bytes\": n,  (numeric) The bytes waiting to be sent to the peer\n"
+            "      \"sendqueue_peak_bytes\": n, (numeric) The most bytes that were waiting to be sent to the peer at once\n"
+            "      \"messages\": {\n"
+            "        \"type\": {\n"
+            "          \"count\": n,        (numeric) Number of messages of that type received from the peer\n"
+            "          \"wait_ms\": x.xx,   (numeric) Total time they waited to be processed\n"
+            "          \"wait_max_ms\": x.xx, (numeric) Longest wait\n"
+            "          \"process_ms\": x.xx,  (numeric) Total time spent processing them\n"
+            "          \"process_max_ms\": x.xx (numeric) Longest processing time\n"
+            "        }, ...\n"
+            "      }\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmsgstats", "")
+            + HelpExampleRpc("getmsgstats", "")
+        );
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue result(UniValue::VOBJ);
+    UniValue messages(UniValue::VOBJ);
+    for (const std::string& strCommand : getAllNetMessageTypes())
+    {
+        CMetricSnapshot wait = GetMsgWaitMetric(strCommand).GetSnapshot();
+        if (wait.nCount == 0)
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("wait", MetricToJSON(wait)));
+        obj.push_back(Pair("process", MetricToJSON(GetMsgProcessMetric(strCommand).GetSnapshot())));
+        messages.push_back(Pair(strCommand, obj));
+    }
+    result.push_back(Pair("messages", messages));
+    result.push_back(Pair("sendqueue", MetricToJSON(GetSendQueueMetric().GetSnapshot())));
+
+    std::vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+    UniValue peers(UniValue::VARR);
+    for (const CNodeStats& stats : vstats)
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("id", stats.nodeid));
+        obj.push_back(Pair("sendqueue_bytes", stats.nSendQueueBytes));
+        obj.push_back(Pair("sendqueue_peak_bytes", stats.nSendQueuePeakBytes));
+        UniValue peerMessages(UniValue::VOBJ);
+        for (const mapMsgCmdTime::value_type& i : stats.mapProcessTimePerMsgCmd)
+        {
+            if (i.second.nCount == 0)
+                continue;
+            const CMsgCmdTime& wait = stats.mapWaitTimePerMsgCmd.at(i.first);
+            UniValue msg(UniValue::VOBJ);
+            msg.push_back(Pair("count", i.second.nCount));
+            msg.push_back(Pair("wait_ms", 0.001 * wait.nTotal));
+            msg.push_back(Pair("wait_max_ms", 0.001 * wait.nMax));
+            msg.push_back(Pair("process_ms", 0.001 * i.second.nTotal));
+            msg.push_back(Pair("process_max_ms", 0.001 * i.second.nMax));
+            peerMessages.push_back(Pair(i.first, msg));
+        }
+        obj.push_back(Pair("messages", peerMessages));
+        peers.push_back(obj);
+    }
+    result.push_back(Pair("peers", peers));
+    return result;
+}
+
 static UniValue addnode(const JSONRPCRequest& request)
 {
     std::string strCommand;
@@ -668,6 +836,7 @@ static const CRPCCommand commands[] =
     { "network",            "getconnectioncount",     &getconnectioncount,     true,  {} },
     { "network",            "ping",                   &ping,                   true,  {} },
     { "network",            "getpeerinfo",            &getpeerinfo,            true,  {} },
+    { "network",            "getmsgstats",            &getmsgstats,            true,  {} },
     { "network",            "addnode",                &addnode,                true,  {"node","command"} },
     { "network",            "disconnectnode",         &disconnectnode,         true,  {"address", "node_id"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
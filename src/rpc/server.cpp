@@ -6,13 +6,16 @@
 #include "rpc/server.h"
 
 #include "base58.h"
+#include "executor.h"
 #include "fs.h"
 #include "init.h"
 #include "random.h"
 #include "sync.h"
+#include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validation/validation.h"
 
 #include <unity/appmanager.h>
 
@@ -32,6 +35,12 @@ static bool fRPCRunning = false;
 static bool fRPCInWarmup = true;
 static std::string rpcWarmupStatus("RPC server started");
 static CCriticalSection cs_rpcWarmup;
+static bool fRPCTipCache = DEFAULT_RPC_TIP_CACHE;
+static CCriticalSection cs_rpcTipCache;
+//! The tip the cached results are for, null while there is none.
+static uint256 hashRPCTipCache;
+//! By method, URI (the wallet), parameters and for some commands the mempool sequence.
+static std::unordered_map<std::string, UniValue> mapRPCTipCache;
 /* Timer-creating functions */
 static RPCTimerInterface* timerInterface = NULL;
 /* Map of name to timer. */
@@ -308,6 +317,7 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
 bool StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
+    fRPCTipCache = GetBoolArg("-rpctipcache", DEFAULT_RPC_TIP_CACHE);
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -333,6 +343,13 @@ bool IsRPCRunning()
     return fRPCRunning;
 }
 
+void RPCTipCacheNewTip(const uint256& hashTip)
+{
+    LOCK(cs_rpcTipCache);
+    hashRPCTipCache = hashTip;
+    mapRPCTipCache.clear();
+}
+
 void SetRPCWarmupStatus(const std::string& newStatus)
 {
     LOCK(cs_rpcWarmup);
@@ -407,12 +424,41 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+static bool IsBatchParallel(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req, "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->okBatchParallel;
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    // Runs of calls that may run in parallel go to the executor together; any other call waits for what comes before it, and holds up what comes after it, as if the batch ran in order.
+    std::vector<UniValue> vResults(vReq.size());
+    for (size_t reqIdx = 0; reqIdx < vReq.size();)
+    {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsBatchParallel(vReq[nEnd]))
+            ++nEnd;
+        if (nEnd - reqIdx < 2)
+        {
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            ++reqIdx;
+            continue;
+        }
+        CTaskGroup calls(GetExecutor(), EXECUTOR_RPC);
+        for (; reqIdx < nEnd; ++reqIdx)
+            calls.Run([&vReq, &vResults, reqIdx]() { vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]); });
+        calls.Wait();
+    }
 
+    UniValue ret(UniValue::VARR);
+    for (UniValue& result : vResults)
+        ret.push_back(std::move(result));
     return ret.write() + "\n";
 }
 
@@ -482,14 +528,38 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    // Commands that only depend on the tip are answered with the result of the same call since the last block, if there was one.
+    std::string strCacheKey;
+    uint256 hashCacheTip;
+    if (fRPCTipCache && pcmd->cacheScope != RPC_CACHE_NONE && !request.fHelp)
+    {
+        strCacheKey = request.strMethod + '\0' + request.URI + '\0' + request.params.write();
+        if (pcmd->cacheScope == RPC_CACHE_TIP_MEMPOOL)
+            strCacheKey += '\0' + std::to_string(mempool.GetTransactionsUpdated());
+        LOCK(cs_rpcTipCache);
+        hashCacheTip = hashRPCTipCache;
+        auto it = mapRPCTipCache.find(strCacheKey);
+        if (it != mapRPCTipCache.end())
+            return it->second;
+    }
+
     try
     {
         // Execute, convert arguments to array if necessary
+        UniValue result;
         if (request.params.isObject()) {
-            return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
+            result = pcmd->actor(transformNamedArguments(request, pcmd->argNames));
         } else {
-            return pcmd->actor(request);
+            result = pcmd->actor(request);
+        }
+        if (!strCacheKey.empty() && !hashCacheTip.IsNull())
+        {
+            // Not if a block came in meanwhile, the result might be from before it.
+            LOCK(cs_rpcTipCache);
+            if (hashRPCTipCache == hashCacheTip && mapRPCTipCache.size() < RPC_TIP_CACHE_SIZE)
+                mapRPCTipCache.emplace(strCacheKey, result);
         }
+        return result;
     }
     catch (const std::exception& e)
     {
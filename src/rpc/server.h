@@ -17,14 +17,20 @@
 #include "rpc/protocol.h"
 #include "uint256.h"
 
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <stdint.h>
 #include <string>
 
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+//! Default for -rpctipcache, answer repeated calls of commands that only depend on the tip from memory
+static const bool DEFAULT_RPC_TIP_CACHE = true;
+//! Most results kept by the tip cache; calls beyond that are answered as usual until the next block.
+static const unsigned int RPC_TIP_CACHE_SIZE = 256;
 
 class CRPCCommand;
 
@@ -47,6 +53,23 @@ struct UniValueType {
     UniValue::VType type;
 };
 
+/** A reply that is sent later, from wherever the result becomes known, see JSONRPCRequest::deferReply. */
+class CRPCDeferredReply
+{
+public:
+    virtual ~CRPCDeferredReply() {}
+    //! Send result (or, given a JSONRPCError object, the error) as the reply; only the first reply counts, later ones return false.
+    virtual bool Reply(const UniValue& result) = 0;
+    virtual bool HasReplied() const = 0;
+};
+
+/**
+ * Defer the reply of the current call: after the handler returns (with NullUniValue, which is not sent) the request waits for the
+ * returned CRPCDeferredReply to be replied to, or nTimeoutMillis (if not 0) to pass, when the result of onTimeout is sent instead. The
+ * worker thread is free for other calls meanwhile.
+ */
+typedef std::function<std::shared_ptr<CRPCDeferredReply>(int64_t nTimeoutMillis, std::function<UniValue()> onTimeout)> RPCDeferFunction;
+
 class JSONRPCRequest
 {
 public:
@@ -56,6 +79,8 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    //! Empty when the transport can't defer the reply (e.g. calls in a batch), handlers that wait have to wait in place then.
+    RPCDeferFunction deferReply;
 
     JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
     void parse(const UniValue& valRequest);
@@ -138,6 +163,17 @@ void RPCRunLater(const std::string& name, std::function<void(void)> func, int64_
 
 typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
 
+/** What the result of a command depends on besides its parameters, for the tip cache of CRPCTable::execute. */
+enum RPCCacheScope
+{
+    //! Anything, never cached.
+    RPC_CACHE_NONE,
+    //! Only the tip.
+    RPC_CACHE_TIP,
+    //! The tip and the mempool.
+    RPC_CACHE_TIP_MEMPOOL
+};
+
 class CRPCCommand
 {
 public:
@@ -146,6 +182,9 @@ public:
     rpcfn_type actor;
     bool okSafeMode;
     std::vector<std::string> argNames;
+    //! Read only and independent of the calls around it, so that the elements of a batch calling it can run at the same time.
+    bool okBatchParallel = false;
+    RPCCacheScope cacheScope = RPC_CACHE_NONE;
 };
 
 /**
@@ -206,6 +245,8 @@ bool StartRPC();
 void InterruptRPC();
 void StopRPC();
 std::string JSONRPCExecBatch(const UniValue& vReq);
+/** The tip changed, drop the results of the tip cache; hashTip is null when there is no tip (any more). */
+void RPCTipCacheNewTip(const uint256& hashTip);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
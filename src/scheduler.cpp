@@ -7,11 +7,23 @@
 #include "random.h"
 #include "reverselock.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <boost/bind.hpp>
 #include <utility>
 
-CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
+static int64_t TickFloor(const boost::chrono::system_clock::time_point& t)
+{
+    return boost::chrono::duration_cast<boost::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+static int64_t TickCeil(const boost::chrono::system_clock::time_point& t)
+{
+    int64_t nTick = TickFloor(t);
+    return boost::chrono::system_clock::time_point(boost::chrono::milliseconds(nTick)) < t ? nTick + 1 : nTick;
+}
+
+CScheduler::CScheduler() : nCurrentTick(TickFloor(boost::chrono::system_clock::now())), nInWheel(0), nNextId(1), nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
 
@@ -30,6 +42,91 @@ static boost::system_time toPosixTime(const boost::chrono::system_clock::time_po
 }
 #endif
 
+// Move the task at it (in from) to the slot for its tick, or to ready if it is due.
+void CScheduler::place(Slot& from, Slot::iterator it)
+{
+    Slot* to;
+    int64_t nDelta = it->nTick - nCurrentTick;
+    if (nDelta <= 0) {
+        to = &ready;
+    } else {
+        nDelta = std::min(nDelta, (int64_t(1) << (WHEEL_LEVELS * WHEEL_SLOT_BITS)) - 1);
+        int nLevel = 0;
+        while (nDelta >> ((nLevel + 1) * WHEEL_SLOT_BITS))
+            ++nLevel;
+        to = &wheel[nLevel][((nCurrentTick + nDelta) >> (nLevel * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1)];
+        ++nInWheel;
+    }
+    to->splice(to->end(), from, it);
+    tasks[it->id] = std::pair(to, it);
+}
+
+void CScheduler::advance(int64_t nTickNow)
+{
+    while (nCurrentTick < nTickNow) {
+        if (nInWheel == 0) {
+            nCurrentTick = nTickNow;
+            break;
+        }
+        // Far behind (a long wait, or the clock jumped): rather than going through every tick, skip to just before the
+        // first task and place everything anew from there.
+        if (nTickNow - nCurrentTick > WHEEL_SLOTS) {
+            int64_t nNext = nextTick();
+            int64_t nSkipTo = std::min(nTickNow, nNext - 1);
+            if (nSkipTo > nCurrentTick) {
+                Slot all;
+                for (int nLevel = 0; nLevel < WHEEL_LEVELS; ++nLevel)
+                    for (int i = 0; i < WHEEL_SLOTS; ++i)
+                        all.splice(all.end(), wheel[nLevel][i]);
+                nInWheel = 0;
+                nCurrentTick = nSkipTo;
+                while (!all.empty())
+                    place(all, all.begin());
+                continue;
+            }
+        }
+        int64_t nTick = ++nCurrentTick;
+        // Each time a level comes round, the next slot of the level above is spread out over the levels below.
+        for (int nLevel = 1; nLevel < WHEEL_LEVELS; ++nLevel) {
+            if (nTick & ((int64_t(1) << (nLevel * WHEEL_SLOT_BITS)) - 1))
+                break;
+            Slot cascade;
+            Slot& slot = wheel[nLevel][(nTick >> (nLevel * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1)];
+            nInWheel -= slot.size();
+            cascade.splice(cascade.end(), slot);
+            while (!cascade.empty())
+                place(cascade, cascade.begin());
+        }
+        Slot& slot = wheel[0][nTick & (WHEEL_SLOTS - 1)];
+        nInWheel -= slot.size();
+        for (Slot::iterator it = slot.begin(); it != slot.end(); ++it)
+            tasks[it->id].first = &ready;
+        ready.splice(ready.end(), slot);
+    }
+}
+
+int64_t CScheduler::nextTick() const
+{
+    if (nInWheel == 0)
+        return -1;
+    // The first task of a level is in the first non-empty slot after the current one (the current one itself holds
+    // tasks a full revolution away); the first slot of the lowest level only holds tasks of that tick.
+    int64_t nNext = -1;
+    for (int nLevel = 0; nLevel < WHEEL_LEVELS; ++nLevel) {
+        int64_t nCurrentSlot = nCurrentTick >> (nLevel * WHEEL_SLOT_BITS);
+        for (int i = 1; i <= WHEEL_SLOTS; ++i) {
+            const Slot& slot = wheel[nLevel][(nCurrentSlot + i) & (WHEEL_SLOTS - 1)];
+            if (slot.empty())
+                continue;
+            for (const Task& task : slot)
+                if (nNext < 0 || task.nTick < nNext)
+                    nNext = task.nTick;
+            break;
+        }
+    }
+    return nNext;
+}
+
 void CScheduler::serviceQueue()
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
@@ -40,41 +137,53 @@ void CScheduler::serviceQueue()
     // is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && tasks.empty()) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get a tiny bit more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop() && tasks.empty()) {
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
 
             // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
-
+            // the time of the first task in the wheel:
+            while (!shouldStop()) {
+                advance(TickFloor(boost::chrono::system_clock::now()));
+                if (!ready.empty())
+                    break;
+                int64_t nNext = nextTick();
+                if (nNext < 0) {
+                    // Only repeating tasks that are running on other threads.
+                    newTaskScheduled.wait(lock);
+                    continue;
+                }
+                boost::chrono::system_clock::time_point timeToWaitFor = boost::chrono::system_clock::time_point(boost::chrono::milliseconds(nNext));
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
-                // Keep waiting until timeout
-            }
+                newTaskScheduled.timed_wait(lock, toPosixTime(timeToWaitFor));
 #else
-            // Some boost versions have a conflicting overload of wait_until that returns void.
-            // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
-                if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
-                    break; // Exit loop after timeout, it means we reached the time of the event
-            }
+                // Some boost versions have a conflicting overload of wait_until that returns void.
+                // Explicitly use a template here to avoid hitting that overload.
+                newTaskScheduled.wait_until<>(lock, timeToWaitFor);
 #endif
+            }
             // If there are multiple threads, the queue can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop() || ready.empty())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            TaskId id = ready.front().id;
+            int64_t nIntervalMs = ready.front().nIntervalMs;
+            Function f = std::move(ready.front().f);
+            ready.pop_front();
+            if (!ready.empty())
+                newTaskScheduled.notify_one();
+            if (nIntervalMs)
+                tasks[id].first = nullptr;
+            else
+                tasks.erase(id);
 
             {
                 // Unlock before calling f, so it can reschedule itself or another task
@@ -82,6 +191,9 @@ void CScheduler::serviceQueue()
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 f();
             }
+            // Repeating tasks are scheduled again unless they were cancelled while running.
+            if (nIntervalMs && tasks.count(id))
+                insert(id, std::move(f), boost::chrono::system_clock::now() + boost::chrono::milliseconds(nIntervalMs), nIntervalMs);
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -103,39 +215,138 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+// Requires newTaskMutex.
+CScheduler::TaskId CScheduler::insert(TaskId id, Function f, boost::chrono::system_clock::time_point t, int64_t nIntervalMs)
 {
+    // A task that is due before the wheel caught up with now still goes to ready: the ticks behind the wheel
+    // count as passed.
+    Slot slot;
+    slot.push_back(Task{id, t, TickCeil(t), nIntervalMs, std::move(f)});
+    place(slot, slot.begin());
+    return id;
+}
+
+CScheduler::TaskId CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+{
+    TaskId id;
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::pair(t, f));
+        id = insert(nNextId++, std::move(f), t, 0);
     }
     newTaskScheduled.notify_one();
+    return id;
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+CScheduler::TaskId CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    return schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+CScheduler::TaskId CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
 {
-    f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    TaskId id;
+    {
+        boost::unique_lock<boost::mutex> lock(newTaskMutex);
+        id = insert(nNextId++, std::move(f), boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), std::max<int64_t>(deltaMilliSeconds, 1));
+    }
+    newTaskScheduled.notify_one();
+    return id;
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+bool CScheduler::cancel(TaskId id)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    auto it = tasks.find(id);
+    if (it == tasks.end())
+        return false;
+    Slot* slot = it->second.first;
+    if (slot) {
+        if (slot != &ready)
+            --nInWheel;
+        slot->erase(it->second.second);
+    }
+    tasks.erase(it);
+    return true;
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (const auto& entry : tasks) {
+        if (!entry.second.first)
+            continue;
+        const Task& task = *entry.second.second;
+        if (result == 0 || task.time < first)
+            first = task.time;
+        if (result == 0 || task.time > last)
+            last = task.time;
+        ++result;
     }
     return result;
 }
+
+CSingleThreadedSchedulerClient::CSingleThreadedSchedulerClient(CScheduler* pschedulerIn) : pscheduler(pschedulerIn)
+{
+}
+
+void CSingleThreadedSchedulerClient::MaybeScheduleProcessQueue()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csCallbacksPending);
+        // Try to avoid scheduling too many copies here, but if we
+        // accidentally have two ProcessQueue's scheduled at once its
+        // not a big deal.
+        if (fCallbacksRunning || callbacksPending.empty())
+            return;
+    }
+    pscheduler->schedule(std::bind(&CSingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now());
+}
+
+void CSingleThreadedSchedulerClient::ProcessQueue()
+{
+    std::function<void(void)> callback;
+    {
+        boost::unique_lock<boost::mutex> lock(csCallbacksPending);
+        if (fCallbacksRunning || callbacksPending.empty())
+            return;
+        fCallbacksRunning = true;
+        callback = std::move(callbacksPending.front());
+        callbacksPending.pop_front();
+    }
+
+    // RAII the setting of fCallbacksRunning and calling MaybeScheduleProcessQueue
+    // to ensure both happen safely even if callback() throws.
+    struct RAIICallbacksRunning {
+        CSingleThreadedSchedulerClient* instance;
+        explicit RAIICallbacksRunning(CSingleThreadedSchedulerClient* _instance) : instance(_instance) {}
+        ~RAIICallbacksRunning()
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(instance->csCallbacksPending);
+                instance->fCallbacksRunning = false;
+            }
+            instance->MaybeScheduleProcessQueue();
+        }
+    } raiicallbacksrunning(this);
+
+    callback();
+}
+
+void CSingleThreadedSchedulerClient::AddToProcessQueue(std::function<void(void)> func)
+{
+    assert(pscheduler);
+
+    {
+        boost::unique_lock<boost::mutex> lock(csCallbacksPending);
+        callbacksPending.emplace_back(std::move(func));
+    }
+    MaybeScheduleProcessQueue();
+}
+
+size_t CSingleThreadedSchedulerClient::CallbacksPending()
+{
+    boost::unique_lock<boost::mutex> lock(csCallbacksPending);
+    return callbacksPending.size();
+}
@@ -12,7 +12,13 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <list>
 #include <map>
+#include <unordered_map>
+
+//! Default for -schedulerthreads, the number of threads servicing the scheduler
+static const int DEFAULT_SCHEDULER_THREADS = 2;
+static const int MAX_SCHEDULER_THREADS = 16;
 
 //
 // Simple class for background tasks that should be run
@@ -31,6 +37,11 @@
 // delete t;
 // delete s; // Must be done after thread is interrupted/joined.
 //
+// The tasks are kept in a hierarchical timer wheel with a resolution of a millisecond, so scheduling and cancelling
+// are constant time however many tasks there are. Any number of threads can service the queue; tasks that are due
+// at the same time may then run at the same time, tasks that have to run one after the other can go through a
+// CSingleThreadedSchedulerClient.
+//
 
 class CScheduler
 {
@@ -39,21 +50,25 @@ public:
     ~CScheduler();
 
     typedef std::function<void(void)> Function;
+    //! Identifies a scheduled task, for cancel; never 0.
+    typedef uint64_t TaskId;
 
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t);
+    TaskId schedule(Function f, boost::chrono::system_clock::time_point t);
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    TaskId scheduleFromNow(Function f, int64_t deltaMilliSeconds);
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    TaskId scheduleEvery(Function f, int64_t deltaMilliSeconds);
 
-    // To keep things as simple as possible, there is no unschedule.
+    // Remove a task that hasn't run yet, or stop a repeating one (a run in progress completes). Returns false if
+    // there was no such task (anymore).
+    bool cancel(TaskId id);
 
     // Services the queue 'forever'. Should be run in a thread,
     // and interrupted using boost::interrupt_thread
@@ -70,13 +85,69 @@ public:
                         boost::chrono::system_clock::time_point &last) const;
 
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    // Four levels of 256 slots: the first has a slot per millisecond, each next one a slot per revolution of the one
+    // below it, reaching out to 2^32 milliseconds (49 days); tasks that are further away are put in the last slot they
+    // can reach and placed again once they get there.
+    static const int WHEEL_LEVELS = 4;
+    static const int WHEEL_SLOT_BITS = 8;
+    static const int WHEEL_SLOTS = 1 << WHEEL_SLOT_BITS;
+
+    struct Task
+    {
+        TaskId id;
+        boost::chrono::system_clock::time_point time;
+        //! Milliseconds since the epoch, rounded up so a task never runs early.
+        int64_t nTick;
+        //! For repeating tasks, 0 for the others.
+        int64_t nIntervalMs;
+        Function f;
+    };
+    typedef std::list<Task> Slot;
+
+    TaskId insert(TaskId id, Function f, boost::chrono::system_clock::time_point t, int64_t nIntervalMs);
+    void place(Slot& from, Slot::iterator it);
+    void advance(int64_t nTickNow);
+    //! Tick of the first task in the wheel, -1 if it is empty.
+    int64_t nextTick() const;
+
+    Slot wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    //! Tasks that are due, in the order they became due.
+    Slot ready;
+    //! Where every task is: its slot (wheel or ready) and position in it; nullptr for repeating tasks that are running.
+    std::unordered_map<TaskId, std::pair<Slot*, Slot::iterator>> tasks;
+    //! All ticks up to and including this one have been handled.
+    int64_t nCurrentTick;
+    size_t nInWheel;
+    TaskId nNextId;
+
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool shouldStop() { return stopRequested || (stopWhenEmpty && tasks.empty()); }
+};
+
+/**
+ * Runs the functions added to it one at a time, in the order they were added, on the threads of a scheduler; for
+ * work that depends on what was done before it but shouldn't keep other scheduler tasks waiting.
+ */
+class CSingleThreadedSchedulerClient
+{
+public:
+    explicit CSingleThreadedSchedulerClient(CScheduler* pschedulerIn);
+
+    void AddToProcessQueue(std::function<void(void)> func);
+    size_t CallbacksPending();
+
+private:
+    void MaybeScheduleProcessQueue();
+    void ProcessQueue();
+
+    CScheduler* pscheduler;
+    boost::mutex csCallbacksPending;
+    std::list<std::function<void(void)>> callbacksPending;
+    bool fCallbacksRunning = false;
 };
 
 #endif
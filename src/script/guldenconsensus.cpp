@@ -18,6 +18,10 @@
 #include "version.h"
 #include "validation/validation.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 namespace {
 
 /** A class that deserializes a single CTransaction one time. */
@@ -152,6 +156,65 @@ int guldenconsensus_verify_script(const unsigned char *scriptPubKey, unsigned in
     return ::verify_script(scriptPubKey, scriptPubKeyLen, am, txTo, txToLen, nIn, flags, err);
 }
 
+int guldenconsensus_verify_transaction(const unsigned char *txTo, unsigned int txToLen,
+                                       const guldenconsensus_spent_output *spentOutputs, unsigned int spentOutputsLen,
+                                       unsigned int flags, unsigned int nThreads, int *inputResults, guldenconsensus_error* err)
+{
+    if (!verify_flags(flags))
+        return set_error(err, guldenconsensus_ERR_INVALID_FLAGS);
+    try {
+        TxInputStream stream(SER_NETWORK, PROTOCOL_VERSION, txTo, txToLen);
+        CTransaction tx(deserialize, stream);
+        if (GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) != txToLen)
+            return set_error(err, guldenconsensus_ERR_TX_SIZE_MISMATCH);
+        if (spentOutputsLen != tx.vin.size() || (spentOutputsLen > 0 && !spentOutputs))
+            return set_error(err, guldenconsensus_ERR_SPENT_OUTPUTS_MISMATCH);
+
+        set_error(err, guldenconsensus_ERR_OK);
+
+        // Shared by all inputs (and threads), it is only read once built.
+        PrecomputedTransactionData txdata(tx);
+        //fixme: (2.0.1) (SEGSIG) (HIGH) - can't pass CKeyID(), need the actual keyID
+        CKeyID tempKeyID;
+        std::vector<int> results(tx.vin.size(), 0);
+        std::atomic<unsigned int> nNext(0);
+        auto verifyInputs = [&]()
+        {
+            // Inputs are handed out one at a time, as their scripts can take very different times to verify.
+            for (unsigned int nIn = nNext++; nIn < tx.vin.size(); nIn = nNext++)
+            {
+                const guldenconsensus_spent_output& spent = spentOutputs[nIn];
+                CScript scriptPubKey(spent.scriptPubKey, spent.scriptPubKey + spent.scriptPubKeyLen);
+                results[nIn] = VerifyScript(tx.vin[nIn].scriptSig, scriptPubKey, &tx.vin[nIn].segregatedSignatureData, flags, TransactionSignatureChecker(tempKeyID, tempKeyID, &tx, nIn, spent.amount, txdata), NULL) ? 1 : 0;
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < std::min<size_t>(nThreads, tx.vin.size()); ++i)
+        {
+            // Fewer threads (down to just this one) only take longer.
+            try {
+                threads.emplace_back(verifyInputs);
+            } catch (const std::system_error&) {
+                break;
+            }
+        }
+        verifyInputs();
+        for (std::thread& thread : threads)
+            thread.join();
+
+        int nAllValid = 1;
+        for (unsigned int nIn = 0; nIn < results.size(); ++nIn)
+        {
+            if (inputResults)
+                inputResults[nIn] = results[nIn];
+            nAllValid &= results[nIn];
+        }
+        return nAllValid;
+    } catch (const std::exception&) {
+        return set_error(err, guldenconsensus_ERR_TX_DESERIALIZE); // Error deserializing
+    }
+}
+
 unsigned int guldenconsensus_version()
 {
     // Just use the API version for now
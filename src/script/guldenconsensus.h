@@ -33,7 +33,7 @@
 extern "C" {
 #endif
 
-#define GULDENCONSENSUS_API_VER 1
+#define GULDENCONSENSUS_API_VER 2
 
 typedef enum guldenconsensus_error_t
 {
@@ -43,6 +43,7 @@ typedef enum guldenconsensus_error_t
     guldenconsensus_ERR_TX_DESERIALIZE,
     guldenconsensus_ERR_AMOUNT_REQUIRED,
     guldenconsensus_ERR_INVALID_FLAGS,
+    guldenconsensus_ERR_SPENT_OUTPUTS_MISMATCH,
 } guldenconsensus_error;
 
 /** Script verification flags */
@@ -72,6 +73,27 @@ EXPORT_SYMBOL int guldenconsensus_verify_script_with_amount(const unsigned char
                                     const unsigned char *txTo        , unsigned int txToLen,
                                     unsigned int nIn, unsigned int flags, guldenconsensus_error* err);
 
+/// The output spent by one input of a transaction.
+typedef struct guldenconsensus_spent_output
+{
+    const unsigned char *scriptPubKey;
+    unsigned int scriptPubKeyLen;
+    int64_t amount;
+} guldenconsensus_spent_output;
+
+/// Returns 1 if every input of the serialized transaction pointed to by txTo
+/// correctly spends the output at the same index of spentOutputs (of which
+/// there must be exactly one per input) under the constraints of flags.
+/// The transaction is deserialized and its signature hashes prepared only
+/// once for all inputs, which are verified on up to nThreads threads (the
+/// calling thread alone for 0 or 1).
+/// If not NULL, inputResults (one per input) receives 1 or 0 for each input
+/// and err an error/success code for the operation; with an error the
+/// return value is 0 and inputResults is left untouched.
+EXPORT_SYMBOL int guldenconsensus_verify_transaction(const unsigned char *txTo, unsigned int txToLen,
+                                                      const guldenconsensus_spent_output *spentOutputs, unsigned int spentOutputsLen,
+                                                      unsigned int flags, unsigned int nThreads, int *inputResults, guldenconsensus_error* err);
+
 EXPORT_SYMBOL unsigned int guldenconsensus_version();
 
 #ifdef __cplusplus
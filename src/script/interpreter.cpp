@@ -1183,10 +1183,12 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 } // anon namespace
 
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+: segsigHashAllPrefix(SER_GETHASH, 0)
 {
     hashPrevouts = GetPrevoutHash(txTo);
     hashSequence = GetSequenceHash(txTo);
     hashOutputs = GetOutputsHash(txTo);
+    segsigHashAllPrefix << txTo.nVersion << hashPrevouts << hashSequence;
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1214,12 +1216,17 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
             hashOutputs = ss.GetHash();
         }
 
-        CHashWriter ss(SER_GETHASH, 0);
-        // Version
-        ss << txTo.nVersion;
-        // Input prevouts/nSequence (none/all, depending on flags)
-        ss << hashPrevouts;
-        ss << hashSequence;
+        // Everything up to the input being signed is the same for all SIGHASH_ALL signatures of the transaction
+        bool fHashAll = !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE;
+        CHashWriter ss = (cache && fHashAll) ? cache->segsigHashAllPrefix : CHashWriter(SER_GETHASH, 0);
+        if (!cache || !fHashAll)
+        {
+            // Version
+            ss << txTo.nVersion;
+            // Input prevouts/nSequence (none/all, depending on flags)
+            ss << hashPrevouts;
+            ss << hashSequence;
+        }
         // The input being signed (replacing the scriptSig with scriptCode + amount)
         // The prevout may already be contained in hashPrevout, and the nSequence
         // may already be contain in hashSequence.
@@ -1410,6 +1417,114 @@ static CScript PushAll(const std::vector<valtype>& values)
     return result;
 }
 
+/**
+ * Get the N elements that scriptSig (or, if it is empty, the segregated signature data) puts on the stack, bottom first, without running EvalScript.
+ * Returns false unless that is exactly N data pushes that EvalScript would accept under flags; the caller then falls back to EvalScript, which also
+ * reports the right error.
+ */
+template <size_t N>
+static bool GetTemplatePushes(const CScript& scriptSig, const CSegregatedSignatureData& witness, unsigned int flags, std::array<valtype, N>& storage, std::array<const valtype*, N>& pushes)
+{
+    if (scriptSig.size() == 0)
+    {
+        if (witness.stack.size() != N)
+            return false;
+        for (size_t i = 0; i < N; ++i)
+        {
+            const valtype& vch = witness.stack[i];
+            // PushAll encodes 0x81 as a one byte push, which MINIMALDATA rejects.
+            if (vch.size() > MAX_SCRIPT_ELEMENT_SIZE || ((flags & SCRIPT_VERIFY_MINIMALDATA) && vch.size() == 1 && vch[0] == 0x81))
+                return false;
+            pushes[i] = &vch;
+        }
+        return true;
+    }
+
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (!scriptSig.GetOp(pc, opcode, storage[i]) || opcode > OP_PUSHDATA4 || storage[i].size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(storage[i], opcode))
+            return false;
+        pushes[i] = &storage[i];
+    }
+    return pc == scriptSig.end();
+}
+
+/**
+ * Verify spends of the common output shapes, pay to pubkey hash and the two signature PoW² witness spend, directly instead of through EvalScript.
+ * Returns false if the spend doesn't have one of these exact shapes. Otherwise fResult (and serror) are set to what the generic evaluation in
+ * VerifyScript gives.
+ */
+static bool VerifyTemplateScript(const CScript& scriptSig, const CScript& scriptPubKey, const CSegregatedSignatureData& witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    // OP_DUP OP_HASH160 <20 byte key hash> OP_EQUALVERIFY OP_CHECKSIG
+    if (scriptPubKey.size() == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 0x14 && scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG)
+    {
+        std::array<valtype, 2> storage;
+        std::array<const valtype*, 2> pushes;
+        if (!GetTemplatePushes(scriptSig, witness, flags, storage, pushes))
+            return false;
+        const valtype& vchSig = *pushes[0];
+        const valtype& vchPubKey = *pushes[1];
+
+        // OP_CHECKSIG removes pushes of the signature from scriptCode; the key hash push is the only one that can match, and only a 20 byte signature can.
+        if (vchSig.size() == 20)
+            return false;
+
+        uint160 hash = Hash160(vchPubKey.begin(), vchPubKey.end());
+        if (memcmp(hash.begin(), &scriptPubKey[3], 20) != 0)
+        {
+            fResult = set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+            return true;
+        }
+        if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, serror))
+        {
+            fResult = false;
+            return true;
+        }
+        if (!checker.CheckSig(vchSig, vchPubKey, scriptPubKey, SIGVERSION_BASE))
+        {
+            fResult = set_error(serror, ((flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size()) ? SCRIPT_ERR_SIG_NULLFAIL : SCRIPT_ERR_EVAL_FALSE);
+            return true;
+        }
+        fResult = set_success(serror);
+        return true;
+    }
+
+    // Witness key and spending key signatures, see the special case in VerifyScript.
+    if (scriptPubKey.IsPoW2Witness())
+    {
+        std::array<valtype, 4> storage;
+        std::array<const valtype*, 4> pushes;
+        if (!GetTemplatePushes(scriptSig, witness, flags, storage, pushes))
+            return false;
+        const valtype& vchSig2    = *pushes[0];
+        const valtype& vchPubKey2 = *pushes[1];
+        const valtype& vchSig1    = *pushes[2];
+        const valtype& vchPubKey1 = *pushes[3];
+
+        // Failures other than encoding leave serror at unknown, as in VerifyScript; so the cheap key checks can go before the signature checks.
+        fResult = false;
+        if (checker.spendingKeyID.IsNull() || checker.signatureKeyID.IsNull())
+            return true;
+        if (!CheckSignatureEncoding(vchSig1, flags, serror) || !CheckPubKeyEncoding(vchPubKey1, flags, SIGVERSION_BASE, serror))
+            return true;
+        if (!CheckSignatureEncoding(vchSig2, flags, serror) || !CheckPubKeyEncoding(vchPubKey2, flags, SIGVERSION_BASE, serror))
+            return true;
+        if (checker.signatureKeyID != CPubKey(vchPubKey1).GetID() || checker.spendingKeyID != CPubKey(vchPubKey2).GetID())
+            return true;
+        if (!checker.CheckSig(vchSig1, vchPubKey1, scriptPubKey, SIGVERSION_BASE) || !checker.CheckSig(vchSig2, vchPubKey2, scriptPubKey, SIGVERSION_BASE))
+            return true;
+        fResult = set_success(serror);
+        return true;
+    }
+
+    return false;
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CSegregatedSignatureData* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CSegregatedSignatureData emptyWitness;
@@ -1424,6 +1539,10 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    bool fTemplateResult;
+    if (VerifyTemplateScript(scriptSig, scriptPubKey, *witness, flags, checker, serror, fTemplateResult))
+        return fTemplateResult;
+
     std::vector<std::vector<unsigned char> > stack, stackCopy;
     if (scriptSig.size() == 0 && witness)
     {
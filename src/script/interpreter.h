@@ -14,6 +14,7 @@
 #define GULDEN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "hash.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -109,6 +110,8 @@ bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned i
 struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
+    //! SegSig signature hash of SIGHASH_ALL signatures, as far as it is the same for every input (version, hashPrevouts and hashSequence); copied to carry on from.
+    CHashWriter segsigHashAllPrefix;
 
     PrecomputedTransactionData(const CTransaction& tx);
 };
@@ -5,8 +5,12 @@
 
 #include "sigcache.h"
 
+#include "clientversion.h"
+#include "fs.h"
+#include "hash.h"
 #include "memusage.h"
 #include "pubkey.h"
+#include "streams.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
@@ -57,6 +61,22 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        setValid.for_each([&](const uint256& entry) { entries.push_back(entry); });
+    }
+
+    //! Entries are only valid with the nonce they were computed with, so this replaces the nonce as well.
+    void SetEntries(const uint256& nonceIn, const std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (uint256 entry : entries)
+            setValid.insert(entry);
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -80,6 +100,87 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
 }
 
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+bool LoadSignatureCache()
+{
+    int64_t nStart = GetTimeMicros();
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+
+    uint256 nonce;
+    std::vector<uint256> entries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION)
+            return false;
+        file >> nonce;
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        hasher << version << nonce;
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            uint256 entry;
+            file >> entry;
+            hasher << entry;
+            entries.push_back(entry);
+        }
+        // The entries are trusted as verified signatures, so make sure the file is complete and intact before using any of them.
+        uint256 hashCheck;
+        file >> hashCheck;
+        if (hasher.GetHash() != hashCheck)
+        {
+            LogPrintf("Signature cache file on disk is corrupt. Continuing anyway.\n");
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    signatureCache.SetEntries(nonce, entries);
+    LogPrintf("Imported %u signature cache entries from disk: %gs\n", entries.size(), (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
+bool DumpSignatureCache()
+{
+    int64_t nStart = GetTimeMicros();
+
+    uint256 nonce;
+    std::vector<uint256> entries;
+    signatureCache.GetEntries(nonce, entries);
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr)
+            return false;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        uint64_t version = SIGCACHE_DUMP_VERSION;
+        file << version << nonce << (uint64_t)entries.size();
+        hasher << version << nonce;
+        for (const uint256& entry : entries) {
+            file << entry;
+            hasher << entry;
+        }
+        file << hasher.GetHash();
+
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat"))
+            return false;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    LogPrintf("Dumped %u signature cache entries: %gs\n", entries.size(), (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
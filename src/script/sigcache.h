@@ -23,6 +23,8 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+//! Save the signature cache on shutdown and load it again on startup
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
 
 class CPubKey;
 
@@ -59,5 +61,10 @@ public:
 };
 
 void InitSignatureCache();
+/** Load the signature cache entries, and the nonce they were computed with, that DumpSignatureCache saved to sigcache.dat.
+ *  Must be called after InitSignatureCache and before any signature is checked (the nonce changes). */
+bool LoadSignatureCache();
+/** Save the signature cache to sigcache.dat in the data directory; no signatures should be checked while this runs. */
+bool DumpSignatureCache();
 
 #endif // GULDEN_SCRIPT_SIGCACHE_H
@@ -29,6 +29,7 @@
 #include <vector>
 #include <type_traits>
 
+#include "crypto/common.h"
 #include "prevector.h"
 #include "support/allocators/secure.h"
 
@@ -68,6 +69,25 @@ inline T* NCONST_PTR(const T* val)
     return const_cast<T*>(val);
 }
 
+/**
+ * Whether the serialized form of T is exactly its representation in memory, so that a contiguous array of them is written
+ * and read with a single copy instead of element by element: bytes, fixed size integers on little endian hosts, and types
+ * that say so with a SERIALIZED_AS_MEMORY member (see base_blob).
+ */
+template<typename T, typename = void> struct is_serialized_as_memory : std::false_type {};
+template<typename T> struct is_serialized_as_memory<T, std::void_t<decltype(T::SERIALIZED_AS_MEMORY)>> : std::integral_constant<bool, T::SERIALIZED_AS_MEMORY> {};
+template<> struct is_serialized_as_memory<char> : std::true_type {};
+template<> struct is_serialized_as_memory<int8_t> : std::true_type {};
+template<> struct is_serialized_as_memory<uint8_t> : std::true_type {};
+#if !defined(WORDS_BIGENDIAN)
+template<> struct is_serialized_as_memory<int16_t> : std::true_type {};
+template<> struct is_serialized_as_memory<uint16_t> : std::true_type {};
+template<> struct is_serialized_as_memory<int32_t> : std::true_type {};
+template<> struct is_serialized_as_memory<uint32_t> : std::true_type {};
+template<> struct is_serialized_as_memory<int64_t> : std::true_type {};
+template<> struct is_serialized_as_memory<uint64_t> : std::true_type {};
+#endif
+
 /*
  * Lowest-level serialization and conversion.
  * @note Sizes of these types are verified in the tests
@@ -234,26 +254,31 @@ inline void WriteCompactSize(CSizeComputer& os, uint64_t nSize);
 template<typename Stream>
 void WriteCompactSize(Stream& os, uint64_t nSize)
 {
+    // Put together in place and handed to the stream in one write.
+    unsigned char buf[9];
     if (nSize < 253)
     {
-        ser_writedata8(os, nSize);
+        buf[0] = nSize;
+        os.write((char*)buf, 1);
     }
     else if (nSize <= std::numeric_limits<unsigned short>::max())
     {
-        ser_writedata8(os, 253);
-        ser_writedata16(os, nSize);
+        buf[0] = 253;
+        WriteLE16(buf + 1, nSize);
+        os.write((char*)buf, 3);
     }
     else if (nSize <= std::numeric_limits<unsigned int>::max())
     {
-        ser_writedata8(os, 254);
-        ser_writedata32(os, nSize);
+        buf[0] = 254;
+        WriteLE32(buf + 1, nSize);
+        os.write((char*)buf, 5);
     }
     else
     {
-        ser_writedata8(os, 255);
-        ser_writedata64(os, nSize);
+        buf[0] = 255;
+        WriteLE64(buf + 1, nSize);
+        os.write((char*)buf, 9);
     }
-    return;
 }
 
 template<typename Stream>
@@ -331,18 +356,15 @@ inline void WriteVarInt(CSizeComputer& os, I n);
 template<typename Stream, typename I>
 void WriteVarInt(Stream& os, I n)
 {
+    // The digits come out least significant first, so fill the buffer from the back and write it in one go.
     unsigned char tmp[(sizeof(n)*8+6)/7];
-    int len=0;
-    while(true) {
-        tmp[len] = (n & 0x7F) | (len ? 0x80 : 0x00);
-        if (n <= 0x7F)
-            break;
+    size_t pos = sizeof(tmp) - 1;
+    tmp[pos] = n & 0x7F;
+    while (n > 0x7F) {
         n = (n >> 7) - 1;
-        len++;
+        tmp[--pos] = (n & 0x7F) | 0x80;
     }
-    do {
-        ser_writedata8(os, tmp[len]);
-    } while(len--);
+    os.write((char*)tmp + pos, sizeof(tmp) - pos);
 }
 
 template<typename Stream, typename I>
@@ -694,6 +716,52 @@ void Unserialize(Stream& is, std::basic_string<C, T, A>& str)
 
 
 
+/**
+ * The elements of a vector or prevector, after its size: one write for types serialized as their memory representation.
+ */
+template<typename Stream, typename T>
+void SerializeElements(Stream& os, const T* pElements, size_t nElements)
+{
+    if constexpr (is_serialized_as_memory<T>::value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "serialized as memory but not trivially copyable");
+        if (nElements)
+            os.write((const char*)pElements, nElements * sizeof(T));
+    }
+    else
+    {
+        for (size_t i = 0; i < nElements; ++i)
+            ::Serialize(os, pElements[i]);
+    }
+}
+
+template<typename Stream, typename V>
+void UnserializeElements(Stream& is, V& v, unsigned int nSize)
+{
+    typedef typename V::value_type T;
+    // Limit size per read so bogus size value won't cause out of memory
+    v.clear();
+    unsigned int i = 0;
+    unsigned int nMid = 0;
+    while (nMid < nSize)
+    {
+        nMid += 5000000 / sizeof(T);
+        if (nMid > nSize)
+            nMid = nSize;
+        v.resize(nMid);
+        if constexpr (is_serialized_as_memory<T>::value)
+        {
+            is.read((char*)&v[i], (nMid - i) * sizeof(T));
+            i = nMid;
+        }
+        else
+        {
+            for (; i < nMid; i++)
+                Unserialize(is, v[i]);
+        }
+    }
+}
+
 /**
  * prevector
  */
@@ -709,8 +777,8 @@ template<typename Stream, unsigned int N, typename T, typename V>
 void Serialize_impl(Stream& os, const prevector<N, T>& v, const V&)
 {
     WriteCompactSize(os, v.size());
-    for (typename prevector<N, T>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
-        ::Serialize(os, (*vi));
+    if (!v.empty())
+        SerializeElements(os, &v[0], v.size());
 }
 
 template<typename Stream, unsigned int N, typename T>
@@ -739,19 +807,7 @@ void Unserialize_impl(Stream& is, prevector<N, T>& v, const unsigned char&)
 template<typename Stream, unsigned int N, typename T, typename V>
 void Unserialize_impl(Stream& is, prevector<N, T>& v, const V&)
 {
-    v.clear();
-    unsigned int nSize = ReadCompactSize(is);
-    unsigned int i = 0;
-    unsigned int nMid = 0;
-    while (nMid < nSize)
-    {
-        nMid += 5000000 / sizeof(T);
-        if (nMid > nSize)
-            nMid = nSize;
-        v.resize(nMid);
-        for (; i < nMid; i++)
-            Unserialize(is, v[i]);
-    }
+    UnserializeElements(is, v, ReadCompactSize(is));
 }
 
 template<typename Stream, unsigned int N, typename T>
@@ -770,8 +826,7 @@ void Serialize(Stream& os, const vectoroverwritewrapper<const std::vector<K>, co
 {
     const std::vector<K>& v = item.vector;
     WriteCompactSize(os, v.size());
-    for (typename std::vector<K>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
-        ::Serialize(os, (*vi));
+    SerializeElements(os, v.data(), v.size());
 }
 
 template<typename Stream, typename K>
@@ -779,8 +834,7 @@ void Serialize(Stream& os, const vectoroverwritewrapper<std::vector<K>, compacts
 {
     const std::vector<K>& v = item.vector;
     WriteCompactSize(os, v.size());
-    for (typename std::vector<K>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
-        ::Serialize(os, (*vi));
+    SerializeElements(os, v.data(), v.size());
 }
 
 template<typename Stream, typename K>
@@ -855,20 +909,7 @@ void Serialize(Stream& os, const vectoroverwritewrapper<std::vector<unsigned cha
 template<typename Stream, typename K>
 void Unserialize(Stream& is, vectoroverwritewrapper<std::vector<K>, compactsizevectorwrapper>& item)
 {
-    std::vector<K>& v = item.vector;
-    v.clear();
-    unsigned int nSize = ReadCompactSize(is);
-    unsigned int i = 0;
-    unsigned int nMid = 0;
-    while (nMid < nSize)
-    {
-        nMid += 5000000 / sizeof(K);
-        if (nMid > nSize)
-            nMid = nSize;
-        v.resize(nMid);
-        for (; i < nMid; i++)
-            Unserialize(is, v[i]);
-    }
+    UnserializeElements(is, item.vector, ReadCompactSize(is));
 }
 
 template<typename Stream, typename K>
@@ -978,8 +1019,7 @@ void Serialize(Stream& os, const vectoroverwritewrapper<std::vector<K>, varintve
 {
     const std::vector<K>& v = item.vector;
     WriteVarInt(os, v.size());
-    for (typename std::vector<K>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
-        ::Serialize(os, (*vi));
+    SerializeElements(os, v.data(), v.size());
 }
 
 template<typename Stream, typename K>
@@ -987,8 +1027,7 @@ void Serialize(Stream& os, vectoroverwritewrapper<std::vector<K>, varintvectorwr
 {
     std::vector<K>& v = item.vector;
     WriteVarInt(os, v.size());
-    for (typename std::vector<K>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
-        ::Serialize(os, (*vi));
+    SerializeElements(os, v.data(), v.size());
 }
 
 template<typename Stream, typename K>
@@ -1023,20 +1062,7 @@ void Serialize(Stream& os, vectoroverwritewrapper<std::vector<unsigned char>, va
 template<typename Stream, typename K>
 void Unserialize(Stream& is, vectoroverwritewrapper<std::vector<K>, varintvectorwrapper>& item)
 {
-    std::vector<K>& v = item.vector;
-    v.clear();
-    unsigned int nSize = ReadVarInt<Stream, unsigned int>(is);
-    unsigned int i = 0;
-    unsigned int nMid = 0;
-    while (nMid < nSize)
-    {
-        nMid += 5000000 / sizeof(K);
-        if (nMid > nSize)
-            nMid = nSize;
-        v.resize(nMid);
-        for (; i < nMid; i++)
-            Unserialize(is, v[i]);
-    }
+    UnserializeElements(is, item.vector, ReadVarInt<Stream, unsigned int>(is));
 }
 
 template<typename Stream, typename K>
@@ -1457,6 +1483,15 @@ inline void WriteCompactSize(CSizeComputer &s, uint64_t nSize)
     s.seek(GetSizeOfCompactSize(nSize));
 }
 
+/** The size of args serialized one after the other, e.g. to reserve a buffer for them in one go. */
+template<typename... Args>
+size_t GetSerializeSizeMany(int nType, int nVersion, const Args&... args)
+{
+    CSizeComputer s(nType, nVersion);
+    ::SerializeMany(s, args...);
+    return s.size();
+}
+
 template <typename T>
 size_t GetSerializeSize(const T& t, int nType, int nVersion = 0)
 {
@@ -150,6 +150,74 @@ private:
     size_t nPos;
 };
 
+/* Minimal stream for reading from an existing byte range (e.g. a memory mapped file) without copying it
+ *
+ * The referenced memory has to stay valid for as long as the reader is used.
+ */
+class CMemoryReader
+{
+ public:
+
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pDataIn  Start of the bytes to read
+ * @param[in]  nSizeIn  Number of bytes available at pDataIn
+*/
+    CMemoryReader(int nTypeIn, int nVersionIn, const unsigned char* pDataIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pData(pDataIn), nSize(nSizeIn)
+    {
+    }
+    void read(char* pch, size_t nRead)
+    {
+        if (nRead > nSize)
+            throw std::ios_base::failure("CMemoryReader::read(): end of data");
+        memcpy(pch, pData, nRead);
+        pData += nRead;
+        nSize -= nRead;
+    }
+    void peek(char* pch, size_t nPeek)
+    {
+        if (nPeek > nSize)
+            throw std::ios_base::failure("CMemoryReader::peek(): end of data");
+        memcpy(pch, pData, nPeek);
+    }
+    void ignore(size_t nIgnore)
+    {
+        if (nIgnore > nSize)
+            throw std::ios_base::failure("CMemoryReader::ignore(): end of data");
+        pData += nIgnore;
+        nSize -= nIgnore;
+    }
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const
+    {
+        return nSize;
+    }
+    bool empty() const
+    {
+        return nSize == 0;
+    }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pData;
+    size_t nSize;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -257,6 +325,8 @@ public:
     void insert(iterator it, size_type n, const char& x) { vch.insert(it, n, x); }
     value_type* data()                               { return vch.data() + nReadPos; }
     const value_type* data() const                   { return vch.data() + nReadPos; }
+    //! Exchange the underlying buffer with vchOther (to take it from or return it to a pool), reading starts over.
+    void swap_data(vector_type& vchOther)             { vch.swap(vchOther); nReadPos = 0; }
 
     void insert(iterator it, std::vector<char>::const_iterator first, std::vector<char>::const_iterator last)
     {
@@ -0,0 +1,188 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_SUPPORT_ALLOCATORS_POOL_H
+#define GULDEN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <new>
+
+/**
+ * A memory resource for node based containers, which allocate (and free) many objects of the same few sizes.
+ *
+ * Memory is taken from the system in chunks of nChunkSizeBytes and carved up into blocks; freed blocks go onto a free list per size and are reused for
+ * later allocations of that size. Nothing is returned to the system before the resource itself is destroyed.
+ * Compared to a plain new per node this saves the per allocation malloc overhead, keeps nodes close together in memory and makes freeing a whole
+ * container (e.g. a coins cache on flush) a matter of freeing a handful of chunks.
+ *
+ * Allocations larger than MAX_BLOCK_SIZE_BYTES, or with a stricter alignment than ALIGN_BYTES, go to operator new as usual (e.g. the bucket array of an
+ * unordered_map).
+ * Not thread safe; it is meant to be owned by the container that uses it, and is subject to the same locking.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class CPoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= sizeof(void*), "a free block has to be able to hold the free list pointer");
+    static_assert(ALIGN_BYTES <= alignof(std::max_align_t), "chunks come from operator new, which only guarantees max_align_t alignment");
+
+    //! Blocks are handed out in multiples of ELEM_ALIGN_BYTES, so that every block is suitably aligned and large enough to link it into a free list.
+    static constexpr std::size_t ELEM_ALIGN_BYTES = ALIGN_BYTES;
+    static constexpr std::size_t NUM_FREE_LISTS = (MAX_BLOCK_SIZE_BYTES + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + 1;
+
+    struct ListNode
+    {
+        ListNode* next;
+    };
+
+public:
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE_BYTES = 262144;
+
+    explicit CPoolResource(std::size_t nChunkSizeBytesIn = DEFAULT_CHUNK_SIZE_BYTES)
+    : nChunkSizeBytes(RoundUp(nChunkSizeBytesIn < MAX_BLOCK_SIZE_BYTES ? MAX_BLOCK_SIZE_BYTES : nChunkSizeBytesIn))
+    {
+        freeLists.fill(nullptr);
+    }
+
+    ~CPoolResource()
+    {
+        for (void* chunk : allocatedChunks)
+            ::operator delete(chunk);
+    }
+
+    CPoolResource(const CPoolResource&) = delete;
+    CPoolResource& operator=(const CPoolResource&) = delete;
+
+    void* Allocate(std::size_t nBytes, std::size_t nAlignment)
+    {
+        if (!IsPooled(nBytes, nAlignment))
+            return ::operator new(nBytes);
+
+        const std::size_t nIndex = FreeListIndex(nBytes);
+        if (freeLists[nIndex])
+        {
+            ListNode* node = freeLists[nIndex];
+            freeLists[nIndex] = node->next;
+            return node;
+        }
+
+        const std::size_t nBlockBytes = nIndex * ELEM_ALIGN_BYTES;
+        if (nBlockBytes > nChunkBytesLeft)
+        {
+            // Whatever is left of the current chunk goes onto the free list that fits it, so that it doesn't go to waste.
+            if (nChunkBytesLeft > 0)
+                PushFree(pChunkPos, nChunkBytesLeft / ELEM_ALIGN_BYTES);
+            AllocateChunk();
+        }
+        void* block = pChunkPos;
+        pChunkPos += nBlockBytes;
+        nChunkBytesLeft -= nBlockBytes;
+        return block;
+    }
+
+    void Deallocate(void* p, std::size_t nBytes, std::size_t nAlignment) noexcept
+    {
+        if (!IsPooled(nBytes, nAlignment))
+        {
+            ::operator delete(p);
+            return;
+        }
+        PushFree(static_cast<char*>(p), FreeListIndex(nBytes));
+    }
+
+    //! Number of chunks taken from the system so far.
+    std::size_t NumAllocatedChunks() const { return allocatedChunks.size(); }
+
+    std::size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+
+private:
+    static constexpr std::size_t RoundUp(std::size_t nBytes)
+    {
+        return (nBytes + ELEM_ALIGN_BYTES - 1) & ~(ELEM_ALIGN_BYTES - 1);
+    }
+
+    static constexpr bool IsPooled(std::size_t nBytes, std::size_t nAlignment)
+    {
+        return nBytes > 0 && nBytes <= MAX_BLOCK_SIZE_BYTES && nAlignment <= ALIGN_BYTES;
+    }
+
+    static constexpr std::size_t FreeListIndex(std::size_t nBytes)
+    {
+        return RoundUp(nBytes) / ELEM_ALIGN_BYTES;
+    }
+
+    void PushFree(char* p, std::size_t nIndex)
+    {
+        ListNode* node = new (p) ListNode{freeLists[nIndex]};
+        freeLists[nIndex] = node;
+    }
+
+    void AllocateChunk()
+    {
+        void* chunk = ::operator new(nChunkSizeBytes);
+        allocatedChunks.push_back(chunk);
+        pChunkPos = static_cast<char*>(chunk);
+        nChunkBytesLeft = nChunkSizeBytes;
+    }
+
+    const std::size_t nChunkSizeBytes;
+    std::list<void*> allocatedChunks;
+    std::array<ListNode*, NUM_FREE_LISTS> freeLists;
+    char* pChunkPos = nullptr;
+    std::size_t nChunkBytesLeft = 0;
+};
+
+/**
+ * Allocator for std containers that takes its memory from a CPoolResource.
+ * The resource has to outlive every container (and copy of the allocator) using it.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(std::max_align_t)>
+class CPoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef CPoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    CPoolAllocator(ResourceType* resourceIn) noexcept : resource(resourceIn) {}
+
+    template <class U>
+    CPoolAllocator(const CPoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : resource(other.Resource()) {}
+
+    template <class U>
+    struct rebind
+    {
+        typedef CPoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* Resource() const noexcept { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const CPoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const CPoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.Resource() == b.Resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const CPoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const CPoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // GULDEN_SUPPORT_ALLOCATORS_POOL_H
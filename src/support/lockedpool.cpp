@@ -27,6 +27,7 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 
 LockedPoolManager* LockedPoolManager::_instance = NULL;
 std::once_flag LockedPoolManager::init_flag;
@@ -257,22 +258,148 @@ size_t PosixLockedPageAllocator::GetLimit()
 /*******************************************************************************/
 // Implementation: LockedPool
 
+static constexpr size_t small_class_sizes[LockedPool::SMALL_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+static_assert(small_class_sizes[LockedPool::SMALL_CLASSES - 1] == LockedPool::SMALL_CHUNK_MAX, "the largest size class must be SMALL_CHUNK_MAX");
+
+static inline size_t small_class(size_t size)
+{
+    size_t size_class = 0;
+    while (small_class_sizes[size_class] < size)
+        ++size_class;
+    return size_class;
+}
+
+struct LockedPool::SmallBlocks
+{
+    struct SizeClass
+    {
+        std::mutex mutex;
+        std::vector<void*> blocks;
+    };
+    SizeClass classes[SMALL_CLASSES];
+    /** Blocks handed out and not freed yet; blocks in the thread caches count as free. */
+    std::atomic<size_t> used_bytes{0};
+    std::atomic<size_t> used_chunks{0};
+};
+
+struct LockedPool::ThreadCache
+{
+    /** Only compared against, to tell whether owner_ref is for the pool at hand. */
+    const SmallBlocks* owner = nullptr;
+    std::weak_ptr<SmallBlocks> owner_ref;
+    std::vector<void*> blocks[SMALL_CLASSES];
+
+    ~ThreadCache()
+    {
+        release();
+    }
+
+    /** Give the blocks back to the pool they came from, unless it is gone already. */
+    void release()
+    {
+        if (std::shared_ptr<SmallBlocks> blocksOwner = owner_ref.lock()) {
+            for (size_t i = 0; i < SMALL_CLASSES; ++i) {
+                if (blocks[i].empty())
+                    continue;
+                std::lock_guard<std::mutex> lock(blocksOwner->classes[i].mutex);
+                blocksOwner->classes[i].blocks.insert(blocksOwner->classes[i].blocks.end(), blocks[i].begin(), blocks[i].end());
+            }
+        }
+        for (auto& cached: blocks)
+            cached.clear();
+        owner = nullptr;
+        owner_ref.reset();
+    }
+};
+
 LockedPool::LockedPool(std::unique_ptr<LockedPageAllocator> allocator_in, LockingFailed_Callback lf_cb_in):
-    allocator(std::move(allocator_in)), lf_cb(lf_cb_in), cumulative_bytes_locked(0)
+    allocator(std::move(allocator_in)), small(std::make_shared<SmallBlocks>()), slab_bytes(0), slab_blocks(0), lf_cb(lf_cb_in), cumulative_bytes_locked(0)
 {
 }
 
 LockedPool::~LockedPool()
 {
 }
-void* LockedPool::alloc(size_t size)
+
+LockedPool::ThreadCache& LockedPool::thread_cache(const std::shared_ptr<SmallBlocks>& small)
 {
-    std::lock_guard<std::mutex> lock(mutex);
+    static thread_local ThreadCache cache;
+    // A thread caches the blocks of one pool at a time, in practice always those of LockedPoolManager.
+    if (cache.owner != small.get() || cache.owner_ref.expired()) {
+        cache.release();
+        cache.owner = small.get();
+        cache.owner_ref = small;
+        for (auto& cached: cache.blocks)
+            cached.reserve(THREAD_CACHE_BLOCKS + 1);
+    }
+    return cache;
+}
 
+void* LockedPool::alloc_small(size_t size_class)
+{
+    std::vector<void*>& cached = thread_cache(small).blocks[size_class];
+    if (cached.empty()) {
+        // Take half a cache worth of blocks from the shared list, which only needs the lock of the pool when it has run out.
+        SmallBlocks::SizeClass& shared = small->classes[size_class];
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (shared.blocks.empty()) {
+            std::lock_guard<std::mutex> lockPool(mutex);
+            if (!new_slab(size_class, shared.blocks))
+                return nullptr;
+        }
+        size_t count = std::min(shared.blocks.size(), THREAD_CACHE_BLOCKS / 2);
+        cached.insert(cached.end(), shared.blocks.end() - count, shared.blocks.end());
+        shared.blocks.resize(shared.blocks.size() - count);
+    }
+    void* addr = cached.back();
+    cached.pop_back();
+    small->used_bytes.fetch_add(small_class_sizes[size_class], std::memory_order_relaxed);
+    small->used_chunks.fetch_add(1, std::memory_order_relaxed);
+    return addr;
+}
+
+bool LockedPool::new_slab(size_t size_class, std::vector<void*>& blocks)
+{
+    const size_t block_size = small_class_sizes[size_class];
+    auto alloc_from_arenas = [&](size_t size) -> char* {
+        for (auto &arena: arenas) {
+            if (void *addr = arena.alloc(size))
+                return static_cast<char*>(addr);
+        }
+        return nullptr;
+    };
+
+    size_t size = SMALL_SLAB_SIZE - SMALL_SLAB_SIZE % block_size;
+    char* base = alloc_from_arenas(size);
+    if (!base && new_arena(ARENA_SIZE, ARENA_ALIGN))
+        base = static_cast<char*>(arenas.back().alloc(size));
+    // Fall back to a slab of a single block rather than failing while the arenas still have room for it.
+    if (!base) {
+        size = block_size;
+        base = alloc_from_arenas(size);
+    }
+    if (!base)
+        return false;
+
+    slabs.emplace(base, Slab{size, size_class});
+    slab_bytes += size;
+    slab_blocks += size / block_size;
+    for (size_t offset = 0; offset < size; offset += block_size)
+        blocks.push_back(base + offset);
+    return true;
+}
+
+void* LockedPool::alloc(size_t size)
+{
     // Don't handle impossible sizes
     if (size == 0 || size > ARENA_SIZE)
         return nullptr;
 
+    if (size <= SMALL_CHUNK_MAX)
+        return alloc_small(small_class(size));
+
+    std::lock_guard<std::mutex> lock(mutex);
+
     // Try allocating from each current arena
     for (auto &arena: arenas) {
         void *addr = arena.alloc(size);
@@ -289,16 +416,67 @@ void* LockedPool::alloc(size_t size)
 
 void LockedPool::free(void *ptr)
 {
-    std::lock_guard<std::mutex> lock(mutex);
-    // TODO we can do better than this linear search by keeping a map of arena
-    // extents to arena, and looking up the address.
-    for (auto &arena: arenas) {
-        if (arena.addressInArena(ptr)) {
-            arena.free(ptr);
-            return;
+    // Freeing the NULL pointer is OK.
+    if (ptr == nullptr)
+        return;
+
+    size_t size_class;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        char* addr = static_cast<char*>(ptr);
+        auto slab = slabs.upper_bound(addr);
+        if (slab == slabs.begin() || addr >= std::prev(slab)->first + std::prev(slab)->second.size) {
+            // TODO we can do better than this linear search by keeping a map of arena
+            // extents to arena, and looking up the address.
+            for (auto &arena: arenas) {
+                if (arena.addressInArena(ptr)) {
+                    arena.free(ptr);
+                    return;
+                }
+            }
+            throw std::runtime_error("LockedPool: invalid address not pointing to any arena");
         }
+        --slab;
+        size_class = slab->second.size_class;
+        if ((addr - slab->first) % small_class_sizes[size_class] != 0)
+            throw std::runtime_error("LockedPool: invalid address not pointing to a block");
+    }
+    // The lock of a size class is never taken while holding that of the pool.
+    // This is the slow path, so look for double frees like the arenas do, as far as the blocks of other threads' caches aren't concerned.
+    const std::vector<void*>& cached = thread_cache(small).blocks[size_class];
+    if (std::find(cached.begin(), cached.end(), ptr) != cached.end())
+        throw std::runtime_error("LockedPool: invalid or double free");
+    SmallBlocks::SizeClass& shared = small->classes[size_class];
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (std::find(shared.blocks.begin(), shared.blocks.end(), ptr) != shared.blocks.end())
+            throw std::runtime_error("LockedPool: invalid or double free");
+        shared.blocks.push_back(ptr);
+    }
+    small->used_bytes.fetch_sub(small_class_sizes[size_class], std::memory_order_relaxed);
+    small->used_chunks.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void LockedPool::free(void *ptr, size_t size)
+{
+    if (ptr == nullptr)
+        return;
+    if (size == 0 || size > SMALL_CHUNK_MAX) {
+        free(ptr);
+        return;
+    }
+
+    const size_t size_class = small_class(size);
+    std::vector<void*>& cached = thread_cache(small).blocks[size_class];
+    cached.push_back(ptr);
+    small->used_bytes.fetch_sub(small_class_sizes[size_class], std::memory_order_relaxed);
+    small->used_chunks.fetch_sub(1, std::memory_order_relaxed);
+    if (cached.size() > THREAD_CACHE_BLOCKS) {
+        SmallBlocks::SizeClass& shared = small->classes[size_class];
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.blocks.insert(shared.blocks.end(), cached.begin() + THREAD_CACHE_BLOCKS / 2, cached.end());
+        cached.resize(THREAD_CACHE_BLOCKS / 2);
     }
-    throw std::runtime_error("LockedPool: invalid address not pointing to any arena");
 }
 
 LockedPool::Stats LockedPool::stats() const
@@ -313,6 +491,13 @@ LockedPool::Stats LockedPool::stats() const
         r.chunks_used += i.chunks_used;
         r.chunks_free += i.chunks_free;
     }
+    // The slabs are used chunks to the arenas; count their blocks instead.
+    const size_t used_bytes = small->used_bytes.load(std::memory_order_relaxed);
+    const size_t used_chunks = small->used_chunks.load(std::memory_order_relaxed);
+    r.used = r.used - slab_bytes + used_bytes;
+    r.free = r.free + slab_bytes - used_bytes;
+    r.chunks_used = r.chunks_used - slabs.size() + used_chunks;
+    r.chunks_free = r.chunks_free + slab_blocks - used_chunks;
     return r;
 }
 
@@ -10,6 +10,7 @@
 #include <map>
 #include <mutex>
 #include <memory>
+#include <vector>
 
 /**
  * OS-dependent allocation and deallocation of locked/pinned memory pages.
@@ -113,6 +114,12 @@ private:
  * memory. This has been done as the sizes and bases of objects are not in themselves sensitive
  * information, as to conserve precious locked memory. In some operating systems
  * the amount of memory that can be locked is small.
+ *
+ * Small chunks (keys, seeds, short strings) don't go through the arenas one by one: the arenas
+ * hand out slabs which are split into blocks of one size class each, and every size class has
+ * its own free list and lock. On top of that each thread keeps the blocks it freed last and hands
+ * them out again without taking any lock, as long as it frees them with free(ptr, size). Slabs
+ * stay with their size class once taken from an arena.
  */
 class LockedPool
 {
@@ -127,6 +134,16 @@ public:
      * memory, setting it too low will facilitate fragmentation.
      */
     static const size_t ARENA_ALIGN = 16;
+    /** Requests up to this size are served from the size classes, all multiples of ARENA_ALIGN.
+     */
+    static const size_t SMALL_CHUNK_MAX = 256;
+    static const size_t SMALL_CLASSES = 8;
+    /** Memory taken from the arenas at once for a size class.
+     */
+    static const size_t SMALL_SLAB_SIZE = 4096;
+    /** Blocks per size class a thread keeps for itself; when it has more, half go back to the shared list.
+     */
+    static const size_t THREAD_CACHE_BLOCKS = 32;
 
     /** Callback when allocation succeeds but locking fails.
      */
@@ -165,6 +182,13 @@ public:
      */
     void free(void *ptr);
 
+    /** Free a chunk of memory that was allocated with alloc(size).
+     * The same as free(ptr), but small chunks go to the cache of the calling thread
+     * without taking a lock. Passing any other size than the one allocated with is
+     * undefined, as is a double free of a small chunk; free(ptr) detects those.
+     */
+    void free(void *ptr, size_t size);
+
     /** Get pool usage statistics */
     Stats stats() const;
 private:
@@ -173,6 +197,26 @@ private:
 
     std::unique_ptr<LockedPageAllocator> allocator;
 
+    /** Free lists of the size classes; shared with the thread caches, which may outlive the pool. */
+    struct SmallBlocks;
+    struct ThreadCache;
+    std::shared_ptr<SmallBlocks> small;
+
+    /** Slabs taken from the arenas, by base address, with their size and size class. */
+    struct Slab
+    {
+        size_t size;
+        size_t size_class;
+    };
+    std::map<char*, Slab> slabs;
+    size_t slab_bytes;
+    size_t slab_blocks;
+
+    void* alloc_small(size_t size_class);
+    /** Take a slab for size_class from the arenas and split it into blocks. */
+    bool new_slab(size_t size_class, std::vector<void*>& blocks);
+    static ThreadCache& thread_cache(const std::shared_ptr<SmallBlocks>& small);
+
     /** Create an arena from locked pages */
     class LockedPageArena: public Arena
     {
@@ -190,7 +234,8 @@ private:
     std::list<LockedPageArena> arenas;
     LockingFailed_Callback lf_cb;
     size_t cumulative_bytes_locked;
-    /** Mutex protects access to this pool's data structures, including arenas.
+    /** Mutex protects access to this pool's data structures, including arenas and slabs but not
+     * the free lists of the size classes. Taken after the lock of a size class, never before.
      */
     mutable std::mutex mutex;
 };
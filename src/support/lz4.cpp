@@ -0,0 +1,177 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "support/lz4.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace {
+
+//! Shortest match the format can express.
+const size_t MIN_MATCH = 4;
+//! The last LAST_LITERALS bytes of a block are always literals.
+const size_t LAST_LITERALS = 5;
+//! A match may not start in the last MATCH_FIND_LIMIT bytes of a block.
+const size_t MATCH_FIND_LIMIT = 12;
+//! Offsets are 16 bit.
+const size_t MAX_DISTANCE = 65535;
+const int HASH_LOG = 14;
+//! After this many positions without a match the search starts skipping ahead, to get through incompressible data (hashes, signatures) quickly.
+const int SKIP_TRIGGER = 6;
+
+inline uint32_t Read32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t HashPosition(const unsigned char* p)
+{
+    return (Read32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+void WriteLength(std::vector<unsigned char>& out, size_t nLength)
+{
+    while (nLength >= 255)
+    {
+        out.push_back(255);
+        nLength -= 255;
+    }
+    out.push_back((unsigned char)nLength);
+}
+
+void WriteLiterals(std::vector<unsigned char>& out, const unsigned char* literals, size_t nLiterals, unsigned char nMatchNibble)
+{
+    out.push_back((unsigned char)((nLiterals >= 15 ? 15 : nLiterals) << 4) | nMatchNibble);
+    if (nLiterals >= 15)
+        WriteLength(out, nLiterals - 15);
+    out.insert(out.end(), literals, literals + nLiterals);
+}
+
+bool ReadLength(const unsigned char*& ip, const unsigned char* iend, size_t& nLength)
+{
+    unsigned char b;
+    do {
+        if (ip == iend || nLength > ((size_t)1 << 30))
+            return false;
+        b = *ip++;
+        nLength += b;
+    } while (b == 255);
+    return true;
+}
+
+}
+
+void LZ4CompressBlock(const unsigned char* data, size_t nSize, std::vector<unsigned char>& out)
+{
+    const unsigned char* const end = data + nSize;
+    const unsigned char* anchor = data;
+
+    if (nSize > MATCH_FIND_LIMIT)
+    {
+        const unsigned char* const matchEndLimit = end - LAST_LITERALS;
+        const unsigned char* const matchStartLimit = end - MATCH_FIND_LIMIT;
+        std::vector<uint32_t> table(1 << HASH_LOG, 0);
+        const unsigned char* ip = data;
+        unsigned int nMisses = 0;
+        while (ip < matchStartLimit)
+        {
+            uint32_t& entry = table[HashPosition(ip)];
+            const unsigned char* ref = data + entry;
+            entry = (uint32_t)(ip - data);
+            if (ref >= ip || (size_t)(ip - ref) > MAX_DISTANCE || Read32(ref) != Read32(ip))
+            {
+                ip += 1 + (nMisses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            nMisses = 0;
+
+            // Extend the match backwards over pending literals, then forwards as far as it goes.
+            while (ip > anchor && ref > data && ip[-1] == ref[-1])
+            {
+                --ip;
+                --ref;
+            }
+            const unsigned char* matchEnd = ip + MIN_MATCH;
+            const unsigned char* refEnd = ref + MIN_MATCH;
+            while (matchEnd < matchEndLimit && *matchEnd == *refEnd)
+            {
+                ++matchEnd;
+                ++refEnd;
+            }
+
+            size_t nMatchLength = (matchEnd - ip) - MIN_MATCH;
+            size_t nOffset = ip - ref;
+            WriteLiterals(out, anchor, ip - anchor, (unsigned char)(nMatchLength >= 15 ? 15 : nMatchLength));
+            out.push_back((unsigned char)(nOffset & 0xff));
+            out.push_back((unsigned char)(nOffset >> 8));
+            if (nMatchLength >= 15)
+                WriteLength(out, nMatchLength - 15);
+
+            ip = matchEnd;
+            anchor = ip;
+        }
+    }
+
+    // The block always ends with a sequence of only literals (possibly none).
+    WriteLiterals(out, anchor, end - anchor, 0);
+}
+
+bool LZ4DecompressBlock(const unsigned char* data, size_t nSize, unsigned char* out, size_t nOutSize)
+{
+    const unsigned char* ip = data;
+    const unsigned char* const iend = data + nSize;
+    unsigned char* op = out;
+    unsigned char* const oend = out + nOutSize;
+
+    while (ip < iend)
+    {
+        const unsigned char token = *ip++;
+
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15 && !ReadLength(ip, iend, nLiterals))
+            return false;
+        if (nLiterals > (size_t)(iend - ip) || nLiterals > (size_t)(oend - op))
+            return false;
+        if (nLiterals)
+            memcpy(op, ip, nLiterals);
+        op += nLiterals;
+        ip += nLiterals;
+
+        // The last sequence has no match.
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        size_t nOffset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (nOffset == 0 || nOffset > (size_t)(op - out))
+            return false;
+
+        size_t nMatchLength = token & 15;
+        if (nMatchLength == 15 && !ReadLength(ip, iend, nMatchLength))
+            return false;
+        nMatchLength += MIN_MATCH;
+        if (nMatchLength > (size_t)(oend - op))
+            return false;
+
+        const unsigned char* match = op - nOffset;
+        if (nOffset >= nMatchLength)
+        {
+            memcpy(op, match, nMatchLength);
+            op += nMatchLength;
+        }
+        else
+        {
+            // Overlapping match, repeats the last nOffset bytes.
+            for (size_t i = 0; i < nMatchLength; ++i)
+                *op++ = *match++;
+        }
+    }
+
+    return op == oend;
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_SUPPORT_LZ4_H
+#define GULDEN_SUPPORT_LZ4_H
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * A small implementation of the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+ * Greedy single probe matching; fast to compress and very fast to decompress, at a lower ratio than general purpose compressors.
+ * Used for the optional compressed block storage, see CBlockStore, and for compressed messages between peers.
+ */
+
+/** Compress nSize bytes at data into a single LZ4 block, which is appended to out. */
+void LZ4CompressBlock(const unsigned char* data, size_t nSize, std::vector<unsigned char>& out);
+
+/** Decompress the LZ4 block of nSize bytes at data into exactly nOutSize bytes at out.
+ *  Returns false if the input is malformed or doesn't decompress to nOutSize bytes; never reads or writes out of bounds.
+ */
+bool LZ4DecompressBlock(const unsigned char* data, size_t nSize, unsigned char* out, size_t nOutSize);
+
+#endif // GULDEN_SUPPORT_LZ4_H
@@ -7,11 +7,185 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include <stdio.h>
+#include <tuple>
 
 
 #include <boost/thread.hpp>
 
+std::atomic<bool> g_fLockStats{DEFAULT_LOCKSTATS};
+
+struct CLockSite
+{
+    // Only written by the thread owning the table: first the name and line, then (release) the file, which marks the slot as taken.
+    std::atomic<const char*> pszFile{nullptr};
+    std::atomic<const char*> pszName{nullptr};
+    std::atomic<int> nLine{0};
+    std::atomic<uint64_t> nCount{0};
+    std::atomic<uint64_t> nContended{0};
+    std::atomic<uint64_t> nWait{0};
+    std::atomic<uint64_t> nMaxWait{0};
+    std::atomic<uint64_t> nHold{0};
+    std::atomic<uint64_t> nMaxHold{0};
+};
+
+namespace {
+
+struct LockSiteTable
+{
+    CLockSite sites[LOCKSTATS_SITES_PER_THREAD];
+    std::atomic<bool> fInUse{true};
+};
+
+// Never freed, the tables outlive the threads that record into them.
+std::mutex& LockSiteTablesMutex()
+{
+    static std::mutex* cs = new std::mutex();
+    return *cs;
+}
+
+std::vector<LockSiteTable*>& LockSiteTables()
+{
+    static std::vector<LockSiteTable*>* tables = new std::vector<LockSiteTable*>();
+    return *tables;
+}
+
+struct LockSiteTableHolder
+{
+    LockSiteTable* table = nullptr;
+    ~LockSiteTableHolder()
+    {
+        if (table)
+            table->fInUse = false;
+    }
+};
+
+LockSiteTable& GetThreadLockSiteTable()
+{
+    static thread_local LockSiteTableHolder holder;
+    if (!holder.table)
+    {
+        std::lock_guard<std::mutex> lock(LockSiteTablesMutex());
+        for (LockSiteTable* table : LockSiteTables())
+        {
+            bool fInUse = false;
+            if (table->fInUse.compare_exchange_strong(fInUse, true))
+            {
+                holder.table = table;
+                break;
+            }
+        }
+        if (!holder.table)
+        {
+            holder.table = new LockSiteTable();
+            LockSiteTables().push_back(holder.table);
+        }
+    }
+    return *holder.table;
+}
+
+void UpdateMax(std::atomic<uint64_t>& nMax, uint64_t nValue)
+{
+    uint64_t nCurrent = nMax.load(std::memory_order_relaxed);
+    while (nValue > nCurrent && !nMax.compare_exchange_weak(nCurrent, nValue, std::memory_order_relaxed))
+    {
+    }
+}
+
+} // namespace
+
+CLockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine)
+{
+    LockSiteTable& table = GetThreadLockSiteTable();
+    // The strings are literals from the LOCK macros, so the pointers identify the site.
+    size_t nSlot = (((size_t)pszFile >> 3) ^ ((size_t)pszName >> 3) ^ ((size_t)nLine * 2654435761U)) % LOCKSTATS_SITES_PER_THREAD;
+    for (int i = 0; i < LOCKSTATS_SITES_PER_THREAD; ++i, nSlot = (nSlot + 1) % LOCKSTATS_SITES_PER_THREAD)
+    {
+        CLockSite& site = table.sites[nSlot];
+        const char* pszSiteFile = site.pszFile.load(std::memory_order_relaxed);
+        if (!pszSiteFile)
+        {
+            site.pszName.store(pszName, std::memory_order_relaxed);
+            site.nLine.store(nLine, std::memory_order_relaxed);
+            site.pszFile.store(pszFile, std::memory_order_release);
+            return &site;
+        }
+        if (pszSiteFile == pszFile && site.nLine.load(std::memory_order_relaxed) == nLine && site.pszName.load(std::memory_order_relaxed) == pszName)
+            return &site;
+    }
+    return nullptr;
+}
+
+void RecordLockWait(CLockSite* site, uint64_t nMicros)
+{
+    site->nContended.fetch_add(1, std::memory_order_relaxed);
+    site->nWait.fetch_add(nMicros, std::memory_order_relaxed);
+    UpdateMax(site->nMaxWait, nMicros);
+}
+
+void RecordLockHold(CLockSite* site, uint64_t nMicros)
+{
+    site->nCount.fetch_add(1, std::memory_order_relaxed);
+    site->nHold.fetch_add(nMicros, std::memory_order_relaxed);
+    UpdateMax(site->nMaxHold, nMicros);
+}
+
+std::vector<CLockSiteStats> GetLockStats()
+{
+    std::map<std::tuple<std::string, std::string, int>, CLockSiteStats> mapStats;
+    {
+        std::lock_guard<std::mutex> lock(LockSiteTablesMutex());
+        for (const LockSiteTable* table : LockSiteTables())
+        {
+            for (const CLockSite& site : table->sites)
+            {
+                const char* pszFile = site.pszFile.load(std::memory_order_acquire);
+                if (!pszFile)
+                    continue;
+                const char* pszName = site.pszName.load(std::memory_order_relaxed);
+                int nLine = site.nLine.load(std::memory_order_relaxed);
+                CLockSiteStats& stats = mapStats[std::make_tuple(std::string(pszName), std::string(pszFile), nLine)];
+                stats.name = pszName;
+                stats.file = pszFile;
+                stats.nLine = nLine;
+                stats.nCount += site.nCount.load(std::memory_order_relaxed);
+                stats.nContended += site.nContended.load(std::memory_order_relaxed);
+                stats.nWait += site.nWait.load(std::memory_order_relaxed);
+                stats.nMaxWait = std::max(stats.nMaxWait, site.nMaxWait.load(std::memory_order_relaxed));
+                stats.nHold += site.nHold.load(std::memory_order_relaxed);
+                stats.nMaxHold = std::max(stats.nMaxHold, site.nMaxHold.load(std::memory_order_relaxed));
+            }
+        }
+    }
+    std::vector<CLockSiteStats> stats;
+    for (const auto& entry : mapStats)
+        if (entry.second.nCount > 0 || entry.second.nContended > 0)
+            stats.push_back(entry.second);
+    std::sort(stats.begin(), stats.end(), [](const CLockSiteStats& a, const CLockSiteStats& b) { return std::tie(a.nWait, a.nHold) > std::tie(b.nWait, b.nHold); });
+    return stats;
+}
+
+void ResetLockStats()
+{
+    // The sites stay where they are (only their owner may change those), just the counters are cleared.
+    std::lock_guard<std::mutex> lock(LockSiteTablesMutex());
+    for (LockSiteTable* table : LockSiteTables())
+    {
+        for (CLockSite& site : table->sites)
+        {
+            site.nCount = 0;
+            site.nContended = 0;
+            site.nWait = 0;
+            site.nMaxWait = 0;
+            site.nHold = 0;
+            site.nMaxHold = 0;
+        }
+    }
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -15,6 +15,12 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
@@ -113,16 +119,75 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+//! Max number of distinct LOCK sites (lock name and file:line) the lock profiler keeps apart per thread, the rest isn't recorded.
+static const int LOCKSTATS_SITES_PER_THREAD = 512;
+static const bool DEFAULT_LOCKSTATS = false;
+
+/** Whether the lock profiler is recording (-lockstats, getlockstats) */
+extern std::atomic<bool> g_fLockStats;
+
+/** Acquisitions of a lock at one place in the code, as recorded by the lock profiler. Times in microseconds. */
+struct CLockSiteStats
+{
+    std::string name;
+    std::string file;
+    int nLine = 0;
+    uint64_t nCount = 0;
+    //! Acquisitions that had to wait for another thread.
+    uint64_t nContended = 0;
+    uint64_t nWait = 0;
+    uint64_t nMaxWait = 0;
+    uint64_t nHold = 0;
+    uint64_t nMaxHold = 0;
+};
+
+/**
+ * The lock profiler: records for every LOCK site how often the lock was taken there, how long it waited for it and how long it held it.
+ * Every thread records into a table of its own with relaxed atomic counters, so recording doesn't take any lock; the tables are only summed up
+ * by GetLockStats. Tables of threads that exit are handed to new threads, so what they recorded is kept.
+ * Nested acquisitions of a recursive lock count as acquisitions of their own, their hold time is included in that of the outer one.
+ */
+struct CLockSite;
+CLockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine);
+void RecordLockWait(CLockSite* site, uint64_t nMicros);
+void RecordLockHold(CLockSite* site, uint64_t nMicros);
+//! Recorded acquisitions, summed over all threads, most waited for first.
+std::vector<CLockSiteStats> GetLockStats();
+void ResetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    //! Set while the lock profiler times the hold of the lock.
+    CLockSite* pLockSite = nullptr;
+    std::chrono::steady_clock::time_point nLockedAt;
+
+    void EnterProfiled(const char* pszName, const char* pszFile, int nLine)
+    {
+        pLockSite = GetLockSite(pszName, pszFile, nLine);
+        nLockedAt = std::chrono::steady_clock::now();
+        if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
+            PrintLockContention(pszName, pszFile, nLine);
+#endif
+            lock.lock();
+            std::chrono::steady_clock::time_point nWaitStart = nLockedAt;
+            nLockedAt = std::chrono::steady_clock::now();
+            if (pLockSite)
+                RecordLockWait(pLockSite, std::chrono::duration_cast<std::chrono::microseconds>(nLockedAt - nWaitStart).count());
+        }
+    }
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (g_fLockStats.load(std::memory_order_relaxed)) {
+            EnterProfiled(pszName, pszFile, nLine);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -139,6 +204,10 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (g_fLockStats.load(std::memory_order_relaxed)) {
+            pLockSite = GetLockSite(pszName, pszFile, nLine);
+            nLockedAt = std::chrono::steady_clock::now();
+        }
         return lock.owns_lock();
     }
 
@@ -165,7 +234,11 @@ public:
     ~CMutexLock() UNLOCK_FUNCTION()
     {
         if (lock.owns_lock())
+        {
+            if (pLockSite)
+                RecordLockHold(pLockSite, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - nLockedAt).count());
             LeaveCritical();
+        }
     }
 
     operator bool()
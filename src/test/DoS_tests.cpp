@@ -18,25 +18,20 @@
 #include "pow.h"
 #include "script/sign.h"
 #include "serialize.h"
+#include "txorphanpool.h"
 #include "util.h"
 #include "validation/validation.h"
 
 #include "test/test_gulden.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include <boost/test/unit_test.hpp>
 
 // Tests these internal-to-net_processing.cpp methods:
-extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern bool HavePoWVerifyBudget(CNode* node, uint64_t nCount);
+extern void ChargePoWVerifyBudget(NodeId nodeid, int64_t nCostMicros);
 
 CService ip(uint32_t i)
 {
@@ -130,13 +125,27 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     BOOST_CHECK(!connman->IsBanned(addr));
 }
 
-CTransactionRef RandomOrphan()
+BOOST_AUTO_TEST_CASE(DoS_powverifybudget)
 {
-    std::map<uint256, COrphanTx>::iterator it;
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second.tx;
+    CAddress addr1(ip(0xa0b0c002), NODE_NONE);
+    CNode inboundNode(id++, NODE_NETWORK, 0, socket_t(get_io_context()), addr1, 5, 5, CAddress(), "", true);
+    GetNodeSignals().InitializeNode(&inboundNode, *connman);
+    CAddress addr2(ip(0xa0b0c003), NODE_NONE);
+    CNode outboundNode(id++, NODE_NETWORK, 0, socket_t(get_io_context()), addr2, 6, 6, CAddress(), "", false);
+    GetNodeSignals().InitializeNode(&outboundNode, *connman);
+
+    LOCK(cs_main);
+    // A fresh inbound peer can have any headers message verified, even one that costs more than its whole budget.
+    BOOST_CHECK(HavePoWVerifyBudget(&inboundNode, 1));
+    BOOST_CHECK(HavePoWVerifyBudget(&inboundNode, MAX_HEADERS_RESULTS));
+
+    // Once in debt further headers wait until the budget has been paid back.
+    ChargePoWVerifyBudget(inboundNode.GetId(), DEFAULT_PEER_POW_BUDGET_MS * 1000 * 2);
+    BOOST_CHECK(!HavePoWVerifyBudget(&inboundNode, 1));
+
+    // Outbound peers are never deferred.
+    ChargePoWVerifyBudget(outboundNode.GetId(), DEFAULT_PEER_POW_BUDGET_MS * 1000 * 2);
+    BOOST_CHECK(HavePoWVerifyBudget(&outboundNode, MAX_HEADERS_RESULTS));
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -145,6 +154,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     key.MakeNewKey(true);
     CBasicKeyStore keystore;
     keystore.AddKey(key);
+    CTxOrphanPool orphanPool;
 
     // 50 orphan transactions:
     for (int i = 0; i < 50; i++)
@@ -158,8 +168,9 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].output.scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        BOOST_CHECK(orphanPool.AddTx(MakeTransactionRef(tx), i));
     }
+    BOOST_CHECK_EQUAL(orphanPool.Size(), 50U);
 
     // ... and 50 that depend on other orphans:
 /*    for (int i = 0; i < 50; i++)
@@ -202,21 +213,70 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
     }*/
 
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+        size_t sizeBefore = orphanPool.Size();
+        BOOST_CHECK_EQUAL(orphanPool.EraseForPeer(i), 1);
+        BOOST_CHECK(orphanPool.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanPool.PeerBytes(i), 0U);
     }
 
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
+    // Test Limit():
+    orphanPool.Limit(40, std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanPool.Size() <= 40);
+    orphanPool.Limit(10, std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanPool.Size() <= 10);
+    orphanPool.Limit(0, std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(orphanPool.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanPool.TotalBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanQuotas)
+{
+    CTxOrphanPool orphanPool;
+    std::vector<CTransactionRef> vTxs;
+    // Peer 0 sends 20 orphans, peer 1 sends 5, all spending the same parent.
+    uint256 hashParent = InsecureRand256();
+    for (int i = 0; i < 25; i++)
+    {
+        CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = i;
+        tx.vin[0].prevout.setHash(hashParent);
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        vTxs.push_back(MakeTransactionRef(tx));
+        BOOST_CHECK(orphanPool.AddTx(vTxs.back(), i < 20 ? 0 : 1));
+    }
+    BOOST_CHECK(!orphanPool.AddTx(vTxs[0], 1));
+    BOOST_CHECK(orphanPool.HaveTx(vTxs[0]->GetHash()));
+    BOOST_CHECK_EQUAL(orphanPool.GetTxsSpending(vTxs[3]->vin[0].prevout).size(), 1U);
+    BOOST_CHECK_EQUAL(orphanPool.GetTxsSpending(vTxs[3]->vin[0].prevout)[0].second, 0);
+
+    // Peer 0 is cut back to its quota, peer 1 keeps everything.
+    size_t nPeer1Bytes = orphanPool.PeerBytes(1);
+    size_t nQuota = nPeer1Bytes * 2;
+    BOOST_CHECK_EQUAL(orphanPool.Limit(100, std::numeric_limits<size_t>::max(), nQuota), 10U);
+    BOOST_CHECK(orphanPool.PeerBytes(0) <= nQuota);
+    BOOST_CHECK_EQUAL(orphanPool.PeerBytes(1), nPeer1Bytes);
+    BOOST_CHECK_EQUAL(orphanPool.TotalBytes(), orphanPool.PeerBytes(0) + orphanPool.PeerBytes(1));
+
+    // The byte limit of the whole pool.
+    orphanPool.Limit(100, nPeer1Bytes, nQuota);
+    BOOST_CHECK(orphanPool.TotalBytes() <= nPeer1Bytes);
+    BOOST_CHECK(orphanPool.Size() <= 5);
+
+    // A block spending the parent outputs takes the rest out.
+    CBlock block;
+    CMutableTransaction spend(TEST_DEFAULT_TX_VERSION);
+    for (int i = 0; i < 25; i++)
+        spend.vin.push_back(vTxs[i]->vin[0]);
+    block.vtx.push_back(MakeTransactionRef(spend));
+    orphanPool.EraseForBlock(block);
+    BOOST_CHECK_EQUAL(orphanPool.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanPool.TotalBytes(), 0U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/addressindex.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/sign.h"
+#include "validation/validation.h"
+#include "utiltime.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(addressindex_script_hashes)
+{
+    CKeyID spendingKeyID(uint160(std::vector<unsigned char>(20, 1)));
+    CKeyID witnessKeyID(uint160(std::vector<unsigned char>(20, 2)));
+    uint160 hashSpending = GetAddressIndexScriptHash(GetScriptForDestination(spendingKeyID));
+    uint160 hashWitness = GetAddressIndexScriptHash(GetScriptForDestination(witnessKeyID));
+
+    // Key hash outputs are found under the same hash as the equivalent script.
+    CTxOut out;
+    out.SetType(CTxOutType::StandardKeyHashOutput);
+    out.output.standardKeyHash.keyID = spendingKeyID;
+    auto hashes = GetAddressIndexScriptHashes(out);
+    BOOST_REQUIRE_EQUAL(hashes.size(), 1);
+    BOOST_CHECK(hashes[0].first == hashSpending && hashes[0].second == ADDRESS_INDEX_OWNER);
+
+    // Witness outputs under both keys, only the spending key owns them.
+    out.SetType(CTxOutType::PoW2WitnessOutput);
+    out.output.witnessDetails.spendingKeyID = spendingKeyID;
+    out.output.witnessDetails.witnessKeyID = witnessKeyID;
+    hashes = GetAddressIndexScriptHashes(out);
+    BOOST_REQUIRE_EQUAL(hashes.size(), 2);
+    BOOST_CHECK(hashes[0].first == hashSpending && hashes[0].second == ADDRESS_INDEX_OWNER);
+    BOOST_CHECK(hashes[1].first == hashWitness && hashes[1].second == ADDRESS_INDEX_WITNESS_KEY);
+
+    uint160 hashScript;
+    BOOST_CHECK(GetAddressIndexScriptHash(CTxDestination(CPoW2WitnessDestination(spendingKeyID, witnessKeyID)), hashScript));
+    BOOST_CHECK(hashScript == hashSpending);
+    BOOST_CHECK(!GetAddressIndexScriptHash(CTxDestination(CNoDestination()), hashScript));
+
+    // Nothing to find for unspendable outputs.
+    out.SetType(CTxOutType::ScriptLegacyOutput);
+    out.output.scriptPubKey = CScript() << OP_RETURN;
+    BOOST_CHECK(GetAddressIndexScriptHashes(out).empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_follow_chain, TestChain100Setup)
+{
+    CScript coinbaseScript = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    uint160 hashCoinbase = GetAddressIndexScriptHash(coinbaseScript);
+    CAmount nCoinbaseReceived = 0;
+    for (const auto& tx : coinbaseTxns)
+        for (const auto& out : tx.vout)
+            if (out.output.scriptPubKey == coinbaseScript)
+                nCoinbaseReceived += out.nValue;
+
+    CAddressIndex addressindex(1 << 20, true);
+    BOOST_REQUIRE(addressindex.Start());
+    for (int i = 0; i < 1000 && !addressindex.IsSynced(); ++i)
+        MilliSleep(10);
+    BOOST_REQUIRE(addressindex.IsSynced());
+
+    CAddressIndexSummary summary;
+    BOOST_CHECK(addressindex.GetSummary(hashCoinbase, summary));
+    BOOST_CHECK_EQUAL(summary.nReceived, nCoinbaseReceived);
+    BOOST_CHECK_EQUAL(summary.nBalance, nCoinbaseReceived);
+
+    // Pay part of a coinbase to a new key.
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+    CMutableTransaction spend(TEST_DEFAULT_TX_VERSION);
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].output.scriptPubKey = GetScriptForDestination(keyID);
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbaseScript, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock({spend}, std::make_shared<CReserveKeyOrScript>(coinbaseScript));
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHashPoW2() == block.GetHashPoW2());
+    BOOST_CHECK(addressindex.BlockUntilSynced());
+
+    uint160 hashKey;
+    BOOST_CHECK(GetAddressIndexScriptHash(CTxDestination(keyID), hashKey));
+    BOOST_CHECK(addressindex.GetSummary(hashKey, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, 11 * CENT);
+    BOOST_CHECK_EQUAL(summary.nEntries, 1);
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>> entries;
+    BOOST_CHECK(addressindex.GetHistory(hashKey, 0, 10, entries));
+    BOOST_REQUIRE_EQUAL(entries.size(), 1);
+    BOOST_CHECK(entries[0].first.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(entries[0].first.nHeight, chainActive.Height());
+    BOOST_CHECK(!entries[0].first.fSpend);
+
+    // The spend shows up last in the history of the coinbase key, paging from the end.
+    BOOST_CHECK(addressindex.GetSummary(hashCoinbase, summary));
+    BOOST_CHECK(addressindex.GetHistory(hashCoinbase, 0, 1000, entries));
+    BOOST_REQUIRE_EQUAL((int64_t)entries.size(), summary.nEntries);
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>> lastEntries;
+    BOOST_CHECK(addressindex.GetHistory(hashCoinbase, entries.size() - 2, 10, lastEntries));
+    BOOST_REQUIRE_EQUAL(lastEntries.size(), 2);
+    bool fFoundSpend = false;
+    for (const auto& entry : lastEntries)
+        fFoundSpend |= entry.first.fSpend && entry.first.txid == spend.GetHash() && entry.second.nValue == coinbaseTxns[0].vout[0].nValue;
+    BOOST_CHECK(fFoundSpend);
+
+    // Disconnecting the block takes its entries out again.
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_CHECK(addressindex.BlockUntilSynced());
+    BOOST_CHECK(addressindex.GetSummary(hashKey, summary));
+    BOOST_CHECK_EQUAL(summary.nEntries, 0);
+    BOOST_CHECK_EQUAL(summary.nBalance, 0);
+    BOOST_CHECK(addressindex.GetHistory(hashKey, 0, 10, entries));
+    BOOST_CHECK(entries.empty());
+    BOOST_CHECK(addressindex.GetSummary(hashCoinbase, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, nCoinbaseReceived);
+    addressindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,9 +14,11 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include "clientversion.h"
 #include "hash.h"
 #include "netbase.h"
 #include "random.h"
+#include "streams.h"
 
 class CAddrManTest : public CAddrMan
 {
@@ -558,4 +560,82 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket)
     //  than 64 buckets.
     BOOST_CHECK(buckets.size() > 64);
 }
+
+BOOST_AUTO_TEST_CASE(addrman_memory_usage)
+{
+    CAddrManTest addrman;
+    addrman.MakeDeterministic();
+
+    // Empty, only the bucket tables count.
+    size_t nEmptyUsage = addrman.DynamicMemoryUsage();
+    BOOST_CHECK(nEmptyUsage > 0);
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    for (unsigned int i = 1; i < 32; i++)
+        addrman.Add(CAddress(ResolveService("250.1.1." + std::to_string(i)), NODE_NONE), source);
+    BOOST_CHECK(addrman.size() > 0);
+    BOOST_CHECK(addrman.DynamicMemoryUsage() >= nEmptyUsage + addrman.size() * sizeof(CAddrInfo));
+}
+
+BOOST_AUTO_TEST_CASE(addrman_journal)
+{
+    CAddrManTest addrman;
+    addrman.MakeDeterministic();
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    CService addr1 = ResolveService("250.1.1.1");
+    CService addr2 = ResolveService("250.1.1.2");
+    CService addr3 = ResolveService("250.1.1.3");
+    CService addr4 = ResolveService("250.1.1.4");
+    addrman.Add(CAddress(addr1, NODE_NONE), source);
+    addrman.Add(CAddress(addr2, NODE_NONE), source);
+    addrman.Add(CAddress(addr3, NODE_NONE), source);
+
+    // What was added since the tables were created is a change.
+    std::vector<CAddrJournalEntry> vChanges;
+    addrman.GetChanges(vChanges);
+    BOOST_CHECK_EQUAL(vChanges.size(), 3);
+    addrman.GetChanges(vChanges);
+    BOOST_CHECK(vChanges.empty());
+
+    // Take a snapshot, as written to peers.dat; reading it back leaves nothing to write.
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers << addrman;
+    CAddrManTest addrmanDisk;
+    ssPeers >> addrmanDisk;
+    addrmanDisk.GetChanges(vChanges);
+    BOOST_CHECK(vChanges.empty());
+
+    // Change the tables and replay only the changes on the snapshot.
+    addrman.Good(CAddress(addr1, NODE_NONE));
+    addrman.Add(CAddress(addr4, NODE_NONE), source);
+    addrman.SetServices(addr2, NODE_NETWORK);
+    addrman.GetChanges(vChanges);
+    BOOST_CHECK_EQUAL(vChanges.size(), 3);
+    CDataStream ssChanges(SER_DISK, CLIENT_VERSION);
+    ssChanges << COMPACTSIZEVECTOR(vChanges);
+    std::vector<CAddrJournalEntry> vChangesRead;
+    ssChanges >> COMPACTSIZEVECTOR(vChangesRead);
+    addrmanDisk.ApplyChanges(vChangesRead);
+
+    BOOST_CHECK_EQUAL(addrmanDisk.size(), addrman.size());
+    BOOST_REQUIRE(addrmanDisk.Find(addr4) != NULL);
+    BOOST_CHECK(addrmanDisk.Find(addr2)->nServices == NODE_NETWORK);
+    // addr1 moved to the tried table, so it is never selected from the new one.
+    std::set<CService> setSelected;
+    for (int i = 0; i < 100; ++i)
+        setSelected.insert(addrmanDisk.Select(true));
+    BOOST_CHECK(setSelected.count(addr4));
+    BOOST_CHECK(!setSelected.count(addr1));
+
+    // Applying the same changes twice doesn't matter; a deletion takes the address out.
+    addrmanDisk.ApplyChanges(vChangesRead);
+    BOOST_CHECK_EQUAL(addrmanDisk.size(), addrman.size());
+    CAddrJournalEntry deleted;
+    deleted.info = CAddrInfo(CAddress(addr3, NODE_NONE), source);
+    deleted.fDeleted = true;
+    addrmanDisk.ApplyChanges(std::vector<CAddrJournalEntry>(1, deleted));
+    BOOST_CHECK(addrmanDisk.Find(addr3) == NULL);
+    BOOST_CHECK_EQUAL(addrmanDisk.size(), addrman.size() - 1);
+}
 BOOST_AUTO_TEST_SUITE_END()
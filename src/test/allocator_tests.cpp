@@ -4,11 +4,16 @@
 
 #include "util.h"
 
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_gulden.h"
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(arena_tests)
@@ -204,6 +209,106 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_mock)
     BOOST_CHECK(pool.stats().used == 0);
 }
 
+BOOST_AUTO_TEST_CASE(lockedpool_tests_small)
+{
+    std::unique_ptr<LockedPageAllocator> x(new TestLockedPageAllocator(1, 1));
+    LockedPool pool(std::move(x));
+
+    // Small chunks come out of slabs of one size class, in whole blocks of it.
+    void *a0 = pool.alloc(20);
+    void *a1 = pool.alloc(32);
+    void *a2 = pool.alloc(LockedPool::SMALL_CHUNK_MAX);
+    BOOST_CHECK(a0 && a1 && a2);
+    BOOST_CHECK(a0 != a1);
+    BOOST_CHECK(pool.stats().used == 32 + 32 + LockedPool::SMALL_CHUNK_MAX);
+    BOOST_CHECK(pool.stats().chunks_used == 3);
+    BOOST_CHECK(pool.stats().used + pool.stats().free == LockedPool::ARENA_SIZE);
+
+    // A chunk freed with its size goes to the thread's cache and is the next one handed out.
+    pool.free(a0, 20);
+    BOOST_CHECK(pool.stats().used == 32 + LockedPool::SMALL_CHUNK_MAX);
+    void *a3 = pool.alloc(17);
+    BOOST_CHECK(a3 == a0);
+
+    // Without its size it is found by address, and a double free is still noticed.
+    pool.free(a1);
+    BOOST_CHECK_THROW(pool.free(a1), std::runtime_error);
+    BOOST_CHECK_THROW(pool.free(static_cast<char*>(a2) + 16), std::runtime_error);
+    pool.free(a2, LockedPool::SMALL_CHUNK_MAX);
+    pool.free(a3);
+
+    // Larger chunks and the slabs share the arenas.
+    void *a4 = pool.alloc(LockedPool::SMALL_CHUNK_MAX + 1);
+    BOOST_CHECK(a4);
+    pool.free(a4, LockedPool::SMALL_CHUNK_MAX + 1);
+    BOOST_CHECK(pool.stats().used == 0);
+    BOOST_CHECK(pool.stats().chunks_used == 0);
+    BOOST_CHECK(pool.stats().total == LockedPool::ARENA_SIZE);
+
+    // When the arenas are full the size classes run out too.
+    std::vector<void*> chunks;
+    while (void *addr = pool.alloc(LockedPool::SMALL_CHUNK_MAX))
+        chunks.push_back(addr);
+    BOOST_CHECK(!chunks.empty());
+    BOOST_CHECK(pool.stats().total == LockedPool::ARENA_SIZE);
+    for (void *addr: chunks)
+        pool.free(addr, LockedPool::SMALL_CHUNK_MAX);
+    BOOST_CHECK(pool.stats().used == 0);
+}
+
+BOOST_AUTO_TEST_CASE(lockedpool_tests_threads)
+{
+    LockedPoolManager &pool = LockedPoolManager::Instance();
+    LockedPool::Stats initial = pool.stats();
+
+    // Chunks of all sizes allocated, written, checked and freed by several threads at once must never overlap.
+    std::atomic<int> nWrong{0};
+    std::vector<std::thread> threads;
+    for (unsigned char t = 1; t <= 4; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            FastRandomContext rand(true);
+            std::vector<std::pair<unsigned char*, size_t>> chunks;
+            for (int i = 0; i < 10000; ++i)
+            {
+                if (chunks.size() < 32 && rand.randbool())
+                {
+                    size_t size = 1 + rand.randrange(2 * LockedPool::SMALL_CHUNK_MAX);
+                    unsigned char* addr = static_cast<unsigned char*>(pool.alloc(size));
+                    if (!addr)
+                    {
+                        ++nWrong;
+                        continue;
+                    }
+                    memset(addr, t, size);
+                    chunks.emplace_back(addr, size);
+                }
+                else if (!chunks.empty())
+                {
+                    size_t n = rand.randrange(chunks.size());
+                    unsigned char* addr = chunks[n].first;
+                    size_t size = chunks[n].second;
+                    if (std::count(addr, addr + size, t) != (ptrdiff_t)size)
+                        ++nWrong;
+                    if (rand.randbool())
+                        pool.free(addr, size);
+                    else
+                        pool.free(addr);
+                    chunks[n] = chunks.back();
+                    chunks.pop_back();
+                }
+            }
+            for (const auto& chunk: chunks)
+                pool.free(chunk.first, chunk.second);
+        });
+    }
+    for (std::thread& thread: threads)
+        thread.join();
+    BOOST_CHECK_EQUAL(nWrong, 0);
+    BOOST_CHECK(pool.stats().used == initial.used);
+}
+
 // These tests used the live LockedPoolManager object, this is also used
 // by other tests so the conditions are somewhat less controllable and thus the
 // tests are somewhat more error-prone.
@@ -231,4 +336,43 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    CPoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Freed blocks are handed out again for the same size.
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK(resource.Allocate(24, 8) == a);
+    BOOST_CHECK(resource.Allocate(17, 8) != a);
+
+    // Blocks that are too big or too strictly aligned don't come from the pool.
+    size_t nChunks = resource.NumAllocatedChunks();
+    void* big = resource.Allocate(65, 8);
+    void* aligned = resource.Allocate(16, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+    resource.Deallocate(big, 65, 8);
+    resource.Deallocate(aligned, 16, 16);
+
+    // Running out of a chunk takes a new one.
+    for (int i = 0; i < 64; ++i)
+        resource.Allocate(64, 8);
+    BOOST_CHECK(resource.NumAllocatedChunks() > nChunks);
+
+    typedef CPoolAllocator<std::pair<const int, int>, 64, 8> MapAllocator;
+    MapAllocator::ResourceType mapResource;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, MapAllocator> map(0, std::hash<int>(), std::equal_to<int>(), &mapResource);
+    for (int i = 0; i < 10000; ++i)
+        map[i] = i * 2;
+    for (int i = 0; i < 10000; i += 2)
+        map.erase(i);
+    for (int i = 0; i < 10000; ++i)
+        BOOST_CHECK_EQUAL(map.count(i), (size_t)(i % 2));
+    BOOST_CHECK_EQUAL(map[9999], 19998);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -50,6 +50,40 @@ BOOST_AUTO_TEST_CASE(base58_EncodeBase58)
     }
 }
 
+// Goal: encoding round trips for every length, including the lengths that don't fill a whole word of input
+BOOST_AUTO_TEST_CASE(base58_EncodeBase58_roundtrip)
+{
+    for (size_t nLength = 0; nLength < 80; ++nLength) {
+        std::vector<unsigned char> vch(nLength);
+        for (auto& c : vch)
+            c = InsecureRandBits(8);
+        if (nLength > 2)
+            vch[0] = vch[1] = 0;
+        std::vector<unsigned char> vchDecoded;
+        BOOST_CHECK(DecodeBase58(EncodeBase58(vch), vchDecoded));
+        BOOST_CHECK(vchDecoded == vch);
+        std::vector<unsigned char> vchMax(nLength, 0xff);
+        BOOST_CHECK(DecodeBase58(EncodeBase58(vchMax), vchDecoded));
+        BOOST_CHECK(vchDecoded == vchMax);
+    }
+}
+
+// Goal: remembered address strings are those of the address asked for
+BOOST_AUTO_TEST_CASE(base58_address_string_cache)
+{
+    CKeyID keyID(uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314")));
+    CScriptID scriptID(uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314")));
+    CGuldenAddress keyAddress(keyID), scriptAddress(scriptID);
+    std::string strKey = keyAddress.ToString();
+    std::string strScript = scriptAddress.ToString();
+    BOOST_CHECK(strKey != strScript);
+    BOOST_CHECK_EQUAL(keyAddress.ToString(), strKey);
+    BOOST_CHECK_EQUAL(scriptAddress.ToString(), strScript);
+    BOOST_CHECK_EQUAL(static_cast<const CBase58Data&>(keyAddress).ToString(), strKey);
+    BOOST_CHECK(CGuldenAddress(strKey).Get() == CTxDestination(keyID));
+    BOOST_CHECK(CGuldenAddress(strScript).Get() == CTxDestination(scriptID));
+}
+
 // Goal: test low-level base58 decoding functionality
 BOOST_AUTO_TEST_CASE(base58_DecodeBase58)
 {
@@ -166,4 +166,27 @@ BOOST_AUTO_TEST_CASE(bip32_test3) {
     RunTest(test3);
 }
 
+BOOST_AUTO_TEST_CASE(bip32_derive_range) {
+    CExtKey key;
+    key.nDepth = 0;
+    key.nChild = 0;
+    memset(key.vchFingerprint, 0, sizeof(key.vchFingerprint));
+    key.chaincode = GetRandHash();
+    key.GetMutableKey().MakeNewKey(true);
+    CExtPubKey pubkey = key.Neuter();
+
+    // The same children as deriving them one at a time.
+    std::vector<CExtPubKey> vChildren;
+    BOOST_REQUIRE(pubkey.DeriveRange(vChildren, 1000, 20));
+    BOOST_REQUIRE_EQUAL(vChildren.size(), 20);
+    for (unsigned int i = 0; i < vChildren.size(); ++i) {
+        CExtPubKey child;
+        BOOST_CHECK(pubkey.Derive(child, 1000 + i));
+        BOOST_CHECK(vChildren[i] == child);
+    }
+
+    BOOST_CHECK(pubkey.DeriveRange(vChildren, 0, 0));
+    BOOST_CHECK(vChildren.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -321,6 +321,59 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(WitnessDeltaRoundTripTest)
+{
+    CBlock blockPoW(BuildBlockTestCase());
+    BOOST_CHECK(CBlockWitnessDelta(blockPoW).IsNull());
+
+    // Witness the PoW block: a witness coinbase and a transaction of the witness' own go after the PoW transactions.
+    CBlock block(blockPoW);
+    CMutableTransaction witnessCoinbase(TEST_DEFAULT_TX_VERSION);
+    witnessCoinbase.vin.resize(2);
+    witnessCoinbase.vin[1].prevout.setHash(InsecureRand256());
+    witnessCoinbase.vout.resize(1);
+    witnessCoinbase.vout[0].nValue = 42;
+    block.vtx.push_back(MakeTransactionRef(std::move(witnessCoinbase)));
+    CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+    tx.vin.resize(1);
+    tx.vin[0].prevout.setHash(InsecureRand256());
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 7;
+    block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    block.nVersionPoW2Witness = 42;
+    block.nTimePoW2Witness = blockPoW.nTime + 1;
+    bool mutated;
+    block.hashMerkleRootPoW2Witness = BlockMerkleRoot(block.vtx.begin() + blockPoW.vtx.size(), block.vtx.end(), &mutated);
+    assert(!mutated);
+    block.witnessHeaderPoW2Sig.assign(65, 1);
+
+    CBlockWitnessDelta witnessDelta(block);
+    BOOST_CHECK_EQUAL(witnessDelta.vtxWitness.size(), 2);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << witnessDelta;
+    // Much less than the whole block.
+    BOOST_CHECK(stream.size() < ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    CBlockWitnessDelta witnessDelta2;
+    stream >> witnessDelta2;
+
+    CBlock block2;
+    BOOST_CHECK(witnessDelta2.FillBlock(blockPoW, block2) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHashPoW2().ToString(), block2.GetHashPoW2().ToString());
+    BOOST_CHECK(block.witnessHeaderPoW2Sig == block2.witnessHeaderPoW2Sig);
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), block2.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK_EQUAL(block.vtx[i]->GetHash().ToString(), block2.vtx[i]->GetHash().ToString());
+
+    // Not the PoW block it witnesses.
+    CBlock block3;
+    BOOST_CHECK(witnessDelta2.FillBlock(BuildBlockTestCase(), block3) == READ_STATUS_FAILED);
+
+    // Witness transactions that don't match the witness header.
+    witnessDelta2.vtxWitness.pop_back();
+    BOOST_CHECK(witnessDelta2.FillBlock(blockPoW, block3) == READ_STATUS_INVALID);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -0,0 +1,171 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "blockfilter.h"
+#include "validation/blockfilterindex.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "undo.h"
+#include "validation/validation.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    SeedInsecureRand(true);
+    CGCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; ++i)
+    {
+        CGCSFilter::Element element1(32), element2(32);
+        for (auto& c : element1)
+            c = InsecureRandBits(8);
+        for (auto& c : element2)
+            c = InsecureRandBits(8);
+        included.insert(element1);
+        excluded.insert(element2);
+    }
+
+    CGCSFilter::Params params(0, 0, 10, 1 << 10);
+    CGCSFilter filter(params, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), included.size());
+    for (const auto& element : included)
+    {
+        BOOST_CHECK(filter.Match(element));
+        CGCSFilter::ElementSet single = excluded;
+        single.insert(element);
+        BOOST_CHECK(filter.MatchAny(single));
+    }
+
+    // Decoding the encoded filter gives the same answers.
+    CGCSFilter decoded(params, filter.GetEncoded());
+    for (const auto& element : included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // Cut short, or with bytes added, it doesn't decode.
+    std::vector<unsigned char> vEncoded = filter.GetEncoded();
+    vEncoded.pop_back();
+    BOOST_CHECK_THROW(CGCSFilter(params, vEncoded), std::ios_base::failure);
+    vEncoded = filter.GetEncoded();
+    vEncoded.push_back(0);
+    BOOST_CHECK_THROW(CGCSFilter(params, vEncoded), std::ios_base::failure);
+
+    // Nothing matches an empty filter.
+    CGCSFilter empty(params);
+    BOOST_CHECK_EQUAL(empty.GetN(), 0);
+    BOOST_CHECK(!empty.Match(*included.begin()));
+    BOOST_CHECK(!empty.MatchAny(included));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    CKeyID spendingKeyID(uint160(std::vector<unsigned char>(20, 1)));
+    CKeyID witnessKeyID(uint160(std::vector<unsigned char>(20, 2)));
+    CKeyID keyID(uint160(std::vector<unsigned char>(20, 3)));
+    CKeyID spentKeyID(uint160(std::vector<unsigned char>(20, 4)));
+    CScript scriptLegacy = CScript() << OP_1;
+    CScript scriptUnspendable = CScript() << OP_RETURN << 4;
+
+    CMutableTransaction coinbase(TEST_DEFAULT_TX_VERSION);
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(2);
+    coinbase.vout[0].output.scriptPubKey = scriptLegacy;
+    coinbase.vout[1].output.scriptPubKey = scriptUnspendable;
+
+    CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    tx.vout.resize(2);
+    tx.vout[0].SetType(CTxOutType::PoW2WitnessOutput);
+    tx.vout[0].output.witnessDetails.spendingKeyID = spendingKeyID;
+    tx.vout[0].output.witnessDetails.witnessKeyID = witnessKeyID;
+    tx.vout[1].SetType(CTxOutType::StandardKeyHashOutput);
+    tx.vout[1].output.standardKeyHash.keyID = keyID;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    CTxOut spent;
+    spent.SetType(CTxOutType::StandardKeyHashOutput);
+    spent.output.standardKeyHash.keyID = spentKeyID;
+    blockundo.vtxundo[0].vprevout.emplace_back(spent, 100, false, true);
+
+    CBlockFilter filter(BlockFilterType::BASIC, block, blockundo);
+    const CGCSFilter& gcs = filter.GetFilter();
+    BOOST_CHECK_EQUAL(gcs.GetN(), 5);
+    auto element = [](const CScript& script) { return CGCSFilter::Element(script.begin(), script.end()); };
+    BOOST_CHECK(gcs.Match(element(scriptLegacy)));
+    BOOST_CHECK(gcs.Match(element(GetScriptForDestination(spendingKeyID))));
+    BOOST_CHECK(gcs.Match(element(GetScriptForDestination(witnessKeyID))));
+    BOOST_CHECK(gcs.Match(element(GetScriptForDestination(keyID))));
+    BOOST_CHECK(gcs.Match(element(GetScriptForDestination(spentKeyID))));
+
+    // Over the wire and back.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << filter;
+    CBlockFilter received;
+    ss >> received;
+    BOOST_CHECK(received.GetBlockHash() == block.GetHashPoW2());
+    BOOST_CHECK(received.GetEncodedFilter() == filter.GetEncodedFilter());
+    BOOST_CHECK(received.GetHash() == filter.GetHash());
+
+    // Headers chain: a different previous header gives a different header.
+    BOOST_CHECK(filter.ComputeHeader(uint256()) != filter.ComputeHeader(InsecureRand256()));
+
+    BlockFilterType filterType;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filterType) && filterType == BlockFilterType::BASIC);
+    BOOST_CHECK(!BlockFilterTypeByName("extended", filterType));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_follow_chain, TestChain100Setup)
+{
+    CBlockFilterIndex filterindex(BlockFilterType::BASIC, 1 << 20, true);
+    BOOST_REQUIRE(filterindex.Start());
+    for (int i = 0; i < 1000 && !filterindex.IsSynced(); ++i)
+        MilliSleep(10);
+    BOOST_REQUIRE(filterindex.IsSynced());
+
+    CScript coinbaseScript = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock({}, std::make_shared<CReserveKeyOrScript>(coinbaseScript));
+    BOOST_CHECK(filterindex.BlockUntilSynced());
+
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+    BOOST_REQUIRE(pindexTip->GetBlockHashPoW2() == block.GetHashPoW2());
+    CBlockFilter filter;
+    BOOST_REQUIRE(filterindex.LookupFilter(pindexTip, filter));
+    BOOST_CHECK(filter.GetFilter().Match(CGCSFilter::Element(coinbaseScript.begin(), coinbaseScript.end())));
+
+    // Every header builds on the one before it.
+    uint256 hashHeader, hashPrevHeader;
+    BOOST_CHECK(filterindex.LookupFilterHeader(pindexTip, hashHeader));
+    BOOST_CHECK(filterindex.LookupFilterHeader(pindexTip->pprev, hashPrevHeader));
+    BOOST_CHECK(filter.ComputeHeader(hashPrevHeader) == hashHeader);
+
+    std::vector<CBlockFilter> filters;
+    std::vector<uint256> hashes;
+    BOOST_CHECK(filterindex.LookupFilterRange(pindexTip->nHeight - 9, pindexTip, filters));
+    BOOST_CHECK(filterindex.LookupFilterHashRange(pindexTip->nHeight - 9, pindexTip, hashes));
+    BOOST_REQUIRE_EQUAL(filters.size(), 10);
+    BOOST_REQUIRE_EQUAL(hashes.size(), 10);
+    BOOST_CHECK(filters.back().GetBlockHash() == block.GetHashPoW2());
+    for (size_t i = 0; i < filters.size(); ++i)
+        BOOST_CHECK(filters[i].GetHash() == hashes[i]);
+    BOOST_CHECK(!filterindex.LookupFilterRange(pindexTip->nHeight + 1, pindexTip, filters));
+    filterindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "blockstore.h"
+#include "chainparams.h"
+#include "txdb.h"
+#include "undo.h"
+#include "validation/validation.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstore_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(undo_cache)
+{
+    CBlockStore store;
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    CTxOut out(5 * COIN, CScript() << OP_TRUE);
+    blockundo.vtxundo[0].vprevout.emplace_back(out, 10, false, true);
+    blockundo.vtxundo[1].vprevout.emplace_back(out, 11, true, false);
+    blockundo.vtxundo[1].vprevout.emplace_back(out, 12, false, false);
+    const uint256 hashBlock = InsecureRand256();
+
+    CDiskBlockPos pos(999, 0);
+    BOOST_REQUIRE(store.UndoWriteToDisk(blockundo, pos, hashBlock, Params().MessageStart()));
+
+    // Read back from the cache and, once the files are closed, from disk; either way the same.
+    for (int i = 0; i < 2; ++i)
+    {
+        CBlockUndo read;
+        BOOST_REQUIRE(store.UndoReadFromDisk(read, pos, hashBlock));
+        BOOST_REQUIRE_EQUAL(read.vtxundo.size(), 2);
+        BOOST_REQUIRE_EQUAL(read.vtxundo[1].vprevout.size(), 2);
+        BOOST_CHECK(read.vtxundo[0].vprevout[0].out == out);
+        BOOST_CHECK_EQUAL(read.vtxundo[1].vprevout[0].nHeight, 11);
+        BOOST_CHECK(read.vtxundo[1].vprevout[0].fCoinBase);
+        BOOST_CHECK_EQUAL(read.vtxundo[1].vprevout[1].nHeight, 12);
+        store.CloseBlockFiles();
+    }
+
+    // A different block at the same position isn't taken from the cache.
+    CBlockUndo read;
+    BOOST_CHECK(!store.UndoReadFromDisk(read, pos, InsecureRand256()));
+
+    // Nor is anything from pruned files.
+    BOOST_REQUIRE(store.UndoReadFromDisk(read, pos, hashBlock));
+    store.UnlinkPrunedFiles({999});
+    BOOST_CHECK(!store.UndoReadFromDisk(read, pos, hashBlock));
+}
+
+BOOST_AUTO_TEST_CASE(recent_block_cache)
+{
+    const CBlockIndex* pindexGenesis;
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Genesis();
+    }
+    const CDiskBlockPos pos = pindexGenesis->GetBlockPos();
+    CBlock block;
+    BOOST_REQUIRE(blockStore.ReadBlockFromDisk(block, pos, Params(), pindexGenesis));
+    BOOST_CHECK(block.GetHashPoW2() == Params().GenesisBlock().GetHashPoW2());
+    BOOST_CHECK(block.fPOWChecked);
+
+    // What is cached for a position is what gets read from it, as long as it is the block the index expects.
+    auto pblockOther = std::make_shared<CBlock>(block);
+    pblockOther->nTime += 1;
+    blockStore.CacheBlock(pos, pblockOther);
+    CBlock cached;
+    BOOST_REQUIRE(blockStore.ReadBlockFromDisk(cached, pos, Params()));
+    BOOST_CHECK_EQUAL(cached.nTime, block.nTime + 1);
+    BOOST_CHECK_EQUAL(cached.vtx.size(), block.vtx.size());
+    BOOST_CHECK(!blockStore.ReadBlockFromDisk(cached, pos, Params(), pindexGenesis));
+
+    // Without the cache it comes from the block file again.
+    blockStore.CloseBlockFiles();
+    BOOST_REQUIRE(blockStore.ReadBlockFromDisk(cached, pos, Params(), pindexGenesis));
+    BOOST_CHECK(cached.GetHashPoW2() == block.GetHashPoW2());
+}
+
+BOOST_AUTO_TEST_CASE(raw_block_magic)
+{
+    const CBlockIndex* pindexGenesis;
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Genesis();
+    }
+    std::vector<unsigned char> vRawBlock;
+    BOOST_REQUIRE(blockStore.ReadRawBlockFromDisk(vRawBlock, pindexGenesis->GetBlockPos(), Params().MessageStart()));
+    CDataStream ss(vRawBlock, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    ss >> block;
+    BOOST_CHECK(block.GetHashPoW2() == Params().GenesisBlock().GetHashPoW2());
+
+    // Bytes stored for another network (or not a block at all) aren't handed out.
+    CMessageHeader::MessageStartChars otherMessageStart;
+    memcpy(otherMessageStart, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    otherMessageStart[0] ^= 0xff;
+    BOOST_CHECK(!blockStore.ReadRawBlockFromDisk(vRawBlock, pindexGenesis->GetBlockPos(), otherMessageStart));
+}
+
+BOOST_FIXTURE_TEST_CASE(verifydb_records_verified_chain, TestChain100Setup)
+{
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsdbview, 3, 50, true));
+    CVerifiedChain verified;
+    BOOST_REQUIRE(pblocktree->ReadVerifiedChain(verified));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(verified.hashTip == chainActive.Tip()->GetBlockHashPoW2());
+        BOOST_CHECK_EQUAL(verified.nHeight, chainActive.Height());
+        BOOST_CHECK_EQUAL(verified.nLowestHeight, chainActive.Height() - 50);
+    }
+    // Only the per block checks are recorded, levels 3 and 4 are always done.
+    BOOST_CHECK_EQUAL(verified.nLevel, 2);
+
+    // After a clean shutdown going deeper the next time only adds the blocks below those, and keeps the range in one piece.
+    BOOST_REQUIRE(pblocktree->WriteFlag("cleanshutdown", true));
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsdbview, 3, 80, true));
+    BOOST_REQUIRE(pblocktree->ReadVerifiedChain(verified));
+    BOOST_CHECK_EQUAL(verified.nLowestHeight, chainActive.Height() - 80);
+    BOOST_CHECK_EQUAL(verified.nLevel, 2);
+
+    // Without one the record isn't trusted, so nothing is skipped and the range isn't extended.
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsdbview, 3, 30, true));
+    BOOST_REQUIRE(pblocktree->ReadVerifiedChain(verified));
+    BOOST_CHECK_EQUAL(verified.nLowestHeight, chainActive.Height() - 30);
+    bool fCleanShutdown = true;
+    BOOST_CHECK(pblocktree->ReadFlag("cleanshutdown", fCleanShutdown) && !fCleanShutdown);
+
+    // A full verification doesn't touch the record.
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 1, 10));
+    CVerifiedChain unchanged;
+    BOOST_REQUIRE(pblocktree->ReadVerifiedChain(unchanged));
+    BOOST_CHECK_EQUAL(unchanged.nLevel, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,113 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "clockcache.h"
+#include "validation/validation.h"
+
+#include "test/test_gulden.h"
+
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+struct IdentityHasher
+{
+    uint64_t operator()(uint64_t n) const { return n; }
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(clockcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(clockcache_basic)
+{
+    CClockCache<uint256, bool, BlockHasher> cache(100);
+    BOOST_CHECK(cache.capacity() >= 100);
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+
+    uint256 hash1 = InsecureRand256(), hash2 = InsecureRand256();
+    bool fValue = false;
+    BOOST_CHECK(!cache.tryGet(hash1, fValue));
+    cache.insert(hash1, true);
+    cache.insert(hash2, false);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK(cache.tryGet(hash1, fValue) && fValue);
+    BOOST_CHECK(cache.tryGet(hash2, fValue) && !fValue);
+    BOOST_CHECK(cache.contains(hash1));
+    BOOST_CHECK_EQUAL(cache.hits(), 2);
+    BOOST_CHECK_EQUAL(cache.misses(), 1);
+
+    // Inserting a key again replaces its value.
+    cache.insert(hash2, true);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK(cache.tryGet(hash2, fValue) && fValue);
+
+    BOOST_CHECK(cache.remove(hash1));
+    BOOST_CHECK(!cache.remove(hash1));
+    BOOST_CHECK(!cache.contains(hash1));
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    BOOST_CHECK(!cache.contains(hash2));
+}
+
+BOOST_AUTO_TEST_CASE(clockcache_eviction)
+{
+    // A single set, so every key competes for the same slots.
+    const size_t nWays = CClockCache<uint64_t, uint64_t, IdentityHasher>::CLOCKCACHE_WAYS;
+    CClockCache<uint64_t, uint64_t, IdentityHasher> cache(nWays, 1);
+    BOOST_CHECK_EQUAL(cache.capacity(), nWays);
+    for (uint64_t i = 0; i < nWays; ++i)
+        cache.insert(i, i);
+    BOOST_CHECK_EQUAL(cache.size(), nWays);
+
+    // An entry used since it went in survives the next eviction, the oldest unused one doesn't.
+    uint64_t nValue;
+    BOOST_CHECK(cache.tryGet(0, nValue));
+    cache.insert(nWays, nWays);
+    BOOST_CHECK_EQUAL(cache.size(), nWays);
+    BOOST_CHECK_EQUAL(cache.evictions(), 1);
+    BOOST_CHECK(cache.contains(0));
+    BOOST_CHECK(!cache.contains(1));
+    BOOST_CHECK(cache.contains(nWays));
+
+    // Never holds more than its capacity.
+    for (uint64_t i = 0; i < 10 * nWays; ++i)
+        cache.insert(100 + i, i);
+    BOOST_CHECK_EQUAL(cache.size(), nWays);
+    for (uint64_t i = 9 * nWays; i < 10 * nWays; ++i)
+        BOOST_CHECK(cache.tryGet(100 + i, nValue) && nValue == i);
+}
+
+BOOST_AUTO_TEST_CASE(clockcache_threads)
+{
+    CClockCache<uint64_t, uint64_t, IdentityHasher> cache(1024, 4);
+    const int nThreads = 4;
+    const uint64_t nKeys = 4096;
+    std::vector<std::thread> threads;
+    std::atomic<int> nWrong{0};
+    for (int t = 0; t < nThreads; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (uint64_t i = 0; i < nKeys; ++i)
+            {
+                uint64_t nKey = (i * nThreads + t) % nKeys;
+                uint64_t nValue;
+                if (cache.tryGet(nKey, nValue) && nValue != nKey * 2)
+                    ++nWrong;
+                cache.insert(nKey, nKey * 2);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    BOOST_CHECK_EQUAL(nWrong, 0);
+    BOOST_CHECK(cache.size() <= cache.capacity());
+    BOOST_CHECK_EQUAL(cache.hits() + cache.misses(), nThreads * nKeys);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include "coins.h"
 #include "script/standard.h"
 #include "uint256.h"
+#include "txdb.h"
 #include "undo.h"
 #include "utilstrencodings.h"
 #include "test/test_gulden.h"
@@ -70,7 +71,7 @@ public:
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
-                map_[it->first] = it->second.coin;
+                map_[it->first] = it->second.coin.Decompress();
                 if (it->second.coin.IsSpent() && InsecureRandRange(3) == 0) {
                     // Randomly delete empty entries on write.
                     map_.erase(it->first);
@@ -559,9 +560,10 @@ size_t InsertCoinsMapEntry(CCoinsMap& map, CAmount value, char flags)
         return 0;
     }
     assert(flags != NO_ENTRY);
-    CCoinsCacheEntry entry;
+    Coin coin;
+    SetCoinsValue(value, coin);
+    CCoinsCacheEntry entry(coin);
     entry.flags = flags;
-    SetCoinsValue(value, entry.coin);
     auto inserted = map.emplace(OUTPOINT, std::move(entry));
     assert(inserted.second);
     return inserted.first->second.coin.DynamicMemoryUsage();
@@ -577,7 +579,7 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
         if (it->second.coin.IsSpent()) {
             value = PRUNED;
         } else {
-            value = it->second.coin.out.nValue;
+            value = it->second.coin.Decompress().out.nValue;
         }
         flags = it->second.flags;
         assert(flags != NO_ENTRY);
@@ -586,7 +588,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
     InsertCoinsMapEntry(map, value, flags);
     view.BatchWrite(map, {});
 }
@@ -855,4 +858,346 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_getallcoinsabove)
+{
+    // Three layers of cache on top of an (empty) base, as used for the witness views.
+    COutPoint outpoints[5];
+    for (int i=0; i<5; ++i)
+        outpoints[i] = COutPoint(InsecureRand256(), i);
+    auto makeCoin = [](CAmount nValue) { return Coin(CTxOut(nValue, CScript() << OP_TRUE), 1, false, false); };
+    auto sameCoins = [](const std::map<COutPoint, Coin>& a, const std::map<COutPoint, Coin>& b)
+    {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const auto& x, const auto& y) { return x.first == y.first && x.second == y.second; });
+    };
+
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache1(&base);
+    cache1.AddCoin(outpoints[0], makeCoin(1), false);
+    cache1.AddCoin(outpoints[1], makeCoin(2), false);
+    CCoinsViewCacheTest cache2(&cache1);
+    cache2.SpendCoin(outpoints[0], nullptr, true);
+    cache2.AddCoin(outpoints[2], makeCoin(3), false);
+    CCoinsViewCacheTest cache3(&cache2);
+    cache3.AddCoin(outpoints[3], makeCoin(4), false);
+    cache3.SpendCoin(outpoints[2], nullptr, true);
+
+    std::map<COutPoint, Coin> expected;
+    cache3.GetAllCoins(expected);
+    BOOST_CHECK_EQUAL(expected.size(), 2);
+    BOOST_CHECK(expected.count(outpoints[1]) && expected.count(outpoints[3]));
+
+    // Substituting the lower layer with its own contents gives the same result.
+    std::map<COutPoint, Coin> cache1Coins;
+    cache1.GetAllCoins(cache1Coins);
+    std::map<COutPoint, Coin> result;
+    cache3.GetAllCoinsAbove(&cache1, cache1Coins, result);
+    BOOST_CHECK(sameCoins(result, expected));
+
+    // The substituted contents are really used instead of enumerating the lower layers.
+    std::map<COutPoint, Coin> substitute;
+    substitute[outpoints[0]] = makeCoin(5);
+    substitute[outpoints[4]] = makeCoin(6);
+    result.clear();
+    cache3.GetAllCoinsAbove(&cache1, substitute, result);
+    BOOST_CHECK_EQUAL(result.size(), 2);
+    BOOST_CHECK(result.count(outpoints[4]) && result.count(outpoints[3]));
+
+    // A view that isn't below us falls back to enumerating everything.
+    result.clear();
+    CCoinsViewTest unrelated;
+    cache3.GetAllCoinsAbove(&unrelated, substitute, result);
+    BOOST_CHECK(sameCoins(result, expected));
+}
+
+static bool SameCoin(const Coin& a, const Coin& b)
+{
+    return a.out == b.out && a.nHeight == b.nHeight && a.fCoinBase == b.fCoinBase && a.fSegSig == b.fSegSig;
+}
+
+BOOST_AUTO_TEST_CASE(compact_coin)
+{
+    CTxOutPoW2Witness details;
+    details.spendingKeyID = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+    details.witnessKeyID = CKeyID(uint160(std::vector<unsigned char>(20, 2)));
+    details.lockFromBlock = 1000;
+    details.lockUntilBlock = 200000;
+    details.failCount = 3;
+    details.actionNonce = std::numeric_limits<uint64_t>::max();
+    CKeyID keyID(uint160(std::vector<unsigned char>(20, 3)));
+    CScript scriptKeyHash = GetScriptForDestination(keyID);
+    CScript scriptScriptHash = GetScriptForDestination(CScriptID(CScript() << OP_TRUE));
+    CScript scriptRaw = CScript() << OP_RETURN << std::vector<unsigned char>(100, 4);
+
+    std::vector<Coin> coins;
+    coins.emplace_back(CTxOut(50000 * COIN, details), 1234, false, true);
+    coins.emplace_back(CTxOut(25 * COIN + 1, CTxOutStandardKeyHash(keyID)), 4321, true, true);
+    coins.emplace_back(CTxOut(0, scriptKeyHash), MEMPOOL_HEIGHT, false, false);
+    coins.emplace_back(CTxOut(MAX_MONEY, scriptScriptHash), 1, true, false);
+    coins.emplace_back(CTxOut(InsecureRandRange(MAX_MONEY), scriptRaw), 0, false, false);
+    coins.emplace_back(CTxOut(MAX_MONEY + 1, CScript()), 77, false, true);
+    for (const Coin& coin : coins)
+    {
+        CCompactCoin compact(coin);
+        BOOST_CHECK(!compact.IsSpent());
+        BOOST_CHECK(SameCoin(compact.Decompress(), coin));
+
+        // The same serialization as the full coin, both ways.
+        CDataStream ssFull(SER_DISK, CLIENT_VERSION), ssCompact(SER_DISK, CLIENT_VERSION);
+        ssFull << coin;
+        ssCompact << compact;
+        BOOST_CHECK(ssFull.str() == ssCompact.str());
+        CCompactCoin read;
+        ssCompact >> read;
+        BOOST_CHECK(SameCoin(read.Decompress(), coin));
+    }
+
+    // Key hash outputs and the common scripts don't allocate.
+    BOOST_CHECK_EQUAL(CCompactCoin(coins[1]).DynamicMemoryUsage(), 0U);
+    BOOST_CHECK_EQUAL(CCompactCoin(coins[2]).DynamicMemoryUsage(), 0U);
+    BOOST_CHECK_EQUAL(CCompactCoin(coins[3]).DynamicMemoryUsage(), 0U);
+
+    CCompactCoin compact(coins[0]);
+    compact.Clear();
+    BOOST_CHECK(compact.IsSpent());
+    BOOST_CHECK(compact.Decompress().IsSpent());
+    BOOST_CHECK(CCompactCoin(Coin()).IsSpent());
+}
+
+BOOST_FIXTURE_TEST_CASE(witness_db_records, TestingSetup)
+{
+    // Witness outputs go through the compact record format, anything else through the generic coin format; both must come back unchanged.
+    CTxOutPoW2Witness details;
+    details.spendingKeyID = CKeyID(uint160(std::vector<unsigned char>(20, InsecureRandBits(8))));
+    details.witnessKeyID = CKeyID(uint160(std::vector<unsigned char>(20, InsecureRandBits(8))));
+    details.lockFromBlock = 1000;
+    details.lockUntilBlock = 200000;
+    details.failCount = 3;
+    details.actionNonce = 7;
+    Coin witnessCoin(CTxOut(50000 * COIN, details), 1234, false, true);
+    Coin scriptCoin(CTxOut(25 * COIN, CScript() << OP_TRUE), 4321, true, false);
+    COutPoint witnessOutpoint(InsecureRand256(), 1);
+    COutPoint scriptOutpoint(InsecureRand256(), 0);
+
+    CWitViewDB witnessDB(1 << 20, true, true);
+    {
+        CCoinsViewCache cache(&witnessDB);
+        cache.AddCoin(witnessOutpoint, Coin(witnessCoin), false);
+        cache.AddCoin(scriptOutpoint, Coin(scriptCoin), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    Coin coin;
+    BOOST_CHECK(witnessDB.GetCoin(witnessOutpoint, coin));
+    BOOST_CHECK(SameCoin(coin, witnessCoin));
+    BOOST_CHECK(coin.fSegSig && !coin.fCoinBase);
+    BOOST_CHECK(witnessDB.GetCoin(scriptOutpoint, coin));
+    BOOST_CHECK(SameCoin(coin, scriptCoin));
+
+    std::map<COutPoint, Coin> allCoins;
+    witnessDB.GetAllCoins(allCoins);
+    BOOST_CHECK_EQUAL(allCoins.size(), 2U);
+    BOOST_CHECK(SameCoin(allCoins[witnessOutpoint], witnessCoin));
+    BOOST_CHECK(SameCoin(allCoins[scriptOutpoint], scriptCoin));
+
+    // Already in the compact format, upgrading again is a no-op.
+    BOOST_CHECK(witnessDB.UpgradeRecordFormat());
+    BOOST_CHECK(witnessDB.GetCoin(witnessOutpoint, coin) && SameCoin(coin, witnessCoin));
+}
+
+BOOST_FIXTURE_TEST_CASE(witness_db_erased, TestingSetup)
+{
+    CTxOutPoW2Witness details;
+    details.spendingKeyID = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+    details.witnessKeyID = CKeyID(uint160(std::vector<unsigned char>(20, 2)));
+    Coin witnessCoin(CTxOut(50000 * COIN, details), 1234, false, true);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 10; ++i)
+        outpoints.emplace_back(InsecureRand256(), i);
+
+    CWitViewDB witnessDB(1 << 20, true, true);
+    BOOST_CHECK_EQUAL(witnessDB.GetErasedSinceCompaction(), 0U);
+    {
+        // Spent before they were ever written, the way the witness caches leave them: nothing to erase.
+        CCoinsViewCache cache(&witnessDB);
+        cache.AddCoin(outpoints[0], Coin(witnessCoin), false);
+        cache.SpendCoin(outpoints[0], nullptr, true);
+        for (size_t i = 1; i < outpoints.size(); ++i)
+            cache.AddCoin(outpoints[i], Coin(witnessCoin), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(witnessDB.GetErasedSinceCompaction(), 0U);
+    BOOST_CHECK(!witnessDB.HaveCoin(outpoints[0]));
+    {
+        CCoinsViewCache cache(&witnessDB);
+        for (size_t i = 1; i < 4; ++i)
+            cache.SpendCoin(outpoints[i], nullptr, true);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(witnessDB.GetErasedSinceCompaction(), 3U);
+
+    std::map<COutPoint, Coin> allCoins;
+    witnessDB.GetAllCoins(allCoins);
+    BOOST_CHECK_EQUAL(allCoins.size(), outpoints.size() - 4);
+    for (size_t i = 4; i < outpoints.size(); ++i)
+        BOOST_CHECK(allCoins.count(outpoints[i]));
+}
+
+BOOST_AUTO_TEST_CASE(prefetched_coins)
+{
+    // Prefetched coins are served from the cache, but never overwrite an entry the cache already has nor get written back.
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    COutPoint outpointNew(InsecureRand256(), 0);
+    COutPoint outpointCached(InsecureRand256(), 1);
+    Coin coinCached(CTxOut(25 * COIN, CScript() << OP_TRUE), 100, false, false);
+    cache.AddCoin(outpointCached, Coin(coinCached), false);
+
+    Coin coinNew(CTxOut(10 * COIN, CScript() << OP_TRUE), 200, false, false);
+    cache.AddPrefetchedCoin(outpointNew, Coin(coinNew));
+    cache.AddPrefetchedCoin(outpointCached, Coin(CTxOut(1 * COIN, CScript() << OP_FALSE), 300, false, false));
+    cache.AddPrefetchedCoin(COutPoint(InsecureRand256(), 2), Coin());
+
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    BOOST_CHECK(cache.HaveCoinInCache(outpointNew));
+    BOOST_CHECK(SameCoin(cache.AccessCoin(outpointNew), coinNew));
+    BOOST_CHECK(SameCoin(cache.AccessCoin(outpointCached), coinCached));
+    cache.SelfTest();
+
+    BOOST_CHECK(cache.Flush());
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpointCached, coin));
+    BOOST_CHECK(!base.GetCoin(outpointNew, coin));
+}
+
+BOOST_FIXTURE_TEST_CASE(background_flush, TestingSetup)
+{
+    // Coins written from the background must be visible straight after the flush, and spending them has to win over what is on disk.
+    COutPoint outpoint(InsecureRand256(), 0);
+    Coin scriptCoin(CTxOut(25 * COIN, CScript() << OP_TRUE), 4321, true, false);
+    uint256 hashFirst = InsecureRand256();
+    uint256 hashSecond = InsecureRand256();
+
+    CCoinsViewDB coinsDB(1 << 20, true, true);
+    coinsDB.SetBackgroundFlush(true);
+    {
+        CCoinsViewCache cache(&coinsDB);
+        cache.AddCoin(outpoint, Coin(scriptCoin), false);
+        cache.SetBestBlock(hashFirst);
+        BOOST_CHECK(cache.Flush());
+    }
+    Coin coin;
+    BOOST_CHECK(coinsDB.GetCoin(outpoint, coin) && SameCoin(coin, scriptCoin));
+    BOOST_CHECK(coinsDB.HaveCoin(outpoint));
+    BOOST_CHECK(coinsDB.GetBestBlock() == hashFirst);
+
+    {
+        CCoinsViewCache cache(&coinsDB);
+        cache.SpendCoin(outpoint);
+        cache.SetBestBlock(hashSecond);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!coinsDB.GetCoin(outpoint, coin));
+    BOOST_CHECK(!coinsDB.HaveCoin(outpoint));
+    BOOST_CHECK(coinsDB.GetBestBlock() == hashSecond);
+
+    BOOST_CHECK(coinsDB.WaitForBackgroundFlush());
+    BOOST_CHECK(!coinsDB.HaveCoin(outpoint));
+    BOOST_CHECK(coinsDB.GetBestBlock() == hashSecond);
+    std::unique_ptr<CCoinsViewCursor> cursor(coinsDB.Cursor());
+    BOOST_CHECK(!cursor->Valid());
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_journal, TestingSetup)
+{
+    // A cache written to a journal and read back on top of the same database ends up with what it had modified, and flushes it the same.
+    COutPoint outpointKept(InsecureRand256(), 0);
+    COutPoint outpointSpent(InsecureRand256(), 1);
+    COutPoint outpointNew(InsecureRand256(), 2);
+    Coin scriptCoin(CTxOut(25 * COIN, CScript() << OP_TRUE), 4321, true, false);
+    uint256 hashFirst = InsecureRand256();
+    uint256 hashSecond = InsecureRand256();
+
+    CCoinsViewDB coinsDB(1 << 20, true, true);
+    {
+        CCoinsViewCache cache(&coinsDB);
+        cache.AddCoin(outpointKept, Coin(scriptCoin), false);
+        cache.AddCoin(outpointSpent, Coin(scriptCoin), false);
+        cache.SetBestBlock(hashFirst);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    {
+        CCoinsViewCache cache(&coinsDB);
+        BOOST_CHECK(!cache.AccessCoin(outpointKept).IsSpent());
+        cache.SpendCoin(outpointSpent);
+        cache.AddCoin(outpointNew, Coin(scriptCoin), false);
+        cache.SetBestBlock(hashSecond);
+        // Only the spend and the new coin are modified.
+        BOOST_CHECK_EQUAL(cache.WriteJournal(ss), 2);
+    }
+
+    CDataStream ssCorrupt(ss.begin(), ss.end() - 1, SER_DISK, CLIENT_VERSION);
+    CCoinsViewCache cache(&coinsDB);
+    BOOST_CHECK_THROW(cache.ReadJournal(ssCorrupt), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+    BOOST_CHECK(cache.GetBestBlock() == hashFirst);
+
+    BOOST_CHECK_EQUAL(cache.ReadJournal(ss), 2);
+    BOOST_CHECK(cache.GetBestBlock() == hashSecond);
+    BOOST_CHECK(cache.AccessCoin(outpointSpent).IsSpent());
+    BOOST_CHECK(SameCoin(cache.AccessCoin(outpointNew), scriptCoin));
+    BOOST_CHECK(cache.Flush());
+
+    Coin coin;
+    BOOST_CHECK(coinsDB.GetCoin(outpointKept, coin) && SameCoin(coin, scriptCoin));
+    BOOST_CHECK(!coinsDB.HaveCoin(outpointSpent));
+    BOOST_CHECK(coinsDB.GetCoin(outpointNew, coin) && SameCoin(coin, scriptCoin));
+    BOOST_CHECK(coinsDB.GetBestBlock() == hashSecond);
+}
+
+BOOST_FIXTURE_TEST_CASE(cursor_from, TestingSetup)
+{
+    // A cursor from a hash starts at the first coin of a transaction sorting at or after it, the way shards of the set are gone through.
+    CCoinsViewDB coinsDB(1 << 20, true, true);
+    std::set<uint256> hashes;
+    {
+        CCoinsViewCache cache(&coinsDB);
+        for (int i = 0; i < 64; ++i)
+        {
+            uint256 hash = InsecureRand256();
+            hashes.insert(hash);
+            cache.AddCoin(COutPoint(hash, 0), Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false, false), false);
+            cache.AddCoin(COutPoint(hash, 1), Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false, false), false);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    for (int nByte : {0, 0x40, 0x80, 0xff})
+    {
+        uint256 hashStart;
+        *hashStart.begin() = nByte;
+        std::unique_ptr<CCoinsViewCursor> cursor(coinsDB.CursorFrom(hashStart));
+        size_t nExpected = 0;
+        for (const uint256& hash : hashes)
+        {
+            if (*hash.begin() >= nByte)
+                nExpected += 2;
+        }
+        size_t nFound = 0;
+        COutPoint key;
+        for (; cursor->Valid(); cursor->Next())
+        {
+            BOOST_REQUIRE(cursor->GetKey(key));
+            BOOST_CHECK(*key.getHash().begin() >= nByte);
+            ++nFound;
+        }
+        BOOST_CHECK_EQUAL(nFound, nExpected);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
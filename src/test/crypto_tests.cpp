@@ -9,8 +9,11 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/hash/sigma/sigma.h"
+#include "Gulden/Common/scrypt.h"
 #include "random.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 #include "test/test_gulden.h"
 
 #include <cryptopp/config.h>
@@ -320,6 +323,42 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Whichever implementation SHA256AutoDetect picked, it has to agree with hashing each message twice.
+    for (int i = 0; i <= 32; ++i)
+    {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j)
+            in[j] = InsecureRandBits(8);
+        for (int j = 0; j < i; ++j)
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_autodetect_benchmark)
+{
+    // Whatever the benchmark leaves out, the implementations that remain still hash correctly.
+    uint32_t nDisable = 0;
+    std::string strBenchmarked = SHA256AutoDetect(nDisable, true);
+    BOOST_CHECK_EQUAL(SHA256Implementation(), strBenchmarked);
+    TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    unsigned char in[64 * 8], out1[32 * 8], out2[32 * 8];
+    for (int j = 0; j < 64 * 8; ++j)
+        in[j] = InsecureRandBits(8);
+    for (int j = 0; j < 8; ++j)
+        CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+    SHA256D64(out2, in, 8);
+    BOOST_CHECK(memcmp(out1, out2, sizeof(out1)) == 0);
+
+    // Handing the outcome back without benchmarking picks the same.
+    BOOST_CHECK_EQUAL(SHA256AutoDetect(nDisable, false), strBenchmarked);
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -504,6 +543,393 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(sigma_aes_prng)
+{
+    // The hardware PRNG kernel must match repeated CryptoPP ECB encryption exactly, or SIGMA verification would diverge between machines.
+    selectOptimisedImplementations();
+    if (!selected_aes256_prng_advance)
+    {
+        BOOST_TEST_MESSAGE("No hardware AES available, skipping sigma_aes_prng");
+        return;
+    }
+    std::vector<unsigned char> seed = ParseHex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4");
+    CryptoPP::ECB_Mode<CryptoPP::AES>::Encryption enc;
+    enc.SetKey(&seed[0], seed.size());
+    uint8_t roundKeys[AES256_PRNG_ROUND_KEY_BYTES];
+    aes256_prng_expand_key(&seed[0], roundKeys);
+    for (uint64_t numSteps : {1, 2, 7, 65536})
+    {
+        std::vector<unsigned char> expected(seed);
+        std::vector<unsigned char> ciphered(32);
+        for (uint64_t i = 0; i < numSteps; ++i)
+        {
+            enc.ProcessData(&ciphered[0], &expected[0], 32);
+            expected = ciphered;
+        }
+        std::vector<unsigned char> state(seed);
+        selected_aes256_prng_advance(roundKeys, &state[0], numSteps);
+        BOOST_CHECK_EQUAL(HexStr(state), HexStr(expected));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigma_kernel_selection_cached)
+{
+    // A benchmarked choice handed back as cached gives the same implementations.
+    sigma_kernel_choice choice;
+    selectOptimisedImplementations(SIGMA_SELECT_BENCHMARK, choice);
+    sigma_selected_implementations benchmarked = selectedSigmaImplementations;
+
+    sigma_kernel_choice cached = choice;
+    selectOptimisedImplementations(SIGMA_SELECT_CACHED, cached);
+    BOOST_CHECK_EQUAL(selectedSigmaImplementations.shavite, benchmarked.shavite);
+    BOOST_CHECK_EQUAL(selectedSigmaImplementations.echo, benchmarked.echo);
+    BOOST_CHECK_EQUAL(selectedSigmaImplementations.argon, benchmarked.argon);
+    BOOST_CHECK_EQUAL(selectedSigmaImplementations.shaviteX2, benchmarked.shaviteX2);
+    BOOST_CHECK_EQUAL(selectedSigmaImplementations.echoX4, benchmarked.echoX4);
+    BOOST_CHECK_EQUAL(cached.shavite, choice.shavite);
+    BOOST_CHECK_EQUAL(cached.echo, choice.echo);
+    BOOST_CHECK_EQUAL(cached.argon, choice.argon);
+    selectOptimisedImplementations();
+}
+
+BOOST_AUTO_TEST_CASE(sigma_fast_hash_x2)
+{
+    // The two way kernels must produce exactly the same digests as the reference implementations for each of their lanes.
+    selectOptimisedImplementations();
+    if (!selected_echo256_opt_x2_Init || !selected_shavite3_256_opt_x2_Init)
+    {
+        BOOST_TEST_MESSAGE("No two way kernels available, skipping sigma_fast_hash_x2");
+        return;
+    }
+    std::vector<unsigned char> dataA(1000);
+    std::vector<unsigned char> dataB(1000);
+    for (unsigned int i = 0; i < dataA.size(); ++i)
+    {
+        dataA[i] = (unsigned char)(i * 7 + 3);
+        dataB[i] = (unsigned char)(i * 13 + 5);
+    }
+    // Lengths either side of the echo (192 byte) and shavite (64 byte) block boundaries and padding thresholds, as well as the mining input size.
+    for (uint64_t len : {0, 1, 63, 64, 65, 174, 175, 191, 192, 193, 80+32+200, 1000})
+    {
+        unsigned char refA[32], refB[32], outA[32], outB[32];
+
+        sph_echo256_context ctx_echo_ref;
+        sph_echo256_init(&ctx_echo_ref);
+        sph_echo256(&ctx_echo_ref, &dataA[0], len);
+        sph_echo256_close(&ctx_echo_ref, refA);
+        sph_echo256_init(&ctx_echo_ref);
+        sph_echo256(&ctx_echo_ref, &dataB[0], len);
+        sph_echo256_close(&ctx_echo_ref, refB);
+        echo256_opt_x2_hashState ctx_echo;
+        selected_echo256_opt_x2_Init(&ctx_echo);
+        selected_echo256_opt_x2_Update(&ctx_echo, &dataA[0], &dataB[0], len/2);
+        selected_echo256_opt_x2_Update(&ctx_echo, &dataA[len/2], &dataB[len/2], len-(len/2));
+        selected_echo256_opt_x2_Final(&ctx_echo, outA, outB);
+        BOOST_CHECK_EQUAL(HexStr(outA, outA+32), HexStr(refA, refA+32));
+        BOOST_CHECK_EQUAL(HexStr(outB, outB+32), HexStr(refB, refB+32));
+
+        shavite3_ref_hashState ctx_shavite_ref;
+        shavite3_ref_Init(&ctx_shavite_ref);
+        shavite3_ref_Update(&ctx_shavite_ref, &dataA[0], len);
+        shavite3_ref_Final(&ctx_shavite_ref, refA);
+        shavite3_ref_Init(&ctx_shavite_ref);
+        shavite3_ref_Update(&ctx_shavite_ref, &dataB[0], len);
+        shavite3_ref_Final(&ctx_shavite_ref, refB);
+        shavite3_256_opt_x2_hashState ctx_shavite;
+        selected_shavite3_256_opt_x2_Init(&ctx_shavite);
+        selected_shavite3_256_opt_x2_Update(&ctx_shavite, &dataA[0], &dataB[0], len/2);
+        selected_shavite3_256_opt_x2_Update(&ctx_shavite, &dataA[len/2], &dataB[len/2], len-(len/2));
+        selected_shavite3_256_opt_x2_Final(&ctx_shavite, outA, outB);
+        BOOST_CHECK_EQUAL(HexStr(outA, outA+32), HexStr(refA, refA+32));
+        BOOST_CHECK_EQUAL(HexStr(outB, outB+32), HexStr(refB, refB+32));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigma_fast_hash_x4)
+{
+    // The four way kernels must produce exactly the same digests as the reference implementations for each of their lanes.
+    selectOptimisedImplementations();
+    if (!selected_echo256_opt_x4_Init || !selected_shavite3_256_opt_x4_Init)
+    {
+        BOOST_TEST_MESSAGE("No four way kernels available, skipping sigma_fast_hash_x4");
+        return;
+    }
+    std::vector<std::vector<unsigned char>> data(4, std::vector<unsigned char>(1000));
+    for (unsigned int lane = 0; lane < 4; ++lane)
+    {
+        for (unsigned int i = 0; i < data[lane].size(); ++i)
+            data[lane][i] = (unsigned char)(i * (7 + 6 * lane) + 3 + 2 * lane);
+    }
+    for (uint64_t len : {0, 1, 63, 64, 65, 174, 175, 191, 192, 193, 80+32+200, 1000})
+    {
+        unsigned char ref[32];
+        unsigned char out[4][32];
+        unsigned char* const outPtrs[4] = { out[0], out[1], out[2], out[3] };
+        const unsigned char* const firstHalf[4] = { &data[0][0], &data[1][0], &data[2][0], &data[3][0] };
+        const unsigned char* const secondHalf[4] = { &data[0][len/2], &data[1][len/2], &data[2][len/2], &data[3][len/2] };
+
+        echo256_opt_x4_hashState ctx_echo;
+        selected_echo256_opt_x4_Init(&ctx_echo);
+        selected_echo256_opt_x4_Update(&ctx_echo, firstHalf, len/2);
+        selected_echo256_opt_x4_Update(&ctx_echo, secondHalf, len-(len/2));
+        selected_echo256_opt_x4_Final(&ctx_echo, outPtrs);
+        for (unsigned int lane = 0; lane < 4; ++lane)
+        {
+            sph_echo256_context ctx_echo_ref;
+            sph_echo256_init(&ctx_echo_ref);
+            sph_echo256(&ctx_echo_ref, &data[lane][0], len);
+            sph_echo256_close(&ctx_echo_ref, ref);
+            BOOST_CHECK_EQUAL(HexStr(out[lane], out[lane]+32), HexStr(ref, ref+32));
+        }
+
+        shavite3_256_opt_x4_hashState ctx_shavite;
+        selected_shavite3_256_opt_x4_Init(&ctx_shavite);
+        selected_shavite3_256_opt_x4_Update(&ctx_shavite, firstHalf, len/2);
+        selected_shavite3_256_opt_x4_Update(&ctx_shavite, secondHalf, len-(len/2));
+        selected_shavite3_256_opt_x4_Final(&ctx_shavite, outPtrs);
+        for (unsigned int lane = 0; lane < 4; ++lane)
+        {
+            shavite3_ref_hashState ctx_shavite_ref;
+            shavite3_ref_Init(&ctx_shavite_ref);
+            shavite3_ref_Update(&ctx_shavite_ref, &data[lane][0], len);
+            shavite3_ref_Final(&ctx_shavite_ref, ref);
+            BOOST_CHECK_EQUAL(HexStr(out[lane], out[lane]+32), HexStr(ref, ref+32));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigma_arena_planner)
+{
+    const uint64_t MB = 1024;
+    const uint64_t GB = 1024*1024;
+    sigma_settings settings;
+    std::vector<sigma_numa_node> noNuma;
+
+    // Plenty of memory: whole arenas, threads split evenly.
+    sigma_memory_info large;
+    large.totalKb = 64*GB;
+    large.availableKb = 60*GB;
+    sigma_arena_plan plan = sigmaPlanArenas(settings, 8*GB, 9, 1, true, large, noNuma);
+    BOOST_CHECK_EQUAL(plan.limitedBy, "request");
+    BOOST_REQUIRE_EQUAL(plan.contexts.size(), 2);
+    BOOST_CHECK_EQUAL(plan.contexts[0].arenaSizeKb, 4*GB);
+    BOOST_CHECK_EQUAL(plan.contexts[0].numThreads, 5);
+    BOOST_CHECK_EQUAL(plan.contexts[1].numThreads, 4);
+    BOOST_CHECK_EQUAL(plan.numHashes, 2*settings.numHashesPost);
+
+    // Too little memory: capped below what is available (reserve and slow hash scratch), split evenly.
+    sigma_memory_info small;
+    small.totalKb = 8*GB;
+    small.availableKb = 6*GB;
+    plan = sigmaPlanArenas(settings, 8*GB, 4, 1, true, small, noNuma);
+    BOOST_CHECK_EQUAL(plan.limitedBy, "available_memory");
+    BOOST_CHECK_EQUAL(plan.budgetKb, 6*GB - 512*MB - 4*settings.argonMemoryCostKb);
+    BOOST_REQUIRE_EQUAL(plan.contexts.size(), 2);
+    BOOST_CHECK_EQUAL(plan.contexts[0].arenaSizeKb, plan.contexts[1].arenaSizeKb);
+    BOOST_CHECK_EQUAL(plan.contexts[0].arenaSizeKb % settings.argonMemoryCostKb, 0);
+    BOOST_CHECK(plan.plannedKb <= plan.budgetKb);
+
+    // A standby set of arenas halves the budget of each set.
+    sigma_arena_plan doubled = sigmaPlanArenas(settings, 8*GB, 4, 2, true, small, noNuma);
+    BOOST_CHECK(doubled.plannedKb <= plan.budgetKb/2);
+
+    // The explicit huge page pool is outside of MemAvailable and counts towards the budget.
+    sigma_memory_info huge = small;
+    huge.availableKb = 2*GB;
+    huge.hugePageSizeKb = 2*MB;
+    huge.freeHugePagesKb = 8*GB;
+    plan = sigmaPlanArenas(settings, 8*GB, 4, 1, true, huge, noNuma);
+    BOOST_CHECK(plan.hugePages);
+    BOOST_CHECK_EQUAL(plan.plannedKb, 8*GB);
+    plan = sigmaPlanArenas(settings, 8*GB, 4, 1, false, huge, noNuma);
+    BOOST_CHECK(!plan.hugePages);
+    BOOST_CHECK(plan.plannedKb < 2*GB);
+
+    // NUMA: memory a node can't hold moves to the other node, every context stays on one node.
+    std::vector<sigma_numa_node> numa(2);
+    for (int i=0; i<2; ++i)
+    {
+        numa[i].node = i;
+        for (int j=0; j<8; ++j)
+            numa[i].cpus.push_back(i*8+j);
+    }
+    numa[0].freeKb = 3*GB;
+    numa[1].freeKb = 20*GB;
+    plan = sigmaPlanArenas(settings, 8*GB, 8, 1, true, large, numa);
+    BOOST_REQUIRE_EQUAL(plan.contexts.size(), 3);
+    BOOST_CHECK_EQUAL(plan.contexts[0].numaNode, 0);
+    BOOST_CHECK_EQUAL(plan.contexts[0].arenaSizeKb, 3*GB);
+    BOOST_CHECK_EQUAL(plan.contexts[0].numThreads, 4);
+    BOOST_CHECK_EQUAL(plan.contexts[1].numaNode, 1);
+    BOOST_CHECK_EQUAL(plan.contexts[2].numaNode, 1);
+    BOOST_CHECK_EQUAL(plan.contexts[1].numThreads + plan.contexts[2].numThreads, 4);
+    BOOST_CHECK_EQUAL(plan.plannedKb, 8*GB);
+}
+
+BOOST_AUTO_TEST_CASE(sigma_verify_cache_lru)
+{
+    std::vector<uint8_t> chunk(1024, 7);
+    std::array<uint64_t, 4> slowHash = {1, 2, 3, 4};
+    std::array<uint64_t, 4> result;
+    uint256 keys[4];
+    for (int i=0; i<4; ++i)
+        keys[i] = sigma_verify_cache::key(chunk.data(), 80, i, 1, 1);
+    BOOST_CHECK(keys[0] != keys[1]);
+
+    // Room for two chunks and two slow hashes.
+    sigma_verify_cache cache(2048, 2);
+    BOOST_CHECK(!cache.getChunk(keys[0]));
+    cache.putChunk(keys[0], chunk.data(), chunk.size());
+    cache.putChunk(keys[1], chunk.data(), chunk.size());
+    BOOST_CHECK(cache.getChunk(keys[0]));
+    // keys[1] is now the least recently used and is evicted first.
+    std::shared_ptr<const std::vector<uint8_t>> held = cache.getChunk(keys[1]);
+    cache.getChunk(keys[0]);
+    cache.putChunk(keys[2], chunk.data(), chunk.size());
+    BOOST_CHECK(!cache.getChunk(keys[1]));
+    BOOST_CHECK(cache.getChunk(keys[0]));
+    BOOST_CHECK(cache.getChunk(keys[2]));
+    // An evicted chunk stays valid for whoever holds it.
+    BOOST_REQUIRE(held);
+    BOOST_CHECK(*held == chunk);
+
+    cache.putSlowHash(keys[0], slowHash);
+    cache.putSlowHash(keys[1], slowHash);
+    cache.putSlowHash(keys[2], slowHash);
+    BOOST_CHECK(!cache.getSlowHash(keys[0], result));
+    BOOST_CHECK(cache.getSlowHash(keys[2], result));
+    BOOST_CHECK(result == slowHash);
+
+    sigma_verify_cache_stats stats = cache.getStats();
+    BOOST_CHECK_EQUAL(stats.chunkEntries, 2);
+    BOOST_CHECK_EQUAL(stats.chunkBytes, 2048);
+    BOOST_CHECK_EQUAL(stats.chunkHits, 5);
+    BOOST_CHECK_EQUAL(stats.chunkMisses, 2);
+    BOOST_CHECK_EQUAL(stats.slowHashEntries, 2);
+
+    // Chunks larger than the whole cache are never stored.
+    sigma_verify_cache tiny(512, 0);
+    tiny.putChunk(keys[3], chunk.data(), chunk.size());
+    tiny.putSlowHash(keys[3], slowHash);
+    BOOST_CHECK(!tiny.getChunk(keys[3]));
+    BOOST_CHECK(!tiny.getSlowHash(keys[3], result));
+}
+
+BOOST_AUTO_TEST_CASE(sigma_verify_cache_results)
+{
+    selectOptimisedImplementations();
+
+    sigma_verify_cache cache(64*1024*1024, 64);
+    sigma_verify_context uncached(defaultSigmaSettings, 1);
+    sigma_verify_context cached(defaultSigmaSettings, 1, &cache);
+
+    // Verification results and hashes must not depend on whether or not they come from the cache.
+    arith_uint256 target = ~arith_uint256();
+    CBlockHeader header;
+    header.nVersion = 536870912;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = defaultSigmaSettings.activationDate + 1;
+    header.nBits = 0x1e0fffff;
+    for (int i=0; i<3; ++i)
+    {
+        header.nPreNonce = 5;
+        header.nPostNonce = i;
+        uint256 expected, actual, repeat;
+        BOOST_CHECK(uncached.verifyHeaderAgainstTarget<1>(header, target, &expected));
+        BOOST_CHECK(cached.verifyHeaderAgainstTarget<1>(header, target, &actual));
+        BOOST_CHECK(cached.verifyHeaderAgainstTarget<1>(header, target, &repeat));
+        BOOST_CHECK(expected == actual);
+        BOOST_CHECK(expected == repeat);
+        BOOST_CHECK_EQUAL(uncached.verifyHeader(header), cached.verifyHeader(header));
+    }
+    sigma_verify_cache_stats stats = cache.getStats();
+    // Every post nonce of the same pre nonce shares one slow hash.
+    BOOST_CHECK_EQUAL(stats.slowHashEntries, 1);
+    BOOST_CHECK(stats.slowHashHits >= 5);
+    BOOST_CHECK(stats.chunkHits >= 3);
+}
+
+BOOST_AUTO_TEST_CASE(sigma_throttle_pacing)
+{
+    const bool fNoInterrupt = false;
+    sigma_throttle throttle;
+    BOOST_CHECK_EQUAL(throttle.hashLimit(), 0);
+    BOOST_CHECK_EQUAL(throttle.dutyCycle(), 100);
+
+    // Unlimited never sleeps.
+    throttle.startRound(2);
+    throttle.pace(0, 0, fNoInterrupt);
+    throttle.pace(0, 1000000, fNoInterrupt);
+    throttle.pace(1, 0, fNoInterrupt);
+    throttle.pace(1, 5, fNoInterrupt);
+    std::vector<sigma_throttle_thread_stats> stats = throttle.threadStats();
+    BOOST_REQUIRE_EQUAL(stats.size(), 2);
+    BOOST_CHECK_EQUAL(stats[0].halfHashes, 1000000);
+    BOOST_CHECK_EQUAL(stats[1].halfHashes, 5);
+    BOOST_CHECK(stats[0].throttledNanos < 20 * 1000 * 1000);
+
+    // 2000 per second over two threads is 1000 for the one that paces here, so 400 of them take at least 0.4s (less what it may catch up).
+    throttle.setHashLimit(2000);
+    throttle.startRound(2);
+    throttle.pace(0, 0, fNoInterrupt);
+    int64_t nStart = GetTimeMillis();
+    for (int i = 0; i < 4; ++i)
+        throttle.pace(0, 100, fNoInterrupt);
+    BOOST_CHECK(GetTimeMillis() - nStart >= 350);
+    stats = throttle.threadStats();
+    BOOST_CHECK(stats[0].throttledNanos >= 300 * 1000 * 1000);
+    BOOST_CHECK_EQUAL(stats[1].halfHashes, 0);
+
+    // An interrupted thread doesn't wait.
+    const bool fInterrupt = true;
+    nStart = GetTimeMillis();
+    throttle.pace(0, 100000, fInterrupt);
+    BOOST_CHECK(GetTimeMillis() - nStart < 100);
+
+    // At a 20% duty cycle each 10ms of work is followed by 40ms of sleep.
+    throttle.setHashLimit(0);
+    throttle.setDutyCycle(20);
+    throttle.startRound(1);
+    throttle.pace(0, 0, fNoInterrupt);
+    MilliSleep(10);
+    nStart = GetTimeMillis();
+    throttle.pace(0, 1, fNoInterrupt);
+    BOOST_CHECK(GetTimeMillis() - nStart >= 35);
+    stats = throttle.threadStats();
+    BOOST_CHECK(stats[0].busyNanos >= 10 * 1000 * 1000);
+
+    throttle.setDutyCycle(0);
+    BOOST_CHECK_EQUAL(throttle.dutyCycle(), 1);
+    throttle.setDutyCycle(1000);
+    BOOST_CHECK_EQUAL(throttle.dutyCycle(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_batch)
+{
+    // Batches that fill the lanes exactly, partially and not at all should all agree with hashing one at a time.
+    std::vector<char> scratchpad(SCRYPT_BATCH_SCRATCHPAD_SIZE);
+    for (size_t count : {1, 2, SCRYPT_BATCH_LANES, SCRYPT_BATCH_LANES + 1, 2 * SCRYPT_BATCH_LANES + 3})
+    {
+        std::vector<std::vector<char>> inputs(count, std::vector<char>(80));
+        std::vector<std::vector<char>> outputs(count, std::vector<char>(32));
+        std::vector<const char*> inputPtrs;
+        std::vector<char*> outputPtrs;
+        for (size_t i = 0; i < count; ++i)
+        {
+            GetRandBytes((unsigned char*)&inputs[i][0], 80);
+            inputPtrs.push_back(&inputs[i][0]);
+            outputPtrs.push_back(&outputs[i][0]);
+        }
+        scrypt_1024_1_1_256_sp_batch(&inputPtrs[0], &outputPtrs[0], count, &scratchpad[0]);
+        for (size_t i = 0; i < count; ++i)
+        {
+            char ref[32];
+            scrypt_1024_1_1_256_sp_generic(&inputs[i][0], ref, &scratchpad[0]);
+            BOOST_CHECK_EQUAL(HexStr(outputs[i].begin(), outputs[i].end()), HexStr(ref, ref+32));
+        }
+    }
+}
 
 BOOST_AUTO_TEST_CASE(chacha20_testvector)
 {
@@ -377,4 +377,31 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each visits exactly the elements that are still in the cache,
+ * i.e. inserted and not erased.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    // Erase every other element.
+    std::set<uint256> expected;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (i % 2)
+            cc.contains(hashes[i], true);
+        else
+            expected.insert(hashes[i]);
+    }
+
+    std::set<uint256> visited;
+    cc.for_each([&](const uint256& h) { BOOST_CHECK(visited.insert(h).second); });
+    BOOST_CHECK(visited == expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
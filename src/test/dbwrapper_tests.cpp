@@ -79,6 +79,107 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_readmany)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (int i = 0; i < 2; i++) {
+        bool obfuscate = (bool)i;
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // Enough keys for the lookups to be spread over several threads; every other key is present.
+        std::map<uint32_t, uint256> mapIn;
+        std::vector<uint32_t> vKeys;
+        for (uint32_t n = 0; n < 4 * DBWRAPPER_READMANY_MIN_PER_THREAD; n++) {
+            vKeys.push_back(n * 2654435761U); // distinct, but not in order
+            if (n % 2 == 0) {
+                mapIn[vKeys.back()] = InsecureRand256();
+                BOOST_CHECK(dbw.Write(vKeys.back(), mapIn[vKeys.back()]));
+            }
+        }
+
+        std::vector<uint256> vValues;
+        std::vector<char> vFound;
+        BOOST_CHECK_EQUAL(dbw.ReadMany(vKeys, vValues, vFound), mapIn.size());
+        BOOST_REQUIRE_EQUAL(vValues.size(), vKeys.size());
+        BOOST_REQUIRE_EQUAL(vFound.size(), vKeys.size());
+        for (size_t n = 0; n < vKeys.size(); n++) {
+            BOOST_CHECK_EQUAL((bool)vFound[n], mapIn.count(vKeys[n]) > 0);
+            if (vFound[n])
+                BOOST_CHECK(vValues[n] == mapIn[vKeys[n]]);
+        }
+
+        // A single key, looked up on the calling thread.
+        BOOST_CHECK_EQUAL(dbw.ReadMany(std::vector<uint32_t>{vKeys[0]}, vValues, vFound), 1U);
+        BOOST_CHECK(vValues[0] == mapIn[vKeys[0]]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_tuning_and_stats)
+{
+    auto findStats = [](const std::string& name) {
+        for (const CDBStats& stats : CDBWrapper::GetOpenDatabaseStats())
+            if (stats.name == name)
+                return true;
+        return false;
+    };
+
+    ForceSetArg("-dbwrappertest-blockcache", "2");
+    ForceSetArg("-dbwrappertest-bloombits", "0");
+    ForceSetArg("-dbwrappertest-maxopenfiles", "100");
+    {
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, "dbwrappertest");
+        BOOST_CHECK(dbw.Write('k', InsecureRand256()));
+
+        CDBStats stats = dbw.GetStats();
+        BOOST_CHECK_EQUAL(stats.name, "dbwrappertest");
+        BOOST_CHECK_EQUAL(stats.nBlockCacheSize, 2U << 20);
+        BOOST_CHECK_EQUAL(stats.nWriteBufferSize, (1U << 20) / 4);
+        BOOST_CHECK_EQUAL(stats.nBloomBits, 0);
+        BOOST_CHECK_EQUAL(stats.nMaxOpenFiles, 100);
+        BOOST_CHECK(stats.nMemoryUsage > 0);
+        BOOST_CHECK(findStats("dbwrappertest"));
+
+        // Databases without a name use the defaults and aren't listed.
+        fs::path ph2 = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw2(ph2, (1 << 20), true, false, false);
+        BOOST_CHECK_EQUAL(dbw2.GetStats().nBloomBits, DEFAULT_DB_BLOOM_BITS);
+        BOOST_CHECK_EQUAL(dbw2.GetStats().nBlockCacheSize, (1U << 20) / 2);
+        BOOST_CHECK(!findStats(""));
+    }
+    BOOST_CHECK(!findStats("dbwrappertest"));
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_compactstep)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false);
+
+    // Nothing to compact in an empty database.
+    BOOST_CHECK_EQUAL(dbw.GetLevelFileCount(0), 0);
+    BOOST_CHECK(!dbw.CompactStep());
+
+    // Several write buffers worth of data, so that level 0 fills up.
+    std::vector<std::pair<uint256, uint256>> entries;
+    for (int i = 0; i < 20000; i++) {
+        entries.emplace_back(InsecureRand256(), InsecureRand256());
+        BOOST_CHECK(dbw.Write(std::pair('c', entries.back().first), entries.back().second));
+    }
+
+    // A pass ends once the whole key space is done; as the keys are random that takes at most one step per two byte prefix.
+    int nSteps = 0;
+    while (dbw.CompactStep())
+        BOOST_REQUIRE(++nSteps <= 256 + 1);
+    BOOST_CHECK(dbw.GetLevelFileCount(0) < DBWRAPPER_COMPACT_LEVEL0_FILES);
+
+    for (const auto& entry : entries) {
+        uint256 value;
+        BOOST_CHECK(dbw.Read(std::pair('c', entry.first), value));
+        BOOST_CHECK(value == entry.second);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 {
     // Perform tests both obfuscated and non-obfuscated.
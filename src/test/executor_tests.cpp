@@ -0,0 +1,99 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "executor.h"
+#include "test/test_gulden.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(executor_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(executor_runs_all_tasks)
+{
+    CExecutor executor(4);
+    std::atomic<int> nRun{0};
+    {
+        CTaskGroup group(executor, EXECUTOR_VALIDATION);
+        for (int i = 0; i < 1000; ++i)
+            group.Run([&]() { ++nRun; });
+        group.Wait();
+    }
+    BOOST_CHECK_EQUAL(nRun, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(executor_nested_groups)
+{
+    // More groups waiting on each other than there are threads; the waiting threads have to run the queued tasks themselves.
+    CExecutor executor(2);
+    std::atomic<int> nRun{0};
+    CTaskGroup outer(executor, EXECUTOR_WITNESS);
+    for (int i = 0; i < 8; ++i)
+    {
+        outer.Run([&]() {
+            CTaskGroup inner(executor, EXECUTOR_VALIDATION);
+            for (int j = 0; j < 16; ++j)
+                inner.Run([&]() { ++nRun; });
+            inner.Wait();
+        });
+    }
+    outer.Wait();
+    BOOST_CHECK_EQUAL(nRun, 8 * 16);
+}
+
+BOOST_AUTO_TEST_CASE(executor_priorities)
+{
+    // With the only thread busy, the queued tasks are taken most urgent first.
+    CExecutor executor(1);
+    std::atomic<bool> fRelease{false};
+    std::atomic<bool> fStarted{false};
+    std::vector<int> order;
+    std::mutex mutex;
+    CTaskGroup group(executor, EXECUTOR_VALIDATION);
+    group.Run([&]() { fStarted = true; while (!fRelease) std::this_thread::yield(); });
+    while (!fStarted)
+        std::this_thread::yield();
+    CTaskGroup mining(executor, EXECUTOR_MINING);
+    CTaskGroup rpc(executor, EXECUTOR_RPC);
+    CTaskGroup validation(executor, EXECUTOR_VALIDATION);
+    mining.Run([&]() { std::lock_guard<std::mutex> lock(mutex); order.push_back(EXECUTOR_MINING); });
+    rpc.Run([&]() { std::lock_guard<std::mutex> lock(mutex); order.push_back(EXECUTOR_RPC); });
+    validation.Run([&]() { std::lock_guard<std::mutex> lock(mutex); order.push_back(EXECUTOR_VALIDATION); });
+    fRelease = true;
+    // Not waiting on the groups, which would run their tasks on this thread; Stop leaves them all to the executor thread.
+    executor.Stop();
+    BOOST_CHECK(order == std::vector<int>({EXECUTOR_VALIDATION, EXECUTOR_RPC, EXECUTOR_MINING}));
+}
+
+BOOST_AUTO_TEST_CASE(executor_exceptions)
+{
+    CExecutor executor(2);
+    CTaskGroup group(executor, EXECUTOR_RPC);
+    std::atomic<int> nRun{0};
+    for (int i = 0; i < 10; ++i)
+        group.Run([&, i]() { ++nRun; if (i == 5) throw std::runtime_error("task failed"); });
+    BOOST_CHECK_THROW(group.Wait(), std::runtime_error);
+    BOOST_CHECK_EQUAL(nRun, 10);
+    // Passed on once.
+    group.Wait();
+}
+
+BOOST_AUTO_TEST_CASE(executor_after_stop)
+{
+    CExecutor executor(2);
+    executor.Stop();
+    BOOST_CHECK_EQUAL(executor.GetThreadCount(), 0);
+    bool fRun = false;
+    CTaskGroup group(executor, EXECUTOR_VALIDATION);
+    group.Run([&]() { fRun = true; });
+    BOOST_CHECK(fRun);
+    group.Wait();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,60 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "hashkernels.h"
+#include "clientversion.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(hashkernels_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(hashkernels_roundtrip)
+{
+    fs::path path = GetDataDir() / "hashkernels.dat";
+    CHashKernelChoice choice;
+    BOOST_CHECK(!ReadHashKernelChoice(path, choice));
+
+    choice = NewHashKernelChoice();
+    BOOST_CHECK(!choice.strCPU.empty());
+    BOOST_CHECK(IsHashKernelChoiceCurrent(choice));
+    choice.nSHA256Disable = 3;
+    choice.sigma.shavite = 2;
+    choice.sigma.echo = 4;
+    choice.sigma.argon = 5;
+    choice.sigma.echoX2 = false;
+    choice.sigma.shaviteX4 = false;
+    BOOST_REQUIRE(WriteHashKernelChoice(path, choice));
+
+    CHashKernelChoice read;
+    BOOST_REQUIRE(ReadHashKernelChoice(path, read));
+    BOOST_CHECK_EQUAL(read.strCPU, choice.strCPU);
+    BOOST_CHECK_EQUAL(read.nClientVersion, CLIENT_VERSION);
+    BOOST_CHECK_EQUAL(read.nSHA256Disable, 3);
+    BOOST_CHECK_EQUAL(read.sigma.shavite, 2);
+    BOOST_CHECK_EQUAL(read.sigma.echo, 4);
+    BOOST_CHECK_EQUAL(read.sigma.argon, 5);
+    BOOST_CHECK(read.sigma.shaviteX2 && !read.sigma.echoX2 && !read.sigma.shaviteX4 && read.sigma.echoX4);
+    BOOST_CHECK(IsHashKernelChoiceCurrent(read));
+
+    // Made by another version or on another processor, it has to be timed again.
+    read.nClientVersion = CLIENT_VERSION + 1;
+    BOOST_CHECK(!IsHashKernelChoiceCurrent(read));
+    read = choice;
+    read.strCPU += " (other)";
+    BOOST_CHECK(!IsHashKernelChoiceCurrent(read));
+
+    // Anything that isn't a choice is ignored.
+    {
+        fs::ofstream file(path, std::ios_base::out | std::ios_base::trunc);
+        file << "cpu=x\nversion=1\nshavite=garbage\n";
+    }
+    read = CHashKernelChoice();
+    BOOST_CHECK(!ReadHashKernelChoice(path, read));
+    BOOST_CHECK(read.strCPU.empty());
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "net_processing.h"
+#include "netmessagemaker.h"
+#include "validation/validation.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+// The headers message as it was put together before the cache, one CBlock at a time.
+static std::vector<unsigned char> ReferenceHeadersMessage(const CBlockIndex* pindexFirst, int nCount, bool fCompat)
+{
+    std::vector<CBlock> vHeaders;
+    for (const CBlockIndex* pindex = pindexFirst; (int)vHeaders.size() < nCount; pindex = chainActive.Next(pindex))
+        vHeaders.push_back(pindex->GetBlockHeader());
+    return CNetMsgMaker(PROTOCOL_VERSION, fCompat ? SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS : 0).Make(NetMsgType::HEADERS, COMPACTSIZEVECTOR(vHeaders)).data;
+}
+
+static void CheckHeadersMessages()
+{
+    LOCK(cs_main);
+    const int nHeight = chainActive.Height();
+    for (bool fCompat : {false, true})
+    {
+        for (int nFirst : {0, 1, nHeight / 2, nHeight - 1, nHeight})
+        {
+            for (int nCount : {1, 2, nHeight + 1 - nFirst})
+            {
+                if (nFirst + nCount > nHeight + 1)
+                    continue;
+                CSerializedNetMsg msg = MakeHeadersMessage(chainActive[nFirst], nCount, fCompat);
+                BOOST_CHECK_EQUAL(msg.command, NetMsgType::HEADERS);
+                BOOST_CHECK(msg.data == ReferenceHeadersMessage(chainActive[nFirst], nCount, fCompat));
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(headerscache_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(headerscache_follow_chain)
+{
+    // Twice, the second time from the cache.
+    CheckHeadersMessages();
+    CheckHeadersMessages();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(MakeHeadersMessage(chainActive.Tip(), 0, false).data == std::vector<unsigned char>(1, 0));
+    }
+
+    // A block on top extends the cached chunk.
+    CScript scriptA = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, std::make_shared<CReserveKeyOrScript>(scriptA));
+    CheckHeadersMessages();
+
+    // A reorg replaces the tip; the chunk that held the old one mustn't be given out any more.
+    CBlockIndex* pindexOldTip;
+    {
+        LOCK(cs_main);
+        pindexOldTip = chainActive.Tip();
+    }
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), pindexOldTip));
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    CScript scriptB = CScript() << OP_TRUE;
+    CreateAndProcessBlock({}, std::make_shared<CReserveKeyOrScript>(scriptB));
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip() != pindexOldTip);
+        BOOST_REQUIRE_EQUAL(chainActive.Height(), pindexOldTip->nHeight);
+    }
+    CheckHeadersMessages();
+
+    // A block off the active chain goes out on its own.
+    {
+        LOCK(cs_main);
+        CSerializedNetMsg msg = MakeHeadersMessage(pindexOldTip, 1, false);
+        std::vector<CBlock> vHeaders(1, CBlock(pindexOldTip->GetBlockHeader()));
+        BOOST_CHECK(msg.data == CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::HEADERS, COMPACTSIZEVECTOR(vHeaders)).data);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -162,4 +162,30 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("204cee644c042adf26537e2e5060f38e0b68f776b91830d396b4abf86be152ecce662faa6458e8cedbe8e37ffff3b1212d5c9d141cfdcc9a70038ef3ff4d75119a"));
 }
 
+BOOST_AUTO_TEST_CASE(pubkey_parse_cache)
+{
+    // The negated key has the same X coordinate, so it lands in the same slot of the parse cache as the key itself and
+    // must not be taken for it; likewise the uncompressed form.
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    std::vector<unsigned char> vchNegated(pubkey.begin(), pubkey.end());
+    vchNegated[0] ^= 1;
+    CPubKey pubkeyNegated(vchNegated.begin(), vchNegated.end());
+    CPubKey pubkeyUncompressed = pubkey;
+    BOOST_CHECK(pubkeyUncompressed.Decompress());
+
+    uint256 hash = InsecureRand256();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    for (int i = 0; i < 2; ++i)
+    {
+        BOOST_CHECK(pubkey.Verify(hash, vchSig));
+        BOOST_CHECK(!pubkeyNegated.Verify(hash, vchSig));
+        BOOST_CHECK(pubkeyUncompressed.Verify(hash, vchSig));
+        BOOST_CHECK(pubkey.Verify(hash, vchSig));
+        BOOST_CHECK(!pubkey.Verify(InsecureRand256(), vchSig));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
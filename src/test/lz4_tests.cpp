@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "support/lz4.h"
+#include "blockstore.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "random.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(lz4_tests, BasicTestingSetup)
+
+static std::vector<unsigned char> RoundTrip(const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> compressed;
+    LZ4CompressBlock(data.data(), data.size(), compressed);
+    std::vector<unsigned char> decompressed(data.size());
+    BOOST_CHECK(LZ4DecompressBlock(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()));
+    BOOST_CHECK(decompressed == data);
+    return compressed;
+}
+
+BOOST_AUTO_TEST_CASE(lz4_roundtrip)
+{
+    // Empty and very short inputs are stored as literals only.
+    RoundTrip(std::vector<unsigned char>());
+    RoundTrip(std::vector<unsigned char>(1, 0x42));
+    RoundTrip(std::vector<unsigned char>(12, 0x42));
+
+    // Incompressible data grows by no more than the literal length encoding.
+    for (size_t nSize : {13, 100, 1000, 100000})
+    {
+        std::vector<unsigned char> data = InsecureRandBytes(nSize);
+        std::vector<unsigned char> compressed = RoundTrip(data);
+        BOOST_CHECK(compressed.size() <= nSize + nSize / 255 + 16);
+    }
+
+    // Repetitive data compresses well, including matches that overlap their own output.
+    std::vector<unsigned char> repetitive;
+    for (int i = 0; i < 100000; ++i)
+        repetitive.push_back((i % 7) == 0 ? InsecureRandBits(8) : (unsigned char)(i % 3));
+    BOOST_CHECK(RoundTrip(repetitive).size() < repetitive.size() / 2);
+    BOOST_CHECK(RoundTrip(std::vector<unsigned char>(100000, 0)).size() < 1000);
+}
+
+BOOST_AUTO_TEST_CASE(lz4_malformed)
+{
+    std::vector<unsigned char> data(5000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (i * 31) % 17;
+    std::vector<unsigned char> compressed;
+    LZ4CompressBlock(data.data(), data.size(), compressed);
+
+    std::vector<unsigned char> decompressed(data.size());
+    // Wrong output size.
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size(), decompressed.data(), decompressed.size() - 1));
+    decompressed.resize(data.size() + 1);
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()));
+    // Truncated input.
+    decompressed.resize(data.size());
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size() - 1, decompressed.data(), decompressed.size()));
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), 0, decompressed.data(), decompressed.size()));
+    // Random corruption must never read or write out of bounds (the sanitizers catch that), and mostly fails.
+    for (int i = 0; i < 200; ++i)
+    {
+        std::vector<unsigned char> corrupt = compressed;
+        corrupt[InsecureRandRange(corrupt.size())] ^= 1 + InsecureRandRange(255);
+        LZ4DecompressBlock(corrupt.data(), corrupt.size(), decompressed.data(), decompressed.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lz4_block_frame)
+{
+    const CBlock& block = Params().GenesisBlock();
+    std::vector<unsigned char> serialised;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, serialised, 0, block);
+
+    CBlockStore store;
+    std::vector<unsigned char> blockData;
+    unsigned int nDiskSize = store.PrepareBlockForDisk(block, blockData);
+    BOOST_CHECK_EQUAL(nDiskSize, blockData.size() + 4);
+    BOOST_CHECK_EQUAL(ReadLE32(blockData.data()), serialised.size());
+    BOOST_CHECK(std::equal(serialised.begin(), serialised.end(), blockData.begin() + 4));
+
+    // A block made up of repetitive transactions is worth compressing.
+    CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    tx.vout[0].output.scriptPubKey = CScript() << OP_TRUE;
+    CBlock bigBlock = block;
+    for (int i = 0; i < 100; ++i)
+    {
+        tx.vin[0].prevout = COutPoint(block.GetHashPoW2(), i);
+        bigBlock.vtx.push_back(MakeTransactionRef(tx));
+    }
+    serialised.clear();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, serialised, 0, bigBlock);
+
+    store.SetCompressBlocks(true);
+    nDiskSize = store.PrepareBlockForDisk(bigBlock, blockData);
+    BOOST_CHECK_EQUAL(nDiskSize, blockData.size() + 4);
+    uint32_t nFrameSize = ReadLE32(blockData.data());
+    BOOST_CHECK(nFrameSize & BLOCK_FRAME_COMPRESSED);
+    BOOST_CHECK_EQUAL(nFrameSize & ~BLOCK_FRAME_COMPRESSED, blockData.size() - 4);
+    BOOST_CHECK(blockData.size() < serialised.size());
+
+    std::vector<unsigned char> decompressed;
+    BOOST_CHECK(CBlockStore::DecompressBlockFrame(blockData.data() + 4, blockData.size() - 4, decompressed));
+    BOOST_CHECK(decompressed == serialised);
+    CBlock readBlock;
+    CMemoryReader(SER_DISK, CLIENT_VERSION, decompressed.data(), decompressed.size()) >> readBlock;
+    BOOST_CHECK(readBlock.GetHashPoW2() == bigBlock.GetHashPoW2());
+    BOOST_CHECK(!CBlockStore::DecompressBlockFrame(blockData.data() + 4, blockData.size() - 5, decompressed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
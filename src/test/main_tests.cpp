@@ -3,8 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "consensus/validation.h"
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 #include "net.h"
+#include "random.h"
+#include "txdb.h"
 #include "unity/signals.h"
 
 #include "test/test_gulden.h"
@@ -53,4 +57,154 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(check_block_parallel_tx_checks)
+{
+    // The transaction checks run on the block check threads of the test setup; a failure has to be reported the same as a serial check would.
+    CBlock block = Params().GenesisBlock();
+    block.fChecked = false;
+    CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    tx.vout[0].output.scriptPubKey = CScript() << OP_TRUE;
+    for (int i = 0; i < 200; ++i)
+    {
+        tx.vin[0].prevout = COutPoint(block.vtx[0]->GetHash(), i);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, Params().GetConsensus(), false, false));
+    BOOST_CHECK(state.IsValid());
+
+    tx.vin.push_back(tx.vin[0]);
+    block.vtx[150] = MakeTransactionRef(tx);
+    BOOST_CHECK(!CheckBlock(block, state, Params().GetConsensus(), false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+
+    // Two transactions spending the same output is caught in the same check.
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(block.vtx[0]->GetHash(), 10);
+    tx.vout[0].nValue = 2;
+    block.vtx[150] = MakeTransactionRef(tx);
+    CValidationState stateDoubleSpend;
+    BOOST_CHECK(!CheckBlock(block, stateDoubleSpend, Params().GetConsensus(), false, false));
+    BOOST_CHECK_EQUAL(stateDoubleSpend.GetRejectReason(), "bad-txns-inputs-duplicate");
+}
+
+BOOST_AUTO_TEST_CASE(load_block_index_guts)
+{
+    // A chain with a fork, so that children end up in other key ranges (read on other threads) than their parents.
+    const int nBlocks = 2000;
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    std::vector<uint256> vHash(nBlocks);
+    std::vector<const CBlockIndex*> vWrite;
+    for (int i = 0; i < nBlocks; ++i)
+    {
+        CBlockIndex& index = vIndex[i];
+        index.pprev = i == 0 ? NULL : &vIndex[i == nBlocks / 2 ? nBlocks / 4 : i - 1];
+        index.nHeight = index.pprev ? index.pprev->nHeight + 1 : 0;
+        index.nVersion = 1;
+        index.hashMerkleRoot = InsecureRand256();
+        index.nTime = i;
+        index.nTx = 1;
+        index.nStatus = BLOCK_HAVE_DATA;
+        vHash[i] = CDiskBlockIndex(&index).GetBlockHashPoW2();
+        index.phashBlock = &vHash[i];
+        vWrite.push_back(&index);
+    }
+
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_REQUIRE(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*>>(), 0, vWrite));
+
+    std::map<uint256, std::unique_ptr<CBlockIndex>> loaded;
+    BOOST_REQUIRE(db.LoadBlockIndexGuts([&](const uint256& hash) -> CBlockIndex* {
+        if (hash.IsNull())
+            return NULL;
+        std::unique_ptr<CBlockIndex>& pindex = loaded[hash];
+        if (!pindex)
+            pindex.reset(new CBlockIndex());
+        return pindex.get();
+    }));
+
+    BOOST_REQUIRE_EQUAL(loaded.size(), nBlocks);
+    for (int i = 0; i < nBlocks; ++i)
+    {
+        const CBlockIndex* pindex = loaded[vHash[i]].get();
+        BOOST_CHECK_EQUAL(pindex->nHeight, vIndex[i].nHeight);
+        BOOST_CHECK(pindex->hashMerkleRoot == vIndex[i].hashMerkleRoot);
+        if (i == 0)
+            BOOST_CHECK(pindex->pprev == NULL);
+        else
+            BOOST_CHECK(pindex->pprev == loaded[*vIndex[i].pprev->phashBlock].get());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_index_witness_header)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1;
+    BOOST_CHECK(!CBlockIndex(header).witnessHeader);
+
+    header.nVersionPoW2Witness = 1;
+    header.nTimePoW2Witness = 2;
+    header.hashMerkleRootPoW2Witness = InsecureRand256();
+    header.witnessHeaderPoW2Sig.assign(65, 0x5a);
+    CBlockIndex index(header);
+    BOOST_REQUIRE(index.witnessHeader);
+    BOOST_CHECK(index.GetBlockHeader().GetHashPoW2() == header.GetHashPoW2());
+
+    // Copies share the witness header, and it survives a round trip through the block tree database format.
+    CBlockIndex copy = index;
+    BOOST_CHECK(copy.witnessHeader == index.witnessHeader);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.GetHashMerkleRootPoW2Witness() == header.hashMerkleRootPoW2Witness);
+    BOOST_CHECK(diskindex.GetWitnessHeaderPoW2Sig() == header.witnessHeaderPoW2Sig);
+    BOOST_CHECK(diskindex.GetBlockHashPoW2() == header.GetHashPoW2());
+}
+
+BOOST_FIXTURE_TEST_CASE(block_connect_stats, TestChain100Setup)
+{
+    std::vector<CBlockConnectStats> stats = GetBlockConnectStats(BLOCK_CONNECT_STATS_HISTORY + 1);
+    BOOST_CHECK_EQUAL(stats.size(), BLOCK_CONNECT_STATS_HISTORY);
+    BOOST_CHECK_EQUAL(GetBlockConnectStats(10).size(), 10U);
+    BOOST_CHECK(GetBlockConnectStats(0).empty());
+
+    // Oldest first, so the last one is the tip.
+    LOCK(cs_main);
+    const CBlockConnectStats& tip = stats.back();
+    BOOST_CHECK_EQUAL(tip.nHeight, chainActive.Height());
+    BOOST_CHECK(tip.hash == chainActive.Tip()->GetBlockHashPoW2());
+    BOOST_CHECK_EQUAL(stats[stats.size() - 2].nHeight, chainActive.Height() - 1);
+    BOOST_CHECK_EQUAL(tip.nTx, 1U);
+    BOOST_CHECK(tip.nTotalMicros >= tip.nConnectBlockMicros);
+    BOOST_CHECK(tip.nConnectBlockMicros >= tip.nCheckMicros + tip.nForksMicros + tip.nTxMicros + tip.nVerifyMicros + tip.nIndexMicros);
+}
+
+BOOST_FIXTURE_TEST_CASE(chain_status_follows_tip, TestChain100Setup)
+{
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(status->nHeight, chainActive.Height());
+        BOOST_CHECK(status->hashTip == chainActive.Tip()->GetBlockHashPoW2());
+        BOOST_CHECK_EQUAL(status->nTipTime, chainActive.Tip()->GetBlockTime());
+        BOOST_CHECK_EQUAL(status->nHeaderHeight, pindexBestHeader->nHeight);
+    }
+
+    // A new block publishes a new snapshot; the one taken before is left as it was.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock({}, std::make_shared<CReserveKeyOrScript>(scriptPubKey));
+    std::shared_ptr<const CChainStatus> statusNew = GetChainStatus();
+    BOOST_CHECK_EQUAL(statusNew->nHeight, status->nHeight + 1);
+    BOOST_CHECK(statusNew->hashTip == block.GetHashPoW2());
+    BOOST_CHECK_EQUAL(statusNew->nHeaderHeight, statusNew->nHeight);
+    BOOST_CHECK(status->hashTip != statusNew->hashTip);
+}
 BOOST_AUTO_TEST_SUITE_END()
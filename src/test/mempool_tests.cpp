@@ -116,6 +116,18 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     testPool.removeRecursive(txParent);
     BOOST_CHECK_EQUAL(testPool.size(), poolSize - 6);
     BOOST_CHECK_EQUAL(testPool.size(), 0U);
+
+    // The links of removed entries are reused, and come back empty:
+    testPool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+    testPool.addUnchecked(txChild[0].GetHash(), entry.FromTx(txChild[0]));
+    CTxMemPool::txiter parentIt = testPool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter childIt = testPool.mapTx.find(txChild[0].GetHash());
+    BOOST_CHECK(testPool.GetMemPoolParents(parentIt).empty());
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(parentIt).size(), 1U);
+    BOOST_CHECK(*testPool.GetMemPoolParents(childIt).begin() == parentIt);
+    BOOST_CHECK(testPool.GetMemPoolChildren(childIt).empty());
+    testPool.removeRecursive(txParent);
+    BOOST_CHECK_EQUAL(testPool.size(), 0U);
 }
 
 template<typename name>
@@ -594,4 +606,47 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorWalkTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK(pool.cs);
+
+    // A chain of 10 transactions, each spending the previous one.
+    std::vector<CTxMemPool::txiter> chain;
+    uint256 hashPrev = GetRandHash();
+    for (int i = 0; i < 10; i++) {
+        CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.setHash(hashPrev);
+        tx.vin[0].prevout.n = 0;
+        tx.vout.resize(1);
+        tx.vout[0].output.scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        hashPrev = tx.GetHash();
+        pool.addUnchecked(hashPrev, entry.Fee(1000).FromTx(tx));
+        chain.push_back(pool.mapTx.find(hashPrev));
+    }
+
+    CTxMemPool::setEntries setAll, setDone, setRest;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    pool.CalculateMemPoolAncestors(*chain[9], setAll, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+    BOOST_CHECK_EQUAL(setAll.size(), 9U);
+    pool.CalculateMemPoolAncestorsExcept(chain[9], setRest, setDone);
+    BOOST_CHECK(setRest == setAll);
+
+    // With the first six in the block, only the three after them are left.
+    setDone.insert(chain.begin(), chain.begin() + 6);
+    setRest.clear();
+    pool.CalculateMemPoolAncestorsExcept(chain[9], setRest, setDone);
+    BOOST_CHECK(setRest == CTxMemPool::setEntries({chain[6], chain[7], chain[8]}));
+
+    const uint256 hashSecond = chain[1]->GetTx().GetHash();
+    BOOST_CHECK(pool.AnyMemPoolAncestor(chain[9], [&](const CTxMemPoolEntry& e) { return e.GetTx().GetHash() == hashSecond; }));
+    BOOST_CHECK(!pool.AnyMemPoolAncestor(chain[1], [&](const CTxMemPoolEntry& e) { return e.GetTx().GetHash() == hashSecond; }));
+    BOOST_CHECK(!pool.AnyMemPoolAncestor(chain[0], [](const CTxMemPoolEntry&) { return true; }));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
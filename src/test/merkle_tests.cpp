@@ -139,4 +139,45 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(block_hash_cache)
+{
+    CBlock block;
+    for (int i = 0; i < 5; ++i)
+    {
+        CMutableTransaction mtx(TEST_DEFAULT_TX_VERSION);
+        mtx.nLockTime = i;
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    // Remembered roots are handed out only while vtx holds the same transactions.
+    uint256 root = BlockMerkleRoot(block);
+    uint256 rootPart = BlockMerkleRoot(block, 1, 3);
+    BOOST_CHECK(root == BlockMerkleRoot(block.vtx.begin(), block.vtx.end()));
+    BOOST_CHECK(rootPart == BlockMerkleRoot(block.vtx.begin() + 1, block.vtx.begin() + 3));
+    BOOST_CHECK(root == BlockMerkleRoot(block));
+    block.vtx.pop_back();
+    BOOST_CHECK(BlockMerkleRoot(block) == BlockMerkleRoot(block.vtx.begin(), block.vtx.end()));
+    BOOST_CHECK(BlockMerkleRoot(block) != root);
+    BOOST_CHECK(BlockMerkleRoot(block, 1, 3) == rootPart);
+
+    // Likewise the header hashes for the header fields, also through copies that share the remembered hashes.
+    block.nVersion = 1;
+    block.nTime = 1000;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    uint256 hash = block.GetHashPoW2();
+    CBlock copy(block);
+    BOOST_CHECK(copy.GetHashPoW2() == hash);
+    copy.nNonce++;
+    BOOST_CHECK(copy.GetHashPoW2() != hash);
+    BOOST_CHECK(copy.GetHashPoW2() == SerializeHash(copy, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS));
+    BOOST_CHECK(block.GetHashPoW2() == hash);
+    CBlockHeader header = block.GetBlockHeader();
+    BOOST_CHECK(header.GetHashLegacy() == hash);
+    block.nVersionPoW2Witness = 1;
+    block.nTimePoW2Witness = 1001;
+    BOOST_CHECK(block.GetHashLegacy() == hash);
+    BOOST_CHECK(block.GetHashPoW2() != hash);
+    BOOST_CHECK(block.GetHashPoW2() == SerializeHash(block, SER_GETHASH, SERIALIZE_BLOCK_HEADER_NO_POW2_WITNESS_SIG));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "metrics.h"
+#include "test/test_gulden.h"
+
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(metrics_tests, BasicTestingSetup)
+
+static CMetricSnapshot FindSnapshot(const std::string& name)
+{
+    for (const CMetricSnapshot& snapshot : GetMetricSnapshots())
+        if (snapshot.name == name)
+            return snapshot;
+    BOOST_ERROR("metric " + name + " not found");
+    return CMetricSnapshot();
+}
+
+BOOST_AUTO_TEST_CASE(metric_record)
+{
+    CMetric metric("test: record");
+    for (uint64_t n = 1; n <= 100; ++n)
+        metric.Record(n);
+    metric.Record(5000);
+
+    CMetricSnapshot snapshot = FindSnapshot("test: record");
+    BOOST_CHECK_EQUAL(snapshot.nCount, 101);
+    BOOST_CHECK_EQUAL(snapshot.nTotal, 5050 + 5000);
+    BOOST_CHECK_EQUAL(snapshot.nMax, 5000);
+    // 50 lies in the 32-63us bucket, 99 in the 64-127us one.
+    BOOST_CHECK_EQUAL(snapshot.nP50, 64);
+    BOOST_CHECK_EQUAL(snapshot.nP99, 128);
+
+    metric.Reset();
+    snapshot = metric.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.nCount, 0);
+    BOOST_CHECK_EQUAL(snapshot.nTotal, 0);
+    BOOST_CHECK_EQUAL(snapshot.nMax, 0);
+}
+
+BOOST_AUTO_TEST_CASE(metric_threads)
+{
+    CMetric metric("test: threads");
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+        threads.emplace_back([&]() { for (int n = 0; n < 1000; ++n) metric.Record(10); });
+    for (auto& thread : threads)
+        thread.join();
+    CMetricSnapshot snapshot = metric.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.nCount, 8000);
+    BOOST_CHECK_EQUAL(snapshot.nTotal, 80000);
+}
+
+BOOST_AUTO_TEST_CASE(metric_timer)
+{
+    // The timer has to cover the rest of the scope, not just the statement it is declared in.
+    for (int i = 0; i < 3; ++i)
+    {
+        DO_BENCHMARK("test: timer", BCLog::BENCH);
+        MilliSleep(2);
+    }
+    CMetricSnapshot snapshot = FindSnapshot("test: timer");
+    BOOST_CHECK_EQUAL(snapshot.nCount, 3);
+    BOOST_CHECK(snapshot.nTotal >= 6000);
+
+    std::string strText = GetMetricsPrometheusText();
+    BOOST_CHECK(strText.find("gulden_duration_seconds_count{name=\"test: timer\"} 3\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(metric_bytes)
+{
+    CMetric metric("test: bytes", BCLog::NONE, 1, MetricUnit::BYTES);
+    metric.Record(1000);
+    metric.Record(3000);
+    CMetricSnapshot snapshot = FindSnapshot("test: bytes");
+    BOOST_CHECK(snapshot.unit == MetricUnit::BYTES);
+    BOOST_CHECK_EQUAL(snapshot.nTotal, 4000);
+
+    // Sizes are not scaled to seconds and are kept apart from the durations.
+    std::string strText = GetMetricsPrometheusText();
+    BOOST_CHECK(strText.find("gulden_size_bytes_sum{name=\"test: bytes\"} 4000.000000\n") != std::string::npos);
+    BOOST_CHECK(strText.find("gulden_duration_seconds_count{name=\"test: bytes\"}") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -210,6 +210,19 @@ static void TestPackageSelection(const CChainParams& chainparams, std::shared_pt
     mempool.addUnchecked(tx.GetHash(), entry.Fee(10000).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(chainActive.Tip(), reservedScript);
     BOOST_CHECK(pblocktemplate->block.vtx.size() >= 9 && pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
+
+    // Nothing changed since, so the next template reuses the selection of this one.
+    std::unique_ptr<CBlockTemplate> pblocktemplateAgain = AssemblerForTest(chainparams).CreateNewBlock(chainActive.Tip(), reservedScript);
+    BOOST_CHECK_EQUAL(pblocktemplateAgain->block.vtx.size(), pblocktemplate->block.vtx.size());
+    for (size_t i = 1; i < pblocktemplate->block.vtx.size() && i < pblocktemplateAgain->block.vtx.size(); ++i)
+        BOOST_CHECK(pblocktemplateAgain->block.vtx[i]->GetHash() == pblocktemplate->block.vtx[i]->GetHash());
+    BOOST_CHECK(pblocktemplateAgain->vTxFees == pblocktemplate->vTxFees);
+
+    // Whereas a change to the mempool is picked up.
+    mempool.removeRecursive(tx);
+    pblocktemplateAgain = AssemblerForTest(chainparams).CreateNewBlock(chainActive.Tip(), reservedScript);
+    for (size_t i=0; i<pblocktemplateAgain->block.vtx.size(); ++i)
+        BOOST_CHECK(pblocktemplateAgain->block.vtx[i]->GetHash() != hashLowFeeTx2);
 }
 
 // Define PRINT_TEST_NONCES_CPP to generate the blockinfo table once
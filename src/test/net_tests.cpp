@@ -184,4 +184,124 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    CNetRecvBufferPool pool;
+    CSerializeData vch;
+    pool.Get(vch, 100, 100);
+    BOOST_CHECK_EQUAL(vch.size(), 100);
+    BOOST_CHECK(vch.capacity() >= CNetRecvBufferPool::MIN_CLASS_SIZE);
+    const char* pData = vch.data();
+    pool.Put(std::move(vch));
+
+    // The next message of about that size gets the same buffer back.
+    CSerializeData vch2;
+    pool.Get(vch2, 3000, 3000);
+    BOOST_CHECK(vch2.data() == pData);
+    BOOST_CHECK_EQUAL(vch2.size(), 3000);
+
+    // A large buffer serves the first part of a large message, so that it doesn't have to grow later.
+    CSerializeData vchLarge;
+    pool.Get(vchLarge, 2000000, 2000000);
+    const char* pLarge = vchLarge.data();
+    pool.Put(std::move(vchLarge));
+    pool.Get(vchLarge, RECV_PRESIZE_LIMIT, 1500000);
+    BOOST_CHECK(vchLarge.data() == pLarge);
+    BOOST_CHECK_EQUAL(vchLarge.size(), RECV_PRESIZE_LIMIT);
+
+    // Small buffers aren't worth keeping.
+    CSerializeData vchSmall(10);
+    vchSmall.shrink_to_fit();
+    pool.Put(std::move(vchSmall));
+    CSerializeData vch3;
+    pool.Get(vch3, 10, 10);
+    BOOST_CHECK(vch3.capacity() >= CNetRecvBufferPool::MIN_CLASS_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(cnode_receive_large_message)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode(new CNode(0, NODE_NETWORK, 0, socket_t(get_io_context()), addr, 0, 0, CAddress(), "", false));
+
+    std::vector<char> payload(1000000);
+    for (size_t i = 0; i < payload.size(); ++i)
+        payload[i] = (char)(i * 7);
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::BLOCK, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ssHeader(SER_NETWORK, INIT_PROTO_VERSION);
+    ssHeader << hdr;
+
+    bool fComplete = false;
+    const void* pBuf = pnode->GetReceiveBuffer().data();
+    BOOST_CHECK(pnode->ReceiveMsgBytes(ssHeader.data(), ssHeader.size(), fComplete));
+    BOOST_CHECK(!fComplete);
+
+    // Receive it the way the socket handler does; after the first part it goes straight into the message.
+    size_t nPos = 0;
+    int nDirect = 0;
+    while (nPos < payload.size()) {
+        boost::asio::mutable_buffer buffer = pnode->GetReceiveBuffer();
+        size_t nBytes = std::min(std::min(buffer.size(), payload.size() - nPos), (size_t)100000);
+        memcpy(buffer.data(), &payload[nPos], nBytes);
+        if (buffer.data() != pBuf)
+            ++nDirect;
+        BOOST_CHECK(pnode->ReceiveMsgBytes(static_cast<const char*>(buffer.data()), nBytes, fComplete));
+        nPos += nBytes;
+        BOOST_CHECK_EQUAL(fComplete, nPos == payload.size());
+    }
+    BOOST_CHECK(nDirect > 0);
+    BOOST_CHECK(pnode->GetReceiveBuffer().data() == pBuf);
+}
+
+BOOST_AUTO_TEST_CASE(compressed_message)
+{
+    std::vector<unsigned char> payload(100000);
+    for (size_t i = 0; i < payload.size(); ++i)
+        payload[i] = (unsigned char)(i % 251 < 200 ? 0 : i);
+
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::BLOCK;
+    msg.data = payload;
+    BOOST_REQUIRE(CompressNetMessage(msg));
+    BOOST_CHECK_EQUAL(msg.command, NetMsgType::COMPRESSED);
+    BOOST_CHECK(msg.data.size() < payload.size() / 2);
+
+    CDataStream vRecv(msg.data, SER_NETWORK, PROTOCOL_VERSION);
+    std::string strCommand = msg.command;
+    BOOST_REQUIRE(DecompressNetMessage(vRecv, strCommand));
+    BOOST_CHECK_EQUAL(strCommand, NetMsgType::BLOCK);
+    BOOST_CHECK(std::vector<unsigned char>(vRecv.begin(), vRecv.end()) == payload);
+
+    // Cut short it doesn't decompress.
+    CDataStream vTruncated(std::vector<unsigned char>(msg.data.begin(), msg.data.end() - 1), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!DecompressNetMessage(vTruncated, strCommand));
+
+    // Nor does a tiny message that claims to expand to far more than LZ4 can.
+    CDataStream vInflated(SER_NETWORK, PROTOCOL_VERSION);
+    vInflated << std::string(NetMsgType::BLOCK);
+    WriteCompactSize(vInflated, MAX_PROTOCOL_MESSAGE_LENGTH);
+    const char compressed[10] = {};
+    vInflated.write(compressed, sizeof(compressed));
+    BOOST_CHECK(!DecompressNetMessage(vInflated, strCommand));
+
+    // Small messages, other kinds and data that doesn't compress are sent as they are.
+    CSerializedNetMsg small;
+    small.command = NetMsgType::HEADERS;
+    small.data.resize(MIN_COMPRESS_MESSAGE_SIZE - 1);
+    BOOST_CHECK(!CompressNetMessage(small));
+    CSerializedNetMsg inv;
+    inv.command = NetMsgType::INV;
+    inv.data = payload;
+    BOOST_CHECK(!CompressNetMessage(inv));
+    CSerializedNetMsg noise;
+    noise.command = NetMsgType::BLOCK;
+    noise.data.resize(10000);
+    GetRandBytes(noise.data.data(), noise.data.size());
+    BOOST_CHECK(!CompressNetMessage(noise));
+    BOOST_CHECK_EQUAL(noise.command, NetMsgType::BLOCK);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
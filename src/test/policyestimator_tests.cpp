@@ -11,6 +11,8 @@
 
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "clientversion.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -194,6 +196,29 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
         BOOST_CHECK(feeEst.estimateSmartFee(i, NULL, mpool).GetFeePerK() >= feeEst.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE).GetFeePerK());
         BOOST_CHECK(feeEst.estimateSmartFee(i, NULL, mpool).GetFeePerK() >= mpool.GetMinFee(1).GetFeePerK());
     }
+
+    // Estimates are kept until the next block, asking again gives the same answer
+    CTxMemPool emptyPool;
+    for (int i = 1; i < 48; i++) {
+        int foundAt1, foundAt2;
+        CFeeRate first = feeEst.estimateSmartFee(i, &foundAt1, emptyPool, i % 2 == 0);
+        CFeeRate second = feeEst.estimateSmartFee(i, &foundAt2, emptyPool, i % 2 == 0);
+        BOOST_CHECK(first == second);
+        BOOST_CHECK_EQUAL(foundAt1, foundAt2);
+    }
+
+    // The estimates file keeps every period of every horizon
+    CAutoFile fileout(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(feeEst.Write(fileout));
+    rewind(fileout.Get());
+    CAutoFile filein(fileout.release(), SER_DISK, CLIENT_VERSION);
+    CBlockPolicyEstimator feeEstRead;
+    BOOST_CHECK(feeEstRead.Read(filein));
+    for (int i = 1; i < 48; i++) {
+        BOOST_CHECK(feeEstRead.estimateRawFee(i, 0.85, FeeEstimateHorizon::SHORT_HALFLIFE) == feeEst.estimateRawFee(i, 0.85, FeeEstimateHorizon::SHORT_HALFLIFE));
+        BOOST_CHECK(feeEstRead.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE) == feeEst.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE));
+        BOOST_CHECK(feeEstRead.estimateRawFee(i, 0.95, FeeEstimateHorizon::LONG_HALFLIFE) == feeEst.estimateRawFee(i, 0.95, FeeEstimateHorizon::LONG_HALFLIFE));
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
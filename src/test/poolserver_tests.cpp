@@ -0,0 +1,62 @@
+// Copyright (c) 2019 The Gulden developers
+// Authored by: Malcolm MacLeod (mmacleod@gmx.com)
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "generation/poolserver.h"
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(poolserver_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(prenonce_allocator_disjoint)
+{
+    CPoolPreNonceAllocator allocator(4096, 2);
+    uint32_t nGroup, nStart, nCount;
+
+    // 16 default sized ranges fill the first group without overlapping.
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        BOOST_REQUIRE(allocator.Allocate(0, nGroup, nStart, nCount));
+        BOOST_CHECK_EQUAL(nGroup, 0);
+        BOOST_CHECK_EQUAL(nStart, i * 4096);
+        BOOST_CHECK_EQUAL(nCount, 4096);
+    }
+    BOOST_CHECK_EQUAL(allocator.ActiveGroups(), 1);
+
+    // Requests are rounded up to whole ranges and spill over into the next group.
+    BOOST_REQUIRE(allocator.Allocate(5000, nGroup, nStart, nCount));
+    BOOST_CHECK_EQUAL(nGroup, 1);
+    BOOST_CHECK_EQUAL(nStart, 0);
+    BOOST_CHECK_EQUAL(nCount, 8192);
+    BOOST_CHECK_EQUAL(allocator.ActiveGroups(), 2);
+
+    // A request larger than a group is capped to the free space of a whole group.
+    BOOST_CHECK(!allocator.Allocate(POOL_PRENONCE_SPACE * 2, nGroup, nStart, nCount));
+
+    // Released ranges are handed out again.
+    allocator.Release(0, 4096 * 3, 4096);
+    BOOST_REQUIRE(allocator.Allocate(1, nGroup, nStart, nCount));
+    BOOST_CHECK_EQUAL(nGroup, 0);
+    BOOST_CHECK_EQUAL(nStart, 4096 * 3);
+}
+
+BOOST_AUTO_TEST_CASE(prenonce_allocator_exhaustion)
+{
+    CPoolPreNonceAllocator allocator(POOL_PRENONCE_SPACE, 3);
+    uint32_t nGroup, nStart, nCount;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        BOOST_REQUIRE(allocator.Allocate(0, nGroup, nStart, nCount));
+        BOOST_CHECK_EQUAL(nGroup, i);
+        BOOST_CHECK_EQUAL(nCount, POOL_PRENONCE_SPACE);
+    }
+    BOOST_CHECK(!allocator.Allocate(0, nGroup, nStart, nCount));
+    allocator.Release(1, 0, POOL_PRENONCE_SPACE);
+    BOOST_CHECK_EQUAL(allocator.ActiveGroups(), 2);
+    BOOST_REQUIRE(allocator.Allocate(0, nGroup, nStart, nCount));
+    BOOST_CHECK_EQUAL(nGroup, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 // file COPYING
 
 #include "chain.h"
+#include "Gulden/Common/diff_old.h"
 #include "chainparams.h"
 #include "pow.h"
 #include "random.h"
@@ -94,4 +95,23 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* The encoded table of historical difficulties must decode to exactly the original values */
+BOOST_AUTO_TEST_CASE(diff_old_table)
+{
+    BOOST_CHECK_EQUAL(diff_old(0, 0xFFFFFFFF), 504365040U);
+    BOOST_CHECK_EQUAL(diff_old(29, 0xFFFFFFFF), 503683479U);
+    BOOST_CHECK_EQUAL(diff_old(99, 0xFFFFFFFF), 503533099U);
+    BOOST_CHECK_EQUAL(diff_old(750000, 0xFFFFFFFF), 453109024U);
+
+    uint64_t nSum = 0;
+    for (int nHeight = 0; nHeight <= 750000; ++nHeight)
+        nSum += diff_old(nHeight, 0xFFFFFFFF);
+    BOOST_CHECK_EQUAL(nSum, 347201080338469ULL);
+
+    // Out of range heights give a zero difficulty, and the result is capped to the pow limit.
+    BOOST_CHECK_EQUAL(diff_old(-1, 0xFFFFFFFF), 0U);
+    BOOST_CHECK_EQUAL(diff_old(750001, 0xFFFFFFFF), 0U);
+    BOOST_CHECK_EQUAL(diff_old(0, 500000000), 500000000U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,9 +4,13 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/blockchain.h"
 
 #include "base58.h"
+#include "chainparams.h"
+#include "jsonwriter.h"
 #include "netbase.h"
+#include "validation/validation.h"
 
 #include "test/test_gulden.h"
 
@@ -341,4 +345,112 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_writer)
+{
+    // Written out piece by piece, in small chunks, a block comes out the same as through UniValue.
+    const CBlock& block = Params().GenesisBlock();
+    LOCK(cs_main);
+    const CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex);
+    for (bool fTxDetails : {false, true})
+    {
+        std::string strStreamed;
+        size_t nChunks = 0;
+        {
+            CJSONWriter writer([&](const char* pData, size_t nSize) { strStreamed.append(pData, nSize); ++nChunks; }, 16);
+            blockToJSON(block, pindex, fTxDetails, writer);
+        }
+        BOOST_CHECK_EQUAL(strStreamed, blockToJSON(block, pindex, fTxDetails).write());
+        BOOST_CHECK(nChunks > 1);
+    }
+
+    std::string strOut;
+    {
+        CJSONWriter writer([&](const char* pData, size_t nSize) { strOut.append(pData, nSize); });
+        writer.BeginArray();
+        writer.BeginObject();
+        writer.KeyValue("a\"b", 1);
+        writer.Key("c");
+        writer.BeginArray();
+        writer.EndArray();
+        writer.EndObject();
+        writer.Value(UniValue());
+        writer.EndArray();
+    }
+    BOOST_CHECK_EQUAL(strOut, "[{\"a\\\"b\":1,\"c\":[]},null]");
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    if (RPCIsInWarmup(nullptr))
+        SetRPCWarmupFinished();
+
+    // Parallel calls around one that isn't, and a failing one among them; the replies come back in the order of the batch.
+    std::string rawtx = "0100000001a15d57094aa7a21a28cb20b59aab8fc7d1149a3bdbcddba9c622e4f5f6a99ece010000006c493046022100f93bb0e7d8db7bd46e40132d1f8242026e045f03a0efe71bbb8e3f475e970d790221009337cd7f1f929f00cc6ff01f03729b069a7c21b59b1736ddfee5db5946c5da8c0121033b9b137ee87d5a812d6f506efdd37f0affa7ffc310711c06c7f3e097c9447c52ffffffff0100e1f505000000001976a9140389035a9225b3839e2bbf32d826a1e222031fd888ac00000000";
+    BOOST_CHECK(tableRPC["decoderawtransaction"]->okBatchParallel);
+    BOOST_CHECK(!tableRPC["echo"]->okBatchParallel);
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 20; ++i)
+    {
+        UniValue params(UniValue::VARR);
+        if (i == 10)
+        {
+            params.push_back(i);
+            batch.push_back(JSONRPCRequestObj("echo", params, i));
+            continue;
+        }
+        params.push_back(i == 5 ? std::string("DEADBEEF") : rawtx);
+        batch.push_back(JSONRPCRequestObj("decoderawtransaction", params, i));
+    }
+
+    UniValue replies;
+    BOOST_REQUIRE(replies.read(JSONRPCExecBatch(batch)));
+    BOOST_REQUIRE_EQUAL(replies.size(), 20);
+    for (int i = 0; i < 20; ++i)
+    {
+        const UniValue& reply = replies[i];
+        BOOST_CHECK_EQUAL(find_value(reply, "id").get_int(), i);
+        if (i == 5)
+            BOOST_CHECK(!find_value(reply, "error").isNull());
+        else if (i == 10)
+            BOOST_CHECK_EQUAL(find_value(reply, "result")[0].get_int(), 10);
+        else
+            BOOST_CHECK_EQUAL(find_value(find_value(reply, "result"), "size").get_int(), 193);
+    }
+}
+
+static int nTipCacheCalls = 0;
+static UniValue tipcachetest([[maybe_unused]] const JSONRPCRequest& request)
+{
+    return ++nTipCacheCalls;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_tip_cache)
+{
+    if (RPCIsInWarmup(nullptr))
+        SetRPCWarmupFinished();
+    static const CRPCCommand command = { "test", "tipcachetest", &tipcachetest, true, {"arg"}, false, RPC_CACHE_TIP };
+    BOOST_REQUIRE(tableRPC.appendCommand(command.name, &command));
+
+    JSONRPCRequest request;
+    request.strMethod = "tipcachetest";
+    request.params = UniValue(UniValue::VARR);
+
+    // Nothing is cached before there is a tip.
+    RPCTipCacheNewTip(uint256());
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 1);
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 2);
+
+    // Same call on the same tip, same answer; other parameters or another tip call again.
+    RPCTipCacheNewTip(InsecureRand256());
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 3);
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 3);
+    request.params.push_back(1);
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 4);
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 4);
+    RPCTipCacheNewTip(InsecureRand256());
+    BOOST_CHECK_EQUAL(tableRPC.execute(request).get_int(), 5);
+    RPCTipCacheNewTip(uint256());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
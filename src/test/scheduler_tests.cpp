@@ -4,6 +4,7 @@
 
 #include "random.h"
 #include "scheduler.h"
+#include "utiltime.h"
 
 #include "test/test_gulden.h"
 
@@ -11,6 +12,9 @@
 #include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <vector>
+
 BOOST_AUTO_TEST_SUITE(scheduler_tests)
 
 static void microTask(CScheduler& s, boost::mutex& mutex, int& counter, int delta, boost::chrono::system_clock::time_point rescheduleTime)
@@ -112,4 +116,83 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(timing_and_cancel)
+{
+    // Tasks spread over a few seconds, some past the first level of the wheel, are all run and none of them early.
+    CScheduler scheduler;
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+
+    FastRandomContext rng(42);
+    std::atomic<int> nRun{0};
+    std::atomic<int> nEarly{0};
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    for (int i = 0; i < 500; i++) {
+        boost::chrono::system_clock::time_point t = now + boost::chrono::microseconds(rng.randrange(1500000));
+        scheduler.schedule([&, t]() { if (boost::chrono::system_clock::now() < t) ++nEarly; ++nRun; }, t);
+    }
+    std::atomic<bool> fCancelledRun{false};
+    CScheduler::TaskId idSoon = scheduler.scheduleFromNow([&]() { fCancelledRun = true; }, 200);
+    CScheduler::TaskId idFar = scheduler.scheduleFromNow([&]() { fCancelledRun = true; }, int64_t(100) * 24 * 60 * 60 * 1000);
+    BOOST_CHECK(scheduler.cancel(idSoon));
+    BOOST_CHECK(!scheduler.cancel(idSoon));
+
+    std::atomic<int> nRepeats{0};
+    CScheduler::TaskId idRepeat = scheduler.scheduleEvery([&]() { ++nRepeats; }, 50);
+
+    MilliSleep(2000);
+    BOOST_CHECK_EQUAL(nRun, 500);
+    BOOST_CHECK_EQUAL(nEarly, 0);
+    BOOST_CHECK(nRepeats > 10);
+    BOOST_CHECK(scheduler.cancel(idRepeat));
+    int nRepeatsCancelled = nRepeats;
+    MilliSleep(200);
+    // At most the run that was in progress.
+    BOOST_CHECK(nRepeats <= nRepeatsCancelled + 1);
+
+    boost::chrono::system_clock::time_point first, last;
+    BOOST_CHECK_EQUAL(scheduler.getQueueInfo(first, last), 1U);
+    BOOST_CHECK(scheduler.cancel(idFar));
+    BOOST_CHECK(!fCancelledRun);
+
+    scheduler.stop(true);
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(singlethreadedclient_ordering)
+{
+    // However many threads service the scheduler, the callbacks of a client run one at a time and in order.
+    CScheduler scheduler;
+    boost::thread_group threads;
+    for (int i = 0; i < 5; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+
+    CSingleThreadedSchedulerClient client(&scheduler);
+    boost::mutex mutex;
+    std::vector<int> order;
+    std::atomic<int> nRunning{0};
+    std::atomic<bool> fOverlap{false};
+    for (int i = 0; i < 200; i++) {
+        client.AddToProcessQueue([&, i]() {
+            if (++nRunning > 1)
+                fOverlap = true;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                order.push_back(i);
+            }
+            --nRunning;
+        });
+    }
+    while (client.CallbacksPending() > 0)
+        MilliSleep(10);
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(!fOverlap);
+    BOOST_CHECK_EQUAL(order.size(), 200U);
+    for (size_t i = 0; i < order.size(); i++)
+        BOOST_CHECK_EQUAL(order[i], (int)i);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
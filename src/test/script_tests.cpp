@@ -12,6 +12,7 @@
 #include "data/script_tests.json.h"
 
 #include "core_io.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "keystore.h"
 #include "script/script.h"
@@ -178,6 +179,8 @@ static void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, const
             BOOST_CHECK_MESSAGE(guldenconsensus_verify_script_with_amount(scriptPubKey.data(), scriptPubKey.size(), 0, (const unsigned char*)&stream[0], stream.size(), 0, libconsensus_flags, NULL) == expect, message);
             BOOST_CHECK_MESSAGE(guldenconsensus_verify_script(scriptPubKey.data(), scriptPubKey.size(), (const unsigned char*)&stream[0], stream.size(), 0, libconsensus_flags, NULL) == expect,message);
         }
+        guldenconsensus_spent_output spent = { scriptPubKey.data(), (unsigned int)scriptPubKey.size(), txCredit.vout[0].nValue };
+        BOOST_CHECK_MESSAGE(guldenconsensus_verify_transaction((const unsigned char*)&stream[0], stream.size(), &spent, 1, libconsensus_flags, 1, NULL, NULL) == expect, message);
     }
 #endif
 }
@@ -780,6 +783,125 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_INVALID_STACK_OPERATION, ScriptErrorString(err));
 }
 
+// VerifyScript without its template fast path: the two scripts through EvalScript and the final stack checks.
+static bool VerifyScriptGeneric(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    std::vector<std::vector<unsigned char> > stack;
+    if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror) || !EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_BASE, serror))
+        return false;
+    // Only the results of OP_CHECKSIG (empty or 1) end up on top of the stack here.
+    if (stack.empty() || stack.back() != std::vector<unsigned char>(1, 1))
+    {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && stack.size() != 1)
+    {
+        *serror = SCRIPT_ERR_CLEANSTACK;
+        return false;
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(script_P2PKH_template)
+{
+    CKey key, key2;
+    key.MakeNewKey(true);
+    key2.MakeNewKey(false);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txFrom = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), CSegregatedSignatureData(), txFrom);
+    uint256 hash = SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    std::vector<unsigned char> vchSig, vchSigHighS, vchSigBad;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    vchSigBad = vchSig;
+    vchSigBad[10] ^= 1;
+    std::vector<unsigned char> vchPubKey = ToByteVector(key.GetPubKey());
+
+    std::vector<CScript> scriptSigs;
+    scriptSigs.push_back(CScript() << vchSig << vchPubKey);
+    scriptSigs.push_back(CScript() << vchSigBad << vchPubKey);
+    scriptSigs.push_back(CScript() << vchSig << ToByteVector(key2.GetPubKey()));
+    scriptSigs.push_back(CScript() << std::vector<unsigned char>() << vchPubKey);
+    scriptSigs.push_back(CScript() << std::vector<unsigned char>(20, 1) << vchPubKey);
+    scriptSigs.push_back(CScript() << std::vector<unsigned char>(1, 0x30) << vchPubKey);
+    scriptSigs.push_back(CScript() << vchSig << vchPubKey << OP_DROP);
+    scriptSigs.push_back(CScript() << vchSig);
+    scriptSigs.push_back(CScript() << OP_1 << vchSig << vchPubKey);
+    // Non minimal push of the public key.
+    CScript nonMinimal = CScript() << vchSig;
+    nonMinimal.push_back(OP_PUSHDATA1);
+    nonMinimal.push_back(vchPubKey.size());
+    nonMinimal.insert(nonMinimal.end(), vchPubKey.begin(), vchPubKey.end());
+    scriptSigs.push_back(nonMinimal);
+
+    std::vector<unsigned int> vFlags = { 0, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S | SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_NULLFAIL | SCRIPT_VERIFY_CLEANSTACK, gFlags };
+    MutableTransactionSignatureChecker checker(CKeyID(), CKeyID(), &txTo, 0, txFrom.vout[0].nValue);
+    for (unsigned int flags : vFlags)
+    {
+        for (const CScript& scriptSig : scriptSigs)
+        {
+            ScriptError err, errGeneric;
+            bool fResult = VerifyScript(scriptSig, scriptPubKey, NULL, flags, checker, &err);
+            bool fResultGeneric = VerifyScriptGeneric(scriptSig, scriptPubKey, flags, checker, &errGeneric);
+            BOOST_CHECK_EQUAL(fResult, fResultGeneric);
+            BOOST_CHECK_MESSAGE(err == errGeneric, std::string(ScriptErrorString(err)) + " != " + ScriptErrorString(errGeneric));
+        }
+    }
+    ScriptError err;
+    BOOST_CHECK(VerifyScript(scriptSigs[0], scriptPubKey, NULL, gFlags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+}
+
+BOOST_AUTO_TEST_CASE(script_PoW2Witness_template)
+{
+    CKey witnessKey, spendingKey;
+    witnessKey.MakeNewKey(true);
+    spendingKey.MakeNewKey(true);
+    // OP_0 followed by a 72 byte push of the witness details, only the shape matters to the script.
+    CScript scriptPubKey = CScript() << OP_0 << std::vector<unsigned char>(72, 0);
+    BOOST_REQUIRE(scriptPubKey.IsPoW2Witness());
+
+    CMutableTransaction txFrom = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), CSegregatedSignatureData(), txFrom);
+    uint256 hash = SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    std::vector<unsigned char> vchWitnessSig, vchSpendingSig, vchOtherSig;
+    BOOST_CHECK(witnessKey.Sign(hash, vchWitnessSig));
+    vchWitnessSig.push_back((unsigned char)SIGHASH_ALL);
+    BOOST_CHECK(spendingKey.Sign(hash, vchSpendingSig));
+    vchSpendingSig.push_back((unsigned char)SIGHASH_ALL);
+    // Well formed, but over the wrong hash.
+    BOOST_CHECK(witnessKey.Sign(uint256S("1"), vchOtherSig));
+    vchOtherSig.push_back((unsigned char)SIGHASH_ALL);
+    std::vector<unsigned char> vchWitnessPubKey = ToByteVector(witnessKey.GetPubKey());
+    std::vector<unsigned char> vchSpendingPubKey = ToByteVector(spendingKey.GetPubKey());
+
+    MutableTransactionSignatureChecker checker(witnessKey.GetPubKey().GetID(), spendingKey.GetPubKey().GetID(), &txTo, 0, txFrom.vout[0].nValue);
+    ScriptError err;
+
+    // Spending key signature first, then the witness key signature; in the scriptSig or as segregated signature data.
+    CScript scriptSig = CScript() << vchSpendingSig << vchSpendingPubKey << vchWitnessSig << vchWitnessPubKey;
+    BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey, NULL, gFlags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    CSegregatedSignatureData witness;
+    witness.stack = { vchSpendingSig, vchSpendingPubKey, vchWitnessSig, vchWitnessPubKey };
+    BOOST_CHECK(VerifyScript(CScript(), scriptPubKey, &witness, gFlags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+
+    // A bad signature, the keys the wrong way round, keys the checker doesn't expect or a stack of the wrong size all fail.
+    BOOST_CHECK(!VerifyScript(CScript() << vchSpendingSig << vchSpendingPubKey << vchOtherSig << vchWitnessPubKey, scriptPubKey, NULL, gFlags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_UNKNOWN_ERROR, ScriptErrorString(err));
+    BOOST_CHECK(!VerifyScript(CScript() << vchWitnessSig << vchWitnessPubKey << vchSpendingSig << vchSpendingPubKey, scriptPubKey, NULL, gFlags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_UNKNOWN_ERROR, ScriptErrorString(err));
+    MutableTransactionSignatureChecker checkerNoSpendingKey(witnessKey.GetPubKey().GetID(), CKeyID(), &txTo, 0, txFrom.vout[0].nValue);
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey, NULL, gFlags, checkerNoSpendingKey, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_UNKNOWN_ERROR, ScriptErrorString(err));
+    BOOST_CHECK(!VerifyScript(CScript() << vchWitnessSig << vchWitnessPubKey, scriptPubKey, NULL, gFlags, checker, &err));
+}
+
 BOOST_AUTO_TEST_CASE(script_combineSigs)
 {
 //SignSignature issues
@@ -1086,4 +1208,54 @@ BOOST_AUTO_TEST_CASE(script_HasValidOps)
     BOOST_CHECK(!script.HasValidOps());
 }
 
+#if defined(HAVE_CONSENSUS_LIB)
+BOOST_AUTO_TEST_CASE(script_consensus_verify_transaction)
+{
+    // Inputs that spend: anything, nothing, and two hash locks of which only one gets the right preimage.
+    std::vector<unsigned char> vchPreimage(32, 7), vchHash(32);
+    CSHA256().Write(vchPreimage.data(), vchPreimage.size()).Finalize(vchHash.data());
+    std::vector<CScript> scriptPubKeys = { CScript() << OP_1, CScript() << OP_0, CScript() << OP_SHA256 << vchHash << OP_EQUAL, CScript() << OP_SHA256 << vchHash << OP_EQUAL };
+    std::vector<CScript> scriptSigs = { CScript(), CScript(), CScript() << vchPreimage, CScript() << vchHash };
+    CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+    tx.vout.resize(1);
+    std::vector<guldenconsensus_spent_output> spentOutputs;
+    for (unsigned int i = 0; i < scriptPubKeys.size(); ++i)
+    {
+        tx.vin.push_back(CTxIn(COutPoint(InsecureRand256(), i), scriptSigs[i], CTxIn::SEQUENCE_FINAL, CTxInFlags::None));
+        spentOutputs.push_back({ scriptPubKeys[i].data(), (unsigned int)scriptPubKeys[i].size(), 0 });
+    }
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << tx;
+    const unsigned char* txTo = (const unsigned char*)&stream[0];
+
+    for (unsigned int nThreads : {0, 1, 3, 16})
+    {
+        std::vector<int> results(tx.vin.size(), -1);
+        guldenconsensus_error err;
+        BOOST_CHECK_EQUAL(guldenconsensus_verify_transaction(txTo, stream.size(), spentOutputs.data(), spentOutputs.size(), guldenconsensus_SCRIPT_FLAGS_VERIFY_P2SH, nThreads, results.data(), &err), 0);
+        BOOST_CHECK_EQUAL(err, guldenconsensus_ERR_OK);
+        BOOST_CHECK(results == std::vector<int>({1, 0, 1, 0}));
+        for (unsigned int i = 0; i < tx.vin.size(); ++i)
+            BOOST_CHECK_EQUAL(guldenconsensus_verify_script(spentOutputs[i].scriptPubKey, spentOutputs[i].scriptPubKeyLen, txTo, stream.size(), i, guldenconsensus_SCRIPT_FLAGS_VERIFY_P2SH, NULL), results[i]);
+    }
+
+    // All valid once the failing inputs are left out.
+    std::vector<guldenconsensus_spent_output> validOutputs = { spentOutputs[0], spentOutputs[2] };
+    CMutableTransaction txValid = tx;
+    txValid.vin = { tx.vin[0], tx.vin[2] };
+    CDataStream streamValid(SER_NETWORK, PROTOCOL_VERSION);
+    streamValid << txValid;
+    BOOST_CHECK_EQUAL(guldenconsensus_verify_transaction((const unsigned char*)&streamValid[0], streamValid.size(), validOutputs.data(), validOutputs.size(), guldenconsensus_SCRIPT_FLAGS_VERIFY_P2SH, 2, NULL, NULL), 1);
+
+    // Errors.
+    guldenconsensus_error err;
+    BOOST_CHECK_EQUAL(guldenconsensus_verify_transaction(txTo, stream.size(), spentOutputs.data(), spentOutputs.size() - 1, 0, 1, NULL, &err), 0);
+    BOOST_CHECK_EQUAL(err, guldenconsensus_ERR_SPENT_OUTPUTS_MISMATCH);
+    BOOST_CHECK_EQUAL(guldenconsensus_verify_transaction(txTo, stream.size() - 1, spentOutputs.data(), spentOutputs.size(), 0, 1, NULL, &err), 0);
+    BOOST_CHECK_EQUAL(err, guldenconsensus_ERR_TX_DESERIALIZE);
+    BOOST_CHECK_EQUAL(guldenconsensus_verify_transaction(txTo, stream.size(), spentOutputs.data(), spentOutputs.size(), 1U << 30, 1, NULL, &err), 0);
+    BOOST_CHECK_EQUAL(err, guldenconsensus_ERR_INVALID_FLAGS);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -249,6 +249,36 @@ BOOST_AUTO_TEST_CASE(compactsize)
     }
 }
 
+BOOST_AUTO_TEST_CASE(vectors_as_memory)
+{
+    // Vectors of types serialized as their memory come out the same as written element by element, and read back.
+    std::vector<uint256> vHashes(3);
+    vHashes[1] = uint256S("0x0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20");
+    std::vector<uint32_t> vInts = {1, 0x01020304, 0xffffffff};
+    CDataStream ss(SER_DISK, 0), ssExpected(SER_DISK, 0);
+    ss << COMPACTSIZEVECTOR(vHashes) << COMPACTSIZEVECTOR(vInts) << VARINTVECTOR(vInts);
+    WriteCompactSize(ssExpected, vHashes.size());
+    for (const uint256& hash : vHashes)
+        ssExpected << hash;
+    WriteCompactSize(ssExpected, vInts.size());
+    for (uint32_t n : vInts)
+        ssExpected << n;
+    ssExpected << VARINT(vInts.size());
+    for (uint32_t n : vInts)
+        ssExpected << n;
+    BOOST_CHECK(ss.str() == ssExpected.str());
+    BOOST_CHECK_EQUAL(GetSerializeSizeMany(SER_DISK, 0, COMPACTSIZEVECTOR(vHashes), COMPACTSIZEVECTOR(vInts), VARINTVECTOR(vInts)), ss.size());
+
+    std::vector<uint256> vHashesRead;
+    std::vector<uint32_t> vIntsRead, vIntsVarRead;
+    ss >> COMPACTSIZEVECTOR(vHashesRead) >> COMPACTSIZEVECTOR(vIntsRead) >> VARINTVECTOR(vIntsVarRead);
+    BOOST_CHECK(vHashesRead == vHashes);
+    BOOST_CHECK(vIntsRead == vInts);
+    BOOST_CHECK(vIntsVarRead == vInts);
+    BOOST_CHECK(is_serialized_as_memory<uint256>::value);
+    BOOST_CHECK(!is_serialized_as_memory<CTxOut>::value);
+}
+
 static bool isCanonicalException(const std::ios_base::failure& ex)
 {
     std::ios_base::failure expectedException("non-canonical ReadCompactSize()");
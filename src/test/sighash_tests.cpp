@@ -105,6 +105,36 @@ BOOST_AUTO_TEST_CASE(sighash_test)
 #endif
 }
 
+// The hashes over all inputs and outputs, and the start of the SIGHASH_ALL signature hash, can be done once for all inputs without changing any of their signature hashes.
+BOOST_AUTO_TEST_CASE(sighash_segsig_precomputed)
+{
+    CMutableTransaction txTo(TEST_DEFAULT_TX_VERSION);
+    for (int i = 0; i < 5; ++i)
+    {
+        txTo.vin.push_back(CTxIn(COutPoint(InsecureRand256(), i), CScript(), CTxIn::SEQUENCE_FINAL, 0));
+    }
+    for (int i = 0; i < 50; ++i)
+    {
+        CTxOut txout;
+        txout.nValue = InsecureRandRange(100000000);
+        txout.output.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(InsecureRand256()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        txTo.vout.push_back(txout);
+    }
+    const CTransaction tx(txTo);
+    const PrecomputedTransactionData txdata(tx);
+    CScript scriptCode = CScript() << OP_CHECKSIG;
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); ++nIn)
+    {
+        for (int nHashType : {(int)SIGHASH_ALL, SIGHASH_ALL|SIGHASH_ANYONECANPAY, (int)SIGHASH_NONE, (int)SIGHASH_SINGLE, SIGHASH_SINGLE|SIGHASH_ANYONECANPAY, 0})
+        {
+            uint256 hash = SignatureHash(scriptCode, tx, nIn, nHashType, 1000, SIGVERSION_SEGSIG);
+            BOOST_CHECK(hash == SignatureHash(scriptCode, tx, nIn, nHashType, 1000, SIGVERSION_SEGSIG, &txdata));
+            // Carrying on from the shared start leaves it as it was for the next input.
+            BOOST_CHECK(hash == SignatureHash(scriptCode, tx, nIn, nHashType, 1000, SIGVERSION_SEGSIG, &txdata));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
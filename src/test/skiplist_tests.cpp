@@ -184,4 +184,56 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     BOOST_CHECK(!chain.FindEarliestAtLeast(int64_t(std::numeric_limits<unsigned int>::max()) + 1));
 }
 
+BOOST_AUTO_TEST_CASE(clonechain_test)
+{
+    // A main chain of 100 blocks and a fork of 20 blocks off height 80.
+    std::vector<CBlockIndex> vMain(100);
+    std::vector<CBlockIndex> vFork(20);
+    for (unsigned int i = 0; i < vMain.size(); i++) {
+        vMain[i].nHeight = i;
+        vMain[i].pprev = i ? &vMain[i - 1] : NULL;
+        vMain[i].BuildSkip();
+    }
+    for (unsigned int i = 0; i < vFork.size(); i++) {
+        vFork[i].nHeight = 81 + i;
+        vFork[i].pprev = i ? &vFork[i - 1] : &vMain[80];
+        vFork[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vMain.back());
+
+    CBlockIndex* pretain = NULL;
+    CCloneChain clone(chain, 70, &vFork.back(), pretain);
+    BOOST_CHECK(pretain == &vFork.back());
+    BOOST_CHECK_EQUAL(clone.Height(), 99);
+    BOOST_CHECK(clone.Tip() == chain.Tip());
+
+    clone.SetTip(&vFork[9]);
+    BOOST_CHECK_EQUAL(clone.Height(), 90);
+    BOOST_CHECK(clone[80] == &vMain[80]);
+    BOOST_CHECK(clone[81] == &vFork[0]);
+    BOOST_CHECK(clone.Tip() == &vFork[9]);
+    BOOST_CHECK(clone[91] == NULL);
+    BOOST_CHECK(clone.Contains(&vFork[5]));
+    BOOST_CHECK(!clone.Contains(&vMain[85]));
+
+    clone.SetTip(&vFork.back());
+    BOOST_CHECK_EQUAL(clone.Height(), 100);
+    BOOST_CHECK(clone.Tip() == &vFork.back());
+    BOOST_CHECK(clone[90] == &vFork[9]);
+
+    clone.SetTip(&vMain[75]);
+    BOOST_CHECK_EQUAL(clone.Height(), 75);
+    BOOST_CHECK(clone.Tip() == &vMain[75]);
+
+    clone.SetTip(&vMain[95]);
+    BOOST_CHECK(clone.Tip() == &vMain[95]);
+    BOOST_CHECK(clone[85] == &vMain[85]);
+
+    // The original chain is left alone.
+    BOOST_CHECK(chain.Tip() == &vMain.back());
+    BOOST_CHECK(chain[85] == &vMain[85]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -71,6 +71,33 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_memory_reader)
+{
+    std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+    CMemoryReader reader(SER_NETWORK, INIT_PROTO_VERSION, vch.data(), vch.size());
+    BOOST_CHECK_EQUAL(reader.size(), 6U);
+
+    unsigned char a;
+    unsigned char b;
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 255);
+    BOOST_CHECK_EQUAL(reader.size(), 4U);
+
+    uint16_t c;
+    reader.peek((char*)&c, sizeof(c));
+    BOOST_CHECK_EQUAL(reader.size(), 4U);
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 0x0403);
+
+    reader.ignore(1);
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 6);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> a, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
@@ -0,0 +1,75 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "sync.h"
+#include "test/test_gulden.h"
+
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static CLockSiteStats FindLockSite(const std::string& name)
+{
+    for (const CLockSiteStats& stats : GetLockStats())
+        if (stats.name == name)
+            return stats;
+    return CLockSiteStats();
+}
+
+BOOST_AUTO_TEST_CASE(lockstats)
+{
+    CCriticalSection csTest;
+
+    // Nothing is recorded while the profiler is off.
+    g_fLockStats = false;
+    {
+        LOCK(csTest);
+    }
+    BOOST_CHECK_EQUAL(FindLockSite("csTest").nCount, 0);
+
+    g_fLockStats = true;
+    for (int i = 0; i < 10; ++i)
+    {
+        LOCK(csTest);
+    }
+    CLockSiteStats stats = FindLockSite("csTest");
+    BOOST_CHECK_EQUAL(stats.nCount, 10);
+    BOOST_CHECK_EQUAL(stats.nContended, 0);
+    BOOST_CHECK(stats.file.find("sync_tests.cpp") != std::string::npos);
+
+    // A second thread has to wait for the lock held here, and holds it for a while itself.
+    std::thread thread;
+    {
+        LOCK(csTest);
+        thread = std::thread([&]() {
+            LOCK(csTest);
+            MilliSleep(5);
+        });
+        MilliSleep(20);
+    }
+    thread.join();
+
+    uint64_t nCount = 0, nContended = 0, nMaxWait = 0, nMaxHold = 0;
+    for (const CLockSiteStats& site : GetLockStats())
+    {
+        if (site.name != "csTest")
+            continue;
+        nCount += site.nCount;
+        nContended += site.nContended;
+        nMaxWait = std::max(nMaxWait, site.nMaxWait);
+        nMaxHold = std::max(nMaxHold, site.nMaxHold);
+    }
+    BOOST_CHECK_EQUAL(nCount, 12);
+    BOOST_CHECK_EQUAL(nContended, 1);
+    BOOST_CHECK(nMaxWait >= 10000);
+    BOOST_CHECK(nMaxHold >= 20000);
+
+    ResetLockStats();
+    BOOST_CHECK_EQUAL(FindLockSite("csTest").nCount, 0);
+    g_fLockStats = DEFAULT_LOCKSTATS;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -29,6 +29,7 @@
 #include "utilstrencodings.h"
 
 #include <map>
+#include <set>
 #include <string>
 
 #include <boost/algorithm/string/classification.hpp>
@@ -283,6 +284,74 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(transaction_arena)
+{
+    // More transactions than fit one chunk of the arena.
+    CBlock block;
+    for (unsigned int i = 0; i < CTransactionArena::MAX_CHUNK_SIZE + 10; ++i)
+    {
+        CMutableTransaction mtx(TEST_DEFAULT_TX_VERSION);
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(InsecureRand256(), i);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i;
+        mtx.vout[0].output.scriptPubKey = CScript() << std::vector<unsigned char>(i % 64, 1) << OP_DROP << OP_TRUE;
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    CTransactionRef txKept, txDetached;
+    {
+        CBlock blockArena;
+        blockArena.UnserializeWithArena(ss);
+        BOOST_REQUIRE_EQUAL(blockArena.vtx.size(), block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); ++i)
+        {
+            BOOST_CHECK(blockArena.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+            BOOST_CHECK(CTransactionArena::Contains(blockArena.vtx[i]));
+        }
+        BOOST_CHECK(!CTransactionArena::Contains(block.vtx[0]));
+        BOOST_CHECK(DetachFromArena(block.vtx[0]) == block.vtx[0]);
+        txKept = blockArena.vtx.back();
+        txDetached = DetachFromArena(blockArena.vtx.back());
+        BOOST_CHECK(!CTransactionArena::Contains(txDetached));
+    }
+    // Either outlives the block.
+    BOOST_CHECK(txKept->GetHash() == block.vtx.back()->GetHash());
+    BOOST_CHECK(txDetached->GetHash() == block.vtx.back()->GetHash());
+
+    // A transaction count the data doesn't back up is a read failure, not a huge allocation.
+    CDataStream ssTruncated(SER_NETWORK, PROTOCOL_VERSION);
+    ssTruncated << *(CBlockHeader*)&block;
+    WriteCompactSize(ssTruncated, MAX_SIZE);
+    CBlock blockTruncated;
+    BOOST_CHECK_THROW(blockTruncated.UnserializeWithArena(ssTruncated), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(block_position_outpoints)
+{
+    COutPoint a(10, 2, 0), b(10, 3, 0), c(11, 0, 0), d(10, 2, 1);
+
+    // Ordered by block, then transaction, then output; a strict weak ordering so usable as map key.
+    BOOST_CHECK(a < b && b < c && a < c);
+    BOOST_CHECK(a < d && !(d < a));
+    BOOST_CHECK(!(a < a) && !(b < a) && !(c < b));
+    std::set<COutPoint> setOutpoints = {c, b, d, a, COutPoint(10, 2, 0)};
+    BOOST_CHECK_EQUAL(setOutpoints.size(), 4);
+
+    // The hash is the double SHA256 of the two little endian 64 bit numbers.
+    unsigned char data[CBlockPosition::SERIALIZED_SIZE] = {10, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0};
+    BOOST_CHECK(a.getHash() == Hash(data, data + sizeof(data)));
+    BOOST_CHECK(a.getHash() == d.getHash());
+    BOOST_CHECK(a.getHash() != b.getHash());
+    BOOST_CHECK(CBlockPosition(2, 10).getHash() != CBlockPosition(10, 2).getHash());
+
+    SaltedOutpointHasher hasher;
+    BOOST_CHECK_EQUAL(hasher(a), hasher(COutPoint(10, 2, 0)));
+    BOOST_CHECK(hasher(a) != hasher(d));
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
@@ -0,0 +1,59 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/txindex.h"
+#include "blockstore.h"
+#include "chainparams.h"
+#include "validation/validation.h"
+#include "utiltime.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txindex_tests)
+
+static void CheckIndexed(const CTxIndex& txindex, const CTransaction& tx)
+{
+    CDiskTxPos pos;
+    BOOST_REQUIRE(txindex.FindTx(tx.GetHash(), pos));
+    LOCK(cs_main);
+    CBlockHeader header;
+    CTransactionRef txRead;
+    BOOST_REQUIRE(blockStore.ReadTransactionFromDisk(header, txRead, pos, pos.nTxOffset));
+    BOOST_CHECK(txRead->GetHash() == tx.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
+{
+    // Started on an existing chain, the index catches up in the background.
+    CTxIndex txindex;
+    BOOST_REQUIRE(txindex.Start());
+    for (int i = 0; i < 1000 && !txindex.IsSynced(); ++i)
+        MilliSleep(10);
+    BOOST_REQUIRE(txindex.IsSynced());
+    BOOST_CHECK(txindex.BlockUntilSynced());
+    for (const auto& tx : coinbaseTxns)
+        CheckIndexed(txindex, tx);
+
+    // Blocks connected from then on are followed.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(), std::make_shared<CReserveKeyOrScript>(scriptPubKey));
+    BOOST_CHECK(txindex.BlockUntilSynced());
+    CheckIndexed(txindex, *block.vtx[0]);
+    txindex.Stop();
+
+    // And a restart continues from the last indexed block.
+    uint256 hashBest;
+    BOOST_CHECK(pblocktree->ReadTxIndexBestBlock(hashBest));
+    BOOST_CHECK(hashBest == block.GetHashPoW2());
+    CTxIndex txindexRestarted;
+    BOOST_REQUIRE(txindexRestarted.Start());
+    for (int i = 0; i < 1000 && !txindexRestarted.IsSynced(); ++i)
+        MilliSleep(10);
+    BOOST_REQUIRE(txindexRestarted.IsSynced());
+    CheckIndexed(txindexRestarted, *block.vtx[0]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,147 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "txreconciliation.h"
+#include "streams.h"
+#include "version.h"
+#include "test/test_gulden.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(txreconciliation_sketch_decode)
+{
+    SeedInsecureRand(true);
+    // Two sets sharing most of their ids; the sketch is sized for the difference only.
+    std::set<uint32_t> setShared, setOnlyA, setOnlyB;
+    while (setShared.size() < 2000)
+        setShared.insert(InsecureRand32());
+    while (setOnlyA.size() < 30)
+        setOnlyA.insert(InsecureRand32());
+    while (setOnlyB.size() < 20)
+        setOnlyB.insert(InsecureRand32());
+
+    size_t nCells = CTxReconSketch::CellsForDifference(setOnlyA.size() + setOnlyB.size());
+    BOOST_CHECK(nCells < setShared.size() / 10);
+    CTxReconSketch sketchA(nCells), sketchB(nCells);
+    for (uint32_t nId : setShared)
+    {
+        sketchA.Add(nId);
+        sketchB.Add(nId);
+    }
+    for (uint32_t nId : setOnlyA)
+        sketchA.Add(nId);
+    for (uint32_t nId : setOnlyB)
+        sketchB.Add(nId);
+
+    // Over the wire and back.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << sketchB;
+    CTxReconSketch sketchReceived;
+    ss >> sketchReceived;
+    BOOST_CHECK(sketchReceived.IsValid());
+    BOOST_CHECK_EQUAL(sketchReceived.GetCells(), nCells);
+
+    BOOST_CHECK(sketchA.Subtract(sketchReceived));
+    std::vector<uint32_t> vAdded, vRemoved;
+    BOOST_CHECK(sketchA.Decode(vAdded, vRemoved));
+    BOOST_CHECK(std::set<uint32_t>(vAdded.begin(), vAdded.end()) == setOnlyA);
+    BOOST_CHECK(std::set<uint32_t>(vRemoved.begin(), vRemoved.end()) == setOnlyB);
+
+    // Sketches of different sizes don't subtract.
+    BOOST_CHECK(!sketchA.Subtract(CTxReconSketch(nCells + CTxReconSketch::NUM_HASHES)));
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_sketch_too_small)
+{
+    SeedInsecureRand(true);
+    CTxReconSketch sketch(CTxReconSketch::CellsForDifference(10));
+    for (int i = 0; i < 1000; ++i)
+        sketch.Add(InsecureRand32());
+    std::vector<uint32_t> vAdded, vRemoved;
+    BOOST_CHECK(!sketch.Decode(vAdded, vRemoved));
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_round)
+{
+    SeedInsecureRand(true);
+    uint64_t nSaltA = InsecureRandBits(64);
+    uint64_t nSaltB = InsecureRandBits(64);
+    CTxReconciliationState initiator(nSaltA, nSaltB, true);
+    CTxReconciliationState responder(nSaltB, nSaltA, false);
+
+    // Both sides salt the short ids the same way, and differently from another connection.
+    uint256 hash = InsecureRand256();
+    BOOST_CHECK_EQUAL(initiator.GetShortId(hash), responder.GetShortId(hash));
+    BOOST_CHECK(initiator.GetShortId(hash) != CTxReconciliationState(nSaltA, nSaltB + 1, true).GetShortId(hash));
+
+    std::vector<uint256> vShared, vOnlyInitiator, vOnlyResponder;
+    for (int i = 0; i < 100; ++i)
+        vShared.push_back(InsecureRand256());
+    for (int i = 0; i < 5; ++i)
+        vOnlyInitiator.push_back(InsecureRand256());
+    for (int i = 0; i < 7; ++i)
+        vOnlyResponder.push_back(InsecureRand256());
+    for (const uint256& txid : vShared)
+    {
+        BOOST_CHECK(initiator.Add(txid));
+        BOOST_CHECK(responder.Add(txid));
+    }
+    for (const uint256& txid : vOnlyInitiator)
+        BOOST_CHECK(initiator.Add(txid));
+    for (const uint256& txid : vOnlyResponder)
+        BOOST_CHECK(responder.Add(txid));
+    // A transaction the peer turned out to have already.
+    uint256 hashKnown = InsecureRand256();
+    BOOST_CHECK(responder.Add(hashKnown));
+    responder.Erase(hashKnown);
+
+    initiator.StartRound();
+    BOOST_CHECK(initiator.IsRoundInProgress());
+    BOOST_CHECK_EQUAL(initiator.GetSetSize(), 0);
+    // What comes in now waits for the next round.
+    BOOST_CHECK(initiator.Add(InsecureRand256()));
+    BOOST_CHECK_EQUAL(initiator.GetSetSize(), 1);
+
+    responder.StartRound();
+    CTxReconSketch sketch = responder.GetRoundSketch(CTxReconciliationState::GetSketchCells(responder.GetRoundSetSize(), initiator.GetRoundSetSize()));
+    CTxReconSketch difference = initiator.GetRoundSketch(sketch.GetCells());
+    BOOST_CHECK(difference.Subtract(sketch));
+    std::vector<uint32_t> vOnlyOurs, vOnlyTheirs;
+    BOOST_CHECK(difference.Decode(vOnlyOurs, vOnlyTheirs));
+
+    std::vector<uint256> vAnnounce = initiator.GetRoundTxs(vOnlyOurs);
+    std::vector<uint256> vRequested = responder.GetRoundTxs(vOnlyTheirs);
+    std::sort(vAnnounce.begin(), vAnnounce.end());
+    std::sort(vRequested.begin(), vRequested.end());
+    std::sort(vOnlyInitiator.begin(), vOnlyInitiator.end());
+    std::sort(vOnlyResponder.begin(), vOnlyResponder.end());
+    BOOST_CHECK(vAnnounce == vOnlyInitiator);
+    BOOST_CHECK(vRequested == vOnlyResponder);
+
+    BOOST_CHECK_EQUAL(initiator.EndRound().size(), vShared.size() + vOnlyInitiator.size());
+    BOOST_CHECK_EQUAL(responder.EndRound().size(), vShared.size() + vOnlyResponder.size());
+    BOOST_CHECK(!responder.IsRoundInProgress());
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_limits)
+{
+    CTxReconciliationState state(1, 2, true);
+    for (size_t i = 0; i < MAX_TX_RECONCILIATION_SET; ++i)
+        state.Add(InsecureRand256());
+    BOOST_CHECK(state.GetSetSize() <= MAX_TX_RECONCILIATION_SET);
+    while (state.GetSetSize() < MAX_TX_RECONCILIATION_SET)
+        state.Add(InsecureRand256());
+    BOOST_CHECK(!state.Add(InsecureRand256()));
+
+    BOOST_CHECK_EQUAL(CTxReconciliationState::GetSketchCells(1000000, 0), MAX_TX_RECONCILIATION_CELLS);
+    BOOST_CHECK(CTxReconSketch(MAX_TX_RECONCILIATION_CELLS).IsValid());
+    BOOST_CHECK(!CTxReconSketch(MAX_TX_RECONCILIATION_CELLS + 1).IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
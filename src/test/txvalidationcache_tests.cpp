@@ -16,6 +16,7 @@
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "test/test_gulden.h"
 #include "utiltime.h"
@@ -96,4 +97,119 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0U);
 }
 
+static CMutableTransaction SignedSpend(const CKey& key, const CScript& scriptPubKey, const uint256& hashPrev, CAmount nValue)
+{
+    CMutableTransaction spend(TEST_DEFAULT_TX_VERSION);
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.setHash(hashPrev);
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = nValue;
+    spend.vout[0].output.scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestChain100Setup)
+{
+    // A batch is accepted as if the transactions came one by one: in order, a child after its parent and the second of a double spend rejected.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CTransactionRef> batch;
+    for (int i = 0; i < 4; i++)
+        batch.push_back(MakeTransactionRef(SignedSpend(coinbaseKey, scriptPubKey, coinbaseTxns[i].GetHash(), 11*CENT)));
+    batch.push_back(MakeTransactionRef(SignedSpend(coinbaseKey, scriptPubKey, batch[0]->GetHash(), 10*CENT)));
+    batch.push_back(MakeTransactionRef(SignedSpend(coinbaseKey, scriptPubKey, coinbaseTxns[1].GetHash(), 12*CENT)));
+
+    LOCK(cs_main);
+    std::vector<CValidationState> states;
+    std::vector<bool> vMissingInputs;
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, batch, states, false, &vMissingInputs), 5U);
+    BOOST_CHECK_EQUAL(states.size(), batch.size());
+    for (size_t i = 0; i < 5; i++)
+        BOOST_CHECK(mempool.exists(batch[i]->GetHash()) && states[i].IsValid());
+    BOOST_CHECK(!mempool.exists(batch[5]->GetHash()));
+    BOOST_CHECK_EQUAL(states[5].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(!vMissingInputs[5]);
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(sigcache_persist, TestingSetup)
+{
+    fs::path path = GetDataDir() / "sigcache.dat";
+    fs::remove(path);
+    BOOST_CHECK(!LoadSignatureCache());
+
+    BOOST_CHECK(DumpSignatureCache());
+    BOOST_CHECK(fs::exists(path));
+    BOOST_CHECK(LoadSignatureCache());
+
+    // A damaged file is ignored rather than trusted.
+    {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(file);
+        fseek(file, 8, SEEK_SET);
+        fputc(0x55, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!LoadSignatureCache());
+    fs::resize_file(path, fs::file_size(path) - 1);
+    BOOST_CHECK(!LoadSignatureCache());
+}
+
+// Number of entries DumpSignatureCache wrote to sigcache.dat.
+static uint64_t DumpedSignatureCacheEntries()
+{
+    BOOST_REQUIRE(DumpSignatureCache());
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    uint64_t version, num;
+    uint256 nonce;
+    file >> version >> nonce >> num;
+    return num;
+}
+
+BOOST_FIXTURE_TEST_CASE(sigcache_entry_roundtrip, TestingSetup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 sighash = InsecureRand256();
+    std::vector<unsigned char> vchSig, vchSigBad;
+    BOOST_REQUIRE(key.Sign(sighash, vchSig));
+    BOOST_REQUIRE(key.Sign(InsecureRand256(), vchSigBad));
+
+    CMutableTransaction mtx(TEST_DEFAULT_TX_VERSION);
+    CTransaction tx(mtx);
+    PrecomputedTransactionData txdata(tx);
+    CachingTransactionSignatureChecker checkerStore(CKeyID(), CKeyID(), &tx, 0, 0, true, txdata);
+    CachingTransactionSignatureChecker checkerLookup(CKeyID(), CKeyID(), &tx, 0, 0, false, txdata);
+
+    // A verified signature is inserted, one that fails isn't.
+    uint64_t nEntries = DumpedSignatureCacheEntries();
+    BOOST_CHECK(checkerStore.VerifySignature(vchSig, pubkey, sighash));
+    BOOST_CHECK_EQUAL(DumpedSignatureCacheEntries(), nEntries + 1);
+    BOOST_CHECK(!checkerStore.VerifySignature(vchSigBad, pubkey, sighash));
+    BOOST_CHECK_EQUAL(DumpedSignatureCacheEntries(), nEntries + 1);
+    fs::path path = GetDataDir() / "sigcache.dat";
+    fs::path pathSaved = GetDataDir() / "sigcache.dat.saved";
+    fs::copy_file(path, pathSaved, fs::copy_option::overwrite_if_exists);
+
+    // A lookup that doesn't store (as for blocks) finds the entry and erases it.
+    BOOST_CHECK(checkerLookup.VerifySignature(vchSig, pubkey, sighash));
+    BOOST_CHECK_EQUAL(DumpedSignatureCacheEntries(), nEntries);
+
+    // Loading the file it was dumped in brings it back.
+    fs::copy_file(pathSaved, path, fs::copy_option::overwrite_if_exists);
+    BOOST_CHECK(LoadSignatureCache());
+    BOOST_CHECK_EQUAL(DumpedSignatureCacheEntries(), nEntries + 1);
+    BOOST_CHECK(checkerLookup.VerifySignature(vchSig, pubkey, sighash));
+    BOOST_CHECK_EQUAL(DumpedSignatureCacheEntries(), nEntries);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,113 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/validationinterface.h"
+#include "test/test_gulden.h"
+#include "arith_uint256.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+class CInventoryListener : public CValidationInterface
+{
+public:
+    std::vector<uint256> vSeen;
+    std::thread::id threadSeen;
+    std::atomic<bool> fBlock{false};
+
+protected:
+    void Inventory(const uint256& hash) override
+    {
+        while (fBlock)
+            std::this_thread::yield();
+        vSeen.push_back(hash);
+        threadSeen = std::this_thread::get_id();
+    }
+};
+
+class CCountingListener : public CValidationInterface
+{
+public:
+    std::atomic<int> nSeen{0};
+
+protected:
+    void Inventory([[maybe_unused]] const uint256& hash) override
+    {
+        ++nSeen;
+    }
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(validationinterface_sync_delivery)
+{
+    CInventoryListener listener;
+    RegisterValidationInterface(&listener);
+    GetMainSignals().Inventory(uint256S("01"));
+    BOOST_CHECK_EQUAL(listener.vSeen.size(), 1);
+    BOOST_CHECK(listener.threadSeen == std::this_thread::get_id());
+
+    UnregisterValidationInterface(&listener);
+    GetMainSignals().Inventory(uint256S("02"));
+    BOOST_CHECK_EQUAL(listener.vSeen.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_async_delivery)
+{
+    CInventoryListener slow;
+    CInventoryListener fast;
+    RegisterValidationInterface(&slow, true);
+    RegisterValidationInterface(&fast);
+
+    // A listener that is stuck doesn't hold up the sender, or the other listeners.
+    slow.fBlock = true;
+    for (int i = 0; i < 100; ++i)
+        GetMainSignals().Inventory(ArithToUint256(arith_uint256(i)));
+    BOOST_CHECK_EQUAL(fast.vSeen.size(), 100);
+
+    slow.fBlock = false;
+    SyncWithValidationInterfaceQueues();
+    BOOST_CHECK(slow.vSeen == fast.vSeen);
+    BOOST_CHECK(slow.threadSeen != std::this_thread::get_id());
+
+    // What was sent before unregistering is still delivered, nothing after.
+    GetMainSignals().Inventory(uint256S("ff"));
+    UnregisterValidationInterface(&slow);
+    GetMainSignals().Inventory(uint256S("fe"));
+    BOOST_CHECK_EQUAL(slow.vSeen.size(), 101);
+    UnregisterValidationInterface(&fast);
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_concurrent_registration)
+{
+    // Emissions going on while listeners come and go.
+    std::atomic<bool> fStop{false};
+    std::vector<std::thread> senders;
+    for (int i = 0; i < 4; ++i)
+    {
+        senders.emplace_back([&]() {
+            while (!fStop)
+                GetMainSignals().Inventory(uint256());
+        });
+    }
+    for (int i = 0; i < 50; ++i)
+    {
+        CCountingListener listener;
+        RegisterValidationInterface(&listener, i % 2 == 0);
+        UnregisterValidationInterface(&listener);
+    }
+    fStop = true;
+    for (auto& sender : senders)
+        sender.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,113 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/witnessvalidation.h"
+#include "consensus/validation.h"
+
+#include "test/test_gulden.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+RouletteItem MakeWitness(uint32_t nCoinHeight, uint64_t nWeight, uint64_t nBlockHeight)
+{
+    Coin coin;
+    coin.nHeight = nCoinHeight;
+    return RouletteItem(COutPoint(InsecureRand256(), 0), coin, nWeight, nBlockHeight - nCoinHeight, 0);
+}
+
+// What PrepareWitnessSelectionPool used to work out for every witness on every block.
+std::set<COutPoint> ScanExpired(const std::vector<RouletteItem>& pool, uint64_t nTotalWeightRaw)
+{
+    std::set<COutPoint> expired;
+    for (const RouletteItem& item : pool)
+    {
+        if (witnessHasExpired(item.nAge, item.nWeight, nTotalWeightRaw))
+            expired.insert(item.outpoint);
+    }
+    return expired;
+}
+
+uint64_t TotalWeight(const std::vector<RouletteItem>& pool)
+{
+    uint64_t nTotal = 0;
+    for (const RouletteItem& item : pool)
+        nTotal += item.nWeight;
+    return nTotal;
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(witnessexpiry_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(witnessexpiry_matches_scan)
+{
+    SeedInsecureRand(true);
+    CWitnessExpiryQueue expiryQueue;
+    uint64_t nBlockHeight = 250000;
+    std::vector<RouletteItem> pool;
+    for (int i = 0; i < 300; ++i)
+        pool.push_back(MakeWitness(nBlockHeight - InsecureRandRange(30000), gMinimumWitnessWeight + InsecureRandRange(200000), nBlockHeight));
+    // A few large enough to have their weight capped.
+    for (int i = 0; i < 3; ++i)
+        pool.push_back(MakeWitness(nBlockHeight - InsecureRandRange(3000), 2000000 + InsecureRandRange(2000000), nBlockHeight));
+
+    for (int nBlock = 0; nBlock < 400; ++nBlock)
+    {
+        // Witnesses come and go, witness again (renewing their age) and change weight; the network weight drifts both ways with it.
+        ++nBlockHeight;
+        for (RouletteItem& item : pool)
+            item.nAge = nBlockHeight - item.coin.nHeight;
+        switch (InsecureRandRange(6))
+        {
+            case 0:
+                pool.push_back(MakeWitness(nBlockHeight - InsecureRandRange(100), gMinimumWitnessWeight + InsecureRandRange(400000), nBlockHeight));
+                break;
+            case 1:
+                pool.erase(pool.begin() + InsecureRandRange(pool.size()));
+                break;
+            case 2:
+            {
+                RouletteItem& item = pool[InsecureRandRange(pool.size())];
+                item.coin.nHeight = nBlockHeight;
+                item.nAge = 0;
+                break;
+            }
+            case 3:
+                pool[InsecureRandRange(pool.size())].nWeight += InsecureRandRange(50000);
+                break;
+            case 4:
+            {
+                // Half the network leaves at once.
+                if (InsecureRandRange(20) == 0)
+                    pool.erase(pool.begin() + pool.size() / 2, pool.end());
+                break;
+            }
+        }
+        uint64_t nTotalWeightRaw = TotalWeight(pool);
+        std::set<COutPoint> expired;
+        expiryQueue.GetExpired(pool, nBlockHeight, nTotalWeightRaw, expired);
+        BOOST_REQUIRE(expired == ScanExpired(pool, nTotalWeightRaw));
+        nBlockHeight += InsecureRandRange(200);
+        for (RouletteItem& item : pool)
+            item.nAge = nBlockHeight - item.coin.nHeight;
+    }
+
+    // Another pool entirely (e.g. on a fork) is just as good, and going back to the earlier one too.
+    std::vector<RouletteItem> other = pool;
+    other.erase(other.begin() + other.size() / 3, other.end());
+    uint64_t nOtherWeight = TotalWeight(other);
+    std::set<COutPoint> expired;
+    expiryQueue.GetExpired(other, nBlockHeight, nOtherWeight, expired);
+    BOOST_CHECK(expired == ScanExpired(other, nOtherWeight));
+    expiryQueue.GetExpired(pool, nBlockHeight, TotalWeight(pool), expired);
+    BOOST_CHECK(expired == ScanExpired(pool, TotalWeight(pool)));
+    BOOST_CHECK(!expired.empty());
+
+    expiryQueue.Clear();
+    expiryQueue.GetExpired(std::vector<RouletteItem>(), nBlockHeight, 0, expired);
+    BOOST_CHECK(expired.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
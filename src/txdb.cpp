@@ -16,30 +16,37 @@
 #include "hash.h"
 #include "pow.h"
 #include "uint256.h"
+#include "util.h"
 
 #include <Gulden/util.h>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
+#include <future>
+
 #include <validation/witnessvalidation.h> //For ppow2witTip (remove in future)
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_TXINDEX_BEST_BLOCK = 'T';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_VERIFIED_CHAIN = 'V';
 
 static const char DB_VERSION     = '1';
 static const char DB_POW2_PHASE2 = '2';
 static const char DB_POW2_PHASE3 = '3';
 static const char DB_POW2_PHASE4 = '4';
 static const char DB_POW2_PHASE5 = '5';
+static const char DB_WITNESS_RECORD_FORMAT = 'W';
+static const char DB_WITNESS_ERASED = 'E';
 
 namespace {
 
@@ -70,24 +77,334 @@ struct CoinEntry {
     }
 };
 
+//! Record formats of the witness database, see WitnessCoinRecord.
+static const uint32_t WITNESS_RECORD_FORMAT_COIN = 0;
+static const uint32_t WITNESS_RECORD_FORMAT_COMPACT = 1;
+
+static const uint8_t WITNESS_RECORD_GENERIC = 0;
+static const uint8_t WITNESS_RECORD_FIXED = 1;
+
+/** Witness database value.
+ *  PoW2WitnessOutput coins, which is all of them from phase 4 onwards, are stored in a fixed layout that doesn't need any of the variable length decoding of the generic coin format.
+ *  Script (backwards compatible) witness outputs keep the generic coin format. */
+struct WitnessCoinRecord {
+    Coin* coin;
+    WitnessCoinRecord(const Coin* ptr) : coin(const_cast<Coin*>(ptr)) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        if (coin->out.GetType() != CTxOutType::PoW2WitnessOutput)
+        {
+            ser_writedata8(s, WITNESS_RECORD_GENERIC);
+            s << *coin;
+            return;
+        }
+        const CTxOutPoW2Witness& details = coin->out.output.witnessDetails;
+        ser_writedata8(s, WITNESS_RECORD_FIXED);
+        ser_writedata32(s, coin->nHeight);
+        ser_writedata8(s, (coin->fCoinBase ? 1 : 0) | (coin->fSegSig ? 2 : 0));
+        ser_writedata8(s, coin->out.output.nValueBase);
+        ser_writedata64(s, coin->out.nValue);
+        s << details.spendingKeyID;
+        s << details.witnessKeyID;
+        ser_writedata64(s, details.lockFromBlock);
+        ser_writedata64(s, details.lockUntilBlock);
+        ser_writedata64(s, details.failCount);
+        ser_writedata64(s, details.actionNonce);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        uint8_t nRecordType = ser_readdata8(s);
+        if (nRecordType == WITNESS_RECORD_GENERIC)
+        {
+            s >> *coin;
+            return;
+        }
+        if (nRecordType != WITNESS_RECORD_FIXED)
+            throw std::ios_base::failure("Unknown witness record type");
+
+        uint32_t nHeight = ser_readdata32(s);
+        uint8_t nFlags = ser_readdata8(s);
+        uint8_t nValueBase = ser_readdata8(s);
+        CAmount nValue = ser_readdata64(s);
+        CTxOutPoW2Witness details;
+        s >> details.spendingKeyID;
+        s >> details.witnessKeyID;
+        details.lockFromBlock = ser_readdata64(s);
+        details.lockUntilBlock = ser_readdata64(s);
+        details.failCount = ser_readdata64(s);
+        details.actionNonce = ser_readdata64(s);
+
+        *coin = Coin(CTxOut(nValue, details), nHeight, (nFlags & 1) != 0, (nFlags & 2) != 0);
+        coin->out.output.nValueBase = nValueBase;
+    }
+};
+
+/** CCoinsViewDBCursor over the witness database, decodes witness records. */
+class CWitViewDBCursor : public CCoinsViewDBCursor
+{
+public:
+    CWitViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn) : CCoinsViewDBCursor(pcursorIn, hashBlockIn) {}
+
+    bool GetValue(Coin &coin) const override
+    {
+        WitnessCoinRecord record(&coin);
+        return pcursor->GetValue(record);
+    }
+};
+
 }
 
 CWitViewDB::CWitViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : CCoinsViewDB(nCacheSize, fMemory, fWipe, "witstate")
+, nErasedSinceCompaction(0)
 {
+    db.Read(DB_WITNESS_ERASED, nErasedSinceCompaction);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, std::string name) : db(GetDataDir() / name, nCacheSize, fMemory, fWipe, true)
+bool CWitViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const
 {
+    bool fUnspent;
+    if (GetPendingCoin(outpoint, coin, fUnspent))
+        return fUnspent;
+    WitnessCoinRecord record(&coin);
+    return db.Read(CoinEntry(&outpoint), record);
+}
+
+bool CWitViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock)
+{
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(db));
+    std::unique_ptr<PendingCoinsMap> pending = NewPendingCoins();
+    size_t count = 0;
+    size_t changed = 0;
+    size_t erased = 0;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        // The witness caches keep coins that are spent while still FRESH (see SpendCoin), but those were never written here and don't need erasing either.
+        if ((it->second.flags & CCoinsCacheEntry::DIRTY) && !((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent())) {
+            CoinEntry entry(&it->first);
+            Coin coin = it->second.coin.Decompress();
+            if (coin.IsSpent()) {
+                batch->Erase(entry);
+                erased++;
+            } else {
+                batch->Write(entry, WitnessCoinRecord(&coin));
+            }
+            if (pending)
+                pending->emplace(it->first, std::move(coin));
+            changed++;
+        }
+        count++;
+        CCoinsMap::iterator itOld = it++;
+        mapCoins.erase(itOld);
+    }
+    if (!hashBlock.IsNull())
+        batch->Write(DB_BEST_BLOCK, hashBlock);
+
+    // Every erased record lingers as a tombstone that cursors have to step over until LevelDB gets round to compacting it away, which for
+    // the rarely written witness database can take very long; so compact the coin records once enough have been erased.
+    bool fCompact = false;
+    if (erased > 0) {
+        nErasedSinceCompaction += erased;
+        fCompact = nErasedSinceCompaction >= WITNESS_DB_COMPACT_ERASED;
+        if (fCompact)
+            nErasedSinceCompaction = 0;
+        batch->Write(DB_WITNESS_ERASED, nErasedSinceCompaction);
+    }
+
+    bool ret = CommitBatch(std::move(batch), std::move(pending), hashBlock, fCompact);
+    LogPrint(BCLog::COINDB, "Committed %u changed witness outputs (out of %u) to witness database...\n", (unsigned int)changed, (unsigned int)count);
+    return ret;
+}
+
+CCoinsViewCursor *CWitViewDB::Cursor() const
+{
+    WaitForBackgroundFlush();
+    CWitViewDBCursor *i = new CWitViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
+    InitCursor(i);
+    return i;
+}
+
+CCoinsViewCursor *CWitViewDB::CursorFrom(const uint256 &hashStart) const
+{
+    WaitForBackgroundFlush();
+    CWitViewDBCursor *i = new CWitViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
+    COutPoint start(hashStart, 0);
+    InitCursor(i, &start);
+    return i;
+}
+
+bool CWitViewDB::UpgradeRecordFormat()
+{
+    uint32_t nFormat = WITNESS_RECORD_FORMAT_COIN;
+    if (db.Read(DB_WITNESS_RECORD_FORMAT, nFormat) && nFormat == WITNESS_RECORD_FORMAT_COMPACT)
+        return true;
+
+    // The records are rewritten in a single batch together with the format marker, so that an interrupted upgrade never leaves
+    // a mix of old and new records behind (the witness database is small enough for this); a rerun then starts from scratch.
+    LogPrintf("Upgrading witness database to compact record format...\n");
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+    CDBBatch batch(db);
+    while (pcursor->Valid())
+    {
+        COutPoint outpoint;
+        CoinEntry entry(&outpoint);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN)
+            break;
+        Coin coin;
+        if (!pcursor->GetValue(coin))
+            return error("%s: cannot parse witness coin record", __func__);
+        batch.Write(entry, WitnessCoinRecord(&coin));
+        pcursor->Next();
+    }
+    batch.Write(DB_WITNESS_RECORD_FORMAT, WITNESS_RECORD_FORMAT_COMPACT);
+    if (!db.WriteBatch(batch, true))
+        return false;
+    // Every record was just rewritten, so the old ones are all garbage.
+    CompactCoins();
+    return true;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, std::string name)
+: db(GetDataDir() / name, nCacheSize, fMemory, fWipe, true, name)
+, fBackgroundFlush(false)
+, fHavePendingCoins(false)
+, fCommitFailed(false)
+{
+}
+
+CCoinsViewDB::~CCoinsViewDB()
+{
+    WaitForBackgroundFlush();
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    bool fUnspent;
+    if (GetPendingCoin(outpoint, coin, fUnspent))
+        return fUnspent;
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
+size_t CCoinsViewDB::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    coins.clear();
+    coins.resize(outpoints.size());
+
+    // Coins in the batch that is being committed are served from there, the rest are read from the database together.
+    std::vector<size_t> vRead;
+    std::vector<CoinEntry> vKeys;
+    size_t nFound = 0;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        bool fUnspent;
+        if (GetPendingCoin(outpoints[i], coins[i], fUnspent)) {
+            if (fUnspent)
+                ++nFound;
+            continue;
+        }
+        vRead.push_back(i);
+        vKeys.emplace_back(&outpoints[i]);
+    }
+    if (vKeys.empty())
+        return nFound;
+
+    std::vector<Coin> vCoins;
+    std::vector<char> vFound;
+    nFound += db.ReadMany(vKeys, vCoins, vFound);
+    for (size_t i = 0; i < vRead.size(); ++i) {
+        if (vFound[i])
+            coins[vRead[i]] = std::move(vCoins[i]);
+    }
+    return nFound;
+}
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    Coin coin;
+    bool fUnspent;
+    if (GetPendingCoin(outpoint, coin, fUnspent))
+        return fUnspent;
     return db.Exists(CoinEntry(&outpoint));
 }
 
+bool CCoinsViewDB::GetPendingCoin(const COutPoint& outpoint, Coin& coin, bool& fUnspent) const
+{
+    if (!fHavePendingCoins)
+        return false;
+    LOCK(cs_pendingCoins);
+    if (!pendingCoins)
+        return false;
+    PendingCoinsMap::const_iterator it = pendingCoins->find(outpoint);
+    if (it == pendingCoins->end())
+        return false;
+    fUnspent = !it->second.IsSpent();
+    if (fUnspent)
+        coin = it->second;
+    return true;
+}
+
+bool CCoinsViewDB::CommitBatch(std::unique_ptr<CDBBatch> batch, std::unique_ptr<PendingCoinsMap> pendingCoinsIn, const uint256& hashBlock, bool fCompactCoins)
+{
+    // Only one batch is in flight at a time; a failure to write the previous one surfaces here, so that the flush that follows it fails.
+    if (!WaitForBackgroundFlush())
+        return false;
+    if (!pendingCoinsIn) {
+        if (!db.WriteBatch(*batch))
+            return false;
+        if (fCompactCoins)
+            CompactCoins();
+        return true;
+    }
+
+    {
+        LOCK(cs_pendingCoins);
+        pendingCoins = std::move(pendingCoinsIn);
+        hashPendingBlock = hashBlock;
+        fHavePendingCoins = true;
+    }
+
+    // The best block is part of the batch, so the database always holds a consistent state whether or not the write completes.
+    LOCK(cs_commitThread);
+    commitThread = std::thread([this, fCompactCoins](std::unique_ptr<CDBBatch> batchIn)
+    {
+        RenameThread("Gulden-dbflush");
+        bool fOk = false;
+        try {
+            fOk = db.WriteBatch(*batchIn);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (!fOk)
+        {
+            // Keep serving the coins from memory, the next flush reports the failure.
+            LogPrintf("Error writing coins to the database in the background\n");
+            fCommitFailed = true;
+            return;
+        }
+        {
+            LOCK(cs_pendingCoins);
+            pendingCoins.reset();
+            hashPendingBlock.SetNull();
+            fHavePendingCoins = false;
+        }
+        if (fCompactCoins)
+            CompactCoins();
+    }, std::move(batch));
+    return true;
+}
+
+void CCoinsViewDB::CompactCoins() const
+{
+    int64_t nStart = GetTimeMicros();
+    db.CompactRange(DB_COIN, (char)(DB_COIN + 1));
+    LogPrint(BCLog::COINDB, "Compacted coin records in %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+}
+
+bool CCoinsViewDB::WaitForBackgroundFlush() const
+{
+    LOCK(cs_commitThread);
+    if (commitThread.joinable())
+        commitThread.join();
+    return !fCommitFailed;
+}
+
 void CCoinsViewDB::SetPhase2ActivationHash(const uint256 &hashPhase2ActivationPoint)
 {
     db.Write(DB_POW2_PHASE2, hashPhase2ActivationPoint);
@@ -141,6 +458,12 @@ uint256 CCoinsViewDB::GetPhase5ActivationHash()
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    if (fHavePendingCoins)
+    {
+        LOCK(cs_pendingCoins);
+        if (!hashPendingBlock.IsNull())
+            return hashPendingBlock;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -148,16 +471,20 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(db);
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(db));
+    std::unique_ptr<PendingCoinsMap> pending = NewPendingCoins();
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
+            Coin coin = it->second.coin.Decompress();
+            if (coin.IsSpent())
+                batch->Erase(entry);
             else
-                batch.Write(entry, it->second.coin);
+                batch->Write(entry, coin);
+            if (pending)
+                pending->emplace(it->first, std::move(coin));
             changed++;
         }
         count++;
@@ -165,9 +492,9 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         mapCoins.erase(itOld);
     }
     if (!hashBlock.IsNull())
-        batch.Write(DB_BEST_BLOCK, hashBlock);
+        batch->Write(DB_BEST_BLOCK, hashBlock);
 
-    bool ret = db.WriteBatch(batch);
+    bool ret = CommitBatch(std::move(batch), std::move(pending), hashBlock);
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
@@ -177,7 +504,7 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, "blockindex") {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -202,11 +529,31 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    // The cursor has to see the result of the last flush.
+    WaitForBackgroundFlush();
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
+    InitCursor(i);
+    return i;
+}
+
+CCoinsViewCursor *CCoinsViewDB::CursorFrom(const uint256 &hashStart) const
+{
+    WaitForBackgroundFlush();
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
+    COutPoint start(hashStart, 0);
+    InitCursor(i, &start);
+    return i;
+}
+
+void CCoinsViewDB::InitCursor(CCoinsViewDBCursor* i, const COutPoint* pStart) const
+{
+    if (pStart)
+        i->pcursor->Seek(CoinEntry(pStart));
+    else
+        i->pcursor->Seek(DB_COIN);
     // Cache key of first record
     if (i->pcursor->Valid()) {
         CoinEntry entry(&i->keyTmp.second);
@@ -215,7 +562,6 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     } else {
         i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -270,13 +616,26 @@ bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect, const uint256& hashBestBlock) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(std::pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(DB_TXINDEX_BEST_BLOCK, hashBestBlock);
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxIndexBestBlock(uint256& hashBestBlock) {
+    return Read(DB_TXINDEX_BEST_BLOCK, hashBestBlock);
+}
+
+bool CBlockTreeDB::WriteVerifiedChain(const CVerifiedChain& verified) {
+    return Write(DB_VERIFIED_CHAIN, verified);
+}
+
+bool CBlockTreeDB::ReadVerifiedChain(CVerifiedChain& verified) {
+    return Read(DB_VERIFIED_CHAIN, verified);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -289,48 +648,101 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+//! Read the block index entries with a first hash byte in [nFirstByteBegin, nFirstByteEnd), computing their hashes along the way.
+static bool ReadBlockIndexRange(CBlockTreeDB& db, int nFirstByteBegin, int nFirstByteEnd, std::vector<std::pair<uint256, CDiskBlockIndex>>& entries)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    uint256 hashStart;
+    *hashStart.begin() = (unsigned char)nFirstByteBegin;
+    pcursor->Seek(std::pair(DB_BLOCK_INDEX, hashStart));
+
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nFirstByteEnd)
+            break;
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex))
+            return error("LoadBlockIndex() : failed to read value");
+        uint256 hash = diskindex.GetBlockHashPoW2();
+        entries.emplace_back(hash, std::move(diskindex));
+        pcursor->Next();
+    }
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    // Reading the entries and hashing the headers is the bulk of the work; the entries are keyed by hash, so splitting the key space into ranges
+    // on the first hash byte gives evenly sized parts that are read on their own threads.
+    // Linking them into the block index is done here, range by range as they come in.
+    const int nRanges = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<std::pair<uint256, CDiskBlockIndex>>> rangeEntries(nRanges);
+    std::vector<std::future<bool>> rangeResults;
+    for (int i = 0; i < nRanges; ++i)
+        rangeResults.push_back(std::async(std::launch::async, ReadBlockIndexRange, std::ref(*this), i * 256 / nRanges, (i + 1) * 256 / nRanges, std::ref(rangeEntries[i])));
+
+    bool fRet = true;
+    for (int i = 0; i < nRanges; ++i)
+    {
+        if (!rangeResults[i].get())
+        {
+            fRet = false;
+            continue;
+        }
+        if (!fRet)
+            continue;
+
+        boost::this_thread::interruption_point();
+        for (const auto& entry : rangeEntries[i])
+        {
+            const CDiskBlockIndex& diskindex = entry.second;
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(entry.first);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            pindexNew->nVersionPoW2Witness = diskindex.nVersionPoW2Witness;
+            pindexNew->nTimePoW2Witness = diskindex.nTimePoW2Witness;
+            pindexNew->witnessHeader = diskindex.witnessHeader;
+
+            /** Scrypt is used for block proof-of-work, but for purposes of performance the index internally uses sha256.
+            *  This check was considered unneccessary given the other safeguards like the genesis and checkpoints. */
+            //if (!CheckProofOfWork(pindexNew, Params().GetConsensus()))
+                //return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+        }
+        std::vector<std::pair<uint256, CDiskBlockIndex>>().swap(rangeEntries[i]);
+    }
+
+    return fRet;
+}
+
+bool CBlockTreeDB::ReadPoWVerifiedHashes(std::function<void(const uint256&)> foundHash)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHashPoW2());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                pindexNew->nVersionPoW2Witness = diskindex.nVersionPoW2Witness;
-                pindexNew->nTimePoW2Witness = diskindex.nTimePoW2Witness;
-                pindexNew->hashMerkleRootPoW2Witness = diskindex.hashMerkleRootPoW2Witness;
-                pindexNew->witnessHeaderPoW2Sig = diskindex.witnessHeaderPoW2Sig;
-
-                /** Scrypt is used for block proof-of-work, but for purposes of performance the index internally uses sha256.
-                *  This check was considered unneccessary given the other safeguards like the genesis and checkpoints. */
-                //if (!CheckProofOfWork(pindexNew, Params().GetConsensus()))
-                    //return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
-            }
+            if (!pcursor->GetValue(diskindex))
+                return error("ReadPoWVerifiedHashes() : failed to read value");
+            if (diskindex.nStatus & BLOCK_POW_VERIFIED)
+                foundHash(diskindex.GetBlockHashLegacy());
+            pcursor->Next();
         } else {
             break;
         }
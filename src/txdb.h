@@ -16,9 +16,14 @@
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "sync.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -45,6 +50,16 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the address index DB specific cache, if -addressindex (MiB)
+static const int64_t nMaxAddressIndexCache = 1024;
+//! Max memory allocated to the block filter index DB specific cache, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 256;
+//! Max number of threads reading the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
+//! -backgroundflush default, write flushed coins to the database from a background thread
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+//! Number of witness coins erased from the witness database after which its coin records are compacted
+static const uint64_t WITNESS_DB_COMPACT_ERASED = 10000;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -71,6 +86,25 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** The blocks a complete startup chain verification (see CVerifyDB) covered: the nLowestHeight up to nHeight ancestors of hashTip, with the per block checks of level nLevel (at most 2) */
+struct CVerifiedChain
+{
+    uint256 hashTip;
+    int nHeight = 0;
+    int nLowestHeight = 0;
+    int nLevel = 0;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashTip);
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nLowestHeight));
+        READWRITE(VARINT(nLevel));
+    }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
@@ -78,12 +112,52 @@ protected:
     CDBWrapper db;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, std::string name="chainstate");
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    //! Whether LevelDB is so far behind with compacting that it slows writes down.
+    bool IsCompactionBehind() const { return db.GetLevelFileCount(0) >= DBWRAPPER_LEVEL0_SLOWDOWN_FILES; }
+    //! Look up many coins at once (see CDBWrapper::ReadMany); coins[i] is left spent if outpoints[i] is. Returns the number of unspent coins.
+    size_t GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
+    //! A cursor positioned at the first coin of a transaction with a hash that sorts at or after hashStart (as serialised, i.e. by its first byte first).
+    virtual CCoinsViewCursor *CursorFrom(const uint256 &hashStart) const;
+protected:
+    //! Position a new cursor at the first coin, or the first one at or after pStart.
+    void InitCursor(CCoinsViewDBCursor* cursor, const COutPoint* pStart = nullptr) const;
+
+    //! Coins written by the batch that is being committed in the background; erased coins are present as spent coins.
+    typedef std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> PendingCoinsMap;
+    //! An empty map for BatchWrite to collect the coins of its batch in, or nullptr if batches are written right away.
+    std::unique_ptr<PendingCoinsMap> NewPendingCoins() const { return std::unique_ptr<PendingCoinsMap>(fBackgroundFlush ? new PendingCoinsMap() : nullptr); }
+    /**
+     * Write batch to the database; with background flushing the write happens on a separate thread and pendingCoinsIn serves reads until it has completed.
+     * With fCompactCoins the coin records are compacted (see CompactCoins) once the batch is written, on the same thread.
+     */
+    bool CommitBatch(std::unique_ptr<CDBBatch> batch, std::unique_ptr<PendingCoinsMap> pendingCoinsIn, const uint256& hashBlock, bool fCompactCoins = false);
+    //! Compact the key range of the coin records, so that cursors over them no longer step over erased and overwritten ones.
+    void CompactCoins() const;
+    //! Look outpoint up in the batch that is being committed. Returns false if the batch doesn't touch it, otherwise fUnspent says whether it holds a coin.
+    bool GetPendingCoin(const COutPoint& outpoint, Coin& coin, bool& fUnspent) const;
+
+private:
+    bool fBackgroundFlush;
+    mutable CCriticalSection cs_pendingCoins;
+    std::unique_ptr<PendingCoinsMap> pendingCoins;
+    uint256 hashPendingBlock;
+    std::atomic<bool> fHavePendingCoins;
+    std::atomic<bool> fCommitFailed;
+    mutable CCriticalSection cs_commitThread;
+    mutable std::thread commitThread;
+
+public:
+    //! Enable or disable writing batches from a background thread.
+    void SetBackgroundFlush(bool fBackgroundFlushIn) { fBackgroundFlush = fBackgroundFlushIn; }
+    //! Wait until the last batch has been written. Returns false if writing a batch in the background failed.
+    bool WaitForBackgroundFlush() const;
 
     //fixme: (2.1) We can remove these for 2.1
     void SetPhase2ActivationHash(const uint256 &hashPhase2ActivationPoint);
@@ -122,7 +196,9 @@ public:
                 if (!cursor->GetValue(outCoin))
                     throw std::runtime_error("Error fetching record from witness cache.");
 
-                allCoins.emplace(std::pair(outPoint, outCoin));
+                // The cursor returns the coins in the order of their keys, which matches that of COutPoint for the usual small output indices
+                // (VARINT doesn't preserve the order from n = 16512 onwards); so each one normally goes at the end of the map, and is merely a bad hint otherwise.
+                allCoins.emplace_hint(allCoins.end(), outPoint, std::move(outCoin));
 
                 cursor->Next();
             }
@@ -136,6 +212,22 @@ class CWitViewDB : public CCoinsViewDB
 {
 public:
     CWitViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    //! Witness coins are stored as compact witness records instead of generic coins.
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    CCoinsViewCursor *Cursor() const override;
+    CCoinsViewCursor *CursorFrom(const uint256 &hashStart) const override;
+
+    //! Convert a witness database with generic coin records to compact witness records. Returns false on error.
+    bool UpgradeRecordFormat();
+
+    //! Witness coins erased since the coin records were last compacted.
+    uint64_t GetErasedSinceCompaction() const { return nErasedSinceCompaction; }
+
+private:
+    //! Kept in the database so that the churn of earlier runs counts as well; the coin records are compacted once it reaches WITNESS_DB_COMPACT_ERASED.
+    uint64_t nErasedSinceCompaction;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -144,14 +236,14 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(COutPoint &key) const;
-    bool GetValue(Coin &coin) const;
-    unsigned int GetValueSize() const;
+    bool GetKey(COutPoint &key) const override;
+    bool GetValue(Coin &coin) const override;
+    unsigned int GetValueSize() const override;
 
-    bool Valid() const;
-    void Next();
+    bool Valid() const override;
+    void Next() override;
 
-private:
+protected:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     std::unique_ptr<CDBIterator> pcursor;
@@ -175,10 +267,16 @@ public:
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    //! Write the positions in list, and hashBestBlock as the last block they cover, in one batch; see CTxIndex.
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list, const uint256& hashBestBlock);
+    bool ReadTxIndexBestBlock(uint256& hashBestBlock);
+    bool WriteVerifiedChain(const CVerifiedChain& verified);
+    bool ReadVerifiedChain(CVerifiedChain& verified);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Call foundHash with the (legacy) hash of every stored block index entry that has BLOCK_POW_VERIFIED set.
+    bool ReadPoWVerifiedHashes(std::function<void(const uint256&)> foundHash);
 };
 
 #endif // GULDEN_TXDB_H
@@ -30,8 +30,8 @@
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp):
-    tx(_tx), nFee(_nFee), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp)
+    tx(DetachFromArena(_tx)), nFee(_nFee), nTime(_nTime), lockPoints(lp), entryHeight(_entryHeight),
+    sigOpCost(_sigOpsCost), spendsCoinbase(_spendsCoinbase), vTxHashesIdx(0), nLinksIdx(0)
 {
     nTxWeight = GetTransactionWeight(*tx);
     nUsageSize = RecursiveDynamicUsage(tx);
@@ -227,6 +227,41 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     return true;
 }
 
+void CTxMemPool::CalculateMemPoolAncestorsExcept(txiter it, setEntries &setAncestors, const setEntries &setDone) const
+{
+    AssertLockHeld(cs);
+    std::vector<txiter> vStage;
+    vStage.push_back(it);
+    while (!vStage.empty()) {
+        txiter stageit = vStage.back();
+        vStage.pop_back();
+        for (const txiter &parent : GetMemPoolParents(stageit)) {
+            if (!setDone.count(parent) && setAncestors.insert(parent).second)
+                vStage.push_back(parent);
+        }
+    }
+}
+
+bool CTxMemPool::AnyMemPoolAncestor(txiter it, const std::function<bool(const CTxMemPoolEntry&)>& f) const
+{
+    AssertLockHeld(cs);
+    setEntries setVisited;
+    std::vector<txiter> vStage;
+    vStage.push_back(it);
+    while (!vStage.empty()) {
+        txiter stageit = vStage.back();
+        vStage.pop_back();
+        for (const txiter &parent : GetMemPoolParents(stageit)) {
+            if (!setVisited.insert(parent).second)
+                continue;
+            if (f(*parent))
+                return true;
+            vStage.push_back(parent);
+        }
+    }
+    return false;
+}
+
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
     setEntries parentIters = GetMemPoolParents(it);
@@ -328,7 +363,7 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFe
     assert(int64_t(nSizeWithDescendants) > 0);
     nModFeesWithDescendants += modifyFee;
     nCountWithDescendants += modifyCount;
-    assert(int64_t(nCountWithDescendants) > 0);
+    assert(int32_t(nCountWithDescendants) > 0);
 }
 
 void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps)
@@ -337,7 +372,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int64_t(nSizeWithAncestors) > 0);
     nModFeesWithAncestors += modifyFee;
     nCountWithAncestors += modifyCount;
-    assert(int64_t(nCountWithAncestors) > 0);
+    assert(int32_t(nCountWithAncestors) > 0);
     nSigOpCostWithAncestors += modifySigOps;
     assert(int(nSigOpCostWithAncestors) >= 0);
 }
@@ -379,7 +414,13 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(std::pair(newit, TxLinks()));
+    if (vFreeLinks.empty()) {
+        newit->nLinksIdx = vLinks.size();
+        vLinks.emplace_back();
+    } else {
+        newit->nLinksIdx = vFreeLinks.back();
+        vFreeLinks.pop_back();
+    }
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -448,8 +489,11 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    TxLinks& links = vLinks[it->nLinksIdx];
+    cachedInnerUsage -= memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+    links.parents.clear();
+    links.children.clear();
+    vFreeLinks.push_back(it->nLinksIdx);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator && (IsArgSet("-testnet") || (it->GetHeight()>Checkpoints::LastCheckPointHeight()))) {minerPolicyEstimator->removeTx(hash, false);}
@@ -604,7 +648,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
+    vLinks.clear();
+    vFreeLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -644,9 +689,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
+        assert(it->nLinksIdx < vLinks.size());
+        const TxLinks &links = vLinks[it->nLinksIdx];
         innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
         setEntries setParentCheck;
@@ -923,7 +967,7 @@ bool CCoinsViewMemPool::HaveCoin(const COutPoint &outpoint) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::MallocUsage(sizeof(TxLinks) * vLinks.size()) + memusage::DynamicUsage(vFreeLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -963,9 +1007,9 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
     setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
+    if (add && vLinks[entry->nLinksIdx].children.insert(child).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
+    } else if (!add && vLinks[entry->nLinksIdx].children.erase(child)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
     }
 }
@@ -973,9 +1017,9 @@ void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
+    if (add && vLinks[entry->nLinksIdx].parents.insert(parent).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
+    } else if (!add && vLinks[entry->nLinksIdx].parents.erase(parent)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
     }
 }
@@ -983,17 +1027,13 @@ void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return vLinks[entry->nLinksIdx].parents;
 }
 
 const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return vLinks[entry->nLinksIdx].children;
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -15,6 +15,8 @@
 
 #include <memory>
 #include <set>
+#include <deque>
+#include <functional>
 #include <map>
 #include <vector>
 #include <utility>
@@ -73,30 +75,33 @@ class CTxMemPool;
 class CTxMemPoolEntry
 {
 private:
+    // The 64 bit fields first and the narrow ones together after them, so that there is no padding in between; the narrow ones are
+    // bounded by the size of a transaction (weight, usage, sigops) or of the mempool (counts).
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
-    size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    size_t nUsageSize;         //!< ... and total memory usage
     int64_t nTime;             //!< Local time when entering the mempool
-    unsigned int entryHeight;  //!< Chain height when entering the mempool
-    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
-    int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
     // descendants as well.
-    uint64_t nCountWithDescendants;  //!< number of descendant transactions
     uint64_t nSizeWithDescendants;   //!< ... and size
     CAmount nModFeesWithDescendants; //!< ... and total fees (all including us)
 
     // Analogous statistics for ancestor transactions
-    uint64_t nCountWithAncestors;
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    uint32_t nTxWeight;              //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    uint32_t nUsageSize;             //!< ... and total memory usage
+    uint32_t entryHeight;            //!< Chain height when entering the mempool
+    int32_t sigOpCost;               //!< Total sigop cost
+    uint32_t nCountWithDescendants;  //!< number of descendant transactions
+    uint32_t nCountWithAncestors;
+    bool spendsCoinbase;             //!< keep track of transactions that spend a coinbase
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
@@ -138,7 +143,8 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t nLinksIdx; //!< Index in mempool's vLinks
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -495,8 +501,9 @@ private:
         setEntries children;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    //! The links of every entry, at its nLinksIdx; slots of removed entries are reused (vFreeLinks), and a deque doesn't move them when it grows.
+    std::deque<TxLinks> vLinks;
+    std::vector<uint32_t> vFreeLinks;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
@@ -583,6 +590,14 @@ public:
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true) const;
 
+    /** Populate setAncestors with the in-mempool ancestors of it that aren't in setDone, without limits.
+     *  Assumes that setDone includes all in-mempool ancestors of anything in it (like the
+     *  transactions of a block being built), so the walk stops there.  cs must be held. */
+    void CalculateMemPoolAncestorsExcept(txiter it, setEntries &setAncestors, const setEntries &setDone) const;
+
+    /** Whether f holds for any in-mempool ancestor of it; stops at the first one.  cs must be held. */
+    bool AnyMemPoolAncestor(txiter it, const std::function<bool(const CTxMemPoolEntry&)>& f) const;
+
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
@@ -0,0 +1,241 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "txorphanpool.h"
+
+#include "core_memusage.h"
+#include "policy/policy.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+CTxOrphanPool::CTxOrphanPool()
+: nTotalBytes(0)
+, nNextSweep(0)
+{
+}
+
+bool CTxOrphanPool::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    LOCK(cs);
+    const uint256& hash = tx->GetHash();
+    if (mapOrphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    unsigned int sz = GetTransactionWeight(*tx);
+    if (sz >= MAX_STANDARD_TX_WEIGHT)
+    {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    CPeerOrphans& peerOrphans = mapPeers[peer];
+    size_t nBytes = RecursiveDynamicUsage(tx);
+    auto ret = mapOrphans.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, nBytes, vOrphanList.size(), peerOrphans.orphans.size()});
+    assert(ret.second);
+    vOrphanList.push_back(ret.first);
+    peerOrphans.orphans.push_back(ret.first);
+    peerOrphans.nBytes += nBytes;
+    nTotalBytes += nBytes;
+    for (const CTxIn& txin : tx->vin)
+        mapOrphansByPrev[txin.prevout].insert(ret.first);
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u, %u kB)\n", hash.ToString(), mapOrphans.size(), mapOrphansByPrev.size(), nTotalBytes / 1000);
+    return true;
+}
+
+bool CTxOrphanPool::HaveTx(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapOrphans.count(hash) > 0;
+}
+
+int CTxOrphanPool::EraseTxInternal(OrphanMap::iterator it)
+{
+    for (const CTxIn& txin : it->second.tx->vin)
+    {
+        auto itPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itPrev == mapOrphansByPrev.end())
+            continue;
+        itPrev->second.erase(it);
+        if (itPrev->second.empty())
+            mapOrphansByPrev.erase(itPrev);
+    }
+
+    // Take it out of both lists by moving the last entry into its place.
+    size_t nListPos = it->second.nListPos;
+    vOrphanList[nListPos] = vOrphanList.back();
+    vOrphanList[nListPos]->second.nListPos = nListPos;
+    vOrphanList.pop_back();
+
+    auto itPeer = mapPeers.find(it->second.fromPeer);
+    assert(itPeer != mapPeers.end());
+    CPeerOrphans& peerOrphans = itPeer->second;
+    size_t nPeerPos = it->second.nPeerPos;
+    peerOrphans.orphans[nPeerPos] = peerOrphans.orphans.back();
+    peerOrphans.orphans[nPeerPos]->second.nPeerPos = nPeerPos;
+    peerOrphans.orphans.pop_back();
+    peerOrphans.nBytes -= it->second.nBytes;
+    if (peerOrphans.orphans.empty())
+        mapPeers.erase(itPeer);
+
+    nTotalBytes -= it->second.nBytes;
+    mapOrphans.erase(it);
+    return 1;
+}
+
+int CTxOrphanPool::EraseTx(const uint256& hash)
+{
+    LOCK(cs);
+    OrphanMap::iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return 0;
+    return EraseTxInternal(it);
+}
+
+int CTxOrphanPool::EraseForPeer(NodeId peer)
+{
+    LOCK(cs);
+    // Erasing the last orphan of the peer erases the peer.
+    int nErased = 0;
+    for (auto itPeer = mapPeers.find(peer); itPeer != mapPeers.end(); itPeer = mapPeers.find(peer))
+        nErased += EraseTxInternal(itPeer->second.orphans.back());
+    if (nErased > 0)
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
+    return nErased;
+}
+
+int CTxOrphanPool::EraseForBlock(const CBlock& block)
+{
+    LOCK(cs);
+    std::vector<OrphanMap::iterator> vOrphanErase;
+    for (const CTransactionRef& ptx : block.vtx)
+    {
+        // Which orphan pool entries must we evict?
+        for (const auto& txin : ptx->vin)
+        {
+            auto itByPrev = mapOrphansByPrev.find(txin.prevout);
+            if (itByPrev == mapOrphansByPrev.end())
+                continue;
+            vOrphanErase.insert(vOrphanErase.end(), itByPrev->second.begin(), itByPrev->second.end());
+        }
+    }
+    // An orphan that spends more than one output of the block is in the list more than once.
+    std::sort(vOrphanErase.begin(), vOrphanErase.end(), IteratorComparator());
+    vOrphanErase.erase(std::unique(vOrphanErase.begin(), vOrphanErase.end()), vOrphanErase.end());
+
+    int nErased = 0;
+    for (const auto& it : vOrphanErase)
+        nErased += EraseTxInternal(it);
+    if (nErased > 0)
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
+    return nErased;
+}
+
+std::vector<std::pair<CTransactionRef, NodeId>> CTxOrphanPool::GetTxsSpending(const COutPoint& prevout) const
+{
+    LOCK(cs);
+    std::vector<std::pair<CTransactionRef, NodeId>> vTxs;
+    auto itByPrev = mapOrphansByPrev.find(prevout);
+    if (itByPrev != mapOrphansByPrev.end())
+    {
+        vTxs.reserve(itByPrev->second.size());
+        for (const auto& it : itByPrev->second)
+            vTxs.emplace_back(it->second.tx, it->second.fromPeer);
+    }
+    return vTxs;
+}
+
+unsigned int CTxOrphanPool::Limit(unsigned int nMaxOrphans, size_t nMaxBytes, size_t nMaxPeerBytes)
+{
+    LOCK(cs);
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow)
+    {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        for (size_t i = 0; i < vOrphanList.size();)
+        {
+            const COrphanTx& orphan = vOrphanList[i]->second;
+            if (orphan.nTimeExpire <= nNow)
+            {
+                // The last entry moves into this place, look at the same position again.
+                nErased += EraseTxInternal(vOrphanList[i]);
+                continue;
+            }
+            nMinExpTime = std::min(orphan.nTimeExpire, nMinExpTime);
+            ++i;
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0)
+            LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
+    }
+
+    // A peer over its share loses random orphans of its own, so that it can't push out the orphans of everyone else.
+    std::vector<NodeId> vPeersOver;
+    for (const auto& peer : mapPeers)
+    {
+        if (peer.second.nBytes > nMaxPeerBytes)
+            vPeersOver.push_back(peer.first);
+    }
+    for (NodeId peer : vPeersOver)
+    {
+        while (true)
+        {
+            auto itPeer = mapPeers.find(peer);
+            if (itPeer == mapPeers.end() || itPeer->second.nBytes <= nMaxPeerBytes)
+                break;
+            EraseTxInternal(itPeer->second.orphans[GetRand(itPeer->second.orphans.size())]);
+            ++nEvicted;
+        }
+    }
+
+    while (!vOrphanList.empty() && (vOrphanList.size() > nMaxOrphans || nTotalBytes > nMaxBytes))
+    {
+        // Evict a random orphan:
+        EraseTxInternal(vOrphanList[GetRand(vOrphanList.size())]);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+size_t CTxOrphanPool::Size() const
+{
+    LOCK(cs);
+    return mapOrphans.size();
+}
+
+size_t CTxOrphanPool::TotalBytes() const
+{
+    LOCK(cs);
+    return nTotalBytes;
+}
+
+size_t CTxOrphanPool::PeerBytes(NodeId peer) const
+{
+    LOCK(cs);
+    auto itPeer = mapPeers.find(peer);
+    return itPeer == mapPeers.end() ? 0 : itPeer->second.nBytes;
+}
+
+void CTxOrphanPool::Clear()
+{
+    LOCK(cs);
+    mapOrphans.clear();
+    mapOrphansByPrev.clear();
+    vOrphanList.clear();
+    mapPeers.clear();
+    nTotalBytes = 0;
+}
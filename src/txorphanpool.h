@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_TXORPHANPOOL_H
+#define GULDEN_TXORPHANPOOL_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+class CBlock;
+
+/** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphantxsize, maximum memory used by orphan transactions in megabytes */
+static const unsigned int DEFAULT_MAX_ORPHAN_TX_SIZE = 10;
+/** A single peer may take up at most this part (1/n) of -maxorphantxsize */
+static const unsigned int ORPHAN_TX_PEER_SHARE = 4;
+/** Expiration time for orphan transactions in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum time between orphan transactions expire time checks in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/**
+ * Transactions whose inputs we don't have yet, waiting for their parents.
+ *
+ * Besides the index by hash and by spent outpoint, every orphan is in a list of all orphans and in a list of the peer that sent it,
+ * so that evicting a random one and forgetting everything of a peer don't have to search. Memory is accounted per orphan and per peer.
+ * The pool has a lock of its own, so that looking things up in it doesn't need cs_main.
+ */
+class CTxOrphanPool
+{
+public:
+    CTxOrphanPool();
+
+    //! False if the transaction is there already or too large to keep.
+    bool AddTx(const CTransactionRef& tx, NodeId peer);
+    bool HaveTx(const uint256& hash) const;
+    //! Number of transactions erased (0 or 1).
+    int EraseTx(const uint256& hash);
+    int EraseForPeer(NodeId peer);
+    //! Erase the orphans that the block includes, or makes invalid by spending the same outputs.
+    int EraseForBlock(const CBlock& block);
+    //! The orphans that spend prevout, with the peer each came from.
+    std::vector<std::pair<CTransactionRef, NodeId>> GetTxsSpending(const COutPoint& prevout) const;
+
+    /**
+     * Expire old orphans, bring peers back within nMaxPeerBytes by evicting random orphans of theirs and then evict random orphans
+     * until there are at most nMaxOrphans of at most nMaxBytes together. Returns the number evicted (not counting the expired ones).
+     */
+    unsigned int Limit(unsigned int nMaxOrphans, size_t nMaxBytes, size_t nMaxPeerBytes);
+
+    size_t Size() const;
+    size_t TotalBytes() const;
+    size_t PeerBytes(NodeId peer) const;
+    void Clear();
+
+private:
+    struct COrphanTx
+    {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t nBytes;
+        //! Position in vOrphanList and in the list of its peer.
+        size_t nListPos;
+        size_t nPeerPos;
+    };
+    typedef std::map<uint256, COrphanTx> OrphanMap;
+
+    struct IteratorComparator
+    {
+        bool operator()(const OrphanMap::iterator& a, const OrphanMap::iterator& b) const
+        {
+            return &(*a) < &(*b);
+        }
+    };
+
+    struct CPeerOrphans
+    {
+        std::vector<OrphanMap::iterator> orphans;
+        size_t nBytes = 0;
+    };
+
+    int EraseTxInternal(OrphanMap::iterator it);
+
+    mutable CCriticalSection cs;
+    OrphanMap mapOrphans;
+    std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>> mapOrphansByPrev;
+    std::vector<OrphanMap::iterator> vOrphanList;
+    std::map<NodeId, CPeerOrphans> mapPeers;
+    size_t nTotalBytes;
+    int64_t nNextSweep;
+};
+
+#endif // GULDEN_TXORPHANPOOL_H
@@ -0,0 +1,195 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "txreconciliation.h"
+
+#include "hash.h"
+
+#include <algorithm>
+
+// Short ids are uniformly distributed already, this only has to make the different uses of one independent.
+static uint32_t MixShortId(uint32_t nShortId, uint32_t nSeed)
+{
+    uint32_t h = nShortId ^ (nSeed * 0x9E3779B9U);
+    h ^= h >> 16;
+    h *= 0x7FEB352DU;
+    h ^= h >> 15;
+    h *= 0x846CA68BU;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t CheckSum(uint32_t nShortId)
+{
+    return MixShortId(nShortId, CTxReconSketch::NUM_HASHES);
+}
+
+CTxReconSketch::CTxReconSketch(size_t nCells)
+: vCells((std::max<size_t>(nCells, 1) + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES)
+{
+}
+
+size_t CTxReconSketch::CellsForDifference(size_t nDifference)
+{
+    // Peeling succeeds from about 1.3 cells per difference for large differences; what makes it fail for small ones is
+    // two ids that share all their cells, which the fixed margin makes unlikely.
+    return (nDifference * 3 / 2 + 32 + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES;
+}
+
+void CTxReconSketch::Update(std::vector<Cell>& vCells, uint32_t nShortId, int32_t nDelta)
+{
+    size_t nPart = vCells.size() / NUM_HASHES;
+    uint32_t nCheckSum = CheckSum(nShortId);
+    for (unsigned int i = 0; i < NUM_HASHES; ++i)
+    {
+        Cell& cell = vCells[i * nPart + MixShortId(nShortId, i) % nPart];
+        cell.nCount += nDelta;
+        cell.nIdSum ^= nShortId;
+        cell.nCheckSum ^= nCheckSum;
+    }
+}
+
+void CTxReconSketch::Update(uint32_t nShortId, int32_t nDelta)
+{
+    Update(vCells, nShortId, nDelta);
+}
+
+bool CTxReconSketch::Subtract(const CTxReconSketch& other)
+{
+    if (other.vCells.size() != vCells.size())
+        return false;
+    for (size_t i = 0; i < vCells.size(); ++i)
+    {
+        vCells[i].nCount -= other.vCells[i].nCount;
+        vCells[i].nIdSum ^= other.vCells[i].nIdSum;
+        vCells[i].nCheckSum ^= other.vCells[i].nCheckSum;
+    }
+    return true;
+}
+
+bool CTxReconSketch::Decode(std::vector<uint32_t>& vAdded, std::vector<uint32_t>& vRemoved) const
+{
+    if (vCells.empty())
+        return false;
+    std::vector<Cell> vWork = vCells;
+    auto isPure = [](const Cell& cell) {
+        return (cell.nCount == 1 || cell.nCount == -1) && cell.nCheckSum == CheckSum(cell.nIdSum);
+    };
+    std::vector<size_t> vPure;
+    for (size_t i = 0; i < vWork.size(); ++i)
+    {
+        if (isPure(vWork[i]))
+            vPure.push_back(i);
+    }
+    // Every id peeled off empties at least one cell, so this ends; an id that is seen twice means the table lied.
+    size_t nPeeled = 0;
+    size_t nPart = vWork.size() / NUM_HASHES;
+    while (!vPure.empty())
+    {
+        size_t nPos = vPure.back();
+        vPure.pop_back();
+        const Cell cell = vWork[nPos];
+        if (!isPure(cell))
+            continue;
+        if (++nPeeled > vWork.size())
+            return false;
+        (cell.nCount > 0 ? vAdded : vRemoved).push_back(cell.nIdSum);
+        Update(vWork, cell.nIdSum, -cell.nCount);
+        for (unsigned int i = 0; i < NUM_HASHES; ++i)
+        {
+            size_t nOther = i * nPart + MixShortId(cell.nIdSum, i) % nPart;
+            if (isPure(vWork[nOther]))
+                vPure.push_back(nOther);
+        }
+    }
+    for (const Cell& cell : vWork)
+    {
+        if (cell.nCount != 0 || cell.nIdSum != 0 || cell.nCheckSum != 0)
+            return false;
+    }
+    return true;
+}
+
+CTxReconciliationState::CTxReconciliationState(uint64_t nLocalSalt, uint64_t nRemoteSalt, bool fInitiatorIn)
+: fInitiator(fInitiatorIn)
+, nNextRound(0)
+, fRound(false)
+{
+    // Both sides must come to the same key, whichever of them made the connection.
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("Gulden txreconciliation") << std::min(nLocalSalt, nRemoteSalt) << std::max(nLocalSalt, nRemoteSalt);
+    uint256 key = ss.GetHash();
+    k0 = key.GetUint64(0);
+    k1 = key.GetUint64(1);
+}
+
+uint32_t CTxReconciliationState::GetShortId(const uint256& hash) const
+{
+    return (uint32_t)SipHashUint256(k0, k1, hash);
+}
+
+bool CTxReconciliationState::Add(const uint256& hash)
+{
+    if (mapSet.size() >= MAX_TX_RECONCILIATION_SET)
+        return false;
+    uint32_t nShortId = GetShortId(hash);
+    if (mapRound.count(nShortId))
+        return mapRound.at(nShortId) == hash;
+    auto ret = mapSet.emplace(nShortId, hash);
+    return ret.first->second == hash;
+}
+
+void CTxReconciliationState::Erase(const uint256& hash)
+{
+    auto it = mapSet.find(GetShortId(hash));
+    if (it != mapSet.end() && it->second == hash)
+        mapSet.erase(it);
+}
+
+void CTxReconciliationState::StartRound()
+{
+    fRound = true;
+    mapRound.swap(mapSet);
+    mapSet.clear();
+}
+
+CTxReconSketch CTxReconciliationState::GetRoundSketch(size_t nCells) const
+{
+    CTxReconSketch sketch(nCells);
+    for (const auto& entry : mapRound)
+        sketch.Add(entry.first);
+    return sketch;
+}
+
+std::vector<uint256> CTxReconciliationState::GetRoundTxs(const std::vector<uint32_t>& vShortIds) const
+{
+    std::vector<uint256> vTxs;
+    vTxs.reserve(vShortIds.size());
+    for (uint32_t nShortId : vShortIds)
+    {
+        auto it = mapRound.find(nShortId);
+        if (it != mapRound.end())
+            vTxs.push_back(it->second);
+    }
+    return vTxs;
+}
+
+std::vector<uint256> CTxReconciliationState::EndRound()
+{
+    std::vector<uint256> vTxs;
+    vTxs.reserve(mapRound.size());
+    for (const auto& entry : mapRound)
+        vTxs.push_back(entry.second);
+    mapRound.clear();
+    fRound = false;
+    return vTxs;
+}
+
+size_t CTxReconciliationState::GetSketchCells(size_t nLocal, size_t nRemote)
+{
+    // The sets differ by at least the difference in size; on top of that expect about a quarter of the smaller set to
+    // be missing on one side and turned up on the other.
+    size_t nDifference = std::max(nLocal, nRemote) - std::min(nLocal, nRemote) + std::min(nLocal, nRemote) / 4 + 1;
+    return std::min(CTxReconSketch::CellsForDifference(nDifference), MAX_TX_RECONCILIATION_CELLS);
+}
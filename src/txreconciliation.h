@@ -0,0 +1,135 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_TXRECONCILIATION_H
+#define GULDEN_TXRECONCILIATION_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation, announce transactions to peers that support it by set reconciliation instead of inv */
+static const bool DEFAULT_TX_RECONCILIATION = false;
+/** Version of the reconciliation protocol, as sent in sendrecon */
+static const uint32_t TX_RECONCILIATION_VERSION = 1;
+/** Time between two reconciliation rounds started with a peer, in seconds */
+static const int64_t TX_RECONCILIATION_INTERVAL = 8;
+/** Most transactions waiting for a round with a peer, the ones after that are announced by inv */
+static const size_t MAX_TX_RECONCILIATION_SET = 3000;
+/** Most cells in a sketch; a difference that needs more than this falls back to inv */
+static const size_t MAX_TX_RECONCILIATION_CELLS = 4 * 1000;
+
+/**
+ * An invertible bloom lookup table of 32 bit short ids. Every id is added to one cell in each of four parts of the
+ * table; subtracting the sketch of one set from that of another leaves only the ids that are in one of the two, which
+ * Decode peels off one at a time from the cells they are alone in. The size needed depends only on the number of
+ * differences and not on the size of the sets.
+ */
+class CTxReconSketch
+{
+public:
+    static const unsigned int NUM_HASHES = 4;
+
+    struct Cell
+    {
+        int32_t nCount = 0;
+        uint32_t nIdSum = 0;
+        uint32_t nCheckSum = 0;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(nCount);
+            READWRITE(nIdSum);
+            READWRITE(nCheckSum);
+        }
+    };
+
+    CTxReconSketch() {}
+    //! nCells is rounded up to a multiple of NUM_HASHES.
+    explicit CTxReconSketch(size_t nCells);
+
+    //! The number of cells to decode about nDifference differences most of the time.
+    static size_t CellsForDifference(size_t nDifference);
+
+    void Add(uint32_t nShortId) { Update(nShortId, 1); }
+    //! Subtract a sketch of the same size; false if the sizes differ.
+    bool Subtract(const CTxReconSketch& other);
+    /**
+     * Recover the ids of a subtracted sketch: those that were only in this set go to vAdded and those that were only
+     * in the subtracted one go to vRemoved. False if the sketch was too small for the difference, the ids found so far
+     * are then not to be trusted.
+     */
+    bool Decode(std::vector<uint32_t>& vAdded, std::vector<uint32_t>& vRemoved) const;
+
+    size_t GetCells() const { return vCells.size(); }
+    //! Whether the sketch is of a size we accept from a peer.
+    bool IsValid() const { return !vCells.empty() && vCells.size() % NUM_HASHES == 0 && vCells.size() <= MAX_TX_RECONCILIATION_CELLS; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITECOMPACTSIZEVECTOR(vCells);
+    }
+
+private:
+    void Update(uint32_t nShortId, int32_t nDelta);
+    static void Update(std::vector<Cell>& vCells, uint32_t nShortId, int32_t nDelta);
+
+    std::vector<Cell> vCells;
+};
+
+/**
+ * What is left to reconcile with one peer. Transactions to announce are kept by short id, which is salted with the
+ * salts of both sides of the connection so that nobody can make ids collide on many connections at once. A round
+ * moves the set aside, so that what comes in while it runs waits for the next round.
+ *
+ * The peer that made the connection starts the rounds: it sends reqrecon with the size of its set, the other side
+ * answers with a sketch of its own set (sketch), the first side subtracts a sketch of its set, decodes the difference,
+ * announces by inv what only it has and asks for what only the other side has (reconcildiff). If the difference can't be
+ * decoded both sides announce their whole set by inv.
+ */
+class CTxReconciliationState
+{
+public:
+    CTxReconciliationState(uint64_t nLocalSalt, uint64_t nRemoteSalt, bool fInitiatorIn);
+
+    uint32_t GetShortId(const uint256& hash) const;
+    //! False if the set is full or the short id is taken; announce the transaction by inv then.
+    bool Add(const uint256& hash);
+    //! The peer has the transaction already.
+    void Erase(const uint256& hash);
+    size_t GetSetSize() const { return mapSet.size(); }
+
+    //! Move the set aside for a round; the last round has to be ended first.
+    void StartRound();
+    size_t GetRoundSetSize() const { return mapRound.size(); }
+    CTxReconSketch GetRoundSketch(size_t nCells) const;
+    //! The transactions of the round with these short ids, the ones we don't have are skipped.
+    std::vector<uint256> GetRoundTxs(const std::vector<uint32_t>& vShortIds) const;
+    //! End the round, returning all transactions that were in it.
+    std::vector<uint256> EndRound();
+    bool IsRoundInProgress() const { return fRound; }
+
+    //! The size of the sketch for sets of nLocal and nRemote transactions, capped at MAX_TX_RECONCILIATION_CELLS.
+    static size_t GetSketchCells(size_t nLocal, size_t nRemote);
+
+    //! Whether this side starts the rounds.
+    const bool fInitiator;
+    //! When to start the next round (in microseconds), only used by the initiator.
+    int64_t nNextRound;
+
+private:
+    uint64_t k0, k1;
+    std::map<uint32_t, uint256> mapSet;
+    std::map<uint32_t, uint256> mapRound;
+    bool fRound;
+};
+
+#endif // GULDEN_TXRECONCILIATION_H
@@ -91,6 +91,9 @@ public:
                ((uint64_t)ptr[7]) << 56;
     }
 
+    //! Serialized as the bytes of data; see is_serialized_as_memory.
+    static constexpr bool SERIALIZED_AS_MEMORY = true;
+
     template<typename Stream>
     void Serialize(Stream& s) const
     {
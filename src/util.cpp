@@ -43,7 +43,11 @@
 #endif // __linux__
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <fcntl.h>
+#include <mutex>
+#include <thread>
 #include <sys/resource.h>
 #include <sys/stat.h>
 
@@ -260,6 +264,7 @@ const CLogCategoryDesc LogCategories[] =
     {BCLog::COINDB, "coindb"},
     {BCLog::DELTA, "delta"},
     {BCLog::WITNESS, "witness"},
+    {BCLog::POOL, "pool"},
     {BCLog::QT, "qt"},
     {BCLog::LEVELDB, "leveldb"},
     {BCLog::ALL, "1"},
@@ -346,17 +351,97 @@ static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fSt
     return strStamped;
 }
 
-int LogPrintStr(const std::string &str)
+namespace {
+
+/**
+ * Bounded queue of log messages, many threads push and the log writer pops (after D. Vyukov's bounded MPMC queue).
+ * Every cell carries a sequence number that tells whose turn it is: the producer claiming position n may fill the cell once it reads n,
+ * the consumer may take it once it reads n + 1, after which the cell is released for position n + LOG_QUEUE_SIZE.
+ */
+class CLogQueue
 {
-    int ret = 0; // Returns total number of characters written
-    static std::atomic_bool fStartedNewLine(true);
+public:
+    CLogQueue()
+    : cells(new Cell[LOG_QUEUE_SIZE])
+    {
+        for (size_t i = 0; i < LOG_QUEUE_SIZE; ++i)
+            cells[i].nSequence.store(i, std::memory_order_relaxed);
+    }
 
-    std::string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
+    //! False if the queue is full.
+    bool Push(std::string&& str)
+    {
+        size_t nPos = nPushPos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = cells[nPos % LOG_QUEUE_SIZE];
+            intptr_t nDiff = (intptr_t)cell.nSequence.load(std::memory_order_acquire) - (intptr_t)nPos;
+            if (nDiff == 0)
+            {
+                if (nPushPos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                {
+                    cell.str = std::move(str);
+                    cell.nSequence.store(nPos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (nDiff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                nPos = nPushPos.load(std::memory_order_relaxed);
+            }
+        }
+    }
 
+    //! Only to be called by the (single) consumer; false if there is nothing to take.
+    bool Pop(std::string& str)
+    {
+        Cell& cell = cells[nPopPos % LOG_QUEUE_SIZE];
+        if (cell.nSequence.load(std::memory_order_acquire) != nPopPos + 1)
+            return false;
+        str = std::move(cell.str);
+        cell.str = std::string();
+        cell.nSequence.store(nPopPos + LOG_QUEUE_SIZE, std::memory_order_release);
+        ++nPopPos;
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> nSequence;
+        std::string str;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> nPushPos{0};
+    alignas(64) size_t nPopPos = 0;
+};
+
+// Never freed, like mutexDebugLog, as there may be logging up to the very end (and a writer that is still running on exit mustn't find them gone).
+CLogQueue* logQueue = new CLogQueue();
+std::mutex* csLogWriter = new std::mutex();
+std::condition_variable* condLogWriter = new std::condition_variable();
+std::thread* logWriterThread = nullptr;
+std::atomic<bool> fLogWriterRunning(false);
+std::atomic<bool> fLogWriterStop(false);
+std::atomic<uint64_t> nLogDropped(0);
+//! Only touched by the consumer.
+uint64_t nLogDroppedReported = 0;
+
+} // namespace
+
+/** Write str to the console or the debug log, the way LogPrintStr does when the log writer doesn't run. */
+static int LogWriteStr(const std::string& str)
+{
+    int ret = 0;
     if (fPrintToConsole)
     {
         // print to console
-        ret = fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
+        ret = fwrite(str.data(), 1, str.size(), stdout);
         fflush(stdout);
     }
     else if (fPrintToDebugLog)
@@ -367,8 +452,8 @@ int LogPrintStr(const std::string &str)
         // buffer if we haven't opened the log yet
         if (fileout == NULL) {
             assert(vMsgsBeforeOpenLog);
-            ret = strTimestamped.length();
-            vMsgsBeforeOpenLog->push_back(strTimestamped);
+            ret = str.length();
+            vMsgsBeforeOpenLog->push_back(str);
         }
         else
         {
@@ -380,12 +465,97 @@ int LogPrintStr(const std::string &str)
                     setbuf(fileout, NULL); // unbuffered
             }
 
-            ret = FileWriteStr(strTimestamped, fileout);
+            ret = FileWriteStr(str, fileout);
         }
     }
     return ret;
 }
 
+/** Take everything off the queue and write it out, together with a note of any messages dropped since the last time. */
+static void LogWriterFlush()
+{
+    std::string strBuffer;
+    std::string str;
+    while (logQueue->Pop(str))
+    {
+        strBuffer += str;
+        // Write out in chunks, so a burst doesn't grow the buffer without bound.
+        if (strBuffer.size() >= LOG_WRITE_BUFFER_SIZE)
+        {
+            LogWriteStr(strBuffer);
+            strBuffer.clear();
+        }
+    }
+    uint64_t nDropped = nLogDropped.load(std::memory_order_relaxed);
+    if (nDropped != nLogDroppedReported)
+    {
+        std::atomic_bool fNewLine(true);
+        strBuffer += LogTimestampStr(strprintf("Log queue full, dropped %d messages (%d in total)\n", nDropped - nLogDroppedReported, nDropped), &fNewLine);
+        nLogDroppedReported = nDropped;
+    }
+    if (!strBuffer.empty())
+        LogWriteStr(strBuffer);
+}
+
+static void LogWriterThread()
+{
+    RenameThread("Gulden-logwriter");
+    while (!fLogWriterStop)
+    {
+        // Messages are collected for a while so that they are written out in one go, but not for so long that tailing the log lags.
+        LogWriterFlush();
+        std::unique_lock<std::mutex> lock(*csLogWriter);
+        condLogWriter->wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS), [] { return fLogWriterStop.load(); });
+    }
+}
+
+void StartLogWriter()
+{
+    if (fLogWriterRunning)
+        return;
+    fLogWriterStop = false;
+    logWriterThread = new std::thread(LogWriterThread);
+    fLogWriterRunning = true;
+}
+
+void StopLogWriter()
+{
+    if (!fLogWriterRunning)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(*csLogWriter);
+        fLogWriterStop = true;
+    }
+    condLogWriter->notify_one();
+    logWriterThread->join();
+    delete logWriterThread;
+    logWriterThread = nullptr;
+    // Log calls from here on are written directly; write out what was queued before them (taking over as the consumer).
+    fLogWriterRunning = false;
+    LogWriterFlush();
+}
+
+int LogPrintStr(const std::string &str)
+{
+    int ret = 0; // Returns total number of characters written
+    static std::atomic_bool fStartedNewLine(true);
+
+    std::string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
+
+    if (fLogWriterRunning && (fPrintToConsole || fPrintToDebugLog))
+    {
+        ret = strTimestamped.size();
+        if (!logQueue->Push(std::move(strTimestamped)))
+        {
+            nLogDropped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        return ret;
+    }
+
+    return LogWriteStr(strTimestamped);
+}
+
 /** Interpret string as boolean, for argument parsing */
 static bool InterpretBool(const std::string& strValue)
 {
@@ -934,6 +1104,14 @@ bool SetupNetworking()
     return true;
 }
 
+// Set when the process starts, before main runs.
+static int64_t nStartupTime = GetTime();
+
+int64_t GetStartupTime()
+{
+    return nStartupTime;
+}
+
 int GetNumCores()
 {
 #if BOOST_VERSION >= 105600
@@ -42,6 +42,13 @@ typedef void unused;
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+static const bool DEFAULT_LOGASYNC      = true;
+//! Number of messages the log queue holds (see StartLogWriter), further messages are dropped until the writer catches up.
+static const size_t LOG_QUEUE_SIZE = 16384;
+//! Milliseconds the log writer collects messages for before writing them out.
+static const int LOG_FLUSH_INTERVAL_MS = 100;
+//! The log writer writes out early once it has collected this many bytes.
+static const size_t LOG_WRITE_BUFFER_SIZE = 64 * 1024;
 
 /** Signals for translation. */
 class CTranslationInterface
@@ -113,6 +120,7 @@ namespace BCLog {
         DELTA       = (1 << 22),
         WITNESS     = (1 << 23),
         IO          = (1 << 24),
+        POOL        = (1 << 25),
         ALL         = ~(uint32_t)0,
     };
 }
@@ -134,6 +142,15 @@ bool GetLogCategory(uint32_t *f, const std::string *str);
 /** Send a string to the log output */
 int LogPrintStr(const std::string &str);
 
+/**
+ * Hand log output to a thread of its own (-logasync), so logging threads no longer wait for the console or the disk.
+ * Messages are queued without taking a lock and written out in batches every LOG_FLUSH_INTERVAL_MS; when the queue is full they are
+ * dropped, which is counted and noted in the log.
+ */
+void StartLogWriter();
+/** Write out whatever is queued and go back to writing log output directly. */
+void StopLogWriter();
+
 /** Get format string from VA_ARGS for error reporting */
 template<typename... Args> std::string FormatStringFromLogArgs(const char *fmt, [[maybe_unused]] const Args&... args) { return fmt; }
 
@@ -385,6 +402,9 @@ inline static void selectLargesHashUnit(double& dHashes, std::string& sLabel)
  */
 int GetNumCores();
 
+//! Time (in seconds) the process started, for reporting how long startup phases took to become useful.
+int64_t GetStartupTime();
+
 void RenameThread(const char* name);
 
 /**
@@ -415,50 +435,6 @@ template <typename Callable> void TraceThread(const char* name,  Callable func)
     }
 }
 
-//fixme: (C++-20) We should be able to take the string desc as a constant compile time paramater as well.
-// Little helper class to RAII encapusulate benchmarks at minimal runtime overhead.
-template <uint32_t logCategory=BCLog::BENCH> class BenchMarkHelper
-{
-public:
-    BenchMarkHelper(const char* strDesc_, uint64_t& nTotal_, uint64_t& nCounter_, const uint32_t nLogThreshold_=1)
-    : strDesc(strDesc_)
-    , nTotal(nTotal_)
-    , nCounter(nCounter_)
-    , nLogThreshold(nLogThreshold_)
-    {
-        nStart = GetTimeMicros();
-        ++nCounter_;
-    }
-    ~BenchMarkHelper()
-    {
-        Split();
-    }
-    void Split()
-    {
-        uint64_t nTime1 = GetTimeMicros(); 
-        nTotal += nTime1 - nStart;
-        if (++nCounter % 100 == 0)
-        {
-            if (nTotal * 0.000001 > nLogThreshold)
-            {
-                //fixme: (C++-20) We should be able to concat the strDesc at compile time as well.
-                LogPrint(logCategory, "%s: %.2fms [%.2fs]\n", strDesc, 0.001 * (nTime1 - nStart), nTotal * 0.000001);
-            }
-        }
-    }
-private:
-    const char* strDesc;
-    uint64_t& nTotal;
-    uint64_t& nCounter;
-    uint32_t nLogThreshold;
-    uint64_t nStart;
-};
-
-/** Run a benchmark - only logs once every 100 calls, and only once overall time passes THRESHOLD (default 1) */
-#define DO_BENCHMARK(DESC, LOGCATEGORY) static uint64_t nTotalBenchMarkTime = 0; static uint64_t nBenchmarkCounter = 0; BenchMarkHelper<LOGCATEGORY>(DESC, nTotalBenchMarkTime, nBenchmarkCounter);
-#define DO_BENCHMARKT(DESC, LOGCATEGORY, THRESHOLD) static uint64_t nTotalBenchMarkTime = 0; static uint64_t nBenchmarkCounter = 0; BenchMarkHelper<LOGCATEGORY>(DESC, nTotalBenchMarkTime, nBenchmarkCounter, THRESHOLD);
-
-
 // Optimised branch prediction
 #if defined(__GNUC__) || defined(__clang__)
 #define LIKELY(x)   __builtin_expect((x),(true))
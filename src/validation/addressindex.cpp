@@ -0,0 +1,269 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/addressindex.h"
+
+#include "hash.h"
+#include "undo.h"
+#include "util.h"
+#include "validation/validation.h"
+
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSINDEX_SUMMARY = 's';
+static const char DB_ADDRESSINDEX_BEST_BLOCK = 'B';
+
+std::unique_ptr<CAddressIndex> g_addressindex;
+
+uint160 GetAddressIndexScriptHash(const CScript& script)
+{
+    return Hash160(script.begin(), script.end());
+}
+
+std::vector<std::pair<uint160, AddressIndexRole>> GetAddressIndexScriptHashes(const CTxOut& out)
+{
+    std::vector<std::pair<uint160, AddressIndexRole>> hashes;
+    switch (out.GetType())
+    {
+        case CTxOutType::PoW2WitnessOutput:
+        {
+            const CKeyID spendingKeyID = out.output.witnessDetails.spendingKeyID;
+            const CKeyID witnessKeyID = out.output.witnessDetails.witnessKeyID;
+            hashes.emplace_back(GetAddressIndexScriptHash(GetScriptForDestination(spendingKeyID)), ADDRESS_INDEX_OWNER);
+            if (witnessKeyID != spendingKeyID)
+                hashes.emplace_back(GetAddressIndexScriptHash(GetScriptForDestination(witnessKeyID)), ADDRESS_INDEX_WITNESS_KEY);
+            break;
+        }
+        case CTxOutType::StandardKeyHashOutput:
+            hashes.emplace_back(GetAddressIndexScriptHash(GetScriptForDestination(out.output.standardKeyHash.keyID)), ADDRESS_INDEX_OWNER);
+            break;
+        case CTxOutType::ScriptLegacyOutput:
+            if (!out.output.scriptPubKey.IsUnspendable())
+                hashes.emplace_back(GetAddressIndexScriptHash(out.output.scriptPubKey), ADDRESS_INDEX_OWNER);
+            break;
+    }
+    return hashes;
+}
+
+bool GetAddressIndexScriptHash(const CTxDestination& dest, uint160& hashScript)
+{
+    if (const CPoW2WitnessDestination* witnessDest = boost::get<CPoW2WitnessDestination>(&dest))
+    {
+        hashScript = GetAddressIndexScriptHash(GetScriptForDestination(witnessDest->spendingKey));
+        return true;
+    }
+    CScript script = GetScriptForDestination(dest);
+    if (script.empty())
+        return false;
+    hashScript = GetAddressIndexScriptHash(script);
+    return true;
+}
+
+CAddressIndexDB::CAddressIndexDB(size_t nCacheSize, bool fMemory, bool fWipe)
+: CDBWrapper(GetDataDir() / "addressindex", nCacheSize, fMemory, fWipe, false, "addressindex")
+{
+}
+
+bool CAddressIndexDB::ReadBestBlock(uint256& hashBestBlock)
+{
+    return Read(DB_ADDRESSINDEX_BEST_BLOCK, hashBestBlock);
+}
+
+bool CAddressIndexDB::ReadSummary(const uint160& hashScript, CAddressIndexSummary& summary)
+{
+    if (!Exists(std::pair(DB_ADDRESSINDEX_SUMMARY, hashScript)))
+    {
+        summary = CAddressIndexSummary();
+        return true;
+    }
+    return Read(std::pair(DB_ADDRESSINDEX_SUMMARY, hashScript), summary);
+}
+
+bool CAddressIndexDB::ReadHistory(const uint160& hashScript, uint64_t nSkip, uint64_t nCount, std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>>& entries)
+{
+    entries.clear();
+    CAddressIndexKey keyStart;
+    keyStart.hashScript = hashScript;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    for (pcursor->Seek(std::pair(DB_ADDRESSINDEX, keyStart)); pcursor->Valid() && entries.size() < nCount; pcursor->Next())
+    {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.hashScript != hashScript)
+            break;
+        if (nSkip > 0)
+        {
+            --nSkip;
+            continue;
+        }
+        CAddressIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read address index entry", __func__);
+        entries.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+CAddressIndex::CAddressIndex(size_t nCacheSizeIn, bool fMemoryIn)
+: nCacheSize(nCacheSizeIn)
+, fMemory(fMemoryIn)
+, db(new CAddressIndexDB(nCacheSizeIn, fMemoryIn))
+{
+}
+
+CAddressIndex::~CAddressIndex()
+{
+    Stop();
+}
+
+bool CAddressIndex::GetSummary(const uint160& hashScript, CAddressIndexSummary& summary)
+{
+    return db->ReadSummary(hashScript, summary);
+}
+
+bool CAddressIndex::GetHistory(const uint160& hashScript, uint64_t nSkip, uint64_t nCount, std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>>& entries)
+{
+    return db->ReadHistory(hashScript, nSkip, nCount, entries);
+}
+
+bool CAddressIndex::Init(const CBlockIndex*& pindexBest)
+{
+    uint256 hashBest;
+    if (db->ReadBestBlock(hashBest))
+    {
+        BlockMap::iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end())
+        {
+            pindexBest = it->second;
+        }
+        else
+        {
+            // Without the block the index ends at there is no way to take out what doesn't belong to the chain, so start over.
+            LogPrintf("%s: last indexed block %s is unknown, rebuilding the address index\n", __func__, hashBest.ToString());
+            db.reset();
+            db.reset(new CAddressIndexDB(nCacheSize, fMemory, true));
+        }
+    }
+    return true;
+}
+
+void CAddressIndex::AddEntry(const CAddressIndexKey& key, const CAddressIndexValue& value, int nSign)
+{
+    if (nSign > 0)
+    {
+        setErase.erase(key);
+        mapWrite[key] = value;
+    }
+    else
+    {
+        mapWrite.erase(key);
+        setErase.insert(key);
+    }
+
+    CAddressIndexSummary& delta = mapSummaryDelta[key.hashScript];
+    delta.nEntries += nSign;
+    if (value.nRole == ADDRESS_INDEX_OWNER)
+    {
+        if (key.fSpend)
+        {
+            delta.nBalance -= nSign * value.nValue;
+        }
+        else
+        {
+            delta.nBalance += nSign * value.nValue;
+            delta.nReceived += nSign * value.nValue;
+        }
+    }
+}
+
+static void ForEachAddressIndexEntry(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, std::function<void(const CAddressIndexKey&, const CAddressIndexValue&)> f)
+{
+    CAddressIndexKey key;
+    CAddressIndexValue value;
+    key.nHeight = pindex->nHeight;
+    for (unsigned int i = 0; i < block.vtx.size(); ++i)
+    {
+        const CTransaction& tx = *block.vtx[i];
+        key.txid = tx.GetHash();
+
+        key.fSpend = false;
+        for (unsigned int n = 0; n < tx.vout.size(); ++n)
+        {
+            key.nIndex = n;
+            value.nValue = tx.vout[n].nValue;
+            for (const auto& hash : GetAddressIndexScriptHashes(tx.vout[n]))
+            {
+                key.hashScript = hash.first;
+                value.nRole = hash.second;
+                f(key, value);
+            }
+        }
+
+        // The undo data holds the spent outputs of every transaction but the coinbase, in the order of the inputs that spend something.
+        if (i == 0)
+            continue;
+        key.fSpend = true;
+        auto spent = blockundo.vtxundo[i - 1].vprevout.begin();
+        for (unsigned int n = 0; n < tx.vin.size(); ++n)
+        {
+            if (tx.vin[n].prevout.IsNull())
+                continue;
+            const CTxOut& prevout = (spent++)->out;
+            key.nIndex = n;
+            value.nValue = prevout.nValue;
+            for (const auto& hash : GetAddressIndexScriptHashes(prevout))
+            {
+                key.hashScript = hash.first;
+                value.nRole = hash.second;
+                f(key, value);
+            }
+        }
+    }
+}
+
+bool CAddressIndex::AddBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (!ReadBlockUndo(block, pindex, blockundo))
+        return false;
+    ForEachAddressIndexEntry(block, pindex, blockundo, [&](const CAddressIndexKey& key, const CAddressIndexValue& value) { AddEntry(key, value, 1); });
+    return true;
+}
+
+bool CAddressIndex::RemoveBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (!ReadBlockUndo(block, pindex, blockundo))
+        return false;
+    ForEachAddressIndexEntry(block, pindex, blockundo, [&](const CAddressIndexKey& key, const CAddressIndexValue& value) { AddEntry(key, value, -1); });
+    return true;
+}
+
+bool CAddressIndex::Commit(const CBlockIndex* pindexBest)
+{
+    CDBBatch batch(*db);
+    for (const auto& key : setErase)
+        batch.Erase(std::pair(DB_ADDRESSINDEX, key));
+    for (const auto& entry : mapWrite)
+        batch.Write(std::pair(DB_ADDRESSINDEX, entry.first), entry.second);
+    for (const auto& delta : mapSummaryDelta)
+    {
+        CAddressIndexSummary summary;
+        if (!db->ReadSummary(delta.first, summary))
+            return error("%s: failed to read from the address index", __func__);
+        summary.nBalance += delta.second.nBalance;
+        summary.nReceived += delta.second.nReceived;
+        summary.nEntries += delta.second.nEntries;
+        if (summary.nEntries == 0)
+            batch.Erase(std::pair(DB_ADDRESSINDEX_SUMMARY, delta.first));
+        else
+            batch.Write(std::pair(DB_ADDRESSINDEX_SUMMARY, delta.first), summary);
+    }
+    batch.Write(DB_ADDRESSINDEX_BEST_BLOCK, pindexBest->GetBlockHashPoW2());
+    if (!db->WriteBatch(batch))
+        return error("%s: failed to write to the address index", __func__);
+    mapWrite.clear();
+    setErase.clear();
+    mapSummaryDelta.clear();
+    return true;
+}
@@ -0,0 +1,171 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_VALIDATION_ADDRESSINDEX_H
+#define GULDEN_VALIDATION_ADDRESSINDEX_H
+
+#include "validation/baseindex.h"
+#include "amount.h"
+#include "crypto/common.h"
+#include "dbwrapper.h"
+#include "script/standard.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <tuple>
+
+class CBlockUndo;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+//! Number of entries to collect before writing them out while the index catches up with the chain.
+static const unsigned int ADDRESSINDEX_SYNC_BATCH_SIZE = 100000;
+
+/** How an indexed output relates to the script it is indexed under. */
+enum AddressIndexRole : uint8_t
+{
+    //! The script owns the output (for witness outputs: the spending key).
+    ADDRESS_INDEX_OWNER = 0,
+    //! The script is the witness key of a witness output; the amount doesn't count towards its balance.
+    ADDRESS_INDEX_WITNESS_KEY = 1,
+};
+
+/** One output received by, or spent from, a script; ordered by script, then height, so the history of a script can be paged through. */
+struct CAddressIndexKey
+{
+    uint160 hashScript;
+    uint32_t nHeight = 0;
+    uint256 txid;
+    //! Output index for received outputs, input index for spends.
+    uint32_t nIndex = 0;
+    bool fSpend = false;
+
+    template<typename Stream> void Serialize(Stream& s) const
+    {
+        // Big endian, so that the database orders the entries of a script by height.
+        unsigned char buf[4];
+        s << hashScript;
+        WriteBE32(buf, nHeight);
+        s.write((char*)buf, 4);
+        s << txid;
+        WriteBE32(buf, nIndex);
+        s.write((char*)buf, 4);
+        s << fSpend;
+    }
+
+    template<typename Stream> void Unserialize(Stream& s)
+    {
+        unsigned char buf[4];
+        s >> hashScript;
+        s.read((char*)buf, 4);
+        nHeight = ReadBE32(buf);
+        s >> txid;
+        s.read((char*)buf, 4);
+        nIndex = ReadBE32(buf);
+        s >> fSpend;
+    }
+
+    friend bool operator<(const CAddressIndexKey& a, const CAddressIndexKey& b)
+    {
+        return std::tie(a.hashScript, a.nHeight, a.txid, a.nIndex, a.fSpend) < std::tie(b.hashScript, b.nHeight, b.txid, b.nIndex, b.fSpend);
+    }
+};
+
+struct CAddressIndexValue
+{
+    CAmount nValue = 0;
+    uint8_t nRole = ADDRESS_INDEX_OWNER;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nValue);
+        READWRITE(nRole);
+    }
+};
+
+/** Totals per script, kept up to date with the entries so balance lookups don't have to walk the history. */
+struct CAddressIndexSummary
+{
+    //! Received minus spent, of the outputs the script owns.
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    //! Number of history entries, of any role.
+    int64_t nEntries = 0;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nBalance);
+        READWRITE(nReceived);
+        READWRITE(nEntries);
+    }
+};
+
+/** Hash of a script as used for the keys of the address index. */
+uint160 GetAddressIndexScriptHash(const CScript& script);
+/** Scripts (with role) an output is indexed under: the script itself, the key hash for key hash outputs, and both keys for witness outputs. */
+std::vector<std::pair<uint160, AddressIndexRole>> GetAddressIndexScriptHashes(const CTxOut& out);
+/** Script hash the history of dest is found under; for a witness destination that of its spending key. False for destinations that can't be looked up. */
+bool GetAddressIndexScriptHash(const CTxDestination& dest, uint160& hashScript);
+
+/** Access to the address index database (addressindex/) */
+class CAddressIndexDB : public CDBWrapper
+{
+public:
+    CAddressIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool ReadBestBlock(uint256& hashBestBlock);
+    bool ReadSummary(const uint160& hashScript, CAddressIndexSummary& summary);
+    //! Entries of hashScript in height order, skipping the first nSkip; at most nCount.
+    bool ReadHistory(const uint160& hashScript, uint64_t nSkip, uint64_t nCount, std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>>& entries);
+};
+
+/**
+ * The address index (-addressindex), maintained in the background (see CBaseIndex).
+ *
+ * Every output, and every spend of one, is recorded under the hash of the script it pays to, for balance and history lookups per address by
+ * explorers and exchanges. Witness outputs are recorded under both their spending and their witness key (see AddressIndexRole).
+ * The spent outputs are taken from the undo data, so apart from its own database the index needs nothing but the block files.
+ * Unlike the transaction index, blocks that get disconnected are taken out of the index again.
+ */
+class CAddressIndex : public CBaseIndex
+{
+public:
+    CAddressIndex(size_t nCacheSize, bool fMemory = false);
+    ~CAddressIndex();
+
+    //! Totals of hashScript; all zero for a script that was never used.
+    bool GetSummary(const uint160& hashScript, CAddressIndexSummary& summary);
+    bool GetHistory(const uint160& hashScript, uint64_t nSkip, uint64_t nCount, std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>>& entries);
+
+protected:
+    const char* GetName() const override { return "addressindex"; }
+    bool Init(const CBlockIndex*& pindexBest) override;
+    bool AddBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool RemoveBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool IsBatchFull() const override { return mapWrite.size() + setErase.size() >= ADDRESSINDEX_SYNC_BATCH_SIZE; }
+    bool Commit(const CBlockIndex* pindexBest) override;
+
+private:
+    void AddEntry(const CAddressIndexKey& key, const CAddressIndexValue& value, int nSign);
+
+    const size_t nCacheSize;
+    const bool fMemory;
+    std::unique_ptr<CAddressIndexDB> db;
+
+    // The batch: entries to write and to erase (never both for the same key), and the change to the totals of each script.
+    std::map<CAddressIndexKey, CAddressIndexValue> mapWrite;
+    std::set<CAddressIndexKey> setErase;
+    std::map<uint160, CAddressIndexSummary> mapSummaryDelta;
+};
+
+/** The address index, nullptr when -addressindex is off. */
+extern std::unique_ptr<CAddressIndex> g_addressindex;
+
+#endif // GULDEN_VALIDATION_ADDRESSINDEX_H
@@ -0,0 +1,249 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/baseindex.h"
+
+#include "blockstore.h"
+#include "chainparams.h"
+#include "undo.h"
+#include "util.h"
+#include "validation/validation.h"
+
+CBaseIndex::~CBaseIndex()
+{
+    assert(!thread.joinable());
+}
+
+bool CBaseIndex::Start()
+{
+    {
+        LOCK(cs_main);
+        if (!Init(pindexBest))
+            return false;
+        LogPrintf("%s: %s up to %s\n", __func__, GetName(), pindexBest ? pindexBest->GetBlockHashPoW2().ToString() : "(none)");
+        RegisterValidationInterface(this);
+    }
+    thread = std::thread(&TraceThread<std::function<void()>>, GetName(), std::function<void()>(std::bind(&CBaseIndex::ThreadIndex, this)));
+    return true;
+}
+
+void CBaseIndex::Stop()
+{
+    if (!thread.joinable())
+        return;
+    UnregisterValidationInterface(this);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+bool CBaseIndex::BlockUntilSynced()
+{
+    if (!fSynced)
+        return false;
+    std::unique_lock<std::mutex> lock(cs);
+    cond.wait(lock, [&]{ return fStop || (queue.empty() && !fBusy); });
+    return true;
+}
+
+void CBaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, [[maybe_unused]] const std::vector<CTransactionRef>& txnConflicted)
+{
+    // Called with cs_main held, as is the switch to fSynced; so every block after the one the index caught up with ends up here.
+    if (!fSynced)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        queue.push_back(QueuedBlock{block, pindex, true});
+    }
+    cond.notify_all();
+}
+
+void CBaseIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    AssertLockHeld(cs_main);
+    if (!fSynced)
+        return;
+    BlockMap::iterator it = mapBlockIndex.find(block->GetHashPoW2());
+    if (it == mapBlockIndex.end())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        queue.push_back(QueuedBlock{block, it->second, false});
+    }
+    cond.notify_all();
+}
+
+bool CBaseIndex::ReadBlockUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& blockundo)
+{
+    // The genesis block has no undo data (and spends nothing).
+    if (!pindex->pprev)
+        return true;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetUndoPos();
+    }
+    if (pos.IsNull())
+        return error("%s: no undo data available", __func__);
+    if (!blockStore.UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHashPoW2()))
+        return error("%s: failure reading undo data", __func__);
+
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent", __func__);
+    for (unsigned int i = 1; i < block.vtx.size(); ++i)
+    {
+        size_t nSpent = 0;
+        for (const auto& txin : block.vtx[i]->vin)
+            if (!txin.prevout.IsNull())
+                ++nSpent;
+        if (blockundo.vtxundo[i - 1].vprevout.size() != nSpent)
+            return error("%s: transaction and undo data inconsistent", __func__);
+    }
+    return true;
+}
+
+bool CBaseIndex::ProcessBlock(const CBlock& block, const CBlockIndex* pindex, bool fConnect)
+{
+    if (fConnect)
+    {
+        if (!AddBlock(block, pindex))
+            return error("%s: %s failed to index block %s", __func__, GetName(), pindex->GetBlockHashPoW2().ToString());
+        pindexBest = pindex;
+    }
+    else
+    {
+        if (!RemoveBlock(block, pindex))
+            return error("%s: %s failed to remove block %s", __func__, GetName(), pindex->GetBlockHashPoW2().ToString());
+        pindexBest = pindex->pprev;
+    }
+    return true;
+}
+
+bool CBaseIndex::CatchUp()
+{
+    const CChainParams& chainparams = Params();
+    int64_t nLastLog = GetTimeMillis();
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            if (fStop)
+                return false;
+        }
+
+        CBlock block;
+        const CBlockIndex* pindexNext;
+        bool fConnect = true;
+        bool fHaveChain;
+        {
+            LOCK(cs_main);
+            fHaveChain = chainActive.Tip() != nullptr;
+        }
+        if (!fHaveChain)
+        {
+            // Nothing to index before the genesis block is connected; wait for it.
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait_for(lock, std::chrono::milliseconds(100));
+            continue;
+        }
+        {
+            LOCK(cs_main);
+            if (pindexBest && !chainActive.Contains(pindexBest))
+            {
+                // The chain moved away from the last indexed block (e.g. a reorg while the node was down), walk back to where they meet.
+                pindexNext = pindexBest;
+                fConnect = false;
+            }
+            else
+            {
+                pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+                if (!pindexNext)
+                {
+                    // Caught up; from here on BlockConnected queues every new block. Commit what we have before anyone can see the switch.
+                    std::lock_guard<std::mutex> lock(cs);
+                    fBusy = true;
+                    fSynced = true;
+                    break;
+                }
+            }
+        }
+        // Read without cs_main, catching up shouldn't hold up block processing.
+        if (!ReadBlockFromDisk(block, pindexNext, chainparams))
+            return error("%s: %s failed to read block %s from disk", __func__, GetName(), pindexNext->GetBlockHashPoW2().ToString());
+
+        if (!ProcessBlock(block, pindexNext, fConnect))
+            return false;
+        if (IsBatchFull() && !Commit(pindexBest))
+            return false;
+        if (GetTimeMillis() > nLastLog + 30000)
+        {
+            LogPrintf("%s: %s at height %d\n", __func__, GetName(), pindexNext->nHeight);
+            nLastLog = GetTimeMillis();
+        }
+    }
+
+    // A failed write is retried with the next batch, the blocks connected from now on have to be picked up either way.
+    Commit(pindexBest);
+    LogPrintf("%s: %s is synced at height %d\n", __func__, GetName(), pindexBest->nHeight);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fBusy = false;
+    }
+    cond.notify_all();
+    return true;
+}
+
+void CBaseIndex::ThreadIndex()
+{
+    if (!CatchUp())
+    {
+        // Keep what was read so far, the next start continues from there.
+        if (pindexBest)
+            Commit(pindexBest);
+        return;
+    }
+
+    while (true)
+    {
+        std::deque<QueuedBlock> blocks;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [&]{ return fStop || !queue.empty(); });
+            if (queue.empty())
+                return;
+            blocks.swap(queue);
+            fBusy = true;
+        }
+
+        // Everything that arrived while the last batch was written goes out as one batch; after a failed write it is retried with the next one.
+        bool fOK = true;
+        for (const auto& queued : blocks)
+        {
+            if (!ProcessBlock(*queued.block, queued.pindex, queued.fConnect))
+            {
+                fOK = false;
+                break;
+            }
+        }
+        if (pindexBest)
+            Commit(pindexBest);
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fBusy = false;
+            // An index that can't follow the chain any more stops here, the next start catches up from the last block written.
+            if (!fOK)
+            {
+                fStop = true;
+                fSynced = false;
+            }
+        }
+        cond.notify_all();
+        if (!fOK)
+            return;
+    }
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_VALIDATION_BASEINDEX_H
+#define GULDEN_VALIDATION_BASEINDEX_H
+
+#include "validation/validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+/**
+ * Base for the optional indexes (-txindex, -addressindex, -blockfilterindex), which are maintained in the background.
+ *
+ * An index follows the active chain through BlockConnected/BlockDisconnected notifications; the blocks are handed to the index on its own thread,
+ * which collects the entries and writes them out in batches, together with the last block covered. So connecting a block doesn't wait for any index.
+ * When started behind the chain (or empty, e.g. when an index is turned on for an existing node) the index first catches up by reading the blocks
+ * from disk, while the node keeps running; blocks on a branch that is no longer active are taken out again first.
+ *
+ * The virtual methods are only called on the index thread (Init from Start); derived classes have to call Stop from their destructor.
+ */
+class CBaseIndex : public CValidationInterface
+{
+public:
+    virtual ~CBaseIndex();
+
+    //! Start following the chain (and catching up with it) from where the index left off.
+    bool Start();
+    //! Write out what has been indexed so far and stop; no-op if not started.
+    void Stop();
+
+    //! Wait until every block connected so far is written to the index. Returns false straight away if the index is still catching up.
+    bool BlockUntilSynced();
+    //! Whether the index has caught up with the chain.
+    bool IsSynced() const { return fSynced; }
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+    //! Name of the index thread, and of the index in the log.
+    virtual const char* GetName() const = 0;
+    //! Set pindexBest to the last block the index on disk covers, nullptr for an empty index. Called with cs_main held.
+    virtual bool Init(const CBlockIndex*& pindexBest) = 0;
+    //! Add the entries for block (at pindex, which extends the index by one block) to the batch; on failure nothing of block may be added.
+    virtual bool AddBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+    //! Take the entries for block (at pindex, the last block in the index) out again; the default leaves them in place.
+    virtual bool RemoveBlock([[maybe_unused]] const CBlock& block, [[maybe_unused]] const CBlockIndex* pindex) { return true; }
+    //! Whether the batch is large enough to be written out while catching up.
+    virtual bool IsBatchFull() const = 0;
+    //! Write the batch, with pindexBest as the last block covered, in one go. On failure the batch has to be kept, it is retried with the next one.
+    virtual bool Commit(const CBlockIndex* pindexBest) = 0;
+
+    //! Read (and check against block) the undo data of block, for indexes that need the spent outputs; the genesis block has none.
+    static bool ReadBlockUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& blockundo);
+
+private:
+    struct QueuedBlock
+    {
+        std::shared_ptr<const CBlock> block;
+        const CBlockIndex* pindex;
+        bool fConnect;
+    };
+
+    void ThreadIndex();
+    //! Read blocks from disk until the index reaches the tip; false if interrupted or a block can't be read.
+    bool CatchUp();
+    bool ProcessBlock(const CBlock& block, const CBlockIndex* pindex, bool fConnect);
+
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Blocks connected (and disconnected) since the index caught up, that still have to be indexed.
+    std::deque<QueuedBlock> queue;
+    //! Whether the index thread is indexing blocks it took from the queue.
+    bool fBusy = false;
+    bool fStop = false;
+    std::atomic<bool> fSynced{false};
+    //! Last block in the index, only used by the index thread once it runs.
+    const CBlockIndex* pindexBest = nullptr;
+    std::thread thread;
+};
+
+#endif // GULDEN_VALIDATION_BASEINDEX_H
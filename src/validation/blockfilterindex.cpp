@@ -0,0 +1,179 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/blockfilterindex.h"
+
+#include "undo.h"
+#include "util.h"
+#include "validation/validation.h"
+
+static const char DB_BLOCKFILTER = 'f';
+static const char DB_BLOCKFILTER_BEST_BLOCK = 'B';
+
+std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+CBlockFilterIndexDB::CBlockFilterIndexDB(size_t nCacheSize, bool fMemory, bool fWipe)
+: CDBWrapper(GetDataDir() / "blockfilterindex", nCacheSize, fMemory, fWipe, false, "blockfilterindex")
+{
+}
+
+bool CBlockFilterIndexDB::ReadBestBlock(uint256& hashBestBlock)
+{
+    return Read(DB_BLOCKFILTER_BEST_BLOCK, hashBestBlock);
+}
+
+bool CBlockFilterIndexDB::ReadEntry(const uint256& hashBlock, CBlockFilterIndexEntry& entry)
+{
+    return Read(std::pair(DB_BLOCKFILTER, hashBlock), entry);
+}
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSizeIn, bool fMemoryIn)
+: filterType(filterTypeIn)
+, nCacheSize(nCacheSizeIn)
+, fMemory(fMemoryIn)
+, db(new CBlockFilterIndexDB(nCacheSizeIn, fMemoryIn))
+{
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    Stop();
+}
+
+bool CBlockFilterIndex::Init(const CBlockIndex*& pindexBest)
+{
+    uint256 hashBest;
+    if (db->ReadBestBlock(hashBest))
+    {
+        BlockMap::iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end())
+        {
+            pindexBest = it->second;
+        }
+        else
+        {
+            // The headers chain through the filters of the blocks before, which can't be followed back from a block we don't know.
+            LogPrintf("%s: last indexed block %s is unknown, rebuilding the block filter index\n", __func__, hashBest.ToString());
+            db.reset();
+            db.reset(new CBlockFilterIndexDB(nCacheSize, fMemory, true));
+        }
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::AddBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (!ReadBlockUndo(block, pindex, blockundo))
+        return false;
+
+    // The previous block is either in the batch or written already; after a reorg not necessarily the block added last.
+    uint256 hashPrevHeader;
+    if (pindex->pprev)
+    {
+        const uint256 hashPrev = pindex->pprev->GetBlockHashPoW2();
+        auto it = mapWrite.find(hashPrev);
+        if (it != mapWrite.end())
+        {
+            hashPrevHeader = it->second.hashHeader;
+        }
+        else
+        {
+            CBlockFilterIndexEntry prevEntry;
+            if (!db->ReadEntry(hashPrev, prevEntry))
+                return error("%s: filter of previous block %s not found", __func__, hashPrev.ToString());
+            hashPrevHeader = prevEntry.hashHeader;
+        }
+    }
+
+    CBlockFilter filter(filterType, block, blockundo);
+    CBlockFilterIndexEntry& entry = mapWrite[filter.GetBlockHash()];
+    entry.vFilter = filter.GetEncodedFilter();
+    entry.hashFilter = filter.GetHash();
+    entry.hashHeader = filter.ComputeHeader(hashPrevHeader);
+    return true;
+}
+
+bool CBlockFilterIndex::Commit(const CBlockIndex* pindexBest)
+{
+    CDBBatch batch(*db);
+    for (const auto& entry : mapWrite)
+        batch.Write(std::pair(DB_BLOCKFILTER, entry.first), entry.second);
+    batch.Write(DB_BLOCKFILTER_BEST_BLOCK, pindexBest->GetBlockHashPoW2());
+    if (!db->WriteBatch(batch))
+        return error("%s: failed to write to the block filter index", __func__);
+    mapWrite.clear();
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter)
+{
+    CBlockFilterIndexEntry entry;
+    if (!db->ReadEntry(pindex->GetBlockHashPoW2(), entry))
+        return false;
+    try
+    {
+        filter = CBlockFilter(filterType, pindex->GetBlockHashPoW2(), std::move(entry.vFilter));
+    }
+    catch (const std::exception& e)
+    {
+        return error("%s: corrupt filter for block %s: %s", __func__, pindex->GetBlockHashPoW2().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& hashHeader)
+{
+    CBlockFilterIndexEntry entry;
+    if (!db->ReadEntry(pindex->GetBlockHashPoW2(), entry))
+        return false;
+    hashHeader = entry.hashHeader;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<std::pair<uint256, CBlockFilterIndexEntry>>& entries)
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+    entries.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it, pindex = pindex->pprev)
+    {
+        it->first = pindex->GetBlockHashPoW2();
+        if (!db->ReadEntry(it->first, it->second))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<CBlockFilter>& filters)
+{
+    std::vector<std::pair<uint256, CBlockFilterIndexEntry>> entries;
+    if (!LookupRange(nStartHeight, pindexStop, entries))
+        return false;
+    filters.clear();
+    filters.reserve(entries.size());
+    try
+    {
+        for (auto& entry : entries)
+            filters.emplace_back(filterType, entry.first, std::move(entry.second.vFilter));
+    }
+    catch (const std::exception& e)
+    {
+        return error("%s: corrupt filter: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& hashes)
+{
+    std::vector<std::pair<uint256, CBlockFilterIndexEntry>> entries;
+    if (!LookupRange(nStartHeight, pindexStop, entries))
+        return false;
+    hashes.clear();
+    hashes.reserve(entries.size());
+    for (const auto& entry : entries)
+        hashes.push_back(entry.second.hashFilter);
+    return true;
+}
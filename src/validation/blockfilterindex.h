@@ -0,0 +1,100 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_VALIDATION_BLOCKFILTERINDEX_H
+#define GULDEN_VALIDATION_BLOCKFILTERINDEX_H
+
+#include "validation/baseindex.h"
+#include "blockfilter.h"
+#include "dbwrapper.h"
+
+#include <map>
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Default for -peerblockfilters, serve compact block filters to peers (needs -blockfilterindex) */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+//! Number of filters to collect before writing them out while the index catches up with the chain.
+static const unsigned int BLOCKFILTERINDEX_SYNC_BATCH_SIZE = 2000;
+//! Most filters a peer can ask for with one getcfilters.
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+//! Most filter hashes a peer can ask for with one getcfheaders.
+static const unsigned int MAX_GETCFHEADERS_SIZE = 2000;
+//! Distance between the filter headers in a cfcheckpt.
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/** What the index keeps for a block: the filter with its hash and header, so that serving either is a single lookup. */
+struct CBlockFilterIndexEntry
+{
+    std::vector<unsigned char> vFilter;
+    uint256 hashFilter;
+    uint256 hashHeader;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITECOMPACTSIZEVECTOR(vFilter);
+        READWRITE(hashFilter);
+        READWRITE(hashHeader);
+    }
+};
+
+/** Access to the block filter index database (blockfilterindex/) */
+class CBlockFilterIndexDB : public CDBWrapper
+{
+public:
+    CBlockFilterIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool ReadBestBlock(uint256& hashBestBlock);
+    bool ReadEntry(const uint256& hashBlock, CBlockFilterIndexEntry& entry);
+};
+
+/**
+ * The compact block filter index (-blockfilterindex), maintained in the background (see CBaseIndex).
+ *
+ * Holds the basic filter (BIP158) of every block in the chain, keyed by block hash, so that light clients can fetch filters
+ * (BIP157) and test them for their own scripts instead of handing the node a bloom filter to test every block against.
+ * The spent outputs are taken from the undo data. Entries of blocks that get disconnected are left in place, they stay valid
+ * for their block; lookups go by blocks of the active chain.
+ */
+class CBlockFilterIndex : public CBaseIndex
+{
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false);
+    ~CBlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+
+    //! False if the block isn't (yet) indexed; likewise for the lookups below.
+    bool LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter);
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& hashHeader);
+    //! The filters of the blocks from nStartHeight up to pindexStop, in chain order.
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<CBlockFilter>& filters);
+    //! The filter hashes of the blocks from nStartHeight up to pindexStop, in chain order.
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& hashes);
+
+protected:
+    const char* GetName() const override { return "blockfilterindex"; }
+    bool Init(const CBlockIndex*& pindexBest) override;
+    bool AddBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool IsBatchFull() const override { return mapWrite.size() >= BLOCKFILTERINDEX_SYNC_BATCH_SIZE; }
+    bool Commit(const CBlockIndex* pindexBest) override;
+
+private:
+    bool LookupRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<std::pair<uint256, CBlockFilterIndexEntry>>& entries);
+
+    const BlockFilterType filterType;
+    const size_t nCacheSize;
+    const bool fMemory;
+    std::unique_ptr<CBlockFilterIndexDB> db;
+
+    //! The batch, by block hash.
+    std::map<uint256, CBlockFilterIndexEntry> mapWrite;
+};
+
+/** The block filter index, nullptr when -blockfilterindex is off. */
+extern std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+#endif // GULDEN_VALIDATION_BLOCKFILTERINDEX_H
@@ -0,0 +1,54 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/chainstatus.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "validation/validation.h"
+
+#include <atomic>
+
+// Only ever replaced as a whole, through std::atomic_load/std::atomic_store.
+static std::shared_ptr<const CChainStatus> chainStatus = std::make_shared<const CChainStatus>();
+
+std::shared_ptr<const CChainStatus> GetChainStatus()
+{
+    return std::atomic_load(&chainStatus);
+}
+
+static void SetHeader(CChainStatus& status, const CBlockIndex* pindexHeader)
+{
+    status.nHeaderHeight = pindexHeader ? pindexHeader->nHeight : -1;
+    status.nHeaderTime = pindexHeader ? pindexHeader->GetBlockTime() : -1;
+}
+
+void PublishChainStatus(const CChainParams& chainParams, int nPoW2Phase)
+{
+    AssertLockHeld(cs_main);
+
+    std::shared_ptr<const CChainStatus> previous = GetChainStatus();
+    std::shared_ptr<CChainStatus> status = std::make_shared<CChainStatus>();
+    if (const CBlockIndex* pindexTip = chainActive.Tip())
+    {
+        status->nHeight = pindexTip->nHeight;
+        status->nTipTime = pindexTip->GetBlockTime();
+        status->hashTip = pindexTip->GetBlockHashPoW2();
+        status->dVerificationProgress = GuessVerificationProgress(chainParams.TxData(), const_cast<CBlockIndex*>(pindexTip));
+        status->fSegSigEnabled = IsSegSigEnabled(pindexTip->pprev);
+    }
+    SetHeader(*status, pindexBestHeader);
+    status->fInitialBlockDownload = IsInitialBlockDownload();
+    status->nPoW2Phase = nPoW2Phase >= 0 ? nPoW2Phase : previous->nPoW2Phase;
+    std::atomic_store(&chainStatus, std::shared_ptr<const CChainStatus>(std::move(status)));
+}
+
+void PublishHeaderTip(const CBlockIndex* pindexHeader)
+{
+    AssertLockHeld(cs_main);
+
+    std::shared_ptr<CChainStatus> status = std::make_shared<CChainStatus>(*GetChainStatus());
+    SetHeader(*status, pindexHeader);
+    std::atomic_store(&chainStatus, std::shared_ptr<const CChainStatus>(std::move(status)));
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_VALIDATION_CHAINSTATUS_H
+#define GULDEN_VALIDATION_CHAINSTATUS_H
+
+#include "uint256.h"
+
+#include <memory>
+#include <stdint.h>
+
+class CBlockIndex;
+class CChainParams;
+
+/**
+ * The state of the chain as the GUI shows it, published by validation whenever the tip or the best header changes.
+ * Readers get the last published one without taking cs_main, so polling it never holds up validation (or waits on it).
+ */
+struct CChainStatus
+{
+    //! Height of the tip, -1 while there is none.
+    int nHeight = -1;
+    int64_t nTipTime = 0;
+    uint256 hashTip;
+    double dVerificationProgress = 0;
+    //! Height and time of the best header, -1 while there is none.
+    int nHeaderHeight = -1;
+    int64_t nHeaderTime = -1;
+    bool fInitialBlockDownload = true;
+    int nPoW2Phase = 1;
+    //! Whether the tip itself is in the segsig format, as IsSegSigEnabled(chainActive.TipPrev()).
+    bool fSegSigEnabled = false;
+};
+
+//! The last published status; never null, and (as it is immutable) safe to keep for as long as the caller likes.
+std::shared_ptr<const CChainStatus> GetChainStatus();
+
+/**
+ * Publish the status of chainActive; cs_main must be held.
+ * nPoW2Phase is the phase of the tip, or -1 to carry over the one published before where it's not to hand.
+ */
+void PublishChainStatus(const CChainParams& chainParams, int nPoW2Phase = -1);
+
+//! Publish a new best header (or none) on top of the last published status; cs_main must be held.
+void PublishHeaderTip(const CBlockIndex* pindexHeader);
+
+#endif // GULDEN_VALIDATION_CHAINSTATUS_H
@@ -0,0 +1,67 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "validation/txindex.h"
+
+#include "clientversion.h"
+#include "util.h"
+#include "validation/validation.h"
+
+std::unique_ptr<CTxIndex> g_txindex;
+
+CTxIndex::~CTxIndex()
+{
+    Stop();
+}
+
+bool CTxIndex::Init(const CBlockIndex*& pindexBest)
+{
+    uint256 hashBest;
+    if (pblocktree->ReadTxIndexBestBlock(hashBest))
+    {
+        BlockMap::iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end())
+            pindexBest = it->second;
+        else
+            LogPrintf("%s: last indexed block %s is unknown, rebuilding the transaction index\n", __func__, hashBest.ToString());
+    }
+    else
+    {
+        // Older versions wrote the index while connecting blocks, so an index they left is complete up to the tip.
+        bool fLegacyIndex = false;
+        if (pblocktree->ReadFlag("txindex", fLegacyIndex) && fLegacyIndex && chainActive.Tip())
+        {
+            pindexBest = chainActive.Tip();
+            if (!pblocktree->WriteTxIndex(vPos, pindexBest->GetBlockHashPoW2()))
+                return error("%s: failed to write to the transaction index", __func__);
+        }
+    }
+    // Older versions refuse to start on a changed -txindex setting, make sure they don't trust an index that might not be complete.
+    pblocktree->WriteFlag("txindex", false);
+    return true;
+}
+
+bool CTxIndex::FindTx(const uint256& txid, CDiskTxPos& pos) const
+{
+    return pblocktree->ReadTxIndex(txid, pos);
+}
+
+bool CTxIndex::AddBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    for (const auto& tx : block.vtx)
+    {
+        vPos.emplace_back(tx->GetHash(), pos);
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return true;
+}
+
+bool CTxIndex::Commit(const CBlockIndex* pindexBest)
+{
+    if (!pblocktree->WriteTxIndex(vPos, pindexBest->GetBlockHashPoW2()))
+        return error("%s: failed to write to the transaction index", __func__);
+    vPos.clear();
+    return true;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_VALIDATION_TXINDEX_H
+#define GULDEN_VALIDATION_TXINDEX_H
+
+#include "validation/baseindex.h"
+#include "txdb.h"
+
+//! Number of transaction positions to collect before writing them out while the index catches up with the chain.
+static const unsigned int TXINDEX_SYNC_BATCH_SIZE = 100000;
+
+/**
+ * The transaction index (-txindex), maintained in the background (see CBaseIndex).
+ *
+ * The positions of the transactions are written to the block tree database, together with the hash of the last block covered.
+ * Lookups only find what has been indexed so far.
+ * Entries of blocks that get disconnected are left in place, a later connect of the transaction overwrites them.
+ */
+class CTxIndex : public CBaseIndex
+{
+public:
+    ~CTxIndex();
+
+    //! Position of txid on disk; false if the transaction isn't (yet) indexed.
+    bool FindTx(const uint256& txid, CDiskTxPos& pos) const;
+
+protected:
+    const char* GetName() const override { return "txindex"; }
+    bool Init(const CBlockIndex*& pindexBest) override;
+    bool AddBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool IsBatchFull() const override { return vPos.size() >= TXINDEX_SYNC_BATCH_SIZE; }
+    bool Commit(const CBlockIndex* pindexBest) override;
+
+private:
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+};
+
+/** The transaction index, nullptr when -txindex is off. */
+extern std::unique_ptr<CTxIndex> g_txindex;
+
+#endif // GULDEN_VALIDATION_TXINDEX_H
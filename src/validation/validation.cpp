@@ -11,6 +11,7 @@
 // file COPYING
 
 #include "validation/validation.h"
+#include "validation/chainstatus.h"
 #include "validation/witnessvalidation.h"
 
 #include "alert.h"
@@ -20,7 +21,9 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "Gulden/auto_checkpoints.h"
+#include "Gulden/util.h"
 #include "checkqueue.h"
+#include "compat/sys.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
@@ -58,6 +61,8 @@
 #endif
 
 #include <atomic>
+#include <deque>
+#include <future>
 #include <sstream>
 
 #include <boost/foreach.hpp>
@@ -75,23 +80,88 @@
 
 CCriticalSection cs_main;
 
+namespace {
+
+/**
+ * Allocates the entries of mapBlockIndex in slabs, rather than one at a time; entries are only freed all together (UnloadBlockIndex).
+ * That saves an allocation per entry (a couple of million at startup) and keeps the entries close together in memory.
+ */
+class CBlockIndexSlabs
+{
+public:
+    CBlockIndex* Allocate()
+    {
+        if (slabs.empty() || nUsed == SLAB_SIZE)
+        {
+            slabs.emplace_back(new CBlockIndex[SLAB_SIZE]);
+            slabStarts.insert(slabs.back().get());
+            nUsed = 0;
+        }
+        return &slabs.back()[nUsed++];
+    }
+
+    //! Whether pindex came from Allocate (instead of being allocated by itself, as tests do).
+    bool Owns(const CBlockIndex* pindex) const
+    {
+        auto it = slabStarts.upper_bound(pindex);
+        if (it == slabStarts.begin())
+            return false;
+        --it;
+        return std::less<const CBlockIndex*>()(pindex, *it + SLAB_SIZE);
+    }
+
+    void Clear()
+    {
+        slabStarts.clear();
+        slabs.clear();
+        nUsed = 0;
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return slabs.size() * memusage::MallocUsage(SLAB_SIZE * sizeof(CBlockIndex)) + memusage::DynamicUsage(slabs) + memusage::DynamicUsage(slabStarts);
+    }
+
+private:
+    static const size_t SLAB_SIZE = 4096;
+    std::vector<std::unique_ptr<CBlockIndex[]>> slabs;
+    std::set<const CBlockIndex*> slabStarts;
+    size_t nUsed = 0;
+};
+
+CBlockIndexSlabs blockIndexSlabs;
+
+}
+
 BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+bool fPrefetchCoins = DEFAULT_PREFETCH_COINS;
+bool fBlockArena = DEFAULT_BLOCK_ARENA;
+int64_t nDBIdleCompact = DEFAULT_DB_IDLE_COMPACT;
+//! Time of the last change of the tip, for CompactDatabasesIfIdle.
+static std::atomic<int64_t> nTimeLastTipUpdate(0);
 std::atomic_bool fImporting(false);
 bool fReindex = false;
+// Read by CheckBlockHeader from any thread (including the VerifyDB workers) without cs_main, so it has a lock of its own.
+static CCriticalSection cs_powVerifiedBeforeReindex;
+static std::unordered_set<uint256, BlockHasher> setPoWVerifiedBeforeReindex GUARDED_BY(cs_powVerifiedBeforeReindex);
+static std::atomic<bool> fHavePoWVerifiedBeforeReindex(false);
 bool fReverseHeaders = false;
-bool fTxIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fAssumeCheckpointPoW = DEFAULT_ASSUME_CHECKPOINT_POW;
+int64_t nSamplePoW = DEFAULT_SAMPLE_POW;
+int64_t nSamplePoWTipAge = DEFAULT_SAMPLE_POW_TIP_AGE * 60 * 60;
 size_t nCoinCacheUsage = 5000 * 300;
+int64_t nMemoryBudget = 0;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -303,9 +373,26 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
 // CBlock and CBlockIndex
 //
 
+// Only the position is taken under cs_main (which is cheap when already held), the block is read without it.
+static CDiskBlockPos GetBlockPosForRead(const CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    return pindex->GetBlockPos();
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const CChainParams& params)
 {
-    return blockStore.ReadBlockFromDisk(block, pindex->GetBlockPos(), params, pindex);
+    return blockStore.ReadBlockFromDisk(block, GetBlockPosForRead(pindex), params, pindex);
+}
+
+bool ReadBlockPrefixFromDisk(CBlock& block, const CBlockIndex* pindex, unsigned int nMaxTransactions)
+{
+    return blockStore.ReadBlockPrefixFromDisk(block, GetBlockPosForRead(pindex), nMaxTransactions, pindex);
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CChainParams& params)
+{
+    return blockStore.ReadRawBlockFromDisk(block, GetBlockPosForRead(pindex), params.MessageStart());
 }
 
 
@@ -765,7 +852,7 @@ DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex,
 
 void static FlushBlockFile(bool fFinalize = false)
 {
-    LOCK(cs_LastBlockFile);
+    LOCK2(cs_LastBlockFile, blockStore.cs_blockstore);
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
@@ -793,6 +880,128 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** Closure representing a range of coins to read from the coins database ahead of ConnectBlock. */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsViewDB* view;
+    std::vector<COutPoint> outpoints;
+    Coin* coins;
+
+public:
+    CCoinsPrefetch() : view(nullptr), coins(nullptr) {}
+    CCoinsPrefetch(const CCoinsViewDB* viewIn, std::vector<COutPoint>&& outpointsIn, Coin* coinsIn) : view(viewIn), outpoints(std::move(outpointsIn)), coins(coinsIn) {}
+
+    bool operator()()
+    {
+        // Coins that can't be read are left spent; ConnectBlock then reads them again through the error catching view.
+        try {
+            std::vector<Coin> vCoins;
+            view->GetCoins(outpoints, vCoins);
+            std::move(vCoins.begin(), vCoins.end(), coins);
+        } catch (const std::exception&) {
+            for (size_t i = 0; i < outpoints.size(); ++i)
+                coins[i].Clear();
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetch& check)
+    {
+        std::swap(view, check.view);
+        outpoints.swap(check.outpoints);
+        std::swap(coins, check.coins);
+    }
+};
+
+//! Number of coins each prefetch reads together; the coins of a block are sorted first, so neighbouring coins mostly share table blocks.
+static const size_t COINS_PREFETCH_RANGE_SIZE = 32;
+
+//! Read latency is what we are hiding, so hand out one range at a time to get as many of them in flight as possible.
+static CCheckQueue<CCoinsPrefetch> coinsprefetchqueue(1);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("Gulden-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+/** Closure representing the context free checks (CheckTransaction) of one transaction of a block, see CheckBlock. */
+class CBlockTxCheck
+{
+private:
+    const CTransaction* tx;
+
+public:
+    CBlockTxCheck() : tx(nullptr) {}
+    CBlockTxCheck(const CTransaction* txIn) : tx(txIn) {}
+
+    bool operator()()
+    {
+        // Only the outcome is needed here; on failure CheckBlock repeats the checks serially to report the first failing transaction.
+        // Duplicate inputs are looked for over the whole block afterwards.
+        CValidationState state;
+        return CheckTransaction(*tx, state, false);
+    }
+
+    void swap(CBlockTxCheck& check)
+    {
+        std::swap(tx, check.tx);
+    }
+};
+
+static CCheckQueue<CBlockTxCheck> blockcheckqueue(16);
+
+void ThreadBlockCheck() {
+    RenameThread("Gulden-blockch");
+    blockcheckqueue.Thread();
+}
+
+/** Read the inputs of block that aren't in view yet from the coins database, in parallel, and add them to view; so that ConnectBlock finds them in memory. view has to be on top of pcoinsdbview with nothing in between that holds coins of its own. */
+static void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& view)
+{
+    AssertLockHeld(cs_main);
+    if (!fPrefetchCoins || !nScriptCheckThreads)
+        return;
+
+    std::set<uint256> setBlockTxHashes;
+    for (const auto& tx : block.vtx)
+        setBlockTxHashes.insert(tx->GetHash());
+
+    std::vector<COutPoint> vOutpoints;
+    for (const auto& tx : block.vtx)
+    {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin)
+        {
+            // Outputs created within the block aren't in the database; neither are outpoints that refer to a block position instead of a hash.
+            if (!txin.prevout.isHash || setBlockTxHashes.count(txin.prevout.getHash()) || view.HaveCoinInCache(txin.prevout))
+                continue;
+            vOutpoints.push_back(txin.prevout);
+        }
+    }
+    if (vOutpoints.empty())
+        return;
+
+    // Sorted by outpoint is the order of the coins in the database.
+    std::sort(vOutpoints.begin(), vOutpoints.end());
+    std::vector<Coin> vCoins(vOutpoints.size());
+    std::vector<CCoinsPrefetch> vChecks;
+    vChecks.reserve(vOutpoints.size() / COINS_PREFETCH_RANGE_SIZE + 1);
+    for (size_t i = 0; i < vOutpoints.size(); i += COINS_PREFETCH_RANGE_SIZE)
+    {
+        size_t nEnd = std::min(i + COINS_PREFETCH_RANGE_SIZE, vOutpoints.size());
+        vChecks.emplace_back(pcoinsdbview, std::vector<COutPoint>(vOutpoints.begin() + i, vOutpoints.begin() + nEnd), &vCoins[i]);
+    }
+    {
+        CCheckQueueControl<CCoinsPrefetch> control(&coinsprefetchqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < vOutpoints.size(); ++i)
+        view.AddPrefetchedCoin(vOutpoints[i], std::move(vCoins[i]));
+}
+
 /**
  * Threshold condition checker that triggers when unknown versionbits are seen on the network.
  */
@@ -828,11 +1037,21 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+// Protected by cs_main
+static std::deque<CBlockConnectStats> blockConnectStats;
+
+std::vector<CBlockConnectStats> GetBlockConnectStats(unsigned int nCount)
+{
+    LOCK(cs_main);
+    nCount = std::min<size_t>(nCount, blockConnectStats.size());
+    return std::vector<CBlockConnectStats>(blockConnectStats.end() - nCount, blockConnectStats.end());
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, bool fVerifyWitness)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, bool fVerifyWitness, CBlockConnectStats* pStats)
 {
     if (!ContextualCheckBlock(block, state, chainparams, pindex->pprev, chain, &view, true))
         return error("%s: Consensus::CheckBlock, failed ContextualCheckBlock with utxo check: %s", __func__, FormatStateMessage(state));
@@ -898,6 +1117,8 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
+    if (pStats)
+        pStats->nCheckMicros = nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -970,6 +1191,8 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
+    if (pStats)
+        pStats->nForksMicros = nTime2 - nTime1;
 
     CBlockUndo blockundo;
 
@@ -988,20 +1211,11 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
             CGetWitnessInfo witInfo;
             if (!GetWitness(chain, chainparams, &view, pindex->pprev, block, witInfo))
                 return state.DoS(100, false, REJECT_INVALID, "invalid-witness", false, "could not determine a valid witness for block");
-            if (witInfo.selectedWitnessTransaction.GetType() <= CTxOutType::ScriptLegacyOutput)
-            {
-                if (CKeyID(uint160(witInfo.selectedWitnessTransaction.output.scriptPubKey.GetPow2WitnessHash())) != pubkey.GetID())
-                    return state.DoS(100, false, REJECT_INVALID, "invalid-witness-signature", false, "script witness signature incorrect for block");
-            }
-            else if(witInfo.selectedWitnessTransaction.GetType() == CTxOutType::PoW2WitnessOutput)
-            {
-                if (witInfo.selectedWitnessTransaction.output.witnessDetails.witnessKeyID != pubkey.GetID())
-                    return state.DoS(100, false, REJECT_INVALID, "invalid-witness-signature", false, "witness signature incorrect for block");
-            }
-            else
-            {
+            CKeyID witnessKeyID;
+            if (!GetSelectedWitnessKeyID(witInfo, witnessKeyID))
                 return state.DoS(100, false, REJECT_INVALID, "invalid-witness-signature", false, "witness signature missing for block");
-            }
+            if (witnessKeyID != pubkey.GetID())
+                return state.DoS(100, false, REJECT_INVALID, "invalid-witness-signature", false, "witness signature incorrect for block");
         }
     }
 
@@ -1010,8 +1224,15 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
     //unsigned int nWitnessCoinbasePayoutIndex = nWitnessCoinbaseIndex + 1;
     //NB! This must occur before CCheckQueueControl to prevent CCheckQueueControl re-entrancy.
 
+    int64_t nTimeWitnessSig = GetTimeMicros();
     int nPoW2PhaseParent = GetPoW2Phase(pindex->pprev, chainparams, chain, &view);
     int nPoW2PhaseGrandParent = GetPoW2Phase(pindex->pprev->pprev, chainparams, chain, &view);
+    int64_t nTimePhase = GetTimeMicros();
+    if (pStats)
+    {
+        pStats->nWitnessSigMicros = nTimeWitnessSig - nTime2;
+        pStats->nPhaseMicros = nTimePhase - nTimeWitnessSig;
+    }
     //NB! IMPORTANT - Below this point we should -not- do any further Is/Get PoW2 phase checks - as we modify the view below which alters the results of phase 3 check.
     //Do and store all such tests above this point in the code.
 
@@ -1030,6 +1251,9 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
                 return state.DoS(100, error("ConnectBlock(): PoW2 phase 3 coinbase has invalid coinbase info)"), REJECT_INVALID, "bad-cb-badwitnessinfo");
         }
     }
+    int64_t nTimeWitnessCoinbase = GetTimeMicros();
+    if (pStats)
+        pStats->nWitnessCoinbaseMicros = nTimeWitnessCoinbase - nTimePhase;
     unsigned int nWitnessCoinbaseIndex = 0;
     if (nPoW2PhaseParent >= 3)
     {
@@ -1067,9 +1291,8 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
     CAmount nFeesPoW2Witness = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
+    int64_t nWitnessCountDelta = 0;
+    int64_t nWitnessWeightDelta = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -1159,11 +1382,35 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
-        vPos.push_back(std::pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        // Track how the witness set changes, for the running totals on the block index.
+        if (i > 0)
+        {
+            for (const auto& spentCoin : blockundo.vtxundo.back().vprevout)
+            {
+                if (IsPow2WitnessOutput(spentCoin.out))
+                {
+                    --nWitnessCountDelta;
+                    nWitnessWeightDelta -= GetPoW2RawWeightForOutput(spentCoin.out, spentCoin.nHeight);
+                }
+            }
+        }
+        for (const auto& out : tx.vout)
+        {
+            if (IsPow2WitnessOutput(out))
+            {
+                ++nWitnessCountDelta;
+                nWitnessWeightDelta += GetPoW2RawWeightForOutput(out, pindex->nHeight);
+            }
+        }
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
+    if (pStats)
+    {
+        pStats->nTx = block.vtx.size();
+        pStats->nInputs = nInputs;
+        pStats->nTxMicros = nTime3 - nTimeWitnessCoinbase;
+    }
 
     //fixme: (2.1) (CLEANUP) - We can remove this after 2.1 becomes active.
 
@@ -1281,45 +1528,68 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
         return state.DoS(100, error("ConnectBlock(): coinbase pays too little (actual=%d vs limit=%d)", actualBlockReward, expectedBlockReward), REJECT_INVALID, "bad-cb-amount");
     }
 
+    // Write the undo data while the script checks drain rather than after them; it only becomes referenced from the block index once the checks have passed.
+    CDiskBlockPos undoPos;
+    bool fWriteUndo = !fJustCheck && pindex->GetUndoPos().IsNull();
+    if (fWriteUndo)
+    {
+        if (!FindUndoPos(state, pindex->nFile, undoPos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            return error("ConnectBlock(): FindUndoPos failed");
+        if (!blockStore.UndoWriteToDisk(blockundo, undoPos, pindex->pprev->GetBlockHashPoW2(), chainparams.MessageStart()))
+            return AbortNode(state, "Failed to write undo data");
+    }
+
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
+    if (pStats)
+        pStats->nVerifyMicros = nTime4 - nTime3;
 
     if (fJustCheck)
         return true;
 
-    // Write undo information to disk
-    if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
+    // Memoise whether phase 4 is active for this block now, which is cheap as the parent already knows (see CBlockIndex::nPoW2Phase4Active).
+    IsPow2Phase4Active(pindex, chainparams, chain, &view);
+
+    // Running witness totals; there can be no witnesses before phase 2, otherwise they follow from those of the parent (if known).
+    if (pindex->nHeight < GetPhase2ActivationHeight())
+    {
+        pindex->nWitnessCount = 0;
+        pindex->nWitnessTotalWeight = 0;
+    }
+    else if (pindex->pprev && pindex->pprev->nWitnessTotalWeight >= 0)
     {
-        if (pindex->GetUndoPos().IsNull()) {
-            CDiskBlockPos _pos;
-            if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
-                return error("ConnectBlock(): FindUndoPos failed");
-            if (!blockStore.UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHashPoW2(), chainparams.MessageStart()))
-                return AbortNode(state, "Failed to write undo data");
+        pindex->nWitnessCount = pindex->pprev->nWitnessCount + nWitnessCountDelta;
+        pindex->nWitnessTotalWeight = pindex->pprev->nWitnessTotalWeight + nWitnessWeightDelta;
+    }
 
+    // Undo information was written to disk above
+    if (fWriteUndo || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
+    {
+        if (fWriteUndo) {
             // update nUndoPos in block index
-            pindex->nUndoPos = _pos.nPos;
+            pindex->nUndoPos = undoPos.nPos;
             pindex->nStatus |= BLOCK_HAVE_UNDO;
         }
 
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
-        if (chain == chainActive)
+        // Blocks connected on a temporary chain (see CCloneChain) share their entry with the block index, so it has to be written out as well.
+        // Temporary copies of an entry (which aren't in mapBlockIndex) must not end up in setDirtyBlockIndex though.
+        BlockMap::iterator mi = pindex->phashBlock ? mapBlockIndex.find(*pindex->phashBlock) : mapBlockIndex.end();
+        if (chain == chainActive || (mi != mapBlockIndex.end() && mi->second == pindex))
         {
             setDirtyBlockIndex.insert(pindex);
         }
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHashPoW2());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
+    if (pStats)
+        pStats->nIndexMicros = nTime5 - nTime4;
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
@@ -1333,6 +1603,120 @@ bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, C
  * if they're too large, if it's been a while since the last write,
  * or always and in all cases if we're in prune mode and are deleting files.
  */
+/**
+ * What the coins cache may grow to before it has to be flushed: its own share plus whatever of the mempool's is unused.
+ * With a -memorybudget the cache instead takes what the budget leaves after the mempool, the witness cache and checkedPoWCache
+ * take up right now during initial sync, when there is hardly a mempool and a larger cache means fewer flushes; near the tip
+ * it goes back to no more than its share, leaving the rest for the mempool and peers. When the system runs short of memory it
+ * is halved, rather than to have the system swap.
+ */
+static const char* CHAINSTATE_JOURNAL_FILENAME = "chainstate_journal.dat";
+static const uint64_t CHAINSTATE_JOURNAL_VERSION = 1;
+//! Whether the coin caches hold a journal taken in at startup, which has to stay on disk until they have been written to the databases.
+static bool fChainstateJournalLoaded = false;
+
+/** Write the modified entries of the coin and witness caches to the chainstate journal, on top of what the databases hold now. */
+static bool WriteChainstateJournal()
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+    // The journal goes on top of what the databases hold once the batch that is being written now is in.
+    if (!pcoinsdbview->WaitForBackgroundFlush() || !ppow2witdbview->WaitForBackgroundFlush())
+        return false;
+    if (!CheckDiskSpace(48 * 2 * (pcoinsTip->GetCacheSize() + ppow2witTip->GetCacheSize())))
+        return false;
+    fs::path pathNew = GetDataDir() / (std::string(CHAINSTATE_JOURNAL_FILENAME) + ".new");
+    try
+    {
+        CAutoFile file(fsbridge::fopen(pathNew, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: failed to open %s", __func__, pathNew.string());
+        file << CHAINSTATE_JOURNAL_VERSION << pcoinsdbview->GetBestBlock() << ppow2witdbview->GetBestBlock();
+        uint64_t nCoins = pcoinsTip->WriteJournal(file);
+        uint64_t nWitnessCoins = ppow2witTip->WriteJournal(file);
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathNew, GetDataDir() / CHAINSTATE_JOURNAL_FILENAME))
+            return error("%s: failed to rename %s", __func__, pathNew.string());
+        LogPrintf("Wrote %u coins and %u witness coins to the chainstate journal in %dms\n", nCoins, nWitnessCoins, GetTimeMillis() - nStart);
+    }
+    catch (const std::exception& e)
+    {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool LoadChainstateJournal()
+{
+    LOCK(cs_main);
+    fs::path path = GetDataDir() / CHAINSTATE_JOURNAL_FILENAME;
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+    int64_t nStart = GetTimeMillis();
+    try
+    {
+        uint64_t nVersion;
+        uint256 hashCoinsBase, hashWitnessBase;
+        file >> nVersion;
+        if (nVersion != CHAINSTATE_JOURNAL_VERSION)
+            throw std::runtime_error(strprintf("unknown version %u", nVersion));
+        file >> hashCoinsBase >> hashWitnessBase;
+        if (hashCoinsBase != pcoinsdbview->GetBestBlock() || hashWitnessBase != ppow2witdbview->GetBestBlock())
+        {
+            // The databases have been written since, so they hold more than the journal does already.
+            LogPrintf("%s: the chainstate journal was written on top of a different state, ignoring it\n", __func__);
+            return false;
+        }
+        uint64_t nCoins = pcoinsTip->ReadJournal(file);
+        uint64_t nWitnessCoins = ppow2witTip->ReadJournal(file);
+        LogPrintf("Loaded %u coins and %u witness coins from the chainstate journal in %dms\n", nCoins, nWitnessCoins, GetTimeMillis() - nStart);
+    }
+    catch (const std::exception& e)
+    {
+        // The databases are consistent by themselves, the blocks after their best block get connected again.
+        LogPrintf("%s: failed to read the chainstate journal (%s), ignoring it\n", __func__, e.what());
+        pcoinsTip->Discard();
+        ppow2witTip->Discard();
+        return false;
+    }
+    fChainstateJournalLoaded = true;
+    return true;
+}
+
+void RemoveChainstateJournal()
+{
+    LOCK(cs_main);
+    fs::remove(GetDataDir() / CHAINSTATE_JOURNAL_FILENAME);
+    fChainstateJournalLoaded = false;
+}
+
+static int64_t GetCoinsCacheSpace(int64_t nCacheSize, int64_t nMempoolUsage, int64_t nMempoolSizeMax)
+{
+    AssertLockHeld(cs_main);
+    int64_t nSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
+    if (nMemoryBudget <= 0)
+        return nSpace;
+
+    int64_t nOtherUsage = nMempoolUsage + ppow2witTip->DynamicMemoryUsage() + CheckedPoWCacheDynamicMemoryUsage() + nMemoryBudget / MEMORY_BUDGET_RESERVE_FRACTION;
+    int64_t nBudgetSpace = std::max<int64_t>(nMemoryBudget - nOtherUsage, nMinDbCache << 20);
+    nSpace = IsInitialBlockDownload() ? std::max(nSpace, nBudgetSpace) : std::min(nSpace, nBudgetSpace);
+
+    // Reading the available memory is a file read on some systems, once every few seconds is plenty.
+    static int64_t nLastAvailableCheck = 0;
+    static uint64_t nAvailable = 0;
+    int64_t nNow = GetTime();
+    if (nNow > nLastAvailableCheck + 5)
+    {
+        nAvailable = systemAvailableMemoryInBytes();
+        nLastAvailableCheck = nNow;
+    }
+    if (nAvailable > 0 && nAvailable < (uint64_t)MIN_AVAILABLE_SYSTEM_MEMORY)
+        nSpace = std::min(nSpace, std::max<int64_t>(nCacheSize / 2, nMinDbCache << 20));
+    return nSpace;
+}
+
 bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight) {
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     LOCK2(cs_main, cs_LastBlockFile);
@@ -1370,19 +1754,23 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
     }
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
-    int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
+    int64_t nTotalSpace = GetCoinsCacheSpace(cacheSize, nMempoolUsage, nMempoolSizeMax);
+    // Flushes that can wait are held back while LevelDB is so far behind with compacting the chainstate that it would slow the write down.
+    bool fCompactionBehind = mode == FLUSH_STATE_PERIODIC && (pcoinsdbview->IsCompactionBehind() || ppow2witdbview->IsCompactionBehind());
     // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
+    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && !fCompactionBehind && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
     // The cache is over the limit, we have to write now.
     bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
-    bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+    bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && !fCompactionBehind && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+    // Write the coin caches to the journal rather than the databases; files are only pruned once the databases have caught up.
+    bool fJournal = mode == FLUSH_STATE_JOURNAL && !fFlushForPrune;
     // Combine all conditions that result in a full cache flush.
-    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || (mode == FLUSH_STATE_JOURNAL && !fJournal) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
     // Write blocks and block index to disk.
-    if (fDoFullFlush || fPeriodicWrite) {
+    if (fDoFullFlush || fPeriodicWrite || fJournal) {
         // Depend on nMinDiskSpace to ensure we can write block index
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
@@ -1406,11 +1794,19 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
                 return AbortNode(state, "Failed to write to block index database");
             }
         }
-        // Finally remove any pruned files
-        if (fFlushForPrune)
+        // Finally remove any pruned files; not while a chainstate write is still in flight, a crash would then need them to catch up.
+        if (fFlushForPrune) {
+            if (!pcoinsdbview->WaitForBackgroundFlush() || !ppow2witdbview->WaitForBackgroundFlush())
+                return AbortNode(state, "Failed to write to coin database");
             blockStore.UnlinkPrunedFiles(setFilesToPrune);
+        }
         nLastWrite = nNow;
     }
+    if (fJournal && !WriteChainstateJournal()) {
+        LogPrintf("Failed to write the chainstate journal, flushing the coin caches instead\n");
+        fJournal = false;
+        fDoFullFlush = true;
+    }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
         // Typical Coin structures on disk are around 48 bytes in size.
@@ -1423,9 +1819,17 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        // Everything else can carry on while the databases are written, but an explicit flush (e.g. at shutdown) has to be on disk when it returns.
+        // So does one that makes a journal taken in at startup redundant, the journal can only go once the databases have what it holds.
+        if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_JOURNAL || fChainstateJournalLoaded) && (!pcoinsdbview->WaitForBackgroundFlush() || !ppow2witdbview->WaitForBackgroundFlush()))
+            return AbortNode(state, "Failed to write to coin database");
+        if (fChainstateJournalLoaded) {
+            fs::remove(GetDataDir() / CHAINSTATE_JOURNAL_FILENAME);
+            fChainstateJournalLoaded = false;
+        }
         nLastFlush = nNow;
     }
-    if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
+    if (fDoFullFlush || fJournal || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
         GetMainSignals().SetBestChain(chainActive.GetLocatorPoW2());
         nLastSetChain = nNow;
@@ -1436,12 +1840,27 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
     return true;
 }
 
+void CompactDatabasesIfIdle()
+{
+    if (nDBIdleCompact <= 0 || fImporting || fReindex || IsInitialBlockDownload())
+        return;
+    if (GetTime() < nTimeLastTipUpdate + nDBIdleCompact)
+        return;
+    CDBWrapper::CompactOpenDatabasesStep();
+}
+
 void FlushStateToDisk() {
     CValidationState state;
     const CChainParams& chainparams = Params();
     FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS);
 }
 
+void FlushStateToJournal() {
+    CValidationState state;
+    const CChainParams& chainparams = Params();
+    FlushStateToDisk(chainparams, state, FLUSH_STATE_JOURNAL);
+}
+
 void PruneAndFlush() {
     CValidationState state;
     fCheckForPruning = true;
@@ -1463,6 +1882,8 @@ static void DoWarning(const std::string& strWarning)
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    nTimeLastTipUpdate = GetTime();
+    PublishChainStatus(chainParams);
 
     // New best block
     mempool.AddTransactionsUpdated(1);
@@ -1553,6 +1974,9 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         CCoinsViewCache view(pcoinsTip);
         if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHashPoW2().ToString());
+        if (view.pChainedWitView)
+            witnessSetIndex.BlockFlushed(pcoinsTip->GetBestBlock(), view.GetBestBlock(), *view.pChainedWitView);
+        witnessSelectionCache.Erase(pindexDelete->GetBlockHashPoW2());
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -1583,6 +2007,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -1676,10 +2101,16 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
+    CBlockConnectStats stats;
+    stats.nHeight = pindexNew->nHeight;
+    stats.hash = pindexNew->GetBlockHashPoW2();
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchBlockInputs(blockConnecting, *pcoinsTip);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
     {
         CCoinsViewCache view(pcoinsTip);
         bool fJustCheck = false;
@@ -1694,15 +2125,18 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         // So this is not really a major weakening of security in any way and still more than sufficient.
         if (((unsigned int)pindexNew->nHeight < Checkpoints::LastCheckPointHeight()))
             fValidateWitness = false;
-        bool rv = ConnectBlock(chainActive, blockConnecting, state, pindexNew, view, chainparams, fJustCheck, fValidateWitness);
+        bool rv = ConnectBlock(chainActive, blockConnecting, state, pindexNew, view, chainparams, fJustCheck, fValidateWitness, &stats);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHashPoW2().ToString());
         }
-        nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
-        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTimePrefetched;
+        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTimePrefetched) * 0.001, nTimeConnectTotal * 0.000001);
+        if (view.pChainedWitView)
+            witnessSetIndex.BlockFlushed(pcoinsTip->GetBestBlock(), view.GetBestBlock(), *view.pChainedWitView);
+        stats.nWitnessFlushMicros = GetTimeMicros() - nTime3;
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -1723,6 +2157,17 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
 
+    stats.nReadMicros = nTime2 - nTime1;
+    stats.nPrefetchMicros = nTimePrefetched - nTime2;
+    stats.nConnectBlockMicros = nTime3 - nTimePrefetched;
+    stats.nFlushMicros = nTime4 - nTime3 - stats.nWitnessFlushMicros;
+    stats.nChainStateMicros = nTime5 - nTime4;
+    stats.nPostConnectMicros = nTime6 - nTime5;
+    stats.nTotalMicros = nTime6 - nTime1;
+    blockConnectStats.push_back(stats);
+    if (blockConnectStats.size() > BLOCK_CONNECT_STATS_HISTORY)
+        blockConnectStats.pop_front();
+
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
@@ -1944,6 +2389,19 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
             pindexFork = chainActive.FindFork(pindexOldTip);
             fInitialDownload = IsInitialBlockDownload();
 
+            // The phase of either tip is cached in its index after the first time, so this is cheap.
+            if (pindexNewTip != pindexOldTip)
+            {
+                int nPhaseNew = GetPoW2Phase(pindexNewTip, chainparams, chainActive);
+                if (pindexOldTip)
+                {
+                    int nPhaseOld = GetPoW2Phase(pindexOldTip, chainparams, chainActive);
+                    if (nPhaseOld != nPhaseNew)
+                        GetMainSignals().PoW2PhaseChanged(pindexNewTip, nPhaseOld, nPhaseNew);
+                }
+                PublishChainStatus(chainparams, nPhaseNew);
+            }
+
             for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
                 assert(trace.pblock && trace.pindex);
                 GetMainSignals().BlockConnected(trace.pblock, trace.pindex, *trace.conflictedTxs);
@@ -2155,8 +2613,8 @@ static CBlockIndex* AddToBlockIndex(const CChainParams& chainParams, const CBloc
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexSlabs.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2185,7 +2643,10 @@ static CBlockIndex* AddToBlockIndex(const CChainParams& chainParams, const CBloc
 
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    {
         pindexBestHeader = pindexNew;
+        PublishHeaderTip(pindexBestHeader);
+    }
 
     setDirtyBlockIndex.insert(pindexNew);
 
@@ -2287,6 +2748,7 @@ static bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned i
             if (fPruneMode)
                 fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
+                LOCK(blockStore.cs_blockstore);
                 FILE *file = blockStore.GetBlockFile(pos);
                 if (file) {
                     LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
@@ -2319,6 +2781,7 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
         if (fPruneMode)
             fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
+            LOCK(blockStore.cs_blockstore);
             FILE *file = blockStore.GetUndoFile(pos);
             if (file) {
                 LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
@@ -2332,25 +2795,70 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     return true;
 }
 
-static bool CheckBlockHeader(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+void SetPoWVerifiedBeforeReindex(std::unordered_set<uint256, BlockHasher>&& setHashes)
+{
+    LOCK(cs_powVerifiedBeforeReindex);
+    setPoWVerifiedBeforeReindex = std::move(setHashes);
+    fHavePoWVerifiedBeforeReindex = !setPoWVerifiedBeforeReindex.empty();
+}
+
+void ClearPoWVerifiedBeforeReindex()
 {
+    LOCK(cs_powVerifiedBeforeReindex);
+    fHavePoWVerifiedBeforeReindex = false;
+    std::unordered_set<uint256, BlockHasher>().swap(setPoWVerifiedBeforeReindex);
+}
+
+bool HavePoWVerifiedBeforeReindex()
+{
+    return fHavePoWVerifiedBeforeReindex;
+}
+
+static bool IsPoWVerifiedBeforeReindex(const uint256& blockHash)
+{
+    if (!fHavePoWVerifiedBeforeReindex)
+        return false;
+    LOCK(cs_powVerifiedBeforeReindex);
+    return setPoWVerifiedBeforeReindex.count(blockHash) > 0;
+}
+
+// pfPoWFullyVerified (if given) is set when the PoW is known to have been fully verified, as opposed to only partially (-sigmapartialverify) or not at all.
+static bool CheckBlockHeader(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool* pfPoWFullyVerified = nullptr)
+{
+    if (pfPoWFullyVerified)
+        *pfPoWFullyVerified = false;
+
     // Check proof of work matches claimed amount
     if (fCheckPOW) {
         uint256 blockHash = block.GetHashLegacy();
         
         //fixme: (PHASE5) We can probably remove this after phase4
         //Avoid unnecessary extra checkpow computation on witness blocks as they contain the exact same pow as their non-witness counterparts.
-        if (checkedPoWCache.contains(blockHash))
-            return checkedPoWCache.get(blockHash);
+        //Results of batch verification (see ProcessNewBlockHeaders) are also picked up here.
+        uint8_t nPoWResult;
+        if (checkedPoWCache.tryGet(blockHash, nPoWResult))
+        {
+            // Checked before, possibly by another thread.
+        }
+        else if (IsPoWVerifiedBeforeReindex(blockHash))
+        {
+            // Already verified by us before the block index was wiped for -reindex.
+            nPoWResult = POW_CHECK_FULL;
+        }
+        else
+        {
+            bool fFullyVerified;
+            nPoWResult = !CheckProofOfWork(&block, consensusParams, &fFullyVerified) ? POW_CHECK_FAILED : (fFullyVerified ? POW_CHECK_FULL : POW_CHECK_PARTIAL);
+            checkedPoWCache.insert(blockHash, nPoWResult);
+        }
 
         // Nested if statement for easier breakpoint management
-        if (!CheckProofOfWork(&block, consensusParams))
+        if (nPoWResult == POW_CHECK_FAILED)
         {
-            checkedPoWCache.insert(blockHash, false);
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
         }
-        
-        checkedPoWCache.insert(blockHash, true);
+        if (pfPoWFullyVerified)
+            *pfPoWFullyVerified = (nPoWResult == POW_CHECK_FULL);
     }
     
     return true;
@@ -2401,10 +2909,22 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
         if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "block contains excess coinbase transactions");
 
+    // Start on the transaction checks in the background while the merkle roots are computed here.
+    bool fParallelChecks = nScriptCheckThreads && block.vtx.size() > 1;
+    CCheckQueueControl<CBlockTxCheck> control(fParallelChecks ? &blockcheckqueue : NULL);
+    if (fParallelChecks)
+    {
+        std::vector<CBlockTxCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx)
+            vChecks.emplace_back(tx.get());
+        control.Add(vChecks);
+    }
+
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block.vtx.begin(), (nWitnessCoinbaseIndex == 0 ? block.vtx.end() : block.vtx.begin()+nWitnessCoinbaseIndex), &mutated);
+        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, 0, (nWitnessCoinbaseIndex == 0 ? block.vtx.size() : nWitnessCoinbaseIndex), &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(100, false, REJECT_INVALID, "bad-txnmrklroot", true, "hashMerkleRoot mismatch");
 
@@ -2416,7 +2936,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 
         if (block.nVersionPoW2Witness != 0)
         {
-            uint256 hashMerkleRoot3 = BlockMerkleRoot(block.vtx.begin()+nWitnessCoinbaseIndex, block.vtx.end(), &mutated);
+            uint256 hashMerkleRoot3 = BlockMerkleRoot(block, nWitnessCoinbaseIndex, block.vtx.size(), &mutated);
             if (block.hashMerkleRootPoW2Witness != hashMerkleRoot3)
                 return state.DoS(100, false, REJECT_INVALID, "bad-txnmrklroot", true, "pow2 witness hashMerkleRoot mismatch");
 
@@ -2429,10 +2949,17 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     }
 
     // Check transactions
-    for (const auto& tx : block.vtx)
-        if (!CheckTransaction(*tx, state, true))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    if (!fParallelChecks || !control.Wait())
+    {
+        for (const auto& tx : block.vtx)
+            if (!CheckTransaction(*tx, state, false))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    }
+
+    // Inputs spent twice, within a transaction or across transactions, with one sort over all of them.
+    if (!CheckBlockDuplicateInputs(block.vtx, state))
+        return false;
 
     unsigned int nSigOps = 0;
     for (const auto& tx : block.vtx)
@@ -2705,7 +3232,31 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CC
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fAssumePOWGood = false)
+// Returns true if the header is a hard coded checkpoint or the current sync checkpoint.
+static bool IsCheckpointHeader(const CBlockHeader& block, const uint256& hash, int nHeight, const CChainParams& chainparams)
+{
+    const MapCheckpoints& checkpoints = chainparams.Checkpoints().mapCheckpoints;
+    auto checkpoint = checkpoints.find(nHeight);
+    if (checkpoint != checkpoints.end() && checkpoint->second == hash)
+        return true;
+
+    LOCK(Checkpoints::cs_hashSyncCheckpoint);
+    return !Checkpoints::hashSyncCheckpoint.IsNull() && block.GetHashLegacy() == Checkpoints::hashSyncCheckpoint;
+}
+
+// A checkpoint commits to all its ancestors, so any of them still waiting on it (or that predate BLOCK_POW_VERIFIED) need never have their PoW verified.
+static void MarkCheckpointAncestorsPoWVerified(CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+
+    for (; pindex && !(pindex->nStatus & BLOCK_POW_VERIFIED) && *pindex->phashBlock != consensusParams.hashGenesisBlock; pindex = pindex->pprev)
+    {
+        pindex->nStatus = (pindex->nStatus & ~BLOCK_POW_PENDING_CHECKPOINT) | BLOCK_POW_VERIFIED;
+        setDirtyBlockIndex.insert(pindex);
+    }
+}
+
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fAssumePOWGood = false, bool fPendingCheckpoint = false)
 {
     AssertLockHeld(cs_main);
 
@@ -2715,6 +3266,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     uint256 hash = block.GetHashPoW2();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
+    bool fPoWFullyVerified = false;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
 
         if (miSelf != mapBlockIndex.end()) {
@@ -2729,7 +3281,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 
         // CheckBlockHeader can take long so temporarily relinquish the lock to avoid freezing the UI
         LEAVE_CRITICAL_SECTION(cs_main);
-        bool blockHeaderIsValid = CheckBlockHeader(block, state, chainparams.GetConsensus(), !fAssumePOWGood);
+        bool blockHeaderIsValid = CheckBlockHeader(block, state, chainparams.GetConsensus(), !fAssumePOWGood && !fPendingCheckpoint, &fPoWFullyVerified);
         ENTER_CRITICAL_SECTION(cs_main);
         if (!blockHeaderIsValid)
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
@@ -2751,8 +3303,26 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
     if (pindex == NULL)
+    {
         pindex = AddToBlockIndex(chainparams, block);
 
+        // Record that the PoW has been verified so that it never has to be verified again (e.g. after a restart or -reindex-chainstate).
+        // A partial SIGMA verify can be fooled by a 'half valid' hash so isn't recorded, such a header gets verified again on the next -reindex.
+        if (fPendingCheckpoint)
+        {
+            pindex->nStatus |= BLOCK_POW_PENDING_CHECKPOINT;
+            setDirtyBlockIndex.insert(pindex);
+        }
+        else if (!fAssumePOWGood && fPoWFullyVerified)
+        {
+            pindex->nStatus |= BLOCK_POW_VERIFIED;
+            setDirtyBlockIndex.insert(pindex);
+        }
+
+        if (fCheckpointsEnabled && IsCheckpointHeader(block, hash, pindex->nHeight, chainparams))
+            MarkCheckpointAncestorsPoWVerified(pindex, chainparams.GetConsensus());
+    }
+
     if (ppindex)
         *ppindex = pindex;
 
@@ -2762,21 +3332,221 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 }
 
 // Exposed wrapper for AcceptBlockHeader
+// Number of leading headers that form an unbroken chain from a known block up to and including a checkpoint (hard coded or the sync checkpoint).
+// Their PoW is committed to by that checkpoint, so only their linkage (and contextual checks) need to be verified; headers after the last
+// checkpoint reached in the batch, or in a batch that reaches none, have their PoW verified as usual.
+static size_t CountCheckpointAnchoredHeaders(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fCheckpointsEnabled || !fAssumeCheckpointPoW || headers.empty())
+        return 0;
+
+    BlockMap::iterator mi = mapBlockIndex.find(headers[0].hashPrevBlock);
+    if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_FAILED_MASK))
+        return 0;
+
+    const MapCheckpoints& checkpoints = chainparams.Checkpoints().mapCheckpoints;
+    int nLastCheckpointHeight = checkpoints.empty() ? 0 : checkpoints.rbegin()->first;
+    uint256 hashSyncCheckpoint;
+    {
+        LOCK(Checkpoints::cs_hashSyncCheckpoint);
+        hashSyncCheckpoint = Checkpoints::hashSyncCheckpoint;
+    }
+
+    // Headers beyond the last checkpoint are only covered if the sync checkpoint lies further on in this batch.
+    size_t nSyncCheckpointIndex = 0;
+    bool fHaveSyncCheckpoint = false;
+    if (!hashSyncCheckpoint.IsNull())
+    {
+        for (size_t i = 0; i < headers.size(); ++i)
+        {
+            if (headers[i].GetHashLegacy() == hashSyncCheckpoint)
+            {
+                nSyncCheckpointIndex = i;
+                fHaveSyncCheckpoint = true;
+            }
+        }
+    }
+
+    int nHeight = mi->second->nHeight;
+    uint256 hashPrev = headers[0].hashPrevBlock;
+    size_t nAnchored = 0;
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        const CBlockHeader& header = headers[i];
+        ++nHeight;
+        if (header.hashPrevBlock != hashPrev)
+            break;
+        if (nHeight > nLastCheckpointHeight && !(fHaveSyncCheckpoint && i <= nSyncCheckpointIndex))
+            break;
+        hashPrev = header.GetHashPoW2();
+        // A header that conflicts with a checkpoint will never be committed to by it, leave it (and its descendants) to full verification.
+        auto checkpoint = checkpoints.find(nHeight);
+        if (checkpoint != checkpoints.end() && checkpoint->second != hashPrev)
+            break;
+        if (checkpoint != checkpoints.end() || (fHaveSyncCheckpoint && i == nSyncCheckpointIndex))
+            nAnchored = i + 1;
+    }
+    return nAnchored;
+}
+
+enum class SampledPoW
+{
+    VERIFY,     // Verify now, as usual
+    BACKGROUND, // Accept now, verify later in VerifySampledPoWBatch
+    SKIP        // Accept on linkage and difficulty alone
+};
+
+static SampledPoW GetSampledPoWPolicy(const CBlockHeader& header)
+{
+    // The tip is what the wallet acts on, so recent headers are always verified.
+    if (nSamplePoW <= 0 || header.nTime <= defaultSigmaSettings.activationDate || header.GetBlockTime() >= GetAdjustedTime() - nSamplePoWTipAge)
+        return SampledPoW::VERIFY;
+    // Keyed with a secret so that a peer can't grind headers that avoid the sample.
+    static const uint64_t k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    static const uint64_t k1 = GetRand(std::numeric_limits<uint64_t>::max());
+    uint256 hash = header.GetHashLegacy();
+    uint64_t nSample = CSipHasher(k0, k1).Write(hash.begin(), hash.size()).Finalize();
+    return (nSample % nSamplePoW == 0) ? SampledPoW::BACKGROUND : SampledPoW::SKIP;
+}
+
+// Sampled headers, and headers left waiting on a checkpoint that never came, waiting for VerifySampledPoWBatch, oldest first.
+static std::deque<uint256> queueSampledPoW GUARDED_BY(cs_main);
+
+// Verify the PoW of headers accepted without it, marking them verified or invalidating them (and their descendants). Returns whether any got invalidated.
+static bool VerifyUncheckedPoW(const std::vector<CBlockIndex*>& vIndex, const char* strReason)
+{
+    std::vector<CBlockHeader> vHeaders;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex : vIndex)
+            vHeaders.push_back(pindex->GetBlockHeader());
+    }
+    std::vector<bool> results;
+    std::vector<bool> fullyVerified;
+    CheckProofOfWorkBatch(vHeaders, Params().GetConsensus(), results, &fullyVerified);
+
+    bool fInvalidated = false;
+    LOCK(cs_main);
+    for (size_t i = 0; i < vIndex.size(); ++i)
+    {
+        if (vIndex[i]->nStatus & BLOCK_FAILED_MASK)
+            continue;
+        if (results[i])
+        {
+            // Passing a partial verify is good enough to no longer wait on the checkpoint, but not to never verify again.
+            vIndex[i]->nStatus &= ~BLOCK_POW_PENDING_CHECKPOINT;
+            if (fullyVerified[i])
+                vIndex[i]->nStatus |= BLOCK_POW_VERIFIED;
+            setDirtyBlockIndex.insert(vIndex[i]);
+        }
+        else
+        {
+            LogPrintf("%s: %s header %s (height %d) failed proof of work, invalidating it and its descendants\n", __func__, strReason, vIndex[i]->GetBlockHashPoW2().ToString(), vIndex[i]->nHeight);
+            CValidationState state;
+            InvalidateBlock(state, Params(), vIndex[i]);
+            fInvalidated = true;
+        }
+    }
+    return fInvalidated;
+}
+
+void VerifySampledPoWBatch()
+{
+    std::vector<CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        while (!queueSampledPoW.empty() && vIndex.size() < SAMPLE_POW_BATCH_SIZE)
+        {
+            BlockMap::iterator mi = mapBlockIndex.find(queueSampledPoW.front());
+            queueSampledPoW.pop_front();
+            if (mi != mapBlockIndex.end() && !(mi->second->nStatus & (BLOCK_POW_VERIFIED | BLOCK_FAILED_MASK)))
+                vIndex.push_back(mi->second);
+        }
+    }
+    if (vIndex.empty())
+        return;
+
+    if (VerifyUncheckedPoW(vIndex, "sampled"))
+    {
+        CValidationState state;
+        ActivateBestChain(state, Params());
+    }
+}
+
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, bool fAssumePOWGood)
 {
+    size_t nAnchored = 0;
+    if (!fAssumePOWGood)
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        nAnchored = CountCheckpointAnchoredHeaders(headers, chainparams);
+    }
+
+    std::vector<SampledPoW> vSampled(headers.size(), SampledPoW::VERIFY);
+    if (!fAssumePOWGood && nSamplePoW > 0)
+    {
+        for (size_t i = nAnchored; i < headers.size(); ++i)
+            vSampled[i] = GetSampledPoWPolicy(headers[i]);
+    }
+
+    // Verify the PoW of all previously unseen headers in parallel and without holding cs_main.
+    // The results are placed in checkedPoWCache so that AcceptBlockHeader below doesn't have to repeat the (expensive) check serially.
+    if (!fAssumePOWGood && headers.size() - nAnchored > 1)
+    {
+        std::vector<CBlockHeader> uncheckedHeaders;
+        {
+            LOCK(cs_main);
+            for (size_t i = nAnchored; i < headers.size(); ++i)
+            {
+                const CBlockHeader& header = headers[i];
+                if (vSampled[i] == SampledPoW::VERIFY && mapBlockIndex.count(header.GetHashPoW2()) == 0 && !checkedPoWCache.contains(header.GetHashLegacy()))
+                    uncheckedHeaders.push_back(header);
+            }
+        }
+        if (uncheckedHeaders.size() > 1)
+        {
+            std::vector<bool> powResults;
+            std::vector<bool> powFullyVerified;
+            CheckProofOfWorkBatch(uncheckedHeaders, chainparams.GetConsensus(), powResults, &powFullyVerified);
+
+            LOCK(cs_main);
+            for (unsigned int i = 0; i < uncheckedHeaders.size(); ++i)
+            {
+                checkedPoWCache.insert(uncheckedHeaders[i].GetHashLegacy(), !powResults[i] ? POW_CHECK_FAILED : (powFullyVerified[i] ? POW_CHECK_FULL : POW_CHECK_PARTIAL));
+            }
+        }
+    }
+
+    // Headers accepted on the strength of the checkpoint at the end of the anchored run, for as long as that checkpoint hasn't been accepted.
+    std::vector<CBlockIndex*> vPendingCheckpoint;
+    bool fAccepted = true;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); ++i) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex, fAssumePOWGood)) {
-                return false;
+            bool fNew = mapBlockIndex.count(header.GetHashPoW2()) == 0;
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, fAssumePOWGood || vSampled[i] != SampledPoW::VERIFY, i < nAnchored)) {
+                fAccepted = false;
+                break;
             }
+            if (fNew && vSampled[i] == SampledPoW::BACKGROUND)
+                queueSampledPoW.push_back(header.GetHashPoW2());
+            if (fNew && i < nAnchored)
+                vPendingCheckpoint.push_back(pindex);
+            if (i + 1 == nAnchored)
+                vPendingCheckpoint.clear();
             if (ppindex) {
                 *ppindex = pindex;
             }
         }
     }
-    return true;
+    // The run broke off before its checkpoint, so nothing vouches for the PoW of the headers already accepted from it; verify it now.
+    if (!vPendingCheckpoint.empty())
+        VerifyUncheckedPoW(vPendingCheckpoint, "checkpoint anchored");
+    return fAccepted;
 }
 
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
@@ -2840,15 +3610,30 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        // Blocks that are already on disk (reindex) keep whatever format they were stored in.
+        std::vector<unsigned char> blockData;
+        unsigned int nDiskSize;
         CDiskBlockPos blockPos;
         if (dbp != NULL)
+        {
             blockPos = *dbp;
-        if (!FindBlockPos(state, blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != NULL))
+            nDiskSize = blockStore.GetBlockDiskSize(blockPos);
+            if (nDiskSize == 0)
+                return error("AcceptBlock(): GetBlockDiskSize failed");
+        }
+        else
+        {
+            nDiskSize = blockStore.PrepareBlockForDisk(block, blockData);
+        }
+        if (!FindBlockPos(state, blockPos, nDiskSize, nHeight, block.GetBlockTime(), dbp != NULL))
             return error("AcceptBlock(): FindBlockPos failed");
         if (dbp == NULL)
-            if (!blockStore.WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+        {
+            if (!blockStore.WriteBlockToDisk(blockData, blockPos, chainparams.MessageStart()))
                 AbortNode(state, "Failed to write block");
+            // Connecting it and the witness code will want it right back.
+            blockStore.CacheBlock(blockPos, pblock);
+        }
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
     } catch (const std::runtime_error& e) {
@@ -2976,6 +3761,29 @@ void PruneOneBlockFile(const int fileNumber)
     setDirtyFileInfo.insert(fileNumber);
 }
 
+/**
+ * The highest block height that pruning may remove the block file of. Besides the MIN_BLOCKS_TO_KEEP blocks below the tip, the blocks from
+ * just below the fork point of every chain with at least the work of the active one are kept, however far down that is: switching to such a
+ * chain, and the witness checks of its blocks (which connect the fork on a clone of the active chain), disconnect the active chain down to
+ * the fork, which takes its blocks and undo data. Negative if nothing may be pruned.
+ * Only chains whose blocks have been validated count (setBlockIndexCandidates), not mere headers such as pindexBestHeader: those cost
+ * nothing but the PoW, which may not even have been checked yet, so a peer could otherwise stall pruning with them.
+ */
+static int GetLastHeightToPrune()
+{
+    AssertLockHeld(cs_main);
+    int nLastHeight = chainActive.Tip()->nHeight - (int)MIN_BLOCKS_TO_KEEP;
+    for (const CBlockIndex* pindex : setBlockIndexCandidates)
+    {
+        if (pindex->nStatus & BLOCK_FAILED_MASK)
+            continue;
+        const CBlockIndex* pindexFork = chainActive.FindFork(pindex);
+        if (pindexFork && pindexFork != chainActive.Tip())
+            nLastHeight = std::min(nLastHeight, pindexFork->nHeight - (int)MIN_BLOCKS_TO_KEEP_BELOW_FORK - 1);
+    }
+    return nLastHeight;
+}
+
 /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
 void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
 {
@@ -2985,8 +3793,11 @@ void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeig
     if (chainActive.Tip() == NULL)
         return;
 
-    // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
-    unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
+    // last block to prune is the lesser of (user-specified height, what the tip and competing chains need kept)
+    int nLastHeightToPrune = GetLastHeightToPrune();
+    if (nLastHeightToPrune < 0)
+        return;
+    unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, (unsigned)nLastHeightToPrune);
     int count=0;
     for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
         if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
@@ -3015,7 +3826,8 @@ void PruneBlockFilesManual(int nManualPruneHeight)
  * Pruning functions are called from FlushStateToDisk when the global fCheckForPruning flag has been set.
  * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.)
  * Pruning cannot take place until the longest chain is at least a certain length (100000 on mainnet, 1000 on testnet, 1000 on regtest).
- * Pruning will never delete a block within a defined distance (currently 288) from the active chain's tip.
+ * Pruning will never delete a block within a defined distance (currently 288) from the active chain's tip,
+ * nor one that switching to a competing chain with at least as much work would need (see GetLastHeightToPrune).
  * The block index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks that were stored in the deleted files.
  * A db flag records the fact that at least some block files have been pruned.
  *
@@ -3031,7 +3843,11 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
         return;
     }
 
-    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+    int nLastHeightToPrune = GetLastHeightToPrune();
+    if (nLastHeightToPrune < 0) {
+        return;
+    }
+    unsigned int nLastBlockWeCanPrune = nLastHeightToPrune;
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
@@ -3050,7 +3866,7 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
             if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
                 break;
 
-            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
+            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip or that a competing chain needs, but keep scanning
             if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
@@ -3090,9 +3906,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexSlabs.Allocate();
     mi = mapBlockIndex.insert(std::pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3161,7 +3975,11 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
             pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
+        // Still waiting on a checkpoint from an earlier run, which may never come; have the PoW verified in the background instead.
+        if ((pindex->nStatus & BLOCK_POW_PENDING_CHECKPOINT) && !(pindex->nStatus & (BLOCK_POW_VERIFIED | BLOCK_FAILED_MASK)))
+            queueSampledPoW.push_back(pindex->GetBlockHashPoW2());
     }
+    PublishHeaderTip(pindexBestHeader);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -3208,15 +4026,12 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainStatus(chainparams);
 
     PruneBlockIndexCandidates();
 
@@ -3291,10 +4106,11 @@ bool UpgradeBlockIndex(const CChainParams& chainparams, int nPreviousVersion, in
 
                 // Write block out using new transaction format.
                 {
-                    unsigned int nSize = ::GetSerializeSize(*pblock, SER_DISK, CLIENT_VERSION);
+                    std::vector<unsigned char> blockData;
+                    unsigned int nDiskSize = blockStore.PrepareBlockForDisk(*pblock, blockData);
                     CValidationState state;
-                    FindBlockPos(state, blockpos, nSize+8, pindex->nHeight, pblock->GetBlockTime());
-                    if (!blockStore.WriteBlockToDisk(*pblock, blockpos, chainparams.MessageStart()))
+                    FindBlockPos(state, blockpos, nDiskSize, pindex->nHeight, pblock->GetBlockTime());
+                    if (!blockStore.WriteBlockToDisk(blockData, blockpos, chainparams.MessageStart()))
                         return error("UpgradeBlockIndex: WriteBlockToDisk: failed");
                     pindex->nFile = blockpos.nFile;
                     pindex->nDataPos = blockpos.nPos;
@@ -3358,97 +4174,201 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100);
 }
 
-bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
+//! Number of blocks VerifyDB reads and checks in parallel before it goes over them in order.
+static const size_t VERIFYDB_BATCH_SIZE = 32;
+
+bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth, bool fSkipVerified)
 {
-    LOCK(cs_main); // Required for ReadBlockFromDisk.
-    if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
-        return true;
+    // The blocks to verify, tip first; with whether an earlier complete verification already did their check levels 0 to 2.
+    std::vector<CBlockIndex*> vBlocks;
+    std::vector<bool> vVerifiedBefore;
+    size_t nVerifiedBefore = 0;
+    CBlockIndex* pindexTip;
+    CVerifiedChain verified;
+    bool fHaveVerified = false;
+    int nLowestHeight;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        if (pindexTip == NULL || pindexTip->pprev == NULL)
+            return true;
+
+        // Verify blocks in the best chain
+        if (nCheckDepth <= 0)
+            nCheckDepth = 1000000000; // suffices until the year 19000
+        if (nCheckDepth > chainActive.Height())
+            nCheckDepth = chainActive.Height();
+        nCheckLevel = std::max(0, std::min(4, nCheckLevel));
+        LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+
+        // Don't repeat the per block checks (levels 0 to 2) an earlier complete verification did at this level or a higher one; the checks of the
+        // coin database against the blocks (levels 3 and 4) are always done as that is what an unclean shutdown might have left inconsistent.
+        // Nor trust the record at all if the last run didn't shut down cleanly, the block files might not have been flushed either.
+        if (fSkipVerified)
+        {
+            bool fCleanShutdown = false;
+            if (pblocktree->ReadFlag("cleanshutdown", fCleanShutdown) && fCleanShutdown && pblocktree->ReadVerifiedChain(verified))
+            {
+                BlockMap::iterator it = mapBlockIndex.find(verified.hashTip);
+                fHaveVerified = it != mapBlockIndex.end() && chainActive.Contains(it->second) && verified.nLevel >= std::min(nCheckLevel, 2);
+            }
+            // Until Shutdown says otherwise.
+            pblocktree->WriteFlag("cleanshutdown", false);
+        }
+        nLowestHeight = pindexTip->nHeight;
+        for (CBlockIndex* pindex = pindexTip; pindex && pindex->pprev; pindex = pindex->pprev)
+        {
+            if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+                break;
+            if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                // If pruning, only go back as far as we have data.
+                LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+                break;
+            }
+            nLowestHeight = pindex->nHeight;
+            bool fVerifiedBefore = fHaveVerified && pindex->nHeight <= verified.nHeight && pindex->nHeight >= verified.nLowestHeight;
+            vBlocks.push_back(pindex);
+            vVerifiedBefore.push_back(fVerifiedBefore);
+            nVerifiedBefore += fVerifiedBefore;
+        }
+        if (nVerifiedBefore > 0)
+            LogPrintf("VerifyDB(): skipping the block checks of %u blocks verified before\n", nVerifiedBefore);
+    }
 
-    // Verify blocks in the best chain
-    if (nCheckDepth <= 0)
-        nCheckDepth = 1000000000; // suffices until the year 19000
-    if (nCheckDepth > chainActive.Height())
-        nCheckDepth = chainActive.Height();
-    nCheckLevel = std::max(0, std::min(4, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CCoinsViewCache coins(coinsview);
-    CBlockIndex* pindexState = chainActive.Tip();
+    CBlockIndex* pindexState = pindexTip;
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
-    CValidationState state;
     int reportDone = 0;
+    const int nThreads = std::max(1, nScriptCheckThreads);
     LogPrintf("[0%%]...");
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    for (size_t nBatch = 0; nBatch < vBlocks.size(); nBatch += VERIFYDB_BATCH_SIZE)
     {
         boost::this_thread::interruption_point();
-        int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
-        if (reportDone < percentageDone/10) {
-            // report every 10% step
-            LogPrintf("[%d%%]...", percentageDone);
-            reportDone = percentageDone/10;
-        }
-        uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
-            break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
-            break;
+        const size_t nBatchEnd = std::min(nBatch + VERIFYDB_BATCH_SIZE, vBlocks.size());
+        std::vector<CBlock> vBlock(nBatchEnd - nBatch);
+        std::vector<std::string> vError(nBatchEnd - nBatch);
+        // Blocks verified before only need reading while level 3 is still going (it stops at the first block it can't disconnect).
+        const bool fDisconnecting = nCheckLevel >= 3 && pindexState == vBlocks[nBatch];
+        std::vector<bool> vRead(nBatchEnd - nBatch);
+        for (size_t i = nBatch; i < nBatchEnd; ++i)
+            vRead[i - nBatch] = !vVerifiedBefore[i] || fDisconnecting;
+
+        // Check levels 0 to 2 don't depend on the chain state, so the blocks of the batch go through them in parallel; without
+        // holding cs_main, which reading them takes.
+        std::atomic<size_t> nNext(nBatch);
+        auto checkBlocks = [&]()
+        {
+            for (size_t i = nNext++; i < nBatchEnd; i = nNext++)
+            {
+                if (!vRead[i - nBatch])
+                    continue;
+                const CBlockIndex* pindex = vBlocks[i];
+                CBlock& block = vBlock[i - nBatch];
+                CValidationState state;
+                // check level 0: read from disk
+                if (!ReadBlockFromDisk(block, pindex, chainparams))
+                    vError[i - nBatch] = strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
+                else if (vVerifiedBefore[i])
+                    continue;
+                // check level 1: verify block validity
+                else if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
+                    vError[i - nBatch] = strprintf("found bad block at %d, hash=%s (%s)", pindex->nHeight, pindex->GetBlockHashPoW2().ToString(), FormatStateMessage(state));
+                // check level 2: verify undo validity
+                else if (nCheckLevel >= 2) {
+                    CBlockUndo undo;
+                    CDiskBlockPos pos = pindex->GetUndoPos();
+                    if (!pos.IsNull() && !blockStore.UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHashPoW2()))
+                        vError[i - nBatch] = strprintf("found bad undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
+                }
+            }
+        };
+        std::vector<std::thread> vThreads;
+        for (int i = 1; i < nThreads && (size_t)i < nBatchEnd - nBatch; ++i)
+            vThreads.emplace_back(checkBlocks);
+        checkBlocks();
+        for (auto& thread : vThreads)
+            thread.join();
+
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexTip) {
+            LogPrintf("VerifyDB(): the chain changed while it was verified, stopping at height %d\n", vBlocks[nBatch]->nHeight);
+            return true;
         }
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                         pindex->nHeight, pindex->GetBlockHashPoW2().ToString(), FormatStateMessage(state));
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!blockStore.UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHashPoW2()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
-            }
-        }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            DisconnectResult res = DisconnectBlock(block, pindex, coins);
-            if (res == DISCONNECT_FAILED) {
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
-            }
-            pindexState = pindex->pprev;
-            if (res == DISCONNECT_UNCLEAN) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else {
-                nGoodTransactions += block.vtx.size();
+        for (size_t i = nBatch; i < nBatchEnd; ++i)
+        {
+            CBlockIndex* pindex = vBlocks[i];
+            const CBlock& block = vBlock[i - nBatch];
+            int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
+            if (reportDone < percentageDone/10) {
+                // report every 10% step
+                LogPrintf("[%d%%]...", percentageDone);
+                reportDone = percentageDone/10;
+            }
+            uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
+            if (!vError[i - nBatch].empty())
+                return error("VerifyDB(): *** %s", vError[i - nBatch]);
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            if (nCheckLevel >= 3 && vRead[i - nBatch] && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+                DisconnectResult res = DisconnectBlock(block, pindex, coins);
+                if (res == DISCONNECT_FAILED) {
+                    return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
+                }
+                pindexState = pindex->pprev;
+                if (res == DISCONNECT_UNCLEAN) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else {
+                    nGoodTransactions += block.vtx.size();
+                }
             }
         }
         if (ShutdownRequested())
             return true;
     }
     if (pindexFailure)
-        return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
+        return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", pindexTip->nHeight - pindexFailure->nHeight + 1, nGoodTransactions);
 
     // check level 4: try reconnecting blocks
     if (nCheckLevel >= 4) {
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexTip) {
+            LogPrintf("VerifyDB(): the chain changed while it was verified, not reconnecting blocks\n");
+            return true;
+        }
         CBlockIndex *pindex = pindexState;
-        while (pindex != chainActive.Tip()) {
+        while (pindex != pindexTip) {
             boost::this_thread::interruption_point();
             uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))));
             pindex = chainActive.Next(pindex);
             CBlock block;
+            CValidationState state;
             if (!ReadBlockFromDisk(block, pindex, chainparams))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
+            // The temporary view sits directly on the coin database when verifying at startup, its inputs can be fetched ahead then.
+            if (coinsview == pcoinsdbview)
+                PrefetchBlockInputs(block, coins);
             if (!ConnectBlock(chainActive, block, state, pindex, coins, chainparams))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHashPoW2().ToString());
         }
     }
 
     LogPrintf("[DONE].\n");
-    LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
+    LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", pindexTip->nHeight - pindexState->nHeight, nGoodTransactions);
+
+    if (fSkipVerified)
+    {
+        // Only the per block checks are skipped the next time, so that is all that is recorded.
+        CVerifiedChain newVerified;
+        newVerified.hashTip = pindexTip->GetBlockHashPoW2();
+        newVerified.nHeight = pindexTip->nHeight;
+        newVerified.nLowestHeight = nLowestHeight;
+        newVerified.nLevel = std::min(nCheckLevel, 2);
+        if (fHaveVerified && verified.nHeight >= nLowestHeight - 1)
+            newVerified.nLowestHeight = std::min(nLowestHeight, verified.nLowestHeight);
+        if (!pblocktree->WriteVerifiedChain(newVerified))
+            LogPrintf("VerifyDB(): failed to record the verified blocks\n");
+    }
 
     return true;
 }
@@ -3544,6 +4464,27 @@ bool RewindBlockIndex(const CChainParams& params)
 // May NOT be used after any connections are up as much
 // of the peer-processing logic assumes a consistent
 // block index state
+size_t BlockIndexDynamicMemoryUsage()
+{
+    AssertLockHeld(cs_main);
+    size_t nUsage = memusage::DynamicUsage(mapBlockIndex) + blockIndexSlabs.DynamicMemoryUsage();
+    for (const auto& entry : mapBlockIndex)
+    {
+        const CBlockIndex* pindex = entry.second;
+        if (!blockIndexSlabs.Owns(pindex))
+            nUsage += memusage::MallocUsage(sizeof(CBlockIndex));
+        if (pindex->witnessHeader)
+            nUsage += memusage::DynamicUsage(pindex->witnessHeader) + memusage::DynamicUsage(pindex->witnessHeader->witnessHeaderPoW2Sig);
+    }
+    return nUsage;
+}
+
+size_t CheckedPoWCacheDynamicMemoryUsage()
+{
+    // All slots are allocated up front, so this doesn't change with the number of entries.
+    return memusage::MallocUsage(checkedPoWCache.SlotBytes());
+}
+
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
@@ -3551,6 +4492,7 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    PublishChainStatus(Params(), 1);
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -3559,14 +4501,20 @@ void UnloadBlockIndex()
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     versionbitscache.Clear();
+    witnessSetIndex.Clear();
+    witnessSelectionCache.Clear();
+    witnessExpiryQueue.Clear();
+    witnessPoolPrecompute.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
     }
 
     for(BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
+        if (!blockIndexSlabs.Owns(entry.second))
+            delete entry.second;
     }
     mapBlockIndex.clear();
+    blockIndexSlabs.Clear();
     fHavePruned = false;
 }
 
@@ -3586,9 +4534,6 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (chainActive.Genesis() != NULL)
         return true;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -3596,12 +4541,13 @@ bool InitBlockIndex(const CChainParams& chainparams)
         try {
             CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            std::vector<unsigned char> blockData;
+            unsigned int nDiskSize = blockStore.PrepareBlockForDisk(block, blockData);
             CDiskBlockPos blockPos;
             CValidationState state;
-            if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
+            if (!FindBlockPos(state, blockPos, nDiskSize, 0, block.GetBlockTime()))
                 return error("LoadBlockIndex(): FindBlockPos failed");
-            if (!blockStore.WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!blockStore.WriteBlockToDisk(blockData, blockPos, chainparams.MessageStart()))
                 return error("LoadBlockIndex(): writing genesis block to disk failed");
             CBlockIndex *pindex = AddToBlockIndex(chainparams, block);
             if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
@@ -3635,124 +4581,156 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+void ReadBlocksFromFile(const CChainParams& chainparams, FILE* fileIn, const std::function<bool(const std::shared_ptr<CBlock>&, uint64_t)>& f)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
-
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        bool fCompressed = false;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            fCompressed = (nSize & BLOCK_FRAME_COMPRESSED) != 0;
+            nSize &= ~BLOCK_FRAME_COMPRESSED;
+            if (nSize < (fCompressed ? 8 : 80) || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            CBlock& block = *pblock;
+            if (fCompressed)
+            {
+                std::vector<unsigned char> compressed(nSize);
+                blkdat.read((char*)compressed.data(), nSize);
+                std::vector<unsigned char> blockData;
+                if (!CBlockStore::DecompressBlockFrame(compressed.data(), compressed.size(), blockData))
+                    throw std::ios_base::failure("corrupt compressed block");
+                CMemoryReader(SER_DISK, CLIENT_VERSION, blockData.data(), blockData.size()) >> block;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
+            else
+            {
                 blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHashPoW2();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+            }
+            nRewind = blkdat.GetPos();
+            if (!f(pblock, nBlockPos))
+                break;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+}
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    bool fAssumePOWGood=false;
-                    //This check is expensive
-                    //Bypass with a small random chance of still checking IFF we are below the checkpoint heights.
-                    //Note: an attacker would still have to meet/break/forge the sha ppev hash checks for an entire chain from the checkpoints
-                    // This is enough to ensure that an attacker would have to go to great lengths for what would amount to a minor nuisance (having to refetch some data after detecting wrong chain)
-                    // So this is not really a major weakening of security in any way and still more than sufficient.
-                    if (((unsigned int)mapBlockIndex.find(block.hashPrevBlock)->second->nHeight < Checkpoints::LastCheckPointHeight()))
-                    {
-                        fAssumePOWGood = true;
-                    }
-                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL, fAssumePOWGood))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
+/** Accept a block read from an external file or, for reindexing, from the block files (dbp is its position then). Returns false to stop loading. */
+static bool ProcessExternalBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, CDiskBlockPos* dbp, int& nLoaded)
+{
+    const CBlock& block = *pblock;
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        {
-                            LOCK(cs_main); // acquire cs_main here to protect ReadBlockFromDisk
-                            if (blockStore.ReadBlockFromDisk(*pblockrecursive, it->second, chainparams))
-                            {
-                                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHashPoW2().ToString(),
-                                        head.ToString());
-                                CValidationState dummy;
-                                if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
-                                {
-                                    nLoaded++;
-                                    queue.push_back(pblockrecursive->GetHashPoW2());
-                                }
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHashPoW2();
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        bool fAssumePOWGood=false;
+        //This check is expensive
+        //Bypass with a small random chance of still checking IFF we are below the checkpoint heights.
+        //Note: an attacker would still have to meet/break/forge the sha ppev hash checks for an entire chain from the checkpoints
+        // This is enough to ensure that an attacker would have to go to great lengths for what would amount to a minor nuisance (having to refetch some data after detecting wrong chain)
+        // So this is not really a major weakening of security in any way and still more than sufficient.
+        if (((unsigned int)mapBlockIndex.find(block.hashPrevBlock)->second->nHeight < Checkpoints::LastCheckPointHeight()))
+        {
+            fAssumePOWGood = true;
+        }
+        if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL, fAssumePOWGood))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            {
+                LOCK(cs_main); // acquire cs_main here to protect ReadBlockFromDisk
+                if (blockStore.ReadBlockFromDisk(*pblockrecursive, it->second, chainparams))
+                {
+                    LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHashPoW2().ToString(),
+                            head.ToString());
+                    CValidationState dummy;
+                    if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
+                    {
+                        nLoaded++;
+                        queue.push_back(pblockrecursive->GetHashPoW2());
                     }
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
         }
+    }
+    return true;
+}
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        ReadBlocksFromFile(chainparams, fileIn, [&](const std::shared_ptr<CBlock>& pblock, uint64_t nBlockPos) {
+            if (dbp)
+                dbp->nPos = nBlockPos;
+            return ProcessExternalBlock(chainparams, pblock, dbp, nLoaded);
+        });
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -3761,6 +4739,79 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     return nLoaded > 0;
 }
 
+/** A block read from a block file ahead of being reindexed. */
+struct CReindexBlock
+{
+    std::shared_ptr<CBlock> block;
+    CDiskBlockPos pos;
+};
+
+void ReindexBlockFiles(const CChainParams& chainparams)
+{
+    // Decoding the blocks (which includes hashing their transactions) is spread over a few threads, each working on a block file of its own a
+    // few files ahead of the one being processed; accepting them into the block index is done here, in file order as before.
+    const size_t nScanThreads = std::max(1, std::min(GetNumCores(), MAX_REINDEX_SCAN_THREADS));
+    std::deque<std::pair<int, std::future<std::vector<CReindexBlock>>>> scans;
+    int nNextFile = 0;
+    bool fMoreFiles = true;
+    while (true) {
+        while (fMoreFiles && scans.size() < nScanThreads) {
+            FILE* file;
+            CDiskBlockPos pos(nNextFile, 0);
+            {
+                LOCK(cs_main);
+                FILE* tmpfile = blockStore.BlockFileExists(pos) ? blockStore.GetBlockFile(pos, true) : NULL;
+                if (!tmpfile) {
+                    // No block files left to reindex (or an error, which is logged in OpenBlockFile)
+                    fMoreFiles = false;
+                    break;
+                }
+                // dupping here because otherwise the cs_main might be locked for a long time
+                file = fdopen(dup(fileno(tmpfile)), "rb+");
+            }
+            int nFile = nNextFile++;
+            scans.emplace_back(nFile, std::async(std::launch::async, [&chainparams, file, nFile]() {
+                std::vector<CReindexBlock> blocks;
+                try {
+                    ReadBlocksFromFile(chainparams, file, [&](const std::shared_ptr<CBlock>& pblock, uint64_t nBlockPos) {
+                        blocks.push_back(CReindexBlock{pblock, CDiskBlockPos(nFile, nBlockPos)});
+                        return !ShutdownRequested();
+                    });
+                } catch (const std::runtime_error& e) {
+                    AbortNode(std::string("System error: ") + e.what());
+                }
+                return blocks;
+            }));
+        }
+        if (scans.empty())
+            break;
+
+        int nFile = scans.front().first;
+        std::vector<CReindexBlock> blocks = scans.front().second.get();
+        scans.pop_front();
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        int64_t nStart = GetTimeMillis();
+        int nLoaded = 0;
+        try {
+            for (CReindexBlock& reindexBlock : blocks) {
+                boost::this_thread::interruption_point();
+                try {
+                    if (!ProcessExternalBlock(chainparams, reindexBlock.block, &reindexBlock.pos, nLoaded))
+                        break;
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
+                // Done with it, keep only what is still ahead in memory.
+                reindexBlock.block.reset();
+            }
+        } catch (const std::runtime_error& e) {
+            AbortNode(std::string("System error: ") + e.what());
+        }
+        if (nLoaded > 0)
+            LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    }
+}
+
 void static CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -3965,7 +5016,9 @@ public:
         // block headers
         BlockMap::iterator it1 = mapBlockIndex.begin();
         for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+            if (!blockIndexSlabs.Owns((*it1).second))
+                delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexSlabs.Clear();
     }
 } instance_of_cmaincleanup;
@@ -27,10 +27,12 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include "consensus/tx_verify.h"
@@ -39,8 +41,8 @@
 #include <atomic>
 
 #include "uint256.h"
+#include "clockcache.h"
 
-#include <LRUCache/LRUCache11.hpp>
 
 class CBlockIndex;
 class CBlockTreeDB;
@@ -66,7 +68,9 @@ enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
-    FLUSH_STATE_ALWAYS
+    FLUSH_STATE_ALWAYS,
+    //! As FLUSH_STATE_ALWAYS, but with the coin and witness caches written to the chainstate journal instead of their databases.
+    FLUSH_STATE_JOURNAL
 };
 
 /** Default for accepting alerts from the P2P network. */
@@ -109,8 +113,25 @@ static const int64_t DUST_HARD_LIMIT = 1000;   // 0.00001 NLG mininput
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -prefetchcoins default, read the inputs of a block into the coins cache in parallel before connecting it */
+static const bool DEFAULT_PREFETCH_COINS = true;
+/** Default for -blockarena, read the transactions of blocks into one arena per block */
+static const bool DEFAULT_BLOCK_ARENA = true;
+/** Default for -memorybudget, the memory in MiB to divide between the caches, mempool and peers (0 = each by its own option) */
+static const int64_t DEFAULT_MEMORY_BUDGET = 0;
+/** Part of -memorybudget held back for peers, the block index and everything else that isn't measured */
+static const int64_t MEMORY_BUDGET_RESERVE_FRACTION = 8;
+/** Below this much memory available to the system, the coins cache is flushed and kept small */
+static const int64_t MIN_AVAILABLE_SYSTEM_MEMORY = 64 * 1024 * 1024;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** Number of blocks requested at a time from a peer that hasn't delivered any yet, and the fewest for one that did. */
+static const int INITIAL_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** A peer gets as many blocks in transit as it delivered in this many seconds so far (within the bounds above). */
+static const int64_t BLOCK_DOWNLOAD_TARGET_SECONDS = 10;
+/** A block in transit is requested from another peer instead once that peer is expected to deliver it this many times sooner. */
+static const int64_t BLOCK_REREQUEST_SPEEDUP = 2;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -127,10 +148,18 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum number of block files decoded at the same time while reindexing. */
+static const int MAX_REINDEX_SCAN_THREADS = 4;
+/** Number of recently connected blocks of which the connect timings are kept, see GetBlockConnectStats. */
+static const unsigned int BLOCK_CONNECT_STATS_HISTORY = 100;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** -dbidlecompact default: seconds without a new tip after which the databases are compacted bit by bit, 0 to leave it to LevelDB */
+static const int64_t DEFAULT_DB_IDLE_COMPACT = 30;
+/** Time (in milliseconds) between the parts of the databases compacted while idle, see CompactDatabasesIfIdle. */
+static const int64_t DB_IDLE_COMPACT_INTERVAL = 2000;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -159,10 +188,20 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -assumecheckpointpow */
+static const bool DEFAULT_ASSUME_CHECKPOINT_POW = true;
+/** Default for -samplepow, 0 = verify the proof of work of every header */
+static const int64_t DEFAULT_SAMPLE_POW = 0;
+/** Default for -samplepowtipage (in hours), headers younger than this are always verified in full when sampling */
+static const int64_t DEFAULT_SAMPLE_POW_TIP_AGE = 48;
+/** Maximum number of sampled headers verified per background batch */
+static const unsigned int SAMPLE_POW_BATCH_SIZE = 16;
 static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -fastshutdown, write the coin caches to a journal at shutdown instead of to the chainstate */
+static const bool DEFAULT_FAST_SHUTDOWN = false;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -202,12 +241,24 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern bool fReverseHeaders;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
+/** Prefetch the inputs of blocks that are about to be connected, using the same number of threads as script verification */
+extern bool fPrefetchCoins;
+/** Read blocks from disk and from peers with their transactions in a CTransactionArena (-blockarena) */
+extern bool fBlockArena;
+/** Seconds without a new tip after which the databases are compacted, 0 to never do so (-dbidlecompact) */
+extern int64_t nDBIdleCompact;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Skip PoW verification of headers that link up to a known checkpoint (see ProcessNewBlockHeaders) */
+extern bool fAssumeCheckpointPoW;
+/** Light client verification: only one in nSamplePoW SIGMA headers older than nSamplePoWTipAge seconds has its PoW verified, in the background (0 = off; see ProcessNewBlockHeaders) */
+extern int64_t nSamplePoW;
+extern int64_t nSamplePoWTipAge;
 extern size_t nCoinCacheUsage;
+/** -memorybudget in bytes; when set the coins cache grows into whatever of it the rest doesn't use during initial sync */
+extern int64_t nMemoryBudget;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -220,8 +271,23 @@ extern bool fEnableReplacement;
 /** Block hash whose ancestors we will assume to have valid scripts without checking them. */
 extern uint256 hashAssumeValid;
 
-/** Cache to prevent repeated calls of same expensive CheckProofOfWork in certain situations */
-inline lru11::Cache<uint256, bool, lru11::NullLock, std::unordered_map<uint256, typename std::list<lru11::KeyValuePair<uint256, bool>>::iterator, BlockHasher>> checkedPoWCache(2000, 100);
+/** Outcome of a CheckProofOfWork as remembered by checkedPoWCache; only a full verify may be persisted as BLOCK_POW_VERIFIED. */
+enum PoWCheckResult : uint8_t
+{
+    POW_CHECK_FAILED = 0,
+    POW_CHECK_PARTIAL = 1, //!< passed a partial SIGMA verify (-sigmapartialverify)
+    POW_CHECK_FULL = 2
+};
+
+/** Cache to prevent repeated calls of same expensive CheckProofOfWork in certain situations; sharded with a lock per shard as headers are checked in parallel without cs_main */
+inline CClockCache<uint256, uint8_t, BlockHasher> checkedPoWCache(2048);
+
+/** Remember the legacy hashes of headers that had BLOCK_POW_VERIFIED set in the block index before it was wiped for -reindex, so that the reindex can skip re-verifying their PoW. */
+void SetPoWVerifiedBeforeReindex(std::unordered_set<uint256, BlockHasher>&& setHashes);
+/** Forget the hashes set by SetPoWVerifiedBeforeReindex, once the reindex is done. */
+void ClearPoWVerifiedBeforeReindex();
+/** Whether any hashes set by SetPoWVerifiedBeforeReindex are (still) remembered. */
+bool HavePoWVerifiedBeforeReindex();
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
@@ -240,6 +306,8 @@ extern bool fPruneMode;
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Nor will block files with a block less than this far below the fork point of a chain that could become the active one; the deepest any witness check clones the chain below a fork (see GetPow2ValidationCloneHeight). */
+static const unsigned int MIN_BLOCKS_TO_KEEP_BELOW_FORK = 10;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
@@ -286,21 +354,50 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  * @param[in]  chainparams The params for the chain we want to connect to
  * @param[in]  fAssumePOWGood A boolean to indicate that the POW can be assumed to be correct
  * @param[out] ppindex If set, the pointer will be set to point to the last new block index object for the given headers
+ *
+ * With -assumecheckpointpow the leading run of headers that links up unbroken from a known block to a checkpoint in the same batch
+ * is accepted without PoW verification (flagged BLOCK_POW_PENDING_CHECKPOINT), once the checkpoint itself is accepted its ancestors
+ * are marked BLOCK_POW_VERIFIED as the checkpoint hash commits to them. Should the batch fail before the checkpoint, the PoW of the
+ * headers already accepted from the run is verified after all.
+ *
+ * With -samplepow SIGMA headers older than -samplepowtipage are accepted on their linkage and difficulty alone, a random sample
+ * of them is queued for background verification by VerifySampledPoWBatch (and the branch invalidated should one fail).
  */
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=NULL, bool fAssumePOWGood = false);
 
+/** Verify the PoW of the next batch of headers queued by -samplepow, meant to be called periodically from the scheduler */
+void VerifySampledPoWBatch();
+
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
+/**
+ * Decode the blocks in fileIn (block files, bootstrap.dat and the like: blocks framed by the message start and their size), skipping anything
+ * that doesn't decode. f is called with each block and its position in the file, and returns false to stop.
+ * Doesn't touch any global state, so several files can be read at once. Takes over fileIn and closes it.
+ */
+void ReadBlocksFromFile(const CChainParams& chainparams, FILE* fileIn, const std::function<bool(const std::shared_ptr<CBlock>&, uint64_t)>& f);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
+/** Rebuild the block index from the block files (-reindex), decoding a few files ahead in parallel */
+void ReindexBlockFiles(const CChainParams& chainparams);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
+/** Memory used by the block index (the map and its entries); requires cs_main */
+size_t BlockIndexDynamicMemoryUsage();
+/** Memory used by checkedPoWCache */
+size_t CheckedPoWCacheDynamicMemoryUsage();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block transaction checking thread, see CheckBlock */
+void ThreadBlockCheck();
+/** Run an instance of the coins prefetching thread */
+void ThreadCoinsPrefetch();
+/** Compact the next part of the databases if the tip hasn't changed for nDBIdleCompact seconds; run from the scheduler */
+void CompactDatabasesIfIdle();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -325,6 +422,15 @@ void PruneOneBlockFile(const int fileNumber);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/**
+ * As FlushStateToDisk, but leave the chainstate databases as they are and write what the coin caches hold on top of them to a
+ * journal, which is quicker when the caches are large. LoadChainstateJournal takes it back into the caches at the next start.
+ */
+void FlushStateToJournal();
+/** Take what a FlushStateToJournal left into the (empty) coin caches; returns false if there is no journal or it doesn't fit the databases. */
+bool LoadChainstateJournal();
+/** Remove the chainstate journal, for when the chainstate databases are rebuilt. */
+void RemoveChainstateJournal();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -336,6 +442,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/**
+ * Verify the scripts of a burst of transactions all at once, on the executor, ahead of accepting them one by one; which then finds
+ * the signatures in the signature cache. Only the transactions whose inputs are all in the chain or the mempool already are checked,
+ * nothing is added to the mempool. Requires cs_main.
+ */
+void PreverifyTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& txs);
+
+/**
+ * Accept txs to the memory pool as AcceptToMemoryPool would, in order, after their scripts were verified by PreverifyTransactions.
+ * states (and pvMissingInputs) are filled with the outcome for each; returns how many were accepted.
+ */
+size_t AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, std::vector<CValidationState>& states, bool fLimitFree,
+                               std::vector<bool>* pvMissingInputs=nullptr);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -416,8 +536,12 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
-/** Functions for disk access for blocks */
+/** Functions for disk access for blocks; these don't need cs_main (see CBlockStore) */
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const CChainParams& params);
+/** Header and first nMaxTransactions transactions of the block at pindex, see CBlockStore::ReadBlockPrefixFromDisk. */
+bool ReadBlockPrefixFromDisk(CBlock& block, const CBlockIndex* pindex, unsigned int nMaxTransactions);
+/** Serialised block at pindex as stored on disk, see CBlockStore::ReadRawBlockFromDisk. */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CChainParams& params);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -438,7 +562,9 @@ class CVerifyDB {
 public:
     CVerifyDB();
     ~CVerifyDB();
-    bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
+    //! With fSkipVerified the per block checks (levels 0 to 2) of the blocks an earlier complete verification covered at the same level or higher are left out, unless
+    //! the last run didn't shut down cleanly; the blocks verified are recorded for the next time. Levels 3 and 4 are always done.
+    bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth, bool fSkipVerified = false);
 };
 
 /** Find the last common block between the parameter chain and a locator. */
@@ -532,10 +658,45 @@ enum DisconnectResult
  *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state. */
 DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
 
+/** Time spent in each phase of connecting a block to the active chain, in microseconds. */
+struct CBlockConnectStats
+{
+    int nHeight = 0;
+    uint256 hash;
+    unsigned int nTx = 0;
+    unsigned int nInputs = 0;
+    // ConnectTip
+    int64_t nReadMicros = 0;
+    int64_t nPrefetchMicros = 0;
+    //! All of ConnectBlock, which the phases below break down.
+    int64_t nConnectBlockMicros = 0;
+    int64_t nWitnessFlushMicros = 0;
+    int64_t nFlushMicros = 0;
+    int64_t nChainStateMicros = 0;
+    int64_t nPostConnectMicros = 0;
+    int64_t nTotalMicros = 0;
+    // ConnectBlock
+    int64_t nCheckMicros = 0;
+    int64_t nForksMicros = 0;
+    //! Witness header signature, including the GetWitness lookup of the expected witness.
+    int64_t nWitnessSigMicros = 0;
+    int64_t nPhaseMicros = 0;
+    //! Validation of the witness coinbase embedded in a phase 3 coinbase.
+    int64_t nWitnessCoinbaseMicros = 0;
+    int64_t nTxMicros = 0;
+    //! Reward checks, writing the undo data and waiting for the script checks.
+    int64_t nVerifyMicros = 0;
+    int64_t nIndexMicros = 0;
+};
+
+/** Timings of the last nCount (at most BLOCK_CONNECT_STATS_HISTORY) blocks connected to the active chain, oldest first. */
+std::vector<CBlockConnectStats> GetBlockConnectStats(unsigned int nCount);
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
-bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, bool fVerifyWitness=true);
+ *  can fail if those validity checks fail (among other reasons).
+ *  The time spent in each phase is added to pStats, if given. */
+bool ConnectBlock(CChain& chain, const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, bool fVerifyWitness=true, CBlockConnectStats* pStats=nullptr);
 
 /** Context-dependent validity checks.
  *  By "context", we mean only the previous block headers, but not the UTXO
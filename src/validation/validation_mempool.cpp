@@ -29,8 +29,12 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "chainparams.h"
+#include "executor.h"
+
+#include <algorithm>
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 256;
 
 static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     int expired = pool.Expire(GetTime() - age);
@@ -562,6 +566,116 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee);
 }
 
+namespace {
+// A transaction of PreverifyTransactions with the coins it spends; the checks point into it, so it stays put.
+struct CPreverifiedTransaction
+{
+    explicit CPreverifiedTransaction(const CTransaction& tx) : view(&dummy), txdata(tx) {}
+
+    CCoinsView dummy;
+    CCoinsViewCache view;
+    PrecomputedTransactionData txdata;
+    std::vector<CScriptCheck> checks;
+};
+}
+
+void PreverifyTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& txs)
+{
+    AssertLockHeld(cs_main);
+    if (txs.size() < 2)
+        return;
+
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard())
+        scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+
+    // Cheap and serial: the context free checks, and gathering the inputs and the checks under the locks.
+    std::vector<std::unique_ptr<CPreverifiedTransaction>> preverified;
+    {
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        for (const CTransactionRef& ptx : txs)
+        {
+            const CTransaction& tx = *ptx;
+            if (tx.IsCoinBase() || pool.exists(tx.GetHash()))
+                continue;
+            CValidationState state;
+            std::vector<CWitnessTxBundle> witnessBundles;
+            if (!CheckTransaction(tx, state) || !CheckTransactionContextual(tx, state, chainActive.Tip()->nHeight, &witnessBundles))
+                continue;
+
+            std::unique_ptr<CPreverifiedTransaction> item(new CPreverifiedTransaction(tx));
+            item->view.SetBackend(viewMemPool);
+            std::vector<COutPoint> coinsToUncache;
+            bool fHaveInputs = true;
+            for (const CTxIn& txin : tx.vin)
+            {
+                if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                    coinsToUncache.push_back(txin.prevout);
+                if (!item->view.HaveCoin(txin.prevout))
+                {
+                    // Spends one of the others (or nothing); left to AcceptToMemoryPool.
+                    fHaveInputs = false;
+                    break;
+                }
+            }
+            item->view.GetBestBlock();
+            item->view.SetBackend(item->dummy);
+            if (fHaveInputs && CheckInputs(tx, state, item->view, true, scriptVerifyFlags, true, item->txdata, &witnessBundles, &item->checks))
+            {
+                preverified.push_back(std::move(item));
+            }
+            else
+            {
+                for (const COutPoint& outpoint : coinsToUncache)
+                    pcoinsTip->Uncache(outpoint);
+            }
+        }
+    }
+
+    // The signatures, all at once; valid ones end up in the signature cache, failures are found again (and reported) by AcceptToMemoryPool.
+    CTaskGroup group(GetExecutor(), EXECUTOR_VALIDATION);
+    for (const auto& item : preverified)
+    {
+        CPreverifiedTransaction* pItem = item.get();
+        group.Run([pItem]()
+        {
+            for (CScriptCheck& check : pItem->checks)
+            {
+                if (!check())
+                    break;
+            }
+        });
+    }
+    group.Wait();
+}
+
+static size_t AcceptToMemoryPoolBatchWithTime(const CChainParams& chainparams, CTxMemPool& pool, const std::vector<CTransactionRef>& txs, const std::vector<int64_t>& vAcceptTime,
+                                              std::vector<CValidationState>& states, bool fLimitFree, std::vector<bool>* pvMissingInputs)
+{
+    PreverifyTransactions(pool, txs);
+
+    size_t nAccepted = 0;
+    states.assign(txs.size(), CValidationState());
+    if (pvMissingInputs)
+        pvMissingInputs->assign(txs.size(), false);
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        bool fMissingInputs = false;
+        if (AcceptToMemoryPoolWithTime(chainparams, pool, states[i], txs[i], fLimitFree, &fMissingInputs, vAcceptTime[i], nullptr, false, 0))
+            ++nAccepted;
+        if (pvMissingInputs)
+            (*pvMissingInputs)[i] = fMissingInputs;
+    }
+    return nAccepted;
+}
+
+size_t AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, std::vector<CValidationState>& states, bool fLimitFree, std::vector<bool>* pvMissingInputs)
+{
+    AssertLockHeld(cs_main);
+    return AcceptToMemoryPoolBatchWithTime(Params(), pool, txs, std::vector<int64_t>(txs.size(), GetTime()), states, fLimitFree, pvMissingInputs);
+}
+
 bool LoadMempool(void)
 {
     const CChainParams& chainparams = Params();
@@ -586,6 +700,11 @@ bool LoadMempool(void)
         }
         uint64_t num;
         file >> num;
+        const uint64_t nTotal = num;
+        int64_t nLastProgress = GetTimeMillis();
+        // Accepted in batches, so that their scripts are verified in parallel.
+        std::vector<CTransactionRef> batch;
+        std::vector<int64_t> batchTimes;
         while (num--) {
             CTransactionRef tx;
             int64_t nTime;
@@ -598,18 +717,25 @@ bool LoadMempool(void)
             if (amountdelta) {
                 mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
-            CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, true, NULL, nTime, NULL, false, 0);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
-                }
+                batch.push_back(tx);
+                batchTimes.push_back(nTime);
             } else {
                 ++skipped;
             }
+            if (batch.size() >= MEMPOOL_LOAD_BATCH_SIZE || (num == 0 && !batch.empty())) {
+                LOCK(cs_main);
+                std::vector<CValidationState> states;
+                size_t nAccepted = AcceptToMemoryPoolBatchWithTime(chainparams, mempool, batch, batchTimes, states, true, nullptr);
+                count += nAccepted;
+                failed += batch.size() - nAccepted;
+                batch.clear();
+                batchTimes.clear();
+                if (GetTimeMillis() - nLastProgress > 10000) {
+                    LogPrintf("Importing mempool transactions from disk: %u of %u\n", nTotal - num, nTotal);
+                    nLastProgress = GetTimeMillis();
+                }
+            }
             if (ShutdownRequested())
                 return false;
         }
@@ -633,15 +759,20 @@ void DumpMempool(void)
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    // With the number of in mempool ancestors, to sort by once the lock is released: parents have to come before their children when loading.
+    std::vector<std::pair<uint64_t, TxMempoolInfo>> vinfo;
 
     {
         LOCK(mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
-        vinfo = mempool.infoAll();
+        vinfo.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry& entry : mempool.mapTx) {
+            vinfo.emplace_back(entry.GetCountWithAncestors(), TxMempoolInfo{entry.GetSharedTx(), entry.GetTime(), CFeeRate(entry.GetFee(), entry.GetTxSize()), entry.GetModifiedFee() - entry.GetFee()});
+        }
     }
+    std::stable_sort(vinfo.begin(), vinfo.end(), [](const std::pair<uint64_t, TxMempoolInfo>& a, const std::pair<uint64_t, TxMempoolInfo>& b) { return a.first < b.first; });
 
     int64_t mid = GetTimeMicros();
 
@@ -657,7 +788,8 @@ void DumpMempool(void)
         file << version;
 
         file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
+        for (const auto& item : vinfo) {
+            const TxMempoolInfo& i = item.second;
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
@@ -669,7 +801,7 @@ void DumpMempool(void)
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
         int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*0.000001, (last-mid)*0.000001);
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump (%u transactions)\n", (mid-start)*0.000001, (last-mid)*0.000001, vinfo.size());
     } catch (const std::exception& e) {
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
     }
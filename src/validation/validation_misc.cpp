@@ -13,6 +13,7 @@
 #include "validation.h"
 #include "validationinterface.h"
 #include "witnessvalidation.h"
+#include "txindex.h"
 #include "versionbitsvalidation.h"
 #include <consensus/validation.h>
 
@@ -36,6 +37,10 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const CChainPar
 {
     CBlockIndex *pindexSlow = NULL;
 
+    // Let the index write out the blocks connected so far first, so that a transaction of the tip can be found.
+    if (g_txindex)
+        g_txindex->BlockUntilSynced();
+
     LOCK(cs_main); // Required for ReadBlockFromDisk.
 
     CTransactionRef ptx = mempool.get(hash);
@@ -45,20 +50,12 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const CChainPar
         return true;
     }
 
-    if (fTxIndex) {
+    if (g_txindex) {
         CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
-            CFile file(blockStore.GetBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
+        if (g_txindex->FindTx(hash, postx)) {
             CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
+            if (!blockStore.ReadTransactionFromDisk(header, txOut, postx, postx.nTxOffset))
+                return error("%s: ReadTransactionFromDisk failed", __func__);
             hashBlock = header.GetHashPoW2();
             if (txOut->GetHash() != hash)
                 return error("%s: txid mismatch", __func__);
@@ -12,6 +12,13 @@
 
 #include "validation/validationinterface.h"
 
+#include "util.h"
+
+#include <chrono>
+#include <map>
+
+#include <boost/bind.hpp>
+
 static CMainSignals g_signals;
 
 CMainSignals& GetMainSignals()
@@ -19,49 +26,231 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn)
+CValidationInterfaceQueue::CValidationInterfaceQueue()
+: thread(&CValidationInterfaceQueue::ThreadDeliver, this)
+{
+}
+
+CValidationInterfaceQueue::~CValidationInterfaceQueue()
+{
+    Stop();
+}
+
+void CValidationInterfaceQueue::Push(std::function<void()> func)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!fStop)
+        {
+            queue.push_back(std::move(func));
+            ++nPushed;
+            cond.notify_all();
+            return;
+        }
+    }
+    func();
+}
+
+void CValidationInterfaceQueue::Sync()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    if (thread.get_id() == std::this_thread::get_id())
+        return;
+    uint64_t nTarget = nPushed;
+    cond.wait(lock, [&]{ return nDone >= nTarget || fStop; });
+}
+
+void CValidationInterfaceQueue::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    if (!thread.joinable())
+        return;
+    // A listener that unregisters from one of its own notifications; the thread ends after that one.
+    if (thread.get_id() == std::this_thread::get_id())
+        thread.detach();
+    else
+        thread.join();
+}
+
+void CValidationInterfaceQueue::ThreadDeliver()
 {
-    g_signals.StalledWitness.connect(boost::bind(&CValidationInterface::StalledWitness, pwalletIn, _1, _2));
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1, _2));
-    g_signals.ScriptForWitnessing.connect(boost::bind(&CValidationInterface::GetScriptForWitnessing, pwalletIn, _1, _2));
-    g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    RenameThread("gulden-notify");
+    std::unique_lock<std::mutex> lock(cs);
+    while (true)
+    {
+        cond.wait(lock, [this]{ return !queue.empty() || fStop; });
+        if (queue.empty())
+            return;
+        std::function<void()> func = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        try
+        {
+            func();
+        }
+        catch (const std::exception& e)
+        {
+            PrintExceptionContinue(&e, "validation notification");
+        }
+        catch (...)
+        {
+            PrintExceptionContinue(NULL, "validation notification");
+        }
+        func = nullptr;
+        lock.lock();
+        ++nDone;
+        cond.notify_all();
+    }
+}
+
+// Emissions count themselves in nEmissions[nEmissionEpoch & 1], see CValidationSignalBase.
+static std::atomic<unsigned int> nEmissionEpoch{0};
+static std::atomic<int> nEmissions[2];
+// Emissions the current thread is in.
+static thread_local int nEmissionDepth = 0;
+// Replaced subscriber lists that couldn't be freed yet, see Retire.
+static std::vector<std::shared_ptr<const void>> vRetiredLater;
+
+int CValidationSignalBase::Enter()
+{
+    ++nEmissionDepth;
+    while (true)
+    {
+        int nHalf = nEmissionEpoch & 1;
+        ++nEmissions[nHalf];
+        // A writer switched halves in between, and may not be waiting for us; count in the half it switched to instead.
+        if ((int)(nEmissionEpoch & 1) == nHalf)
+            return nHalf;
+        --nEmissions[nHalf];
+    }
+}
+
+void CValidationSignalBase::Leave(int nHalf)
+{
+    --nEmissions[nHalf];
+    --nEmissionDepth;
+}
+
+bool CValidationSignalBase::Retire(std::vector<std::shared_ptr<const void>>& retired)
+{
+    if (nEmissionDepth > 0)
+    {
+        vRetiredLater.insert(vRetiredLater.end(), retired.begin(), retired.end());
+        retired.clear();
+        return false;
+    }
+    // Emissions that start from here on see the new lists.
+    int nHalf = nEmissionEpoch++ & 1;
+    while (nEmissions[nHalf] != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    retired.clear();
+    vRetiredLater.clear();
+    return true;
+}
+
+// Registration takes turns, for Retire; and the queues of the listeners registered with fAsync.
+static std::mutex csValidationInterfaces;
+static std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue>> mapQueues;
+
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fAsync)
+{
+    std::lock_guard<std::mutex> lock(csValidationInterfaces);
+    std::shared_ptr<CValidationInterfaceQueue> queue;
+    if (fAsync)
+    {
+        queue = std::make_shared<CValidationInterfaceQueue>();
+        mapQueues[pwalletIn] = queue;
+    }
+    std::vector<std::shared_ptr<const void>> retired;
+    retired.push_back(g_signals.StalledWitness.Connect(pwalletIn, boost::bind(&CValidationInterface::StalledWitness, pwalletIn, _1, _2), queue));
+    retired.push_back(g_signals.WitnessSelected.Connect(pwalletIn, boost::bind(&CValidationInterface::WitnessSelected, pwalletIn, _1, _2), queue));
+    retired.push_back(g_signals.PoW2PhaseChanged.Connect(pwalletIn, boost::bind(&CValidationInterface::PoW2PhaseChanged, pwalletIn, _1, _2, _3), queue));
+    retired.push_back(g_signals.UpdatedBlockTip.Connect(pwalletIn, boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3), queue));
+    retired.push_back(g_signals.TransactionAddedToMempool.Connect(pwalletIn, boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1), queue));
+    retired.push_back(g_signals.BlockConnected.Connect(pwalletIn, boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3), queue));
+    retired.push_back(g_signals.BlockDisconnected.Connect(pwalletIn, boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1), queue));
+    retired.push_back(g_signals.SetBestChain.Connect(pwalletIn, boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1), queue));
+    retired.push_back(g_signals.Inventory.Connect(pwalletIn, boost::bind(&CValidationInterface::Inventory, pwalletIn, _1), queue));
+    retired.push_back(g_signals.Broadcast.Connect(pwalletIn, boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2), queue));
+    retired.push_back(g_signals.BlockChecked.Connect(pwalletIn, boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2), nullptr));
+    retired.push_back(g_signals.ScriptForMining.Connect(pwalletIn, boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1, _2), nullptr));
+    retired.push_back(g_signals.ScriptForWitnessing.Connect(pwalletIn, boost::bind(&CValidationInterface::GetScriptForWitnessing, pwalletIn, _1, _2), nullptr));
+    retired.push_back(g_signals.NewPoWValidBlock.Connect(pwalletIn, boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2), queue));
+    CValidationSignalBase::Retire(retired);
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn)
 {
-    g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
-    g_signals.ScriptForWitnessing.disconnect(boost::bind(&CValidationInterface::GetScriptForWitnessing, pwalletIn, _1, _2));
-    g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1, _2));
-    g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.StalledWitness.connect(boost::bind(&CValidationInterface::StalledWitness, pwalletIn, _1, _2));
+    std::shared_ptr<CValidationInterfaceQueue> queue;
+    {
+        std::lock_guard<std::mutex> lock(csValidationInterfaces);
+        std::vector<std::shared_ptr<const void>> retired;
+        retired.push_back(g_signals.NewPoWValidBlock.Disconnect(pwalletIn));
+        retired.push_back(g_signals.ScriptForWitnessing.Disconnect(pwalletIn));
+        retired.push_back(g_signals.ScriptForMining.Disconnect(pwalletIn));
+        retired.push_back(g_signals.BlockChecked.Disconnect(pwalletIn));
+        retired.push_back(g_signals.Broadcast.Disconnect(pwalletIn));
+        retired.push_back(g_signals.Inventory.Disconnect(pwalletIn));
+        retired.push_back(g_signals.SetBestChain.Disconnect(pwalletIn));
+        retired.push_back(g_signals.BlockDisconnected.Disconnect(pwalletIn));
+        retired.push_back(g_signals.BlockConnected.Disconnect(pwalletIn));
+        retired.push_back(g_signals.TransactionAddedToMempool.Disconnect(pwalletIn));
+        retired.push_back(g_signals.UpdatedBlockTip.Disconnect(pwalletIn));
+        retired.push_back(g_signals.PoW2PhaseChanged.Disconnect(pwalletIn));
+        retired.push_back(g_signals.WitnessSelected.Disconnect(pwalletIn));
+        retired.push_back(g_signals.StalledWitness.Disconnect(pwalletIn));
+        CValidationSignalBase::Retire(retired);
+        auto it = mapQueues.find(pwalletIn);
+        if (it != mapQueues.end())
+        {
+            queue = it->second;
+            mapQueues.erase(it);
+        }
+    }
+    // Nothing is pushed anymore, deliver what was.
+    if (queue)
+        queue->Stop();
 }
 
 void UnregisterAllValidationInterfaces()
 {
-    g_signals.ScriptForWitnessing.disconnect_all_slots();
-    g_signals.ScriptForMining.disconnect_all_slots();
-    g_signals.BlockChecked.disconnect_all_slots();
-    g_signals.Broadcast.disconnect_all_slots();
-    g_signals.Inventory.disconnect_all_slots();
-    g_signals.SetBestChain.disconnect_all_slots();
-    g_signals.TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.BlockConnected.disconnect_all_slots();
-    g_signals.BlockDisconnected.disconnect_all_slots();
-    g_signals.UpdatedBlockTip.disconnect_all_slots();
-    g_signals.NewPoWValidBlock.disconnect_all_slots();
+    std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue>> queues;
+    {
+        std::lock_guard<std::mutex> lock(csValidationInterfaces);
+        std::vector<std::shared_ptr<const void>> retired;
+        retired.push_back(g_signals.NewPoWValidBlock.DisconnectAll());
+        retired.push_back(g_signals.ScriptForWitnessing.DisconnectAll());
+        retired.push_back(g_signals.ScriptForMining.DisconnectAll());
+        retired.push_back(g_signals.BlockChecked.DisconnectAll());
+        retired.push_back(g_signals.Broadcast.DisconnectAll());
+        retired.push_back(g_signals.Inventory.DisconnectAll());
+        retired.push_back(g_signals.SetBestChain.DisconnectAll());
+        retired.push_back(g_signals.TransactionAddedToMempool.DisconnectAll());
+        retired.push_back(g_signals.BlockConnected.DisconnectAll());
+        retired.push_back(g_signals.BlockDisconnected.DisconnectAll());
+        retired.push_back(g_signals.UpdatedBlockTip.DisconnectAll());
+        retired.push_back(g_signals.PoW2PhaseChanged.DisconnectAll());
+        retired.push_back(g_signals.WitnessSelected.DisconnectAll());
+        retired.push_back(g_signals.StalledWitness.DisconnectAll());
+        CValidationSignalBase::Retire(retired);
+        queues.swap(mapQueues);
+    }
+    for (auto& item : queues)
+        item.second->Stop();
+}
+
+void SyncWithValidationInterfaceQueues()
+{
+    std::vector<std::shared_ptr<CValidationInterfaceQueue>> queues;
+    {
+        std::lock_guard<std::mutex> lock(csValidationInterfaces);
+        for (auto& item : mapQueues)
+            queues.push_back(item.second);
+    }
+    for (auto& queue : queues)
+        queue->Sync();
 }
@@ -17,8 +17,15 @@
 #include "config/gulden-config.h"
 #endif
 
-#include <boost/signals2/signal.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "generation/generation.h"
 
@@ -36,21 +43,33 @@ class CAccount;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core.
+ * With fAsync the notifications are delivered on a thread of the wallet's own instead of the thread that sends them, in the order they were
+ * sent, so that a slow listener doesn't hold up validation; except GetScriptForMining, GetScriptForWitnessing and BlockChecked, which pass
+ * values back or refer to state of the sender and are always delivered right away.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fAsync=false);
+/**
+ * Unregister a wallet from core; once it returns no more notifications are delivered to it (unless called from a notification itself).
+ * Registering waits for the notifications in progress elsewhere, so listeners shouldn't (un)register from their notifications.
+ */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/** Wait until the notifications sent so far have been delivered to the listeners registered with fAsync */
+void SyncWithValidationInterfaceQueues();
 
 class CValidationInterface {
 public:
     virtual ~CValidationInterface() {}
 protected:
     virtual void StalledWitness([[maybe_unused]] const CBlockIndex* pBlock, [[maybe_unused]] uint64_t nSeconds) {}
+    virtual void WitnessSelected([[maybe_unused]] const CBlockIndex* pBlock, [[maybe_unused]] const COutPoint& selectedWitnessOutpoint) {}
+    virtual void PoW2PhaseChanged([[maybe_unused]] const CBlockIndex* pindexNew, [[maybe_unused]] int nPhaseOld, [[maybe_unused]] int nPhaseNew) {}
     virtual void UpdatedBlockTip([[maybe_unused]] const CBlockIndex *pindexNew, [[maybe_unused]] const CBlockIndex *pindexFork, [[maybe_unused]] bool fInitialDownload) {}
     virtual void TransactionAddedToMempool([[maybe_unused]] const CTransactionRef &ptxn) {}
-    virtual void BlockConnected([[maybe_unused]] const std::shared_ptr<const CBlock> &block, [[maybe_unused]] const CBlockIndex *pindex, [[maybe_unused]] const std::vector<CTransactionRef> &txnConflicted) {}
+    virtual void BlockConnected([[maybe_unused]] const std::shared_ptr<const CBlock> &block, [[maybe_unused]] const CBlockIndex *, [[maybe_unused]] const std::vector<CTransactionRef> &txnConflicted) {}
     virtual void BlockDisconnected([[maybe_unused]] const std::shared_ptr<const CBlock> &block) {}
     virtual void SetBestChain([[maybe_unused]] const CBlockLocator &locator) {}
     virtual void Inventory([[maybe_unused]] const uint256 &hash) {}
@@ -58,50 +77,185 @@ protected:
     virtual void BlockChecked([[maybe_unused]] const CBlock&, [[maybe_unused]] const CValidationState&) {}
     virtual void GetScriptForMining([[maybe_unused]] std::shared_ptr<CReserveKeyOrScript>&, [[maybe_unused]] CAccount* forAccount) {};
     virtual void GetScriptForWitnessing([[maybe_unused]] std::shared_ptr<CReserveKeyOrScript>&, [[maybe_unused]] CAccount* forAccount) {};
-    virtual void NewPoWValidBlock([[maybe_unused]] const CBlockIndex *pindex, [[maybe_unused]] const std::shared_ptr<const CBlock>& block) {};
-    friend void ::RegisterValidationInterface([[maybe_unused]] CValidationInterface* interface);
+    virtual void NewPoWValidBlock([[maybe_unused]] const CBlockIndex *, [[maybe_unused]] const std::shared_ptr<const CBlock>& block) {};
+    friend void ::RegisterValidationInterface([[maybe_unused]] CValidationInterface* interface, bool fAsync);
     friend void ::UnregisterValidationInterface([[maybe_unused]] CValidationInterface* interface);
     friend void ::UnregisterAllValidationInterfaces();
 };
 
+/** Delivers the notifications of one listener on a thread of its own, one at a time and in the order they were pushed. */
+class CValidationInterfaceQueue
+{
+public:
+    CValidationInterfaceQueue();
+    ~CValidationInterfaceQueue();
+
+    //! Queue func; once stopped it is run on the calling thread instead.
+    void Push(std::function<void()> func);
+    //! Wait until everything pushed so far has been run.
+    void Sync();
+    //! Run what is still queued and stop the thread.
+    void Stop();
+
+private:
+    void ThreadDeliver();
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> queue;
+    uint64_t nPushed = 0;
+    uint64_t nDone = 0;
+    bool fStop = false;
+    std::thread thread;
+};
+
+/**
+ * What all signals share: keeping track of the emissions in progress, so that a subscriber list that has been replaced can be freed once
+ * nothing may still be reading it. Emissions count themselves in the half of the current epoch; a writer switches to the other half and waits
+ * for the one it left to empty, which new emissions never join.
+ */
+class CValidationSignalBase
+{
+protected:
+    //! Start an emission; returns the half it counts in, to pass to Leave.
+    static int Enter();
+    static void Leave(int nHalf);
+
+public:
+    /**
+     * Free the subscriber lists that were replaced, after waiting for the emissions that may still use them. Called from an emission there
+     * is no waiting (for that very emission); the lists are then kept until the next time. Returns whether it waited.
+     * Only from RegisterValidationInterface and co, who take turns.
+     */
+    static bool Retire(std::vector<std::shared_ptr<const void>>& retired);
+};
+
+/**
+ * A notification with the listeners for it. Emitting takes no locks: the subscriber list is never changed but replaced by a new one, so an
+ * emission goes through whatever list was there when it started.
+ */
+template<typename... Args>
+class CValidationSignal : public CValidationSignalBase
+{
+public:
+    typedef std::function<void(Args...)> Slot;
+
+    CValidationSignal() {}
+    CValidationSignal(const CValidationSignal&) = delete;
+    CValidationSignal& operator=(const CValidationSignal&) = delete;
+    ~CValidationSignal() { delete subscribers.load(); }
+
+    void operator()(Args... args) const
+    {
+        struct Guard
+        {
+            int nHalf = Enter();
+            ~Guard() { Leave(nHalf); }
+        } guard;
+        const Subscribers* pSubscribers = subscribers.load();
+        if (!pSubscribers)
+            return;
+        for (const Subscriber& subscriber : *pSubscribers)
+        {
+            if (subscriber.queue)
+            {
+                const Slot& slot = subscriber.slot;
+                subscriber.queue->Push([slot, args...]() mutable { slot(args...); });
+            }
+            else
+            {
+                subscriber.slot(args...);
+            }
+        }
+    }
+
+    // The changes return the replaced list, to hand to Retire.
+    std::shared_ptr<const void> Connect(const void* pOwner, Slot slot, std::shared_ptr<CValidationInterfaceQueue> queue)
+    {
+        const Subscribers* pOld = subscribers.load();
+        Subscribers* pNew = pOld ? new Subscribers(*pOld) : new Subscribers();
+        pNew->push_back(Subscriber{pOwner, std::move(slot), std::move(queue)});
+        return Replace(pNew);
+    }
+
+    std::shared_ptr<const void> Disconnect(const void* pOwner)
+    {
+        const Subscribers* pOld = subscribers.load();
+        if (!pOld)
+            return nullptr;
+        Subscribers* pNew = new Subscribers();
+        for (const Subscriber& subscriber : *pOld)
+        {
+            if (subscriber.pOwner != pOwner)
+                pNew->push_back(subscriber);
+        }
+        return Replace(pNew);
+    }
+
+    std::shared_ptr<const void> DisconnectAll()
+    {
+        return Replace(nullptr);
+    }
+
+private:
+    struct Subscriber
+    {
+        const void* pOwner;
+        Slot slot;
+        std::shared_ptr<CValidationInterfaceQueue> queue;
+    };
+    typedef std::vector<Subscriber> Subscribers;
+
+    std::shared_ptr<const void> Replace(const Subscribers* pNew)
+    {
+        return std::shared_ptr<const Subscribers>(subscribers.exchange(pNew));
+    }
+
+    std::atomic<const Subscribers*> subscribers{nullptr};
+};
+
 struct CMainSignals {
     //! Notifies listeners of a stalled witness at tip of chain
-    boost::signals2::signal<void (const CBlockIndex *, uint64_t nSeconds)> StalledWitness;
+    CValidationSignal<const CBlockIndex *, uint64_t> StalledWitness;
+    //! Notifies listeners of the witness selected to sign a block at the tip of chain, once the witness thread has worked it out
+    CValidationSignal<const CBlockIndex *, const COutPoint &> WitnessSelected;
+    //! Notifies listeners of the tip of chain moving to another PoW2 phase
+    CValidationSignal<const CBlockIndex *, int, int> PoW2PhaseChanged;
 
     /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
+    CValidationSignal<const CBlockIndex *, const CBlockIndex *, bool> UpdatedBlockTip;
     /** Notifies listeners of a transaction having been added to mempool. */
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
+    CValidationSignal<const CTransactionRef &> TransactionAddedToMempool;
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
      */
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef> &)> BlockConnected;
+    CValidationSignal<const std::shared_ptr<const CBlock> &, const CBlockIndex *, const std::vector<CTransactionRef> &> BlockConnected;
     /** Notifies listeners of a block being disconnected */
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
+    CValidationSignal<const std::shared_ptr<const CBlock> &> BlockDisconnected;
     /** Notifies listeners of a new active block chain. */
-    boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
+    CValidationSignal<const CBlockLocator &> SetBestChain;
     /** Notifies listeners about an inventory item being seen on the network. */
-    boost::signals2::signal<void (const uint256 &)> Inventory;
+    CValidationSignal<const uint256 &> Inventory;
     /** Tells listeners to broadcast their data. */
-    boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
+    CValidationSignal<int64_t, CConnman*> Broadcast;
     /**
      * Notifies listeners of a block validation result.
      * If the provided CValidationState IsValid, the provided block
      * is guaranteed to be the current best block at the time the
      * callback was generated (not necessarily now)
      */
-    boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
+    CValidationSignal<const CBlock&, const CValidationState&> BlockChecked;
     /** Notifies listeners that a key for mining is required (coinbase) */
-    boost::signals2::signal<void (std::shared_ptr<CReserveKeyOrScript>&, CAccount* forAccount)> ScriptForMining;
+    CValidationSignal<std::shared_ptr<CReserveKeyOrScript>&, CAccount*> ScriptForMining;
 
     //! Notifies listeners that a key for witnessing is required (to generate non-compound coinbase outputs)
-    boost::signals2::signal<void (std::shared_ptr<CReserveKeyOrScript>&, CAccount* forAccount)> ScriptForWitnessing;
+    CValidationSignal<std::shared_ptr<CReserveKeyOrScript>&, CAccount*> ScriptForWitnessing;
 
     /**
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
-    boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
+    CValidationSignal<const CBlockIndex *, const std::shared_ptr<const CBlock>&> NewPoWValidBlock;
 };
 
 CMainSignals& GetMainSignals();
@@ -10,6 +10,9 @@
 #include <consensus/validation.h>
 #include <Gulden/util.h>
 #include "timedata.h" // GetAdjustedTime()
+#include "chainparams.h"
+#include "scheduler.h"
+#include "metrics.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -26,6 +29,356 @@
 
 CWitViewDB *ppow2witdbview = NULL;
 std::shared_ptr<CCoinsViewCache> ppow2witTip = NULL;
+CWitnessSetIndex witnessSetIndex;
+
+CWitnessSetIndex::Snapshot CWitnessSetIndex::Get(const uint256& blockHash)
+{
+    AssertLockHeld(cs_main);
+    auto iter = snapshots.find(blockHash);
+    if (iter == snapshots.end())
+        return nullptr;
+    iter->second.nLastUse = ++nUseCounter;
+    return iter->second.snapshot;
+}
+
+CWitnessSetIndex::Snapshot CWitnessSetIndex::GetTip()
+{
+    AssertLockHeld(cs_main);
+    if (!ppow2witTip || !pcoinsTip)
+        return nullptr;
+    // The witness view is always flushed together with pcoinsTip, so they are at the same block.
+    uint256 hashTip = pcoinsTip->GetBestBlock();
+    Snapshot snapshot = Get(hashTip);
+    if (!snapshot)
+    {
+        DO_BENCHMARK("WIT: CWitnessSetIndex::GetTip", BCLog::BENCH|BCLog::WITNESS);
+        std::shared_ptr<std::map<COutPoint, Coin>> allWitnessCoins = std::make_shared<std::map<COutPoint, Coin>>();
+        ppow2witTip->GetAllCoins(*allWitnessCoins);
+        snapshot = allWitnessCoins;
+        Add(hashTip, snapshot);
+    }
+    return snapshot;
+}
+
+void CWitnessSetIndex::BlockFlushed(const uint256& hashPrev, const uint256& hashBlock, const CCoinsViewCache& witnessView)
+{
+    AssertLockHeld(cs_main);
+    // Nothing to derive from; e.g. during initial sync where nobody asks for the witness set, a snapshot is only built once somebody does.
+    Snapshot prev = Get(hashPrev);
+    if (!prev || Get(hashBlock))
+        return;
+    std::shared_ptr<std::map<COutPoint, Coin>> allWitnessCoins = std::make_shared<std::map<COutPoint, Coin>>(*prev);
+    witnessView.ApplyCachedCoins(*allWitnessCoins);
+    Add(hashBlock, allWitnessCoins);
+}
+
+void CWitnessSetIndex::Clear()
+{
+    AssertLockHeld(cs_main);
+    snapshots.clear();
+}
+
+size_t CWitnessSetIndex::DynamicMemoryUsage() const
+{
+    AssertLockHeld(cs_main);
+    size_t nUsage = memusage::DynamicUsage(snapshots);
+    for (const auto& entry : snapshots)
+        nUsage += memusage::DynamicUsage(entry.second.snapshot) + WitnessCoinsDynamicMemoryUsage(*entry.second.snapshot);
+    return nUsage;
+}
+
+void CWitnessSetIndex::Add(const uint256& blockHash, Snapshot snapshot)
+{
+    while (snapshots.size() >= WITNESS_SET_SNAPSHOTS)
+    {
+        auto oldest = std::min_element(snapshots.begin(), snapshots.end(), [](const auto& a, const auto& b) { return a.second.nLastUse < b.second.nLastUse; });
+        snapshots.erase(oldest);
+    }
+    snapshots[blockHash] = Entry{snapshot, ++nUseCounter};
+}
+
+CWitnessSelectionCache witnessSelectionCache;
+
+CWitnessSelectionCache::Result CWitnessSelectionCache::Get(const uint256& prevHash, const uint256& powHash)
+{
+    LOCK(cs);
+    auto iter = results.find(std::make_pair(prevHash, powHash));
+    if (iter == results.end())
+        return nullptr;
+    iter->second.nLastUse = ++nUseCounter;
+    return iter->second.result;
+}
+
+void CWitnessSelectionCache::Add(const uint256& prevHash, const uint256& powHash, Result result)
+{
+    LOCK(cs);
+    while (results.size() >= WITNESS_SELECTION_CACHE_SIZE)
+    {
+        auto oldest = std::min_element(results.begin(), results.end(), [](const auto& a, const auto& b) { return a.second.nLastUse < b.second.nLastUse; });
+        results.erase(oldest);
+    }
+    results[std::make_pair(prevHash, powHash)] = Entry{result, ++nUseCounter};
+}
+
+void CWitnessSelectionCache::Erase(const uint256& prevHash)
+{
+    LOCK(cs);
+    for (auto iter = results.lower_bound(std::make_pair(prevHash, uint256())); iter != results.end() && iter->first.first == prevHash; )
+        iter = results.erase(iter);
+}
+
+void CWitnessSelectionCache::Clear()
+{
+    LOCK(cs);
+    results.clear();
+}
+
+size_t CWitnessSelectionCache::DynamicMemoryUsage()
+{
+    LOCK(cs);
+    size_t nUsage = memusage::DynamicUsage(results);
+    for (const auto& entry : results)
+        nUsage += memusage::DynamicUsage(entry.second.result) + WitnessInfoDynamicMemoryUsage(*entry.second.result);
+    return nUsage;
+}
+
+CWitnessExpiryQueue witnessExpiryQueue;
+
+void CWitnessExpiryQueue::Project(const COutPoint& outpoint, Entry& entry)
+{
+    if (entry.nExpiryHeight != 0)
+        queue.erase(std::make_pair(entry.nExpiryHeight, outpoint));
+    else
+        capped.erase(outpoint);
+    if (entry.nWeight > nProjectedWeight / 100)
+    {
+        entry.nExpiryHeight = 0;
+        capped.insert(outpoint);
+    }
+    else
+    {
+        // witnessHasExpired is true once the age exceeds the smaller of the two limits; 1 past the coin height so that 0 stays free to mean capped.
+        entry.nExpiryHeight = entry.nCoinHeight + std::min<uint64_t>(gMaximumParticipationAge, expectedWitnessBlockPeriod(entry.nWeight, nProjectedWeight)) + 1;
+        queue.insert(std::make_pair(entry.nExpiryHeight, outpoint));
+    }
+}
+
+void CWitnessExpiryQueue::GetExpired(const std::vector<RouletteItem>& pool, uint64_t nBlockHeight, uint64_t nTotalWeightRaw, std::set<COutPoint>& expired)
+{
+    DO_BENCHMARK("WIT: CWitnessExpiryQueue::GetExpired", BCLog::BENCH|BCLog::WITNESS);
+
+    LOCK(cs);
+    expired.clear();
+
+    // Project a little under the network weight so that a small drop in it doesn't mean projecting everything again.
+    bool fReproject = nTotalWeightRaw < nProjectedWeight || nTotalWeightRaw > nProjectedWeight + nProjectedWeight / 16;
+    if (fReproject)
+        nProjectedWeight = nTotalWeightRaw - nTotalWeightRaw / 64;
+
+    ++nSyncCounter;
+    for (const RouletteItem& item : pool)
+    {
+        auto [iter, fNew] = entries.emplace(item.outpoint, Entry{item.coin.nHeight, item.nWeight, 0, nSyncCounter});
+        Entry& entry = iter->second;
+        if (fNew)
+        {
+            Project(item.outpoint, entry);
+        }
+        else if (fReproject || entry.nCoinHeight != item.coin.nHeight || entry.nWeight != item.nWeight)
+        {
+            entry.nCoinHeight = item.coin.nHeight;
+            entry.nWeight = item.nWeight;
+            Project(item.outpoint, entry);
+        }
+        entry.nSeen = nSyncCounter;
+    }
+    for (auto iter = entries.begin(); iter != entries.end(); )
+    {
+        if (iter->second.nSeen == nSyncCounter)
+        {
+            ++iter;
+            continue;
+        }
+        if (iter->second.nExpiryHeight != 0)
+            queue.erase(std::make_pair(iter->second.nExpiryHeight, iter->first));
+        else
+            capped.erase(iter->first);
+        iter = entries.erase(iter);
+    }
+
+    // The real expiry is never before the projected one, so only the witnesses past theirs (and the capped ones) can have expired.
+    auto isExpired = [&](const COutPoint& outpoint)
+    {
+        const Entry& entry = entries.find(outpoint)->second;
+        if (witnessHasExpired(nBlockHeight - entry.nCoinHeight, entry.nWeight, nTotalWeightRaw))
+            expired.insert(outpoint);
+    };
+    for (auto iter = queue.begin(); iter != queue.end() && iter->first <= nBlockHeight; ++iter)
+        isExpired(iter->second);
+    for (const COutPoint& outpoint : capped)
+        isExpired(outpoint);
+}
+
+void CWitnessExpiryQueue::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+    queue.clear();
+    capped.clear();
+    nProjectedWeight = 0;
+}
+
+size_t CWitnessExpiryQueue::DynamicMemoryUsage()
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(entries) + memusage::DynamicUsage(queue) + memusage::DynamicUsage(capped);
+}
+
+size_t WitnessCoinsDynamicMemoryUsage(const std::map<COutPoint, Coin>& witnessCoins)
+{
+    size_t nUsage = memusage::DynamicUsage(witnessCoins);
+    for (const auto& entry : witnessCoins)
+        nUsage += entry.second.DynamicMemoryUsage();
+    return nUsage;
+}
+
+size_t WitnessInfoDynamicMemoryUsage(const CGetWitnessInfo& witnessInfo)
+{
+    // Only the pool entries themselves; the coins in them rarely have a script large enough to need an allocation of its own.
+    return WitnessCoinsDynamicMemoryUsage(witnessInfo.allWitnessCoins) + memusage::DynamicUsage(witnessInfo.witnessSelectionPoolUnfiltered) + memusage::DynamicUsage(witnessInfo.witnessSelectionPoolFiltered);
+}
+
+CWitnessPoolPrecompute witnessPoolPrecompute;
+
+CWitnessPoolPrecompute::Pool CWitnessPoolPrecompute::Get(const uint256& prevHash)
+{
+    LOCK(cs);
+    auto iter = pools.find(prevHash);
+    if (iter == pools.end())
+        return nullptr;
+    iter->second.nLastUse = ++nUseCounter;
+    return iter->second.pool;
+}
+
+CWitnessNetworkWeight::CWitnessNetworkWeight(const uint256& hashBlockIn, uint64_t nHeightIn, const CGetWitnessInfo& witnessInfo)
+: hashBlock(hashBlockIn)
+, nHeight(nHeightIn)
+, nWitnesses(witnessInfo.allWitnessCoins.size())
+, nEligibleWitnesses(witnessInfo.witnessSelectionPoolFiltered.size())
+, nTotalWeightRaw(witnessInfo.nTotalWeightRaw)
+, nTotalWeightEligibleRaw(witnessInfo.nTotalWeightEligibleRaw)
+, nTotalWeightEligibleAdjusted(witnessInfo.nTotalWeightEligibleAdjusted)
+{
+}
+
+CWitnessPoolPrecompute::Pool CWitnessPoolPrecompute::GetLatest(CWitnessNetworkWeight& tipWeight)
+{
+    LOCK(cs);
+    if (!latestPool || weightHistory.empty())
+        return nullptr;
+    tipWeight = weightHistory.rbegin()->second;
+    return latestPool;
+}
+
+std::vector<CWitnessNetworkWeight> CWitnessPoolPrecompute::GetWeightHistory()
+{
+    LOCK(cs);
+    std::vector<CWitnessNetworkWeight> history;
+    history.reserve(weightHistory.size());
+    for (const auto& [nHeight, weight] : weightHistory)
+    {
+        (unused)nHeight;
+        history.push_back(weight);
+    }
+    return history;
+}
+
+void CWitnessPoolPrecompute::SetLatest(const CBlockIndex* pindexTip)
+{
+    LOCK(cs);
+    auto iter = pools.find(pindexTip->GetBlockHashPoW2());
+    if (iter == pools.end())
+        return;
+    latestPool = iter->second.pool;
+    // After a reorg the heights from the fork on belong to the new chain.
+    weightHistory.erase(weightHistory.lower_bound(pindexTip->nHeight), weightHistory.end());
+    weightHistory[pindexTip->nHeight] = CWitnessNetworkWeight(pindexTip->GetBlockHashPoW2(), pindexTip->nHeight, *latestPool);
+    while (weightHistory.size() > WITNESS_WEIGHT_HISTORY_SIZE)
+        weightHistory.erase(weightHistory.begin());
+}
+
+bool CWitnessPoolPrecompute::Prepare(CChain& chain, const CChainParams& chainParams, CBlockIndex* pindexPrev)
+{
+    DO_BENCHMARK("WIT: CWitnessPoolPrecompute::Prepare", BCLog::BENCH|BCLog::WITNESS);
+
+    uint256 prevHash = pindexPrev->GetBlockHashPoW2();
+    if (Get(prevHash))
+        return true;
+
+    {
+        LOCK(cs_main);
+        if (!IsPow2WitnessingActive(pindexPrev, chainParams, chain))
+            return false;
+    }
+
+    // Same as GetWitnessInfo/GetWitnessHelper minus the PoW block, which only matters for the selection itself (and for the witness set if it touches it; see GetWitness).
+    uint64_t nBlockHeight = pindexPrev->nHeight + 1;
+    std::shared_ptr<CGetWitnessInfo> witnessInfo = std::make_shared<CGetWitnessInfo>();
+    if (!getAllUnspentWitnessCoins(chain, chainParams, pindexPrev, witnessInfo->allWitnessCoins))
+        return false;
+    PopulateWitnessSelectionPool(*witnessInfo, nBlockHeight);
+    if (!PrepareWitnessSelectionPool(*witnessInfo, nBlockHeight))
+        return false;
+
+    LOCK(cs);
+    while (pools.size() >= WITNESS_POOL_PRECOMPUTE_SIZE)
+    {
+        auto oldest = std::min_element(pools.begin(), pools.end(), [](const auto& a, const auto& b) { return a.second.nLastUse < b.second.nLastUse; });
+        pools.erase(oldest);
+    }
+    pools[prevHash] = Entry{witnessInfo, ++nUseCounter};
+    return true;
+}
+
+void CWitnessPoolPrecompute::SetScheduler(CScheduler* scheduler_)
+{
+    LOCK(cs);
+    schedulerClient.reset(scheduler_ ? new CSingleThreadedSchedulerClient(scheduler_) : nullptr);
+}
+
+void CWitnessPoolPrecompute::Clear()
+{
+    LOCK(cs);
+    pools.clear();
+    latestPool = nullptr;
+    weightHistory.clear();
+}
+
+size_t CWitnessPoolPrecompute::DynamicMemoryUsage()
+{
+    LOCK(cs);
+    size_t nUsage = memusage::DynamicUsage(pools) + memusage::DynamicUsage(weightHistory);
+    for (const auto& entry : pools)
+        nUsage += memusage::DynamicUsage(entry.second.pool) + WitnessInfoDynamicMemoryUsage(*entry.second.pool);
+    return nUsage;
+}
+
+void CWitnessPoolPrecompute::UpdatedBlockTip(const CBlockIndex *pindexNew, [[maybe_unused]] const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    // During initial download blocks arrive faster than we could prepare anything for them.
+    if (fInitialDownload || !pindexNew)
+        return;
+
+    LOCK(cs);
+    if (!schedulerClient)
+        return;
+    CBlockIndex* pindexPrev = const_cast<CBlockIndex*>(pindexNew);
+    schedulerClient->AddToProcessQueue([this, pindexPrev]()
+    {
+        if (Prepare(chainActive, Params(), pindexPrev))
+            SetLatest(pindexPrev);
+    });
+}
 
 std::map<std::string, std::string> staticFundingAddressLookupTable = {
 {"2p2CP3Wwadok5Qa1UkCE9u5NUBTV8JVmYfG1oxWcvfEr5oFUSMpJSnxYHa4YDM", "GMj42Mv7QjxfgmhSZUGf1dpAiqTE6j2wJp"},
@@ -959,19 +1312,117 @@ uint64_t estimatedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeig
 }
 
 
-bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain_, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock, CCoinsViewCache* viewOverride)
+const CBlock& GetBlockWithoutWitness(const CBlock& block, CBlock& storage)
+{
+    if (block.nVersionPoW2Witness == 0)
+        return block;
+
+    storage = CBlock(block.GetBlockHeader());
+    storage.nVersionPoW2Witness = 0;
+    storage.nTimePoW2Witness = 0;
+    storage.hashMerkleRootPoW2Witness = uint256();
+    storage.witnessHeaderPoW2Sig.clear();
+    storage.fChecked = block.fChecked;
+    storage.fPOWChecked = block.fPOWChecked;
+
+    // Everything from the witness coinbase onwards belongs to the witness.
+    auto witnessCoinbase = block.vtx.end();
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+    {
+        if (block.vtx[i]->IsCoinBase() && block.vtx[i]->IsPoW2WitnessCoinBase())
+        {
+            witnessCoinbase = block.vtx.begin() + i;
+            break;
+        }
+    }
+    storage.vtx.assign(block.vtx.begin(), witnessCoinbase);
+    return storage;
+}
+
+bool RestoreViewToBlock(CChain& chain, const CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainParams)
+{
+    AssertLockHeld(cs_main); // Required for ReadBlockFromDisk.
+    DO_BENCHMARK("WIT: RestoreViewToBlock", BCLog::BENCH|BCLog::WITNESS);
+
+    const CBlockIndex* pTip = chain.Tip();
+    if (!pTip || view.GetBestBlock() != pTip->GetBlockHashPoW2())
+        return false;
+    const CBlockIndex* pFork = chain.FindFork(pindex);
+    if (!pFork)
+        return false;
+
+    // Only blocks that have been connected before (and are therefore known to be valid) can be applied without validating them.
+    std::vector<const CBlockIndex*> vConnect;
+    for (const CBlockIndex* pConnect = pindex; pConnect != pFork; pConnect = pConnect->pprev)
+    {
+        if (!pConnect->IsValid(BLOCK_VALID_SCRIPTS) || !(pConnect->nStatus & BLOCK_HAVE_DATA))
+            return false;
+        vConnect.push_back(pConnect);
+    }
+
+    for (const CBlockIndex* pDisconnect = pTip; pDisconnect != pFork; pDisconnect = pDisconnect->pprev)
+    {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pDisconnect, chainParams))
+            return false;
+        if (DisconnectBlock(block, pDisconnect, view) != DISCONNECT_OK)
+            return false;
+    }
+
+    for (auto iter = vConnect.rbegin(); iter != vConnect.rend(); ++iter)
+    {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, *iter, chainParams))
+            return false;
+        for (const auto& tx : block.vtx)
+            UpdateCoins(*tx, view, (*iter)->nHeight);
+        view.SetBestBlock((*iter)->GetBlockHashPoW2());
+    }
+    return true;
+}
+
+bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain_, std::map<COutPoint, Coin>& allWitnessCoins, const CBlock* newBlock, CCoinsViewCache* viewOverride)
 {
     DO_BENCHMARK("WIT: getAllUnspentWitnessCoins", BCLog::BENCH|BCLog::WITNESS);
 
+    assert(pPreviousIndexChain_);
+
+    allWitnessCoins.clear();
+
+    if (pPreviousIndexChain_->nHeight < GetPhase2ActivationHeight())
+        return true;
+
+    // If we already know the witness set after pPreviousIndexChain_ then there is nothing to replay.
+    // Only for the real chain state (an override view may hold changes that aren't part of any block).
+    // Snapshots are immutable, so cs_main is only needed to look one up and not for (the potentially large) copy.
+    bool fStateAfterPrevious = false;
+    CWitnessSetIndex::Snapshot snapshot;
+    {
+        LOCK(cs_main);
+
+        // Whether the replay below results in the state after pPreviousIndexChain_ itself, i.e. not the phase 3 case where a witnessed block is replaced by its PoW block.
+        fStateAfterPrevious = (pPreviousIndexChain_->nVersionPoW2Witness==0 || IsPow2Phase4Active(pPreviousIndexChain_->pprev, chainParams, chain, viewOverride?viewOverride:pcoinsTip));
+
+        bool fTipView = (viewOverride == nullptr || viewOverride == pcoinsTip);
+        if (fTipView && !newBlock && fStateAfterPrevious)
+        {
+            snapshot = witnessSetIndex.Get(pPreviousIndexChain_->GetBlockHashPoW2());
+            if (!snapshot && pcoinsTip->GetBestBlock() == pPreviousIndexChain_->GetBlockHashPoW2())
+                snapshot = witnessSetIndex.GetTip();
+        }
+    }
+    if (snapshot)
+    {
+        allWitnessCoins = *snapshot;
+        return true;
+    }
+
     #ifdef ENABLE_WALLET
     LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:NULL);
     #else
     LOCK(cs_main);
     #endif
 
-    assert(pPreviousIndexChain_);
-
-    allWitnessCoins.clear();
     //fixme: (2.0.1) Add more error handling to this function.
     // Sort out pre-conditions.
     // We have to make sure that we are using a view and chain that includes the PoW block we are witnessing and all of its transactions as the tip.
@@ -980,58 +1431,62 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
     // NB!!! - It is important that we don't flush either of these before destructing, we want to throw the result away.
     CCoinsViewCache viewNew(viewOverride?viewOverride:pcoinsTip);
 
-    if (pPreviousIndexChain_->nHeight < GetPhase2ActivationHeight())
-        return true;
-
-    // We work on a clone of the chain to prevent modifying the actual chain.
     CBlockIndex* pPreviousIndexChain = nullptr;
-    CCloneChain tempChain(chain, GetPow2ValidationCloneHeight(chain, pPreviousIndexChain_, 2), pPreviousIndexChain_, pPreviousIndexChain);
+    std::unique_ptr<CChain> tempChain;
+    // Entry for the PoW block of a witness block at the tip of tempChain (see below), which doesn't own its entries.
+    std::unique_ptr<CBlockIndex> pPreviousIndexChainPoW;
     CValidationState state;
-    assert(pPreviousIndexChain);
 
-    // Force the tip of the chain to the block that comes before the block we are examining.
-    // For phase 3 this must be a PoW block - from phase 4 it should be a witness block 
-    if (pPreviousIndexChain->nVersionPoW2Witness==0 || IsPow2Phase4Active(pPreviousIndexChain->pprev, chainParams, tempChain, &viewNew))
+    // Where possible restore the state after pPreviousIndexChain_ from undo data; which doesn't require cloning the chain or validating any block again.
+    if (fStateAfterPrevious)
     {
-        ForceActivateChain(pPreviousIndexChain, nullptr, state, chainParams, tempChain, viewNew);
+        CCoinsViewCache viewRestore(&viewNew);
+        if (RestoreViewToBlock(chain, pPreviousIndexChain_, viewRestore, chainParams))
+        {
+            viewRestore.Flush();
+            pPreviousIndexChain = const_cast<CBlockIndex*>(pPreviousIndexChain_);
+            tempChain.reset(new CBranchChain(chain, pPreviousIndexChain));
+        }
     }
-    else
+
+    if (!tempChain)
     {
-        CBlockIndex* pPreviousIndexChainPoW = new CBlockIndex(*GetPoWBlockForPoSBlock(pPreviousIndexChain));
-        assert(pPreviousIndexChainPoW);
-        pPreviousIndexChainPoW->pprev = pPreviousIndexChain->pprev;
-        ForceActivateChainWithBlockAsTip(pPreviousIndexChain->pprev, nullptr, state, chainParams, tempChain, viewNew, pPreviousIndexChainPoW);
-        pPreviousIndexChain = tempChain.Tip();
+        // We work on a clone of the chain to prevent modifying the actual chain.
+        tempChain.reset(new CCloneChain(chain, GetPow2ValidationCloneHeight(chain, pPreviousIndexChain_, 2), pPreviousIndexChain_, pPreviousIndexChain));
+        assert(pPreviousIndexChain);
+
+        // Force the tip of the chain to the block that comes before the block we are examining.
+        // For phase 3 this must be a PoW block - from phase 4 it should be a witness block 
+        if (pPreviousIndexChain->nVersionPoW2Witness==0 || IsPow2Phase4Active(pPreviousIndexChain->pprev, chainParams, *tempChain, &viewNew))
+        {
+            ForceActivateChain(pPreviousIndexChain, nullptr, state, chainParams, *tempChain, viewNew);
+        }
+        else
+        {
+            CBlockIndex* pPoWIndex = GetPoWBlockForPoSBlock(pPreviousIndexChain);
+            if (!pPoWIndex)
+                return error("getAllUnspentWitnessCoins: Unable to find PoW block for witness block %s", pPreviousIndexChain->GetBlockHashPoW2().ToString());
+
+            // A copy of the PoW block index re-parented onto the parent of the witness block.
+            pPreviousIndexChainPoW.reset(new CBlockIndex(*pPoWIndex));
+            pPreviousIndexChainPoW->pprev = pPreviousIndexChain->pprev;
+            ForceActivateChainWithBlockAsTip(pPreviousIndexChain->pprev, nullptr, state, chainParams, *tempChain, viewNew, pPreviousIndexChainPoW.get());
+            pPreviousIndexChain = tempChain->Tip();
+        }
     }
 
     // If we have been passed a new tip block (not yet part of the chain) then add it to the chain now.
     if (newBlock)
     {
-        // Strip any witness information from the block we have been given we want a non-witness block as the tip in order to calculate the witness for it.
-        if (newBlock->nVersionPoW2Witness != 0)
-        {
-            for (unsigned int i = 1; i < newBlock->vtx.size(); i++)
-            {
-                if (newBlock->vtx[i]->IsCoinBase() && newBlock->vtx[i]->IsPoW2WitnessCoinBase())
-                {
-                    while (newBlock->vtx.size() > i)
-                    {
-                        newBlock->vtx.pop_back();
-                    }
-                    break;
-                }
-            }
-            newBlock->nVersionPoW2Witness = 0;
-            newBlock->nTimePoW2Witness = 0;
-            newBlock->hashMerkleRootPoW2Witness = uint256();
-            newBlock->witnessHeaderPoW2Sig.clear();
-        }
+        // We want a non-witness block as the tip in order to calculate the witness for it.
+        CBlock strippedBlock;
+        const CBlock& powBlock = GetBlockWithoutWitness(*newBlock, strippedBlock);
 
         // Place the block in question at the tip of the chain.
-        CBlockIndex indexDummy(*newBlock);
+        CBlockIndex indexDummy(powBlock);
         indexDummy.pprev = pPreviousIndexChain;
         indexDummy.nHeight = pPreviousIndexChain->nHeight + 1;
-        if (!ConnectBlock(tempChain, *newBlock, state, &indexDummy, viewNew, chainParams, true, false))
+        if (!ConnectBlock(*tempChain, powBlock, state, &indexDummy, viewNew, chainParams, true, false))
         {
             //fixme: (2.1) If we are inside a GetWitness call ban the peer that sent us this?
             return false;
@@ -1043,41 +1498,43 @@ bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, c
         Therefore the order of operations is crucial, we must first iterate the lowest layer, then the second lowest and finally the highest layer.
         For each iteration we should remove items from allWitnessCoins if they have been deleted in the higher layer as the higher layer overrides the lower layer.
         GetAllCoins takes care of all of this automatically.
+        The lowest layers (ppow2witTip and the witness database) hold the state of the current tip, which the witness set index usually has in memory already; in which case only the layers above it need to be walked.
     **/
-    viewNew.pChainedWitView->GetAllCoins(allWitnessCoins);
+    CWitnessSetIndex::Snapshot tipSnapshot = witnessSetIndex.GetTip();
+    if (tipSnapshot)
+        viewNew.pChainedWitView->GetAllCoinsAbove(ppow2witTip.get(), *tipSnapshot, allWitnessCoins);
+    else
+        viewNew.pChainedWitView->GetAllCoins(allWitnessCoins);
 
     return true;
 }
 
 
 //fixme: (2.0.1) Improve error handling.
-//fixme: (2.1) Handle nodes with excessive pruning. //pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
-bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+bool PrepareWitnessSelectionPool(CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
 {
-    DO_BENCHMARK("WIT: GetWitnessHelper", BCLog::BENCH|BCLog::WITNESS);
+    DO_BENCHMARK("WIT: PrepareWitnessSelectionPool", BCLog::BENCH|BCLog::WITNESS);
 
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
+    /** Sort the pool deterministically once up front, the filters below preserve order so the filtered pool comes out sorted regardless of how many passes it takes. **/
+    /** Whether a witness has expired doesn't depend on nMinAge either, so that too is only determined once; by the expiry queue, which only has to look at the witnesses close to expiring. **/
+    std::set<COutPoint> expiredWitnesses;
+    witnessExpiryQueue.GetExpired(witnessInfo.witnessSelectionPoolUnfiltered, nBlockHeight, witnessInfo.nTotalWeightRaw, expiredWitnesses);
+    std::vector<RouletteItem> sortedPool;
+    sortedPool.reserve(witnessInfo.witnessSelectionPoolUnfiltered.size());
+    std::copy_if(witnessInfo.witnessSelectionPoolUnfiltered.begin(), witnessInfo.witnessSelectionPoolUnfiltered.end(), std::back_inserter(sortedPool), [&](const RouletteItem& x){ return expiredWitnesses.count(x.outpoint) == 0; });
+    std::sort(sortedPool.begin(), sortedPool.end());
 
     /** Generate the pool of potential witnesses for the given block index **/
     /** Addresses younger than nMinAge blocks are discarded **/
     uint64_t nMinAge = gMinimumParticipationAge;
     while (true)
     {
-        witnessInfo.witnessSelectionPoolFiltered.clear();
-        witnessInfo.witnessSelectionPoolFiltered = witnessInfo.witnessSelectionPoolUnfiltered;
-
         /** Eliminate addresses that have witnessed within the last `gMinimumParticipationAge` blocks **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ return (x.nAge <= nMinAge); }), witnessInfo.witnessSelectionPoolFiltered.end());
-
-        /** Eliminate addresses that have not witnessed within the expected period of time that they should have **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ return witnessHasExpired(x.nAge, x.nWeight, witnessInfo.nTotalWeightRaw); }), witnessInfo.witnessSelectionPoolFiltered.end());
-
+        /** Eliminate addresses that have not witnessed within the expected period of time that they should have (already eliminated from sortedPool) **/
         /** Eliminate addresses that are within 100 blocks from lock period expiring, or whose lock period has expired. **/
-        witnessInfo.witnessSelectionPoolFiltered.erase(std::remove_if(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end(), [&](RouletteItem& x){ CTxOutPoW2Witness details; GetPow2WitnessOutput(x.coin.out, details); return (GetPoW2RemainingLockLengthInBlocks(details.lockUntilBlock, nBlockHeight) <= nMinAge); }), witnessInfo.witnessSelectionPoolFiltered.end());
+        witnessInfo.witnessSelectionPoolFiltered.clear();
+        witnessInfo.witnessSelectionPoolFiltered.reserve(sortedPool.size());
+        std::copy_if(sortedPool.begin(), sortedPool.end(), std::back_inserter(witnessInfo.witnessSelectionPoolFiltered), [&](const RouletteItem& x){ return x.nAge > nMinAge && GetPoW2RemainingLockLengthInBlocks(x.nLockUntilBlock, nBlockHeight) > nMinAge; });
 
         // We must have at least 100 accounts to keep odds of being selected down below 1% at all times.
         if (witnessInfo.witnessSelectionPoolFiltered.size() < 100)
@@ -1108,8 +1565,7 @@ bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t
         return error("Unable to determine any witnesses for block.");
     }
 
-    /** Ensure the pool is sorted deterministically **/
-    std::sort(witnessInfo.witnessSelectionPoolFiltered.begin(), witnessInfo.witnessSelectionPoolFiltered.end());
+    /** NB! The pool is already sorted deterministically (see sortedPool above) **/
 
     /** Calculate total eligible weight **/
     witnessInfo.nTotalWeightEligibleRaw = 0;
@@ -1139,7 +1595,11 @@ bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t
         witnessInfo.nTotalWeightEligibleAdjusted += item.nWeight;
         item.nCumulativeWeight = witnessInfo.nTotalWeightEligibleAdjusted;
     }
+    return true;
+}
 
+void SelectWitnessFromPool(const uint256& blockHash, CGetWitnessInfo& witnessInfo)
+{
     /** sha256 as random roulette spin/seed - NB! We delibritely use sha256 and -not- the normal PoW hash here as the normal PoW hash is biased towards certain number ranges by -design- (block target) so is not a good RNG... **/
     arith_uint256 rouletteSelectionSeed = UintToArith256(blockHash);
 
@@ -1162,26 +1622,51 @@ bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t
     witnessInfo.selectedWitnessTransaction = selectedWitness->coin.out;
     witnessInfo.selectedWitnessBlockHeight = selectedWitness->coin.nHeight;
     witnessInfo.selectedWitnessOutpoint = selectedWitness->outpoint;
-
-    return true;
 }
 
-bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
 {
-    DO_BENCHMARK("WIT: GetWitnessInfo", BCLog::BENCH|BCLog::WITNESS);
-
-    #ifdef DISABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
+    DO_BENCHMARK("WIT: GetWitnessHelper", BCLog::BENCH|BCLog::WITNESS);
 
-    // Fetch all unspent witness outputs for the chain in which -block- acts as the tip.
-    if (!getAllUnspentWitnessCoins(chain, chainParams, pPreviousIndexChain, witnessInfo.allWitnessCoins, &block, viewOverride))
+    if (!PrepareWitnessSelectionPool(witnessInfo, nBlockHeight))
         return false;
 
+    SelectWitnessFromPool(blockHash, witnessInfo);
+    return true;
+}
+
+// Whether the PoW part of block creates or spends any of the witness coins, i.e. whether the witness set after it differs from allWitnessCoins.
+static bool BlockChangesWitnessSet(const CBlock& block, const std::map<COutPoint, Coin>& allWitnessCoins)
+{
+    CBlock strippedBlock;
+    const CBlock& powBlock = GetBlockWithoutWitness(block, strippedBlock);
+    for (const auto& tx : powBlock.vtx)
+    {
+        for (const auto& out : tx->vout)
+        {
+            if (IsPow2WitnessOutput(out))
+                return true;
+        }
+        if (!tx->IsCoinBase())
+        {
+            for (const auto& in : tx->vin)
+            {
+                if (allWitnessCoins.count(in.prevout))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+void PopulateWitnessSelectionPool(CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+{
     // Gather all witnesses that exceed minimum weight and count the total witness weight.
-    for (auto coinIter : witnessInfo.allWitnessCoins)
+    // NB! witnessInfo may be reused across calls, clear() retains the capacity of the pool.
+    witnessInfo.witnessSelectionPoolUnfiltered.clear();
+    witnessInfo.witnessSelectionPoolUnfiltered.reserve(witnessInfo.allWitnessCoins.size());
+    witnessInfo.nTotalWeightRaw = 0;
+    for (const auto& coinIter : witnessInfo.allWitnessCoins)
     {
         //fixme: (2.0.1) Unit tests
         uint64_t nAge = nBlockHeight - coinIter.second.nHeight;
@@ -1193,29 +1678,78 @@ bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCa
             int64_t nWeight = GetPoW2RawWeightForAmount(coin.out.nValue, GetPoW2LockLengthInBlocksFromOutput(coin.out, coin.nHeight, nUnused1, nUnused2));
             if (nWeight < gMinimumWitnessWeight)
                 continue;
-            witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(outPoint, coin, nWeight, nAge));
+            CTxOutPoW2Witness details;
+            GetPow2WitnessOutput(coin.out, details);
+            witnessInfo.witnessSelectionPoolUnfiltered.push_back(RouletteItem(outPoint, coin, nWeight, nAge, details.lockUntilBlock));
             witnessInfo.nTotalWeightRaw += nWeight;
         }
     }
+}
+
+bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, const CBlock& block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight)
+{
+    DO_BENCHMARK("WIT: GetWitnessInfo", BCLog::BENCH|BCLog::WITNESS);
+
+    // Fetch all unspent witness outputs for the chain in which -block- acts as the tip.
+    // This takes the locks it needs itself; after which everything works on witnessInfo only so no locks are held for the remainder.
+    if (!getAllUnspentWitnessCoins(chain, chainParams, pPreviousIndexChain, witnessInfo.allWitnessCoins, &block, viewOverride))
+        return false;
+
+    PopulateWitnessSelectionPool(witnessInfo, nBlockHeight);
     return true;
 }
 
-bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo)
+bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, const CBlock& block, CGetWitnessInfo& witnessInfo)
 {
     DO_BENCHMARK("WIT: GetWitness", BCLog::BENCH|BCLog::WITNESS);
 
-    #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pactiveWallet?&pactiveWallet->cs_wallet:nullptr);
-    #else
-    LOCK(cs_main);
-    #endif
+    // NB! No locks are taken here, GetWitnessInfo takes them only for as long as it needs to capture the witness set and the selection itself works on witnessInfo alone.
+    uint256 prevHash = pPreviousIndexChain->GetBlockHashPoW2();
+    uint256 powHash = block.GetHashLegacy();
+    if (CWitnessSelectionCache::Result cached = witnessSelectionCache.Get(prevHash, powHash))
+    {
+        witnessInfo = *cached;
+        return true;
+    }
 
-    // Fetch all the chain info (for specific block) we will need to calculate the witness.
+    // If the pool for this height was prepared ahead of time and the PoW block doesn't change the witness set, only the roulette spin is left to do.
     uint64_t nBlockHeight = pPreviousIndexChain->nHeight + 1;
+    if (CWitnessPoolPrecompute::Pool pool = witnessPoolPrecompute.Get(prevHash))
+    {
+        if (!BlockChangesWitnessSet(block, pool->allWitnessCoins))
+        {
+            witnessInfo = *pool;
+            SelectWitnessFromPool(powHash, witnessInfo);
+            witnessSelectionCache.Add(prevHash, powHash, std::make_shared<const CGetWitnessInfo>(witnessInfo));
+            return true;
+        }
+    }
+
+    // Fetch all the chain info (for specific block) we will need to calculate the witness.
     if (!GetWitnessInfo(chain, chainParams, viewOverride, pPreviousIndexChain, block, witnessInfo, nBlockHeight))
         return false;
 
-    return GetWitnessHelper(block.GetHashLegacy(), witnessInfo, nBlockHeight);
+    if (!GetWitnessHelper(powHash, witnessInfo, nBlockHeight))
+        return false;
+
+    witnessSelectionCache.Add(prevHash, powHash, std::make_shared<const CGetWitnessInfo>(witnessInfo));
+    return true;
+}
+
+bool GetSelectedWitnessKeyID(const CGetWitnessInfo& witnessInfo, CKeyID& keyID)
+{
+    const CTxOut& output = witnessInfo.selectedWitnessTransaction;
+    if (output.GetType() <= CTxOutType::ScriptLegacyOutput)
+    {
+        keyID = CKeyID(uint160(output.output.scriptPubKey.GetPow2WitnessHash()));
+        return true;
+    }
+    else if (output.GetType() == CTxOutType::PoW2WitnessOutput)
+    {
+        keyID = output.output.witnessDetails.witnessKeyID;
+        return true;
+    }
+    return false;
 }
 
 // Ideally this should have been some hybrid of witInfo.nTotalWeight / witInfo.nReducedTotalWeight - as both independantly aren't perfect.
@@ -1255,17 +1789,16 @@ bool ExtractWitnessBlockFromWitnessCoinbase(CChain& chain, int nWitnessCoinbaseI
     std::vector<unsigned char> serialisedWitnessHeaderInfo = std::vector<unsigned char>(block.vtx[0]->vout[nWitnessCoinbaseIndex].output.scriptPubKey.begin() + 6, block.vtx[0]->vout[nWitnessCoinbaseIndex].output.scriptPubKey.end());
     CDataStream serialisedWitnessHeaderInfoStream(serialisedWitnessHeaderInfo, SER_NETWORK, INIT_PROTO_VERSION);
 
+    // Everything about the embedded witness header can be checked from the coinbase alone, so do that before going to disk for the transactions of the previous block.
+    int32_t nVersionPoW2Witness;
+    uint32_t nTimePoW2Witness;
+    uint256 hashMerkleRootPoW2Witness;
+    std::vector<unsigned char> witnessHeaderPoW2Sig(65);
     uint256 hashPrevPoWIndex;
-
-    // Reconstruct header information of previous witness block from the coinbase of this PoW block.
-    if (!ReadBlockFromDisk(embeddedWitnessBlock, pindexPrev, chainParams))
-        return false;
-
-    embeddedWitnessBlock.witnessHeaderPoW2Sig.resize(65);
-    ::Unserialize(serialisedWitnessHeaderInfoStream, embeddedWitnessBlock.nVersionPoW2Witness);
-    ::Unserialize(serialisedWitnessHeaderInfoStream, embeddedWitnessBlock.nTimePoW2Witness);
-    ::Unserialize(serialisedWitnessHeaderInfoStream, embeddedWitnessBlock.hashMerkleRootPoW2Witness);
-    ::Unserialize(serialisedWitnessHeaderInfoStream, NOSIZEVECTOR(embeddedWitnessBlock.witnessHeaderPoW2Sig));
+    ::Unserialize(serialisedWitnessHeaderInfoStream, nVersionPoW2Witness);
+    ::Unserialize(serialisedWitnessHeaderInfoStream, nTimePoW2Witness);
+    ::Unserialize(serialisedWitnessHeaderInfoStream, hashMerkleRootPoW2Witness);
+    ::Unserialize(serialisedWitnessHeaderInfoStream, NOSIZEVECTOR(witnessHeaderPoW2Sig));
     ::Unserialize(serialisedWitnessHeaderInfoStream, hashPrevPoWIndex);
 
     // Check prev hash
@@ -1273,13 +1806,22 @@ bool ExtractWitnessBlockFromWitnessCoinbase(CChain& chain, int nWitnessCoinbaseI
         return error("Embedded witness coinbase info contains mismatched prevHash.");
 
     // Check for valid signature size
-    if (embeddedWitnessBlock.witnessHeaderPoW2Sig.size() != 65)
+    if (witnessHeaderPoW2Sig.size() != 65)
         return error("Embedded witness coinbase info contains invalid signature size.");
 
     // Check that block is a witness block
-    if (embeddedWitnessBlock.nVersionPoW2Witness == 0)
+    if (nVersionPoW2Witness == 0)
         return error("Embedded witness coinbase info contains invalid witness version.");
 
+    // Reconstruct header information of previous witness block from the coinbase of this PoW block.
+    if (!ReadBlockFromDisk(embeddedWitnessBlock, pindexPrev, chainParams))
+        return false;
+
+    embeddedWitnessBlock.nVersionPoW2Witness = nVersionPoW2Witness;
+    embeddedWitnessBlock.nTimePoW2Witness = nTimePoW2Witness;
+    embeddedWitnessBlock.hashMerkleRootPoW2Witness = hashMerkleRootPoW2Witness;
+    embeddedWitnessBlock.witnessHeaderPoW2Sig = witnessHeaderPoW2Sig;
+
     // Reconstruct transaction information of previous witness block from the coinbase of this PoW block.
     CMutableTransaction coinbaseTx(CTransaction::CURRENT_VERSION);
     coinbaseTx.vin.resize(2);
@@ -7,6 +7,10 @@
 #define GULDEN_WITNESS_VALIDATION_H
 
 #include "validation/validation.h"
+#include "validation/validationinterface.h"
+
+class CScheduler;
+class CSingleThreadedSchedulerClient;
 
 //fixme: (2.0.1) - Properly document all of these; including pre/post conditions;
 //fixme: (2.0.1) implement unit tests.
@@ -17,14 +21,48 @@ extern std::shared_ptr<CCoinsViewCache> ppow2witTip;
 extern bool haveStaticFundingAddress(std::string sLookupAddress, uint64_t nHeight);
 extern std::string getStaticFundingAddress(std::string sLookupAddress, uint64_t nHeight);
 
+/** Number of witness set snapshots kept in memory (see CWitnessSetIndex) */
+static const unsigned int WITNESS_SET_SNAPSHOTS = 16;
+
+/** The unspent witness coins as of recent blocks, so that getAllUnspentWitnessCoins does not have to replay the chain and enumerate the whole witness database for blocks at or near the tip.
+ *  The witness set after a block does not depend on which chain is active so snapshots are keyed by block hash, immutable and remain valid across reorgs.
+ *  ConnectTip/DisconnectTip derive the snapshot of the new tip from that of the old one by applying the changes the block made to the witness view.
+ *  Protected by cs_main. */
+class CWitnessSetIndex
+{
+public:
+    typedef std::shared_ptr<const std::map<COutPoint, Coin>> Snapshot;
+
+    //! Snapshot of the witness set after blockHash, nullptr if there is none.
+    Snapshot Get(const uint256& blockHash);
+    //! Snapshot of the contents of ppow2witTip, enumerating the witness database once if we don't have it yet; nullptr if there is no witness view.
+    Snapshot GetTip();
+    //! Derive the snapshot for hashBlock from the one for hashPrev; witnessView is the (not yet flushed) witness view on top of ppow2witTip that holds the changes.
+    void BlockFlushed(const uint256& hashPrev, const uint256& hashBlock, const CCoinsViewCache& witnessView);
+    void Clear();
+    size_t DynamicMemoryUsage() const;
+private:
+    void Add(const uint256& blockHash, Snapshot snapshot);
+    struct Entry
+    {
+        Snapshot snapshot;
+        uint64_t nLastUse;
+    };
+    std::map<uint256, Entry> snapshots;
+    uint64_t nUseCounter = 0;
+};
+extern CWitnessSetIndex witnessSetIndex;
+
 struct RouletteItem
 {
 public:
-    RouletteItem(const COutPoint& outpoint_, const Coin& coin_, int64_t nWeight_, int64_t nAge_) : outpoint(outpoint_), coin(coin_), nWeight(nWeight_), nAge(nAge_), nCumulativeWeight(0) {};
+    RouletteItem(const COutPoint& outpoint_, const Coin& coin_, int64_t nWeight_, int64_t nAge_, uint64_t nLockUntilBlock_) : outpoint(outpoint_), coin(coin_), nWeight(nWeight_), nAge(nAge_), nLockUntilBlock(nLockUntilBlock_), nCumulativeWeight(0) {};
     COutPoint outpoint;
     Coin coin;
     uint64_t nWeight;
     uint64_t nAge;
+    //! lockUntilBlock of the witness output, kept here so that it doesn't have to be parsed out of the output again for every filtering pass
+    uint64_t nLockUntilBlock;
     uint64_t nCumulativeWeight;
 
     friend inline bool operator<(const RouletteItem& a, const RouletteItem& b)
@@ -38,6 +76,7 @@ public:
         return a.nCumulativeWeight < b;
     }
 };
+// May be reused for multiple GetWitnessInfo/GetWitness calls, the pools then keep their allocations.
 struct CGetWitnessInfo
 {
     //! All unspent witness coins on the network
@@ -73,6 +112,153 @@ struct CGetWitnessInfo
     uint64_t nMaxIndividualWeight = 0;
 };
 
+/** Number of witness selection results kept in memory (see CWitnessSelectionCache) */
+static const unsigned int WITNESS_SELECTION_CACHE_SIZE = 32;
+
+/** Results of GetWitness, so that asking who should witness the same PoW block again (witness thread, ConnectBlock, RPC) is a lookup instead of a full selection.
+ *  The selection only depends on the chain state after the previous block and on the PoW block itself; results are therefore keyed by (previous block PoW² hash, PoW block legacy hash) and never go stale.
+ *  On reorg results for PoW blocks on top of the disconnected block are dropped as they are unlikely to be asked for again.
+ *  Thread safe, doesn't require cs_main. */
+class CWitnessSelectionCache
+{
+public:
+    typedef std::shared_ptr<const CGetWitnessInfo> Result;
+
+    //! Cached result for the PoW block powHash on top of prevHash, nullptr if there is none.
+    Result Get(const uint256& prevHash, const uint256& powHash);
+    void Add(const uint256& prevHash, const uint256& powHash, Result result);
+    //! Forget all results for PoW blocks on top of prevHash.
+    void Erase(const uint256& prevHash);
+    void Clear();
+    size_t DynamicMemoryUsage();
+private:
+    struct Entry
+    {
+        Result result;
+        uint64_t nLastUse;
+    };
+    CCriticalSection cs;
+    std::map<std::pair<uint256, uint256>, Entry> results;
+    uint64_t nUseCounter = 0;
+};
+extern CWitnessSelectionCache witnessSelectionCache;
+
+/** Which witnesses of a selection pool have expired (see witnessHasExpired), without working out the expected witness period of every witness for every block.
+ *  Every witness is queued by the height at which it expires, projected with a total weight a little under the network weight at the time; the expected period
+ *  only grows with the network weight, so as long as the network weight stays at or above the projected one only the witnesses whose projected expiry has
+ *  passed need to be looked at. Witnesses over 1% of the projected weight have their weight capped, which doesn't grow in step, so those are always looked at.
+ *  The projection is redone when the network weight drops below the projected one, or grows so far above it that the queue gets too far ahead of itself.
+ *  Any pool can be passed in, the queue is brought in line with it first; which only costs a lookup per witness that didn't change since the previous call.
+ *  Thread safe, doesn't require cs_main. */
+class CWitnessExpiryQueue
+{
+public:
+    //! The outpoints of the witnesses in pool (for the block at nBlockHeight, with network weight nTotalWeightRaw) that have expired.
+    void GetExpired(const std::vector<RouletteItem>& pool, uint64_t nBlockHeight, uint64_t nTotalWeightRaw, std::set<COutPoint>& expired);
+    void Clear();
+    size_t DynamicMemoryUsage();
+private:
+    struct Entry
+    {
+        uint64_t nCoinHeight;
+        uint64_t nWeight;
+        //! Height after which the witness has expired if the network weight were nProjectedWeight; 0 for capped witnesses, which aren't queued.
+        uint64_t nExpiryHeight;
+        uint64_t nSeen;
+    };
+    void Project(const COutPoint& outpoint, Entry& entry);
+
+    CCriticalSection cs;
+    std::map<COutPoint, Entry> entries;
+    std::set<std::pair<uint64_t, COutPoint>> queue;
+    std::set<COutPoint> capped;
+    uint64_t nProjectedWeight = 0;
+    uint64_t nSyncCounter = 0;
+};
+extern CWitnessExpiryQueue witnessExpiryQueue;
+
+/** Number of precomputed witness selection pools kept in memory (see CWitnessPoolPrecompute) */
+static const unsigned int WITNESS_POOL_PRECOMPUTE_SIZE = 4;
+
+/** Number of blocks for which CWitnessPoolPrecompute remembers the network weight (about a day) */
+static const unsigned int WITNESS_WEIGHT_HISTORY_SIZE = 576;
+
+/** Witness totals of the network after a block, as the selection for the block after it sees them. */
+struct CWitnessNetworkWeight
+{
+    uint256 hashBlock;
+    uint64_t nHeight = 0;
+    uint64_t nWitnesses = 0;
+    uint64_t nEligibleWitnesses = 0;
+    uint64_t nTotalWeightRaw = 0;
+    uint64_t nTotalWeightEligibleRaw = 0;
+    uint64_t nTotalWeightEligibleAdjusted = 0;
+
+    CWitnessNetworkWeight() {}
+    CWitnessNetworkWeight(const uint256& hashBlockIn, uint64_t nHeightIn, const CGetWitnessInfo& witnessInfo);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nWitnesses);
+        READWRITE(nEligibleWitnesses);
+        READWRITE(nTotalWeightRaw);
+        READWRITE(nTotalWeightEligibleRaw);
+        READWRITE(nTotalWeightEligibleAdjusted);
+    }
+};
+
+/** Filtered and weight capped witness selection pools for the block after a given block; prepared in the background as soon as that block becomes the tip.
+ *  Apart from the roulette spin the selection only depends on the state after the previous block, so once the PoW block arrives only the final pick remains (see GetWitness).
+ *  A pool is only used for PoW blocks that don't create or spend witness coins themselves, GetWitness falls back to a full selection for any other block.
+ *  Thread safe, doesn't require cs_main. */
+class CWitnessPoolPrecompute : public CValidationInterface
+{
+public:
+    typedef std::shared_ptr<const CGetWitnessInfo> Pool;
+
+    //! Prepared pool for the block after prevHash, nullptr if there is none.
+    Pool Get(const uint256& prevHash);
+    //! Pool prepared for the most recent tip, with that tip; nullptr if there is none (yet). For readers that want the current witness set without cs_main.
+    Pool GetLatest(CWitnessNetworkWeight& tipWeight);
+    //! Network weight after each of the most recent tips, oldest first; blocks that were disconnected again are left out.
+    std::vector<CWitnessNetworkWeight> GetWeightHistory();
+    //! Prepare the pool for the block after pindexPrev unless we already have it; returns false if there is nothing to prepare (witnessing not active) or on failure.
+    bool Prepare(CChain& chain, const CChainParams& chainParams, CBlockIndex* pindexPrev);
+    //! Scheduler on which pools for new tips are prepared (one at a time, in tip order), nullptr to stop doing so.
+    void SetScheduler(CScheduler* scheduler);
+    void Clear();
+    size_t DynamicMemoryUsage();
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+private:
+    struct Entry
+    {
+        Pool pool;
+        uint64_t nLastUse;
+    };
+    //! Make the pool for the block after pindexTip the latest, and remember its weight.
+    void SetLatest(const CBlockIndex* pindexTip);
+
+    CCriticalSection cs;
+    std::map<uint256, Entry> pools;
+    uint64_t nUseCounter = 0;
+    std::unique_ptr<CSingleThreadedSchedulerClient> schedulerClient;
+    Pool latestPool;
+    //! By height.
+    std::map<uint64_t, CWitnessNetworkWeight> weightHistory;
+};
+extern CWitnessPoolPrecompute witnessPoolPrecompute;
+
+/** Memory used by a set of witness coins (e.g. a CWitnessSetIndex snapshot) */
+size_t WitnessCoinsDynamicMemoryUsage(const std::map<COutPoint, Coin>& witnessCoins);
+/** Memory used by the coins and selection pools of a witness selection */
+size_t WitnessInfoDynamicMemoryUsage(const CGetWitnessInfo& witnessInfo);
+
 int GetPoW2WitnessCoinbaseIndex(const CBlock& block);
 
 CAmount GetBlockSubsidyWitness(int nHeight);
@@ -97,13 +283,34 @@ uint64_t expectedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeigh
 // The average frequency which we are expected to witness in.
 uint64_t estimatedWitnessBlockPeriod(uint64_t nWeight, uint64_t networkTotalWeight);
 
-bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::map<COutPoint, Coin>& allWitnessCoins, CBlock* newBlock=nullptr, CCoinsViewCache* viewOverride=nullptr);
+/** The PoW part of block: block itself if it doesn't carry a witness, otherwise storage filled with the header minus the witness fields and the transactions before the witness coinbase.
+ *  Transactions are shared with block and not copied. */
+const CBlock& GetBlockWithoutWitness(const CBlock& block, CBlock& storage);
+
+/** Bring view, which must hold the state after the tip of chain, to the state after pindex.
+ *  The blocks of chain above the fork point with pindex are disconnected using their undo data, the blocks from the fork point up to pindex are applied as is; so no block index is cloned and no block is validated again.
+ *  Returns false, with view in an undefined state, if that isn't possible (block or undo data unavailable, or a block on the branch of pindex that was never connected). */
+bool RestoreViewToBlock(CChain& chain, const CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainParams);
+
+bool getAllUnspentWitnessCoins(CChain& chain, const CChainParams& chainParams, const CBlockIndex* pPreviousIndexChain, std::map<COutPoint, Coin>& allWitnessCoins, const CBlock* newBlock=nullptr, CCoinsViewCache* viewOverride=nullptr);
+
+//! Fill the unfiltered selection pool and total weight of witnessInfo from its allWitnessCoins.
+void PopulateWitnessSelectionPool(CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
+
+//! Filter and weight cap the selection pool of witnessInfo, everything in the selection of the witness that doesn't depend on the PoW block.
+bool PrepareWitnessSelectionPool(CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
+
+//! Pick the witness for the PoW block blockHash from the prepared pool.
+void SelectWitnessFromPool(const uint256& blockHash, CGetWitnessInfo& witnessInfo);
 
 bool GetWitnessHelper(uint256 blockHash, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
 
-bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
+bool GetWitnessInfo(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, const CBlock& block, CGetWitnessInfo& witnessInfo, uint64_t nBlockHeight);
+
+bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, const CBlock& block, CGetWitnessInfo& witnessInfo);
 
-bool GetWitness(CChain& chain, const CChainParams& chainParams, CCoinsViewCache* viewOverride, CBlockIndex* pPreviousIndexChain, CBlock block, CGetWitnessInfo& witnessInfo);
+/** The key the selected witness of witnessInfo has to sign the witnessed block with; false if the selected output can't witness. */
+bool GetSelectedWitnessKeyID(const CGetWitnessInfo& witnessInfo, CKeyID& keyID);
 
 bool witnessHasExpired(uint64_t nWitnessAge, uint64_t nWitnessWeight, uint64_t nNetworkTotalWitnessWeight);
 
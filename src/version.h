@@ -16,7 +16,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70016;
+static const int PROTOCOL_VERSION = 70017;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -57,4 +57,7 @@ static const int POW2_CAPABLE_VERSION = 70015;
 //! Reverse headers for fast header synchronisation from last checkpoint
 static const int REVERSEHEADERS_VERSION = 70016;
 
+//! "witnessdelta" announcements of witnessed blocks start with this version
+static const int WITNESS_DELTA_VERSION = 70017;
+
 #endif // GULDEN_VERSION_H
@@ -17,6 +17,8 @@
 #include "util.h"
 #include <validation/validation.h>
 
+#include <thread>
+
 bool fShowChildAccountsSeperately = false;
 
 static void AllocateShadowAccountsIfNeeded(int nAccountPoolTargetSize, int nAccountPoolTargetSizeWitness, int& nNumNewAccountsAllocated, bool& tryLockWallet)
@@ -94,6 +96,83 @@ static void AllocateShadowAccountsIfNeeded(int nAccountPoolTargetSize, int nAcco
     }
 }
 
+//! Most threads to derive keypool keys ahead of time with.
+static const int KEYPOOL_DERIVE_MAX_THREADS = 4;
+//! Fewer keys than this to derive aren't worth starting threads for.
+static const size_t KEYPOOL_DERIVE_MIN_KEYS_PER_THREAD = 16;
+
+/**
+ * Derive the child keys that topping up the keypools of the HD accounts to nTargetKeypoolSize will need, spread over a few threads and without holding
+ * the wallet lock; only handing them to their accounts takes it. TopUpKeyPool then only has to write them out.
+ */
+static void DeriveKeyPoolKeysAhead(CWallet* pwallet, unsigned int nTargetKeypoolSize)
+{
+    // Consecutive children of a chain are derived together (see CExtPubKey::DeriveRange), in runs short enough to keep all threads busy.
+    struct KeysToDerive
+    {
+        boost::uuids::uuid accountUUID;
+        int keyChain;
+        CExtPubKey chainKey;
+        uint32_t nFirstChild;
+        uint32_t nCount;
+        std::vector<CExtPubKey> vChildKeys;
+    };
+    std::vector<KeysToDerive> vKeys;
+    size_t nKeys = 0;
+    {
+        LOCK(pwallet->cs_wallet);
+        for (const auto& [accountUUID, account] : pwallet->mapAccounts)
+        {
+            if (!account->IsHD() || account->IsFixedKeyPool())
+                continue;
+            CAccountHD* accountHD = dynamic_cast<CAccountHD*>(account);
+            unsigned int nFinalTargetSize = account->IsMinimalKeyPool() ? 1 : nTargetKeypoolSize;
+            for (auto keyChain : { KEYCHAIN_EXTERNAL, KEYCHAIN_CHANGE })
+            {
+                const auto& keyPool = ( keyChain == KEYCHAIN_EXTERNAL ? account->setKeyPoolExternal : account->setKeyPoolInternal );
+                if (keyPool.size() >= nFinalTargetSize)
+                    continue;
+                for (uint32_t nChild : accountHD->GetChildIndexesToDerive(keyChain, nFinalTargetSize - keyPool.size()))
+                {
+                    KeysToDerive* run = vKeys.empty() ? nullptr : &vKeys.back();
+                    if (run && run->accountUUID == accountUUID && run->keyChain == keyChain && run->nFirstChild + run->nCount == nChild && run->nCount < KEYPOOL_DERIVE_MIN_KEYS_PER_THREAD)
+                        ++run->nCount;
+                    else
+                        vKeys.push_back(KeysToDerive{accountUUID, keyChain, accountHD->GetChainKeyPub(keyChain), nChild, 1, {}});
+                    ++nKeys;
+                }
+            }
+        }
+    }
+    if (vKeys.empty())
+        return;
+
+    std::atomic<size_t> nNext(0);
+    auto deriveKeys = [&]()
+    {
+        for (size_t i = nNext++; i < vKeys.size(); i = nNext++)
+            vKeys[i].chainKey.DeriveRange(vKeys[i].vChildKeys, vKeys[i].nFirstChild, vKeys[i].nCount);
+    };
+    int nThreads = std::max(1, std::min({GetNumCores(), KEYPOOL_DERIVE_MAX_THREADS, (int)(nKeys / KEYPOOL_DERIVE_MIN_KEYS_PER_THREAD)}));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(deriveKeys);
+    deriveKeys();
+    for (auto& thread : vThreads)
+        thread.join();
+
+    LOCK(pwallet->cs_wallet);
+    for (const auto& keys : vKeys)
+    {
+        // The account may have gone away in the meantime; a run that failed to derive is left for GetPubKey to derive one by one.
+        auto findIter = pwallet->mapAccounts.find(keys.accountUUID);
+        if (findIter == pwallet->mapAccounts.end())
+            continue;
+        for (const CExtPubKey& childKey : keys.vChildKeys)
+            dynamic_cast<CAccountHD*>(findIter->second)->AddDerivedChildKey(keys.keyChain, childKey);
+    }
+}
+
 static void ThreadShadowPoolManager()
 {
     static bool promptOnceForAccountGenerationUnlock = true;
@@ -109,7 +188,10 @@ static void ThreadShadowPoolManager()
 
         if (pactiveWallet)
         {
+            DeriveKeyPoolKeysAhead(pactiveWallet, nKeyPoolTargetDepth);
+
             LOCK2(cs_main, pactiveWallet->cs_wallet);
+            CWalletDBBatchScope batchScope(pactiveWallet->GetDBHandle());
 
             int nNumNewAccountsAllocated = 0;
 
@@ -218,9 +300,15 @@ void StartShadowPoolManagerThread(boost::thread_group& threadGroup)
 }
 
 std::string accountNameForAddress(const CWallet &wallet, const CTxDestination& dest)
+{
+    CAccount* account = accountForAddress(wallet, dest);
+    return account ? account->getLabel() : "";
+}
+
+CAccount* accountForAddress(const CWallet &wallet, const CTxDestination& dest)
 {
     LOCK(wallet.cs_wallet);
-    std::string accountNameForAddress;
+    CAccount* accountForAddress = nullptr;
 
     isminetype ret = isminetype::ISMINE_NO;
     for (const auto& accountItem : wallet.mapAccounts)
@@ -231,19 +319,208 @@ std::string accountNameForAddress(const CWallet &wallet, const CTxDestination& d
             if (temp > ret)
             {
                 ret = temp;
-                accountNameForAddress = accountItem.second->getLabel();
+                accountForAddress = accountItem.second;
             }
         }
     }
     if (ret < isminetype::ISMINE_WATCH_ONLY)
-        return "";
-    return accountNameForAddress;
+        return nullptr;
+    return accountForAddress;
+}
+
+/**
+ * The keys scriptPubKey pays to, if it is of a kind that is spendable by us exactly when any account has one of them (see
+ * IsMine(const CKeyStore&, const CScript&)); false for scripts that need more than that, such as P2SH and multisig.
+ */
+static bool GetKeysForIsMine(const CScript& scriptPubKey, std::vector<CKeyID>& keyIDs)
+{
+    std::vector<std::vector<unsigned char>> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+    switch (whichType)
+    {
+        case TX_NULL_DATA:
+            keyIDs.clear();
+            return true;
+        case TX_PUBKEY:
+            keyIDs = { CPubKey(vSolutions[0]).GetID() };
+            return true;
+        case TX_PUBKEYHASH:
+            keyIDs = { CKeyID(uint160(vSolutions[0])) };
+            return true;
+        case TX_PUBKEYHASH_POW2WITNESS:
+            keyIDs = { CKeyID(uint160(vSolutions[0])), CKeyID(uint160(vSolutions[1])) };
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool GetKeysForIsMine(const CTxOut& out, std::vector<CKeyID>& keyIDs)
+{
+    switch (out.GetType())
+    {
+        case CTxOutType::ScriptLegacyOutput:
+            return GetKeysForIsMine(out.output.scriptPubKey, keyIDs);
+        case CTxOutType::PoW2WitnessOutput:
+            keyIDs = { out.output.witnessDetails.spendingKeyID, out.output.witnessDetails.witnessKeyID };
+            return true;
+        case CTxOutType::StandardKeyHashOutput:
+            keyIDs = { out.output.standardKeyHash.keyID };
+            return true;
+    }
+    return false;
+}
+
+static isminetype IsMineByKeys(const CWallet& wallet, const std::vector<CKeyID>& keyIDs)
+{
+    for (const CKeyID& keyID : keyIDs)
+    {
+        if (wallet.GetAccountsForKey(keyID))
+            return ISMINE_SPENDABLE;
+    }
+    return ISMINE_NO;
+}
+
+//! Most threads to decrypt account and seed keys with on unlock.
+static const int WALLET_UNLOCK_MAX_THREADS = 8;
+//! Fewer accounts than this to unlock aren't worth starting threads for.
+static const size_t WALLET_UNLOCK_MIN_ACCOUNTS_PER_THREAD = 8;
+
+bool CGuldenWallet::UnlockWithMasterKey(const CKeyingMaterial& vMasterKeyIn) const
+{
+    LOCK(cs_wallet);
+
+    std::vector<CAccount*> vAccounts;
+    vAccounts.reserve(mapAccounts.size());
+    for (const auto& [accountUUID, account] : mapAccounts)
+    {
+        (unused)accountUUID;
+        vAccounts.push_back(account);
+    }
+    std::vector<CHDSeed*> vSeeds;
+    vSeeds.reserve(mapSeeds.size());
+    for (const auto& [seedUUID, seed] : mapSeeds)
+    {
+        (unused)seedUUID;
+        vSeeds.push_back(seed);
+    }
+
+    // Every account and seed only touches its own keys when unlocking, so they can be unlocked side by side. Accounts that want upgrading are
+    // only noted here, they are written out afterwards.
+    const size_t nItems = vAccounts.size() + vSeeds.size();
+    std::vector<char> vUnlocked(nItems, false);
+    std::vector<char> vNeedsWrite(vAccounts.size(), false);
+    auto unlockItem = [&](size_t i)
+    {
+        if (i < vAccounts.size())
+        {
+            bool needsWriteToDisk = false;
+            vUnlocked[i] = vAccounts[i]->Unlock(vMasterKeyIn, needsWriteToDisk);
+            vNeedsWrite[i] = needsWriteToDisk;
+        }
+        else
+        {
+            vUnlocked[i] = vSeeds[i - vAccounts.size()]->Unlock(vMasterKeyIn);
+        }
+    };
+
+    // A wrong key fails on the first account already; don't keep every core busy finding that out for all the others.
+    size_t nFirst = 0;
+    if (nItems > 0)
+    {
+        unlockItem(0);
+        if (!vUnlocked[0])
+            return false;
+        nFirst = 1;
+    }
+
+    std::atomic<size_t> nNext(nFirst);
+    auto unlockItems = [&]()
+    {
+        for (size_t i = nNext++; i < nItems; i = nNext++)
+            unlockItem(i);
+    };
+    int nThreads = std::max(1, std::min({GetNumCores(), WALLET_UNLOCK_MAX_THREADS, (int)((nItems - nFirst) / WALLET_UNLOCK_MIN_ACCOUNTS_PER_THREAD)}));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(unlockItems);
+    unlockItems();
+    for (auto& thread : vThreads)
+        thread.join();
+
+    // Unlocking can upgrade every account at once; write them out with a single flush.
+    CWalletDBBatchScope batchScope(*dbw);
+    for (size_t i = 0; i < vAccounts.size(); ++i)
+    {
+        if (vNeedsWrite[i])
+        {
+            CWalletDB db(*dbw);
+            if (!db.WriteAccount(getUUIDAsString(vAccounts[i]->getUUID()), vAccounts[i]))
+            {
+                throw std::runtime_error("Writing account failed");
+            }
+        }
+    }
+    return std::all_of(vUnlocked.begin(), vUnlocked.end(), [](char fUnlocked) { return fUnlocked; });
+}
+
+const std::vector<CAccount*>* CGuldenWallet::GetAccountsForKey(const CKeyID& keyID) const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (fAccountKeysDirty || nAccountKeysChangeCounter != CBasicKeyStore::nChangeCounter || mapAccountKeysRead.size() != mapAccounts.size())
+    {
+        // Noted before the keys are read, so that a key that comes in meanwhile leaves the index stale instead of incomplete.
+        nAccountKeysChangeCounter = CBasicKeyStore::nChangeCounter;
+        if (fAccountKeysDirty)
+        {
+            mapAccountKeys.clear();
+            mapAccountKeysRead.clear();
+            fAccountKeysDirty = false;
+        }
+        // With thousands of (watch only) accounts topping up their lookahead one at a time, only the accounts that got keys are read again.
+        std::set<CKeyID> setKeys;
+        for (const auto& [accountUUID, account] : mapAccounts)
+        {
+            (unused)accountUUID;
+            const uint64_t nKeysChangeCounter = account->GetKeysChangeCounter();
+            auto [itRead, fNewAccount] = mapAccountKeysRead.emplace(account, nKeysChangeCounter);
+            if (!fNewAccount)
+            {
+                if (itRead->second == nKeysChangeCounter)
+                    continue;
+                itRead->second = nKeysChangeCounter;
+            }
+            account->GetKeys(setKeys);
+            for (const CKeyID& accountKeyID : setKeys)
+            {
+                std::vector<CAccount*>& vAccounts = mapAccountKeys[accountKeyID];
+                if (fNewAccount || std::find(vAccounts.begin(), vAccounts.end(), account) == vAccounts.end())
+                    vAccounts.push_back(account);
+            }
+        }
+        // An account that was swapped out of mapAccounts without MarkAccountKeysDirty; start over rather than keep pointing at it.
+        if (mapAccountKeysRead.size() != mapAccounts.size())
+        {
+            fAccountKeysDirty = true;
+            return GetAccountsForKey(keyID);
+        }
+    }
+
+    auto it = mapAccountKeys.find(keyID);
+    return it == mapAccountKeys.end() ? nullptr : &it->second;
 }
 
 isminetype IsMine(const CWallet &wallet, const CTxDestination& dest)
 {
     LOCK(wallet.cs_wallet);
 
+    std::vector<CKeyID> keyIDs;
+    if (GetKeysForIsMine(GetScriptForDestination(dest), keyIDs))
+        return IsMineByKeys(wallet, keyIDs);
+
     isminetype ret = isminetype::ISMINE_NO;
     for (const auto& accountItem : wallet.mapAccounts)
     {
@@ -261,6 +538,11 @@ isminetype IsMine(const CWallet &wallet, const CTxOut& out)
 {
     LOCK(wallet.cs_wallet);
 
+    // Almost every output pays to keys, for which the index of account keys answers for all accounts at once.
+    std::vector<CKeyID> keyIDs;
+    if (GetKeysForIsMine(out, keyIDs))
+        return IsMineByKeys(wallet, keyIDs);
+
     isminetype ret = isminetype::ISMINE_NO;
     for (const auto& [accountUUID, account] : wallet.mapAccounts)
     {
@@ -516,6 +798,7 @@ void CGuldenWallet::deleteAccount(CAccount* account, bool shouldPurge)
 
         mapAccountLabels.erase(mapAccountLabels.find(account->getUUID()));
         mapAccounts.erase(mapAccounts.find(account->getUUID()));
+        MarkAccountKeysDirty();
 
         // Make sure we are no longer the active account
         if(getActiveAccount()->getUUID() == account->getUUID())
@@ -25,6 +25,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -41,6 +42,8 @@ void StartShadowPoolManagerThread(boost::thread_group& threadGroup);
 extern bool fShowChildAccountsSeperately;
 
 std::string accountNameForAddress(const CWallet &wallet, const CTxDestination& dest);
+//! The account of the wallet that dest belongs to, nullptr if none.
+CAccount* accountForAddress(const CWallet &wallet, const CTxDestination& dest);
 isminetype IsMine(const CWallet &wallet, const CTxDestination& dest);
 isminetype IsMine(const CWallet &wallet, const CTxOut& out);
 
@@ -86,31 +89,8 @@ public:
         return ret;
     }
 
-    bool UnlockWithMasterKey(const CKeyingMaterial& vMasterKeyIn) const
-    {
-        LOCK(cs_wallet);
-        bool ret = true;
-        for (auto accountPair : mapAccounts)
-        {
-            bool needsWriteToDisk = false;
-            if (!accountPair.second->Unlock(vMasterKeyIn, needsWriteToDisk))
-                ret = false;
-            if (needsWriteToDisk)
-            {
-                CWalletDB db(*dbw);
-                if (!db.WriteAccount(getUUIDAsString(accountPair.second->getUUID()), accountPair.second))
-                {
-                    throw std::runtime_error("Writing account failed");
-                }
-            }
-        }
-        for (auto seedPair : mapSeeds)
-        {
-            if (!seedPair.second->Unlock(vMasterKeyIn))
-                ret = false;
-        }
-        return ret;
-    }
+    //! Unlock every account and seed; the key is tried on one of them first so that a wrong one fails fast, the rest are decrypted on several threads.
+    bool UnlockWithMasterKey(const CKeyingMaterial& vMasterKeyIn) const;
 
 
     virtual bool IsCrypted() const
@@ -281,6 +261,18 @@ public:
     //! for wallet upgrade
     void ForceRewriteKeys(CAccount& forAccount);
 
+    struct KeyIDHasher
+    {
+        size_t operator()(const CKeyID& keyID) const { return keyID.GetUint64(0); }
+    };
+
+    //! The index of GetAccountsForKey, up to date while CBasicKeyStore::nChangeCounter stays as it was when it was last brought up to date.
+    mutable std::unordered_map<CKeyID, std::vector<CAccount*>, KeyIDHasher> mapAccountKeys;
+    mutable uint64_t nAccountKeysChangeCounter = 0;
+    //! The keys change counter of every account as it was when its keys were read into the index; only accounts that have moved on are read again.
+    mutable std::unordered_map<const CAccount*, uint64_t> mapAccountKeysRead;
+    mutable bool fAccountKeysDirty = true;
+
     // The 'shadow pool thread' sets delay lock true if it had a backlog of work it wants to do on the unlocked wallet
     bool delayLock;
     bool wantDelayLock;
@@ -292,6 +284,11 @@ public:
     std::map<boost::uuids::uuid, std::string> mapAccountLabels;
     std::map<uint256, CWalletTx> mapWallet;
 
+    //! The accounts that have keyID, or nullptr if none does; a lookup in an index of the keys of every account, so that IsMine doesn't have to ask them one by one. Requires cs_wallet.
+    const std::vector<CAccount*>* GetAccountsForKey(const CKeyID& keyID) const;
+    //! Have GetAccountsForKey rebuild its index; for accounts that go away, new accounts and new keys are noticed without.
+    void MarkAccountKeysDirty() const { fAccountKeysDirty = true; }
+
     CAccount* activeAccount;
     CHDSeed* activeSeed;
 
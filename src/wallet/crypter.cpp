@@ -12,6 +12,7 @@
 #include "crypter.h"
 
 #include "crypto/sha512.h"
+#include "memusage.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "util.h"
@@ -189,6 +190,7 @@ bool CCryptoKeyStore::SetCrypted()
     if (!mapKeys.empty())
         return false;
     fUseCrypto = true;
+    NoteChange();
     return true;
 }
 
@@ -286,6 +288,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
             return false;
 
         mapCryptedKeys[vchPubKey.GetID()] = std::pair(vchPubKey, vchCryptedSecret);
+        NoteChange();
     }
     return true;
 }
@@ -361,6 +364,7 @@ bool CCryptoKeyStore::EncryptKeys(const CKeyingMaterial& vMasterKeyIn)
             return false;
 
         fUseCrypto = true;
+        NoteChange();
         for(KeyMap::value_type& mKey : mapKeys)
         {
             const CKey &key = mKey.second;
@@ -376,3 +380,13 @@ bool CCryptoKeyStore::EncryptKeys(const CKeyingMaterial& vMasterKeyIn)
     }
     return true;
 }
+
+size_t CCryptoKeyStore::DynamicMemoryUsage() const
+{
+    size_t nUsage = CBasicKeyStore::DynamicMemoryUsage();
+    LOCK(cs_KeyStore);
+    nUsage += memusage::DynamicUsage(mapCryptedKeys);
+    for (const auto& entry : mapCryptedKeys)
+        nUsage += memusage::DynamicUsage(entry.second.second);
+    return nUsage;
+}
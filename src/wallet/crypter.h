@@ -172,6 +172,8 @@ protected:
 
     virtual bool Lock();
 
+    size_t DynamicMemoryUsage() const override;
+
     virtual bool AddCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret);
     virtual bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
     virtual bool AddKeyPubKey(int64_t HDKeyIndex, const CPubKey &pubkey);
@@ -358,7 +358,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
+CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdbw(&dbw), pdb(NULL), activeTxn(NULL)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -438,6 +438,31 @@ void CWalletDBWrapper::IncrementUpdateCounter()
     ++nUpdateCounter;
 }
 
+void CWalletDBWrapper::FlushLog()
+{
+    if (IsDummy())
+        return;
+    nLastCloseFlushed = nUpdateCounter.load();
+    env->dbenv->txn_checkpoint(0, 0, 0);
+}
+
+bool CWalletDBWrapper::IsFlushDeferred() const
+{
+    return nBatchScopes > 0 && nUpdateCounter - nLastCloseFlushed < WALLET_DB_BATCH_FLUSH_WRITES;
+}
+
+CWalletDBBatchScope::CWalletDBBatchScope(CWalletDBWrapper& dbwIn)
+: dbw(dbwIn)
+{
+    ++dbw.nBatchScopes;
+}
+
+CWalletDBBatchScope::~CWalletDBBatchScope()
+{
+    if (--dbw.nBatchScopes == 0 && dbw.nUpdateCounter != dbw.nLastCloseFlushed)
+        dbw.FlushLog();
+}
+
 void CDB::Close()
 {
     if (!pdb)
@@ -447,8 +472,11 @@ void CDB::Close()
     activeTxn = NULL;
     pdb = NULL;
 
-    if (fFlushOnClose)
+    if (fFlushOnClose && !pdbw->IsFlushDeferred())
+    {
+        pdbw->nLastCloseFlushed = pdbw->nUpdateCounter.load();
         Flush();
+    }
 
     {
         LOCK(env->cs_db);
@@ -28,6 +28,8 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+//! Writes that may pile up under a CWalletDBBatchScope before a handle that closes flushes them anyway.
+static const unsigned int WALLET_DB_BATCH_FLUSH_WRITES = 1000;
 
 class CDBEnv
 {
@@ -102,13 +104,13 @@ class CWalletDBWrapper
     friend class CDB;
 public:
     /** Create dummy DB handle */
-    CWalletDBWrapper() : nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), env(nullptr)
+    CWalletDBWrapper() : nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), nBatchScopes(0), nLastCloseFlushed(0), env(nullptr)
     {
     }
 
     /** Create DB handle to real database */
     CWalletDBWrapper(CDBEnv *env_in, const std::string &strFile_in) :
-        nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), env(env_in), strFile(strFile_in)
+        nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), nBatchScopes(0), nLastCloseFlushed(0), env(env_in), strFile(strFile_in)
     {
     }
 
@@ -130,12 +132,25 @@ public:
 
     void IncrementUpdateCounter();
 
+    /** Flush the database log to disk now, as a closing CDB otherwise does.
+     */
+    void FlushLog();
+
+    /** Whether a closing CDB should leave the flush to the CWalletDBBatchScope it is under.
+     */
+    bool IsFlushDeferred() const;
+
     std::atomic<unsigned int> nUpdateCounter;
     unsigned int nLastSeen;
     unsigned int nLastFlushed;
     int64_t nLastWalletUpdate;
 
 private:
+    friend class CWalletDBBatchScope;
+    std::atomic<int> nBatchScopes;
+    //! nUpdateCounter as of the last flush on close (or FlushLog).
+    std::atomic<unsigned int> nLastCloseFlushed;
+
     /** BerkeleyDB specific */
     CDBEnv *env;
     std::string strFile;
@@ -148,10 +163,32 @@ private:
 };
 
 
+/**
+ * While one of these is alive, CDB handles of dbw don't flush the log to disk each time they close, as they otherwise do for
+ * every single write; the flush is done once when the last scope ends, or by a closing handle once WALLET_DB_BATCH_FLUSH_WRITES
+ * writes have piled up. For long runs of small writes, such as rescans and keypool top ups.
+ * Every write remains its own BerkeleyDB transaction (DB_AUTO_COMMIT), so a crash in between loses at most the tail of the
+ * writes, never leaves part of one behind; the same as for writes between two periodic flushes (see MaybeCompactWalletDB).
+ */
+class CWalletDBBatchScope
+{
+public:
+    explicit CWalletDBBatchScope(CWalletDBWrapper& dbwIn);
+    ~CWalletDBBatchScope();
+
+private:
+    CWalletDBBatchScope(const CWalletDBBatchScope&);
+    void operator=(const CWalletDBBatchScope&);
+
+    CWalletDBWrapper& dbw;
+};
+
+
 /** RAII class that provides access to a Berkeley database */
 class CDB
 {
 protected:
+    CWalletDBWrapper* pdbw;
     Db* pdb;
     std::string strFile;
     DbTxn* activeTxn;
@@ -61,7 +61,8 @@ public:
 
     void SetTx(CTransactionRef arg)
     {
-        tx = std::move(arg);
+        // Wallet transactions outlive the block they came in with.
+        tx = DetachFromArena(arg);
     }
 
     ADD_SERIALIZE_METHODS;
@@ -34,6 +34,7 @@
 #include "wallet/walletdb.h"
 #include "script/ismine.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include <univalue.h>
@@ -1671,15 +1672,17 @@ UniValue listtransactions(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() > 4)
+    if (request.fHelp || request.params.size() > 5)
         throw std::runtime_error(
-            "listtransactions ( \"account\" count skip include_watchonly)\n"
+            "listtransactions ( \"account\" count skip include_watchonly cursor)\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) The account UUID or unique label. \"*\" for all accounts.\n"
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. skip           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. include_watchonly (bool, optional, default=false) Include transactions to watch-only addresses (see 'importaddress')\n"
+            "5. cursor         (numeric, optional) Only list transactions from before this 'orderpos'; pass the lowest 'orderpos' of a page to get\n"
+            "                  the page before it. Unlike 'skip' this costs only what is returned, however deep into the history.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1719,6 +1722,7 @@ UniValue listtransactions(const JSONRPCRequest& request)
             "                                                     may be unknown for unconfirmed transactions not in the mempool\n"
             "    \"abandoned\": xxx          (bool) 'true' if the transaction has been abandoned (inputs are respendable). Only available for the \n"
             "                                         'send' category of transactions.\n"
+            "    \"orderpos\": n            (numeric) The position of the transaction in the wallet, for use as 'cursor'.\n"
             "  }\n"
             "]\n"
 
@@ -1727,6 +1731,8 @@ UniValue listtransactions(const JSONRPCRequest& request)
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList the 20 transactions before the one at orderpos 5000\n"
+            + HelpExampleCli("listtransactions", "\"*\" 20 0 false 5000") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
         );
@@ -1746,6 +1752,9 @@ UniValue listtransactions(const JSONRPCRequest& request)
     if(request.params.size() > 3)
         if(request.params[3].get_bool())
             filter = filter | ISMINE_WATCH_ONLY;
+    int64_t nCursor = std::numeric_limits<int64_t>::max();
+    if (request.params.size() > 4 && !request.params[4].isNull())
+        nCursor = request.params[4].get_int64();
 
     if (nCount < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
@@ -1756,15 +1765,21 @@ UniValue listtransactions(const JSONRPCRequest& request)
 
     const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
 
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    // iterate backwards, from just before the cursor, until we have nCount items to return:
+    for (CWallet::TxItems::const_reverse_iterator it(txOrdered.lower_bound(nCursor)); it != txOrdered.rend(); ++it)
     {
+        UniValue entries(UniValue::VARR);
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
-            ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+            ListTransactions(pwallet, *pwtx, strAccount, 0, true, entries, filter);
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, entries);
+        for (UniValue entry : entries.getValues())
+        {
+            entry.push_back(Pair("orderpos", (*it).first));
+            ret.push_back(entry);
+        }
 
         if ((int)ret.size() >= (nCount+nFrom)) break;
     }
@@ -3290,7 +3305,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false,  {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false,  {"min_conf","include_empty","include_watchonly"} },
     { "wallet",             "listsinceblock",           &listsinceblock,           false,  {"blockhash","target_confirmations","include_watchonly"} },
-    { "wallet",             "listtransactions",         &listtransactions,         false,  {"account","count","skip","include_watchonly"} },
+    { "wallet",             "listtransactions",         &listtransactions,         false,  {"account","count","skip","include_watchonly","cursor"} },
     { "wallet",             "listunspent",              &listunspent,              false,  {"min_conf","max_conf","addresses","include_unsafe","query_options"} },
     { "wallet",             "listunspentforaccount",    &listunspentforaccount,    false,  {"account","min_conf","max_conf","addresses","include_unsafe","query_options"} },
     { "wallet",             "lockunspent",              &lockunspent,              true,   {"unlock","transactions"} },
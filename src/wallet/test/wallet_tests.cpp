@@ -21,6 +21,8 @@
 #include "test/test_gulden.h"
 #include "validation/validation.h"
 #include "blockstore.h"
+#include "utiltime.h"
+#include "validation/blockfilterindex.h"
 #include "wallet/test/wallet_test_fixture.h"
 
 #include <boost/test/unit_test.hpp>
@@ -357,6 +359,32 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_exact_match)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.GenerateNewLegacyAccount("My account");
+    empty_wallet();
+
+    // Only five of the big coins together with all three small ones make the target, which needs no change.
+    for (int i = 0; i < 200; i++)
+        add_coin(wallet, 37 * CENT);
+    add_coin(wallet, 1 * CENT);
+    add_coin(wallet, 2 * CENT);
+    add_coin(wallet, 4 * CENT);
+    for (int i = 0; i < RUN_TESTS; i++)
+    {
+        BOOST_CHECK(wallet.SelectCoinsMinConf(192 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet));
+        BOOST_CHECK_EQUAL(nValueRet, 192 * CENT);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 8U);
+    }
+
+    empty_wallet();
+}
+
 BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
 {
     CoinSet setCoinsRet;
@@ -460,6 +488,62 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(rescan_with_block_filters, TestChain100Setup)
+{
+    g_blockfilterindex.reset(new CBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true));
+    BOOST_REQUIRE(g_blockfilterindex->Start());
+    for (int i = 0; i < 1000 && !g_blockfilterindex->IsSynced(); ++i)
+        MilliSleep(10);
+    BOOST_REQUIRE(g_blockfilterindex->IsSynced());
+
+    CBlockIndex* genesis;
+    {
+        LOCK(cs_main);
+        genesis = chainActive.Genesis();
+    }
+
+    // Leaving out the blocks that don't match finds the same transactions as reading them all.
+    size_t nFound;
+    {
+        CWallet wallet;
+        LOCK(wallet.cs_wallet);
+        wallet.GenerateNewLegacyAccount("My account");
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey(), *wallet.getActiveAccount(), KEYCHAIN_EXTERNAL);
+        CGCSFilter::ElementSet elements;
+        BOOST_CHECK(wallet.GetBlockFilterElements(elements));
+        CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+        BOOST_CHECK(elements.count(CGCSFilter::Element(scriptPubKey.begin(), scriptPubKey.end())));
+        BOOST_CHECK(wallet.ScanForWalletTransactions(genesis) == nullptr);
+        nFound = wallet.mapWallet.size();
+    }
+    BOOST_CHECK(nFound > 0);
+    {
+        std::unique_ptr<CBlockFilterIndex> filterindex = std::move(g_blockfilterindex);
+        CWallet wallet;
+        LOCK(wallet.cs_wallet);
+        wallet.GenerateNewLegacyAccount("My account");
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey(), *wallet.getActiveAccount(), KEYCHAIN_EXTERNAL);
+        BOOST_CHECK(wallet.ScanForWalletTransactions(genesis) == nullptr);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), nFound);
+        g_blockfilterindex = std::move(filterindex);
+    }
+
+    // A wallet none of the blocks involve finds nothing.
+    {
+        CWallet wallet;
+        LOCK(wallet.cs_wallet);
+        wallet.GenerateNewLegacyAccount("My account");
+        CKey key;
+        key.MakeNewKey(true);
+        wallet.AddKeyPubKey(key, key.GetPubKey(), *wallet.getActiveAccount(), KEYCHAIN_EXTERNAL);
+        BOOST_CHECK(wallet.ScanForWalletTransactions(genesis) == nullptr);
+        BOOST_CHECK(wallet.mapWallet.empty());
+    }
+
+    g_blockfilterindex->Stop();
+    g_blockfilterindex.reset();
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -553,6 +637,224 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
     BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 1000*COIN);
 }
 
+BOOST_FIXTURE_TEST_CASE(balances_cache, TestChain100Setup)
+{
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.GenerateNewLegacyAccount("My account");
+    CAccount* account = wallet.getActiveAccount();
+
+    // Nothing in the wallet yet, and that gets remembered.
+    WalletBalances balances;
+    wallet.GetBalances(balances, account);
+    BOOST_CHECK_EQUAL(balances.immatureExcludingLocked, 0);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(account), 0);
+
+    // Transactions coming in break the cached balances.
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey(), *account, KEYCHAIN_EXTERNAL);
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    BOOST_CHECK(wallet.GetImmatureBalance(account) > 0);
+
+    // The cached balances are the same as those worked out from scratch, for the account and for the whole wallet.
+    WalletBalances calculated;
+    wallet.GetBalances(balances, account);
+    wallet.GetBalances(calculated, account, false, false);
+    BOOST_CHECK(balances == calculated);
+    BOOST_CHECK_EQUAL(balances.immatureExcludingLocked, wallet.GetImmatureBalance(account));
+    BOOST_CHECK_EQUAL(balances.availableExcludingLocked, wallet.GetBalance(account));
+    wallet.GetBalances(calculated, nullptr, false, false);
+    BOOST_CHECK(balances == calculated);
+
+    // A transaction marked dirty breaks them too.
+    wallet.GetBalances(balances);
+    wallet.mapWallet.begin()->second.MarkDirty();
+    wallet.mapWallet.begin()->second.mapValue["replaced_by_txid"] = uint256().ToString();
+    wallet.GetBalances(calculated);
+    BOOST_CHECK(balances != calculated);
+}
+
+BOOST_AUTO_TEST_CASE(ismine_account_key_index)
+{
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.GenerateNewLegacyAccount("My account");
+    CAccount* account = wallet.getActiveAccount();
+
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    CTxOut out(1 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+    CTxOut witnessOut;
+    witnessOut.SetType(CTxOutType::PoW2WitnessOutput);
+    witnessOut.output.witnessDetails.spendingKeyID = otherKey.GetPubKey().GetID();
+    witnessOut.output.witnessDetails.witnessKeyID = key.GetPubKey().GetID();
+    BOOST_CHECK_EQUAL(::IsMine(wallet, out), ISMINE_NO);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, witnessOut), ISMINE_NO);
+
+    // A key added after the index was built is found all the same.
+    wallet.AddKeyPubKey(key, key.GetPubKey(), *account, KEYCHAIN_EXTERNAL);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, out), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, witnessOut), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, CTxDestination(key.GetPubKey().GetID())), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, CTxDestination(otherKey.GetPubKey().GetID())), ISMINE_NO);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, CTxOut(1 * COIN, GetScriptForRawPubKey(key.GetPubKey()))), ISMINE_SPENDABLE);
+
+    // Accounts and keys that come in later are added to the index, without losing what is in it already.
+    CAccount* otherAccount = wallet.GenerateNewLegacyAccount("My other account");
+    BOOST_REQUIRE(otherAccount && otherAccount != account);
+    wallet.AddKeyPubKey(otherKey, otherKey.GetPubKey(), *otherAccount, KEYCHAIN_EXTERNAL);
+    wallet.AddKeyPubKey(key, key.GetPubKey(), *otherAccount, KEYCHAIN_EXTERNAL);
+    BOOST_CHECK_EQUAL(::IsMine(wallet, CTxDestination(otherKey.GetPubKey().GetID())), ISMINE_SPENDABLE);
+    const std::vector<CAccount*>* accounts = wallet.GetAccountsForKey(key.GetPubKey().GetID());
+    BOOST_REQUIRE(accounts);
+    BOOST_CHECK_EQUAL(accounts->size(), 2);
+    accounts = wallet.GetAccountsForKey(otherKey.GetPubKey().GetID());
+    BOOST_REQUIRE(accounts);
+    BOOST_CHECK(accounts->size() == 1 && accounts->front() == otherAccount);
+}
+
+BOOST_AUTO_TEST_CASE(hd_account_keys_derived_ahead)
+{
+    std::vector<unsigned char> seed(32, 7);
+    CExtKey masterKey;
+    masterKey.SetMaster(std::vector<unsigned char>{'t','e','s','t'}, seed.data(), seed.size());
+    CAccountHD account(masterKey, boost::uuids::nil_generator()(), AccountType::Desktop);
+    CAccountHD reference(masterKey, boost::uuids::nil_generator()(), AccountType::Desktop);
+
+    // Derive the second and third of the next three keys ahead of time, the first was passed over.
+    std::vector<uint32_t> vIndexes = account.GetChildIndexesToDerive(KEYCHAIN_EXTERNAL, 3);
+    BOOST_REQUIRE_EQUAL(vIndexes.size(), 3);
+    for (size_t i = 1; i < vIndexes.size(); ++i)
+    {
+        CExtPubKey childKey;
+        BOOST_REQUIRE(account.GetChainKeyPub(KEYCHAIN_EXTERNAL).Derive(childKey, vIndexes[i]));
+        account.AddDerivedChildKey(KEYCHAIN_EXTERNAL, childKey);
+    }
+    BOOST_CHECK_EQUAL(account.GetChildIndexesToDerive(KEYCHAIN_EXTERNAL, 3).size(), 1);
+    BOOST_CHECK_EQUAL(account.GetChildIndexesToDerive(KEYCHAIN_CHANGE, 3).size(), 3);
+
+    // The keys handed out are the same as without deriving ahead, before, from and after the ones derived ahead.
+    for (int i = 0; i < 5; ++i)
+    {
+        CExtPubKey childKey, referenceKey;
+        account.GetPubKey(childKey, KEYCHAIN_EXTERNAL);
+        reference.GetPubKey(referenceKey, KEYCHAIN_EXTERNAL);
+        BOOST_CHECK(childKey == referenceKey);
+    }
+    BOOST_CHECK_EQUAL(account.GetChildIndexesToDerive(KEYCHAIN_EXTERNAL, 3).size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_batch_scope)
+{
+    CWalletDBWrapper& dbw = pwalletMain->GetDBHandle();
+    BOOST_CHECK(!dbw.IsFlushDeferred());
+    {
+        CWalletDBBatchScope batchScope(dbw);
+        BOOST_CHECK(dbw.IsFlushDeferred());
+        {
+            // Scopes nest, the flush waits for the outermost one.
+            CWalletDBBatchScope innerScope(dbw);
+            BOOST_CHECK(CWalletDB(dbw).WriteOrderPosNext(1));
+        }
+        BOOST_CHECK(dbw.IsFlushDeferred());
+
+        // Past the threshold the next handle to close flushes after all, and the count starts over.
+        for (unsigned int i = 0; i < WALLET_DB_BATCH_FLUSH_WRITES; ++i)
+            dbw.IncrementUpdateCounter();
+        BOOST_CHECK(!dbw.IsFlushDeferred());
+        BOOST_CHECK(CWalletDB(dbw).WriteOrderPosNext(2));
+        BOOST_CHECK(dbw.IsFlushDeferred());
+    }
+    BOOST_CHECK(!dbw.IsFlushDeferred());
+}
+
+BOOST_AUTO_TEST_CASE(wallet_notification_batch)
+{
+    CWallet wallet;
+    std::vector<std::vector<std::pair<uint256, ChangeType>>> vNotified;
+    int nSingleNotifications = 0;
+    boost::signals2::scoped_connection c1(wallet.NotifyTransactionsChanged.connect([&](CWallet*, const std::vector<std::pair<uint256, ChangeType>>& vChanges) { vNotified.push_back(vChanges); }));
+    boost::signals2::scoped_connection c2(wallet.NotifyTransactionChanged.connect([&](CWallet*, const uint256&, ChangeType) { ++nSingleNotifications; }));
+
+    const uint256 hash1 = GetRandHash();
+    const uint256 hash2 = GetRandHash();
+    LOCK(wallet.cs_wallet);
+    wallet.NotifyTransaction(hash1, CT_UPDATED);
+    BOOST_CHECK_EQUAL(vNotified.size(), 1);
+    {
+        CWalletNotificationBatch batch(wallet);
+        wallet.NotifyTransaction(hash1, CT_NEW);
+        {
+            CWalletNotificationBatch innerBatch(wallet);
+            wallet.NotifyTransaction(hash2, CT_UPDATED);
+            wallet.NotifyTransaction(hash1, CT_UPDATED);
+        }
+        BOOST_CHECK_EQUAL(vNotified.size(), 1);
+    }
+    // One notification for the batch, one entry per transaction in the order first seen; new stays new.
+    BOOST_CHECK_EQUAL(nSingleNotifications, 4);
+    BOOST_REQUIRE_EQUAL(vNotified.size(), 2);
+    BOOST_REQUIRE_EQUAL(vNotified[1].size(), 2);
+    BOOST_CHECK(vNotified[1][0] == std::pair(hash1, CT_NEW));
+    BOOST_CHECK(vNotified[1][1] == std::pair(hash2, CT_UPDATED));
+}
+
+BOOST_AUTO_TEST_CASE(witness_account_history_statistics)
+{
+    CWitnessAccountHistory history;
+    BOOST_CHECK(history.GetOrigin() == nullptr);
+    BOOST_CHECK_EQUAL(history.GetAverageRewardPeriod(), 0);
+
+    CWitnessAccountEvent event;
+    event.type = CWitnessAccountEvent::Fund;
+    event.nHeight = 1000;
+    history.vEvents.push_back(event);
+    event.type = CWitnessAccountEvent::Increase;
+    event.nHeight = 1100;
+    history.vEvents.push_back(event);
+    BOOST_REQUIRE(history.GetOrigin() != nullptr);
+    BOOST_CHECK_EQUAL(history.GetOrigin()->nHeight, 1000);
+    BOOST_CHECK_EQUAL(history.GetAverageRewardPeriod(), 0);
+
+    // Four rewards in the 800 blocks since the account was funded.
+    history.nRewardCount = 4;
+    history.nLastRewardHeight = 1800;
+    BOOST_CHECK_EQUAL(history.GetAverageRewardPeriod(), 200);
+}
+
+BOOST_AUTO_TEST_CASE(LoadWalletTransactions)
+{
+    // Enough transactions for LoadWallet to decode them on more than one thread.
+    std::unique_ptr<CWalletDBWrapper> dbw(new CWalletDBWrapper(&bitdb, "wallet_load_test.dat"));
+    std::set<uint256> setHashes;
+    {
+        CWalletDB walletdb(*dbw, "cr+");
+        for (size_t i = 0; i < 2 * WALLET_LOAD_MIN_TX_PER_THREAD + 1; ++i)
+        {
+            CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
+            tx.nLockTime = i;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = COIN;
+            CWalletTx wtx(nullptr, MakeTransactionRef(std::move(tx)));
+            wtx.nOrderPos = i;
+            BOOST_CHECK(walletdb.WriteTx(wtx));
+            setHashes.insert(wtx.GetHash());
+        }
+    }
+
+    CWallet wallet(std::move(dbw));
+    WalletLoadState loadState;
+    wallet.LoadWallet(loadState);
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), setHashes.size());
+    for (const auto& hash : setHashes)
+        BOOST_CHECK(wallet.mapWallet.count(hash));
+    // And each one is in the ordered index.
+    BOOST_CHECK_EQUAL(wallet.wtxOrdered.size(), setHashes.size());
+}
+
 static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
 {
     CMutableTransaction tx(TEST_DEFAULT_TX_VERSION);
@@ -715,4 +1017,27 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2U);
 }
 
+BOOST_FIXTURE_TEST_CASE(AvailableCoinsSkipsSpentTransactions, ListCoinsTestingSetup)
+{
+    LOCK2(cs_main, wallet->cs_wallet);
+    CAccount* account = wallet->getActiveAccount();
+
+    std::vector<COutput> available;
+    wallet->AvailableCoins(account, available);
+    BOOST_CHECK_EQUAL(available.size(), 1U);
+    const uint256 hashSpent = available[0].tx->GetHash();
+
+    // Once spent the coinbase is left out of the walk over the wallet, but its outputs come back once anything could change.
+    AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    wallet->AvailableCoins(account, available);
+    BOOST_CHECK_EQUAL(available.size(), 2U);
+    for (const auto& coin : available)
+        BOOST_CHECK(coin.tx->GetHash() != hashSpent);
+    wallet->MarkDirty();
+    std::vector<COutput> availableAgain;
+    wallet->AvailableCoins(account, availableAgain);
+    BOOST_CHECK_EQUAL(availableAgain.size(), 2U);
+    BOOST_CHECK_EQUAL(wallet->GetAvailableBalance(account), available[0].tx->tx->vout[available[0].i].nValue + available[1].tx->tx->vout[available[1].i].nValue);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,6 +19,7 @@
 #include "chain.h"
 #include "wallet/coincontrol.h"
 #include "consensus/consensus.h"
+#include "core_memusage.h"
 #include "consensus/validation.h"
 #include "consensus/tx_verify.h"
 #include "fs.h"
@@ -386,6 +387,27 @@ void CWallet::SetBestChain(const CBlockLocator& loc)
     walletdb.WriteBestBlock(loc);
 }
 
+size_t CWallet::TransactionsDynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    size_t nUsage = memusage::DynamicUsage(mapWallet) + memusage::DynamicUsage(mapTxSpends) + memusage::DynamicUsage(wtxOrdered) + memusage::DynamicUsage(mapRequestCount);
+    for (const auto& entry : mapWallet)
+    {
+        const CWalletTx& wtx = entry.second;
+        nUsage += RecursiveDynamicUsage(wtx.tx) + memusage::DynamicUsage(wtx.mapValue) + memusage::DynamicUsage(wtx.vOrderForm);
+    }
+    return nUsage;
+}
+
+size_t CWallet::AccountsDynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    size_t nUsage = memusage::DynamicUsage(mapAccounts) + memusage::DynamicUsage(mapKeyMetadata) + memusage::DynamicUsage(mapAddressBook);
+    for (const auto& entry : mapAccounts)
+        nUsage += memusage::MallocUsage(sizeof(CAccount)) + entry.second->DynamicMemoryUsage();
+    return nUsage;
+}
+
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn, bool fExplicit)
 {
     LOCK(cs_wallet); // nWalletVersion
@@ -615,6 +637,22 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+bool CWallet::IsFullySpent(const uint256& hash, const CWalletTx& wtx) const
+{
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++)
+    {
+        if (!IsSpent(hash, i))
+            return false;
+    }
+    return true;
+}
+
+void CWallet::MarkAvailableCoinsCandidate(const uint256& hash) const
+{
+    LOCK(cs_availableCoinsCandidates);
+    setAvailableCoinsCandidates.insert(hash);
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::pair(outpoint, wtxid));
@@ -906,7 +944,7 @@ bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
         success = false;
     }
 
-    NotifyTransactionChanged(this, originalHash, CT_UPDATED);
+    NotifyTransaction(originalHash, CT_UPDATED);
 
     return success;
 }
@@ -983,7 +1021,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     wtx.MarkDirty();
 
     // Notify UI of new or updated transaction
-    NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
+    NotifyTransaction(hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
     // notify an external script when a wallet transaction comes in or is updated
     std::string strCmd = GetArg("-walletnotify", "");
@@ -1202,7 +1240,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.setAbandoned();
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
-            NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
+            NotifyTransaction(wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(hashTx, 0));
             while (iter != mapTxSpends.end() && iter->first.getHash() == now) {
@@ -1303,6 +1341,48 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
     }
 }
 
+void CWallet::NotifyTransaction(const uint256& hashTx, ChangeType status)
+{
+    AssertLockHeld(cs_wallet);
+    if (!mapWitnessAccountEvents.empty())
+        setWitnessAccountEventsDirty.insert(hashTx);
+    NotifyTransactionChanged(this, hashTx, status);
+    if (nNotificationBatchDepth == 0)
+    {
+        NotifyTransactionsChanged(this, {{hashTx, status}});
+        return;
+    }
+    auto [it, fInserted] = mapBatchedTxNotifications.emplace(hashTx, vBatchedTxNotifications.size());
+    if (fInserted)
+    {
+        vBatchedTxNotifications.emplace_back(hashTx, status);
+    }
+    else
+    {
+        // A transaction that came in during the batch is still new to the listeners, whatever else happened to it since.
+        ChangeType& batchedStatus = vBatchedTxNotifications[it->second].second;
+        if (batchedStatus != CT_NEW || status != CT_UPDATED)
+            batchedStatus = status;
+    }
+}
+
+CWalletNotificationBatch::CWalletNotificationBatch(CWallet& walletIn)
+: wallet(walletIn)
+{
+    AssertLockHeld(wallet.cs_wallet);
+    ++wallet.nNotificationBatchDepth;
+}
+
+CWalletNotificationBatch::~CWalletNotificationBatch()
+{
+    if (--wallet.nNotificationBatchDepth > 0 || wallet.vBatchedTxNotifications.empty())
+        return;
+    std::vector<std::pair<uint256, ChangeType>> vChanges;
+    vChanges.swap(wallet.vBatchedTxNotifications);
+    wallet.mapBatchedTxNotifications.clear();
+    wallet.NotifyTransactionsChanged(&wallet, vChanges);
+}
+
 void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
     LOCK2(cs_main, cs_wallet);
     SyncTransaction(ptx);
@@ -1318,6 +1398,8 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     // to abandon a transaction and then have it inadvertently cleared by
     // the notification that the conflicted transaction was evicted.
 
+    // Listeners hear of the whole block at once instead of every transaction in it.
+    CWalletNotificationBatch notificationBatch(*this);
     for (const CTransactionRef& ptx : vtxConflicted) {
         SyncTransaction(ptx);
     }
@@ -1328,6 +1410,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     LOCK2(cs_main, cs_wallet);
+    CWalletNotificationBatch notificationBatch(*this);
 
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx);
@@ -1536,10 +1619,20 @@ void CWallet::AvailableCoins(CAccount* forAccount, std::vector<COutput> &vCoins,
     {
         LOCK2(cs_main, cs_wallet);
 
+        LOCK(cs_availableCoinsCandidates);
+
         CAmount nTotal = 0;
 
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (std::set<uint256>::const_iterator candidate = setAvailableCoinsCandidates.begin(); candidate != setAvailableCoinsCandidates.end(); )
         {
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(*candidate);
+            if (it == mapWallet.end() || IsFullySpent(it->first, it->second))
+            {
+                candidate = setAvailableCoinsCandidates.erase(candidate);
+                continue;
+            }
+            ++candidate;
+
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
 
@@ -1756,7 +1849,63 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
+/**
+ * Depth first search for a subset of vValue (sorted by decreasing value) that adds up to nTargetValue exactly, including the bigger coins
+ * first so that the first match found has few inputs. Branches that overshoot or can't reach the target anymore are cut, as are ones that
+ * only differ from an explored one by taking another coin of the same value; gives up after BNB_MAX_TRIES steps.
+ */
+static bool SelectCoinsBnB(const std::vector<CInputCoin>& vValue, const CAmount& nTargetValue, std::vector<char>& vfBest, size_t nMaxTries = BNB_MAX_TRIES)
+{
+    std::vector<char> vfSelection;
+    vfSelection.reserve(vValue.size());
+    CAmount nCurrent = 0;
+    // Value of the coins that haven't been included or left out yet.
+    CAmount nRemaining = 0;
+    for (const auto& coin : vValue)
+        nRemaining += coin.txout.nValue;
+
+    for (size_t nTries = 0; nTries < nMaxTries; ++nTries)
+    {
+        if (nCurrent == nTargetValue)
+        {
+            vfBest = vfSelection;
+            vfBest.resize(vValue.size(), false);
+            return true;
+        }
+        if (nCurrent > nTargetValue || nCurrent + nRemaining < nTargetValue)
+        {
+            // Back up to the last coin included and leave it out instead.
+            while (!vfSelection.empty() && !vfSelection.back())
+            {
+                vfSelection.pop_back();
+                nRemaining += vValue[vfSelection.size()].txout.nValue;
+            }
+            if (vfSelection.empty())
+                return false;
+            vfSelection.back() = false;
+            nCurrent -= vValue[vfSelection.size() - 1].txout.nValue;
+        }
+        else
+        {
+            size_t nPos = vfSelection.size();
+            const CAmount nValue = vValue[nPos].txout.nValue;
+            nRemaining -= nValue;
+            // Including a coin of the same value as one just left out leads to selections that were explored already.
+            if (nPos > 0 && !vfSelection.back() && nValue == vValue[nPos - 1].txout.nValue)
+            {
+                vfSelection.push_back(false);
+            }
+            else
+            {
+                vfSelection.push_back(true);
+                nCurrent += nValue;
+            }
+        }
+    }
+    return false;
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::vector<COutput>& vCoins,
                                  std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
@@ -1764,13 +1913,12 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
 
     // List of values less than target
     boost::optional<CInputCoin> coinLowestLarger;
+    int nLowestLargerCount = 0;
+    boost::optional<CInputCoin> coinExact;
+    int nExactCount = 0;
     std::vector<CInputCoin> vValue;
     CAmount nTotalLower = 0;
 
-    std::random_device rng;
-    std::mt19937 urng(rng());
-    std::shuffle(vCoins.begin(), vCoins.end(), urng);
-
     for(const COutput &output : vCoins)
     {
         if (!output.fSpendable)
@@ -1790,9 +1938,9 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
 
         if (coin.txout.nValue == nTargetValue)
         {
-            setCoinsRet.insert(coin);
-            nValueRet += coin.txout.nValue;
-            return true;
+            // Pick one of the coins that match exactly at random.
+            if (GetRandInt(++nExactCount) == 0)
+                coinExact = coin;
         }
         else if (coin.txout.nValue < nTargetValue + MIN_CHANGE)
         {
@@ -1802,9 +1950,22 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         else if (!coinLowestLarger || coin.txout.nValue < coinLowestLarger->txout.nValue)
         {
             coinLowestLarger = coin;
+            nLowestLargerCount = 1;
+        }
+        else if (coin.txout.nValue == coinLowestLarger->txout.nValue && GetRandInt(++nLowestLargerCount) == 0)
+        {
+            // Pick one of the coins of the same value at random.
+            coinLowestLarger = coin;
         }
     }
 
+    if (coinExact)
+    {
+        setCoinsRet.insert(coinExact.get());
+        nValueRet += coinExact->txout.nValue;
+        return true;
+    }
+
     if (nTotalLower == nTargetValue)
     {
         for (const auto& input : vValue)
@@ -1824,15 +1985,25 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
-    std::reverse(vValue.begin(), vValue.end());
+    // Only the candidates are shuffled, so that coins of the same value are picked at random; the stable sort keeps them in that order.
+    std::random_device rng;
+    std::mt19937 urng(rng());
+    std::shuffle(vValue.begin(), vValue.end(), urng);
+    std::stable_sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     std::vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+    // An exact match needs no change; otherwise solve subset sum by stochastic approximation
+    if (SelectCoinsBnB(vValue, nTargetValue, vfBest))
+    {
+        nBest = nTargetValue;
+    }
+    else
+    {
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
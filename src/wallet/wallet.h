@@ -16,6 +16,7 @@
 #include "wallettx.h"
 
 #include "amount.h"
+#include "blockfilter.h"
 #include "policy/feerate.h"
 #include "streams.h"
 #include "tinyformat.h"
@@ -79,9 +80,18 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 //! -walletrbf default
 static const bool DEFAULT_WALLET_RBF = false;
 static const bool DEFAULT_WALLETBROADCAST = true;
+//! Default for -walletasync
+static const bool DEFAULT_WALLET_ASYNC = false;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! Most steps the branch and bound coin selection takes looking for an exact match before leaving it to the stochastic approximation.
+static const size_t BNB_MAX_TRIES = 100000;
+
+//! Blocks a rescan reads ahead of the ones it is matching against the wallet.
+static const unsigned int WALLET_RESCAN_BATCH_SIZE = 64;
+//! Most threads a rescan reads blocks with.
+static const int WALLET_RESCAN_MAX_READ_THREADS = 8;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -410,6 +420,20 @@ struct WalletBalances
                 && immatureLocked             == rhs.immatureLocked
                 && totalLocked                == rhs.totalLocked;
     }
+    WalletBalances& operator+=(const WalletBalances& rhs)
+    {
+        availableIncludingLocked   += rhs.availableIncludingLocked;
+        availableExcludingLocked   += rhs.availableExcludingLocked;
+        availableLocked            += rhs.availableLocked;
+        unconfirmedIncludingLocked += rhs.unconfirmedIncludingLocked;
+        unconfirmedExcludingLocked += rhs.unconfirmedExcludingLocked;
+        unconfirmedLocked          += rhs.unconfirmedLocked;
+        immatureIncludingLocked    += rhs.immatureIncludingLocked;
+        immatureExcludingLocked    += rhs.immatureExcludingLocked;
+        immatureLocked             += rhs.immatureLocked;
+        totalLocked                += rhs.totalLocked;
+        return *this;
+    }
     bool operator!=(const WalletBalances& rhs) const
     {
         return availableIncludingLocked       != rhs.availableIncludingLocked
@@ -425,6 +449,47 @@ struct WalletBalances
     }
 };
 
+/** Something that happened to a witness account in the chain, see CWallet::GetWitnessAccountHistory. */
+struct CWitnessAccountEvent
+{
+    enum Type
+    {
+        Fund,
+        Reward,
+        Renew,
+        Increase,
+        Split,
+        Merge,
+        ChangeKey,
+        Empty
+    };
+
+    Type type = Fund;
+    uint256 hashTx;
+    uint256 hashBlock;
+    int nHeight = 0;
+    int64_t nTime = 0;
+    //! The reward earned, or the amount locked when done (for Empty the amount that came out).
+    CAmount nAmount = 0;
+    //! The lock length in blocks of the witness output when done, and the block it is locked until; 0 for rewards and Empty.
+    uint64_t nLockLength = 0;
+    uint64_t nLockUntilBlock = 0;
+};
+
+/** The history of a witness account in the active chain, oldest first, with the totals of its rewards. */
+struct CWitnessAccountHistory
+{
+    std::vector<CWitnessAccountEvent> vEvents;
+    CAmount nRewardsToDate = 0;
+    uint64_t nRewardCount = 0;
+    int nLastRewardHeight = 0;
+
+    //! The event that first funded the account, nullptr if it never was.
+    const CWitnessAccountEvent* GetOrigin() const;
+    //! The average number of blocks between rewards since the account was funded, 0 if it didn't earn yet.
+    uint64_t GetAverageRewardPeriod() const;
+};
+
 /*
 All Gulden specific functionality goes in base class CGuldenWallet
 A little bit clumsy 
@@ -436,6 +501,41 @@ private:
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet;
 
+    /**
+     * The balances of each account (the nil uuid for the whole wallet), so that polling them costs a lookup per account
+     * instead of a pass over mapWallet. They are good for as long as no transaction has its caches broken (see
+     * MarkBalancesDirty) and the tip and mempool stay the same, as maturity, trust and witness locks follow those.
+     */
+    mutable std::map<boost::uuids::uuid, WalletBalances> mapBalancesCache;
+    mutable uint64_t nBalancesCacheGeneration = 0;
+    mutable const CBlockIndex* pBalancesCacheTip = nullptr;
+    mutable unsigned int nBalancesCacheMempoolUpdated = 0;
+    mutable std::atomic<uint64_t> nBalancesGeneration{0};
+
+    /**
+     * The wallet transactions that may have outputs left to spend, which is what AvailableCoins walks instead of all of
+     * mapWallet. Transactions it finds with every output spent are dropped; whatever can make an output spendable again (a
+     * spend that gets conflicted, abandoned or disconnected, or the transaction itself coming in again) breaks the caches of
+     * the transaction, which puts it back (see MarkAvailableCoinsCandidate).
+     */
+    mutable CCriticalSection cs_availableCoinsCandidates;
+    mutable std::set<uint256> setAvailableCoinsCandidates;
+
+    /**
+     * The witness account events of every wallet transaction, per account, kept for the accounts that were asked about at
+     * least once. Each is built with one pass over mapWallet; from then on only the transactions that NotifyTransaction was
+     * called for since are looked at again. Events of blocks that left the active chain stay, GetWitnessAccountHistory skips
+     * them. Protected by cs_wallet.
+     */
+    mutable std::map<boost::uuids::uuid, std::map<uint256, std::vector<CWitnessAccountEvent>>> mapWitnessAccountEvents;
+    mutable std::set<uint256> setWitnessAccountEventsDirty;
+    void GetWitnessAccountEvents(const CAccount& forAccount, const CWalletTx& wtx, std::vector<CWitnessAccountEvent>& vEvents) const;
+
+    //! The balances of just forAccount, or of the whole wallet for nullptr; one pass over mapWallet. Requires cs_main and cs_wallet.
+    void CalculateBalances(WalletBalances& balances, const CAccount* forAccount, bool useCache) const;
+    //! As CalculateBalances, but from mapBalancesCache when possible. Requires cs_main and cs_wallet.
+    const WalletBalances& GetCachedBalances(const CAccount* forAccount) const;
+
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
@@ -474,6 +574,15 @@ private:
      * Should be called with pindexBlock and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, const CBlockIndex *pindex = NULL, int posInBlock = 0);
 
+    /**
+     * Transaction changes held back while a CWalletNotificationBatch is open, in the order they were first seen and with one
+     * entry per transaction, for NotifyTransactionsChanged to hand over at once. Protected by cs_wallet.
+     */
+    int nNotificationBatchDepth = 0;
+    std::vector<std::pair<uint256, ChangeType>> vBatchedTxNotifications;
+    std::map<uint256, size_t> mapBatchedTxNotifications;
+    friend class CWalletNotificationBatch;
+
     std::set<int64_t> setKeyPool;
 
     //int64_t nTimeFirstKey;
@@ -622,13 +731,17 @@ public:
 
     /**
      * Shuffle and select coins until nTargetValue is reached while avoiding
-     * small change; This method is stochastic for some inputs and upon
-     * completion the coin set and corresponding actual target value is
-     * assembled
+     * small change; A set of coins that adds up to nTargetValue exactly, so
+     * that no change is needed at all, is looked for first by branch and bound
+     * within BNB_MAX_TRIES steps; failing that this method is stochastic for
+     * some inputs. Upon completion the coin set and corresponding actual
+     * target value is assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
+    //! Whether all outputs of wtx, the wallet transaction hash, are spent. Requires cs_wallet.
+    bool IsFullySpent(const uint256& hash, const CWalletTx& wtx) const;
 
     bool IsLockedCoin(uint256 hash, unsigned int n) const;
     void LockCoin(const COutPoint& output);
@@ -719,12 +832,26 @@ public:
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     void ClearCacheForTransaction(const uint256& hash);
     bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
+    //! Whether AddToWalletIfInvolvingMe could do anything at all for tx; a cheap test so that a rescan only takes the full path for the few transactions that touch the wallet.
+    bool MightInvolveMe(const CTransaction& tx) const;
+    /**
+     * The elements the outputs of the wallet are found by in basic block filters (see GetBasicFilterElements): the key hash and pay to
+     * pubkey scripts of every account key. Returns false if the wallet also watches scripts or has redeem scripts, which filters can't
+     * be matched for this way. Requires cs_wallet.
+     */
+    bool GetBlockFilterElements(CGCSFilter::ElementSet& elements) const;
     int GetTransactionScanProgressPercent();
     int64_t RescanFromTime(int64_t startTime, bool update);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
-    void GetBalances(WalletBalances& balances, const CAccount* forAccount = nullptr, bool includeChildren=false) const;
+    void GetBalances(WalletBalances& balances, const CAccount* forAccount = nullptr, bool includeChildren=false, bool useCache=true) const;
+    //! The rewards and actions of witness account forAccount in the active chain; all but the first call for an account are cheap. Requires cs_main and cs_wallet.
+    void GetWitnessAccountHistory(const CAccount* forAccount, CWitnessAccountHistory& history) const;
+    //! Invalidate the balances kept per account; every change to a transaction that can affect them breaks its caches, which calls this.
+    void MarkBalancesDirty() const { ++nBalancesGeneration; }
+    //! Have AvailableCoins look at the outputs of the wallet transaction hash again; called along with MarkBalancesDirty.
+    void MarkAvailableCoinsCandidate(const uint256& hash) const;
     CAmount GetBalance(const CAccount* forAccount = nullptr, bool useCache=true, bool includePoW2LockedWitnesses=false, bool includeChildren=false) const;
     CAmount GetLockedBalance(const CAccount* forAccount = nullptr, bool includeChildren=false);
     CAmount GetUnconfirmedBalance(const CAccount* forAccount = nullptr, bool includePoW2LockedWitnesses=false, bool includeChildren=false) const;
@@ -862,6 +989,11 @@ public:
         return nPoolSize;
     }
 
+    //! Memory used by the wallet transactions (mapWallet and the indexes on it).
+    size_t TransactionsDynamicMemoryUsage() const;
+    //! Memory used by the accounts and their key stores, and the wallet wide key metadata and address book.
+    size_t AccountsDynamicMemoryUsage() const;
+
     //! signify that a particular wallet feature is now used. this may change nWalletVersion and nWalletMaxVersion if those are lower
     bool SetMinVersion(enum WalletFeature, CWalletDB* pwalletdbIn = NULL, bool fExplicit = false);
 
@@ -899,6 +1031,16 @@ public:
     boost::signals2::signal<void (CWallet *wallet, const uint256 &hashTx,
             ChangeType status)> NotifyTransactionChanged;
 
+    /**
+     * Wallet transactions added, removed or updated; once per block while blocks are connected or disconnected, and for every
+     * single change otherwise. Listeners that don't need to handle every change apart should prefer this over NotifyTransactionChanged.
+     * @note called with lock cs_wallet held.
+     */
+    boost::signals2::signal<void (CWallet *wallet, const std::vector<std::pair<uint256, ChangeType>>& vChanges)> NotifyTransactionsChanged;
+
+    //! Signal that hashTx changed, on both NotifyTransactionChanged and (possibly batched) NotifyTransactionsChanged. Requires cs_wallet.
+    void NotifyTransaction(const uint256& hashTx, ChangeType status);
+
     /** Show progress e.g. for rescan */
     boost::signals2::signal<void (const std::string &title, int nProgress)> ShowProgress;
 
@@ -943,6 +1085,21 @@ public:
 };
 
 
+/**
+ * While in scope, the NotifyTransactionsChanged signals of a wallet are collected and sent as one when the outermost scope ends.
+ * Requires cs_wallet for the whole of its lifetime.
+ */
+class CWalletNotificationBatch
+{
+public:
+    explicit CWalletNotificationBatch(CWallet& walletIn);
+    ~CWalletNotificationBatch();
+
+private:
+    CWallet& wallet;
+};
+
+
 // Helper for producing a bunch of max-sized low-S signatures (eg 72 bytes)
 // ContainerType is meant to hold pair<CWalletTx *, int>, and be iterable
 // so that each entry corresponds to each vIn, in order.
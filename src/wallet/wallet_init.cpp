@@ -82,6 +82,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-walletrbf", strprintf(helptr("Send transactions with full-RBF opt-in enabled (default: %u)"), DEFAULT_WALLET_RBF));
     strUsage += HelpMessageOpt("-upgradewallet", helptr("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", helptr("Specify wallet file (within data directory)") + " " + strprintf(helptr("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-walletasync", strprintf(helptr("Process new blocks and transactions in the wallet on a thread of its own, so that a slow wallet doesn't hold up validation; wallet RPC may then lag the chain slightly (default: %u)"), DEFAULT_WALLET_ASYNC));
     strUsage += HelpMessageOpt("-walletbroadcast", helptr("Make the wallet broadcast transactions") + " " + strprintf(helptr("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", helptr("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", helptr("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
@@ -520,7 +521,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
 
     LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
 
-    RegisterValidationInterface(walletInstance);
+    RegisterValidationInterface(walletInstance, GetBoolArg("-walletasync", DEFAULT_WALLET_ASYNC));
 
     CBlockIndex *pindexRescan = chainActive.Tip();
     if (GetBoolArg("-rescan", false) || GuldenAppManager::gApp->isRecovery)
@@ -14,6 +14,7 @@
 #include "wallet/wallettx.h"
 
 #include "validation/validation.h"
+#include "validation/blockfilterindex.h"
 #include "net.h"
 #include "scheduler.h"
 #include "timedata.h"
@@ -22,6 +23,8 @@
 #include <unity/appmanager.h>
 #include <script/ismine.h>
 
+#include <thread>
+
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
@@ -112,6 +115,78 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
     return startTime;
 }
 
+bool CWallet::MightInvolveMe(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+
+    // Everything AddToWalletIfInvolvingMe looks at: the transaction itself, conflicts with our spends, inputs from our transactions and our outputs.
+    if (mapWallet.count(tx.GetHash()))
+        return true;
+    for (const CTxIn& txin : tx.vin)
+    {
+        if (mapTxSpends.count(txin.prevout) || mapWallet.count(txin.prevout.getHash()))
+            return true;
+    }
+    for (const CTxOut& txout : tx.vout)
+    {
+        if (IsMine(txout))
+            return true;
+    }
+    return false;
+}
+
+bool CWallet::GetBlockFilterElements(CGCSFilter::ElementSet& elements) const
+{
+    AssertLockHeld(cs_wallet);
+
+    elements.clear();
+    for (const auto& [accountUUID, account] : mapAccounts)
+    {
+        (unused)accountUUID;
+        if (account->HaveWatchOnly() || account->HaveCScripts())
+            return false;
+    }
+    // Looking any key up brings the index of the account keys up to date.
+    GetAccountsForKey(CKeyID());
+    for (const auto& [keyID, vAccounts] : mapAccountKeys)
+    {
+        CScript script = GetScriptForDestination(keyID);
+        elements.emplace(script.begin(), script.end());
+        CPubKey pubKey;
+        if (!vAccounts.empty() && vAccounts.front()->GetPubKey(keyID, pubKey))
+        {
+            script = GetScriptForRawPubKey(pubKey);
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    return true;
+}
+
+/** Read the blocks of vIndex that vWanted asks for into vBlocks on a few threads; vRead tells which of them could be read. */
+static void ReadBlocksForRescan(const std::vector<CBlockIndex*>& vIndex, const std::vector<char>& vWanted, std::vector<CBlock>& vBlocks, std::vector<char>& vRead, const CChainParams& chainParams)
+{
+    vBlocks.assign(vIndex.size(), CBlock());
+    vRead.assign(vIndex.size(), false);
+
+    // ReadBlockFromDisk only takes cs_main for the position, the reading and deserialising of one block doesn't depend on any other.
+    std::atomic<size_t> nNext(0);
+    auto readBlocks = [&]()
+    {
+        for (size_t i = nNext++; i < vIndex.size(); i = nNext++)
+        {
+            if (vWanted[i])
+                vRead[i] = ReadBlockFromDisk(vBlocks[i], vIndex[i], chainParams);
+        }
+    };
+    int nThreads = std::max(1, std::min(GetNumCores(), WALLET_RESCAN_MAX_READ_THREADS));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(readBlocks);
+    readBlocks();
+    for (auto& thread : vThreads)
+        thread.join();
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -128,6 +203,7 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
 
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
+    CWalletDBBatchScope batchScope(*dbw);
     {
         LOCK2(cs_main, cs_wallet); // Required for ReadBlockFromDisk.
         fAbortRescan = false;
@@ -145,14 +221,32 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
         uint64_t nProgressStart = pindex->nHeight;
         uint64_t nProgressTip = chainActive.Tip()->nHeight;
         uint64_t nWorkQuantity = nProgressTip - nProgressStart;
+        std::vector<CBlockIndex*> vBatch;
+        std::vector<CBlock> vBlocks;
+        std::vector<char> vRead;
+
+        // With -blockfilterindex the blocks whose filter matches none of the scripts of the wallet can't involve it, so they aren't read at all.
+        // The wallet gets keys during the scan (its lookahead follows the keys it finds used), the filters are matched again when it does.
+        CGCSFilter::ElementSet filterElements;
+        uint64_t nFilterElementsChangeCounter = CBasicKeyStore::nChangeCounter;
+        bool fUseFilters = g_blockfilterindex && GetBlockFilterElements(filterElements);
+        std::vector<CBlockFilter> vFilters;
+        std::vector<char> vMatch;
+        uint64_t nSkipped = 0;
         while (pindex && !fAbortRescan && nWorkQuantity > 0)
         {
-            // Temporarily release lock to allow shadow key allocation a chance to do it's thing
+            vBatch.clear();
+            for (CBlockIndex* pindexBatch = pindex; pindexBatch && vBatch.size() < WALLET_RESCAN_BATCH_SIZE; pindexBatch = chainActive.Next(pindexBatch))
+                vBatch.push_back(pindexBatch);
+            vFilters.assign(vBatch.size(), CBlockFilter());
+            vMatch.assign(vBatch.size(), true);
+
+            // Temporarily release lock to allow shadow key allocation a chance to do it's thing; the blocks of the batch are read meanwhile.
             LEAVE_CRITICAL_SECTION(cs_main)
             LEAVE_CRITICAL_SECTION(cs_wallet)
             nTransactionScanProgressPercent = ((pindex->nHeight-nProgressStart) / (double)(nWorkQuantity)) * 100;
             nTransactionScanProgressPercent = std::max(1, std::min(99, nTransactionScanProgressPercent));
-            if (pindex->nHeight % 100 == 0 && nProgressTip - nProgressStart > 0)
+            if (nProgressTip - nProgressStart > 0)
             {
                 ShowProgress(_("Rescanning..."), nTransactionScanProgressPercent);
             }
@@ -160,25 +254,63 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%d%%\n", pindex->nHeight, nTransactionScanProgressPercent);
             }
+            if (fUseFilters)
+            {
+                for (size_t i = 0; i < vBatch.size(); ++i)
+                    vMatch[i] = !g_blockfilterindex->LookupFilter(vBatch[i], vFilters[i]) || vFilters[i].GetFilter().MatchAny(filterElements);
+            }
+            ReadBlocksForRescan(vBatch, vMatch, vBlocks, vRead, chainParams);
             ENTER_CRITICAL_SECTION(cs_main)
             ENTER_CRITICAL_SECTION(cs_wallet)
 
             if (ShutdownRequested())
                 return ret;
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+            // Match the blocks from nFrom on that were left out again if the wallet got keys since, and read the ones that match now.
+            auto rematchFilters = [&](size_t nFrom)
+            {
+                if (!fUseFilters || nFilterElementsChangeCounter == CBasicKeyStore::nChangeCounter)
+                    return;
+                nFilterElementsChangeCounter = CBasicKeyStore::nChangeCounter;
+                fUseFilters = GetBlockFilterElements(filterElements);
+                for (size_t i = nFrom; i < vBatch.size(); ++i)
+                {
+                    if (!vMatch[i] && (!fUseFilters || vFilters[i].GetFilter().MatchAny(filterElements)))
+                    {
+                        vMatch[i] = true;
+                        vRead[i] = ReadBlockFromDisk(vBlocks[i], vBatch[i], chainParams);
+                    }
+                }
+            };
+
+            // In chain order, so that a transaction finds the ones before it that it spends from already in the wallet.
+            CWalletNotificationBatch notificationBatch(*this);
+            for (size_t i = 0; i < vBatch.size(); ++i)
+            {
+                rematchFilters(i);
+                if (!vMatch[i])
+                {
+                    ++nSkipped;
+                    continue;
+                }
+                if (!vRead[i])
+                {
+                    ret = vBatch[i];
+                    continue;
+                }
+                for (size_t posInBlock = 0; posInBlock < vBlocks[i].vtx.size(); ++posInBlock)
+                {
+                    if (MightInvolveMe(*vBlocks[i].vtx[posInBlock]))
+                        AddToWalletIfInvolvingMe(vBlocks[i].vtx[posInBlock], vBatch[i], posInBlock, fUpdate);
                 }
-            } else {
-                ret = pindex;
             }
-            pindex = chainActive.Next(pindex);
+            pindex = chainActive.Next(vBatch.back());
         }
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
         }
+        if (nSkipped > 0)
+            LogPrintf("Rescan left out %u blocks that their compact filter shows don't involve the wallet\n", nSkipped);
         nTransactionScanProgressPercent = 100;
         ShowProgress(_("Rescanning..."), nTransactionScanProgressPercent); // hide progress dialog in GUI
 
@@ -66,6 +66,7 @@ int CWallet::TopUpKeyPool(unsigned int nTargetKeypoolSize, unsigned int nMaxNewA
 
     LOCK2(cs_main, cs_wallet);
 
+    CWalletDBBatchScope batchScope(*dbw);
     CWalletDB walletdb(*dbw);
 
     // Top up key pool
@@ -107,6 +108,16 @@ int CWallet::TopUpKeyPool(unsigned int nTargetKeypoolSize, unsigned int nMaxNewA
             for (auto& keyChain : { KEYCHAIN_EXTERNAL, KEYCHAIN_CHANGE })
             {
                 auto& keyPool = ( keyChain == KEYCHAIN_EXTERNAL ? account->setKeyPoolExternal : account->setKeyPoolInternal );
+
+                // Derive all the keys this is going to add at once, rather than one by one in GenerateNewKey.
+                if (account->IsHD() && keyPool.size() < nFinalAccountTargetSize)
+                {
+                    unsigned int nToDerive = nFinalAccountTargetSize - keyPool.size();
+                    if (nMaxNewAllocations != 0)
+                        nToDerive = std::min(nToDerive, nMaxNewAllocations - nNew);
+                    dynamic_cast<CAccountHD*>(account)->DeriveChildKeysAhead(keyChain, nToDerive);
+                }
+
                 while (keyPool.size() < nFinalAccountTargetSize)
                 {
                     // We can't allocate any keys here if we are a non HD account that is locked - so don't and instead just signal to caller that there is an issue.
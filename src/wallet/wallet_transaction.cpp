@@ -28,12 +28,15 @@
 #include "Gulden/util.h"
 #include "alert.h"
 
+#include <thread>
+
 bool CWallet::SignTransaction(CAccount* fromAccount, CMutableTransaction &tx, SignType type)
 {
     AssertLockHeld(cs_wallet); // mapWallet
 
     // sign the new tx
     CTransaction txNewConst(tx);
+    const PrecomputedTransactionData txdata(txNewConst);
     int nIn = 0;
     for (const auto& input : tx.vin) {
         if (input.prevout.IsNull() && txNewConst.IsPoW2WitnessCoinBase())
@@ -70,7 +73,7 @@ bool CWallet::SignTransaction(CAccount* fromAccount, CMutableTransaction &tx, Si
             signAccount = FindAccountForTransaction(prevTx->vout[input.prevout.n]);
         if (!signAccount)
             return false;
-        if (!ProduceSignature(TransactionSignatureCreator(signingKeyID, signAccount, &txNewConst, nIn, amount, SIGHASH_ALL), prevTx->vout[input.prevout.n], sigdata, type, txNewConst.nVersion)) {
+        if (!ProduceSignature(TransactionSignatureCreator(signingKeyID, signAccount, &txNewConst, nIn, amount, SIGHASH_ALL, &txdata), prevTx->vout[input.prevout.n], sigdata, type, txNewConst.nVersion)) {
             return false;
         }
         UpdateTransaction(tx, nIn, sigdata);
@@ -190,6 +193,48 @@ void CWallet::AddTxInputs(CMutableTransaction& tx, std::set<CInputCoin>& setCoin
         tx.vin.push_back(CTxIn(coin.outpoint,CScript(), nSequence, nFlags));
 }
 
+//! Most threads to sign the inputs of one transaction with.
+static const int WALLET_SIGN_MAX_THREADS = 8;
+//! Fewer inputs than this to sign aren't worth starting threads for.
+static const size_t WALLET_SIGN_MIN_INPUTS_PER_THREAD = 16;
+
+/**
+ * Sign every input of txNew, vCoins holding the outputs they spend in the same order. The hashes over all inputs and outputs that go
+ * into every signature are done once up front, which keeps signing one pass over the transaction however many outputs it pays to; the
+ * inputs are signed side by side, only putting the signatures in place is left for after.
+ */
+static bool SignTransactionInputs(CAccount* forAccount, CMutableTransaction& txNew, const std::vector<CInputCoin>& vCoins)
+{
+    const CTransaction txNewConst(txNew);
+    const PrecomputedTransactionData txdata(txNewConst);
+    std::vector<SignatureData> vSigData(vCoins.size());
+    std::atomic<bool> fFailed(false);
+    std::atomic<size_t> nNext(0);
+    auto signInputs = [&]()
+    {
+        for (size_t nIn = nNext++; nIn < vCoins.size() && !fFailed; nIn = nNext++)
+        {
+            //fixme: (2.1) (SEGSIG) (sign type)
+            CKeyID signingKeyID = ExtractSigningPubkeyFromTxOutput(vCoins[nIn].txout, SignType::Spend);
+            if (!ProduceSignature(TransactionSignatureCreator(signingKeyID, forAccount, &txNewConst, nIn, vCoins[nIn].txout.nValue, SIGHASH_ALL, &txdata), vCoins[nIn].txout, vSigData[nIn], Spend, txNewConst.nVersion))
+                fFailed = true;
+        }
+    };
+    int nThreads = std::max(1, std::min({GetNumCores(), WALLET_SIGN_MAX_THREADS, (int)(vCoins.size() / WALLET_SIGN_MIN_INPUTS_PER_THREAD)}));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(signInputs);
+    signInputs();
+    for (auto& thread : vThreads)
+        thread.join();
+    if (fFailed)
+        return false;
+
+    for (size_t nIn = 0; nIn < vCoins.size(); ++nIn)
+        UpdateTransaction(txNew, nIn, vSigData[nIn]);
+    return true;
+}
+
 bool CWallet::CreateTransaction(CAccount* forAccount, const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKeyOrScript& reservekey, CAmount& nFeeRet,
                                 int& nChangePosInOut, std::string& strFailReason, const CCoinControl* coinControl, bool sign)
 {
@@ -477,8 +522,6 @@ bool CWallet::CreateTransaction(CAccount* forAccount, const std::vector<CRecipie
 
                 unsigned int nBytes = GetVirtualTransactionSize(txNew);
 
-                CTransaction txNewConst(txNew);
-
                 // Remove scriptSigs to eliminate the fee calculation dummy signatures
                 for (auto& vin : txNew.vin) {
                     vin.scriptSig = CScript();
@@ -542,24 +585,10 @@ bool CWallet::CreateTransaction(CAccount* forAccount, const std::vector<CRecipie
 
         if (sign)
         {
-            CTransaction txNewConst(txNew);
-            int nIn = 0;
-            for (const auto& coin : setCoins)
+            if (!SignTransactionInputs(forAccount, txNew, std::vector<CInputCoin>(setCoins.begin(), setCoins.end())))
             {
-                SignatureData sigdata;
-
-                //fixme: (2.1) (SEGSIG) (sign type)
-                CKeyID signingKeyID = ExtractSigningPubkeyFromTxOutput(coin.txout, SignType::Spend);
-
-                if (!ProduceSignature(TransactionSignatureCreator(signingKeyID, forAccount, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL),  coin.txout, sigdata, Spend, txNewConst.nVersion))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
-                }
-
-                nIn++;
+                strFailReason = _("Signing transaction failed");
+                return false;
             }
         }
 
@@ -742,8 +771,6 @@ bool CWallet::AddFeeForTransaction(CAccount* forAccount, CMutableTransaction& tx
 
                 unsigned int nBytes = GetVirtualTransactionSize(txNew);
 
-                CTransaction txNewConst(txNew);
-
                 // Remove scriptSigs to eliminate the fee calculation dummy signatures
                 for (auto& vin : txNew.vin) {
                     vin.scriptSig = CScript();
@@ -807,24 +834,10 @@ bool CWallet::AddFeeForTransaction(CAccount* forAccount, CMutableTransaction& tx
 
         if (sign)
         {
-            CTransaction txNewConst(txNew);
-            int nIn = 0;
-            for (const auto& coin : setCoins)
+            if (!SignTransactionInputs(forAccount, txNew, std::vector<CInputCoin>(setCoins.begin(), setCoins.end())))
             {
-                SignatureData sigdata;
-
-                //fixme: (2.1) (SEGSIG) (sign type)
-                CKeyID signingKeyID = ExtractSigningPubkeyFromTxOutput(coin.txout, SignType::Spend);
-
-                if (!ProduceSignature(TransactionSignatureCreator(signingKeyID, forAccount, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL),  coin.txout, sigdata, Spend, txNewConst.nVersion))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
-                }
-
-                nIn++;
+                strFailReason = _("Signing transaction failed");
+                return false;
             }
         }
 
@@ -986,7 +999,7 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKeyOrScript& reservek
             {
                 CWalletTx &coin = mapWallet[txin.prevout.getHash()];
                 coin.BindWallet(this);
-                NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
+                NotifyTransaction(coin.GetHash(), CT_UPDATED);
             }
         }
 
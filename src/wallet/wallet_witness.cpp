@@ -0,0 +1,191 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "wallet/wallet.h"
+#include "wallet/wallettx.h"
+
+#include "consensus/tx_verify.h"
+#include "consensus/validation.h"
+#include "validation/validation.h"
+#include "Gulden/util.h"
+
+const CWitnessAccountEvent* CWitnessAccountHistory::GetOrigin() const
+{
+    for (const CWitnessAccountEvent& event : vEvents)
+    {
+        if (event.type == CWitnessAccountEvent::Fund)
+            return &event;
+    }
+    return nullptr;
+}
+
+uint64_t CWitnessAccountHistory::GetAverageRewardPeriod() const
+{
+    const CWitnessAccountEvent* origin = GetOrigin();
+    if (!origin || nRewardCount == 0 || nLastRewardHeight <= origin->nHeight)
+        return 0;
+    return (nLastRewardHeight - origin->nHeight) / nRewardCount;
+}
+
+void CWallet::GetWitnessAccountEvents(const CAccount& forAccount, const CWalletTx& wtx, std::vector<CWitnessAccountEvent>& vEvents) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const auto blockIter = mapBlockIndex.find(wtx.hashBlock);
+    if (blockIter == mapBlockIndex.end() || !blockIter->second)
+        return;
+    const CBlockIndex* pindex = blockIter->second;
+
+    CWitnessAccountEvent event;
+    event.hashTx = wtx.GetHash();
+    event.hashBlock = wtx.hashBlock;
+    event.nHeight = pindex->nHeight;
+    event.nTime = pindex->GetBlockTime();
+
+    // Rewards are what the account gets out of the coinbase besides its witness output; before phase 4 that is the fixed witness subsidy in the PoW coinbase.
+    if (wtx.IsCoinBase())
+    {
+        CAmount nReward = 0;
+        CTxOutPoW2Witness witnessDetails;
+        for (const CTxOut& txOut : wtx.tx->vout)
+        {
+            if (::IsMine(forAccount, txOut) && !GetPow2WitnessOutput(txOut, witnessDetails))
+                nReward += txOut.nValue;
+        }
+        if (nReward > 0 && (wtx.IsPoW2WitnessCoinBase() || nReward == 20 * COIN))
+        {
+            event.type = CWitnessAccountEvent::Reward;
+            event.nAmount = nReward;
+            vEvents.push_back(event);
+        }
+        return;
+    }
+
+    // Classify the witness outputs and inputs the same way validation does.
+    std::vector<CWitnessTxBundle> witnessBundles;
+    CValidationState state;
+    if (!CheckTransactionContextual(*wtx.tx, state, pindex->nHeight, &witnessBundles))
+        return;
+    for (const CTxIn& txIn : wtx.tx->vin)
+    {
+        const CWalletTx* txPrev = GetWalletTx(txIn.prevout.getHash());
+        if (!txPrev || txIn.prevout.n >= txPrev->tx->vout.size())
+            break;
+        if (!CheckTxInputAgainstWitnessBundles(state, &witnessBundles, txPrev->tx->vout[txIn.prevout.n], txIn, pindex->nHeight, pindex->nHeight))
+            break;
+    }
+
+    for (const CWitnessTxBundle& witnessBundle : witnessBundles)
+    {
+        switch (witnessBundle.bundleType)
+        {
+            case CWitnessTxBundle::WitnessTxType::CreationType: event.type = CWitnessAccountEvent::Fund; break;
+            case CWitnessTxBundle::WitnessTxType::RenewType: event.type = CWitnessAccountEvent::Renew; break;
+            case CWitnessTxBundle::WitnessTxType::IncreaseType: event.type = CWitnessAccountEvent::Increase; break;
+            case CWitnessTxBundle::WitnessTxType::SplitType: event.type = CWitnessAccountEvent::Split; break;
+            case CWitnessTxBundle::WitnessTxType::MergeType: event.type = CWitnessAccountEvent::Merge; break;
+            case CWitnessTxBundle::WitnessTxType::ChangeWitnessKeyType: event.type = CWitnessAccountEvent::ChangeKey; break;
+            case CWitnessTxBundle::WitnessTxType::SpendType: event.type = CWitnessAccountEvent::Empty; break;
+            case CWitnessTxBundle::WitnessTxType::WitnessType: continue;
+        }
+
+        event.nAmount = 0;
+        event.nLockLength = 0;
+        event.nLockUntilBlock = 0;
+        bool fMine = false;
+        if (event.type == CWitnessAccountEvent::Empty)
+        {
+            for (const auto& [txOut, witnessDetails] : witnessBundle.inputs)
+            {
+                (unused)witnessDetails;
+                if (::IsMine(forAccount, txOut))
+                {
+                    fMine = true;
+                    event.nAmount += txOut.nValue;
+                }
+            }
+        }
+        else
+        {
+            for (const auto& [txOut, witnessDetails] : witnessBundle.outputs)
+            {
+                (unused)witnessDetails;
+                if (::IsMine(forAccount, txOut))
+                {
+                    fMine = true;
+                    event.nAmount += txOut.nValue;
+                    uint64_t nLockFromBlock, nLockUntilBlock;
+                    event.nLockLength = std::max<uint64_t>(event.nLockLength, GetPoW2LockLengthInBlocksFromOutput(txOut, pindex->nHeight, nLockFromBlock, nLockUntilBlock));
+                    event.nLockUntilBlock = std::max(event.nLockUntilBlock, nLockUntilBlock);
+                }
+            }
+        }
+        if (fMine)
+            vEvents.push_back(event);
+    }
+}
+
+void CWallet::GetWitnessAccountHistory(const CAccount* forAccount, CWitnessAccountHistory& history) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    history = CWitnessAccountHistory();
+    if (!forAccount || !forAccount->IsPoW2Witness())
+        return;
+
+    // Bring the accounts already indexed up to date with the transactions that changed since, then index this one if it is new.
+    if (!setWitnessAccountEventsDirty.empty())
+    {
+        for (auto& [accountUUID, mapEvents] : mapWitnessAccountEvents)
+        {
+            const auto accountIter = mapAccounts.find(accountUUID);
+            for (const uint256& hash : setWitnessAccountEventsDirty)
+            {
+                mapEvents.erase(hash);
+                const auto walletIter = mapWallet.find(hash);
+                if (accountIter == mapAccounts.end() || walletIter == mapWallet.end())
+                    continue;
+                std::vector<CWitnessAccountEvent> vEvents;
+                GetWitnessAccountEvents(*accountIter->second, walletIter->second, vEvents);
+                if (!vEvents.empty())
+                    mapEvents[hash] = std::move(vEvents);
+            }
+        }
+        setWitnessAccountEventsDirty.clear();
+    }
+    auto [indexIter, fNew] = mapWitnessAccountEvents.emplace(forAccount->getUUID(), std::map<uint256, std::vector<CWitnessAccountEvent>>());
+    if (fNew)
+    {
+        for (const auto& [hash, wtx] : mapWallet)
+        {
+            std::vector<CWitnessAccountEvent> vEvents;
+            GetWitnessAccountEvents(*forAccount, wtx, vEvents);
+            if (!vEvents.empty())
+                indexIter->second[hash] = std::move(vEvents);
+        }
+    }
+
+    for (const auto& [hash, vEvents] : indexIter->second)
+    {
+        (unused)hash;
+        for (const CWitnessAccountEvent& event : vEvents)
+        {
+            const auto blockIter = mapBlockIndex.find(event.hashBlock);
+            if (blockIter == mapBlockIndex.end() || !chainActive.Contains(blockIter->second))
+                continue;
+            history.vEvents.push_back(event);
+        }
+    }
+    std::stable_sort(history.vEvents.begin(), history.vEvents.end(), [](const CWitnessAccountEvent& a, const CWitnessAccountEvent& b) { return a.nHeight < b.nHeight; });
+    for (const CWitnessAccountEvent& event : history.vEvents)
+    {
+        if (event.type != CWitnessAccountEvent::Reward)
+            continue;
+        history.nRewardsToDate += event.nAmount;
+        ++history.nRewardCount;
+        history.nLastRewardHeight = event.nHeight;
+    }
+}
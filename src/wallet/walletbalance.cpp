@@ -348,111 +348,77 @@ CAmount CWalletTx::GetChange() const
 
 extern bool IsMine(const CAccount* forAccount, const CWalletTx& tx);
 
-CAmount CWallet::GetBalance(const CAccount* forAccount, bool useCache, bool includePoW2LockedWitnesses, bool includeChildren) const
+void CWallet::CalculateBalances(WalletBalances& balances, const CAccount* forAccount, bool useCache) const
 {
-    CAmount nTotal = 0;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    balances.availableIncludingLocked = balances.availableExcludingLocked = 0;
+    balances.unconfirmedIncludingLocked = balances.unconfirmedExcludingLocked = 0;
+    balances.immatureIncludingLocked = balances.immatureExcludingLocked = 0;
+    for (const auto& walletEntry : mapWallet)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            //fixme: (Post-2.1) - is this okay? Should it be cached or something? (CBSU?)
-            if (!forAccount || ::IsMine(forAccount, *pcoin))
-            {
-                if (pcoin->IsTrusted() && !pcoin->isAbandoned() && pcoin->mapValue.count("replaced_by_txid") == 0)
-                {
-                    nTotal += includePoW2LockedWitnesses ? pcoin->GetAvailableCreditIncludingLockedWitnesses(useCache, forAccount) : pcoin->GetAvailableCredit(useCache, forAccount);
-                }
-            }
+        const CWalletTx* pcoin = &walletEntry.second;
+        if (pcoin->isAbandoned() || pcoin->mapValue.count("replaced_by_txid") != 0)
+            continue;
+        //fixme: (Post-2.1) - is this okay? Should it be cached or something? (CBSU?)
+        if (forAccount && !::IsMine(forAccount, *pcoin))
+            continue;
 
+        int nDepth = pcoin->GetDepthInMainChain();
+        if (pcoin->IsTrusted())
+        {
+            balances.availableIncludingLocked += pcoin->GetAvailableCreditIncludingLockedWitnesses(useCache, forAccount);
+            balances.availableExcludingLocked += pcoin->GetAvailableCredit(useCache, forAccount);
         }
-    }
-    if (forAccount && includeChildren)
-    {
-        for (const auto& accountItem : mapAccounts)
+        else if (nDepth == 0 && pcoin->InMempool())
         {
-            const auto& childAccount = accountItem.second;
-            if (childAccount->getParentUUID() == forAccount->getUUID())
-            {
-                nTotal += GetBalance(childAccount, includePoW2LockedWitnesses, false);
-            }
+            balances.unconfirmedIncludingLocked += pcoin->GetAvailableCreditIncludingLockedWitnesses(useCache, forAccount);
+            balances.unconfirmedExcludingLocked += pcoin->GetAvailableCredit(useCache, forAccount);
+        }
+        if (nDepth > 0)
+        {
+            balances.immatureIncludingLocked += pcoin->GetImmatureCreditIncludingLockedWitnesses(useCache, forAccount);
+            balances.immatureExcludingLocked += pcoin->GetImmatureCredit(useCache, forAccount);
         }
     }
-
-    return nTotal;
-}
-
-CAmount CWallet::GetLockedBalance(const CAccount* forAccount, bool includeChildren)
-{
-    //fixme: (2.1) This can probably be drastically improved.
-    WalletBalances balances;
-    GetBalances(balances, forAccount, includeChildren);
-    return balances.totalLocked;;
-}
-
-void CWallet::GetBalances(WalletBalances& balances, const CAccount* forAccount, bool includeChildren) const
-{
-    balances.availableIncludingLocked = GetBalance(forAccount, true, true, includeChildren);
-    balances.availableExcludingLocked = GetBalance(forAccount, true, false, includeChildren);
     balances.availableLocked = balances.availableIncludingLocked - balances.availableExcludingLocked;
-    balances.unconfirmedIncludingLocked = GetUnconfirmedBalance(forAccount, true, includeChildren);
-    balances.unconfirmedExcludingLocked = GetUnconfirmedBalance(forAccount, false, includeChildren);
     balances.unconfirmedLocked = balances.unconfirmedIncludingLocked - balances.unconfirmedExcludingLocked;
-    balances.immatureIncludingLocked = GetImmatureBalance(forAccount, true, includeChildren);
-    balances.immatureExcludingLocked = GetImmatureBalance(forAccount, false, includeChildren);
     balances.immatureLocked = balances.immatureIncludingLocked - balances.immatureExcludingLocked;
     balances.totalLocked = balances.availableLocked + balances.unconfirmedLocked + balances.immatureLocked;
 }
 
-CAmount CWallet::GetUnconfirmedBalance(const CAccount* forAccount, bool includePoW2LockedWitnesses, bool includeChildren) const
+const WalletBalances& CWallet::GetCachedBalances(const CAccount* forAccount) const
 {
-    CAmount nTotal = 0;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    uint64_t nGeneration = nBalancesGeneration;
+    if (nGeneration != nBalancesCacheGeneration || chainActive.Tip() != pBalancesCacheTip || mempool.GetTransactionsUpdated() != nBalancesCacheMempoolUpdated)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            //fixme: (Post-2.1)- is this okay? Should it be cached or something? (CBSU?)
-            if (!forAccount || ::IsMine(forAccount, *pcoin))
-            {
-                if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool() && !pcoin->isAbandoned() && pcoin->mapValue.count("replaced_by_txid") == 0)
-                {
-                    nTotal += includePoW2LockedWitnesses ? pcoin->GetAvailableCreditIncludingLockedWitnesses(true, forAccount) : pcoin->GetAvailableCredit(true, forAccount);
-                }
-            }
-        }
+        mapBalancesCache.clear();
+        nBalancesCacheGeneration = nGeneration;
+        pBalancesCacheTip = chainActive.Tip();
+        nBalancesCacheMempoolUpdated = mempool.GetTransactionsUpdated();
     }
-    if (forAccount && includeChildren)
+
+    const boost::uuids::uuid accountUUID = forAccount ? forAccount->getUUID() : boost::uuids::nil_uuid();
+    auto it = mapBalancesCache.find(accountUUID);
+    if (it == mapBalancesCache.end())
     {
-        for (const auto& accountItem : mapAccounts)
-        {
-            const auto& childAccount = accountItem.second;
-            if (childAccount->getParentUUID() == forAccount->getUUID())
-            {
-                nTotal += GetUnconfirmedBalance(childAccount, includePoW2LockedWitnesses, false);
-            }
-        }
+        it = mapBalancesCache.emplace(accountUUID, WalletBalances()).first;
+        CalculateBalances(it->second, forAccount, true);
     }
-    return nTotal;
+    return it->second;
 }
 
-CAmount CWallet::GetImmatureBalance(const CAccount* forAccount, bool includePoW2LockedWitnesses, bool includeChildren) const
+void CWallet::GetBalances(WalletBalances& balances, const CAccount* forAccount, bool includeChildren, bool useCache) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->isAbandoned() && pcoin->GetDepthInMainChain() > 0 && pcoin->mapValue.count("replaced_by_txid") == 0)
-            {
-                if (!forAccount || ::IsMine(forAccount, *pcoin))
-                {
-                    nTotal += includePoW2LockedWitnesses ? pcoin->GetImmatureCreditIncludingLockedWitnesses(true, forAccount) : pcoin->GetImmatureCredit(true, forAccount);
-                }
-            }
-        }
-    }
+    LOCK2(cs_main, cs_wallet);
+    if (useCache)
+        balances = GetCachedBalances(forAccount);
+    else
+        CalculateBalances(balances, forAccount, false);
     if (forAccount && includeChildren)
     {
         for (const auto& accountItem : mapAccounts)
@@ -460,11 +426,47 @@ CAmount CWallet::GetImmatureBalance(const CAccount* forAccount, bool includePoW2
             const auto& childAccount = accountItem.second;
             if (childAccount->getParentUUID() == forAccount->getUUID())
             {
-                nTotal += GetImmatureBalance(childAccount, includePoW2LockedWitnesses, false);
+                if (useCache)
+                {
+                    balances += GetCachedBalances(childAccount);
+                }
+                else
+                {
+                    WalletBalances childBalances;
+                    CalculateBalances(childBalances, childAccount, false);
+                    balances += childBalances;
+                }
             }
         }
     }
-    return nTotal;
+}
+
+CAmount CWallet::GetBalance(const CAccount* forAccount, bool useCache, bool includePoW2LockedWitnesses, bool includeChildren) const
+{
+    WalletBalances balances;
+    GetBalances(balances, forAccount, includeChildren, useCache);
+    return includePoW2LockedWitnesses ? balances.availableIncludingLocked : balances.availableExcludingLocked;
+}
+
+CAmount CWallet::GetLockedBalance(const CAccount* forAccount, bool includeChildren)
+{
+    WalletBalances balances;
+    GetBalances(balances, forAccount, includeChildren);
+    return balances.totalLocked;
+}
+
+CAmount CWallet::GetUnconfirmedBalance(const CAccount* forAccount, bool includePoW2LockedWitnesses, bool includeChildren) const
+{
+    WalletBalances balances;
+    GetBalances(balances, forAccount, includeChildren);
+    return includePoW2LockedWitnesses ? balances.unconfirmedIncludingLocked : balances.unconfirmedExcludingLocked;
+}
+
+CAmount CWallet::GetImmatureBalance(const CAccount* forAccount, bool includePoW2LockedWitnesses, bool includeChildren) const
+{
+    WalletBalances balances;
+    GetBalances(balances, forAccount, includeChildren);
+    return includePoW2LockedWitnesses ? balances.immatureIncludingLocked : balances.immatureExcludingLocked;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
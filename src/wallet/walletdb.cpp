@@ -24,6 +24,7 @@
 #include "wallet/wallet.h"
 
 #include <atomic>
+#include <thread>
 
 
 #include <boost/thread.hpp>
@@ -393,14 +394,115 @@ public:
     int nFileVersion;
     std::vector<uint256> vWalletUpgrade;
 
+    //! Leave the decoding of transactions to LoadDeferredTransactions, which can do many of them at once.
+    bool fDeferTransactions;
+    std::vector<std::pair<uint256, CDataStream>> vDeferredTx;
+
     CWalletScanState() {
         nKeys = nCKeys = nKeyMeta = 0;
         fIsEncrypted = false;
         fAnyUnordered = false;
         nFileVersion = 0;
+        fDeferTransactions = false;
     }
 };
 
+//! Decode and check the wallet transaction of a "tx" record; doesn't touch the wallet, so that many can be decoded at once.
+static bool ReadWalletTx(const uint256& hash, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgrade, std::string& strErr)
+{
+    ssValue >> wtx;
+    CValidationState state;
+
+    if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgrade = true;
+    }
+    return true;
+}
+
+static void LoadWalletTx(CWallet* pwallet, CWalletScanState& wss, const uint256& hash, const CWalletTx& wtx, bool fUpgrade)
+{
+    if (fUpgrade)
+        wss.vWalletUpgrade.push_back(hash);
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->LoadToWallet(wtx);
+}
+
+/**
+ * Decode and check the transactions gathered in wss.vDeferredTx on a few threads, then add them to the wallet in the order they were read;
+ * returns false if any of them is bad, like ReadKeyValue does for a single one.
+ */
+static bool LoadDeferredTransactions(CWallet* pwallet, CWalletScanState& wss)
+{
+    struct DecodedTx
+    {
+        CWalletTx wtx;
+        bool fValid = false;
+        bool fUpgrade = false;
+        std::string strErr;
+    };
+    std::vector<DecodedTx> vDecoded(wss.vDeferredTx.size());
+
+    std::atomic<size_t> nNext(0);
+    auto decode = [&]()
+    {
+        for (size_t i = nNext++; i < vDecoded.size(); i = nNext++)
+        {
+            try
+            {
+                vDecoded[i].fValid = ReadWalletTx(wss.vDeferredTx[i].first, wss.vDeferredTx[i].second, vDecoded[i].wtx, vDecoded[i].fUpgrade, vDecoded[i].strErr);
+            }
+            catch (...)
+            {
+                vDecoded[i].fValid = false;
+            }
+        }
+    };
+    int nThreads = std::max(1, std::min({GetNumCores(), WALLET_LOAD_MAX_THREADS, (int)(vDecoded.size() / WALLET_LOAD_MIN_TX_PER_THREAD)}));
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(decode);
+    decode();
+    for (auto& thread : vThreads)
+        thread.join();
+
+    bool fAllValid = true;
+    for (size_t i = 0; i < vDecoded.size(); ++i)
+    {
+        if (!vDecoded[i].strErr.empty())
+            LogPrintf("%s\n", vDecoded[i].strErr);
+        if (!vDecoded[i].fValid)
+        {
+            fAllValid = false;
+            continue;
+        }
+        LoadWalletTx(pwallet, wss, wss.vDeferredTx[i].first, vDecoded[i].wtx, vDecoded[i].fUpgrade);
+    }
+    wss.vDeferredTx.clear();
+    return fAllValid;
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr)
@@ -426,37 +528,17 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         {
             uint256 hash;
             ssKey >> hash;
-            CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
-                return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+            if (wss.fDeferTransactions)
             {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
+                // Decoded later, together with others (see LoadDeferredTransactions).
+                wss.vDeferredTx.emplace_back(hash, ssValue);
+                return true;
             }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
+            CWalletTx wtx;
+            bool fUpgrade = false;
+            if (!ReadWalletTx(hash, ssValue, wtx, fUpgrade, strErr))
+                return false;
+            LoadWalletTx(pwallet, wss, hash, wtx, fUpgrade);
         }
         else if (strType == "acentry")
         {
@@ -864,6 +946,7 @@ bool CWalletDB::IsKeyType(const std::string& strType)
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet, WalletLoadState& nExtraLoadState)
 {
     CWalletScanState wss;
+    wss.fDeferTransactions = true;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
@@ -1036,8 +1119,20 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet, WalletLoadState& nExtraLoadStat
             }
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
+
+            if (wss.vDeferredTx.size() >= WALLET_LOAD_TX_BATCH_SIZE && !LoadDeferredTransactions(pwallet, wss))
+            {
+                fNoncriticalErrors = true;
+                SoftSetBoolArg("-rescan", true);
+            }
         }
         pcursor->close();
+
+        if (!LoadDeferredTransactions(pwallet, wss))
+        {
+            fNoncriticalErrors = true;
+            SoftSetBoolArg("-rescan", true);
+        }
     }
     catch (const boost::thread_interrupted&) {
         throw;
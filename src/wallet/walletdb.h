@@ -41,6 +41,12 @@
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Transaction records LoadWallet gathers before decoding them together.
+static const size_t WALLET_LOAD_TX_BATCH_SIZE = 10000;
+//! Most threads LoadWallet decodes transactions with.
+static const int WALLET_LOAD_MAX_THREADS = 8;
+//! Fewer transactions than this per thread aren't worth starting one for.
+static const size_t WALLET_LOAD_MIN_TX_PER_THREAD = 500;
 
 class CHDSeed;
 class CAccount;
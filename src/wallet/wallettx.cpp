@@ -13,6 +13,27 @@
 #include "wallet/wallet.h"
 #include "wallet/wallettx.h"
 
+void CWalletTx::MarkDirty()
+{
+    fChangeCached = false;
+    nChangeCached = 0;
+    debitCached.clear();
+    creditCached.clear();
+    immatureCreditCached.clear();
+    availableCreditCached.clear();
+    availableCreditCachedIncludingLockedWitnesses.clear();
+    watchDebitCached.clear();
+    watchCreditCached.clear();
+    immatureWatchCreditCached.clear();
+    availableWatchCreditCached.clear();
+    if (pwallet)
+    {
+        pwallet->MarkBalancesDirty();
+        if (tx)
+            pwallet->MarkAvailableCoinsCandidate(GetHash());
+    }
+}
+
 int64_t CWalletTx::GetTxTime() const
 {
     int64_t n = nTimeSmart;
@@ -205,20 +205,8 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fChangeCached = false;
-        nChangeCached = 0;
-        debitCached.clear();
-        creditCached.clear();
-        immatureCreditCached.clear();
-        availableCreditCached.clear();
-        availableCreditCachedIncludingLockedWitnesses.clear();
-        watchDebitCached.clear();
-        watchCreditCached.clear();
-        immatureWatchCreditCached.clear();
-        availableWatchCreditCached.clear();
-    }
+    //! Break the credit/debit caches, and with them the balances the wallet keeps per account.
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
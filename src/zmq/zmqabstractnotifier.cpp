@@ -21,6 +21,21 @@ bool CZMQAbstractNotifier::NotifyStalledWitness(const CBlockIndex* pDelayedIndex
     return true;
 }
 
+bool CZMQAbstractNotifier::NotifyWitnessSelected(const CBlockIndex* /*pindex*/, const COutPoint& /*selectedWitnessOutpoint*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyWitnessSigned(const CBlockIndex* /*pindex*/, const CBlock& /*block*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyPhaseChange(const CBlockIndex* /*pindex*/, int /*nPhaseOld*/, int /*nPhaseNew*/)
+{
+    return true;
+}
+
 bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
 {
     return true;
@@ -28,18 +28,24 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetOutboundMessageHighWaterMark() const { return nOutboundMessageHighWaterMark; }
+    void SetOutboundMessageHighWaterMark(int nHighWaterMark) { nOutboundMessageHighWaterMark = nHighWaterMark; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyStalledWitness(const CBlockIndex* pDelayedIndex, uint64_t nSecondsDelayed);
+    virtual bool NotifyWitnessSelected(const CBlockIndex* pindex, const COutPoint& selectedWitnessOutpoint);
+    virtual bool NotifyWitnessSigned(const CBlockIndex* pindex, const CBlock& block);
+    virtual bool NotifyPhaseChange(const CBlockIndex* pindex, int nPhaseOld, int nPhaseNew);
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int nOutboundMessageHighWaterMark = 0;
 };
 
 #endif // GULDEN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -20,12 +20,16 @@ public:
 
     static CZMQNotificationInterface* Create();
 
+    std::list<const CZMQAbstractNotifier*> GetActiveNotifiers() const;
+
 protected:
     bool Initialize();
     void Shutdown();
 
     // CValidationInterface
     void StalledWitness(const CBlockIndex* pBlock, uint64_t nSeconds) override;
+    void WitnessSelected(const CBlockIndex* pBlock, const COutPoint& selectedWitnessOutpoint) override;
+    void PoW2PhaseChanged(const CBlockIndex* pindexNew, int nPhaseOld, int nPhaseNew) override;
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
@@ -38,4 +42,6 @@ private:
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 
+extern CZMQNotificationInterface* pzmqNotificationInterface;
+
 #endif // GULDEN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -11,12 +11,18 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "pubkey.h"
 #include "streams.h"
 #include "zmqpublishnotifier.h"
 #include "validation/validation.h"
 #include "util.h"
 #include "rpc/server.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
@@ -25,48 +31,137 @@ static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_STALLEDWITNESS = "stalledwitness";
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+static const char *MSG_RAWHEADER = "rawheader";
+static const char *MSG_WITNESSSELECTED = "witnessselected";
+static const char *MSG_WITNESSSIGNED = "witnesssigned";
+static const char *MSG_PHASECHANGE = "phasechange";
+
+static void zmq_free_data(void* /*data*/, void* hint)
 {
-    va_list args;
-    va_start(args, size);
+    delete static_cast<std::vector<unsigned char>*>(hint);
+}
 
-    while (1)
+// Internal function to send a three part message: command, data and a LE 4byte sequence number.
+// The data is handed to zmq as is instead of copied, it is freed once zmq has sent it.
+static int zmq_send_message(void *sock, const char* command, std::vector<unsigned char>&& data, uint32_t nSequence)
+{
+    if (zmq_send(sock, command, strlen(command), ZMQ_SNDMORE) == -1)
     {
-        zmq_msg_t msg;
+        zmqError("Unable to send ZMQ msg");
+        return -1;
+    }
 
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0)
-        {
-            zmqError("Unable to initialize ZMQ msg");
-            va_end(args);
-            return -1;
-        }
+    std::vector<unsigned char>* pData = new std::vector<unsigned char>(std::move(data));
+    zmq_msg_t msg;
+    if (zmq_msg_init_data(&msg, pData->data(), pData->size(), zmq_free_data, pData) != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        delete pData;
+        return -1;
+    }
+    if (zmq_msg_send(&msg, sock, ZMQ_SNDMORE) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msg);
+        return -1;
+    }
 
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], nSequence);
+    if (zmq_send(sock, msgseq, sizeof(msgseq), 0) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        return -1;
+    }
+    return 0;
+}
 
-        data = va_arg(args, const void*);
+/**
+ * A publishing socket, with the queue of messages for it and the thread that sends them; shared by the notifiers that publish on the same address.
+ * Validation only ever waits for a message to be queued: when subscribers can't keep up the queue fills to its limit and further messages are
+ * dropped, the gap shows in the sequence numbers.
+ */
+class CZMQPublishSocket
+{
+public:
+    struct Message
+    {
+        const char* command;
+        std::vector<unsigned char> data;
+        std::function<bool(std::vector<unsigned char>&)> makeData;
+        uint32_t nSequence;
+    };
+
+    CZMQPublishSocket(void* psocketIn, size_t nMaxQueueIn)
+    : psocket(psocketIn)
+    , nMaxQueue(nMaxQueueIn)
+    , thread(&CZMQPublishSocket::ThreadSend, this)
+    {
+    }
 
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1)
+    //! Sends what is still queued, then closes the socket.
+    ~CZMQPublishSocket()
+    {
         {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            va_end(args);
-            return -1;
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
         }
+        cond.notify_one();
+        thread.join();
+        int linger = 0;
+        zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
+        zmq_close(psocket);
+    }
 
-        zmq_msg_close(&msg);
+    //! False if the queue is full.
+    bool Push(Message&& message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() >= nMaxQueue)
+                return false;
+            queue.push_back(std::move(message));
+        }
+        cond.notify_one();
+        return true;
+    }
 
-        if (!data)
-            break;
+    size_t GetQueueSize()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
 
-        size = va_arg(args, size_t);
+private:
+    void ThreadSend()
+    {
+        RenameThread("Gulden-zmqpub");
+        while (true)
+        {
+            Message message;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]{ return !queue.empty() || fStop; });
+                if (queue.empty())
+                    return;
+                message = std::move(queue.front());
+                queue.pop_front();
+            }
+            if (message.makeData && !message.makeData(message.data))
+                continue;
+
+            zmq_send_message(psocket, message.command, std::move(message.data), message.nSequence);
+        }
     }
-    va_end(args);
-    return 0;
-}
+
+    void* psocket;
+    const size_t nMaxQueue;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Message> queue;
+    bool fStop = false;
+    std::thread thread;
+};
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
@@ -84,14 +179,26 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &nOutboundMessageHighWaterMark, sizeof(nOutboundMessageHighWaterMark));
+        if (rc!=0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            psocket = 0;
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
             zmq_close(psocket);
+            psocket = 0;
             return false;
         }
 
+        socket = std::make_shared<CZMQPublishSocket>(psocket, std::max<int64_t>(1, GetArg("-zmqqueuesize", DEFAULT_ZMQ_QUEUE_SIZE)));
+
         // register this notifier for the address, so it can be reused for other publish notifier
         mapPublishNotifiers.insert(std::pair(address, this));
         return true;
@@ -101,6 +208,7 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
         LogPrint(BCLog::ZMQ, "zmq: Reusing socket for address %s\n", address);
 
         psocket = i->second->psocket;
+        socket = i->second->socket;
         mapPublishNotifiers.insert(std::pair(address, this));
 
         return true;
@@ -126,31 +234,45 @@ void CZMQAbstractPublishNotifier::Shutdown()
         }
     }
 
+    // The last notifier on the socket takes the thread down with it and closes the socket.
     if (count == 1)
-    {
         LogPrint(BCLog::ZMQ, "Close socket at address %s\n", address);
-        int linger = 0;
-        zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
-        zmq_close(psocket);
-    }
+    socket = nullptr;
 
     psocket = 0;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+size_t CZMQAbstractPublishNotifier::GetQueueSize() const
+{
+    return socket ? socket->GetQueueSize() : 0;
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, std::vector<unsigned char> data)
 {
     assert(psocket);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
-        return false;
+    /* the sequence number is used up even if the message is dropped, so that the gap shows */
+    uint32_t nMessageSequence = nSequence++;
+    if (!socket->Push(CZMQPublishSocket::Message{command, std::move(data), nullptr, nMessageSequence}))
+    {
+        uint64_t nDroppedSoFar = ++nDropped;
+        LogPrint(BCLog::ZMQ, "zmq: Queue of %s full, dropped %s message %u (%u dropped so far)\n", address, command, nMessageSequence, nDroppedSoFar);
+    }
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    // Dropping isn't a failure of the notifier, it stays in place for the messages after.
+    return true;
+}
 
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, std::function<bool(std::vector<unsigned char>&)> makeData)
+{
+    assert(psocket);
+
+    uint32_t nMessageSequence = nSequence++;
+    if (!socket->Push(CZMQPublishSocket::Message{command, std::vector<unsigned char>(), std::move(makeData), nMessageSequence}))
+    {
+        uint64_t nDroppedSoFar = ++nDropped;
+        LogPrint(BCLog::ZMQ, "zmq: Queue of %s full, dropped %s message %u (%u dropped so far)\n", address, command, nMessageSequence, nDroppedSoFar);
+    }
     return true;
 }
 
@@ -158,40 +280,40 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHashPoW2();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashblock %s\n", hash.GetHex());
-    unsigned char data[32];
+    std::vector<unsigned char> data(32);
     for (unsigned int i = 0; i < 32; i++)
         data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHBLOCK, data, 32);
+    return SendMessage(MSG_HASHBLOCK, std::move(data));
 }
 
 bool CZMQPublishStalledWitnessNotifier::NotifyStalledWitness(const CBlockIndex* pDelayedIndex, uint64_t nSecondsDelayed)
 {
     uint256 hash = pDelayedIndex->GetBlockHashPoW2();
     LogPrint(BCLog::ZMQ, "zmq: Publish stalled witness hashblock %s %d\n", hash.GetHex(), nSecondsDelayed);
-    unsigned char data[40];
+    std::vector<unsigned char> data(40);
     for (unsigned int i = 0; i < 32; i++)
         data[31 - i] = hash.begin()[i];
     WriteLE64(&data[32], nSecondsDelayed);
-    return SendMessage(MSG_STALLEDWITNESS, data, 40);
+    return SendMessage(MSG_STALLEDWITNESS, std::move(data));
 }
 
 bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
+    std::vector<unsigned char> data(32);
     for (unsigned int i = 0; i < 32; i++)
         data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    return SendMessage(MSG_HASHTX, std::move(data));
 }
 
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHashPoW2().GetHex());
 
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    // Read and serialised on the thread of the socket, block indexes stay in place.
+    return SendMessage(MSG_RAWBLOCK, [pindex](std::vector<unsigned char>& data)
     {
-        LOCK(cs_main);// cs_main required for ReadBlockFromDisk.
         CBlock block;
         if(!ReadBlockFromDisk(block, pindex, Params()))
         {
@@ -199,17 +321,71 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
             return false;
         }
 
-        ss << block;
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), data, 0, block);
+        return true;
+    });
+}
+
+bool CZMQPublishRawHeaderNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawheader %s\n", pindex->GetBlockHashPoW2().GetHex());
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0, pindex->GetBlockHeader());
+    return SendMessage(MSG_RAWHEADER, std::move(data));
+}
+
+bool CZMQPublishWitnessSelectedNotifier::NotifyWitnessSelected(const CBlockIndex* pindex, const COutPoint& selectedWitnessOutpoint)
+{
+    uint256 hash = pindex->GetBlockHashPoW2();
+    LogPrint(BCLog::ZMQ, "zmq: Publish witnessselected %s %s\n", hash.GetHex(), selectedWitnessOutpoint.ToString());
+    std::vector<unsigned char> data(68);
+    const uint256 hashWitnessTx = selectedWitnessOutpoint.getHash();
+    for (unsigned int i = 0; i < 32; i++)
+    {
+        data[31 - i] = hash.begin()[i];
+        data[63 - i] = hashWitnessTx.begin()[i];
     }
+    WriteLE32(&data[64], selectedWitnessOutpoint.n);
+    return SendMessage(MSG_WITNESSSELECTED, std::move(data));
+}
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+bool CZMQPublishWitnessSignedNotifier::NotifyWitnessSigned(const CBlockIndex* pindex, const CBlock& block)
+{
+    uint256 hash = pindex->GetBlockHashPoW2();
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hash, block.witnessHeaderPoW2Sig))
+    {
+        // Can't happen for a block that was connected, nothing to tell then.
+        LogPrint(BCLog::ZMQ, "zmq: No witness signature on block %s\n", hash.GetHex());
+        return true;
+    }
+    CKeyID witnessKeyID = pubkey.GetID();
+    LogPrint(BCLog::ZMQ, "zmq: Publish witnesssigned %s %s\n", hash.GetHex(), witnessKeyID.GetHex());
+    std::vector<unsigned char> data(56);
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    WriteLE32(&data[32], pindex->nHeight);
+    std::copy(witnessKeyID.begin(), witnessKeyID.end(), data.begin() + 36);
+    return SendMessage(MSG_WITNESSSIGNED, std::move(data));
+}
+
+bool CZMQPublishPhaseChangeNotifier::NotifyPhaseChange(const CBlockIndex* pindex, int nPhaseOld, int nPhaseNew)
+{
+    uint256 hash = pindex->GetBlockHashPoW2();
+    LogPrint(BCLog::ZMQ, "zmq: Publish phasechange %s %d -> %d\n", hash.GetHex(), nPhaseOld, nPhaseNew);
+    std::vector<unsigned char> data(40);
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    WriteLE32(&data[32], nPhaseOld);
+    WriteLE32(&data[36], nPhaseNew);
+    return SendMessage(MSG_PHASECHANGE, std::move(data));
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), data, 0, transaction);
+    return SendMessage(MSG_RAWTX, std::move(data));
 }
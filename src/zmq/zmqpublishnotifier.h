@@ -7,22 +7,42 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
 class CBlockIndex;
+class CZMQPublishSocket;
+
+//! Default for -zmqpub<type>hwm, the ZMQ high water mark of the socket: messages it holds per subscriber before it drops them
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+//! Default for -zmqqueuesize, messages waiting to be sent on a socket before further notifications for it are dropped
+static const int DEFAULT_ZMQ_QUEUE_SIZE = 10000;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence; //!< upcounting per message sequence number
+    std::atomic<uint32_t> nSequence{0}; //!< upcounting per message sequence number, dropped messages use one up too so that subscribers can tell
+    std::atomic<uint64_t> nDropped{0}; //!< messages dropped because the queue of the socket was full
+    std::shared_ptr<CZMQPublishSocket> socket;
 
 public:
 
-    /* send zmq multipart message
+    /* queue zmq multipart message, sent by the thread of the socket
        parts:
           * command
           * data
           * message sequence number
     */
-    bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendMessage(const char *command, std::vector<unsigned char> data);
+    //! The same with data made by makeData on the thread of the socket, for data that is expensive to get (a block from disk); false from makeData drops the message.
+    bool SendMessage(const char *command, std::function<bool(std::vector<unsigned char>&)> makeData);
+
+    uint32_t GetSequence() const { return nSequence; }
+    uint64_t GetDropped() const { return nDropped; }
+    //! Messages waiting to be sent on the socket, by this notifier and those sharing the socket with it.
+    size_t GetQueueSize() const;
 
     bool Initialize(void *pcontext);
     void Shutdown();
@@ -40,6 +60,24 @@ public:
     bool NotifyStalledWitness(const CBlockIndex* pDelayedIndex, uint64_t nSecondsDelayed) override;
 };
 
+class CZMQPublishWitnessSelectedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyWitnessSelected(const CBlockIndex* pindex, const COutPoint& selectedWitnessOutpoint) override;
+};
+
+class CZMQPublishWitnessSignedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyWitnessSigned(const CBlockIndex* pindex, const CBlock& block) override;
+};
+
+class CZMQPublishPhaseChangeNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyPhaseChange(const CBlockIndex* pindex, int nPhaseOld, int nPhaseNew) override;
+};
+
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
@@ -52,6 +90,12 @@ public:
     bool NotifyBlock(const CBlockIndex *pindex);
 };
 
+class CZMQPublishRawHeaderNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlock(const CBlockIndex *pindex);
+};
+
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
@@ -0,0 +1,67 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#include "zmq/zmqrpc.h"
+
+#include "rpc/server.h"
+#include "zmq/zmqabstractnotifier.h"
+#include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqpublishnotifier.h"
+
+#include <univalue.h>
+
+static UniValue getzmqnotifications(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getzmqnotifications\n"
+            "\nReturns information about the active ZeroMQ notifications.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"type\": \"pubhashtx\",          (string) Type of notification\n"
+            "    \"address\": \"...\",             (string) Address of the publisher\n"
+            "    \"hwm\": n,                     (numeric) Outbound message high water mark of the socket\n"
+            "    \"sequence\": n,                (numeric) Sequence number the next message will get\n"
+            "    \"dropped\": n,                 (numeric) Messages dropped because the queue of the socket was full, their sequence numbers are skipped\n"
+            "    \"queued\": n                   (numeric) Messages waiting to be sent on the socket\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getzmqnotifications", "")
+            + HelpExampleRpc("getzmqnotifications", ""));
+
+    UniValue result(UniValue::VARR);
+    if (pzmqNotificationInterface)
+    {
+        for (const CZMQAbstractNotifier* notifier : pzmqNotificationInterface->GetActiveNotifiers())
+        {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("type", notifier->GetType()));
+            obj.push_back(Pair("address", notifier->GetAddress()));
+            obj.push_back(Pair("hwm", notifier->GetOutboundMessageHighWaterMark()));
+            if (const CZMQAbstractPublishNotifier* publisher = dynamic_cast<const CZMQAbstractPublishNotifier*>(notifier))
+            {
+                obj.push_back(Pair("sequence", (uint64_t)publisher->GetSequence()));
+                obj.push_back(Pair("dropped", publisher->GetDropped()));
+                obj.push_back(Pair("queued", (uint64_t)publisher->GetQueueSize()));
+            }
+            result.push_back(obj);
+        }
+    }
+    return result;
+}
+
+static const CRPCCommand commands[] =
+{ //  category              name                      actor (function)         okSafeMode
+  //  --------------------- ------------------------  -----------------------  ----------
+    { "zmq",                "getzmqnotifications",    &getzmqnotifications,    true,  {} },
+};
+
+void RegisterZMQRPCCommands(CRPCTable& t)
+{
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
+        t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+}
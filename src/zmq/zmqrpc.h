@@ -0,0 +1,13 @@
+// Copyright (c) 2019 The Gulden developers
+// Distributed under the GULDEN software license, see the accompanying
+// file COPYING
+
+#ifndef GULDEN_ZMQ_ZMQRPC_H
+#define GULDEN_ZMQ_ZMQRPC_H
+
+class CRPCTable;
+
+/** Register ZMQ RPC commands */
+void RegisterZMQRPCCommands(CRPCTable& tableRPC);
+
+#endif // GULDEN_ZMQ_ZMQRPC_H